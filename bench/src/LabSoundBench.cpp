@@ -0,0 +1,602 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+// LabSoundBench times the DSP kernels and whole graphs in isolation, so that performance changes can be
+// measured rather than judged by ear. Every benchmark processes deterministic input, is calibrated to run for
+// a fixed time budget, and reports the fastest of several runs, in nanoseconds per sample and as a multiple of
+// realtime at 44.1kHz.
+//
+// Usage: LabSoundBench [--filter text] [--seconds budget] [--hrtf path] [--replay log]
+//
+// --filter runs only the benchmarks whose name contains the text. --hrtf is the directory of the HRTF
+// database, which the HRTF benchmarks are skipped without; like the examples, run from the assets directory
+// to use the default. --replay renders a session recorded by a CommandRecorder, see CommandLog.h, instead of
+// the benchmarks, so that it can be timed and profiled as often as needed.
+
+#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
+    #define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "LabSound/LabSound.h"
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Biquad.h"
+#include "internal/Cone.h"
+#include "internal/DirectConvolver.h"
+#include "internal/Distance.h"
+#include "internal/DynamicsCompressorKernel.h"
+#include "internal/FFTConvolver.h"
+#include "internal/FFTFrame.h"
+#include "internal/HRTFDatabaseLoader.h"
+#include "internal/HRTFPanner.h"
+#include "internal/ReverbConvolver.h"
+#include "internal/SincResampler.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lab;
+
+namespace
+{
+    const float SampleRate = 44100.f;
+    const size_t Quantum = AudioNode::ProcessingSizeInFrames;
+
+    struct Options
+    {
+        std::string filter;
+        double seconds = 0.25;
+        std::string hrtfPath = "hrtf";
+        std::string replayPath;
+    };
+
+    Options g_options;
+
+    bool selected(const std::string & name)
+    {
+        return g_options.filter.empty() || name.find(g_options.filter) != std::string::npos;
+    }
+
+    void report(const std::string & name, double secondsPerCall, size_t samplesPerCall)
+    {
+        double nsPerSample = secondsPerCall * 1e9 / samplesPerCall;
+        double realtime = (samplesPerCall / SampleRate) / secondsPerCall;
+        std::printf("%-44s %12.3f ns/sample %12.1fx realtime\n", name.c_str(), nsPerSample, realtime);
+        std::fflush(stdout);
+    }
+
+    // Calls body, which processes samplesPerCall samples, often enough to fill a fifth of the time budget per
+    // run, and reports the fastest of five runs.
+    void run(const std::string & name, size_t samplesPerCall, const std::function<void()> & body)
+    {
+        if (!selected(name))
+            return;
+
+        using clock = std::chrono::steady_clock;
+        auto measure = [&](size_t calls) -> double
+        {
+            auto start = clock::now();
+            for (size_t i = 0; i < calls; ++i)
+                body();
+            return std::chrono::duration<double>(clock::now() - start).count();
+        };
+
+        const double runBudget = g_options.seconds / 5;
+        size_t calls = 1;
+        measure(1); // warm up caches and lazily initialized state
+        while (measure(calls) < runBudget && calls < (size_t(1) << 30))
+            calls *= 2;
+
+        double best = measure(calls);
+        for (int i = 1; i < 5; ++i)
+            best = std::min(best, measure(calls));
+
+        report(name, best / calls, samplesPerCall);
+    }
+
+    // A fixed seed linear congruential generator, so that every run processes the same signal.
+    void fillNoise(float * data, size_t length, uint32_t seed)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            data[i] = static_cast<float>(seed >> 8) * (2.f / 16777216.f) - 1.f;
+        }
+    }
+
+    // Decaying noise, standing in for a reverb impulse response.
+    void fillImpulse(float * data, size_t length, uint32_t seed)
+    {
+        fillNoise(data, length, seed);
+        for (size_t i = 0; i < length; ++i)
+            data[i] *= std::exp(-6.9f * static_cast<float>(i) / static_cast<float>(length));
+    }
+
+    std::shared_ptr<AudioBus> makeImpulseBus(size_t channels, float seconds)
+    {
+        size_t length = static_cast<size_t>(seconds * SampleRate);
+        auto bus = std::make_shared<AudioBus>(static_cast<int>(channels), length);
+        for (size_t c = 0; c < channels; ++c)
+            fillImpulse(bus->channel(static_cast<int>(c))->mutableData(), length, 7 + static_cast<uint32_t>(c));
+        return bus;
+    }
+
+    // An idle offline context, for the kernels that read the sample rate through the render lock.
+    std::unique_ptr<AudioContext> makeKernelContext()
+    {
+        std::unique_ptr<AudioContext> context(new AudioContext(true));
+        context->setDestinationNode(std::make_shared<OfflineAudioDestinationNode>(context.get(), SampleRate, 1.f, 2));
+        context->lazyInitialize();
+        return context;
+    }
+
+    void benchVectorMath()
+    {
+        using namespace VectorMath;
+
+        for (size_t frames : { Quantum, size_t(4096) })
+        {
+            AudioFloatArray a(frames), b(frames), c(frames), d(frames), e(frames), f(frames);
+            AudioFloatArray interleaved(2 * frames);
+            std::vector<uint16_t> halves(frames);
+            std::vector<int16_t> shorts(frames);
+            fillNoise(a.data(), frames, 1);
+            fillNoise(b.data(), frames, 2);
+            fillNoise(c.data(), frames, 3);
+            fillNoise(d.data(), frames, 4);
+
+            AudioFloatArray positive(frames), indices(frames), table(1024);
+            for (size_t i = 0; i < frames; ++i)
+            {
+                positive[i] = std::fabs(a[i]) + 1e-3f;
+                indices[i] = (b[i] + 1.f) * 511.5f;
+            }
+            fillNoise(table.data(), table.size(), 5);
+
+            const float scale = 0.5f;
+            const float low = -0.5f;
+            const float high = 0.5f;
+            const float start = 0.25f;
+            const float step = 1e-4f;
+            const float ratio = 0.9999f;
+            const float exponent = 1.5f;
+            const std::string suffix = "/" + std::to_string(frames);
+
+            run("VectorMath::vsma" + suffix, frames, [&] { vsma(a.data(), 1, &scale, e.data(), 1, frames); });
+            run("VectorMath::vsmul" + suffix, frames, [&] { vsmul(a.data(), 1, &scale, e.data(), 1, frames); });
+            run("VectorMath::vadd" + suffix, frames, [&] { vadd(a.data(), 1, b.data(), 1, e.data(), 1, frames); });
+            run("VectorMath::vmul" + suffix, frames, [&] { vmul(a.data(), 1, b.data(), 1, e.data(), 1, frames); });
+            run("VectorMath::zvmul" + suffix, frames, [&] { zvmul(a.data(), b.data(), c.data(), d.data(), e.data(), f.data(), frames); });
+            run("VectorMath::vsvesq" + suffix, frames, [&] { float sum; vsvesq(a.data(), 1, &sum, frames); });
+            run("VectorMath::vmaxmgv" + suffix, frames, [&] { float max; vmaxmgv(a.data(), 1, &max, frames); });
+            run("VectorMath::vclip" + suffix, frames, [&] { vclip(a.data(), 1, &low, &high, e.data(), 1, frames); });
+            run("VectorMath::vintlve" + suffix, frames, [&] { vintlve(a.data(), b.data(), interleaved.data(), 2 * frames); });
+            run("VectorMath::vdeintlve" + suffix, frames, [&] { vdeintlve(interleaved.data(), e.data(), f.data(), 2 * frames); });
+            run("VectorMath::vfill" + suffix, frames, [&] { vfill(&scale, e.data(), frames); });
+            run("VectorMath::vsadd" + suffix, frames, [&] { vsadd(a.data(), &scale, e.data(), frames); });
+            run("VectorMath::vramp" + suffix, frames, [&] { vramp(&start, &step, e.data(), frames); });
+            run("VectorMath::vexpramp" + suffix, frames, [&] { vexpramp(&start, &ratio, e.data(), frames); });
+            run("VectorMath::vexp" + suffix, frames, [&] { vexp(a.data(), e.data(), frames); });
+            run("VectorMath::vlog" + suffix, frames, [&] { vlog(positive.data(), e.data(), frames); });
+            run("VectorMath::vpow" + suffix, frames, [&] { vpow(positive.data(), &exponent, e.data(), frames); });
+            run("VectorMath::vlinearToDecibels" + suffix, frames, [&] { vlinearToDecibels(positive.data(), e.data(), frames); });
+            run("VectorMath::vdecibelsToLinear" + suffix, frames, [&] { vdecibelsToLinear(a.data(), e.data(), frames); });
+            run("VectorMath::vtanh" + suffix, frames, [&] { vtanh(a.data(), e.data(), frames); });
+            run("VectorMath::vlookup" + suffix, frames, [&] { vlookup(table.data(), table.size(), indices.data(), e.data(), frames); });
+            run("VectorMath::vfloatToHalf" + suffix, frames, [&] { vfloatToHalf(a.data(), halves.data(), frames); });
+            run("VectorMath::vhalfToFloat" + suffix, frames, [&] { vhalfToFloat(halves.data(), e.data(), frames); });
+            run("VectorMath::vpolar" + suffix, frames, [&] { vpolar(a.data(), b.data(), e.data(), f.data(), frames); });
+            run("VectorMath::vrect" + suffix, frames, [&] { vrect(positive.data(), a.data(), e.data(), f.data(), frames); });
+            run("VectorMath::vdequantize16" + suffix, frames, [&] { vdequantize16(shorts.data(), e.data(), frames); });
+            run("VectorMath::vdotpr2" + suffix, frames, [&] { float dot1, dot2; vdotpr2(a.data(), b.data(), c.data(), &dot1, &dot2, frames); });
+        }
+    }
+
+    void benchAudioBus()
+    {
+        for (size_t channels : { size_t(2), size_t(16), size_t(64) })
+        {
+            AudioBus source(channels, Quantum), destination(channels, Quantum);
+            for (size_t c = 0; c < channels; ++c)
+            {
+                fillNoise(source.channel(c)->mutableData(), Quantum, 41 + static_cast<uint32_t>(c));
+                fillNoise(destination.channel(c)->mutableData(), Quantum, 97 + static_cast<uint32_t>(c));
+            }
+            const std::string suffix = "/" + std::to_string(channels);
+
+            run("AudioBus::copyFrom" + suffix, Quantum * channels, [&] { destination.copyFrom(source); });
+            run("AudioBus::sumFrom" + suffix, Quantum * channels, [&] { destination.sumFrom(source); });
+            run("AudioBus::scale" + suffix, Quantum * channels, [&] { destination.scale(1.f); });
+        }
+    }
+
+    void benchFFT()
+    {
+        for (size_t fftSize = 256; fftSize <= 32768; fftSize *= 2)
+        {
+            FFTFrame frame(fftSize);
+            AudioFloatArray data(fftSize);
+            fillNoise(data.data(), fftSize, 11);
+            const std::string suffix = "/" + std::to_string(fftSize);
+
+            run("FFTFrame::doFFT" + suffix, fftSize, [&] { frame.doFFT(data.data()); });
+            frame.doFFT(data.data());
+            run("FFTFrame::doInverseFFT" + suffix, fftSize, [&] { frame.doInverseFFT(data.data()); });
+        }
+    }
+
+    void benchDirectConvolver()
+    {
+        for (size_t kernelSize : { size_t(16), size_t(64), Quantum })
+        {
+            AudioFloatArray kernel(kernelSize);
+            fillImpulse(kernel.data(), kernelSize, 29);
+
+            DirectConvolver convolver(Quantum);
+            AudioFloatArray source(Quantum), destination(Quantum);
+            fillNoise(source.data(), Quantum, 31);
+
+            run("DirectConvolver/" + std::to_string(kernelSize), Quantum, [&] {
+                convolver.process(&kernel, source.data(), destination.data(), Quantum);
+            });
+        }
+    }
+
+    void benchFFTConvolver()
+    {
+        for (size_t fftSize : { size_t(256), size_t(1024), size_t(4096) })
+        {
+            AudioFloatArray impulse(fftSize / 2);
+            fillImpulse(impulse.data(), impulse.size(), 13);
+            FFTFrame kernel(fftSize);
+            kernel.doPaddedFFT(impulse.data(), impulse.size());
+
+            FFTConvolver convolver(fftSize);
+            AudioFloatArray source(Quantum), destination(Quantum);
+            fillNoise(source.data(), Quantum, 17);
+
+            run("FFTConvolver/" + std::to_string(fftSize), Quantum, [&] {
+                convolver.process(&kernel, source.data(), destination.data(), Quantum);
+            });
+        }
+    }
+
+    void benchReverbConvolver(AudioContext * context)
+    {
+        // Without background threads, every stage is processed on the calling thread and so is measured here.
+        for (int seconds : { 1, 5, 10 })
+        {
+            const std::string name = "ReverbConvolver/" + std::to_string(seconds) + "s";
+            if (!selected(name))
+                continue;
+
+            size_t length = static_cast<size_t>(seconds * SampleRate);
+            auto impulse = std::make_shared<AudioBus>(1, length);
+            fillImpulse(impulse->channel(0)->mutableData(), length, 19);
+            auto prepared = std::make_shared<PreparedImpulse>(impulse, 32768, false, false);
+            prepared->waitUntilPrepared();
+            ReverbConvolver convolver(prepared, 0, Quantum, 0);
+
+            AudioChannel source(Quantum), destination(Quantum);
+            fillNoise(source.mutableData(), Quantum, 23);
+
+            run(name, Quantum, [&] {
+                ContextRenderLock r(context, "LabSoundBench");
+                convolver.process(r, &source, &destination, Quantum);
+            });
+        }
+    }
+
+    // The algorithmic alternative to the convolvers above. Unconnected, the node rings out, which costs the same
+    // as a driven network.
+    void benchFDNReverbNode(AudioContext * context)
+    {
+        for (uint32_t lines : { 8u, 16u })
+        {
+            FDNReverbNode reverb(SampleRate);
+            reverb.setLines(lines);
+            run("FDNReverbNode/" + std::to_string(lines) + "-lines", Quantum, [&] {
+                ContextRenderLock r(context, "LabSoundBench");
+                reverb.process(r, Quantum);
+            });
+        }
+    }
+
+    // Unconnected, the node shifts silence, which costs the same as a signal.
+    void benchPitchShiftNode(AudioContext * context)
+    {
+        for (PitchShiftNode::Quality quality : { PitchShiftNode::Quality::Realtime, PitchShiftNode::Quality::HighQuality })
+        {
+            PitchShiftNode shifter(quality);
+            shifter.pitch()->setValue(7.f);
+            const char * name = quality == PitchShiftNode::Quality::Realtime ? "realtime" : "high-quality";
+            run(std::string("PitchShiftNode/") + name, Quantum, [&] {
+                ContextRenderLock r(context, "LabSoundBench");
+                shifter.process(r, Quantum);
+            });
+        }
+    }
+
+    // The saturation run on every voice. Unconnected, the node shapes silence, which costs the same as a signal.
+    void benchClipNode(AudioContext * context)
+    {
+        for (ClipNode::Mode mode : { ClipNode::CLIP, ClipNode::TANH })
+        {
+            ClipNode clip;
+            clip.setMode(mode);
+            run(mode == ClipNode::CLIP ? "ClipNode/clip" : "ClipNode/tanh", Quantum, [&] {
+                ContextRenderLock r(context, "LabSoundBench");
+                clip.process(r, Quantum);
+            });
+        }
+    }
+
+    std::shared_ptr<HRTFDatabaseLoader> loadHRTFDatabase()
+    {
+        auto loader = HRTFDatabaseLoader::loaderFor(SampleRate, g_options.hrtfPath);
+        loader->waitForLoaderThreadCompletion();
+        if (!loader->database())
+        {
+            std::printf("%-44s skipped, no HRTF database at \"%s\"\n", "HRTF", g_options.hrtfPath.c_str());
+            return nullptr;
+        }
+        return loader;
+    }
+
+    // The distance and cone gains of 500 emitters, as the spatial batch evaluates them every quantum.
+    void benchAttenuation()
+    {
+        const size_t emitters = 500;
+        AudioFloatArray distances(emitters), cosines(emitters), gains(emitters);
+        fillNoise(distances.data(), emitters, 11);
+        fillNoise(cosines.data(), emitters, 12);
+        for (size_t i = 0; i < emitters; ++i)
+            distances[i] = 1.f + 50.f * std::fabs(distances[i]);
+
+        DistanceEffect distance;
+        distance.setModel(DistanceEffect::ModelExponential, true);
+        distance.setRolloffFactor(1.5);
+        run("DistanceEffect exponential/500", emitters, [&] {
+            for (size_t i = 0; i < emitters; ++i)
+                gains[i] = distance.tableGain(distances[i]);
+        });
+
+        ConeEffect cone;
+        cone.setInnerAngle(60);
+        cone.setOuterAngle(240);
+        cone.setOuterGain(0.25);
+        run("ConeEffect/500", emitters, [&] {
+            for (size_t i = 0; i < emitters; ++i)
+                gains[i] = static_cast<float>(cone.gain(cosines[i]));
+        });
+    }
+
+    void benchHRTFPanner(AudioContext * context, const std::shared_ptr<HRTFDatabaseLoader> & loader)
+    {
+        if (!loader || !selected("HRTFPanner"))
+            return;
+
+        HRTFPanner panner(SampleRate, loader);
+        AudioBus input(1, Quantum), output(2, Quantum);
+        fillNoise(input.channel(0)->mutableData(), Quantum, 29);
+
+        // The azimuth moves every quantum, so that the crossfades between convolver sets are included.
+        double azimuth = 0;
+        run("HRTFPanner", Quantum, [&] {
+            ContextRenderLock r(context, "LabSoundBench");
+            panner.pan(r, azimuth, 0, &input, &output, Quantum);
+            azimuth = azimuth < 170 ? azimuth + 1 : -170;
+        });
+    }
+
+    void benchSincResampler()
+    {
+        const size_t sourceFrames = 4096;
+        AudioFloatArray source(sourceFrames), destination(2 * sourceFrames);
+        fillNoise(source.data(), sourceFrames, 31);
+
+        for (double scaleFactor : { 44100.0 / 48000.0, 48000.0 / 44100.0, 2.0 })
+        {
+            SincResampler resampler(scaleFactor);
+            char name[64];
+            std::snprintf(name, sizeof(name), "SincResampler/%.4f", scaleFactor);
+            run(name, static_cast<size_t>(sourceFrames / scaleFactor), [&] {
+                resampler.process(source.data(), destination.data(), sourceFrames);
+            });
+        }
+    }
+
+    void benchBiquad()
+    {
+        Biquad biquad;
+        biquad.setLowpassParams(0.1, 5);
+        AudioFloatArray source(Quantum), destination(Quantum);
+        fillNoise(source.data(), Quantum, 37);
+        run("Biquad/lowpass", Quantum, [&] { biquad.process(source.data(), destination.data(), Quantum); });
+    }
+
+    void benchDynamicsCompressorKernel(AudioContext * context)
+    {
+        DynamicsCompressorKernel kernel(2);
+        AudioFloatArray left(Quantum), right(Quantum), outLeft(Quantum), outRight(Quantum);
+        fillNoise(left.data(), Quantum, 41);
+        fillNoise(right.data(), Quantum, 43);
+        const float * sources[2] = { left.data(), right.data() };
+        float * destinations[2] = { outLeft.data(), outRight.data() };
+
+        // The defaults of DynamicsCompressor.
+        run("DynamicsCompressorKernel/stereo", Quantum, [&] {
+            ContextRenderLock r(context, "LabSoundBench");
+            kernel.process(r, sources, destinations, 2, Quantum,
+                           -24.f, 30.f, 12.f, 0.003f, 0.250f, 0.006f, 0.f, 1.f,
+                           0.09f, 0.16f, 0.42f, 0.98f);
+        });
+    }
+
+    // Renders voices oscillators, each through its own panner, into a shared convolution reverb mixed with
+    // the dry signal, with an OfflineAudioDestinationNode. The per sample figures are per output frame.
+    // Ambisonic panners are heard through the listener's decoder rather than their outputs, so bypass the reverb.
+    void benchScene(int voices, PanningMode panningMode)
+    {
+        const bool usesHRTF = panningMode == PanningMode::HRTF || panningMode == PanningMode::AMBISONIC;
+        const char * mode = panningMode == PanningMode::HRTF ? "hrtf" : panningMode == PanningMode::AMBISONIC ? "ambisonic" : "equalpower";
+        const std::string name = "scene/" + std::to_string(voices) + "-voices-" + mode + "-reverb";
+        if (!selected(name))
+            return;
+
+        const float lengthSeconds = 5.f;
+
+        std::unique_ptr<AudioContext> context(new AudioContext(true));
+        context->setDestinationNode(std::make_shared<OfflineAudioDestinationNode>(context.get(), SampleRate, lengthSeconds, 2));
+        context->lazyInitialize();
+
+        std::vector<std::shared_ptr<AudioNode>> nodes;
+        auto dry = std::make_shared<GainNode>();
+        auto wet = std::make_shared<GainNode>();
+        auto reverb = std::make_shared<ConvolverNode>();
+        reverb->setImpulse(makeImpulseBus(2, 2.f));
+        reverb->waitForImpulse();
+        wet->gain()->setValue(0.3f);
+        dry->gain()->setValue(1.f / voices);
+
+        for (int i = 0; i < voices; ++i)
+        {
+            auto oscillator = std::make_shared<OscillatorNode>(SampleRate);
+            oscillator->frequency()->setValue(110.f + 13.f * i);
+            oscillator->setType(i % 2 ? OscillatorType::SAWTOOTH : OscillatorType::SINE);
+            oscillator->start(0);
+
+            auto panner = std::make_shared<PannerNode>(SampleRate, usesHRTF ? g_options.hrtfPath : std::string());
+            panner->setPanningModel(panningMode);
+            float angle = 6.2831853f * i / voices;
+            panner->setPosition(std::cos(angle), 0, std::sin(angle));
+
+            context->connect(panner, oscillator);
+            context->connect(dry, panner);
+            nodes.push_back(oscillator);
+            nodes.push_back(panner);
+        }
+        context->connect(reverb, dry);
+        context->connect(wet, reverb);
+        context->connect(context->destination(), dry);
+        context->connect(context->destination(), wet);
+
+        // Connections are applied by the context's update thread.
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        auto start = std::chrono::steady_clock::now();
+        context->startRendering();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        report(name, elapsed, static_cast<size_t>(lengthSeconds * SampleRate));
+    }
+
+    // Renders a recorded session as often as the time budget allows, and reports the fastest render, per output
+    // frame, and the commands that couldn't be replayed.
+    void benchReplay(const std::string & path)
+    {
+        CommandReplayer replayer = CommandReplayer::load(path);
+        const std::string name = "replay/" + path;
+        const size_t frames = static_cast<size_t>(std::max<uint64_t>(replayer.length(), 1));
+
+        double best = 0;
+        double total = 0;
+        size_t skipped = 0;
+        for (int i = 0; i < 5 && (i == 0 || total < g_options.seconds); ++i)
+        {
+            std::unique_ptr<AudioContext> context(new AudioContext(true, true, replayer.renderQuantumSize()));
+            context->setDestinationNode(std::make_shared<OfflineAudioDestinationNode>(context.get(), replayer.sampleRate(), 0.f, replayer.channels()));
+            context->lazyInitialize();
+
+            auto start = std::chrono::steady_clock::now();
+            skipped = replayer.replay(*context);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = i ? std::min(best, elapsed) : elapsed;
+            total += elapsed;
+        }
+
+        double nsPerSample = best * 1e9 / frames;
+        double realtime = (frames / replayer.sampleRate()) / best;
+        std::printf("%-44s %12.3f ns/sample %12.1fx realtime, %zu commands, %zu skipped\n",
+                    name.c_str(), nsPerSample, realtime, replayer.commandCount(), skipped);
+        std::fflush(stdout);
+    }
+
+    void parseOptions(int argc, char ** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc)
+                g_options.filter = argv[++i];
+            else if (arg == "--seconds" && i + 1 < argc)
+                g_options.seconds = std::max(0.01, std::atof(argv[++i]));
+            else if (arg == "--hrtf" && i + 1 < argc)
+                g_options.hrtfPath = argv[++i];
+            else if (arg == "--replay" && i + 1 < argc)
+                g_options.replayPath = argv[++i];
+            else
+                throw std::invalid_argument("unknown argument " + arg + "; usage: LabSoundBench [--filter text] [--seconds budget] [--hrtf path] [--replay log]");
+        }
+    }
+}
+
+int main(int argc, char ** argv) try
+{
+    parseOptions(argc, argv);
+
+    if (!g_options.replayPath.empty())
+    {
+        benchReplay(g_options.replayPath);
+        return 0;
+    }
+
+    std::unique_ptr<AudioContext> context = makeKernelContext();
+    // Held for the whole run, so that the scenes' panners share the loaded database.
+    std::shared_ptr<HRTFDatabaseLoader> hrtfLoader = loadHRTFDatabase();
+
+    benchVectorMath();
+    benchAudioBus();
+    benchFFT();
+    benchDirectConvolver();
+    benchFFTConvolver();
+    benchReverbConvolver(context.get());
+    benchFDNReverbNode(context.get());
+    benchPitchShiftNode(context.get());
+    benchClipNode(context.get());
+    benchAttenuation();
+    benchHRTFPanner(context.get(), hrtfLoader);
+    benchSincResampler();
+    benchBiquad();
+    benchDynamicsCompressorKernel(context.get());
+
+    for (int voices : { 8, 32, 128 })
+    {
+        benchScene(voices, PanningMode::EQUALPOWER);
+        if (hrtfLoader)
+        {
+            benchScene(voices, PanningMode::HRTF);
+            benchScene(voices, PanningMode::AMBISONIC);
+        }
+    }
+
+    return 0;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "LabSoundBench: " << e.what() << std::endl;
+    return 1;
+}
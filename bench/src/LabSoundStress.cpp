@@ -0,0 +1,537 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+// LabSoundStress renders the graphs of the examples headlessly, with an OfflineAudioDestinationNode, at growing
+// sizes, so that their cost can be tracked from build to build. Each scene is built scale times over, its voices,
+// panners or convolvers side by side, and each render reports its multiple of realtime, the median, 99th
+// percentile and longest render quantum, the graph's memory by AudioContext::memoryReport() and the process's
+// peak resident memory so far. The scenes play synthesized material in place of the examples' files, so that the
+// results don't depend on the assets.
+//
+// Usage: LabSoundStress [--filter text] [--scales 1,4,16] [--seconds length] [--hrtf path] [--json file]
+//
+// --filter runs only the scenes whose name contains the text. --seconds is the length of audio each render
+// produces. --hrtf is the directory of the HRTF database; without it the spatialization scene pans equal power.
+// --json also writes the results to the file, for comparison with earlier runs.
+
+#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
+    #define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "LabSound/LabSound.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/HRTFDatabaseLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+using namespace lab;
+
+namespace
+{
+    const float SampleRate = 44100.f;
+    const size_t Quantum = AudioNode::ProcessingSizeInFrames;
+
+    struct Options
+    {
+        std::string filter;
+        std::vector<int> scales = { 1, 4, 16 };
+        float seconds = 5.f;
+        std::string hrtfPath = "hrtf";
+        std::string jsonPath;
+    };
+
+    Options g_options;
+
+    struct Result
+    {
+        std::string scene;
+        int scale = 0;
+        size_t nodes = 0;
+        double renderSeconds = 0;
+        double realtime = 0;
+        double p50Seconds = 0;
+        double p99Seconds = 0;
+        double maxSeconds = 0;
+        size_t graphBytes = 0;
+        size_t peakResidentBytes = 0;
+    };
+
+    // The peak resident memory of the process so far, or 0 where it can't be had.
+    size_t peakResidentBytes()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage))
+            return 0;
+    #if defined(__APPLE__)
+        return static_cast<size_t>(usage.ru_maxrss);
+    #else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+    #endif
+#endif
+    }
+
+    // A fixed seed linear congruential generator, so that every run renders the same signal.
+    struct Noise
+    {
+        uint32_t seed;
+        float operator()()
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) * (2.f / 16777216.f) - 1.f;
+        }
+    };
+
+    // Decaying noise, standing in for the examples' impulse response.
+    std::shared_ptr<AudioBus> makeImpulseBus(float seconds)
+    {
+        const size_t length = static_cast<size_t>(seconds * SampleRate);
+        auto bus = std::make_shared<AudioBus>(2, length);
+        for (int c = 0; c < 2; ++c)
+        {
+            Noise noise{ 7u + static_cast<uint32_t>(c) };
+            float * data = bus->channel(c)->mutableData();
+            for (size_t i = 0; i < length; ++i)
+                data[i] = noise() * std::exp(-6.9f * static_cast<float>(i) / static_cast<float>(length));
+        }
+        return bus;
+    }
+
+    // Syllables of lowpassed noise and a buzzing fundamental, standing in for the examples' voice and train.
+    std::shared_ptr<AudioBus> makeClipBus(float seconds, uint32_t seed)
+    {
+        const size_t length = static_cast<size_t>(seconds * SampleRate);
+        auto bus = std::make_shared<AudioBus>(1, length);
+        float * data = bus->channel(0)->mutableData();
+        Noise noise{ seed };
+        float lowpassed = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            const float t = static_cast<float>(i) / SampleRate;
+            const float syllable = std::max(0.f, std::sin(6.2831853f * 3.f * t));
+            lowpassed += (noise() - lowpassed) * 0.1f;
+            data[i] = syllable * (0.5f * lowpassed + 0.3f * std::sin(6.2831853f * 140.f * t));
+        }
+        return bus;
+    }
+
+    // The Moog style lowpass of the Groove example.
+    struct MoogFilter
+    {
+        float y1 = 0, y2 = 0, y3 = 0, y4 = 0;
+        float oldx = 0, oldy1 = 0, oldy2 = 0, oldy3 = 0;
+
+        float process(float cutoff, float resonance, float sample)
+        {
+            cutoff = 2.f * cutoff / SampleRate;
+            const float p = cutoff * (1.8f - 0.8f * cutoff);
+            const float k = 2.f * std::sin(cutoff * 3.14159265f * 0.5f) - 1.f;
+            const float t1 = (1.f - p) * 1.386249f;
+            const float t2 = 12.f + t1 * t1;
+            const float r = resonance * (t2 + 6.f * t1) / (t2 - 6.f * t1);
+            const float x = sample - r * y4;
+            y1 = x * p + oldx * p - k * y1;
+            y2 = y1 * p + oldy1 * p - k * y2;
+            y3 = y2 * p + oldy2 * p - k * y3;
+            y4 = y3 * p + oldy3 * p - k * y4;
+            y4 -= (y4 * y4 * y4) / 6.f;
+            oldx = x;
+            oldy1 = y1;
+            oldy2 = y2;
+            oldy3 = y3;
+            return y4;
+        }
+    };
+
+    // Each scene adds scale copies of its example's graph to the context, feeding into mix, and keeps its nodes.
+    using Scene = void (*)(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes);
+
+    // Groove: a FunctionNode synthesizing a bassline and kick through Moog filters, under an ADSR, per voice.
+    void buildGroove(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes)
+    {
+        static const int bassline[8] = { 7, 7, 7, 12, 10, 10, 10, 15 };
+
+        for (int v = 0; v < scale; ++v)
+        {
+            auto filters = std::make_shared<std::vector<MoogFilter>>(4);
+            const float detune = 1.f + 0.003f * v;
+
+            auto groove = std::make_shared<FunctionNode>(2);
+            groove->setFunction([filters, detune](ContextRenderLock & r, FunctionNode * self, int channel, float * samples, size_t frames)
+            {
+                const float dt = 1.f / r.context()->sampleRate();
+                float now = static_cast<float>(self->now());
+                const float bass = std::pow(2.f, (bassline[int(now * 4.f) % 8] - 33.f) / 12.f) * 440.f * detune;
+                MoogFilter & bassFilter = (*filters)[channel];
+                MoogFilter & kickFilter = (*filters)[2 + channel];
+                for (size_t i = 0; i < frames; ++i)
+                {
+                    const float saw = 1.f - 2.f * std::fmod(now, 1.f / bass) * bass;
+                    const float square = std::sin(6.2831853f * now * bass * 0.5f) > 0 ? 1.f : -1.f;
+                    const float envelope = std::max(0.f, 0.889f - std::fmod(now, 0.125f) * 48.f / (std::fmod(now, 0.125f) * 48.f + 1.f));
+                    const float bassSample = bassFilter.process(1000.f + 140.f * std::sin(6.2831853f * now / 32.f), 0.2f, (saw * 1.9f + square) * envelope / 3.f);
+                    const float kick = kickFilter.process(240.f, 0.1f, std::sin(6.2831853f * 55.f * now) * std::max(0.f, 1.f - std::fmod(now, 0.5f) * 8.f));
+                    samples[i] = 0.66f * bassSample + 2.f * kick;
+                    now += dt;
+                }
+            });
+            groove->start(0);
+
+            auto envelope = std::make_shared<ADSRNode>();
+            envelope->set(0.01f, 0.5f, 14.f, 0.f, 1.f);
+            envelope->noteOn(0.0);
+
+            context.connect(envelope, groove);
+            context.connect(mix, envelope);
+            nodes.push_back(groove);
+            nodes.push_back(envelope);
+        }
+    }
+
+    // InfiniteFM: a square modulator driving an oscillator's frequency, through an ADSR into a feedback delay.
+    void buildInfiniteFM(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes)
+    {
+        for (int v = 0; v < scale; ++v)
+        {
+            auto modulator = std::make_shared<OscillatorNode>(SampleRate);
+            modulator->setType(OscillatorType::SQUARE);
+            modulator->frequency()->setValue(4.f + 7.f * v);
+            modulator->start(0);
+
+            auto modulatorGain = std::make_shared<GainNode>();
+            modulatorGain->gain()->setValue(16.f + 31.f * v);
+
+            auto oscillator = std::make_shared<OscillatorNode>(SampleRate);
+            oscillator->setType(OscillatorType::SQUARE);
+            oscillator->frequency()->setValue(80.f + 11.f * v);
+            oscillator->start(0);
+
+            auto trigger = std::make_shared<ADSRNode>();
+            trigger->set(0.25f, 0.5f, 0.5f, 0.f, 0.f);
+            trigger->noteOn(0.0);
+
+            auto signalGain = std::make_shared<GainNode>();
+            auto feedbackTap = std::make_shared<GainNode>();
+            feedbackTap->gain()->setValue(0.5f);
+            auto chainDelay = std::make_shared<DelayNode>(SampleRate, 4.f);
+            chainDelay->delayTime()->setValue(0.1f);
+
+            context.connect(modulatorGain, modulator);
+            context.connectParam(oscillator->frequency(), modulatorGain, 0);
+            context.connect(trigger, oscillator);
+            context.connect(signalGain, trigger);
+            context.connect(feedbackTap, signalGain);
+            context.connect(chainDelay, feedbackTap);
+            context.connect(signalGain, chainDelay);
+            context.connect(mix, signalGain);
+
+            for (std::shared_ptr<AudioNode> node : std::initializer_list<std::shared_ptr<AudioNode>>{ modulator, modulatorGain, oscillator, trigger, signalGain, feedbackTap, chainDelay })
+                nodes.push_back(node);
+        }
+    }
+
+    // Spatialization: a looping clip per panner, the panners spread around the listener. HRTF panning if the
+    // database loaded, and equal power otherwise.
+    void buildSpatialization(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes)
+    {
+        std::shared_ptr<HRTFDatabaseLoader> loader = HRTFDatabaseLoader::loaderFor(SampleRate, g_options.hrtfPath);
+        loader->waitForLoaderThreadCompletion();
+        const bool hrtf = loader->database() != nullptr;
+
+        std::shared_ptr<AudioBus> clip = makeClipBus(2.f, 17);
+        ContextRenderLock r(&context, "LabSoundStress");
+        for (int v = 0; v < scale; ++v)
+        {
+            auto source = std::make_shared<SampledAudioNode>();
+            source->setBus(r, clip);
+            source->setLoop(true);
+            source->start(0.0f);
+
+            auto panner = std::make_shared<PannerNode>(SampleRate, hrtf ? g_options.hrtfPath : std::string());
+            panner->setPanningModel(hrtf ? PanningMode::HRTF : PanningMode::EQUALPOWER);
+            const float angle = 6.2831853f * v / scale;
+            panner->setPosition({ std::cos(angle), 0.1f, std::sin(angle) });
+
+            context.connect(panner, source);
+            context.connect(mix, panner);
+            nodes.push_back(source);
+            nodes.push_back(panner);
+        }
+    }
+
+    // ConvolutionReverb: a clip through a dry gain, into a convolver with a two second impulse, per voice.
+    void buildConvolutionReverb(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes)
+    {
+        std::shared_ptr<AudioBus> impulse = makeImpulseBus(2.f);
+        std::shared_ptr<AudioBus> clip = makeClipBus(3.f, 23);
+        ContextRenderLock r(&context, "LabSoundStress");
+        for (int v = 0; v < scale; ++v)
+        {
+            auto convolver = std::make_shared<ConvolverNode>();
+            convolver->setImpulse(impulse);
+            convolver->waitForImpulse();
+
+            auto wetGain = std::make_shared<GainNode>();
+            wetGain->gain()->setValue(1.15f);
+            auto dryGain = std::make_shared<GainNode>();
+            dryGain->gain()->setValue(0.75f);
+
+            auto voice = std::make_shared<SampledAudioNode>();
+            voice->setBus(r, clip);
+            voice->setLoop(true);
+            voice->start(0.0f);
+
+            context.connect(dryGain, voice);
+            context.connect(convolver, dryGain);
+            context.connect(wetGain, convolver);
+            context.connect(mix, wetGain);
+            context.connect(mix, dryGain);
+
+            for (std::shared_ptr<AudioNode> node : std::initializer_list<std::shared_ptr<AudioNode>>{ convolver, wetGain, dryGain, voice })
+                nodes.push_back(node);
+        }
+    }
+
+    // RedAlert: a swept sawtooth and its resonator, through five delays and four resonant bandpasses.
+    void buildRedAlert(AudioContext & context, int scale, std::shared_ptr<GainNode> mix, std::vector<std::shared_ptr<AudioNode>> & nodes)
+    {
+        for (int v = 0; v < scale; ++v)
+        {
+            auto sweep = std::make_shared<FunctionNode>(1);
+            const float offset = 0.05f * v;
+            sweep->setFunction([offset](ContextRenderLock & r, FunctionNode * self, int, float * values, size_t frames)
+            {
+                const double dt = 1.0 / r.context()->sampleRate();
+                double now = std::fmod(self->now() + offset, 1.2);
+                for (size_t i = 0; i < frames; ++i, now += dt)
+                    values[i] = now > 0.9 ? 487.f + 360.f : std::sqrt(static_cast<float>(now) / 0.9f) * 487.f + 360.f;
+            });
+            sweep->start(0);
+
+            auto oscillator = std::make_shared<OscillatorNode>(SampleRate);
+            oscillator->setType(OscillatorType::SAWTOOTH);
+            oscillator->frequency()->setValue(220);
+            oscillator->start(0);
+            auto oscillatorGain = std::make_shared<GainNode>();
+            oscillatorGain->gain()->setValue(0.5f);
+
+            auto resonator = std::make_shared<OscillatorNode>(SampleRate);
+            resonator->setType(OscillatorType::SINE);
+            resonator->frequency()->setValue(220);
+            resonator->start(0);
+            auto resonatorGain = std::make_shared<GainNode>();
+            resonatorGain->gain()->setValue(0.f);
+
+            auto resonanceSum = std::make_shared<GainNode>();
+            resonanceSum->gain()->setValue(0.5f);
+            auto delaySum = std::make_shared<GainNode>();
+            delaySum->gain()->setValue(0.2f);
+            auto filterSum = std::make_shared<GainNode>();
+            filterSum->gain()->setValue(0.2f);
+
+            context.connectParam(oscillator->frequency(), sweep, 0);
+            context.connectParam(resonator->frequency(), oscillator, 0);
+            context.connect(oscillatorGain, oscillator);
+            context.connect(resonanceSum, oscillatorGain);
+            context.connect(resonatorGain, resonator);
+            context.connect(resonanceSum, resonatorGain);
+
+            for (std::shared_ptr<AudioNode> node : std::initializer_list<std::shared_ptr<AudioNode>>{ sweep, oscillator, oscillatorGain, resonator, resonatorGain, resonanceSum, delaySum, filterSum })
+                nodes.push_back(node);
+
+            const float delays[5] = { 0.015f, 0.022f, 0.035f, 0.024f, 0.011f };
+            for (float time : delays)
+            {
+                auto delay = std::make_shared<DelayNode>(SampleRate, 0.04f);
+                delay->delayTime()->setValue(time);
+                context.connect(delay, resonanceSum);
+                context.connect(delaySum, delay);
+                nodes.push_back(delay);
+            }
+
+            context.connect(filterSum, delaySum);
+            const float centerFrequencies[4] = { 740.f, 1400.f, 1500.f, 1600.f };
+            for (float frequency : centerFrequencies)
+            {
+                auto filter = std::make_shared<BiquadFilterNode>();
+                filter->frequency()->setValue(frequency);
+                filter->q()->setValue(12.f);
+                context.connect(filter, delaySum);
+                context.connect(filterSum, filter);
+                nodes.push_back(filter);
+            }
+
+            context.connect(mix, filterSum);
+        }
+    }
+
+    double percentile(const std::vector<double> & sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0;
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+    }
+
+    // Renders a scene at a scale, timing each render quantum from the stop condition, which the offline
+    // destination asks after every quantum.
+    Result stress(const std::string & name, Scene build, int scale)
+    {
+        std::unique_ptr<AudioContext> context(new AudioContext(true));
+        auto destination = std::make_shared<OfflineAudioDestinationNode>(context.get(), SampleRate, g_options.seconds, 2);
+        context->setDestinationNode(destination);
+        context->lazyInitialize();
+
+        auto mix = std::make_shared<GainNode>();
+        mix->gain()->setValue(1.f / scale);
+        std::vector<std::shared_ptr<AudioNode>> nodes;
+        build(*context, scale, mix, nodes);
+        context->connect(context->destination(), mix);
+
+        using clock = std::chrono::steady_clock;
+        std::vector<double> quanta;
+        quanta.reserve(static_cast<size_t>(g_options.seconds * SampleRate / Quantum) + 2);
+        clock::time_point last;
+        destination->setStopCondition([&quanta, &last](ContextRenderLock &, uint64_t)
+        {
+            const clock::time_point now = clock::now();
+            quanta.push_back(std::chrono::duration<double>(now - last).count());
+            last = now;
+            return false;
+        });
+
+        last = clock::now();
+        const clock::time_point start = last;
+        context->startRendering();
+        const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+        const AudioMemoryReport memory = context->memoryReport();
+        std::sort(quanta.begin(), quanta.end());
+
+        Result result;
+        result.scene = name;
+        result.scale = scale;
+        result.nodes = memory.nodes.size();
+        result.renderSeconds = elapsed;
+        result.realtime = elapsed > 0 ? destination->framesRendered() / SampleRate / elapsed : 0;
+        result.p50Seconds = percentile(quanta, 0.5);
+        result.p99Seconds = percentile(quanta, 0.99);
+        result.maxSeconds = quanta.empty() ? 0 : quanta.back();
+        result.graphBytes = memory.total();
+        result.peakResidentBytes = peakResidentBytes();
+
+        std::printf("%-22s x%-4d %5zu nodes %10.1fx realtime  quantum p50 %8.1f us  p99 %8.1f us  max %8.1f us  graph %8.2f MB  peak %8.2f MB\n",
+                    name.c_str(), scale, result.nodes, result.realtime,
+                    result.p50Seconds * 1e6, result.p99Seconds * 1e6, result.maxSeconds * 1e6,
+                    result.graphBytes / 1048576.0, result.peakResidentBytes / 1048576.0);
+        std::fflush(stdout);
+        return result;
+    }
+
+    void writeJson(const std::string & path, const std::vector<Result> & results)
+    {
+        std::ofstream out(path);
+        if (!out)
+            throw std::runtime_error("can't write " + path);
+
+        out << "{\"sampleRate\":" << SampleRate << ",\"quantum\":" << Quantum << ",\"seconds\":" << g_options.seconds << ",\"results\":[";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result & result = results[i];
+            out << (i ? ",\n" : "\n");
+            out << "{\"scene\":\"" << result.scene << "\",\"scale\":" << result.scale << ",\"nodes\":" << result.nodes
+                << ",\"renderSeconds\":" << result.renderSeconds << ",\"realtime\":" << result.realtime
+                << ",\"quantumP50Seconds\":" << result.p50Seconds << ",\"quantumP99Seconds\":" << result.p99Seconds
+                << ",\"quantumMaxSeconds\":" << result.maxSeconds << ",\"graphBytes\":" << result.graphBytes
+                << ",\"peakResidentBytes\":" << result.peakResidentBytes << "}";
+        }
+        out << "\n]}\n";
+    }
+
+    std::vector<int> parseScales(const std::string & list)
+    {
+        std::vector<int> scales;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+            if (int scale = std::atoi(item.c_str()))
+                scales.push_back(std::max(scale, 1));
+        if (scales.empty())
+            throw std::invalid_argument("no scales in " + list);
+        return scales;
+    }
+
+    void parseOptions(int argc, char ** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc)
+                g_options.filter = argv[++i];
+            else if (arg == "--scales" && i + 1 < argc)
+                g_options.scales = parseScales(argv[++i]);
+            else if (arg == "--seconds" && i + 1 < argc)
+                g_options.seconds = std::max(0.1f, static_cast<float>(std::atof(argv[++i])));
+            else if (arg == "--hrtf" && i + 1 < argc)
+                g_options.hrtfPath = argv[++i];
+            else if (arg == "--json" && i + 1 < argc)
+                g_options.jsonPath = argv[++i];
+            else
+                throw std::invalid_argument("unknown argument " + arg + "; usage: LabSoundStress [--filter text] [--scales 1,4,16] [--seconds length] [--hrtf path] [--json file]");
+        }
+    }
+}
+
+int main(int argc, char ** argv) try
+{
+    parseOptions(argc, argv);
+
+    const std::pair<const char *, Scene> scenes[] = {
+        { "Groove", buildGroove },
+        { "InfiniteFM", buildInfiniteFM },
+        { "Spatialization", buildSpatialization },
+        { "ConvolutionReverb", buildConvolutionReverb },
+        { "RedAlert", buildRedAlert },
+    };
+
+    std::vector<Result> results;
+    for (const auto & scene : scenes)
+    {
+        if (!g_options.filter.empty() && std::string(scene.first).find(g_options.filter) == std::string::npos)
+            continue;
+        for (int scale : g_options.scales)
+            results.push_back(stress(scene.first, scene.second, scale));
+    }
+
+    if (!g_options.jsonPath.empty())
+        writeJson(g_options.jsonPath, results);
+    return 0;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "LabSoundStress: " << e.what() << std::endl;
+    return 1;
+}
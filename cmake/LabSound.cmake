@@ -30,6 +30,7 @@ add_library(LabSound STATIC
     ${third_rtaudio}
     ${third_kissfft}
     ${ooura_src}
+    ${LABSOUND_FFT_SOURCES}
  )
 
 if (APPLE)
@@ -57,7 +58,9 @@ target_include_directories(LabSound PRIVATE
     ${LABSOUND_ROOT}/src
     ${LABSOUND_ROOT}/src/internal
     ${LABSOUND_ROOT}/third_party
-    ${LABSOUND_ROOT}/third_party/libnyquist/include)
+    ${LABSOUND_ROOT}/third_party/libnyquist/include
+    ${LABSOUND_ROOT}/third_party/libnyquist/third_party/opus/libopus/include
+    ${LABSOUND_ROOT}/third_party/libnyquist/third_party/wavpack/include)
 
 if (MSVC_IDE)
     # hack to get around the "Debug" and "Release" directories cmake tries to add on Windows
@@ -75,6 +78,7 @@ set_target_properties(LabSound PROPERTIES OUTPUT_NAME_DEBUG LabSound_d)
 
 if (WIN32)
     target_compile_definitions(LabSound PRIVATE __WINDOWS_WASAPI__=1)
+    target_link_libraries(LabSound avrt ws2_32)
 elseif (APPLE)
 else()
     if (LABSOUND_JACK)
@@ -91,7 +95,43 @@ else()
     endif()
 endif()
 
+# Per node render time profiling, see AudioContext::setProfiling().
+if (LABSOUND_PROFILER)
+    target_compile_definitions(LabSound PRIVATE LABSOUND_PROFILER=1)
+endif()
+
+# A timeline of render quanta, graph updates and background work, see AudioTrace.
+if (LABSOUND_TRACE)
+    target_compile_definitions(LabSound PRIVATE LABSOUND_TRACE=1)
+endif()
+
+# Catches allocations and locks on the render threads, for debug builds, see AudioRealtimeCheck.
+if (LABSOUND_RT_CHECK)
+    target_compile_definitions(LabSound PRIVATE LABSOUND_RT_CHECK=1)
+    target_link_libraries(LabSound ${CMAKE_DL_LIBS})
+endif()
+
+# Integer filter arithmetic for targets without a fast floating point unit, see FixedPoint.h. Public, because it
+# changes the layout of internal classes the benchmarks use.
+if (LABSOUND_FIXED_POINT)
+    target_compile_definitions(LabSound PUBLIC LABSOUND_FIXED_POINT=1)
+endif()
+
+# CLAP plugin hosting for PluginNode, see LoadClapPlugin(). Needs only the CLAP headers.
+set(LABSOUND_CLAP_DIR "" CACHE PATH "Directory containing clap/clap.h, for LoadClapPlugin")
+if (LABSOUND_CLAP_DIR)
+    find_path(LABSOUND_CLAP_INCLUDE clap/clap.h PATHS "${LABSOUND_CLAP_DIR}" "${LABSOUND_CLAP_DIR}/include" NO_DEFAULT_PATH)
+    if (LABSOUND_CLAP_INCLUDE)
+        target_compile_definitions(LabSound PUBLIC LABSOUND_CLAP=1)
+        target_include_directories(LabSound PRIVATE "${LABSOUND_CLAP_INCLUDE}")
+        target_link_libraries(LabSound ${CMAKE_DL_LIBS})
+    else()
+        message(WARNING "clap/clap.h not found in LABSOUND_CLAP_DIR; LoadClapPlugin is not built")
+    endif()
+endif()
+
 target_link_libraries(LabSound libnyquist libopus libwavpack)
+target_link_libraries(LabSound ${LABSOUND_FFT_LIBRARIES})
 
 install(TARGETS LabSound
     LIBRARY DESTINATION lib
@@ -0,0 +1,45 @@
+
+set(labsound_bench_src
+    "${LABSOUND_ROOT}/bench/src/LabSoundBench.cpp")
+
+add_executable(LabSoundBench ${labsound_bench_src})
+
+_set_cxx_14(LabSoundBench)
+_set_compile_options(LabSoundBench)
+
+# The benchmarks time the library's internal kernels directly.
+target_include_directories(LabSoundBench PRIVATE
+    "${LABSOUND_ROOT}/src"
+    "${LABSOUND_ROOT}/third_party")
+
+target_link_libraries(LabSoundBench LabSound ${DARWIN_LIBS})
+
+set_target_properties(LabSoundBench PROPERTIES
+                      RUNTIME_OUTPUT_DIRECTORY bin)
+
+set_property(TARGET LabSoundBench PROPERTY FOLDER "examples")
+
+install(TARGETS LabSoundBench
+    BUNDLE DESTINATION bin
+    RUNTIME DESTINATION bin)
+
+# LabSoundStress renders the examples' graphs offline at growing sizes.
+add_executable(LabSoundStress "${LABSOUND_ROOT}/bench/src/LabSoundStress.cpp")
+
+_set_cxx_14(LabSoundStress)
+_set_compile_options(LabSoundStress)
+
+target_include_directories(LabSoundStress PRIVATE
+    "${LABSOUND_ROOT}/src"
+    "${LABSOUND_ROOT}/third_party")
+
+target_link_libraries(LabSoundStress LabSound ${DARWIN_LIBS})
+
+set_target_properties(LabSoundStress PROPERTIES
+                      RUNTIME_OUTPUT_DIRECTORY bin)
+
+set_property(TARGET LabSoundStress PROPERTY FOLDER "examples")
+
+install(TARGETS LabSoundStress
+    BUNDLE DESTINATION bin
+    RUNTIME DESTINATION bin)
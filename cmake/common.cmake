@@ -60,6 +60,14 @@ function(_set_compile_options proj)
         target_compile_definitions(${proj} PRIVATE HAVE_STDINT_H=1 HAVE_SETENV=1 HAVE_SINF=1)
     endif()
 
+    # The FFT library changes the layout of FFTFrame, so everything including it is built with its settings.
+    if(LABSOUND_FFT_DEFINITIONS)
+        target_compile_definitions(${proj} PRIVATE ${LABSOUND_FFT_DEFINITIONS})
+    endif()
+    if(LABSOUND_FFT_INCLUDE_DIRS)
+        target_include_directories(${proj} PRIVATE ${LABSOUND_FFT_INCLUDE_DIRS})
+    endif()
+
 endfunction()
 
 function(_set_cxx_14 proj)
@@ -0,0 +1,51 @@
+
+# LABSOUND_FFT selects the FFT library FFTFrame is built on. DEFAULT is Accelerate on macOS and KissFFT
+# elsewhere. OOURA is built from third_party. PFFFT is built from the pffft.c and pffft.h found in
+# LABSOUND_PFFFT_DIR, FFTW links the system's single precision fftw3f, and MKL links mkl_rt from MKLROOT.
+# When the requested library can't be found, the default is used.
+set(LABSOUND_FFT "DEFAULT" CACHE STRING "FFT library used by FFTFrame: DEFAULT, KISSFFT, OOURA, PFFFT, FFTW or MKL")
+set_property(CACHE LABSOUND_FFT PROPERTY STRINGS DEFAULT KISSFFT OOURA PFFFT FFTW MKL)
+set(LABSOUND_PFFFT_DIR "" CACHE PATH "Directory containing pffft.c and pffft.h, for LABSOUND_FFT=PFFFT")
+
+set(LABSOUND_FFT_DEFINITIONS)
+set(LABSOUND_FFT_INCLUDE_DIRS)
+set(LABSOUND_FFT_LIBRARIES)
+set(LABSOUND_FFT_SOURCES)
+
+if (LABSOUND_FFT STREQUAL "KISSFFT")
+    set(LABSOUND_FFT_DEFINITIONS WEBAUDIO_KISSFFT=1)
+elseif (LABSOUND_FFT STREQUAL "OOURA")
+    set(LABSOUND_FFT_DEFINITIONS WEBAUDIO_OOURA=1)
+elseif (LABSOUND_FFT STREQUAL "PFFFT")
+    find_path(PFFFT_INCLUDE_DIR pffft.h HINTS "${LABSOUND_PFFFT_DIR}")
+    find_file(PFFFT_SOURCE pffft.c HINTS "${LABSOUND_PFFFT_DIR}" "${PFFFT_INCLUDE_DIR}")
+    if (PFFFT_INCLUDE_DIR AND PFFFT_SOURCE)
+        set(LABSOUND_FFT_DEFINITIONS WEBAUDIO_PFFFT=1)
+        set(LABSOUND_FFT_INCLUDE_DIRS "${PFFFT_INCLUDE_DIR}")
+        set(LABSOUND_FFT_SOURCES "${PFFFT_SOURCE}")
+    else()
+        message(WARNING "LABSOUND_FFT is PFFFT, but pffft.c and pffft.h weren't found in LABSOUND_PFFFT_DIR; using the default FFT")
+    endif()
+elseif (LABSOUND_FFT STREQUAL "FFTW")
+    find_path(FFTW_INCLUDE_DIR fftw3.h)
+    find_library(FFTW_LIBRARY NAMES fftw3f libfftw3f-3)
+    if (FFTW_INCLUDE_DIR AND FFTW_LIBRARY)
+        set(LABSOUND_FFT_DEFINITIONS WEBAUDIO_FFTW=1)
+        set(LABSOUND_FFT_INCLUDE_DIRS "${FFTW_INCLUDE_DIR}")
+        set(LABSOUND_FFT_LIBRARIES "${FFTW_LIBRARY}")
+    else()
+        message(WARNING "LABSOUND_FFT is FFTW, but fftw3f wasn't found; using the default FFT")
+    endif()
+elseif (LABSOUND_FFT STREQUAL "MKL")
+    find_path(MKL_INCLUDE_DIR mkl_dfti.h HINTS "$ENV{MKLROOT}/include")
+    find_library(MKL_LIBRARY NAMES mkl_rt HINTS "$ENV{MKLROOT}/lib" "$ENV{MKLROOT}/lib/intel64")
+    if (MKL_INCLUDE_DIR AND MKL_LIBRARY)
+        set(LABSOUND_FFT_DEFINITIONS WEBAUDIO_MKL=1)
+        set(LABSOUND_FFT_INCLUDE_DIRS "${MKL_INCLUDE_DIR}")
+        set(LABSOUND_FFT_LIBRARIES "${MKL_LIBRARY}")
+    else()
+        message(WARNING "LABSOUND_FFT is MKL, but mkl_rt wasn't found; using the default FFT")
+    endif()
+elseif (NOT LABSOUND_FFT STREQUAL "DEFAULT")
+    message(WARNING "Unknown LABSOUND_FFT ${LABSOUND_FFT}; using the default FFT")
+endif()
@@ -0,0 +1,37 @@
+set(labsound_hrtfpack_src
+    "${LABSOUND_ROOT}/tools/src/LabSoundHRTFPack.cpp")
+
+add_executable(LabSoundHRTFPack ${labsound_hrtfpack_src})
+
+_set_cxx_14(LabSoundHRTFPack)
+_set_compile_options(LabSoundHRTFPack)
+
+# The converter writes the library's internal HRTF database format.
+target_include_directories(LabSoundHRTFPack PRIVATE
+    "${LABSOUND_ROOT}/src"
+    "${LABSOUND_ROOT}/third_party")
+
+target_link_libraries(LabSoundHRTFPack LabSound ${DARWIN_LIBS})
+
+# SOFA files are read with libmysofa, which is only needed by the converter.
+set(LABSOUND_MYSOFA_DIR "" CACHE PATH "libmysofa install prefix, for LabSoundHRTFPack --sofa")
+if (LABSOUND_MYSOFA_DIR)
+    find_path(LABSOUND_MYSOFA_INCLUDE mysofa.h PATHS "${LABSOUND_MYSOFA_DIR}/include" "${LABSOUND_MYSOFA_DIR}" NO_DEFAULT_PATH)
+    find_library(LABSOUND_MYSOFA_LIBRARY mysofa PATHS "${LABSOUND_MYSOFA_DIR}/lib" "${LABSOUND_MYSOFA_DIR}" NO_DEFAULT_PATH)
+    if (LABSOUND_MYSOFA_INCLUDE AND LABSOUND_MYSOFA_LIBRARY)
+        target_compile_definitions(LabSoundHRTFPack PRIVATE LABSOUND_MYSOFA=1)
+        target_include_directories(LabSoundHRTFPack PRIVATE "${LABSOUND_MYSOFA_INCLUDE}")
+        target_link_libraries(LabSoundHRTFPack "${LABSOUND_MYSOFA_LIBRARY}")
+    else()
+        message(WARNING "libmysofa not found in LABSOUND_MYSOFA_DIR; LabSoundHRTFPack is built without SOFA support")
+    endif()
+endif()
+
+set_target_properties(LabSoundHRTFPack PROPERTIES
+                      RUNTIME_OUTPUT_DIRECTORY bin)
+
+set_property(TARGET LabSoundHRTFPack PROPERTY FOLDER "tools")
+
+install(TARGETS LabSoundHRTFPack
+    BUNDLE DESTINATION bin
+    RUNTIME DESTINATION bin)
@@ -40,7 +40,7 @@ struct OfflineRenderApp : public LabSoundExampleApp
             recorder->writeRecordingToWav(1, "OfflineRender.wav");
         };
 
-        // Offline rendering happens in a separate thread and blocks until complete.
+        // Offline rendering happens on this thread and blocks until complete.
         // It needs to acquire the graph and render lock itself, so it must
         // be outside the scope of where we make changes to the graph!
         context->startRendering();
@@ -8,26 +8,38 @@
 
 // WebAudio Public API
 #include "LabSound/core/AnalyserNode.h"
+#include "LabSound/core/AttachedAudioDestinationNode.h"
 #include "LabSound/core/AudioBasicInspectorNode.h"
 #include "LabSound/core/AudioBasicProcessorNode.h"
 #include "LabSound/core/AudioContext.h"
 #include "LabSound/core/AudioDestinationNode.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+#include "LabSound/core/AudioThreadPolicy.h"
 #include "LabSound/core/AudioHardwareSourceNode.h"
 #include "LabSound/core/AudioListener.h"
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioGraphSnapshot.h"
+#include "LabSound/core/AudioLockProfile.h"
+#include "LabSound/core/AudioProfile.h"
+#include "LabSound/core/AudioRealtimeCheck.h"
+#include "LabSound/core/AudioRenderHealth.h"
+#include "LabSound/core/AudioTrace.h"
+#include "LabSound/core/AudioTransport.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
 #include "LabSound/core/BiquadFilterNode.h"
 #include "LabSound/core/ChannelMergerNode.h"
 #include "LabSound/core/ChannelSplitterNode.h"
+#include "LabSound/core/ConcurrentQueue.h"
 #include "LabSound/core/Constants.h"
 #include "LabSound/core/ConvolverNode.h"
 #include "LabSound/core/DefaultAudioDestinationNode.h"
 #include "LabSound/core/DelayNode.h"
 #include "LabSound/core/DynamicsCompressorNode.h"
 #include "LabSound/core/GainNode.h"
+#include "LabSound/core/GraphTransaction.h"
 #include "LabSound/core/OfflineAudioDestinationNode.h"
 #include "LabSound/core/OscillatorNode.h"
 #include "LabSound/core/PannerNode.h"
@@ -39,21 +51,45 @@
 #include "LabSound/extended/ADSRNode.h"
 #include "LabSound/extended/AudioFileReader.h"
 #include "LabSound/extended/ClipNode.h"
+#include "LabSound/extended/CommandLog.h"
+#include "LabSound/extended/CompactAudioBus.h"
+#include "LabSound/extended/DeviceOutputNode.h"
 #include "LabSound/extended/DiodeNode.h"
+#include "LabSound/extended/FDNReverbNode.h"
+#include "LabSound/extended/FeatureExtractorNode.h"
 #include "LabSound/extended/FunctionNode.h"
+#include "LabSound/extended/GranularNode.h"
+#include "LabSound/extended/GraphPrefab.h"
+#include "LabSound/extended/LoadGovernor.h"
+#include "LabSound/extended/MappedAudioFile.h"
+#include "LabSound/extended/MixerNode.h"
+#include "LabSound/extended/MultibandCompressorNode.h"
+#include "LabSound/extended/NetworkAudioOutput.h"
+#include "LabSound/extended/OfflineRenderFarm.h"
 #include "LabSound/extended/NoiseNode.h"
+#include "LabSound/extended/OscillatorBankNode.h"
+#include "LabSound/extended/ParametricEQNode.h"
 #include "LabSound/extended/PdNode.h"
 #include "LabSound/extended/PeakCompNode.h"
 #include "LabSound/extended/PingPongDelayNode.h"
+#include "LabSound/extended/PitchShiftNode.h"
+#include "LabSound/extended/PluginNode.h"
 #include "LabSound/extended/PowerMonitorNode.h"
 #include "LabSound/extended/PWMNode.h"
 #include "LabSound/extended/RealtimeAnalyser.h"
 #include "LabSound/extended/RecorderNode.h"
+#include "LabSound/extended/SampleCache.h"
 #include "LabSound/extended/SampledInstrumentNode.h"
+#include "LabSound/extended/SampledVoicePool.h"
 #include "LabSound/extended/SfxrNode.h"
 #include "LabSound/extended/SpatializationNode.h"
+#include "LabSound/extended/SpectrumCache.h"
 #include "LabSound/extended/SpectralMonitorNode.h"
+#include "LabSound/extended/StkNode.h"
+#include "LabSound/extended/StreamingAudioNode.h"
 #include "LabSound/extended/SupersawNode.h"
+#include "LabSound/extended/TapNode.h"
+#include "LabSound/extended/VoiceManager.h"
 
 #include <memory>
 // Factory functions for convenience.
@@ -61,9 +97,22 @@
 namespace lab {
 namespace Sound {
     std::shared_ptr<AudioHardwareSourceNode> MakeHardwareSourceNode(ContextRenderLock & r);
-    std::unique_ptr<AudioContext> MakeRealtimeAudioContext(uint32_t numChannels, float sample_rate = LABSOUND_DEFAULT_SAMPLERATE);
+    // renderQuantumSize is the number of frames rendered per quantum, see AudioContext::renderQuantumSize().
+    // The graph renders at sample_rate whatever the device's rate; if the device can't run at it, the destination
+    // resamples its output, see AudioContext::baseLatency().
+    std::unique_ptr<AudioContext> MakeRealtimeAudioContext(uint32_t numChannels, float sample_rate = LABSOUND_DEFAULT_SAMPLERATE, size_t renderQuantumSize = AudioNode::ProcessingSizeInFrames);
+    // As above, talking to the hardware as deviceSettings say, such as through ALSA with a render quantum of 64
+    // frames for the period. See AudioContext::outputLatency() for what the device buffers. With the Null
+    // backend there is no hardware, and the context renders in real time for AudioDeviceSettings::nullOutput.
+    std::unique_ptr<AudioContext> MakeRealtimeAudioContext(const AudioDeviceSettings & deviceSettings, uint32_t numChannels, float sample_rate = LABSOUND_DEFAULT_SAMPLERATE, size_t renderQuantumSize = AudioNode::ProcessingSizeInFrames);
+    // Offline contexts render as fast as they can on the thread calling startRendering(). Larger render quanta,
+    // up to 4096 frames, and AudioContext::setRenderWorkerCount() speed up long renders of large graphs; to render
+    // many at once, see OfflineRenderFarm.
+    // A context rendered by host, in its render callback and mixed into its output, with no device or threads of
+    // its own, see AudioContext::attachContext(). To be destroyed before the host.
+    std::unique_ptr<AudioContext> MakeAttachedAudioContext(AudioContext & host, uint32_t numChannels);
     std::unique_ptr<AudioContext> MakeOfflineAudioContext(uint32_t numChannels, float recordTimeMilliseconds);
-    std::unique_ptr<AudioContext> MakeOfflineAudioContext(uint32_t numChannels, float recordTimeMilliseconds, float sample_rate);
+    std::unique_ptr<AudioContext> MakeOfflineAudioContext(uint32_t numChannels, float recordTimeMilliseconds, float sample_rate, size_t renderQuantumSize = AudioNode::ProcessingSizeInFrames);
 
     char const * const * const AudioNodeNames();
 
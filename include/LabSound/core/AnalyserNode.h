@@ -14,8 +14,11 @@ namespace lab {
 
 class AudioSetting;
 
+// The spectrum is analysed every analysisHop frames off the audio thread, and the get functions copy out the
+// latest analysis; see RealtimeAnalyser.
+//
 // params:
-// settings: fftSize, minDecibels, maxDecibels, smoothingTimeConstant
+// settings: fftSize, minDecibels, maxDecibels, smoothingTimeConstant, analysisHop
 //
 class AnalyserNode : public AudioBasicInspectorNode 
 {
@@ -28,6 +31,7 @@ public:
     // AudioNode
     virtual void process(ContextRenderLock&, size_t framesToProcess) override;
     virtual void reset(ContextRenderLock&) override;
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
 
     void setFftSize(ContextRenderLock&, size_t fftSize);
     size_t fftSize() const { return m_analyser->fftSize(); }
@@ -43,7 +47,15 @@ public:
     void setSmoothingTimeConstant(double k);
     double smoothingTimeConstant() const;
 
+    void setAnalysisHop(uint32_t frames);
+    uint32_t analysisHop() const;
+
     // ffi: user facing functions
+    void getFloatFrequencyData(float* array, size_t count) { m_analyser->getFloatFrequencyData(array, count); }
+    void getByteFrequencyData(uint8_t* array, size_t count) { m_analyser->getByteFrequencyData(array, count); }
+    void getFloatTimeDomainData(float* array, size_t count) { m_analyser->getFloatTimeDomainData(array, count); } // LabSound
+    void getByteTimeDomainData(uint8_t* array, size_t count) { m_analyser->getByteTimeDomainData(array, count); }
+
     void getFloatFrequencyData(std::vector<float>& array) { m_analyser->getFloatFrequencyData(array); }
     void getByteFrequencyData(std::vector<uint8_t>& array) { m_analyser->getByteFrequencyData(array); }
     void getFloatTimeDomainData(std::vector<float>& array) { m_analyser->getFloatTimeDomainData(array); } // LabSound
@@ -61,6 +73,7 @@ private:
     std::shared_ptr<AudioSetting> _minDecibels;
     std::shared_ptr<AudioSetting> _maxDecibels;
     std::shared_ptr<AudioSetting> _smoothingTimeConstant;
+    std::shared_ptr<AudioSetting> _analysisHop;
 };
 
 } // namespace lab
@@ -0,0 +1,28 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AttachedAudioDestinationNode_h
+#define AttachedAudioDestinationNode_h
+
+#include "LabSound/core/AudioDestinationNode.h"
+
+namespace lab {
+
+class AudioContext;
+
+// The destination of a context attached to another, see AudioContext::attachContext(). It has no device; the
+// host renders it in its own render callback, and mixes it into its own output.
+class AttachedAudioDestinationNode final : public AudioDestinationNode
+{
+public:
+
+    AttachedAudioDestinationNode(AudioContext * context, size_t channelCount, float sampleRate);
+    virtual ~AttachedAudioDestinationNode();
+
+    // Rendering starts as the context is initialized, and follows the host's.
+    virtual void startRendering() override { }
+};
+
+} // namespace lab
+
+#endif
@@ -29,37 +29,17 @@ namespace lab {
         // if re-allocated. Allocations are zero-initialized.
         void allocate(size_t n)
         {
-            size_t initialSize = sizeof(T) * n;
-            
-            const size_t alignment = 16;
-            
+            // Cache line alignment, which also satisfies every SIMD width the vector math uses.
+            const size_t alignment = 64;
+
             if (m_allocation)
                 free(m_allocation);
 
-            bool isAllocationGood = false;
-
-            while (!isAllocationGood) {
-                // Initially we try to allocate the exact size, but if it's not aligned
-                // then we'll have to reallocate and from then on allocate extra.
-                static size_t extraAllocationBytes = 0;
-
-                T* allocation = static_cast<T*>(malloc(initialSize + extraAllocationBytes));
-                if (!allocation) {
-                    //CRASH(); // dimitri
-                }
-                T* alignedData = alignedAddress(allocation, alignment);
-
-                if (alignedData == allocation || extraAllocationBytes == alignment) {
-                    m_allocation = allocation;
-                    m_alignedData = alignedData;
-                    m_size = n;
-                    isAllocationGood = true;
-                    zero();
-                } else {
-                    extraAllocationBytes = alignment; // always allocate extra after the first alignment failure.
-                    free(allocation);
-                }
-            }
+            // Over-allocate by the alignment once, rather than retrying when malloc returns an unaligned block.
+            m_allocation = static_cast<T*>(malloc(sizeof(T) * n + alignment));
+            m_alignedData = m_allocation ? alignedAddress(m_allocation, alignment) : nullptr;
+            m_size = m_allocation ? n : 0;
+            zero();
         }
 
         T* data() { return m_alignedData; }
@@ -12,6 +12,10 @@ namespace lab {
 // AudioBasicInspectorNode is an AudioNode with one input and one output where the output might not necessarily connect to another node's input.
 // If the output is not connected to any other node, then the AudioBasicInspectorNode's processIfNecessary() function will be called automatically by
 // AudioContext before the end of each render quantum so that it can inspect the audio stream.
+//
+// An inspector taps the stream rather than sitting in its path: its output is the bus its input was rendered into,
+// so nothing is copied and the nodes downstream read the upstream buffer itself. It only renders into a bus of its
+// own while a declick ramp would change the samples, or if the channel counts differ.
 
 // NONFINAL NODE
 
@@ -25,6 +29,7 @@ public:
     // AudioNode
     virtual void pullInputs(ContextRenderLock& r, size_t framesToProcess) override;
     virtual void checkNumberOfChannelsForInput(ContextRenderLock&, AudioNodeInput*) override;
+    virtual bool aliasesInputs() const override { return true; }
 };
 
 } // namespace lab
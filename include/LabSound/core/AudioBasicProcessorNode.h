@@ -33,6 +33,13 @@ public:
     // Called in the main thread when the number of channels for the input may have changed.
     virtual void checkNumberOfChannelsForInput(ContextRenderLock&, AudioNodeInput*) override;
 
+    // Builds the processor's kernels for the input's channels, which would otherwise be rebuilt on the render
+    // thread as the first connection is seen.
+    virtual void prepare(AudioContext & context, size_t inputChannels) override;
+
+    // Reports the processor's memory as well as the buses'.
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
+
     // Returns the number of channels for both the input and the output.
     size_t numberOfChannels();
 
@@ -15,8 +15,26 @@ namespace lab {
     using lab::ChannelInterpretation;
     using lab::Channel;
     
+// The level of a bus's content as a whole, measured when it was loaded if asked for, so that playback can apply a
+// normalizing gain without another pass over the samples, or changing them where the bus is shared. Loudness is
+// integrated as ITU-R BS.1770 has it, in LUFS; levels are linear. A signal too short or too quiet to pass the
+// loudness gate has an integrated loudness of -infinity.
+struct AudioBusLoudness
+{
+    bool measured = false;
+    float peak = 0;
+    float rms = 0;
+    float integratedLoudness = 0;
+
+    // The gain bringing the integrated loudness to targetLoudness, reduced as needed so that the peak stays
+    // within peakCeiling; 1 if nothing was measured, and only the peak's limit if the loudness is -infinity.
+    float normalizationGain(float targetLoudness = -23.f, float peakCeiling = 1.f) const;
+};
+
 // An AudioBus represents a collection of one or more AudioChannels.
 // The data layout is "planar" as opposed to "interleaved".
+// The channels are views of one aligned block the bus allocates, so that copying, summing and scaling a whole bus
+// can run as one call over it.
 // An AudioBus with one channel is mono, an AudioBus with two channels is stereo, etc.
 class AudioBus 
 {
@@ -33,21 +51,24 @@ public:
     // allocate indicates whether or not to initially have the AudioChannels created with managed storage.
     // Normal usage is to pass true here, in which case the AudioChannels will memory-manage their own storage.
     // If allocate is false then setChannelMemory() has to be called later on for each channel before the AudioBus is useable...
+    // When allocating, the channels' storage is one block, channelStride() frames from one channel to the next.
     AudioBus(size_t numberOfChannels, size_t length, bool allocate = true);
+    ~AudioBus();
 
     // Tells the given channel to use an externally allocated buffer.
     void setChannelMemory(size_t channelIndex, float* storage, size_t length);
 
     // Channels
-    size_t numberOfChannels() const { return m_channels.size(); }
+    size_t numberOfChannels() const { return m_numberOfChannels; }
 
     // Use this when looping over channels
-    AudioChannel * channel(size_t channel) { return m_channels[channel].get(); }
+    AudioChannel * channel(size_t channel) { return &m_channels[channel]; }
+    const AudioChannel * channel(size_t channel) const { return &m_channels[channel]; }
 
-    const AudioChannel * channel(size_t channel) const 
-    {
-        return const_cast<AudioBus*>(this)->m_channels[channel].get(); 
-    }
+    // The distance in frames from the start of one channel's storage to the next, when the bus allocated them as
+    // one block, or 0 if it didn't, or a channel has been given other memory since. The stride is rounded up to
+    // a cache line, so every channel starts on one.
+    size_t channelStride() const { return m_channelStride; }
     
     // use this when accessing channels semantically
     AudioChannel* channelByType(Channel type);
@@ -89,6 +110,11 @@ public:
     // If sourceBus is already mono, then the returned AudioBus will simply be a copy.
     static std::unique_ptr<AudioBus> createByMixingToMono(const AudioBus* sourceBus);
 
+    // The gains, one per channel, with which sumFrom() mixes a bus of numberOfChannels into a mono bus under the
+    // speakers interpretation. Other channel counts mix discretely, taking the first channel alone, for which it
+    // returns nullptr.
+    static const float * monoMixGains(size_t numberOfChannels);
+
     // Scales all samples by the same amount.
     void scale(float scale);
 
@@ -116,8 +142,16 @@ public:
     // Makes maximum absolute value == 1.0 (if possible).
     void normalize();
 
+    // As measured when the bus was loaded; see AudioFileLoadOptions. Not kept up to date as the bus is written.
+    const AudioBusLoudness & loudness() const { return m_loudness; }
+    void setLoudness(const AudioBusLoudness & loudness) { m_loudness = loudness; }
+
     bool isFirstTime() { return m_isFirstTime; }
 
+    // The bytes of sample memory the bus and its channels allocated, pooled or not. Memory given to a channel by
+    // setChannelMemory() isn't counted.
+    size_t memoryBytes() const;
+
 protected:
 
     AudioBus() {};
@@ -126,12 +160,29 @@ protected:
     void discreteCopyFrom(const AudioBus&);
     void speakersSumFrom(const AudioBus&);
     void discreteSumFrom(const AudioBus&);
-    void speakersSumFrom5_1_ToMono(const AudioBus&);
-    void speakersSumFrom7_1_ToMono(const AudioBus&);
 
-    size_t m_length;
+    // The frames from the start of the first channel to the end of the last, when the channels are in the bus's
+    // block, none of them silent, so that a whole-bus operation is one call over them, padding included; 0
+    // otherwise.
+    size_t contiguousSpan() const;
+
+    // Whether the bus can be overwritten as one span matching source's, which it must have the topology of.
+    bool canOverwriteContiguously(const AudioBus & source) const
+    {
+        return m_channelStride && m_channelStride == source.m_channelStride && m_length == source.m_length;
+    }
+
+    size_t m_length = 0;
+
+    // The channels' storage, from the shared channel arena if it's pooled, and otherwise an array of the bus's.
+    float * m_storage = nullptr;
+    size_t m_pooledCapacity = 0;
+    std::unique_ptr<AudioFloatArray> m_storageArray;
+    size_t m_channelStride = 0;
 
-    std::vector<std::unique_ptr<AudioChannel> > m_channels;
+    // Declared after the storage, which they point into, so that they are destroyed first.
+    std::unique_ptr<AudioChannel[]> m_channels;
+    size_t m_numberOfChannels = 0;
 
     int m_layout = LayoutCanonical;
 
@@ -142,6 +193,7 @@ protected:
     bool m_isFirstTime = true;
     float m_sampleRate = 0.0f;
 
+    AudioBusLoudness m_loudness;
 };
 
 } // lab
@@ -29,13 +29,8 @@ public:
     {
     }
 
-    // Manage storage for us.
-    explicit AudioChannel(size_t length)
-        : m_length(length)
-        , m_silent(true)
-    {
-        m_memBuffer.reset(new AudioFloatArray(length));
-    }
+    // Manage storage for us. Lengths of up to a few render quanta are drawn from a shared pool of buffers.
+    explicit AudioChannel(size_t length);
 
     // An empty audio channel -- must call set() before it's useful...
     AudioChannel()
@@ -44,15 +39,11 @@ public:
     {
     }
 
+    ~AudioChannel();
+
     // Redefine the memory for this channel.
     // storage represents external memory not managed by this object.
-    void set(float * storage, size_t length)
-    {
-        m_memBuffer.reset();  // clean up managed storage
-        m_rawPointer = storage;
-        m_length = length;
-        m_silent = false;
-    }
+    void set(float * storage, size_t length);
 
     // How many sample-frames do we contain?
     size_t length() const { return m_length; }
@@ -64,32 +55,38 @@ public:
     // Direct access to PCM sample data. Non-const accessor clears silent flag.
     float * mutableData()
     {
+        if (m_sharedZeros)
+            unshareZeros();
         clearSilentFlag();
-        return const_cast<float *>(data());
+        return storage();
     }
 
+    // A zeroed channel that owns its storage reads as SharedZeros, until it is next written.
     const float * data() const
     {
-        if (m_rawPointer)
-            return m_rawPointer;
-        if (m_memBuffer)
-            return m_memBuffer->data();
-        return nullptr;
+        return m_sharedZeros ? SharedZeros : storage();
     }
 
-    // Zeroes out all sample values in buffer.
+    // Zeroes out all sample values in buffer. A channel that owns its storage, and is no longer than SharedZeros,
+    // is pointed at SharedZeros instead, and its own storage is only cleared by the next mutableData().
     void zero()
     {
         if (m_silent) return;
 
         m_silent = true;
 
-        if (m_memBuffer)
+        if ((m_pooledCapacity || m_memBuffer || m_busStorage) && m_length <= SharedZeroLength)
+            m_sharedZeros = true;
+        else if (m_memBuffer)
             m_memBuffer->zero();
-        else if (m_rawPointer)
+        else if (m_rawPointer && m_rawPointer != SharedZeros)
             memset(m_rawPointer, 0, sizeof(float) * m_length);
     }
 
+    // Silence shared by every zeroed channel, as long as the longest render quantum. Read only.
+    static const size_t SharedZeroLength = 4096;
+    alignas(16) static const float SharedZeros[SharedZeroLength];
+
     // Clears the silent flag.
     void clearSilentFlag() { m_silent = false; }
 
@@ -110,11 +107,43 @@ public:
     // Returns maximum absolute value (useful for normalization).
     float maxAbsValue() const;
 
+    // The bytes of storage the channel allocated itself, pooled or not; external memory and its bus's storage
+    // aren't counted.
+    size_t memoryBytes() const { return (m_pooledCapacity + (m_memBuffer ? m_memBuffer->size() : 0)) * sizeof(float); }
+
 private:
+    friend class AudioBus;
+
+    // Points the channel at its share of the storage its bus allocated for all of its channels, which the channel
+    // treats as its own, but doesn't free.
+    void setBusStorage(float * storage, size_t length);
+
+    // mutableData(), for the bus about to overwrite the whole channel, without clearing stale storage first.
+    float * overwrittenData()
+    {
+        m_sharedZeros = false;
+        clearSilentFlag();
+        return storage();
+    }
+
+    float * storage() const
+    {
+        if (m_rawPointer)
+            return m_rawPointer;
+        if (m_memBuffer)
+            return m_memBuffer->data();
+        return nullptr;
+    }
+
+    void unshareZeros();
+
     size_t m_length = 0;
     float * m_rawPointer = nullptr;
+    size_t m_pooledCapacity = 0; // nonzero if m_rawPointer is a pooled buffer owned by this channel
     std::unique_ptr<AudioFloatArray> m_memBuffer;
     bool m_silent = true;
+    bool m_sharedZeros = false; // data() is SharedZeros, and the storage is stale
+    bool m_busStorage = false; // m_rawPointer is owned by the channel's bus
 };
 
 }  // lab
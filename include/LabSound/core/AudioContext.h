@@ -6,15 +6,25 @@
 #ifndef AUDIO_CONTEXT_H
 #define AUDIO_CONTEXT_H
 
-#include "LabSound/core/ConcurrentQueue.h"
+#include "LabSound/core/AudioGraphSnapshot.h"
+#include "LabSound/core/AudioLockProfile.h"
+#include "LabSound/core/AudioMemory.h"
+#include "LabSound/core/AudioProfile.h"
+#include "LabSound/core/AudioRenderHealth.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
+#include "LabSound/core/AudioStartup.h"
+#include "LabSound/core/AudioThreadPolicy.h"
+#include "LabSound/core/AudioTransport.h"
+#include "LabSound/core/GraphTransaction.h"
 
+#include <chrono>
 #include <set>
 #include <atomic>
 #include <vector>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <condition_variable>
 #include <functional>
@@ -22,6 +32,7 @@
 namespace lab
 {
 
+class AudioBus;
 class AudioDestinationNode;
 class AudioListener;
 class AudioNode;
@@ -29,24 +40,35 @@ class AudioScheduledSourceNode;
 class AudioHardwareSourceNode;
 class AudioNodeInput;
 class AudioNodeOutput;
+class AudioSummingJunction;
+class CommandRecorder;
 class ContextGraphLock;
 class ContextRenderLock;
+struct ContextLockTiming;
 
 class AudioContext
 {
     friend class ContextGraphLock;
     friend class ContextRenderLock;
+    friend struct ContextLockTiming;
+    friend class GraphTransaction;
+    friend class AudioSummingJunction;
 
 public:
 
-    // Somewhat arbitrary and could be increased if necessary
+    // The default channelLimit(), and the highest it may be raised to.
     static const size_t maxNumberOfChannels;
+    static const size_t maxChannelLimit;
 
-    // Debugging/Sanity Checking
-    std::string m_graphLocker;
-    std::string m_renderLocker;
+    // Debugging/Sanity Checking: names the current holders of the locks, see AudioContextLock.h
+    std::atomic<const char *> m_graphLocker{ nullptr };
+    std::atomic<const char *> m_renderLocker{ nullptr };
 
-    explicit AudioContext(bool isOffline, bool autoDispatchEvents = true);
+    // renderQuantumSize is the number of frames rendered per quantum. It must be a power of two
+    // between MinRenderQuantumSize and MaxRenderQuantumSize. ConvolverNode and HRTF panning work
+    // in blocks of AudioNode::ProcessingSizeInFrames; smaller quanta are gathered into a block, which adds a
+    // block to their latency.
+    explicit AudioContext(bool isOffline, bool autoDispatchEvents = true, size_t renderQuantumSize = AudioNode::ProcessingSizeInFrames);
     ~AudioContext();
 
     bool isInitialized() const;
@@ -65,15 +87,109 @@ public:
 
     double currentTime() const;
 
+    // The index of the render quantum being rendered. It increases by one after every quantum and, unlike the
+    // sample frame, is never reset, so it identifies a quantum exactly however long the context has run.
+    uint64_t currentRenderQuantum() const { return m_currentRenderQuantum; }
+
     float sampleRate() const;
 
+    // The seconds between the graph rendering a frame and its being handed to the audio hardware, such as the
+    // look ahead of resampling to a device that runs at a different rate than sampleRate().
+    double baseLatency() const;
+
+    // The seconds the audio hardware holds a frame before playing it, as far as the destination can tell; 0
+    // where it can't.
+    double outputLatency() const;
+
+    // The seconds between live input arriving at the audio hardware and its being handed to the graph, and
+    // between its arrival and the graph's response to it being played, by which monitoring can be aligned.
+    double inputLatency() const;
+    double roundTripLatency() const;
+
+    // The seconds between a node's output and the destination's: the most that the latencies of the nodes on any
+    // path from it add up to, see AudioNode::latencyTime(), not counting its own. Negative if its output doesn't
+    // reach the destination, or only through a feedback cycle. The render thread works the latencies out as it
+    // adopts a new render schedule, and every few quanta besides; reading one is an atomic load, cheap enough to
+    // poll every frame, from any thread.
+    double pathLatency(const AudioNode & node) const;
+
+    // When what a node outputs now is heard: its pathLatency(), plus baseLatency() and outputLatency(). Negative
+    // if the node isn't heard.
+    double presentationLatency(const AudioNode & node) const;
+
+    // How close the destination's renders come to their deadlines, the xruns the device reported, and the
+    // longest wait for the render lock. May be called from any thread; with reset, the counts start over.
+    AudioRenderHealth renderHealth(bool reset = false);
+
+    // If set, called with each deadline miss and xrun as the context's events are dispatched. Set it before the
+    // context starts rendering.
+    std::function<void(const AudioRenderHealthEvent &)> renderHealthCallback;
+
+    static const size_t MinRenderQuantumSize;
+    static const size_t MaxRenderQuantumSize;
+    size_t renderQuantumSize() const { return m_renderQuantumSize; }
+
+    // Newly connected nodes fade in, and disconnecting nodes fade out, along an exponential curve of
+    // declickLength() frames that ends exactly at unity or silence. Setting the length takes the render lock.
+    static const size_t DefaultDeclickLength;
+    void setDeclickLength(size_t frames);
+    size_t declickLength() const;
+
+    // The fade curves, declickLength() gains each. Only valid on the render thread.
+    const float * declickFadeIn() const;
+    const float * declickFadeOut() const;
+
+    // The transport follows a tempo map, see AudioTransport.h, by default 120 beats per minute in 4 from context
+    // time 0. The map may be set from any thread but the render thread, which takes it up at its next quantum
+    // without blocking. setTempo() changes the map in force from the beat the render thread is about to reach.
+    void setTempoMap(const TempoMap & map);
+    void setTempo(double bpm, unsigned beatsPerBar = 0);
+    TempoMap tempoMap() const;
+
+    // Musical time to context time and back, by the map last set, for start(), stop() and automation.
+    double timeAtBeat(double beat) const;
+    double beatAtTime(double time) const;
+
+    // Where the transport is at the start of the current quantum, and the map it follows, for tempo synced nodes
+    // and for converting beats to frames on the render path. Render thread only; the position is worked out once
+    // per quantum, so reading it costs nothing.
+    const TransportPosition & transport(ContextRenderLock &) const;
+    const TempoMap & renderTempoMap(ContextRenderLock &) const;
+
     AudioListener & listener();
 
     void handlePreRenderTasks(ContextRenderLock &); // Called at the start of each render quantum.
     void handlePostRenderTasks(ContextRenderLock &); // Called at the end of each render quantum.
 
+    // Called from the render thread by a node whose disconnection ramp has just reached silence, so that the
+    // graph update thread can complete the pending disconnection without waiting for its timeout.
+    void notifyDisconnectionReady();
+
+    // Called from the render thread by a scheduled source as it finishes, so that the graph update thread can
+    // disconnect it if it was held until finished.
+    void notifySourceFinished();
+
+    // Called from the render path, on the audio thread or a render worker, instead of dropping a reference
+    // that may be the last one. The reference is handed to the graph update thread, which drops it, so that no
+    // destructor or deallocation runs while rendering.
+    void deferRelease(ContextRenderLock &, std::shared_ptr<void> && object);
+    void deferRelease(ContextRenderLock &, std::unique_ptr<AudioBus> && bus);
+
+    // Work the render path hands to the graph update thread, as doing it would allocate or block.
+    struct DeferredTask
+    {
+        virtual ~DeferredTask() = default;
+        virtual void run() = 0;
+    };
+
+    // Called from the render path, on the audio thread or a render worker. Passing a reference the caller
+    // already holds doesn't allocate. The update thread calls run() and then drops its reference, so a task may
+    // outlive whatever posted it. Returns false if the queue is full, leaving the caller to ask again later.
+    bool deferTask(ContextRenderLock &, std::shared_ptr<DeferredTask> task);
+
     // AudioContext can pull node(s) at the end of each render quantum even when they are not connected to any downstream nodes.
     // These two methods are called by the nodes who want to add/remove themselves into/from the automatic pull lists.
+    // They may be called from any thread; the change takes effect with the next render schedule.
     void addAutomaticPullNode(std::shared_ptr<AudioNode>);
     void removeAutomaticPullNode(std::shared_ptr<AudioNode>);
 
@@ -81,6 +197,109 @@ public:
     // Only an AudioDestinationNode should call this.
     void processAutomaticPullNodes(ContextRenderLock &, size_t framesToProcess);
 
+    // Processes the compiled render schedule: every node reachable from the destination or an automatic pull node
+    // is rendered in dependency order, so that when the destination pulls its input the graph is already rendered.
+    // Only an AudioDestinationNode should call this, before it pulls its input.
+    void processRenderSchedule(ContextRenderLock &, size_t framesToProcess);
+
+    // Opt-in parallel rendering. With a non-zero count, the nodes of each dependency level of the render
+    // schedule are processed by a pool of that many worker threads together with the audio thread, with a
+    // barrier between levels. Output is identical to single threaded rendering. Zero, the default, renders
+    // the whole graph on the audio thread. Offline contexts render in parallel too, and with a render quantum
+    // of 1024 frames or more, each level has enough work to keep the workers busy.
+    void setRenderWorkerCount(size_t count);
+    size_t renderWorkerCount() const;
+
+    // Processors running a kernel per channel, the filters, delays and wave shapers, spread the channels of a bus
+    // at least this wide over the render workers. They can only while the workers are otherwise idle, that is
+    // while the node is alone in its level of the render schedule, or the quantum is rendered serially. Zero, the
+    // default, keeps each processor on one thread.
+    // The most channels a node of the context may be set to, or its buses grow to, maxNumberOfChannels by
+    // default. Higher order ambisonics, 64 channels at 7th order, and large speaker arrays need more. It is
+    // clamped to between 1 and maxChannelLimit, and should be set before the graph is built: a node already
+    // wider than a lowered limit keeps its channels.
+    void setChannelLimit(size_t channels);
+    size_t channelLimit() const { return m_channelLimit.load(std::memory_order_relaxed); }
+
+    void setParallelKernelThreshold(size_t channels) { m_parallelKernelThreshold.store(channels, std::memory_order_relaxed); }
+    size_t parallelKernelThreshold() const { return m_parallelKernelThreshold.load(std::memory_order_relaxed); }
+
+    // Calls task(userData, i) for every i below count and returns once all have, spread over the render workers
+    // if called by the render thread while they are idle, and otherwise in turn on the calling thread. For a
+    // node to split its own work into independent items. Does not allocate.
+    void runOnIdleRenderWorkers(ContextRenderLock &, void (*task)(void * userData, size_t index), void * userData, size_t count);
+
+    // Opt-in rewrites of the render schedule, which leave the output unchanged. While their gains hold still, a
+    // chain of GainNodes each feeding only the next is applied as one multiplication, and a GainNode at unity
+    // hands its input on untouched. A ChannelSplitterNode whose outputs each feed only the input of the same
+    // index of one ChannelMergerNode is skipped together with the merger. Gains and channel counts are checked
+    // every quantum and connections whenever the schedule is compiled, so automation and graph edits are always
+    // honoured. Nodes with no path to the destination or an automatic pull node are never rendered, with or
+    // without this.
+    void setGraphOptimization(bool enabled);
+    bool graphOptimization() const { return m_graphOptimization.load(std::memory_order_relaxed); }
+
+    // Scheduling and core affinity for the context's threads. The render thread takes a new policy at its next
+    // quantum, and the background threads when they next wake; setting the render workers' policy restarts
+    // their pool. The render workers of a realtime context ask for SCHED_FIFO by default; the other roles, and
+    // an offline context's workers, are left as created.
+    void setThreadPolicy(AudioThreadRole role, const AudioThreadPolicy & policy);
+    AudioThreadPolicy threadPolicy(AudioThreadRole role) const;
+
+    // The AudioThreadPolicy::Failure mask of the role's threads since its policy was last set. Each failure is
+    // also logged.
+    unsigned threadPolicyFailures(AudioThreadRole role) const;
+
+    // Applies the render thread's policy to the calling thread, unless it already has it. Only an
+    // AudioDestinationNode should call this, on the render thread.
+    void applyRenderThreadPolicy();
+
+    // Opt-in profiling of each node's render time, available when LabSound is built with LABSOUND_PROFILER; a
+    // build without it ignores this. Profiling costs two reads of the CPU's counter per node per quantum, and
+    // nothing while it's off.
+    void setProfiling(bool enabled);
+    bool isProfiling() const { return m_profilingEpoch.load(std::memory_order_relaxed) != 0; }
+
+    // The render times since profiling was started, or last reset. May be called from any thread.
+    AudioProfile profile(bool reset = false);
+
+    // The nodes and connections of the render graph, with each node's channels, parameters, silence, latency and
+    // tail, and its cost when profiling. The graph lock is held while the graph is walked, which the render thread
+    // never waits for; the latency and tail are read by the render thread at its next quantum, for which this
+    // waits a few quanta at most. May be called from any thread but the render thread.
+    AudioGraphSnapshot snapshotGraph();
+
+    // The memory of the render graph, the same nodes snapshotGraph() finds, by node and by category, with what
+    // they share counted once, see AudioMemoryReport. The graph lock is held while the graph is walked, which the
+    // render thread never waits for; the nodes report at the render thread's next quantum, into room reserved for
+    // them, for which this waits. Unless the context isn't rendering, they report on the calling thread. May be
+    // called from any thread but the render thread.
+    AudioMemoryReport memoryReport();
+
+    // Opt-in timing of the graph and render locks: how long each holder waits for them and holds them, and whom
+    // it kept waiting, to find what stalls the render thread. Locks cost a relaxed load while it's off; while it's
+    // on, two reads of the CPU's counter and a table lookup each, without allocating.
+    void setLockProfiling(bool enabled);
+    bool isLockProfiling() const { return m_lockProfiling.load(std::memory_order_relaxed); }
+
+    // The lock times since lock profiling was started, or last reset. May be called from any thread.
+    AudioLockProfile lockProfile(bool reset = false);
+
+    // While profiling, the number of the current profiling period, and 0 otherwise. For AudioNode.
+    uint32_t profilingEpoch() const { return m_profilingEpoch.load(std::memory_order_relaxed); }
+
+    // Records the graph edits applied from now on, and the parameter values and source starts and stops the
+    // render thread takes up, each with its sample frame, see CommandLog.h. Replaces the recorder recording so
+    // far. Stopping takes the render lock, and completes the log. May be called from any thread but the render
+    // thread.
+    void startRecordingCommands(std::shared_ptr<CommandRecorder> recorder);
+    void stopRecordingCommands();
+
+    // Called from the render path, while recording, by AudioParam as it takes up a value, and by
+    // AudioScheduledSourceNode as it takes up a start or stop time.
+    void recordParamValue(ContextRenderLock &, const AudioParam * param, float value);
+    void recordSchedule(ContextRenderLock &, const AudioNode * node, bool start, double when);
+
     void connect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx = 0, uint32_t srcIdx = 0);
     void disconnect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx = 0, uint32_t srcidx = 0);
 
@@ -88,38 +307,139 @@ public:
 
     void holdSourceNodeUntilFinished(std::shared_ptr<AudioScheduledSourceNode> node);
 
+    // Has a node do, on a background thread of the context's, the initialization and allocation it would
+    // otherwise do as it first renders, see AudioNode::prepare(), for input of inputChannels channels, if known.
+    // onReady, if given, is posted as an event once it's done, and the node can then be connected without a
+    // spike in the render thread's load. Nodes are prepared one at a time, in the order asked; the node must not
+    // be connected meanwhile.
+    void prewarm(std::shared_ptr<AudioNode> node, size_t inputChannels = 0, std::function<void()> onReady = {});
+
+    // Starts loading, in the background, what nodes would otherwise load as they are made or first render: the
+    // HRTF database in hrtfSearchPath, if given, which the context holds so that panners made with the same search
+    // path share it rather than wait for their own; and the FFT setups of the sizes from 128 to largestFFTSize,
+    // which the convolvers, analysers and HRTF panners share. Call it once the destination is set, as soon as the
+    // context is made; see startupTimings() for when each finishes.
+    void preload(const std::string & hrtfSearchPath, size_t largestFFTSize = 32768);
+
+    // The seconds since the context was made at which each phase of its startup completed, see AudioStartupPhase.
+    // May be called from any thread.
+    AudioStartupTimings startupTimings() const;
+
+    // Records the time a phase of the startup completed, the first time it's called for the phase. Lock free, for
+    // the destinations, and the context's own threads.
+    void markStartupPhase(AudioStartupPhase phase);
+
+    // Whether a scheduled source node in the render schedule is playing, or is yet to play. Render thread only.
+    bool hasPendingScheduledSources(ContextRenderLock &);
+
     // Necessary to call when using an OfflineAudioDestinationNode
     void startRendering();
+
+    // Attaches a context to this one, its host, which renders it in its own render callback and mixes it into its
+    // own output, and updates its graph on its own graph update thread; the guest has no device stream or threads
+    // of its own, and a guest without render workers of its own shares the host's. Suspending the host suspends
+    // its guests. The guest must have an AttachedAudioDestinationNode, be attached before it is initialized, and
+    // render at the host's sample rate and quantum size, see Sound::MakeAttachedAudioContext(). A guest is
+    // detached as it is destroyed, which must be before its host is. Throws std::invalid_argument if the guest
+    // can't be attached.
+    void attachContext(AudioContext & guest);
+    bool isAttached() const;
+
+    // Renders the attached contexts, and mixes them into destinationBus. Only an AudioDestinationNode should call
+    // this, after it has rendered its own graph.
+    void renderAttachedContexts(ContextRenderLock &, AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess);
+
+    // Stops the audio device, and parks the graph update thread, until resume(), so that a paused context costs
+    // next to nothing. The sample clock stands still meanwhile, so scheduled sources and automation carry on from
+    // where they were. Graph edits made while suspended are applied, and are heard on resume. A context suspended
+    // before it's initialized starts suspended. An offline context isn't suspended. From one thread at a time.
+    void suspend();
+    void resume();
+    bool isSuspended() const { return m_suspended.load(std::memory_order_acquire); }
+
+    // An offline context has no graph update thread. Its pending graph edits, deferred tasks and releases, and
+    // events are handled by this instead, when anything is pending. Only an OfflineAudioDestinationNode should
+    // call this, on its render thread before each quantum.
+    void updateOfflineGraph();
     std::function<void()> offlineRenderCompleteCallback;
 
+    // An event is a small, trivially copyable record. Events are posted to a preallocated ring, so posting
+    // one from the render thread never allocates or blocks.
+    struct Event
+    {
+        static const size_t PayloadSize = 48;
+
+        void (*callback)(void * payload);
+        alignas(8) unsigned char payload[PayloadSize];
+    };
+
+    // Realtime safe: posts callback(payload) to be run by dispatchEvents(). payloadSize bytes, at most
+    // Event::PayloadSize, are copied from payload into the event. If the ring is full the event is dropped,
+    // counted by eventOverflowCount(), and false is returned.
+    bool enqueueEvent(void (*callback)(void * payload), const void * payload = nullptr, size_t payloadSize = 0);
+
+    // Posts a copy of fn. This allocates, and is meant for callers that are not on the render thread.
+    void enqueueEvent(std::function<void()>&);
+
+    // The number of events dropped because the event ring was full.
+    uint64_t eventOverflowCount() const;
+
     // event dispatching will be called automatically, depending on constructor
     // argument. If not automatically dispatching, it is the user's responsibility
     // to call dispatchEvents often enough to satisfy the user's needs.
-    void enqueueEvent(std::function<void()>&);
+    // Each call drains at most one ring's worth of events, and it must only be called from one thread at a time.
     void dispatchEvents();
 
 private:
 
     std::mutex m_graphLock;
     std::mutex m_renderLock;
-    std::mutex m_updateMutex;
     std::condition_variable cv;
 
     std::atomic<bool> updateThreadShouldRun{ true };
+    std::atomic<bool> m_suspended{ false };
     std::thread graphUpdateThread;
     void update();
-    float graphKeepAlive{ 0.f };
-    float lastGraphUpdateTime{ 0.f };
+    void updateGraph(); // one pass of the update thread's work
+    void updateGraphIfPending();
+    std::chrono::steady_clock::time_point updateAttachedContexts(); // returns when the next falls due
+    void detachContext(AudioContext & guest);
+    void notifyUpdateThread();
+    bool drainGraphCommands(); // returns true if a transaction was drained
+    void commitGraphEdits(std::vector<GraphTransaction::Edit> && edits);
+    void queueDirtyJunction(ContextGraphLock &, std::shared_ptr<AudioSummingJunction> junction); // see AudioSummingJunction::setDirty()
 
     bool m_isInitialized = false;
     bool m_isAudioThreadFinished = false;
     bool m_isOfflineContext = false;
-    bool m_automaticPullNodesNeedUpdating = false; // keeps track if m_automaticPullNodes is modified.
+    size_t m_renderQuantumSize = AudioNode::ProcessingSizeInFrames;
+    uint64_t m_currentRenderQuantum = 0; // advanced by handlePostRenderTasks() on the render thread
 
     void uninitialize();
 
-    void handleAutomaticSources();
-    void updateAutomaticPullNodes();
+    void handleAutomaticSources(); // called on the update thread
+
+    // Rebuilds the flattened, topologically sorted render schedule from the current graph connections.
+    // Called on the graph update thread whenever the topology has changed.
+    void compileRenderSchedule(ContextGraphLock &);
+    void processScheduledNode(ContextRenderLock &, size_t step, size_t framesToProcess);
+    void updatePathLatencies(ContextRenderLock &); // of the render schedule, see pathLatency()
+    void updateTransport(ContextRenderLock &); // at the start of each quantum, see transport()
+    std::atomic<bool> m_renderScheduleNeedsUpdating{ true };
+    std::atomic<bool> m_graphOptimization{ false };
+    std::atomic<size_t> m_parallelKernelThreshold{ 0 };
+    std::atomic<size_t> m_channelLimit{ maxNumberOfChannels };
+
+    std::atomic<uint32_t> m_profilingEpoch{ 0 };
+
+    // See setLockProfiling(). The locks time themselves with lockTicks(), and record each acquisition as they
+    // release it, so that the records of a lock are only written by its holder.
+    std::atomic<bool> m_lockProfiling{ false };
+    static uint64_t lockTicks();
+    void recordLockUse(bool renderLock, const char * holder, const ContextLockTiming & timing);
+
+    // The duration of a render quantum, or 0 before there's a destination.
+    double quantumSeconds() const;
 
     std::shared_ptr<AudioDestinationNode> m_destinationNode;
     std::shared_ptr<AudioListener> m_listener;
@@ -129,9 +449,9 @@ private:
     struct Internals;
     std::unique_ptr<Internals> m_internal;
 
-    std::set<std::shared_ptr<AudioNode>> m_automaticPullNodes; // queue for added pull nodes
-    std::vector<std::shared_ptr<AudioNode>> m_renderingAutomaticPullNodes; // vector of known pull nodes
+    std::set<std::shared_ptr<AudioNode>> m_automaticPullNodes; // owned by the update thread, edited with the graph lock held
 
+    // Sources disconnected once they finish, see holdSourceNodeUntilFinished(). Owned by the update thread.
     std::vector<std::shared_ptr<AudioScheduledSourceNode>> automaticSources;
 
     enum class ConnectionType : int
@@ -148,7 +468,8 @@ private:
         std::shared_ptr<AudioNode> source;
         uint32_t destIndex;
         uint32_t srcIndex;
-        float duration = 0.1f;
+        std::chrono::steady_clock::time_point deadline; // a FinishDisconnect completes by then even if its ramp hasn't
+        double due = 0; // context time at which a deferred Connect is made
 
         PendingConnection(
             std::shared_ptr<AudioNode> destination,
@@ -159,21 +480,18 @@ private:
         : type(t), destination(destination), source(source), destIndex(destIndex), srcIndex(srcIndex) { }
     };
 
-    struct CompareScheduledTime
+    struct LaterDue
     {
-        bool operator()(const PendingConnection & p1, const PendingConnection & p2)
-        {
-            if (!p1.destination || !p2.destination) return false;
-            if (!p2.destination->isScheduledNode()) return false; // src cannot be compared
-            if (!p1.destination->isScheduledNode()) return false; // dest cannot be compared
-            AudioScheduledSourceNode * ap2 = static_cast<AudioScheduledSourceNode*>(p2.destination.get());
-            AudioScheduledSourceNode * ap1 = static_cast<AudioScheduledSourceNode*>(p1.destination.get());
-            return ap2->startTime() < ap1->startTime();
-        }
+        bool operator()(const PendingConnection & p1, const PendingConnection & p2) const { return p1.due > p2.due; }
     };
 
-    std::priority_queue<PendingConnection, std::deque<PendingConnection>, CompareScheduledTime> pendingNodeConnections;
-    std::queue<std::tuple<std::shared_ptr<AudioParam>, std::shared_ptr<AudioNode>, uint32_t>> pendingParamConnections;
+    // Owned by the update thread. Edits drained from the graph command queue, in the order they were made; the
+    // connections of scheduled sources that start beyond the lookahead, in a min-heap of when they fall due, so
+    // that each is touched only when it is pushed and when it is made; and the disconnections whose ramps are
+    // in flight, which are short lived.
+    std::vector<PendingConnection> pendingNodeConnections;
+    std::priority_queue<PendingConnection, std::vector<PendingConnection>, LaterDue> deferredConnections;
+    std::vector<PendingConnection> disconnectionsInFlight;
 };
 
 } // End namespace lab
@@ -7,6 +7,7 @@
 
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioIOCallback.h"
+#include "LabSound/core/AudioRenderHealth.h"
 
 
 namespace lab {
@@ -34,6 +35,12 @@ public:
     // It will optionally give us local/live audio input in sourceBus (if it's not 0).
     virtual void render(AudioBus * sourceBus, AudioBus * destinationBus, size_t numberOfFrames) override;
 
+    // Counts the xrun, and posts an event for it if the context asks for them.
+    virtual void reportXrun() override;
+
+    // See AudioContext::renderHealth().
+    AudioRenderHealth renderHealth(bool reset);
+
     uint64_t currentSampleFrame() const;
     double currentTime() const;
     double currentSampleTime() const; // extrapolated exact time
@@ -42,8 +49,24 @@ public:
 
     virtual void startRendering() = 0;
 
+    // Stops the device calling render() until startRendering(), where the destination can. Otherwise, and for the
+    // callbacks in flight as it stops, render() fills silence without pulling the graph while the context is suspended.
+    virtual void stopRendering() { }
+
     float sampleRate() const { return m_sampleRate; }
 
+    // The seconds between the destination rendering a frame and its being handed to the audio hardware.
+    virtual double baseLatency() const { return 0; }
+
+    // The seconds between a frame being handed to the audio hardware and its being played, where known.
+    virtual double outputLatency() const { return 0; }
+
+    // The seconds between a frame arriving at the hardware's input and its being handed to the graph, where known.
+    virtual double inputLatency() const { return 0; }
+
+    // The seconds between a frame arriving at the input and the graph's response to it being played.
+    virtual double roundTripLatency() const { return inputLatency() + baseLatency() + outputLatency(); }
+
     AudioSourceProvider * localAudioInputProvider();
     
 protected:
@@ -55,6 +78,13 @@ protected:
     AudioContext * m_context;
 
 private:
+
+    // Render deadline and xrun counters, written by the render thread and by whichever thread reports xruns.
+    struct RenderHealth;
+    std::unique_ptr<RenderHealth> m_health;
+
+    void recordRender(double load, double lockWait, double renderedSeconds);
+    void postHealthEvent(AudioRenderHealthEvent::Type type, double time, double load);
 };
 
 } // namespace lab
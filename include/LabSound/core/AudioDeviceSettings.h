@@ -0,0 +1,69 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioDeviceSettings_h
+#define AudioDeviceSettings_h
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace lab {
+
+class AudioBus;
+
+// How a realtime context talks to the audio hardware. The defaults give each platform's usual destination; the
+// rest only matter to the backends that use them.
+struct AudioDeviceSettings
+{
+    enum class Backend
+    {
+        Default,
+
+        // RtAudio, over whichever API LabSound was built for.
+        RtAudio,
+
+        // On Linux, ALSA or JACK directly, if LabSound was built for it, for periods as short as the render
+        // quantum. Either falls back on RtAudio if the device can't be opened.
+        Alsa,
+        Jack,
+
+        // No hardware at all: a clock paces the rendering as a device would, and each quantum is handed to
+        // nullOutput. For servers without an audio device.
+        Null
+    };
+
+    Backend backend = Backend::Default;
+
+    // The device is probed and opened on a thread of its own, so that Sound::MakeRealtimeAudioContext() returns
+    // without waiting for it. The graph can be built meanwhile, and rendering starts as soon as the device is open.
+    // The destination's latencies are 0 until then. If the device can't be opened the context never renders.
+    bool openInBackground = false;
+
+    // The ALSA PCM, "default" if empty, or "hw:0,0" and the like to bypass the sound server and plugins; or the
+    // JACK client's name, "LabSound" if empty.
+    std::string deviceName;
+
+    // ALSA's buffer holds this many periods of the render quantum. Two is the least latency, three rides out a
+    // late wake.
+    unsigned periodCount = 2;
+
+    // ALSA writes straight into the device's buffer where it allows, instead of copying through the driver.
+    bool mmap = true;
+
+    // The SCHED_FIFO priority of ALSA's render thread, or 0 to leave it at the default scheduling. JACK's
+    // thread is scheduled by its server.
+    int realtimePriority = 80;
+
+    // The Null backend calls this on its render thread with every quantum rendered, and the sample frame at which
+    // the quantum starts. The bus is only valid for the call.
+    std::function<void(const AudioBus & bus, uint64_t sampleFrame)> nullOutput;
+
+    // How many seconds ahead of its clock the Null backend may render. At 0 each quantum is rendered as it falls
+    // due; more renders in bursts, for a consumer that buffers, and is reported as the base latency.
+    double nullLookahead = 0;
+};
+
+} // namespace lab
+
+#endif // AudioDeviceSettings_h
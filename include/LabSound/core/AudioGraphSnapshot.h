@@ -0,0 +1,73 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioGraphSnapshot_h
+#define AudioGraphSnapshot_h
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+class AudioNode;
+
+// The render graph of a context as it was when snapshotted, see AudioContext::snapshotGraph(): every node reachable
+// upstream of the destination and the automatic pull nodes, and the connections between them. Nodes are referred
+// to by their index in nodes.
+struct AudioGraphSnapshot
+{
+    struct Param
+    {
+        std::string name;
+        float value = 0;                   // the smoothed intrinsic value, without automation or connections
+        std::vector<size_t> drivers;       // the nodes connected to the parameter
+    };
+
+    struct Node
+    {
+        std::string type;                  // the node's class, such as "GainNode"
+        const AudioNode * node = nullptr;  // tells instances apart; not to be dereferenced once the graph changes
+
+        size_t channelCount = 0;
+        std::vector<size_t> inputChannels;  // per input, the most channels of the connections into it
+        std::vector<size_t> outputChannels; // per output
+        std::vector<Param> params;
+
+        bool dormant = false;              // see AudioNode::isDormant()
+        double silentSeconds = 0;          // how long the node's inputs have been silent
+
+        // Read by the render thread for the snapshot; negative if it didn't render in time, or the node is only
+        // pulled by another, as in a feedback cycle.
+        double latencySeconds = -1;
+        double tailSeconds = -1;
+
+        // From AudioContext::profile(), when profiling; otherwise zero.
+        double meanSeconds = 0;
+        double budgetPercent = 0;
+    };
+
+    struct Connection
+    {
+        size_t source;
+        size_t output;
+        size_t destination;
+        size_t input;
+    };
+
+    double sampleRate = 0;
+    double quantumSeconds = 0;
+    bool profiled = false;
+    std::vector<Node> nodes;               // the destination first
+    std::vector<Connection> connections;
+
+    // Graphviz DOT, one record per node labelled with its inputs, outputs and costs, and an edge per connection,
+    // dashed for parameter connections.
+    std::string toDot() const;
+
+    std::string toJson() const;
+};
+
+} // namespace lab
+
+#endif // AudioGraphSnapshot_h
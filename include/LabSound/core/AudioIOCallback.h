@@ -16,6 +16,10 @@ struct AudioIOCallback
     // render() is called periodically to get the next render quantum of audio into destinationBus.
     // Optional audio input is given in sourceBus (if it's not 0).
     virtual void render(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess) = 0;
+
+    // Called when the device reports that it under or overran since it last asked for audio. May be called from
+    // any thread.
+    virtual void reportXrun() {}
     virtual ~AudioIOCallback() {}
 };
 
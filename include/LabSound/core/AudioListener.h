@@ -6,11 +6,14 @@
 
 #include "LabSound/core/FloatPoint3D.h"
 #include "LabSound/core/AudioParam.h"
+#include <cstdint>
 #include <memory>
 
 namespace lab 
 {
+    class AmbisonicField;
     class AudioParam;
+    class ContextRenderLock;
 
     // AudioListener maintains the state of the listener in the audio scene as defined in the OpenAL specification.
     class AudioListener 
@@ -30,10 +33,34 @@ namespace lab
         std::shared_ptr<AudioParam> m_positionY;
         std::shared_ptr<AudioParam> m_positionZ;
 
+        std::unique_ptr<AmbisonicField> m_ambisonicField;
+
+    public:
+
+        // The listener's position, and its right, front and up axes, which are orthonormal, with the forward vector
+        // as front and the up vector turned to be square to it. The version starts at 1 and changes only when the
+        // listener moves or turns, so that panners can keep what they worked out relative to the listener until it
+        // does.
+        struct Frame
+        {
+            FloatPoint3D position;
+            FloatPoint3D right;
+            FloatPoint3D front;
+            FloatPoint3D up;
+            uint64_t version = 0;
+        };
+
+    private:
+
+        Frame m_frame;
+        FloatPoint3D m_frameForward;
+        FloatPoint3D m_frameUp;
+        uint64_t m_frameSampleFrame = ~0ull;
+
     public:
 
         AudioListener();
-        ~AudioListener() = default;
+        ~AudioListener();
 
         // Position
         void setPosition(float x, float y, float z) { setPosition({ x, y, z }); }
@@ -78,6 +105,15 @@ namespace lab
         // Speed of sound
         void setSpeedOfSound(float speedOfSound) { m_speedOfSound->setValue(speedOfSound); }
         std::shared_ptr<AudioParam> speedOfSound() const { return m_speedOfSound; }
+
+        // The frame for the current render quantum, worked out the first time it's asked for in the quantum. The
+        // context's SpatialBatch asks before any node is rendered, so that panners rendered in parallel only read it.
+        // Only used on the audio thread.
+        const Frame & frame(ContextRenderLock & r);
+
+        // The field PannerNodes using PanningMode::AMBISONIC encode their sources into as the graph is rendered. The
+        // destination decodes it once per render quantum. Only used on the audio thread.
+        AmbisonicField & ambisonicField() const { return *m_ambisonicField; }
     };
 
 } // lab
@@ -0,0 +1,50 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioLockProfile_h
+#define AudioLockProfile_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+// The acquisitions of one of a context's locks by one holder. A holder is named by the suitor its ContextGraphLock
+// or ContextRenderLock was made with, such as "AudioDestinationNode::render" for the render callback.
+struct AudioLockHolderProfile
+{
+    std::string holder;
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;           // the acquisitions that found the lock held, and waited for it
+
+    double meanWaitSeconds = 0;
+    double p99WaitSeconds = 0;        // to within an octave
+    double maxWaitSeconds = 0;
+    double meanHoldSeconds = 0;
+    double p99HoldSeconds = 0;
+    double maxHoldSeconds = 0;
+
+    // The waits of other holders that found the lock held by this one. The holder is read as the wait begins,
+    // so a wait that spans several holders is put down to the first.
+    uint64_t blockedOthers = 0;
+    double blockedOthersSeconds = 0;
+    double maxBlockedOthersSeconds = 0;
+
+    // waitHistogram[i] and holdHistogram[i] count the times from AudioLockProfile::bucketSeconds[i] up to the next.
+    std::vector<uint64_t> waitHistogram;
+    std::vector<uint64_t> holdHistogram;
+};
+
+// A snapshot of the use of a context's locks, see AudioContext::lockProfile(). To find what stalls rendering,
+// look at the render lock's holders that blocked others, and the waits of "AudioDestinationNode::render".
+struct AudioLockProfile
+{
+    std::vector<double> bucketSeconds;              // the lower bounds of the histograms' buckets, an octave apart
+    std::vector<AudioLockHolderProfile> graphLock;  // those that blocked others longest first, then the longest held
+    std::vector<AudioLockHolderProfile> renderLock;
+};
+
+} // namespace lab
+
+#endif // AudioLockProfile_h
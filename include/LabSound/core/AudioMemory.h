@@ -0,0 +1,108 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioMemory_h
+#define AudioMemory_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+class AudioBus;
+class AudioNode;
+
+enum class AudioMemoryCategory
+{
+    Buses,            // the nodes' input, output and scratch buses
+    Samples,          // the audio sources play, such as decoded files and wave tables
+    DelayLines,
+    ImpulseResponses, // convolution kernels, and the convolvers' buffers
+    HRTF,             // the head related transfer functions' kernels
+    Analysis,         // analysers' and meters' histories and spectra
+    Other,
+    _Count
+};
+
+const char * AudioMemoryCategoryName(AudioMemoryCategory category);
+
+// The memory in use by the nodes of a context's render graph, see AudioContext::memoryReport(). Each node reports
+// the bytes it allocated, by category. Memory a node holds a reference to, and which others may hold too, such as
+// a decoded file, a prepared impulse response or the HRTF database, is reported by each holder but counted once.
+struct AudioMemoryReport
+{
+    static const size_t Categories = static_cast<size_t>(AudioMemoryCategory::_Count);
+
+    struct Node
+    {
+        std::string type;                  // the node's class, such as "GainNode"
+        const AudioNode * node = nullptr;  // tells instances apart; not to be dereferenced once the graph changes
+        size_t bytes[Categories] = {};     // what the node allocated itself
+        std::vector<size_t> shared;        // indices in shared of what the node holds
+
+        size_t total() const;
+    };
+
+    struct Shared
+    {
+        AudioMemoryCategory category;
+        const void * owner = nullptr;
+        size_t bytes = 0;
+        size_t holders = 0;                // the nodes holding it
+
+        // The owner's reference count when it was reported, or 0 if it isn't reference counted. More references
+        // than holders means the owner is also held outside the graph's nodes, by the application for instance.
+        long references = 0;
+    };
+
+    std::vector<Node> nodes;               // the destination first
+    std::vector<Shared> shared;
+
+    // The shared channel arena, which every context draws its buses from: the bytes of its slabs, and of the
+    // buffers handed out of them. Pooled buses are also counted as Buses by the nodes that hold them.
+    size_t channelArenaBytes = 0;
+    size_t channelArenaBytesInUse = 0;
+
+    // What the nodes allocated plus what they hold, counting each shared owner once.
+    size_t bytes(AudioMemoryCategory category) const;
+    size_t total() const;
+
+    std::string toJson() const;
+};
+
+// Collects the memory of one node for an AudioMemoryReport, see AudioNode::reportMemory().
+class AudioMemoryUsage
+{
+public:
+
+    // A usage given overflowed mustn't allocate, as on the render thread: rather than grow the report's lists past
+    // the room reserved in them, it sets overflowed, and the report is to be made again with more room.
+    AudioMemoryUsage(AudioMemoryReport & report, AudioMemoryReport::Node & node, bool * overflowed = nullptr);
+
+    void add(AudioMemoryCategory category, size_t bytes);
+
+    // Memory the node holds but may share with other nodes, identified by owner, which must outlive the report.
+    void addShared(AudioMemoryCategory category, const void * owner, size_t bytes, long references = 0);
+
+    template <typename T>
+    void addShared(AudioMemoryCategory category, const std::shared_ptr<T> & owner, size_t bytes)
+    {
+        if (owner)
+            addShared(category, owner.get(), bytes, owner.use_count());
+    }
+
+    // Adds what a bus allocated, see AudioBus::memoryBytes(); a null bus adds nothing.
+    void addBus(const AudioBus * bus, AudioMemoryCategory category = AudioMemoryCategory::Buses);
+
+private:
+
+    AudioMemoryReport & m_report;
+    AudioMemoryReport::Node & m_node;
+    bool * m_overflowed;
+};
+
+} // namespace lab
+
+#endif // AudioMemory_h
@@ -12,6 +12,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -27,6 +28,10 @@ enum PanningMode
     PANNING_NONE = 0,
     EQUALPOWER = 10,
     HRTF = 20,
+
+    // Encoded into the listener's ambisonic field, which is decoded to binaural once for all such sources. The
+    // PannerNode's own output is silent; the sound is heard from the destination.
+    AMBISONIC = 30,
 };
 
 enum FilterType
@@ -52,13 +57,16 @@ enum class OscillatorType
     CUSTOM = 5
 };
 
+class AudioBus;
 class AudioContext;
+class AudioMemoryUsage;
 class AudioNodeInput;
 class AudioNodeOutput;
 class AudioParam;
 class AudioSetting;
 class ContextGraphLock;
 class ContextRenderLock;
+struct NodeProfileRecord;
 
 // An AudioNode is the basic building block for handling audio within an AudioContext.
 // It may be an audio source, an intermediate processing module, or an audio destination.
@@ -69,6 +77,8 @@ class AudioNode
 {
 public:
 
+    // The default render quantum. A context may render in other quantum sizes, see AudioContext::renderQuantumSize();
+    // nodes size their buses and scratch buffers from the context they render in rather than from this value.
     enum
     {
         ProcessingSizeInFrames = 128
@@ -109,11 +119,28 @@ public:
     // Called from context's audio thread.
     void processIfNecessary(ContextRenderLock& r, size_t framesToProcess);
 
+    // Returns true if processIfNecessary() has already begun processing this node during the current render quantum.
+    bool isProcessedThisQuantum(ContextRenderLock& r) const;
+
     // Called when a new connection has been made to one of our inputs or the connection number of channels has changed.
     // This potentially gives us enough information to perform a lazy initialization or, if necessary, a re-initialization.
     // Called from main thread.
     virtual void checkNumberOfChannelsForInput(ContextRenderLock&, AudioNodeInput*);
 
+    // Does ahead of time what the node would otherwise do as it first renders, so that adding it to a playing
+    // graph costs the render thread nothing out of the ordinary: initializes it, sizes its outputs and per channel
+    // state for input of inputChannels channels, unless 0, grows its scratch buffers to the context's render
+    // quantum, and waits for what it loads in the background. Called off the render thread, before the node is
+    // connected, see AudioContext::prewarm(); the render lock is only taken to swap in new buses. Overrides call
+    // the base.
+    virtual void prepare(AudioContext & context, size_t inputChannels);
+
+    // Adds the memory the node allocated, and that which it holds a share of, to usage, see
+    // AudioContext::memoryReport(). The base reports the buses of the inputs and outputs; overrides call it, and
+    // add their own buffers. Called with the render lock held, by the render thread at the start of a quantum, or
+    // by the caller of memoryReport() while the context isn't rendering; so it must neither allocate nor block.
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const;
+
     // tailTime() is the length of time (not counting latency time) where non-zero output may occur after continuous silent input.
     virtual double tailTime(ContextRenderLock & r) const = 0;
 
@@ -126,10 +153,31 @@ public:
     // will take tailTime() and latencyTime() into account when determining whether the node will propagate silence.
     virtual bool propagatesSilence(ContextRenderLock & r) const;
 
+    // True for a node whose outputs may alias the channel memory of its input buses instead of copying it, as
+    // ChannelSplitterNode and ChannelMergerNode do. The render schedule then keeps the buses feeding it for the
+    // whole quantum rather than lending them on.
+    virtual bool aliasesInputs() const { return false; }
+
+    // Renders the node at control rate, one value for every stride frames, for nodes such as low frequency
+    // oscillators that only drive parameters; the parameters interpolate linearly between the values, a stride
+    // behind. Only nodes that support it do, and only in quanta where each output is mono and connected to
+    // parameters alone, no declick ramp is under way, and the stride divides the quantum; otherwise they render
+    // at the full rate. A stride of 1, the default, is the full rate. May be called from any thread.
+    void setControlRate(size_t stride) { m_controlRate.store(static_cast<uint32_t>(stride ? stride : 1), std::memory_order_relaxed); }
+    size_t controlRate() const { return m_controlRate.load(std::memory_order_relaxed); }
+    virtual bool supportsControlRate() const { return false; }
+
     bool inputsAreSilent(ContextRenderLock&);
     void silenceOutputs(ContextRenderLock&);
     void unsilenceOutputs(ContextRenderLock&);
 
+    // A node is dormant after a quantum in which it rendered silence because its inputs were silent and it
+    // propagates silence, that is its tail has elapsed. The render schedule doesn't process a dormant node
+    // while it still propagates silence and everything feeding its inputs is dormant too, so that idle
+    // subgraphs cost next to nothing until a source starts or a connection changes.
+    bool isDormant() const { return m_dormant; }
+
+    // Throws std::invalid_argument for a count above the context's channelLimit().
     size_t channelCount();
     virtual void setChannelCount(ContextGraphLock & g, size_t count);
 
@@ -150,6 +198,10 @@ public:
     std::shared_ptr<AudioParam> getParam(char const * const str);
     std::shared_ptr<AudioSetting> getSetting(char const * const str);
 
+    // By index in params() and settings(), or null past the end.
+    std::shared_ptr<AudioParam> paramAt(size_t index) const { return index < m_params.size() ? m_params[index] : nullptr; }
+    std::shared_ptr<AudioSetting> settingAt(size_t index) const { return index < m_settings.size() ? m_settings[index] : nullptr; }
+
     // USER FACING FUNCTIONS <
     
 protected:
@@ -167,6 +219,19 @@ protected:
     // Force all inputs to take any channel interpretation changes into account.
     void updateChannelsForInputs(ContextGraphLock&);
 
+    // Stands in for processIfNecessary() when the render schedule's graph optimization lets the node hand on the
+    // bus it was fed as its first output's result, see AudioContext::setGraphOptimization(). Returns false, and
+    // leaves the node to be processed, while a declick ramp is under way or the bus doesn't match the output.
+    bool renderPassThrough(ContextRenderLock&, AudioBus * bus, size_t framesToProcess);
+
+    // False while a declick ramp is under way, which scales the outputs in place after process(), so that they
+    // can't alias memory the node doesn't own.
+    bool rampsSettled() const { return m_disconnectRamp == RampInactive && m_connectRamp == RampComplete; }
+
+    // During process(), the frames each value rendered stands for, see setControlRate(). The node renders
+    // framesToProcess / controlStride() values at the start of its output buses.
+    size_t controlStride() const { return m_controlStride; }
+
 private:
 
     friend class AudioContext;
@@ -176,38 +241,79 @@ private:
     std::vector<std::shared_ptr<AudioNodeInput>> m_inputs;
     std::vector<std::shared_ptr<AudioNodeOutput>> m_outputs;
 
-    double m_lastProcessingTime{ -1.0 };
-    double m_lastNonSilentTime{ -1.0 };
+    uint64_t m_lastProcessingQuantum{ UINT64_MAX }; // the context's render quantum index when last processed
+    int64_t m_lastNonSilentFrame{ -1 };             // the sample frame following the last non-silent input
+    bool m_dormant{ false };
 
-    float audibleThreshold() const { return 0.05f; }
+    // Stands in for processIfNecessary() while the node remains dormant: its outputs stay silent.
+    void renderDormant(ContextRenderLock&);
+
+    // Stands in for processIfNecessary() when a consumer renders straight from this node's input instead, see
+    // AudioContext::setGraphOptimization(). Nothing reads the outputs this quantum, so they are left as they are.
+    void renderBypassed(ContextRenderLock&);
+
+    // The declick ramps hold the number of frames of the context's fade curve applied so far, or one of these.
+    enum : int32_t
+    {
+        RampInactive = -1,
+        RampComplete = INT32_MAX
+    };
 
     // starts an immediate ramp to zero in preparation for disconnection
     void scheduleDisconnect()
     {
-        m_disconnectSchedule = 1.f;
-        m_connectSchedule = 1.f;
+        m_disconnectRamp = 0;
+        m_connectRamp = RampComplete;
     }
 
     // returns true if the disconnection ramp has reached zero.
     // This is intended to allow the AudioContext to manage popping artifacts
-    bool disconnectionReady() const { return m_disconnectSchedule >= 0.f && m_disconnectSchedule <= audibleThreshold(); }
+    bool disconnectionReady() const { return m_disconnectRamp == RampComplete; }
 
     // starts an immediate ramp to unity due to being newly connected to a graph
     void scheduleConnect()
     {
-        m_disconnectSchedule = -1.f;
-        m_connectSchedule = 0.f;
+        m_disconnectRamp = RampInactive;
+        m_connectRamp = 0;
     }
 
     // returns true if the connection has ramped to unity
     // This is intended to signal when the danger of possible popping artifacts has passed
-    bool connectionReady() const { return m_connectSchedule > (1.f - audibleThreshold()); }
+    bool connectionReady() const { return m_connectRamp == RampComplete; }
+
+    // Applies the declick ramps to the outputs after process(). Called on the audio thread.
+    void applyDeclickRamps(ContextRenderLock&);
+
+    // Choose the stride the outputs are rendered at this quantum, and keep the last values rendered for the
+    // parameters to interpolate from the next.
+    void beginControlRender(ContextRenderLock&, size_t framesToProcess);
+    void endControlRender(ContextRenderLock&, size_t framesToProcess);
 
-    std::atomic<float> m_disconnectSchedule{ -1.f };
-    std::atomic<float> m_connectSchedule{ 0.f };
+    std::atomic<uint32_t> m_controlRate{ 1 };
+    size_t m_controlStride{ 1 };
+
+    std::atomic<int32_t> m_disconnectRamp{ RampInactive };
+    std::atomic<int32_t> m_connectRamp{ 0 };
+
+    // The node's render times, see AudioContext::setProfiling(). Only kept when LabSound is built with
+    // LABSOUND_PROFILER.
+    std::shared_ptr<NodeProfileRecord> m_profile;
+
+    // The latency and tail, read by the render thread for the graph snapshot of the generation given, see
+    // AudioContext::snapshotGraph().
+    std::atomic<double> m_reportedLatency{ 0 };
+    std::atomic<double> m_reportedTail{ 0 };
+    std::atomic<uint32_t> m_reportedGeneration{ 0 };
+
+    // The latency between the node's output and the destination's, or negative where it doesn't reach it, see
+    // AudioContext::pathLatency(). Written by the render thread.
+    std::atomic<double> m_pathLatency{ -1 };
 
 protected:
 
+    // The channels of the first input, given a connection of inputChannels, by the node's channel count mode.
+    size_t channelsForInput(size_t inputChannels) const;
+
     std::vector<std::shared_ptr<AudioParam>> m_params;
     std::vector<std::shared_ptr<AudioSetting>> m_settings;
     size_t m_channelCount;
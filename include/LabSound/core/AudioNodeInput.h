@@ -45,10 +45,17 @@ public:
     // bus() contains the rendered audio after pull() has been called for each time quantum.
     AudioBus* bus(ContextRenderLock&);
     
-    // updateInternalBus() updates m_internalSummingBus appropriately for the number of channels.
+    // updateInternalBus() updates m_internalSummingBus appropriately for the number of channels and the render quantum size.
     // This must be called when we own the context's graph lock in the audio thread at the very start or end of the render quantum.
     void updateInternalBus(ContextRenderLock&);
 
+    // Called by the context's render schedule around our AudioNode's processing to lend a shared summing bus,
+    // which is used if its topology matches the internal one. Pass nullptr to return it.
+    void setSharedSummingBus(ContextRenderLock&, AudioBus * sharedBus) { m_sharedSummingBus = sharedBus; }
+
+    // The summing bus the input allocated, rather than one lent to it.
+    const AudioBus * internalBus(ContextRenderLock&) const { return m_internalSummingBus.get(); }
+
     // The number of channels of the connection with the largest number of channels.
     // Only valid during render quantum because it is dependent on the active bus
     size_t numberOfChannels(ContextRenderLock&) const;
@@ -58,6 +65,9 @@ private:
     AudioNode * m_node;
 
     std::unique_ptr<AudioBus> m_internalSummingBus;
+    AudioBus * m_sharedSummingBus = nullptr;
+
+    AudioBus * summingBus();
 };
 
 } // namespace lab
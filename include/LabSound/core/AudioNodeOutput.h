@@ -34,9 +34,29 @@ public:
     // Called from context's audio thread.
     AudioBus * pull(ContextRenderLock&, AudioBus* inPlaceBus, size_t framesToProcess);
 
+    // Called by the context's render schedule just before our AudioNode is processed. Consumers read the result
+    // later in the quantum instead of pulling it, so processing is directed into sharedBus, which the schedule
+    // lends to outputs whose results are never needed at the same time, or else into the internal bus.
+    // Called from context's audio thread.
+    void prepareScheduledRender(ContextRenderLock&, AudioBus * sharedBus);
+
+    // Stops rendering into sharedBus, called before the schedule owning it is retired.
+    void releaseSharedBus(ContextRenderLock&, AudioBus * sharedBus);
+
+    // Makes bus this quantum's result instead of the bus the node would have rendered into, for a source whose
+    // audio is already in memory. It must have the output's channel count and the quantum's length, and outlive
+    // the quantum. Called from the node's process().
+    void setRenderedBus(ContextRenderLock&, AudioBus * bus);
+
     // bus() will contain the rendered audio after pull() is called for each rendering time quantum.
     AudioBus * bus(ContextRenderLock&) const;
 
+    // The frames each value of the bus stands for this quantum. More than one when the node renders at control
+    // rate, see AudioNode::setControlRate(); the values are then the first of the bus's frames, and controlCarry()
+    // is the last value of the quantum before.
+    size_t renderedStride() const { return m_renderedStride; }
+    float controlCarry() const { return m_controlCarry; }
+
     // renderingFanOutCount() is the number of AudioNodeInputs that we're connected to during rendering.
     // Unlike fanOutCount() it will not change during the course of a render quantum.
     size_t renderingFanOutCount() const;
@@ -63,8 +83,10 @@ private:
 
     AudioNode * m_node;
 
+    friend class AudioNode;
     friend class AudioNodeInput;
     friend class AudioParam;
+    friend class AudioContext;
     
     // These are called from AudioNodeInput.
     // They must be called with the context's graph lock.
@@ -83,9 +105,9 @@ private:
     // It must be called with the context's graph lock.
     size_t paramFanOutCount();
 
-    // updateInternalBus() updates m_internalBus appropriately for the number of channels.
-    // It is called in the constructor or in the audio thread with the context's graph lock.
-    void updateInternalBus();
+    // updateInternalBus() updates m_internalBus appropriately for the number of channels and the render quantum size.
+    // It is called in the audio thread; the bus it replaces is released on the graph update thread.
+    void updateInternalBus(ContextRenderLock&);
 
     // Announce to any nodes we're connected to that we changed our channel count for its input.
     void propagateChannelCount(ContextRenderLock&);
@@ -110,6 +132,11 @@ private:
     size_t m_renderingFanOutCount;
     size_t m_renderingParamFanOutCount;
 
+    // Render thread only, see renderedStride().
+    size_t m_renderedStride = 1;
+    float m_controlCarry = 0;
+    float m_controlLast = 0;
+
     std::set<std::shared_ptr<AudioParam>> m_params;
     typedef std::set<AudioParam*>::iterator ParamsIterator;
 };
@@ -10,6 +10,7 @@
 #include "LabSound/core/AudioSummingJunction.h"
 
 #include <sys/types.h>
+#include <atomic>
 #include <string>
 
 namespace lab {
@@ -27,7 +28,8 @@ public:
     // AudioSummingJunction
     virtual void didUpdate(ContextRenderLock&) override { }
 
-    // Intrinsic value.
+    // Intrinsic value. setValue may be called from any thread; the value is handed to the render thread,
+    // which takes it up the next time it reads the parameter.
     float value(ContextRenderLock&);
     void setValue(float);
 
@@ -51,7 +53,11 @@ public:
     // Returns true if smoothed value has already snapped exactly to value.
     bool smooth(ContextRenderLock&);
 
-    void resetSmoothedValue() { m_smoothedValue = m_value; }
+    // As smooth(), approaching the value frame by frame over the quantum, at the rate smooth() takes a quantum
+    // at, and writing the smoothed values to values. If true is returned, values holds the value throughout.
+    bool smooth(ContextRenderLock&, float* values, size_t framesToProcess);
+
+    void resetSmoothedValue(ContextRenderLock&);
     void setSmoothingConstant(double k) { m_smoothingConstant = k; }
 
     // Parameter automation.    
@@ -59,10 +65,17 @@ public:
     void linearRampToValueAtTime(float value, float time) { m_timeline.linearRampToValueAtTime(value, time); }
     void exponentialRampToValueAtTime(float value, float time) { m_timeline.exponentialRampToValueAtTime(value, time); }
     void setTargetAtTime(float target, float time, float timeConstant) { m_timeline.setTargetAtTime(target, time, timeConstant); }
-    void setValueCurveAtTime(std::vector<float> curve, float time, float duration) { m_timeline.setValueCurveAtTime(curve, time, duration); }
+    void setValueCurveAtTime(std::vector<float> curve, float time, float duration) { m_timeline.setValueCurveAtTime(std::move(curve), time, duration); }
+    void setValueCurveAtTime(std::shared_ptr<const std::vector<float>> curve, float time, float duration) { m_timeline.setValueCurveAtTime(std::move(curve), time, duration); }
     void cancelScheduledValues(float startTime) { m_timeline.cancelScheduledValues(startTime); }
 
-    bool hasSampleAccurateValues() { return m_timeline.hasValues() || numberOfConnections(); }
+    bool hasSampleAccurateValues() { return m_timeline.hasValues() || isConnected(); }
+
+    // True if the value doesn't change over the framesToProcess frames starting at the context's current time:
+    // nothing is connected, and the timeline, if it has events, holds one value then. A node can then take
+    // its scalar path, with value() or smooth(), which snaps to a timeline's value, rather than calculating
+    // sample accurate values.
+    bool isConstantForQuantum(ContextRenderLock&, size_t framesToProcess);
     
     // Calculates numberOfValues parameter values starting at the context's current time.
     // Must be called in the context's render thread.
@@ -78,8 +91,14 @@ private:
     void calculateFinalValues(ContextRenderLock& r, float* values, size_t numberOfValues, bool sampleAccurate);
     void calculateTimelineValues(ContextRenderLock& r, float* values, size_t numberOfValues);
 
+    // Takes up a value given to setValue since the last read, for the context to record, see
+    // AudioContext::startRecordingCommands().
+    void applySetValue(ContextRenderLock&);
+
     std::string m_name;
     double m_value;
+    std::atomic<float> m_setValue;
+    std::atomic<bool> m_hasSetValue{ false };
     double m_defaultValue;
     double m_minValue;
     double m_maxValue;
@@ -90,9 +109,6 @@ private:
     double m_smoothingConstant;
     
     AudioParamTimeline m_timeline;
-    
-    struct Data;
-    std::unique_ptr<Data> m_data;
 };
 
 } // namespace lab
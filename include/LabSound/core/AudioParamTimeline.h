@@ -6,23 +6,36 @@
 #define AudioParamTimeline_h
 
 #include "LabSound/core/AudioContext.h"
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <vector>
 
 namespace lab {
 
+// The mutators may be called from any thread. They are checked against the events scheduled so far, and then
+// queued for the render thread, which applies them the next time it reads the timeline. The events
+// themselves are only touched by the render thread, so automation never blocks or glitches rendering.
 class AudioParamTimeline 
 {
 
 public:
 
-    AudioParamTimeline() { }
+    AudioParamTimeline();
+    ~AudioParamTimeline();
 
     void setValueAtTime(float value, float time);
     void linearRampToValueAtTime(float value, float time);
     void exponentialRampToValueAtTime(float value, float time);
     void setTargetAtTime(float target, float time, float timeConstant);
-    void setValueCurveAtTime(std::vector<float> & curve, float time, float duration);
+    void setValueCurveAtTime(std::vector<float> curve, float time, float duration);
+
+    // The curve is held rather than copied, so that many events can play the same one.
+    void setValueCurveAtTime(std::shared_ptr<const std::vector<float>> curve, float time, float duration);
+
+    // Removes the events starting at or after startTime. Events superseded by the time a render needed a later
+    // one may have been pruned, so cancelling the event in progress leaves the param at its current value,
+    // rather than returning it to an earlier one.
     void cancelScheduledValues(float startTime);
 
     // hasValue is set to true if a valid timeline value is returned.
@@ -37,7 +50,12 @@ public:
     float valuesForTimeRange(double startTime, double endTime, float defaultValue, 
                              float* values, size_t numberOfValues, double sampleRate, double controlRate);
 
-    bool hasValues() { return m_events.size() > 0; }
+    // True if the timeline holds a single value from startTime to endTime, which is then returned in value.
+    // value is passed in as the value before the first event, as valuesForTimeRange's defaultValue is.
+    bool isConstantForTimeRange(double startTime, double endTime, float& value);
+
+    // True if there are events, or changes to them not yet applied. Safe to call from any thread.
+    bool hasValues() const;
 
 private:
 
@@ -58,43 +76,24 @@ private:
             LastType
         };
 
-        ParamEvent(Type type, float value, float time, float timeConstant, float duration, std::vector<float> curve)
+        ParamEvent() : ParamEvent(LastType, 0, 0, 0, 0, nullptr) { }
+
+        ParamEvent(Type type, float value, float time, float timeConstant, float duration, std::shared_ptr<const std::vector<float>> curve)
             : m_type(type)
             , m_value(value)
             , m_time(time)
             , m_timeConstant(timeConstant)
             , m_duration(duration)
-            , m_curve(curve)
+            , m_curve(std::move(curve))
         {
         }
 
-        ParamEvent(const ParamEvent& rhs)
-        : m_type(rhs.m_type)
-        , m_value(rhs.m_value)
-        , m_time(rhs.m_time)
-        , m_timeConstant(rhs.m_timeConstant)
-        , m_duration(rhs.m_duration)
-        , m_curve(rhs.m_curve)
-        {
-        }
-
-        const ParamEvent& operator=(const ParamEvent& rhs) {
-
-            m_type = rhs.m_type;
-            m_value = rhs.m_value;
-            m_time = rhs.m_time;
-            m_timeConstant = rhs.m_timeConstant;
-            m_duration = rhs.m_duration;
-            m_curve = rhs.m_curve;
-            return *this;
-        }
-
         unsigned type() const { return m_type; }
         float value() const { return m_value; }
         float time() const { return m_time; }
         float timeConstant() const { return m_timeConstant; }
         float duration() const { return m_duration; }
-        std::vector<float> & curve() { return m_curve; }
+        const std::vector<float> * curve() const { return m_curve.get(); }
 
     private:
         unsigned m_type;
@@ -102,14 +101,37 @@ private:
         float m_time;
         float m_timeConstant;
         float m_duration;
-        std::vector<float> m_curve;
+        std::shared_ptr<const std::vector<float>> m_curve;
     };
 
-    void insertEvent(const ParamEvent&);
+    // Checks the event against those scheduled, throwing if it overlaps a SetValueCurve, and queues it.
+    void insertEvent(ParamEvent&&);
+
+    struct Commands;
+    Commands& commandsForChange();
+
+    // Called by the render thread before it reads the events.
+    void applyCommands(double renderTime);
+    void applyEvent(ParamEvent&&);
+    void applyCancel(float startTime);
+
     float valuesForTimeRangeImpl(double startTime, double endTime, float defaultValue, 
                                  float* values, size_t numberOfValues, double sampleRate, double controlRate);
 
+    // Owned by the render thread. Sorted by time; events at the same time keep the order they were inserted in.
     std::vector<ParamEvent> m_events;
+
+    // The first event the last render needed. Those before it had been superseded by then, and are pruned once
+    // they make up half of the events, so that a long timeline costs a render no more than a short one.
+    size_t m_cursor{ 0 };
+
+    std::atomic<bool> m_hasEvents{ false };
+
+    // Serializes the mutators, and guards the commands' creation. They are made on the first change, so that a
+    // parameter that is never automated has no queue.
+    std::mutex m_commandsMutex;
+    std::unique_ptr<Commands> m_ownedCommands;
+    std::atomic<Commands*> m_commands{ nullptr };
 };
 
 } // namespace lab
@@ -11,6 +11,7 @@ namespace lab
 {
     
 class AudioBus;
+class AudioMemoryUsage;
 class ContextRenderLock;
     
 // AudioProcessor is an abstract base class representing an audio signal processing object with a single input and a single output,
@@ -45,6 +46,9 @@ public:
     virtual double tailTime(ContextRenderLock & r) const = 0;
     virtual double latencyTime(ContextRenderLock & r) const = 0;
 
+    // Adds the memory the processor allocated, see AudioNode::reportMemory().
+    virtual void reportMemory(AudioMemoryUsage &) const { }
+
 protected:
     bool m_initialized = false;
     size_t m_numberOfChannels;
@@ -0,0 +1,44 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioProfile_h
+#define AudioProfile_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+class AudioNode;
+
+// The render time of a node, or of all the nodes of a type, in process() and its declick ramps. The times of
+// inputs pulled by the node are counted by the nodes they come from.
+struct AudioNodeProfile
+{
+    std::string type;                 // the node's class, such as "GainNode"
+    const AudioNode * node = nullptr; // tells instances apart; the node may since have been destroyed. nullptr for a type
+    size_t instances = 0;             // 1 for a node, the number of nodes profiled for a type
+
+    uint64_t calls = 0;               // the number of times process() was timed
+    double minSeconds = 0;
+    double meanSeconds = 0;
+    double p99Seconds = 0;            // to within a quarter of an octave
+    double maxSeconds = 0;
+
+    // The average time per quantum rendered, dormant quanta included, as a percentage of the quantum's duration.
+    double budgetPercent = 0;
+};
+
+// A snapshot of a context's render times, see AudioContext::profile().
+struct AudioProfile
+{
+    double quantumSeconds = 0;
+    uint64_t quanta = 0;                  // the quanta rendered while profiling, since it was started or reset
+    std::vector<AudioNodeProfile> nodes;  // most expensive first
+    std::vector<AudioNodeProfile> types;  // most expensive first
+};
+
+} // namespace lab
+
+#endif // AudioProfile_h
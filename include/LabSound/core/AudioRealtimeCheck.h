@@ -0,0 +1,47 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioRealtimeCheck_h
+#define AudioRealtimeCheck_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+// Something the render thread, or a render worker, did that can block it, and where it was done.
+struct AudioRealtimeViolation
+{
+    enum class Kind { Allocation, Deallocation, Lock };
+
+    Kind kind;
+    uint64_t count = 0;               // the times it was done from this call stack
+    std::vector<std::string> stack;   // innermost call first, symbolized where the platform can
+};
+
+// A debugging aid, available when LabSound is built with LABSOUND_RT_CHECK, which catches allocations, frees
+// and blocking mutex locks made while rendering. Allocations are caught by interposing malloc and free on glibc,
+// and by replacing operator new and delete elsewhere; locks are caught by interposing pthread_mutex_lock, on
+// Linux only. Each distinct call stack is recorded once, with a count, and the graph update logs the ones that
+// are new or recurred, so test scenes flag regressions in realtime safety. The checks slow down every allocation
+// in the process, so this is not for release builds.
+class AudioRealtimeCheck
+{
+public:
+
+    // False if LabSound was built without LABSOUND_RT_CHECK, in which case nothing is ever recorded.
+    static bool available();
+
+    static std::vector<AudioRealtimeViolation> violations();
+
+    // Forgets the violations recorded so far.
+    static void reset();
+
+    // Logs the violations that are new, or were repeated, since they were last logged, and returns their number.
+    static size_t log();
+};
+
+} // namespace lab
+
+#endif // AudioRealtimeCheck_h
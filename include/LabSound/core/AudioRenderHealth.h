@@ -0,0 +1,52 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioRenderHealth_h
+#define AudioRenderHealth_h
+
+#include <cstdint>
+#include <vector>
+
+namespace lab {
+
+// How well the destination's rendering keeps up with the device, see AudioContext::renderHealth(). A render's
+// load is the time it took as a fraction of the duration of the audio it rendered, its deadline; a render that
+// takes longer than its deadline starves the device unless the device buffers more.
+struct AudioRenderHealth
+{
+    static const int LoadBuckets = 16;
+
+    uint64_t renders = 0;
+    uint64_t deadlineMisses = 0;        // renders with a load above 1
+    double meanLoad = 0;
+    double maxLoad = 0;
+
+    // The load averaged over about the last quarter of a second of audio, which a reset leaves alone.
+    double recentLoad = 0;
+
+    // loadHistogram[i] counts the renders with a load from i / 8 to (i + 1) / 8; the last bucket also counts
+    // everything above.
+    uint64_t loadHistogram[LoadBuckets] = {};
+
+    // Under and overruns the device reported, and the context times of the latest of them, oldest first.
+    uint64_t xruns = 0;
+    std::vector<double> recentXrunTimes;
+
+    // The longest the render thread waited to take the render lock, in seconds.
+    double maxRenderLockWait = 0;
+};
+
+// Posted through the context's events when a render misses its deadline or the device reports an xrun, see
+// AudioContext::renderHealthCallback.
+struct AudioRenderHealthEvent
+{
+    enum class Type { DeadlineMiss, Xrun };
+
+    Type type;
+    double time; // the context time it happened at
+    double load; // for a DeadlineMiss, the render's load
+};
+
+} // namespace lab
+
+#endif // AudioRenderHealth_h
@@ -6,6 +6,7 @@
 #define AudioScheduledSourceNode_h
 
 #include "LabSound/core/AudioSourceNode.h"
+#include <atomic>
 #include <functional>
 
 namespace lab {
@@ -29,12 +30,19 @@ public:
     };
 
     AudioScheduledSourceNode();
-    virtual ~AudioScheduledSourceNode() { }
+    virtual ~AudioScheduledSourceNode();
 
     // Scheduling.
     void start(double when);
     void stop(double when);
 
+    // Scheduling in musical time, see AudioContext::setTempoMap(). The render thread turns the beat into a sample
+    // frame by the tempo map in force as it takes the request up, so a start is sample accurate however far ahead
+    // it is asked for, and its connection is made at once rather than deferred by the update thread. A beat that
+    // has passed starts or stops the source at once.
+    void startAtBeat(double beat);
+    void stopAtBeat(double beat);
+
     double startTime() const { return m_startTime; }
 
     unsigned short playbackState() const { return static_cast<unsigned short>(m_playbackState); }
@@ -49,7 +57,7 @@ public:
     // This is to save the cost of a dynamic_cast when scheduling nodes.
     virtual bool isScheduledNode() const override { return true; }
 
-    void setOnEnded(std::function<void()> fn) { m_onEnded = fn; }
+    void setOnEnded(std::function<void()> fn);
 
 protected:
 
@@ -60,13 +68,21 @@ protected:
     // Each frame time is relative to the context's currentSampleFrame().
     // quantumFrameOffset    : Offset frame in this time quantum to start rendering.
     // nonSilentFramesToProcess : Number of frames rendering non-silence (will be <= quantumFrameSize).
-    void updateSchedulingInfo(ContextRenderLock &,
+    //
+    // The source renders exactly frames [quantumFrameOffset, quantumFrameOffset + nonSilentFramesToProcess) of
+    // the bus, the rest having been zeroed. False if no frame of the quantum sounds, in which case the whole bus
+    // has been zeroed and the source should return without rendering.
+    bool updateSchedulingInfo(ContextRenderLock &,
                               size_t quantumFrameSize, AudioBus * outputBus,
                               size_t & quantumFrameOffset, size_t & nonSilentFramesToProcess);
 
     // Called when we have no more sound to play or the noteOff/stop() time has been reached.
     void finish(ContextRenderLock&);
 
+    // Forgets a stop time that has already passed, which is left from an earlier run when a source that finished
+    // is started again.
+    void forgetElapsedEndTime(ContextRenderLock&);
+
     // this is the base declaration
     virtual void clearPannerNode() {}
 
@@ -91,7 +107,27 @@ protected:
     double m_pendingEndTime;
     double m_endTime; // in seconds
 
-    std::function<void()> m_onEnded;
+    // Pending startAtBeat() and stopAtBeat() beats, or NaN.
+    double m_pendingStartBeat;
+    double m_pendingEndBeat;
+
+    // The onended callback lives in a reference counted box shared with the events posted for it, so that
+    // finish() can post an event from the render thread without copying the std::function, and a node
+    // released before its event is dispatched doesn't take the callback with it.
+    struct OnEndedHandler
+    {
+        std::function<void()> fn;
+        std::atomic<int> references{ 1 };
+    };
+
+    static void releaseOnEnded(OnEndedHandler *);
+    static void dispatchOnEnded(void * payload);
+
+    std::atomic<OnEndedHandler *> m_onEnded{ nullptr };
+
+    // Set while finish() loads the handler and posts its event, which setOnEnded() waits out before releasing the
+    // handler it replaced.
+    std::atomic<bool> m_takingOnEnded{ false };
 };
 
 } // namespace lab
@@ -5,6 +5,7 @@
 #ifndef AudioSetting_h
 #define AudioSetting_h
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include <cstdint>
@@ -19,12 +20,17 @@ namespace lab
 // a value changed callback is provided so that if tools set values, they can
 // be responded to.
 //
+// The value is stored atomically, so the render thread may read it while another thread sets it. Every change
+// bumps version(), after the value is stored, so that a node can keep the version its derived state was built
+// for and rebuild that state only when changed() says the setting has moved on.
+//
 class AudioSetting
 {
     std::string _name;
-    float _valf = 0;
-    uint32_t _vali = 0;
-    bool _asFloat = false;
+    std::atomic<float> _valf{ 0 };
+    std::atomic<uint32_t> _vali{ 0 };
+    std::atomic<bool> _asFloat{ false };
+    std::atomic<uint32_t> _version{ 1 };
     std::function<void()> _valueChanged;
 
 public:
@@ -40,31 +46,46 @@ public:
     void setValueChanged(std::function<void()> fn) { _valueChanged = fn; }
     std::string name() const { return _name; }
 
-    float valueFloat() const { return _valf; }
+    float valueFloat() const { return _valf.load(std::memory_order_relaxed); }
     void setFloat(float v, bool notify = true)
     {
-        if (v == _valf)
+        if (v == valueFloat())
             return;
 
-        _valf = v;
-        _vali = uint32_t(v);
-        _asFloat = true;
+        _valf.store(v, std::memory_order_relaxed);
+        _vali.store(uint32_t(v), std::memory_order_relaxed);
+        _asFloat.store(true, std::memory_order_relaxed);
+        _version.fetch_add(1, std::memory_order_release);
         if (notify && _valueChanged) _valueChanged();
     }
 
-    uint32_t valueUint32() const { return _vali; }
+    uint32_t valueUint32() const { return _vali.load(std::memory_order_relaxed); }
     void setUint32(uint32_t v, bool notify = true)
     {
-        if (v == _vali)
+        if (v == valueUint32())
             return;
 
-        _vali = v;
-        _valf = float(v);
-        _asFloat = false;
+        _vali.store(v, std::memory_order_relaxed);
+        _valf.store(float(v), std::memory_order_relaxed);
+        _asFloat.store(false, std::memory_order_relaxed);
+        _version.fetch_add(1, std::memory_order_release);
         if (notify && _valueChanged) _valueChanged();
     }
 
-    bool floatAssigned() const { return _asFloat; }
+    bool floatAssigned() const { return _asFloat.load(std::memory_order_relaxed); }
+
+    // Starts at 1, so that a node whose seen version starts at 0 builds its state on first use.
+    uint32_t version() const { return _version.load(std::memory_order_acquire); }
+
+    // True, updating seen, if the setting has changed since seen was taken.
+    bool changed(uint32_t & seen) const
+    {
+        const uint32_t v = version();
+        if (v == seen)
+            return false;
+        seen = v;
+        return true;
+    }
 };
 
 } // lab
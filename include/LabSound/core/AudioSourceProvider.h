@@ -26,6 +26,10 @@ public:
     // provideInput() gets called repeatedly to render time-slices of a continuous audio stream.
     virtual void provideInput(AudioBus* bus, size_t framesToProcess) = 0;
 
+    // A provider whose audio for the quantum is already in a bus may return it, so that the client reads it in
+    // place instead of having provideInput() copy it. The bus is only valid until the quantum has been rendered.
+    virtual AudioBus* inputBus(size_t framesToProcess) { return nullptr; }
+
     // If a client is set, we call it back when the audio format is available or changes.
     virtual void setClient(AudioSourceProviderClient*) { };
 
@@ -0,0 +1,41 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioStartup_h
+#define AudioStartup_h
+
+#include <cstddef>
+
+namespace lab {
+
+// The phases of a context's startup, in the order they usually complete, see AudioContext::startupTimings().
+enum class AudioStartupPhase
+{
+    ContextCreated,         // the origin the other phases are timed from
+    DeviceOpened,           // the destination probed and opened the audio device
+    UpdateThreadStarted,
+    RenderingStarted,       // the device's stream was started
+    FirstQuantum,           // the first render quantum was rendered, and handed to the device
+    HRTFLoaded,             // the HRTF database asked for by AudioContext::preload() finished loading
+    FFTPrepared,            // AudioContext::preload() set up the FFT sizes asked for
+    _Count
+};
+
+const char * AudioStartupPhaseName(AudioStartupPhase phase);
+
+struct AudioStartupTimings
+{
+    static const size_t Phases = static_cast<size_t>(AudioStartupPhase::_Count);
+
+    // The seconds from the context's construction to each phase, or -1 for a phase not reached yet. Some phases
+    // are never reached by some contexts: an offline context opens no device, and a context only loads the HRTF
+    // database and sets up FFTs ahead of their use if asked to.
+    double seconds[Phases];
+
+    bool reached(AudioStartupPhase phase) const { return seconds[static_cast<size_t>(phase)] >= 0; }
+    double at(AudioStartupPhase phase) const { return seconds[static_cast<size_t>(phase)]; }
+};
+
+} // namespace lab
+
+#endif // AudioStartup_h
@@ -5,6 +5,7 @@
 #ifndef AudioSummingJunction_h
 #define AudioSummingJunction_h
 
+#include <atomic>
 #include <vector>
 #include <memory>
 
@@ -25,50 +26,88 @@ public:
     explicit AudioSummingJunction();
     virtual ~AudioSummingJunction();
 
-    // This must be called whenever we modify m_outputs.
-    void changedOutputs(ContextGraphLock&);
-    
-    // This copies m_outputs to m_renderingOutputs. See comments for these lists below.
-    void updateRenderingState(ContextRenderLock& r);
+    // Publishes the junction's current connections to the render thread, which adopts them and calls didUpdate()
+    // at the start of its next quantum. Must be called with the graph lock whenever the connections change.
+    static void setDirty(ContextGraphLock&, std::shared_ptr<AudioSummingJunction>);
 
     // will count expired pointers
     size_t numberOfConnections() const { return m_connectedOutputs.size(); }
     
-    // Rendering code accesses its version of the current connections here.
-    size_t numberOfRenderingConnections(ContextRenderLock&) const;
-    std::shared_ptr<AudioNodeOutput> renderingOutput(ContextRenderLock&, size_t i) {
-        return i < m_renderingOutputs.size() ? m_renderingOutputs[i].lock() : nullptr; }
-    
-    const std::shared_ptr<AudioNodeOutput> renderingOutput(ContextRenderLock&, size_t i) const {
-        return i < m_renderingOutputs.size() ? m_renderingOutputs[i].lock() : nullptr; }
-    
-    bool isConnected() const { return numberOfConnections() > 0; }
+    // Rendering code accesses its version of the current connections here. The outputs are kept alive until
+    // the render thread adopts the next version, so they are valid for at least the rest of the quantum.
+    size_t numberOfRenderingConnections(ContextRenderLock&) const { return renderingConnectionCount(); }
+    AudioNodeOutput * renderingOutput(ContextRenderLock&, size_t i) const {
+        return i < renderingConnectionCount() ? m_renderingOutputs->outputs[i] : nullptr; }
+
+    // Called while rendering.
+    bool isConnected() const { return renderingConnectionCount() > 0; }
 
     virtual void didUpdate(ContextRenderLock&) = 0;
 
+    // Must be called with the graph lock, followed by setDirty().
     void junctionConnectOutput(std::shared_ptr<AudioNodeOutput>);
     void junctionDisconnectOutput(std::shared_ptr<AudioNodeOutput>);
-	void junctionDisconnectAllOutputs();
-    void setDirty() { m_renderingStateNeedUpdating = true; }
-    
-    static void handleDirtyAudioSummingJunctions(ContextRenderLock& r);
+    void junctionDisconnectAllOutputs();
 
     bool isConnected(std::shared_ptr<AudioNodeOutput> o) const;
 
+    // Appends the outputs currently connected to this junction. This is the graph's view of the connections,
+    // not the rendering view, and is used by the graph update thread to compile the render schedule.
+    void connectedOutputs(ContextGraphLock&, std::vector<std::shared_ptr<AudioNodeOutput>> & outputs) const;
+
+    // A version of the connections for rendering. It owns the outputs, and the render path reads them through
+    // the raw pointers, without locking weak pointers.
+    struct RenderingOutputs
+    {
+        std::vector<std::shared_ptr<AudioNodeOutput>> owners;
+        std::vector<AudioNodeOutput *> outputs;
+        RenderingOutputs * nextRetired = nullptr;
+    };
+
+    // Each context tracks its dirty junctions in an intrusive lock-free stack, so that nothing is scanned or
+    // allocated to find them. The graph thread pushes a junction when it publishes new connections, and at the
+    // start of a quantum the render thread takes the whole stack with one exchange, adopting the new versions.
+    // The versions they replace are pushed onto a second stack, from which the update thread frees them.
+    class DirtyList
+    {
+    public:
+        DirtyList() = default;
+        ~DirtyList();
+
+        // Called with the graph lock.
+        void push(ContextGraphLock&, std::shared_ptr<AudioSummingJunction>);
+
+        // Called on the render thread at the start of a quantum. Returns true if a version was retired.
+        bool update(ContextRenderLock&);
+
+        // Called on the update thread.
+        void collectGarbage();
+
+    private:
+        DirtyList(const DirtyList &) = delete;
+        DirtyList & operator=(const DirtyList &) = delete;
+
+        std::atomic<AudioSummingJunction *> m_junctions{ nullptr };
+        std::atomic<RenderingOutputs *> m_retired{ nullptr };
+    };
+
 protected:
-    
-    // m_outputs contains the AudioNodeOutputs representing current connections.
-    // The rendering code should never use this directly, but instead uses m_renderingOutputs.
+
+    size_t renderingConnectionCount() const { return m_renderingOutputs ? m_renderingOutputs->outputs.size() : 0; }
+
+    // m_connectedOutputs contains the AudioNodeOutputs representing current connections.
+    // The rendering code never uses this; it is only read and written with the graph lock.
     std::vector<std::weak_ptr<AudioNodeOutput>> m_connectedOutputs;
 
-    // m_renderingOutputs is a copy of m_connectedOutputs which will never be modified during the graph rendering on the audio thread.
-    // This is the list which is used by the rendering code.
-    // Whenever m_outputs is modified, the context is told so it can later update m_renderingOutputs from m_outputs at a safe time.
-    // Most of the time, m_renderingOutputs is identical to m_outputs.
-    std::vector<std::weak_ptr<AudioNodeOutput>> m_renderingOutputs;
+    // The version of the connections used for rendering, owned by the render thread, and the one published to
+    // replace it, which the render thread takes with an exchange.
+    RenderingOutputs * m_renderingOutputs = nullptr;
+    std::atomic<RenderingOutputs *> m_pendingOutputs{ nullptr };
 
-    // m_renderingStateNeedUpdating indicates outputs were changed
-    bool m_renderingStateNeedUpdating;
+    // Links the junction into its context's DirtyList while it is queued there, which keeps it alive.
+    std::atomic<bool> m_queued{ false };
+    AudioSummingJunction * m_nextDirty = nullptr;
+    std::shared_ptr<AudioSummingJunction> m_queuedSelf;
 };
 
 } // namespace lab
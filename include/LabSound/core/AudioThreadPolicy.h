@@ -0,0 +1,62 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioThreadPolicy_h
+#define AudioThreadPolicy_h
+
+#include <vector>
+
+namespace lab {
+
+// How one of a context's threads is scheduled, see AudioContext::setThreadPolicy().
+struct AudioThreadPolicy
+{
+    enum class Scheduling
+    {
+        // The thread is left as it was created.
+        Default,
+
+        // SCHED_FIFO on Linux. On Windows the thread joins the MMCSS "Pro Audio" task, and on macOS it takes the
+        // time constraint policy with a period of one render quantum.
+        Fifo,
+
+        // SCHED_RR on Linux, which shares the priority level in turns; elsewhere the same as Fifo.
+        RoundRobin
+    };
+
+    Scheduling scheduling = Scheduling::Default;
+
+    // The SCHED_FIFO or SCHED_RR priority on Linux, clamped to what the system allows. On Windows, above 90
+    // asks MMCSS for critical rather than high priority. Unused on macOS.
+    int priority = 80;
+
+    // The cores the thread may run on, empty for any. Render workers are each pinned to one of them in turn. On
+    // macOS, which has no hard affinity, threads on the same list are tagged to share a cache instead.
+    std::vector<unsigned> cores;
+
+    // What may go wrong applying a policy. Usually a lack of privilege: CAP_SYS_NICE or an rtprio limit on Linux,
+    // or a core that doesn't exist.
+    enum Failure : unsigned
+    {
+        SchedulingFailed = 1,
+        AffinityFailed = 2
+    };
+};
+
+enum class AudioThreadRole
+{
+    // The thread calling the destination for audio: the device's callback thread, ALSA's render thread, or
+    // the offline render thread.
+    Render,
+
+    // The threads of the pool set up by AudioContext::setRenderWorkerCount().
+    RenderWorkers,
+
+    // The context's graph update thread, and the workers convolving the tails of long impulse responses. The
+    // convolution workers are shared by every context; the last policy set by any context applies to them.
+    Background
+};
+
+} // namespace lab
+
+#endif // AudioThreadPolicy_h
@@ -0,0 +1,41 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioTrace_h
+#define AudioTrace_h
+
+#include <cstddef>
+#include <string>
+
+namespace lab {
+
+// A timeline of render quanta, graph updates, background convolution and HRTF loading, across all of LabSound's
+// threads, available when LabSound is built with LABSOUND_TRACE. Each thread records its events into a buffer of
+// its own without locking; a thread's buffer keeps its latest eventsPerThread events. The trace is written in the
+// Chrome JSON trace format, which chrome://tracing and ui.perfetto.dev open.
+class AudioTrace
+{
+public:
+
+    // False if LabSound was built without LABSOUND_TRACE, in which case tracing never starts.
+    static bool available();
+
+    // Discards the events recorded so far, and starts recording.
+    static void start(size_t eventsPerThread = 1 << 16);
+
+    // Stops recording, keeping the events recorded for json() and write().
+    static void stop();
+
+    static bool isTracing();
+
+    // The events recorded since start(). Events still being recorded while tracing may be missing or torn, so a
+    // complete trace is taken after stop().
+    static std::string json();
+
+    // Writes json() to the file, returning false if it can't be written.
+    static bool write(const std::string & path);
+};
+
+} // namespace lab
+
+#endif // AudioTrace_h
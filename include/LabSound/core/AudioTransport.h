@@ -0,0 +1,72 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioTransport_h
+#define AudioTransport_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lab {
+
+// Musical time against the context's timeline: where each beat falls, in seconds of context time. The map is a
+// list of segments of steady tempo and meter, the first of which puts beat 0 at its origin. Before the origin the
+// first tempo carries on backwards, so that beats before it are negative. Bars count from 0 at the origin.
+class TempoMap
+{
+public:
+
+    struct Segment
+    {
+        double beat = 0;            // where the segment starts
+        double time = 0;            // in seconds of context time
+        double bar = 0;
+        double bpm = 120;
+        unsigned beatsPerBar = 4;
+    };
+
+    explicit TempoMap(double bpm = 120, unsigned beatsPerBar = 4, double origin = 0);
+
+    // Changes the tempo, and the meter unless beatsPerBar is 0, from beat on. The segments from beat on are
+    // dropped, so the map is built up in order. A change before the first segment is clamped to it. Throws
+    // std::invalid_argument if bpm isn't positive and finite.
+    void setTempo(double beat, double bpm, unsigned beatsPerBar = 0);
+
+    const std::vector<Segment> & segments() const { return m_segments; }
+
+    // The segment in force at the beat, or at the time, found by binary search.
+    size_t segmentAtBeat(double beat) const;
+    size_t segmentAtTime(double time) const;
+
+    double timeAtBeat(double beat) const;
+    double beatAtTime(double time) const;
+    double beatAtBar(double bar) const;
+    double barAtBeat(double beat) const;
+    double bpmAtBeat(double beat) const { return m_segments[segmentAtBeat(beat)].bpm; }
+
+private:
+
+    std::vector<Segment> m_segments; // never empty, in order of beat and of time
+};
+
+// Where the transport is at the first frame of the render quantum, see AudioContext::transport(). Worked out once
+// per quantum by the render thread, so that tempo synced nodes read it for free. The tempo holds from frame until
+// segmentEndFrame, which may lie within the quantum, or beyond it.
+struct TransportPosition
+{
+    uint64_t frame = 0;
+    double beat = 0;
+    double bar = 0;
+    double bpm = 120;
+    double framesPerBeat = 0;
+    unsigned beatsPerBar = 4;
+    uint64_t segmentEndFrame = UINT64_MAX;
+
+    // The beat offset frames into the quantum, for offsets before segmentEndFrame.
+    double beatAt(size_t offset) const { return beat + offset / framesPerBeat; }
+};
+
+} // namespace lab
+
+#endif // AudioTransport_h
@@ -31,6 +31,11 @@ public:
     std::shared_ptr<AudioParam> gain();
     std::shared_ptr<AudioParam> detune();
 
+    // While a parameter is automated or driven by a connection, the filter is designed again every this many
+    // frames, 16 to begin with, and interpolated in between. Fewer frames follow fast sweeps more closely.
+    size_t coefficientInterval() const;
+    void setCoefficientInterval(size_t frames);
+
     // Get the magnitude and phase response of the filter at the given
     // set of frequencies (in Hz). The phase response is in radians.
     void getFrequencyResponse(ContextRenderLock&, const std::vector<float>& frequencyHz, std::vector<float>& magResponse, std::vector<float>& phaseResponse);
@@ -7,6 +7,8 @@
 
 #include "LabSound/core/AudioNode.h"
 
+#include <memory>
+
 namespace lab {
 
 class AudioContext;
@@ -16,7 +18,7 @@ class ChannelMergerNode : public AudioNode
 public:
 
     ChannelMergerNode(size_t numberOfInputs = 1);
-    virtual ~ChannelMergerNode() {}
+    virtual ~ChannelMergerNode();
 
     void addInputs(size_t n);
 
@@ -27,12 +29,17 @@ public:
     // Called in the audio thread (pre-rendering task) when the number of channels for an input may have changed.
     virtual void checkNumberOfChannelsForInput(ContextRenderLock&, AudioNodeInput*) override;
 
+    virtual bool aliasesInputs() const override { return true; }
+
 private:
 
     virtual double tailTime(ContextRenderLock & r) const override { return 0; }
     virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
 
     size_t m_desiredNumberOfOutputChannels = 1; // default
+
+    // Views the channels of the input buses in order, rendered instead of a copy. Sized with the output.
+    std::unique_ptr<AudioBus> m_channelViews;
 };
 
 } // namespace lab
@@ -7,6 +7,9 @@
 
 #include "LabSound/core/AudioNode.h"
 
+#include <memory>
+#include <vector>
+
 namespace lab
 {
 
@@ -18,19 +21,22 @@ class ChannelSplitterNode : public AudioNode
 public:
 
     ChannelSplitterNode(size_t numberOfOutputs = 1);
-    virtual ~ChannelSplitterNode() {}
+    virtual ~ChannelSplitterNode();
 
     void addOutputs(size_t numberOfOutputs);
 
     // AudioNode
     virtual void process(ContextRenderLock&, size_t framesToProcess) override;
     virtual void reset(ContextRenderLock&) override;
+    virtual bool aliasesInputs() const override { return true; }
 
 private:
 
     virtual double tailTime(ContextRenderLock & r) const override { return 0; }
     virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
 
+    // Per output, a mono bus viewing its channel of the input bus, rendered instead of a copy.
+    std::vector<std::unique_ptr<AudioBus>> m_channelViews;
 };
 
 } // namespace lab
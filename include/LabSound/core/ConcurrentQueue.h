@@ -3,63 +3,206 @@
 
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
-#include <queue>
+#ifndef LABSOUND_CONCURRENT_QUEUE_H
+#define LABSOUND_CONCURRENT_QUEUE_H
 
-namespace lab 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded, lock-free queues, for passing items to and from the render thread, which may neither block nor allocate.
+// The storage is allocated when a queue is made, and a full queue refuses a push rather than growing.
+
+namespace lab
 {
 
-template<typename Data>
-class concurrent_queue
+// A bounded, lock-free queue for one producer and one consumer. All slots are allocated up front, so pushing and
+// popping never allocate or block; tryPush() fails instead when the queue is full. Each side caches the other's
+// position, and only reloads it when the queue looks full or empty, so they rarely touch each other's cache line.
+template <typename T>
+class BoundedSPSCQueue
 {
-private:
-    std::queue<Data> the_queue;
-    mutable std::mutex the_mutex;
-    std::condition_variable the_condition_variable;
-    
 public:
-    void push(Data const& data)
+
+    // capacity is rounded up to a power of two.
+    explicit BoundedSPSCQueue(size_t capacity)
     {
+        m_capacity = 1;
+        while (m_capacity < capacity)
+            m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_slots.reset(new T[m_capacity]);
+    }
+
+    BoundedSPSCQueue(const BoundedSPSCQueue &) = delete;
+    BoundedSPSCQueue & operator=(const BoundedSPSCQueue &) = delete;
+
+    size_t capacity() const { return m_capacity; }
+
+    // Must only be called from the producer thread.
+    bool tryPush(T && item)
+    {
+        const size_t position = m_writePosition.load(std::memory_order_relaxed);
+        if (position - m_cachedReadPosition == m_capacity)
         {
-            std::lock_guard<std::mutex> lock(the_mutex);
-            the_queue.push(data);
+            m_cachedReadPosition = m_readPosition.load(std::memory_order_acquire);
+            if (position - m_cachedReadPosition == m_capacity)
+                return false; // full
         }
-        the_condition_variable.notify_one();
+
+        m_slots[position & m_mask] = std::move(item);
+        m_writePosition.store(position + 1, std::memory_order_release);
+        return true;
     }
-    
-    bool empty() const
+
+    bool tryPush(const T & item)
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        return the_queue.empty();
+        T copy(item);
+        return tryPush(std::move(copy));
     }
-    
-    bool try_pop(Data& popped_value)
+
+    // Must only be called from the consumer thread.
+    bool tryPop(T & item)
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        if(the_queue.empty())
+        const size_t position = m_readPosition.load(std::memory_order_relaxed);
+        if (position == m_cachedWritePosition)
         {
-            return false;
+            m_cachedWritePosition = m_writePosition.load(std::memory_order_acquire);
+            if (position == m_cachedWritePosition)
+                return false;
         }
-        
-        popped_value = the_queue.front();
-        the_queue.pop();
+
+        T & slot = m_slots[position & m_mask];
+        item = std::move(slot);
+        slot = T();
+        m_readPosition.store(position + 1, std::memory_order_release);
         return true;
     }
-    
-    void wait_and_pop(Data& popped_value)
+
+    // Must only be called from the consumer thread.
+    bool empty() const
     {
-        std::unique_lock<std::mutex> lock(the_mutex);
-        while(the_queue.empty())
+        return m_readPosition.load(std::memory_order_relaxed) == m_writePosition.load(std::memory_order_acquire);
+    }
+
+private:
+
+    std::unique_ptr<T[]> m_slots;
+    size_t m_capacity;
+    size_t m_mask;
+
+    // The producer's and the consumer's positions, each with its copy of the other's, on their own cache lines.
+    alignas(64) std::atomic<size_t> m_writePosition{ 0 };
+    size_t m_cachedReadPosition{ 0 };
+    alignas(64) std::atomic<size_t> m_readPosition{ 0 };
+    size_t m_cachedWritePosition{ 0 };
+};
+
+// A bounded, lock-free queue for many producers and a single consumer. All slots are allocated up front,
+// so pushing and popping never allocate or block; tryPush() fails instead when the queue is full.
+//
+// Every slot carries a sequence number which tells a producer whether the slot is free for the position
+// it claimed, and tells the consumer whether the producer has finished writing it (D. Vyukov's bounded queue).
+template <typename T>
+class BoundedMPSCQueue
+{
+public:
+
+    // capacity is rounded up to a power of two.
+    explicit BoundedMPSCQueue(size_t capacity)
+    {
+        m_capacity = 1;
+        while (m_capacity < capacity)
+            m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+
+        m_slots.reset(new Slot[m_capacity]);
+        for (size_t i = 0; i < m_capacity; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedMPSCQueue(const BoundedMPSCQueue &) = delete;
+    BoundedMPSCQueue & operator=(const BoundedMPSCQueue &) = delete;
+
+    size_t capacity() const { return m_capacity; }
+
+    // Safe to call from any number of threads concurrently.
+    bool tryPush(T && item)
+    {
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        Slot * slot;
+
+        for (;;)
         {
-            the_condition_variable.wait(lock);
+            slot = &m_slots[position & m_mask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
         }
-        
-        popped_value = the_queue.front();
-        the_queue.pop();
+
+        slot->value = std::move(item);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(const T & item)
+    {
+        T copy(item);
+        return tryPush(std::move(copy));
     }
-    
+
+    // Must only be called from the consumer thread.
+    bool tryPop(T & item)
+    {
+        Slot & slot = m_slots[m_dequeuePosition & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+            return false;
+
+        item = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(m_dequeuePosition + m_capacity, std::memory_order_release);
+        ++m_dequeuePosition;
+        return true;
+    }
+
+    // Must only be called from the consumer thread. A push that is still in progress is not seen.
+    bool empty() const
+    {
+        return m_slots[m_dequeuePosition & m_mask].sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1;
+    }
+
+private:
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_capacity;
+    size_t m_mask;
+
+    // Producers and the consumer work on different cache lines.
+    alignas(64) std::atomic<size_t> m_enqueuePosition{ 0 };
+    alignas(64) size_t m_dequeuePosition{ 0 };
 };
-    
-}
 
+} // namespace lab
+
+#endif // LABSOUND_CONCURRENT_QUEUE_H
@@ -7,12 +7,16 @@
 
 #include "LabSound/core/AudioNode.h"
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
 
 namespace lab {
 
 class AudioBus;
 class AudioSetting;
+class PreparedImpulse;
 class Reverb;
 
 // params:
@@ -31,30 +35,114 @@ public:
     virtual void initialize() override;
     virtual void uninitialize() override;
 
+    // Waits for the impulse last set, and swaps in its reverb and output's channels, which otherwise happens as
+    // the node next renders.
+    virtual void prepare(AudioContext & context, size_t inputChannels) override;
+
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
+
     // Impulse responses
+    // The impulse setters return at once: the reverb is built on a background thread, and the render thread
+    // takes it up at the start of a quantum, crossfading from the reverb it replaces. An impulse set before the
+    // last was taken up is superseded.
     // setImpulse takes an audio bus as a source of a buffer to create an audio
-    // bus from, but the bus and its data is not retained
-    void setImpulse(std::shared_ptr<AudioBus> bus);
+    // bus from, but the bus and its data is not retained. Returns the frames of it that will be convolved, after
+    // trimming.
+    size_t setImpulse(std::shared_ptr<AudioBus> bus);
     std::shared_ptr<AudioBus> getImpulse();
 
+    // Trims impulses given to setImpulse: a response is cut, with a short fade, where its energy decay curve,
+    // the energy of all its channels from each frame on, falls thresholdDb below its total energy, such as -90;
+    // and to at most maxFrames. Convolving, and the memory for, the response are saved in proportion. By
+    // default, and at a threshold of 0 or more, silent tails aren't trimmed.
+    void setImpulseTrim(float thresholdDb, size_t maxFrames = SIZE_MAX);
+    float impulseTrimThreshold() const { return m_trimThresholdDb; }
+    size_t maxImpulseLength() const { return m_maxImpulseLength; }
+
+    // Blocks until the reverb of the impulse last set is built, and the whole of its response is prepared. The
+    // head of a long response is heard as soon as the reverb is built, and the rest joins as it's prepared on
+    // background threads; an offline render that must not depend on their timing waits for it.
+    void waitForImpulse();
+
+    // The equal-power crossfade between the old and new reverbs as an impulse is swapped, by default 50ms, or
+    // none at 0. There's none if the new impulse changes the number of channels. May be called from any thread.
+    void setCrossfadeTime(double seconds) { m_crossfadeTime.store(seconds, std::memory_order_relaxed); }
+    double crossfadeTime() const { return m_crossfadeTime.load(std::memory_order_relaxed); }
+
+    // Transforms an impulse response once, so that any number of ConvolverNodes can share the result
+    // through setPreparedImpulse rather than each computing and keeping their own copy of it.
+    // Returns nullptr if the bus is not a supported impulse response.
+    // The response is first trimmed to length frames, if it's longer. An offline impulse is partitioned for
+    // offline renders, see setOfflinePartitioning().
+    static std::shared_ptr<PreparedImpulse> prepareImpulse(std::shared_ptr<AudioBus> bus, bool normalize = true, size_t length = SIZE_MAX,
+                                                           bool offline = false);
+
+    // The frames of an impulse that setImpulseTrim keeps, for preparing impulses to share trimmed alike.
+    static size_t trimmedLength(const AudioBus & bus, float thresholdDb, size_t maxFrames = SIZE_MAX);
+    void setPreparedImpulse(std::shared_ptr<PreparedImpulse> impulse);
+
+    // Convolves numberOfInputs input channels into numberOfOutputs output channels through a matrix of impulse
+    // responses, such as an Ambisonic B-format set. The impulse has numberOfInputs * numberOfOutputs channels,
+    // where channel i * numberOfOutputs + o is the response from input i to output o; a true stereo impulse
+    // response (LL, LR, RL, RR) is a 2 by 2 matrix. Each input is transformed once per FFT block, however many
+    // outputs it feeds.
+    void setMatrixImpulse(std::shared_ptr<PreparedImpulse> impulse, size_t numberOfInputs, size_t numberOfOutputs);
+
     bool normalize() const;
     void setNormalize(bool normalize);
 
+    // Impulses given to setImpulse from then on are partitioned for an offline render, where only throughput
+    // matters: past its first few thousand frames, the response is convolved in blocks sized to its length, up
+    // to 16384 frames rather than 1024, which convolves a response of 20 seconds in about half the time. Each
+    // block's transforms fall in a single quantum, which would glitch a realtime render. The output is the same,
+    // to within rounding.
+    void setOfflinePartitioning(bool offline) { m_offlinePartitioning = offline; }
+    bool offlinePartitioning() const { return m_offlinePartitioning; }
+
+    // Cuts the response short, for less work under load: the parts of the response starting at or past seconds
+    // are skipped, and come back when the limit is raised. The response is cut where its stages, or their
+    // partitions, begin, so somewhat more than seconds may be kept. May be called from any thread; infinite by
+    // default.
+    void setTailLimit(double seconds) { m_tailLimit.store(seconds, std::memory_order_relaxed); }
+    double tailLimit() const { return m_tailLimit.load(std::memory_order_relaxed); }
+
 private:
 
     virtual double tailTime(ContextRenderLock & r) const override;
     virtual double latencyTime(ContextRenderLock & r) const override;
 
-    std::unique_ptr<Reverb> m_reverb;
-    std::shared_ptr<AudioBus> m_bus;
+    // Builds reverbs on a background thread and hands them to the render thread, see ConvolverNode.cpp.
+    struct Loader;
+    std::shared_ptr<Loader> m_loader;
+    void load(std::shared_ptr<AudioBus> bus, size_t length, std::shared_ptr<PreparedImpulse> impulse, size_t numberOfInputs, size_t numberOfOutputs);
 
     // lock free swap on update
-    bool m_swapOnRender;
-    std::unique_ptr<Reverb> m_newReverb;
-    std::shared_ptr<AudioBus> m_newBus;
+    void swapReverb(ContextRenderLock &);
+    void processSlice(ContextRenderLock &, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess);
+
+    std::shared_ptr<Reverb> m_reverb;
+    std::shared_ptr<AudioBus> m_bus;
+
+    // The reverb being faded out, rendered into m_fadeBus, one slice long.
+    std::shared_ptr<Reverb> m_fadingReverb;
+    std::shared_ptr<AudioBus> m_fadeBus;
+    size_t m_fadeFrames = 0;
+    size_t m_fadePosition = 0;
+    std::atomic<double> m_crossfadeTime{ 0.05 };
+
+    // Feed the reverb one slice at a time when the context renders quanta larger or smaller than the slice size
+    // the reverb is built for, see ConvolverNode.cpp. Swapped in with the reverb.
+    struct Slices;
+    std::shared_ptr<Slices> m_slices;
 
     // Normalize the impulse response or not. Must default to true.
     std::shared_ptr<AudioSetting> m_normalize;
+
+    std::atomic<double> m_tailLimit{ std::numeric_limits<double>::infinity() };
+
+    bool m_offlinePartitioning = false;
+    float m_trimThresholdDb = 0;
+    size_t m_maxImpulseLength = SIZE_MAX;
 };
 
 } // namespace lab
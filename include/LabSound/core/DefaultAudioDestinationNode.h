@@ -6,6 +6,11 @@
 #define DefaultAudioDestinationNode_h
 
 #include "LabSound/core/AudioDestinationNode.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace lab {
 
@@ -15,17 +20,34 @@ struct AudioDestination;
 class DefaultAudioDestinationNode final : public AudioDestinationNode 
 {
     std::unique_ptr<AudioDestination> m_destination;
+    AudioDeviceSettings m_deviceSettings;
+    bool m_rendering = false;
+
+    // m_destination may only be used once m_opened is set. Until then, with AudioDeviceSettings::openInBackground,
+    // startRendering() and stopRendering() only note what's asked, under m_openLock, and m_opener acts on it once
+    // the device is open.
+    std::thread m_opener;
+    std::mutex m_openLock;
+    std::atomic<bool> m_opened{ false };
+    bool m_startRequested = false;
 
     void createDestination();
+    void openDestination();
     
 public:
 
-    DefaultAudioDestinationNode(AudioContext* context, size_t channelCount, const float sampleRate);
+    DefaultAudioDestinationNode(AudioContext* context, size_t channelCount, const float sampleRate,
+                                const AudioDeviceSettings & deviceSettings = AudioDeviceSettings());
     virtual ~DefaultAudioDestinationNode();
     
     virtual void initialize() override;
     virtual void uninitialize() override;
     virtual void startRendering() override;
+    virtual void stopRendering() override;
+    virtual double baseLatency() const override;
+    virtual double outputLatency() const override;
+    virtual double inputLatency() const override;
+    virtual double roundTripLatency() const override;
     
     unsigned maxChannelCount() const;
     virtual void setChannelCount(ContextGraphLock &, size_t) override;
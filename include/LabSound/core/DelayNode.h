@@ -12,6 +12,7 @@ namespace lab
 {
 
 class AudioParam;
+class AudioSetting;
 class DelayProcessor;
 
 // TempoSync is commonly used by subclasses of DelayNode
@@ -33,13 +34,27 @@ enum TempoSync
     TS_2D,
 };
 
+// How a delay falling between frames is read. LAGRANGE interpolates through four frames rather than two, which
+// dulls modulated delays less; delays under two frames are read linearly either way.
+enum class DelayInterpolation
+{
+    LINEAR = 0,
+    LAGRANGE = 1
+};
+
+// settings: interpolation
+//
 class DelayNode : public AudioBasicProcessorNode
 {
     DelayProcessor * delayProcessor();
+    std::shared_ptr<AudioSetting> m_interpolation;
 public:
     // default maximum delay of 100ms
     DelayNode(float sampleRate = LABSOUND_DEFAULT_SAMPLERATE, double maxDelayTime = 0.1);
     std::shared_ptr<AudioParam> delayTime();
+
+    DelayInterpolation interpolation() const;
+    void setInterpolation(DelayInterpolation type);
 };
 
 } // namespace lab
@@ -33,8 +33,16 @@ public:
 
     // Called in the main thread when the number of channels for the input may have changed.
     virtual void checkNumberOfChannelsForInput(ContextRenderLock&, AudioNodeInput*) override;
+    virtual void prepare(AudioContext & context, size_t inputChannels) override;
 
     std::shared_ptr<AudioParam> gain() const { return m_gain; }
+
+    // Used by the render schedule's graph optimization, see AudioContext::setGraphOptimization(). Stands in for
+    // processing while the gain is settled, holding one value over the quantum and done de-zippering to it: the
+    // input is handed on untouched if the gain, times any carried into it, is unity, or else if it can be carried
+    // on into next, a settled GainNode fed only by this one. Returns false, and the node is processed as usual,
+    // otherwise.
+    bool renderFolded(ContextRenderLock&, size_t framesToProcess, GainNode * next);
     
 protected:
     
@@ -45,6 +53,12 @@ protected:
     std::shared_ptr<AudioParam> m_gain;
 
     AudioFloatArray m_sampleAccurateGainValues;
+
+    bool isSettled(ContextRenderLock&, size_t framesToProcess);
+
+    // The gains of the GainNodes folded into this one, for the render quantum they were carried in.
+    float m_carriedGain = 1.f;
+    uint64_t m_carriedQuantum = UINT64_MAX;
 };
 
 } // namespace lab
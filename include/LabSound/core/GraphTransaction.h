@@ -0,0 +1,79 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef GraphTransaction_h
+#define GraphTransaction_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+
+class AudioContext;
+class AudioNode;
+class AudioParam;
+
+// A GraphTransaction collects graph edits and hands them to the context in one piece, waking the graph
+// update thread once. All edits of a committed transaction are applied by the same graph update, under one
+// graph lock, and the render thread adopts them all at the start of one quantum, so that a voice built from
+// many nodes is heard fully wired from the first render quantum it is heard in. Rendering carries on with the
+// graph as it was while the transaction is applied. As with individual edits, connections to scheduled sources that
+// start more than 100ms in the future are deferred, and disconnections ramp out before they complete.
+//
+//     GraphTransaction voice(context);
+//     voice.connect(gain, sampler);
+//     voice.connect(context->destination(), gain);
+//     voice.connectParam(gain->gain(), envelope, 0);
+//     voice.commit();
+//
+// Edits that are never committed are discarded.
+class GraphTransaction
+{
+public:
+
+    struct Edit
+    {
+        enum class Type : int
+        {
+            Connect = 0,
+            Disconnect,
+            ConnectParam
+        };
+
+        Type type;
+        std::shared_ptr<AudioNode> destination;
+        std::shared_ptr<AudioNode> source;
+        std::shared_ptr<AudioParam> param;
+        uint32_t destIndex;
+        uint32_t srcIndex;
+    };
+
+    explicit GraphTransaction(AudioContext * context);
+    ~GraphTransaction() = default;
+
+    // These validate their arguments exactly as the AudioContext methods of the same names do.
+    void connect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx = 0, uint32_t srcIdx = 0);
+    void disconnect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx = 0, uint32_t srcIdx = 0);
+    void connectParam(std::shared_ptr<AudioParam> param, std::shared_ptr<AudioNode> driver, uint32_t index);
+
+    // Hands all collected edits to the context. The transaction is empty afterwards and may be reused.
+    void commit();
+
+    void reserve(size_t edits) { m_edits.reserve(edits); }
+
+    size_t size() const { return m_edits.size(); }
+    bool empty() const { return m_edits.empty(); }
+
+private:
+
+    AudioContext * m_context;
+    std::vector<Edit> m_edits;
+};
+
+} // end namespace lab
+
+#endif // GraphTransaction_h
@@ -37,7 +37,8 @@
 #include <cmath>
 #endif
 
-#if defined(__ARM_NEON__)
+// __ARM_NEON__ is only defined for 32 bit ARM, AArch64 compilers define __ARM_NEON.
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(_M_ARM64)
 #define ARM_NEON_INTRINSICS 1
 #endif
 
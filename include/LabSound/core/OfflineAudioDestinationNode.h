@@ -7,11 +7,22 @@
 
 #include "LabSound/core/AudioDestinationNode.h"
 
+#include <atomic>
+#include <functional>
+#include <string>
+
 namespace lab {
 
 class AudioBus;
 class AudioContext;
+class AudioFileWriter;
+class ContextRenderLock;
 
+// Renders the context as fast as it can, on the thread calling startRendering(), for lengthSeconds or until a stop
+// condition is met. An offline context has no graph update thread; its graph is updated between quanta instead.
+// The rendered audio may be streamed to a sink or a file in blocks as it is produced, so that a render of any
+// length runs in constant memory. The node is the context's destination(), and is configured before
+// startRendering().
 class OfflineAudioDestinationNode final : public AudioDestinationNode
 {
     
@@ -24,15 +35,54 @@ public:
     virtual void uninitialize() override;
 
     virtual void startRendering() override;
-    
+
+    // Called on the render thread with each block of rendered audio, and the sample frame it starts at. Blocks
+    // are blockSize() frames long, but for the last, which may be shorter.
+    using Sink = std::function<void(const AudioBus & block, uint64_t sampleFrame)>;
+    void setSink(Sink sink) { m_sink = std::move(sink); }
+
+    // Streams the render to a file, CAF if the path ends in .caf, WavPack if it ends in .wv and WAV otherwise. The
+    // file is complete once startRendering() returns. Returns false if it can't be created. An empty path stops
+    // streaming to a file.
+    bool setOutputFile(const std::string & path);
+
+    // The frames handed to the sink or file at a time, 4096 by default.
+    void setBlockSize(size_t frames) { m_blockSize = frames ? frames : 1; }
+    size_t blockSize() const { return m_blockSize; }
+
+    // Asked after each quantum with the frames rendered so far, and the render stops once it returns true. With a
+    // stop condition lengthSeconds, if greater than zero, only limits the render.
+    using StopCondition = std::function<bool(ContextRenderLock &, uint64_t framesRendered)>;
+    void setStopCondition(StopCondition condition) { m_stopCondition = std::move(condition); }
+
+    // Sets a stop condition that ends the render once no scheduled source is playing or waiting to play, and the
+    // output has then stayed below threshold for silenceSeconds, so that reverb and delay tails have decayed. A
+    // looping source never finishes, so lengthSeconds should still be set as a limit.
+    void renderUntilSilent(double silenceSeconds = 1, float threshold = 1e-5f);
+
+    // The frames rendered so far by the current or last render.
+    uint64_t framesRendered() const { return m_framesRendered.load(std::memory_order_relaxed); }
+
 private:
   
     std::unique_ptr<AudioBus> m_renderBus;
-    std::thread m_renderThread;
     void offlineRender();
     bool m_startedRendering{ false };
     uint32_t m_numChannels;
     float m_lengthSeconds;
+
+    // Copies frames of the render bus into the block, handing it over when full.
+    void deliver(size_t frames);
+    void deliverBlock();
+
+    Sink m_sink;
+    std::unique_ptr<AudioFileWriter> m_fileWriter;
+    StopCondition m_stopCondition;
+    size_t m_blockSize{ 4096 };
+    std::unique_ptr<AudioBus> m_blockBus;
+    size_t m_blockFill{ 0 };
+    uint64_t m_blockStart{ 0 };
+    std::atomic<uint64_t> m_framesRendered{ 0 };
 };
 
 } // namespace lab
@@ -30,10 +30,17 @@ public:
     // AudioNode
     virtual void process(ContextRenderLock&, size_t framesToProcess) override;
     virtual void reset(ContextRenderLock&) override;
+    virtual bool supportsControlRate() const override { return true; }
+    virtual void prepare(AudioContext & context, size_t inputChannels) override;
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
 
     OscillatorType type() const;
     void setType(OscillatorType type);
 
+    // Plays the waveform of the given Fourier coefficients, the cosine terms in real and the sine terms in imag,
+    // indexed by harmonic, and sets the type to CUSTOM. The DC terms, at index 0, are ignored. Oscillators given identical coefficients share a table.
+    void setPeriodicWave(const std::vector<float> & real, const std::vector<float> & imag);
+
     std::shared_ptr<AudioParam> frequency() { return m_frequency; }
     std::shared_ptr<AudioParam> detune() { return m_detune; }
 
@@ -45,8 +52,10 @@ private:
 
     void setWaveTable(std::shared_ptr<WaveTable> table);
 
-    // Returns true if there are sample-accurate timeline parameter changes.
-    bool calculateSampleAccuratePhaseIncrements(ContextRenderLock&, size_t framesToProcess);
+    // Returns true, with the increments in m_phaseIncrements, if the frequency or detune change over the
+    // quantum, from their timelines, connections or de-zippering. Otherwise returns false with the detuned
+    // frequency, constant over the quantum.
+    bool calculateSampleAccuratePhaseIncrements(ContextRenderLock&, size_t framesToProcess, float & frequency);
 
     virtual bool propagatesSilence(ContextRenderLock & r) const override;
 
@@ -70,12 +79,6 @@ private:
     AudioFloatArray m_detuneValues;
 
     std::shared_ptr<WaveTable> m_waveTable;
-
-    // Cache the wave tables for different waveform types, except CUSTOM.
-    static std::shared_ptr<WaveTable> s_waveTableSine;
-    static std::shared_ptr<WaveTable> s_waveTableSquare;
-    static std::shared_ptr<WaveTable> s_waveTableSawtooth;
-    static std::shared_ptr<WaveTable> s_waveTableTriangle;
 };
 
 } // namespace lab
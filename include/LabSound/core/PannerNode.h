@@ -23,8 +23,10 @@ namespace lab {
 class AudioBus;
 class ConeEffect;
 class DistanceEffect;
+class DopplerDelay;
 class HRTFDatabaseLoader;
 class Panner;
+class SpatialBatch;
 
 // params: orientation[XYZ], velocity[XYZ], position[XYZ]
 // settings: distanceModel, refDistance, maxDistance, rolloffFactor,
@@ -52,6 +54,7 @@ class PannerNode : public AudioNode
     std::shared_ptr<AudioSetting> m_coneInnerAngle;
     std::shared_ptr<AudioSetting> m_coneOuterAngle;
     std::shared_ptr<AudioSetting> m_panningModel;
+    std::shared_ptr<AudioSetting> m_doppler;
 
 
 public:
@@ -63,7 +66,10 @@ public:
         EXPONENTIAL_DISTANCE = 2,
     };
 
-    PannerNode(const float sampleRate = LABSOUND_DEFAULT_SAMPLERATE, const std::string & searchPath = "");
+    // The HRTF responses of hrtfSubject are loaded from searchPath; panners of different subjects, for example one
+    // per listener, each have their own database, and those of the same subject share one.
+    PannerNode(const float sampleRate = LABSOUND_DEFAULT_SAMPLERATE, const std::string & searchPath = "",
+               const std::string & hrtfSubject = "Composite");
     virtual ~PannerNode();
 
     // AudioNode
@@ -73,6 +79,12 @@ public:
     virtual void initialize() override;
     virtual void uninitialize() override;
 
+    // Waits for the HRTF database the HRTF and Ambisonic models load in the background, which the node otherwise
+    // pans with equal power without until it's loaded.
+    virtual void prepare(AudioContext & context, size_t inputChannels) override;
+
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
+
     // Panning model
     PanningMode panningModel() const;
     void setPanningModel(PanningMode m);
@@ -124,9 +136,26 @@ public:
     float coneOuterGain() const;
     void setConeOuterGain(float angle);
 
+    // The distance to the listener as of the last quantum rendered. May be called from any thread.
+    float listenerDistance() const { return m_listenerDistance.load(std::memory_order_relaxed); }
+
+    // The gain of the distance model at a distance, without the cone's. May be called from any thread.
+    float distanceGainAt(float distance) const;
+
     void getAzimuthElevation(ContextRenderLock & r, double * outAzimuth, double * outElevation);
+
+    // The pitch rate a SampledAudioNode connected to the panner plays at for the Doppler shift, from the velocities
+    // of the source and listener. 1 while the panner shifts the pitch itself.
     float dopplerRate(ContextRenderLock & r);
 
+    // Off by default. When on, the panner delays its input by the time sound takes to reach the listener, the
+    // distance times the listener's dopplerFactor over its speedOfSound, up to a second. As the distance changes
+    // the delay is ramped, shifting the pitch of any source, not only a SampledAudioNode. The shift follows the
+    // positions of the source and listener, not their velocities; while the distance holds still, the delay is
+    // read without the ramp.
+    bool doppler() const;
+    void setDoppler(bool enabled);
+
     // Accessors for dynamically calculated gain values.
     std::shared_ptr<AudioParam> distanceGain() { return m_distanceGain; }
     std::shared_ptr<AudioParam> coneGain() { return m_coneGain; }
@@ -136,20 +165,73 @@ public:
 
 protected:
 
+    friend class SpatialBatch;
+
     std::shared_ptr<HRTFDatabaseLoader> m_hrtfDatabaseLoader;
 
     // Returns the combined distance and cone gain attenuation.
     virtual float distanceConeGain(ContextRenderLock & r);
 
+    // Returns the azimuth and elevation in the given number of seconds, from the velocities of the source and listener;
+    // returns false if neither is moving.
+    bool getPredictedAzimuthElevation(ContextRenderLock & r, double seconds, double * outAzimuth, double * outElevation);
+
     // Notifies any SampledAudioNodes connected to us either directly or indirectly about our existence.
     // This is in order to handle the pitch change necessary for the doppler shift.
     // @tofix - broken?
     void notifyAudioSourcesConnectedToNode(ContextRenderLock & r, AudioNode *);
 
+    // The delay to the listener for the Doppler delay line, in frames.
+    double dopplerDelayFrames(ContextRenderLock & r);
+
     std::unique_ptr<Panner> m_panner;
+
+    // Pans while the HRTF database is loading, or if it couldn't be loaded.
+    std::unique_ptr<Panner> m_fallbackPanner;
     std::unique_ptr<DistanceEffect> m_distanceEffect;
     std::unique_ptr<ConeEffect> m_coneEffect;
 
+    // The geometry of the render quantum starting at sampleFrame, evaluated by the context's SpatialBatch, or by
+    // updateGeometry() for a panner outside of it. The source's position and orientation, and the version of the
+    // listener's frame, it was worked out for are kept with it, and while none of them change only the gains are
+    // worked out again, from the distance and cone cosine, so that the panners of a still scene cost next to
+    // nothing. A listenerVersion of 0 is never current.
+    struct Geometry
+    {
+        uint64_t sampleFrame = ~0ull;
+        uint64_t listenerVersion = 0;
+        FloatPoint3D position;
+        FloatPoint3D orientation;
+        float distance = 0;
+        float coneCosine = 1;
+        double azimuth = 0;
+        double elevation = 0;
+        double distanceGain = 1;
+        double coneGain = 1;
+    };
+    Geometry m_geometry;
+    bool hasGeometry(ContextRenderLock & r) const;
+
+    // Whether the geometry was worked out for this position, orientation and listener frame.
+    bool geometryCurrent(const FloatPoint3D & position, const FloatPoint3D & orientation, uint64_t listenerVersion) const
+    {
+        return m_geometry.listenerVersion == listenerVersion && m_geometry.position == position && m_geometry.orientation == orientation;
+    }
+
+    // The gains from the geometry's distance and cone cosine, and the distance to the listener published.
+    void updateGains();
+
+    // Brings the geometry up to date for the quantum, for a panner the SpatialBatch hasn't evaluated.
+    void updateGeometry(ContextRenderLock & r);
+
+    std::atomic<float> m_listenerDistance{ 0 };
+
+    // The Doppler delay lines, made the first time Doppler is turned on and published to the render thread, and
+    // made longer should a quantum not fit.
+    struct DopplerLines;
+    std::shared_ptr<DopplerLines> m_dopplerLines;
+    DopplerDelay * m_activeDoppler = nullptr; // the line rendered last quantum, owned by the render thread
+
     float m_lastGain = -1.0f;
     float m_sampleRate;
 };
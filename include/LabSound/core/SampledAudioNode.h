@@ -8,33 +8,57 @@
 #include "LabSound/core/AudioParam.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
 #include "LabSound/core/PannerNode.h"
+#include "LabSound/extended/CompactAudioBus.h"
 
 #include <memory>
+#include <vector>
 
 namespace lab {
 
 class AudioContext;
 class AudioBus;
+class MappedAudioFile;
 
 // This should  be used for short sounds which require a high degree of scheduling flexibility (can playback in rhythmically perfect ways).
 //
 // params: gain, playbackRate
-// settings: loop
+// settings: loop, loopStart, loopEnd, interpolation
 //
 class SampledAudioNode final : public AudioScheduledSourceNode
 {
 public:
 
+    // How samples between the source's frames are found, when the source isn't played at its own rate. Linear is
+    // the cheapest; cubic reads four frames per output frame and keeps more of the top octave; sinc reads
+    // SincTaps frames through a windowed sinc, and has a flat passband and little imaging, at several times the cost.
+    // At the source's own rate, from a whole frame, frames are copied whatever the mode.
+    enum InterpolationMode
+    {
+        LINEAR = 0,
+        CUBIC = 1,
+        SINC = 2
+    };
+
+    static const int SincTaps = 16;
+
     SampledAudioNode();
     virtual ~SampledAudioNode();
 
     // AudioNode
     virtual void process(ContextRenderLock&, size_t framesToProcess) override;
     virtual void reset(ContextRenderLock&) override;
+    virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
 
     bool setBus(ContextRenderLock &, std::shared_ptr<AudioBus> sourceBus);
     std::shared_ptr<AudioBus> getBus() const { return m_sourceBus; }
 
+    // Plays a mapped file, or a compact bus, in place of a bus, converting its samples as they are rendered. Setting
+    // any one of the three clears the others.
+    bool setMappedFile(ContextRenderLock &, std::shared_ptr<MappedAudioFile> sourceFile);
+    std::shared_ptr<MappedAudioFile> getMappedFile() const { return m_sourceFile; }
+    bool setCompactBus(ContextRenderLock &, std::shared_ptr<CompactAudioBus> sourceBus);
+    std::shared_ptr<CompactAudioBus> getCompactBus() const { return m_sourceCompact; }
+
     // numberOfChannels() returns the number of output channels. This value equals the number of channels from the buffer.
     // If a new buffer is set with a different number of channels, then this value will dynamically change.
     size_t numberOfChannels(ContextRenderLock & r);
@@ -54,6 +78,16 @@ public:
     void setLoopStart(double loopStart);
     void setLoopEnd(double loopEnd);
 
+    // Crossfades the loop's last frames, up to seconds of them, into the frames leading up to its start, with equal
+    // power, so that a loop whose ends don't meet cleanly doesn't click. The blend is made here, for the source
+    // and loop as they are, and kept alongside the source; it's played in place of the loop's last frames for as
+    // long as they stay the same. It's no longer than the frames before the loop's start, nor the loop. Returns
+    // false, with no crossfade, if there's no loop with frames before its start. Zero seconds removes it.
+    bool setLoopCrossfade(ContextRenderLock &, double seconds);
+
+    InterpolationMode interpolation() const;
+    void setInterpolation(InterpolationMode mode);
+
     std::shared_ptr<AudioParam> gain() { return m_gain; }
     std::shared_ptr<AudioParam> playbackRate() { return m_playbackRate; }
     std::shared_ptr<AudioParam> detune() { return m_detune; }
@@ -62,6 +96,13 @@ public:
     void setPannerNode(PannerNode*);
     virtual void clearPannerNode() override;
 
+    // A virtualized node keeps its place in the source, advancing as it would while playing, but reads nothing and
+    // outputs silence, so that the nodes it feeds fall dormant. It fades out over the context's declick length
+    // before going quiet, and fades back in where it has got to when made real again. May be called from any
+    // thread; see VoiceManager.
+    void setVirtualized(bool virtualized) { m_virtualized.store(virtualized, std::memory_order_relaxed); }
+    bool isVirtualized() const { return m_virtualized.load(std::memory_order_relaxed); }
+
     // If we are no longer playing, propagate silence ahead to downstream nodes.
     virtual bool propagatesSilence(ContextRenderLock & r) const override;
 
@@ -70,14 +111,33 @@ private:
     virtual double tailTime(ContextRenderLock & r) const override { return 0; }
     virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
 
-    // Returns true on success.
-    bool renderFromBuffer(ContextRenderLock &, AudioBus *, size_t destinationFrameOffset, size_t numberOfFrames);
+    // Returns true on success. If skip is set, the playback position is advanced over the frames without rendering them.
+    bool renderFromBuffer(ContextRenderLock &, AudioBus *, size_t destinationFrameOffset, size_t numberOfFrames, bool skip = false);
 
     // Render silence starting from "index" frame in AudioBus.
     bool renderSilenceAndFinishIfNotLooping(ContextRenderLock & r, AudioBus *, size_t index, size_t framesToProcess);
 
+    // The source, whichever of the bus, the mapped file and the compact bus is set, as it is described by it.
+    bool hasSource() const;
+    size_t sourceChannelCount() const;
+    size_t sourceLength() const;
+    float sourceSampleRate() const;
+    const void * sourceIdentity() const;
+
     // m_buffer holds the sample data which this node outputs.
     std::shared_ptr<AudioBus> m_sourceBus;
+    std::shared_ptr<MappedAudioFile> m_sourceFile;
+    std::shared_ptr<CompactAudioBus> m_sourceCompact;
+    CompactAudioBus::Reader m_compactReader;
+
+    // A pointer per channel of the mapped file or compact bus, for reading it into the output.
+    std::vector<float *> m_destinations;
+
+    // The loop's crossfade, and the source, the loop's end frame, and its length in frames it was made for.
+    std::unique_ptr<AudioBus> m_loopCrossfade;
+    const void * m_crossfadeSource = nullptr;
+    long m_crossfadeEnd = 0;
+    long m_crossfadeDelta = 0;
 
     // Exposed attributes
     std::shared_ptr<AudioParam> m_gain;
@@ -95,6 +155,7 @@ private:
 
     std::shared_ptr<AudioSetting> m_loopStart;
     std::shared_ptr<AudioSetting> m_loopEnd;
+    std::shared_ptr<AudioSetting> m_interpolation;
 
     // m_virtualReadIndex is a sample-frame index into our buffer representing the current playback position.
     // Since it's floating-point, it has sub-sample accuracy.
@@ -112,6 +173,11 @@ private:
     // m_lastGain provides continuity when we dynamically adjust the gain.
     float m_lastGain{ 1.0f };
 
+    std::atomic<bool> m_virtualized{ false };
+
+    // Render thread only: the fade towards virtualization, from 1 while real to 0 once virtual.
+    float m_presence{ 1.0f };
+
     // We optionally keep track of a panner node which has a doppler shift that is incorporated into
     // the pitch rate. We manually manage ref-counting because we want to use RefTypeConnection.
     PannerNode * m_pannerNode{ nullptr };
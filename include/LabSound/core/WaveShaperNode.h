@@ -9,11 +9,22 @@
 
 namespace lab
 {
+   class AudioSetting;
    class WaveShaperProcessor;
 
+enum class OverSampleType
+{
+    OVERSAMPLE_NONE = 0,
+    OVERSAMPLE_2X = 1,
+    OVERSAMPLE_4X = 2
+};
+
+// settings: oversample
+//
 class WaveShaperNode : public AudioBasicProcessorNode
 {
     WaveShaperProcessor * waveShaperProcessor();
+    std::shared_ptr<AudioSetting> m_oversample;
 public:
     WaveShaperNode();
     virtual ~WaveShaperNode() = default;    
@@ -21,6 +32,11 @@ public:
     // setCurve will take ownership of curve
     void setCurve(std::vector<float> && curve);
     std::vector<float> & curve();
+
+    // The curve is applied at two or four times the sample rate, through half-band filters either side of it,
+    // so that the harmonics it adds above the Nyquist frequency are filtered out ahead of folding back down.
+    OverSampleType oversample() const;
+    void setOversample(OverSampleType type);
 };
 
 } // namespace lab
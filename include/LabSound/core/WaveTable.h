@@ -24,6 +24,13 @@ public:
 
     ~WaveTable();
 
+    // Tables shared by every oscillator at a sample rate. A table is built on first request, by the calling
+    // thread, as that takes an inverse FFT per range; request tables before rendering rather than on the audio
+    // thread. The basic waveforms are kept for the life of the program, custom ones while any oscillator holds
+    // them, and a custom table is shared when its coefficients are identical. Safe to call from any thread.
+    static std::shared_ptr<WaveTable> shared(const float sampleRate, OscillatorType basicWaveform);
+    static std::shared_ptr<WaveTable> shared(const float sampleRate, const std::vector<float> & real, const std::vector<float> & imag);
+
     // Returns pointers to the lower and higher wavetable data for the pitch range containing
     // the given fundamental frequency. These two tables are in adjacent "pitch" ranges
     // where the higher table will have the maximum number of partials which won't alias when played back
@@ -37,6 +44,9 @@ public:
 
     unsigned periodicWaveSize() const;
 
+    // The bytes of the band limited tables.
+    size_t memoryBytes() const;
+
 private:
 
     void generateBasicWaveform(OscillatorType);
@@ -3,8 +3,8 @@
 
 #pragma once
 
+#include <cstddef>
 #include <vector>
-#include <cmath>
 
 namespace lab {
 
@@ -24,88 +24,15 @@ namespace lab {
         window_parzen
     };
 
-    inline void applyWindow(WindowType wType, std::vector<float> &buffer) {
-
-        int bSize = static_cast<int>(buffer.size());
-
-        switch (wType) {
-
-            case window_rectangle: {
-                for (int i = 0; i< bSize; i++) {
-                    buffer[i] *= 0.5;
-                }
-            }
-            break;
-
-            case window_hamming: {
-                for (int i = 0; i< bSize; i++) {
-                    buffer[i] *= 0.54f - 0.46f * cos(TwoPi * i / ( bSize));
-                }
-            }
-            break;
+    // The coefficients of a window of the given type and size. They are generated on the first request for the
+    // type and size, which is not realtime safe, and shared from then on; the table lives as long as the program.
+    const float * windowCoefficients(WindowType wType, size_t size);
 
-            case window_hanning: {
-                for (int i = 0; i< bSize; i++) {
-                    buffer[i] *= 0.5f - (0.5f * cos(TwoPi * i / ( bSize)));
-                }
-            }
-            break;
+    // Multiplies the buffer by the window's coefficients.
+    void applyWindow(WindowType wType, float * buffer, size_t size);
 
-            case window_hanningz: {
-                for (int i = 0; i< bSize; i++) {
-                    buffer[i] *= 0.5f * (1.0f - cos(TwoPi * i / ( bSize)));
-                }
-            }
-            break;
-
-            case window_blackman: {
-                for (int i= 0; i < bSize; i++) {
-                    buffer[i] *= 0.42f - 0.50f * cos(TwoPi * i / (bSize - 1.0f)) + 0.08f * cos(4.0f * TwoPi * i / (bSize - 1.0f));
-                }
-            }
-            break;
-
-            case window_blackman_harris: {
-                for (int i = 0; i < bSize; i++) {
-                    buffer[i] *= 0.35875f - 0.48829f * cos(TwoPi * i / (bSize - 1.0f)) + 0.14128f * cos(2.0f * TwoPi * i / (bSize - 1.0f)) - 0.01168f * cos(3.0f*TwoPi*i/( bSize - 1.0f));
-                }
-            }
-            break;
-
-            case window_gaussian: {
-                float a, b, c = 0.5;
-                int n;
-                for (n = 0; n <  bSize; n++) {
-                    a = (n - c * (bSize - 1)) / (sqrt(c) * (bSize - 1));
-                    b = -c * sqrt(a);
-                    buffer[n] *= exp(b);
-                }
-            }
-            break;
-                
-            case window_welch: {
-                for (int i = 0; i < bSize; i++) {
-                    buffer[i] *= 1.0f - sqrt((2.0f * i - bSize) / (bSize + 1.0f));
-                }
-            }
-            break;
-                
-            case window_bartlett: {
-                for (int i = 0; i < bSize; i++) {
-                    buffer[i] *= 1.0f - abs(2.0f * (i / bSize) - 1.0f);
-                }
-            }
-            break; 
-                
-            case window_parzen: {
-                for (int i = 0; i < bSize; i++) {
-                    buffer[i] *= 1.0f - abs((2.0f * i - bSize) / ( bSize + 1.0f));
-                }
-            }
-            break;
-                
-        }
-        
+    inline void applyWindow(WindowType wType, std::vector<float> &buffer) {
+        applyWindow(wType, buffer.data(), buffer.size());
     }
 
 } // End namespace lab
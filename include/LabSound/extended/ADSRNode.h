@@ -14,12 +14,25 @@
 namespace lab
 {
 
+    // Notes on and off take effect at the sample frame of their time, and each quantum is rendered a stage at a
+    // time, as ramps or a constant gain. Attacks are linear; decays and releases are linear or exponential, the
+    // latter reaching -80 dB of their target as the stage ends.
+    //
+    // params: attackTime, attackLevel, decayTime, sustain, release
+    // settings: shape
+    //
     class ADSRNode : public AudioBasicProcessorNode
     {
         class ADSRNodeInternal;
         ADSRNodeInternal * internalNode;
         
     public:
+
+        enum Shape
+        {
+            LINEAR = 0,
+            EXPONENTIAL = 1
+        };
         
         ADSRNode();
         virtual ~ADSRNode();
@@ -33,6 +46,9 @@ namespace lab
 
         void set(float aT, float aL, float d, float s, float r);
 
+        Shape shape() const;
+        void setShape(Shape shape);
+
         std::shared_ptr<AudioParam> attackTime() const; // Duration in ms
         std::shared_ptr<AudioParam> attackLevel() const; // Duration in ms
         std::shared_ptr<AudioParam> decayTime() const; // Duration in ms
@@ -11,6 +11,7 @@
 #include "LabSound/core/AudioContext.h"
 #include "LabSound/extended/Logging.h"
 
+#include <atomic>
 #include <iostream>
 #include <mutex>
 
@@ -19,24 +20,53 @@
 namespace lab
 {
 
+    // The lock suitor names the code holding the lock, for debugging and lock profiling. It is recorded as a plain
+    // pointer so that acquiring a lock never allocates, which matters on the audio thread. Pass a string literal.
+
+    // An acquisition's times, taken while the context profiles its locks, see AudioContext::setLockProfiling().
+    // The holder found in the way is read as the wait begins.
+    struct ContextLockTiming
+    {
+        const char * blocker = nullptr;
+        uint64_t requested = 0;
+        uint64_t acquired = 0;
+        bool contended = false;
+
+        void acquire(std::mutex & lock, const std::atomic<const char *> & holder)
+        {
+            requested = AudioContext::lockTicks();
+            if (!lock.try_lock())
+            {
+                contended = true;
+                blocker = holder.load(std::memory_order_relaxed);
+                lock.lock();
+            }
+            acquired = AudioContext::lockTicks();
+        }
+    };
+
     class ContextGraphLock
     {
-        AudioContext * m_context;
+        AudioContext * m_context = nullptr;
+        ContextLockTiming m_timing;
 
     public:
         
-        ContextGraphLock(AudioContext * context, const std::string & lockSuitor)
+        ContextGraphLock(AudioContext * context, const char * lockSuitor)
         {
             if (context)
             {
-                context->m_graphLock.lock();
+                if (context->m_lockProfiling.load(std::memory_order_relaxed))
+                    m_timing.acquire(context->m_graphLock, context->m_graphLocker);
+                else
+                    context->m_graphLock.lock();
                 m_context = context;
                 m_context->m_graphLocker = lockSuitor;
             }
 #if defined(DEBUG_LOCKS)
-            if (!m_context && context->m_graphLocker.size())
+            if (!m_context && context && context->m_graphLocker)
             {
-                LOG("%s failed to acquire [GRAPH] lock. Currently held by: %s.", lockSuitor.c_str(), context->m_graphLocker.c_str());
+                LOG("%s failed to acquire [GRAPH] lock. Currently held by: %s.", lockSuitor, context->m_graphLocker.load());
             }
 #endif
         }
@@ -45,7 +75,9 @@ namespace lab
         {
             if (m_context)
             {
-                //m_context->m_graphLocker.clear();
+                if (m_timing.acquired)
+                    m_context->recordLockUse(false, m_context->m_graphLocker.load(std::memory_order_relaxed), m_timing);
+                m_context->m_graphLocker = nullptr;
                 m_context->m_graphLock.unlock();
             }
             
@@ -56,26 +88,30 @@ namespace lab
     
     class ContextRenderLock
     {
-        AudioContext * m_context;
+        AudioContext * m_context = nullptr;
+        ContextLockTiming m_timing;
 
     public:
         
-        ContextRenderLock(AudioContext * context, const std::string & lockSuitor)
+        ContextRenderLock(AudioContext * context, const char * lockSuitor)
         {
             if (context)
             {
-                context->m_renderLock.lock();
+                if (context->m_lockProfiling.load(std::memory_order_relaxed))
+                    m_timing.acquire(context->m_renderLock, context->m_renderLocker);
+                else
+                    context->m_renderLock.lock();
                 m_context = context;
                 m_context->m_renderLocker = lockSuitor;
             }
 #if defined(DEBUG_LOCKS)
-            else if (context && context->m_renderLocker.size())
+            else if (context && context->m_renderLocker)
             {
-                LOG("%s failed to acquire [RENDER] lock. Currently held by: %s.", lockSuitor.c_str(), context->m_renderLocker.c_str());
+                LOG("%s failed to acquire [RENDER] lock. Currently held by: %s.", lockSuitor, context->m_renderLocker.load());
             }
             else
             {
-                LOG("%s failed to acquire [RENDER] lock.", lockSuitor.c_str());
+                LOG("%s failed to acquire [RENDER] lock.", lockSuitor);
             }
 #endif
         }
@@ -84,6 +120,9 @@ namespace lab
         {
             if (m_context)
             {
+                if (m_timing.acquired)
+                    m_context->recordLockUse(true, m_context->m_renderLocker.load(std::memory_order_relaxed), m_timing);
+                m_context->m_renderLocker = nullptr;
                 m_context->m_renderLock.unlock();
             }
         }
@@ -6,6 +6,7 @@
 
 #include "LabSound/core/AudioBus.h"
 
+#include <future>
 #include <memory>
 #include <vector>
 #include <string>
@@ -13,15 +14,35 @@
 
 namespace lab
 {
+    struct AudioFileLoadOptions
+    {
+        bool mixToMono = false;
+
+        // Measures the decoded audio's peak, RMS and integrated loudness as it's written into the bus, and keeps
+        // them as the bus's loudness(), from which playback can apply a normalizing gain, rather than normalizing
+        // the samples with further passes over them.
+        bool measureLoudness = false;
+    };
+
     // Performs direct filesystem i/o to decode the file (using libnyquist)
     std::shared_ptr<AudioBus> MakeBusFromFile(const char * filePath, bool mixToMono);
     std::shared_ptr<AudioBus> MakeBusFromFile(const std::string& path, bool mixToMono);
+    std::shared_ptr<AudioBus> MakeBusFromFile(const std::string& path, const AudioFileLoadOptions & options);
+
+    // Decodes files on threads of their own, each with its own decoder, so that many files load at once. A batch
+    // is shared by threadCount threads, one per core if zero, which exit once it has been decoded. Each future
+    // gives its file's bus, or an empty pointer if the file couldn't be decoded, as MakeBusFromFile() does.
+    std::future<std::shared_ptr<AudioBus>> MakeBusFromFileAsync(const std::string & path, bool mixToMono);
+    std::vector<std::future<std::shared_ptr<AudioBus>>> MakeBusesFromFiles(const std::vector<std::string> & paths, bool mixToMono, size_t threadCount = 0);
+    std::vector<std::future<std::shared_ptr<AudioBus>>> MakeBusesFromFiles(const std::vector<std::string> & paths, const AudioFileLoadOptions & options, size_t threadCount = 0);
 
     // Loads and decodes a raw binary memory chunk making use of magic numbers to determine filetype. 
     std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, bool mixToMono);
+    std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const AudioFileLoadOptions & options);
 
     // Loads and decodes a raw binary memory chunk where the file extension (mp3, wav, ogg, etc) is aleady known. 
     std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const std::string& extension, bool mixToMono);
+    std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const std::string& extension, const AudioFileLoadOptions & options);
 }
 
 #endif
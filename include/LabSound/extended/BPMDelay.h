@@ -11,6 +11,8 @@
 #include "LabSound/core/AudioParam.h"
 #include "LabSound/core/DelayNode.h"
 
+#include <atomic>
+
 namespace lab 
 {
     class BPMDelay : public DelayNode 
@@ -18,6 +20,7 @@ namespace lab
         float tempo;
         int noteDivision; 
         std::vector<float> times;
+        std::atomic<bool> transportSync{ false };
 
         void recomputeDelay()
         {
@@ -36,6 +39,11 @@ namespace lab
         }
 
         void SetDelayIndex(TempoSync value);
+
+        // Follows the tempo of the context's transport, see AudioContext::transport(), rather than SetTempo().
+        void SyncToTransport(bool sync) { transportSync = sync; }
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override;
     };
 }
 
@@ -0,0 +1,138 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef COMMAND_LOG_H
+#define COMMAND_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+    class AudioNode;
+    class AudioParam;
+    class ContextRenderLock;
+
+    // Records what is done to a context, each with the sample frame it took effect at, to a compact binary log
+    // that a CommandReplayer renders again offline, so that a session can be reproduced and profiled exactly:
+    //
+    //     auto recorder = std::make_shared<CommandRecorder>();
+    //     context->startRecordingCommands(recorder);
+    //     ...
+    //     context->stopRecordingCommands();
+    //     recorder->save("session.lscl");
+    //
+    // The log holds the graph edits, connections, disconnections, parameter connections, automatic pull nodes
+    // and held sources, as the graph update applies them, transactions kept whole; and the parameter values set
+    // and the source starts and stops, as the render thread takes them up. Each node is described where the log
+    // first meets it, by its type and its parameters' and settings' values. What a node is given through its own
+    // API, such as a SampledAudioNode's bus, and parameter automation, aren't recorded; see
+    // CommandReplayer::onNode for giving them back. Recording is best started before the graph is built, as a
+    // graph made earlier only appears as far as it is edited afterwards.
+    class CommandRecorder
+    {
+        friend class AudioContext;
+
+    public:
+
+        enum class Command : uint8_t
+        {
+            None = 0,
+            Node,           // a node's description, where the log first meets it
+            Connect,
+            Disconnect,
+            ConnectParam,
+            AddPullNode,
+            RemovePullNode,
+            HoldSource,
+            BeginTransaction,
+            EndTransaction,
+            SetValue,
+            Start,
+            Stop,
+            End,            // recording stopped
+        };
+
+        // The render thread's records go through a preallocated ring of renderCapacity entries, which the graph
+        // update empties; should it fill, records are dropped and counted.
+        explicit CommandRecorder(size_t renderCapacity = 8192);
+        ~CommandRecorder();
+
+        // The log so far, complete once recording has stopped. May be called from any thread.
+        std::vector<uint8_t> log();
+        bool save(const std::string & path);
+
+        // Records lost to a full ring, and those naming a parameter of a node the log hasn't met.
+        uint64_t droppedCount() const;
+
+    private:
+
+        struct State;
+        std::unique_ptr<State> m_state;
+
+        // Called by the context: as recording starts, by the graph update, and on the render thread. recordRender
+        // returns true when the ring should be emptied soon.
+        void begin(AudioContext & context, uint64_t frame);
+        void finish(uint64_t frame);
+        void recordNode(uint64_t frame, const std::shared_ptr<AudioNode> & node);
+        void recordEdit(uint64_t frame, Command command, const std::shared_ptr<AudioNode> & destination, const std::shared_ptr<AudioNode> & source,
+                        const AudioParam * param, uint32_t destIndex, uint32_t srcIndex);
+        void recordTransaction(uint64_t frame, bool begins);
+        bool recordRender(ContextRenderLock &, Command command, uint64_t frame, const void * object, double value);
+        void drain();
+    };
+
+    // Renders a CommandRecorder's log with an offline context, applying each command at its frame, counted from
+    // the start of recording. Nodes are made by type through GraphPrefab's registry.
+    //
+    //     CommandReplayer replayer = CommandReplayer::load("session.lscl");
+    //     auto context = lab::Sound::MakeOfflineAudioContext(replayer.channels(), 0, replayer.sampleRate(), replayer.renderQuantumSize());
+    //     replayer.replay(*context);
+    class CommandReplayer
+    {
+    public:
+
+        // Throw std::invalid_argument if the log is malformed, or can't be read.
+        CommandReplayer(const uint8_t * data, size_t size);
+        static CommandReplayer load(const std::string & path);
+        ~CommandReplayer();
+
+        CommandReplayer(CommandReplayer &&);
+        CommandReplayer & operator=(CommandReplayer &&);
+
+        // As recorded.
+        float sampleRate() const;
+        uint32_t channels() const;
+        size_t renderQuantumSize() const;
+
+        // The frames from the start of recording to its end, or to the last command if it didn't end.
+        uint64_t length() const;
+        size_t commandCount() const;
+
+        // Makes a node of a type the registry doesn't know; without it, or if it returns nullptr, the node's
+        // commands are skipped.
+        std::function<std::shared_ptr<AudioNode>(AudioContext &, const std::string & type)> makeNode;
+
+        // Called with each node as it's made, by the log's number for it, to give it what the log doesn't carry.
+        // Called on the render thread, holding the render lock.
+        std::function<void(uint32_t id, const std::string & type, AudioNode &)> onNode;
+
+        // Renders the log with an offline context at its sample rate, whose destination's stop condition it
+        // replaces for the while, and returns the commands skipped. The context's length, if any, should be at
+        // least length(). Throws std::invalid_argument if the context isn't offline or runs at another rate.
+        size_t replay(AudioContext & context);
+
+    private:
+
+        struct Log;
+        std::unique_ptr<Log> m_log;
+    };
+
+} // end namespace lab
+
+#endif
@@ -0,0 +1,93 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef CompactAudioBus_h
+#define CompactAudioBus_h
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioBus;
+
+    // A bus's samples held in half the memory, as 16 bit integers or half precision floats, or in an eighth of it as
+    // IMA ADPCM, for a SampledAudioNode to play from, converting them to floats as it renders. For the sounds of a
+    // large library kept resident, at a quantum's conversion per playing voice. 16 bit integers keep 16 bit sources
+    // exactly; half precision floats keep 11 bits of precision at any level, which suits sources with a wide dynamic
+    // range. ADPCM is lossy, with its noise following the signal's level, which suits effects and ambiences more
+    // than quiet, sparse sounds.
+    class CompactAudioBus
+    {
+    public:
+
+        enum class Format
+        {
+            Int16,  // round(sample * 32768), clamped; read as value / 32768
+            Float16, // IEEE half precision, rounded to nearest
+            ImaAdpcm // 4 bits a sample, coded from the Int16 samples, see AdpcmBlockFrames
+        };
+
+        // ADPCM is coded in blocks of this many frames of a channel, each beginning with the decoder's state, so
+        // that a block decodes without those before it. A read decodes from the start of each block it touches.
+        static const size_t AdpcmBlockFrames = 256;
+
+        // Reads a compact bus for one voice. For ADPCM it keeps the block of each channel it last decoded, so that
+        // a voice playing through the bus decodes each block once, whether it reads a quantum or a frame at a
+        // time; the other formats are read from the bus as they are. Only the thread rendering the voice uses it.
+        class Reader
+        {
+        public:
+
+            // Allocates the decoded blocks, for a bus the caller keeps alive; null detaches.
+            void setBus(const CompactAudioBus * bus);
+
+            void read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels);
+            float sample(unsigned channel, size_t frame);
+
+        private:
+
+            // The channel's decoded block holding frame.
+            const float * block(unsigned channel, size_t frame);
+
+            const CompactAudioBus * m_bus = nullptr;
+            std::vector<float> m_decoded;  // AdpcmBlockFrames a channel
+            std::vector<size_t> m_blocks;  // which block each channel holds, or SIZE_MAX
+        };
+
+        // Returns nullptr if the bus has no channels.
+        static std::shared_ptr<CompactAudioBus> create(const AudioBus & bus, Format format);
+
+        Format format() const { return m_format; }
+        unsigned numberOfChannels() const { return m_numberOfChannels; }
+        float sampleRate() const { return m_sampleRate; }
+        size_t length() const { return m_length; }
+        double duration() const { return m_length / static_cast<double>(m_sampleRate); }
+
+        // The bytes the samples take.
+        size_t bytes() const { return m_samples.size() * sizeof(uint16_t); }
+
+        // Converts frameCount frames starting at frame into the first numberOfChannels channels of the bus,
+        // each of which must have room for them.
+        void read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels) const;
+
+        float sample(unsigned channel, size_t frame) const;
+
+    private:
+
+        CompactAudioBus(Format format, unsigned numberOfChannels, size_t length, float sampleRate);
+
+        // Decodes count of the frames of a channel's ADPCM block, from its first frame + skip on, into destination.
+        void decode(unsigned channel, size_t block, size_t skip, size_t count, float * destination) const;
+
+        Format m_format;
+        unsigned m_numberOfChannels;
+        size_t m_length;
+        float m_sampleRate;
+        std::vector<uint16_t> m_samples; // planar, a channel after another; for ADPCM, a channel's blocks after another
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef DEVICE_OUTPUT_NODE_H
+#define DEVICE_OUTPUT_NODE_H
+
+#include "LabSound/core/AudioBasicInspectorNode.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+
+#include <memory>
+
+namespace lab
+{
+    class AudioContext;
+    struct AudioDestination;
+
+    // Plays its input on a device other than the context's, such as a headphone cue mix beside a speaker array,
+    // while passing it through, so that whatever feeds both is rendered once. The input is mixed to the device's
+    // channels, and handed through a ring of about twice bufferSeconds to the device's own callback. The device
+    // runs on its own clock, so its callback resamples adaptively: as the ring fills or drains, the device reads
+    // it faster or slower, by up to a fifth of a percent, keeping the ring about bufferSeconds full.
+    //
+    // Like a RecorderNode, it's only rendered while something pulls it; connect it on to the destination, or
+    // add it to the context's automatic pull nodes. The device plays silence until the ring first fills, and
+    // after any underrun until it fills again.
+    class DeviceOutputNode : public AudioBasicInspectorNode
+    {
+        class Device;
+
+    public:
+
+        // Opens the device as settings say, at the context's sample rate, and starts it.
+        DeviceOutputNode(AudioContext & context, const AudioDeviceSettings & settings, int channels = 2, double bufferSeconds = 0.05);
+        virtual ~DeviceOutputNode();
+
+        // AudioNode
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // The rest may be called from any thread.
+
+        // The context's frames the device reads per frame it plays; above 1 if the device's clock runs slow
+        // against the context's.
+        double driftRatio() const;
+
+        // Times the device found the ring empty, and quanta dropped because it was full.
+        uint64_t underrunCount() const;
+        uint64_t overrunCount() const;
+
+        // The seconds between a frame being rendered and being handed to the device.
+        double latency() const;
+
+    private:
+
+        // The device must keep being fed, silence or not.
+        virtual bool propagatesSilence(ContextRenderLock &) const override { return false; }
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        std::unique_ptr<Device> m_device;
+        std::unique_ptr<AudioDestination> m_destination;
+        std::unique_ptr<AudioBus> m_mix;
+    };
+
+} // end namespace lab
+
+#endif
@@ -0,0 +1,80 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef FDN_REVERB_NODE_H
+#define FDN_REVERB_NODE_H
+
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+
+#include <memory>
+
+namespace lab
+{
+    class AudioSetting;
+
+    // An algorithmic stereo reverb, a feedback delay network of 8 or 16 delay lines mixed through a Hadamard
+    // matrix. Each line's length is modulated slowly so that the tail doesn't ring, and each line has a damping
+    // filter setting its decay, so that the network falls 60dB in decayTime at low frequencies, and faster the
+    // higher the damping at high frequencies. It renders a hall for a small fraction of the cost of convolving
+    // with a measured impulse response of the same length, though it only approximates a room.
+    //
+    // Like a ConvolverNode it outputs the reverberation only. The input's left channel feeds the even lines and
+    // its right channel the odd ones; a mono input feeds them all.
+    //
+    // decayTime is in seconds and modulationDepth, the most a line's length is stretched, in seconds too.
+    // damping goes from 0, which decays as fast at all frequencies, to 1, which decays twenty times as fast at
+    // the Nyquist frequency. size scales the lengths of the lines, from 0.1 to 1, which is a large hall.
+    //
+    // params: decayTime, damping, modulationRate, modulationDepth
+    // settings: lines, size
+    //
+    class FDNReverbNode : public AudioNode
+    {
+    public:
+
+        enum { MaxLines = 16 };
+
+        FDNReverbNode(float sampleRate);
+        virtual ~FDNReverbNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        virtual void initialize() override;
+        virtual void uninitialize() override;
+
+        // 8 or 16.
+        uint32_t lines() const;
+        void setLines(uint32_t lines);
+        float size() const;
+        void setSize(float size);
+
+        std::shared_ptr<AudioParam> decayTime() { return m_decayTime; }
+        std::shared_ptr<AudioParam> damping() { return m_damping; }
+        std::shared_ptr<AudioParam> modulationRate() { return m_modulationRate; }
+        std::shared_ptr<AudioParam> modulationDepth() { return m_modulationDepth; }
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override;
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        std::shared_ptr<AudioParam> m_decayTime;
+        std::shared_ptr<AudioParam> m_damping;
+        std::shared_ptr<AudioParam> m_modulationRate;
+        std::shared_ptr<AudioParam> m_modulationDepth;
+
+        std::shared_ptr<AudioSetting> m_lines;
+        std::shared_ptr<AudioSetting> m_size;
+
+        float m_sampleRate;
+
+        struct Internals;
+        std::unique_ptr<Internals> m_internal;
+    };
+}
+
+#endif
@@ -0,0 +1,125 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef FEATURE_EXTRACTOR_NODE_H
+#define FEATURE_EXTRACTOR_NODE_H
+
+#include "LabSound/core/AudioBasicInspectorNode.h"
+
+#include <memory>
+
+namespace lab
+{
+    class AudioSetting;
+
+    // Extracts features of its input, mixed to mono, every hopSize frames, from a Hann windowed frame of
+    // windowSize frames: the log energies of melBands mel spaced bands, the first mfccCount mel frequency cepstral
+    // coefficients, the spectral centroid, the spectral flux and the onsets it marks, and the pitch, found by the
+    // McLeod pitch method between minPitch and maxPitch. Only the features asked for are computed. Each frame's
+    // features are published to other threads as soon as the audio thread has computed them, and features()
+    // copies out the latest without waiting for it.
+    //
+    // An onset is a flux more than onsetThreshold times its average over the last few frames, and more than a
+    // small floor.
+    //
+    // settings: windowSize, hopSize, melBands, mfccCount, minPitch, maxPitch, onsetThreshold, features
+    //
+    class FeatureExtractorNode : public AudioBasicInspectorNode
+    {
+    public:
+
+        enum { MaxMelBands = 128, MaxMFCCs = 40 };
+
+        enum Feature : uint32_t
+        {
+            MelBands = 1,
+            MFCC = 2, // implies MelBands
+            Centroid = 4,
+            Onset = 8,
+            Pitch = 16,
+            AllFeatures = 31
+        };
+
+        // The features not asked for are zero.
+        struct Features
+        {
+            // Counts the frames analysed; 0 before the first.
+            uint64_t sequence;
+
+            // The context's frame at the end of the analysed frame.
+            uint64_t sampleFrame;
+
+            uint32_t melBandCount;
+            float melBands[MaxMelBands];
+
+            uint32_t mfccCount;
+            float mfcc[MaxMFCCs];
+
+            // In Hz.
+            float centroid;
+
+            float flux;
+            bool onset;
+
+            // In Hz, and 0 if no pitch was found. clarity is the normalized autocorrelation at the pitch's period,
+            // up to 1 for a perfectly periodic frame.
+            float pitch;
+            float pitchClarity;
+        };
+
+        FeatureExtractorNode(float sampleRate);
+        virtual ~FeatureExtractorNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // Rounded up to a power of two, from 64 to 16384. The hop is at most the window.
+        void setWindowSize(uint32_t size);
+        uint32_t windowSize() const;
+        void setHopSize(uint32_t size);
+        uint32_t hopSize() const;
+
+        // Up to MaxMelBands and MaxMFCCs.
+        void setMelBands(uint32_t bands);
+        uint32_t melBands() const;
+        void setMFCCCount(uint32_t count);
+        uint32_t mfccCount() const;
+
+        void setPitchRange(float minPitch, float maxPitch);
+        void setOnsetThreshold(float threshold);
+
+        // A mask of Feature.
+        void setEnabledFeatures(uint32_t features);
+        uint32_t enabledFeatures() const;
+
+        // May be called from any thread. Returns false if no frame has been analysed since the last call.
+        bool features(Features & result);
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        // Rebuilds the analysis from the settings.
+        void configure();
+
+        std::shared_ptr<AudioSetting> m_windowSize;
+        std::shared_ptr<AudioSetting> m_hopSize;
+        std::shared_ptr<AudioSetting> m_melBands;
+        std::shared_ptr<AudioSetting> m_mfccCount;
+        std::shared_ptr<AudioSetting> m_minPitch;
+        std::shared_ptr<AudioSetting> m_maxPitch;
+        std::shared_ptr<AudioSetting> m_onsetThreshold;
+        std::shared_ptr<AudioSetting> m_features;
+
+        float m_sampleRate;
+
+        struct Analysis;
+        struct Internals;
+        std::unique_ptr<Internals> m_internal;
+    };
+}
+
+#endif
@@ -4,18 +4,36 @@
 #ifndef FUNCTION_NODE_H
 #define FUNCTION_NODE_H
 
+#include "LabSound/core/AudioArray.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioParam.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace lab
 {
-    
+    class AudioBus;
+
+    // Renders whatever a user function writes. A function is either called per channel through a std::function,
+    // or once per quantum through a plain function pointer, given the whole output bus and the sample accurate
+    // values of the params added to the node.
+    //
+    // Driving parameters, it can render at control rate, see AudioNode::setControlRate(). The function is then
+    // given a frame for every controlStride() frames of the quantum, and the params' values are given likewise.
+    //
     class FunctionNode : public AudioScheduledSourceNode
     {
         
     public:
-        
+
+        // Writes frames of each channel of bus from offset on. params holds a pointer per param, in the order they
+        // were added, to a quantum of values indexed like the bus's channels.
+        typedef void (*BlockFunction)(ContextRenderLock & r, FunctionNode * me, AudioBus & bus, size_t offset, size_t frames,
+                                      const float * const * params, void * userData);
+
         FunctionNode(size_t channels = 1);
         virtual ~FunctionNode();
         
@@ -23,10 +41,25 @@ namespace lab
         void setFunction(std::function<void(ContextRenderLock & r, FunctionNode * me, int channel, float * buffer, size_t frames)> fn)
         {
             _function = fn;
+            _blockFunction = nullptr;
+            _userData = nullptr;
         }
+
+        // Replaces any per channel function. userData is passed through to fn, and is the caller's to keep alive.
+        void setBlockFunction(BlockFunction fn, void * userData = nullptr)
+        {
+            _function = nullptr;
+            _blockFunction = fn;
+            _userData = userData;
+        }
+
+        // Adds a param for a block function to read, before the node is connected; it can be automated or
+        // driven by a connection like any other.
+        std::shared_ptr<AudioParam> addParam(const std::string & name, double defaultValue, double minValue, double maxValue);
         
         virtual void process(ContextRenderLock & r, size_t framesToProcess) override;
         virtual void reset(ContextRenderLock & r) override;
+        virtual bool supportsControlRate() const override { return true; }
         
         double now() const { return _now; }
         
@@ -35,6 +68,14 @@ namespace lab
         virtual bool propagatesSilence(ContextRenderLock & r) const override;
         
         std::function<void(ContextRenderLock & r, FunctionNode * me, int channel, float * values, size_t framesToProcess)> _function;
+
+        BlockFunction _blockFunction = nullptr;
+        void * _userData = nullptr;
+
+        // The added params, a quantum of values for each, and pointers to those for the block function.
+        std::vector<std::shared_ptr<AudioParam>> _addedParams;
+        std::vector<std::unique_ptr<AudioFloatArray>> _paramValues;
+        std::vector<const float *> _paramValuePointers;
         
         double _now = 0.0;
     };
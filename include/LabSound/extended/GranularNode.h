@@ -0,0 +1,142 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef GRANULAR_NODE_H
+#define GRANULAR_NODE_H
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioBus;
+    class AudioSetting;
+
+    // A granular synthesizer, rendering every grain of one source bus itself, from a pool allocated up front, rather
+    // than through a scheduled node per grain. While density is above zero, grains start density times a second,
+    // each at the sample frame it falls on, read from position, moved at random by up to positionJitter either way,
+    // at playbackRate, and panned at random by up to spread. Grains can also be started one by one with triggerGrain.
+    // Each grain is shaped by the window, and a grain that doesn't fit in the pool is dropped. The params are read
+    // once per quantum. Positions and durations are in seconds.
+    //
+    // params: density, duration, position, positionJitter, playbackRate, spread, gain
+    // settings: window, maxGrains
+    //
+    class GranularNode final : public AudioNode
+    {
+    public:
+
+        enum WindowType
+        {
+            HANN = 0,
+            TRIANGLE = 1,
+            TUKEY = 2 // flat, with cosine tapers over the outer quarters
+        };
+
+        GranularNode();
+        virtual ~GranularNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // Replaces the source, silencing every grain. A mono source plays in both channels; a stereo one in its own.
+        void setSource(ContextRenderLock &, std::shared_ptr<AudioBus> source);
+
+        // Starts a grain at when, in the context's time, or at once if that has passed. pan is from -1, left, to 1,
+        // right. Returns false, dropping the grain, if there is no source or the pool is full.
+        bool triggerGrain(ContextRenderLock &, double when, double position, double duration,
+                          float playbackRate = 1, float gain = 1, float pan = 0);
+
+        size_t activeGrainCount() const { return m_active.size(); }
+
+        WindowType window() const;
+        void setWindow(WindowType window);
+
+        // The most grains sounding at once. Changing it silences every grain.
+        uint32_t maxGrains() const;
+        void setMaxGrains(uint32_t grains);
+
+        std::shared_ptr<AudioParam> density() { return m_density; }
+        std::shared_ptr<AudioParam> duration() { return m_duration; }
+        std::shared_ptr<AudioParam> position() { return m_position; }
+        std::shared_ptr<AudioParam> positionJitter() { return m_positionJitter; }
+        std::shared_ptr<AudioParam> playbackRate() { return m_playbackRate; }
+        std::shared_ptr<AudioParam> spread() { return m_spread; }
+        std::shared_ptr<AudioParam> gain() { return m_gain; }
+
+        virtual bool propagatesSilence(ContextRenderLock & r) const override;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        struct Grain
+        {
+            double position;      // in source frames
+            double rate;          // source frames per frame
+            uint64_t startFrame;
+            uint32_t length;      // in frames
+            uint32_t elapsed;
+            float gainLeft;
+            float gainRight;
+        };
+
+        // Empties the pool and sizes it for the given grains.
+        void resizePool(size_t count);
+
+        // Fills the window table for the window setting.
+        void buildWindow();
+
+        // Takes a grain from the pool, fitting it within the source. Returns false if none is free.
+        bool startGrain(ContextRenderLock &, uint64_t frame, double position, double duration, float playbackRate, float gain, float pan);
+
+        // Adds the grain's frames in this quantum to left and right, returning true once it has ended.
+        bool renderGrain(Grain & grain, float * left, float * right, uint64_t quantumStart, size_t framesToProcess);
+
+        // Uniform in [-1, 1).
+        float random();
+
+        std::shared_ptr<AudioBus> m_source;
+
+        std::vector<Grain> m_grains;
+        std::vector<uint32_t> m_free;
+        std::vector<uint32_t> m_active;
+
+        // The frame of the next scheduled grain, and of the last, while density is above zero.
+        double m_nextOnset{ 0 };
+        double m_lastOnset{ 0 };
+        bool m_isStreaming{ false };
+
+        std::vector<float> m_windowTable;
+        uint32_t m_windowType{ 0xffffffff };
+        uint32_t m_windowVersion{ 0 }; // of m_window, when m_windowTable was built
+
+        // The read positions of a grain, its window, and its samples, for a quantum.
+        AudioFloatArray m_indices;
+        AudioFloatArray m_windowValues;
+        AudioFloatArray m_samples;
+
+        uint32_t m_random{ 0x9e3779b9u };
+
+        std::shared_ptr<AudioParam> m_density;
+        std::shared_ptr<AudioParam> m_duration;
+        std::shared_ptr<AudioParam> m_position;
+        std::shared_ptr<AudioParam> m_positionJitter;
+        std::shared_ptr<AudioParam> m_playbackRate;
+        std::shared_ptr<AudioParam> m_spread;
+        std::shared_ptr<AudioParam> m_gain;
+        std::shared_ptr<AudioSetting> m_window;
+        std::shared_ptr<AudioSetting> m_maxGrains;
+
+        float m_lastGain{ 1.0f };
+    };
+}
+
+#endif
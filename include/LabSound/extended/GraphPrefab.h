@@ -0,0 +1,193 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef GRAPH_PREFAB_H
+#define GRAPH_PREFAB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+    class AudioNode;
+    class GraphTransaction;
+
+    // The structure of a graph, independent of any context: its nodes by type, with their parameters' and
+    // settings' values, and the connections between them. Nodes are referred to by their index in nodes.
+    struct GraphDescription
+    {
+        struct Value
+        {
+            std::string name;
+            float value = 0;
+        };
+
+        struct Node
+        {
+            std::string type; // as registered with GraphPrefab, such as "GainNode"
+            std::string name; // optional, to find the node in an instance
+            std::vector<Value> params;
+            std::vector<Value> settings;
+        };
+
+        struct Connection
+        {
+            size_t source;
+            uint32_t output = 0;
+            size_t destination;
+            uint32_t input = 0;
+            std::string param; // if not empty, the destination's parameter driven, rather than an input
+        };
+
+        std::vector<Node> nodes;
+        std::vector<Connection> connections;
+
+        // Returns the new node's index.
+        size_t addNode(const std::string & type, const std::string & name = std::string());
+        void setParam(size_t node, const std::string & param, float value);
+        void setSetting(size_t node, const std::string & setting, float value);
+        void connect(size_t destination, size_t source, uint32_t input = 0, uint32_t output = 0);
+        void connectParam(size_t destination, const std::string & param, size_t driver, uint32_t output = 0);
+
+        // {"nodes":[{"type":..., "name":..., "params":{...}, "settings":{...}}, ...],
+        //  "connections":[{"source":0, "output":0, "destination":1, "input":0, "param":"gain"}, ...]}
+        // with the defaults left out. fromJson throws std::invalid_argument on a malformed description.
+        std::string toJson() const;
+        static GraphDescription fromJson(const std::string & json);
+
+        // A compact little-endian equivalent, which fromBinary likewise throws std::invalid_argument on.
+        std::vector<uint8_t> toBinary() const;
+        static GraphDescription fromBinary(const uint8_t * data, size_t size);
+    };
+
+    // One block of memory for the nodes of a prefab instance. Nodes made through make() are placed in it one
+    // after another, and the block is freed once the last of them is; a node that doesn't fit goes on the heap.
+    class PrefabArena
+    {
+    public:
+
+        struct Block;
+
+        template <typename T>
+        struct Allocator
+        {
+            typedef T value_type;
+
+            explicit Allocator(std::shared_ptr<Block> b) : block(std::move(b)) {}
+            template <typename U>
+            Allocator(const Allocator<U> & other) : block(other.block) {}
+
+            T * allocate(size_t n) { return static_cast<T *>(PrefabArena::allocate(block, sizeof(T) * n, alignof(T))); }
+            void deallocate(T * p, size_t n) { PrefabArena::deallocate(block, p, sizeof(T) * n); }
+
+            template <typename U>
+            bool operator==(const Allocator<U> & other) const { return block == other.block; }
+            template <typename U>
+            bool operator!=(const Allocator<U> & other) const { return block != other.block; }
+
+            std::shared_ptr<Block> block;
+        };
+
+        // An arena of capacity bytes; with none, every node goes on the heap, and the bytes are only counted.
+        explicit PrefabArena(size_t capacity = 0);
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make(Args &&... args)
+        {
+            return std::allocate_shared<T>(Allocator<T>(m_block), std::forward<Args>(args)...);
+        }
+
+        // The bytes asked of the arena, the block or not, with their alignment.
+        size_t used() const;
+
+    private:
+
+        static void * allocate(const std::shared_ptr<Block> & block, size_t bytes, size_t alignment);
+        static void deallocate(const std::shared_ptr<Block> & block, void * p, size_t bytes);
+
+        std::shared_ptr<Block> m_block;
+    };
+
+    // A graph description compiled for a context: its types looked up, its parameter and setting names resolved,
+    // and its connections checked, once, so that instantiating it only makes the nodes, in one PrefabArena, sets
+    // their values, and wires them in one GraphTransaction, without waking the graph update thread per connection.
+    //
+    //     GraphPrefab voice(context, GraphDescription::fromJson(json));
+    //     GraphTransaction t(&context);
+    //     std::vector<std::shared_ptr<AudioNode>> nodes = voice.instantiate(context, t);
+    //     t.connect(context.destination(), nodes[voice.index("out")]);
+    //     t.commit();
+    class GraphPrefab
+    {
+    public:
+
+        // Makes a node of a type in an arena, such as [](AudioContext & c, PrefabArena & a) { return
+        // a.make<GainNode>(); }.
+        using NodeFactory = std::function<std::shared_ptr<AudioNode>(AudioContext &, PrefabArena &)>;
+
+        // LabSound's nodes that need no more than a sample rate to construct are registered from the start, by
+        // class name. May be called from any thread.
+        static void registerType(const std::string & type, NodeFactory factory);
+
+        // A node of a registered type, on the heap, or nullptr if the type is unknown.
+        static std::shared_ptr<AudioNode> makeNode(AudioContext & context, const std::string & type);
+
+        // Throws std::invalid_argument if the description names an unknown type, parameter or setting, or a
+        // connection to a node, input or output that doesn't exist.
+        GraphPrefab(AudioContext & context, const GraphDescription & description);
+        ~GraphPrefab();
+
+        // Makes the nodes, in the order of the description, and adds their connections to the transaction,
+        // which is left to be committed, perhaps with the instance's connections to the rest of the graph.
+        std::vector<std::shared_ptr<AudioNode>> instantiate(AudioContext & context, GraphTransaction & transaction) const;
+
+        // As above, committing the connections at once.
+        std::vector<std::shared_ptr<AudioNode>> instantiate(AudioContext & context) const;
+
+        // The index of the node of a name, or the node count if there's none.
+        size_t index(const std::string & name) const;
+
+        size_t nodeCount() const { return m_nodes.size(); }
+
+        // The bytes of each instance's block.
+        size_t arenaBytes() const { return m_arenaBytes; }
+
+    private:
+
+        struct Value
+        {
+            size_t index;
+            float value;
+            bool integer; // for settings, set as an integer
+        };
+
+        struct Node
+        {
+            std::string name;
+            NodeFactory factory;
+            std::vector<Value> params;
+            std::vector<Value> settings;
+        };
+
+        struct Connection
+        {
+            size_t source;
+            uint32_t output;
+            size_t destination;
+            uint32_t input;
+            size_t param; // of the destination, or SIZE_MAX for an input
+        };
+
+        std::vector<Node> m_nodes;
+        std::vector<Connection> m_connections;
+        size_t m_arenaBytes = 0;
+    };
+
+} // end namespace lab
+
+#endif
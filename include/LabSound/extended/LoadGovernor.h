@@ -0,0 +1,104 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef LOAD_GOVERNOR_H
+#define LOAD_GOVERNOR_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+    class ConvolverNode;
+    class PannerNode;
+    class SampledAudioNode;
+    class SampledVoicePool;
+
+    // Trades rendering detail for time as the render load rises, rather than letting the device miss its deadlines.
+    // The load is AudioRenderHealth::recentLoad. As it passes each threshold in turn a step is engaged, and a step
+    // is released once the load falls hysteresis below its threshold, the latest step first. At most one step is
+    // taken per holdSeconds, so that a step's effect on the load is seen before the next.
+    //
+    // Only registered objects are degraded; they are held weakly, and everything degraded is restored when the
+    // governor is released or destroyed. update() is to be called regularly, say once a frame, from one thread,
+    // which is the thread onChange is called on.
+    class LoadGovernor
+    {
+    public:
+
+        enum class Step
+        {
+            SimplerPanning,    // HRTF panners at least pannerDistance from the listener pan at equal power
+            ShorterReverbs,    // convolvers keep reverbTail seconds of their responses
+            CheaperResampling, // sampled nodes interpolate linearly
+            FewerVoices,       // voice pools are limited to voiceFraction of their voices
+        };
+        static const int StepCount = 4;
+
+        struct Settings
+        {
+            double thresholds[StepCount] = { 0.6, 0.7, 0.8, 0.9 }; // by step, as fractions of the render budget
+            double hysteresis = 0.15;
+            double holdSeconds = 0.5;
+
+            float pannerDistance = 10;
+            double reverbTail = 0.5;
+            float voiceFraction = 0.5f;
+        };
+
+        struct Event
+        {
+            Step step;
+            bool engaged;
+            double load;
+        };
+
+        explicit LoadGovernor(AudioContext & context);
+        LoadGovernor(AudioContext & context, const Settings & settings);
+        ~LoadGovernor();
+
+        void addPanner(std::shared_ptr<PannerNode> panner);
+        void addConvolver(std::shared_ptr<ConvolverNode> convolver);
+        void addSampledNode(std::shared_ptr<SampledAudioNode> node);
+        void addVoicePool(std::shared_ptr<SampledVoicePool> pool);
+
+        void update();
+
+        // Releases every step now.
+        void release();
+
+        // The steps engaged; those below it are engaged too.
+        int engagedSteps() const { return m_engaged; }
+
+        std::function<void(const Event &)> onChange;
+
+    private:
+
+        void engage(Step step);
+        void disengage(Step step);
+        void updatePanners();
+
+        template <typename T>
+        struct Entry
+        {
+            std::weak_ptr<T> object;
+            bool degraded = false;
+            int restore = 0; // the setting to restore, where there are several
+        };
+
+        AudioContext & m_context;
+        Settings m_settings;
+        int m_engaged = 0;
+        std::chrono::steady_clock::time_point m_lastChange;
+
+        std::vector<Entry<PannerNode>> m_panners;
+        std::vector<Entry<ConvolverNode>> m_convolvers;
+        std::vector<Entry<SampledAudioNode>> m_sampledNodes;
+        std::vector<Entry<SampledVoicePool>> m_voicePools;
+    };
+}
+
+#endif
@@ -9,17 +9,69 @@
 #include <string>
 #include <iostream>
 
-#if defined(_DEBUG) || defined (DEBUG)
-    #define LOG(...) LabSoundLog(__FILE__, __LINE__, __VA_ARGS__);
-    #define LOG_ERROR(...) LabSoundLog(__FILE__, __LINE__, __VA_ARGS__)
-    #define LOG_VERBOSE(channel, ...) LabSoundLog(__FILE__, __LINE__, __VA_ARGS__)
+// Severities, lowest first. LABSOUND_LOG_LEVEL is the lowest that is compiled in: by default everything in debug
+// builds, and nothing otherwise. LabSoundSetLogLevel() filters further at runtime.
+#define LABSOUND_LOG_VERBOSE 0
+#define LABSOUND_LOG_INFO    1
+#define LABSOUND_LOG_ERROR   2
+#define LABSOUND_LOG_NONE    3
+
+#ifndef LABSOUND_LOG_LEVEL
+    #if defined(_DEBUG) || defined (DEBUG)
+        #define LABSOUND_LOG_LEVEL LABSOUND_LOG_VERBOSE
+    #else
+        #define LABSOUND_LOG_LEVEL LABSOUND_LOG_NONE
+    #endif
+#endif
+
+#if LABSOUND_LOG_LEVEL <= LABSOUND_LOG_VERBOSE
+    #define LOG_VERBOSE(channel, ...) LabSoundLogAt(LABSOUND_LOG_VERBOSE, __FILE__, __LINE__, __VA_ARGS__)
 #else
-    #define LOG(...)
-    #define LOG_ERROR(channel, ...)
     #define LOG_VERBOSE(channel, ...)
 #endif
 
+#if LABSOUND_LOG_LEVEL <= LABSOUND_LOG_INFO
+    #define LOG(...) LabSoundLogAt(LABSOUND_LOG_INFO, __FILE__, __LINE__, __VA_ARGS__);
+#else
+    #define LOG(...)
+#endif
+
+#if LABSOUND_LOG_LEVEL <= LABSOUND_LOG_ERROR
+    #define LOG_ERROR(...) LabSoundLogAt(LABSOUND_LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
+#else
+    #define LOG_ERROR(...)
+#endif
+
+// The longest message kept, terminator included; longer ones are truncated.
+#define LABSOUND_LOG_MESSAGE_SIZE 232
+
+// Formats the message into a fixed size record and queues it for the logging thread, which hands it to the sink.
+// Neither allocates nor blocks, so it may be called while rendering. If the queue is full the message is dropped,
+// and the number dropped is logged later. While the logging thread isn't running, the message is handed to the
+// sink directly.
+void LabSoundLogAt(int level, const char* file, int line, const char* fmt, ...);
+
+// Logs at LABSOUND_LOG_ERROR.
 void LabSoundLog(const char* file, int line, const char* fmt, ...);
+
 void LabSoundAssertLog(const char* file, int line, const char * function, const char * assertion);
 
+// Messages below the level are discarded when they are logged. Defaults to LABSOUND_LOG_VERBOSE.
+void LabSoundSetLogLevel(int level);
+int LabSoundGetLogLevel();
+
+// Called for every message, on the logging thread while it runs; nullptr restores the default, which prints to
+// stdout.
+typedef void (*LabSoundLogSink)(int level, const char* file, int line, const char* message);
+void LabSoundSetLogSink(LabSoundLogSink sink);
+
+// Blocks until the messages queued so far have been handed to the sink.
+void LabSoundLogFlush();
+
+// The logging thread runs from the first start to the matching stop, which hands on the messages still queued.
+// Each context starts it as it's made and stops it as it's destroyed, unless the library's logging is compiled
+// out. Not to be called while rendering.
+void LabSoundStartLogging();
+void LabSoundStopLogging();
+
 #endif
@@ -0,0 +1,44 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef MappedAudioFile_h
+#define MappedAudioFile_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace lab
+{
+    // An uncompressed WAV file mapped into memory rather than decoded, for a SampledAudioNode to play its samples
+    // from as they are, converting them to floats as it renders. Opening one doesn't read the samples, and the pages
+    // holding them are part of the OS's file cache, shared by every process and node playing the file.
+    class MappedAudioFile
+    {
+    public:
+
+        // Returns nullptr if the file can't be mapped, or isn't a PCM or float WAV file.
+        static std::shared_ptr<MappedAudioFile> open(const std::string & path);
+        ~MappedAudioFile();
+
+        unsigned numberOfChannels() const;
+        float sampleRate() const;
+        size_t length() const;
+        double duration() const;
+
+        // Converts frameCount frames starting at frame into the first numberOfChannels channels of the file,
+        // each of which must have room for them.
+        void read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels) const;
+
+        float sample(unsigned channel, size_t frame) const;
+
+    private:
+
+        struct Internals;
+        explicit MappedAudioFile(std::unique_ptr<Internals> internals);
+
+        std::unique_ptr<Internals> m_internals;
+    };
+}
+
+#endif
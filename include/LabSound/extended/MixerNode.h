@@ -0,0 +1,61 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef MIXER_NODE_H
+#define MIXER_NODE_H
+
+#include "LabSound/core/AudioNode.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+namespace lab
+{
+    class AudioBus;
+
+    // Sums many inputs into one stereo output, each with a gain and a pan of its own, in place of a GainNode and a
+    // StereoPannerNode per voice feeding one shared input. Connect to an input by its index. Mono inputs are panned
+    // at equal power and stereo inputs as StereoPannerNode pans them; inputs of more channels are mixed down to
+    // stereo first. Several inputs are summed in each pass over the output, and a gain or pan change is ramped
+    // over a quantum.
+    class MixerNode : public AudioNode
+    {
+    public:
+
+        explicit MixerNode(size_t numberOfInputs = 1);
+        virtual ~MixerNode();
+
+        // Adds inputs at unity gain, centred. As with ChannelMergerNode, add them before the node renders.
+        void addInputs(size_t n);
+
+        // May be called from any thread. Pans run from -1, left, to 1, right. Indices past the inputs are ignored.
+        void setGain(size_t input, float gain);
+        void setPan(size_t input, float pan);
+        float gain(size_t input) const;
+        float pan(size_t input) const;
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        struct Strip
+        {
+            std::atomic<float> gain{ 1.f };
+            std::atomic<float> pan{ 0.f };
+
+            // Render thread only: the gains last applied, from each input channel to each output channel.
+            float applied[2][2] = {};
+            size_t appliedChannels = 0;
+        };
+
+        std::deque<Strip> m_strips;
+        std::unique_ptr<AudioBus> m_downmix;
+    };
+}
+
+#endif
@@ -0,0 +1,90 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef MULTIBAND_COMPRESSOR_NODE_H
+#define MULTIBAND_COMPRESSOR_NODE_H
+
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+
+#include <memory>
+
+namespace lab
+{
+    class AudioSetting;
+
+    // A stereo compressor that can listen to a sidechain, and can split its input into two or three bands by
+    // fourth order Linkwitz-Riley crossovers, compressing each band by an envelope of its own. While none of them
+    // is compressed, the bands sum to the input with a flat magnitude, delayed by the lookahead.
+    //
+    // Input 0 is compressed. While input 1, the sidechain, is connected, the envelopes follow it instead, split
+    // by the same crossovers, so that music on input 0 ducks under dialog on input 1 from one frame to the next,
+    // with no analysis on the main thread. The makeup gain is applied as given; unlike DynamicsCompressorNode's
+    // it isn't raised automatically.
+    //
+    // The parameters apply to every band. reduction reports the deepest reduction of any band, in dB.
+    //
+    // params: threshold, knee, ratio, attack, release, makeupGain, reduction
+    // settings: bands, lowCrossover, highCrossover
+    //
+    class MultibandCompressorNode : public AudioNode
+    {
+    public:
+
+        enum { MaxBands = 3 };
+
+        MultibandCompressorNode();
+        virtual ~MultibandCompressorNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        virtual void initialize() override;
+        virtual void uninitialize() override;
+        virtual void prepare(AudioContext & context, size_t inputChannels) override;
+
+        // From 1, a single band compressor, to MaxBands. Two bands cross over at the low crossover, and three at
+        // the low and the high crossovers, in Hz.
+        uint32_t bands() const;
+        void setBands(uint32_t bands);
+        float lowCrossover() const;
+        void setLowCrossover(float hz);
+        float highCrossover() const;
+        void setHighCrossover(float hz);
+
+        // The reduction of each band at the end of the last quantum, in dB.
+        float bandReduction(uint32_t band) const;
+
+        std::shared_ptr<AudioParam> threshold() { return m_threshold; }
+        std::shared_ptr<AudioParam> knee() { return m_knee; }
+        std::shared_ptr<AudioParam> ratio() { return m_ratio; }
+        std::shared_ptr<AudioParam> attack() { return m_attack; }
+        std::shared_ptr<AudioParam> release() { return m_release; }
+        std::shared_ptr<AudioParam> makeupGain() { return m_makeupGain; }
+        std::shared_ptr<AudioParam> reduction() { return m_reduction; }
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override;
+
+        std::shared_ptr<AudioParam> m_threshold;
+        std::shared_ptr<AudioParam> m_knee;
+        std::shared_ptr<AudioParam> m_ratio;
+        std::shared_ptr<AudioParam> m_attack;
+        std::shared_ptr<AudioParam> m_release;
+        std::shared_ptr<AudioParam> m_makeupGain;
+        std::shared_ptr<AudioParam> m_reduction;
+
+        std::shared_ptr<AudioSetting> m_bands;
+        std::shared_ptr<AudioSetting> m_lowCrossover;
+        std::shared_ptr<AudioSetting> m_highCrossover;
+
+        struct Internals;
+        std::unique_ptr<Internals> m_internal;
+    };
+}
+
+#endif
@@ -0,0 +1,104 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef NETWORK_AUDIO_OUTPUT_H
+#define NETWORK_AUDIO_OUTPUT_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace lab
+{
+    class AudioBus;
+
+    // Streams what a context renders as RTP over UDP, for servers without an audio device. It's fed by the Null
+    // backend's clock, see AudioDeviceSettings::nullOutput:
+    //
+    //     settings.backend = AudioDeviceSettings::Backend::Null;
+    //     settings.nullOutput = network->output();
+    //
+    // The render thread only copies each quantum into a ring of about bufferSeconds; a thread of the output's own
+    // cuts the ring into packets, encodes them and sends each as its time comes, so that packets leave evenly
+    // rather than in bursts of a quantum. The payload is uncompressed big-endian L16 or L24, as AES67 carries it,
+    // or Opus where LabSound was built with it.
+    //
+    // The output listens for RTCP receiver reports on the local port above its own, and reports the loss and
+    // jitter they carry alongside its own counts.
+    class NetworkAudioOutput
+    {
+        class Sender;
+
+    public:
+
+        enum class Encoding
+        {
+            L16,
+            L24,
+            Opus, // 48 kHz on the wire; the context must run at 8, 12, 16, 24 or 48 kHz
+        };
+
+        struct Settings
+        {
+            std::string address = "127.0.0.1"; // IPv4, unicast or multicast
+            uint16_t port = 5004;
+            uint16_t localPort = 5004;          // RTP is sent from here, and RTCP received on the port above
+            int multicastTTL = 16;
+
+            Encoding encoding = Encoding::L24;
+            uint8_t payloadType = 96;
+            uint32_t ssrc = 0;                  // random if 0
+
+            // AES67's default of 1 ms, which the largest packets are split below a network MTU. Opus takes 2.5,
+            // 5, 10, 20, 40 or 60 ms, and uses the nearest.
+            double packetSeconds = 0.001;
+            int opusBitrate = 128000;
+
+            double bufferSeconds = 0.1;
+        };
+
+        struct Statistics
+        {
+            uint64_t packetsSent = 0;
+            uint64_t bytesSent = 0;
+            uint64_t sendErrors = 0;      // packets the socket refused, lost before the network
+            uint64_t overruns = 0;        // quanta dropped because the ring was full
+            uint64_t underruns = 0;       // packets that fell due before their audio was rendered
+
+            // How unevenly packets leave, as RFC 3550's interarrival jitter, in seconds.
+            double sendJitter = 0;
+
+            // From the latest receiver report, if any has come.
+            bool hasReceiverReport = false;
+            double fractionLost = 0;      // since the report before
+            int64_t cumulativeLost = 0;
+            double receiverJitter = 0;    // seconds
+        };
+
+        // Opens the socket and starts the sending thread; isOpen() says if it failed.
+        NetworkAudioOutput(float sampleRate, int channels, const Settings & settings);
+        ~NetworkAudioOutput();
+
+        bool isOpen() const;
+
+        // Queues a quantum of the bus's first channels. Called on the render thread; doesn't block or allocate.
+        void write(const AudioBus & bus, uint64_t sampleFrame);
+
+        // A callback for AudioDeviceSettings::nullOutput that writes to this output, which must outlive it.
+        std::function<void(const AudioBus &, uint64_t)> output();
+
+        // May be called from any thread.
+        Statistics statistics() const;
+
+        // The seconds between a frame being rendered and its packet leaving.
+        double latency() const;
+
+    private:
+
+        std::unique_ptr<Sender> m_sender;
+    };
+
+} // end namespace lab
+
+#endif
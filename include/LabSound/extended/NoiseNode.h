@@ -6,6 +6,7 @@
 #ifndef NOISE_NODE_H
 #define NOISE_NODE_H
 
+#include "LabSound/core/AudioArray.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioParam.h"
@@ -14,8 +15,12 @@ namespace lab
 {
     class AudioSetting;
 
+    // White noise from four interleaved xorshift generators, filtered to pink or brown a block at a time. Each node
+    // is seeded from the order nodes were made in, so a render made the same way plays the same noise; changing the
+    // seed, or resetting the node, restarts its sequence.
+    //
     // params: 
-    // settings: type
+    // settings: type, seed
     //
     class NoiseNode : public AudioScheduledSourceNode 
     {
@@ -34,28 +39,35 @@ namespace lab
 
         virtual void process(ContextRenderLock&, size_t framesToProcess) override;
         virtual void reset(ContextRenderLock&) override;
+        virtual void prepare(AudioContext & context, size_t inputChannels) override;
 
         NoiseType type() const;
         void setType(NoiseType newType);
 
+        uint32_t seed() const;
+        void setSeed(uint32_t seed);
+
     private:
 
         virtual bool propagatesSilence(ContextRenderLock & r) const override;
 
-        std::shared_ptr<AudioSetting> _type;
-
-        uint32_t whiteSeed = 1489853723;
-
-        float lastBrown = 0;
-
-        float pink0 = 0; 
-        float pink1 = 0;
-        float pink2 = 0;
-        float pink3 = 0;
-        float pink4 = 0;
-        float pink5 = 0;
-        float pink6 = 0;
+        // Seeds the generators from the seed setting and clears the filters.
+        void restart();
 
+        std::shared_ptr<AudioSetting> _type;
+        std::shared_ptr<AudioSetting> _seed;
+
+        enum { Lanes = 4 };
+        uint32_t m_lanes[Lanes];
+        uint32_t m_laneSeed = 0;
+        uint32_t m_seedVersion = 0; // of _seed, when the lanes were seeded
+        bool m_restart = true;
+
+        // A quantum of white noise, and the filter states carried between quanta.
+        std::unique_ptr<AudioFloatArray> m_white;
+        float m_lastWhite = 0;
+        float m_brown = 0;
+        float m_pink[6] = {};
     };
 
 }
@@ -0,0 +1,82 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef OfflineRenderFarm_H
+#define OfflineRenderFarm_H
+
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/Constants.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+    class OfflineAudioDestinationNode;
+
+    // One offline render: a context of its own, with the graph setup builds, rendered to wherever setup has the
+    // destination send its output, see OfflineAudioDestinationNode::setSink() and setOutputFile().
+    struct OfflineRenderJob
+    {
+        uint32_t numChannels = 2;
+        float sampleRate = LABSOUND_DEFAULT_SAMPLERATE;
+        size_t renderQuantumSize = AudioNode::ProcessingSizeInFrames;
+
+        // Render workers helping the pool thread with the job, see AudioContext::setRenderWorkerCount(). Jobs
+        // already run side by side, so this is for long jobs of large graphs that would otherwise finish last.
+        size_t renderWorkerCount = 0;
+
+        // The length of the render, or with a stop condition its limit.
+        float lengthSeconds = 0;
+
+        // Called on a pool thread to build the graph and configure the destination, before rendering.
+        std::function<void(AudioContext &, OfflineAudioDestinationNode &)> setup;
+
+        // Called on the pool thread once the render is complete, before the context is destroyed.
+        std::function<void(AudioContext &, OfflineAudioDestinationNode &)> finished;
+    };
+
+    // Renders many offline contexts concurrently on a fixed pool of threads, each rendering one job at a time on
+    // the thread itself. Offline contexts have no threads of their own, so a job costs no threads beyond the
+    // pool's. Immutable assets are shared between jobs by handing them the same objects: buses from
+    // SampleCache::shared(), impulses from ConvolverNode::prepareImpulse(), and the HRTF database, which PannerNodes
+    // of the same sample rate share already.
+    class OfflineRenderFarm
+    {
+    public:
+
+        // With a threadCount of zero, there's a thread for each hardware thread.
+        explicit OfflineRenderFarm(size_t threadCount = 0);
+
+        // Completes the jobs already submitted.
+        ~OfflineRenderFarm();
+
+        size_t threadCount() const { return m_threads.size(); }
+
+        // Queues the job, which is rendered once a thread is free. May be called from any thread, and from jobs.
+        void submit(OfflineRenderJob job);
+
+        // Blocks until every job submitted so far has completed. Must not be called from a job.
+        void wait();
+
+    private:
+
+        void workerEntry();
+
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_lock;
+        std::condition_variable m_work;
+        std::condition_variable m_idle;
+        std::deque<OfflineRenderJob> m_jobs;
+        size_t m_running = 0;
+        bool m_shouldRun = true;
+    };
+}
+
+#endif
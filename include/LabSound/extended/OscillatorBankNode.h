@@ -0,0 +1,87 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef OSCILLATOR_BANK_NODE_H
+#define OSCILLATOR_BANK_NODE_H
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioScheduledSourceNode.h"
+#include "LabSound/core/Constants.h"
+
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioSetting;
+    class WaveTable;
+
+    // A bank of oscillators reading one band limited wavetable, each detuned from the shared frequency by cents of
+    // its own and scaled by an amplitude of its own. The voices are summed into one mono output as they render,
+    // rather than through a node and a bus apiece. Each voice's band is chosen once per quantum, for the
+    // highest frequency the voice reaches in it.
+    //
+    // params: frequency, gain
+    // settings: type
+    //
+    class OscillatorBankNode : public AudioScheduledSourceNode
+    {
+    public:
+
+        // Room for this many voices is reserved up front, so that setting up to as many doesn't allocate.
+        enum { ReservedVoices = 128 };
+
+        OscillatorBankNode(const float sampleRate = LABSOUND_DEFAULT_SAMPLERATE);
+        virtual ~OscillatorBankNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // Any of the basic waveforms, not CUSTOM.
+        OscillatorType type() const;
+        void setType(OscillatorType type);
+
+        // Sets a voice for each detune, in cents. amplitudes is either empty, for voices at unity, or has an
+        // amplitude for each voice. Voices already sounding keep their phases; added voices start spread evenly
+        // through the period, so that they don't reinforce each other as they start.
+        void setVoices(ContextRenderLock &, const std::vector<float> & detunes, const std::vector<float> & amplitudes = {});
+        size_t voiceCount() const { return m_detuneScales.size(); }
+
+        std::shared_ptr<AudioParam> frequency() { return m_frequency; }
+        std::shared_ptr<AudioParam> gain() { return m_gain; }
+
+        virtual bool propagatesSilence(ContextRenderLock & r) const override;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        void _setType(OscillatorType type);
+
+        float m_sampleRate;
+
+        std::shared_ptr<AudioSetting> m_type;
+        std::shared_ptr<AudioParam> m_frequency;
+        std::shared_ptr<AudioParam> m_gain;
+
+        std::shared_ptr<WaveTable> m_waveTable;
+
+        // Per voice, the detune as a frequency ratio, the amplitude, and the phase in table frames.
+        std::vector<float> m_detuneScales;
+        std::vector<float> m_amplitudes;
+        std::vector<double> m_phases;
+
+        // Sample accurate frequencies when the frequency is automated, and the increments and read positions of a voice.
+        AudioFloatArray m_frequencies;
+        AudioFloatArray m_readIndices;
+
+        bool m_firstRender{ true };
+        float m_lastGain{ 1.0f };
+    };
+}
+
+#endif
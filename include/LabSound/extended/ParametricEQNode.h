@@ -0,0 +1,55 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef PARAMETRIC_EQ_NODE_H
+#define PARAMETRIC_EQ_NODE_H
+
+#include "LabSound/core/AudioBasicProcessorNode.h"
+
+#include <vector>
+
+namespace lab
+{
+    // A band of a ParametricEQNode, shaped as a BiquadFilterNode of the same type would be. FILTER_NONE passes the
+    // signal through unchanged.
+    struct ParametricEQBand
+    {
+        FilterType type = PEAKING;
+        float frequency = 1000; // Hz
+        float q = 1;
+        float gain = 0; // dB, for the shelving and peaking types
+    };
+
+    // Filters each channel through a cascade of biquad sections, one per band, all in one pass over the quantum,
+    // rather than through a node and a bus per band. A band's coefficients are computed again only when it changes.
+    //
+    // params:
+    // settings:
+    //
+    class ParametricEQNode : public AudioBasicProcessorNode
+    {
+        class ParametricEQProcessor;
+        ParametricEQProcessor * eqProcessor() const;
+
+    public:
+
+        ParametricEQNode();
+        virtual ~ParametricEQNode();
+
+        // Replaces the bands, clearing the filters' memory if the number of bands changes.
+        void setBands(ContextRenderLock &, const std::vector<ParametricEQBand> & bands);
+        void setBand(ContextRenderLock &, size_t index, const ParametricEQBand & band);
+
+        const std::vector<ParametricEQBand> & bands() const;
+        size_t bandCount() const { return bands().size(); }
+
+        // The magnitude and phase response of the whole cascade at the given frequencies, in Hz. The phase
+        // response is in radians.
+        void getFrequencyResponse(ContextRenderLock &, const std::vector<float> & frequencyHz,
+                                  std::vector<float> & magResponse, std::vector<float> & phaseResponse);
+    };
+}
+
+#endif
@@ -9,6 +9,8 @@
 
 #include "LabSound/core/AudioBasicProcessorNode.h"
 
+#include <cstdint>
+
 namespace pd
 {
     class PdBase;
@@ -19,24 +21,38 @@ namespace pd
 namespace lab
 {
 
+class AudioContext;
+
+// Runs a patch with two channels in and out. Pd works in blocks of its own size, 64 frames, which the node
+// bridges to the render quantum through interleaved rings kept for the node's life, so that each quantum is one
+// interleaving of its input, as many blocks as have accumulated in one call to Pd, and one deinterleaving of its
+// output. A quantum smaller than Pd's block delays the output by the difference.
+//
+// With runOnWorker, the patch runs on a thread of the node's own, a quantum behind the render thread, which only
+// hands it each quantum's input and takes the output of the last, so that a heavy patch doesn't hold up the graph;
+// the output is a quantum later. A quantum the worker hasn't finished in time plays as silence. An offline context
+// runs the patch on its render thread, at the same latency.
 class PureDataNode : public AudioBasicProcessorNode
 {
-    
+
 public:
-    
-    PureDataNode(AudioContext *, float sampleRate);
+
+    explicit PureDataNode(AudioContext & context, bool runOnWorker = false);
     virtual ~PureDataNode();
-    
+
     pd::PdBase & pd() const;
-    
-    virtual double tailTime(ContextRenderLock & r) const override { return 0; }
-    virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
-    
+
+    // The quanta played as silence because the worker fell behind.
+    uint64_t underrunCount() const;
+
+    // A patch may make sound without input.
+    virtual bool propagatesSilence(ContextRenderLock & r) const override { return false; }
+
 private:
-    
+
     class PureDataNodeInternal;
-    PureDataNodeInternal * data;
-    
+    PureDataNodeInternal * data; // owned by m_processor
+
 };
 
 } // end namespace lab
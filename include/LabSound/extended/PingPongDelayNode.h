@@ -28,19 +28,20 @@ namespace lab
         virtual ~Subgraph() { }
     };
 
+    // A tempo synced echo, fed by the input summed to mono, that alternates between channels. The input is
+    // built into a mono send and a stereo delay line in one node, whose two channels feed one another, so
+    // that the subgraph between input and output is three nodes rather than ten.
     class PingPongDelayNode : public Subgraph
     {
-        float tempo;
+        class Delay;
 
-        std::shared_ptr<BPMDelay> leftDelay;
-        std::shared_ptr<BPMDelay> rightDelay;
+        float tempo;
+        TempoSync delayIndex;
+        bool transportSync = false;
 
-        std::shared_ptr<GainNode> splitterGain;
-        std::shared_ptr<GainNode> wetGain;
-        std::shared_ptr<GainNode> feedbackGain;
+        std::shared_ptr<Delay> delay;
 
-        std::shared_ptr<ChannelMergerNode> merger;
-        std::shared_ptr<ChannelSplitterNode> splitter;
+        void recomputeDelay();
 
     public:
 
@@ -52,6 +53,9 @@ namespace lab
         void SetLevel(float f);
         void SetDelayIndex(TempoSync value);
 
+        // Follows the tempo of the context's transport, see AudioContext::transport(), rather than SetTempo().
+        void SyncToTransport(bool sync);
+
         virtual void BuildSubgraph(std::unique_ptr<AudioContext> & ac) override;
     };
 }
@@ -0,0 +1,59 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef PITCH_SHIFT_NODE_H
+#define PITCH_SHIFT_NODE_H
+
+#include "LabSound/core/AudioBasicProcessorNode.h"
+
+#include <memory>
+
+namespace lab
+{
+    class AudioBus;
+    class AudioParam;
+
+    // Shifts the pitch of its input without changing its duration, with a phase vocoder: in each channel's short
+    // time spectrum, every peak is taken as a sinusoid, whose true frequency is found from the advance of its phase
+    // since the last frame, and is moved with the bins around it to its shifted frequency, keeping their phases
+    // locked to its own. The output is delayed by the analysis window, which the node reports as its latency.
+    //
+    // With a SampledAudioNode's playbackRate, it stretches time in real time: a rate of r, shifted by
+    // -12 * log2(r) semitones, plays r times as fast at the original pitch. timeStretch() does the same offline.
+    //
+    // params: pitch
+    // settings:
+    //
+    class PitchShiftNode : public AudioBasicProcessorNode
+    {
+        class PitchShiftProcessor;
+        PitchShiftProcessor * pitchProcessor() const;
+
+    public:
+
+        enum class Quality
+        {
+            Realtime,     // windows of 1024 frames, hopping by 256
+            HighQuality,  // windows of 4096 frames, hopping by 512; low notes and dense chords keep their harmonics
+                          // apart, at four times the latency and a little over twice the cost
+        };
+
+        explicit PitchShiftNode(Quality quality = Quality::Realtime);
+        virtual ~PitchShiftNode();
+
+        // The shift in semitones, from -24 to 24, default 0. It is read once per render quantum.
+        std::shared_ptr<AudioParam> pitch() const;
+
+        Quality quality() const;
+
+        // Renders the bus stretched to timeScale times its length and shifted by semitones, without the vocoder's
+        // latency: it is resampled to the new length, which also moves its pitch, and the vocoder moves the pitch
+        // back. Returns nullptr for a bus without a sample rate, or a scale that isn't positive.
+        static std::unique_ptr<AudioBus> timeStretch(const AudioBus & source, double timeScale, float semitones = 0,
+                                                     Quality quality = Quality::HighQuality);
+    };
+}
+
+#endif
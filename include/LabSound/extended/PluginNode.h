@@ -0,0 +1,136 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef PLUGIN_NODE_H
+#define PLUGIN_NODE_H
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+
+    // An effect from a plugin format, as seen by PluginNode. A format's host implements it around a loaded plugin;
+    // see LoadClapPlugin().
+    class AudioPlugin
+    {
+    public:
+
+        struct Parameter
+        {
+            std::string name;
+            double minValue;
+            double maxValue;
+            double defaultValue;
+        };
+
+        // A parameter, by its index in parameters(), taking value from frame on in the block being processed.
+        struct ParameterEvent
+        {
+            uint32_t frame;
+            uint32_t parameter;
+            double value;
+        };
+
+        virtual ~AudioPlugin() { }
+
+        virtual size_t inputChannels() const = 0;
+        virtual size_t outputChannels() const = 0;
+        virtual const std::vector<Parameter> & parameters() const = 0;
+
+        // Prepares the plugin to process blocks of up to maxFrames. Called before any process(), and not on the
+        // render thread; false if the plugin can't run.
+        virtual bool activate(double sampleRate, size_t maxFrames) = 0;
+
+        // Clears the plugin's state, such as its delay lines, as for a new stream.
+        virtual void reset() = 0;
+
+        virtual size_t latencyFrames() const { return 0; }
+        virtual double tailTime() const { return 0; }
+
+        // Processes frames from inputs into outputs, which are planar channels, inputChannels() and
+        // outputChannels() of them. The events are in frame order. Must not allocate or block.
+        virtual void process(const float * const * inputs, float * const * outputs, size_t frames,
+                             const ParameterEvent * events, size_t eventCount) = 0;
+    };
+
+    // Runs an AudioPlugin on the node's input. The bus channels are handed to the plugin as its buffers as they are,
+    // the input's as its inputs and the output's as its outputs, so nothing is copied on the way in or out. Each of
+    // the plugin's parameters is an AudioParam of the node, named as the parameter; its sample accurate values are
+    // passed to the plugin as events, at most one every ParameterEventFrames frames, where the value changes.
+    //
+    // With runOnWorker, the plugin runs on a thread of the node's own, a quantum behind the render thread, which
+    // hands it a copy of each quantum's input and takes the output of the last, so that a heavy plugin doesn't hold
+    // up the graph; the output is a quantum later. A quantum the worker hasn't finished in time plays as silence.
+    // An offline context runs the plugin on its render thread, at the same latency.
+    class PluginNode : public AudioNode
+    {
+    public:
+
+        static const size_t ParameterEventFrames = 16;
+
+        PluginNode(AudioContext & context, std::unique_ptr<AudioPlugin> plugin, bool runOnWorker = false);
+        virtual ~PluginNode();
+
+        AudioPlugin & plugin() const { return *m_plugin; }
+
+        // The param for the plugin's parameter at index, as ordered by AudioPlugin::parameters().
+        std::shared_ptr<AudioParam> parameter(size_t index) const;
+
+        // The quanta played as silence because the worker fell behind.
+        uint64_t underrunCount() const;
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock & r) override;
+
+        virtual double tailTime(ContextRenderLock & r) const override;
+        virtual double latencyTime(ContextRenderLock & r) const override;
+
+        // A plugin may make sound without input, such as a reverb's tail.
+        virtual bool propagatesSilence(ContextRenderLock & r) const override { return false; }
+
+    private:
+
+        class Worker;
+
+        void gatherEvents(ContextRenderLock & r, size_t framesToProcess);
+
+        std::unique_ptr<AudioPlugin> m_plugin;
+        bool m_active = false;
+        float m_sampleRate;
+
+        // The params' values are sampled every ParameterEventFrames frames, into a row of samples each, and an
+        // event is made of each sample that differs from the value last sent.
+        std::vector<std::shared_ptr<AudioParam>> m_pluginParams;
+        std::vector<double> m_sentValues;
+        std::unique_ptr<AudioFloatArray> m_paramValues;
+        std::unique_ptr<AudioFloatArray> m_paramSamples;
+        size_t m_samplesPerQuantum;
+        std::vector<AudioPlugin::ParameterEvent> m_events;
+        size_t m_eventCount = 0;
+
+        // For channels the buses lack: silence in, and scratch out.
+        std::unique_ptr<AudioFloatArray> m_silence;
+        std::unique_ptr<AudioFloatArray> m_discard;
+        std::vector<const float *> m_inputs;
+        std::vector<float *> m_outputs;
+
+        std::unique_ptr<Worker> m_worker;
+    };
+
+#if defined(LABSOUND_CLAP)
+    // Loads the plugin with pluginId from the CLAP bundle at path, or its first plugin if pluginId is empty. The
+    // plugin's first audio input and output ports are used. Null if it can't be loaded.
+    std::unique_ptr<AudioPlugin> LoadClapPlugin(const std::string & path, const std::string & pluginId = std::string());
+#endif
+
+} // end namespace lab
+
+#endif
@@ -7,6 +7,7 @@
 #define POWER_MONITOR_NODE_H
 
 #include "LabSound/core/AudioBasicInspectorNode.h"
+#include <memory>
 #include <vector>
 #include <mutex>
 
@@ -14,6 +15,13 @@ namespace lab {
 
     class AudioSetting;
 
+    // Besides db(), the node meters its input in one pass per quantum, after ITU-R BS.1770: the K-weighted
+    // momentary (400ms), short term (3s) and gated integrated loudness, the true peak, found by oversampling
+    // four times, and each channel's sample peak and its RMS over windowSize frames. The sliding windows are
+    // kept as running sums of 100ms blocks, so their cost doesn't grow with their length. The loudnesses and
+    // peaks are updated every 100ms and the RMS every quantum, and levels() copies out the latest without
+    // waiting for the audio thread.
+    //
     // params:
     // settings: windowSize
     //    
@@ -21,6 +29,23 @@ namespace lab {
     {
     public:
 
+        enum { MaxMeteredChannels = 8 };
+
+        // Loudnesses are in LUFS and levels in dBFS, or dBTP for true peaks; silence is -infinity. The peaks are
+        // over the momentary window, but for maxTruePeak, which is since the node was reset.
+        struct Levels
+        {
+            float momentaryLoudness;
+            float shortTermLoudness;
+            float integratedLoudness;
+            float truePeak;
+            float maxTruePeak;
+
+            uint32_t channelCount;
+            float peak[MaxMeteredChannels];
+            float rms[MaxMeteredChannels];
+        };
+
         PowerMonitorNode();
 
         virtual ~PowerMonitorNode();
@@ -44,6 +69,9 @@ namespace lab {
         //
         void windowSize(size_t ws);
         size_t windowSize() const;
+
+        // May be called from any thread.
+        void levels(Levels & result);
         
     private:
 
@@ -53,6 +81,9 @@ namespace lab {
         float _db;
         std::shared_ptr<AudioSetting> _windowSize;
 
+        struct Meter;
+        std::unique_ptr<Meter> _meter;
+
     };
 
 }
@@ -7,14 +7,23 @@
 
 #include "LabSound/core/AudioArray.h"
 #include "LabSound/extended/AudioContextLock.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 namespace lab 
 {
 
 class AudioBus;
-class FFTFrame;
-
+class STFT;
+class SpectrumAnalysisPool;
+
+// The audio thread hands the latest fftSize frames of input to the shared analysis worker every analysisHop
+// frames, and the worker publishes the smoothed spectrum it computes from them along with those frames. The
+// get functions copy out the last published analysis and never compute one, so the readers' rate doesn't
+// affect the smoothing, which is applied once per hop, nor do they wait for the audio thread or the worker.
+// Several threads may read at once; they only wait for each other.
 class RealtimeAnalyser
 {
 
@@ -39,13 +48,26 @@ public:
     void setSmoothingTimeConstant(double k) { m_smoothingTimeConstant = k; }
     double smoothingTimeConstant() const { return m_smoothingTimeConstant; }
 
-    void getFloatFrequencyData(std::vector<float>&);
-    void getByteFrequencyData(std::vector<uint8_t>&);
-    void getFloatTimeDomainData(std::vector<float>&); // LabSound
-    void getByteTimeDomainData(std::vector<uint8_t>&);
+    // The number of frames between analyses, rounded up to a whole number of render quanta in effect.
+    void setAnalysisHop(uint32_t frames) { m_analysisHop = std::max(frames, 1u); }
+    uint32_t analysisHop() const { return m_analysisHop; }
+
+    // These fill at most frequencyBinCount() or fftSize() values of the destination, and leave the rest as it is.
+    void getFloatFrequencyData(float * destination, size_t count);
+    void getByteFrequencyData(uint8_t * destination, size_t count);
+    void getFloatTimeDomainData(float * destination, size_t count); // LabSound
+    void getByteTimeDomainData(uint8_t * destination, size_t count);
+
+    void getFloatFrequencyData(std::vector<float>& a) { getFloatFrequencyData(a.data(), a.size()); }
+    void getByteFrequencyData(std::vector<uint8_t>& a) { getByteFrequencyData(a.data(), a.size()); }
+    void getFloatTimeDomainData(std::vector<float>& a) { getFloatTimeDomainData(a.data(), a.size()); } // LabSound
+    void getByteTimeDomainData(std::vector<uint8_t>& a) { getByteTimeDomainData(a.data(), a.size()); }
 
     void writeInput(ContextRenderLock& r, AudioBus*, size_t framesToProcess);
 
+    // The bytes of the input, the exchanged analyses and the worker's buffers.
+    size_t memoryBytes() const;
+
     static const double DefaultSmoothingTimeConstant;
     static const double DefaultMinDecibels;
     static const double DefaultMaxDecibels;
@@ -54,27 +76,42 @@ public:
     static const uint32_t MinFFTSize;
     static const uint32_t MaxFFTSize;
     static const uint32_t InputBufferSize;
+    static const uint32_t DefaultAnalysisHop;
 
 private:
 
+    friend class SpectrumAnalysisPool;
+
+    // Called by the analysis worker; analyses the input published since the last call, if any, and returns
+    // whether there was some.
+    bool analysePendingInput();
+
     // The audio thread writes the input audio here.
     AudioFloatArray m_inputBuffer;
     size_t m_writeIndex;
+    size_t m_framesSinceAnalysis;
     
     uint32_t m_fftSize;
-    std::unique_ptr<FFTFrame> m_analysisFrame;
-    void doFFTAnalysis();
-    
-    // doFFTAnalysis() stores the floating-point magnitude analysis data here.
+    std::atomic<uint32_t> m_analysisHop;
+
+    // The buffers passing the input to the worker and its analyses to the readers.
+    struct Exchange;
+    std::unique_ptr<Exchange> m_exchange;
+
+    // Used by the worker only.
+    std::unique_ptr<STFT> m_analysis;
     AudioFloatArray m_magnitudeBuffer;
-    AudioFloatArray& magnitudeBuffer() { return m_magnitudeBuffer; }
+    std::atomic<bool> m_clearHistory;
+    void doFFTAnalysis(const float * input);
 
     // A value between 0 and 1 which averages the previous version of m_magnitudeBuffer with the current analysis magnitude data.
-    double m_smoothingTimeConstant;    
+    std::atomic<double> m_smoothingTimeConstant;
 
     // The range used when converting when using getByteFrequencyData(). 
-    double m_minDecibels;
-    double m_maxDecibels;
+    std::atomic<double> m_minDecibels;
+    std::atomic<double> m_maxDecibels;
+
+    std::shared_ptr<SpectrumAnalysisPool> m_pool;
 };
 
 } // namespace lab
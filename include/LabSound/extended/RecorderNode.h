@@ -6,16 +6,24 @@
 
 #include "LabSound/core/AudioBasicInspectorNode.h"
 #include "LabSound/core/AudioContext.h"
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <mutex>
 
 namespace lab
 {
-    
+    class AudioFileWriter;
+
+    // Records its input into memory between startRecording() and stopRecording(), or streams it to disk between
+    // startStreaming() and stopStreaming(). The two are independent, and may run at once.
     class RecorderNode : public AudioBasicInspectorNode
     {
         
     public:
+
+        // About six seconds at 44.1kHz.
+        enum { DefaultStreamBufferFrames = 1 << 18 };
         
         RecorderNode();
         virtual ~RecorderNode();
@@ -23,6 +31,9 @@ namespace lab
         // AudioNode
         virtual void process(ContextRenderLock &, size_t framesToProcess) override;
         virtual void reset(ContextRenderLock &) override;
+
+        // The recorded data grows for as long as the node records, until getData() takes it.
+        virtual void reportMemory(ContextRenderLock &, AudioMemoryUsage & usage) const override;
         
         void startRecording() { m_recording = true; }
         void stopRecording() { m_recording = false; }
@@ -34,6 +45,24 @@ namespace lab
         void getData(std::vector<float> & result);
         
         void writeRecordingToWav(int channels, const std::string & filenameWithWavExtension);
+
+        // Streams the input to a 32 bit float WAV file, or a CAF file if the path ends in .caf, with up to 32
+        // channels; one mixes the input down, and otherwise missing channels are silent and extra ones dropped. The
+        // render thread copies each quantum into a ring of bufferFrames frames, and a writer thread writes it out,
+        // so memory stays fixed however long the recording. Replaces any stream already running. Returns false if
+        // the file can't be created.
+        //
+        // A path ending in .wv streams a WavPack file instead, which the writer thread encodes as it goes: 24 bit
+        // and lossless, or lossy at lossyBitsPerSample bits per sample, from 2 to 23, if that isn't 0.
+        bool startStreaming(const std::string & path, int channels, size_t bufferFrames = DefaultStreamBufferFrames,
+                            float lossyBitsPerSample = 0);
+
+        // Waits for the buffered frames to be written, and completes the file. Returns false if any write failed.
+        bool stopStreaming();
+
+        // The quanta left out of the stream since it started, because the writer had fallen behind and the ring was
+        // full, or because the stream was being replaced.
+        uint64_t droppedQuantumCount() const { return m_droppedQuanta.load(std::memory_order_relaxed); }
         
     private:
         
@@ -46,6 +75,12 @@ namespace lab
         std::vector<float> m_data; // interleaved
         mutable std::recursive_mutex m_mutex;
 
+        // The render thread only tries for m_streamMutex, and drops the quantum if it's held.
+        std::unique_ptr<AudioFileWriter> m_stream;
+        std::mutex m_streamMutex;
+        std::vector<float> m_monoMix;
+        std::atomic<uint64_t> m_droppedQuanta{ 0 };
+
     };
     
 } // end namespace lab
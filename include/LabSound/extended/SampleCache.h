@@ -0,0 +1,92 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SampleCache_H
+#define SampleCache_H
+
+#include "LabSound/core/AudioBus.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <string>
+#include <tuple>
+
+namespace lab
+{
+    // Decoded files, shared by everything that asks for the same file in the same form, so that a file is only
+    // decoded again once it has been evicted. Buses nothing but the cache refers to are evicted, least recently used
+    // first, while the cache is over its budget. Buses still in use, by a SampledAudioNode or anything else, are
+    // never evicted, so the cache may stay over budget until they are let go.
+    class SampleCache
+    {
+    public:
+
+        struct Statistics
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            uint64_t sharedMaps = 0; // misses mapped from the shared directory rather than decoded
+            size_t residentBytes = 0;
+            size_t entryCount = 0;
+        };
+
+        // The cache shared by the process, with a budget of DefaultBudget until it is set.
+        static SampleCache & shared();
+
+        static const size_t DefaultBudget = 512 * 1024 * 1024;
+
+        explicit SampleCache(size_t budgetBytes = DefaultBudget);
+        ~SampleCache();
+
+        // Returns the file's samples, as MakeBusFromFile() decodes them, resampled to sampleRate unless it is zero.
+        // A file being decoded for another caller is waited for rather than decoded twice. Files that can't be
+        // decoded aren't cached, and return an empty pointer.
+        std::shared_ptr<AudioBus> bus(const std::string & path, bool mixToMono, float sampleRate = 0);
+
+        size_t budget() const;
+        void setBudget(size_t budgetBytes);
+
+        // Evicts every bus nothing else refers to.
+        void purge();
+
+        // Shares decoded buses between processes through an existing directory, such as one in /dev/shm. A file
+        // missing from the cache is looked for there, and mapped rather than decoded if another process has
+        // registered it, unless the file has changed since; a file decoded here is registered there for the
+        // others. Buses so mapped share their pages with every process mapping them, and must not be written. An
+        // empty directory, the default, stops sharing; buses already mapped stay valid.
+        void setSharedDirectory(const std::string & directory);
+        std::string sharedDirectory() const;
+
+        Statistics statistics() const;
+
+    private:
+
+        typedef std::tuple<std::string, bool, float> Key;
+
+        struct Entry
+        {
+            Key key;
+            std::shared_future<std::shared_ptr<AudioBus>> bus;
+            size_t bytes = 0;
+        };
+
+        // Evicts unreferenced buses, oldest first, until the cache is within bytes. Called with m_lock held.
+        void evict(size_t bytes);
+
+        mutable std::mutex m_lock;
+
+        // Most recently used first.
+        std::list<Entry> m_entries;
+        std::map<Key, std::list<Entry>::iterator> m_index;
+
+        size_t m_budget;
+        Statistics m_statistics;
+        std::string m_sharedDirectory;
+    };
+}
+
+#endif
@@ -6,43 +6,39 @@
 #ifndef SAMPLED_INSTRUMENT_NODE
 #define SAMPLED_INSTRUMENT_NODE
 
-#include "LabSound/core/AudioContext.h"
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioParam.h"
-#include "LabSound/core/SampledAudioNode.h"
 
-#include "LabSound/extended/ADSRNode.h"
-#include "LabSound/extended/AudioContextLock.h"
-
-#include <iostream> 
+#include <algorithm>
 #include <array>
+#include <memory>
 #include <string>
-#include <algorithm>
+#include <vector>
 
-/*
-namespace lab 
+namespace lab
 {
-    struct SamplerSound;
+    class AudioBus;
+    class AudioSetting;
 
-    // Ex: F#6. Assumes uppercase note names, hash symbol for sharp, and octave. 
-    inline uint8_t MakeMIDINoteFromString(std::string noteName) 
+    // Ex: F#6. Assumes uppercase note names, hash symbol for sharp, and octave.
+    inline uint8_t MakeMIDINoteFromString(std::string noteName)
     {
         const std::array<std::string, 12> midiTranslationArray = {{ "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" }};
 
-        // Ocatve is always last character, as an integer 
+        // Ocatve is always last character, as an integer
         std::string octaveString = noteName.substr(noteName.length() - 1, 1);
         int octave = std::stoi(octaveString);
 
-        std::string noteString = noteName.erase(noteName.length() - 1, 1); 
+        std::string noteString = noteName.erase(noteName.length() - 1, 1);
 
         std::transform(noteString.begin(), noteString.end(), noteString.begin(), ::toupper);
 
         // IF we don't use # notation, convert S to #
         std::replace(noteString.begin(), noteString.end(), 'S', '#');
 
-        // Note name is now the first or second character 
+        // Note name is now the first or second character
         int notePos = -1;
-        for (int i = 0; i < 12; ++i) 
+        for (int i = 0; i < 12; ++i)
         {
             if (noteString == midiTranslationArray[i])
             {
@@ -67,42 +63,108 @@ namespace lab
         return  (originalNote + std::to_string(octave));
     }
 
-    struct SampledInstrumentDefinition
+    // A sample, and the notes and velocities it plays. It is pitched from its root note, and if loopEnd is after
+    // loopStart, loops between them, in frames, until the voice playing it has faded out.
+    struct SampledInstrumentZone
     {
-        std::vector<uint8_t> audio;
-        std::string extension;
-        uint8_t root;
-        uint8_t min;
-        uint8_t max;
+        std::shared_ptr<AudioBus> bus;
+        uint8_t root = 60;
+        uint8_t minNote = 0;
+        uint8_t maxNote = 127;
+        uint8_t minVelocity = 0;
+        uint8_t maxVelocity = 127;
+        float gain = 1;
+        size_t loopStart = 0;
+        size_t loopEnd = 0;
     };
 
-    // This class is a little but subversive of the typical LabSound node pattern. 
-    // Instead of inheriting from a node and injecting samples into an audio buffer,
-    // it internally creates ad-hoc SampledAudioNode(s) and keeps them around
-    // in the graph so long as our gain node has been connected. 
-    class SampledInstrumentNode 
+    // A polyphonic sampler, rendering every voice itself into its one stereo output, rather than through a node per
+    // voice. A note plays the first zone covering its note and velocity. When every voice is in use a new note
+    // steals one, preferring the quietest released voice and otherwise the oldest, which fades out quickly.
+    //
+    // params: gain
+    // settings: polyphony, release
+    //
+    class SampledInstrumentNode final : public AudioNode
     {
-        std::vector<std::shared_ptr<SamplerSound>> samples;
-        std::shared_ptr<GainNode> gainNode;
-        std::vector<std::shared_ptr<SampledAudioNode>> voices;
-        const float maxVoiceCount = 24;
-        float sampleRate;
     public:
-        SampledInstrumentNode(AudioContext * ctx, float sampleRate);
-        ~SampledInstrumentNode();
 
-        void LoadInstrument(std::vector<SampledInstrumentDefinition> & sounds);
+        SampledInstrumentNode();
+        virtual ~SampledInstrumentNode();
 
-        void NoteOn(ContextRenderLock & r, const int midiNoteNumber, const float amplitude);
-        void NoteOff(ContextRenderLock & r, const int midiNoteNumber, const float amplitude);
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
 
-        void KillAllNotes(); 
+        // Replaces the zones, silencing every voice.
+        void setZones(ContextRenderLock &, const std::vector<SampledInstrumentZone> & zones);
 
-        GainNode * GetOutputNode() { return gainNode.get(); }
-    };
+        // Notes start at when, in the context's time, or at once if that has passed. Velocities are MIDI's, from 0
+        // to 127, and scale the zone's gain linearly.
+        void noteOn(ContextRenderLock &, uint8_t note, uint8_t velocity, double when = 0);
+        void noteOff(ContextRenderLock &, uint8_t note, double when = 0);
+        void allNotesOff(ContextRenderLock &);
 
-}
+        // The most voices sounding at once, and the seconds a voice fades out for once released.
+        uint32_t polyphony() const;
+        void setPolyphony(uint32_t voices);
+        float release() const;
+        void setRelease(float seconds);
+
+        size_t activeVoiceCount() const { return m_active.size(); }
+
+        std::shared_ptr<AudioParam> gain() { return m_gain; }
 
-*/
+        virtual bool propagatesSilence(ContextRenderLock & r) const override;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        enum VoiceState : uint8_t
+        {
+            VoiceFree,
+            VoiceHeld,
+            VoiceReleased,
+            VoiceStolen
+        };
+
+        // Sizes the voice arrays for the polyphony and the voices fading out after being stolen.
+        void resizeVoices(size_t count);
+
+        // Returns a free voice, stealing one if as many as the polyphony are sounding.
+        uint32_t allocateVoice(ContextRenderLock &);
+
+        // Starts the voice's release of the given frames, at the sample frame given.
+        void releaseVoice(uint32_t voice, uint64_t frame, float frames);
+
+        void renderVoice(uint32_t voice, float * left, float * right, uint64_t quantumStart, size_t framesToProcess);
+
+        std::vector<SampledInstrumentZone> m_zones;
+
+        // The state of each voice, one array per field so that the render loop only touches what it reads.
+        std::vector<double> m_position;
+        std::vector<double> m_rate;
+        std::vector<float> m_envelope;
+        std::vector<float> m_envelopeStep;
+        std::vector<float> m_voiceGain;
+        std::vector<uint64_t> m_startFrame;
+        std::vector<uint64_t> m_releaseFrame;
+        std::vector<float> m_releaseFrames;
+        std::vector<uint32_t> m_zone;
+        std::vector<uint8_t> m_note;
+        std::vector<uint8_t> m_state;
+
+        // The voices that aren't free, oldest first, and how many of those aren't fading out after being stolen.
+        std::vector<uint32_t> m_active;
+        size_t m_sounding{ 0 };
+
+        std::shared_ptr<AudioParam> m_gain;
+        std::shared_ptr<AudioSetting> m_polyphony;
+        std::shared_ptr<AudioSetting> m_release;
+
+        float m_lastGain{ 1.0f };
+    };
+}
 
 #endif
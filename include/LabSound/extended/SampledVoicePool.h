@@ -0,0 +1,56 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SAMPLED_VOICE_POOL_H
+#define SAMPLED_VOICE_POOL_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioBus;
+    class AudioContext;
+    class AudioNode;
+    class SampledAudioNode;
+
+    // Plays one shots of a sound through a fixed set of SampledAudioNodes, in place of a new node per shot held with
+    // AudioContext::holdSourceNodeUntilFinished(). The voices are created and connected to the destination once;
+    // a voice that has finished is restarted where it is, so a shot neither allocates nor edits the graph. Idle
+    // voices are silent and skipped as dormant. Must be destroyed before the context.
+    class SampledVoicePool
+    {
+    public:
+
+        SampledVoicePool(AudioContext & context, std::shared_ptr<AudioBus> bus, std::shared_ptr<AudioNode> destination, size_t voices);
+        ~SampledVoicePool();
+
+        // Starts the sound at the context time when, and returns the voice playing it, or nullptr if every voice is
+        // busy or the voice limit is reached. The voice's gain and playback rate are set as given. To be called
+        // from one thread at a time, as are the other members.
+        std::shared_ptr<SampledAudioNode> play(double when = 0, float gain = 1, float playbackRate = 1);
+
+        // The number of voices playing or scheduled.
+        size_t activeVoices() const;
+
+        size_t size() const { return m_voices.size(); }
+
+        // Caps the voices playing at once, at most size(). Voices beyond the new limit are stopped, the longest
+        // playing first.
+        void setVoiceLimit(size_t limit);
+        size_t voiceLimit() const { return m_limit; }
+
+    private:
+
+        AudioContext & m_context;
+        std::shared_ptr<AudioNode> m_destination;
+        std::vector<std::shared_ptr<SampledAudioNode>> m_voices;
+        std::vector<uint64_t> m_startedShot; // per voice, the number of the shot it last played
+        uint64_t m_shots = 0;
+        size_t m_next = 0;
+        size_t m_limit;
+    };
+}
+
+#endif
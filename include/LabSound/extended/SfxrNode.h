@@ -9,8 +9,13 @@
 #include "LabSound/core/Constants.h"
 #include "LabSound/core/AudioScheduledSourceNode.h"
 
+#include <future>
+#include <memory>
+
 namespace lab {
 
+    class AudioBus;
+
     class SfxrNode : public lab::AudioScheduledSourceNode {
     public:
 
@@ -71,6 +76,14 @@ namespace lab {
 
         void noteOn();
 
+        // Synthesizes the whole effect the params describe now into a bus, on a thread of its own, and remembers it
+        // for every SfxrNode; effects baked with identical params share a bus. Once the bus is ready, a note on
+        // with those params plays it rather than synthesizing the effect again.
+        std::shared_future<std::shared_ptr<AudioBus>> bake(ContextRenderLock&);
+
+        // Forgets every baked effect. Nodes playing one finish it.
+        static void clearBakedEffects();
+
         // some presets
         void setDefaultBeep();
         void coin();
@@ -88,6 +101,11 @@ namespace lab {
     private:
         virtual bool propagatesSilence(ContextRenderLock & r) const override;
 
+        class Sfxr;
+
+        // Copies the params into the synthesizer, returning true if any changed.
+        bool copyParams(ContextRenderLock&, Sfxr & synth);
+
         std::shared_ptr<AudioParam> _waveType;
         std::shared_ptr<AudioParam> _attack;
         std::shared_ptr<AudioParam> _sustainTime;
@@ -112,8 +130,12 @@ namespace lab {
         std::shared_ptr<AudioParam> _hpFilterCutoff;
         std::shared_ptr<AudioParam> _hpFilterCutoffSweep;
 
-        class Sfxr;
         Sfxr *sfxr;
+
+        // The baked effect being played in place of the synthesizer, if any, and the next frame of it.
+        std::shared_ptr<AudioBus> _baked;
+        size_t _bakedPosition = 0;
+        bool _noteStarted = false;
     };
 
 }
@@ -7,7 +7,8 @@
 #define SPATIALIZATION_NODE_H
 
 #include "LabSound/core/PannerNode.h"
-#include <map>
+#include <memory>
+#include <stdint.h>
 
 namespace lab {
 
@@ -38,22 +39,39 @@ namespace lab {
             return *this; }
     };
     
+    // The occluders are kept in a uniform grid of cubes, cellSize on a side, so that the occlusion of a source is found
+    // from the occluders near the cells crossed by the line to the listener rather than from all of them.
+    // An occluder that moves by less than the movement threshold from where it was last placed stays where it was, so
+    // that the occlusion of sources which haven't moved either needn't be found again.
+    // The occluders may be edited while the context is rendering.
     class Occluders 
     {
 
     public:
+        explicit Occluders(float cellSize = 4.f);
+        ~Occluders();
+
         void setOccluder(int id, float x, float y, float z, float radius);
         
         void removeOccluder(int id);
         
         float occlusion(const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos) const;
 
+        // As occlusion(), but returns false rather than waiting while the occluders are being edited. For the audio thread.
+        bool tryOcclusion(const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos, float * result) const;
+
+        void setMovementThreshold(float distance);
+        float movementThreshold() const;
+
+        // Changes whenever an edit changes the occlusion of any source.
+        uint64_t revision() const;
+
     private:
 
-        std::map<int, Occluder> occluders;
+        struct Internals;
+        std::unique_ptr<Internals> m_internal;
 
     };
-    
     typedef std::shared_ptr<Occluders> OccludersPtr;
 
     class SpatializationNode : public PannerNode 
@@ -69,6 +87,14 @@ namespace lab {
 
         virtual float distanceConeGain(ContextRenderLock& r);
         std::shared_ptr<Occluders> occluders;
+
+        // The occlusion last found, and what it was found for. It is found again once the source or the listener
+        // has moved by more than the occluders' movement threshold, or the occluders have changed.
+        float m_occlusion = 1.f;
+        FloatPoint3D m_occlusionSource;
+        FloatPoint3D m_occlusionListener;
+        const Occluders * m_occlusionOccluders = nullptr;
+        uint64_t m_occlusionRevision = 0;
     };
     
 }
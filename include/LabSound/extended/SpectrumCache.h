@@ -0,0 +1,19 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SpectrumCache_H
+#define SpectrumCache_H
+
+#include <string>
+
+namespace lab
+{
+    // Opts in to caching the transformed kernels of convolution impulse responses and of the HRTF database as files
+    // in an existing directory, so that later runs memory-map them rather than computing their FFTs again. Entries
+    // are keyed by a hash of the source audio, the sample rate, the FFT size and the FFT implementation, so a stale
+    // entry is never used. An empty directory, the default, disables the cache.
+    void SetSpectrumCacheDirectory(const std::string & directory);
+    std::string SpectrumCacheDirectory();
+}
+
+#endif
@@ -0,0 +1,396 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef STK_NODE_H
+#define STK_NODE_H
+
+#ifdef STK
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioScheduledSourceNode.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "STK/Bowed.h"
+#include "STK/Clarinet.h"
+#include "STK/Flute.h"
+#include "STK/Plucked.h"
+#include "STK/StifKarp.h"
+#include "STK/Stk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lab
+{
+    // Nodes running the Synthesis ToolKit's generators, effects and instruments, for builds with STK defined that
+    // compile third_party/STK/src/STKInlineCompile.cpp.
+    //
+    // STK's block ticks loop over its per frame tick(), a virtual call per frame, into frames of doubles. These
+    // nodes loop over T's own tick() instead, called by its qualified name so that it isn't dispatched and can be
+    // inlined, and write each frame straight into the output bus as a float, so that nothing passes through
+    // StkFrames.
+    //
+    // STK has one sample rate for the whole process, which each node sets to the rate it is given before making
+    // its objects; objects already made at another rate keep it.
+
+    // Plays T, an stk::Generator or anything with tick() and lastFrame() like one, with an output channel for
+    // each of its channels.
+    //
+    // params:
+    // settings:
+    //
+    template <typename T>
+    class StkGeneratorNode : public AudioScheduledSourceNode
+    {
+    public:
+
+        template <typename... Args>
+        explicit StkGeneratorNode(float sampleRate, Args &&... args) : AudioScheduledSourceNode()
+        {
+            stk::Stk::setSampleRate(sampleRate);
+            m_generator.reset(new T(std::forward<Args>(args)...));
+
+            addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, std::max(1u, m_generator->channelsOut()))));
+            initialize();
+        }
+
+        virtual ~StkGeneratorNode() { uninitialize(); }
+
+        // Changed under a ContextRenderLock, or before the node is connected.
+        T & generator() { return *m_generator; }
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override
+        {
+            AudioBus * outputBus = output(0)->bus(r);
+
+            if (!isInitialized() || !outputBus->numberOfChannels())
+            {
+                outputBus->zero();
+                return;
+            }
+
+            size_t quantumFrameOffset;
+            size_t nonSilentFramesToProcess;
+            if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
+                return;
+
+            T & generator = *m_generator;
+            const size_t channels = std::min<size_t>(outputBus->numberOfChannels(), generator.channelsOut());
+            float * destination = outputBus->channel(0)->mutableData() + quantumFrameOffset;
+
+            if (channels == 1)
+            {
+                for (size_t i = 0; i < nonSilentFramesToProcess; ++i)
+                    destination[i] = static_cast<float>(generator.T::tick());
+            }
+            else
+            {
+                const stk::StkFrames & last = generator.lastFrame();
+                for (size_t i = 0; i < nonSilentFramesToProcess; ++i)
+                {
+                    destination[i] = static_cast<float>(generator.T::tick());
+                    for (size_t c = 1; c < channels; ++c)
+                        outputBus->channel(c)->mutableData()[quantumFrameOffset + i] = static_cast<float>(last[c]);
+                }
+            }
+            outputBus->clearSilentFlag();
+        }
+
+        virtual void reset(ContextRenderLock &) override { }
+
+    private:
+
+        virtual bool propagatesSilence(ContextRenderLock & r) const override
+        {
+            return !isPlayingOrScheduled() || hasFinished();
+        }
+
+        std::unique_ptr<T> m_generator;
+    };
+
+    // Runs T, an stk::Effect, over its input, with an output channel for each of its channels. A mono effect takes
+    // the input's first channel; with InputChannels of 2, one taking stereo like stk::FreeVerb takes the first
+    // two, and a mono input feeds both.
+    //
+    // An effect's tail is only known to the effect, so it is given with setTailTime(); until it is, the node
+    // stops processing as soon as its input falls silent.
+    //
+    // params:
+    // settings:
+    //
+    template <typename T, unsigned InputChannels = 1>
+    class StkEffectNode : public AudioNode
+    {
+        static_assert(InputChannels == 1 || InputChannels == 2, "STK effects take one or two channels");
+
+    public:
+
+        template <typename... Args>
+        explicit StkEffectNode(float sampleRate, Args &&... args) : AudioNode()
+        {
+            stk::Stk::setSampleRate(sampleRate);
+            m_effect.reset(new T(std::forward<Args>(args)...));
+
+            addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+            addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, std::max(1u, m_effect->channelsOut()))));
+            initialize();
+        }
+
+        virtual ~StkEffectNode() { uninitialize(); }
+
+        // Changed under a ContextRenderLock, or before the node is connected.
+        T & effect() { return *m_effect; }
+
+        void setTailTime(double seconds) { m_tailTime = seconds; }
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override
+        {
+            AudioBus * outputBus = output(0)->bus(r);
+
+            if (!isInitialized() || !outputBus->numberOfChannels())
+            {
+                outputBus->zero();
+                return;
+            }
+
+            // Unconnected, the effect rings out on silence.
+            const float * sourceL = nullptr;
+            const float * sourceR = nullptr;
+            if (input(0)->isConnected())
+            {
+                AudioBus * inputBus = input(0)->bus(r);
+                sourceL = inputBus->channel(0)->data();
+                sourceR = inputBus->numberOfChannels() > 1 ? inputBus->channel(1)->data() : sourceL;
+            }
+
+            T & effect = *m_effect;
+            const size_t channels = std::min<size_t>(outputBus->numberOfChannels(), effect.channelsOut());
+            const stk::StkFrames & last = effect.lastFrame();
+            float * destination = outputBus->channel(0)->mutableData();
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                const stk::StkFloat left = sourceL ? sourceL[i] : 0;
+                const stk::StkFloat right = sourceR ? sourceR[i] : 0;
+                destination[i] = static_cast<float>(tickFrame(effect, left, right, std::integral_constant<unsigned, InputChannels>()));
+                for (size_t c = 1; c < channels; ++c)
+                    outputBus->channel(c)->mutableData()[i] = static_cast<float>(last[c]);
+            }
+            for (size_t c = channels; c < outputBus->numberOfChannels(); ++c)
+                outputBus->channel(c)->zero();
+            outputBus->clearSilentFlag();
+        }
+
+        virtual void reset(ContextRenderLock &) override { m_effect->clear(); }
+
+    private:
+
+        static stk::StkFloat tickFrame(T & effect, stk::StkFloat left, stk::StkFloat, std::integral_constant<unsigned, 1>)
+        {
+            return effect.T::tick(left);
+        }
+
+        static stk::StkFloat tickFrame(T & effect, stk::StkFloat left, stk::StkFloat right, std::integral_constant<unsigned, 2>)
+        {
+            return effect.T::tick(left, right);
+        }
+
+        virtual double tailTime(ContextRenderLock & r) const override { return m_tailTime; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        std::unique_ptr<T> m_effect;
+        double m_tailTime = 0;
+    };
+
+    // Plays T, a mono stk::Instrmnt, polyphonically: a voice apiece, each a T rather than a pointer to an
+    // Instrmnt, rendered a quantum at a time and summed into the one output. A note already sounding is played
+    // again on its voice; otherwise a note takes a silent voice, then the oldest released one, then the oldest.
+    // A released voice stops being rendered once a quantum of it peaks below -100dB.
+    //
+    // params:
+    // settings:
+    //
+    template <typename T>
+    class StkInstrumentNode : public AudioNode
+    {
+    public:
+
+        // The arguments are given to each voice's constructor.
+        template <typename... Args>
+        StkInstrumentNode(float sampleRate, uint32_t polyphony, Args &&... args) : AudioNode()
+        {
+            stk::Stk::setSampleRate(sampleRate);
+            m_voices.resize(std::max(1u, polyphony));
+            for (Voice & voice : m_voices)
+                voice.instrument.reset(new T(args...));
+
+            addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
+            initialize();
+        }
+
+        virtual ~StkInstrumentNode() { uninitialize(); }
+
+        // Velocities are MIDI's, from 0 to 127, and are the instrument's amplitude.
+        void noteOn(ContextRenderLock &, uint8_t note, uint8_t velocity)
+        {
+            Voice * chosen = nullptr;
+            for (Voice & voice : m_voices)
+            {
+                if (voice.sounding && voice.note == note)
+                {
+                    chosen = &voice;
+                    break;
+                }
+            }
+            for (Voice & voice : m_voices)
+            {
+                if (chosen)
+                    break;
+                if (!voice.sounding)
+                    chosen = &voice;
+            }
+            if (!chosen)
+            {
+                // The oldest released voice, or failing that the oldest.
+                for (Voice & voice : m_voices)
+                {
+                    if (!chosen || (voice.held == chosen->held ? voice.started < chosen->started : !voice.held))
+                        chosen = &voice;
+                }
+            }
+
+            chosen->note = note;
+            chosen->held = true;
+            chosen->sounding = true;
+            chosen->started = m_noteCount++;
+            chosen->instrument->noteOn(440.0 * std::pow(2.0, (note - 69) / 12.0), velocity / 127.0);
+        }
+
+        void noteOff(ContextRenderLock &, uint8_t note)
+        {
+            for (Voice & voice : m_voices)
+            {
+                if (voice.held && voice.note == note)
+                {
+                    voice.held = false;
+                    voice.instrument->noteOff(0.5);
+                }
+            }
+        }
+
+        void allNotesOff(ContextRenderLock & r)
+        {
+            for (Voice & voice : m_voices)
+            {
+                if (voice.held)
+                {
+                    voice.held = false;
+                    voice.instrument->noteOff(0.5);
+                }
+            }
+        }
+
+        // Sent to every voice, with STK's control numbers, and values from 0 to 128.
+        void controlChange(ContextRenderLock &, int number, float value)
+        {
+            for (Voice & voice : m_voices)
+                voice.instrument->controlChange(number, value);
+        }
+
+        size_t polyphony() const { return m_voices.size(); }
+
+        size_t activeVoiceCount() const
+        {
+            return static_cast<size_t>(std::count_if(m_voices.begin(), m_voices.end(), [](const Voice & voice) { return voice.sounding; }));
+        }
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override
+        {
+            AudioBus * outputBus = output(0)->bus(r);
+            outputBus->zero();
+
+            if (!isInitialized())
+                return;
+
+            float * destination = outputBus->channel(0)->mutableData();
+            bool sounded = false;
+            for (Voice & voice : m_voices)
+            {
+                if (!voice.sounding)
+                    continue;
+
+                T & instrument = *voice.instrument;
+                float peak = 0;
+                for (size_t i = 0; i < framesToProcess; ++i)
+                {
+                    const float sample = static_cast<float>(instrument.T::tick());
+                    destination[i] += sample;
+                    peak = std::max(peak, std::fabs(sample));
+                }
+
+                sounded = true;
+                if (!voice.held && peak < SilentPeak)
+                    voice.sounding = false;
+            }
+
+            if (sounded)
+                outputBus->clearSilentFlag();
+        }
+
+        virtual void reset(ContextRenderLock &) override
+        {
+            for (Voice & voice : m_voices)
+            {
+                voice.held = false;
+                voice.sounding = false;
+                voice.instrument->clear();
+            }
+        }
+
+        virtual bool propagatesSilence(ContextRenderLock & r) const override
+        {
+            return std::none_of(m_voices.begin(), m_voices.end(), [](const Voice & voice) { return voice.sounding; });
+        }
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        // -100dB.
+        static constexpr float SilentPeak = 1e-5f;
+
+        struct Voice
+        {
+            std::unique_ptr<T> instrument;
+            uint64_t started = 0;
+            uint8_t note = 0;
+            bool held = false;
+            bool sounding = false;
+        };
+
+        std::vector<Voice> m_voices;
+        uint64_t m_noteCount = 0;
+    };
+
+    // Physical models that need no rawwave files. Flute's voices must be given their lowest frequency.
+    using StkBowedNode = StkInstrumentNode<stk::Bowed>;
+    using StkClarinetNode = StkInstrumentNode<stk::Clarinet>;
+    using StkFluteNode = StkInstrumentNode<stk::Flute>;
+    using StkPluckedNode = StkInstrumentNode<stk::Plucked>;
+    using StkStifKarpNode = StkInstrumentNode<stk::StifKarp>;
+}
+
+#endif
+
+#endif
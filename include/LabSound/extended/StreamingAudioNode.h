@@ -0,0 +1,104 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#pragma once
+
+#ifndef STREAMING_AUDIO_NODE_H
+#define STREAMING_AUDIO_NODE_H
+
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioScheduledSourceNode.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab
+{
+    class AudioBus;
+    class AudioFileStream;
+    class AudioSetting;
+    class MultiChannelResampler;
+
+    // StreamingAudioNode plays a PCM WAV file from disk as it is read, for sounds too long to decode whole, such as
+    // music and ambience. A shared I/O thread reads readAhead seconds ahead of playback, so only that much of the
+    // file is held in memory. A file at another rate than the context's is resampled as it plays.
+    //
+    // params: gain
+    // settings: loop, loopStart, loopEnd, readAhead
+    //
+    class StreamingAudioNode final : public AudioScheduledSourceNode
+    {
+    public:
+
+        StreamingAudioNode();
+        virtual ~StreamingAudioNode();
+
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // Opens the file to stream, replacing any other, and sets the number of output channels to the file's.
+        // Reading starts straight away, so the file can play as soon as the node is started. Returns false, and
+        // plays nothing, if the file can't be opened or isn't a PCM or float WAV file.
+        bool setFile(ContextRenderLock &, const std::string & path);
+
+        float duration() const;
+
+        // The position in the file, in seconds, to play from next. Frames that have already been read ahead still
+        // play first, for a few milliseconds, before the new position is heard.
+        void seek(double seconds);
+
+        bool loop() const;
+        void setLoop(bool loop);
+
+        // Loop times in seconds. A loopEnd of zero loops at the end of the file.
+        double loopStart() const;
+        double loopEnd() const;
+        void setLoopStart(double loopStart);
+        void setLoopEnd(double loopEnd);
+
+        // The seconds read ahead of playback, for files set afterwards.
+        double readAhead() const;
+        void setReadAhead(double seconds);
+
+        // The number of times the disk couldn't keep up with playback, which was filled with silence.
+        uint64_t underrunCount() const;
+
+        std::shared_ptr<AudioParam> gain() { return m_gain; }
+
+        virtual bool propagatesSilence(ContextRenderLock & r) const override;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        class StreamProvider;
+
+        // Passes the loop settings to the stream.
+        void updateLoop();
+
+        std::shared_ptr<AudioFileStream> m_stream;
+
+        // When the file's rate differs from the context's.
+        std::unique_ptr<StreamProvider> m_provider;
+        std::unique_ptr<MultiChannelResampler> m_resampler;
+        std::unique_ptr<AudioBus> m_resampledBus;
+
+        // The frames the resampler holds back, and those of them still to play once the stream has ended.
+        size_t m_latencyFrames{ 0 };
+        size_t m_tailFrames{ 0 };
+
+        std::vector<float *> m_channels;
+
+        std::shared_ptr<AudioParam> m_gain;
+        std::shared_ptr<AudioSetting> m_isLooping;
+        std::shared_ptr<AudioSetting> m_loopStart;
+        std::shared_ptr<AudioSetting> m_loopEnd;
+        std::shared_ptr<AudioSetting> m_readAhead;
+
+        float m_lastGain{ 1.0f };
+    };
+}
+
+#endif
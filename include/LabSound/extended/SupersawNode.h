@@ -10,6 +10,10 @@
 
 namespace lab 
 {
+    // Detuned saws, rendered together by an OscillatorBankNode through an ADSR envelope.
+    //
+    // params: detune, frequency, sawCount
+    //
     class SupersawNode : public AudioNode 
     {
         class SupersawNodeInternal;
@@ -32,7 +36,9 @@ namespace lab
         void noteOn(double when);
         void noteOff(ContextRenderLock&, double when);
 
-        void update(ContextRenderLock& r); // call if sawCount is changed. CBB: update automatically
+        // Connects the saws to the envelope, so must be called once before the node is heard. Changes to sawCount
+        // and detune are applied as the node renders.
+        void update(ContextRenderLock& r);
 
     private:
 
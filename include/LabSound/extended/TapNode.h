@@ -0,0 +1,116 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef TAP_NODE_H
+#define TAP_NODE_H
+
+#include "LabSound/core/AudioBasicInspectorNode.h"
+
+#include <atomic>
+#include <memory>
+
+namespace lab
+{
+    // Passes its input through, and publishes it to other threads as a ring of fixed size planar blocks of up to
+    // blockFrames frames, a quantum by default, for consumers such as inference or network senders that want the
+    // signal without copying it. A consumer leases a block and reads its channels where they lie in the ring;
+    // the render thread never writes a leased block, and neither side waits for the other.
+    //
+    // Blocks are numbered in the order they're written, from 1. A block can't be written while its slot holds a
+    // leased block, or, under DropNewest, one that no consumer has leased yet; it is then dropped, and counted
+    // in the next block's droppedBefore. Under OverwriteOldest, unleased blocks are overwritten as the ring wraps,
+    // so consumers that fall behind skip ahead.
+    class TapNode : public AudioBasicInspectorNode
+    {
+        class Ring;
+
+    public:
+
+        enum OverflowPolicy
+        {
+            OverwriteOldest,
+            DropNewest
+        };
+
+        enum { DefaultBlockCount = 64 };
+
+        // A consumer's hold on a block, released when the lease is destroyed or reset. Leases are movable, and
+        // may outlive the node.
+        class Lease
+        {
+        public:
+
+            Lease() = default;
+            Lease(Lease && other);
+            Lease & operator=(Lease && other);
+            ~Lease();
+
+            Lease(const Lease &) = delete;
+            Lease & operator=(const Lease &) = delete;
+
+            bool valid() const { return m_ring != nullptr; }
+            explicit operator bool() const { return valid(); }
+
+            void reset();
+
+            uint64_t sequence() const;
+
+            // The blocks dropped between this one and the one before it.
+            uint64_t droppedBefore() const;
+
+            // The context's frame at the block's start.
+            uint64_t sampleFrame() const;
+
+            float sampleRate() const;
+            int numberOfChannels() const;
+            size_t length() const;
+
+            // length() frames of channel c, valid while the lease is.
+            const float * channel(int c) const;
+
+        private:
+
+            friend class TapNode;
+            Lease(std::shared_ptr<Ring> ring, size_t slot)
+                : m_ring(std::move(ring)), m_slot(slot) {}
+
+            std::shared_ptr<Ring> m_ring;
+            size_t m_slot{ 0 };
+        };
+
+        // Up to AudioContext::maxChannelLimit channels are tapped, and blockCount is at least 2.
+        TapNode(int channels = 2, size_t blockCount = DefaultBlockCount, OverflowPolicy policy = OverwriteOldest,
+                size_t blockFrames = ProcessingSizeInFrames);
+        virtual ~TapNode();
+
+        // AudioNode
+        virtual void process(ContextRenderLock &, size_t framesToProcess) override;
+        virtual void reset(ContextRenderLock &) override;
+
+        // The rest may be called from any thread.
+
+        // The sequence number of the latest block written, or 0 before the first.
+        uint64_t latestSequence() const;
+
+        // Leases block sequence, or returns an invalid lease if it isn't in the ring, or is being written.
+        Lease acquire(uint64_t sequence);
+
+        // Leases the oldest block in the ring numbered sequence or later, and sets sequence to the number after
+        // it, so a consumer can keep calling it with the same cursor, starting from 0, to see each block in turn.
+        // Returns an invalid lease when there is none yet.
+        Lease acquireNext(uint64_t & sequence);
+
+        // The blocks dropped since the node was created.
+        uint64_t droppedBlockCount() const;
+
+    private:
+
+        virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        std::shared_ptr<Ring> m_ring;
+    };
+
+} // end namespace lab
+
+#endif
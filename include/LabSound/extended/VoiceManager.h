@@ -0,0 +1,86 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef VOICE_MANAGER_H
+#define VOICE_MANAGER_H
+
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+    class AudioContext;
+    class GainNode;
+    class PannerNode;
+    class SampledAudioNode;
+
+    // Caps the number of sources heard at once, across the context and within groups of voices. On each update the
+    // voices playing are ranked by priority, and then by how loud they are estimated to be: the source's gain, the
+    // gain of its group's bus, and the distance gain of its panner. Those ranked past the limits, or quieter than the
+    // audibility threshold, are virtualized, see SampledAudioNode::setVirtualized(): they keep their place in their
+    // sounds without rendering, and the panners and effects after them fall dormant. A virtual voice that ranks
+    // within the limits again fades back in where it has got to.
+    //
+    // The estimate is made from the intrinsic values of the parameters, without their automation, and the panner's
+    // and listener's positions. Voices are held weakly, and forgotten once they finish. To be used from one thread.
+    class VoiceManager
+    {
+    public:
+
+        VoiceManager(AudioContext & context, size_t maxVoices);
+
+        // Makes every voice still managed real.
+        ~VoiceManager();
+
+        // Adds a group of at most maxVoices real voices, and returns its index. If a bus is given, its gain counts
+        // towards the loudness of the group's voices.
+        size_t addGroup(size_t maxVoices, std::shared_ptr<GainNode> bus = nullptr);
+
+        // Manages a source, scheduled or playing, in a group. The panner, if any, is the one the source is heard
+        // through. Higher priorities are kept real ahead of lower ones, however loud.
+        void addVoice(size_t group, std::shared_ptr<SampledAudioNode> source, std::shared_ptr<PannerNode> panner = nullptr, int priority = 0);
+
+        void setMaxVoices(size_t maxVoices) { m_maxVoices = maxVoices; }
+        size_t maxVoices() const { return m_maxVoices; }
+
+        // Voices estimated quieter than this gain are virtual whatever the limits. Defaults to -60 dB.
+        void setAudibilityThreshold(float gain) { m_threshold = gain; }
+        float audibilityThreshold() const { return m_threshold; }
+
+        // Ranks the voices and virtualizes or realizes them; to be called regularly, say once a frame.
+        void update();
+
+        // As of the last update.
+        size_t realVoices() const { return m_real; }
+        size_t virtualVoices() const { return m_virtual; }
+
+    private:
+
+        struct Group
+        {
+            size_t maxVoices;
+            std::weak_ptr<GainNode> bus;
+            size_t real = 0;
+        };
+
+        struct Voice
+        {
+            std::weak_ptr<SampledAudioNode> source;
+            std::weak_ptr<PannerNode> panner;
+            size_t group;
+            int priority;
+            float loudness = 0;
+        };
+
+        AudioContext & m_context;
+        size_t m_maxVoices;
+        float m_threshold = 0.001f;
+        std::vector<Group> m_groups;
+        std::vector<Voice> m_voices;
+        std::vector<size_t> m_ranking;
+        size_t m_real = 0;
+        size_t m_virtual = 0;
+    };
+}
+
+#endif
@@ -35,6 +35,7 @@ win32 {
 	SOURCES += $$files($$PWD/../src/internal/src/win/*.cpp)
 	SOURCES += $$PWD/../third_party/rtaudio/src/RtAudio.cpp
 	SOURCES += $$PWD/../third_party/STK/src/STKInlineCompile.cpp
+	DEFINES += STK
 	
 	QMAKE_LFLAGS += /NODEFAULTLIB:MSVCRT /OPT:REF
 	QMAKE_CFLAGS_RELEASE = -O2 -MT
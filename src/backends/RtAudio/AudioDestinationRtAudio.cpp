@@ -11,6 +11,9 @@
 
 #include <rtaudio/RtAudio.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace lab
 {
 
@@ -35,9 +38,26 @@ static int NumDefaultOutputChannels()
 const float kLowThreshold = -1.0f;
 const float kHighThreshold = 1.0f;
 
-AudioDestination * AudioDestination::MakePlatformAudioDestination(AudioIOCallback & callback, size_t numberOfOutputChannels, float sampleRate)
+// Full scale for 32 bit integers; the largest float below 2^31.
+const float kInt32Scale = 2147483392.f;
+const float kInt32Unscale = 1.f / 2147483648.f;
+
+// The stream's format: float where the device takes it, or RtAudio can't say, else the widest integer it takes.
+// Packed 24 bit is left to RtAudio's conversion from 32.
+static RtAudioFormat StreamFormat(const RtAudio::DeviceInfo & info)
+{
+    if (!info.nativeFormats || (info.nativeFormats & RTAUDIO_FLOAT32))
+        return RTAUDIO_FLOAT32;
+    if (info.nativeFormats & (RTAUDIO_SINT32 | RTAUDIO_SINT24))
+        return RTAUDIO_SINT32;
+    if (info.nativeFormats & RTAUDIO_SINT16)
+        return RTAUDIO_SINT16;
+    return RTAUDIO_FLOAT32;
+}
+
+AudioDestination * AudioDestination::MakePlatformAudioDestination(AudioIOCallback & callback, size_t numberOfOutputChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings)
 {
-    return new AudioDestinationRtAudio(callback, numberOfOutputChannels, sampleRate);
+    return new AudioDestinationRtAudio(callback, numberOfOutputChannels, sampleRate, framesPerBuffer, settings);
 }
 
 unsigned long AudioDestination::maxChannelCount()
@@ -45,15 +65,16 @@ unsigned long AudioDestination::maxChannelCount()
     return NumDefaultOutputChannels();
 }
 
-AudioDestinationRtAudio::AudioDestinationRtAudio(AudioIOCallback & callback, size_t numChannels, float sampleRate)
+AudioDestinationRtAudio::AudioDestinationRtAudio(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings)
 : m_callback(callback)
-, m_renderBus(numChannels, AudioNode::ProcessingSizeInFrames, false)
-, m_inputBus(1, AudioNode::ProcessingSizeInFrames, false)
+, m_framesPerBuffer(framesPerBuffer)
+, m_renderBus(numChannels, framesPerBuffer, false)
+, m_inputBus(1, framesPerBuffer, false)
 {
     m_numChannels = numChannels;
     m_sampleRate = sampleRate;
     m_renderBus.setSampleRate(m_sampleRate);
-    configure();
+    configure(settings);
 }
 
 AudioDestinationRtAudio::~AudioDestinationRtAudio()
@@ -62,7 +83,7 @@ AudioDestinationRtAudio::~AudioDestinationRtAudio()
         dac.closeStream();
 }
 
-void AudioDestinationRtAudio::configure()
+void AudioDestinationRtAudio::configure(const AudioDeviceSettings & settings)
 {
     if (dac.getDeviceCount() < 1)
     {
@@ -84,19 +105,77 @@ void AudioDestinationRtAudio::configure()
     inputParams.nChannels = 1;
     inputParams.firstChannel = 0;
 
-    unsigned int bufferFrames = AudioNode::ProcessingSizeInFrames;
+    // The graph renders at its own rate. If the device can't run at it, the device runs at its preferred rate and
+    // the graph is resampled to that.
+    unsigned int deviceSampleRate = static_cast<unsigned int>(m_sampleRate);
+    const std::vector<unsigned int> & supportedSampleRates = deviceInfo.sampleRates;
+    if (!supportedSampleRates.empty() && std::find(supportedSampleRates.begin(), supportedSampleRates.end(), deviceSampleRate) == supportedSampleRates.end())
+    {
+        deviceSampleRate = deviceInfo.preferredSampleRate ? deviceInfo.preferredSampleRate : supportedSampleRates.back();
+        LOG("Resampling from %f Hz to the device's %u Hz", m_sampleRate, deviceSampleRate);
+        m_resampler.reset(new DestinationResampler(m_callback, static_cast<unsigned>(m_numChannels), m_sampleRate, static_cast<float>(deviceSampleRate), m_framesPerBuffer));
+        m_renderBus.setSampleRate(static_cast<float>(deviceSampleRate));
+    }
+
+    unsigned int bufferFrames = static_cast<unsigned int>(m_framesPerBuffer);
+
+    m_format = StreamFormat(deviceInfo);
+    if (m_format != RTAUDIO_FLOAT32)
+    {
+        LOG("Writing the device's %d bit integer format", m_format == RTAUDIO_SINT16 ? 16 : 32);
+    }
 
     RtAudio::StreamOptions options;
-    options.flags |= RTAUDIO_NONINTERLEAVED;
 
     try
     {
-        dac.openStream(&outputParams, &inputParams, RTAUDIO_FLOAT32, (unsigned int) m_sampleRate, &bufferFrames, &outputCallback, this, &options);
+        dac.openStream(&outputParams, &inputParams, m_format, deviceSampleRate, &bufferFrames, &outputCallback, this, &options);
+
+        // A buffer of whole quanta is rendered in place. If the device took another size, it's asked for the
+        // nearest multiple of the quantum before settling for what it offers.
+        if (bufferFrames % m_framesPerBuffer)
+        {
+            unsigned int wholeQuanta = static_cast<unsigned int>(std::max<size_t>(1, (bufferFrames + m_framesPerBuffer / 2) / m_framesPerBuffer) * m_framesPerBuffer);
+            dac.closeStream();
+            dac.openStream(&outputParams, &inputParams, m_format, deviceSampleRate, &wholeQuanta, &outputCallback, this, &options);
+            bufferFrames = wholeQuanta;
+        }
+
+        m_streamLatency = static_cast<double>(dac.getStreamLatency()) / deviceSampleRate;
     }
     catch (RtAudioError & e)
     {
         e.printMessage();
     }
+
+    m_sources.resize(m_numChannels);
+    reserve(bufferFrames);
+
+    if (!m_resampler)
+    {
+        m_quantizer.reset(new DestinationQuantizer(m_callback, m_numChannels, 1, m_framesPerBuffer, bufferFrames));
+        if (!m_quantizer->inPlace())
+        {
+            LOG("The device's buffer of %u frames isn't a multiple of the render quantum; rendering a quantum ahead", bufferFrames);
+        }
+    }
+}
+
+double AudioDestinationRtAudio::baseLatency() const
+{
+    if (m_resampler)
+        return m_resampler->latency();
+    return m_quantizer ? m_quantizer->latencyFrames() / static_cast<double>(m_sampleRate) : 0;
+}
+
+double AudioDestinationRtAudio::inputLatency() const
+{
+    return m_quantizer ? m_quantizer->inputLatencyFrames() / static_cast<double>(m_sampleRate) : 0;
+}
+
+double AudioDestinationRtAudio::roundTripLatency() const
+{
+    return m_streamLatency + inputLatency() + baseLatency();
 }
 
 void AudioDestinationRtAudio::start()
@@ -123,48 +202,86 @@ void AudioDestinationRtAudio::stop()
     }
 }
 
+void AudioDestinationRtAudio::reserve(size_t frames)
+{
+    m_planar.resize(frames * m_numChannels);
+    if (m_format != RTAUDIO_FLOAT32)
+    {
+        m_interleaved.resize(frames * m_numChannels);
+        m_input.resize(frames);
+    }
+}
+
 // Pulls on our provider to get rendered audio stream.
 void AudioDestinationRtAudio::render(int numberOfFrames, void * outputBuffer, void * inputBuffer)
 {
-    float *myOutputBufferOfFloats = (float*) outputBuffer;
-    float *myInputBufferOfFloats = (float*) inputBuffer;
+    const size_t frames = static_cast<size_t>(numberOfFrames);
+
+    // RtAudio may change the buffer's size; the scratch only grows.
+    if (m_planar.size() < frames * m_numChannels)
+        reserve(frames);
 
-    // Inform bus to use an externally allocated buffer from rtaudio
-    if (m_renderBus.isFirstTime())
+    // Any channel the graph leaves alone plays silence.
+    std::memset(m_planar.data(), 0, sizeof(float) * frames * m_numChannels);
+    for (uint32_t i = 0; i < m_numChannels; ++i)
     {
-		for (uint32_t i = 0; i < m_numChannels; ++i)
-		{
-			m_renderBus.setChannelMemory(i, myOutputBufferOfFloats + i * numberOfFrames, numberOfFrames);
-		}
+        m_renderBus.setChannelMemory(i, m_planar.data() + i * frames, frames);
     }
 
-    if (m_inputBus.isFirstTime())
+    // The input is mono, so interleaved it is already planar.
+    const float * input = nullptr;
+    if (inputBuffer)
     {
-        m_inputBus.setChannelMemory(0, myInputBufferOfFloats, numberOfFrames);
+        switch (m_format)
+        {
+        case RTAUDIO_SINT16: VectorMath::vdequantize16(static_cast<const int16_t *>(inputBuffer), m_input.data(), frames); input = m_input.data(); break;
+        case RTAUDIO_SINT32: VectorMath::vdequantize32(static_cast<const int32_t *>(inputBuffer), &kInt32Unscale, m_input.data(), frames); input = m_input.data(); break;
+        default: input = static_cast<const float *>(inputBuffer); break;
+        }
+        m_inputBus.setChannelMemory(0, const_cast<float *>(input), frames);
     }
 
     // Source Bus :: Destination Bus
-    m_callback.render(&m_inputBus, &m_renderBus, numberOfFrames);
+    if (m_resampler)
+        m_resampler->render(nullptr, &m_renderBus, frames);
+    else if (m_quantizer)
+        m_quantizer->render(input ? &m_inputBus : nullptr, &m_renderBus, frames);
+
+    for (unsigned i = 0; i < m_numChannels; ++i)
+        m_sources[i] = m_renderBus.channel(i)->data();
 
-    // Clamp values at 0db (i.e., [-1.0, 1.0])
-    for (unsigned i = 0; i < m_renderBus.numberOfChannels(); ++i)
+    // The integer conversions clamp as they go; float is clamped at 0db (i.e., [-1.0, 1.0]) before it's interleaved.
+    const size_t samples = frames * m_numChannels;
+    switch (m_format)
     {
-        AudioChannel * channel = m_renderBus.channel(i);
-        VectorMath::vclip(channel->data(), 1, &kLowThreshold, &kHighThreshold, channel->mutableData(), 1, numberOfFrames);
+    case RTAUDIO_SINT16:
+        VectorMath::vinterleave(m_sources.data(), m_numChannels, m_interleaved.data(), frames);
+        VectorMath::vquantize16(m_interleaved.data(), static_cast<int16_t *>(outputBuffer), m_dither, samples);
+        break;
+    case RTAUDIO_SINT32:
+        VectorMath::vinterleave(m_sources.data(), m_numChannels, m_interleaved.data(), frames);
+        VectorMath::vquantize32(m_interleaved.data(), &kInt32Scale, static_cast<int32_t *>(outputBuffer), samples);
+        break;
+    default:
+        for (unsigned i = 0; i < m_numChannels; ++i)
+        {
+            AudioChannel * channel = m_renderBus.channel(i);
+            VectorMath::vclip(channel->data(), 1, &kLowThreshold, &kHighThreshold, channel->mutableData(), 1, frames);
+        }
+        VectorMath::vinterleave(m_sources.data(), m_numChannels, static_cast<float *>(outputBuffer), frames);
+        break;
     }
 }
 
 int outputCallback(void * outputBuffer, void * inputBuffer, unsigned int nBufferFrames, double streamTime, RtAudioStreamStatus status, void * userData)
 {
-    float *fBufOut = (float*) outputBuffer;
-
-    // Buffer is nBufferFrames * channels
-    // NB: channel count should be set in a principled way
-    memset(fBufOut, 0, sizeof(float) * nBufferFrames * 2);
-
     AudioDestinationRtAudio * audioDestination = static_cast<AudioDestinationRtAudio*>(userData);
 
-    audioDestination->render(nBufferFrames, fBufOut, inputBuffer);
+    // RtAudio flags an under or overflow since the last callback.
+    if (status)
+        audioDestination->reportXrun();
+
+    audioDestination->render(nBufferFrames, outputBuffer, inputBuffer);
 
     return 0;
 }
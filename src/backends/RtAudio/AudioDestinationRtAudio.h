@@ -7,12 +7,17 @@
 
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioDeviceSettings.h"
 
 #include "internal/AudioDestination.h"
+#include "internal/DestinationQuantizer.h"
+#include "internal/DestinationResampler.h"
 
 #include "rtaudio/RtAudio.h"
 #include <iostream>
 #include <cstdlib>
+#include <memory>
+#include <vector>
 
 namespace lab {
 
@@ -21,21 +26,29 @@ class AudioDestinationRtAudio : public AudioDestination
 
 public:
 
-    AudioDestinationRtAudio(AudioIOCallback &, size_t numChannels, float sampleRate);
+    AudioDestinationRtAudio(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings);
     virtual ~AudioDestinationRtAudio();
 
     virtual void start() override;
     virtual void stop() override;
 
     float sampleRate() const override { return m_sampleRate; }
+    double baseLatency() const override;
+    double inputLatency() const override;
+    double roundTripLatency() const override;
 
     void render(int numberOfFrames, void * outputBuffer, void * inputBuffer);
+    void reportXrun() { m_callback.reportXrun(); }
 
 private:
 
-    void configure();
+    void configure(const AudioDeviceSettings & settings);
+
+    // Sizes the scratch buffers for callbacks of frames.
+    void reserve(size_t frames);
 
     AudioIOCallback & m_callback;
+    size_t m_framesPerBuffer;
 
     AudioBus m_renderBus = {2, AudioNode::ProcessingSizeInFrames, false};
     AudioBus m_inputBus = {1, AudioNode::ProcessingSizeInFrames, false};
@@ -43,6 +56,24 @@ private:
     unsigned m_numChannels;
     float m_sampleRate;
 
+    // Converts the graph's rate to the device's, when the device can't run at the graph's.
+    std::unique_ptr<DestinationResampler> m_resampler;
+
+    // Splits the device's buffers into render quanta, when the graph isn't resampled.
+    std::unique_ptr<DestinationQuantizer> m_quantizer;
+
+    // The stream is interleaved, in the device's own format where RtAudio offers it, so that RtAudio has no
+    // conversion of its own to make; the graph's planar float is interleaved and converted here.
+    RtAudioFormat m_format = RTAUDIO_FLOAT32;
+    std::vector<float> m_planar;      // the render bus's channels
+    std::vector<float> m_interleaved; // the output, before an integer format's conversion
+    std::vector<float> m_input;       // the input, after an integer format's conversion
+    std::vector<const float *> m_sources;
+    uint32_t m_dither[4] = { 0x9e3779b9, 0x7f4a7c15, 0x85ebca6b, 0xc2b2ae35 };
+
+    // The seconds RtAudio reports its stream buffers, input and output together.
+    double m_streamLatency = 0;
+
     RtAudio dac;
 };
 
@@ -179,9 +179,9 @@ public:
 };
 //LabSound end
 
-AudioDestination* AudioDestination::MakePlatformAudioDestination(AudioIOCallback& callback, size_t numberOfOutputChannels, float sampleRate)
+AudioDestination* AudioDestination::MakePlatformAudioDestination(AudioIOCallback& callback, size_t numberOfOutputChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings &)
 {
-    return new AudioDestinationMac(callback, numberOfOutputChannels, sampleRate);
+    return new AudioDestinationMac(callback, numberOfOutputChannels, sampleRate, framesPerBuffer);
 }
 
 unsigned long AudioDestination::maxChannelCount()
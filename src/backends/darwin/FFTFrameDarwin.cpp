@@ -4,11 +4,11 @@
 
 
 #include "LabSound/core/Macros.h"
+#include "internal/FFTFrame.h"
 
-#if defined(LABSOUND_PLATFORM_OSX) && !defined(WEBAUDIO_KISSFFT)
+#if USE_ACCELERATE_FFT
 
 #include "internal/Assertions.h"
-#include "internal/FFTFrame.h"
 #include "internal/VectorMath.h"
 
 namespace lab {
@@ -158,4 +158,4 @@ float* FFTFrame::imagData() const
 
 } // namespace lab
 
-#endif // #if OS(DARWIN)
+#endif // USE_ACCELERATE_FFT
@@ -0,0 +1,374 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#if defined(__LINUX_ALSA__)
+
+#include "AudioDestinationAlsa.h"
+
+#include "LabSound/core/AudioIOCallback.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace lab
+{
+
+namespace
+{
+    const unsigned MaxDeviceChannels = 32;
+
+    // How long the render thread waits on the device before looking again.
+    const int WaitMilliseconds = 100;
+
+    const float LowThreshold = -1.f;
+    const float HighThreshold = 1.f;
+
+    // The device's formats, in order of preference.
+    const snd_pcm_format_t Formats[] = {
+        SND_PCM_FORMAT_FLOAT_LE,
+        SND_PCM_FORMAT_S32_LE,
+        SND_PCM_FORMAT_S24_LE,
+        SND_PCM_FORMAT_S16_LE,
+    };
+
+    template <typename T>
+    void store(uint8_t * destination, T value)
+    {
+        std::memcpy(destination, &value, sizeof(value));
+    }
+}
+
+std::unique_ptr<AudioDestinationAlsa> AudioDestinationAlsa::open(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                                                 const AudioDeviceSettings & settings)
+{
+    std::unique_ptr<AudioDestinationAlsa> destination(new AudioDestinationAlsa(callback, numChannels, sampleRate, framesPerBuffer, settings));
+    if (!destination->configure(settings))
+        return nullptr;
+    return destination;
+}
+
+AudioDestinationAlsa::AudioDestinationAlsa(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                           const AudioDeviceSettings & settings)
+    : m_callback(callback)
+    , m_numChannels(numChannels)
+    , m_sampleRate(sampleRate)
+    , m_framesPerBuffer(framesPerBuffer)
+    , m_realtimePriority(settings.realtimePriority)
+    , m_renderBus(numChannels, framesPerBuffer)
+    , m_inputBus(1, framesPerBuffer)
+{
+    m_renderBus.setSampleRate(sampleRate);
+}
+
+AudioDestinationAlsa::~AudioDestinationAlsa()
+{
+    stop();
+    if (m_pcm)
+        snd_pcm_close(m_pcm);
+}
+
+bool AudioDestinationAlsa::configure(const AudioDeviceSettings & settings)
+{
+    const char * name = settings.deviceName.empty() ? "default" : settings.deviceName.c_str();
+    int err = snd_pcm_open(&m_pcm, name, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0)
+    {
+        LOG_ERROR("Can't open the ALSA device %s: %s", name, snd_strerror(err));
+        m_pcm = nullptr;
+        return false;
+    }
+
+    snd_pcm_hw_params_t * hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(m_pcm, hw);
+
+    // The device's buffer is written directly where it allows, either layout being handled by convert().
+    m_mmap = settings.mmap && (snd_pcm_hw_params_set_access(m_pcm, hw, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) == 0 ||
+                               snd_pcm_hw_params_set_access(m_pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0);
+    if (!m_mmap && (err = snd_pcm_hw_params_set_access(m_pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+    {
+        LOG_ERROR("The ALSA device %s can't be written to: %s", name, snd_strerror(err));
+        return false;
+    }
+
+    for (snd_pcm_format_t format : Formats)
+    {
+        if (snd_pcm_hw_params_test_format(m_pcm, hw, format) == 0 && snd_pcm_hw_params_set_format(m_pcm, hw, format) == 0)
+        {
+            m_format = format;
+            break;
+        }
+    }
+    if (m_format == SND_PCM_FORMAT_UNKNOWN)
+    {
+        LOG_ERROR("The ALSA device %s has none of the sample formats LabSound writes", name);
+        return false;
+    }
+
+    // The device may have more channels than the graph, which are left silent, or fewer, which are dropped.
+    m_deviceChannels = static_cast<unsigned>(m_numChannels);
+    snd_pcm_hw_params_set_channels_near(m_pcm, hw, &m_deviceChannels);
+    m_deviceChannels = std::min(m_deviceChannels, MaxDeviceChannels);
+
+    m_deviceSampleRate = static_cast<unsigned>(m_sampleRate);
+    int dir = 0;
+    snd_pcm_hw_params_set_rate_near(m_pcm, hw, &m_deviceSampleRate, &dir);
+
+    m_periodFrames = m_framesPerBuffer;
+    dir = 0;
+    snd_pcm_hw_params_set_period_size_near(m_pcm, hw, &m_periodFrames, &dir);
+    unsigned periods = std::max(settings.periodCount, 2u);
+    dir = 0;
+    snd_pcm_hw_params_set_periods_near(m_pcm, hw, &periods, &dir);
+
+    if ((err = snd_pcm_hw_params(m_pcm, hw)) < 0)
+    {
+        LOG_ERROR("Can't configure the ALSA device %s: %s", name, snd_strerror(err));
+        return false;
+    }
+    snd_pcm_hw_params_get_period_size(hw, &m_periodFrames, &dir);
+    snd_pcm_hw_params_get_buffer_size(hw, &m_bufferFrames);
+
+    // The device starts once as many quanta as fit its buffer are written, and the render thread is woken when
+    // there's room for another.
+    snd_pcm_sw_params_t * sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(m_pcm, sw);
+    const snd_pcm_uframes_t quantum = m_framesPerBuffer;
+    snd_pcm_sw_params_set_start_threshold(m_pcm, sw, std::max(m_bufferFrames / quantum, snd_pcm_uframes_t(1)) * quantum);
+    snd_pcm_sw_params_set_avail_min(m_pcm, sw, quantum);
+    if ((err = snd_pcm_sw_params(m_pcm, sw)) < 0)
+    {
+        LOG_ERROR("Can't configure the ALSA device %s: %s", name, snd_strerror(err));
+        return false;
+    }
+
+    if (m_deviceSampleRate != static_cast<unsigned>(m_sampleRate))
+    {
+        LOG("Resampling from %f Hz to the device's %u Hz", m_sampleRate, m_deviceSampleRate);
+        m_resampler.reset(new DestinationResampler(m_callback, static_cast<unsigned>(m_numChannels), m_sampleRate,
+                                                   static_cast<float>(m_deviceSampleRate), m_framesPerBuffer));
+        m_renderBus.setSampleRate(static_cast<float>(m_deviceSampleRate));
+    }
+
+    if (!m_mmap)
+        m_interleaved.resize(m_framesPerBuffer * m_deviceChannels * snd_pcm_format_physical_width(m_format) / 8);
+    if (m_format != SND_PCM_FORMAT_FLOAT_LE)
+        m_scratch.resize(m_framesPerBuffer * m_deviceChannels);
+
+    LOG("ALSA device %s: %u Hz, %u channels, %s, periods of %lu frames, a buffer of %lu frames", name, m_deviceSampleRate,
+        m_deviceChannels, snd_pcm_format_name(m_format), static_cast<unsigned long>(m_periodFrames), static_cast<unsigned long>(m_bufferFrames));
+    return true;
+}
+
+void AudioDestinationAlsa::start()
+{
+    if (m_thread.joinable())
+        return;
+
+    snd_pcm_prepare(m_pcm);
+    m_running = true;
+    m_thread = std::thread(&AudioDestinationAlsa::renderEntry, this);
+}
+
+void AudioDestinationAlsa::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    m_thread.join();
+    snd_pcm_drop(m_pcm);
+}
+
+void AudioDestinationAlsa::renderEntry()
+{
+    if (m_realtimePriority > 0)
+    {
+        sched_param param = {};
+        param.sched_priority = std::min(m_realtimePriority, sched_get_priority_max(SCHED_FIFO));
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+        {
+            LOG("The ALSA render thread can't be scheduled in realtime; it needs CAP_SYS_NICE or an rtprio limit");
+        }
+    }
+
+    const snd_pcm_sframes_t quantum = static_cast<snd_pcm_sframes_t>(m_framesPerBuffer);
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcm);
+        if (avail < 0)
+        {
+            if (!recover(static_cast<int>(avail)))
+                break;
+            continue;
+        }
+
+        if (avail < quantum)
+        {
+            // A buffer that isn't a whole number of quanta can be too full for another before it starts.
+            if (snd_pcm_state(m_pcm) == SND_PCM_STATE_PREPARED)
+            {
+                snd_pcm_start(m_pcm);
+                continue;
+            }
+
+            const int err = snd_pcm_wait(m_pcm, WaitMilliseconds);
+            if (err < 0 && !recover(err))
+                break;
+            continue;
+        }
+
+        if (!renderQuantum())
+            break;
+    }
+}
+
+bool AudioDestinationAlsa::renderQuantum()
+{
+    if (m_resampler)
+        m_resampler->render(nullptr, &m_renderBus, m_framesPerBuffer);
+    else
+        m_callback.render(&m_inputBus, &m_renderBus, m_framesPerBuffer);
+
+    // Clamped at 0dB, as the other destinations do.
+    for (size_t c = 0; c < m_renderBus.numberOfChannels(); ++c)
+    {
+        AudioChannel * channel = m_renderBus.channel(c);
+        if (!channel->isSilent())
+            VectorMath::vclip(channel->data(), 1, &LowThreshold, &HighThreshold, channel->mutableData(), 1, m_framesPerBuffer);
+    }
+
+    return m_mmap ? writeMapped(m_framesPerBuffer) : writeCopied(m_framesPerBuffer);
+}
+
+bool AudioDestinationAlsa::writeMapped(size_t frames)
+{
+    uint8_t * destinations[MaxDeviceChannels];
+    unsigned steps[MaxDeviceChannels];
+
+    // The device's buffer may wrap within the quantum, taking it in two spans.
+    for (size_t done = 0; done < frames;)
+    {
+        const snd_pcm_channel_area_t * areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t size = frames - done;
+        int err = snd_pcm_mmap_begin(m_pcm, &areas, &offset, &size);
+        if (err < 0)
+            return recover(err);
+
+        for (unsigned c = 0; c < m_deviceChannels; ++c)
+        {
+            destinations[c] = static_cast<uint8_t *>(areas[c].addr) + (areas[c].first + offset * areas[c].step) / 8;
+            steps[c] = areas[c].step / 8;
+        }
+        convert(done, size, destinations, steps);
+
+        // The rest of a quantum that overran is dropped.
+        const snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcm, offset, size);
+        if (committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != size)
+            return recover(committed < 0 ? static_cast<int>(committed) : -EPIPE);
+        done += size;
+    }
+    return true;
+}
+
+bool AudioDestinationAlsa::writeCopied(size_t frames)
+{
+    uint8_t * destinations[MaxDeviceChannels];
+    unsigned steps[MaxDeviceChannels];
+    const unsigned bytes = snd_pcm_format_physical_width(m_format) / 8;
+    for (unsigned c = 0; c < m_deviceChannels; ++c)
+    {
+        destinations[c] = m_interleaved.data() + c * bytes;
+        steps[c] = bytes * m_deviceChannels;
+    }
+    convert(0, frames, destinations, steps);
+
+    const uint8_t * source = m_interleaved.data();
+    for (size_t done = 0; done < frames;)
+    {
+        const snd_pcm_sframes_t written = snd_pcm_writei(m_pcm, source + done * steps[0], frames - done);
+        if (written < 0)
+            return recover(static_cast<int>(written));
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void AudioDestinationAlsa::convert(size_t offset, size_t frames, uint8_t * const * destinations, const unsigned * steps)
+{
+    const unsigned renderChannels = static_cast<unsigned>(m_renderBus.numberOfChannels());
+
+    // The usual layout, frames of every channel side by side, is interleaved and converted a vector at a time, the
+    // channels the graph doesn't render reading silence.
+    const unsigned bytes = snd_pcm_format_physical_width(m_format) / 8;
+    bool interleaved = frames <= AudioChannel::SharedZeroLength && frames <= m_framesPerBuffer;
+    for (unsigned c = 0; c < m_deviceChannels && interleaved; ++c)
+        interleaved = steps[c] == bytes * m_deviceChannels && destinations[c] == destinations[0] + c * bytes;
+
+    if (interleaved)
+    {
+        const float * sources[MaxDeviceChannels];
+        for (unsigned c = 0; c < m_deviceChannels; ++c)
+            sources[c] = c < renderChannels ? m_renderBus.channel(c)->data() + offset : AudioChannel::SharedZeros;
+
+        const size_t samples = frames * m_deviceChannels;
+        if (m_format == SND_PCM_FORMAT_FLOAT_LE)
+        {
+            VectorMath::vinterleave(sources, m_deviceChannels, reinterpret_cast<float *>(destinations[0]), frames);
+            return;
+        }
+
+        VectorMath::vinterleave(sources, m_deviceChannels, m_scratch.data(), frames);
+        const float scale = m_format == SND_PCM_FORMAT_S32_LE ? 2147483392.f : 8388607.f;
+        if (m_format == SND_PCM_FORMAT_S16_LE)
+            VectorMath::vquantize16(m_scratch.data(), reinterpret_cast<int16_t *>(destinations[0]), m_dither, samples);
+        else
+            VectorMath::vquantize32(m_scratch.data(), &scale, reinterpret_cast<int32_t *>(destinations[0]), samples);
+        return;
+    }
+
+    for (unsigned c = 0; c < m_deviceChannels; ++c)
+    {
+        const float * source = c < renderChannels ? m_renderBus.channel(c)->data() + offset : nullptr;
+        uint8_t * destination = destinations[c];
+        const unsigned step = steps[c];
+        for (size_t i = 0; i < frames; ++i, destination += step)
+        {
+            const float sample = source ? std::max(std::min(source[i], 1.f), -1.f) : 0.f;
+            switch (m_format)
+            {
+            case SND_PCM_FORMAT_FLOAT_LE: store(destination, sample); break;
+            case SND_PCM_FORMAT_S32_LE: store(destination, static_cast<int32_t>(std::lrint(sample * 8388607.f)) * 256); break;
+            case SND_PCM_FORMAT_S24_LE: store(destination, static_cast<int32_t>(std::lrint(sample * 8388607.f))); break;
+            default: store(destination, static_cast<int16_t>(std::lrint(sample * 32767.f))); break;
+            }
+        }
+    }
+}
+
+bool AudioDestinationAlsa::recover(int error)
+{
+    m_xruns.fetch_add(1, std::memory_order_relaxed);
+    m_callback.reportXrun();
+    const int err = snd_pcm_recover(m_pcm, error, 1);
+    if (err < 0)
+    {
+        LOG_ERROR("The ALSA device failed: %s", snd_strerror(err));
+        return false;
+    }
+    return true;
+}
+
+} // namespace lab
+
+#endif // __LINUX_ALSA__
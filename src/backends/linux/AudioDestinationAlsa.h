@@ -0,0 +1,106 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioDestinationAlsa_h
+#define AudioDestinationAlsa_h
+
+#if defined(__LINUX_ALSA__)
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+
+#include "internal/AudioDestination.h"
+#include "internal/DestinationResampler.h"
+
+#include <alsa/asoundlib.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace lab {
+
+struct AudioIOCallback;
+
+// Plays through an ALSA PCM directly, from a render thread of its own, for periods as short as the render
+// quantum. The buffer is AudioDeviceSettings::periodCount periods of a quantum, and the thread renders a quantum
+// whenever there's room for one, writing it straight into the device's buffer if it allows mmap access, and
+// through snd_pcm_writei if not. Under and overruns are recovered from and counted. The device's own format is
+// used, float or 32, 24 or 16 bit integers, and its rate, the graph being resampled if it can't run at the
+// graph's. There's no live input; that is left to the RtAudio destination.
+class AudioDestinationAlsa : public AudioDestination
+{
+public:
+
+    // Returns nullptr if the PCM can't be opened or configured.
+    static std::unique_ptr<AudioDestinationAlsa> open(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                                      const AudioDeviceSettings & settings);
+
+    virtual ~AudioDestinationAlsa();
+
+    virtual void start() override;
+    virtual void stop() override;
+
+    float sampleRate() const override { return m_sampleRate; }
+    double baseLatency() const override { return m_resampler ? m_resampler->latency() : 0; }
+    double outputLatency() const override { return static_cast<double>(m_bufferFrames) / m_deviceSampleRate; }
+
+    uint64_t xrunCount() const { return m_xruns.load(std::memory_order_relaxed); }
+
+private:
+
+    AudioDestinationAlsa(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings);
+
+    bool configure(const AudioDeviceSettings & settings);
+
+    void renderEntry();
+
+    // Renders a quantum into m_renderBus, and writes it to the device. Returns false if the device failed.
+    bool renderQuantum();
+    bool writeMapped(size_t frames);
+    bool writeCopied(size_t frames);
+
+    // Converts frames of the render bus from offset on, to the device's format at each channel's address, a step
+    // of bytes apart.
+    void convert(size_t offset, size_t frames, uint8_t * const * destinations, const unsigned * steps);
+
+    // Recovers from an under or overrun, or a suspend. Returns false if the device can't be recovered.
+    bool recover(int error);
+
+    AudioIOCallback & m_callback;
+    size_t m_numChannels;
+    float m_sampleRate;
+    size_t m_framesPerBuffer;
+    int m_realtimePriority;
+
+    snd_pcm_t * m_pcm = nullptr;
+    snd_pcm_format_t m_format = SND_PCM_FORMAT_UNKNOWN;
+    bool m_mmap = false;
+    unsigned m_deviceChannels = 0;
+    unsigned m_deviceSampleRate = 0;
+    snd_pcm_uframes_t m_periodFrames = 0;
+    snd_pcm_uframes_t m_bufferFrames = 0;
+
+    AudioBus m_renderBus;
+    AudioBus m_inputBus;
+
+    // For writei, a quantum interleaved in the device's format.
+    std::vector<uint8_t> m_interleaved;
+
+    // For the integer formats, a quantum interleaved before its conversion, and the 16 bit format's dither.
+    std::vector<float> m_scratch;
+    uint32_t m_dither[4] = { 0x9e3779b9, 0x7f4a7c15, 0x85ebca6b, 0xc2b2ae35 };
+
+    std::unique_ptr<DestinationResampler> m_resampler;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running{ false };
+    std::atomic<uint64_t> m_xruns{ 0 };
+};
+
+} // namespace lab
+
+#endif // __LINUX_ALSA__
+
+#endif // AudioDestinationAlsa_h
@@ -0,0 +1,184 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#if defined(__UNIX_JACK__)
+
+#include "AudioDestinationJack.h"
+
+#include "LabSound/core/AudioIOCallback.h"
+#include "LabSound/extended/Logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace lab
+{
+
+std::unique_ptr<AudioDestinationJack> AudioDestinationJack::open(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                                                 const AudioDeviceSettings & settings)
+{
+    std::unique_ptr<AudioDestinationJack> destination(new AudioDestinationJack(callback, numChannels, sampleRate, framesPerBuffer));
+    if (!destination->configure(settings))
+        return nullptr;
+    return destination;
+}
+
+AudioDestinationJack::AudioDestinationJack(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer)
+    : m_callback(callback)
+    , m_numChannels(numChannels)
+    , m_sampleRate(sampleRate)
+    , m_framesPerBuffer(framesPerBuffer)
+    , m_renderBus(numChannels, framesPerBuffer)
+    , m_inputBus(1, framesPerBuffer)
+    , m_readPosition(framesPerBuffer)
+{
+    m_renderBus.setSampleRate(sampleRate);
+}
+
+AudioDestinationJack::~AudioDestinationJack()
+{
+    stop();
+    if (m_client)
+        jack_client_close(m_client);
+}
+
+bool AudioDestinationJack::configure(const AudioDeviceSettings & settings)
+{
+    const std::string name = settings.deviceName.empty() ? "LabSound" : settings.deviceName;
+    jack_status_t status;
+    m_client = jack_client_open(name.c_str(), JackNoStartServer, &status);
+    if (!m_client)
+    {
+        LOG_ERROR("Can't connect to a JACK server (status 0x%x)", static_cast<unsigned>(status));
+        return false;
+    }
+
+    for (size_t c = 0; c < m_numChannels; ++c)
+    {
+        const std::string portName = "out_" + std::to_string(c + 1);
+        jack_port_t * port = jack_port_register(m_client, portName.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (!port)
+        {
+            LOG_ERROR("Can't register the JACK port %s", portName.c_str());
+            return false;
+        }
+        m_ports.push_back(port);
+    }
+
+    m_serverSampleRate = jack_get_sample_rate(m_client);
+    if (m_serverSampleRate != static_cast<unsigned>(m_sampleRate))
+    {
+        LOG("Resampling from %f Hz to the JACK server's %u Hz", m_sampleRate, m_serverSampleRate);
+        m_resampler.reset(new DestinationResampler(m_callback, static_cast<unsigned>(m_numChannels), m_sampleRate,
+                                                   static_cast<float>(m_serverSampleRate), m_framesPerBuffer));
+        m_renderBus.setSampleRate(static_cast<float>(m_serverSampleRate));
+    }
+
+    jack_set_process_callback(m_client, &AudioDestinationJack::processCallback, this);
+    jack_set_xrun_callback(m_client, &AudioDestinationJack::xrunCallback, this);
+
+    LOG("JACK client %s: %u Hz, periods of %u frames", jack_get_client_name(m_client), m_serverSampleRate,
+        static_cast<unsigned>(jack_get_buffer_size(m_client)));
+    return true;
+}
+
+void AudioDestinationJack::start()
+{
+    if (m_active)
+        return;
+
+    if (jack_activate(m_client) != 0)
+    {
+        LOG_ERROR("Can't activate the JACK client");
+        return;
+    }
+    m_active = true;
+
+    // The ports are connected to the system's playback ports in order, once the client is active.
+    const char ** playback = jack_get_ports(m_client, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+    if (playback)
+    {
+        for (size_t c = 0; c < m_ports.size() && playback[c]; ++c)
+            jack_connect(m_client, jack_port_name(m_ports[c]), playback[c]);
+        jack_free(playback);
+    }
+}
+
+void AudioDestinationJack::stop()
+{
+    if (!m_active)
+        return;
+
+    jack_deactivate(m_client);
+    m_active = false;
+}
+
+double AudioDestinationJack::baseLatency() const
+{
+    // Besides any resampling, a quantum may be rendered ahead of the server's period.
+    const double resampling = m_resampler ? m_resampler->latency() : 0;
+    const jack_nframes_t period = m_client ? jack_get_buffer_size(m_client) : 0;
+    const double ahead = period % m_framesPerBuffer ? static_cast<double>(m_framesPerBuffer) / m_serverSampleRate : 0;
+    return resampling + ahead;
+}
+
+double AudioDestinationJack::outputLatency() const
+{
+    if (m_ports.empty() || !m_serverSampleRate)
+        return 0;
+
+    jack_latency_range_t range;
+    jack_port_get_latency_range(m_ports[0], JackPlaybackLatency, &range);
+    return static_cast<double>(range.max) / m_serverSampleRate;
+}
+
+int AudioDestinationJack::processCallback(jack_nframes_t frames, void * self)
+{
+    static_cast<AudioDestinationJack *>(self)->render(frames);
+    return 0;
+}
+
+int AudioDestinationJack::xrunCallback(void * self)
+{
+    AudioDestinationJack * destination = static_cast<AudioDestinationJack *>(self);
+    destination->m_xruns.fetch_add(1, std::memory_order_relaxed);
+    destination->m_callback.reportXrun();
+    return 0;
+}
+
+void AudioDestinationJack::render(jack_nframes_t frames)
+{
+    float * outputs[32] = {};
+    const size_t portCount = std::min<size_t>(m_ports.size(), 32);
+    for (size_t c = 0; c < portCount; ++c)
+        outputs[c] = static_cast<float *>(jack_port_get_buffer(m_ports[c], frames));
+
+    for (size_t done = 0; done < frames;)
+    {
+        if (m_readPosition == m_framesPerBuffer)
+        {
+            if (m_resampler)
+                m_resampler->render(nullptr, &m_renderBus, m_framesPerBuffer);
+            else
+                m_callback.render(&m_inputBus, &m_renderBus, m_framesPerBuffer);
+            m_readPosition = 0;
+        }
+
+        // Clamped at 0dB, as the other destinations do.
+        const size_t count = std::min<size_t>(frames - done, m_framesPerBuffer - m_readPosition);
+        for (size_t c = 0; c < portCount; ++c)
+        {
+            const float * source = m_renderBus.channel(c)->data() + m_readPosition;
+            float * destination = outputs[c] + done;
+            for (size_t i = 0; i < count; ++i)
+                destination[i] = std::max(std::min(source[i], 1.f), -1.f);
+        }
+        m_readPosition += count;
+        done += count;
+    }
+}
+
+} // namespace lab
+
+#endif // __UNIX_JACK__
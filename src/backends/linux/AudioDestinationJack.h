@@ -0,0 +1,84 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioDestinationJack_h
+#define AudioDestinationJack_h
+
+#if defined(__UNIX_JACK__)
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+
+#include "internal/AudioDestination.h"
+#include "internal/DestinationResampler.h"
+
+#include <jack/jack.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace lab {
+
+struct AudioIOCallback;
+
+// Plays as a JACK client, rendering in the server's process callback and connecting its ports to the system's
+// playback ports. When the server's period isn't the render quantum, quanta are rendered ahead into a buffer of
+// one, which adds up to a quantum to the latency; a server period that is a multiple of the quantum, or equal to
+// it, adds none. The graph is resampled if the server runs at another rate. Live input is left to the RtAudio
+// destination.
+class AudioDestinationJack : public AudioDestination
+{
+public:
+
+    // Returns nullptr if there is no server to connect to.
+    static std::unique_ptr<AudioDestinationJack> open(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                                      const AudioDeviceSettings & settings);
+
+    virtual ~AudioDestinationJack();
+
+    virtual void start() override;
+    virtual void stop() override;
+
+    float sampleRate() const override { return m_sampleRate; }
+    double baseLatency() const override;
+    double outputLatency() const override;
+
+    uint64_t xrunCount() const { return m_xruns.load(std::memory_order_relaxed); }
+
+private:
+
+    AudioDestinationJack(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer);
+
+    bool configure(const AudioDeviceSettings & settings);
+
+    static int processCallback(jack_nframes_t frames, void * self);
+    static int xrunCallback(void * self);
+
+    void render(jack_nframes_t frames);
+
+    AudioIOCallback & m_callback;
+    size_t m_numChannels;
+    float m_sampleRate;
+    size_t m_framesPerBuffer;
+
+    jack_client_t * m_client = nullptr;
+    std::vector<jack_port_t *> m_ports;
+    unsigned m_serverSampleRate = 0;
+    bool m_active = false;
+
+    // The last quantum rendered, of which the frames from m_readPosition on are yet to be played.
+    AudioBus m_renderBus;
+    AudioBus m_inputBus;
+    size_t m_readPosition;
+
+    std::unique_ptr<DestinationResampler> m_resampler;
+
+    std::atomic<uint64_t> m_xruns{ 0 };
+};
+
+} // namespace lab
+
+#endif // __UNIX_JACK__
+
+#endif // AudioDestinationJack_h
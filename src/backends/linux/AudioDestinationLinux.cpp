@@ -3,6 +3,8 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "AudioDestinationLinux.h"
+#include "AudioDestinationAlsa.h"
+#include "AudioDestinationJack.h"
 #include "internal/VectorMath.h"
 
 #include "LabSound/core/AudioNode.h"
@@ -11,6 +13,9 @@
 
 #include <rtaudio/RtAudio.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace lab
 {
 
@@ -35,9 +40,30 @@ static int NumDefaultOutputChannels()
 const float kLowThreshold = -1.0f;
 const float kHighThreshold = 1.0f;
 
-AudioDestination * AudioDestination::MakePlatformAudioDestination(AudioIOCallback & callback, size_t numberOfOutputChannels, float sampleRate)
+AudioDestination * AudioDestination::MakePlatformAudioDestination(AudioIOCallback & callback, size_t numberOfOutputChannels, float sampleRate, size_t framesPerBuffer,
+                                                                   const AudioDeviceSettings & settings)
 {
-    return new AudioDestinationLinux(callback, numberOfOutputChannels, sampleRate);
+    // The native backends are built along with RtAudio's API of the same name, and fall back on RtAudio.
+    if (settings.backend == AudioDeviceSettings::Backend::Alsa)
+    {
+#if defined(__LINUX_ALSA__)
+        if (std::unique_ptr<AudioDestinationAlsa> alsa = AudioDestinationAlsa::open(callback, numberOfOutputChannels, sampleRate, framesPerBuffer, settings))
+            return alsa.release();
+#else
+        LOG_ERROR("LabSound wasn't built for ALSA; LABSOUND_ASOUND selects it");
+#endif
+    }
+    else if (settings.backend == AudioDeviceSettings::Backend::Jack)
+    {
+#if defined(__UNIX_JACK__)
+        if (std::unique_ptr<AudioDestinationJack> jack = AudioDestinationJack::open(callback, numberOfOutputChannels, sampleRate, framesPerBuffer, settings))
+            return jack.release();
+#else
+        LOG_ERROR("LabSound wasn't built for JACK; LABSOUND_JACK selects it");
+#endif
+    }
+
+    return new AudioDestinationLinux(callback, numberOfOutputChannels, sampleRate, framesPerBuffer, settings);
 }
 
 unsigned long AudioDestination::maxChannelCount()
@@ -45,15 +71,16 @@ unsigned long AudioDestination::maxChannelCount()
     return NumDefaultOutputChannels();
 }
 
-AudioDestinationLinux::AudioDestinationLinux(AudioIOCallback & callback, size_t numChannels, float sampleRate)
+AudioDestinationLinux::AudioDestinationLinux(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings)
 : m_callback(callback)
-, m_renderBus(numChannels, AudioNode::ProcessingSizeInFrames, false)
-, m_inputBus(1, AudioNode::ProcessingSizeInFrames, false)
+, m_framesPerBuffer(framesPerBuffer)
+, m_renderBus(numChannels, framesPerBuffer, false)
+, m_inputBus(1, framesPerBuffer, false)
 {
     m_numChannels = numChannels;
     m_sampleRate = sampleRate;
     m_renderBus.setSampleRate(m_sampleRate);
-    configure();
+    configure(settings);
 }
 
 AudioDestinationLinux::~AudioDestinationLinux()
@@ -62,7 +89,7 @@ AudioDestinationLinux::~AudioDestinationLinux()
         dac.closeStream();
 }
 
-void AudioDestinationLinux::configure()
+void AudioDestinationLinux::configure(const AudioDeviceSettings & settings)
 {
     if (dac.getDeviceCount() < 1)
     {
@@ -77,7 +104,7 @@ void AudioDestinationLinux::configure()
     outputParams.firstChannel = 0;
 
     auto outDeviceInfo = dac.getDeviceInfo(outputParams.deviceId);
-    LOG("Using Default Audio Device: %s", deviceInfo.name.c_str());
+    LOG("Using Default Audio Device: %s", outDeviceInfo.name.c_str());
 
     RtAudio::StreamParameters inputParams;
     inputParams.deviceId = dac.getDefaultInputDevice();
@@ -86,7 +113,19 @@ void AudioDestinationLinux::configure()
 
     auto inDeviceInfo = dac.getDeviceInfo(outputParams.deviceId);
 
-    unsigned int bufferFrames = AudioNode::ProcessingSizeInFrames;
+    // The graph renders at its own rate. If the device can't run at it, the device runs at its preferred rate and
+    // the graph is resampled to that.
+    unsigned int deviceSampleRate = static_cast<unsigned int>(m_sampleRate);
+    const std::vector<unsigned int> & supportedSampleRates = outDeviceInfo.sampleRates;
+    if (!supportedSampleRates.empty() && std::find(supportedSampleRates.begin(), supportedSampleRates.end(), deviceSampleRate) == supportedSampleRates.end())
+    {
+        deviceSampleRate = outDeviceInfo.preferredSampleRate ? outDeviceInfo.preferredSampleRate : supportedSampleRates.back();
+        LOG("Resampling from %f Hz to the device's %u Hz", m_sampleRate, deviceSampleRate);
+        m_resampler.reset(new DestinationResampler(m_callback, static_cast<unsigned>(m_numChannels), m_sampleRate, static_cast<float>(deviceSampleRate), m_framesPerBuffer));
+        m_renderBus.setSampleRate(static_cast<float>(deviceSampleRate));
+    }
+
+    unsigned int bufferFrames = static_cast<unsigned int>(m_framesPerBuffer);
 
     RtAudio::StreamOptions options;
     options.flags |= RTAUDIO_NONINTERLEAVED;
@@ -96,12 +135,53 @@ void AudioDestinationLinux::configure()
         dac.openStream(outDeviceInfo.probed ? &outputParams : nullptr, 
                        inDeviceInfo.probed ? &inputParams : nullptr, 
             RTAUDIO_FLOAT32, 
-            (unsigned int) m_sampleRate, &bufferFrames, &outputCallback, this, &options);
+            deviceSampleRate, &bufferFrames, &outputCallback, this, &options);
+
+        // A buffer of whole quanta is rendered in place. If the device took another size, it's asked for the
+        // nearest multiple of the quantum before settling for what it offers.
+        if (bufferFrames % m_framesPerBuffer)
+        {
+            unsigned int wholeQuanta = static_cast<unsigned int>(std::max<size_t>(1, (bufferFrames + m_framesPerBuffer / 2) / m_framesPerBuffer) * m_framesPerBuffer);
+            dac.closeStream();
+            dac.openStream(outDeviceInfo.probed ? &outputParams : nullptr,
+                           inDeviceInfo.probed ? &inputParams : nullptr,
+                RTAUDIO_FLOAT32,
+                deviceSampleRate, &wholeQuanta, &outputCallback, this, &options);
+            bufferFrames = wholeQuanta;
+        }
+
+        m_streamLatency = static_cast<double>(dac.getStreamLatency()) / deviceSampleRate;
     }
     catch (RtAudioError & e)
     {
         e.printMessage();
     }
+
+    if (!m_resampler)
+    {
+        m_quantizer.reset(new DestinationQuantizer(m_callback, static_cast<unsigned>(m_numChannels), inDeviceInfo.probed ? 1u : 0u, m_framesPerBuffer, bufferFrames));
+        if (!m_quantizer->inPlace())
+        {
+            LOG("The device's buffer of %u frames isn't a multiple of the render quantum; rendering a quantum ahead", bufferFrames);
+        }
+    }
+}
+
+double AudioDestinationLinux::baseLatency() const
+{
+    if (m_resampler)
+        return m_resampler->latency();
+    return m_quantizer ? m_quantizer->latencyFrames() / static_cast<double>(m_sampleRate) : 0;
+}
+
+double AudioDestinationLinux::inputLatency() const
+{
+    return m_quantizer ? m_quantizer->inputLatencyFrames() / static_cast<double>(m_sampleRate) : 0;
+}
+
+double AudioDestinationLinux::roundTripLatency() const
+{
+    return m_streamLatency + inputLatency() + baseLatency();
 }
 
 void AudioDestinationLinux::start()
@@ -134,22 +214,25 @@ void AudioDestinationLinux::render(int numberOfFrames, void * outputBuffer, void
     float *myOutputBufferOfFloats = (float*) outputBuffer;
     float *myInputBufferOfFloats = (float*) inputBuffer;
 
-    // Inform bus to use an externally allocated buffer from rtaudio
-    if (m_renderBus.isFirstTime())
+    // Any channel the graph leaves alone plays silence.
+    std::memset(myOutputBufferOfFloats, 0, sizeof(float) * numberOfFrames * m_numChannels);
+
+    // The buses are pointed at RtAudio's buffers for each callback, as the buffers' size may change.
+    for (uint32_t i = 0; i < m_numChannels; ++i)
     {
-        for (uint32_t i = 0; i < m_numChannels; ++i)
-        {
-            m_renderBus.setChannelMemory(i, myOutputBufferOfFloats + i * numberOfFrames, numberOfFrames);
-        }
+        m_renderBus.setChannelMemory(i, myOutputBufferOfFloats + i * numberOfFrames, numberOfFrames);
     }
 
-    if (m_inputBus.isFirstTime())
+    if (myInputBufferOfFloats)
     {
         m_inputBus.setChannelMemory(0, myInputBufferOfFloats, numberOfFrames);
     }
 
     // Source Bus :: Destination Bus
-    m_callback.render(&m_inputBus, &m_renderBus, numberOfFrames);
+    if (m_resampler)
+        m_resampler->render(nullptr, &m_renderBus, numberOfFrames);
+    else if (m_quantizer)
+        m_quantizer->render(myInputBufferOfFloats ? &m_inputBus : nullptr, &m_renderBus, numberOfFrames);
 
     // Clamp values at 0db (i.e., [-1.0, 1.0])
     for (unsigned i = 0; i < m_renderBus.numberOfChannels(); ++i)
@@ -163,12 +246,12 @@ int outputCallback(void * outputBuffer, void * inputBuffer, unsigned int nBuffer
 {
     float *fBufOut = (float*) outputBuffer;
 
-    // Buffer is nBufferFrames * channels
-    // NB: channel count should be set in a principled way
-    memset(fBufOut, 0, sizeof(float) * nBufferFrames * 2);
-
     AudioDestinationLinux * audioDestination = static_cast<AudioDestinationLinux*>(userData);
 
+    // RtAudio flags an under or overflow since the last callback.
+    if (status)
+        audioDestination->reportXrun();
+
     audioDestination->render(nBufferFrames, fBufOut, inputBuffer);
 
     return 0;
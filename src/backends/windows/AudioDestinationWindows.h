@@ -7,8 +7,11 @@
 
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioDeviceSettings.h"
 
 #include "internal/AudioDestination.h"
+#include "internal/DestinationQuantizer.h"
+#include "internal/DestinationResampler.h"
 
 #include "rtaudio/RtAudio.h"
 #include <iostream>
@@ -22,24 +25,37 @@ class AudioDestinationWin : public AudioDestination
 
 public:
 
-    AudioDestinationWin(AudioIOCallback &, size_t numChannels, float sampleRate);
+    AudioDestinationWin(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings);
     virtual ~AudioDestinationWin();
 
     virtual void start() override;
     virtual void stop() override;
 
     float sampleRate() const override { return m_sampleRate; }
+    double baseLatency() const override;
+    double inputLatency() const override;
+    double roundTripLatency() const override;
 
     void render(int numberOfFrames, void * outputBuffer, void * inputBuffer);
+    void reportXrun() { m_callback.reportXrun(); }
 
 private:
-    void configure();
+    void configure(const AudioDeviceSettings & settings);
 
     AudioIOCallback & m_callback;
+    size_t m_framesPerBuffer;
     AudioBus m_renderBus = {2, AudioNode::ProcessingSizeInFrames, false};
     std::unique_ptr<AudioBus> m_inputBus;
     size_t m_numChannels;
     float m_sampleRate;
+    // Converts the graph's rate to the device's, when the device can't run at the graph's.
+    std::unique_ptr<DestinationResampler> m_resampler;
+
+    // Splits the device's buffers into render quanta, when the graph isn't resampled.
+    std::unique_ptr<DestinationQuantizer> m_quantizer;
+
+    // The seconds RtAudio reports its stream buffers, input and output together.
+    double m_streamLatency = 0;
     RtAudio dac;
 };
 
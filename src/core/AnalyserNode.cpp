@@ -4,6 +4,7 @@
 
 #include "LabSound/core/AnalyserNode.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
@@ -17,6 +18,7 @@ void AnalyserNode::shared_construction(size_t fftSize)
     _minDecibels = std::make_shared<AudioSetting>("minDecibels");
     _maxDecibels = std::make_shared<AudioSetting>("maxDecibels");
     _smoothingTimeConstant = std::make_shared<AudioSetting>("smoothingTimeConstant");
+    _analysisHop = std::make_shared<AudioSetting>("analysisHop");
 
     _fftSize->setUint32(static_cast<uint32_t>(fftSize));
     _fftSize->setValueChanged(
@@ -27,6 +29,8 @@ void AnalyserNode::shared_construction(size_t fftSize)
             // restore other values
             m_analyser->setMinDecibels(_minDecibels->valueFloat());
             m_analyser->setMaxDecibels(_maxDecibels->valueFloat());
+            m_analyser->setSmoothingTimeConstant(_smoothingTimeConstant->valueFloat());
+            m_analyser->setAnalysisHop(_analysisHop->valueUint32());
         });
 
     _minDecibels->setFloat(-100.f);
@@ -47,10 +51,17 @@ void AnalyserNode::shared_construction(size_t fftSize)
             m_analyser->setSmoothingTimeConstant(_smoothingTimeConstant->valueFloat());
         });
 
+    _analysisHop->setUint32(RealtimeAnalyser::DefaultAnalysisHop);
+    _analysisHop->setValueChanged(
+        [this]() {
+            m_analyser->setAnalysisHop(_analysisHop->valueUint32());
+        });
+
     m_settings.push_back(_fftSize);
     m_settings.push_back(_minDecibels);
     m_settings.push_back(_maxDecibels);
     m_settings.push_back(_smoothingTimeConstant);
+    m_settings.push_back(_analysisHop);
 
     // N.B.: inputs and outputs added by AudioBasicInspectorNode... no need to create here.
     initialize();
@@ -87,6 +98,10 @@ void AnalyserNode::setSmoothingTimeConstant(double k) {
     _smoothingTimeConstant->setFloat(static_cast<float>(k)); }
 double AnalyserNode::smoothingTimeConstant() const {
     return m_analyser->smoothingTimeConstant(); }
+void AnalyserNode::setAnalysisHop(uint32_t frames) {
+    _analysisHop->setUint32(frames); }
+uint32_t AnalyserNode::analysisHop() const {
+    return m_analyser->analysisHop(); }
 void AnalyserNode::setFftSize(ContextRenderLock&, size_t sz) {
     _fftSize->setUint32(static_cast<uint32_t>(sz)); }
 
@@ -113,6 +128,13 @@ void AnalyserNode::process(ContextRenderLock& r, size_t framesToProcess)
     }
 }
 
+void AnalyserNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioBasicInspectorNode::reportMemory(r, usage);
+    if (m_analyser)
+        usage.add(AudioMemoryCategory::Analysis, m_analyser->memoryBytes());
+}
+
 void AnalyserNode::reset(ContextRenderLock&)
 {
     m_analyser->reset();
@@ -0,0 +1,18 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AttachedAudioDestinationNode.h"
+
+namespace lab {
+
+AttachedAudioDestinationNode::AttachedAudioDestinationNode(AudioContext * context, size_t channelCount, float sampleRate)
+    : AudioDestinationNode(context, channelCount, sampleRate)
+{
+}
+
+AttachedAudioDestinationNode::~AttachedAudioDestinationNode()
+{
+    uninitialize();
+}
+
+} // namespace lab
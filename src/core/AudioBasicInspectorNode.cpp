@@ -17,13 +17,16 @@ AudioBasicInspectorNode::AudioBasicInspectorNode(int outputChannelCount) : Audio
     initialize();
 }
 
-// We override pullInputs() as an optimization allowing this node to take advantage of in-place processing,
-// where the input is simply passed through unprocessed to the output.
-// Note: this only applies if the input and output channel counts match.
+// The input is rendered into the bus of the output feeding it, or its summing bus, and that bus becomes this node's
+// output; process() then finds its input and output buses the same, and has nothing to copy.
 void AudioBasicInspectorNode::pullInputs(ContextRenderLock& r, size_t framesToProcess)
 {
-    // Render input stream - try to render directly into output bus for pass-through processing where process() doesn't need to do anything...
-    input(0)->pull(r, output(0)->bus(r), framesToProcess);
+    AudioBus * bus = input(0)->pull(r, nullptr, framesToProcess);
+
+    // A ramp would scale the bus in place, and it belongs to the node that fed it.
+    auto out = output(0);
+    if (bus && rampsSettled() && bus->numberOfChannels() == out->numberOfChannels() && bus->length() >= framesToProcess)
+        out->setRenderedBus(r, bus);
 }
 
 void AudioBasicInspectorNode::checkNumberOfChannelsForInput(ContextRenderLock& r, AudioNodeInput* input)
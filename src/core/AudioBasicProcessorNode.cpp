@@ -3,13 +3,19 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/AudioBasicProcessorNode.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioProcessor.h"
 #include "LabSound/core/AudioBus.h"
 
+#include "LabSound/extended/AudioContextLock.h"
+
 #include "internal/Assertions.h"
 
+#include <algorithm>
+
 namespace lab {
 
 AudioBasicProcessorNode::AudioBasicProcessorNode() : AudioNode()
@@ -105,11 +111,35 @@ void AudioBasicProcessorNode::checkNumberOfChannelsForInput(ContextRenderLock& r
     AudioNode::checkNumberOfChannelsForInput(r, input);
 }
 
+void AudioBasicProcessorNode::prepare(AudioContext & context, size_t inputChannels)
+{
+    AudioNode::prepare(context, inputChannels);
+
+    const size_t channels = inputChannels ? std::min(channelsForInput(inputChannels), context.channelLimit()) : 0;
+    if (!channels || !processor() || channels == output(0)->numberOfChannels())
+        return;
+
+    processor()->setNumberOfChannels(channels);
+    uninitialize();
+    initialize();
+
+    ContextRenderLock r(&context, "AudioBasicProcessorNode::prepare");
+    for (unsigned int i = 0; i < numberOfOutputs(); ++i)
+        output(i)->setNumberOfChannels(r, channels);
+}
+
 size_t AudioBasicProcessorNode::numberOfChannels()
 {
     return output(0)->numberOfChannels();
 }
 
+void AudioBasicProcessorNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioNode::reportMemory(r, usage);
+    if (m_processor)
+        m_processor->reportMemory(usage);
+}
+
 double AudioBasicProcessorNode::tailTime(ContextRenderLock & r) const
 {
     return m_processor->tailTime(r);
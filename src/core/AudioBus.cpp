@@ -3,40 +3,343 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/AudioBus.h"
+#include "internal/AudioChannelArena.h"
 #include "internal/DenormalDisabler.h"
-#include "internal/SincResampler.h"
+#include "internal/MultiChannelResampler.h"
 #include "internal/VectorMath.h"
 #include "internal/Assertions.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <cmath>
+#include <cstring>
 #include <math.h>
 
 namespace lab {
 
 using namespace VectorMath;
 
-const unsigned MaxBusChannels = 32;
+namespace {
 
-AudioBus::AudioBus(size_t numberOfChannels, size_t length, bool allocate) : m_length(length)
+    enum class MixMode { Copy, Sum };
+
+    // Mixing kernels for the common channel layouts, with the counts known at compile time so that each one is a
+    // single loop over the frames, reading every source channel and writing every destination channel once per
+    // frame. The independent channel streams then vectorize and pipeline together, where mixing a channel at a
+    // time would reread the destination once per source channel. When copying, a destination starts from zero,
+    // so both modes round the same as the per channel operations they replace.
+    template <size_t Sources, size_t Destinations, MixMode Mode>
+    struct SpeakerMix;
+
+    template <MixMode Mode>
+    struct SpeakerMix<1, 1, Mode>
+    {
+        static void run(const float * const * source, float * const * destination, size_t frames)
+        {
+            const float * s = source[0];
+            float * d = destination[0];
+            for (size_t i = 0; i < frames; ++i)
+                d[i] = (Mode == MixMode::Sum ? d[i] : 0.f) + s[i];
+        }
+    };
+
+    template <MixMode Mode>
+    struct SpeakerMix<2, 2, Mode>
+    {
+        static void run(const float * const * source, float * const * destination, size_t frames)
+        {
+            const float * sl = source[0];
+            const float * sr = source[1];
+            float * dl = destination[0];
+            float * dr = destination[1];
+            for (size_t i = 0; i < frames; ++i)
+            {
+                const float l = sl[i];
+                const float r = sr[i];
+                dl[i] = (Mode == MixMode::Sum ? dl[i] : 0.f) + l;
+                dr[i] = (Mode == MixMode::Sum ? dr[i] : 0.f) + r;
+            }
+        }
+    };
+
+    // Mono to stereo, into both left and right.
+    template <MixMode Mode>
+    struct SpeakerMix<1, 2, Mode>
+    {
+        static void run(const float * const * source, float * const * destination, size_t frames)
+        {
+            const float * s = source[0];
+            float * dl = destination[0];
+            float * dr = destination[1];
+            for (size_t i = 0; i < frames; ++i)
+            {
+                const float m = s[i];
+                dl[i] = (Mode == MixMode::Sum ? dl[i] : 0.f) + m;
+                dr[i] = (Mode == MixMode::Sum ? dr[i] : 0.f) + m;
+            }
+        }
+    };
+
+    // Stereo to mono, output += 0.5 * (input.L + input.R).
+    template <MixMode Mode>
+    struct SpeakerMix<2, 1, Mode>
+    {
+        static void run(const float * const * source, float * const * destination, size_t frames)
+        {
+            const float * sl = source[0];
+            const float * sr = source[1];
+            float * d = destination[0];
+            for (size_t i = 0; i < frames; ++i)
+            {
+                float v = Mode == MixMode::Sum ? d[i] : 0.f;
+                v += 0.5f * sl[i];
+                v += 0.5f * sr[i];
+                d[i] = v;
+            }
+        }
+    };
+
+    typedef void (*MixKernel)(const float * const * source, float * const * destination, size_t frames);
+
+    // The other speaker mixes, a row of gains per destination channel and a column per source channel, following
+    // the Web Audio API's mixing rules. 7.1, which they don't cover, folds its back channels in like the
+    // surrounds.
+    typedef float SpeakerGains[MaxMixChannels][MaxMixChannels];
+
+    const float Minus3dB = 0.7071f;
+
+    const SpeakerGains s_monoToQuad = { { 1 }, { 1 } };
+    const SpeakerGains s_monoToCenter = { {}, {}, { 1 } };
+    const SpeakerGains s_stereoToSurround = { { 1 }, { 0, 1 } };
+    const SpeakerGains s_quadToSurround = { { 1 }, { 0, 1 }, {}, {}, { 0, 0, 1 }, { 0, 0, 0, 1 } };
+    const SpeakerGains s_5_1To7_1 = { { 1 }, { 0, 1 }, { 0, 0, 1 }, { 0, 0, 0, 1 }, { 0, 0, 0, 0, 1 }, { 0, 0, 0, 0, 0, 1 } };
+
+    const SpeakerGains s_quadToMono = { { 0.25f, 0.25f, 0.25f, 0.25f } };
+    const SpeakerGains s_quadToStereo = { { 0.5f, 0, 0.5f }, { 0, 0.5f, 0, 0.5f } };
+    const SpeakerGains s_5_1ToMono = { { Minus3dB, Minus3dB, 1, 0, 0.5f, 0.5f } };
+    const SpeakerGains s_5_1ToStereo = { { 1, 0, Minus3dB, 0, Minus3dB }, { 0, 1, Minus3dB, 0, 0, Minus3dB } };
+    const SpeakerGains s_5_1ToQuad = { { 1, 0, Minus3dB }, { 0, 1, Minus3dB }, { 0, 0, 0, 0, 1 }, { 0, 0, 0, 0, 0, 1 } };
+    const SpeakerGains s_7_1ToMono = { { Minus3dB, Minus3dB, 1, 0, 0.5f, 0.5f, 0.5f, 0.5f } };
+    const SpeakerGains s_7_1ToStereo = { { 1, 0, Minus3dB, 0, Minus3dB, 0, Minus3dB }, { 0, 1, Minus3dB, 0, 0, Minus3dB, 0, Minus3dB } };
+    const SpeakerGains s_7_1ToQuad = { { 1, 0, Minus3dB }, { 0, 1, Minus3dB }, { 0, 0, 0, 0, 1, 0, Minus3dB }, { 0, 0, 0, 0, 0, 1, 0, Minus3dB } };
+    const SpeakerGains s_7_1To5_1 = { { 1 }, { 0, 1 }, { 0, 0, 1 }, { 0, 0, 0, 1 }, { 0, 0, 0, 0, 1, 0, Minus3dB }, { 0, 0, 0, 0, 0, 1, 0, Minus3dB } };
+
+    struct MixLayout
+    {
+        size_t sources;
+        size_t destinations;
+        MixKernel copy;
+        MixKernel sum;
+        const SpeakerGains * gains;
+    };
+
+#define LABSOUND_MIX_KERNEL(S, D) { S, D, &SpeakerMix<S, D, MixMode::Copy>::run, &SpeakerMix<S, D, MixMode::Sum>::run, nullptr }
+#define LABSOUND_MIX_GAINS(S, D, GAINS) { S, D, nullptr, nullptr, &GAINS }
+
+    // Equal counts mix the same under either interpretation; the others are speaker mixes. 5.0 isn't a layout
+    // of Channel, so it mixes discretely.
+    const MixLayout s_mixLayouts[] = {
+        LABSOUND_MIX_KERNEL(2, 2),
+        LABSOUND_MIX_KERNEL(1, 2),
+        LABSOUND_MIX_KERNEL(1, 1),
+        LABSOUND_MIX_KERNEL(2, 1),
+        LABSOUND_MIX_GAINS(8, 2, s_7_1ToStereo),
+        LABSOUND_MIX_GAINS(6, 2, s_5_1ToStereo),
+        LABSOUND_MIX_GAINS(1, 4, s_monoToQuad),
+        LABSOUND_MIX_GAINS(1, 6, s_monoToCenter),
+        LABSOUND_MIX_GAINS(1, 8, s_monoToCenter),
+        LABSOUND_MIX_GAINS(2, 4, s_stereoToSurround),
+        LABSOUND_MIX_GAINS(2, 6, s_stereoToSurround),
+        LABSOUND_MIX_GAINS(2, 8, s_stereoToSurround),
+        LABSOUND_MIX_GAINS(4, 6, s_quadToSurround),
+        LABSOUND_MIX_GAINS(4, 8, s_quadToSurround),
+        LABSOUND_MIX_GAINS(6, 8, s_5_1To7_1),
+        LABSOUND_MIX_GAINS(4, 1, s_quadToMono),
+        LABSOUND_MIX_GAINS(4, 2, s_quadToStereo),
+        LABSOUND_MIX_GAINS(6, 1, s_5_1ToMono),
+        LABSOUND_MIX_GAINS(6, 4, s_5_1ToQuad),
+        LABSOUND_MIX_GAINS(8, 1, s_7_1ToMono),
+        LABSOUND_MIX_GAINS(8, 4, s_7_1ToQuad),
+        LABSOUND_MIX_GAINS(8, 6, s_7_1To5_1),
+    };
+
+#undef LABSOUND_MIX_KERNEL
+#undef LABSOUND_MIX_GAINS
+
+    // Mixes through gains with VectorMath::vmix(). Silent source channels are left out, and destination channels
+    // fed only by them are left alone, or zeroed when copying, so silence carries through.
+    void mixWithGains(const SpeakerGains & gains, const AudioBus & sourceBus, AudioBus & destinationBus, MixMode mode)
+    {
+        const size_t numberOfSourceChannels = sourceBus.numberOfChannels();
+        const size_t numberOfDestinationChannels = destinationBus.numberOfChannels();
+
+        const float * sources[MaxMixChannels];
+        size_t sourceChannels[MaxMixChannels];
+        size_t sourceCount = 0;
+        for (size_t i = 0; i < numberOfSourceChannels; ++i)
+        {
+            if (!sourceBus.channel(i)->isSilent())
+            {
+                sourceChannels[sourceCount] = i;
+                sources[sourceCount++] = sourceBus.channel(i)->data();
+            }
+        }
+
+        // Destinations into silence are written, the rest accumulated into.
+        float rows[MaxMixChannels][MaxMixChannels];
+        const float * writeGains[MaxMixChannels];
+        float * writes[MaxMixChannels];
+        size_t writeCount = 0;
+        const float * accumulateGains[MaxMixChannels];
+        float * accumulates[MaxMixChannels];
+        size_t accumulateCount = 0;
+
+        for (size_t d = 0; d < numberOfDestinationChannels; ++d)
+        {
+            bool fed = false;
+            for (size_t s = 0; s < sourceCount; ++s)
+            {
+                rows[d][s] = gains[d][sourceChannels[s]];
+                fed = fed || rows[d][s] != 0;
+            }
+
+            AudioChannel * channel = destinationBus.channel(d);
+            if (!fed)
+            {
+                if (mode == MixMode::Copy)
+                    channel->zero();
+            }
+            else if (mode == MixMode::Sum && !channel->isSilent())
+            {
+                accumulateGains[accumulateCount] = rows[d];
+                accumulates[accumulateCount++] = channel->mutableData();
+            }
+            else
+            {
+                writeGains[writeCount] = rows[d];
+                writes[writeCount++] = channel->mutableData();
+            }
+        }
+
+        const size_t frames = destinationBus.length();
+        if (writeCount)
+            vmix(sources, sourceCount, writeGains, writes, writeCount, false, frames);
+        if (accumulateCount)
+            vmix(sources, sourceCount, accumulateGains, accumulates, accumulateCount, true, frames);
+    }
+
+    // Mixes the source into the destination with a kernel or gains, if the layout has them. Returns false, leaving
+    // the destination untouched, when it doesn't, or when only some of the channels a kernel reads are silent; the
+    // per channel paths skip those instead.
+    bool mixWithKernel(const AudioBus & sourceBus, AudioBus & destinationBus, MixMode mode)
+    {
+        const size_t numberOfSourceChannels = sourceBus.numberOfChannels();
+        const size_t numberOfDestinationChannels = destinationBus.numberOfChannels();
+        const size_t frames = destinationBus.length();
+
+        const MixLayout * layout = nullptr;
+        for (const MixLayout & candidate : s_mixLayouts)
+        {
+            if (candidate.sources == numberOfSourceChannels && candidate.destinations == numberOfDestinationChannels)
+            {
+                layout = &candidate;
+                break;
+            }
+        }
+        if (!layout || sourceBus.length() < frames)
+            return false;
+
+        if (layout->gains)
+        {
+            mixWithGains(*layout->gains, sourceBus, destinationBus, mode);
+            return true;
+        }
+
+        size_t silentSources = 0;
+        for (size_t i = 0; i < numberOfSourceChannels; ++i)
+        {
+            if (sourceBus.channel(i)->isSilent())
+                ++silentSources;
+        }
+
+        if (silentSources == numberOfSourceChannels)
+        {
+            if (mode == MixMode::Copy)
+                destinationBus.zero();
+            return true;
+        }
+        if (silentSources)
+            return false;
+
+        // Summing into silence is copying.
+        if (mode == MixMode::Sum)
+        {
+            size_t silentDestinations = 0;
+            for (size_t i = 0; i < numberOfDestinationChannels; ++i)
+            {
+                if (destinationBus.channel(i)->isSilent())
+                    ++silentDestinations;
+            }
+
+            if (silentDestinations == numberOfDestinationChannels)
+                mode = MixMode::Copy;
+            else if (silentDestinations)
+                return false;
+        }
+
+        const float * source[MaxMixChannels];
+        float * destination[MaxMixChannels];
+        for (size_t i = 0; i < numberOfSourceChannels; ++i)
+            source[i] = sourceBus.channel(i)->data();
+        for (size_t i = 0; i < numberOfDestinationChannels; ++i)
+            destination[i] = destinationBus.channel(i)->mutableData();
+
+        (mode == MixMode::Copy ? layout->copy : layout->sum)(source, destination, frames);
+        return true;
+    }
+
+} // anonymous namespace
+
+AudioBus::AudioBus(size_t numberOfChannels, size_t length, bool allocate)
+    : m_length(length)
+    , m_channels(new AudioChannel[numberOfChannels])
+    , m_numberOfChannels(numberOfChannels)
 {
-    ASSERT(numberOfChannels <= MaxBusChannels);
-    if (numberOfChannels > MaxBusChannels) return;
+    if (!allocate)
+    {
+        for (size_t i = 0; i < numberOfChannels; ++i)
+            m_channels[i].set(nullptr, length);
+        return;
+    }
 
-    for (uint32_t i = 0; i < numberOfChannels; ++i) 
+    // One allocation for all the channels, each starting on a cache line, keeps a wide bus's channels together.
+    const size_t CacheLineFrames = 64 / sizeof(float);
+    m_channelStride = (length + CacheLineFrames - 1) / CacheLineFrames * CacheLineFrames;
+    const size_t frames = m_channelStride * numberOfChannels;
+    m_storage = AudioChannelArena::acquire(frames, m_pooledCapacity);
+    if (!m_storage && frames)
     {
-		AudioChannel * newChannel{ nullptr };
-        if (allocate) newChannel = new AudioChannel(length);
-        else newChannel = new AudioChannel(nullptr, length);
-        m_channels.emplace_back(std::unique_ptr<AudioChannel>(newChannel));
+        m_pooledCapacity = 0;
+        m_storageArray.reset(new AudioFloatArray(frames));
+        m_storage = m_storageArray->data();
     }
+
+    for (size_t i = 0; i < numberOfChannels; ++i)
+        m_channels[i].setBusStorage(m_storage ? m_storage + i * m_channelStride : nullptr, length);
+}
+
+AudioBus::~AudioBus()
+{
+    if (m_pooledCapacity)
+        AudioChannelArena::release(m_storage, m_pooledCapacity);
 }
 
 void AudioBus::setChannelMemory(size_t channelIndex, float * storage, size_t length)
 {
-    if (channelIndex < m_channels.size()) 
+    if (channelIndex < m_numberOfChannels)
     {
         channel(channelIndex)->set(storage, length);
+        m_channelStride = 0;
         m_length = length; // FIXME: verify that this length matches all the other channel lengths
     }
 }
@@ -49,17 +352,17 @@ void AudioBus::resizeSmaller(size_t newLength)
 		m_length = newLength;
 	}
 
-	for (size_t i = 0; i < m_channels.size(); ++i)
+	for (size_t i = 0; i < m_numberOfChannels; ++i)
 	{
-		m_channels[i]->resizeSmaller(newLength);
+		m_channels[i].resizeSmaller(newLength);
 	}
 }
 
 void AudioBus::zero()
 {
-	for (size_t i = 0; i < m_channels.size(); ++i)
+	for (size_t i = 0; i < m_numberOfChannels; ++i)
 	{
-		m_channels[i]->zero();
+		m_channels[i].zero();
 	}
 }
 
@@ -193,14 +496,58 @@ float AudioBus::maxAbsValue() const
     return max;
 }
 
+size_t AudioBus::memoryBytes() const
+{
+    size_t frames = m_pooledCapacity;
+    if (m_storageArray)
+        frames += m_storageArray->size();
+    if (m_dezipperGainValues)
+        frames += m_dezipperGainValues->size();
+
+    size_t bytes = frames * sizeof(float);
+    for (size_t i = 0; i < m_numberOfChannels; ++i)
+        bytes += m_channels[i].memoryBytes();
+    return bytes;
+}
+
 void AudioBus::normalize()
 {
     float max = maxAbsValue();
     if (max) scale(1.0f / max);
 }
 
+float AudioBusLoudness::normalizationGain(float targetLoudness, float peakCeiling) const
+{
+    if (!measured)
+        return 1.f;
+
+    float gain = std::isfinite(integratedLoudness) ? powf(10.f, (targetLoudness - integratedLoudness) / 20.f) : 1.f;
+    if (peak > 0)
+        gain = std::min(gain, peakCeiling / peak);
+    return gain;
+}
+
+size_t AudioBus::contiguousSpan() const
+{
+    if (!m_channelStride || !m_numberOfChannels)
+        return 0;
+
+    for (size_t i = 0; i < m_numberOfChannels; ++i)
+    {
+        if (m_channels[i].isSilent() || m_channels[i].data() != m_storage + i * m_channelStride)
+            return 0;
+    }
+    return (m_numberOfChannels - 1) * m_channelStride + m_length;
+}
+
 void AudioBus::scale(float scale)
 {
+    if (size_t span = contiguousSpan())
+    {
+        vsmul(m_storage, 1, &scale, m_storage, 1, span);
+        return;
+    }
+
 	for (size_t i = 0; i < numberOfChannels(); ++i)
 	{
 		channel(i)->scale(scale);
@@ -219,6 +566,19 @@ void AudioBus::copyFrom(const AudioBus& sourceBus, ChannelInterpretation channel
 
     if (numberOfDestinationChannels == numberOfSourceChannels) 
 	{
+        if (mixWithKernel(sourceBus, *this, MixMode::Copy))
+            return;
+
+        // Channels held in blocks of the same layout copy as one span.
+        const size_t span = sourceBus.contiguousSpan();
+        if (span && canOverwriteContiguously(sourceBus))
+        {
+            for (size_t i = 0; i < numberOfDestinationChannels; ++i)
+                m_channels[i].overwrittenData();
+            memcpy(m_storage, sourceBus.m_storage, sizeof(float) * span);
+            return;
+        }
+
 		for (size_t i = 0; i < numberOfSourceChannels; ++i)
 		{
 			channel(i)->copyFrom(sourceBus.channel(i));
@@ -238,13 +598,35 @@ void AudioBus::copyFrom(const AudioBus& sourceBus, ChannelInterpretation channel
 
 void AudioBus::sumFrom(const AudioBus &sourceBus, ChannelInterpretation channelInterpretation)
 {
-    if (&sourceBus == this) return;
+    // Summing silence leaves the destination as it is, however the channels would be mixed.
+    if (&sourceBus == this || sourceBus.isSilent()) return;
     
     size_t numberOfSourceChannels = sourceBus.numberOfChannels();
     size_t numberOfDestinationChannels = numberOfChannels();
 
     if (numberOfDestinationChannels == numberOfSourceChannels) 
     {
+        if (mixWithKernel(sourceBus, *this, MixMode::Sum))
+            return;
+
+        // Channels held in blocks of the same layout sum as one span, or copy as one into silence.
+        const size_t span = sourceBus.contiguousSpan();
+        if (span && canOverwriteContiguously(sourceBus))
+        {
+            if (span == contiguousSpan())
+            {
+                vadd(m_storage, 1, sourceBus.m_storage, 1, m_storage, 1, span);
+                return;
+            }
+            if (isSilent())
+            {
+                for (size_t i = 0; i < numberOfDestinationChannels; ++i)
+                    m_channels[i].overwrittenData();
+                memcpy(m_storage, sourceBus.m_storage, sizeof(float) * span);
+                return;
+            }
+        }
+
         for (size_t i = 0; i < numberOfSourceChannels; ++i)
         {
              channel(i)->sumFrom(sourceBus.channel(i));
@@ -264,8 +646,10 @@ void AudioBus::sumFrom(const AudioBus &sourceBus, ChannelInterpretation channelI
 
 void AudioBus::speakersCopyFrom(const AudioBus& sourceBus)
 {
-    // FIXME: Implement down mixing 5.1 to stereo.
-    // https://bugs.webkit.org/show_bug.cgi?id=79192
+    // Every pair of the layouts of Channel has a kernel or gains. The per channel paths below are for mono and
+    // stereo when only some of the channels involved are silent.
+    if (mixWithKernel(sourceBus, *this, MixMode::Copy))
+        return;
     
     const size_t numberOfSourceChannels = sourceBus.numberOfChannels();
     const size_t numberOfDestinationChannels = numberOfChannels();
@@ -290,40 +674,6 @@ void AudioBus::speakersCopyFrom(const AudioBus& sourceBus)
         vadd(sourceL, 1, sourceR, 1, destination, 1, length());
         float scale = 0.5;
         vsmul(destination, 1, &scale, destination, 1, length());
-    } 
-	else if (numberOfDestinationChannels == Channels::Surround_5_1 && numberOfSourceChannels == Channels::Mono) 
-	{
-        // Handle mono -> 5.1 case, copy mono channel to center.
-        channelByType(Channel::Center)->copyFrom(sourceBus.channel(0));
-        channelByType(Channel::Left)->zero();
-        channelByType(Channel::Right)->zero();
-        channelByType(Channel::LFE)->zero();
-        channelByType(Channel::SurroundLeft)->zero();
-        channelByType(Channel::SurroundRight)->zero();
-    } 
-	else if (numberOfDestinationChannels == Channels::Mono && numberOfSourceChannels == Channels::Surround_5_1) 
-	{
-        // Handle 5.1 -> mono case.
-        zero();
-        speakersSumFrom5_1_ToMono(sourceBus);
-    } 
-	else if (numberOfDestinationChannels == Channels::Surround_7_1 && numberOfSourceChannels == Channels::Mono) 
-	{
-        // Handle mono -> 7.1 case, copy mono channel to center.
-        channelByType(Channel::Center)->copyFrom(sourceBus.channel(0));
-        channelByType(Channel::Left)->zero();
-        channelByType(Channel::Right)->zero();
-        channelByType(Channel::LFE)->zero();
-        channelByType(Channel::SurroundLeft)->zero();
-        channelByType(Channel::SurroundRight)->zero();
-        channelByType(Channel::BackLeft)->zero();
-        channelByType(Channel::BackRight)->zero();
-    } 
-	else if (numberOfDestinationChannels == Channels::Mono && numberOfSourceChannels == Channels::Surround_7_1) 
-	{
-        // Handle 7.1 -> mono case.
-        zero();
-        speakersSumFrom7_1_ToMono(sourceBus);
     } 
 	else 
 	{
@@ -334,8 +684,8 @@ void AudioBus::speakersCopyFrom(const AudioBus& sourceBus)
 
 void AudioBus::speakersSumFrom(const AudioBus& sourceBus)
 {
-    // FIXME: Implement down mixing 5.1 && 7.1 to stereo.
-    // https://bugs.webkit.org/show_bug.cgi?id=79192
+    if (mixWithKernel(sourceBus, *this, MixMode::Sum))
+        return;
     
     const size_t numberOfSourceChannels = sourceBus.numberOfChannels();
     const size_t numberOfDestinationChannels = numberOfChannels();
@@ -359,26 +709,6 @@ void AudioBus::speakersSumFrom(const AudioBus& sourceBus)
         float scale = 0.5;
         vsma(sourceL, 1, &scale, destination, 1, length());
         vsma(sourceR, 1, &scale, destination, 1, length());
-    } 
-	else if (numberOfDestinationChannels == Channels::Surround_5_1 && numberOfSourceChannels == Channels::Mono) 
-	{
-        // Handle mono -> 5.1 case, sum mono channel into center.
-        channelByType(Channel::Center)->sumFrom(sourceBus.channel(0));
-    } 
-	else if (numberOfDestinationChannels == Channels::Mono && numberOfSourceChannels == Channels::Surround_5_1) 
-	{
-        // Handle 5.1 -> mono case.
-        speakersSumFrom5_1_ToMono(sourceBus);
-    } 
-	else if (numberOfDestinationChannels == Channels::Surround_7_1 && numberOfSourceChannels == Channels::Mono) 
-	{
-        // Handle mono -> 7.1 case, sum mono channel into center.
-        channelByType(Channel::Center)->sumFrom(sourceBus.channel(0));
-    } 
-	else if (numberOfDestinationChannels == Channels::Mono && numberOfSourceChannels == Channels::Surround_7_1) 
-	{
-        // Handle 7.1 -> mono case.
-        speakersSumFrom7_1_ToMono(sourceBus);
     } 
 	else 
 	{
@@ -387,76 +717,6 @@ void AudioBus::speakersSumFrom(const AudioBus& sourceBus)
     }
 }
 
-void AudioBus::speakersSumFrom5_1_ToMono(const AudioBus& sourceBus)
-{
-    AudioBus& sourceBusSafe = const_cast<AudioBus&>(sourceBus);
-    
-    const float * sourceL = sourceBusSafe.channelByType(Channel::Left)->data();
-    const float * sourceR = sourceBusSafe.channelByType(Channel::Right)->data();
-    const float * sourceC = sourceBusSafe.channelByType(Channel::Center)->data();
-    const float * sourceSL = sourceBusSafe.channelByType(Channel::SurroundLeft)->data();
-    const float * sourceSR = sourceBusSafe.channelByType(Channel::SurroundRight)->data();
-    
-    float * destination = channelByType(Channel::Left)->mutableData();
-    
-    AudioFloatArray temp(length());
-    float * tempData = temp.data();
-    
-    // Sum in L and R.
-    vadd(sourceL, 1, sourceR, 1, tempData, 1, length());
-    float scale = 0.7071f;
-    vsmul(tempData, 1, &scale, tempData, 1, length());
-    vadd(tempData, 1, destination, 1, destination, 1, length());
-    
-    // Sum in SL and SR.
-    vadd(sourceSL, 1, sourceSR, 1, tempData, 1, length());
-    scale = 0.5;
-    vsmul(tempData, 1, &scale, tempData, 1, length());
-    vadd(tempData, 1, destination, 1, destination, 1, length());
-    
-    // Sum in center.
-    vadd(sourceC, 1, destination, 1, destination, 1, length());
-}
-
-void AudioBus::speakersSumFrom7_1_ToMono(const AudioBus& sourceBus)
-{
-    AudioBus& sourceBusSafe = const_cast<AudioBus&>(sourceBus);
-    
-    const float * sourceL = sourceBusSafe.channelByType(Channel::Left)->data();
-    const float * sourceR = sourceBusSafe.channelByType(Channel::Right)->data();
-    const float * sourceC = sourceBusSafe.channelByType(Channel::Center)->data();
-    const float * sourceSL = sourceBusSafe.channelByType(Channel::SurroundLeft)->data();
-    const float * sourceSR = sourceBusSafe.channelByType(Channel::SurroundRight)->data();
-    const float * sourceBL = sourceBusSafe.channelByType(Channel::BackLeft)->data();
-    const float * sourceBR = sourceBusSafe.channelByType(Channel::BackRight)->data();
-    
-    float * destination = channelByType(Channel::Left)->mutableData();
-    
-    AudioFloatArray temp(length());
-    float * tempData = temp.data();
-    
-    // Sum in L and R.
-    vadd(sourceL, 1, sourceR, 1, tempData, 1, length());
-    float scale = 0.7071f;
-    vsmul(tempData, 1, &scale, tempData, 1, length());
-    vadd(tempData, 1, destination, 1, destination, 1, length());
-    
-    // Sum in SL and SR.
-    vadd(sourceSL, 1, sourceSR, 1, tempData, 1, length());
-    scale = 0.5;
-    vsmul(tempData, 1, &scale, tempData, 1, length());
-    vadd(tempData, 1, destination, 1, destination, 1, length());
-    
-    // Sum in BL and BR.
-    vadd(sourceBL, 1, sourceBR, 1, tempData, 1, length());
-    scale = 0.5;
-    vsmul(tempData, 1, &scale, tempData, 1, length());
-    vadd(tempData, 1, destination, 1, destination, 1, length());
-    
-    // Sum in center.
-    vadd(sourceC, 1, destination, 1, destination, 1, length());
-}
-
 void AudioBus::discreteCopyFrom(const AudioBus & sourceBus)
 {
     const size_t numberOfSourceChannels = sourceBus.numberOfChannels();
@@ -523,9 +783,7 @@ void AudioBus::copyWithGainFrom(const AudioBus & sourceBus, float * lastMixGain,
         return;
     }
 
-    const size_t numberOfChannels = m_channels.size();
-    ASSERT(numberOfChannels <= MaxBusChannels);
-	if (numberOfChannels > MaxBusChannels) return;
+    const size_t numberOfChannels = m_numberOfChannels;
 
     // If it is copying from the same bus and no need to change gain, just return.
 	if (this == &sourceBus && *lastMixGain == targetGain && targetGain == 1)
@@ -533,16 +791,6 @@ void AudioBus::copyWithGainFrom(const AudioBus & sourceBus, float * lastMixGain,
 		return;
 	}
 
-    AudioBus & sourceBusSafe = const_cast<AudioBus&>(sourceBus);
-    const float * sources[MaxBusChannels];
-    float * destinations[MaxBusChannels];
-
-    for (uint32_t i = 0; i < numberOfChannels; ++i) 
-    {
-        sources[i] = sourceBusSafe.channel(i)->data();
-        destinations[i] = channel(i)->mutableData();
-    }
-
     // We don't want to suddenly change the gain from mixing one time slice to the next,
     // so we "de-zipper" by slowly changing the gain each sample-frame until we've achieved the target gain.
     
@@ -583,27 +831,34 @@ void AudioBus::copyWithGainFrom(const AudioBus & sourceBus, float * lastMixGain,
             gain = DenormalDisabler::flushDenormalFloatToZero(gain);
             *gainValues++ = gain;
         }
-
-        for (uint32_t channelIndex = 0; channelIndex < numberOfChannels; ++channelIndex) 
-        {
-            vmul(sources[channelIndex], 1, m_dezipperGainValues->data(), 1, destinations[channelIndex], 1, framesToDezipper);
-            sources[channelIndex] += framesToDezipper;
-            destinations[channelIndex] += framesToDezipper;
-        }
     } 
     else
     {
         gain = totalDesiredGain;
     }
-        
 
-    // Apply constant gain after de-zippering has converged on target gain.
-    if (framesToDezipper < framesToProcess) 
+    // At a constant gain, channels held in blocks of the same layout scale as one span.
+    const size_t span = framesToDezipper ? 0 : sourceBus.contiguousSpan();
+    if (span && canOverwriteContiguously(sourceBus))
     {
         for (size_t channelIndex = 0; channelIndex < numberOfChannels; ++channelIndex)
-        {
-            vsmul(sources[channelIndex], 1, &gain, destinations[channelIndex], 1, framesToProcess - framesToDezipper);
-        }        
+            m_channels[channelIndex].overwrittenData();
+        vsmul(sourceBus.m_storage, 1, &gain, m_storage, 1, span);
+        *lastMixGain = gain;
+        return;
+    }
+
+    for (size_t channelIndex = 0; channelIndex < numberOfChannels; ++channelIndex)
+    {
+        const float * source = sourceBus.channel(channelIndex)->data();
+        float * destination = channel(channelIndex)->mutableData();
+
+        if (framesToDezipper)
+            vmul(source, 1, m_dezipperGainValues->data(), 1, destination, 1, framesToDezipper);
+
+        // Apply constant gain after de-zippering has converged on target gain.
+        if (framesToDezipper < framesToProcess)
+            vsmul(source + framesToDezipper, 1, &gain, destination + framesToDezipper, 1, framesToProcess - framesToDezipper);
     }
 
     // Save the target gain as the starting point for next time around.
@@ -702,21 +957,30 @@ std::unique_ptr<AudioBus> AudioBus::createBySampleRateConverting(const AudioBus*
     size_t numberOfDestinationChannels = resamplerSourceBus->numberOfChannels();
     std::unique_ptr<AudioBus> destinationBus(new AudioBus(numberOfDestinationChannels, destinationLength));
 
-    // Sample-rate convert each channel.
-    for (size_t i = 0; i < numberOfDestinationChannels; ++i) 
-	{
-        const float* source = resamplerSourceBus->channel(i)->data();
-        float* destination = destinationBus->channel(i)->mutableData();
-
-        SincResampler resampler(sampleRateRatio);
-        resampler.process(source, destination, sourceLength);
-    }
+    // Sample-rate convert the channels, a long bus in ranges on several threads.
+    MultiChannelResampler::convert(*resamplerSourceBus, *destinationBus, sampleRateRatio);
 
     destinationBus->clearSilentFlag();
     destinationBus->setSampleRate(newSampleRate);    
     return destinationBus;
 }
 
+const float * AudioBus::monoMixGains(size_t numberOfChannels)
+{
+    static const float monoGains[] = { 1 };
+    static const float stereoGains[] = { 0.5f, 0.5f };
+
+    switch (numberOfChannels)
+    {
+        case 1: return monoGains;
+        case 2: return stereoGains;
+        case 4: return s_quadToMono[0];
+        case 6: return s_5_1ToMono[0];
+        case 8: return s_7_1ToMono[0];
+        default: return nullptr;
+    }
+}
+
 std::unique_ptr<AudioBus> AudioBus::createByMixingToMono(const AudioBus* sourceBus)
 {
 	if (sourceBus->isSilent())
@@ -764,9 +1028,9 @@ std::unique_ptr<AudioBus> AudioBus::createByMixingToMono(const AudioBus* sourceB
 
 bool AudioBus::isSilent() const
 {
-	for (size_t i = 0; i < m_channels.size(); ++i)
+	for (size_t i = 0; i < m_numberOfChannels; ++i)
 	{
-		if (!m_channels[i]->isSilent())
+		if (!m_channels[i].isSilent())
 		{
 			return false;
 		}
@@ -776,9 +1040,9 @@ bool AudioBus::isSilent() const
 
 void AudioBus::clearSilentFlag()
 {
-	for (size_t i = 0; i < m_channels.size(); ++i)
+	for (size_t i = 0; i < m_numberOfChannels; ++i)
 	{
-		m_channels[i]->clearSilentFlag();
+		m_channels[i].clearSilentFlag();
 	}
 }
 
@@ -2,6 +2,7 @@
 // Copyright (C) 2010, Google Inc. All rights reserved.
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
+#include "internal/AudioChannelArena.h"
 #include "internal/VectorMath.h"
 #include "internal/Assertions.h"
 
@@ -14,6 +15,59 @@ namespace lab {
 
 using namespace VectorMath;
 
+alignas(16) const float AudioChannel::SharedZeros[AudioChannel::SharedZeroLength] = {};
+const size_t AudioChannel::SharedZeroLength;
+
+AudioChannel::AudioChannel(size_t length)
+    : m_length(length)
+    , m_silent(true)
+{
+    m_rawPointer = AudioChannelArena::acquire(length, m_pooledCapacity);
+    if (!m_rawPointer)
+    {
+        m_pooledCapacity = 0;
+        m_memBuffer.reset(new AudioFloatArray(length));
+    }
+}
+
+AudioChannel::~AudioChannel()
+{
+    if (m_pooledCapacity)
+        AudioChannelArena::release(m_rawPointer, m_pooledCapacity);
+}
+
+void AudioChannel::set(float * storage, size_t length)
+{
+    // clean up managed storage
+    if (m_pooledCapacity)
+        AudioChannelArena::release(m_rawPointer, m_pooledCapacity);
+    m_pooledCapacity = 0;
+    m_memBuffer.reset();
+
+    m_rawPointer = storage;
+    m_length = length;
+    m_sharedZeros = false;
+    m_busStorage = false;
+
+    // A view of a zeroed channel is silent.
+    m_silent = storage == SharedZeros;
+}
+
+void AudioChannel::setBusStorage(float * storage, size_t length)
+{
+    set(storage, length);
+    m_busStorage = true;
+    m_silent = true;
+}
+
+void AudioChannel::unshareZeros()
+{
+    // The storage is only cleared once it's to be written; a channel that stays silent never touches it.
+    m_sharedZeros = false;
+    if (float * p = storage())
+        memset(p, 0, sizeof(float) * m_length);
+}
+
 void AudioChannel::resizeSmaller(size_t newLength)
 {
     ASSERT(newLength <= m_length);
@@ -2,56 +2,548 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioRealtimeCheck.h"
+#include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AnalyserNode.h"
+#include "LabSound/core/AttachedAudioDestinationNode.h"
 #include "LabSound/core/AudioListener.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/ChannelMergerNode.h"
+#include "LabSound/core/ChannelSplitterNode.h"
+#include "LabSound/core/ConcurrentQueue.h"
 #include "LabSound/core/DefaultAudioDestinationNode.h"
+#include "LabSound/core/GainNode.h"
 #include "LabSound/core/OfflineAudioDestinationNode.h"
 #include "LabSound/core/OscillatorNode.h"
+#include "LabSound/core/PannerNode.h"
 #include "LabSound/core/AudioHardwareSourceNode.h"
 
 #include "LabSound/extended/AudioContextLock.h"
+#include "LabSound/extended/CommandLog.h"
 
+#include "internal/AlignedAllocation.h"
 #include "internal/AudioDestination.h"
 #include "internal/Assertions.h"
-
-#include "readerwriterqueue/readerwriterqueue.h"
-
+#include "internal/AudioChannelArena.h"
+#include "internal/BackgroundConvolverPool.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/FFTFrame.h"
+#include "internal/HRTFDatabaseLoader.h"
+#include "internal/LockProfiler.h"
+#include "internal/NodeProfiler.h"
+#include "internal/RenderWorkerPool.h"
+#include "internal/SpatialBatch.h"
+#include "internal/ThreadScheduling.h"
+#include "internal/Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
 #include <queue>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <assert.h>
 #include <stdio.h>
 
 namespace lab
 {
 
-struct AudioContext::Internals
+struct AudioContext::Internals : AlignedAllocation<AudioContext::Internals>
 {
     Internals(bool a) : autoDispatchEvents(a) {}
-    ~Internals() = default;
+    ~Internals()
+    {
+        delete pendingSchedule.exchange(nullptr);
+        delete retiredSchedule.exchange(nullptr);
+        delete renderSchedule;
+        delete pendingTempoMap.exchange(nullptr);
+        delete retiredTempoMap.exchange(nullptr);
+        delete renderTempoMap;
+    }
 
-    moodycamel::ReaderWriterQueue<std::function<void()>> enqueuedEvents;
+    // Gain curves for the declick ramps, see AudioContext::setDeclickLength(). Replaced under the render lock.
+    std::vector<float> declickFadeIn;
+    std::vector<float> declickFadeOut;
+
+    // Posted from the render thread and the render workers, drained by dispatchEvents().
+    BoundedMPSCQueue<AudioContext::Event> enqueuedEvents{ 1024 };
+    std::atomic<uint64_t> eventOverflowCount{ 0 };
     bool autoDispatchEvents;
+
+    // The render schedule is a flat list of nodes in dependency order, referenced through
+    // one of each node's outputs so that a node released by the user simply drops out.
+    // Steps are grouped into levels; no node depends on another node in its own level.
+    struct RenderSchedule
+    {
+        std::vector<std::weak_ptr<AudioNodeOutput>> steps;
+        std::vector<size_t> levels; // offset of the first step of each level, plus steps.size()
+        std::vector<std::shared_ptr<AudioNode>> automaticPullNodes;
+
+        // The steps feeding each step's inputs, as offsets into feeders, plus feeders.size(). A feeder that
+        // isn't scheduled itself, such as a member of a feedback cycle, is recorded as steps.size(), whose
+        // dormant flag is never set.
+        std::vector<uint32_t> feederOffsets;
+        std::vector<uint32_t> feeders;
+
+        // The steps feeding the destination's inputs, and per step, the latency from its output to the
+        // destination's, see AudioContext::pathLatency(). The latencies are worked out by the render thread.
+        std::vector<uint32_t> destinationFeeders;
+        std::vector<double> pathLatencies;
+        std::vector<double> stepLatencies;
+        uint64_t pathLatencyQuantum = 0; // when they were last worked out
+
+        // Per step, whether the node was dormant after it was last rendered. Written by the render thread and
+        // the render workers, each step only by the participant rendering it.
+        std::unique_ptr<uint8_t[]> dormant;
+
+        // The steps in depth first order, which is the order the schedule is rendered in serially. It keeps
+        // each chain of nodes together, where the level order interleaves them.
+        std::vector<uint32_t> serialOrder;
+
+        // Intermediate buses shared between outputs, and summing inputs, whose results are never needed at the
+        // same time. buses[outputOffsets[step] + k] is lent to output k of the step's node and
+        // buses[inputOffsets[step] + k] to its input k, or is nullptr if that keeps its own bus. Rendering in
+        // levels keeps more results alive at once than rendering serially, so each order has its own plan.
+        struct BusPlan
+        {
+            std::vector<std::unique_ptr<AudioBus>> pool;
+            std::vector<AudioBus *> buses;
+        };
+        std::vector<uint32_t> outputOffsets; // plus the number of outputs
+        std::vector<uint32_t> inputOffsets;  // following the outputs, plus the total
+        BusPlan serialPlan;
+        BusPlan parallelPlan;
+
+        // The scheduled PannerNodes, whose geometry is evaluated together before the steps are rendered.
+        std::unique_ptr<SpatialBatch> spatialBatch;
+
+        // Per step, how graph optimization may render it instead of processing it, or empty while that is off;
+        // see AudioContext::setGraphOptimization(). A GainNode may fold its gain on into the GainNode of step
+        // partner, or steps.size() if there is none, and a ChannelSplitterNode may be skipped together with the
+        // ChannelMergerNode of step partner, which then hands on handedOn[partner], the splitter's input.
+        struct Rewrite
+        {
+            enum Kind : uint8_t { None, Gain, Splitter } kind;
+            uint32_t partner;
+        };
+        std::vector<Rewrite> rewrites;
+        std::unique_ptr<AudioBus *[]> handedOn; // each written by a splitter's step, and cleared by its merger's
+    };
+
+    // Schedules are published as immutable snapshots. The update thread hands a compiled schedule
+    // over through pendingSchedule, and at the start of a quantum the render thread adopts it with a
+    // single exchange. The schedule it rendered before goes to retiredSchedule, from where the update
+    // thread frees it. The render thread never blocks, allocates or frees; it waits to adopt
+    // a new schedule until the previous retiree has been collected.
+    std::atomic<RenderSchedule *> pendingSchedule{ nullptr };
+    std::atomic<RenderSchedule *> retiredSchedule{ nullptr };
+    RenderSchedule * renderSchedule = nullptr; // owned by the render thread
+
+    // Dormant nodes are processed anyway in the quantum a new schedule is adopted, where connection changes
+    // are picked up. Set by the render thread at the start of each quantum.
+    bool skipDormantNodes = false;
+
+    // The bus plan in effect for the current quantum, or nullptr. Only while the graph lock is held during the
+    // quantum is it certain that the schedule describes every consumer of an output. Set by the render thread.
+    const RenderSchedule::BusPlan * busPlan = nullptr;
+
+    // Called on the update thread.
+    void publishSchedule(RenderSchedule * schedule)
+    {
+        delete retiredSchedule.exchange(nullptr);
+        delete pendingSchedule.exchange(schedule); // superseded before the render thread adopted it
+    }
+
+    // Called on the render thread; returns true if a new schedule was adopted. retire(schedule) is called
+    // just before the schedule rendered so far is handed to the update thread.
+    template <typename Retire>
+    bool adoptSchedule(Retire retire)
+    {
+        if (!pendingSchedule.load() || retiredSchedule.load())
+            return false;
+
+        RenderSchedule * schedule = pendingSchedule.exchange(nullptr);
+        if (!schedule)
+            return false;
+
+        if (renderSchedule)
+            retire(*renderSchedule);
+        retiredSchedule.store(renderSchedule);
+        renderSchedule = schedule;
+        return true;
+    }
+
+    // The tempo map, see AudioContext::setTempoMap(). tempoMap is the copy the other threads read and edit,
+    // under tempoMapLock. Copies of it are handed to the render thread as schedules are, and the one it
+    // rendered with before goes to retiredTempoMap, from where the update thread frees it.
+    mutable std::mutex tempoMapLock;
+    TempoMap tempoMap;
+    std::atomic<TempoMap *> pendingTempoMap{ nullptr };
+    std::atomic<TempoMap *> retiredTempoMap{ nullptr };
+    TempoMap * renderTempoMap = new TempoMap(); // owned by the render thread
+    size_t tempoSegment = 0; // of renderTempoMap, in force at the current quantum
+    TransportPosition transport;
+
+    // Called with tempoMapLock held.
+    void publishTempoMap()
+    {
+        TempoMap * map = new TempoMap(tempoMap);
+        delete retiredTempoMap.exchange(nullptr);
+        delete pendingTempoMap.exchange(map);
+    }
+
+    // References the render path lets go of, any of which may be the last, see AudioContext::deferRelease().
+    // Both the audio thread and the render workers push here, and the update thread drops them. Should the
+    // ring ever be full, the reference is dropped in place rather than allocating on the audio thread. The
+    // steps' handles pass through every quantum, so the update thread is only woken for a reference that looks
+    // like the last, or once the ring is half full; the rest wait for its next pass.
+    struct DeferredRelease
+    {
+        std::shared_ptr<void> object;
+        std::unique_ptr<AudioBus> bus;
+    };
+
+    static const size_t DeferredReleaseCapacity = 4096;
+    BoundedMPSCQueue<DeferredRelease> deferredReleases{ DeferredReleaseCapacity };
+    std::atomic<size_t> deferredReleaseCount{ 0 };
+
+    // Whether a reference just pushed is worth waking the update thread for.
+    bool countDeferredRelease(bool likelyLast)
+    {
+        return deferredReleaseCount.fetch_add(1, std::memory_order_relaxed) + 1 == DeferredReleaseCapacity / 2 || likelyLast;
+    }
+
+    // The summing junctions whose connections changed, adopted by the render thread at the start of a quantum.
+    AudioSummingJunction::DirtyList dirtyJunctions;
+
+    // Held by the update thread while it applies a transaction and publishes its schedule. The render thread
+    // only tries it, and while it is held goes on rendering the connections and schedule it has, adopting
+    // neither until the whole transaction can be adopted at once; adoptionHeld records that for the quantum.
+    std::mutex adoptionLock;
+    bool adoptionHeld = false; // owned by the render thread
+
+    // Work handed over by the render path, see AudioContext::deferTask().
+    BoundedMPSCQueue<std::shared_ptr<AudioContext::DeferredTask>> deferredTasks{ 256 };
+
+    // Called on the update thread.
+    void runDeferredTasks()
+    {
+        std::shared_ptr<AudioContext::DeferredTask> task;
+        while (deferredTasks.tryPop(task))
+        {
+            task->run();
+            task.reset();
+        }
+    }
+
+    // Called on the update thread, which is where everything the render path lets go of is destroyed.
+    void collectGarbage()
+    {
+        deferredReleaseCount.store(0, std::memory_order_relaxed);
+        DeferredRelease release;
+        while (deferredReleases.tryPop(release))
+            release = DeferredRelease();
+
+        delete retiredSchedule.exchange(nullptr);
+        delete retiredTempoMap.exchange(nullptr);
+        dirtyJunctions.collectGarbage();
+    }
+
+    // Optional pool rendering each level of the schedule in parallel, see setRenderWorkerCount().
+    std::unique_ptr<RenderWorkerPool> workers;
+
+    // The workers, set while the render thread renders a node by itself with them otherwise idle, for
+    // runOnIdleRenderWorkers(). Only touched by the render thread.
+    RenderWorkerPool * idleWorkers = nullptr;
+
+    // The contexts attached to this one, see attachContext(), and the bus each renders into. Edited holding both
+    // guestLock and the render lock, so that the update thread and the render thread each need only one of them.
+    struct Guest
+    {
+        AudioContext * context;
+        AudioDestinationNode * destination;
+        std::unique_ptr<AudioBus> bus;
+    };
+    std::vector<Guest> guests;
+    std::mutex guestLock;
+
+    // The context this one is attached to, if any. Only set before initialization, and cleared as it's destroyed.
+    AudioContext * host = nullptr;
+
+    // See setThreadPolicy(), indexed by AudioThreadRole. A policy is replaced under policyLock, which the render
+    // thread only tries, and its generation bumped; each thread compares that with the generation it applied.
+    static const int ThreadRoleCount = 3;
+    mutable std::mutex policyLock;
+    AudioThreadPolicy policies[ThreadRoleCount];
+    std::atomic<uint32_t> policyGeneration[ThreadRoleCount] = {};
+    std::atomic<unsigned> policyFailures[ThreadRoleCount] = {};
+
+    // Owned by the render thread. The policy is applied again if the render thread changes.
+    uint32_t renderPolicyApplied = 0;
+    std::thread::id renderPolicyThread;
+
+    // See setProfiling(). The records of the nodes scheduled so far, registered by the graph update, which are
+    // dropped once their node is gone. Each profiling period has an epoch of its own, and a node's record is
+    // cleared when it is first written in a new one. The counter's rate is measured over the period.
+    std::mutex profileLock;
+    std::vector<std::shared_ptr<NodeProfileRecord>> profileRecords;
+    uint32_t lastProfilingEpoch = 0;
+    uint64_t profileStartQuantum = 0;
+    uint64_t profileStartTicks = 0;
+    std::chrono::steady_clock::time_point profileStartTime;
+
+    // Called with profileLock held. Returns the new period's epoch.
+    uint32_t beginProfilingPeriod(uint64_t currentQuantum)
+    {
+        if (++lastProfilingEpoch == 0)
+            lastProfilingEpoch = 1;
+        profileStartQuantum = currentQuantum;
+        profileStartTicks = ProfileTicks();
+        profileStartTime = std::chrono::steady_clock::now();
+        return lastProfilingEpoch;
+    }
+
+    // See setLockProfiling(). The records of the graph lock and the render lock are made when lock profiling is
+    // first started, and kept until the context goes, as a lock may be released just after it is stopped. Each
+    // period has an epoch, as for node profiling.
+    std::mutex lockProfileLock;
+    std::unique_ptr<LockProfileRecords> lockRecordStorage[2];
+    std::atomic<LockProfileRecords *> lockRecords[2] = {};
+    std::atomic<uint32_t> lockProfileEpoch{ 0 };
+    uint64_t lockProfileStartTicks = 0;
+    std::chrono::steady_clock::time_point lockProfileStartTime;
+
+    // Called with lockProfileLock held.
+    void beginLockProfilingPeriod()
+    {
+        uint32_t epoch = lockProfileEpoch.load() + 1;
+        lockProfileEpoch.store(epoch ? epoch : 1);
+        lockProfileStartTicks = ProfileTicks();
+        lockProfileStartTime = std::chrono::steady_clock::now();
+    }
+
+    // See snapshotGraph(). A snapshot bumps the requested generation, and the render thread reports the nodes'
+    // latency and tail and sets the reported generation to match at the start of its next quantum.
+    std::mutex snapshotLock;
+    std::atomic<uint32_t> snapshotRequested{ 0 };
+    std::atomic<uint32_t> snapshotReported{ 0 };
+
+    // See memoryReport(). The render thread takes up a request at the start of its next quantum, has the nodes
+    // report into room reserved for them, and marks it done.
+    struct MemoryRequest
+    {
+        AudioMemoryReport * report = nullptr;
+        const std::vector<AudioNode *> * nodes = nullptr;
+        bool overflowed = false;
+        std::atomic<bool> done{ false };
+
+        void run(ContextRenderLock & r)
+        {
+            for (size_t i = 0; i < nodes->size(); ++i)
+            {
+                AudioMemoryUsage usage(*report, report->nodes[i], &overflowed);
+                (*nodes)[i]->reportMemory(r, usage);
+            }
+            done.store(true, std::memory_order_release);
+        }
+    };
+    std::mutex memoryReportLock;
+    std::atomic<MemoryRequest *> memoryRequest{ nullptr };
+
+    // Graph edits from any thread are pushed to a preallocated ring without taking a lock. Only the update
+    // thread pops from it, moving the edits into its own pendingNodeConnections. Should the ring
+    // ever fill up, edits spill into a locked overflow list rather than being dropped.
+    struct GraphCommand
+    {
+        enum class Type : int { None = 0, Connect, Disconnect, ConnectParam, Batch, AddPullNode, RemovePullNode, HoldSource };
+
+        Type type = Type::None;
+        std::shared_ptr<AudioNode> destination;
+        std::shared_ptr<AudioNode> source;
+        std::shared_ptr<AudioParam> param;
+        uint32_t destIndex = 0;
+        uint32_t srcIndex = 0;
+
+        // The edits of a committed GraphTransaction travel through the ring as a single command.
+        std::unique_ptr<std::vector<GraphTransaction::Edit>> batch;
+    };
+
+    BoundedMPSCQueue<GraphCommand> graphCommands{ 4096 };
+    std::mutex overflowMutex;
+    std::vector<GraphCommand> overflowCommands;
+    std::atomic<bool> overflowPending{ false };
+
+    // Parameter connections drained from the ring, waiting for the graph lock. Owned by the update thread.
+    std::vector<GraphCommand> pendingParamConnections;
+
+    // Automatic pull nodes added and removed, in order, likewise.
+    std::vector<GraphCommand> pendingPullNodeEdits;
+
+    // See prewarm(). The thread is started with the first node, and stopped as the context is destroyed.
+    struct Prewarm
+    {
+        std::shared_ptr<AudioNode> node;
+        size_t inputChannels;
+        std::function<void()> onReady;
+    };
+    std::mutex prewarmLock;
+    std::condition_variable prewarmReady;
+    std::deque<Prewarm> prewarms;
+    std::thread prewarmThread;
+    bool prewarmStopping = false;
+
+    // See startupTimings(). Shared with the HRTF loader's callback, which may outlive the context.
+    struct Startup
+    {
+        Startup()
+        {
+            for (std::atomic<int64_t> & phase : nanoseconds)
+                phase.store(-1, std::memory_order_relaxed);
+        }
+
+        void mark(AudioStartupPhase phase)
+        {
+            std::atomic<int64_t> & stamp = nanoseconds[static_cast<size_t>(phase)];
+            if (stamp.load(std::memory_order_relaxed) >= 0)
+                return;
+            int64_t unset = -1;
+            const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+            stamp.compare_exchange_strong(unset, now, std::memory_order_relaxed);
+        }
+
+        const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        std::atomic<int64_t> nanoseconds[AudioStartupTimings::Phases];
+    };
+    std::shared_ptr<Startup> startup = std::make_shared<Startup>();
+
+    // See preload(). The thread setting up the FFTs is stopped as the context is destroyed.
+    std::shared_ptr<HRTFDatabaseLoader> hrtfLoader;
+    std::thread preloadThread;
+    std::atomic<bool> preloadStopping{ false };
+
+    // See startRecordingCommands(). The graph update takes its own reference under recorderLock; the render
+    // thread's pointer is only cleared holding the render lock.
+    std::mutex recorderLock;
+    std::shared_ptr<CommandRecorder> recorder;
+    std::atomic<CommandRecorder *> renderRecorder{ nullptr };
+
+    // The update thread sleeps on cv holding updateWaitMutex. Producers only take the mutex to notify it
+    // when it is actually waiting.
+    std::mutex updateWaitMutex;
+    std::atomic<bool> updateThreadWaiting{ false };
+    std::atomic<bool> updateRequested{ false };
+
+    // Set by the render thread when a scheduled source finishes, see notifySourceFinished().
+    std::atomic<bool> sourcesFinished{ false };
+
+    // Owned by whichever thread updates the graph: when the nearest deferred connection or disconnection falls
+    // due, whether disconnections are in flight, and the generation of the Background policy last applied.
+    std::chrono::steady_clock::time_point updateWakeAt = std::chrono::steady_clock::time_point::max();
+    bool disconnectionsPending = false;
+    uint32_t backgroundPolicyApplied = 0;
+
+    // Once edits spill, the rest follow them into the overflow list until the update thread has taken it, as it
+    // drains the ring first; so the edits of each thread stay in order.
+    void push(GraphCommand && command)
+    {
+        if (!overflowPending.load(std::memory_order_acquire) && graphCommands.tryPush(std::move(command)))
+            return;
+
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflowCommands.emplace_back(std::move(command));
+        overflowPending.store(true, std::memory_order_release);
+    }
 };
 
 const size_t lab::AudioContext::maxNumberOfChannels = 32;
+const size_t lab::AudioContext::maxChannelLimit = 1024;
+const size_t lab::AudioContext::MinRenderQuantumSize = 16;
+const size_t lab::AudioContext::MaxRenderQuantumSize = 4096;
+
+// About as long as the former per-sample decay by 0.98 took to reach the audible threshold.
+const size_t lab::AudioContext::DefaultDeclickLength = 150;
+
+namespace
+{
+    // The fade curve decays exponentially to this fraction of its start over the ramp, and is offset and
+    // scaled so that it reaches exactly zero at the end.
+    const float DeclickThreshold = 0.05f;
+
+    void computeDeclickCurves(size_t frames, std::vector<float> & fadeIn, std::vector<float> & fadeOut)
+    {
+        fadeIn.resize(frames);
+        fadeOut.resize(frames);
+
+        const double decay = std::pow(static_cast<double>(DeclickThreshold), 1.0 / static_cast<double>(frames ? frames : 1));
+        double gain = 1.0;
+        for (size_t i = 0; i < frames; ++i, gain *= decay)
+        {
+            float out = static_cast<float>((gain - DeclickThreshold) / (1.0 - DeclickThreshold));
+            fadeOut[i] = out;
+            fadeIn[i] = 1.f - out;
+        }
+    }
+}
 
 // Constructor for realtime rendering
-AudioContext::AudioContext(bool isOffline, bool autoDispatchEvents) : m_isOfflineContext(isOffline)
+AudioContext::AudioContext(bool isOffline, bool autoDispatchEvents, size_t renderQuantumSize)
+: m_isOfflineContext(isOffline)
+, m_renderQuantumSize(renderQuantumSize)
 {
+    bool isPowerOfTwo = renderQuantumSize && !(renderQuantumSize & (renderQuantumSize - 1));
+    if (!isPowerOfTwo || renderQuantumSize < MinRenderQuantumSize || renderQuantumSize > MaxRenderQuantumSize)
+        throw std::invalid_argument("Render quantum size must be a power of two between 16 and 4096 frames");
+
+#if LABSOUND_LOG_LEVEL < LABSOUND_LOG_NONE
+    LabSoundStartLogging();
+#endif
+
     m_internal.reset(new AudioContext::Internals(autoDispatchEvents));
+
+    // Render workers work on behalf of the render thread, so they ask for the same class of scheduling. An offline
+    // render has no deadline, and a long one mustn't starve the rest of the system, so its workers are left as created.
+    if (!isOffline)
+    {
+        AudioThreadPolicy & workerPolicy = m_internal->policies[static_cast<int>(AudioThreadRole::RenderWorkers)];
+        workerPolicy.scheduling = AudioThreadPolicy::Scheduling::Fifo;
+        workerPolicy.priority = 98;
+    }
+    computeDeclickCurves(DefaultDeclickLength, m_internal->declickFadeIn, m_internal->declickFadeOut);
     m_listener.reset(new AudioListener());
+    markStartupPhase(AudioStartupPhase::ContextCreated);
 }
 
 AudioContext::~AudioContext()
 {
-    // LOG can block.
-    // LOG("Begin AudioContext::~AudioContext()");
+    LOG("Begin AudioContext::~AudioContext()");
+
+    if (AudioContext * host = m_internal->host)
+        host->detachContext(*this);
+
+    // Guests can't outlive their host.
+    ASSERT(m_internal->guests.empty());
+    while (!m_internal->guests.empty())
+        detachContext(*m_internal->guests.back().context);
+
+    {
+        std::lock_guard<std::mutex> lock(m_internal->prewarmLock);
+        m_internal->prewarmStopping = true;
+        m_internal->prewarms.clear();
+    }
+    m_internal->prewarmReady.notify_all();
+    if (m_internal->prewarmThread.joinable())
+        m_internal->prewarmThread.join();
 
-    if (!isOfflineContext()) graphKeepAlive = 0.25f;
+    m_internal->preloadStopping = true;
+    if (m_internal->preloadThread.joinable())
+        m_internal->preloadThread.join();
 
     updateThreadShouldRun = false;
-    cv.notify_all();
+    notifyUpdateThread();
 
     if (graphUpdateThread.joinable())
         graphUpdateThread.join();
@@ -64,9 +556,16 @@ AudioContext::~AudioContext()
 
     ASSERT(!m_isInitialized);
     ASSERT(!m_automaticPullNodes.size());
-    ASSERT(!m_renderingAutomaticPullNodes.size());
+
+#if defined(LABSOUND_RT_CHECK)
+    AudioRealtimeCheck::log();
+#endif
 
     LOG("Finish AudioContext::~AudioContext()");
+
+#if LABSOUND_LOG_LEVEL < LABSOUND_LOG_NONE
+    LabSoundStopLogging();
+#endif
 }
 
 void AudioContext::lazyInitialize()
@@ -81,17 +580,21 @@ void AudioContext::lazyInitialize()
             {
                 m_destinationNode->initialize();
 
-                graphKeepAlive = 0.25f; // pump the graph for the first 0.25 seconds
-                graphUpdateThread = std::thread(&AudioContext::update, this);
-
-                if (!isOfflineContext())
+                // An offline context has no update thread; its render thread updates the graph between quanta. An
+                // attached context is rendered and updated by its host's threads.
+                if (!isOfflineContext() && !m_internal->host)
                 {
+                    graphUpdateThread = std::thread(&AudioContext::update, this);
+                    markStartupPhase(AudioStartupPhase::UpdateThreadStarted);
+
                     // This starts the audio thread. The destination node's provideInput() method will now be called repeatedly to render audio.
                     // Each time provideInput() is called, a portion of the audio stream is rendered. Let's call this time period a "render quantum".
-                    m_destinationNode->startRendering();
+                    // A suspended context starts on resume().
+                    if (!isSuspended())
+                        m_destinationNode->startRendering();
                 }
 
-                cv.notify_all();
+                notifyUpdateThread();
             }
             else
             {
@@ -115,8 +618,6 @@ void AudioContext::uninitialize()
     // Don't allow the context to initialize a second time after it's already been explicitly uninitialized.
     m_isAudioThreadFinished = true;
 
-    updateAutomaticPullNodes(); // added for the case where an OfflineAudioDestinationNode needs to update the graph
-
     m_isInitialized = false;
 }
 
@@ -127,338 +628,2461 @@ bool AudioContext::isInitialized() const
 
 void AudioContext::holdSourceNodeUntilFinished(std::shared_ptr<AudioScheduledSourceNode> node)
 {
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    automaticSources.push_back(node);
+    if (!node)
+        return;
+
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::HoldSource;
+    command.destination = std::move(node);
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
 }
 
-void AudioContext::handleAutomaticSources()
+void AudioContext::prewarm(std::shared_ptr<AudioNode> node, size_t inputChannels, std::function<void()> onReady)
 {
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    for (auto i = automaticSources.begin(); i != automaticSources.end(); ++i)
+    if (!node)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_internal->prewarmLock);
+    if (m_internal->prewarmStopping)
+        return;
+
+    m_internal->prewarms.push_back({std::move(node), inputChannels, std::move(onReady)});
+    if (!m_internal->prewarmThread.joinable())
     {
-        if ((*i)->hasFinished())
+        m_internal->prewarmThread = std::thread([this]()
         {
-            pendingNodeConnections.emplace(*i, std::shared_ptr<AudioNode>(), ConnectionType::Disconnect, 0, 0);
-            i = automaticSources.erase(i);
-            if (i == automaticSources.end()) break;
-        }
-    }
-}
+            Internals & internal = *m_internal;
+            std::unique_lock<std::mutex> lock(internal.prewarmLock);
+            for (;;)
+            {
+                internal.prewarmReady.wait(lock, [&internal]() { return internal.prewarmStopping || !internal.prewarms.empty(); });
+                if (internal.prewarmStopping)
+                    return;
 
-void AudioContext::handlePreRenderTasks(ContextRenderLock & r)
-{
-    ASSERT(r.context());
+                Internals::Prewarm job = std::move(internal.prewarms.front());
+                internal.prewarms.pop_front();
+                lock.unlock();
+
+                job.node->prepare(*this, job.inputChannels);
+                job.node.reset();
+                if (job.onReady)
+                    enqueueEvent(job.onReady);
 
-    // At the beginning of every render quantum, try to update the internal rendering graph state (from main thread changes).
-    AudioSummingJunction::handleDirtyAudioSummingJunctions(r);
-    updateAutomaticPullNodes();
+                lock.lock();
+            }
+        });
+    }
+    m_internal->prewarmReady.notify_one();
 }
 
-void AudioContext::handlePostRenderTasks(ContextRenderLock & r)
+void AudioContext::preload(const std::string & hrtfSearchPath, size_t largestFFTSize)
 {
-    ASSERT(r.context());
-
-    AudioSummingJunction::handleDirtyAudioSummingJunctions(r);
+    if (hrtfSearchPath.length() && !m_internal->hrtfLoader)
+    {
+        // The search path is keyed as PannerNode keys it, so that panners find this loader.
+        std::string searchPath = hrtfSearchPath;
+        if (searchPath.back() == '/' || searchPath.back() == '\\')
+            searchPath.pop_back();
+
+        m_internal->hrtfLoader = HRTFDatabaseLoader::loaderFor(sampleRate(), searchPath);
+        std::shared_ptr<Internals::Startup> startup = m_internal->startup;
+        m_internal->hrtfLoader->whenLoaded([startup](HRTFDatabase *)
+        {
+            startup->mark(AudioStartupPhase::HRTFLoaded);
+        });
+    }
 
-    updateAutomaticPullNodes();
-    handleAutomaticSources();
+    // Making a frame of each size sets up the size, once, for every frame to come.
+    if (largestFFTSize && !m_internal->preloadThread.joinable())
+    {
+        m_internal->preloadThread = std::thread([this, largestFFTSize]()
+        {
+            for (size_t size = 128; size <= largestFFTSize; size *= 2)
+            {
+                if (m_internal->preloadStopping)
+                    return;
+                FFTFrame frame(size);
+            }
+            markStartupPhase(AudioStartupPhase::FFTPrepared);
+        });
+    }
 }
 
-void AudioContext::connect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+const char * AudioStartupPhaseName(AudioStartupPhase phase)
 {
-    if (!destination) throw std::runtime_error("Cannot connect to null destination");
-    if (!destination) throw std::runtime_error("Cannot connect from null source");
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    if (srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
-    if (destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
-    pendingNodeConnections.emplace(destination, source, ConnectionType::Connect, destIdx, srcIdx);
-    cv.notify_all();
+    switch (phase)
+    {
+        case AudioStartupPhase::ContextCreated: return "ContextCreated";
+        case AudioStartupPhase::DeviceOpened: return "DeviceOpened";
+        case AudioStartupPhase::UpdateThreadStarted: return "UpdateThreadStarted";
+        case AudioStartupPhase::RenderingStarted: return "RenderingStarted";
+        case AudioStartupPhase::FirstQuantum: return "FirstQuantum";
+        case AudioStartupPhase::HRTFLoaded: return "HRTFLoaded";
+        case AudioStartupPhase::FFTPrepared: return "FFTPrepared";
+        default: return "Unknown";
+    }
 }
 
-void AudioContext::disconnect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+AudioStartupTimings AudioContext::startupTimings() const
 {
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    if (source && srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
-    if (destination && destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
-    pendingNodeConnections.emplace(destination, source, ConnectionType::Disconnect, destIdx, srcIdx);
-    cv.notify_all();
+    AudioStartupTimings timings;
+    for (size_t i = 0; i < AudioStartupTimings::Phases; ++i)
+    {
+        const int64_t nanoseconds = m_internal->startup->nanoseconds[i].load(std::memory_order_relaxed);
+        timings.seconds[i] = nanoseconds >= 0 ? nanoseconds * 1e-9 : -1;
+    }
+    return timings;
 }
 
-void AudioContext::connectParam(std::shared_ptr<AudioParam> param, std::shared_ptr<AudioNode> driver, uint32_t index)
+void AudioContext::markStartupPhase(AudioStartupPhase phase)
 {
-    if (!param) throw std::invalid_argument("No parameter specified");
-    if (index >= driver->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs on the driver");
-    pendingParamConnections.push(std::make_tuple(param, driver, index));
-    cv.notify_all();
+    m_internal->startup->mark(phase);
 }
 
-void AudioContext::update()
+void AudioContext::startRecordingCommands(std::shared_ptr<CommandRecorder> recorder)
 {
-    LOG("Begin UpdateGraphThread");
-
-    const float frameSizeMs = (sampleRate() / (float)AudioNode::ProcessingSizeInFrames) / 1000.f; // = ~0.345ms @ 44.1k/128
-    const float graphTickDurationMs = frameSizeMs * 16; // = ~5.5ms
-    const int graphTickDurationUs = static_cast<int>(graphTickDurationMs * 1000.f);  // = ~5550us
+    stopRecordingCommands();
+    if (!recorder)
+        return;
 
-    // graphKeepAlive keeps the thread alive momentarily (letting tail tasks
-    // finish) even updateThreadShouldRun has been signaled.
-    while (updateThreadShouldRun || graphKeepAlive > 0)
+    recorder->begin(*this, currentSampleFrame());
     {
-        // A `unique_lock` automatically acquires a lock on construction. The purpose of
-        // this mutex is to synchronize updates to the graph from the main thread,
-        // primarily through `connect(...)` and `disconnect(...)`.
-        std::unique_lock<std::mutex> lk;
-
-        if (!m_isOfflineContext)
-        {
-            lk = std::unique_lock<std::mutex>(m_updateMutex);
-            // A condition variable is used to notify this thread that a graph update is pending
-            // in one of the queues.
-
-            // graph needs to tick to complete
-            if ((currentTime() + graphKeepAlive) > currentTime())
-            {
-                cv.wait_until(lk, std::chrono::steady_clock::now() + std::chrono::microseconds(graphTickDurationUs));
-            }
-            else
-            {
-                // otherwise wait for someone to connect or disconnect something
-                cv.wait(lk);
-            }
-        }
-
-        if (m_internal->autoDispatchEvents)
-            dispatchEvents();
-
-        // if blocked on cv.wait, double check whether it's still necessary to run.
-        if (updateThreadShouldRun || graphKeepAlive > 0)
-        {
-            ContextGraphLock gLock(this, "AudioContext::Update()");
-
-            const double now = currentTime();
-            const float delta = static_cast<float>(now - lastGraphUpdateTime);
-            lastGraphUpdateTime = static_cast<float>(now);
-            graphKeepAlive -= delta;
-
-            // Satisfy parameter connections
-            while (!pendingParamConnections.empty())
-            {
-                auto connection = pendingParamConnections.front();
-                pendingParamConnections.pop();
-                AudioParam::connect(gLock, std::get<0>(connection), std::get<1>(connection)->output(std::get<2>(connection)));
-            }
-
-            std::vector<PendingConnection> skippedConnections;
-
-            // Satisfy node connections
-            while (!pendingNodeConnections.empty())
-            {
-                auto connection = pendingNodeConnections.top();
-                pendingNodeConnections.pop();
-
-                switch (connection.type)
-                {
-                case ConnectionType::Connect:
-                {
-                    // requeue this node if the scheduled time is > 100ms away
-                    if (connection.destination && connection.destination->isScheduledNode())
-                    {
-                        AudioScheduledSourceNode * node = dynamic_cast<AudioScheduledSourceNode*>(connection.destination.get());
-                        if (node->startTime() > now + 0.1)
-                        {
-                            pendingNodeConnections.pop(); // pop from current queue
-                            skippedConnections.push_back(connection); // save for later
-                            continue;
-                        }
-                    }
-
-                    connection.source->scheduleConnect();
-
-                    AudioNodeInput::connect(gLock, connection.destination->input(connection.destIndex), connection.source->output(connection.srcIndex));
-                }
-                break;
-
-                case ConnectionType::Disconnect:
-                {
-                    connection.type = ConnectionType::FinishDisconnect;
-                    skippedConnections.push_back(connection); // save for later
-                    if (connection.source)
-                    {
-                        // if source and destination are specified, then we don't ramp out the destination
-                        connection.source->scheduleDisconnect();
-                    }
-                    else if (connection.destination)
-                    {
-                        // this case is a disconnect where source is nothing, and destination is something
-                        // probably this case should be disallowed because we have to study it to find out
-                        // if it is any different than a source with no destination. Answer: it's the same. source or dest by itself means disconnect all
-                        connection.destination->scheduleDisconnect();
-                    }
-                    graphKeepAlive = updateThreadShouldRun ? connection.duration : graphKeepAlive;
-                }
-                break;
-
-                // @TODO disconnect should occur not in the next quantum, but when node->disconnectionReady() is true
-                case ConnectionType::FinishDisconnect:
-                {
-                    if (connection.duration > 0)
-                    {
-                        connection.duration -= delta;
-                        skippedConnections.push_back(connection);
-                        continue;
-                    }
-
-                    if (connection.source && connection.destination)
-                    {
-                        AudioNodeInput::disconnect(gLock, connection.destination->input(connection.destIndex), connection.source->output(connection.srcIndex));
-                    }
-                    else if (connection.destination)
-                    {
-                        for (unsigned int out = 0; out < connection.destination->numberOfOutputs(); ++out)
-                        {
-                            auto output = connection.destination->output(out);
-                            if (!output) continue;
-
-                            AudioNodeOutput::disconnectAll(gLock, output);
-                        }
-                    }
-                    else if (connection.source)
-                    {
-                        for (unsigned int out = 0; out < connection.source->numberOfOutputs(); ++out)
-                        {
-                            auto output = connection.source->output(out);
-                            if (!output) continue;
-
-                            AudioNodeOutput::disconnectAll(gLock, output);
-                        }
-                    }
-
-                }
-                break;
-                }
-            }
-
-            // We have incompletely connected nodes, so next time the thread ticks we can re-check them
-            for (auto & sc : skippedConnections)
-            {
-                pendingNodeConnections.push(sc);
-            }
+        std::lock_guard<std::mutex> lock(m_internal->recorderLock);
+        m_internal->recorder = recorder;
+    }
+    m_internal->renderRecorder.store(recorder.get(), std::memory_order_release);
+}
 
-        }
+void AudioContext::stopRecordingCommands()
+{
+    {
+        ContextRenderLock r(this, "AudioContext::stopRecordingCommands");
+        m_internal->renderRecorder.store(nullptr, std::memory_order_release);
+    }
 
-        if (lk.owns_lock()) 
-            lk.unlock();
+    std::shared_ptr<CommandRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock(m_internal->recorderLock);
+        std::swap(recorder, m_internal->recorder);
     }
+    if (recorder)
+        recorder->finish(currentSampleFrame());
+}
 
-    LOG("End UpdateGraphThread");
+void AudioContext::recordParamValue(ContextRenderLock & r, const AudioParam * param, float value)
+{
+    CommandRecorder * recorder = m_internal->renderRecorder.load(std::memory_order_acquire);
+    if (recorder && recorder->recordRender(r, CommandRecorder::Command::SetValue, currentSampleFrame(), param, value))
+        notifyUpdateThread();
 }
 
-void AudioContext::addAutomaticPullNode(std::shared_ptr<AudioNode> node)
+void AudioContext::recordSchedule(ContextRenderLock & r, const AudioNode * node, bool start, double when)
 {
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    if (m_automaticPullNodes.find(node) == m_automaticPullNodes.end())
-    {
-        m_automaticPullNodes.insert(node);
-        m_automaticPullNodesNeedUpdating = true;
-    }
+    CommandRecorder * recorder = m_internal->renderRecorder.load(std::memory_order_acquire);
+    if (recorder && recorder->recordRender(r, start ? CommandRecorder::Command::Start : CommandRecorder::Command::Stop, currentSampleFrame(), node, when))
+        notifyUpdateThread();
 }
 
-void AudioContext::removeAutomaticPullNode(std::shared_ptr<AudioNode> node)
+bool AudioContext::hasPendingScheduledSources(ContextRenderLock & r)
 {
-    std::lock_guard<std::mutex> lock(m_updateMutex);
-    auto it = m_automaticPullNodes.find(node);
-    if (it != m_automaticPullNodes.end())
+    if (!m_internal->renderSchedule)
+        return false;
+
+    bool pending = false;
+    for (const std::weak_ptr<AudioNodeOutput> & step : m_internal->renderSchedule->steps)
     {
-        m_automaticPullNodes.erase(it);
-        m_automaticPullNodesNeedUpdating = true;
+        std::shared_ptr<AudioNodeOutput> output = step.lock();
+        if (!output)
+            continue;
+
+        AudioNode * node = output->node();
+        if (node && node->isScheduledNode())
+            pending = static_cast<AudioScheduledSourceNode *>(node)->isPlayingOrScheduled();
+
+        deferRelease(r, std::move(output));
+        if (pending)
+            break;
     }
+    return pending;
 }
 
-void AudioContext::updateAutomaticPullNodes()
+void AudioContext::handleAutomaticSources()
 {
-    /// @TODO this seems like work for the update thread.
-    /// m_automaticPullNodesNeedUpdating can go away in favor of
-    /// add and remove doing a cv.notify.
-    /// m_automaticPullNodes should be an add/remove vector
-    /// m_renderingAutomaticPullNodes should be the actual live vector
-    if (m_automaticPullNodesNeedUpdating)
-    {
-        std::lock_guard<std::mutex> lock(m_updateMutex);
-
-        // Copy from m_automaticPullNodes to m_renderingAutomaticPullNodes.
-        m_renderingAutomaticPullNodes.resize(m_automaticPullNodes.size());
+    // The held sources are only looked at once one of them may have finished, rather than every quantum.
+    if (!m_internal->sourcesFinished.exchange(false))
+        return;
 
-        unsigned j = 0;
-        for (auto i = m_automaticPullNodes.begin(); i != m_automaticPullNodes.end(); ++i, ++j)
+    for (size_t i = 0; i < automaticSources.size();)
+    {
+        if (automaticSources[i]->hasFinished())
         {
-            m_renderingAutomaticPullNodes[j] = *i;
+            pendingNodeConnections.emplace_back(std::move(automaticSources[i]), nullptr, ConnectionType::Disconnect);
+            automaticSources[i] = std::move(automaticSources.back());
+            automaticSources.pop_back();
         }
-
-        m_automaticPullNodesNeedUpdating = false;
+        else
+            ++i;
     }
 }
 
-void AudioContext::processAutomaticPullNodes(ContextRenderLock & r, size_t framesToProcess)
+void AudioContext::handlePreRenderTasks(ContextRenderLock & r)
 {
-    for (unsigned i = 0; i < m_renderingAutomaticPullNodes.size(); ++i)
-        m_renderingAutomaticPullNodes[i]->processIfNecessary(r, framesToProcess);
-}
+    ASSERT(r.context());
 
-void AudioContext::enqueueEvent(std::function<void()>& fn)
-{
-    m_internal->enqueuedEvents.enqueue(fn);
-    cv.notify_all();    // processing thread must dispatch events
+    // At the beginning of every render quantum, adopt the connections changed by the graph thread since the last,
+    // unless a transaction is being applied. Let the update thread free the ones they replace.
+    std::unique_lock<std::mutex> adoption(m_internal->adoptionLock, std::try_to_lock);
+    m_internal->adoptionHeld = !adoption.owns_lock();
+    if (!m_internal->adoptionHeld && m_internal->dirtyJunctions.update(r))
+        notifyUpdateThread();
+
+    updateTransport(r);
 }
 
-void AudioContext::dispatchEvents()
+void AudioContext::updateTransport(ContextRenderLock & r)
 {
-    std::function<void()> event_fn;
-    while (m_internal->enqueuedEvents.try_dequeue(event_fn))
+    Internals & internal = *m_internal;
+    const double sampleRate = this->sampleRate();
+    const uint64_t frame = currentSampleFrame();
+    const double time = frame / sampleRate;
+
+    // Take up a new tempo map once the one it replaces last time has been collected.
+    if (internal.pendingTempoMap.load() && !internal.retiredTempoMap.load())
     {
-        if (event_fn)
-            event_fn();
+        if (TempoMap * map = internal.pendingTempoMap.exchange(nullptr))
+        {
+            internal.retiredTempoMap.store(internal.renderTempoMap);
+            internal.renderTempoMap = map;
+            internal.tempoSegment = map->segmentAtTime(time);
+            notifyUpdateThread();
+        }
     }
+
+    // The segment in force only moves on as the clock does, and rarely, so following it is O(1).
+    const std::vector<TempoMap::Segment> & segments = internal.renderTempoMap->segments();
+    size_t & segment = internal.tempoSegment;
+    if (segment && segments[segment].time > time)
+        segment = internal.renderTempoMap->segmentAtTime(time);
+    while (segment + 1 < segments.size() && segments[segment + 1].time <= time)
+        ++segment;
+
+    const TempoMap::Segment & s = segments[segment];
+    TransportPosition & transport = internal.transport;
+    transport.frame = frame;
+    transport.beat = s.beat + (time - s.time) * s.bpm / 60;
+    transport.bar = s.bar + (transport.beat - s.beat) / s.beatsPerBar;
+    transport.bpm = s.bpm;
+    transport.framesPerBeat = sampleRate * 60 / s.bpm;
+    transport.beatsPerBar = s.beatsPerBar;
+    transport.segmentEndFrame = segment + 1 < segments.size() ?
+        static_cast<uint64_t>(std::ceil(segments[segment + 1].time * sampleRate)) : UINT64_MAX;
 }
 
-void AudioContext::setDestinationNode(std::shared_ptr<AudioDestinationNode> node)
+const TransportPosition & AudioContext::transport(ContextRenderLock &) const
 {
-    m_destinationNode = node;
+    return m_internal->transport;
 }
 
-std::shared_ptr<AudioDestinationNode> AudioContext::destination()
+const TempoMap & AudioContext::renderTempoMap(ContextRenderLock &) const
 {
-    return m_destinationNode;
+    return *m_internal->renderTempoMap;
 }
 
-bool AudioContext::isOfflineContext()
+void AudioContext::setTempoMap(const TempoMap & map)
 {
-    return m_isOfflineContext;
+    std::lock_guard<std::mutex> lock(m_internal->tempoMapLock);
+    m_internal->tempoMap = map;
+    m_internal->publishTempoMap();
 }
 
-uint64_t AudioContext::currentSampleFrame() const
+void AudioContext::setTempo(double bpm, unsigned beatsPerBar)
 {
-    return m_destinationNode->currentSampleFrame();
+    // The render thread takes the change up at the earliest at the start of its next quantum.
+    const double when = m_destinationNode ? currentTime() + quantumSeconds() : 0;
+
+    std::lock_guard<std::mutex> lock(m_internal->tempoMapLock);
+    m_internal->tempoMap.setTempo(m_internal->tempoMap.beatAtTime(when), bpm, beatsPerBar);
+    m_internal->publishTempoMap();
 }
 
-double AudioContext::currentTime() const
+TempoMap AudioContext::tempoMap() const
 {
-    return m_destinationNode->currentTime();
+    std::lock_guard<std::mutex> lock(m_internal->tempoMapLock);
+    return m_internal->tempoMap;
 }
 
-float AudioContext::sampleRate() const
+double AudioContext::timeAtBeat(double beat) const
 {
-    ASSERT(m_destinationNode);
-    return m_destinationNode->sampleRate();
+    std::lock_guard<std::mutex> lock(m_internal->tempoMapLock);
+    return m_internal->tempoMap.timeAtBeat(beat);
 }
 
-AudioListener & AudioContext::listener()
+double AudioContext::beatAtTime(double time) const
 {
-    return *m_listener.get();
+    std::lock_guard<std::mutex> lock(m_internal->tempoMapLock);
+    return m_internal->tempoMap.beatAtTime(time);
 }
 
-void AudioContext::startRendering()
+void AudioContext::handlePostRenderTasks(ContextRenderLock & r)
 {
-    destination()->startRendering();
+    ASSERT(r.context());
+
+    if (!m_currentRenderQuantum)
+        markStartupPhase(AudioStartupPhase::FirstQuantum);
+    ++m_currentRenderQuantum;
+}
+
+void AudioContext::connect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+{
+    if (!destination) throw std::runtime_error("Cannot connect to null destination");
+    if (!source) throw std::runtime_error("Cannot connect from null source");
+    if (srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
+    if (destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
+
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::Connect;
+    command.destination = std::move(destination);
+    command.source = std::move(source);
+    command.destIndex = destIdx;
+    command.srcIndex = srcIdx;
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::disconnect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+{
+    if (source && srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
+    if (destination && destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
+
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::Disconnect;
+    command.destination = std::move(destination);
+    command.source = std::move(source);
+    command.destIndex = destIdx;
+    command.srcIndex = srcIdx;
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::connectParam(std::shared_ptr<AudioParam> param, std::shared_ptr<AudioNode> driver, uint32_t index)
+{
+    if (!param) throw std::invalid_argument("No parameter specified");
+    if (index >= driver->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs on the driver");
+
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::ConnectParam;
+    command.param = std::move(param);
+    command.source = std::move(driver);
+    command.srcIndex = index;
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::commitGraphEdits(std::vector<GraphTransaction::Edit> && edits)
+{
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::Batch;
+    command.batch.reset(new std::vector<GraphTransaction::Edit>(std::move(edits)));
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::deferRelease(ContextRenderLock &, std::shared_ptr<void> && object)
+{
+    if (!object)
+        return;
+
+    // Another owner may let go at any moment, so the reference is always handed on, even if it isn't the last
+    // now; use_count() only decides whether to wake the update thread for it.
+    const bool likelyLast = object.use_count() == 1;
+    Internals::DeferredRelease release;
+    release.object = std::move(object);
+    if (m_internal->deferredReleases.tryPush(std::move(release)) && m_internal->countDeferredRelease(likelyLast))
+        notifyUpdateThread();
+}
+
+void AudioContext::deferRelease(ContextRenderLock &, std::unique_ptr<AudioBus> && bus)
+{
+    if (!bus)
+        return;
+
+    Internals::DeferredRelease release;
+    release.bus = std::move(bus);
+    if (m_internal->deferredReleases.tryPush(std::move(release)) && m_internal->countDeferredRelease(true))
+        notifyUpdateThread();
+}
+
+bool AudioContext::deferTask(ContextRenderLock &, std::shared_ptr<DeferredTask> task)
+{
+    if (!task || !m_internal->deferredTasks.tryPush(std::move(task)))
+        return false;
+
+    notifyUpdateThread();
+    return true;
+}
+
+void AudioContext::notifyDisconnectionReady()
+{
+    notifyUpdateThread();
+}
+
+void AudioContext::notifySourceFinished()
+{
+    m_internal->sourcesFinished = true;
+    notifyUpdateThread();
+}
+
+void AudioContext::queueDirtyJunction(ContextGraphLock & g, std::shared_ptr<AudioSummingJunction> junction)
+{
+    m_internal->dirtyJunctions.push(g, std::move(junction));
+}
+
+void AudioContext::notifyUpdateThread()
+{
+    m_internal->updateRequested = true;
+
+    // An attached context is updated by its host's update thread.
+    if (AudioContext * host = m_internal->host)
+    {
+        host->notifyUpdateThread();
+        return;
+    }
+
+    // If the update thread isn't waiting, it is guaranteed to see updateRequested before it next waits.
+    if (m_internal->updateThreadWaiting)
+    {
+        std::lock_guard<std::mutex> lock(m_internal->updateWaitMutex);
+        cv.notify_all();
+    }
+}
+
+bool AudioContext::drainGraphCommands()
+{
+    bool batchSeen = false;
+
+    // Commands are recorded as they're drained, at the frame their graph update is heard from.
+    std::shared_ptr<CommandRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock(m_internal->recorderLock);
+        recorder = m_internal->recorder;
+    }
+    const uint64_t frame = recorder ? currentSampleFrame() : 0;
+    if (recorder)
+        recorder->drain();
+
+    auto record = [&recorder, frame](CommandRecorder::Command type, const std::shared_ptr<AudioNode> & destination, const std::shared_ptr<AudioNode> & source,
+                                     const AudioParam * param, uint32_t destIndex, uint32_t srcIndex)
+    {
+        if (recorder)
+            recorder->recordEdit(frame, type, destination, source, param, destIndex, srcIndex);
+    };
+
+    auto route = [this, &batchSeen, &recorder, &record, frame](Internals::GraphCommand & command)
+    {
+        switch (command.type)
+        {
+        case Internals::GraphCommand::Type::Connect:
+            record(CommandRecorder::Command::Connect, command.destination, command.source, nullptr, command.destIndex, command.srcIndex);
+            pendingNodeConnections.emplace_back(std::move(command.destination), std::move(command.source), ConnectionType::Connect, command.destIndex, command.srcIndex);
+            break;
+        case Internals::GraphCommand::Type::Disconnect:
+            record(CommandRecorder::Command::Disconnect, command.destination, command.source, nullptr, command.destIndex, command.srcIndex);
+            pendingNodeConnections.emplace_back(std::move(command.destination), std::move(command.source), ConnectionType::Disconnect, command.destIndex, command.srcIndex);
+            break;
+        case Internals::GraphCommand::Type::ConnectParam:
+            record(CommandRecorder::Command::ConnectParam, nullptr, command.source, command.param.get(), 0, command.srcIndex);
+            m_internal->pendingParamConnections.emplace_back(std::move(command));
+            break;
+        case Internals::GraphCommand::Type::Batch:
+            if (recorder)
+            {
+                // The transaction's nodes are described first, so that its parameter connections can name them.
+                recorder->recordTransaction(frame, true);
+                for (const auto & edit : *command.batch)
+                {
+                    recorder->recordNode(frame, edit.destination);
+                    recorder->recordNode(frame, edit.source);
+                }
+            }
+            for (auto & edit : *command.batch)
+            {
+                switch (edit.type)
+                {
+                case GraphTransaction::Edit::Type::Connect:
+                    record(CommandRecorder::Command::Connect, edit.destination, edit.source, nullptr, edit.destIndex, edit.srcIndex);
+                    pendingNodeConnections.emplace_back(std::move(edit.destination), std::move(edit.source), ConnectionType::Connect, edit.destIndex, edit.srcIndex);
+                    break;
+                case GraphTransaction::Edit::Type::Disconnect:
+                    record(CommandRecorder::Command::Disconnect, edit.destination, edit.source, nullptr, edit.destIndex, edit.srcIndex);
+                    pendingNodeConnections.emplace_back(std::move(edit.destination), std::move(edit.source), ConnectionType::Disconnect, edit.destIndex, edit.srcIndex);
+                    break;
+                case GraphTransaction::Edit::Type::ConnectParam:
+                {
+                    record(CommandRecorder::Command::ConnectParam, nullptr, edit.source, edit.param.get(), 0, edit.srcIndex);
+                    Internals::GraphCommand param;
+                    param.type = Internals::GraphCommand::Type::ConnectParam;
+                    param.param = std::move(edit.param);
+                    param.source = std::move(edit.source);
+                    param.srcIndex = edit.srcIndex;
+                    m_internal->pendingParamConnections.emplace_back(std::move(param));
+                }
+                break;
+                }
+            }
+            if (recorder)
+                recorder->recordTransaction(frame, false);
+            command.batch.reset();
+            batchSeen = true;
+            break;
+        case Internals::GraphCommand::Type::AddPullNode:
+        case Internals::GraphCommand::Type::RemovePullNode:
+            record(command.type == Internals::GraphCommand::Type::AddPullNode ? CommandRecorder::Command::AddPullNode : CommandRecorder::Command::RemovePullNode,
+                   command.destination, nullptr, nullptr, 0, 0);
+            m_internal->pendingPullNodeEdits.emplace_back(std::move(command));
+            break;
+        case Internals::GraphCommand::Type::HoldSource:
+            record(CommandRecorder::Command::HoldSource, command.destination, nullptr, nullptr, 0, 0);
+            // A source that finished before it was held is picked up by the next scan.
+            if (static_cast<AudioScheduledSourceNode *>(command.destination.get())->hasFinished())
+                m_internal->sourcesFinished = true;
+            automaticSources.push_back(std::static_pointer_cast<AudioScheduledSourceNode>(std::move(command.destination)));
+            break;
+        case Internals::GraphCommand::Type::None:
+            break;
+        }
+    };
+
+    Internals::GraphCommand command;
+    while (m_internal->graphCommands.tryPop(command))
+        route(command);
+
+    if (m_internal->overflowPending.load(std::memory_order_acquire))
+    {
+        std::vector<Internals::GraphCommand> overflow;
+        {
+            std::lock_guard<std::mutex> lock(m_internal->overflowMutex);
+            std::swap(overflow, m_internal->overflowCommands);
+            m_internal->overflowPending.store(false, std::memory_order_release);
+        }
+        for (auto & c : overflow)
+            route(c);
+    }
+
+    return batchSeen;
+}
+
+void AudioContext::update()
+{
+    LOG("Begin UpdateGraphThread");
+
+    // Deferred tasks run here, see DenormalDisabler.
+    DenormalDisabler denormalDisabler;
+
+    // The thread sleeps until it is notified, or until the nearest pending task falls due. Nothing is
+    // polled; with nothing pending, it sleeps until the next graph edit.
+    //
+    // After updateThreadShouldRun has been cleared, the thread stays alive until the disconnections in flight complete.
+    std::chrono::steady_clock::time_point guestWakeAt = std::chrono::steady_clock::time_point::max();
+    while (updateThreadShouldRun || m_internal->disconnectionsPending)
+    {
+        {
+            // A condition variable is used to notify this thread that a graph update is pending
+            // in the command queue. Producers never contend with the graph update itself; they only
+            // take updateWaitMutex, and only while this thread is actually waiting.
+            std::unique_lock<std::mutex> lk(m_internal->updateWaitMutex);
+            m_internal->updateThreadWaiting = true;
+
+            auto requested = [this]() { return m_internal->updateRequested.load(); };
+
+            // While suspended the thread is parked: nothing falls due with the clock standing still, so it
+            // only wakes for graph edits. Disconnections in flight still time out once the context is closing.
+            const bool parked = isSuspended() && updateThreadShouldRun;
+            const std::chrono::steady_clock::time_point wakeAt = std::min(m_internal->updateWakeAt, guestWakeAt);
+            if (wakeAt != std::chrono::steady_clock::time_point::max() && !parked)
+                cv.wait_until(lk, wakeAt, requested);
+            else
+                cv.wait(lk, requested);
+
+            m_internal->updateThreadWaiting = false;
+        }
+
+        updateGraph();
+        guestWakeAt = updateAttachedContexts();
+    }
+
+    LOG("End UpdateGraphThread");
+}
+
+void AudioContext::updateOfflineGraph()
+{
+    updateGraphIfPending();
+}
+
+void AudioContext::updateGraphIfPending()
+{
+    // A pass is only needed while something is pending: an edit, or a connection or disconnection in flight.
+    if (!m_internal->updateRequested && !m_internal->disconnectionsPending &&
+        m_internal->updateWakeAt == std::chrono::steady_clock::time_point::max())
+        return;
+
+    updateGraph();
+}
+
+std::chrono::steady_clock::time_point AudioContext::updateAttachedContexts()
+{
+    std::lock_guard<std::mutex> lock(m_internal->guestLock);
+
+    std::chrono::steady_clock::time_point wakeAt = std::chrono::steady_clock::time_point::max();
+    for (auto & guest : m_internal->guests)
+    {
+        guest.context->updateGraphIfPending();
+        wakeAt = std::min(wakeAt, guest.context->m_internal->updateWakeAt);
+    }
+    return wakeAt;
+}
+
+void AudioContext::updateGraph()
+{
+    using Clock = std::chrono::steady_clock;
+
+    // A deferred connection is made this far ahead of its source's start time, so that the source is wired
+    // in before it begins to play. A disconnection whose ramp never reaches silence, for example because its
+    // node isn't being rendered, is completed after DisconnectionTimeout.
+    const double ScheduledConnectionLookahead = 0.1;
+    const auto DisconnectionTimeout = std::chrono::milliseconds(100);
+
+    LABSOUND_TRACE_SCOPE("graph update");
+
+    m_internal->updateRequested = false;
+
+#if defined(LABSOUND_RT_CHECK)
+    AudioRealtimeCheck::log();
+#endif
+
+    // An offline context updates its graph on its render thread, whose scheduling is the render policy's, and an
+    // attached one on its host's update thread, whose scheduling is the host's.
+    const int background = static_cast<int>(AudioThreadRole::Background);
+    if (!m_isOfflineContext && !m_internal->host &&
+        m_internal->backgroundPolicyApplied != m_internal->policyGeneration[background].load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(m_internal->policyLock);
+        m_internal->backgroundPolicyApplied = m_internal->policyGeneration[background].load();
+        m_internal->policyFailures[background] |= ApplyAudioThreadPolicy(m_internal->policies[background], "graph update", quantumSeconds());
+    }
+
+    if (m_internal->autoDispatchEvents)
+        dispatchEvents();
+
+    m_internal->runDeferredTasks();
+    m_internal->collectGarbage();
+
+    // Owned by whichever thread runs the updates.
+    Clock::time_point & wakeAt = m_internal->updateWakeAt;
+    bool & disconnectionsPending = m_internal->disconnectionsPending;
+
+    const bool batchSeen = drainGraphCommands();
+    handleAutomaticSources();
+
+    ContextGraphLock gLock(this, "AudioContext::Update()");
+
+    // A committed transaction must not be heard half applied, so the render thread adopts nothing until its
+    // edits are made and the schedule reflecting them is published. It keeps rendering meanwhile.
+    std::unique_lock<std::mutex> adoptionLock(m_internal->adoptionLock, std::defer_lock);
+    if (batchSeen)
+        adoptionLock.lock();
+
+    const double now = currentTime();
+    const Clock::time_point wallNow = Clock::now();
+
+    wakeAt = Clock::time_point::max();
+    disconnectionsPending = false;
+
+    // Satisfy parameter connections
+    for (auto & connection : m_internal->pendingParamConnections)
+    {
+        AudioParam::connect(gLock, connection.param, connection.source->output(connection.srcIndex));
+        m_renderScheduleNeedsUpdating = true;
+    }
+    m_internal->pendingParamConnections.clear();
+
+    for (auto & edit : m_internal->pendingPullNodeEdits)
+    {
+        const bool changed = edit.type == Internals::GraphCommand::Type::AddPullNode ?
+            m_automaticPullNodes.insert(std::move(edit.destination)).second :
+            m_automaticPullNodes.erase(edit.destination) > 0;
+        if (changed)
+            m_renderScheduleNeedsUpdating = true;
+    }
+    m_internal->pendingPullNodeEdits.clear();
+
+    // Connections of scheduled sources that have come within the lookahead join this pass's edits.
+    while (!deferredConnections.empty() && deferredConnections.top().due <= now)
+    {
+        pendingNodeConnections.push_back(deferredConnections.top());
+        deferredConnections.pop();
+    }
+
+    // Satisfy node connections
+    for (auto & connection : pendingNodeConnections)
+    {
+        switch (connection.type)
+        {
+        case ConnectionType::Connect:
+        {
+            // defer the connection if the node starts further ahead than the lookahead; its start may have moved
+            if (connection.destination && connection.destination->isScheduledNode())
+            {
+                AudioScheduledSourceNode * node = static_cast<AudioScheduledSourceNode*>(connection.destination.get());
+                connection.due = node->startTime() - ScheduledConnectionLookahead;
+                if (connection.due > now)
+                {
+                    deferredConnections.push(std::move(connection));
+                    continue;
+                }
+            }
+
+            connection.source->scheduleConnect();
+
+            AudioNodeInput::connect(gLock, connection.destination->input(connection.destIndex), connection.source->output(connection.srcIndex));
+            m_renderScheduleNeedsUpdating = true;
+        }
+        break;
+
+        case ConnectionType::Disconnect:
+        {
+            connection.type = ConnectionType::FinishDisconnect;
+            connection.deadline = wallNow + DisconnectionTimeout;
+            if (connection.source)
+            {
+                // if source and destination are specified, then we don't ramp out the destination
+                connection.source->scheduleDisconnect();
+            }
+            else if (connection.destination)
+            {
+                // this case is a disconnect where source is nothing, and destination is something
+                // probably this case should be disallowed because we have to study it to find out
+                // if it is any different than a source with no destination. Answer: it's the same. source or dest by itself means disconnect all
+                connection.destination->scheduleDisconnect();
+            }
+            disconnectionsInFlight.push_back(std::move(connection));
+        }
+        break;
+
+        case ConnectionType::FinishDisconnect:
+            break;
+        }
+    }
+    pendingNodeConnections.clear();
+
+    // The disconnection completes once the ramp has reached silence, which the rendering node
+    // signals through notifyDisconnectionReady(), or else when its deadline passes.
+    for (size_t i = 0; i < disconnectionsInFlight.size();)
+    {
+        PendingConnection & connection = disconnectionsInFlight[i];
+        AudioNode * ramping = connection.source ? connection.source.get() : connection.destination.get();
+        if (ramping && !ramping->disconnectionReady() && wallNow < connection.deadline)
+        {
+            wakeAt = std::min(wakeAt, connection.deadline);
+            disconnectionsPending = true;
+            ++i;
+            continue;
+        }
+
+        if (connection.source && connection.destination)
+        {
+            AudioNodeInput::disconnect(gLock, connection.destination->input(connection.destIndex), connection.source->output(connection.srcIndex));
+        }
+        else if (connection.destination)
+        {
+            for (unsigned int out = 0; out < connection.destination->numberOfOutputs(); ++out)
+            {
+                auto output = connection.destination->output(out);
+                if (!output) continue;
+
+                AudioNodeOutput::disconnectAll(gLock, output);
+            }
+        }
+        else if (connection.source)
+        {
+            for (unsigned int out = 0; out < connection.source->numberOfOutputs(); ++out)
+            {
+                auto output = connection.source->output(out);
+                if (!output) continue;
+
+                AudioNodeOutput::disconnectAll(gLock, output);
+            }
+        }
+
+        m_renderScheduleNeedsUpdating = true;
+        disconnectionsInFlight.erase(disconnectionsInFlight.begin() + i);
+    }
+
+    // Wake up when the nearest deferred connection comes within the lookahead.
+    if (!deferredConnections.empty())
+    {
+        const double dueIn = deferredConnections.top().due - now;
+        wakeAt = std::min(wakeAt, wallNow + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dueIn)));
+    }
+
+    if (m_renderScheduleNeedsUpdating)
+        compileRenderSchedule(gLock);
+}
+
+void AudioContext::addAutomaticPullNode(std::shared_ptr<AudioNode> node)
+{
+    if (!node)
+        return;
+
+    // The update thread owns the set, and publishes it to the render thread with the next schedule.
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::AddPullNode;
+    command.destination = std::move(node);
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::removeAutomaticPullNode(std::shared_ptr<AudioNode> node)
+{
+    if (!node)
+        return;
+
+    Internals::GraphCommand command;
+    command.type = Internals::GraphCommand::Type::RemovePullNode;
+    command.destination = std::move(node);
+    m_internal->push(std::move(command));
+    notifyUpdateThread();
+}
+
+void AudioContext::processAutomaticPullNodes(ContextRenderLock & r, size_t framesToProcess)
+{
+    // The pull nodes are referenced by the render schedule, so that a removed node is released with a retired
+    // schedule on the update thread rather than here.
+    if (!m_internal->renderSchedule)
+        return;
+
+    for (auto & node : m_internal->renderSchedule->automaticPullNodes)
+        node->processIfNecessary(r, framesToProcess);
+}
+
+void AudioContext::compileRenderSchedule(ContextGraphLock & g)
+{
+    m_renderScheduleNeedsUpdating = false;
+
+    std::vector<AudioNode *> roots;
+    if (m_destinationNode) roots.push_back(m_destinationNode.get());
+    for (auto & node : m_automaticPullNodes)
+        roots.push_back(node.get());
+
+    // Depth first search from the roots, emitting each node after everything feeding its inputs
+    // and parameters. A node's level is one more than the deepest level it depends on, so each level
+    // only depends on earlier ones.
+    //
+    // A dependency that is still on the stack closes a feedback cycle (such as through a DelayNode). The
+    // nodes of the cycle above that ancestor are owned by it and left out of the schedule: the recursive
+    // pull reaches them while the ancestor is processed and they read its output from the previous quantum,
+    // exactly as without a schedule. Nodes depending on a cycle are placed after the node owning it.
+    struct Visit
+    {
+        bool done;
+        bool scheduled;
+        size_t level;
+        size_t depth;
+        AudioNode * owner;
+    };
+    std::unordered_map<AudioNode *, Visit> visits;
+
+    struct Frame
+    {
+        AudioNode * node;
+        std::shared_ptr<AudioNodeOutput> handle;
+        std::vector<std::shared_ptr<AudioNodeOutput>> dependencies;
+        size_t next;
+        size_t level;
+    };
+
+    struct Step
+    {
+        std::shared_ptr<AudioNodeOutput> handle;
+        size_t level;
+    };
+
+    std::vector<Step> steps;
+    std::vector<Frame> stack;
+    size_t levelCount = 0;
+
+    auto push = [&](AudioNode * node, std::shared_ptr<AudioNodeOutput> handle)
+    {
+        visits[node] = { false, false, 0, stack.size(), nullptr };
+        stack.push_back({node, handle, {}, 0, 0});
+        Frame & frame = stack.back();
+        for (auto & input : node->m_inputs)
+            input->connectedOutputs(g, frame.dependencies);
+        for (auto & param : node->m_params)
+            param->connectedOutputs(g, frame.dependencies);
+    };
+
+    auto schedule = [&](Visit & visit, std::shared_ptr<AudioNodeOutput> handle)
+    {
+        visit.scheduled = true;
+        steps.push_back({handle, visit.level});
+        levelCount = std::max(levelCount, visit.level + 1);
+    };
+
+    auto owner = [&](AudioNode * node)
+    {
+        while (visits[node].owner)
+            node = visits[node].owner;
+        return node;
+    };
+
+    for (AudioNode * root : roots)
+    {
+        if (visits.find(root) != visits.end())
+            continue;
+
+        push(root, nullptr);
+
+        while (!stack.empty())
+        {
+            Frame & frame = stack.back();
+            if (frame.next < frame.dependencies.size())
+            {
+                std::shared_ptr<AudioNodeOutput> output = frame.dependencies[frame.next++];
+                AudioNode * dependency = output->node();
+                if (!dependency)
+                    continue;
+
+                if (visits.find(dependency) == visits.end())
+                {
+                    push(dependency, output);
+                    continue;
+                }
+
+                Visit & visit = visits[dependency];
+                AudioNode * head = owner(dependency);
+                Visit & headVisit = visits[head];
+
+                if (!headVisit.done)
+                {
+                    // Feedback: everything on the stack above the head of the cycle is owned by it.
+                    for (size_t i = headVisit.depth + 1; i < stack.size(); ++i)
+                    {
+                        Visit & member = visits[stack[i].node];
+                        if (!member.owner)
+                            member.owner = head;
+                    }
+                }
+                else
+                {
+                    // A root found upstream of another root must run inside the schedule as well, since
+                    // it is otherwise only processed after the destination has pulled.
+                    if (head == dependency && !visit.scheduled)
+                        schedule(visit, output);
+
+                    frame.level = std::max(frame.level, headVisit.level + 1);
+                }
+
+                if (visit.done)
+                    frame.level = std::max(frame.level, visit.level + 1);
+                continue;
+            }
+
+            Visit & visit = visits[frame.node];
+            visit.done = true;
+            visit.level = frame.level;
+
+            // Roots are processed by the destination and processAutomaticPullNodes() themselves.
+            if (frame.handle && !visit.owner)
+                schedule(visit, frame.handle);
+
+            AudioNode * finished = frame.node;
+            stack.pop_back();
+
+            // The node that pushed this one depends on it like on any node visited before.
+            if (!stack.empty())
+            {
+                Visit & headVisit = visits[owner(finished)];
+                if (headVisit.done)
+                    stack.back().level = std::max(stack.back().level, headVisit.level + 1);
+                stack.back().level = std::max(stack.back().level, visit.level + 1);
+            }
+        }
+    }
+
+    // Order the steps by level. The sort is stable, so within a level the depth first order is kept.
+    std::unique_ptr<Internals::RenderSchedule> compiled(new Internals::RenderSchedule());
+    compiled->levels.assign(levelCount + 1, 0);
+    for (auto & step : steps)
+        compiled->levels[step.level + 1] += 1;
+    for (size_t i = 1; i <= levelCount; ++i)
+        compiled->levels[i] += compiled->levels[i - 1];
+
+    std::vector<size_t> cursor(compiled->levels.begin(), compiled->levels.end() - 1);
+    compiled->steps.resize(steps.size());
+    compiled->serialOrder.reserve(steps.size());
+    for (auto & step : steps)
+    {
+        compiled->serialOrder.push_back(static_cast<uint32_t>(cursor[step.level]));
+        compiled->steps[cursor[step.level]++] = step.handle;
+    }
+
+    compiled->automaticPullNodes.assign(m_automaticPullNodes.begin(), m_automaticPullNodes.end());
+
+    std::unordered_map<AudioNode *, uint32_t> stepIndices;
+    for (size_t i = 0; i < compiled->steps.size(); ++i)
+        if (auto handle = compiled->steps[i].lock())
+            stepIndices[handle->node()] = static_cast<uint32_t>(i);
+
+    const uint32_t unscheduled = static_cast<uint32_t>(compiled->steps.size());
+    std::vector<std::shared_ptr<AudioNodeOutput>> feeding;
+    compiled->feederOffsets.reserve(compiled->steps.size() + 1);
+    for (auto & step : compiled->steps)
+    {
+        compiled->feederOffsets.push_back(static_cast<uint32_t>(compiled->feeders.size()));
+
+        auto handle = step.lock();
+        if (!handle || !handle->node())
+            continue;
+
+        feeding.clear();
+        for (auto & input : handle->node()->m_inputs)
+            input->connectedOutputs(g, feeding);
+        for (auto & output : feeding)
+        {
+            auto found = stepIndices.find(output->node());
+            compiled->feeders.push_back(found != stepIndices.end() ? found->second : unscheduled);
+        }
+    }
+    compiled->feederOffsets.push_back(static_cast<uint32_t>(compiled->feeders.size()));
+
+    // The schedule is walked up from the destination, so everything feeding it is a step.
+    if (m_destinationNode)
+    {
+        feeding.clear();
+        for (auto & input : m_destinationNode->m_inputs)
+            input->connectedOutputs(g, feeding);
+        for (auto & output : feeding)
+        {
+            auto found = stepIndices.find(output->node());
+            if (found != stepIndices.end())
+                compiled->destinationFeeders.push_back(found->second);
+        }
+        ASSERT(compiled->destinationFeeders.size() == feeding.size());
+    }
+    compiled->pathLatencies.resize(compiled->steps.size());
+    compiled->stepLatencies.resize(compiled->steps.size());
+
+    compiled->dormant.reset(new uint8_t[compiled->steps.size() + 1]());
+
+    std::vector<std::weak_ptr<AudioNodeOutput>> emitters;
+    for (auto & step : compiled->steps)
+    {
+        auto handle = step.lock();
+        if (handle && dynamic_cast<PannerNode *>(handle->node()))
+            emitters.push_back(step);
+    }
+    if (!emitters.empty())
+        compiled->spatialBatch.reset(new SpatialBatch(std::move(emitters)));
+
+    // Plan the shared buses like registers: every bus is live from the step producing it to its last
+    // consumer, and a bus no longer live is handed to the next result with the same channel count. An output
+    // only takes part if all of its consumers are steps, so neither a root, a feedback cycle nor an
+    // automation connection ever reads a bus after it has been reused. A summing input is only live while
+    // its own step is processed. The buses feeding a node that aliases its inputs may be read through its
+    // outputs for the rest of the quantum, so they are never shared.
+    struct Lifetime
+    {
+        uint32_t step;
+        uint32_t slot;
+        size_t channels;
+        uint32_t lastSerial; // serial position of the last consumer
+        uint32_t lastLevel;  // level of the last consumer
+        size_t unseenConsumers;
+    };
+    std::vector<Lifetime> lifetimes;
+
+    std::vector<uint32_t> serialPosition(compiled->steps.size());
+    for (size_t i = 0; i < compiled->serialOrder.size(); ++i)
+        serialPosition[compiled->serialOrder[i]] = static_cast<uint32_t>(i);
+
+    std::vector<uint32_t> stepLevel(compiled->steps.size());
+    for (size_t level = 0; level + 1 < compiled->levels.size(); ++level)
+        for (size_t i = compiled->levels[level]; i < compiled->levels[level + 1]; ++i)
+            stepLevel[i] = static_cast<uint32_t>(level);
+
+    std::unordered_map<AudioNodeOutput *, size_t> outputLifetimes;
+    for (uint32_t i = 0; i < compiled->steps.size(); ++i)
+    {
+        compiled->outputOffsets.push_back(static_cast<uint32_t>(outputLifetimes.size()));
+        auto handle = compiled->steps[i].lock();
+        if (!handle || !handle->node())
+            continue;
+
+        for (auto & output : handle->node()->m_outputs)
+        {
+            uint32_t slot = static_cast<uint32_t>(outputLifetimes.size());
+            size_t consumers = output->fanOutCount() + output->paramFanOutCount();
+            outputLifetimes[output.get()] = lifetimes.size();
+            lifetimes.push_back({i, slot, consumers ? output->numberOfChannels() : 0, serialPosition[i], stepLevel[i], consumers});
+        }
+    }
+    const uint32_t outputCount = static_cast<uint32_t>(outputLifetimes.size());
+    compiled->outputOffsets.push_back(outputCount);
+
+    uint32_t slotCount = outputCount;
+    for (uint32_t i = 0; i < compiled->steps.size(); ++i)
+    {
+        compiled->inputOffsets.push_back(slotCount);
+        auto handle = compiled->steps[i].lock();
+        if (!handle || !handle->node())
+            continue;
+
+        AudioNode * node = handle->node();
+        const bool aliased = node->aliasesInputs();
+        for (auto & input : node->m_inputs)
+        {
+            feeding.clear();
+            input->connectedOutputs(g, feeding);
+
+            size_t summedChannels = 1;
+            for (auto & output : feeding)
+            {
+                summedChannels = std::max(summedChannels, output->numberOfChannels());
+
+                auto found = outputLifetimes.find(output.get());
+                if (found == outputLifetimes.end())
+                    continue;
+                Lifetime & lifetime = lifetimes[found->second];
+                lifetime.lastSerial = std::max(lifetime.lastSerial, serialPosition[i]);
+                lifetime.lastLevel = std::max(lifetime.lastLevel, stepLevel[i]);
+                lifetime.unseenConsumers -= lifetime.unseenConsumers ? 1 : 0;
+                if (aliased)
+                    lifetime.channels = 0;
+            }
+
+            // A single connection is read straight from the connected output; only a sum needs a bus.
+            if (feeding.size() > 1 && !aliased)
+            {
+                if (node->channelCountMode() == ChannelCountMode::Explicit)
+                    summedChannels = node->channelCount();
+                else if (node->channelCountMode() == ChannelCountMode::ClampedMax)
+                    summedChannels = std::min(summedChannels, node->channelCount());
+                lifetimes.push_back({i, slotCount, summedChannels, serialPosition[i], stepLevel[i], 0});
+            }
+            ++slotCount;
+        }
+    }
+    compiled->inputOffsets.push_back(slotCount);
+
+    auto planBuses = [&](Internals::RenderSchedule::BusPlan & plan, bool serial)
+    {
+        std::vector<const Lifetime *> order;
+        for (auto & lifetime : lifetimes)
+            if (lifetime.channels && !lifetime.unseenConsumers)
+                order.push_back(&lifetime);
+
+        auto first = [&](const Lifetime * l) { return serial ? serialPosition[l->step] : stepLevel[l->step]; };
+        auto last = [&](const Lifetime * l) { return serial ? l->lastSerial : l->lastLevel; };
+        std::stable_sort(order.begin(), order.end(), [&](const Lifetime * a, const Lifetime * b) { return first(a) < first(b); });
+
+        typedef std::pair<uint32_t, size_t> Live; // last use, index into the pool
+        std::priority_queue<Live, std::vector<Live>, std::greater<Live>> live;
+        std::unordered_map<size_t, std::vector<size_t>> available; // by channel count
+
+        plan.buses.assign(slotCount, nullptr);
+        for (const Lifetime * lifetime : order)
+        {
+            while (!live.empty() && live.top().first < first(lifetime))
+            {
+                available[plan.pool[live.top().second]->numberOfChannels()].push_back(live.top().second);
+                live.pop();
+            }
+
+            std::vector<size_t> & candidates = available[lifetime->channels];
+            size_t index;
+            if (candidates.empty())
+            {
+                index = plan.pool.size();
+                plan.pool.emplace_back(new AudioBus(lifetime->channels, m_renderQuantumSize));
+            }
+            else
+            {
+                index = candidates.back();
+                candidates.pop_back();
+            }
+
+            plan.buses[lifetime->slot] = plan.pool[index].get();
+            live.push({last(lifetime), index});
+        }
+    };
+    // Graph optimization, see setGraphOptimization(). A rewritten step hands on a bus it was fed, which has to stay
+    // valid for the rest of the quantum, so only an input with a single connection qualifies, as it is read straight
+    // from the connected output, and that output keeps its own bus rather than a shared one.
+    if (m_graphOptimization.load())
+    {
+        typedef Internals::RenderSchedule::Rewrite Rewrite;
+        compiled->rewrites.assign(compiled->steps.size(), Rewrite{ Rewrite::None, unscheduled });
+        compiled->handedOn.reset(new AudioBus *[compiled->steps.size()]());
+
+        auto soleFeeder = [&](AudioNodeInput & input) -> std::shared_ptr<AudioNodeOutput>
+        {
+            feeding.clear();
+            input.connectedOutputs(g, feeding);
+            return feeding.size() == 1 ? feeding.front() : nullptr;
+        };
+
+        // The input that the output feeds, if it feeds nothing else.
+        auto soleConsumer = [](AudioNodeOutput & output) -> AudioNodeInput *
+        {
+            return output.fanOutCount() == 1 && !output.paramFanOutCount() ? output.m_inputs.front().get() : nullptr;
+        };
+
+        auto keepOwnBus = [&](const std::shared_ptr<AudioNodeOutput> & output)
+        {
+            auto found = outputLifetimes.find(output.get());
+            if (found != outputLifetimes.end())
+                lifetimes[found->second].channels = 0;
+        };
+
+        auto is = [](AudioNode * node, const std::type_info & type) { return node && typeid(*node) == type; };
+
+        for (uint32_t i = 0; i < compiled->steps.size(); ++i)
+        {
+            auto handle = compiled->steps[i].lock();
+            AudioNode * node = handle ? handle->node() : nullptr;
+            std::shared_ptr<AudioNodeOutput> feeder;
+
+            if (is(node, typeid(GainNode)))
+            {
+                // A gain driven by a connection is never settled.
+                if (static_cast<GainNode *>(node)->gain()->numberOfConnections() || !(feeder = soleFeeder(*node->m_inputs[0])))
+                    continue;
+
+                Rewrite & rewrite = compiled->rewrites[i];
+                rewrite.kind = Rewrite::Gain;
+
+                AudioNodeInput * consumer = soleConsumer(*node->m_outputs[0]);
+                AudioNode * next = consumer ? consumer->node() : nullptr;
+                if (is(next, typeid(GainNode)) && consumer == next->m_inputs[0].get() && consumer->numberOfConnections() == 1)
+                {
+                    auto found = stepIndices.find(next);
+                    if (found != stepIndices.end())
+                        rewrite.partner = found->second;
+                }
+                keepOwnBus(feeder);
+            }
+            else if (is(node, typeid(ChannelSplitterNode)))
+            {
+                // Each output k feeds only input k of the same merger, which has no other connections.
+                const size_t channels = node->m_outputs.size();
+                AudioNodeInput * consumer = channels ? soleConsumer(*node->m_outputs[0]) : nullptr;
+                AudioNode * merger = consumer ? consumer->node() : nullptr;
+                if (!is(merger, typeid(ChannelMergerNode)) || merger->m_inputs.size() != channels)
+                    continue;
+
+                bool identity = true;
+                for (size_t k = 0; identity && k < channels; ++k)
+                    identity = soleConsumer(*node->m_outputs[k]) == merger->m_inputs[k].get() && merger->m_inputs[k]->numberOfConnections() == 1;
+
+                auto found = stepIndices.find(merger);
+                if (!identity || found == stepIndices.end() || !(feeder = soleFeeder(*node->m_inputs[0])))
+                    continue;
+
+                compiled->rewrites[i] = Rewrite{ Rewrite::Splitter, found->second };
+                keepOwnBus(feeder);
+            }
+        }
+    }
+
+    planBuses(compiled->serialPlan, true);
+    planBuses(compiled->parallelPlan, false);
+
+    // Nodes are registered with the profiler when they're first scheduled, the members of feedback cycles too.
+    {
+        std::lock_guard<std::mutex> lock(m_internal->profileLock);
+        for (auto & visit : visits)
+        {
+            NodeProfileRecord * record = visit.first->m_profile.get();
+            if (!record || record->registered)
+                continue;
+
+            record->registered = true;
+            record->type = NodeTypeName(*visit.first);
+            record->node = visit.first;
+            m_internal->profileRecords.push_back(visit.first->m_profile);
+        }
+    }
+
+    m_internal->publishSchedule(compiled.release());
+}
+
+void AudioContext::processScheduledNode(ContextRenderLock & r, size_t step, size_t framesToProcess)
+{
+    Internals::RenderSchedule & schedule = *m_internal->renderSchedule;
+
+    std::shared_ptr<AudioNodeOutput> output = schedule.steps[step].lock();
+    if (!output)
+        return;
+
+    // Taken first, so that nothing handed on outlives the quantum.
+    AudioBus * handedOn = nullptr;
+    if (!schedule.rewrites.empty())
+        std::swap(handedOn, schedule.handedOn[step]);
+
+    AudioNode * node = output->node();
+    if (!node || node->isProcessedThisQuantum(r))
+    {
+        deferRelease(r, std::move(output));
+        return;
+    }
+
+    // The outputs are directed to their buses first, so that a dormant node silences those rather than a bus it
+    // rendered into, or passed through, in an earlier quantum.
+    const Internals::RenderSchedule::BusPlan * plan = m_internal->busPlan;
+    auto sharedBus = [&](const std::vector<uint32_t> & offsets, size_t k) -> AudioBus *
+    {
+        return plan && offsets[step] + k < offsets[step + 1] ? plan->buses[offsets[step] + k] : nullptr;
+    };
+
+    for (size_t k = 0; k < node->m_outputs.size(); ++k)
+        node->m_outputs[k]->prepareScheduledRender(r, sharedBus(schedule.outputOffsets, k));
+
+    // An idle node fed only by idle nodes is not processed at all; its outputs are already silent. Feeders
+    // are in earlier levels, so their flags are already up to date for this quantum.
+    if (m_internal->skipDormantNodes && schedule.dormant[step])
+    {
+        bool dormant = true;
+        for (uint32_t i = schedule.feederOffsets[step]; dormant && i < schedule.feederOffsets[step + 1]; ++i)
+            dormant = schedule.dormant[schedule.feeders[i]] != 0;
+
+        if (dormant && node->propagatesSilence(r))
+        {
+            node->renderDormant(r);
+            deferRelease(r, std::move(output));
+            return;
+        }
+    }
+
+    if (plan)
+        for (size_t k = 0; k < node->m_inputs.size(); ++k)
+            node->m_inputs[k]->setSharedSummingBus(r, sharedBus(schedule.inputOffsets, k));
+
+    // Graph optimization only applies where the schedule describes every consumer, as the bus plan does.
+    bool rewritten = false;
+    if (plan && !schedule.rewrites.empty())
+    {
+        const Internals::RenderSchedule::Rewrite & rewrite = schedule.rewrites[step];
+        std::shared_ptr<AudioNodeOutput> partner;
+        if (rewrite.partner < schedule.steps.size())
+            partner = schedule.steps[rewrite.partner].lock();
+        AudioNode * partnerNode = partner ? partner->node() : nullptr;
+
+        if (handedOn)
+        {
+            rewritten = node->renderPassThrough(r, handedOn, framesToProcess);
+        }
+        else if (rewrite.kind == Internals::RenderSchedule::Rewrite::Gain)
+        {
+            rewritten = static_cast<GainNode *>(node)->renderFolded(r, framesToProcess, static_cast<GainNode *>(partnerNode));
+        }
+        else if (rewrite.kind == Internals::RenderSchedule::Rewrite::Splitter && partnerNode)
+        {
+            // The merger puts the channels back as they were, provided there are as many as the splitter has
+            // outputs. The graph lock keeps the ramps and channel counts checked here until the merger renders.
+            AudioBus * source = node->rampsSettled() && partnerNode->rampsSettled() ? node->m_inputs[0]->pull(r, nullptr, framesToProcess) : nullptr;
+            if (source && source->numberOfChannels() == node->m_outputs.size() && partner->numberOfChannels() == node->m_outputs.size())
+            {
+                node->renderBypassed(r);
+                schedule.handedOn[rewrite.partner] = source;
+                rewritten = true;
+            }
+        }
+
+        if (partner)
+            deferRelease(r, std::move(partner));
+    }
+
+    // Everything this node depends on has already been processed, so pulling its inputs only gathers
+    // the rendered buses. Connections made after the schedule was compiled are still pulled recursively.
+    if (!rewritten)
+        node->processIfNecessary(r, framesToProcess);
+    schedule.dormant[step] = node->isDormant();
+
+    if (plan)
+        for (auto & in : node->m_inputs)
+            in->setSharedSummingBus(r, nullptr);
+
+    // Settle any channel count change made while pulling the inputs now, so that the consumers in later
+    // levels, which may run concurrently with each other, find the output already up to date.
+    for (auto & out : node->m_outputs)
+        out->updateRenderingState(r);
+
+    deferRelease(r, std::move(output));
+}
+
+namespace
+{
+    struct ParallelLevel
+    {
+        AudioContext * context;
+        ContextRenderLock * renderLock;
+        size_t firstStep;
+        size_t framesToProcess;
+    };
+}
+
+void AudioContext::updatePathLatencies(ContextRenderLock & r)
+{
+    Internals::RenderSchedule & schedule = *m_internal->renderSchedule;
+    const size_t count = schedule.steps.size();
+    std::vector<double> & path = schedule.pathLatencies;
+    std::vector<double> & latency = schedule.stepLatencies;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::shared_ptr<AudioNodeOutput> handle = schedule.steps[i].lock();
+        latency[i] = handle && handle->node() ? handle->node()->latencyTime(r) : 0;
+        path[i] = -1;
+        deferRelease(r, std::move(handle));
+    }
+
+    // The destination has no latency of its own; what it adds is baseLatency().
+    for (uint32_t step : schedule.destinationFeeders)
+        path[step] = 0;
+
+    // A step's feeders are all in earlier levels, so walking the steps backwards reaches every consumer of a
+    // step before the step itself.
+    for (size_t i = count; i-- > 0;)
+    {
+        if (path[i] < 0)
+            continue;
+        const double through = path[i] + latency[i];
+        for (uint32_t k = schedule.feederOffsets[i]; k < schedule.feederOffsets[i + 1]; ++k)
+        {
+            const uint32_t feeder = schedule.feeders[k];
+            if (feeder < count)
+                path[feeder] = std::max(path[feeder], through);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::shared_ptr<AudioNodeOutput> handle = schedule.steps[i].lock();
+        if (handle && handle->node())
+            handle->node()->m_pathLatency.store(path[i], std::memory_order_relaxed);
+        deferRelease(r, std::move(handle));
+    }
+}
+
+double AudioContext::pathLatency(const AudioNode & node) const
+{
+    return node.m_pathLatency.load(std::memory_order_relaxed);
+}
+
+double AudioContext::presentationLatency(const AudioNode & node) const
+{
+    const double path = pathLatency(node);
+    return path < 0 ? path : path + baseLatency() + outputLatency();
+}
+
+void AudioContext::processRenderSchedule(ContextRenderLock & r, size_t framesToProcess)
+{
+    // No output may keep rendering into a shared bus of the schedule being retired. A schedule is not adopted
+    // without the connections it was compiled from, which are held back while a transaction is applied.
+    bool adoptedSchedule = !m_internal->adoptionHeld && m_internal->adoptSchedule([this, &r](Internals::RenderSchedule & retired)
+    {
+        for (size_t i = 0; i < retired.steps.size(); ++i)
+        {
+            std::shared_ptr<AudioNodeOutput> handle = retired.steps[i].lock();
+            AudioNode * node = handle ? handle->node() : nullptr;
+            for (size_t k = 0; node && k < node->m_outputs.size() && retired.outputOffsets[i] + k < retired.outputOffsets[i + 1]; ++k)
+            {
+                node->m_outputs[k]->releaseSharedBus(r, retired.serialPlan.buses[retired.outputOffsets[i] + k]);
+                node->m_outputs[k]->releaseSharedBus(r, retired.parallelPlan.buses[retired.outputOffsets[i] + k]);
+            }
+            if (node)
+                node->m_pathLatency.store(-1, std::memory_order_relaxed);
+            deferRelease(r, std::move(handle));
+        }
+    });
+
+    // Let the update thread free the schedule just retired.
+    if (adoptedSchedule)
+        notifyUpdateThread();
+
+    // A node's latency may change without the graph changing, as a convolver's impulse is set, so the path
+    // latencies are worked out again every so often.
+    const uint64_t PathLatencyInterval = 16;
+    if (Internals::RenderSchedule * schedule = m_internal->renderSchedule)
+    {
+        if (adoptedSchedule || m_currentRenderQuantum - schedule->pathLatencyQuantum >= PathLatencyInterval)
+        {
+            updatePathLatencies(r);
+            schedule->pathLatencyQuantum = m_currentRenderQuantum;
+        }
+    }
+
+    m_internal->skipDormantNodes = !adoptedSchedule;
+
+    // A graph snapshot asks for the nodes' latency and tail, which are only read while rendering.
+    const uint32_t snapshot = m_internal->snapshotRequested.load(std::memory_order_acquire);
+    if (snapshot != m_internal->snapshotReported.load(std::memory_order_relaxed))
+    {
+        auto report = [&r, snapshot](AudioNode * node)
+        {
+            node->m_reportedLatency.store(node->latencyTime(r), std::memory_order_relaxed);
+            node->m_reportedTail.store(node->tailTime(r), std::memory_order_relaxed);
+            node->m_reportedGeneration.store(snapshot, std::memory_order_release);
+        };
+
+        if (m_destinationNode)
+            report(m_destinationNode.get());
+        if (Internals::RenderSchedule * schedule = m_internal->renderSchedule)
+        {
+            for (const std::weak_ptr<AudioNodeOutput> & step : schedule->steps)
+            {
+                std::shared_ptr<AudioNodeOutput> handle = step.lock();
+                if (handle && handle->node())
+                    report(handle->node());
+                deferRelease(r, std::move(handle));
+            }
+            for (auto & node : schedule->automaticPullNodes)
+                report(node.get());
+        }
+
+        m_internal->snapshotReported.store(snapshot, std::memory_order_release);
+    }
+
+    if (Internals::MemoryRequest * request = m_internal->memoryRequest.exchange(nullptr, std::memory_order_acq_rel))
+        request->run(r);
+
+    if (!m_internal->renderSchedule)
+        return;
+
+    Internals::RenderSchedule & schedule = *m_internal->renderSchedule;
+
+    if (schedule.spatialBatch)
+        schedule.spatialBatch->update(r);
+
+    // Parallel rendering is only safe while the graph holds still and the schedule describes it completely.
+    // Holding the graph lock keeps the update thread from editing connections during the quantum, and the
+    // first quantum after a topology change runs serially because that is where rendering state and channel
+    // counts of new connections are picked up.
+    //
+    // The shared buses are planned for exactly the graph the schedule was compiled from, so they are only
+    // used under the same condition, by serial rendering as well.
+    std::unique_lock<std::mutex> graphLock;
+    if (!adoptedSchedule && !m_internal->pendingSchedule.load())
+        graphLock = std::unique_lock<std::mutex>(m_graphLock, std::try_to_lock);
+
+    // An attached context renders on its host's render thread, between the host's own uses of its pool.
+    RenderWorkerPool * workers = m_internal->workers.get();
+    if (!workers && m_internal->host)
+        workers = m_internal->host->m_internal->workers.get();
+
+    if (!workers || !graphLock.owns_lock())
+    {
+        m_internal->busPlan = graphLock.owns_lock() ? &schedule.serialPlan : nullptr;
+        m_internal->idleWorkers = workers;
+        for (uint32_t step : schedule.serialOrder)
+            processScheduledNode(r, step, framesToProcess);
+        m_internal->idleWorkers = nullptr;
+        return;
+    }
+
+    m_internal->busPlan = &schedule.parallelPlan;
+
+    ParallelLevel level = { this, &r, 0, framesToProcess };
+    for (size_t i = 0; i + 1 < schedule.levels.size(); ++i)
+    {
+        level.firstStep = schedule.levels[i];
+
+        // A node alone in its level is rendered here, with the workers left to it.
+        if (schedule.levels[i + 1] - schedule.levels[i] == 1)
+        {
+            m_internal->idleWorkers = workers;
+            processScheduledNode(r, level.firstStep, framesToProcess);
+            m_internal->idleWorkers = nullptr;
+            continue;
+        }
+
+        workers->run([](void * userData, size_t index)
+        {
+            ParallelLevel * level = static_cast<ParallelLevel *>(userData);
+            level->context->processScheduledNode(*level->renderLock, level->firstStep + index, level->framesToProcess);
+        }, &level, schedule.levels[i + 1] - schedule.levels[i]);
+    }
+}
+
+void AudioContext::setRenderWorkerCount(size_t count)
+{
+    std::unique_ptr<RenderWorkerPool> workers;
+    if (count)
+        workers.reset(new RenderWorkerPool(count, threadPolicy(AudioThreadRole::RenderWorkers), quantumSeconds()));
+
+    {
+        ContextRenderLock r(this, "AudioContext::setRenderWorkerCount");
+        std::swap(m_internal->workers, workers);
+    }
+
+    // The retired pool's threads are joined here, outside of the render lock.
+}
+
+void AudioContext::setChannelLimit(size_t channels)
+{
+    m_channelLimit.store(std::max(size_t(1), std::min(channels, maxChannelLimit)), std::memory_order_relaxed);
+}
+
+void AudioContext::runOnIdleRenderWorkers(ContextRenderLock & r, void (*task)(void * userData, size_t index), void * userData, size_t count)
+{
+    // A worker rendering a node of a parallel level finds no idle workers, as the render thread clears them
+    // before handing the level out.
+    if (RenderWorkerPool * workers = m_internal->idleWorkers)
+    {
+        if (count > 1)
+        {
+            m_internal->idleWorkers = nullptr;
+            workers->run(task, userData, count);
+            m_internal->idleWorkers = workers;
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        task(userData, i);
+}
+
+void AudioContext::setDeclickLength(size_t frames)
+{
+    std::vector<float> fadeIn, fadeOut;
+    computeDeclickCurves(frames, fadeIn, fadeOut);
+
+    ContextRenderLock r(this, "AudioContext::setDeclickLength");
+    std::swap(m_internal->declickFadeIn, fadeIn);
+    std::swap(m_internal->declickFadeOut, fadeOut);
+}
+
+size_t AudioContext::declickLength() const
+{
+    return m_internal->declickFadeOut.size();
+}
+
+const float * AudioContext::declickFadeIn() const
+{
+    return m_internal->declickFadeIn.data();
+}
+
+const float * AudioContext::declickFadeOut() const
+{
+    return m_internal->declickFadeOut.data();
+}
+
+size_t AudioContext::renderWorkerCount() const
+{
+    return m_internal->workers ? m_internal->workers->workerCount() : 0;
+}
+
+void AudioContext::setGraphOptimization(bool enabled)
+{
+    if (m_graphOptimization.exchange(enabled) == enabled)
+        return;
+
+    // The rewrites are planned when the schedule is compiled.
+    m_renderScheduleNeedsUpdating = true;
+    notifyUpdateThread();
+}
+
+double AudioContext::quantumSeconds() const
+{
+    return m_destinationNode ? m_renderQuantumSize / static_cast<double>(m_destinationNode->sampleRate()) : 0;
+}
+
+void AudioContext::setThreadPolicy(AudioThreadRole role, const AudioThreadPolicy & policy)
+{
+    const int index = static_cast<int>(role);
+    {
+        std::lock_guard<std::mutex> lock(m_internal->policyLock);
+        m_internal->policies[index] = policy;
+        m_internal->policyFailures[index] = 0;
+        m_internal->policyGeneration[index].fetch_add(1, std::memory_order_release);
+    }
+
+    switch (role)
+    {
+    case AudioThreadRole::Render:
+        break;
+
+    case AudioThreadRole::RenderWorkers:
+        if (size_t count = renderWorkerCount())
+            setRenderWorkerCount(count);
+        break;
+
+    case AudioThreadRole::Background:
+        BackgroundConvolverPool::setSharedThreadPolicy(policy, quantumSeconds());
+        notifyUpdateThread();
+        break;
+    }
+}
+
+AudioThreadPolicy AudioContext::threadPolicy(AudioThreadRole role) const
+{
+    std::lock_guard<std::mutex> lock(m_internal->policyLock);
+    return m_internal->policies[static_cast<int>(role)];
+}
+
+unsigned AudioContext::threadPolicyFailures(AudioThreadRole role) const
+{
+    const int index = static_cast<int>(role);
+    unsigned failures = m_internal->policyFailures[index].load();
+    if (role == AudioThreadRole::RenderWorkers && m_internal->workers)
+        failures |= m_internal->workers->policyFailures();
+    else if (role == AudioThreadRole::Background)
+        failures |= BackgroundConvolverPool::sharedPolicyFailures();
+    return failures;
+}
+
+void AudioContext::applyRenderThreadPolicy()
+{
+    // The host's render thread keeps the host's policy.
+    if (m_internal->host)
+        return;
+
+    const int index = static_cast<int>(AudioThreadRole::Render);
+    const uint32_t generation = m_internal->policyGeneration[index].load(std::memory_order_acquire);
+    if (generation == m_internal->renderPolicyApplied && std::this_thread::get_id() == m_internal->renderPolicyThread)
+        return;
+
+    // The render thread doesn't wait for the lock; it tries again next quantum.
+    std::unique_lock<std::mutex> lock(m_internal->policyLock, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    m_internal->renderPolicyApplied = m_internal->policyGeneration[index].load();
+    m_internal->renderPolicyThread = std::this_thread::get_id();
+    m_internal->policyFailures[index] |= ApplyAudioThreadPolicy(m_internal->policies[index], "render", quantumSeconds());
+}
+
+void AudioContext::setProfiling(bool enabled)
+{
+#if defined(LABSOUND_PROFILER)
+    std::lock_guard<std::mutex> lock(m_internal->profileLock);
+    if (enabled != isProfiling())
+        m_profilingEpoch.store(enabled ? m_internal->beginProfilingPeriod(m_currentRenderQuantum) : 0);
+#else
+    if (enabled)
+    {
+        LOG_ERROR("Profiling needs LabSound to be built with LABSOUND_PROFILER");
+    }
+#endif
+}
+
+AudioGraphSnapshot AudioContext::snapshotGraph()
+{
+    AudioGraphSnapshot snapshot;
+    snapshot.sampleRate = m_destinationNode ? m_destinationNode->sampleRate() : 0;
+    snapshot.quantumSeconds = quantumSeconds();
+
+    std::lock_guard<std::mutex> snapshotLock(m_internal->snapshotLock);
+
+    // Ask the render thread for the nodes' latency and tail, and give it a few quanta to answer.
+    uint32_t generation = m_internal->snapshotRequested.load() + 1;
+    if (!generation)
+        generation = 1;
+    m_internal->snapshotRequested.store(generation, std::memory_order_release);
+    if (m_isInitialized && m_destinationNode)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(std::max(0.02, 4 * snapshot.quantumSeconds));
+        while (m_internal->snapshotReported.load(std::memory_order_acquire) != generation && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::map<const AudioNode *, AudioNodeProfile> costs;
+    if (isProfiling())
+    {
+        snapshot.profiled = true;
+        for (AudioNodeProfile & cost : profile().nodes)
+            costs[cost.node] = cost;
+    }
+
+    ContextGraphLock g(this, "AudioContext::snapshotGraph");
+
+    std::vector<AudioNode *> roots;
+    if (m_destinationNode)
+        roots.push_back(m_destinationNode.get());
+    for (auto & node : m_automaticPullNodes)
+        roots.push_back(node.get());
+
+    // Breadth first upstream from the roots, through inputs and parameters alike.
+    std::unordered_map<AudioNode *, size_t> indices;
+    std::vector<AudioNode *> nodes;
+    auto indexOf = [&](AudioNode * node)
+    {
+        auto found = indices.find(node);
+        if (found != indices.end())
+            return found->second;
+        indices[node] = nodes.size();
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    };
+    auto outputIndex = [](AudioNode * node, const AudioNodeOutput * output)
+    {
+        for (size_t k = 0; k < node->m_outputs.size(); ++k)
+            if (node->m_outputs[k].get() == output)
+                return k;
+        return size_t(0);
+    };
+
+    for (AudioNode * root : roots)
+        indexOf(root);
+
+    const uint64_t currentFrame = currentSampleFrame();
+    std::vector<std::shared_ptr<AudioNodeOutput>> connected;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        AudioNode * node = nodes[i];
+
+        AudioGraphSnapshot::Node entry;
+        entry.type = NodeTypeName(*node);
+        entry.node = node;
+        entry.channelCount = node->m_channelCount;
+        entry.dormant = node->isDormant();
+        if (snapshot.sampleRate > 0)
+            entry.silentSeconds = std::max(0.0, (static_cast<double>(currentFrame) - static_cast<double>(node->m_lastNonSilentFrame)) / snapshot.sampleRate);
+
+        if (node->m_reportedGeneration.load(std::memory_order_acquire) == generation)
+        {
+            entry.latencySeconds = node->m_reportedLatency.load(std::memory_order_relaxed);
+            entry.tailSeconds = node->m_reportedTail.load(std::memory_order_relaxed);
+        }
+
+        auto cost = costs.find(node);
+        if (cost != costs.end())
+        {
+            entry.meanSeconds = cost->second.meanSeconds;
+            entry.budgetPercent = cost->second.budgetPercent;
+        }
+
+        for (auto & output : node->m_outputs)
+            entry.outputChannels.push_back(output->numberOfChannels());
+
+        for (size_t k = 0; k < node->m_inputs.size(); ++k)
+        {
+            connected.clear();
+            node->m_inputs[k]->connectedOutputs(g, connected);
+
+            size_t channels = 0;
+            for (auto & output : connected)
+            {
+                AudioNode * source = output->node();
+                if (!source)
+                    continue;
+                channels = std::max(channels, output->numberOfChannels());
+                const size_t sourceIndex = indexOf(source);
+                snapshot.connections.push_back({ sourceIndex, outputIndex(source, output.get()), i, k });
+            }
+            entry.inputChannels.push_back(channels);
+        }
+
+        for (auto & param : node->m_params)
+        {
+            AudioGraphSnapshot::Param p;
+            p.name = param->name();
+            p.value = param->smoothedValue();
+
+            connected.clear();
+            param->connectedOutputs(g, connected);
+            for (auto & output : connected)
+                if (AudioNode * driver = output->node())
+                    p.drivers.push_back(indexOf(driver));
+
+            entry.params.push_back(std::move(p));
+        }
+
+        snapshot.nodes.push_back(std::move(entry));
+    }
+
+    return snapshot;
+}
+
+AudioMemoryReport AudioContext::memoryReport()
+{
+    AudioMemoryReport report;
+
+    ContextGraphLock g(this, "AudioContext::memoryReport");
+
+    // Breadth first upstream from the roots, through inputs and parameters alike, as snapshotGraph() walks.
+    std::vector<AudioNode *> nodes;
+    std::unordered_set<AudioNode *> found;
+    auto visit = [&](AudioNode * node)
+    {
+        if (node && found.insert(node).second)
+            nodes.push_back(node);
+    };
+
+    if (m_destinationNode)
+        visit(m_destinationNode.get());
+    for (auto & node : m_automaticPullNodes)
+        visit(node.get());
+
+    std::vector<std::shared_ptr<AudioNodeOutput>> connected;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        AudioNode * node = nodes[i];
+        for (auto & input : node->m_inputs)
+        {
+            connected.clear();
+            input->connectedOutputs(g, connected);
+            for (auto & output : connected)
+                visit(output->node());
+        }
+        for (auto & param : node->m_params)
+        {
+            connected.clear();
+            param->connectedOutputs(g, connected);
+            for (auto & output : connected)
+                visit(output->node());
+        }
+    }
+
+    // The entries are made before any node reports, so that they stay put while the nodes add to them.
+    report.nodes.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        report.nodes[i].type = NodeTypeName(*nodes[i]);
+        report.nodes[i].node = nodes[i];
+    }
+
+    std::lock_guard<std::mutex> memoryLock(m_internal->memoryReportLock);
+
+    // The nodes report into room reserved for them, so that the render thread needn't allocate; should they
+    // need more, they report again with twice the room.
+    const bool rendering = m_isInitialized && m_destinationNode;
+    for (size_t room = 4;; room *= 2)
+    {
+        report.shared.clear();
+        report.shared.reserve(room * nodes.size());
+        for (AudioMemoryReport::Node & entry : report.nodes)
+        {
+            std::fill(std::begin(entry.bytes), std::end(entry.bytes), size_t(0));
+            entry.shared.clear();
+            entry.shared.reserve(room);
+        }
+
+        Internals::MemoryRequest request;
+        request.report = &report;
+        request.nodes = &nodes;
+        m_internal->memoryRequest.store(&request, std::memory_order_release);
+
+        // A request the render thread hasn't taken up in a few quanta is taken back, as the context isn't
+        // rendering, and the nodes report here; rendering that starts meanwhile waits for them.
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(std::max(0.02, 4 * quantumSeconds()));
+        while (rendering && !request.done.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (m_internal->memoryRequest.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            ContextRenderLock r(this, "AudioContext::memoryReport");
+            request.run(r);
+        }
+        while (!request.done.load(std::memory_order_acquire))
+            std::this_thread::yield();
+
+        if (!request.overflowed)
+            break;
+    }
+
+    report.channelArenaBytes = AudioChannelArena::bytesReserved();
+    report.channelArenaBytesInUse = AudioChannelArena::bytesInUse();
+    return report;
+}
+
+AudioProfile AudioContext::profile(bool reset)
+{
+    AudioProfile profile;
+    profile.quantumSeconds = quantumSeconds();
+
+    std::lock_guard<std::mutex> lock(m_internal->profileLock);
+    const uint32_t epoch = m_profilingEpoch.load();
+    if (!epoch)
+        return profile;
+
+    Internals & internals = *m_internal;
+    profile.quanta = m_currentRenderQuantum - internals.profileStartQuantum;
+
+    const uint64_t elapsedTicks = ProfileTicks() - internals.profileStartTicks;
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - internals.profileStartTime).count();
+    const double secondsPerTick = elapsedTicks ? elapsedSeconds / static_cast<double>(elapsedTicks) : 0;
+    const double budgetSeconds = static_cast<double>(profile.quanta) * profile.quantumSeconds;
+
+    typedef std::vector<uint64_t> Histogram;
+
+    // The middle of the bucket holding the 99th percentile, within the range of times seen.
+    auto percentile99 = [](const Histogram & histogram, uint64_t calls, uint64_t minTicks, uint64_t maxTicks)
+    {
+        const uint64_t rank = calls - calls / 100;
+        uint64_t seen = 0;
+        for (int b = 0; b < NodeProfileRecord::BucketCount; ++b)
+        {
+            seen += histogram[b];
+            if (seen >= rank)
+                return std::max(std::min(NodeProfileRecord::bucketTicks(b), static_cast<double>(maxTicks)), static_cast<double>(minTicks));
+        }
+        return static_cast<double>(maxTicks);
+    };
+
+    struct Totals
+    {
+        AudioNodeProfile profile;
+        uint64_t totalTicks = 0;
+        uint64_t minTicks = UINT64_MAX;
+        uint64_t maxTicks = 0;
+        Histogram histogram = Histogram(NodeProfileRecord::BucketCount, 0);
+    };
+
+    auto complete = [&](Totals & totals)
+    {
+        AudioNodeProfile & p = totals.profile;
+        p.minSeconds = totals.minTicks * secondsPerTick;
+        p.maxSeconds = totals.maxTicks * secondsPerTick;
+        p.meanSeconds = p.calls ? totals.totalTicks * secondsPerTick / p.calls : 0;
+        p.p99Seconds = percentile99(totals.histogram, p.calls, totals.minTicks, totals.maxTicks) * secondsPerTick;
+        p.budgetPercent = budgetSeconds > 0 ? 100 * totals.totalTicks * secondsPerTick / budgetSeconds : 0;
+        return p;
+    };
+
+    std::map<std::string, Totals> types;
+    auto & records = internals.profileRecords;
+    records.erase(std::remove_if(records.begin(), records.end(), [](const std::shared_ptr<NodeProfileRecord> & record)
+    {
+        return record.use_count() == 1;
+    }), records.end());
+
+    for (auto & record : records)
+    {
+        // A record not written since the period began holds an earlier period's times.
+        if (record->epoch.load(std::memory_order_acquire) != epoch)
+            continue;
+
+        Totals node;
+        node.profile.type = record->type;
+        node.profile.node = record->node;
+        node.profile.instances = 1;
+        node.profile.calls = record->calls.load(std::memory_order_relaxed);
+        node.totalTicks = record->totalTicks.load(std::memory_order_relaxed);
+        node.minTicks = record->minTicks.load(std::memory_order_relaxed);
+        node.maxTicks = record->maxTicks.load(std::memory_order_relaxed);
+        for (int b = 0; b < NodeProfileRecord::BucketCount; ++b)
+            node.histogram[b] = record->histogram[b].load(std::memory_order_relaxed);
+        if (!node.profile.calls)
+            continue;
+
+        profile.nodes.push_back(complete(node));
+
+        Totals & type = types[record->type];
+        type.profile.type = record->type;
+        type.profile.instances += 1;
+        type.profile.calls += node.profile.calls;
+        type.totalTicks += node.totalTicks;
+        type.minTicks = std::min(type.minTicks, node.minTicks);
+        type.maxTicks = std::max(type.maxTicks, node.maxTicks);
+        for (int b = 0; b < NodeProfileRecord::BucketCount; ++b)
+            type.histogram[b] += node.histogram[b];
+    }
+
+    for (auto & type : types)
+        profile.types.push_back(complete(type.second));
+
+    auto costlier = [](const AudioNodeProfile & a, const AudioNodeProfile & b) { return a.budgetPercent > b.budgetPercent; };
+    std::sort(profile.nodes.begin(), profile.nodes.end(), costlier);
+    std::sort(profile.types.begin(), profile.types.end(), costlier);
+
+    if (reset)
+        m_profilingEpoch.store(internals.beginProfilingPeriod(m_currentRenderQuantum));
+
+    return profile;
+}
+
+uint64_t AudioContext::lockTicks()
+{
+    return ProfileTicks();
+}
+
+void AudioContext::setLockProfiling(bool enabled)
+{
+    Internals & internals = *m_internal;
+    std::lock_guard<std::mutex> lock(internals.lockProfileLock);
+    if (enabled == isLockProfiling())
+        return;
+
+    if (enabled)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            if (!internals.lockRecordStorage[i])
+            {
+                internals.lockRecordStorage[i].reset(new LockProfileRecords());
+                internals.lockRecords[i].store(internals.lockRecordStorage[i].get(), std::memory_order_release);
+            }
+        }
+        internals.beginLockProfilingPeriod();
+    }
+    m_lockProfiling.store(enabled);
+}
+
+void AudioContext::recordLockUse(bool renderLock, const char * holder, const ContextLockTiming & timing)
+{
+    LockProfileRecords * records = m_internal->lockRecords[renderLock ? 1 : 0].load(std::memory_order_acquire);
+    if (!records)
+        return;
+
+    const uint32_t epoch = m_internal->lockProfileEpoch.load(std::memory_order_relaxed);
+    const uint64_t released = ProfileTicks();
+    const uint64_t waitTicks = timing.acquired - timing.requested;
+    const uint64_t holdTicks = released - timing.acquired;
+
+    LockHolderRecord & record = records->recordFor(holder ? holder : "(unnamed)");
+    record.beginEpoch(epoch);
+    LockHolderRecord::add(record.acquisitions, 1);
+    LockHolderRecord::add(record.waitTicks, waitTicks);
+    LockHolderRecord::raise(record.maxWaitTicks, waitTicks);
+    LockHolderRecord::add(record.holdTicks, holdTicks);
+    LockHolderRecord::raise(record.maxHoldTicks, holdTicks);
+    LockHolderRecord::add(record.waitHistogram[LockHolderRecord::bucket(waitTicks)], 1);
+    LockHolderRecord::add(record.holdHistogram[LockHolderRecord::bucket(holdTicks)], 1);
+
+    if (timing.contended)
+    {
+        LockHolderRecord::add(record.contended, 1);
+        if (timing.blocker)
+        {
+            LockHolderRecord & blocker = records->recordFor(timing.blocker);
+            blocker.beginEpoch(epoch);
+            LockHolderRecord::add(blocker.blockedOthers, 1);
+            LockHolderRecord::add(blocker.blockedOthersTicks, waitTicks);
+            LockHolderRecord::raise(blocker.maxBlockedOthersTicks, waitTicks);
+        }
+    }
+}
+
+AudioLockProfile AudioContext::lockProfile(bool reset)
+{
+    AudioLockProfile profile;
+
+    Internals & internals = *m_internal;
+    std::lock_guard<std::mutex> lock(internals.lockProfileLock);
+    if (!internals.lockRecords[0].load())
+        return profile;
+
+    const uint64_t elapsedTicks = ProfileTicks() - internals.lockProfileStartTicks;
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - internals.lockProfileStartTime).count();
+    const double secondsPerTick = elapsedTicks ? elapsedSeconds / static_cast<double>(elapsedTicks) : 0;
+    const uint32_t epoch = internals.lockProfileEpoch.load();
+
+    for (int b = 0; b < LockHolderRecord::BucketCount; ++b)
+        profile.bucketSeconds.push_back(LockHolderRecord::bucketLowTicks(b) * secondsPerTick);
+
+    // The top of the bucket holding the 99th percentile, within the longest time seen.
+    auto percentile99 = [&](const std::vector<uint64_t> & histogram, uint64_t count, uint64_t maxTicks)
+    {
+        const uint64_t rank = count - count / 100;
+        uint64_t seen = 0;
+        for (int b = 0; b < LockHolderRecord::BucketCount; ++b)
+        {
+            seen += histogram[b];
+            if (seen >= rank)
+                return std::min(LockHolderRecord::bucketLowTicks(b + 1), static_cast<double>(maxTicks)) * secondsPerTick;
+        }
+        return maxTicks * secondsPerTick;
+    };
+
+    struct Totals
+    {
+        AudioLockHolderProfile profile;
+        uint64_t waitTicks = 0;
+        uint64_t maxWaitTicks = 0;
+        uint64_t holdTicks = 0;
+        uint64_t maxHoldTicks = 0;
+        uint64_t blockedOthersTicks = 0;
+        uint64_t maxBlockedOthersTicks = 0;
+    };
+
+    auto gather = [&](LockProfileRecords & records, std::vector<AudioLockHolderProfile> & holders)
+    {
+        // Suitors with the same name, from different places, are one holder.
+        std::map<std::string, Totals> byName;
+        for (LockHolderRecord & record : records.holders)
+        {
+            const char * holder = record.holder.load(std::memory_order_acquire);
+            if (!holder || record.epoch.load(std::memory_order_acquire) != epoch)
+                continue;
+
+            Totals & totals = byName[holder];
+            AudioLockHolderProfile & p = totals.profile;
+            if (p.holder.empty())
+            {
+                p.holder = holder;
+                p.waitHistogram.assign(LockHolderRecord::BucketCount, 0);
+                p.holdHistogram.assign(LockHolderRecord::BucketCount, 0);
+            }
+            p.acquisitions += record.acquisitions.load(std::memory_order_relaxed);
+            p.contended += record.contended.load(std::memory_order_relaxed);
+            p.blockedOthers += record.blockedOthers.load(std::memory_order_relaxed);
+            totals.waitTicks += record.waitTicks.load(std::memory_order_relaxed);
+            totals.holdTicks += record.holdTicks.load(std::memory_order_relaxed);
+            totals.blockedOthersTicks += record.blockedOthersTicks.load(std::memory_order_relaxed);
+            totals.maxWaitTicks = std::max(totals.maxWaitTicks, record.maxWaitTicks.load(std::memory_order_relaxed));
+            totals.maxHoldTicks = std::max(totals.maxHoldTicks, record.maxHoldTicks.load(std::memory_order_relaxed));
+            totals.maxBlockedOthersTicks = std::max(totals.maxBlockedOthersTicks, record.maxBlockedOthersTicks.load(std::memory_order_relaxed));
+            for (int b = 0; b < LockHolderRecord::BucketCount; ++b)
+            {
+                p.waitHistogram[b] += record.waitHistogram[b].load(std::memory_order_relaxed);
+                p.holdHistogram[b] += record.holdHistogram[b].load(std::memory_order_relaxed);
+            }
+        }
+
+        for (auto & entry : byName)
+        {
+            Totals & totals = entry.second;
+            AudioLockHolderProfile & p = totals.profile;
+            p.maxWaitSeconds = totals.maxWaitTicks * secondsPerTick;
+            p.maxHoldSeconds = totals.maxHoldTicks * secondsPerTick;
+            p.blockedOthersSeconds = totals.blockedOthersTicks * secondsPerTick;
+            p.maxBlockedOthersSeconds = totals.maxBlockedOthersTicks * secondsPerTick;
+            if (p.acquisitions)
+            {
+                p.meanWaitSeconds = totals.waitTicks * secondsPerTick / p.acquisitions;
+                p.meanHoldSeconds = totals.holdTicks * secondsPerTick / p.acquisitions;
+                p.p99WaitSeconds = percentile99(p.waitHistogram, p.acquisitions, totals.maxWaitTicks);
+                p.p99HoldSeconds = percentile99(p.holdHistogram, p.acquisitions, totals.maxHoldTicks);
+            }
+            holders.push_back(std::move(p));
+        }
+
+        std::sort(holders.begin(), holders.end(), [](const AudioLockHolderProfile & a, const AudioLockHolderProfile & b)
+        {
+            if (a.blockedOthersSeconds != b.blockedOthersSeconds)
+                return a.blockedOthersSeconds > b.blockedOthersSeconds;
+            return a.maxHoldSeconds > b.maxHoldSeconds;
+        });
+    };
+
+    gather(*internals.lockRecords[0].load(), profile.graphLock);
+    gather(*internals.lockRecords[1].load(), profile.renderLock);
+
+    if (reset)
+        internals.beginLockProfilingPeriod();
+
+    return profile;
+}
+
+bool AudioContext::enqueueEvent(void (*callback)(void * payload), const void * payload, size_t payloadSize)
+{
+    ASSERT(payloadSize <= Event::PayloadSize);
+    if (!callback || payloadSize > Event::PayloadSize)
+        return false;
+
+    Event event;
+    event.callback = callback;
+    if (payloadSize)
+        memcpy(event.payload, payload, payloadSize);
+
+    if (!m_internal->enqueuedEvents.tryPush(std::move(event)))
+    {
+        m_internal->eventOverflowCount.fetch_add(1);
+        return false;
+    }
+
+    notifyUpdateThread();    // processing thread must dispatch events
+    return true;
+}
+
+void AudioContext::enqueueEvent(std::function<void()>& fn)
+{
+    if (!fn)
+        return;
+
+    std::function<void()> * boxed = new std::function<void()>(fn);
+    auto dispatch = [](void * payload)
+    {
+        std::function<void()> * fn;
+        memcpy(&fn, payload, sizeof(fn));
+        (*fn)();
+        delete fn;
+    };
+
+    if (!enqueueEvent(dispatch, &boxed, sizeof(boxed)))
+        delete boxed;
+}
+
+uint64_t AudioContext::eventOverflowCount() const
+{
+    return m_internal->eventOverflowCount.load();
+}
+
+void AudioContext::dispatchEvents()
+{
+    // Events posted by the callbacks themselves wait for the next call, so a callback that keeps posting
+    // can't keep this loop running.
+    Event event;
+    for (size_t i = 0, n = m_internal->enqueuedEvents.capacity(); i < n && m_internal->enqueuedEvents.tryPop(event); ++i)
+        event.callback(event.payload);
+}
+
+void AudioContext::setDestinationNode(std::shared_ptr<AudioDestinationNode> node)
+{
+    m_destinationNode = node;
+}
+
+std::shared_ptr<AudioDestinationNode> AudioContext::destination()
+{
+    return m_destinationNode;
+}
+
+bool AudioContext::isOfflineContext()
+{
+    return m_isOfflineContext;
+}
+
+uint64_t AudioContext::currentSampleFrame() const
+{
+    return m_destinationNode->currentSampleFrame();
+}
+
+double AudioContext::currentTime() const
+{
+    return m_destinationNode->currentTime();
+}
+
+float AudioContext::sampleRate() const
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->sampleRate();
+}
+
+double AudioContext::baseLatency() const
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->baseLatency();
+}
+
+double AudioContext::outputLatency() const
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->outputLatency();
+}
+
+double AudioContext::inputLatency() const
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->inputLatency();
+}
+
+double AudioContext::roundTripLatency() const
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->roundTripLatency();
+}
+
+AudioRenderHealth AudioContext::renderHealth(bool reset)
+{
+    ASSERT(m_destinationNode);
+    return m_destinationNode->renderHealth(reset);
+}
+
+AudioListener & AudioContext::listener()
+{
+    return *m_listener.get();
+}
+
+void AudioContext::startRendering()
+{
+    destination()->startRendering();
+}
+
+void AudioContext::attachContext(AudioContext & guest)
+{
+    if (&guest == this || m_internal->host || guest.m_internal->host || !guest.m_internal->guests.empty())
+        throw std::invalid_argument("Contexts can only be attached to one unattached host");
+    if (m_isOfflineContext || guest.m_isOfflineContext)
+        throw std::invalid_argument("Offline contexts can't be attached");
+    if (guest.m_isInitialized)
+        throw std::invalid_argument("A context must be attached before it's initialized");
+    if (!std::dynamic_pointer_cast<AttachedAudioDestinationNode>(guest.m_destinationNode))
+        throw std::invalid_argument("An attached context needs an AttachedAudioDestinationNode");
+    if (guest.sampleRate() != sampleRate() || guest.renderQuantumSize() != renderQuantumSize())
+        throw std::invalid_argument("An attached context must render at its host's sample rate and quantum size");
+
+    Internals::Guest entry;
+    entry.context = &guest;
+    entry.destination = guest.m_destinationNode.get();
+    entry.bus.reset(new AudioBus(entry.destination->channelCount(), renderQuantumSize()));
+
+    std::lock_guard<std::mutex> lock(m_internal->guestLock);
+    ContextRenderLock r(this, "AudioContext::attachContext");
+    guest.m_internal->host = this;
+    m_internal->guests.push_back(std::move(entry));
+}
+
+void AudioContext::detachContext(AudioContext & guest)
+{
+    std::unique_ptr<AudioBus> bus;
+    {
+        std::lock_guard<std::mutex> lock(m_internal->guestLock);
+        ContextRenderLock r(this, "AudioContext::detachContext");
+        for (auto i = m_internal->guests.begin(); i != m_internal->guests.end(); ++i)
+        {
+            if (i->context == &guest)
+            {
+                bus = std::move(i->bus);
+                m_internal->guests.erase(i);
+                break;
+            }
+        }
+        guest.m_internal->host = nullptr;
+    }
+}
+
+bool AudioContext::isAttached() const
+{
+    return m_internal->host != nullptr;
+}
+
+void AudioContext::renderAttachedContexts(ContextRenderLock &, AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess)
+{
+    for (auto & guest : m_internal->guests)
+    {
+        // Only reallocated if the destination hands over buses of another length.
+        if (guest.bus->length() != destinationBus->length())
+            guest.bus.reset(new AudioBus(guest.destination->channelCount(), destinationBus->length()));
+
+        guest.destination->render(sourceBus, guest.bus.get(), framesToProcess);
+        destinationBus->sumFrom(*guest.bus);
+    }
+}
+
+void AudioContext::suspend()
+{
+    if (m_isOfflineContext || isSuspended())
+        return;
+
+    // Set first, so that a callback the device makes before it stops renders silence without pulling the graph.
+    m_suspended.store(true, std::memory_order_release);
+    if (m_isInitialized && m_destinationNode)
+        m_destinationNode->stopRendering();
+}
+
+void AudioContext::resume()
+{
+    if (!isSuspended())
+        return;
+
+    m_suspended.store(false, std::memory_order_release);
+    if (m_isInitialized && !m_isAudioThreadFinished && m_destinationNode)
+        m_destinationNode->startRendering();
+
+    // Anything that fell due while parked is seen to now.
+    notifyUpdateThread();
 }
 
 } // End namespace lab
@@ -5,30 +5,37 @@
 #include "LabSound/core/AudioDestinationNode.h"
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioListener.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSourceProvider.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 
+#include "internal/AmbisonicField.h"
 #include "internal/Assertions.h"
 #include "internal/AudioUtilities.h"
 #include "internal/DenormalDisabler.h"
+#include "internal/RealtimeCheck.h"
+#include "internal/Trace.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 
 namespace lab
 {
 
 // LocalAudioInputProvider allows us to expose an AudioSourceProvider for local/live audio input.
-// If there is local/live audio input, we call set() with the audio input data every render quantum.
+// The destination calls set() with the bus the hardware handed it every render quantum, which is lent to the
+// provider's clients without being copied, and cleared once the quantum has been rendered.
 class AudioDestinationNode::LocalAudioInputProvider : public AudioSourceProvider
 {
-    AudioBus m_sourceBus;
+    AudioBus * m_liveBus = nullptr;
 
 public:
-    LocalAudioInputProvider(size_t channelCount)
-        : m_sourceBus(channelCount, AudioNode::ProcessingSizeInFrames)
+    LocalAudioInputProvider()
     {
         epoch[0] = epoch[1] = std::chrono::high_resolution_clock::now();
     }
@@ -39,15 +46,25 @@ public:
 
     void set(AudioBus * bus)
     {
-        if (bus) m_sourceBus.copyFrom(*bus);
+        m_liveBus = bus;
     }
 
     // AudioSourceProvider.
-    virtual void provideInput(AudioBus * destinationBus, size_t numberOfFrames)
+    virtual void provideInput(AudioBus * destinationBus, size_t numberOfFrames) override
     {
-        bool isGood = destinationBus && destinationBus->length() == numberOfFrames && m_sourceBus.length() == numberOfFrames;
-        ASSERT(isGood);
-        if (isGood) destinationBus->copyFrom(m_sourceBus);
+        if (!destinationBus)
+            return;
+
+        AudioBus * live = inputBus(numberOfFrames);
+        if (live)
+            destinationBus->copyFrom(*live);
+        else
+            destinationBus->zero();
+    }
+
+    virtual AudioBus * inputBus(size_t numberOfFrames) override
+    {
+        return m_liveBus && m_liveBus->length() == numberOfFrames ? m_liveBus : nullptr;
     }
 
     // Counts the number of sample-frames processed by the destination.
@@ -58,11 +75,31 @@ public:
     std::chrono::high_resolution_clock::time_point epoch[2];
 };
 
+struct AudioDestinationNode::RenderHealth
+{
+    static const int RecentXruns = 16;
+
+    // Only the render thread adds to the sums and raises the maxima; a reset exchanges them for zero.
+    std::atomic<uint64_t> renders{ 0 };
+    std::atomic<uint64_t> deadlineMisses{ 0 };
+    std::atomic<double> loadSum{ 0 };
+    std::atomic<double> maxLoad{ 0 };
+    std::atomic<double> maxLockWait{ 0 };
+    std::atomic<uint64_t> loadHistogram[AudioRenderHealth::LoadBuckets] = {};
+    std::atomic<double> recentLoad{ 0 };
+
+    // The sample frame of each xrun, in a ring indexed by the count.
+    std::atomic<uint64_t> xruns{ 0 };
+    std::atomic<uint64_t> xrunsAtReset{ 0 };
+    std::atomic<uint64_t> xrunFrames[RecentXruns] = {};
+};
+
 AudioDestinationNode::AudioDestinationNode(AudioContext * context, size_t channelCount, float sampleRate)
     : m_sampleRate(sampleRate)
     , m_context(context)
+    , m_health(new RenderHealth())
 {
-    m_localAudioInputProvider = new LocalAudioInputProvider(channelCount);
+    m_localAudioInputProvider = new LocalAudioInputProvider();
 
     addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
 
@@ -95,9 +132,28 @@ void AudioDestinationNode::render(AudioBus * sourceBus, AudioBus * destinationBu
     if (!m_context)
         return;
 
+    // A suspended context renders nothing, and its sample clock stands still.
+    if (m_context->isSuspended())
+    {
+        destinationBus->zero();
+        return;
+    }
+
+    LABSOUND_TRACE_SCOPE("render quantum");
+    LABSOUND_REALTIME_SCOPE();
+
+    // The render is timed against the duration of the audio it renders. An offline render has no deadline.
+    const bool timed = !m_context->isOfflineContext();
+    const std::chrono::steady_clock::time_point renderStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+    // The render thread takes up a new scheduling policy before it renders the quantum.
+    m_context->applyRenderThreadPolicy();
+
+    const std::chrono::steady_clock::time_point lockStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     ContextRenderLock renderLock(m_context, "AudioDestinationNode::render");
     if (!renderLock.context())
         return;  // return if couldn't acquire lock
+    const std::chrono::steady_clock::time_point locked = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
 
     if (!m_context->isInitialized())
     {
@@ -116,9 +172,14 @@ void AudioDestinationNode::render(AudioBus * sourceBus, AudioBus * destinationBu
     // Let the context take care of any business at the start of each render quantum.
     m_context->handlePreRenderTasks(renderLock);
 
-    // Prepare the local audio input provider for this render quantum.
-    if (sourceBus)
-        m_localAudioInputProvider->set(sourceBus);
+    // Lend the live input to the local audio input provider for this render quantum.
+    m_localAudioInputProvider->set(sourceBus);
+
+    // Render the compiled schedule so that the graph feeding the destination is processed in dependency order.
+    {
+        LABSOUND_TRACE_SCOPE("render schedule");
+        m_context->processRenderSchedule(renderLock, numberOfFrames);
+    }
 
     /// @TODO why is only input 0 processed?
 
@@ -138,14 +199,113 @@ void AudioDestinationNode::render(AudioBus * sourceBus, AudioBus * destinationBu
     // Process nodes which need a little extra help because they are not connected to anything, but still need to process.
     m_context->processAutomaticPullNodes(renderLock, numberOfFrames);
 
+    // Every ambisonic source has now been encoded, so the listener's field is decoded once for all of them.
+    m_context->listener().ambisonicField().decode(renderLock, destinationBus, numberOfFrames);
+
+    // Contexts attached to this one are rendered in the same callback, and heard through the same device.
+    m_context->renderAttachedContexts(renderLock, sourceBus, destinationBus, numberOfFrames);
+
     // Let the context take care of any business at the end of each render quantum.
     m_context->handlePostRenderTasks(renderLock);
 
+    // The hardware's input is only valid for the quantum.
+    m_localAudioInputProvider->set(nullptr);
+
     // Advance current sample-frame.
     int index = 1 - (m_localAudioInputProvider->m_currentSampleFrame & 1);
     m_localAudioInputProvider->epoch[index] = std::chrono::high_resolution_clock::now();
     uint64_t t = m_localAudioInputProvider->m_currentSampleFrame & ~1;
     m_localAudioInputProvider->m_currentSampleFrame = t + numberOfFrames * 2 + index;
+
+    if (timed && numberOfFrames)
+    {
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(end - renderStart).count();
+        recordRender(seconds * m_sampleRate / numberOfFrames, std::chrono::duration<double>(locked - lockStart).count(), numberOfFrames / static_cast<double>(m_sampleRate));
+    }
+}
+
+void AudioDestinationNode::recordRender(double load, double lockWait, double renderedSeconds)
+{
+    RenderHealth & health = *m_health;
+
+    // An exponential average, weighted by the audio each render produced, whatever the quantum size.
+    const double RecentLoadSeconds = 0.25;
+    const double weight = 1 - std::exp(-renderedSeconds / RecentLoadSeconds);
+    const double recent = health.recentLoad.load(std::memory_order_relaxed);
+    health.recentLoad.store(recent + (load - recent) * weight, std::memory_order_relaxed);
+
+    health.renders.fetch_add(1, std::memory_order_relaxed);
+    health.loadSum.store(health.loadSum.load(std::memory_order_relaxed) + load, std::memory_order_relaxed);
+    if (load > health.maxLoad.load(std::memory_order_relaxed))
+        health.maxLoad.store(load, std::memory_order_relaxed);
+    if (lockWait > health.maxLockWait.load(std::memory_order_relaxed))
+        health.maxLockWait.store(lockWait, std::memory_order_relaxed);
+
+    const int bucket = std::min(static_cast<int>(load * 8), AudioRenderHealth::LoadBuckets - 1);
+    health.loadHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (load > 1)
+    {
+        health.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+        postHealthEvent(AudioRenderHealthEvent::Type::DeadlineMiss, currentTime(), load);
+    }
+}
+
+void AudioDestinationNode::reportXrun()
+{
+    const uint64_t frame = currentSampleFrame();
+    const uint64_t index = m_health->xruns.fetch_add(1, std::memory_order_relaxed);
+    m_health->xrunFrames[index % RenderHealth::RecentXruns].store(frame, std::memory_order_relaxed);
+    postHealthEvent(AudioRenderHealthEvent::Type::Xrun, frame / static_cast<double>(m_sampleRate), 0);
+}
+
+void AudioDestinationNode::postHealthEvent(AudioRenderHealthEvent::Type type, double time, double load)
+{
+    if (!m_context || !m_context->renderHealthCallback)
+        return;
+
+    struct Payload
+    {
+        AudioContext * context;
+        AudioRenderHealthEvent event;
+    };
+
+    Payload payload = { m_context, { type, time, load } };
+    m_context->enqueueEvent([](void * p)
+    {
+        Payload payload;
+        memcpy(&payload, p, sizeof(payload));
+        if (payload.context->renderHealthCallback)
+            payload.context->renderHealthCallback(payload.event);
+    }, &payload, sizeof(payload));
+}
+
+AudioRenderHealth AudioDestinationNode::renderHealth(bool reset)
+{
+    RenderHealth & health = *m_health;
+    AudioRenderHealth snapshot;
+
+    auto take = [reset](auto & value) { return reset ? value.exchange(0, std::memory_order_relaxed) : value.load(std::memory_order_relaxed); };
+    snapshot.renders = take(health.renders);
+    snapshot.deadlineMisses = take(health.deadlineMisses);
+    const double loadSum = take(health.loadSum);
+    snapshot.meanLoad = snapshot.renders ? loadSum / snapshot.renders : 0;
+    snapshot.maxLoad = take(health.maxLoad);
+    snapshot.recentLoad = health.recentLoad.load(std::memory_order_relaxed);
+    snapshot.maxRenderLockWait = take(health.maxLockWait);
+    for (int i = 0; i < AudioRenderHealth::LoadBuckets; ++i)
+        snapshot.loadHistogram[i] = take(health.loadHistogram[i]);
+
+    // The ring keeps the latest xruns; those before a reset aren't reported again.
+    const uint64_t xruns = health.xruns.load(std::memory_order_relaxed);
+    const uint64_t since = reset ? health.xrunsAtReset.exchange(xruns, std::memory_order_relaxed) : health.xrunsAtReset.load(std::memory_order_relaxed);
+    snapshot.xruns = xruns - since;
+    const uint64_t recent = std::min<uint64_t>(snapshot.xruns, RenderHealth::RecentXruns);
+    for (uint64_t i = xruns - recent; i < xruns; ++i)
+        snapshot.recentXrunTimes.push_back(health.xrunFrames[i % RenderHealth::RecentXruns].load(std::memory_order_relaxed) / static_cast<double>(m_sampleRate));
+
+    return snapshot;
 }
 
 uint64_t AudioDestinationNode::currentSampleFrame() const
@@ -0,0 +1,175 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioGraphSnapshot.h"
+
+#include <cstdio>
+
+namespace lab {
+
+namespace {
+
+    std::string number(double value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+
+    std::string quoted(const std::string & text)
+    {
+        std::string out = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out + "\"";
+    }
+
+    // Escaped for a field of a DOT record label.
+    std::string recordText(const std::string & text)
+    {
+        std::string out;
+        for (char c : text)
+        {
+            if (c == '{' || c == '}' || c == '|' || c == '<' || c == '>')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    // Quoted for DOT, whose escapes, such as \n and those of record labels, are kept.
+    std::string dotQuoted(const std::string & text)
+    {
+        std::string out = "\"";
+        for (char c : text)
+        {
+            if (c == '"')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out + "\"";
+    }
+
+    template <typename T>
+    std::string list(const std::vector<T> & values)
+    {
+        std::string out = "[";
+        for (size_t i = 0; i < values.size(); ++i)
+            out += (i ? "," : "") + number(static_cast<double>(values[i]));
+        return out + "]";
+    }
+
+    std::string milliseconds(double seconds)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.3g ms", seconds * 1000);
+        return text;
+    }
+
+} // anonymous namespace
+
+std::string AudioGraphSnapshot::toDot() const
+{
+    std::string out = "digraph LabSound {\n";
+    out += "    rankdir=LR;\n";
+    out += "    node [shape=record, fontname=\"Helvetica\", fontsize=10];\n";
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const Node & node = nodes[i];
+
+        // Inputs and parameters on the left, the node in the middle, and outputs on the right.
+        std::string ports;
+        for (size_t k = 0; k < node.inputChannels.size(); ++k)
+            ports += (ports.empty() ? "" : "|") + std::string("<i") + std::to_string(k) + "> in " + std::to_string(k) + " (" + std::to_string(node.inputChannels[k]) + " ch)";
+        for (size_t k = 0; k < node.params.size(); ++k)
+            ports += (ports.empty() ? "" : "|") + std::string("<p") + std::to_string(k) + "> " + recordText(node.params[k].name) + " = " + number(node.params[k].value);
+
+        std::string outputs;
+        for (size_t k = 0; k < node.outputChannels.size(); ++k)
+            outputs += (outputs.empty() ? "" : "|") + std::string("<o") + std::to_string(k) + "> out " + std::to_string(k) + " (" + std::to_string(node.outputChannels[k]) + " ch)";
+
+        std::string body = recordText(node.type);
+        if (node.dormant)
+            body += "\\ndormant";
+        if (node.latencySeconds > 0)
+            body += "\\nlatency " + milliseconds(node.latencySeconds);
+        if (node.tailSeconds > 0)
+            body += "\\ntail " + milliseconds(node.tailSeconds);
+        if (profiled)
+            body += "\\n" + number(node.budgetPercent) + "% of budget, " + milliseconds(node.meanSeconds) + " per call";
+
+        std::string label = "{";
+        if (!ports.empty())
+            label += "{" + ports + "}|";
+        label += body;
+        if (!outputs.empty())
+            label += "|{" + outputs + "}";
+        label += "}";
+
+        out += "    n" + std::to_string(i) + " [label=" + dotQuoted(label);
+        if (node.dormant)
+            out += ", style=filled, fillcolor=\"#e0e0e0\"";
+        out += "];\n";
+    }
+
+    for (const Connection & c : connections)
+        out += "    n" + std::to_string(c.source) + ":o" + std::to_string(c.output) + " -> n" + std::to_string(c.destination) + ":i" + std::to_string(c.input) + ";\n";
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+        for (size_t k = 0; k < nodes[i].params.size(); ++k)
+            for (size_t driver : nodes[i].params[k].drivers)
+                out += "    n" + std::to_string(driver) + " -> n" + std::to_string(i) + ":p" + std::to_string(k) + " [style=dashed];\n";
+
+    out += "}\n";
+    return out;
+}
+
+std::string AudioGraphSnapshot::toJson() const
+{
+    std::string out = "{\"sampleRate\":" + number(sampleRate) + ",\"quantumSeconds\":" + number(quantumSeconds);
+    out += std::string(",\"profiled\":") + (profiled ? "true" : "false") + ",\"nodes\":[";
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const Node & node = nodes[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"index\":" + std::to_string(i) + ",\"type\":" + quoted(node.type);
+        out += ",\"channelCount\":" + std::to_string(node.channelCount);
+        out += ",\"inputChannels\":" + list(node.inputChannels);
+        out += ",\"outputChannels\":" + list(node.outputChannels);
+        out += std::string(",\"dormant\":") + (node.dormant ? "true" : "false");
+        out += ",\"silentSeconds\":" + number(node.silentSeconds);
+        out += ",\"latencySeconds\":" + number(node.latencySeconds);
+        out += ",\"tailSeconds\":" + number(node.tailSeconds);
+        out += ",\"meanSeconds\":" + number(node.meanSeconds);
+        out += ",\"budgetPercent\":" + number(node.budgetPercent);
+        out += ",\"params\":[";
+        for (size_t k = 0; k < node.params.size(); ++k)
+        {
+            const Param & param = node.params[k];
+            out += k ? "," : "";
+            out += "{\"name\":" + quoted(param.name) + ",\"value\":" + number(param.value) + ",\"drivers\":" + list(param.drivers) + "}";
+        }
+        out += "]}";
+    }
+
+    out += "\n],\"connections\":[";
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        const Connection & c = connections[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"source\":" + std::to_string(c.source) + ",\"output\":" + std::to_string(c.output);
+        out += ",\"destination\":" + std::to_string(c.destination) + ",\"input\":" + std::to_string(c.input) + "}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+} // namespace lab
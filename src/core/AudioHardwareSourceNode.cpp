@@ -31,7 +31,7 @@ void AudioHardwareSourceNode::setFormat(ContextRenderLock & r, size_t numberOfCh
     if (numberOfChannels != m_sourceNumberOfChannels || sourceSampleRate != r.context()->sampleRate())
     {
         // The sample-rate must be equal to the context's sample-rate.
-        if (!numberOfChannels || numberOfChannels > AudioContext::maxNumberOfChannels || sourceSampleRate != r.context()->sampleRate())
+        if (!numberOfChannels || numberOfChannels > r.context()->channelLimit() || sourceSampleRate != r.context()->sampleRate())
             throw std::runtime_error("AudioHardwareSourceNode must match samplerate of context... ");
 
         m_sourceNumberOfChannels = numberOfChannels;
@@ -57,6 +57,15 @@ void AudioHardwareSourceNode::process(ContextRenderLock & r, size_t numberOfFram
         return;
     }
 
+    // Where its layout matches, the live input itself becomes the output's bus, so it isn't copied. A declick
+    // ramp on the output then shapes the hardware's buffer in place, which nothing reads after the graph.
+    AudioBus * live = audioSourceProvider()->inputBus(numberOfFrames);
+    if (live && live->numberOfChannels() == outputBus->numberOfChannels())
+    {
+        output(0)->setRenderedBus(r, live);
+        return;
+    }
+
     // Use a tryLock() to avoid contention in the real-time audio thread.
     // If we fail to acquire the lock then the MediaStream must be in the middle of
     // a format change, so we output silence in this case.
@@ -2,6 +2,10 @@
 // Copyright (C) 2018, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/AudioListener.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/AmbisonicField.h"
 
 namespace lab
 {
@@ -18,11 +22,16 @@ namespace lab
         m_velocityZ(std::make_shared<AudioParam>("velocityZ", 0.f, -1000.f, 1000.f)),
         m_positionX(std::make_shared<AudioParam>("positionX", 0.f, -1.e6f, 1.e6f)),
         m_positionY(std::make_shared<AudioParam>("positionY", 0.f, -1.e6f, 1.e6f)),
-        m_positionZ(std::make_shared<AudioParam>("positionZ", 0.f, -1.e6f, 1.e6f))
+        m_positionZ(std::make_shared<AudioParam>("positionZ", 0.f, -1.e6f, 1.e6f)),
+        m_ambisonicField(new AmbisonicField())
     {
 
     }
 
+    AudioListener::~AudioListener()
+    {
+    }
+
     void AudioListener::setForward(const FloatPoint3D& fwd)
     {
         m_forwardX->setValue(fwd.x);
@@ -44,6 +53,30 @@ namespace lab
         m_positionZ->setValue(position.z);
     }
 
+    const AudioListener::Frame & AudioListener::frame(ContextRenderLock & r)
+    {
+        const uint64_t sampleFrame = r.context()->currentSampleFrame();
+        if (m_frame.version && sampleFrame == m_frameSampleFrame)
+            return m_frame;
+
+        m_frameSampleFrame = sampleFrame;
+
+        const FloatPoint3D position = { m_positionX->value(r), m_positionY->value(r), m_positionZ->value(r) };
+        const FloatPoint3D forward = { m_forwardX->value(r), m_forwardY->value(r), m_forwardZ->value(r) };
+        const FloatPoint3D up = { m_upX->value(r), m_upY->value(r), m_upZ->value(r) };
+        if (m_frame.version && position == m_frame.position && forward == m_frameForward && up == m_frameUp)
+            return m_frame;
+
+        m_frameForward = forward;
+        m_frameUp = up;
+        m_frame.position = position;
+        m_frame.front = normalize(forward);
+        m_frame.right = normalize(cross(m_frame.front, up));
+        m_frame.up = cross(m_frame.right, m_frame.front);
+        ++m_frame.version;
+        return m_frame;
+    }
+
     void AudioListener::setVelocity(const FloatPoint3D &velocity)
     {
         m_velocityX->setValue(velocity.x);
@@ -0,0 +1,153 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioMemory.h"
+#include "LabSound/core/AudioBus.h"
+
+namespace lab {
+
+const char * AudioMemoryCategoryName(AudioMemoryCategory category)
+{
+    switch (category)
+    {
+        case AudioMemoryCategory::Buses: return "Buses";
+        case AudioMemoryCategory::Samples: return "Samples";
+        case AudioMemoryCategory::DelayLines: return "DelayLines";
+        case AudioMemoryCategory::ImpulseResponses: return "ImpulseResponses";
+        case AudioMemoryCategory::HRTF: return "HRTF";
+        case AudioMemoryCategory::Analysis: return "Analysis";
+        default: return "Other";
+    }
+}
+
+size_t AudioMemoryReport::Node::total() const
+{
+    size_t sum = 0;
+    for (size_t bytes : this->bytes)
+        sum += bytes;
+    return sum;
+}
+
+size_t AudioMemoryReport::bytes(AudioMemoryCategory category) const
+{
+    const size_t index = static_cast<size_t>(category);
+    size_t sum = 0;
+    for (const Node & node : nodes)
+        sum += node.bytes[index];
+    for (const Shared & owner : shared)
+        if (owner.category == category)
+            sum += owner.bytes;
+    return sum;
+}
+
+size_t AudioMemoryReport::total() const
+{
+    size_t sum = 0;
+    for (const Node & node : nodes)
+        sum += node.total();
+    for (const Shared & owner : shared)
+        sum += owner.bytes;
+    return sum;
+}
+
+std::string AudioMemoryReport::toJson() const
+{
+    std::string out = "{\"total\":" + std::to_string(total());
+    out += ",\"channelArenaBytes\":" + std::to_string(channelArenaBytes);
+    out += ",\"channelArenaBytesInUse\":" + std::to_string(channelArenaBytesInUse);
+
+    out += ",\"categories\":{";
+    for (size_t c = 0; c < Categories; ++c)
+    {
+        const AudioMemoryCategory category = static_cast<AudioMemoryCategory>(c);
+        out += c ? "," : "";
+        out += std::string("\"") + AudioMemoryCategoryName(category) + "\":" + std::to_string(bytes(category));
+    }
+
+    out += "},\"nodes\":[";
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const Node & node = nodes[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"index\":" + std::to_string(i) + ",\"type\":\"" + node.type + "\"";
+        for (size_t c = 0; c < Categories; ++c)
+            if (node.bytes[c])
+                out += std::string(",\"") + AudioMemoryCategoryName(static_cast<AudioMemoryCategory>(c)) + "\":" + std::to_string(node.bytes[c]);
+        out += ",\"shared\":[";
+        for (size_t k = 0; k < node.shared.size(); ++k)
+            out += (k ? "," : "") + std::to_string(node.shared[k]);
+        out += "]}";
+    }
+
+    out += "\n],\"shared\":[";
+    for (size_t i = 0; i < shared.size(); ++i)
+    {
+        const Shared & owner = shared[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"index\":" + std::to_string(i) + ",\"category\":\"" + AudioMemoryCategoryName(owner.category) + "\"";
+        out += ",\"bytes\":" + std::to_string(owner.bytes) + ",\"holders\":" + std::to_string(owner.holders);
+        out += ",\"references\":" + std::to_string(owner.references) + "}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+AudioMemoryUsage::AudioMemoryUsage(AudioMemoryReport & report, AudioMemoryReport::Node & node, bool * overflowed)
+: m_report(report)
+, m_node(node)
+, m_overflowed(overflowed)
+{
+}
+
+void AudioMemoryUsage::add(AudioMemoryCategory category, size_t bytes)
+{
+    m_node.bytes[static_cast<size_t>(category)] += bytes;
+}
+
+void AudioMemoryUsage::addShared(AudioMemoryCategory category, const void * owner, size_t bytes, long references)
+{
+    if (!owner)
+        return;
+
+    size_t index = 0;
+    while (index < m_report.shared.size() && m_report.shared[index].owner != owner)
+        ++index;
+    if (index == m_report.shared.size())
+    {
+        if (m_overflowed && m_report.shared.size() == m_report.shared.capacity())
+        {
+            *m_overflowed = true;
+            return;
+        }
+
+        AudioMemoryReport::Shared entry;
+        entry.category = category;
+        entry.owner = owner;
+        m_report.shared.push_back(entry);
+    }
+
+    // A node holding the owner more than once, as the fading and current impulse of a convolver may, is one holder.
+    AudioMemoryReport::Shared & entry = m_report.shared[index];
+    for (size_t held : m_node.shared)
+        if (held == index)
+            return;
+
+    if (m_overflowed && m_node.shared.size() == m_node.shared.capacity())
+    {
+        *m_overflowed = true;
+        return;
+    }
+
+    entry.bytes = bytes;
+    entry.references = references;
+    ++entry.holders;
+    m_node.shared.push_back(index);
+}
+
+void AudioMemoryUsage::addBus(const AudioBus * bus, AudioMemoryCategory category)
+{
+    if (bus)
+        add(category, bus->memoryBytes());
+}
+
+} // namespace lab
@@ -6,6 +6,7 @@
 
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioParam.h"
@@ -13,13 +14,28 @@
 #include "LabSound/extended/AudioContextLock.h"
 
 #include "internal/Assertions.h"
+#include "internal/NodeProfiler.h"
+#include "internal/VectorMath.h"
+
+#include <cstring>
 
 using namespace std;
 
 namespace lab {
 
-AudioNode::AudioNode() = default;
-AudioNode::~AudioNode() = default;
+AudioNode::AudioNode()
+{
+#if defined(LABSOUND_PROFILER)
+    m_profile = std::make_shared<NodeProfileRecord>();
+#endif
+}
+
+AudioNode::~AudioNode()
+{
+    // A summing junction rendering from an output may keep it alive for a while longer.
+    for (auto & out : m_outputs)
+        out->m_node = nullptr;
+}
 
 void AudioNode::initialize()
 {
@@ -67,18 +83,17 @@ void AudioNode::setChannelCount(ContextGraphLock & g, size_t channelCount)
         throw std::invalid_argument("No context specified");
     }
 
-    if (channelCount <= AudioContext::maxNumberOfChannels)
+    if (channelCount > g.context()->channelLimit())
     {
-        if (m_channelCount != channelCount)
-        {
-            m_channelCount = channelCount;
-            if (m_channelCountMode != ChannelCountMode::Max)
-                updateChannelsForInputs(g);
-        }
-        return;
+        throw std::invalid_argument("Channel count exceeds the context's channelLimit()");
     }
 
-    throw std::logic_error("Should not be reached");
+    if (m_channelCount != channelCount)
+    {
+        m_channelCount = channelCount;
+        if (m_channelCountMode != ChannelCountMode::Max)
+            updateChannelsForInputs(g);
+    }
 }
 
 void AudioNode::setChannelCountMode(ContextGraphLock& g, ChannelCountMode mode)
@@ -101,7 +116,7 @@ void AudioNode::updateChannelsForInputs(ContextGraphLock& g)
 {
     for (auto input : m_inputs)
     {
-        input->changedOutputs(g);
+        AudioSummingJunction::setDirty(g, input);
     }
 }
 
@@ -117,74 +132,192 @@ void AudioNode::processIfNecessary(ContextRenderLock & r, size_t framesToProcess
     // This handles the "fanout" problem where an output is connected to multiple inputs.
     // The first time we're called during this time slice we process, but after that we don't want to re-process,
     // instead our output(s) will already have the results cached in their bus;
-    double currentTime = ac->currentTime();
-    if (m_lastProcessingTime != currentTime)
+    const uint64_t quantum = ac->currentRenderQuantum();
+    if (m_lastProcessingQuantum != quantum)
     {
-        m_lastProcessingTime = currentTime; // important to first update this time to accomodate feedback loops in the rendering graph
+        m_lastProcessingQuantum = quantum; // important to first update this to accomodate feedback loops in the rendering graph
 
         pullInputs(r, framesToProcess);
 
         bool silentInputs = inputsAreSilent(r);
         if (!silentInputs)
         {
-            m_lastNonSilentTime = (ac->currentSampleFrame() + framesToProcess) / static_cast<double>(ac->sampleRate());
+            m_lastNonSilentFrame = static_cast<int64_t>(ac->currentSampleFrame() + framesToProcess);
         }
 
         // if this node is supposed to copy silence through, and is itself silent
         if (silentInputs && propagatesSilence(r))
         {
             silenceOutputs(r);
+            m_dormant = true;
+
+            if (m_controlStride != 1)
+            {
+                m_controlStride = 1;
+                for (auto & out : m_outputs)
+                {
+                    out->m_renderedStride = 1;
+                    out->m_controlLast = 0;
+                }
+            }
+
+            // Nothing is heard, so a pending disconnection needn't wait for its ramp.
+            int32_t disconnect = m_disconnectRamp;
+            if (disconnect != RampInactive && disconnect != RampComplete && m_disconnectRamp.compare_exchange_strong(disconnect, RampComplete))
+                ac->notifyDisconnectionReady();
         }
         else
         {
+#if defined(LABSOUND_PROFILER)
+            const uint32_t profilingEpoch = ac->profilingEpoch();
+            const uint64_t start = profilingEpoch ? ProfileTicks() : 0;
+#endif
+
+            beginControlRender(r, framesToProcess);
             process(r, framesToProcess);
+            endControlRender(r, framesToProcess);
+
+            applyDeclickRamps(r);
+
+#if defined(LABSOUND_PROFILER)
+            if (profilingEpoch)
+                m_profile->record(ProfileTicks() - start, profilingEpoch);
+#endif
+
+            unsilenceOutputs(r);
+            m_dormant = false;
+        }
+    }
+}
+
+void AudioNode::renderDormant(ContextRenderLock & r)
+{
+    m_lastProcessingQuantum = r.context()->currentRenderQuantum();
+    silenceOutputs(r); // the buses are already silent, so this doesn't touch their samples
+}
+
+void AudioNode::renderBypassed(ContextRenderLock & r)
+{
+    m_lastProcessingQuantum = r.context()->currentRenderQuantum();
+    m_dormant = false;
+}
 
-            float new_schedule = 0.f;
+bool AudioNode::renderPassThrough(ContextRenderLock & r, AudioBus * bus, size_t framesToProcess)
+{
+    // A ramp would scale the bus in place, and it belongs to the node that fed it.
+    if (!isInitialized() || !bus || !rampsSettled())
+        return false;
+
+    auto out = output(0);
+    if (!out || bus->numberOfChannels() != out->numberOfChannels() || bus->length() < framesToProcess)
+        return false;
+
+    AudioContext * ac = r.context();
+    m_lastProcessingQuantum = ac->currentRenderQuantum();
+    if (!bus->isSilent())
+        m_lastNonSilentFrame = static_cast<int64_t>(ac->currentSampleFrame() + framesToProcess);
+
+    out->setRenderedBus(r, bus);
+    m_dormant = false;
+    return true;
+}
+
+void AudioNode::applyDeclickRamps(ContextRenderLock & r)
+{
+    AudioContext * ac = r.context();
+    const int32_t length = static_cast<int32_t>(ac->declickLength());
 
-            if (m_disconnectSchedule >= 0)
+    // The update thread may restart a ramp at any time, so a ramp is only advanced if it wasn't restarted meanwhile.
+    int32_t disconnect = m_disconnectRamp;
+    if (disconnect != RampInactive)
+    {
+        // Fade out along the curve, then hold silence until the context completes the disconnection.
+        for (auto & out : m_outputs)
+        {
+            AudioBus * bus = out->bus(r);
+            for (unsigned i = 0; i < bus->numberOfChannels(); ++i)
             {
-                for (auto out : m_outputs)
-                    for (unsigned i = 0; i < out->bus(r)->numberOfChannels(); ++i)
-                    {
-                        float scale = m_disconnectSchedule;
-                        float * sample = out->bus(r)->channel(i)->mutableData();
-                        size_t numSamples = out->bus(r)->channel(i)->length();
-                        for (size_t s = 0; s < numSamples; ++s)
-                        {
-                            sample[s] *= scale;
-                            scale *= 0.98f;
-                        }
-                        new_schedule = scale;
-                    }
-
-                m_disconnectSchedule = new_schedule;
+                AudioChannel * channel = bus->channel(i);
+                float * data = channel->mutableData();
+                size_t frames = channel->length();
+                size_t fade = disconnect < length ? std::min(frames, static_cast<size_t>(length - disconnect)) : 0;
+                if (fade)
+                    VectorMath::vmul(data, 1, ac->declickFadeOut() + disconnect, 1, data, 1, fade);
+                if (fade < frames)
+                    memset(data + fade, 0, (frames - fade) * sizeof(float));
             }
+        }
+
+        if (disconnect != RampComplete)
+        {
+            int32_t advanced = disconnect + static_cast<int32_t>(ac->renderQuantumSize());
+            int32_t next = advanced >= length ? RampComplete : advanced;
+            if (m_disconnectRamp.compare_exchange_strong(disconnect, next) && next == RampComplete)
+                ac->notifyDisconnectionReady();
+        }
+    }
 
-            new_schedule = 1.f;
-            if (m_connectSchedule < 1)
+    int32_t connect = m_connectRamp;
+    if (connect != RampComplete)
+    {
+        for (auto & out : m_outputs)
+        {
+            AudioBus * bus = out->bus(r);
+            for (unsigned i = 0; i < bus->numberOfChannels(); ++i)
             {
-                for (auto out : m_outputs)
-                    for (unsigned i = 0; i < out->bus(r)->numberOfChannels(); ++i)
-                    {
-                        float scale = m_connectSchedule;
-                        float * sample = out->bus(r)->channel(i)->mutableData();
-                        size_t numSamples = out->bus(r)->channel(i)->length();
-                        for (size_t s = 0; s < numSamples; ++s)
-                        {
-                            sample[s] *= scale;
-                            scale = 1.f - ((1.f - scale) * 0.98f);
-                        }
-                        new_schedule = scale;
-                    }
-
-                m_connectSchedule = new_schedule;
+                AudioChannel * channel = bus->channel(i);
+                float * data = channel->mutableData();
+                size_t fade = connect < length ? std::min(channel->length(), static_cast<size_t>(length - connect)) : 0;
+                if (fade)
+                    VectorMath::vmul(data, 1, ac->declickFadeIn() + connect, 1, data, 1, fade);
             }
-
-            unsilenceOutputs(r);
         }
+
+        int32_t advanced = connect + static_cast<int32_t>(ac->renderQuantumSize());
+        m_connectRamp.compare_exchange_strong(connect, advanced >= length ? RampComplete : advanced);
+    }
+}
+
+void AudioNode::beginControlRender(ContextRenderLock &, size_t framesToProcess)
+{
+    size_t stride = m_controlRate.load(std::memory_order_relaxed);
+    if (stride == 1 && m_controlStride == 1)
+        return;
+
+    if (!supportsControlRate() || !rampsSettled() || framesToProcess % stride)
+        stride = 1;
+    for (auto & out : m_outputs)
+        if (out->numberOfChannels() != 1 || out->renderingFanOutCount() || !out->renderingParamFanOutCount())
+            stride = 1;
+
+    m_controlStride = stride;
+    for (auto & out : m_outputs)
+    {
+        out->m_renderedStride = stride;
+        out->m_controlCarry = out->m_controlLast;
+    }
+}
+
+void AudioNode::endControlRender(ContextRenderLock & r, size_t framesToProcess)
+{
+    if (m_controlRate.load(std::memory_order_relaxed) == 1 && m_controlStride == 1)
+        return;
+
+    // Kept at the full rate too, so that a switch to control rate carries on from the value last rendered.
+    for (auto & out : m_outputs)
+    {
+        AudioBus * bus = out->bus(r);
+        const size_t values = framesToProcess / m_controlStride;
+        out->m_controlLast = bus->isSilent() || !bus->numberOfChannels() || !values ? 0.f : bus->channel(0)->data()[values - 1];
     }
 }
 
+bool AudioNode::isProcessedThisQuantum(ContextRenderLock& r) const
+{
+    auto ac = r.context();
+    return ac && m_lastProcessingQuantum == ac->currentRenderQuantum();
+}
+
 void AudioNode::checkNumberOfChannelsForInput(ContextRenderLock& r, AudioNodeInput* input)
 {
     ASSERT(r.context());
@@ -198,11 +331,37 @@ void AudioNode::checkNumberOfChannelsForInput(ContextRenderLock& r, AudioNodeInp
     }
 }
 
+void AudioNode::prepare(AudioContext &, size_t)
+{
+    if (!isInitialized())
+        initialize();
+}
+
+void AudioNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    for (auto & input : m_inputs)
+        usage.addBus(input->internalBus(r));
+    for (auto & output : m_outputs)
+        usage.addBus(output->m_internalBus.get());
+}
+
+size_t AudioNode::channelsForInput(size_t inputChannels) const
+{
+    switch (m_channelCountMode)
+    {
+    case ChannelCountMode::ClampedMax: return std::min(inputChannels, m_channelCount);
+    case ChannelCountMode::Explicit: return m_channelCount;
+    default: return inputChannels;
+    }
+}
+
 bool AudioNode::propagatesSilence(ContextRenderLock & r) const
 {
     ASSERT(r.context());
 
-    return m_lastNonSilentTime + latencyTime(r) + tailTime(r) < r.context()->currentTime(); // dimitri use of latencyTime() / tailTime()
+    // The tail is converted to frames, so that the comparison stays exact however long the context has run.
+    const double tailFrames = (latencyTime(r) + tailTime(r)) * r.context()->sampleRate(); // dimitri use of latencyTime() / tailTime()
+    return m_lastNonSilentFrame + tailFrames < static_cast<double>(r.context()->currentSampleFrame());
 }
 
 void AudioNode::pullInputs(ContextRenderLock& r, size_t framesToProcess)
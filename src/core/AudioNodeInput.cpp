@@ -43,6 +43,7 @@ void AudioNodeInput::connect(ContextGraphLock& g, std::shared_ptr<AudioNodeInput
 
     toOutput->addInput(g, junction);
     junction->junctionConnectOutput(toOutput);
+    setDirty(g, junction);
 }
 
 void AudioNodeInput::disconnect(ContextGraphLock& g, std::shared_ptr<AudioNodeInput> junction, std::shared_ptr<AudioNodeOutput> toOutput)
@@ -55,6 +56,7 @@ void AudioNodeInput::disconnect(ContextGraphLock& g, std::shared_ptr<AudioNodeIn
     {
         junction->junctionDisconnectOutput(toOutput);
         toOutput->removeInput(g, junction);
+        setDirty(g, junction);
     }
 }
 
@@ -66,11 +68,14 @@ void AudioNodeInput::didUpdate(ContextRenderLock& r)
 void AudioNodeInput::updateInternalBus(ContextRenderLock& r)
 {
     size_t numberOfInputChannels = numberOfChannels(r);
+    size_t renderQuantumSize = r.context()->renderQuantumSize();
 
-    if (numberOfInputChannels == m_internalSummingBus->numberOfChannels())
+    if (numberOfInputChannels == m_internalSummingBus->numberOfChannels() && renderQuantumSize == m_internalSummingBus->length())
         return;
 
-    m_internalSummingBus = std::unique_ptr<AudioBus>(new AudioBus(numberOfInputChannels, AudioNode::ProcessingSizeInFrames));
+    std::unique_ptr<AudioBus> bus(new AudioBus(numberOfInputChannels, renderQuantumSize));
+    std::swap(bus, m_internalSummingBus);
+    r.context()->deferRelease(r, std::move(bus));
 }
 
 size_t AudioNodeInput::numberOfChannels(ContextRenderLock& r) const
@@ -88,11 +93,8 @@ size_t AudioNodeInput::numberOfChannels(ContextRenderLock& r) const
     size_t c = numberOfRenderingConnections(r);
     for (size_t i = 0; i < c; ++i)
     {
-        auto output = renderingOutput(r, i);
-        if (output)
-        {
+        if (AudioNodeOutput * output = renderingOutput(r, i))
             maxChannels = max(maxChannels, output->bus(r)->numberOfChannels());
-        }
     }
 
     if (mode == ChannelCountMode::ClampedMax)
@@ -111,20 +113,26 @@ AudioBus* AudioNodeInput::bus(ContextRenderLock& r)
     // @tofix - did I miss part of the merge?
     if (numberOfRenderingConnections(r) == 1) // && node()->channelCountMode() == ChannelCountMode::Max)
     {
-        std::shared_ptr<AudioNodeOutput> output = renderingOutput(r, 0);
-        if (output) {
-          return output->bus(r);
-        }
+        if (AudioNodeOutput * output = renderingOutput(r, 0))
+            return output->bus(r);
     }
 
     // Multiple connections case (or no connections).
+    return summingBus();
+}
+
+AudioBus* AudioNodeInput::summingBus()
+{
+    if (m_sharedSummingBus && m_sharedSummingBus->topologyMatches(*m_internalSummingBus))
+        return m_sharedSummingBus;
     return m_internalSummingBus.get();
 }
 
 
 AudioBus* AudioNodeInput::pull(ContextRenderLock& r, AudioBus* inPlaceBus, size_t framesToProcess)
 {
-    updateRenderingState(r);
+    if (m_internalSummingBus->length() != r.context()->renderQuantumSize())
+        updateInternalBus(r);
 
     size_t c = numberOfRenderingConnections(r);
 
@@ -132,11 +140,8 @@ AudioBus* AudioNodeInput::pull(ContextRenderLock& r, AudioBus* inPlaceBus, size_
     if (c == 1)
     {
         // If this input is simply passing data through, then immediately delegate the pull request to it.
-        auto output = renderingOutput(r, 0);
-        if (output)
-        {
-             return output->pull(r, inPlaceBus, framesToProcess);
-        }
+        if (AudioNodeOutput * output = renderingOutput(r, 0))
+            return output->pull(r, inPlaceBus, framesToProcess);
 
         c = 0; // if there's a single input, but it has no output; treat this input as silent.
     }
@@ -145,26 +150,27 @@ AudioBus* AudioNodeInput::pull(ContextRenderLock& r, AudioBus* inPlaceBus, size_
     {
         // Generate silence if we're not connected to anything, and return the silent bus
         /// @TODO a possible optimization is to flag silence and propagate it to consumers of this input.
-        m_internalSummingBus->zero();
-        return m_internalSummingBus.get();
+        AudioBus * silentBus = summingBus();
+        silentBus->zero();
+        return silentBus;
     }
 
     // multiple connections
-    m_internalSummingBus->zero();
+    AudioBus * sumBus = summingBus();
+    sumBus->zero();
 
     for (int i = 0; i < c; ++i)
     {
-        auto output = renderingOutput(r, i);
-        if (output)
+        if (AudioNodeOutput * output = renderingOutput(r, i))
         {
             // Render audio from this output.
             AudioBus* connectionBus = output->pull(r, 0, framesToProcess);
 
             // Sum, with unity-gain.
-            m_internalSummingBus->sumFrom(*connectionBus);
+            sumBus->sumFrom(*connectionBus);
         }
     }
-    return m_internalSummingBus.get();
+    return sumBus;
 }
 
 } // namespace lab
@@ -32,7 +32,7 @@ AudioNodeOutput::AudioNodeOutput(AudioNode* node, size_t numberOfChannels, size_
     , m_renderingFanOutCount(0)
     , m_renderingParamFanOutCount(0)
 {
-    ASSERT(numberOfChannels <= AudioContext::maxNumberOfChannels);
+    ASSERT(numberOfChannels <= AudioContext::maxChannelLimit);
     
     m_internalBus.reset(new AudioBus(numberOfChannels, processingSizeInFrames));
 }
@@ -45,21 +45,27 @@ AudioNodeOutput::~AudioNodeOutput()
 void AudioNodeOutput::setNumberOfChannels(ContextRenderLock& r, size_t numberOfChannels)
 {
     ASSERT(r.context());
-    ASSERT(numberOfChannels <= AudioContext::maxNumberOfChannels);
+    ASSERT(numberOfChannels <= r.context()->channelLimit());
     
     if (m_numberOfChannels == numberOfChannels)
         return;
     
     m_desiredNumberOfChannels = numberOfChannels;
-    m_internalBus.reset(new AudioBus(numberOfChannels, AudioNode::ProcessingSizeInFrames));
+
+    std::unique_ptr<AudioBus> bus(new AudioBus(numberOfChannels, r.context()->renderQuantumSize()));
+    std::swap(bus, m_internalBus);
+    r.context()->deferRelease(r, std::move(bus));
 }
 
-void AudioNodeOutput::updateInternalBus()
+void AudioNodeOutput::updateInternalBus(ContextRenderLock& r)
 {
-    if (numberOfChannels() == m_internalBus->numberOfChannels())
+    size_t renderQuantumSize = r.context()->renderQuantumSize();
+    if (numberOfChannels() == m_internalBus->numberOfChannels() && renderQuantumSize == m_internalBus->length())
         return;
 
-    m_internalBus.reset(new AudioBus(numberOfChannels(), AudioNode::ProcessingSizeInFrames));
+    std::unique_ptr<AudioBus> bus(new AudioBus(numberOfChannels(), renderQuantumSize));
+    std::swap(bus, m_internalBus);
+    r.context()->deferRelease(r, std::move(bus));
 }
 
 void AudioNodeOutput::updateRenderingState(ContextRenderLock& r)
@@ -68,9 +74,14 @@ void AudioNodeOutput::updateRenderingState(ContextRenderLock& r)
     {
         ASSERT(r.context());
         m_numberOfChannels = m_desiredNumberOfChannels;
-        updateInternalBus();
+        updateInternalBus(r);
         propagateChannelCount(r);
     }
+    else if (m_internalBus->length() != r.context()->renderQuantumSize())
+    {
+        // The first quantum rendered in a context whose quantum size differs from the one the bus was created with.
+        updateInternalBus(r);
+    }
     m_renderingFanOutCount = fanOutCount();
     m_renderingParamFanOutCount = paramFanOutCount();
 }
@@ -102,20 +113,53 @@ AudioBus * AudioNodeOutput::pull(ContextRenderLock& r, AudioBus* inPlaceBus, siz
     // cause our node to process() only the first time, caching the output in m_internalOutputBus for subsequent calls.    
 
     updateRenderingState(r);
+
+    auto n = node();
+
+    // The node was released while still connected. It is silent until the connection is dropped.
+    if (!n)
+    {
+        m_inPlaceBus = 0;
+        m_internalBus->zero();
+        return bus(r);
+    }
+
+    // If the render schedule (or a feedback loop) has already reached our node during this quantum, the result
+    // is in whichever bus it was rendered into. In-place processing can only be offered before that point.
+    if (n->isProcessedThisQuantum(r))
+        return bus(r);
     
     bool useInPlaceBus = inPlaceBus && inPlaceBus->numberOfChannels() == numberOfChannels() && (m_renderingFanOutCount + m_renderingParamFanOutCount) == 1;
     
     // Setup the actual destination bus for processing when our node's process() method gets called in processIfNecessary() below.
     m_inPlaceBus = useInPlaceBus ? inPlaceBus : 0;
-    
-    auto n = node();
-    if (!n)
-        return bus(r);
 
     n->processIfNecessary(r, framesToProcess);
     return bus(r);
 }
 
+void AudioNodeOutput::prepareScheduledRender(ContextRenderLock& r, AudioBus * sharedBus)
+{
+    updateRenderingState(r);
+
+    // The plan was made for the channel count when the schedule was compiled.
+    bool useSharedBus = sharedBus && sharedBus->numberOfChannels() == m_internalBus->numberOfChannels() && sharedBus->length() == m_internalBus->length();
+    m_inPlaceBus = useSharedBus ? sharedBus : 0;
+}
+
+void AudioNodeOutput::releaseSharedBus(ContextRenderLock& r, AudioBus * sharedBus)
+{
+    if (sharedBus && m_inPlaceBus == sharedBus)
+        m_inPlaceBus = 0;
+}
+
+void AudioNodeOutput::setRenderedBus(ContextRenderLock& r, AudioBus * bus)
+{
+    ASSERT(r.context());
+    ASSERT(bus && bus->numberOfChannels() == numberOfChannels());
+    m_inPlaceBus = bus;
+}
+
 AudioBus* AudioNodeOutput::bus(ContextRenderLock& r) const
 {
     ASSERT(r.context()); // only legal during rendering because an in place bus might have been supplied to pull
@@ -148,7 +192,6 @@ void AudioNodeOutput::addInput(ContextGraphLock& g, std::shared_ptr<AudioNodeInp
         return;
     
     m_inputs.emplace_back(input);
-    input->setDirty();
 }
 
 void AudioNodeOutput::removeInput(ContextGraphLock& g, std::shared_ptr<AudioNodeInput> input)
@@ -160,7 +203,6 @@ void AudioNodeOutput::removeInput(ContextGraphLock& g, std::shared_ptr<AudioNode
     {
         if (input == *i) 
         {
-            input->setDirty();
             i = m_inputs.erase(i);
             if (i == m_inputs.end()) break;
         }
@@ -12,17 +12,12 @@
 
 #include "internal/AudioUtilities.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include <algorithm>
 
 using namespace lab;
 
-// AudioBus is not exposed in the public API
-struct AudioParam::Data
-{
-    std::unique_ptr<AudioBus> m_internalSummingBus;
-};
-
 const double AudioParam::DefaultSmoothingConstant = 0.05;
 const double AudioParam::SnapThreshold = 0.001;
 
@@ -30,21 +25,34 @@ AudioParam::AudioParam(const std::string& name, double defaultValue, double minV
 : AudioSummingJunction()
 , m_name(name)
 , m_value(defaultValue)
+, m_setValue(static_cast<float>(defaultValue))
 , m_defaultValue(defaultValue)
 , m_minValue(minValue)
 , m_maxValue(maxValue)
 , m_units(units)
 , m_smoothedValue(defaultValue)
 , m_smoothingConstant(DefaultSmoothingConstant)
-, m_data(new Data())
 {
 
 }
 
 AudioParam::~AudioParam() {}
 
+void AudioParam::applySetValue(ContextRenderLock& r)
+{
+    if (!m_hasSetValue.exchange(false, std::memory_order_acquire))
+        return;
+
+    const float value = m_setValue.load(std::memory_order_relaxed);
+    m_value = value;
+    if (AudioContext* context = r.context())
+        context->recordParamValue(r, this, value);
+}
+
 float AudioParam::value(ContextRenderLock& r)
 {
+    applySetValue(r);
+
     // Update value for timeline.
     if (r.context()) {
         bool hasValue;
@@ -59,8 +67,10 @@ float AudioParam::value(ContextRenderLock& r)
 
 void AudioParam::setValue(float value)
 {
-    if (!std::isnan(value) && !std::isinf(value))
-        m_value = value;
+    if (!std::isnan(value) && !std::isinf(value)) {
+        m_setValue.store(value, std::memory_order_relaxed);
+        m_hasSetValue.store(true, std::memory_order_release);
+    }
 }
 
 float AudioParam::smoothedValue()
@@ -68,8 +78,16 @@ float AudioParam::smoothedValue()
     return static_cast<float>(m_smoothedValue);
 }
 
+void AudioParam::resetSmoothedValue(ContextRenderLock& r)
+{
+    applySetValue(r);
+    m_smoothedValue = m_value;
+}
+
 bool AudioParam::smooth(ContextRenderLock& r)
 {
+    applySetValue(r);
+
     // If values have been explicitly scheduled on the timeline, then use the exact value.
     // Smoothing effectively is performed by the timeline.
     bool useTimelineValue = false;
@@ -95,6 +113,57 @@ bool AudioParam::smooth(ContextRenderLock& r)
     return false;
 }
 
+bool AudioParam::isConstantForQuantum(ContextRenderLock& r, size_t framesToProcess)
+{
+    applySetValue(r);
+
+    if (!r.context() || isConnected())
+        return false;
+
+    if (!m_timeline.hasValues())
+        return true;
+
+    double sampleRate = r.context()->sampleRate();
+    double startTime = r.context()->currentTime();
+    double endTime = startTime + framesToProcess / sampleRate;
+
+    float value = static_cast<float>(m_value);
+    if (!m_timeline.isConstantForTimeRange(startTime, endTime, value))
+        return false;
+
+    m_value = value;
+    return true;
+}
+
+bool AudioParam::smooth(ContextRenderLock& r, float* values, size_t framesToProcess)
+{
+    applySetValue(r);
+
+    bool useTimelineValue = false;
+    if (r.context())
+        m_value = m_timeline.valueForContextTime(r, static_cast<float>(m_value), useTimelineValue);
+
+    if (m_smoothedValue == m_value || useTimelineValue) {
+        bool isSmoothed = m_smoothedValue == m_value;
+        m_smoothedValue = m_value;
+        float value = static_cast<float>(m_value);
+        VectorMath::vfill(&value, values, framesToProcess);
+        return isSmoothed;
+    }
+
+    // A quantum of frames shrinks the distance to the value by as much as smooth() does once.
+    float coefficient = static_cast<float>(1 - pow(1 - m_smoothingConstant, 1.0 / framesToProcess));
+    float smoothed = static_cast<float>(m_smoothedValue);
+    float target = static_cast<float>(m_value);
+    VectorMath::vsmooth(&smoothed, &target, &coefficient, values, framesToProcess);
+    m_smoothedValue = smoothed;
+
+    if (fabs(m_smoothedValue - m_value) < SnapThreshold)
+        m_smoothedValue = m_value;
+
+    return false;
+}
+
 float AudioParam::finalValue(ContextRenderLock& r)
 {
     float value;
@@ -117,6 +186,8 @@ void AudioParam::calculateFinalValues(ContextRenderLock& r, float* values, size_
     if (!isSafe)
         return;
 
+    applySetValue(r);
+
     // The calculated result will be the "intrinsic" value summed with all audio-rate connections.
 
     if (sampleAccurate) {
@@ -134,45 +205,100 @@ void AudioParam::calculateFinalValues(ContextRenderLock& r, float* values, size_
         values[0] = static_cast<float>(m_value);
     }
     
-    // if there are rendering connections, be sure they are ready
-    updateRenderingState(r);
-    
     size_t connectionCount = numberOfRenderingConnections(r);
     if (!connectionCount)
         return;
 
     // Now sum all of the audio-rate connections together (unity-gain summing junction).
     // Note that parameter connections would normally be mono, so mix down to mono if necessary.
-    
-    // LabSound: For some reason a bus was temporarily created here and the results discarded.
-    // Bug still exists in WebKit top of tree.
-    if (m_data->m_internalSummingBus && m_data->m_internalSummingBus->length() < numberOfValues)
-        m_data->m_internalSummingBus.reset();
-    
-    if (!m_data->m_internalSummingBus)
-        m_data->m_internalSummingBus.reset(new AudioBus(1, numberOfValues));
 
-    // point the summing bus at the values array
-    m_data->m_internalSummingBus->setChannelMemory(0, values, numberOfValues);
+    // The drivers' channels are read where they are and added straight into the values, with no bus between.
+    // Mono connections, the usual case, are summed together in one pass, a batch at a time. The channels of wider
+    // ones are mixed down through the gains AudioBus::sumFrom() would use, a batch at a time in one pass too.
+    const size_t BatchSize = 16;
+    const float* batch[BatchSize];
+    size_t batchCount = 0;
+
+    const float* mixBatch[VectorMath::MaxMixChannels];
+    float mixGains[VectorMath::MaxMixChannels];
+    size_t mixCount = 0;
+    const float* mixRows[1] = { mixGains };
+    float* mixDestinations[1] = { values };
 
     for (size_t i = 0; i < connectionCount; ++i)
     {
-        auto output = renderingOutput(r, i);
+        AudioNodeOutput * output = renderingOutput(r, i);
         
         ASSERT(output);
         
         // Render audio from this output.
-        AudioBus* connectionBus = output->pull(r, 0, AudioNode::ProcessingSizeInFrames);
-
+        AudioBus* connectionBus = output->pull(r, 0, r.context()->renderQuantumSize());
+
+        // A node rendering at control rate holds a value per stride frames. The values are interpolated from the
+        // quantum's last, so each is reached a stride after the frame it was rendered for.
+        const size_t stride = output->renderedStride();
+        if (stride > 1 && connectionBus->numberOfChannels() == 1) {
+            const float * controls = connectionBus->channel(0)->data();
+            const bool silent = connectionBus->isSilent();
+            float from = output->controlCarry();
+            for (size_t frame = 0, k = 0; frame < numberOfValues && (!silent || from != 0); ++k) {
+                const float to = silent ? 0.f : controls[k];
+                const float step = (to - from) / stride;
+                const size_t end = std::min(numberOfValues, frame + stride);
+                for (size_t j = 1; frame < end; ++frame, ++j)
+                    values[frame] += from + step * j;
+                from = to;
+            }
+        }
         // Sum, with unity-gain.
-        m_data->m_internalSummingBus->sumFrom(*connectionBus);
+        else if (connectionBus->numberOfChannels() == 1 && connectionBus->length() >= numberOfValues) {
+            if (!connectionBus->isSilent()) {
+                batch[batchCount++] = connectionBus->channel(0)->data();
+                if (batchCount == BatchSize) {
+                    VectorMath::vsum(batch, batchCount, values, numberOfValues);
+                    batchCount = 0;
+                }
+            }
+        }
+        else if (connectionBus->length() >= numberOfValues && !connectionBus->isSilent()) {
+            const size_t channelCount = connectionBus->numberOfChannels();
+            const float* gains = AudioBus::monoMixGains(channelCount);
+
+            // A discrete mix down takes the first channel as it is.
+            if (!gains) {
+                if (!connectionBus->channel(0)->isSilent()) {
+                    batch[batchCount++] = connectionBus->channel(0)->data();
+                    if (batchCount == BatchSize) {
+                        VectorMath::vsum(batch, batchCount, values, numberOfValues);
+                        batchCount = 0;
+                    }
+                }
+                continue;
+            }
+
+            for (size_t c = 0; c < channelCount; ++c) {
+                if (!gains[c] || connectionBus->channel(c)->isSilent())
+                    continue;
+                mixBatch[mixCount] = connectionBus->channel(c)->data();
+                mixGains[mixCount++] = gains[c];
+                if (mixCount == VectorMath::MaxMixChannels) {
+                    VectorMath::vmix(mixBatch, mixCount, mixRows, mixDestinations, 1, true, numberOfValues);
+                    mixCount = 0;
+                }
+            }
+        }
     }
+
+    if (batchCount)
+        VectorMath::vsum(batch, batchCount, values, numberOfValues);
+    if (mixCount)
+        VectorMath::vmix(mixBatch, mixCount, mixRows, mixDestinations, 1, true, numberOfValues);
 }
 
 void AudioParam::calculateTimelineValues(ContextRenderLock& r, float* values, size_t numberOfValues)
 {
     // Calculate values for this render quantum.
-    // Normally numberOfValues will equal AudioNode::ProcessingSizeInFrames (the render quantum size).
+    // Normally numberOfValues will equal the context's render quantum size.
     double sampleRate = r.context()->sampleRate();
     double startTime = r.context()->currentTime();
     double endTime = startTime + numberOfValues / sampleRate;
@@ -192,6 +318,7 @@ void AudioParam::connect(ContextGraphLock& g, std::shared_ptr<AudioParam> param,
     
     param->junctionConnectOutput(output);
     output->addParam(g, param);
+    setDirty(g, param);
 }
 
 void AudioParam::disconnect(ContextGraphLock& g, std::shared_ptr<AudioParam> param, std::shared_ptr<AudioNodeOutput> output)
@@ -201,6 +328,7 @@ void AudioParam::disconnect(ContextGraphLock& g, std::shared_ptr<AudioParam> par
     
     if (param->isConnected(output)) {
         param->junctionDisconnectOutput(output);
+        setDirty(g, param);
     }
     output->removeParam(g, param);
 }
@@ -213,4 +341,5 @@ void AudioParam::disconnectAll(ContextGraphLock& g, std::shared_ptr<AudioParam>
 			j->removeParam(g, param);
 	}
 	param->junctionDisconnectAllOutputs();
+	setDirty(g, param);
 }
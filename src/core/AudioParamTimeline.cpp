@@ -5,12 +5,15 @@
 #include "LabSound/core/AudioNode.h"
 #include "LabSound/core/AudioParamTimeline.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/ConcurrentQueue.h"
 #include "LabSound/core/Macros.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 
+#include "internal/AlignedAllocation.h"
 #include "internal/Assertions.h"
 #include "internal/AudioUtilities.h"
+#include "internal/VectorMath.h"
 
 #include <algorithm>
 
@@ -18,35 +21,118 @@ using namespace std;
 
 namespace lab {
 
-//@tofix - is there any reason this should be per object instead of static?
-namespace
+// Writes value from writeIndex up to fillToFrame, and advances writeIndex.
+static void fillValues(float* values, unsigned& writeIndex, size_t fillToFrame, float value)
+{
+    if (writeIndex < fillToFrame) {
+        VectorMath::vfill(&value, values + writeIndex, fillToFrame - writeIndex);
+        writeIndex = static_cast<unsigned>(fillToFrame);
+    }
+}
+
+// Changes made by the mutators, on their way to the render thread, and what the mutators need to check
+// further changes against.
+struct AudioParamTimeline::Commands : AlignedAllocation<AudioParamTimeline::Commands>
+{
+    struct Command
+    {
+        enum Type { Insert, Cancel };
+
+        Type type = Insert;
+
+        // A Cancel only uses the event's time.
+        ParamEvent event;
+    };
+
+    BoundedMPSCQueue<Command> queue{ 256 };
+
+    // Commands that didn't fit in the queue. Once one has overflowed, the rest follow it here until the render
+    // thread has taken them, so that they are applied in the order they were made.
+    std::mutex overflowMutex;
+    std::vector<Command> overflow;
+    std::atomic<bool> overflowPending{ false };
+
+    // Commands not yet applied by the render thread.
+    std::atomic<int> pending{ 0 };
+
+    // The events as the mutators have scheduled them, without their values, so that overlaps are found
+    // without touching the render thread's events. Those over by the time the render thread last read the
+    // timeline are pruned like its own.
+    struct Span
+    {
+        float time;
+        float duration;
+        unsigned type;
+    };
+    std::vector<Span> spans;
+    std::atomic<double> renderTime{ 0 };
+
+    // Called by a mutator, holding m_commandsMutex.
+    void push(Command&& command)
+    {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        if (!overflowPending.load(std::memory_order_acquire) && queue.tryPush(std::move(command)))
+            return;
+
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflow.emplace_back(std::move(command));
+        overflowPending.store(true, std::memory_order_release);
+    }
+
+    void pruneSpans()
+    {
+        // Nothing starts within a SetValueCurve, so of the events started by the render time, only the latest
+        // to start can still be in progress.
+        const double time = renderTime.load(std::memory_order_relaxed);
+        auto started = std::lower_bound(spans.begin(), spans.end(), time,
+            [](const Span& e, double time) { return e.time < time; });
+        if (started == spans.begin())
+            return;
+
+        auto pruneTo = std::lower_bound(spans.begin(), started, (started - 1)->time,
+            [](const Span& e, float time) { return e.time < time; });
+        size_t count = pruneTo - spans.begin();
+        if (count > 0 && count * 2 >= spans.size())
+            spans.erase(spans.begin(), pruneTo);
+    }
+};
+
+AudioParamTimeline::AudioParamTimeline()
+{
+}
+
+AudioParamTimeline::~AudioParamTimeline()
 {
-    std::mutex m_eventsMutex;
 }
 
 void AudioParamTimeline::setValueAtTime(float value, float time)
 {
-    insertEvent(ParamEvent(ParamEvent::SetValue, value, time, 0, 0, {}));
+    insertEvent(ParamEvent(ParamEvent::SetValue, value, time, 0, 0, nullptr));
 }
 
 void AudioParamTimeline::linearRampToValueAtTime(float value, float time)
 {
-    insertEvent(ParamEvent(ParamEvent::LinearRampToValue, value, time, 0, 0, {}));
+    insertEvent(ParamEvent(ParamEvent::LinearRampToValue, value, time, 0, 0, nullptr));
 }
 
 void AudioParamTimeline::exponentialRampToValueAtTime(float value, float time)
 {
-    insertEvent(ParamEvent(ParamEvent::ExponentialRampToValue, value, time, 0, 0, {}));
+    insertEvent(ParamEvent(ParamEvent::ExponentialRampToValue, value, time, 0, 0, nullptr));
 }
 
 void AudioParamTimeline::setTargetAtTime(float target, float time, float timeConstant)
 {
-    insertEvent(ParamEvent(ParamEvent::SetTarget, target, time, timeConstant, 0, {}));
+    insertEvent(ParamEvent(ParamEvent::SetTarget, target, time, timeConstant, 0, nullptr));
 }
 
-void AudioParamTimeline::setValueCurveAtTime(std::vector<float> & curve, float time, float duration)
+void AudioParamTimeline::setValueCurveAtTime(std::vector<float> curve, float time, float duration)
 {
-    insertEvent(ParamEvent(ParamEvent::SetValueCurve, 0, time, 0, duration, curve));
+    setValueCurveAtTime(std::make_shared<const std::vector<float>>(std::move(curve)), time, duration);
+}
+
+void AudioParamTimeline::setValueCurveAtTime(std::shared_ptr<const std::vector<float>> curve, float time, float duration)
+{
+    insertEvent(ParamEvent(ParamEvent::SetValueCurve, 0, time, 0, duration, std::move(curve)));
 }
 
 static bool isValidNumber(float x)
@@ -54,7 +140,7 @@ static bool isValidNumber(float x)
     return !std::isnan(x) && !std::isinf(x);
 }
 
-void AudioParamTimeline::insertEvent(const ParamEvent& event)
+void AudioParamTimeline::insertEvent(ParamEvent&& event)
 {
     // Sanity check the event. Be super careful we're not getting infected with NaN or Inf.
     bool isValid = event.type() < ParamEvent::LastType
@@ -69,65 +155,166 @@ void AudioParamTimeline::insertEvent(const ParamEvent& event)
     if (!isValid)
         return;
 
-    std::lock_guard<std::mutex> lock(m_eventsMutex);
+    std::lock_guard<std::mutex> lock(m_commandsMutex);
+    Commands& commands = commandsForChange();
+    commands.pruneSpans();
 
-    unsigned i = 0;
-    float insertTime = event.time();
-    
-    for (i = 0; i < m_events.size(); ++i)
+    std::vector<Commands::Span>& spans = commands.spans;
+    const float insertTime = event.time();
+
+    // The events at the insertion time are [sameTime, insertAt); a new event goes after them.
+    auto insertAt = std::upper_bound(spans.begin(), spans.end(), insertTime,
+        [](float time, const Commands::Span& e) { return time < e.time; });
+    auto sameTime = std::lower_bound(spans.begin(), insertAt, insertTime,
+        [](const Commands::Span& e, float time) { return e.time < time; });
+
+    if (event.type() == ParamEvent::SetValueCurve)
     {
-        
-        if (event.type() == ParamEvent::SetValueCurve)
+        // If this event is a SetValueCurve, make sure it doesn't overlap any existing
+        // event. It's ok if the SetValueCurve starts at the same time as the end of some other
+        // duration. The first event after it is the only one that could start within it.
+        double endTime = event.time() + event.duration();
+        if (insertAt != spans.end() && insertAt->time < endTime)
         {
-            // If this event is a SetValueCurve, make sure it doesn't overlap any existing
-            // event. It's ok if the SetValueCurve starts at the same time as the end of some other
-            // duration.
-            double endTime = event.time() + event.duration();
-            if (m_events[i].time() > event.time() && m_events[i].time() < endTime)
-            {
-                throw std::runtime_error("ParamEvent::SetValueCurve overlaps existing");
-            }
+            throw std::runtime_error("ParamEvent::SetValueCurve overlaps existing");
         }
-        else
+    }
+
+    // Make sure this event doesn't start within an existing SetValueCurve event. No event starts within one,
+    // so the one covering the insertion time would be among the latest to start at or before it. A
+    // SetValueCurve at the same time is overwritten rather than overlapped.
+    for (auto latest = insertAt; latest != spans.begin() && (latest - 1)->time == (insertAt - 1)->time; )
+    {
+        --latest;
+        if (latest->type == ParamEvent::SetValueCurve
+            && !(event.type() == ParamEvent::SetValueCurve && latest->time == insertTime))
         {
-            // Otherwise, make sure this event doesn't overlap any existing SetValueCurve event.
-            if (m_events[i].type() == ParamEvent::SetValueCurve)
+            double endTime = latest->time + latest->duration;
+            if (event.time() >= latest->time && event.time() < endTime)
             {
-                double endTime = m_events[i].time() + m_events[i].duration();
-                if (event.time() >= m_events[i].time() && event.time() < endTime)
-                {
-                    throw std::runtime_error("ParamEvent::SetValueCurve overlaps existing");
-                }
+                throw std::runtime_error("ParamEvent::SetValueCurve overlaps existing");
             }
         }
-        
-        // Overwrite same event type and time.
-        if (m_events[i].time() == insertTime && m_events[i].type() == event.type())
-        {
-            m_events[i] = event;
-            return;
-        }
+    }
 
-        if (m_events[i].time() > insertTime)
-        {
-            break;
+    // Overwrite same event type and time, as the render thread will.
+    auto same = std::find_if(sameTime, insertAt, [&event](const Commands::Span& e) { return e.type == event.type(); });
+    if (same != insertAt)
+        same->duration = event.duration();
+    else
+        spans.insert(insertAt, Commands::Span{ event.time(), event.duration(), event.type() });
+
+    commands.push(Commands::Command{ Commands::Command::Insert, std::move(event) });
+}
+
+void AudioParamTimeline::cancelScheduledValues(float startTime)
+{
+    std::lock_guard<std::mutex> lock(m_commandsMutex);
+    Commands& commands = commandsForChange();
+
+    auto cancelFrom = std::lower_bound(commands.spans.begin(), commands.spans.end(), startTime,
+        [](const Commands::Span& e, float time) { return e.time < time; });
+    commands.spans.erase(cancelFrom, commands.spans.end());
+
+    commands.push(Commands::Command{ Commands::Command::Cancel, ParamEvent(ParamEvent::LastType, 0, startTime, 0, 0, nullptr) });
+}
+
+AudioParamTimeline::Commands& AudioParamTimeline::commandsForChange()
+{
+    if (!m_ownedCommands) {
+        m_ownedCommands.reset(new Commands());
+        m_commands.store(m_ownedCommands.get(), std::memory_order_release);
+    }
+    return *m_ownedCommands;
+}
+
+bool AudioParamTimeline::hasValues() const
+{
+    if (m_hasEvents.load(std::memory_order_relaxed))
+        return true;
+
+    Commands* commands = m_commands.load(std::memory_order_acquire);
+    return commands && commands->pending.load(std::memory_order_relaxed) > 0;
+}
+
+void AudioParamTimeline::applyCommands(double renderTime)
+{
+    Commands* commands = m_commands.load(std::memory_order_acquire);
+    if (!commands)
+        return;
+
+    commands->renderTime.store(renderTime, std::memory_order_relaxed);
+
+    int applied = 0;
+    auto apply = [this, &applied](Commands::Command& command) {
+        if (command.type == Commands::Command::Insert)
+            applyEvent(std::move(command.event));
+        else
+            applyCancel(command.event.time());
+        ++applied;
+    };
+
+    Commands::Command command;
+    while (commands->queue.tryPop(command))
+        apply(command);
+
+    // Wait for the overflow until the next read, rather than for the mutator appending to it.
+    if (commands->overflowPending.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(commands->overflowMutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            std::vector<Commands::Command> overflow;
+            std::swap(overflow, commands->overflow);
+            commands->overflowPending.store(false, std::memory_order_release);
+            lock.unlock();
+
+            for (auto& c : overflow)
+                apply(c);
         }
     }
 
-    m_events.insert(m_events.begin() + i, event);
+    if (applied) {
+        m_hasEvents.store(!m_events.empty(), std::memory_order_relaxed);
+        commands->pending.fetch_sub(applied, std::memory_order_relaxed);
+    }
 }
 
-void AudioParamTimeline::cancelScheduledValues(float startTime)
+void AudioParamTimeline::applyEvent(ParamEvent&& event)
 {
-    std::lock_guard<std::mutex> lock(m_eventsMutex);
+    const float insertTime = event.time();
 
-    // Remove all events starting at startTime.
-    for (unsigned i = 0; i < m_events.size(); ++i) {
-        if (m_events[i].time() >= startTime) {
-            m_events.erase(m_events.begin() + i, m_events.end());
-            break;
+    // The events at the insertion time are [sameTime, insertAt); a new event goes after them.
+    auto insertAt = std::upper_bound(m_events.begin(), m_events.end(), insertTime,
+        [](float time, const ParamEvent& e) { return time < e.time(); });
+    auto sameTime = std::lower_bound(m_events.begin(), insertAt, insertTime,
+        [](const ParamEvent& e, float time) { return e.time() < time; });
+
+    // Overwrite same event type and time.
+    for (auto i = sameTime; i != insertAt; ++i)
+    {
+        if (i->type() == event.type())
+        {
+            *i = std::move(event);
+            return;
         }
     }
+
+    // Keep the cursor on the event it was on.
+    size_t index = insertAt - m_events.begin();
+    if (m_cursor > 0 && index <= m_cursor)
+        ++m_cursor;
+
+    m_events.insert(insertAt, std::move(event));
+}
+
+void AudioParamTimeline::applyCancel(float startTime)
+{
+    // Remove all events starting at startTime.
+    auto cancelFrom = std::lower_bound(m_events.begin(), m_events.end(), startTime,
+        [](const ParamEvent& e, float time) { return e.time() < time; });
+    m_events.erase(cancelFrom, m_events.end());
+
+    if (m_cursor >= m_events.size())
+        m_cursor = m_events.empty() ? 0 : m_events.size() - 1;
 }
 
 float AudioParamTimeline::valueForContextTime(ContextRenderLock& r, float defaultValue, bool& hasValue)
@@ -136,8 +323,9 @@ float AudioParamTimeline::valueForContextTime(ContextRenderLock& r, float defaul
     if (!context)
         return defaultValue;
 
-    std::unique_lock<std::mutex> lock(m_eventsMutex, std::try_to_lock);
-    if (!lock.owns_lock() || !m_events.size() || context->currentTime() < m_events[0].time()) {
+    applyCommands(context->currentTime());
+
+    if (!m_events.size() || context->currentTime() < m_events[0].time()) {
         hasValue = false;
         return defaultValue;
     }
@@ -146,8 +334,8 @@ float AudioParamTimeline::valueForContextTime(ContextRenderLock& r, float defaul
     double sampleRate = context->sampleRate();
     double startTime = context->currentTime();
     double endTime = startTime + 1.1 / sampleRate; // time just beyond one sample-frame
-    double controlRate = sampleRate / AudioNode::ProcessingSizeInFrames; // one parameter change per render quantum
-    float value = valuesForTimeRange(startTime, endTime, defaultValue, &value, 1, sampleRate, controlRate);
+    double controlRate = sampleRate / context->renderQuantumSize(); // one parameter change per render quantum
+    float value = valuesForTimeRangeImpl(startTime, endTime, defaultValue, &value, 1, sampleRate, controlRate);
 
     hasValue = true;
     return value;
@@ -162,10 +350,47 @@ float AudioParamTimeline::valuesForTimeRange(
     double sampleRate,
     double controlRate)
 {
+    if (!values)
+        return defaultValue;
+
+    applyCommands(startTime);
+
     float value = valuesForTimeRangeImpl(startTime, endTime, defaultValue, values, numberOfValues, sampleRate, controlRate);
     return value;
 }
 
+bool AudioParamTimeline::isConstantForTimeRange(double startTime, double endTime, float& value)
+{
+    applyCommands(startTime);
+
+    // The event in effect at startTime is the last to start by then, and the value holds until the next starts,
+    // unless the one in effect approaches a target or plays a curve, or the next ramps to its value.
+    auto next = std::upper_bound(m_events.begin(), m_events.end(), startTime,
+        [](double time, const ParamEvent& e) { return time < e.time(); });
+
+    if (next != m_events.end() && next->time() < endTime)
+        return false;
+
+    if (next == m_events.begin())
+        return true;
+
+    if (next != m_events.end()
+        && (next->type() == ParamEvent::LinearRampToValue || next->type() == ParamEvent::ExponentialRampToValue))
+        return false;
+
+    const ParamEvent& event = *(next - 1);
+    switch (event.type()) {
+    case ParamEvent::SetValue:
+    case ParamEvent::LinearRampToValue:
+    case ParamEvent::ExponentialRampToValue:
+        value = event.value();
+        return true;
+
+    default:
+        return false;
+    }
+}
+
 float AudioParamTimeline::valuesForTimeRangeImpl(
     double startTime,
     double endTime,
@@ -175,14 +400,9 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
     double sampleRate,
     double controlRate)
 {
-    if (!values)
-        return defaultValue;
-
     // Return default value if there are no events matching the desired time range.
-    std::unique_lock<std::mutex> lock(m_eventsMutex, std::try_to_lock);
-    if (!lock.owns_lock() || !m_events.size() || endTime <= m_events[0].time()) {
-        for (unsigned i = 0; i < numberOfValues; ++i)
-            values[i] = defaultValue;
+    if (!m_events.size() || endTime <= m_events[0].time()) {
+        VectorMath::vfill(&defaultValue, values, numberOfValues);
         return defaultValue;
     }
 
@@ -197,8 +417,7 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
         double fillToTime = std::min(endTime, firstEventTime);
         size_t fillToFrame = AudioUtilities::timeToSampleFrame(fillToTime - startTime, sampleRate);
         fillToFrame = std::min(fillToFrame, numberOfValues);
-        for (; writeIndex < fillToFrame; ++writeIndex)
-            values[writeIndex] = defaultValue;
+        fillValues(values, writeIndex, fillToFrame, defaultValue);
 
         currentTime = fillToTime;
     }
@@ -207,10 +426,14 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
     // Go through each event and render the value buffer where the times overlap,
     // stopping when we've rendered all the requested values.
-    // FIXME: could try to optimize by avoiding having to iterate starting from the very first event
-    // and keeping track of a "current" event index.
+    // An event is passed over once the next has started. Resume from the first the last render needed, if
+    // the ones before it are still passed over, which they are unless time has gone back.
     int n = static_cast<int>(m_events.size());
-    for (int i = 0; i < n && writeIndex < numberOfValues; ++i) {
+    if (m_cursor >= m_events.size() || !(m_events[m_cursor].time() < startTime))
+        m_cursor = 0;
+
+    bool isCursorSet = false;
+    for (int i = static_cast<int>(m_cursor); i < n && writeIndex < numberOfValues; ++i) {
         ParamEvent& event = m_events[i];
         ParamEvent* nextEvent = i < n - 1 ? &(m_events[i + 1]) : 0;
 
@@ -218,6 +441,11 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
         if (nextEvent && nextEvent->time() < currentTime)
             continue;
 
+        if (!isCursorSet) {
+            m_cursor = i;
+            isCursorSet = true;
+        }
+
         float value1 = event.value();
         double time1 = event.time();
         float value2 = nextEvent ? nextEvent->value() : value1;
@@ -235,17 +463,22 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
         // First handle linear and exponential ramps which require looking ahead to the next event.
         if (nextEventType == ParamEvent::LinearRampToValue) {
-            for (; writeIndex < fillToFrame; ++writeIndex) {
+            if (writeIndex < fillToFrame) {
+                // value = (1 - x) * value1 + x * value2, where x advances by k for each second.
+                size_t count = fillToFrame - writeIndex;
                 float x = static_cast<float>(currentTime - time1) * k;
-                value = (1 - x) * value1 + x * value2;
-                values[writeIndex] = value;
-                currentTime += sampleFrameTimeIncr;
+                float start = value1 + x * (value2 - value1);
+                float step = static_cast<float>(sampleFrameTimeIncr) * k * (value2 - value1);
+                VectorMath::vramp(&start, &step, values + writeIndex, count);
+
+                value = values[fillToFrame - 1];
+                currentTime += count * sampleFrameTimeIncr;
+                writeIndex = static_cast<unsigned>(fillToFrame);
             }
         } else if (nextEventType == ParamEvent::ExponentialRampToValue) {
             if (value1 <= 0 || value2 <= 0) {
                 // Handle negative values error case by propagating previous value.
-                for (; writeIndex < fillToFrame; ++writeIndex)
-                    values[writeIndex] = value;
+                fillValues(values, writeIndex, fillToFrame, value);
             } else {
                 float numSampleFrames = static_cast<float>(deltaTime * sampleRate);
                 // The value goes exponentially from value1 to value2 in a duration of deltaTime seconds (corresponding to numSampleFrames).
@@ -258,10 +491,13 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
                 value = value1 * powf(value2 / value1,
                                       AudioUtilities::timeToSampleFrame(currentTime - time1, sampleRate) / numSampleFrames);
 
-                for (; writeIndex < fillToFrame; ++writeIndex) {
-                    values[writeIndex] = value;
-                    value *= multiplier;
-                    currentTime += sampleFrameTimeIncr;
+                if (writeIndex < fillToFrame) {
+                    size_t count = fillToFrame - writeIndex;
+                    VectorMath::vexpramp(&value, &multiplier, values + writeIndex, count);
+
+                    value = values[fillToFrame - 1] * multiplier;
+                    currentTime += count * sampleFrameTimeIncr;
+                    writeIndex = static_cast<unsigned>(fillToFrame);
                 }
             }
         } else {
@@ -275,8 +511,7 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
                     // Simply stay at a constant value.
                     value = event.value();
-                    for (; writeIndex < fillToFrame; ++writeIndex)
-                        values[writeIndex] = value;
+                    fillValues(values, writeIndex, fillToFrame, value);
 
                     break;
                 }
@@ -285,14 +520,29 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
                 {
                     currentTime = fillToTime;
 
-                    // Exponential approach to target value with given time constant.
+                    // Exponential approach to target value with given time constant. The distance to the target
+                    // shrinks by 1 - discreteTimeConstant a frame, target + (value - target) * (1 - k)^i, which is
+                    // rendered in closed form rather than stepped a frame at a time.
                     float target = event.value();
                     float timeConstant = event.timeConstant();
                     float discreteTimeConstant = static_cast<float>(AudioUtilities::discreteTimeConstantForSampleRate(timeConstant, controlRate));
 
-                    for (; writeIndex < fillToFrame; ++writeIndex) {
-                        values[writeIndex] = value;
-                        value += (target - value) * discreteTimeConstant;
+                    if (writeIndex < fillToFrame) {
+                        size_t count = fillToFrame - writeIndex;
+                        float ratio = 1 - discreteTimeConstant;
+                        if (ratio > 0 && ratio < 1) {
+                            float distance = value - target;
+                            VectorMath::vexpramp(&distance, &ratio, values + writeIndex, count);
+                            VectorMath::vsadd(values + writeIndex, &target, values + writeIndex, count);
+                            value = target + (values[fillToFrame - 1] - target) * ratio;
+                            writeIndex = static_cast<unsigned>(fillToFrame);
+                        } else {
+                            // A time constant of 0 jumps to the target after the first frame.
+                            values[writeIndex++] = value;
+                            if (ratio <= 0)
+                                value = target;
+                            fillValues(values, writeIndex, fillToFrame, value);
+                        }
                     }
 
                     break;
@@ -300,9 +550,9 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
             case ParamEvent::SetValueCurve:
                 {
-                    std::vector<float> & curve = event.curve();
-                    float * curveData = curve.size() > 0 ? curve.data() : 0;
-                    size_t numberOfCurvePoints = curve.size() > 0 ? curve.size() : 0;
+                    const std::vector<float> * curve = event.curve();
+                    const float * curveData = curve && curve->size() > 0 ? curve->data() : 0;
+                    size_t numberOfCurvePoints = curve ? curve->size() : 0;
 
                     // Curve events have duration, so don't just use next event time.
                     float duration = event.duration();
@@ -311,12 +561,11 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
                     // (N - 1)/Td in the specification.
                     float curvePointsPerFrame = static_cast<float>((numberOfCurvePoints - 1) / duration / sampleRate);
 
-                    if (curve.size() == 0 || !curveData || !numberOfCurvePoints || duration <= 0 || sampleRate <= 0)
+                    if (!curveData || !numberOfCurvePoints || duration <= 0 || sampleRate <= 0)
                     {
                         // Error condition - simply propagate previous value.
                         currentTime = fillToTime;
-                        for (; writeIndex < fillToFrame; ++writeIndex)
-                            values[writeIndex] = value;
+                        fillValues(values, writeIndex, fillToFrame, value);
                         break;
                     }
 
@@ -347,24 +596,26 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
                     // Render the stretched curve data using nearest neighbor sampling.
                     // Oversampled curve data can be provided if smoothness is desired.
-                    for (; writeIndex < fillToFrame; ++writeIndex) {
-                        // Ideally we'd use round() from MathExtras, but we're in a tight loop here
-                        // and we're trading off precision for extra speed.
-                        unsigned curveIndex = static_cast<unsigned>(0.5 + curveVirtualIndex);
-
-                        curveVirtualIndex += curvePointsPerFrame;
-
-                        // Bounds check.
-                        if (curveIndex < numberOfCurvePoints)
-                            value = curveData[curveIndex];
-
-                        values[writeIndex] = value;
+                    // The indices are laid down as a ramp in the values themselves, each computed from its frame
+                    // rather than accumulated, and then replaced by the points they pick. Past the last point
+                    // the curve holds it.
+                    if (writeIndex < fillToFrame) {
+                        size_t count = fillToFrame - writeIndex;
+                        float* dest = values + writeIndex;
+                        float start = curveVirtualIndex + 0.5f;
+                        VectorMath::vramp(&start, &curvePointsPerFrame, dest, count);
+
+                        const float lastPoint = static_cast<float>(numberOfCurvePoints - 1);
+                        for (size_t j = 0; j < count; ++j)
+                            dest[j] = curveData[static_cast<size_t>(std::min(dest[j], lastPoint))];
+
+                        value = dest[count - 1];
+                        writeIndex = static_cast<unsigned>(fillToFrame);
                     }
 
                     // If there's any time left after the duration of this event and the start
                     // of the next, then just propagate the last value.
-                    for (; writeIndex < nextEventFillToFrame; ++writeIndex)
-                        values[writeIndex] = value;
+                    fillValues(values, writeIndex, nextEventFillToFrame, value);
 
                     // Re-adjust current time
                     currentTime = nextEventFillToTime;
@@ -377,8 +628,17 @@ float AudioParamTimeline::valuesForTimeRangeImpl(
 
     // If there's any time left after processing the last event then just propagate the last value
     // to the end of the values buffer.
-    for (; writeIndex < numberOfValues; ++writeIndex)
-        values[writeIndex] = value;
+    fillValues(values, writeIndex, numberOfValues, value);
+
+    // Prune the events passed over, once there are enough of them that moving the rest down costs no more than
+    // passing over them again would have. Those starting with the cursor's event are kept, since an event
+    // inserted at that time could still overwrite one of them rather than follow them.
+    if (m_cursor > 0 && m_cursor * 2 >= m_events.size()) {
+        auto pruneTo = std::lower_bound(m_events.begin(), m_events.begin() + m_cursor, m_events[m_cursor].time(),
+            [](const ParamEvent& e, float time) { return e.time() < time; });
+        m_cursor -= pruneTo - m_events.begin();
+        m_events.erase(m_events.begin(), pruneTo);
+    }
 
     return value;
 }
@@ -10,9 +10,14 @@
 #include "LabSound/extended/AudioContextLock.h"
 
 #include "internal/AudioUtilities.h"
+#include "internal/VectorMath.h"
 #include "internal/Assertions.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
 
 using namespace std;
 
@@ -24,25 +29,85 @@ AudioScheduledSourceNode::AudioScheduledSourceNode()
 : m_playbackState(UNSCHEDULED_STATE)
 , m_pendingStartTime(UnknownTime), m_startTime(0)
 , m_pendingEndTime(UnknownTime), m_endTime(UnknownTime)
+, m_pendingStartBeat(std::numeric_limits<double>::quiet_NaN())
+, m_pendingEndBeat(std::numeric_limits<double>::quiet_NaN())
 {
 }
 
-void AudioScheduledSourceNode::updateSchedulingInfo(ContextRenderLock& r,
+AudioScheduledSourceNode::~AudioScheduledSourceNode()
+{
+    releaseOnEnded(m_onEnded.exchange(nullptr));
+}
+
+void AudioScheduledSourceNode::setOnEnded(std::function<void()> fn)
+{
+    OnEndedHandler * handler = nullptr;
+    if (fn)
+    {
+        handler = new OnEndedHandler();
+        handler->fn = std::move(fn);
+    }
+
+    // finish() may have loaded the old handler before the exchange, and not yet taken its reference.
+    OnEndedHandler * replaced = m_onEnded.exchange(handler);
+    while (m_takingOnEnded.load())
+        std::this_thread::yield();
+    releaseOnEnded(replaced);
+}
+
+void AudioScheduledSourceNode::releaseOnEnded(OnEndedHandler * handler)
+{
+    if (handler && handler->references.fetch_sub(1) == 1)
+        delete handler;
+}
+
+void AudioScheduledSourceNode::dispatchOnEnded(void * payload)
+{
+    OnEndedHandler * handler;
+    memcpy(&handler, payload, sizeof(handler));
+    handler->fn();
+    releaseOnEnded(handler);
+}
+
+// Zeroes frames [start, end) of each of the bus's channels.
+static void zeroFrames(AudioBus * bus, size_t start, size_t end)
+{
+    static const float zero = 0.f;
+    for (unsigned i = 0; i < bus->numberOfChannels(); ++i)
+        VectorMath::vfill(&zero, bus->channel(i)->mutableData() + start, end - start);
+}
+
+bool AudioScheduledSourceNode::updateSchedulingInfo(ContextRenderLock& r,
                                                     size_t quantumFrameSize,
                                                     AudioBus * outputBus,
                                                     size_t & quantumFrameOffset,
                                                     size_t & nonSilentFramesToProcess)
 {
-    if (!outputBus)
-        return;
+    quantumFrameOffset = 0;
+    nonSilentFramesToProcess = 0;
 
-    if (quantumFrameSize != AudioNode::ProcessingSizeInFrames)
-        return;
+    if (!outputBus)
+        return false;
 
     AudioContext * context = r.context();
 
-    if (!context)
-        return;
+    if (!context || quantumFrameSize != context->renderQuantumSize())
+    {
+        outputBus->zero();
+        return false;
+    }
+
+    // Beats become times by the tempo map the render thread follows now.
+    if (!std::isnan(m_pendingEndBeat))
+    {
+        m_pendingEndTime = max(0.0, context->renderTempoMap(r).timeAtBeat(m_pendingEndBeat));
+        m_pendingEndBeat = std::numeric_limits<double>::quiet_NaN();
+    }
+    if (!std::isnan(m_pendingStartBeat))
+    {
+        m_pendingStartTime = max(0.0, context->renderTempoMap(r).timeAtBeat(m_pendingStartBeat));
+        m_pendingStartBeat = std::numeric_limits<double>::quiet_NaN();
+    }
 
     // not atomic, but will largely prevent the times from being updated
     // by another thread during the update calculations.
@@ -50,11 +115,13 @@ void AudioScheduledSourceNode::updateSchedulingInfo(ContextRenderLock& r,
     {
         m_endTime = m_pendingEndTime;
         m_pendingEndTime = UnknownTime;
+        context->recordSchedule(r, this, false, m_endTime);
     }
     if (m_pendingStartTime > UnknownTime)
     {
         m_startTime = m_pendingStartTime;
         m_pendingStartTime = UnknownTime;
+        context->recordSchedule(r, this, true, m_startTime);
     }
 
     float sampleRate = r.context()->sampleRate();
@@ -75,10 +142,8 @@ void AudioScheduledSourceNode::updateSchedulingInfo(ContextRenderLock& r,
     // If unscheduled, or finished, or out of time, output silence
     if (m_playbackState == UNSCHEDULED_STATE || m_playbackState == FINISHED_STATE || startFrame >= quantumEndFrame)
     {
-        // Output silence.
         outputBus->zero();
-        nonSilentFramesToProcess = 0;
-        return;
+        return false;
     }
 
     // Check if it's time to start playing.
@@ -87,47 +152,33 @@ void AudioScheduledSourceNode::updateSchedulingInfo(ContextRenderLock& r,
         m_playbackState = PLAYING_STATE;
     }
 
-    quantumFrameOffset = startFrame > quantumStartFrame ? startFrame - quantumStartFrame : 0;
-    quantumFrameOffset = std::min(quantumFrameOffset, quantumFrameSize); // clamp to valid range
-    nonSilentFramesToProcess = quantumFrameSize - quantumFrameOffset;
-
-    if (!nonSilentFramesToProcess)
+    // The source sounds from its start frame, or the quantum's start, up to its end frame, if that falls in this
+    // quantum, or the quantum's end.
+    const size_t spanStart = startFrame > quantumStartFrame ? static_cast<size_t>(startFrame - quantumStartFrame) : 0;
+    size_t spanEnd = quantumFrameSize;
+    const bool endsInQuantum = m_endTime != UnknownTime && endFrame >= quantumStartFrame && endFrame < quantumEndFrame;
+    if (endsInQuantum)
     {
-        // Output silence.
-        outputBus->zero();
-        return;
+        spanEnd = static_cast<size_t>(endFrame - quantumStartFrame);
+        finish(r);
     }
 
-    // Handle silence before we start playing.
-    // Zero any initial frames representing silence leading up to a rendering start time in the middle of the quantum.
-    if (quantumFrameOffset)
+    // A stop at or before the start leaves nothing to render.
+    if (spanEnd <= spanStart)
     {
-        for (unsigned i = 0; i < outputBus->numberOfChannels(); ++i)
-            memset(outputBus->channel(i)->mutableData(), 0, sizeof(float) * quantumFrameOffset);
+        outputBus->zero();
+        return false;
     }
 
-    // Handle silence after we're done playing.
-    // If the end time is somewhere in the middle of this time quantum, then zero out the
-    // frames from the end time to the very end of the quantum.
-    if (m_endTime != UnknownTime && endFrame >= quantumStartFrame && endFrame < quantumEndFrame) {
-        size_t zeroStartFrame = endFrame - quantumStartFrame;
-        size_t framesToZero = quantumFrameSize - zeroStartFrame;
-
-        bool isSafe = zeroStartFrame < quantumFrameSize && framesToZero <= quantumFrameSize && zeroStartFrame + framesToZero <= quantumFrameSize;
-        ASSERT(isSafe);
-
-        if (isSafe) {
-            if (framesToZero > nonSilentFramesToProcess)
-                nonSilentFramesToProcess = 0;
-            else
-                nonSilentFramesToProcess -= framesToZero;
-
-            for (unsigned i = 0; i < outputBus->numberOfChannels(); ++i)
-                memset(outputBus->channel(i)->mutableData() + zeroStartFrame, 0, sizeof(float) * framesToZero);
-        }
+    // The frames before the start and after the end are silent; the source renders just the frames between.
+    if (spanStart)
+        zeroFrames(outputBus, 0, spanStart);
+    if (spanEnd < quantumFrameSize)
+        zeroFrames(outputBus, spanEnd, quantumFrameSize);
 
-        finish(r);
-    }
+    quantumFrameOffset = spanStart;
+    nonSilentFramesToProcess = spanEnd - spanStart;
+    return true;
 }
 
 void AudioScheduledSourceNode::start(double when)
@@ -142,6 +193,7 @@ void AudioScheduledSourceNode::start(double when)
         return;
     }
 
+    m_pendingStartBeat = std::numeric_limits<double>::quiet_NaN();
     m_pendingStartTime = when;
     m_playbackState = SCHEDULED_STATE;
 }
@@ -158,19 +210,63 @@ void AudioScheduledSourceNode::stop(double when)
         return;
 
     when = max(0.0, when);
+    m_pendingEndBeat = std::numeric_limits<double>::quiet_NaN();
     m_pendingEndTime = when;
 }
 
+void AudioScheduledSourceNode::startAtBeat(double beat)
+{
+    if (m_playbackState == PLAYING_STATE || !std::isfinite(beat))
+        return;
+
+    m_pendingStartTime = UnknownTime;
+    m_pendingStartBeat = beat;
+    m_playbackState = SCHEDULED_STATE;
+}
+
+void AudioScheduledSourceNode::stopAtBeat(double beat)
+{
+    if (!std::isfinite(beat))
+        return;
+
+    m_pendingEndTime = UnknownTime;
+    m_pendingEndBeat = beat;
+}
+
+void AudioScheduledSourceNode::forgetElapsedEndTime(ContextRenderLock& r)
+{
+    if (m_endTime != UnknownTime && m_endTime <= r.context()->currentTime())
+        m_endTime = UnknownTime;
+}
+
 void AudioScheduledSourceNode::reset(ContextRenderLock&)
 {
     m_pendingEndTime = UnknownTime;
+    m_pendingEndBeat = std::numeric_limits<double>::quiet_NaN();
     m_playbackState = UNSCHEDULED_STATE;
 }
 
 void AudioScheduledSourceNode::finish(ContextRenderLock& r)
 {
     m_playbackState = FINISHED_STATE;
-    r.context()->enqueueEvent(m_onEnded);
+
+    // If the context holds this source until it finishes, it can let it go now.
+    r.context()->notifySourceFinished();
+
+    // The flag is raised before the handler is loaded, so a setOnEnded() replacing it waits until the event has
+    // its reference before releasing the node's.
+    m_takingOnEnded.store(true);
+
+    // The event holds a reference until it has been dispatched. The node still holds its own here, so dropping
+    // the event's reference again when the event ring is full can't free the handler on this thread.
+    if (OnEndedHandler * handler = m_onEnded.load())
+    {
+        handler->references.fetch_add(1);
+        if (!r.context()->enqueueEvent(&AudioScheduledSourceNode::dispatchOnEnded, &handler, sizeof(handler)))
+            handler->references.fetch_sub(1);
+    }
+
+    m_takingOnEnded.store(false);
 }
 
 } // namespace lab
@@ -11,54 +11,35 @@
 #include "internal/Assertions.h"
 
 #include <algorithm>
-#include <iostream>
 
 namespace lab 
 {
-    
-lab::concurrent_queue<std::shared_ptr<AudioSummingJunction>> s_dirtySummingJunctions;
-
-namespace
-{
-    std::mutex junctionMutex;
-}
 
-void AudioSummingJunction::handleDirtyAudioSummingJunctions(ContextRenderLock& r)
-{
-    ASSERT(r.context());
-    std::shared_ptr<AudioSummingJunction> asj;
-    while (s_dirtySummingJunctions.try_pop(asj))
-        asj->updateRenderingState(r);
-}
-
-AudioSummingJunction::AudioSummingJunction() : m_renderingStateNeedUpdating(false)
+AudioSummingJunction::AudioSummingJunction()
 {
     
 }
 
 AudioSummingJunction::~AudioSummingJunction()
 {
-    
+    delete m_pendingOutputs.exchange(nullptr);
+    delete m_renderingOutputs;
 }
     
 bool AudioSummingJunction::isConnected(std::shared_ptr<AudioNodeOutput> o) const
 {
-    std::lock_guard<std::mutex> lock(junctionMutex);
-    
-    for (auto i : m_connectedOutputs)
+    for (auto & i : m_connectedOutputs)
         if (i.lock() == o)
             return true;
 
     return false;
 }
 
-size_t AudioSummingJunction::numberOfRenderingConnections(ContextRenderLock&) const {
-    size_t count = 0;
-    for (auto i : m_renderingOutputs) {
-        if (!i.expired())
-            ++count;
-    }
-    return count;
+void AudioSummingJunction::connectedOutputs(ContextGraphLock&, std::vector<std::shared_ptr<AudioNodeOutput>> & outputs) const
+{
+    for (auto & i : m_connectedOutputs)
+        if (auto o = i.lock())
+            outputs.push_back(o);
 }
     
 void AudioSummingJunction::junctionConnectOutput(std::shared_ptr<AudioNodeOutput> o)
@@ -66,20 +47,17 @@ void AudioSummingJunction::junctionConnectOutput(std::shared_ptr<AudioNodeOutput
     if (!o)
         return;
     
-    std::lock_guard<std::mutex> lock(junctionMutex);
-
     for (std::vector<std::weak_ptr<AudioNodeOutput>>::iterator i = m_connectedOutputs.begin(); i != m_connectedOutputs.end();)
         if (i->expired())
             i = m_connectedOutputs.erase(i);
         else
             i++;
     
-    for (auto i : m_connectedOutputs)
+    for (auto & i : m_connectedOutputs)
         if (i.lock() == o)
             return;
 
     m_connectedOutputs.push_back(o);
-    m_renderingStateNeedUpdating = true;
 }
 
 void AudioSummingJunction::junctionDisconnectOutput(std::shared_ptr<AudioNodeOutput> o)
@@ -87,48 +65,118 @@ void AudioSummingJunction::junctionDisconnectOutput(std::shared_ptr<AudioNodeOut
     if (!o)
         return;
     
-    std::lock_guard<std::mutex> lock(junctionMutex);
-
     for (std::vector<std::weak_ptr<AudioNodeOutput>>::iterator i = m_connectedOutputs.begin(); i != m_connectedOutputs.end(); ++i)
         if (!i->expired() && i->lock() == o) {
             m_connectedOutputs.erase(i);
-            m_renderingStateNeedUpdating = true;
             break;
         }
 }
     
 void AudioSummingJunction::junctionDisconnectAllOutputs()
 {
-	std::lock_guard<std::mutex> lock(junctionMutex);
 	m_connectedOutputs.clear();
-	m_renderingStateNeedUpdating = true;
 }
 
-void AudioSummingJunction::changedOutputs(ContextGraphLock&)
+void AudioSummingJunction::setDirty(ContextGraphLock& g, std::shared_ptr<AudioSummingJunction> junction)
 {
-    if (!m_renderingStateNeedUpdating)
+    if (!junction)
+        return;
+
+    // Outputs whose node has been released are dropped along the way.
+    std::unique_ptr<RenderingOutputs> outputs(new RenderingOutputs());
+    auto & connected = junction->m_connectedOutputs;
+    for (auto i = connected.begin(); i != connected.end();)
     {
-        m_renderingStateNeedUpdating = true;
+        std::shared_ptr<AudioNodeOutput> o = i->lock();
+        if (!o || !o->node())
+        {
+            i = connected.erase(i);
+            continue;
+        }
+        outputs->outputs.push_back(o.get());
+        outputs->owners.push_back(std::move(o));
+        ++i;
     }
+
+    // A version published earlier that the render thread hasn't adopted yet is superseded.
+    delete junction->m_pendingOutputs.exchange(outputs.release());
+
+    ASSERT(g.context());
+    if (g.context())
+        g.context()->queueDirtyJunction(g, std::move(junction));
 }
-    
-void AudioSummingJunction::updateRenderingState(ContextRenderLock& r)
+
+AudioSummingJunction::DirtyList::~DirtyList()
+{
+    // The junctions still queued keep the versions they were given, which they free themselves.
+    AudioSummingJunction * junction = m_junctions.exchange(nullptr);
+    while (junction)
+    {
+        AudioSummingJunction * next = junction->m_nextDirty;
+        std::shared_ptr<AudioSummingJunction> self = std::move(junction->m_queuedSelf);
+        junction->m_queued = false;
+        junction = next;
+    }
+    collectGarbage();
+}
+
+void AudioSummingJunction::DirtyList::push(ContextGraphLock&, std::shared_ptr<AudioSummingJunction> junction)
 {
-    if (r.context() && m_renderingStateNeedUpdating)
+    // A junction already queued picks up its latest version when it is taken.
+    if (junction->m_queued.exchange(true))
+        return;
+
+    AudioSummingJunction * j = junction.get();
+    j->m_queuedSelf = std::move(junction);
+
+    // Only the thread holding the graph lock pushes, so there is no ABA; the render thread only takes everything.
+    j->m_nextDirty = m_junctions.load(std::memory_order_relaxed);
+    while (!m_junctions.compare_exchange_weak(j->m_nextDirty, j, std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+bool AudioSummingJunction::DirtyList::update(ContextRenderLock& r)
+{
+    bool retired = false;
+
+    AudioSummingJunction * junction = m_junctions.exchange(nullptr, std::memory_order_acquire);
+    while (junction)
     {
-        std::lock_guard<std::mutex> lock(junctionMutex);
-        
-        // Copy from m_outputs to m_renderingOutputs.
-        m_renderingOutputs.clear();
-        for (std::vector<std::weak_ptr<AudioNodeOutput>>::iterator i = m_connectedOutputs.begin(); i != m_connectedOutputs.end(); ++i)
-            if (!i->expired())
+        AudioSummingJunction * next = junction->m_nextDirty;
+
+        // Once the junction is unqueued the graph thread may queue it again, so the version is taken after.
+        std::shared_ptr<AudioSummingJunction> self = std::move(junction->m_queuedSelf);
+        junction->m_queued.store(false);
+
+        if (RenderingOutputs * outputs = junction->m_pendingOutputs.exchange(nullptr))
+        {
+            if (RenderingOutputs * old = junction->m_renderingOutputs)
             {
-                m_renderingOutputs.push_back(*i);
-                i->lock()->updateRenderingState(r);
+                old->nextRetired = m_retired.load(std::memory_order_relaxed);
+                while (!m_retired.compare_exchange_weak(old->nextRetired, old, std::memory_order_release, std::memory_order_relaxed)) {}
+                retired = true;
             }
+            junction->m_renderingOutputs = outputs;
+
+            for (AudioNodeOutput * o : outputs->outputs)
+                o->updateRenderingState(r);
+        }
+
+        junction->didUpdate(r);
+        r.context()->deferRelease(r, std::move(self));
+        junction = next;
+    }
+
+    return retired;
+}
 
-        didUpdate(r);
-        m_renderingStateNeedUpdating = false;
+void AudioSummingJunction::DirtyList::collectGarbage()
+{
+    RenderingOutputs * outputs = m_retired.exchange(nullptr, std::memory_order_acquire);
+    while (outputs)
+    {
+        RenderingOutputs * next = outputs->nextRetired;
+        delete outputs;
+        outputs = next;
     }
 }
 
@@ -0,0 +1,91 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioTransport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace lab {
+
+TempoMap::TempoMap(double bpm, unsigned beatsPerBar, double origin)
+{
+    if (!(bpm > 0) || !std::isfinite(bpm))
+        throw std::invalid_argument("Tempo must be positive");
+
+    Segment first;
+    first.time = origin;
+    first.bpm = bpm;
+    first.beatsPerBar = std::max(1u, beatsPerBar);
+    m_segments.push_back(first);
+}
+
+void TempoMap::setTempo(double beat, double bpm, unsigned beatsPerBar)
+{
+    if (!(bpm > 0) || !std::isfinite(bpm))
+        throw std::invalid_argument("Tempo must be positive");
+
+    if (beat <= m_segments.front().beat)
+    {
+        m_segments.resize(1);
+        m_segments.front().bpm = bpm;
+        if (beatsPerBar)
+            m_segments.front().beatsPerBar = beatsPerBar;
+        return;
+    }
+
+    while (m_segments.back().beat >= beat)
+        m_segments.pop_back();
+
+    const Segment & last = m_segments.back();
+    Segment change;
+    change.beat = beat;
+    change.time = last.time + (beat - last.beat) * 60 / last.bpm;
+    change.bar = last.bar + (beat - last.beat) / last.beatsPerBar;
+    change.bpm = bpm;
+    change.beatsPerBar = beatsPerBar ? beatsPerBar : last.beatsPerBar;
+    m_segments.push_back(change);
+}
+
+size_t TempoMap::segmentAtBeat(double beat) const
+{
+    auto after = std::upper_bound(m_segments.begin() + 1, m_segments.end(), beat,
+                                  [](double b, const Segment & s) { return b < s.beat; });
+    return static_cast<size_t>(after - m_segments.begin()) - 1;
+}
+
+size_t TempoMap::segmentAtTime(double time) const
+{
+    auto after = std::upper_bound(m_segments.begin() + 1, m_segments.end(), time,
+                                  [](double t, const Segment & s) { return t < s.time; });
+    return static_cast<size_t>(after - m_segments.begin()) - 1;
+}
+
+double TempoMap::timeAtBeat(double beat) const
+{
+    const Segment & s = m_segments[segmentAtBeat(beat)];
+    return s.time + (beat - s.beat) * 60 / s.bpm;
+}
+
+double TempoMap::beatAtTime(double time) const
+{
+    const Segment & s = m_segments[segmentAtTime(time)];
+    return s.beat + (time - s.time) * s.bpm / 60;
+}
+
+double TempoMap::barAtBeat(double beat) const
+{
+    const Segment & s = m_segments[segmentAtBeat(beat)];
+    return s.bar + (beat - s.beat) / s.beatsPerBar;
+}
+
+double TempoMap::beatAtBar(double bar) const
+{
+    auto after = std::upper_bound(m_segments.begin() + 1, m_segments.end(), bar,
+                                  [](double b, const Segment & s) { return b < s.bar; });
+    const Segment & s = *(after - 1);
+    return s.beat + (bar - s.bar) * s.beatsPerBar;
+}
+
+} // namespace lab
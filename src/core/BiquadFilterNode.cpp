@@ -94,4 +94,14 @@ std::shared_ptr<AudioParam> BiquadFilterNode::detune()
     return biquadProcessor()->parameter4();
 }
 
+size_t BiquadFilterNode::coefficientInterval() const
+{
+    return biquadProcessor()->coefficientInterval();
+}
+
+void BiquadFilterNode::setCoefficientInterval(size_t frames)
+{
+    biquadProcessor()->setCoefficientInterval(frames);
+}
+
 } // namespace lab
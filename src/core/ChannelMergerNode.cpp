@@ -8,8 +8,12 @@
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioBus.h"
 
+#include "LabSound/extended/AudioContextLock.h"
+
 #include "internal/Assertions.h"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace lab
@@ -23,15 +27,21 @@ ChannelMergerNode::ChannelMergerNode(size_t numberOfInputs_)
     initialize(); // initialize only sets a flag, no need to allocate memory according to input count
 }
 
+ChannelMergerNode::~ChannelMergerNode()
+{
+}
+
 void ChannelMergerNode::addInputs(size_t n)
 {
-    if (!n || numberOfInputs() == AudioContext::maxNumberOfChannels)
+    // The node may not have a context yet, so its inputs are only bounded by the highest limit a context may
+    // have; the merged channels are bounded by its context's own channelLimit().
+    if (!n || numberOfInputs() == AudioContext::maxChannelLimit)
         return;
 
-    if (n + numberOfInputs() > AudioContext::maxNumberOfChannels)
+    if (n + numberOfInputs() > AudioContext::maxChannelLimit)
     {
         // Notify user we were clamped to max?
-        n = AudioContext::maxNumberOfChannels - numberOfInputs();
+        n = AudioContext::maxChannelLimit - numberOfInputs();
     }
 
     // Create the requested number of inputs.
@@ -53,7 +63,31 @@ void ChannelMergerNode::process(ContextRenderLock& r, size_t framesToProcess)
         return;
     }
 
-    // Merge all the channels from all the inputs into one output.
+    // Consumers only read the output, so it views the channels of the inputs, unless a declick ramp is about to
+    // scale it in place.
+    if (rampsSettled() && m_channelViews && m_channelViews->numberOfChannels() == output->numberOfChannels())
+    {
+        size_t viewed = 0;
+        for (uint32_t i = 0; i < numberOfInputs(); ++i)
+        {
+            auto input = this->input(i);
+            if (!input->isConnected())
+                continue;
+
+            AudioBus* bus = input->bus(r);
+            for (size_t j = 0; j < bus->numberOfChannels() && viewed < m_channelViews->numberOfChannels(); ++j)
+                m_channelViews->setChannelMemory(viewed++, const_cast<float*>(bus->channel(j)->data()), framesToProcess);
+        }
+
+        if (viewed == m_channelViews->numberOfChannels())
+        {
+            output->setRenderedBus(r, m_channelViews.get());
+            return;
+        }
+    }
+
+    // Merge all the channels from all the inputs into one output, up to the channels it has.
+    const size_t numberOfOutputChannels = output->numberOfChannels();
     uint32_t outputChannelIndex = 0;
     for (uint32_t i = 0; i < numberOfInputs(); ++i)
     {
@@ -64,7 +98,7 @@ void ChannelMergerNode::process(ContextRenderLock& r, size_t framesToProcess)
             size_t numberOfInputChannels = input->bus(r)->numberOfChannels();
 
             // Merge channels from this particular input.
-            for (size_t j = 0; j < numberOfInputChannels; ++j)
+            for (size_t j = 0; j < numberOfInputChannels && outputChannelIndex < numberOfOutputChannels; ++j)
             {
                 AudioChannel* inputChannel = input->bus(r)->channel(j);
                 AudioChannel* outputChannel = output->bus(r)->channel(outputChannelIndex);
@@ -75,7 +109,7 @@ void ChannelMergerNode::process(ContextRenderLock& r, size_t framesToProcess)
         }
     }
 
-    ASSERT(outputChannelIndex == output->numberOfChannels());
+    ASSERT(outputChannelIndex == numberOfOutputChannels);
 }
 
 void ChannelMergerNode::reset(ContextRenderLock&)
@@ -99,6 +133,7 @@ void ChannelMergerNode::checkNumberOfChannelsForInput(ContextRenderLock& r, Audi
            numberOfOutputChannels += input->bus(r)->numberOfChannels();
         }
     }
+    numberOfOutputChannels = std::min(numberOfOutputChannels, r.context()->channelLimit());
 
     // Set the correct number of channels on the output
     auto output = this->output(0);
@@ -109,6 +144,14 @@ void ChannelMergerNode::checkNumberOfChannelsForInput(ContextRenderLock& r, Audi
     // output channels here.
     m_desiredNumberOfOutputChannels = numberOfOutputChannels;
 
+    if (numberOfOutputChannels && (!m_channelViews || m_channelViews->numberOfChannels() != numberOfOutputChannels))
+    {
+        std::unique_ptr<AudioBus> views(new AudioBus(numberOfOutputChannels, r.context()->renderQuantumSize(), false));
+        std::swap(views, m_channelViews);
+        if (views)
+            r.context()->deferRelease(r, std::move(views));
+    }
+
     AudioNode::checkNumberOfChannelsForInput(r, input);
 }
 
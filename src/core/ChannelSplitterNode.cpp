@@ -21,21 +21,27 @@ ChannelSplitterNode::ChannelSplitterNode(size_t numberOfOutputs_)
     initialize();   // currently initialize only sets a flag; no memory is allocated in response to adding outputs
 }
 
+ChannelSplitterNode::~ChannelSplitterNode()
+{
+}
+
 void ChannelSplitterNode::addOutputs(size_t numberOfOutputs_)
 {
-    if (!numberOfOutputs_ || numberOfOutputs() == AudioContext::maxNumberOfChannels)
+    // The node may not have a context yet, so its outputs are only bounded by the highest limit a context may have.
+    if (!numberOfOutputs_ || numberOfOutputs() == AudioContext::maxChannelLimit)
         return;
 
-    if (numberOfOutputs_ + numberOfOutputs() > AudioContext::maxNumberOfChannels)
+    if (numberOfOutputs_ + numberOfOutputs() > AudioContext::maxChannelLimit)
     {
         // Notify user clamping to max?
-        numberOfOutputs_ = AudioContext::maxNumberOfChannels - numberOfOutputs();
+        numberOfOutputs_ = AudioContext::maxChannelLimit - numberOfOutputs();
     }
 
     // Create a fixed number of outputs (able to handle the maximum number of channels fed to an input).
     for (uint32_t i = 0; i < numberOfOutputs_; ++i)
     {
         addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
+        m_channelViews.emplace_back(new AudioBus(1, AudioNode::ProcessingSizeInFrames, false));
     }
 }
 
@@ -47,15 +53,25 @@ void ChannelSplitterNode::process(ContextRenderLock& r, size_t framesToProcess)
 
     size_t numberOfSourceChannels = source->numberOfChannels();
 
+    // Consumers only read the outputs, so each is a view of its channel of the source. A declick ramp scales the
+    // outputs in place though, so while one is under way the channels are copied.
+    const bool view = rampsSettled();
+
     for (uint32_t i = 0; i < numberOfOutputs(); ++i)
     {
+        if (i < numberOfSourceChannels && view && i < m_channelViews.size())
+        {
+            m_channelViews[i]->setChannelMemory(0, const_cast<float*>(source->channel(i)->data()), framesToProcess);
+            output(i)->setRenderedBus(r, m_channelViews[i].get());
+            continue;
+        }
+
         AudioBus* destination = output(i)->bus(r);
         ASSERT(destination);
 
         if (i < numberOfSourceChannels)
         {
             // Split the channel out if it exists in the source.
-            // It would be nice to avoid the copy and simply pass along pointers, but this becomes extremely difficult with fanout and fanin.
             destination->channel(0)->copyFrom(source->channel(i));
         }
         else if (output(i)->renderingFanOutCount() > 0)
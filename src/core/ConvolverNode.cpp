@@ -6,13 +6,26 @@
 
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/Macros.h"
 #include "LabSound/extended/AudioContextLock.h"
 
 #include "internal/Assertions.h"
+#include "internal/PreparedImpulse.h"
 #include "internal/Reverb.h"
+#include "internal/TripleBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -26,7 +39,104 @@ const size_t MaxFFTSize = 32768;
 
 namespace lab {
 
-ConvolverNode::ConvolverNode() : m_swapOnRender(false)
+// The buses the reverb renders slices through, built with it so none is allocated on the render thread. The
+// views feed it a slice of a larger quantum, or a gathered slice; the input's view has as many channels as the
+// input, which may be fewer than the reverb's. Quanta smaller than a slice are gathered into the input's FIFO,
+// and answered from the output's, which holds the slice rendered before, from position on.
+struct ConvolverNode::Slices
+{
+    std::vector<std::unique_ptr<AudioBus>> inputViews; // of 1 to numberOfInputs channels
+    std::unique_ptr<AudioBus> outputView;
+    std::unique_ptr<AudioBus> inputFifo;
+    std::unique_ptr<AudioBus> outputFifo;
+    size_t position = 0;
+
+    Slices(size_t numberOfInputs, size_t numberOfOutputs)
+        : outputView(new AudioBus(numberOfOutputs, AudioNode::ProcessingSizeInFrames, false))
+        , inputFifo(new AudioBus(numberOfInputs, AudioNode::ProcessingSizeInFrames))
+        , outputFifo(new AudioBus(numberOfOutputs, AudioNode::ProcessingSizeInFrames))
+    {
+        for (size_t i = 1; i <= numberOfInputs; ++i)
+            inputViews.emplace_back(new AudioBus(i, AudioNode::ProcessingSizeInFrames, false));
+    }
+};
+
+// The impulse last set, and the reverbs built from it. The background thread runs while there's an impulse to
+// build, building only the latest, and publishes its reverbs through the triple buffer, which the render thread
+// takes them from; so the thread never waits on rendering, nor rendering on it. Shared with the thread, so that
+// the node may be destroyed while a reverb is being built.
+struct ConvolverNode::Loader
+{
+    struct Job
+    {
+        std::shared_ptr<AudioBus> bus; // prepared on the thread, unless impulse is set
+        bool normalize = true;
+        bool offline = false;
+        size_t length = SIZE_MAX;
+        std::shared_ptr<PreparedImpulse> impulse;
+        size_t numberOfInputs = 0; // a matrix impulse's, or 0 for one of up to four channels
+        size_t numberOfOutputs = 0;
+    };
+
+    struct Swap
+    {
+        std::shared_ptr<Reverb> reverb;
+        std::shared_ptr<AudioBus> fadeBus;
+        std::shared_ptr<Slices> slices;
+        size_t numberOfInputs = 2;
+        size_t numberOfOutputs = 2;
+    };
+
+    std::mutex lock;
+    std::condition_variable idle;
+    Job job;
+    bool hasJob = false;
+    bool running = false;
+    std::shared_ptr<PreparedImpulse> prepared; // the last impulse built
+
+    TripleBuffer<Swap> swaps{ [](Swap &) {} };
+
+    static void run(std::shared_ptr<Loader> loader)
+    {
+        std::unique_lock<std::mutex> lock(loader->lock);
+        while (loader->hasJob)
+        {
+            Job job = std::move(loader->job);
+            loader->hasJob = false;
+            lock.unlock();
+
+            Swap swap;
+            std::shared_ptr<PreparedImpulse> impulse = job.impulse ? job.impulse : ConvolverNode::prepareImpulse(job.bus, job.normalize, job.length, job.offline);
+            if (impulse)
+            {
+                if (job.numberOfInputs)
+                {
+                    swap.reverb = std::make_shared<Reverb>(impulse, AudioNode::ProcessingSizeInFrames, job.numberOfInputs, job.numberOfOutputs);
+                    swap.numberOfInputs = job.numberOfInputs;
+                    swap.numberOfOutputs = job.numberOfOutputs;
+                }
+                else
+                    swap.reverb = std::make_shared<Reverb>(impulse, AudioNode::ProcessingSizeInFrames, 2);
+
+                swap.fadeBus = std::make_shared<AudioBus>(swap.numberOfOutputs, AudioNode::ProcessingSizeInFrames);
+                swap.slices = std::make_shared<Slices>(swap.numberOfInputs, swap.numberOfOutputs);
+            }
+
+            lock.lock();
+            if (swap.reverb && !loader->hasJob)
+            {
+                loader->prepared = impulse;
+                loader->swaps.back() = std::move(swap);
+                loader->swaps.publish();
+            }
+        }
+
+        loader->running = false;
+        loader->idle.notify_all();
+    }
+};
+
+ConvolverNode::ConvolverNode() : m_loader(std::make_shared<Loader>())
 , m_normalize(std::make_shared<AudioSetting>("normalize"))
 {
     addInput(unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
@@ -47,15 +157,89 @@ ConvolverNode::~ConvolverNode()
     uninitialize();
 }
 
-void ConvolverNode::process(ContextRenderLock & r, size_t framesToProcess)
+void ConvolverNode::swapReverb(ContextRenderLock & r)
+{
+    if (!m_loader->swaps.update())
+        return;
+
+    Loader::Swap & swap = m_loader->swaps.front();
+    AudioContext * context = r.context();
+
+    // A reverb still fading out from an earlier swap is cut short.
+    if (m_fadingReverb)
+        context->deferRelease(r, std::move(m_fadingReverb));
+
+    const double fadeFrames = m_crossfadeTime.load(std::memory_order_relaxed) * context->sampleRate();
+    if (m_reverb && fadeFrames >= 1 && swap.numberOfInputs == m_channelCount && swap.numberOfOutputs == output(0)->numberOfChannels())
+    {
+        m_fadingReverb = std::move(m_reverb);
+        m_fadeFrames = static_cast<size_t>(fadeFrames);
+        m_fadePosition = 0;
+    }
+    else if (m_reverb)
+        context->deferRelease(r, std::move(m_reverb));
+
+    m_reverb = std::move(swap.reverb);
+    if (m_fadeBus)
+        context->deferRelease(r, std::move(m_fadeBus));
+    m_fadeBus = std::move(swap.fadeBus);
+
+    // A slice being gathered carries over, so that the gathering keeps in step with the quanta.
+    if (m_slices)
+    {
+        Slices & slices = *swap.slices;
+        slices.position = m_slices->position;
+        for (size_t i = 0; i < std::min(slices.inputFifo->numberOfChannels(), m_slices->inputFifo->numberOfChannels()); ++i)
+            slices.inputFifo->channel(i)->copyFrom(m_slices->inputFifo->channel(i));
+        for (size_t i = 0; i < std::min(slices.outputFifo->numberOfChannels(), m_slices->outputFifo->numberOfChannels()); ++i)
+            slices.outputFifo->channel(i)->copyFrom(m_slices->outputFifo->channel(i));
+        context->deferRelease(r, std::move(m_slices));
+    }
+    m_slices = std::move(swap.slices);
+
+    // A matrix impulse may change the number of channels, which takes effect from the next quantum's input.
+    m_channelCount = swap.numberOfInputs;
+    output(0)->setNumberOfChannels(r, swap.numberOfOutputs);
+}
+
+void ConvolverNode::prepare(AudioContext & context, size_t inputChannels)
 {
-    if (m_swapOnRender)
+    AudioNode::prepare(context, inputChannels);
+    waitForImpulse();
+
+    ContextRenderLock r(&context, "ConvolverNode::prepare");
+    swapReverb(r);
+}
+
+void ConvolverNode::processSlice(ContextRenderLock & r, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess)
+{
+    m_reverb->process(r, inputBus, outputBus, framesToProcess);
+    if (!m_fadingReverb)
+        return;
+
+    m_fadingReverb->process(r, inputBus, m_fadeBus.get(), framesToProcess);
+
+    // Equal power, so that the uncorrelated tails keep their loudness through the fade.
+    const size_t channels = std::min(outputBus->numberOfChannels(), m_fadeBus->numberOfChannels());
+    for (size_t c = 0; c < channels; ++c)
     {
-        m_reverb = std::move(m_newReverb);
-        m_bus = m_newBus;
-        m_newBus.reset();
-        m_swapOnRender = false;
+        float * out = outputBus->channel(c)->mutableData();
+        const float * fading = m_fadeBus->channel(c)->data();
+        for (size_t i = 0; i < framesToProcess; ++i)
+        {
+            const double x = std::min(1.0, static_cast<double>(m_fadePosition + i) / m_fadeFrames) * piOverTwoDouble;
+            out[i] = out[i] * static_cast<float>(std::sin(x)) + fading[i] * static_cast<float>(std::cos(x));
+        }
     }
+
+    m_fadePosition += framesToProcess;
+    if (m_fadePosition >= m_fadeFrames)
+        r.context()->deferRelease(r, std::move(m_fadingReverb));
+}
+
+void ConvolverNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    swapReverb(r);
     
     AudioBus * outputBus = output(0)->bus(r);
     
@@ -69,13 +253,68 @@ void ConvolverNode::process(ContextRenderLock & r, size_t framesToProcess)
     // Note that we can handle the case where nothing is connected to the input, in which case we'll just feed silence into the convolver.
     // FIXME: If we wanted to get fancy we could try to factor in the 'tail time' and stop processing once the tail dies down if
     // we keep getting fed silence.
-    m_reverb->process(r, input(0)->bus(r), outputBus, framesToProcess);
+    AudioBus * inputBus = input(0)->bus(r);
+    const size_t sliceSize = AudioNode::ProcessingSizeInFrames;
+
+    const double tailFrames = m_tailLimit.load(std::memory_order_relaxed) * r.context()->sampleRate();
+    const size_t tailLimit = tailFrames < static_cast<double>(SIZE_MAX / 2) ? static_cast<size_t>(std::max(tailFrames, 0.0)) : SIZE_MAX;
+    m_reverb->setTailLimit(tailLimit);
+    if (m_fadingReverb)
+        m_fadingReverb->setTailLimit(tailLimit);
+
+    if (framesToProcess == sliceSize)
+    {
+        processSlice(r, inputBus, outputBus, framesToProcess);
+        return;
+    }
+
+    // Quanta are powers of two, so one either divides a slice or is divided by it.
+    Slices & slices = *m_slices;
+    const size_t inputChannels = std::min(inputBus->numberOfChannels(), slices.inputViews.size());
+    const size_t outputChannels = std::min(outputBus->numberOfChannels(), slices.outputView->numberOfChannels());
+    AudioBus * inputSlice = slices.inputViews[inputChannels - 1].get();
+
+    if (framesToProcess < sliceSize)
+    {
+        for (size_t i = 0; i < inputChannels; ++i)
+        {
+            const float * source = inputBus->channel(i)->data();
+            std::copy(source, source + framesToProcess, slices.inputFifo->channel(i)->mutableData() + slices.position);
+        }
+        for (size_t i = 0; i < outputChannels; ++i)
+        {
+            const float * rendered = slices.outputFifo->channel(i)->data() + slices.position;
+            std::copy(rendered, rendered + framesToProcess, outputBus->channel(i)->mutableData());
+        }
+
+        slices.position += framesToProcess;
+        if (slices.position < sliceSize)
+            return;
+
+        slices.position = 0;
+        for (size_t i = 0; i < inputChannels; ++i)
+            inputSlice->setChannelMemory(i, slices.inputFifo->channel(i)->mutableData(), sliceSize);
+        processSlice(r, inputSlice, slices.outputFifo.get(), sliceSize);
+        return;
+    }
+
+    for (size_t offset = 0; offset < framesToProcess; offset += sliceSize)
+    {
+        for (size_t i = 0; i < inputChannels; ++i)
+            inputSlice->setChannelMemory(i, inputBus->channel(i)->mutableData() + offset, sliceSize);
+        for (size_t i = 0; i < outputChannels; ++i)
+            slices.outputView->setChannelMemory(i, outputBus->channel(i)->mutableData() + offset, sliceSize);
+
+        processSlice(r, inputSlice, slices.outputView.get(), sliceSize);
+    }
 }
 
-void ConvolverNode::reset(ContextRenderLock&)
+void ConvolverNode::reset(ContextRenderLock & r)
 {
-    m_newReverb.reset();
-    m_swapOnRender = true;
+    if (m_reverb)
+        r.context()->deferRelease(r, std::move(m_reverb));
+    if (m_fadingReverb)
+        r.context()->deferRelease(r, std::move(m_fadingReverb));
 }
 
 void ConvolverNode::initialize()
@@ -89,6 +328,8 @@ void ConvolverNode::initialize()
 void ConvolverNode::uninitialize()
 {
     m_reverb.reset();
+    m_fadingReverb.reset();
+    m_slices.reset();
 
     if (!isInitialized())
         return;
@@ -96,31 +337,191 @@ void ConvolverNode::uninitialize()
     AudioNode::uninitialize();
 }
 
-void ConvolverNode::setImpulse(std::shared_ptr<AudioBus> bus)
+size_t ConvolverNode::trimmedLength(const AudioBus & bus, float thresholdDb, size_t maxFrames)
+{
+    size_t length = std::min(bus.length(), maxFrames);
+    if (thresholdDb >= 0 || !length)
+        return length;
+
+    // The energy decay curve, integrated back from the end, reaches the threshold at the last frame kept.
+    double total = 0;
+    for (size_t c = 0; c < bus.numberOfChannels(); ++c)
+    {
+        const float * data = bus.channel(c)->data();
+        for (size_t i = 0; i < bus.length(); ++i)
+            total += static_cast<double>(data[i]) * data[i];
+    }
+
+    const double threshold = total * std::pow(10.0, thresholdDb / 10.0);
+    double remaining = 0;
+    size_t end = bus.length();
+    while (end > 1)
+    {
+        for (size_t c = 0; c < bus.numberOfChannels(); ++c)
+        {
+            const float x = bus.channel(c)->data()[end - 1];
+            remaining += static_cast<double>(x) * x;
+        }
+        if (remaining > threshold)
+            break;
+        --end;
+    }
+
+    return std::min(length, end);
+}
+
+std::shared_ptr<PreparedImpulse> ConvolverNode::prepareImpulse(std::shared_ptr<AudioBus> bus, bool normalize, size_t length, bool offline)
 {
-    if (!bus) return;
+    if (!bus) return nullptr;
 
     size_t numberOfChannels = bus->numberOfChannels();
     size_t bufferLength = bus->length();
 
-    // The current implementation supports up to four channel impulse responses, which are interpreted as true-stereo (see Reverb class).
-    bool isBufferGood = numberOfChannels > 0 && numberOfChannels <= 4 && bufferLength;
+    // Up to four channel impulse responses are interpreted as true-stereo (see Reverb class), and more
+    // can only be used as a matrix of responses.
+    bool isBufferGood = numberOfChannels > 0 && numberOfChannels <= AudioContext::maxChannelLimit && bufferLength;
     ASSERT(isBufferGood);
-    if (!isBufferGood) return;
+    if (!isBufferGood) return nullptr;
+
+    if (length < bufferLength && length)
+    {
+        // A raised cosine fade over the last 10ms, or quarter of what's kept if less, so the cut doesn't click.
+        std::shared_ptr<AudioBus> trimmed = std::make_shared<AudioBus>(numberOfChannels, length);
+        trimmed->setSampleRate(bus->sampleRate());
+        const float sampleRate = bus->sampleRate() > 0 ? bus->sampleRate() : 44100.f;
+        const size_t fadeFrames = std::max<size_t>(std::min(static_cast<size_t>(sampleRate * 0.01f), length / 4), 1);
+        for (size_t c = 0; c < numberOfChannels; ++c)
+        {
+            float * out = trimmed->channel(c)->mutableData();
+            std::memcpy(out, bus->channel(c)->data(), length * sizeof(float));
+            for (size_t i = 0; i < fadeFrames; ++i)
+                out[length - fadeFrames + i] *= 0.5f * (1.f + std::cos(piFloat * (i + 1) / fadeFrames));
+        }
+        bus = std::move(trimmed);
+    }
+
+    // Offline, the tail's partitions are sized to the response, a 128th of it or more, which balances the cost of
+    // their transforms against that of summing their products.
+    size_t maxFFTSize = MaxFFTSize;
+    if (offline)
+    {
+        maxFFTSize = PreparedImpulse::MaxRealtimeFFTSize;
+        while (maxFFTSize < MaxFFTSize && maxFFTSize / 2 < bus->length() / 128)
+            maxFFTSize *= 2;
+    }
 
-    // Create the reverb with the given impulse response.
     const bool threaded = false;
-    m_newReverb = std::unique_ptr<Reverb>(new Reverb(bus.get(), AudioNode::ProcessingSizeInFrames, MaxFFTSize, 2, threaded, normalize()));
-    m_newBus = bus;
-    m_swapOnRender = true;
+    return std::make_shared<PreparedImpulse>(bus, maxFFTSize, threaded, normalize, offline);
+}
+
+void ConvolverNode::load(std::shared_ptr<AudioBus> bus, size_t length, std::shared_ptr<PreparedImpulse> impulse, size_t numberOfInputs, size_t numberOfOutputs)
+{
+    std::lock_guard<std::mutex> lock(m_loader->lock);
+    m_loader->job.bus = std::move(bus);
+    m_loader->job.normalize = normalize();
+    m_loader->job.offline = m_offlinePartitioning;
+    m_loader->job.length = length;
+    m_loader->job.impulse = std::move(impulse);
+    m_loader->job.numberOfInputs = numberOfInputs;
+    m_loader->job.numberOfOutputs = numberOfOutputs;
+    m_loader->hasJob = true;
+
+    if (!m_loader->running)
+    {
+        m_loader->running = true;
+        std::thread(&Loader::run, m_loader).detach();
+    }
+}
+
+void ConvolverNode::waitForImpulse()
+{
+    std::unique_lock<std::mutex> lock(m_loader->lock);
+    m_loader->idle.wait(lock, [this]() { return !m_loader->running; });
+    std::shared_ptr<PreparedImpulse> prepared = m_loader->prepared;
+    lock.unlock();
+
+    if (prepared)
+        prepared->waitUntilPrepared();
+}
+
+size_t ConvolverNode::setImpulse(std::shared_ptr<AudioBus> bus)
+{
+    if (!bus) return 0;
+
+    bool isImpulseGood = bus->numberOfChannels() <= Channels::Quad;
+    ASSERT(isImpulseGood);
+    if (!isImpulseGood) return 0;
+
+    const size_t length = trimmedLength(*bus, m_trimThresholdDb, m_maxImpulseLength);
+    m_bus = bus;
+    load(std::move(bus), length, nullptr, 0, 0);
+    return length;
+}
+
+void ConvolverNode::setImpulseTrim(float thresholdDb, size_t maxFrames)
+{
+    m_trimThresholdDb = thresholdDb;
+    m_maxImpulseLength = maxFrames;
+}
+
+void ConvolverNode::setPreparedImpulse(std::shared_ptr<PreparedImpulse> impulse)
+{
+    if (!impulse) return;
+
+    bool isImpulseGood = impulse->numberOfChannels() <= Channels::Quad;
+    ASSERT(isImpulseGood);
+    if (!isImpulseGood) return;
+
+    m_bus = impulse->impulseResponse();
+    load(nullptr, SIZE_MAX, std::move(impulse), 0, 0);
+}
+
+void ConvolverNode::setMatrixImpulse(std::shared_ptr<PreparedImpulse> impulse, size_t numberOfInputs, size_t numberOfOutputs)
+{
+    if (!impulse) return;
+
+    bool isMatrixGood = numberOfInputs && numberOfOutputs && numberOfOutputs <= AudioContext::maxChannelLimit
+        && impulse->numberOfChannels() == numberOfInputs * numberOfOutputs;
+    ASSERT(isMatrixGood);
+    if (!isMatrixGood) return;
+
+    m_bus = impulse->impulseResponse();
+    load(nullptr, SIZE_MAX, std::move(impulse), numberOfInputs, numberOfOutputs);
 }
 
 std::shared_ptr<AudioBus> ConvolverNode::getImpulse()
 {
-    if (m_swapOnRender) return m_newBus;
     return m_bus;
 }
 
+void ConvolverNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioNode::reportMemory(r, usage);
+    usage.addBus(m_fadeBus.get());
+    if (m_slices)
+    {
+        usage.addBus(m_slices->inputFifo.get());
+        usage.addBus(m_slices->outputFifo.get());
+    }
+
+    // The convolvers' buffers are the node's; the transformed response, and the response it was made from, may
+    // be shared with other convolvers.
+    usage.addShared(AudioMemoryCategory::ImpulseResponses, m_bus, m_bus ? m_bus->memoryBytes() : 0);
+    for (const Reverb * reverb : { m_reverb.get(), m_fadingReverb.get() })
+    {
+        if (!reverb)
+            continue;
+        usage.add(AudioMemoryCategory::ImpulseResponses, reverb->memoryBytes());
+        // Each of a reverb's convolvers holds the impulse, so its reference count isn't reported.
+        if (std::shared_ptr<const PreparedImpulse> impulse = reverb->impulse())
+        {
+            usage.addShared(AudioMemoryCategory::ImpulseResponses, impulse.get(), impulse->memoryBytes());
+            const std::shared_ptr<AudioBus> & response = impulse->impulseResponse();
+            usage.addShared(AudioMemoryCategory::ImpulseResponses, response, response ? response->memoryBytes() : 0);
+        }
+    }
+}
+
 double ConvolverNode::tailTime(ContextRenderLock & r) const
 {
     return m_reverb ? m_reverb->impulseResponseLength() / static_cast<double>(r.context()->sampleRate()) : 0;
@@ -128,7 +529,12 @@ double ConvolverNode::tailTime(ContextRenderLock & r) const
 
 double ConvolverNode::latencyTime(ContextRenderLock & r) const
 {
-    return m_reverb ? m_reverb->latencyFrames() / static_cast<double>(r.context()->sampleRate()) : 0;
+    if (!m_reverb)
+        return 0;
+
+    // Quanta smaller than a slice are gathered into one, which adds a slice.
+    const size_t gathering = r.context()->renderQuantumSize() < AudioNode::ProcessingSizeInFrames ? AudioNode::ProcessingSizeInFrames : 0;
+    return (m_reverb->latencyFrames() + gathering) / static_cast<double>(r.context()->sampleRate());
 }
 
 bool ConvolverNode::normalize() const
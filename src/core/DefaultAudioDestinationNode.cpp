@@ -3,17 +3,21 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/DefaultAudioDestinationNode.h"
+#include "LabSound/core/AudioContext.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 #include "LabSound/extended/Logging.h"
 
 #include "internal/Assertions.h"
 #include "internal/AudioDestination.h"
+#include "internal/NullAudioDestination.h"
 
 namespace lab {
     
-DefaultAudioDestinationNode::DefaultAudioDestinationNode(AudioContext* context, size_t channelCount, const float sampleRate) 
+DefaultAudioDestinationNode::DefaultAudioDestinationNode(AudioContext* context, size_t channelCount, const float sampleRate,
+                                                         const AudioDeviceSettings & deviceSettings)
 : AudioDestinationNode(context, channelCount, sampleRate)
+, m_deviceSettings(deviceSettings)
 {
     // Node-specific default mixing rules.
     m_channelCount = channelCount;
@@ -31,16 +35,47 @@ void DefaultAudioDestinationNode::initialize()
     if (isInitialized())
         return;
 
-    createDestination();
+    if (m_deviceSettings.openInBackground)
+        m_opener = std::thread(&DefaultAudioDestinationNode::openDestination, this);
+    else
+        openDestination();
     AudioNode::initialize();
 }
 
+void DefaultAudioDestinationNode::openDestination()
+{
+    try
+    {
+        createDestination();
+    }
+    catch (const std::exception & e)
+    {
+        LOG_ERROR("The audio device couldn't be opened: %s", e.what());
+        return;
+    }
+    if (!m_destination)
+        return;
+
+    m_context->markStartupPhase(AudioStartupPhase::DeviceOpened);
+
+    std::lock_guard<std::mutex> lock(m_openLock);
+    m_opened.store(true, std::memory_order_release);
+    if (m_startRequested && !m_rendering)
+    {
+        m_destination->start();
+        m_rendering = true;
+        m_context->markStartupPhase(AudioStartupPhase::RenderingStarted);
+    }
+}
+
 void DefaultAudioDestinationNode::uninitialize()
 {
     if (!isInitialized())
         return;
 
-    m_destination->stop();
+    if (m_opener.joinable())
+        m_opener.join();
+    stopRendering();
     AudioNode::uninitialize();
 }
 
@@ -48,16 +83,65 @@ void DefaultAudioDestinationNode::uninitialize()
 void DefaultAudioDestinationNode::createDestination()
 {
     LOG("Designated Samplerate: %f", m_sampleRate);
-    m_destination = std::unique_ptr<AudioDestination>(AudioDestination::MakePlatformAudioDestination(*this, channelCount(), m_sampleRate));
+
+    // The Null backend needs no platform, so it's made here rather than by each platform's factory.
+    if (m_deviceSettings.backend == AudioDeviceSettings::Backend::Null)
+    {
+        m_destination.reset(new NullAudioDestination(*this, channelCount(), m_sampleRate, m_context->renderQuantumSize(), m_deviceSettings));
+        return;
+    }
+
+    m_destination = std::unique_ptr<AudioDestination>(AudioDestination::MakePlatformAudioDestination(*this, channelCount(), m_sampleRate, m_context->renderQuantumSize(),
+                                                                                                      m_deviceSettings));
 }
 
 void DefaultAudioDestinationNode::startRendering()
 {
     ASSERT(isInitialized());
-    if (isInitialized())
+    if (!isInitialized())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_openLock);
+    m_startRequested = true;
+    if (m_opened.load(std::memory_order_acquire) && !m_rendering)
+    {
         m_destination->start();
+        m_rendering = true;
+        m_context->markStartupPhase(AudioStartupPhase::RenderingStarted);
+    }
+}
+
+void DefaultAudioDestinationNode::stopRendering()
+{
+    std::lock_guard<std::mutex> lock(m_openLock);
+    m_startRequested = false;
+    if (m_rendering)
+    {
+        m_destination->stop();
+        m_rendering = false;
+    }
 }
     
+double DefaultAudioDestinationNode::baseLatency() const
+{
+    return m_opened.load(std::memory_order_acquire) && m_destination ? m_destination->baseLatency() : 0;
+}
+
+double DefaultAudioDestinationNode::outputLatency() const
+{
+    return m_opened.load(std::memory_order_acquire) && m_destination ? m_destination->outputLatency() : 0;
+}
+
+double DefaultAudioDestinationNode::inputLatency() const
+{
+    return m_opened.load(std::memory_order_acquire) && m_destination ? m_destination->inputLatency() : 0;
+}
+
+double DefaultAudioDestinationNode::roundTripLatency() const
+{
+    return m_opened.load(std::memory_order_acquire) && m_destination ? m_destination->roundTripLatency() : 0;
+}
+
 unsigned DefaultAudioDestinationNode::maxChannelCount() const
 {
     return AudioDestination::maxChannelCount();
@@ -71,7 +155,9 @@ void DefaultAudioDestinationNode::setChannelCount(ContextGraphLock& g, size_t ch
     
     ASSERT(g.context());
     
-    if (!maxChannelCount() || channelCount > maxChannelCount())
+    // Without hardware, any channel count can be rendered.
+    const bool headless = m_deviceSettings.backend == AudioDeviceSettings::Backend::Null;
+    if (!headless && (!maxChannelCount() || channelCount > maxChannelCount()))
     {
         throw std::invalid_argument("Max channel count invalid");
     }
@@ -81,10 +167,19 @@ void DefaultAudioDestinationNode::setChannelCount(ContextGraphLock& g, size_t ch
     
     if (this->channelCount() != oldChannelCount && isInitialized())
     {
-        // Re-create destination.
-        m_destination->stop();
+        // A device still opening is waited for, and then opened again with the new channel count.
+        if (m_opener.joinable())
+            m_opener.join();
+        if (!m_opened.load(std::memory_order_acquire))
+            return;
+
+        // Re-create destination, rendering only if the old one was.
+        std::lock_guard<std::mutex> lock(m_openLock);
+        if (m_rendering)
+            m_destination->stop();
         createDestination();
-        m_destination->start();
+        if (m_rendering)
+            m_destination->start();
     }
 }
     
@@ -5,6 +5,7 @@
 #include "LabSound/core/DelayNode.h"
 #include "LabSound/core/AudioBasicProcessorNode.h"
 #include "LabSound/core/AudioProcessor.h"
+#include "LabSound/core/AudioSetting.h"
 
 #include "internal/AudioDSPKernel.h"
 #include "internal/DelayProcessor.h"
@@ -18,6 +19,7 @@ namespace lab
 const double maximumAllowedDelayTime = 128;
 
 DelayNode::DelayNode(float sampleRate, double maxDelayTime) : AudioBasicProcessorNode()
+, m_interpolation(std::make_shared<AudioSetting>("interpolation"))
 {
     if (maxDelayTime <= 0 || maxDelayTime >= maximumAllowedDelayTime)
     {
@@ -27,9 +29,31 @@ DelayNode::DelayNode(float sampleRate, double maxDelayTime) : AudioBasicProcesso
 
     m_params.push_back(delayProcessor()->delayTime());
 
+    m_interpolation->setValueChanged(
+        [this]()
+        {
+            uint32_t type = m_interpolation->valueUint32();
+            if (type > static_cast<uint32_t>(DelayInterpolation::LAGRANGE))
+                throw std::out_of_range("Interpolation exceeds index of known types");
+
+            delayProcessor()->setInterpolation(static_cast<DelayInterpolation>(type));
+        }
+    );
+    m_settings.push_back(m_interpolation);
+
     initialize();
 }
 
+DelayInterpolation DelayNode::interpolation() const
+{
+    return static_cast<DelayInterpolation>(m_interpolation->valueUint32());
+}
+
+void DelayNode::setInterpolation(DelayInterpolation type)
+{
+    m_interpolation->setUint32(static_cast<uint32_t>(type));
+}
+
 std::shared_ptr<AudioParam> DelayNode::delayTime()
 {
     return delayProcessor()->delayTime();
@@ -37,10 +37,6 @@ GainNode::~GainNode()
 
 void GainNode::process(ContextRenderLock& r, size_t framesToProcess)
 {
-    // FIXME: for some cases there is a nice optimization to avoid processing here, and let the gain change
-    // happen in the summing junction input of the AudioNode we're connected to.
-    // Then we can avoid all of the following:
-
     AudioBus* outputBus = output(0)->bus(r);
     ASSERT(outputBus);
 
@@ -49,13 +45,29 @@ void GainNode::process(ContextRenderLock& r, size_t framesToProcess)
     else {
         AudioBus* inputBus = input(0)->bus(r);
 
-        if (gain()->hasSampleAccurateValues()) {
+        if (m_carriedQuantum == r.context()->currentRenderQuantum() && m_carriedGain != 1.f) {
+            // Gains folded in from upstream by the render schedule, which only carries them into a settled gain.
+            float scaled = m_lastGain * m_carriedGain;
+            outputBus->copyWithGainFrom(*inputBus, &scaled, scaled);
+        }
+        else if (gain()->hasSampleAccurateValues() && gain()->isConstantForQuantum(r, framesToProcess)) {
+            // The timeline holds one gain over the quantum, so scale by it exactly, as the sample-accurate
+            // values would have.
+            m_lastGain = gain()->value(r);
+            outputBus->copyWithGainFrom(*inputBus, &m_lastGain, m_lastGain);
+        }
+        else if (gain()->hasSampleAccurateValues()) {
             // Apply sample-accurate gain scaling for precise envelopes, grain windows, etc.
-            ASSERT(framesToProcess <= m_sampleAccurateGainValues.size());
+            // The scratch buffer grows once if the context renders larger quanta than the default.
+            if (framesToProcess > m_sampleAccurateGainValues.size())
+                m_sampleAccurateGainValues.allocate(framesToProcess);
             if (framesToProcess <= m_sampleAccurateGainValues.size()) {
                 float* gainValues = m_sampleAccurateGainValues.data();
                 gain()->calculateSampleAccurateValues(r, gainValues, framesToProcess);
                 outputBus->copyWithSampleAccurateGainValuesFrom(*inputBus, gainValues, framesToProcess);
+
+                // De-zipper from where the envelope left off, should it stop being automated.
+                m_lastGain = gainValues[framesToProcess - 1];
             }
         }
         else {
@@ -65,6 +77,34 @@ void GainNode::process(ContextRenderLock& r, size_t framesToProcess)
     }
 }
 
+bool GainNode::isSettled(ContextRenderLock& r, size_t framesToProcess)
+{
+    if (gain()->hasSampleAccurateValues() && !gain()->isConstantForQuantum(r, framesToProcess))
+        return false;
+    return gain()->value(r) == m_lastGain;
+}
+
+bool GainNode::renderFolded(ContextRenderLock& r, size_t framesToProcess, GainNode * next)
+{
+    if (!isInitialized() || !input(0)->isConnected() || !isSettled(r, framesToProcess))
+        return false;
+
+    const uint64_t quantum = r.context()->currentRenderQuantum();
+    const float total = m_lastGain * (m_carriedQuantum == quantum ? m_carriedGain : 1.f);
+    if (total != 1.f && !(next && next->isSettled(r, framesToProcess)))
+        return false;
+
+    if (!renderPassThrough(r, input(0)->pull(r, nullptr, framesToProcess), framesToProcess))
+        return false;
+
+    if (total != 1.f)
+    {
+        next->m_carriedGain = total;
+        next->m_carriedQuantum = quantum;
+    }
+    return true;
+}
+
 void GainNode::reset(ContextRenderLock& r)
 {
     // Snap directly to desired gain.
@@ -76,6 +116,21 @@ void GainNode::reset(ContextRenderLock& r)
 // As soon as we know the channel count of our input, we can lazily initialize.
 // Sometimes this may be called more than once with different channel counts, in which case we must safely
 // uninitialize and then re-initialize with the new channel count.
+void GainNode::prepare(AudioContext & context, size_t inputChannels)
+{
+    AudioNode::prepare(context, inputChannels);
+
+    if (context.renderQuantumSize() > m_sampleAccurateGainValues.size())
+        m_sampleAccurateGainValues.allocate(context.renderQuantumSize());
+
+    const size_t channels = inputChannels ? std::min(channelsForInput(inputChannels), context.channelLimit()) : 0;
+    if (channels && channels != output(0)->numberOfChannels())
+    {
+        ContextRenderLock r(&context, "GainNode::prepare");
+        output(0)->setNumberOfChannels(r, channels);
+    }
+}
+
 void GainNode::checkNumberOfChannelsForInput(ContextRenderLock& r, AudioNodeInput* input)
 {
     if (!input)
@@ -0,0 +1,52 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/GraphTransaction.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+
+#include <stdexcept>
+
+namespace lab
+{
+
+GraphTransaction::GraphTransaction(AudioContext * context) : m_context(context)
+{
+    if (!context) throw std::invalid_argument("GraphTransaction requires a context");
+}
+
+void GraphTransaction::connect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+{
+    if (!destination) throw std::runtime_error("Cannot connect to null destination");
+    if (!source) throw std::runtime_error("Cannot connect from null source");
+    if (srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
+    if (destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
+    m_edits.push_back({ Edit::Type::Connect, std::move(destination), std::move(source), nullptr, destIdx, srcIdx });
+}
+
+void GraphTransaction::disconnect(std::shared_ptr<AudioNode> destination, std::shared_ptr<AudioNode> source, uint32_t destIdx, uint32_t srcIdx)
+{
+    if (source && srcIdx > source->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs");
+    if (destination && destIdx > destination->numberOfInputs()) throw std::out_of_range("Input index greater than available inputs");
+    m_edits.push_back({ Edit::Type::Disconnect, std::move(destination), std::move(source), nullptr, destIdx, srcIdx });
+}
+
+void GraphTransaction::connectParam(std::shared_ptr<AudioParam> param, std::shared_ptr<AudioNode> driver, uint32_t index)
+{
+    if (!param) throw std::invalid_argument("No parameter specified");
+    if (index >= driver->numberOfOutputs()) throw std::out_of_range("Output index greater than available outputs on the driver");
+    m_edits.push_back({ Edit::Type::ConnectParam, nullptr, std::move(driver), std::move(param), 0, index });
+}
+
+void GraphTransaction::commit()
+{
+    if (m_edits.empty())
+        return;
+
+    std::vector<Edit> edits;
+    std::swap(edits, m_edits);
+    m_context->commitGraphEdits(std::move(edits));
+}
+
+} // end namespace lab
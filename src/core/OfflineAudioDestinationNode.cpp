@@ -9,21 +9,23 @@
 #include "LabSound/extended/Logging.h"
 
 #include "internal/Assertions.h"
+#include "internal/AudioFileWriter.h"
+#include "internal/DenormalDisabler.h"
 
 #include <algorithm>
+#include <limits>
+#include <vector>
 
 using namespace std;
  
 namespace lab {
-    
-const size_t renderQuantumSize = 128;    
 
 OfflineAudioDestinationNode::OfflineAudioDestinationNode(AudioContext * context, const float sampleRate, const float lengthSeconds, const uint32_t numChannels) 
 : AudioDestinationNode(context, numChannels, sampleRate),
     m_numChannels(numChannels),
     m_lengthSeconds(lengthSeconds) 
 {
-    m_renderBus = std::unique_ptr<AudioBus>(new AudioBus(m_numChannels, renderQuantumSize));
+    m_renderBus = std::unique_ptr<AudioBus>(new AudioBus(m_numChannels, context->renderQuantumSize()));
 }
 
 OfflineAudioDestinationNode::~OfflineAudioDestinationNode()
@@ -44,11 +46,6 @@ void OfflineAudioDestinationNode::uninitialize()
     if (!isInitialized())
         return;
 
-    if (m_renderThread.joinable())
-    {
-       m_renderThread.join();
-    }
-
     AudioNode::uninitialize();
 }
 
@@ -58,11 +55,8 @@ void OfflineAudioDestinationNode::startRendering()
     {
         m_startedRendering = true;
 
-        m_renderThread = std::thread(&OfflineAudioDestinationNode::offlineRender, this);
-        
-        // @tofix - ability to update main thread from here. Currently blocks until complete
-        if (m_renderThread.joinable())
-            m_renderThread.join();
+        // Renders on the calling thread, blocking until complete.
+        offlineRender();
 
         if (m_context->offlineRenderCompleteCallback)
             m_context->offlineRenderCompleteCallback();
@@ -75,14 +69,46 @@ void OfflineAudioDestinationNode::startRendering()
     }
 }
 
+bool OfflineAudioDestinationNode::setOutputFile(const std::string & path)
+{
+    m_fileWriter.reset();
+    if (path.empty())
+        return true;
+
+    // The ring holds a few blocks, the render waiting on the writer when it fills.
+    m_fileWriter = AudioFileWriter::open(path, m_numChannels, m_blockSize * 4);
+    return m_fileWriter != nullptr;
+}
+
+void OfflineAudioDestinationNode::renderUntilSilent(double silenceSeconds, float threshold)
+{
+    const uint64_t silenceFrames = static_cast<uint64_t>(silenceSeconds * m_context->sampleRate());
+    std::shared_ptr<uint64_t> silentSince = std::make_shared<uint64_t>(0);
+    AudioBus * output = m_renderBus.get();
+
+    m_stopCondition = [this, silenceFrames, threshold, silentSince, output](ContextRenderLock & r, uint64_t framesRendered)
+    {
+        // The silence is timed from the last quantum that was audible, or had a source yet to finish.
+        if (framesRendered < *silentSince)
+            *silentSince = 0; // a new render
+        if (output->maxAbsValue() >= threshold || m_context->hasPendingScheduledSources(r))
+            *silentSince = framesRendered;
+        return framesRendered - *silentSince >= silenceFrames;
+    };
+}
+
 void OfflineAudioDestinationNode::offlineRender()
 {
     LOG("Starting Offline Rendering");
 
+    DenormalDisabler denormalDisabler;
+
     ASSERT(m_renderBus.get());
     if (!m_renderBus.get())
         return;
 
+    const size_t renderQuantumSize = m_context->renderQuantumSize();
+
     bool isRenderBusAllocated = m_renderBus->length() >= renderQuantumSize;
     ASSERT(isRenderBusAllocated);
     if (!isRenderBusAllocated)
@@ -93,16 +119,107 @@ void OfflineAudioDestinationNode::offlineRender()
     if (!isAudioContextInitialized) 
         return;
 
-    // Break up the render target into smaller "render quantize" sized pieces.
-    size_t framesToProcess = static_cast<size_t>((m_lengthSeconds * m_context->sampleRate()) / renderQuantumSize);
+    // Without a stop condition, lengthSeconds are rendered. With one, they limit the render if given.
+    const float sampleRate = m_context->sampleRate();
+    uint64_t lengthFrames = m_lengthSeconds > 0 ? static_cast<uint64_t>(static_cast<double>(m_lengthSeconds) * sampleRate) : 0;
+    if (!lengthFrames && m_stopCondition)
+        lengthFrames = std::numeric_limits<uint64_t>::max();
 
-    while (framesToProcess > 0)
+    if (m_sink || m_fileWriter)
     {
+        m_blockBus.reset(new AudioBus(m_numChannels, m_blockSize));
+        m_blockBus->setSampleRate(sampleRate);
+    }
+    m_blockFill = 0;
+    m_framesRendered = 0;
+
+    // Render in quanta, of which only the frames within the length are kept.
+    uint64_t framesRendered = 0;
+    while (framesRendered < lengthFrames)
+    {
+        m_context->updateOfflineGraph();
         render(0, m_renderBus.get(), renderQuantumSize);
-        framesToProcess -= 1;
+
+        const size_t frames = static_cast<size_t>(std::min<uint64_t>(renderQuantumSize, lengthFrames - framesRendered));
+        if (m_blockBus)
+            deliver(frames);
+        framesRendered += frames;
+        m_framesRendered.store(framesRendered, std::memory_order_relaxed);
+
+        if (m_stopCondition)
+        {
+            ContextRenderLock r(m_context, "OfflineAudioDestinationNode::offlineRender");
+            if (m_stopCondition(r, framesRendered))
+                break;
+        }
+    }
+
+    // Events posted by the last quanta are dispatched, and the objects they released freed.
+    m_context->updateOfflineGraph();
+
+    if (m_blockBus && m_blockFill)
+        deliverBlock();
+    m_blockBus.reset();
+
+    if (m_fileWriter)
+    {
+        if (!m_fileWriter->close())
+        {
+            LOG_ERROR("The offline render couldn't be completely written to its file");
+        }
+        m_fileWriter.reset();
     }
 
     LOG("Stopping Offline Rendering");
 }
 
+void OfflineAudioDestinationNode::deliver(size_t frames)
+{
+    for (size_t done = 0; done < frames;)
+    {
+        if (!m_blockFill)
+            m_blockStart = m_framesRendered.load(std::memory_order_relaxed) + done;
+
+        const size_t count = std::min(frames - done, m_blockSize - m_blockFill);
+        for (uint32_t c = 0; c < m_numChannels; ++c)
+        {
+            const float * source = m_renderBus->channel(c)->data() + done;
+            std::copy(source, source + count, m_blockBus->channel(c)->mutableData() + m_blockFill);
+        }
+        m_blockFill += count;
+        done += count;
+
+        if (m_blockFill == m_blockSize)
+            deliverBlock();
+    }
+}
+
+void OfflineAudioDestinationNode::deliverBlock()
+{
+    // The block is handed over whole, or a view of the frames the last block got to.
+    AudioBus * block = m_blockBus.get();
+    std::unique_ptr<AudioBus> view;
+    if (m_blockFill < m_blockSize)
+    {
+        view.reset(new AudioBus(m_numChannels, m_blockFill, false));
+        for (uint32_t c = 0; c < m_numChannels; ++c)
+            view->setChannelMemory(c, m_blockBus->channel(c)->mutableData(), m_blockFill);
+        view->setSampleRate(m_blockBus->sampleRate());
+        block = view.get();
+    }
+
+    if (m_fileWriter)
+    {
+        std::vector<const float *> channels(m_numChannels);
+        for (uint32_t c = 0; c < m_numChannels; ++c)
+            channels[c] = block->channel(c)->data();
+        m_fileWriter->writeWaiting(channels.data(), m_blockFill, block->sampleRate());
+    }
+
+    if (m_sink)
+        m_sink(*block, m_blockStart);
+
+    m_blockFill = 0;
+}
+
 } // namespace lab
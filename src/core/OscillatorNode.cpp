@@ -6,6 +6,7 @@
 
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioSetting.h"
@@ -17,8 +18,10 @@
 #include "internal/AudioUtilities.h"
 #include "internal/VectorMath.h"
 #include "internal/Assertions.h"
+#include "internal/WaveTableOscillator.h"
 
 #include <algorithm>
+#include <cstring>
 
 using namespace std;
 
@@ -26,11 +29,6 @@ namespace lab {
 
 using namespace VectorMath;
 
-std::shared_ptr<WaveTable> OscillatorNode::s_waveTableSine = 0;
-std::shared_ptr<WaveTable> OscillatorNode::s_waveTableSquare = 0;
-std::shared_ptr<WaveTable> OscillatorNode::s_waveTableSawtooth = 0;
-std::shared_ptr<WaveTable> OscillatorNode::s_waveTableTriangle = 0;
-
 OscillatorNode::OscillatorNode(const float sampleRate) :
       m_sampleRate(sampleRate),
       m_type(std::make_shared<AudioSetting>("type")),
@@ -82,113 +80,85 @@ void OscillatorNode::setType(OscillatorType type)
 
 void OscillatorNode::_setType(OscillatorType type)
 {
-    std::shared_ptr<WaveTable> waveTable;
-
-    switch (type)
-    {
-        case OscillatorType::SINE:
-            if (!s_waveTableSine)
-            {
-                s_waveTableSine = std::make_shared<WaveTable>(m_sampleRate, OscillatorType::SINE);
-            }
-            waveTable = s_waveTableSine;
-            break;
-        case OscillatorType::SQUARE:
-            if (!s_waveTableSquare)
-            {
-                s_waveTableSquare = std::make_shared<WaveTable>(m_sampleRate, OscillatorType::SQUARE);
-            }
-            waveTable = s_waveTableSquare;
-            break;
-        case OscillatorType::SAWTOOTH:
-            if (!s_waveTableSawtooth)
-            {
-                s_waveTableSawtooth = std::make_shared<WaveTable>(m_sampleRate, OscillatorType::SAWTOOTH);
-            }
-            waveTable = s_waveTableSawtooth;
-            break;
-        case OscillatorType::TRIANGLE:
-            if (!s_waveTableTriangle)
-            {
-                s_waveTableTriangle = std::make_shared<WaveTable>(m_sampleRate, OscillatorType::TRIANGLE);
-            }
-            waveTable = s_waveTableTriangle;
-            break;
-        case OscillatorType::CUSTOM:
-        default:
-            throw std::invalid_argument("Cannot set wavtable for custom type");
-    }
+    if (type == OscillatorType::CUSTOM)
+        throw std::invalid_argument("Cannot set wavtable for custom type");
 
-    setWaveTable(waveTable);
+    setWaveTable(WaveTable::shared(m_sampleRate, type));
 
     // set the value again, with no notification, as setWaveTable forces the type to CUSTOM.
     m_type->setUint32(static_cast<uint32_t>(type), false);
 }
 
-bool OscillatorNode::calculateSampleAccuratePhaseIncrements(ContextRenderLock & r, size_t framesToProcess)
+bool OscillatorNode::calculateSampleAccuratePhaseIncrements(ContextRenderLock & r, size_t framesToProcess, float & frequency)
 {
     bool isGood = framesToProcess <= m_phaseIncrements.size() && framesToProcess <= m_detuneValues.size();
     ASSERT(isGood);
     if (!isGood)
         return false;
 
-    if (m_firstRender) {
-        m_firstRender = false;
-        m_frequency->resetSmoothedValue();
-        m_detune->resetSmoothedValue();
-    }
-
-    bool hasSampleAccurateValues = false;
     bool hasFrequencyChanges = false;
+    bool hasDetuneChanges = false;
     float* phaseIncrements = m_phaseIncrements.data();
 
-    float finalScale = m_waveTable->rateScale();
-
-    if (m_frequency->hasSampleAccurateValues()) {
-        hasSampleAccurateValues = true;
+    if (m_frequency->hasSampleAccurateValues() && !m_frequency->isConstantForQuantum(r, framesToProcess)) {
         hasFrequencyChanges = true;
 
         // Get the sample-accurate frequency values and convert to phase increments.
         // They will be converted to phase increments below.
         m_frequency->calculateSampleAccurateValues(r, phaseIncrements, framesToProcess);
     } else {
-        // Handle ordinary parameter smoothing/de-zippering if there are no scheduled changes.
-        m_frequency->smooth(r);
-        float frequency = m_frequency->smoothedValue();
-        finalScale *= frequency;
+        // Handle ordinary parameter smoothing/de-zippering if there are no scheduled changes. While it is
+        // approaching a new value, the frequency changes frame by frame.
+        hasFrequencyChanges = !m_frequency->smooth(r, phaseIncrements, framesToProcess);
     }
 
-    if (m_detune->hasSampleAccurateValues()) {
-        hasSampleAccurateValues = true;
-
-        // Get the sample-accurate detune values.
-        float* detuneValues = hasFrequencyChanges ? m_detuneValues.data() : phaseIncrements;
+    // Get the detune values, alongside the frequencies if those change.
+    float* detuneValues = hasFrequencyChanges ? m_detuneValues.data() : phaseIncrements;
+    if (m_detune->hasSampleAccurateValues() && !m_detune->isConstantForQuantum(r, framesToProcess)) {
+        hasDetuneChanges = true;
         m_detune->calculateSampleAccurateValues(r, detuneValues, framesToProcess);
+    } else {
+        hasDetuneChanges = !m_detune->smooth(r, detuneValues, framesToProcess);
+    }
+
+    if (!hasFrequencyChanges && !hasDetuneChanges) {
+        frequency = m_frequency->smoothedValue() * powf(2, m_detune->smoothedValue() / 1200);
+        return false;
+    }
+
+    float finalScale = m_waveTable->rateScale();
 
-        // Convert from cents to rate scalar.
-        float k = 1.f / 1200.f;
+    if (hasDetuneChanges) {
+        // Convert from cents to rate scalar, 2^(cents / 1200) = e^(cents * ln(2) / 1200).
+        float k = logf(2) / 1200.f;
         vsmul(detuneValues, 1, &k, detuneValues, 1, framesToProcess);
-        for (unsigned i = 0; i < framesToProcess; ++i)
-            detuneValues[i] = powf(2, detuneValues[i]); // FIXME: converting to expf() will be faster.
+        vexp(detuneValues, detuneValues, framesToProcess);
 
         if (hasFrequencyChanges) {
             // Multiply frequencies by detune scalings.
             vmul(detuneValues, 1, phaseIncrements, 1, phaseIncrements, 1, framesToProcess);
         }
+        else
+            finalScale *= m_frequency->smoothedValue();
     } else {
-        // Handle ordinary parameter smoothing/de-zippering if there are no scheduled changes.
-        m_detune->smooth(r);
-        float detune = m_detune->smoothedValue();
-        float detuneScale = powf(2, detune / 1200);
-        finalScale *= detuneScale;
+        finalScale *= powf(2, m_detune->smoothedValue() / 1200);
     }
 
-    if (hasSampleAccurateValues) {
-        // Convert from frequency to wavetable increment.
-        vsmul(phaseIncrements, 1, &finalScale, phaseIncrements, 1, framesToProcess);
-    }
+    // Convert from frequency to wavetable increment.
+    vsmul(phaseIncrements, 1, &finalScale, phaseIncrements, 1, framesToProcess);
 
-    return hasSampleAccurateValues;
+    return true;
+}
+
+void OscillatorNode::prepare(AudioContext & context, size_t inputChannels)
+{
+    AudioScheduledSourceNode::prepare(context, inputChannels);
+
+    if (context.renderQuantumSize() > m_phaseIncrements.size())
+    {
+        m_phaseIncrements.allocate(context.renderQuantumSize());
+        m_detuneValues.allocate(context.renderQuantumSize());
+    }
 }
 
 void OscillatorNode::process(ContextRenderLock& r, size_t framesToProcess)
@@ -200,9 +170,12 @@ void OscillatorNode::process(ContextRenderLock& r, size_t framesToProcess)
         return;
     }
 
-    ASSERT(framesToProcess <= m_phaseIncrements.size());
+    // The scratch buffers grow once if the context renders larger quanta than the default.
     if (framesToProcess > m_phaseIncrements.size())
-        return;
+    {
+        m_phaseIncrements.allocate(framesToProcess);
+        m_detuneValues.allocate(framesToProcess);
+    }
 
     // The audio thread can't block on this lock, so we call tryLock() instead.
     if (!r.context()) {
@@ -220,82 +193,77 @@ void OscillatorNode::process(ContextRenderLock& r, size_t framesToProcess)
     size_t quantumFrameOffset = 0;
     size_t nonSilentFramesToProcess = 0;
 
-    updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess);
-
-    if (!nonSilentFramesToProcess) {
-        outputBus->zero();
+    if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
         return;
+
+    if (m_firstRender) {
+        m_firstRender = false;
+        m_frequency->resetSmoothedValue(r);
+        m_detune->resetSmoothedValue(r);
     }
 
-    unsigned waveTableSize = m_waveTable->periodicWaveSize();
-    double invWaveTableSize = 1.0 / waveTableSize;
+    ASSERT(quantumFrameOffset <= framesToProcess);
+
+    WaveTable & waveTable = *m_waveTable;
+    const unsigned waveTableSize = waveTable.periodicWaveSize();
+    const float rateScale = waveTable.rateScale();
 
-    float* destP = outputBus->channel(0)->mutableData();
+    float* destP = outputBus->channel(0)->mutableData() + quantumFrameOffset;
+    size_t n = nonSilentFramesToProcess;
 
-    ASSERT(quantumFrameOffset <= framesToProcess);
+    // At control rate, a value is read for each stride frames that sound, a stride of phase apart.
+    const size_t stride = controlStride();
+    size_t firstValue = quantumFrameOffset;
+    if (stride > 1) {
+        firstValue = (quantumFrameOffset + stride - 1) / stride;
+        const size_t endValue = (quantumFrameOffset + nonSilentFramesToProcess + stride - 1) / stride;
+        const size_t values = framesToProcess / stride;
+        if (endValue < values)
+            memset(outputBus->channel(0)->mutableData() + endValue, 0, (values - endValue) * sizeof(float));
+        destP = outputBus->channel(0)->mutableData() + firstValue;
+        n = endValue - firstValue;
+    }
 
     // We keep virtualReadIndex double-precision since we're accumulating values.
     double virtualReadIndex = m_virtualReadIndex;
 
-    float rateScale = m_waveTable->rateScale();
-    float invRateScale = 1 / rateScale;
-    bool hasSampleAccurateValues = calculateSampleAccuratePhaseIncrements(r, framesToProcess);
-
-    float frequency = 0;
     float* higherWaveData = 0;
     float* lowerWaveData = 0;
     float tableInterpolationFactor;
 
-    if (!hasSampleAccurateValues) {
-        frequency = m_frequency->smoothedValue();
-        float detune = m_detune->smoothedValue();
-        float detuneScale = powf(2, detune / 1200);
-        frequency *= detuneScale;
-        m_waveTable->waveDataForFundamentalFrequency(frequency, lowerWaveData, higherWaveData, tableInterpolationFactor);
+    float frequency = 0;
+    if (!calculateSampleAccuratePhaseIncrements(r, framesToProcess, frequency)) {
+        // Neither is driven by a connection, automated to change during the quantum, nor de-zippering, so the
+        // frequency is constant over it. The read indices are generated in the phase increment buffer.
+        float* readIndices = m_phaseIncrements.data();
+        waveTable.waveDataForFundamentalFrequency(frequency * stride, lowerWaveData, higherWaveData, tableInterpolationFactor);
+        waveTableReadIndices(virtualReadIndex, static_cast<double>(frequency) * rateScale * stride, waveTableSize, readIndices, n);
+        waveTableRead(lowerWaveData, higherWaveData, tableInterpolationFactor, waveTableSize, readIndices, destP, n);
     }
-
-    float incr = frequency * rateScale;
-    float* phaseIncrements = m_phaseIncrements.data();
-
-    unsigned readIndexMask = waveTableSize - 1;
-
-    // Start rendering at the correct offset.
-    destP += quantumFrameOffset;
-    size_t n = nonSilentFramesToProcess;
-
-    while (n--) {
-        unsigned readIndex = static_cast<unsigned>(virtualReadIndex);
-        unsigned readIndex2 = readIndex + 1;
-
-        // Contain within valid range.
-        readIndex = readIndex & readIndexMask;
-        readIndex2 = readIndex2 & readIndexMask;
-
-        if (hasSampleAccurateValues) {
-            incr = *phaseIncrements++;
-
-            frequency = invRateScale * incr;
-            m_waveTable->waveDataForFundamentalFrequency(frequency, lowerWaveData, higherWaveData, tableInterpolationFactor);
+    else {
+        float* phaseIncrements = m_phaseIncrements.data() + firstValue;
+        if (stride > 1) {
+            // Each value's increment covers its stride, at the frequency of the frame it stands for.
+            float* increments = m_phaseIncrements.data();
+            for (size_t i = firstValue; i < firstValue + n; ++i)
+                increments[i] = increments[i * stride] * stride;
         }
 
-        float sample1Lower = lowerWaveData[readIndex];
-        float sample2Lower = lowerWaveData[readIndex2];
-        float sample1Higher = higherWaveData[readIndex];
-        float sample2Higher = higherWaveData[readIndex2];
-
-        // Linearly interpolate within each table (lower and higher).
-        float interpolationFactor = static_cast<float>(virtualReadIndex) - readIndex;
-        float sampleHigher = (1 - interpolationFactor) * sample1Higher + interpolationFactor * sample2Higher;
-        float sampleLower = (1 - interpolationFactor) * sample1Lower + interpolationFactor * sample2Lower;
+        // The table range is chosen for a block of frames at a time, for the highest frequency in it, and the
+        // increments are replaced by the read indices they lead to.
+        const float invRateScale = 1 / rateScale;
+        const size_t BlockSize = 16;
+        for (size_t i = 0; i < n; i += BlockSize) {
+            size_t blockSize = std::min(BlockSize, n - i);
 
-        // Then interpolate between the two tables.
-        float sample = (1 - tableInterpolationFactor) * sampleHigher + tableInterpolationFactor * sampleLower;
+            float highestIncrement = 0;
+            for (size_t j = 0; j < blockSize; ++j)
+                highestIncrement = std::max(highestIncrement, fabsf(phaseIncrements[i + j]));
 
-        *destP++ = sample;
-
-        // Increment virtual read index and wrap virtualReadIndex into the range 0 -> waveTableSize.
-        virtualReadIndex += incr;
-        virtualReadIndex -= floor(virtualReadIndex * invWaveTableSize) * waveTableSize;
+            waveTable.waveDataForFundamentalFrequency(highestIncrement * invRateScale, lowerWaveData, higherWaveData, tableInterpolationFactor);
+            waveTableReadIndices(virtualReadIndex, phaseIncrements + i, waveTableSize, phaseIncrements + i, blockSize);
+            waveTableRead(lowerWaveData, higherWaveData, tableInterpolationFactor, waveTableSize, phaseIncrements + i, destP + i, blockSize);
+        }
     }
 
     m_virtualReadIndex = virtualReadIndex;
@@ -308,6 +276,11 @@ void OscillatorNode::reset(ContextRenderLock&)
     m_virtualReadIndex = 0;
 }
 
+void OscillatorNode::setPeriodicWave(const std::vector<float> & real, const std::vector<float> & imag)
+{
+    setWaveTable(WaveTable::shared(m_sampleRate, real, imag));
+}
+
 void OscillatorNode::setWaveTable(std::shared_ptr<WaveTable> waveTable)
 {
     m_waveTable = waveTable;
@@ -315,6 +288,17 @@ void OscillatorNode::setWaveTable(std::shared_ptr<WaveTable> waveTable)
     m_type->setUint32(static_cast<uint32_t>(OscillatorType::CUSTOM), false);
 }
 
+void OscillatorNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioScheduledSourceNode::reportMemory(r, usage);
+    usage.add(AudioMemoryCategory::Other, (m_phaseIncrements.size() + m_detuneValues.size()) * sizeof(float));
+
+    // Tables are shared by the oscillators at a sample rate, and the basic ones are cached besides, so their
+    // reference counts aren't reported.
+    if (m_waveTable)
+        usage.addShared(AudioMemoryCategory::Samples, m_waveTable.get(), m_waveTable->memoryBytes());
+}
+
 bool OscillatorNode::propagatesSilence(ContextRenderLock & r) const
 {
     return !isPlayingOrScheduled() || hasFinished() || !m_waveTable.get();
@@ -6,6 +6,7 @@
 
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
@@ -13,11 +14,13 @@
 #include "LabSound/core/SampledAudioNode.h"
 #include "LabSound/extended/AudioContextLock.h"
 
+#include "internal/AmbisonicPanner.h"
 #include "internal/HRTFDatabaseLoader.h"
 #include "internal/HRTFPanner.h"
 #include "internal/Panner.h"
 #include "internal/Cone.h"
 #include "internal/Distance.h"
+#include "internal/DopplerDelay.h"
 #include "internal/EqualPowerPanner.h"
 #include "internal/Assertions.h"
 
@@ -25,13 +28,44 @@ using namespace std;
 
 namespace lab {
 
+// How far ahead of a moving source HRTF kernels are prefetched, in seconds.
+static const double HRTFPrefetchTime = 0.1;
+
 template <typename T>
 static void fixNANs(T& x)
 {
     if (std::isnan(T(x)) || std::isinf(x)) x = T(0);
 }
 
-PannerNode::PannerNode(const float sampleRate, const std::string & searchPath)
+// A line replaced by a longer one is kept until the node is destroyed, as the render thread may still be reading
+// it. Also the task by which the render thread has the update thread make a line of requestedFrames.
+struct PannerNode::DopplerLines : public AudioContext::DeferredTask
+{
+    DopplerLines(float sampleRate) : sampleRate(sampleRate) { }
+
+    // Makes the first line, or a longer one if quanta of frames don't fit the one there is. Not on the render
+    // thread, unless offline.
+    void make(size_t frames)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        const DopplerDelay * line = current.load(std::memory_order_acquire);
+        if (line && line->maxFrames() >= frames)
+            return;
+
+        lines.emplace_back(new DopplerDelay(sampleRate, frames));
+        current.store(lines.back().get(), std::memory_order_release);
+    }
+
+    virtual void run() override { make(requestedFrames.load()); }
+
+    float sampleRate;
+    std::mutex lock;
+    std::vector<std::unique_ptr<DopplerDelay>> lines;
+    std::atomic<DopplerDelay *> current{ nullptr };
+    std::atomic<size_t> requestedFrames{ 0 };
+};
+
+PannerNode::PannerNode(const float sampleRate, const std::string & searchPath, const std::string & hrtfSubject)
 : AudioNode()
 , m_orientationX(std::make_shared<AudioParam>("orientationX", 0.f, -1.f, 1.f))
 , m_orientationY(std::make_shared<AudioParam>("orientationY", 0.f, -1.f, 1.f))
@@ -49,6 +83,8 @@ PannerNode::PannerNode(const float sampleRate, const std::string & searchPath)
 , m_coneInnerAngle(std::make_shared<AudioSetting>("coneInnerAngle"))
 , m_coneOuterAngle(std::make_shared<AudioSetting>("coneOuterAngle"))
 , m_panningModel(std::make_shared<AudioSetting>("panningMode"))
+, m_doppler(std::make_shared<AudioSetting>("doppler"))
+, m_dopplerLines(std::make_shared<DopplerLines>(sampleRate))
 , m_sampleRate(sampleRate)
 {
     if (searchPath.length())
@@ -60,7 +96,7 @@ PannerNode::PannerNode(const float sampleRate, const std::string & searchPath)
             return path;
         };
         LOG("Initializing HRTF Database");
-        m_hrtfDatabaseLoader = HRTFDatabaseLoader::MakeHRTFLoaderSingleton(sampleRate, stripSlash(searchPath));
+        m_hrtfDatabaseLoader = HRTFDatabaseLoader::loaderFor(sampleRate, stripSlash(searchPath), hrtfSubject);
     }
 
     m_distanceEffect.reset(new DistanceEffect());
@@ -110,7 +146,7 @@ PannerNode::PannerNode(const float sampleRate, const std::string & searchPath)
 
     m_rolloffFactor->setValueChanged(
         [this]() {
-            m_distanceEffect->setRolloffFactor(m_maxDistance->valueFloat());
+            m_distanceEffect->setRolloffFactor(m_rolloffFactor->valueFloat());
         }
     );
     m_settings.push_back(m_rolloffFactor);
@@ -136,6 +172,16 @@ PannerNode::PannerNode(const float sampleRate, const std::string & searchPath)
         }
     );
 
+    // The delay line is made the first time Doppler is turned on, and kept until the node is destroyed, so that the
+    // render thread never sees it freed.
+    m_doppler->setValueChanged(
+        [this]() {
+            if (m_doppler->valueUint32())
+                m_dopplerLines->make(ProcessingSizeInFrames);
+        }
+    );
+    m_settings.push_back(m_doppler);
+
     // Node-specific default mixing rules.
     m_channelCount = 2;
     m_channelCountMode = ChannelCountMode::ClampedMax;
@@ -159,21 +205,39 @@ void PannerNode::initialize()
             m_panner = std::unique_ptr<Panner>(new EqualPowerPanner(m_sampleRate));
             break;
         case PanningMode::HRTF:
-            m_panner = std::unique_ptr<Panner>(new HRTFPanner(m_sampleRate));
+            m_panner = std::unique_ptr<Panner>(new HRTFPanner(m_sampleRate, m_hrtfDatabaseLoader));
+            break;
+        case PanningMode::AMBISONIC:
+            m_panner = std::unique_ptr<Panner>(new AmbisonicPanner(m_sampleRate, m_hrtfDatabaseLoader));
             break;
         default:
             throw std::runtime_error("invalid panning model");
     }
 
+    m_fallbackPanner = std::unique_ptr<Panner>(new EqualPowerPanner(m_sampleRate));
+
     AudioNode::initialize();
 }
 
+void PannerNode::prepare(AudioContext & context, size_t inputChannels)
+{
+    AudioNode::prepare(context, inputChannels);
+
+    const PanningMode model = static_cast<PanningMode>(m_panningModel->valueUint32());
+    if (m_hrtfDatabaseLoader && model != PanningMode::EQUALPOWER)
+        m_hrtfDatabaseLoader->waitForLoaderThreadCompletion();
+
+    if (m_doppler->valueUint32())
+        m_dopplerLines->make(context.renderQuantumSize());
+}
+
 void PannerNode::uninitialize()
 {
     if (!isInitialized())
         return;
 
     m_panner.reset();
+    m_fallbackPanner.reset();
 
     AudioNode::uninitialize();
 }
@@ -229,29 +293,75 @@ void PannerNode::process(ContextRenderLock & r, size_t framesToProcess)
         return;
     }
 
-    // HRTFDatabase should be loaded before proceeding for offline audio context
-    if (static_cast<PanningMode>(m_panningModel->valueUint32()) == PanningMode::HRTF && !m_hrtfDatabaseLoader->isLoaded())
+    // Until the HRTF database has been loaded, or if it can't be, pan with equal power rather than wait or fall silent.
+    // An offline context waits instead, as it doesn't render in real time and its output should not depend on timing.
+    Panner * panner = m_panner.get();
+    bool useHRTF = panner->panningModel() == PanningMode::HRTF;
+    if (useHRTF)
     {
-        if (r.context()->isOfflineContext())
-        {
+        if (m_hrtfDatabaseLoader && r.context()->isOfflineContext())
             m_hrtfDatabaseLoader->waitForLoaderThreadCompletion();
+
+        if (!m_hrtfDatabaseLoader || !m_hrtfDatabaseLoader->database())
+        {
+            panner = m_fallbackPanner.get();
+            useHRTF = false;
         }
-        else
+    }
+
+    // Get the distance and cone gain, which also updates the distance to the listener.
+    float totalGain = distanceConeGain(r);
+
+    // Delay the source by the time its sound takes to reach the listener, so that its pitch shifts as that changes.
+    // A line too short for the quantum, as of a node not prepared for its context, asks for a longer one, and the
+    // source is heard undelayed until it is made. Offline, it is made in place.
+    DopplerDelay * doppler = m_doppler->valueUint32() ? m_dopplerLines->current.load(std::memory_order_acquire) : nullptr;
+    if (doppler && framesToProcess > doppler->maxFrames())
+    {
+        if (r.context()->isOfflineContext())
+            m_dopplerLines->make(framesToProcess);
+        else if (m_dopplerLines->requestedFrames.load() < framesToProcess)
         {
-            destination->zero();
-            return;
+            m_dopplerLines->requestedFrames.store(framesToProcess);
+            if (!r.context()->deferTask(r, m_dopplerLines))
+                m_dopplerLines->requestedFrames.store(0);
         }
+        doppler = m_dopplerLines->current.load(std::memory_order_acquire);
+        if (framesToProcess > doppler->maxFrames())
+            doppler = nullptr;
     }
+    if (doppler)
+    {
+        if (doppler != m_activeDoppler)
+            doppler->reset();
+        source = doppler->process(source, dopplerDelayFrames(r), framesToProcess);
+    }
+    m_activeDoppler = doppler;
 
     // Apply the panning effect.
     double azimuth;
     double elevation;
     getAzimuthElevation(r, &azimuth, &elevation);
 
-    m_panner->pan(r, azimuth, elevation, source, destination, framesToProcess);
+    // Ambisonic sources are heard once the destination decodes the listener's field, and are panned with equal power
+    // until it can be.
+    if (panner->panningModel() == PanningMode::AMBISONIC)
+    {
+        if (static_cast<AmbisonicPanner *>(panner)->encode(r, azimuth, elevation, totalGain, source, framesToProcess))
+        {
+            destination->zero();
+            return;
+        }
+        panner = m_fallbackPanner.get();
+    }
+
+    panner->pan(r, azimuth, elevation, source, destination, framesToProcess);
 
-    // Get the distance and cone gain.
-    float totalGain = distanceConeGain(r);
+    // Ask for the HRTF kernels of where a moving source is headed, so that they are ready by the time it gets there.
+    if (useHRTF && getPredictedAzimuthElevation(r, HRTFPrefetchTime, &azimuth, &elevation))
+    {
+        static_cast<HRTFPanner *>(panner)->prefetch(azimuth, elevation);
+    }
 
     // Snap to desired gain at the beginning.
     if (m_lastGain == -1.f)
@@ -264,6 +374,7 @@ void PannerNode::process(ContextRenderLock & r, size_t framesToProcess)
 void PannerNode::reset(ContextRenderLock&)
 {
     m_lastGain = -1.0; // force to snap to initial gain
+    m_activeDoppler = nullptr;
     if (m_panner.get())
         m_panner->reset();
 }
@@ -276,7 +387,7 @@ PanningMode PannerNode::panningModel() const
 
 void PannerNode::setPanningModel(PanningMode model)
 {
-    if (model != PanningMode::EQUALPOWER && model != PanningMode::HRTF)
+    if (model != PanningMode::EQUALPOWER && model != PanningMode::HRTF && model != PanningMode::AMBISONIC)
         throw std::invalid_argument("Unknown panning model specified");
 
     PanningMode curr = static_cast<PanningMode>(m_panningModel->valueUint32());
@@ -290,7 +401,10 @@ void PannerNode::setPanningModel(PanningMode model)
                 m_panner = std::unique_ptr<Panner>(new EqualPowerPanner(m_sampleRate));
                 break;
             case PanningMode::HRTF:
-                m_panner = std::unique_ptr<Panner>(new HRTFPanner(m_sampleRate));
+                m_panner = std::unique_ptr<Panner>(new HRTFPanner(m_sampleRate, m_hrtfDatabaseLoader));
+                break;
+            case PanningMode::AMBISONIC:
+                m_panner = std::unique_ptr<Panner>(new AmbisonicPanner(m_sampleRate, m_hrtfDatabaseLoader));
                 break;
             default:
                 throw std::invalid_argument("invalid panning model");
@@ -309,26 +423,14 @@ PannerNode::DistanceModel PannerNode::distanceModel()
     return static_cast<PannerNode::DistanceModel>(m_distanceModel->valueUint32());
 }
 
-void PannerNode::getAzimuthElevation(ContextRenderLock& r, double* outAzimuth, double* outElevation)
+// Returns the azimuth and elevation of the source as heard by the listener at listenerPosition.
+static void calculateAzimuthElevation(const FloatPoint3D & listenerPosition, const FloatPoint3D & listenerForward, const FloatPoint3D & listenerUp,
+                                      const FloatPoint3D & sourcePosition, double * outAzimuth, double * outElevation)
 {
-    // FIXME: we should cache azimuth and elevation (if possible), so we only re-calculate if a change has been made.
-
     double azimuth = 0.0;
 
-    AudioListener & listener = r.context()->listener();
-
     // Calculate the source-listener vector
-    FloatPoint3D listenerPosition = {
-                                        listener.positionX()->value(r),
-                                        listener.positionY()->value(r),
-                                        listener.positionZ()->value(r) };
-
-    FloatPoint3D sourceListener = {
-                                        positionX()->value(r),
-                                        positionY()->value(r),
-                                        positionZ()->value(r) };
-
-    sourceListener = normalize(sourceListener - listenerPosition);
+    FloatPoint3D sourceListener = sourcePosition - listenerPosition;
 
     if (is_zero(sourceListener))
     {
@@ -338,17 +440,10 @@ void PannerNode::getAzimuthElevation(ContextRenderLock& r, double* outAzimuth, d
         return;
     }
 
-    // Align axes
-    FloatPoint3D listenerFront = normalize(FloatPoint3D{
-                                        listener.forwardX()->value(r),
-                                        listener.forwardY()->value(r),
-                                        listener.forwardZ()->value(r) }
-                                    );
+    sourceListener = normalize(sourceListener);
 
-    FloatPoint3D listenerUp = {
-                                        listener.upX()->value(r),
-                                        listener.upY()->value(r),
-                                        listener.upZ()->value(r) };
+    // Align axes
+    FloatPoint3D listenerFront = normalize(listenerForward);
 
     FloatPoint3D listenerRight = normalize(cross(listenerFront, listenerUp));
     FloatPoint3D up = cross(listenerRight, listenerFront);
@@ -386,10 +481,128 @@ void PannerNode::getAzimuthElevation(ContextRenderLock& r, double* outAzimuth, d
         *outElevation = elevation;
 }
 
+bool PannerNode::hasGeometry(ContextRenderLock & r) const
+{
+    return m_geometry.sampleFrame == r.context()->currentSampleFrame();
+}
+
+void PannerNode::updateGains()
+{
+    m_geometry.distanceGain = m_distanceEffect->tableGain(m_geometry.distance);
+    m_geometry.coneGain = m_coneEffect->gain(static_cast<double>(m_geometry.coneCosine));
+    m_listenerDistance.store(m_geometry.distance, std::memory_order_relaxed);
+}
+
+void PannerNode::updateGeometry(ContextRenderLock & r)
+{
+    if (hasGeometry(r))
+        return;
+
+    const AudioListener::Frame & listener = r.context()->listener().frame(r);
+
+    const FloatPoint3D position = {
+                                        positionX()->value(r),
+                                        positionY()->value(r),
+                                        positionZ()->value(r) };
+
+    const FloatPoint3D orientation = {
+                                        orientationX()->value(r),
+                                        orientationY()->value(r),
+                                        orientationZ()->value(r) };
+
+    if (!geometryCurrent(position, orientation, listener.version))
+    {
+        double azimuth;
+        double elevation;
+        calculateAzimuthElevation(listener.position, listener.front, listener.up, position, &azimuth, &elevation);
+
+        // A source without an orientation radiates equally in every direction, as if the listener were straight
+        // ahead, as the SpatialBatch takes it.
+        const FloatPoint3D sourceToListener = listener.position - position;
+        const float distance = magnitude(sourceToListener);
+        const float orientationLength = magnitude(orientation);
+        float coneCosine = 1;
+        if (orientationLength > 0)
+            coneCosine = distance > 0 ? dot(sourceToListener, orientation) / (distance * orientationLength) : 0;
+
+        m_geometry.azimuth = azimuth;
+        m_geometry.elevation = elevation;
+        m_geometry.distance = distance;
+        m_geometry.coneCosine = std::max(-1.f, std::min(1.f, coneCosine));
+        m_geometry.position = position;
+        m_geometry.orientation = orientation;
+        m_geometry.listenerVersion = listener.version;
+    }
+
+    updateGains();
+    m_geometry.sampleFrame = r.context()->currentSampleFrame();
+}
+
+void PannerNode::getAzimuthElevation(ContextRenderLock& r, double* outAzimuth, double* outElevation)
+{
+    updateGeometry(r);
+
+    if (outAzimuth)
+        *outAzimuth = m_geometry.azimuth;
+    if (outElevation)
+        *outElevation = m_geometry.elevation;
+}
+
+bool PannerNode::getPredictedAzimuthElevation(ContextRenderLock & r, double seconds, double * outAzimuth, double * outElevation)
+{
+    AudioListener & listener = r.context()->listener();
+
+    const FloatPoint3D sourceVelocity = {
+                                        velocityX()->value(r),
+                                        velocityY()->value(r),
+                                        velocityZ()->value(r) };
+    const FloatPoint3D listenerVelocity = {
+                                        listener.velocityX()->value(r),
+                                        listener.velocityY()->value(r),
+                                        listener.velocityZ()->value(r) };
+
+    if (is_zero(sourceVelocity) && is_zero(listenerVelocity))
+        return false;
+
+    // Both keep moving as they are; the listener's orientation is assumed not to change.
+    const float t = static_cast<float>(seconds);
+    FloatPoint3D listenerPosition = FloatPoint3D {
+                                        listener.positionX()->value(r),
+                                        listener.positionY()->value(r),
+                                        listener.positionZ()->value(r) } + listenerVelocity * t;
+
+    FloatPoint3D sourcePosition = FloatPoint3D {
+                                        positionX()->value(r),
+                                        positionY()->value(r),
+                                        positionZ()->value(r) } + sourceVelocity * t;
+
+    const AudioListener::Frame & frame = listener.frame(r);
+    calculateAzimuthElevation(listenerPosition, frame.front, frame.up, sourcePosition, outAzimuth, outElevation);
+    return true;
+}
+
+double PannerNode::dopplerDelayFrames(ContextRenderLock & r)
+{
+    AudioListener & listener = r.context()->listener();
+    const double dopplerFactor = listener.dopplerFactor()->value(r);
+    const double speedOfSound = listener.speedOfSound()->value(r);
+    if (!(dopplerFactor > 0.0) || !(speedOfSound > 0.0))
+        return 0;
+
+    return listenerDistance() * dopplerFactor / speedOfSound * m_sampleRate;
+}
+
+bool PannerNode::doppler() const { return m_doppler->valueUint32() != 0; }
+void PannerNode::setDoppler(bool enabled) { m_doppler->setUint32(enabled ? 1 : 0); }
+
 float PannerNode::dopplerRate(ContextRenderLock & r)
 {
     double dopplerShift = 1.0;
 
+    // The delay line shifts the pitch itself.
+    if (doppler())
+        return static_cast<float>(dopplerShift);
+
     AudioListener & listener = r.context()->listener();
 
     // FIXME: optimize for case when neither source nor listener has changed...
@@ -455,37 +668,11 @@ float PannerNode::dopplerRate(ContextRenderLock & r)
 
 float PannerNode::distanceConeGain(ContextRenderLock& r)
 {
-    AudioListener & listener = r.context()->listener();
-
-    FloatPoint3D listenerPosition = {
-                                                    listener.positionX()->value(r),
-                                                    listener.positionY()->value(r),
-                                                    listener.positionZ()->value(r) };
-
-    FloatPoint3D position = {
-                                                    positionX()->value(r),
-                                                    positionY()->value(r),
-                                                    positionZ()->value(r) };
+    updateGeometry(r);
 
-
-    double listenerDistance = magnitude(position - listenerPosition); // "distanceTo"
-
-    double distanceGain = m_distanceEffect->gain(listenerDistance);
-
-    m_distanceGain->setValue(static_cast<float>(distanceGain));
-
-    // FIXME: could optimize by caching coneGain
-
-    FloatPoint3D orientation = {
-                                                    orientationX()->value(r),
-                                                    orientationY()->value(r),
-                                                    orientationZ()->value(r) };
-
-    double coneGain = m_coneEffect->gain(position, orientation, listenerPosition);
-
-    m_coneGain->setValue(static_cast<float>(coneGain));
-
-    return float(distanceGain * coneGain);
+    m_distanceGain->setValue(static_cast<float>(m_geometry.distanceGain));
+    m_coneGain->setValue(static_cast<float>(m_geometry.coneGain));
+    return float(m_geometry.distanceGain * m_geometry.coneGain);
 }
 
 void PannerNode::notifyAudioSourcesConnectedToNode(ContextRenderLock& r, AudioNode* node)
@@ -509,14 +696,15 @@ void PannerNode::notifyAudioSourcesConnectedToNode(ContextRenderLock& r, AudioNo
             // For each input, go through all of its connections, looking for SampledAudioNodes.
             for (unsigned j = 0; j < input->numberOfRenderingConnections(r); ++j)
             {
-                auto connectedOutput = input->renderingOutput(r, j);
-                AudioNode* connectedNode = connectedOutput->node();
+                AudioNode* connectedNode = input->renderingOutput(r, j)->node();
                 notifyAudioSourcesConnectedToNode(r, connectedNode); // recurse
             }
         }
     }
 }
 
+float PannerNode::distanceGainAt(float distance) const { return static_cast<float>(m_distanceEffect->gain(distance)); }
+
 float PannerNode::refDistance() { return static_cast<float>(m_distanceEffect->refDistance()); }
 void PannerNode::setRefDistance(float refDistance) { m_refDistance->setFloat(refDistance); }
 
@@ -535,7 +723,24 @@ void PannerNode::setConeOuterAngle(float angle) { m_coneOuterAngle->setFloat(ang
 float PannerNode::coneOuterGain() const { return static_cast<float>(m_coneEffect->outerGain()); }
 void PannerNode::setConeOuterGain(float angle) { m_coneEffect->setOuterGain(angle); }
 
-double PannerNode::tailTime(ContextRenderLock & r) const { return m_panner ? m_panner->tailTime(r) : 0; }
+void PannerNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioNode::reportMemory(r, usage);
+
+    if (const DopplerDelay * doppler = m_dopplerLines->current.load(std::memory_order_acquire))
+        usage.add(AudioMemoryCategory::DelayLines, doppler->memoryBytes());
+
+    // The database is shared by every panner of its sample rate, whichever model they pan with.
+    if (m_hrtfDatabaseLoader)
+        if (const HRTFDatabase * database = m_hrtfDatabaseLoader->database())
+            usage.addShared(AudioMemoryCategory::HRTF, database, database->memoryBytes());
+}
+
+double PannerNode::tailTime(ContextRenderLock & r) const
+{
+    const double dopplerTime = m_activeDoppler ? m_activeDoppler->delayFrames() / m_sampleRate : 0;
+    return (m_panner ? m_panner->tailTime(r) : 0) + dopplerTime;
+}
 double PannerNode::latencyTime(ContextRenderLock & r) const { return m_panner ? m_panner->latencyTime(r) : 0; }
 
 } // namespace lab
@@ -10,12 +10,16 @@
 
 #include "internal/AudioUtilities.h"
 #include "internal/FFTFrame.h"
+#include "internal/STFT.h"
 #include "internal/VectorMath.h"
 #include "internal/Assertions.h"
+#include "internal/SpectrumAnalysisPool.h"
+#include "internal/TripleBuffer.h"
 
 #include <algorithm>
 #include <limits.h>
 #include <complex>
+#include <mutex>
 
 using namespace std;
 
@@ -31,6 +35,41 @@ const uint32_t RealtimeAnalyser::MinFFTSize = 32;
 const uint32_t RealtimeAnalyser::MaxFFTSize = 2048;
 const uint32_t RealtimeAnalyser::InputBufferSize = RealtimeAnalyser::MaxFFTSize * 2;
 
+// About 86 analyses a second at 44.1kHz.
+const uint32_t RealtimeAnalyser::DefaultAnalysisHop = 512;
+
+struct RealtimeAnalyser::Exchange
+{
+    // The last fftSize frames of input, in order.
+    struct Input
+    {
+        AudioFloatArray timeDomain;
+    };
+
+    // An analysis, with the input it was made from.
+    struct Analysis
+    {
+        AudioFloatArray timeDomain;
+        AudioFloatArray magnitudes;
+    };
+
+    explicit Exchange(uint32_t fftSize)
+        : input([fftSize](Input & slot) { slot.timeDomain.allocate(fftSize); })
+        , analyses([fftSize](Analysis & slot) {
+            slot.timeDomain.allocate(fftSize);
+            slot.magnitudes.allocate(fftSize / 2);
+        })
+    {
+    }
+
+    // From the audio thread to the worker.
+    TripleBuffer<Input> input;
+
+    // From the worker to the readers, who take turns as its consumer.
+    TripleBuffer<Analysis> analyses;
+    std::mutex readerLock;
+};
+
 inline uint32_t RoundNextPow2(uint32_t v)
 {
     v--;
@@ -43,26 +82,12 @@ inline uint32_t RoundNextPow2(uint32_t v)
     return v;
 }
     
-inline void ApplyBlackmanWindow(float * p, uint32_t n)
-{
-    // Blackman window
-    double alpha = 0.16;
-    double a0 = 0.5 * (1 - alpha);
-    double a1 = 0.5;
-    double a2 = 0.5 * alpha;
-    
-    for (uint32_t i = 0; i < n; ++i) 
-    {
-        double x = static_cast<double>(i) / static_cast<double>(n);
-        double window = a0 - a1 * cos(2 * piDouble * x) + a2 * cos(4 * piDouble * x);
-        p[i] *= float(window);
-    }
-
-}
-
 RealtimeAnalyser::RealtimeAnalyser(uint32_t fftSize)
     : m_inputBuffer(InputBufferSize)
     , m_writeIndex(0)
+    , m_framesSinceAnalysis(0)
+    , m_analysisHop(DefaultAnalysisHop)
+    , m_clearHistory(false)
     , m_smoothingTimeConstant(DefaultSmoothingTimeConstant)
     , m_minDecibels(DefaultMinDecibels)
     , m_maxDecibels(DefaultMaxDecibels)
@@ -70,22 +95,41 @@ RealtimeAnalyser::RealtimeAnalyser(uint32_t fftSize)
     uint32_t size = max(min(RoundNextPow2(fftSize), MaxFFTSize), MinFFTSize);
     m_fftSize = size;
     
-    m_analysisFrame = std::unique_ptr<FFTFrame>(new FFTFrame(size));
+    // The worker is handed whole frames, so the STFT only windows and transforms them; its hop is unused.
+    m_analysis.reset(new STFT(window_blackman, size, size));
     
-    // m_magnitudeBuffer has size = fftSize / 2 because it contains floats reduced from complex values in m_analysisFrame.
+    // m_magnitudeBuffer has size = fftSize / 2 because it contains floats reduced from complex values in the analysis frame.
     m_magnitudeBuffer.allocate(size / 2);
+
+    m_exchange.reset(new Exchange(size));
+
+    m_pool = SpectrumAnalysisPool::shared();
+    m_pool->add(this);
 }
 
 RealtimeAnalyser::~RealtimeAnalyser()
 {
+    m_pool->remove(this);
+}
 
+size_t RealtimeAnalyser::memoryBytes() const
+{
+    // The exchange triple buffers the input and the analyses, spectrum and all.
+    const size_t exchangeFrames = 3 * (m_fftSize + m_fftSize + m_fftSize / 2);
+    size_t bytes = (m_inputBuffer.size() + m_magnitudeBuffer.size() + exchangeFrames) * sizeof(float);
+    if (m_analysis)
+        bytes += m_analysis->memoryBytes();
+    return bytes;
 }
 
 void RealtimeAnalyser::reset()
 {
     m_writeIndex = 0;
     m_inputBuffer.zero();
-    m_magnitudeBuffer.zero();
+
+    // The worker owns the smoothed magnitudes, so it clears them itself, and the silence is published at once.
+    m_clearHistory = true;
+    m_framesSinceAnalysis = m_analysisHop;
 }
 
 void RealtimeAnalyser::writeInput(ContextRenderLock &r, AudioBus* bus, size_t framesToProcess)
@@ -121,18 +165,17 @@ void RealtimeAnalyser::writeInput(ContextRenderLock &r, AudioBus* bus, size_t fr
     m_writeIndex += framesToProcess;
     if (m_writeIndex >= InputBufferSize)
         m_writeIndex = 0;
-}
 
-void RealtimeAnalyser::doFFTAnalysis()
-{    
-    // Unroll the input buffer into a temporary buffer, where we'll apply an analysis window followed by an FFT.
+    // Every hop, the previous fftSize values of the input buffer are unrolled into the worker's input.
+    m_framesSinceAnalysis += framesToProcess;
+    if (m_framesSinceAnalysis < m_analysisHop)
+        return;
+    m_framesSinceAnalysis = 0;
+
     uint32_t fftSize = this->fftSize();
-    
-    AudioFloatArray temporaryBuffer(fftSize);
     float* inputBuffer = m_inputBuffer.data();
-    float* tempP = temporaryBuffer.data();
+    float* tempP = m_exchange->input.back().timeDomain.data();
 
-    // Take the previous fftSize values from the input buffer and copy into the temporary buffer.
     size_t writeIndex = m_writeIndex;
     if (writeIndex < fftSize) 
     {
@@ -144,14 +187,35 @@ void RealtimeAnalyser::doFFTAnalysis()
         memcpy(tempP, inputBuffer + writeIndex - fftSize, sizeof(*tempP) * fftSize);
     }
 
-    // Window the input samples.
-    ApplyBlackmanWindow(tempP, fftSize);
-    
-    // Do the analysis.
-    m_analysisFrame->doFFT(tempP);
+    m_exchange->input.publish();
+    m_pool->wake();
+}
 
-    float* realP = m_analysisFrame->realData();
-    float* imagP = m_analysisFrame->imagData();
+bool RealtimeAnalyser::analysePendingInput()
+{
+    if (!m_exchange->input.update())
+        return false;
+
+    if (m_clearHistory.exchange(false))
+        m_magnitudeBuffer.zero();
+
+    const AudioFloatArray & input = m_exchange->input.front().timeDomain;
+    doFFTAnalysis(input.data());
+
+    Exchange::Analysis & analysis = m_exchange->analyses.back();
+    memcpy(analysis.timeDomain.data(), input.data(), sizeof(float) * input.size());
+    memcpy(analysis.magnitudes.data(), m_magnitudeBuffer.data(), sizeof(float) * m_magnitudeBuffer.size());
+    m_exchange->analyses.publish();
+    return true;
+}
+
+void RealtimeAnalyser::doFFTAnalysis(const float * input)
+{    
+    // Window the input samples and do the analysis.
+    FFTFrame& frame = m_analysis->analyseFrame(input);
+
+    float* realP = frame.realData();
+    float* imagP = frame.imagData();
 
     // Blow away the packed nyquist component.
     imagP[0] = 0;
@@ -165,8 +229,8 @@ void RealtimeAnalyser::doFFTAnalysis()
     k = min(1.0, k);    
     
     // Convert the analysis data from complex to magnitude and average with the previous result.
-    float* destination = magnitudeBuffer().data();
-    size_t n = magnitudeBuffer().size();
+    float* destination = m_magnitudeBuffer.data();
+    size_t n = m_magnitudeBuffer.size();
     for (size_t i = 0; i < n; ++i) {
         std::complex<double> c(realP[i], imagP[i]);
         double scalarMagnitude = abs(c) * magnitudeScale;        
@@ -174,19 +238,21 @@ void RealtimeAnalyser::doFFTAnalysis()
     }
 }
 
-void RealtimeAnalyser::getFloatFrequencyData(std::vector<float>& destinationArray)
+void RealtimeAnalyser::getFloatFrequencyData(float* destinationArray, size_t destinationLength)
 {
-    if (!destinationArray.size())
+    if (!destinationLength)
         return;
-        
-    doFFTAnalysis();
+
+    std::lock_guard<std::mutex> lock(m_exchange->readerLock);
+    m_exchange->analyses.update();
+    const AudioFloatArray& magnitudes = m_exchange->analyses.front().magnitudes;
     
     // Convert from linear magnitude to floating-point decibels.
     const double minDecibels = m_minDecibels;
-    size_t sourceLength = magnitudeBuffer().size();
-    size_t len = min(sourceLength, destinationArray.size());
+    size_t sourceLength = magnitudes.size();
+    size_t len = min(sourceLength, destinationLength);
     if (len > 0) {
-        const float* source = magnitudeBuffer().data();
+        const float* source = magnitudes.data();
         for (size_t i = 0; i < len; ++i) {
             float linearValue = source[i];
             double dbMag = !linearValue ? minDecibels : AudioUtilities::linearToDecibels(linearValue);
@@ -195,21 +261,24 @@ void RealtimeAnalyser::getFloatFrequencyData(std::vector<float>& destinationArra
     }
 }
 
-void RealtimeAnalyser::getByteFrequencyData(std::vector<uint8_t>& destinationArray)
+void RealtimeAnalyser::getByteFrequencyData(uint8_t* destinationArray, size_t destinationLength)
 {
-    if (!destinationArray.size())
+    if (!destinationLength)
         return;
-        
-    doFFTAnalysis();
+
+    std::lock_guard<std::mutex> lock(m_exchange->readerLock);
+    m_exchange->analyses.update();
+    const AudioFloatArray& magnitudes = m_exchange->analyses.front().magnitudes;
     
     // Convert from linear magnitude to unsigned-byte decibels.
-    size_t sourceLength = magnitudeBuffer().size();
-    size_t len = min(sourceLength, destinationArray.size());
+    size_t sourceLength = magnitudes.size();
+    size_t len = min(sourceLength, destinationLength);
     if (len > 0) {
-        const double rangeScaleFactor = m_maxDecibels == m_minDecibels ? 1 : 1 / (m_maxDecibels - m_minDecibels);
         const double minDecibels = m_minDecibels;
+        const double maxDecibels = m_maxDecibels;
+        const double rangeScaleFactor = maxDecibels == minDecibels ? 1 : 1 / (maxDecibels - minDecibels);
 
-        const float* source = magnitudeBuffer().data();
+        const float* source = magnitudes.data();
         for (size_t i = 0; i < len; ++i) {
             float linearValue = source[i];
             double dbMag = !linearValue ? minDecibels : AudioUtilities::linearToDecibels(linearValue);
@@ -229,48 +298,34 @@ void RealtimeAnalyser::getByteFrequencyData(std::vector<uint8_t>& destinationArr
 }
 
 // LabSound begin
-void RealtimeAnalyser::getFloatTimeDomainData(std::vector<float>& destinationArray)
+void RealtimeAnalyser::getFloatTimeDomainData(float* destinationArray, size_t destinationLength)
 {
-    if (!destinationArray.size())
+    if (!destinationLength)
         return;
-    
-    size_t fftSize = this->fftSize();
-    size_t len = min(fftSize, destinationArray.size());
-    if (len > 0) {
-        bool isInputBufferGood = m_inputBuffer.size() == InputBufferSize && m_inputBuffer.size() > fftSize;
-        ASSERT(isInputBufferGood);
-        if (!isInputBufferGood)
-            return;
-        
-        float* inputBuffer = m_inputBuffer.data();
-        size_t writeIndex = m_writeIndex;
-        
-        for (size_t i = 0; i < len; ++i)
-            // Buffer access is protected due to modulo operation.
-            destinationArray[i] = inputBuffer[(i + writeIndex - fftSize + InputBufferSize) % InputBufferSize];
-    }
+
+    std::lock_guard<std::mutex> lock(m_exchange->readerLock);
+    m_exchange->analyses.update();
+    const AudioFloatArray& timeDomain = m_exchange->analyses.front().timeDomain;
+
+    size_t len = min(timeDomain.size(), destinationLength);
+    memcpy(destinationArray, timeDomain.data(), sizeof(float) * len);
 }
 // LabSound end
 
-void RealtimeAnalyser::getByteTimeDomainData(std::vector<uint8_t>& destinationArray)
+void RealtimeAnalyser::getByteTimeDomainData(uint8_t* destinationArray, size_t destinationLength)
 {
-    if (!destinationArray.size())
+    if (!destinationLength)
         return;
-        
-    size_t fftSize = this->fftSize();
-    size_t len = min(fftSize, destinationArray.size());
-    if (len > 0) {
-        bool isInputBufferGood = m_inputBuffer.size() == InputBufferSize && m_inputBuffer.size() > fftSize;
-        ASSERT(isInputBufferGood);
-        if (!isInputBufferGood)
-            return;
 
-        float* inputBuffer = m_inputBuffer.data();
-        size_t writeIndex = m_writeIndex;
+    std::lock_guard<std::mutex> lock(m_exchange->readerLock);
+    m_exchange->analyses.update();
+    const AudioFloatArray& timeDomain = m_exchange->analyses.front().timeDomain;
 
+    size_t len = min(timeDomain.size(), destinationLength);
+    if (len > 0) {
+        const float* source = timeDomain.data();
         for (size_t i = 0; i < len; ++i) {
-            // Buffer access is protected due to modulo operation.
-            float value = inputBuffer[(i + writeIndex - fftSize + InputBufferSize) % InputBufferSize];
+            float value = source[i];
 
             // Scale from nominal -1 -> +1 to unsigned byte.
             double scaledValue = 128 * (value + 1);
@@ -287,4 +342,3 @@ void RealtimeAnalyser::getByteTimeDomainData(std::vector<uint8_t>& destinationAr
 }
 
 } // namespace lab
-
@@ -8,16 +8,22 @@
 #include "LabSound/core/SampledAudioNode.h"
 
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
 #include "LabSound/core/Macros.h"
 #include "LabSound/extended/AudioContextLock.h"
+#include "LabSound/extended/CompactAudioBus.h"
+#include "LabSound/extended/MappedAudioFile.h"
 
 #include "internal/AudioUtilities.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
 using namespace std;
 
@@ -30,11 +36,71 @@ const double DefaultGrainDuration = 0.020; // 20ms
 // to minimize linear interpolation aliasing.
 const double MaxRate = 1024;
 
+const int SampledAudioNode::SincTaps;
+
+namespace {
+
+// The sinc kernels are tabulated at this many sub-sample offsets between two frames, and interpolated between.
+const int SincOffsets = 64;
+
+// The kernel's cutoff, as a fraction of the source's Nyquist frequency, leaves its transition band short of it.
+const double SincCutoff = 0.9;
+
+// Blackman windowed sinc kernels for the offsets from 0 to 1, SincTaps apiece, each normalized to unity gain
+// at DC. Tap SincTaps / 2 - 1 is the frame before the position interpolated.
+const float * sincKernels()
+{
+    static const std::vector<float> kernels = [] {
+        const int taps = SampledAudioNode::SincTaps;
+        const double pi = 3.14159265358979323846;
+        std::vector<float> table((SincOffsets + 1) * taps);
+        for (int o = 0; o <= SincOffsets; ++o)
+        {
+            double weights[SampledAudioNode::SincTaps];
+            double sum = 0;
+            for (int j = 0; j < taps; ++j)
+            {
+                double x = j - (taps / 2 - 1) - static_cast<double>(o) / SincOffsets;
+                double sinc = x == 0 ? 1 : std::sin(pi * SincCutoff * x) / (pi * SincCutoff * x);
+                double t = (x + taps / 2) / taps;
+                double window = 0.42 - 0.5 * std::cos(2 * pi * t) + 0.08 * std::cos(4 * pi * t);
+                weights[j] = sinc * window;
+                sum += weights[j];
+            }
+            for (int j = 0; j < taps; ++j)
+                table[o * taps + j] = static_cast<float>(weights[j] / sum);
+        }
+        return table;
+    }();
+    return kernels.data();
+}
+
+// taps holds SincTaps frames around the position, at fraction past tap SincTaps / 2 - 1.
+inline float sincInterpolate(const float * taps, double fraction)
+{
+    double offset = fraction * SincOffsets;
+    int o = std::min(static_cast<int>(offset), SincOffsets - 1);
+    const float * kernel = sincKernels() + o * SampledAudioNode::SincTaps;
+
+    float dot1, dot2;
+    VectorMath::vdotpr2(taps, kernel, kernel + SampledAudioNode::SincTaps, &dot1, &dot2, SampledAudioNode::SincTaps);
+    return dot1 + static_cast<float>(offset - o) * (dot2 - dot1);
+}
+
+// Catmull-Rom, through s1 and s2 at fraction past s1.
+inline float cubicInterpolate(float s0, float s1, float s2, float s3, float fraction)
+{
+    return s1 + 0.5f * fraction * (s2 - s0 + fraction * (2 * s0 - 5 * s1 + 4 * s2 - s3 + fraction * (3 * (s1 - s2) + s3 - s0)));
+}
+
+} // namespace
+
 SampledAudioNode::SampledAudioNode()
 : AudioScheduledSourceNode()
 , m_isLooping(std::make_shared<AudioSetting>("loop"))
 , m_loopStart(std::make_shared<AudioSetting>("loopStart"))
 , m_loopEnd(std::make_shared<AudioSetting>("loopEnd"))
+, m_interpolation(std::make_shared<AudioSetting>("interpolation"))
 , m_grainDuration(DefaultGrainDuration)
 {
     m_gain = make_shared<AudioParam>("gain", 1.0, 0.0, 1.0);
@@ -48,6 +114,7 @@ SampledAudioNode::SampledAudioNode()
     m_settings.push_back(m_isLooping);
     m_settings.push_back(m_loopStart);
     m_settings.push_back(m_loopEnd);
+    m_settings.push_back(m_interpolation);
 
     // Default to mono. A call to setBus() will set the number of output channels to that of the bus.
     addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
@@ -64,7 +131,7 @@ void SampledAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
 {
     AudioBus* outputBus = output(0)->bus(r);
 
-    if (!getBus() || !isInitialized() || ! r.context())
+    if (!hasSource() || !isInitialized() || ! r.context())
     {
         outputBus->zero();
         return;
@@ -73,7 +140,7 @@ void SampledAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
     // After calling setBuffer() with a buffer having a different number of channels, there can in rare cases be a slight delay
     // before the output bus is updated to the new number of channels because of use of tryLocks() in the context's updating system.
     // In this case, if the the buffer has just been changed and we're not quite ready yet, then just output silence.
-    if (numberOfChannels(r) != getBus()->numberOfChannels())
+    if (numberOfChannels(r) != sourceChannelCount())
     {
         outputBus->zero();
         return;
@@ -100,6 +167,7 @@ void SampledAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
 
         m_isGrain = true;
         m_startTime = m_requestWhen;
+        forgetElapsedEndTime(r);
 
         // We call timeToSampleFrame here since at playbackRate == 1 we don't want to go through linear interpolation
         // at a sub-sample position since it will degrade the quality.
@@ -108,17 +176,20 @@ void SampledAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
 
         /// @TODO consistently pick double or size_t through this entire API chain.
         m_virtualReadIndex = static_cast<double>(
-                                AudioUtilities::timeToSampleFrame(m_grainOffset, static_cast<double>(getBus()->sampleRate())));
+                                AudioUtilities::timeToSampleFrame(m_grainOffset, static_cast<double>(sourceSampleRate())));
         m_startRequested = false;
     }
 
     size_t quantumFrameOffset;
     size_t bufferFramesToProcess;
 
-    updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, bufferFramesToProcess);
+    if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, bufferFramesToProcess))
+        return;
 
-    if (!bufferFramesToProcess)
+    const bool virtualized = isVirtualized();
+    if (virtualized && m_presence == 0)
     {
+        renderFromBuffer(r, outputBus, quantumFrameOffset, bufferFramesToProcess, true);
         outputBus->zero();
         return;
     }
@@ -134,6 +205,24 @@ void SampledAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
     float totalGain = gain()->value(r);
     outputBus->copyWithGainFrom(*outputBus, &m_lastGain, totalGain);
     outputBus->clearSilentFlag();
+
+    // Fade linearly towards or away from virtualization; a fade reversed part way turns back from where it is.
+    if (virtualized || m_presence < 1)
+    {
+        const float step = 1.f / static_cast<float>(std::max<size_t>(1, r.context()->declickLength()));
+        float presence = m_presence;
+        for (size_t i = 0; i < outputBus->numberOfChannels(); ++i)
+        {
+            float * data = outputBus->channel(i)->mutableData();
+            presence = m_presence;
+            for (size_t f = 0; f < framesToProcess; ++f)
+            {
+                presence = virtualized ? std::max(0.f, presence - step) : std::min(1.f, presence + step);
+                data[f] *= presence;
+            }
+        }
+        m_presence = presence;
+    }
 }
 
 // Returns true if we're finished.
@@ -159,20 +248,22 @@ bool SampledAudioNode::renderSilenceAndFinishIfNotLooping(ContextRenderLock& r,
     return false;
 }
 
-bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, size_t destinationFrameOffset, size_t numberOfFrames)
+bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, size_t destinationFrameOffset, size_t numberOfFrames, bool skip)
 {
     if (!r.context())
         return false;
 
     auto srcBus = getBus();
+    auto srcFile = m_sourceFile;
+    auto srcCompact = m_sourceCompact;
 
-    if (!bus || !srcBus)
+    if (!bus || (!srcBus && !srcFile && !srcCompact))
         return false;
 
     size_t numChannels = numberOfChannels(r);
     size_t busNumberOfChannels = bus->numberOfChannels();
 
-    bool channelCountGood = numChannels && numChannels == busNumberOfChannels;
+    bool channelCountGood = numChannels && numChannels == busNumberOfChannels && (srcBus || m_destinations.size() >= numChannels);
     ASSERT(channelCountGood);
     if (!channelCountGood)
         return false;
@@ -193,8 +284,8 @@ bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, siz
     // Offset the pointers to the correct offset frame.
     size_t writeIndex = destinationFrameOffset;
 
-    size_t bufferLength = srcBus->length();
-    double bufferSampleRate = srcBus->sampleRate();
+    size_t bufferLength = sourceLength();
+    double bufferSampleRate = sourceSampleRate();
 
     // Avoid converting from time to sample-frames twice by computing
     // the grain end time first before computing the sample frame.
@@ -224,8 +315,8 @@ bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, siz
     if (loop() && (loopS || loopE) && loopS >= 0 && loopE > 0 && loopS < loopE)
     {
         // Convert from seconds to sample-frames.
-        double loopStartFrame = loopS * srcBus->sampleRate();
-        double loopEndFrame = loopE * srcBus->sampleRate();
+        double loopStartFrame = loopS * bufferSampleRate;
+        double loopEndFrame = loopE * bufferSampleRate;
 
         virtualEndFrame = std::min(loopEndFrame, virtualEndFrame);
         virtualDeltaFrames = virtualEndFrame - loopStartFrame;
@@ -241,9 +332,70 @@ bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, siz
     // Get local copy.
     double virtualReadIndex = m_virtualReadIndex;
 
-    // Render loop - reading from the source buffer to the destination using linear interpolation.
+    if (skip)
+    {
+        virtualReadIndex += pitchRate * numberOfFrames;
+        if (virtualReadIndex >= virtualEndFrame)
+        {
+            if (renderSilenceAndFinishIfNotLooping(r, bus, writeIndex, numberOfFrames))
+                return true;
+            virtualReadIndex = virtualEndFrame - virtualDeltaFrames + std::fmod(virtualReadIndex - virtualEndFrame, virtualDeltaFrames);
+        }
+        m_virtualReadIndex = virtualReadIndex;
+        return true;
+    }
+
+    // Render loop - reading from the source buffer to the destination, interpolating unless reading whole frames
+    // at the source's own rate.
     int framesToProcess = static_cast<int>(numberOfFrames);
 
+    const bool isLooping = loop();
+    const long length = static_cast<long>(bufferLength);
+
+    // The loop's crossfade stands in for its last frames, if it was made for the source and loop as they are.
+    const AudioBus * crossfade = nullptr;
+    long crossfadeStart = length;
+    long crossfadeEnd = length;
+    if (isLooping && m_loopCrossfade)
+    {
+        long end = std::min(length, static_cast<long>(std::ceil(virtualEndFrame)));
+        if (sourceIdentity() == m_crossfadeSource && end == m_crossfadeEnd && std::lround(virtualDeltaFrames) == m_crossfadeDelta)
+        {
+            crossfade = m_loopCrossfade.get();
+            crossfadeEnd = end;
+            crossfadeStart = end - static_cast<long>(crossfade->length());
+        }
+    }
+
+    // Frames read past the end of the loop are the loop's first, and frames outside the source are silent.
+    auto sourceFrame = [&](unsigned channel, long frame) -> float {
+        if (isLooping && frame >= virtualEndFrame)
+            frame = static_cast<long>(std::floor(frame - virtualDeltaFrames));
+        if (frame < 0 || frame >= length)
+            return 0.f;
+        if (frame >= crossfadeStart && frame < crossfadeEnd)
+            return crossfade->channel(channel)->data()[frame - crossfadeStart];
+        if (srcBus)
+            return srcBus->channel(channel)->data()[frame];
+        return srcFile ? srcFile->sample(channel, static_cast<size_t>(frame)) : m_compactReader.sample(channel, static_cast<size_t>(frame));
+    };
+
+    // A channel's frames from first on, where they are in memory, and how many follow before the region holding
+    // them ends: the crossfade, or the bus up to the crossfade, the loop's end, or its own. Null for any other
+    // frame, and for a mapped file's or compact bus's frames, which are converted as they are read.
+    const long contiguousEnd = std::min(crossfadeStart, isLooping ? std::min(length, static_cast<long>(virtualEndFrame)) : length);
+    auto contiguousFrames = [&](unsigned channel, long first, long & available) -> const float * {
+        if (first >= crossfadeStart && first < crossfadeEnd)
+        {
+            available = crossfadeEnd - first;
+            return crossfade->channel(channel)->data() + (first - crossfadeStart);
+        }
+        if (!srcBus || first < 0 || first >= contiguousEnd)
+            return nullptr;
+        available = contiguousEnd - first;
+        return srcBus->channel(channel)->data() + first;
+    };
+
     // Optimize for the very common case of playing back with pitchRate == 1.
     // We can avoid the linear interpolation.
     if (pitchRate == 1 && virtualReadIndex == floor(virtualReadIndex) && virtualDeltaFrames == floor(virtualDeltaFrames) && virtualEndFrame == floor(virtualEndFrame))
@@ -254,13 +406,35 @@ bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, siz
 
         while (framesToProcess > 0)
         {
-            int framesToEnd = static_cast<int>(endFrame) - readIndex;
-            int framesThisTime = std::min(framesToProcess, framesToEnd);
+            // Copied up to the crossfade, and then from it.
+            int regionEnd = readIndex < crossfadeStart ? static_cast<int>(std::min<long>(crossfadeStart, static_cast<long>(endFrame))) : static_cast<int>(endFrame);
+            int framesThisTime = std::min(framesToProcess, regionEnd - readIndex);
             framesThisTime = std::max(0, framesThisTime);
 
-            for (unsigned i = 0; i < numChannels; ++i)
+            if (crossfade && readIndex >= crossfadeStart)
+            {
+                for (unsigned i = 0; i < numChannels; ++i)
+                {
+                    memcpy(bus->channel(i)->mutableData() + writeIndex, crossfade->channel(i)->data() + (readIndex - crossfadeStart), sizeof(float) * framesThisTime);
+                }
+            }
+            else if (srcBus)
+            {
+                for (unsigned i = 0; i < numChannels; ++i)
+                {
+                    memcpy(bus->channel(i)->mutableData() + writeIndex, srcBus->channel(i)->data() + readIndex, sizeof(float) * framesThisTime);
+                }
+            }
+            else
             {
-                memcpy(bus->channel(i)->mutableData() + writeIndex, srcBus->channel(i)->data() + readIndex, sizeof(float) * framesThisTime);
+                // A mapped file's or a compact bus's samples are converted as they are played.
+                float ** destinations = m_destinations.data();
+                for (unsigned i = 0; i < numChannels; ++i)
+                    destinations[i] = bus->channel(i)->mutableData() + writeIndex;
+                if (srcFile)
+                    srcFile->read(readIndex, framesThisTime, destinations, static_cast<unsigned>(numChannels));
+                else
+                    m_compactReader.read(readIndex, framesThisTime, destinations, static_cast<unsigned>(numChannels));
             }
 
             writeIndex += framesThisTime;
@@ -277,48 +451,126 @@ bool SampledAudioNode::renderFromBuffer(ContextRenderLock& r, AudioBus* bus, siz
         }
         virtualReadIndex = readIndex;
     }
-    else
+    else if (interpolation() == LINEAR)
     {
-        while (framesToProcess--)
+        while (framesToProcess > 0)
         {
-            unsigned readIndex = static_cast<unsigned>(virtualReadIndex);
-            double interpolationFactor = virtualReadIndex - readIndex;
+            long readIndex = static_cast<long>(virtualReadIndex);
+            if (readIndex >= length)
+                break;
 
-            // For linear interpolation we need the next sample-frame too.
-            unsigned readIndex2 = readIndex + 1;
+            // A span of frames whose pairs all lie within one region in memory, short of the loop's end, is
+            // interpolated without checks. The span stops a frame short, for rounding in the position's sum.
+            long available = 0;
+            int span = 0;
+            if (contiguousFrames(0, readIndex, available) && available >= 2)
+            {
+                double limit = std::min(static_cast<double>(readIndex + available - 1), virtualEndFrame);
+                span = static_cast<int>(std::min<double>(framesToProcess, std::ceil((limit - virtualReadIndex) / pitchRate) - 1));
+            }
 
-            if (readIndex2 >= bufferLength)
+            if (span > 0)
             {
-                if (loop()) {
-                    // Make sure to wrap around at the end of the buffer.
-                    readIndex2 = static_cast<unsigned>(virtualReadIndex + 1 - virtualDeltaFrames);
-                } else
-                    readIndex2 = readIndex;
+                double position = virtualReadIndex;
+                for (unsigned i = 0; i < numChannels; ++i)
+                {
+                    const float * source = contiguousFrames(i, readIndex, available);
+                    float * destination = bus->channel(i)->mutableData() + writeIndex;
+                    position = virtualReadIndex;
+                    for (int k = 0; k < span; ++k)
+                    {
+                        long index = static_cast<long>(position);
+                        float fraction = static_cast<float>(position - index);
+                        const float * pair = source + (index - readIndex);
+                        destination[k] = pair[0] + fraction * (pair[1] - pair[0]);
+                        position += pitchRate;
+                    }
+                }
+                virtualReadIndex = position;
+                writeIndex += span;
+                framesToProcess -= span;
             }
+            else
+            {
+                // A frame at a region's edge, checked. For linear interpolation we need the next sample-frame too,
+                // which past the end of the source is the frame itself.
+                double interpolationFactor = virtualReadIndex - readIndex;
+                long readIndex2 = readIndex + 1;
+                if (!isLooping && readIndex2 >= length)
+                    readIndex2 = readIndex;
 
-            // Final sanity check on buffer access.
-            // FIXME: as an optimization, try to get rid of this inner-loop check and put assertions and guards before the loop.
-            if (readIndex >= bufferLength || readIndex2 >= bufferLength)
-                break;
+                for (unsigned i = 0; i < numChannels; ++i)
+                {
+                    double sample1 = sourceFrame(i, readIndex);
+                    double sample2 = sourceFrame(i, readIndex2);
+                    double sample = (1.0 - interpolationFactor) * sample1 + interpolationFactor * sample2;
+                    bus->channel(i)->mutableData()[writeIndex] = static_cast<float>(sample);
+                }
+                writeIndex++;
+                framesToProcess--;
+
+                virtualReadIndex += pitchRate;
+            }
 
-            // Linear interpolation.
-            for (unsigned i = 0; i < numChannels; ++i)
+            // Wrap-around, retaining sub-sample position since virtualReadIndex is floating-point.
+            if (virtualReadIndex >= virtualEndFrame)
             {
-                float * destination = bus->channel(i)->mutableData();
-                const float * source = srcBus->channel(i)->data();
+                virtualReadIndex -= virtualDeltaFrames;
+                if (renderSilenceAndFinishIfNotLooping(r, bus, writeIndex, static_cast<size_t>(framesToProcess)))
+                    break;
+            }
+        }
+    }
+    else
+    {
+        const bool isCubic = interpolation() == CUBIC;
 
-                double sample1 = source[readIndex];
-                double sample2 = source[readIndex2];
-                double sample = (1.0 - interpolationFactor) * sample1 + interpolationFactor * sample2;
+        float window[SincTaps];
+        bool finished = false;
+        while (framesToProcess > 0 && !finished)
+        {
+            // The frames before the loop's end need no wrap.
+            int span = static_cast<int>(std::min<double>(framesToProcess, std::max(1.0, std::ceil((virtualEndFrame - virtualReadIndex) / pitchRate))));
+            for (int k = 0; k < span; ++k)
+            {
+                long readIndex = static_cast<long>(virtualReadIndex);
+                double fraction = virtualReadIndex - readIndex;
 
-                destination[writeIndex] = static_cast<float>(sample);
+                if (readIndex >= length)
+                {
+                    finished = true;
+                    break;
+                }
+
+                for (unsigned i = 0; i < numChannels; ++i)
+                {
+                    float * destination = bus->channel(i)->mutableData() + writeIndex;
+                    if (isCubic)
+                    {
+                        *destination = cubicInterpolate(sourceFrame(i, readIndex - 1), sourceFrame(i, readIndex),
+                            sourceFrame(i, readIndex + 1), sourceFrame(i, readIndex + 2), static_cast<float>(fraction));
+                        continue;
+                    }
+
+                    // Windows of frames within one region are read in place.
+                    const long first = readIndex - (SincTaps / 2 - 1);
+                    long available = 0;
+                    const float * taps = contiguousFrames(i, first, available);
+                    if (!taps || available < SincTaps)
+                    {
+                        taps = window;
+                        for (int t = 0; t < SincTaps; ++t)
+                            window[t] = sourceFrame(i, first + t);
+                    }
+                    *destination = sincInterpolate(taps, fraction);
+                }
+                writeIndex++;
+                framesToProcess--;
+
+                virtualReadIndex += pitchRate;
             }
-            writeIndex++;
 
-            virtualReadIndex += pitchRate;
-
-            // Wrap-around, retaining sub-sample position since virtualReadIndex is floating-point.
-            if (virtualReadIndex >= virtualEndFrame)
+            if (!finished && virtualReadIndex >= virtualEndFrame)
             {
                 virtualReadIndex -= virtualDeltaFrames;
                 if (renderSilenceAndFinishIfNotLooping(r, bus, writeIndex, static_cast<size_t>(framesToProcess)))
@@ -339,9 +591,22 @@ void SampledAudioNode::reset(ContextRenderLock& r)
 {
     m_virtualReadIndex = 0;
     m_lastGain = gain()->value(r);
+    m_presence = isVirtualized() ? 0.f : 1.f;
     AudioScheduledSourceNode::reset(r);
 }
 
+void SampledAudioNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+{
+    AudioScheduledSourceNode::reportMemory(r, usage);
+
+    // A mapped file's pages belong to the file, and aren't counted.
+    if (m_sourceBus)
+        usage.addShared(AudioMemoryCategory::Samples, m_sourceBus, m_sourceBus->memoryBytes());
+    if (m_sourceCompact)
+        usage.addShared(AudioMemoryCategory::Samples, m_sourceCompact, m_sourceCompact->bytes());
+    usage.addBus(m_loopCrossfade.get(), AudioMemoryCategory::Samples);
+}
+
 bool SampledAudioNode::setBus(ContextRenderLock & r, std::shared_ptr<AudioBus> buffer)
 {
     ASSERT(r.context());
@@ -351,7 +616,7 @@ bool SampledAudioNode::setBus(ContextRenderLock & r, std::shared_ptr<AudioBus> b
         // Do any necesssary re-configuration to the buffer's number of channels.
         size_t numberOfChannels = buffer->numberOfChannels();
 
-        if (numberOfChannels > AudioContext::maxNumberOfChannels)
+        if (numberOfChannels > r.context()->channelLimit())
             return false;
 
         output(0)->setNumberOfChannels(r, numberOfChannels);
@@ -359,9 +624,155 @@ bool SampledAudioNode::setBus(ContextRenderLock & r, std::shared_ptr<AudioBus> b
 
     m_virtualReadIndex = 0;
     m_sourceBus = buffer;
+    m_sourceFile.reset();
+    m_sourceCompact.reset();
+    m_compactReader.setBus(nullptr);
+    m_loopCrossfade.reset();
+    return true;
+}
+
+bool SampledAudioNode::setMappedFile(ContextRenderLock & r, std::shared_ptr<MappedAudioFile> file)
+{
+    ASSERT(r.context());
+
+    if (file)
+    {
+        if (file->numberOfChannels() > r.context()->channelLimit())
+            return false;
+
+        output(0)->setNumberOfChannels(r, file->numberOfChannels());
+        m_destinations.resize(file->numberOfChannels());
+    }
+
+    m_virtualReadIndex = 0;
+    m_sourceBus.reset();
+    m_sourceFile = file;
+    m_sourceCompact.reset();
+    m_compactReader.setBus(nullptr);
+    m_loopCrossfade.reset();
+    return true;
+}
+
+bool SampledAudioNode::setCompactBus(ContextRenderLock & r, std::shared_ptr<CompactAudioBus> compact)
+{
+    ASSERT(r.context());
+
+    if (compact)
+    {
+        if (compact->numberOfChannels() > r.context()->channelLimit())
+            return false;
+
+        output(0)->setNumberOfChannels(r, compact->numberOfChannels());
+        m_destinations.resize(compact->numberOfChannels());
+    }
+
+    m_virtualReadIndex = 0;
+    m_sourceBus.reset();
+    m_sourceFile.reset();
+    m_sourceCompact = compact;
+    m_compactReader.setBus(compact.get());
+    m_loopCrossfade.reset();
+    return true;
+}
+
+bool SampledAudioNode::setLoopCrossfade(ContextRenderLock & r, double seconds)
+{
+    ASSERT(r.context());
+
+    m_loopCrossfade.reset();
+    m_crossfadeSource = nullptr;
+
+    double loopS = loopStart();
+    double loopE = loopEnd();
+    if (seconds <= 0 || !hasSource() || !(loopS >= 0 && loopE > 0 && loopS < loopE))
+        return false;
+
+    // The loop's end and length in frames, as renderFromBuffer finds them.
+    const double sampleRate = sourceSampleRate();
+    const long length = static_cast<long>(sourceLength());
+    const double virtualEndFrame = std::min(loopE * sampleRate, static_cast<double>(length));
+    const long end = std::min(length, static_cast<long>(std::ceil(virtualEndFrame)));
+    const long delta = std::lround(virtualEndFrame - loopS * sampleRate);
+
+    // The loop's last frames fade into those a loop's length before them, which lead up to its start.
+    const long frames = std::min(std::min(static_cast<long>(seconds * sampleRate), end - delta), delta);
+    if (frames < 2)
+        return false;
+
+    const unsigned channels = static_cast<unsigned>(sourceChannelCount());
+    std::unique_ptr<AudioBus> crossfade(new AudioBus(channels, static_cast<size_t>(frames)));
+    AudioBus preroll(channels, static_cast<size_t>(frames));
+    auto read = [&](long first, AudioBus & destination) {
+        std::vector<float *> destinations(channels);
+        for (unsigned i = 0; i < channels; ++i)
+            destinations[i] = destination.channel(i)->mutableData();
+        if (m_sourceBus)
+        {
+            for (unsigned i = 0; i < channels; ++i)
+                memcpy(destinations[i], m_sourceBus->channel(i)->data() + first, sizeof(float) * frames);
+        }
+        else if (m_sourceFile)
+            m_sourceFile->read(static_cast<size_t>(first), static_cast<size_t>(frames), destinations.data(), channels);
+        else
+            m_sourceCompact->read(static_cast<size_t>(first), static_cast<size_t>(frames), destinations.data(), channels);
+    };
+    read(end - frames, *crossfade);
+    read(end - frames - delta, preroll);
+
+    // Ending on the frame before the loop's start, which follows it.
+    const double halfPi = 1.57079632679489661923;
+    for (unsigned i = 0; i < channels; ++i)
+    {
+        float * out = crossfade->channel(i)->mutableData();
+        const float * in = preroll.channel(i)->data();
+        for (long k = 0; k < frames; ++k)
+        {
+            double t = static_cast<double>(k + 1) / frames;
+            out[k] = static_cast<float>(out[k] * std::cos(t * halfPi) + in[k] * std::sin(t * halfPi));
+        }
+    }
+    crossfade->setSampleRate(static_cast<float>(sampleRate));
+
+    m_loopCrossfade = std::move(crossfade);
+    m_crossfadeSource = sourceIdentity();
+    m_crossfadeEnd = end;
+    m_crossfadeDelta = delta;
     return true;
 }
 
+bool SampledAudioNode::hasSource() const
+{
+    return m_sourceBus || m_sourceFile || m_sourceCompact;
+}
+
+const void * SampledAudioNode::sourceIdentity() const
+{
+    if (m_sourceBus)
+        return m_sourceBus.get();
+    return m_sourceFile ? static_cast<const void *>(m_sourceFile.get()) : static_cast<const void *>(m_sourceCompact.get());
+}
+
+size_t SampledAudioNode::sourceChannelCount() const
+{
+    if (m_sourceBus)
+        return m_sourceBus->numberOfChannels();
+    return m_sourceFile ? m_sourceFile->numberOfChannels() : m_sourceCompact ? m_sourceCompact->numberOfChannels() : 0;
+}
+
+size_t SampledAudioNode::sourceLength() const
+{
+    if (m_sourceBus)
+        return m_sourceBus->length();
+    return m_sourceFile ? m_sourceFile->length() : m_sourceCompact ? m_sourceCompact->length() : 0;
+}
+
+float SampledAudioNode::sourceSampleRate() const
+{
+    if (m_sourceBus)
+        return m_sourceBus->sampleRate();
+    return m_sourceFile ? m_sourceFile->sampleRate() : m_sourceCompact ? m_sourceCompact->sampleRate() : 0;
+}
+
 size_t SampledAudioNode::numberOfChannels(ContextRenderLock& r)
 {
     return output(0)->numberOfChannels();
@@ -375,7 +786,7 @@ void SampledAudioNode::startGrain(double when, double grainOffset)
 
 void SampledAudioNode::startGrain(double when, double grainOffset, double grainDuration)
 {
-    if (!getBus())
+    if (!hasSource())
         return;
 
     m_requestWhen = when;
@@ -388,11 +799,10 @@ void SampledAudioNode::startGrain(double when, double grainOffset, double grainD
 
 float SampledAudioNode::duration() const
 {
-    auto bus = getBus();
-    if (!bus)
+    if (!hasSource())
         return 0;
 
-    return bus->length() / bus->sampleRate();
+    return sourceLength() / sourceSampleRate();
 }
 
 double SampledAudioNode::totalPitchRate(ContextRenderLock & r)
@@ -404,8 +814,8 @@ double SampledAudioNode::totalPitchRate(ContextRenderLock & r)
     // Incorporate buffer's sample-rate versus AudioContext's sample-rate.
     // Normally it's not an issue because buffers are loaded at the AudioContext's sample-rate, but we can handle it in any case.
     double sampleRateFactor = 1.0;
-    if (getBus())
-        sampleRateFactor = getBus()->sampleRate() / r.context()->sampleRate();
+    if (hasSource())
+        sampleRateFactor = sourceSampleRate() / r.context()->sampleRate();
 
     double basePitchRate = playbackRate()->value(r);
 
@@ -428,7 +838,7 @@ double SampledAudioNode::totalPitchRate(ContextRenderLock & r)
 
 bool SampledAudioNode::propagatesSilence(ContextRenderLock & r) const
 {
-    return !isPlayingOrScheduled() || hasFinished() || !m_sourceBus;
+    return !isPlayingOrScheduled() || hasFinished() || !hasSource();
 }
 
 void SampledAudioNode::setPannerNode(PannerNode* pannerNode)
@@ -468,6 +878,17 @@ void SampledAudioNode::setLoopEnd(double loopEnd)
     m_loopEnd->setFloat(static_cast<float>(loopEnd));
 }
 
+SampledAudioNode::InterpolationMode SampledAudioNode::interpolation() const
+{
+    return InterpolationMode(m_interpolation->valueUint32());
+}
+
+void SampledAudioNode::setInterpolation(InterpolationMode mode)
+{
+    ASSERT(mode <= SINC);
+    m_interpolation->setUint32(uint32_t(std::min(mode, SINC)));
+}
+
 
 } // namespace lab
 
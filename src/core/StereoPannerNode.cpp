@@ -16,6 +16,9 @@
 #include "internal/Panner.h"
 #include "internal/AudioUtilities.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <cmath>
 
 
 namespace lab
@@ -35,7 +38,7 @@ public:
     Spatializer(const float sampleRate, PanningModel model)
     {
         // Convert smoothing time (50ms) to a per-sample time value.
-        m_smoothingConstant = AudioUtilities::discreteTimeConstantForSampleRate(SmoothingTimeConstant, sampleRate);
+        m_smoothingConstant = static_cast<float>(AudioUtilities::discreteTimeConstantForSampleRate(SmoothingTimeConstant, sampleRate));
     }
 
     virtual ~Spatializer()
@@ -46,179 +49,108 @@ public:
     // Handle sample-accurate panning by AudioParam automation.
     virtual void panWithSampleAccurateValues(const AudioBus* inputBus, AudioBus* outputBus, const float* panValues, size_t framesToProcess)
     {
-        size_t numberOfInputChannels = inputBus->numberOfChannels();
-
-        bool isInputSafe = inputBus && (inputBus->numberOfChannels() == Channels::Mono || inputBus->numberOfChannels() == Channels::Stereo) && framesToProcess <= inputBus->length();
-
-        ASSERT(isInputSafe);
-
-        if (!isInputSafe)
+        const float* sourceL;
+        const float* sourceR;
+        float* destinationL;
+        float* destinationR;
+        if (!channels(inputBus, outputBus, framesToProcess, sourceL, sourceR, destinationL, destinationR))
             return;
 
-        bool isOutputSafe = outputBus && outputBus->numberOfChannels() == Channels::Stereo && framesToProcess <= outputBus->length();
-
-        ASSERT(isOutputSafe);
-
-        if (!isOutputSafe)
-            return;
-
-        const float* sourceL = inputBus->channel(0)->data();
-        const float* sourceR = numberOfInputChannels > Channels::Mono ? inputBus->channel(1)->data() : sourceL;
-
-        float* destinationL = outputBus->channelByType(Channel::Left)->mutableData();
-        float* destinationR = outputBus->channelByType(Channel::Right)->mutableData();
+        if (m_gainL.size() < framesToProcess)
+        {
+            m_gainL.allocate(framesToProcess);
+            m_gainR.allocate(framesToProcess);
+        }
+        float* gainL = m_gainL.data();
+        float* gainR = m_gainR.data();
 
-        if (!sourceL || !sourceR || !destinationL || !destinationR)
-            return;
+        // The pan positions are gathered in the left gains, and replaced by the gains of the pan law.
+        const bool isMono = inputBus->numberOfChannels() == Channels::Mono;
+        for (size_t i = 0; i < framesToProcess; ++i)
+        {
+            const float pan = clampTo(panValues[i], -1.f, 1.f);
 
-        double gainL, gainR, panRadian;
-        size_t n = framesToProcess;
+            // Pan from left to right [-1; 1] will be normalized as [0; 1] for a mono source. For a stereo source,
+            // [-1; 0] is normalized to [0; 1], and [0; 1] is left as it is.
+            gainL[i] = isMono ? pan * 0.5f + 0.5f : (pan <= 0 ? pan + 1 : pan);
+        }
+        VectorMath::vpangains(gainL, gainL, gainR, framesToProcess);
 
-        // For mono source case.
-        if (numberOfInputChannels == Channels::Mono)
+        if (isMono)
         {
-            while (n--)
+            for (size_t i = 0; i < framesToProcess; ++i)
             {
-                float inputL = *sourceL++;
-
-                m_pan = clampTo(*panValues++, -1.0, 1.0);
-
-                // Pan from left to right [-1; 1] will be normalized as [0; 1].
-                panRadian = (m_pan * 0.5 + 0.5) * piOverTwoDouble;
-
-                gainL = std::cos(panRadian);
-                gainR = std::sin(panRadian);
-
-                *destinationL++ = static_cast<float>(inputL * gainL);
-                *destinationR++ = static_cast<float>(inputL * gainR);
+                const float input = sourceL[i];
+                destinationL[i] = input * gainL[i];
+                destinationR[i] = input * gainR[i];
             }
         }
-        // For stereo source case.
         else
         {
-            while (n--)
+            // When [-1; 0], keep left channel intact and equal-power pan the right channel only, and the reverse
+            // when [0; 1]. The pan value is checked every sample. See crbug.com/470559.
+            for (size_t i = 0; i < framesToProcess; ++i)
             {
-                float inputL = *sourceL++;
-                float inputR = *sourceR++;
-
-                m_pan = clampTo(*panValues++, -1.0, 1.0);
-
-                // Normalize [-1; 0] to [0; 1]. Do nothing when [0; 1].
-                panRadian = (m_pan <= 0 ? m_pan + 1 : m_pan) * piOverTwoDouble;
-
-                gainL = std::cos(panRadian);
-                gainR = std::sin(panRadian);
-
-                if (m_pan <= 0)
-                {
-                    *destinationL++ = static_cast<float>(inputL + inputR * gainL);
-                    *destinationR++ = static_cast<float>(inputR * gainR);
-                }
-                else
-                {
-                    *destinationL++ = static_cast<float>(inputL * gainL);
-                    *destinationR++ = static_cast<float>(inputR + inputL * gainR);
-                }
+                const float inputL = sourceL[i];
+                const float inputR = sourceR[i];
+                const bool keepLeft = panValues[i] <= 0;
+                destinationL[i] = keepLeft ? inputL + inputR * gainL[i] : inputL * gainL[i];
+                destinationR[i] = keepLeft ? inputR * gainR[i] : inputR + inputL * gainR[i];
             }
         }
 
+        m_pan = clampTo(panValues[framesToProcess - 1], -1.f, 1.f);
     }
 
     // Handle de-zippered panning to a target value.
     virtual void panToTargetValue(const AudioBus* inputBus, AudioBus* outputBus, float panValue, size_t framesToProcess)
     {
-        size_t numberOfInputChannels = inputBus->numberOfChannels();
-
-        bool isInputSafe = inputBus && (inputBus->numberOfChannels() == Channels::Mono || inputBus->numberOfChannels() == Channels::Stereo) && framesToProcess <= inputBus->length();
-
-        ASSERT(isInputSafe);
-
-        if (!isInputSafe)
-            return;
-
-        bool isOutputSafe = outputBus && outputBus->numberOfChannels() == Channels::Stereo && framesToProcess <= outputBus->length();
-
-        ASSERT(isOutputSafe);
-
-        if (!isOutputSafe)
-            return;
-
-        const float* sourceL = inputBus->channel(0)->data();
-        const float* sourceR = numberOfInputChannels > Channels::Mono ? inputBus->channel(1)->data() : sourceL;
-
-        float* destinationL = outputBus->channelByType(Channel::Left)->mutableData();
-        float* destinationR = outputBus->channelByType(Channel::Right)->mutableData();
-
-        if (!sourceL || !sourceR || !destinationL || !destinationR)
+        const float* sourceL;
+        const float* sourceR;
+        float* destinationL;
+        float* destinationR;
+        if (!channels(inputBus, outputBus, framesToProcess, sourceL, sourceR, destinationL, destinationR))
             return;
 
         float targetPan = clampTo(panValue, -1.f, 1.f);
 
-        // Don't de-zipper on first render call.
-        if (m_isFirstRender)
+        // Don't de-zipper on first render call, nor once the pan is close enough to be heard as there.
+        if (m_isFirstRender || std::fabs(targetPan - m_pan) < SnapThreshold)
         {
             m_isFirstRender = false;
             m_pan = targetPan;
         }
 
-        double gainL, gainR, panRadian;
-        const double smoothingConstant = m_smoothingConstant;
-        size_t n = framesToProcess;
-
-        // For mono source case.
-        if (numberOfInputChannels == Channels::Mono)
+        if (m_pan != targetPan)
         {
-            while (n--)
-            {
-                float inputL = *sourceL++;
-
-                m_pan += (targetPan - m_pan) * smoothingConstant;
-
-                // Pan from left to right [-1; 1] will be normalized as [0; 1].
-                panRadian = (m_pan * 0.5 + 0.5) * piOverTwoDouble;
-
-                gainL = std::cos(panRadian);
-                gainR = std::sin(panRadian);
+            if (m_panValues.size() < framesToProcess)
+                m_panValues.allocate(framesToProcess);
+            VectorMath::vsmooth(&m_pan, &targetPan, &m_smoothingConstant, m_panValues.data(), framesToProcess);
+            panWithSampleAccurateValues(inputBus, outputBus, m_panValues.data(), framesToProcess);
+            return;
+        }
 
-                *destinationL++ = static_cast<float>(inputL * gainL);
-                *destinationR++ = static_cast<float>(inputL * gainR);
-            }
+        // The pan is constant over the quantum, so the gains are too, and the sources are read once for both outputs.
+        const bool isMono = inputBus->numberOfChannels() == Channels::Mono;
+        const float position = isMono ? m_pan * 0.5f + 0.5f : (m_pan <= 0 ? m_pan + 1 : m_pan);
+        float gainL, gainR;
+        VectorMath::vpangains(&position, &gainL, &gainR, 1);
 
+        const float* sources[2] = { sourceL, sourceR };
+        float* destinations[2] = { destinationL, destinationR };
+        if (isMono)
+        {
+            const float gains[2][1] = { { gainL }, { gainR } };
+            const float* gainPointers[2] = { gains[0], gains[1] };
+            VectorMath::vmix(sources, 1, gainPointers, destinations, 2, false, framesToProcess);
         }
-        // For stereo source case.
         else
         {
-            while (n--) {
-                float inputL = *sourceL++;
-                float inputR = *sourceR++;
-
-                m_pan += (targetPan - m_pan) * smoothingConstant;
-
-                // Normalize [-1; 0] to [0; 1] for the left pan position (<= 0), and
-                // do nothing when [0; 1].
-
-                panRadian = (m_pan <= 0 ? m_pan + 1 : m_pan) * piOverTwoDouble;
-
-                gainL = std::cos(panRadian);
-                gainR = std::sin(panRadian);
-
-                // The pan value should be checked every sample when de-zippering.
-                // See crbug.com/470559.
-                if (m_pan <= 0)
-                {
-                    // When [-1; 0], keep left channel intact and equal-power pan the
-                    // right channel only.
-                    *destinationL++ = static_cast<float>(inputL + inputR * gainL);
-                    *destinationR++ = static_cast<float>(inputR * gainR);
-                }
-                else
-                {
-                    // When [0; 1], keep right channel intact and equal-power pan the
-                    // left channel only.
-                    *destinationL++ = static_cast<float>(inputL * gainL);
-                    *destinationR++ = static_cast<float>(inputR + inputL * gainR);
-                }
-            }
+            const bool keepLeft = m_pan <= 0;
+            const float gains[2][2] = { { keepLeft ? 1.f : gainL, keepLeft ? gainL : 0.f },
+                                        { keepLeft ? 0.f : gainR, keepLeft ? gainR : 1.f } };
+            const float* gainPointers[2] = { gains[0], gains[1] };
+            VectorMath::vmix(sources, 2, gainPointers, destinations, 2, false, framesToProcess);
         }
     }
 
@@ -232,14 +164,48 @@ public:
 
 private:
 
+    bool channels(const AudioBus* inputBus, AudioBus* outputBus, size_t framesToProcess,
+                  const float*& sourceL, const float*& sourceR, float*& destinationL, float*& destinationR) const
+    {
+        bool isInputSafe = inputBus && (inputBus->numberOfChannels() == Channels::Mono || inputBus->numberOfChannels() == Channels::Stereo) && framesToProcess <= inputBus->length();
+
+        ASSERT(isInputSafe);
+
+        if (!isInputSafe)
+            return false;
+
+        bool isOutputSafe = outputBus && outputBus->numberOfChannels() == Channels::Stereo && framesToProcess <= outputBus->length();
+
+        ASSERT(isOutputSafe);
+
+        if (!isOutputSafe || !framesToProcess)
+            return false;
+
+        sourceL = inputBus->channel(0)->data();
+        sourceR = inputBus->numberOfChannels() > Channels::Mono ? inputBus->channel(1)->data() : sourceL;
+
+        destinationL = outputBus->channelByType(Channel::Left)->mutableData();
+        destinationR = outputBus->channelByType(Channel::Right)->mutableData();
+
+        return sourceL && sourceR && destinationL && destinationR;
+    }
+
     bool m_isFirstRender = true;
-    double m_pan = 0.0;
+    float m_pan = 0.f;
 
-    double m_smoothingConstant;
+    float m_smoothingConstant;
+
+    // Scratch for a quantum: the pan gains, and the de-zippered pan values.
+    AudioFloatArray m_gainL;
+    AudioFloatArray m_gainR;
+    AudioFloatArray m_panValues;
 
     // Use a 50ms smoothing / de-zippering time-constant.
     const float SmoothingTimeConstant = 0.050f;
 
+    // A pan this close to its target is snapped to it; the gains then differ by less than 1e-5.
+    const float SnapThreshold = 1e-5f;
+
 };
 
 using namespace std;
@@ -285,7 +251,9 @@ void StereoPannerNode::process(ContextRenderLock& r, size_t framesToProcess)
     if (m_pan->hasSampleAccurateValues())
     {
         // Apply sample-accurate panning specified by AudioParam automation.
-        ASSERT(framesToProcess <= m_sampleAccuratePanValues->size());
+        // The scratch buffer grows once if the context renders larger quanta than the default.
+        if (framesToProcess > m_sampleAccuratePanValues->size())
+            m_sampleAccuratePanValues->allocate(framesToProcess);
 
         if (framesToProcess <= m_sampleAccuratePanValues->size())
         {
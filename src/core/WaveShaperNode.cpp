@@ -3,14 +3,31 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/WaveShaperNode.h"
+#include "LabSound/core/AudioSetting.h"
 #include "internal/WaveShaperProcessor.h"
 
+#include <stdexcept>
+
 namespace lab
 {
 
 WaveShaperNode::WaveShaperNode()
+    : m_oversample(std::make_shared<AudioSetting>("oversample"))
 {
     m_processor.reset(new WaveShaperProcessor(1));
+
+    m_oversample->setValueChanged(
+        [this]()
+        {
+            uint32_t type = m_oversample->valueUint32();
+            if (type > static_cast<uint32_t>(OverSampleType::OVERSAMPLE_4X))
+                throw std::out_of_range("Oversample type exceeds index of known types");
+
+            waveShaperProcessor()->setOversample(static_cast<OverSampleType>(type));
+        }
+    );
+    m_settings.push_back(m_oversample);
+
     initialize();
 }
 
@@ -19,6 +36,16 @@ void WaveShaperNode::setCurve(std::vector<float> && curve)
     waveShaperProcessor()->setCurve(std::move(curve));
 }
 
+OverSampleType WaveShaperNode::oversample() const
+{
+    return static_cast<OverSampleType>(m_oversample->valueUint32());
+}
+
+void WaveShaperNode::setOversample(OverSampleType type)
+{
+    m_oversample->setUint32(static_cast<uint32_t>(type));
+}
+
 #if 0
 std::vector<float> & WaveShaperNode::curve()
 {
@@ -12,8 +12,14 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
 
 // The number of bands per octave.  Each octave will have this many entries in the wave tables.
 const unsigned kNumberOfOctaveBands = 3;
@@ -29,6 +35,91 @@ namespace lab
     
 using namespace VectorMath;
 
+namespace
+{
+    struct CustomWaveTable
+    {
+        std::vector<float> real;
+        std::vector<float> imag;
+        std::weak_ptr<WaveTable> table;
+    };
+
+    std::mutex & waveTableLock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    // FNV-1a over the bits of the coefficients.
+    uint64_t hashCoefficients(const std::vector<float> & real, const std::vector<float> & imag)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (const std::vector<float> * coefficients : { &real, &imag })
+        {
+            for (float c : *coefficients)
+            {
+                uint32_t bits;
+                memcpy(&bits, &c, sizeof(bits));
+                hash = (hash ^ bits) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+}
+
+std::shared_ptr<WaveTable> WaveTable::shared(const float sampleRate, OscillatorType basicWaveform)
+{
+    static std::map<std::pair<float, OscillatorType>, std::shared_ptr<WaveTable>> tables;
+
+    if (basicWaveform < OscillatorType::SINE || basicWaveform > OscillatorType::TRIANGLE)
+        throw std::invalid_argument("Shared wave tables are for the basic waveforms, or from coefficients");
+
+    std::lock_guard<std::mutex> guard(waveTableLock());
+    std::shared_ptr<WaveTable> & table = tables[std::make_pair(sampleRate, basicWaveform)];
+    if (!table)
+        table = std::make_shared<WaveTable>(sampleRate, basicWaveform);
+    return table;
+}
+
+std::shared_ptr<WaveTable> WaveTable::shared(const float sampleRate, const std::vector<float> & real, const std::vector<float> & imag)
+{
+    static std::map<std::pair<float, uint64_t>, std::vector<CustomWaveTable>> tables;
+
+    const auto key = std::make_pair(sampleRate, hashCoefficients(real, imag));
+
+    std::lock_guard<std::mutex> guard(waveTableLock());
+
+    auto found = tables.find(key);
+    if (found != tables.end())
+    {
+        for (CustomWaveTable & custom : found->second)
+        {
+            if (custom.real == real && custom.imag == imag)
+            {
+                if (std::shared_ptr<WaveTable> table = custom.table.lock())
+                    return table;
+            }
+        }
+    }
+
+    CustomWaveTable custom { real, imag, {} };
+    std::shared_ptr<WaveTable> table = std::make_shared<WaveTable>(sampleRate, OscillatorType::CUSTOM, custom.real, custom.imag);
+    custom.table = table;
+
+    // Forget the tables no oscillator holds any more before remembering the new one.
+    for (auto i = tables.begin(); i != tables.end();)
+    {
+        std::vector<CustomWaveTable> & bucket = i->second;
+        bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [](const CustomWaveTable & c) { return c.table.expired(); }), bucket.end());
+        if (bucket.empty())
+            i = tables.erase(i);
+        else
+            ++i;
+    }
+    tables[key].push_back(std::move(custom));
+    return table;
+}
+
 WaveTable::WaveTable(const float sampleRate, OscillatorType basicWaveform)
 : m_centsPerRange(CentsPerRange)
 , m_sampleRate(sampleRate)
@@ -113,6 +204,14 @@ void WaveTable::waveDataForFundamentalFrequency(float fundamentalFrequency, floa
     tableInterpolationFactor = pitchRange - rangeIndex1;
 }
 
+size_t WaveTable::memoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto & table : m_bandLimitedTables)
+        bytes += table->size() * sizeof(float);
+    return bytes;
+}
+
 size_t WaveTable::maxNumberOfPartials() const
 {
     return periodicWaveSize() / 2;
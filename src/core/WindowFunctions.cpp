@@ -0,0 +1,128 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/WindowFunctions.h"
+
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace lab {
+
+namespace {
+
+    // Multiplies the buffer by the window; the tables are generated from buffers of ones.
+    void generateWindow(WindowType wType, float * buffer, size_t size) {
+
+        int bSize = static_cast<int>(size);
+
+        switch (wType) {
+
+            case window_rectangle: {
+                for (int i = 0; i< bSize; i++) {
+                    buffer[i] *= 0.5;
+                }
+            }
+            break;
+
+            case window_hamming: {
+                for (int i = 0; i< bSize; i++) {
+                    buffer[i] *= 0.54f - 0.46f * cos(TwoPi * i / ( bSize));
+                }
+            }
+            break;
+
+            case window_hanning: {
+                for (int i = 0; i< bSize; i++) {
+                    buffer[i] *= 0.5f - (0.5f * cos(TwoPi * i / ( bSize)));
+                }
+            }
+            break;
+
+            case window_hanningz: {
+                for (int i = 0; i< bSize; i++) {
+                    buffer[i] *= 0.5f * (1.0f - cos(TwoPi * i / ( bSize)));
+                }
+            }
+            break;
+
+            case window_blackman: {
+                for (int i= 0; i < bSize; i++) {
+                    buffer[i] *= 0.42f - 0.50f * cos(TwoPi * i / (bSize - 1.0f)) + 0.08f * cos(2.0f * TwoPi * i / (bSize - 1.0f));
+                }
+            }
+            break;
+
+            case window_blackman_harris: {
+                for (int i = 0; i < bSize; i++) {
+                    buffer[i] *= 0.35875f - 0.48829f * cos(TwoPi * i / (bSize - 1.0f)) + 0.14128f * cos(2.0f * TwoPi * i / (bSize - 1.0f)) - 0.01168f * cos(3.0f*TwoPi*i/( bSize - 1.0f));
+                }
+            }
+            break;
+
+            case window_gaussian: {
+                float a, b, c = 0.5;
+                int n;
+                for (n = 0; n <  bSize; n++) {
+                    a = (n - c * (bSize - 1)) / (sqrt(c) * (bSize - 1));
+                    b = -c * sqrt(a);
+                    buffer[n] *= exp(b);
+                }
+            }
+            break;
+                
+            case window_welch: {
+                for (int i = 0; i < bSize; i++) {
+                    buffer[i] *= 1.0f - sqrt((2.0f * i - bSize) / (bSize + 1.0f));
+                }
+            }
+            break;
+                
+            case window_bartlett: {
+                for (int i = 0; i < bSize; i++) {
+                    buffer[i] *= 1.0f - abs(2.0f * (i / bSize) - 1.0f);
+                }
+            }
+            break; 
+                
+            case window_parzen: {
+                for (int i = 0; i < bSize; i++) {
+                    buffer[i] *= 1.0f - abs((2.0f * i - bSize) / ( bSize + 1.0f));
+                }
+            }
+            break;
+                
+        }
+        
+    }
+
+    std::mutex s_tablesLock;
+    std::map<std::pair<WindowType, size_t>, std::unique_ptr<AudioFloatArray>> s_tables;
+
+} // namespace
+
+const float * windowCoefficients(WindowType wType, size_t size)
+{
+    std::lock_guard<std::mutex> lock(s_tablesLock);
+    std::unique_ptr<AudioFloatArray> & table = s_tables[std::make_pair(wType, size)];
+    if (!table)
+    {
+        table.reset(new AudioFloatArray(size));
+        std::fill(table->data(), table->data() + size, 1.f);
+        generateWindow(wType, table->data(), size);
+    }
+    return table->data();
+}
+
+void applyWindow(WindowType wType, float * buffer, size_t size)
+{
+    VectorMath::vmul(buffer, 1, windowCoefficients(wType, size), 1, buffer, 1, size);
+}
+
+} // namespace lab
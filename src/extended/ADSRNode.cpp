@@ -7,9 +7,13 @@
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioProcessor.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioSetting.h"
 
 #include "internal/VectorMath.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 using namespace lab;
@@ -20,19 +24,39 @@ namespace lab
     // Private ADSRNode Implementation //
     /////////////////////////////////////
 
+    namespace
+    {
+        // An exponential stage has this far left to go when it ends, and then snaps to its target; -80 dB.
+        const float ExponentialRemainder = 1e-4f;
+
+        // With gain still sounding, a note on first fades out over this many frames, so the attack doesn't pop.
+        const size_t RetriggerFrames = 16;
+    }
+
     class ADSRNode::ADSRNodeInternal : public lab::AudioProcessor
     {
 
     public:
 
+        enum Stage
+        {
+            Idle,
+            Retrigger,
+            Attack,
+            Decay,
+            Sustain,
+            Release
+        };
+
         ADSRNodeInternal()
-        : AudioProcessor(2), m_noteOnTime(-1.), m_noteOffTime(0), m_currentGain(0)
+        : AudioProcessor(2), m_noteOnTime(-1.), m_noteOffWhen(-1.), m_noteOffTime(0), m_currentGain(0)
         {
             m_attackTime = std::make_shared<AudioParam>("attackTime",  0.05, 0, 120);
             m_attackLevel = std::make_shared<AudioParam>("attackLevel",  1.0, 0, 10);
             m_decayTime = std::make_shared<AudioParam>("decayTime",   0.05,  0, 120);
             m_sustainLevel = std::make_shared<AudioParam>("sustain", 0.75, 0, 10);
             m_releaseTime = std::make_shared<AudioParam>("release", 0.0625, 0, 120);
+            m_shape = std::make_shared<AudioSetting>("shape");
         }
 
         virtual ~ADSRNodeInternal() { }
@@ -49,78 +73,79 @@ namespace lab
             if (!numberOfChannels())
                 return;
 
-            if (m_noteOnTime >= 0)
-            {
-                if (m_currentGain > 0)
-                {
-                    m_zeroSteps = 16;
-                    m_zeroStepSize = -m_currentGain / 16.0f;
-                }
-                else
-                    m_zeroSteps = 0;
-
-                m_attackTimeTarget = m_noteOnTime + m_attackTime->value(r);
-
-                m_attackSteps = static_cast<int>(m_attackTime->value(r) * r.context()->sampleRate());
-                m_attackStepSize = m_attackLevel->value(r) / m_attackSteps;
-
-                m_decayTimeTarget = m_attackTimeTarget + m_decayTime->value(r);
-
-                m_decaySteps = static_cast<int>(m_decayTime->value(r) * r.context()->sampleRate());
-                m_decayStepSize = (m_sustainLevel->value(r) - m_attackLevel->value(r)) / m_decaySteps;
-
-                m_releaseSteps = 0;
-
-                m_noteOffTime = std::numeric_limits<double>::max();
-                m_noteOnTime = -1.;
-            }
-
-            // We handle both the 1 -> N and N -> N case here.
-            const float* source = sourceBus->channelByType(Channel::First)->data();
-
             // this will only ever happen once, so if heap contention is an issue it should only ever cause one glitch
             // what would be better, alloca? What does webaudio do elsewhere for this sort of thing?
             if (gainValues.size() < framesToProcess)
                 gainValues.resize(framesToProcess);
 
-            float s = m_sustainLevel->value(r);
+            m_sustain = m_sustainLevel->value(r);
+            if (m_stage == Sustain)
+                m_currentGain = m_sustain;
 
-            for (size_t i = 0; i < framesToProcess; ++i)
-            {
-                if (m_zeroSteps > 0)
-                {
-                    --m_zeroSteps;
-                    m_currentGain += m_zeroStepSize;
-                    gainValues[i] = m_currentGain;
-                }
+            const double sampleRate = r.context()->sampleRate();
+            const uint64_t quantumStart = r.context()->currentSampleFrame();
 
-                else if (m_attackSteps > 0)
-                {
-                    --m_attackSteps;
-                    m_currentGain += m_attackStepSize;
-                    gainValues[i] = m_currentGain;
-                }
+            // Where in the quantum a note on or off lands, from frame on; at frame if its time has passed.
+            auto offsetOf = [&](double when, size_t frame) -> size_t
+            {
+                const double at = std::round(when * sampleRate) - static_cast<double>(quantumStart);
+                if (at <= static_cast<double>(frame))
+                    return frame;
+                return at < static_cast<double>(framesToProcess) ? static_cast<size_t>(at) : framesToProcess;
+            };
+
+            // Split the quantum wherever a note on or off lands or a stage ends, rendering each piece as a ramp
+            // or a constant. A quantum with neither stays at one gain.
+            bool isConstant = true;
+            const float initialGain = m_currentGain;
+            size_t i = 0;
+            while (i < framesToProcess)
+            {
+                size_t end = framesToProcess;
+                if (m_noteOnTime >= 0)
+                    end = offsetOf(m_noteOnTime, i);
+                else if (m_noteOffWhen >= 0)
+                    end = offsetOf(m_noteOffWhen, i);
 
-                else if (m_decaySteps > 0)
+                if (end == i)
                 {
-                    --m_decaySteps;
-                    m_currentGain += m_decayStepSize;
-                    gainValues[i] = m_currentGain;
+                    if (isConstant)
+                    {
+                        VectorMath::vfill(&initialGain, &gainValues[0], i);
+                        isConstant = false;
+                    }
+
+                    if (m_noteOnTime >= 0)
+                    {
+                        m_noteOnTime = -1.;
+                        beginStage(r, m_currentGain > 0 ? Retrigger : Attack);
+                    }
+                    else
+                    {
+                        m_noteOffWhen = -1.;
+                        if (m_stage != Idle && m_stage != Release)
+                            beginStage(r, Release);
+                    }
+                    continue;
                 }
 
-                else if (m_releaseSteps > 0)
-                {
-                    --m_releaseSteps;
-                    m_currentGain += m_releaseStepSize;
-                    gainValues[i] = m_currentGain;
-                }
-                else
+                const bool isRamp = m_stage != Idle && m_stage != Sustain;
+                if (isRamp)
                 {
-                    m_currentGain = (m_noteOffTime == std::numeric_limits<double>::max()) ? s : 0;
-                    gainValues[i] = m_currentGain;
+                    end = std::min(end, i + m_stageFrames);
+                    renderRamp(&gainValues[i], end - i);
+                    isConstant = false;
+                    if (!m_stageFrames)
+                        beginStage(r, Stage(m_stage + 1));
                 }
+                else if (!isConstant)
+                    VectorMath::vfill(&m_currentGain, &gainValues[i], end - i);
+                i = end;
             }
 
+            // We handle both the 1 -> N and N -> N case here.
+            const float* source = sourceBus->channelByType(Channel::First)->data();
+
             size_t numChannels = numberOfChannels();
             for (size_t channelIndex = 0; channelIndex < numChannels; ++channelIndex)
             {
@@ -129,7 +154,12 @@ namespace lab
 
                 float * destination = destinationBus->channel(channelIndex)->mutableData();
 
-                VectorMath::vmul(source, 1, &gainValues[0], 1, destination, 1, framesToProcess);
+                if (!isConstant)
+                    VectorMath::vmul(source, 1, &gainValues[0], 1, destination, 1, framesToProcess);
+                else if (initialGain)
+                    VectorMath::vsmul(source, 1, &initialGain, destination, 1, framesToProcess);
+                else
+                    memset(destination, 0, framesToProcess * sizeof(float));
             }
         }
 
@@ -140,37 +170,116 @@ namespace lab
 
         void noteOn(double now)
         {
+            m_noteOffWhen = -1.;
+            m_noteOffTime = std::numeric_limits<double>::max();
             m_noteOnTime = now;
         }
 
         void noteOff(ContextRenderLock& r, double now)
         {
-            // note off at any time except while a note is on, has no effect
-            m_noteOnTime = -1.;
+            // note off at any time except while a note is on, or scheduled to be before it, has no effect
+            if (m_noteOnTime >= 0 && now <= m_noteOnTime)
+            {
+                m_noteOnTime = -1.;
+                return;
+            }
 
             if (m_noteOffTime == std::numeric_limits<double>::max())
             {
                 m_noteOffTime = now + m_releaseTime->value(r);
-                m_releaseSteps = static_cast<int>(m_releaseTime->value(r) * r.context()->sampleRate());
-                m_releaseStepSize = -m_sustainLevel->value(r) / m_releaseSteps;
+                m_noteOffWhen = now;
             }
         }
 
-        int m_zeroSteps;
-        float m_zeroStepSize;
+        // Starts a stage from the current gain, skipping it if it lasts no frames.
+        void beginStage(ContextRenderLock & r, Stage stage)
+        {
+            const float sampleRate = r.context()->sampleRate();
+            const bool exponential = ADSRNode::Shape(m_shape->valueUint32()) == ADSRNode::EXPONENTIAL;
 
-        int m_attackSteps;
-        float m_attackStepSize;
+            m_stage = stage;
+            m_stageExponential = false;
+            switch (stage)
+            {
+                case Retrigger:
+                    m_stageFrames = RetriggerFrames;
+                    m_stageTarget = 0;
+                    break;
+                case Attack:
+                    m_stageFrames = static_cast<size_t>(m_attackTime->value(r) * sampleRate);
+                    m_stageTarget = m_attackLevel->value(r);
+                    break;
+                case Decay:
+                    m_stageFrames = static_cast<size_t>(m_decayTime->value(r) * sampleRate);
+                    m_stageTarget = m_sustain;
+                    m_stageExponential = exponential;
+                    break;
+                case Release:
+                    m_stageFrames = static_cast<size_t>(m_releaseTime->value(r) * sampleRate);
+                    m_stageTarget = 0;
+                    m_stageExponential = exponential;
+                    break;
+                case Sustain:
+                    m_currentGain = m_sustain;
+                    return;
+                case Idle:
+                default:
+                    m_stage = Idle;
+                    m_currentGain = 0;
+                    return;
+            }
 
-        int m_decaySteps;
-        float m_decayStepSize;
+            if (!m_stageFrames)
+            {
+                m_currentGain = m_stageTarget;
+                beginStage(r, stage == Release ? Idle : Stage(stage + 1));
+                return;
+            }
 
-        int m_releaseSteps;
-        float m_releaseStepSize;
+            if (m_stageExponential)
+                m_stageStep = std::pow(ExponentialRemainder, 1.f / m_stageFrames);
+            else
+                m_stageStep = (m_stageTarget - m_currentGain) / m_stageFrames;
+        }
 
+        // Writes the next frames of the current stage, which ends exactly on its target.
+        void renderRamp(float * gains, size_t frames)
+        {
+            if (m_stageExponential)
+            {
+                // target + (gain - target) * ratio^(i + 1)
+                const float ratio = m_stageStep;
+                const float start = (m_currentGain - m_stageTarget) * ratio;
+                VectorMath::vexpramp(&start, &ratio, gains, frames);
+                VectorMath::vsadd(gains, &m_stageTarget, gains, frames);
+            }
+            else
+            {
+                // gain + step * (i + 1)
+                const float start = m_currentGain + m_stageStep;
+                VectorMath::vramp(&start, &m_stageStep, gains, frames);
+            }
+
+            m_stageFrames -= frames;
+            if (m_stageFrames)
+                m_currentGain = gains[frames - 1];
+            else
+                m_currentGain = gains[frames - 1] = m_stageTarget;
+        }
+
+        Stage m_stage = Idle;
+        size_t m_stageFrames = 0;
+        float m_stageTarget = 0;
+        float m_stageStep = 0; // the increment of a linear stage, and the ratio of an exponential one
+        bool m_stageExponential = false;
+        float m_sustain = 0;
+
+        // A pending note on and note off, in context time, and negative if there is none.
         double m_noteOnTime;
+        double m_noteOffWhen;
 
-        double m_attackTimeTarget, m_decayTimeTarget, m_noteOffTime;
+        // When the release of the current note ends.
+        double m_noteOffTime;
 
         float m_currentGain;
 
@@ -181,6 +290,7 @@ namespace lab
         std::shared_ptr<AudioParam> m_decayTime;
         std::shared_ptr<AudioParam> m_sustainLevel;
         std::shared_ptr<AudioParam> m_releaseTime;
+        std::shared_ptr<AudioSetting> m_shape;
     };
 
     /////////////////////
@@ -202,6 +312,8 @@ namespace lab
         m_params.push_back(internalNode->m_sustainLevel);
         m_params.push_back(internalNode->m_releaseTime);
 
+        m_settings.push_back(internalNode->m_shape);
+
         initialize();
     }
 
@@ -235,6 +347,16 @@ namespace lab
         internalNode->m_releaseTime->setValue(r);
     }
 
+    ADSRNode::Shape ADSRNode::shape() const
+    {
+        return Shape(internalNode->m_shape->valueUint32());
+    }
+
+    void ADSRNode::setShape(Shape shape)
+    {
+        internalNode->m_shape->setUint32(static_cast<uint32_t>(shape));
+    }
+
     std::shared_ptr<AudioParam> ADSRNode::attackLevel() const
     {
         return internalNode->m_attackLevel;
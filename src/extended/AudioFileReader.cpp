@@ -2,6 +2,9 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "internal/Assertions.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/Loudness.h"
+#include "internal/VectorMath.h"
 
 #include "LabSound/core/Macros.h"
 #include "LabSound/core/AudioBus.h"
@@ -11,50 +14,75 @@
 
 #include "libnyquist/Decoders.h"
 
-#include <mutex>
-#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
 
 namespace detail
 {
-    std::shared_ptr<lab::AudioBus> LoadInternal(nqr::AudioData * audioData, bool mixToMono)
+    // Deinterleaves the decoded samples straight into the channels of a new bus, mixing stereo to mono if asked, with
+    // vectorized loops and no intermediate buffer. The frames are written a span at a time, so that measuring the
+    // loudness reads each span while it's still in cache rather than making passes of its own over the bus.
+    std::shared_ptr<lab::AudioBus> LoadInternal(const nqr::AudioData & audioData, const lab::AudioFileLoadOptions & options)
     {
-        size_t numSamples = audioData->samples.size();
-        if (!numSamples) return nullptr;
+        size_t numSamples = audioData.samples.size();
+        if (!numSamples || audioData.channelCount <= 0) return nullptr;
 
-        size_t length = int(numSamples / audioData->channelCount);
-        const size_t busChannelCount = mixToMono ? 1 : (audioData->channelCount);
-
-        std::vector<float> planarSamples(numSamples);
+        const size_t channelCount = static_cast<size_t>(audioData.channelCount);
+        const size_t length = numSamples / channelCount;
+        const bool mixToMono = options.mixToMono;
+        const size_t busChannelCount = mixToMono ? 1 : channelCount;
+        const float * samples = audioData.samples.data();
 
         // Create AudioBus where we'll put the PCM audio data
         std::shared_ptr<lab::AudioBus> audioBus(new lab::AudioBus(busChannelCount, length));
-        audioBus->setSampleRate((float) audioData->sampleRate);
+        audioBus->setSampleRate((float) audioData.sampleRate);
+
+        std::unique_ptr<lab::LoudnessAnalyzer> analyzer;
+        if (options.measureLoudness && audioData.sampleRate > 0)
+            analyzer.reset(new lab::LoudnessAnalyzer(static_cast<float>(audioData.sampleRate), busChannelCount, length));
 
-        // Deinterleave stereo into LabSound/WebAudio planar channel layout
-        nqr::DeinterleaveChannels(audioData->samples.data(), planarSamples.data(), length, audioData->channelCount, length);
+        std::vector<float *> destinations(busChannelCount);
+        std::vector<float *> spans(busChannelCount);
+        for (size_t c = 0; c < busChannelCount; ++c)
+            destinations[c] = audioBus->channel(c)->mutableData();
 
-        // Mix to mono if stereo -- easier to do in place instead of using libnyquist helper functions
-        // because we've already deinterleaved
-        if (audioData->channelCount == lab::Channels::Stereo && mixToMono)
+        const size_t spanFrames = lab::LoudnessAnalyzer::SpanFrames;
+        for (size_t offset = 0; offset < length; offset += spanFrames)
         {
-            float * destinationMono = audioBus->channel(0)->mutableData();
-            float * leftSamples = planarSamples.data();
-            float * rightSamples = planarSamples.data() + length;
+            const size_t frames = std::min(spanFrames, length - offset);
+            const float * source = samples + offset * channelCount;
 
-            for (size_t i = 0; i < length; i++)
+            if (channelCount == lab::Channels::Stereo && mixToMono)
             {
-                destinationMono[i] = 0.5f * (leftSamples[i] + rightSamples[i]);
+                lab::VectorMath::vdownmix2(source, destinations[0] + offset, frames);
             }
-        }
-        else
-        {
-            for (size_t i = 0; i < busChannelCount; ++i)
+            else if (busChannelCount == channelCount)
+            {
+                // Deinterleave into LabSound/WebAudio planar channel layout
+                for (size_t c = 0; c < busChannelCount; ++c)
+                    spans[c] = destinations[c] + offset;
+                lab::VectorMath::vdeinterleave(source, channelCount, spans.data(), frames);
+            }
+            else
+            {
+                // Other layouts mixed to mono keep their first channel.
+                float * destination = destinations[0] + offset;
+                for (size_t i = 0; i < frames; ++i)
+                    destination[i] = source[i * channelCount];
+            }
+
+            if (analyzer)
             {
-                std::memcpy(audioBus->channel(i)->mutableData(), planarSamples.data() + (i * length), length * sizeof(float));
+                for (size_t c = 0; c < busChannelCount; ++c)
+                    analyzer->analyze(c, destinations[c] + offset, frames);
+                analyzer->advance(frames);
             }
         }
 
-        delete audioData;
+        if (analyzer)
+            audioBus->setLoudness(analyzer->result());
 
         return audioBus;
     }
@@ -63,46 +91,152 @@ namespace detail
 namespace lab
 {
 
-    nqr::NyquistIO nyquist_io;
-    std::mutex g_fileIOMutex;
-
-    std::shared_ptr<AudioBus> MakeBusFromFile(const char * filePath, bool mixToMono)
+    namespace
     {
-        std::lock_guard<std::mutex> lock(g_fileIOMutex);
-        nqr::AudioData * audioData = new nqr::AudioData();
-        try
+        // A NyquistIO is only used by one thread at a time, so every call and every decoding thread makes its own
+        // rather than sharing one behind a lock.
+        std::shared_ptr<AudioBus> DecodeFile(nqr::NyquistIO & io, const std::string & path, const AudioFileLoadOptions & options)
+        {
+            nqr::AudioData audioData;
+            try
+            {
+                io.Load(&audioData, path);
+            }
+            catch (...)
+            {
+                // use empty pointer as load failure sentinel
+                /// @TODO report loading error
+                return {};
+            }
+
+            return detail::LoadInternal(audioData, options);
+        }
+
+        // The files of a MakeBusesFromFiles() call. Each decoding thread holds the batch, and takes the next file
+        // not yet taken until there are none left, then exits; so no thread outlives the work it was started for.
+        struct DecodeBatch
+        {
+            std::vector<std::string> paths;
+            AudioFileLoadOptions options;
+            std::vector<std::promise<std::shared_ptr<AudioBus>>> results;
+            std::atomic<size_t> next{ 0 };
+        };
+
+        void DecodeBatchFiles(std::shared_ptr<DecodeBatch> batch)
         {
-            nyquist_io.Load(audioData, std::string(filePath));
+            DenormalDisabler denormalDisabler;
+
+            nqr::NyquistIO io;
+            for (size_t i = batch->next.fetch_add(1); i < batch->paths.size(); i = batch->next.fetch_add(1))
+            {
+                try
+                {
+                    batch->results[i].set_value(DecodeFile(io, batch->paths[i], batch->options));
+                }
+                catch (...)
+                {
+                    batch->results[i].set_exception(std::current_exception());
+                }
+            }
         }
-        catch (...)
+    }
+
+    namespace
+    {
+        AudioFileLoadOptions MonoOption(bool mixToMono)
         {
-            // use empty pointer as load failure sentinel
-            /// @TODO report loading error
-            return {};
+            AudioFileLoadOptions options;
+            options.mixToMono = mixToMono;
+            return options;
         }
+    }
 
-        return detail::LoadInternal(audioData, mixToMono);
+    std::shared_ptr<AudioBus> MakeBusFromFile(const char * filePath, bool mixToMono)
+    {
+        return MakeBusFromFile(std::string(filePath), MonoOption(mixToMono));
     }
 
     std::shared_ptr<AudioBus> MakeBusFromFile(const std::string& path, bool mixToMono)
     {
-        return MakeBusFromFile(path.c_str(), mixToMono);
+        return MakeBusFromFile(path, MonoOption(mixToMono));
+    }
+
+    std::shared_ptr<AudioBus> MakeBusFromFile(const std::string& path, const AudioFileLoadOptions & options)
+    {
+        nqr::NyquistIO io;
+        return DecodeFile(io, path, options);
+    }
+
+    std::future<std::shared_ptr<AudioBus>> MakeBusFromFileAsync(const std::string & path, bool mixToMono)
+    {
+        return std::move(MakeBusesFromFiles(std::vector<std::string>{ path }, mixToMono).front());
+    }
+
+    std::vector<std::future<std::shared_ptr<AudioBus>>> MakeBusesFromFiles(const std::vector<std::string> & paths, bool mixToMono, size_t threadCount)
+    {
+        return MakeBusesFromFiles(paths, MonoOption(mixToMono), threadCount);
+    }
+
+    std::vector<std::future<std::shared_ptr<AudioBus>>> MakeBusesFromFiles(const std::vector<std::string> & paths, const AudioFileLoadOptions & options, size_t threadCount)
+    {
+        std::shared_ptr<DecodeBatch> batch = std::make_shared<DecodeBatch>();
+        batch->paths = paths;
+        batch->options = options;
+        batch->results.resize(paths.size());
+
+        std::vector<std::future<std::shared_ptr<AudioBus>>> buses;
+        buses.reserve(paths.size());
+        for (auto & result : batch->results)
+            buses.push_back(result.get_future());
+
+        if (!threadCount)
+            threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        threadCount = std::min(threadCount, paths.size());
+
+        size_t started = 0;
+        for (; started < threadCount; ++started)
+        {
+            try
+            {
+                std::thread(DecodeBatchFiles, batch).detach();
+            }
+            catch (const std::system_error &)
+            {
+                break;
+            }
+        }
+
+        // If no thread could be started, the files are decoded here instead.
+        if (!started && !paths.empty())
+            DecodeBatchFiles(batch);
+
+        return buses;
     }
 
     std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, bool mixToMono)
     {
-        std::lock_guard<std::mutex> lock(g_fileIOMutex);
-        nqr::AudioData * audioData = new nqr::AudioData();
-        nyquist_io.Load(audioData, buffer);
-        return detail::LoadInternal(audioData, mixToMono);
+        return MakeBusFromMemory(buffer, MonoOption(mixToMono));
+    }
+
+    std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const AudioFileLoadOptions & options)
+    {
+        nqr::NyquistIO io;
+        nqr::AudioData audioData;
+        io.Load(&audioData, buffer);
+        return detail::LoadInternal(audioData, options);
     }
 
     std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const std::string& extension, bool mixToMono)
     {
-        std::lock_guard<std::mutex> lock(g_fileIOMutex);
-        nqr::AudioData * audioData = new nqr::AudioData();
-        nyquist_io.Load(audioData, extension, buffer);
-        return detail::LoadInternal(audioData, mixToMono);
+        return MakeBusFromMemory(buffer, extension, MonoOption(mixToMono));
+    }
+
+    std::shared_ptr<AudioBus> MakeBusFromMemory(const std::vector<uint8_t> & buffer, const std::string& extension, const AudioFileLoadOptions & options)
+    {
+        nqr::NyquistIO io;
+        nqr::AudioData audioData;
+        io.Load(&audioData, extension, buffer);
+        return detail::LoadInternal(audioData, options);
     }
 
 } // end namespace lab
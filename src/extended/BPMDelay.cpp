@@ -2,6 +2,7 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioProcessor.h"
@@ -77,4 +78,19 @@ namespace lab
             throw std::invalid_argument("Delay index out of bounds");
     }
 
+    void BPMDelay::process(ContextRenderLock & r, size_t framesToProcess)
+    {
+        if (transportSync && r.context())
+        {
+            const float bpm = static_cast<float>(r.context()->transport(r).bpm);
+            if (bpm != tempo)
+            {
+                tempo = bpm;
+                recomputeDelay();
+            }
+        }
+
+        DelayNode::process(r, framesToProcess);
+    }
+
 }
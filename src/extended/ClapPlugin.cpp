@@ -0,0 +1,322 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#if defined(LABSOUND_CLAP)
+
+#include "LabSound/extended/PluginNode.h"
+#include "LabSound/extended/Logging.h"
+
+#include <clap/clap.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace lab
+{
+
+namespace
+{
+    // The bundle's shared library, kept loaded, and its entry initialised, while a plugin from it lives.
+    class ClapLibrary
+    {
+    public:
+
+        ~ClapLibrary()
+        {
+            if (m_entry)
+                m_entry->deinit();
+#if defined(_WIN32)
+            if (m_handle)
+                FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+            if (m_handle)
+                dlclose(m_handle);
+#endif
+        }
+
+        bool open(const std::string & path)
+        {
+            std::string binary = path;
+#if defined(__APPLE__)
+            // A bundle's binary is in Contents/MacOS, named as the bundle.
+            const size_t slash = path.find_last_of('/', path.size() - 2);
+            std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+            if (!name.empty() && name.back() == '/')
+                name.pop_back();
+            const size_t dot = name.rfind(".clap");
+            if (dot != std::string::npos)
+                binary = path + "/Contents/MacOS/" + name.substr(0, dot);
+#endif
+
+#if defined(_WIN32)
+            m_handle = LoadLibraryA(binary.c_str());
+            void * symbol = m_handle ? reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(m_handle), "clap_entry")) : nullptr;
+#else
+            m_handle = dlopen(binary.c_str(), RTLD_LOCAL | RTLD_NOW);
+            void * symbol = m_handle ? dlsym(m_handle, "clap_entry") : nullptr;
+#endif
+            const clap_plugin_entry_t * entry = static_cast<const clap_plugin_entry_t *>(symbol);
+            if (!entry || !clap_version_is_compatible(entry->clap_version) || !entry->init(path.c_str()))
+                return false;
+
+            m_entry = entry;
+            return true;
+        }
+
+        const clap_plugin_factory_t * factory() const
+        {
+            return static_cast<const clap_plugin_factory_t *>(m_entry->get_factory(CLAP_PLUGIN_FACTORY_ID));
+        }
+
+    private:
+
+        void * m_handle = nullptr;
+        const clap_plugin_entry_t * m_entry = nullptr;
+    };
+
+    // The node's events, as the CLAP input event list the plugin reads.
+    struct ClapInputEvents
+    {
+        const clap_event_param_value_t * events;
+        uint32_t count;
+
+        static uint32_t size(const clap_input_events_t * list)
+        {
+            return static_cast<const ClapInputEvents *>(list->ctx)->count;
+        }
+
+        static const clap_event_header_t * get(const clap_input_events_t * list, uint32_t index)
+        {
+            const ClapInputEvents * self = static_cast<const ClapInputEvents *>(list->ctx);
+            return index < self->count ? &self->events[index].header : nullptr;
+        }
+    };
+
+    // Events the plugin sends back, such as its own parameter changes, are dropped.
+    bool dropOutputEvent(const clap_output_events_t *, const clap_event_header_t *) { return true; }
+
+    const void * hostExtension(const clap_host_t *, const char *) { return nullptr; }
+    void hostRequest(const clap_host_t *) { }
+
+    class ClapPlugin : public AudioPlugin
+    {
+    public:
+
+        ClapPlugin(std::unique_ptr<ClapLibrary> library)
+            : m_library(std::move(library))
+        {
+            m_host.clap_version = CLAP_VERSION;
+            m_host.host_data = this;
+            m_host.name = "LabSound";
+            m_host.vendor = "LabSound";
+            m_host.url = "https://github.com/LabSound/LabSound";
+            m_host.version = "1.0";
+            m_host.get_extension = hostExtension;
+            m_host.request_restart = hostRequest;
+            m_host.request_process = hostRequest;
+            m_host.request_callback = hostRequest;
+        }
+
+        virtual ~ClapPlugin()
+        {
+            if (m_plugin)
+            {
+                if (m_processing)
+                    m_plugin->stop_processing(m_plugin);
+                if (m_activated)
+                    m_plugin->deactivate(m_plugin);
+                m_plugin->destroy(m_plugin);
+            }
+        }
+
+        bool create(const std::string & pluginId)
+        {
+            const clap_plugin_factory_t * factory = m_library->factory();
+            if (!factory || !factory->get_plugin_count(factory))
+                return false;
+
+            std::string id = pluginId;
+            if (id.empty())
+            {
+                const clap_plugin_descriptor_t * descriptor = factory->get_plugin_descriptor(factory, 0);
+                if (!descriptor || !descriptor->id)
+                    return false;
+                id = descriptor->id;
+            }
+
+            m_plugin = factory->create_plugin(factory, &m_host, id.c_str());
+            if (!m_plugin || !m_plugin->init(m_plugin))
+                return false;
+
+            // The channels of the first ports, if there are any.
+            auto ports = static_cast<const clap_plugin_audio_ports_t *>(m_plugin->get_extension(m_plugin, CLAP_EXT_AUDIO_PORTS));
+            clap_audio_port_info_t info;
+            if (ports && ports->count(m_plugin, true) && ports->get(m_plugin, 0, true, &info))
+                m_inputChannels = info.channel_count;
+            if (ports && ports->count(m_plugin, false) && ports->get(m_plugin, 0, false, &info))
+                m_outputChannels = info.channel_count;
+
+            m_params = static_cast<const clap_plugin_params_t *>(m_plugin->get_extension(m_plugin, CLAP_EXT_PARAMS));
+            const uint32_t count = m_params ? m_params->count(m_plugin) : 0;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                clap_param_info_t param;
+                if (!m_params->get_info(m_plugin, i, &param))
+                    continue;
+                m_parameters.push_back({ param.name, param.min_value, param.max_value, param.default_value });
+                m_paramIds.push_back(param.id);
+                m_paramCookies.push_back(param.cookie);
+            }
+
+            m_latency = static_cast<const clap_plugin_latency_t *>(m_plugin->get_extension(m_plugin, CLAP_EXT_LATENCY));
+            m_tail = static_cast<const clap_plugin_tail_t *>(m_plugin->get_extension(m_plugin, CLAP_EXT_TAIL));
+            return true;
+        }
+
+        virtual size_t inputChannels() const override { return m_inputChannels; }
+        virtual size_t outputChannels() const override { return m_outputChannels; }
+        virtual const std::vector<Parameter> & parameters() const override { return m_parameters; }
+
+        virtual bool activate(double sampleRate, size_t maxFrames) override
+        {
+            if (m_activated)
+                return true;
+
+            m_sampleRate = sampleRate;
+            m_activated = m_plugin->activate(m_plugin, sampleRate, 1, static_cast<uint32_t>(maxFrames));
+
+            // Room for as many events as PluginNode makes in a block of maxFrames.
+            const size_t samples = (maxFrames + PluginNode::ParameterEventFrames - 1) / PluginNode::ParameterEventFrames;
+            m_events.resize(m_parameters.size() * samples);
+            for (auto & event : m_events)
+            {
+                std::memset(&event, 0, sizeof(event));
+                event.header.size = sizeof(clap_event_param_value_t);
+                event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+                event.header.type = CLAP_EVENT_PARAM_VALUE;
+                event.note_id = -1;
+                event.port_index = -1;
+                event.channel = -1;
+                event.key = -1;
+            }
+            return m_activated;
+        }
+
+        virtual void reset() override
+        {
+            if (m_activated)
+                m_plugin->reset(m_plugin);
+        }
+
+        virtual size_t latencyFrames() const override
+        {
+            return m_latency && m_activated ? m_latency->get(m_plugin) : 0;
+        }
+
+        virtual double tailTime() const override
+        {
+            if (!m_tail || !m_activated)
+                return 0;
+            const uint32_t frames = m_tail->get(m_plugin);
+            return frames == UINT32_MAX ? 1e6 : frames / m_sampleRate;
+        }
+
+        virtual void process(const float * const * inputs, float * const * outputs, size_t frames,
+                             const ParameterEvent * events, size_t eventCount) override
+        {
+            // The plugin starts processing on the thread that processes it.
+            if (!m_processing)
+                m_processing = m_plugin->start_processing(m_plugin);
+
+            const uint32_t count = static_cast<uint32_t>(std::min(eventCount, m_events.size()));
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                clap_event_param_value_t & event = m_events[i];
+                event.header.time = events[i].frame;
+                event.param_id = m_paramIds[events[i].parameter];
+                event.cookie = m_paramCookies[events[i].parameter];
+                event.value = events[i].value;
+            }
+
+            ClapInputEvents list = { m_events.data(), count };
+            clap_input_events_t in = { &list, ClapInputEvents::size, ClapInputEvents::get };
+            clap_output_events_t out = { nullptr, dropOutputEvent };
+
+            // CLAP's buffers aren't const, though a plugin doesn't write its inputs.
+            clap_audio_buffer_t input = {};
+            input.data32 = const_cast<float **>(inputs);
+            input.channel_count = m_inputChannels;
+            clap_audio_buffer_t output = {};
+            output.data32 = const_cast<float **>(outputs);
+            output.channel_count = m_outputChannels;
+
+            clap_process_t process = {};
+            process.steady_time = m_steadyTime;
+            process.frames_count = static_cast<uint32_t>(frames);
+            process.audio_inputs = &input;
+            process.audio_outputs = &output;
+            process.audio_inputs_count = m_inputChannels ? 1 : 0;
+            process.audio_outputs_count = m_outputChannels ? 1 : 0;
+            process.in_events = &in;
+            process.out_events = &out;
+
+            if (!m_processing || m_plugin->process(m_plugin, &process) == CLAP_PROCESS_ERROR)
+            {
+                for (uint32_t c = 0; c < m_outputChannels; ++c)
+                    std::fill(outputs[c], outputs[c] + frames, 0.f);
+            }
+            m_steadyTime += static_cast<int64_t>(frames);
+        }
+
+    private:
+
+        std::unique_ptr<ClapLibrary> m_library;
+        clap_host_t m_host;
+        const clap_plugin_t * m_plugin = nullptr;
+        const clap_plugin_params_t * m_params = nullptr;
+        const clap_plugin_latency_t * m_latency = nullptr;
+        const clap_plugin_tail_t * m_tail = nullptr;
+
+        uint32_t m_inputChannels = 0;
+        uint32_t m_outputChannels = 0;
+        std::vector<Parameter> m_parameters;
+        std::vector<clap_id> m_paramIds;
+        std::vector<void *> m_paramCookies;
+
+        std::vector<clap_event_param_value_t> m_events;
+        double m_sampleRate = 0;
+        int64_t m_steadyTime = 0;
+        bool m_activated = false;
+        bool m_processing = false;
+    };
+
+} // anon
+
+std::unique_ptr<AudioPlugin> LoadClapPlugin(const std::string & path, const std::string & pluginId)
+{
+    std::unique_ptr<ClapLibrary> library(new ClapLibrary());
+    if (!library->open(path))
+    {
+        LOG_ERROR("LoadClapPlugin: %s is not a CLAP plugin", path.c_str());
+        return nullptr;
+    }
+
+    std::unique_ptr<ClapPlugin> plugin(new ClapPlugin(std::move(library)));
+    if (!plugin->create(pluginId))
+    {
+        LOG_ERROR("LoadClapPlugin: could not create %s from %s", pluginId.empty() ? "a plugin" : pluginId.c_str(), path.c_str());
+        return nullptr;
+    }
+    return std::move(plugin);
+}
+
+} // namespace lab
+
+#endif
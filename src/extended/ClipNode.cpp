@@ -13,8 +13,7 @@
 
 #include "internal/VectorMath.h"
 
-#include <iostream>
-#include <vector>
+#include <limits>
 
 using namespace lab;
 
@@ -55,11 +54,6 @@ namespace lab
             // We handle both the 1 -> N and N -> N case here.
             const float* source = sourceBus->channel(0)->data();
 
-            // this will only ever happen once, so if heap contention is an issue it should only ever cause one glitch
-            // what would be better, alloca? What does webaudio do elsewhere for this sort of thing?
-            if (gainValues.size() < framesToProcess)
-                gainValues.resize(framesToProcess);
-
             size_t numChannels = numberOfChannels();
 
             ClipNode::Mode clipMode = static_cast<ClipNode::Mode>(mode->valueUint32());
@@ -75,10 +69,9 @@ namespace lab
                         source = sourceBus->channel(channelIndex)->data();
 
                     float * destination = destinationBus->channel(channelIndex)->mutableData();
-                    for (size_t i = 0; i < framesToProcess; ++i)
-                    {
-                        *destination++ = outputGain * tanhf(inputGain * source[i]);
-                    }
+                    VectorMath::vsmul(source, 1, &inputGain, destination, 1, framesToProcess);
+                    VectorMath::vtanh(destination, destination, framesToProcess);
+                    VectorMath::vsmul(destination, 1, &outputGain, destination, 1, framesToProcess);
                 }
             }
             else
@@ -92,18 +85,7 @@ namespace lab
                         source = sourceBus->channel(channelIndex)->data();
 
                     float * destination = destinationBus->channel(channelIndex)->mutableData();
-
-                    for (size_t i = 0; i < framesToProcess; ++i)
-                    {
-                        float d = source[i];
-
-                        if (d < minf)
-                            d = minf;
-                        else if (d > maxf)
-                            d = maxf;
-
-                        *destination++ = d;
-                    }
+                    VectorMath::vclip(source, 1, &minf, &maxf, destination, 1, framesToProcess);
                 }
             }
         }
@@ -116,8 +98,6 @@ namespace lab
         std::shared_ptr<AudioParam> aVal;
         std::shared_ptr<AudioParam> bVal;
         std::shared_ptr<AudioSetting> mode;
-
-        std::vector<float> gainValues;
     };
 
     /////////////////////
@@ -0,0 +1,775 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/CommandLog.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioDestinationNode.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioScheduledSourceNode.h"
+#include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/ConcurrentQueue.h"
+#include "LabSound/core/GraphTransaction.h"
+#include "LabSound/core/OfflineAudioDestinationNode.h"
+#include "LabSound/extended/GraphPrefab.h"
+
+#include "internal/AlignedAllocation.h"
+#include "internal/NodeProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace lab
+{
+
+namespace
+{
+    // "LSCL", then the version, the sample rate, the channels and the render quantum. Each record follows as its
+    // command, the change in frame since the record before, zigzag encoded, and its operands. Integers are
+    // LEB128, floats little-endian.
+    const char Magic[4] = { 'L', 'S', 'C', 'L' };
+    const uint32_t Version = 1;
+
+    typedef CommandRecorder::Command Command;
+
+    class LogWriter
+    {
+    public:
+
+        void u8(uint8_t v) { bytes.push_back(v); }
+
+        void varint(uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                bytes.push_back(static_cast<uint8_t>(v | 0x80));
+                v >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(v));
+        }
+
+        void f32(float v)
+        {
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            for (int i = 0; i < 4; ++i)
+                bytes.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+
+        void f64(double v)
+        {
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            for (int i = 0; i < 8; ++i)
+                bytes.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+
+        void string(const std::string & s)
+        {
+            varint(s.size());
+            bytes.insert(bytes.end(), s.begin(), s.end());
+        }
+
+        void record(Command command, uint64_t frame)
+        {
+            const int64_t delta = static_cast<int64_t>(frame - lastFrame);
+            u8(static_cast<uint8_t>(command));
+            varint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+            lastFrame = frame;
+        }
+
+        std::vector<uint8_t> bytes;
+        uint64_t lastFrame = 0;
+    };
+
+    class LogReader
+    {
+    public:
+
+        LogReader(const uint8_t * data, size_t size) : m_data(data), m_size(size) {}
+
+        uint8_t u8()
+        {
+            need(1);
+            return m_data[m_pos++];
+        }
+
+        uint64_t varint()
+        {
+            uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                const uint8_t b = u8();
+                v |= uint64_t(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return v;
+            }
+            throw std::invalid_argument("Malformed command log, bad integer");
+        }
+
+        uint32_t u32()
+        {
+            const uint64_t v = varint();
+            if (v > UINT32_MAX)
+                throw std::invalid_argument("Malformed command log, bad integer");
+            return static_cast<uint32_t>(v);
+        }
+
+        float f32()
+        {
+            need(4);
+            uint32_t bits = 0;
+            for (int i = 0; i < 4; ++i)
+                bits |= uint32_t(m_data[m_pos++]) << (8 * i);
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        double f64()
+        {
+            need(8);
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; ++i)
+                bits |= uint64_t(m_data[m_pos++]) << (8 * i);
+            double v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        std::string string()
+        {
+            const uint64_t length = varint();
+            need(length);
+            std::string s(reinterpret_cast<const char *>(m_data + m_pos), static_cast<size_t>(length));
+            m_pos += static_cast<size_t>(length);
+            return s;
+        }
+
+        // A count of items of at least minBytes each, checked against what's left.
+        uint32_t count(size_t minBytes)
+        {
+            const uint32_t n = u32();
+            need(static_cast<uint64_t>(n) * minBytes);
+            return n;
+        }
+
+        bool done() const { return m_pos == m_size; }
+
+    private:
+
+        void need(uint64_t bytes) const
+        {
+            if (m_size - m_pos < bytes)
+                throw std::invalid_argument("Malformed command log, truncated");
+        }
+
+        const uint8_t * m_data;
+        size_t m_size;
+        size_t m_pos = 0;
+    };
+}
+
+// The render thread's records hold the raw parameter or node, which the graph update resolves to the log's
+// numbers; neither is dereferenced, so it doesn't matter if it's gone by then.
+struct CommandRecorder::State : AlignedAllocation<CommandRecorder::State>
+{
+    struct RenderRecord
+    {
+        Command command = Command::None;
+        uint64_t frame = 0;
+        const void * object = nullptr;
+        double value = 0;
+    };
+
+    explicit State(size_t capacity) : ring(capacity), drainAt(std::max<size_t>(ring.capacity() / 2, 1)) {}
+
+    BoundedMPSCQueue<RenderRecord> ring;
+    const size_t drainAt;
+    std::atomic<size_t> undrained{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+
+    // The rest is the graph update's, and log()'s.
+    std::mutex mutex;
+    LogWriter writer;
+    bool recording = false;
+    AudioContext * context = nullptr;
+
+    struct NodeEntry
+    {
+        uint32_t id;
+        std::weak_ptr<AudioNode> node;
+    };
+    std::unordered_map<const AudioNode *, NodeEntry> nodes;
+    std::unordered_map<const AudioParam *, std::pair<uint32_t, uint32_t>> params; // the node's number and index
+    uint32_t nextId = 1; // 0 is no node
+
+    // Called holding the mutex. Returns the node's number, describing it first if it's new to the log. An
+    // address the log knows, whose node is gone, is a new node.
+    uint32_t node(uint64_t frame, const std::shared_ptr<AudioNode> & n)
+    {
+        if (!n)
+            return 0;
+
+        auto found = nodes.find(n.get());
+        if (found != nodes.end() && !found->second.node.expired())
+            return found->second.id;
+
+        const uint32_t id = nextId++;
+        nodes[n.get()] = { id, n };
+
+        std::shared_ptr<AudioDestinationNode> destination = context ? context->destination() : nullptr;
+        writer.record(Command::Node, frame);
+        writer.varint(id);
+        writer.string(NodeTypeName(*n));
+        writer.u8(n == destination ? 1 : 0);
+
+        const size_t paramCount = n->params().size();
+        writer.varint(paramCount);
+        for (size_t i = 0; i < paramCount; ++i)
+        {
+            std::shared_ptr<AudioParam> param = n->paramAt(i);
+            params[param.get()] = std::make_pair(id, static_cast<uint32_t>(i));
+            writer.f32(param->smoothedValue());
+        }
+
+        const size_t settingCount = n->settings().size();
+        writer.varint(settingCount);
+        for (size_t i = 0; i < settingCount; ++i)
+        {
+            std::shared_ptr<AudioSetting> setting = n->settingAt(i);
+            writer.u8(setting->floatAssigned() ? 1 : 0);
+            writer.f32(setting->valueFloat());
+        }
+        return id;
+    }
+
+    // Called holding the mutex.
+    uint32_t knownNode(const void * n) const
+    {
+        auto found = nodes.find(static_cast<const AudioNode *>(n));
+        return found == nodes.end() ? 0 : found->second.id;
+    }
+
+    // Called holding the mutex.
+    void drain()
+    {
+        RenderRecord r;
+        while (ring.tryPop(r))
+        {
+            undrained.fetch_sub(1, std::memory_order_relaxed);
+            if (!recording)
+                continue;
+
+            if (r.command == Command::SetValue)
+            {
+                auto found = params.find(static_cast<const AudioParam *>(r.object));
+                if (found == params.end())
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                writer.record(r.command, r.frame);
+                writer.varint(found->second.first);
+                writer.varint(found->second.second);
+                writer.f32(static_cast<float>(r.value));
+            }
+            else
+            {
+                const uint32_t id = knownNode(r.object);
+                if (!id)
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                writer.record(r.command, r.frame);
+                writer.varint(id);
+                writer.f64(r.value);
+            }
+        }
+    }
+};
+
+CommandRecorder::CommandRecorder(size_t renderCapacity)
+    : m_state(new State(renderCapacity))
+{
+}
+
+CommandRecorder::~CommandRecorder()
+{
+}
+
+void CommandRecorder::begin(AudioContext & context, uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+
+    LogWriter & w = m_state->writer;
+    w = LogWriter();
+    w.bytes.insert(w.bytes.end(), Magic, Magic + 4);
+    w.varint(Version);
+    w.f32(context.sampleRate());
+    std::shared_ptr<AudioDestinationNode> destination = context.destination();
+    w.varint(destination ? destination->channelCount() : 0);
+    w.varint(context.renderQuantumSize());
+    w.varint(frame);
+    w.lastFrame = frame;
+
+    m_state->nodes.clear();
+    m_state->params.clear();
+    m_state->nextId = 1;
+    m_state->context = &context;
+    m_state->recording = true;
+}
+
+void CommandRecorder::finish(uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+    if (!m_state->recording)
+        return;
+
+    m_state->writer.record(Command::End, std::max(frame, m_state->writer.lastFrame));
+    m_state->recording = false;
+    m_state->context = nullptr;
+    m_state->nodes.clear();
+    m_state->params.clear();
+}
+
+void CommandRecorder::recordNode(uint64_t frame, const std::shared_ptr<AudioNode> & node)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+    if (m_state->recording)
+        m_state->node(frame, node);
+}
+
+void CommandRecorder::recordEdit(uint64_t frame, Command command, const std::shared_ptr<AudioNode> & destination, const std::shared_ptr<AudioNode> & source,
+                                 const AudioParam * param, uint32_t destIndex, uint32_t srcIndex)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+    if (!m_state->recording)
+        return;
+
+    LogWriter & w = m_state->writer;
+    if (command == Command::ConnectParam)
+    {
+        auto found = m_state->params.find(param);
+        if (found == m_state->params.end())
+        {
+            m_state->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const uint32_t driver = m_state->node(frame, source);
+        w.record(command, frame);
+        w.varint(found->second.first);
+        w.varint(found->second.second);
+        w.varint(driver);
+        w.varint(srcIndex);
+        return;
+    }
+
+    const uint32_t d = m_state->node(frame, destination);
+    const uint32_t s = m_state->node(frame, source);
+    w.record(command, frame);
+    w.varint(d);
+    if (command == Command::Connect || command == Command::Disconnect)
+    {
+        w.varint(s);
+        w.varint(destIndex);
+        w.varint(srcIndex);
+    }
+}
+
+void CommandRecorder::recordTransaction(uint64_t frame, bool begins)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+    if (m_state->recording)
+        m_state->writer.record(begins ? Command::BeginTransaction : Command::EndTransaction, frame);
+}
+
+bool CommandRecorder::recordRender(ContextRenderLock &, Command command, uint64_t frame, const void * object, double value)
+{
+    State::RenderRecord r;
+    r.command = command;
+    r.frame = frame;
+    r.object = object;
+    r.value = value;
+    if (!m_state->ring.tryPush(std::move(r)))
+    {
+        m_state->dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return m_state->undrained.fetch_add(1, std::memory_order_relaxed) + 1 == m_state->drainAt;
+}
+
+void CommandRecorder::drain()
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+}
+
+std::vector<uint8_t> CommandRecorder::log()
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->drain();
+    return m_state->writer.bytes;
+}
+
+bool CommandRecorder::save(const std::string & path)
+{
+    const std::vector<uint8_t> bytes = log();
+    std::FILE * file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    const bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && written;
+}
+
+uint64_t CommandRecorder::droppedCount() const
+{
+    return m_state->dropped.load(std::memory_order_relaxed);
+}
+
+struct CommandReplayer::Log
+{
+    struct NodeRecord
+    {
+        std::string type;
+        bool destination;
+        std::vector<float> params;
+        std::vector<std::pair<bool, float>> settings; // whether set as a float, and the value
+    };
+
+    struct Record
+    {
+        Command command;
+        uint64_t frame; // from the start of recording
+        uint32_t a = 0, b = 0, c = 0, d = 0;
+        double value = 0;
+    };
+
+    float sampleRate = 0;
+    uint32_t channels = 0;
+    size_t quantum = 0;
+    uint64_t start = 0;
+    uint64_t length = 0;
+    std::vector<NodeRecord> nodes; // by number, less one
+    std::vector<Record> records;
+};
+
+CommandReplayer::CommandReplayer(const uint8_t * data, size_t size)
+    : m_log(new Log())
+{
+    LogReader r(data, size);
+    if (size < 4 || memcmp(data, Magic, 4))
+        throw std::invalid_argument("Not a command log");
+    for (int i = 0; i < 4; ++i)
+        r.u8();
+    if (r.u32() != Version)
+        throw std::invalid_argument("Unsupported command log version");
+
+    Log & log = *m_log;
+    log.sampleRate = r.f32();
+    log.channels = r.u32();
+    log.quantum = r.u32();
+    log.start = r.varint();
+    if (!(log.sampleRate > 0) || !log.channels || !log.quantum)
+        throw std::invalid_argument("Malformed command log, bad header");
+
+    uint64_t frame = log.start;
+    bool ended = false;
+    while (!r.done())
+    {
+        const uint8_t command = r.u8();
+        const uint64_t zigzag = r.varint();
+        frame += static_cast<uint64_t>(static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1));
+        if (frame < log.start)
+            throw std::invalid_argument("Malformed command log, a command before the start");
+
+        Log::Record record;
+        record.command = static_cast<Command>(command);
+        record.frame = frame - log.start;
+
+        auto nodeId = [&]() -> uint32_t
+        {
+            const uint32_t id = r.u32();
+            if (id > log.nodes.size())
+                throw std::invalid_argument("Malformed command log, an unknown node");
+            return id;
+        };
+
+        switch (record.command)
+        {
+        case Command::Node:
+        {
+            if (r.u32() != log.nodes.size() + 1)
+                throw std::invalid_argument("Malformed command log, nodes out of order");
+            Log::NodeRecord node;
+            node.type = r.string();
+            node.destination = r.u8() != 0;
+            node.params.resize(r.count(4));
+            for (float & v : node.params)
+                v = r.f32();
+            node.settings.resize(r.count(5));
+            for (auto & s : node.settings)
+            {
+                s.first = r.u8() != 0;
+                s.second = r.f32();
+            }
+            log.nodes.push_back(std::move(node));
+            record.a = static_cast<uint32_t>(log.nodes.size());
+            break;
+        }
+        case Command::Connect:
+        case Command::Disconnect:
+            record.a = nodeId();
+            record.b = nodeId();
+            record.c = r.u32();
+            record.d = r.u32();
+            break;
+        case Command::ConnectParam:
+            record.a = nodeId();
+            record.b = r.u32();
+            record.c = nodeId();
+            record.d = r.u32();
+            break;
+        case Command::AddPullNode:
+        case Command::RemovePullNode:
+        case Command::HoldSource:
+            record.a = nodeId();
+            break;
+        case Command::BeginTransaction:
+        case Command::EndTransaction:
+            break;
+        case Command::SetValue:
+            record.a = nodeId();
+            record.b = r.u32();
+            record.value = r.f32();
+            break;
+        case Command::Start:
+        case Command::Stop:
+            record.a = nodeId();
+            record.value = r.f64();
+            break;
+        case Command::End:
+            ended = true;
+            break;
+        default:
+            throw std::invalid_argument("Malformed command log, unknown command " + std::to_string(command));
+        }
+
+        log.length = std::max(log.length, record.frame);
+        if (record.command != Command::End)
+            log.records.push_back(record);
+    }
+
+    // Render records are logged as the graph update collects them, a little after edits of the same frame or
+    // later; the order within a frame is kept.
+    std::stable_sort(log.records.begin(), log.records.end(), [](const Log::Record & x, const Log::Record & y) { return x.frame < y.frame; });
+
+    // Without an end, the last command is heard for a quantum.
+    if (!ended)
+        log.length += log.quantum;
+}
+
+CommandReplayer CommandReplayer::load(const std::string & path)
+{
+    std::FILE * file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::invalid_argument("Can't read " + path);
+
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[65536];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    std::fclose(file);
+    return CommandReplayer(bytes.data(), bytes.size());
+}
+
+CommandReplayer::~CommandReplayer()
+{
+}
+
+CommandReplayer::CommandReplayer(CommandReplayer &&) = default;
+CommandReplayer & CommandReplayer::operator=(CommandReplayer &&) = default;
+
+float CommandReplayer::sampleRate() const { return m_log->sampleRate; }
+uint32_t CommandReplayer::channels() const { return m_log->channels; }
+size_t CommandReplayer::renderQuantumSize() const { return m_log->quantum; }
+uint64_t CommandReplayer::length() const { return m_log->length; }
+size_t CommandReplayer::commandCount() const { return m_log->records.size(); }
+
+size_t CommandReplayer::replay(AudioContext & context)
+{
+    std::shared_ptr<OfflineAudioDestinationNode> destination = std::dynamic_pointer_cast<OfflineAudioDestinationNode>(context.destination());
+    if (!destination)
+        throw std::invalid_argument("A command log is replayed with an offline context");
+    if (context.sampleRate() != m_log->sampleRate)
+        throw std::invalid_argument("The context's sample rate isn't the command log's");
+
+    const Log & log = *m_log;
+
+    // Times are shifted with the frames, so that recording starts at zero.
+    const double startSeconds = static_cast<double>(log.start) / log.sampleRate;
+
+    std::vector<std::shared_ptr<AudioNode>> nodes(log.nodes.size() + 1);
+    std::unique_ptr<GraphTransaction> transaction;
+    size_t skipped = 0;
+    size_t next = 0;
+
+    auto apply = [&](const Log::Record & record)
+    {
+        const std::shared_ptr<AudioNode> & a = nodes[record.a];
+        switch (record.command)
+        {
+        case Command::Node:
+        {
+            const Log::NodeRecord & n = log.nodes[record.a - 1];
+            std::shared_ptr<AudioNode> node;
+            if (n.destination)
+                node = context.destination();
+            else
+            {
+                node = GraphPrefab::makeNode(context, n.type);
+                if (!node && makeNode)
+                    node = makeNode(context, n.type);
+                if (!node)
+                {
+                    ++skipped;
+                    return;
+                }
+
+                for (size_t i = 0; i < n.params.size(); ++i)
+                    if (std::shared_ptr<AudioParam> param = node->paramAt(i))
+                        param->setValue(n.params[i]);
+                for (size_t i = 0; i < n.settings.size(); ++i)
+                {
+                    std::shared_ptr<AudioSetting> setting = node->settingAt(i);
+                    if (!setting)
+                        continue;
+                    if (n.settings[i].first)
+                        setting->setFloat(n.settings[i].second);
+                    else
+                        setting->setUint32(static_cast<uint32_t>(n.settings[i].second));
+                }
+            }
+            if (onNode)
+                onNode(record.a, n.type, *node);
+            nodes[record.a] = std::move(node);
+            return;
+        }
+        case Command::Connect:
+        case Command::Disconnect:
+        {
+            // A disconnection may name only one side.
+            const std::shared_ptr<AudioNode> & b = nodes[record.b];
+            if ((record.a && !a) || (record.b && !b) || (record.command == Command::Connect && (!a || !b)))
+                break;
+            if (record.command == Command::Connect)
+            {
+                if (transaction)
+                    transaction->connect(a, b, record.c, record.d);
+                else
+                    context.connect(a, b, record.c, record.d);
+            }
+            else if (transaction)
+                transaction->disconnect(a, b, record.c, record.d);
+            else
+                context.disconnect(a, b, record.c, record.d);
+            return;
+        }
+        case Command::ConnectParam:
+        {
+            const std::shared_ptr<AudioNode> & driver = nodes[record.c];
+            std::shared_ptr<AudioParam> param = a ? a->paramAt(record.b) : nullptr;
+            if (!param || !driver)
+                break;
+            if (transaction)
+                transaction->connectParam(param, driver, record.d);
+            else
+                context.connectParam(param, driver, record.d);
+            return;
+        }
+        case Command::AddPullNode:
+        case Command::RemovePullNode:
+            if (!a)
+                break;
+            if (record.command == Command::AddPullNode)
+                context.addAutomaticPullNode(a);
+            else
+                context.removeAutomaticPullNode(a);
+            return;
+        case Command::HoldSource:
+            if (!a || !a->isScheduledNode())
+                break;
+            context.holdSourceNodeUntilFinished(std::static_pointer_cast<AudioScheduledSourceNode>(a));
+            return;
+        case Command::BeginTransaction:
+            transaction.reset(new GraphTransaction(&context));
+            return;
+        case Command::EndTransaction:
+            if (transaction)
+                transaction->commit();
+            transaction.reset();
+            return;
+        case Command::SetValue:
+        {
+            std::shared_ptr<AudioParam> param = a ? a->paramAt(record.b) : nullptr;
+            if (!param)
+                break;
+            param->setValue(static_cast<float>(record.value));
+            return;
+        }
+        case Command::Start:
+        case Command::Stop:
+        {
+            if (!a || !a->isScheduledNode())
+                break;
+            AudioScheduledSourceNode * source = static_cast<AudioScheduledSourceNode *>(a.get());
+            const double when = std::max(0.0, record.value - startSeconds);
+            if (record.command == Command::Start)
+                source->start(when);
+            else
+                source->stop(when);
+            return;
+        }
+        default:
+            return;
+        }
+        ++skipped;
+    };
+
+    // Each quantum's commands are applied before it's rendered: those of the first now, and the rest as the
+    // quantum before ends, after which the offline destination updates the graph.
+    auto applyUntil = [&](uint64_t frame)
+    {
+        while (next < log.records.size() && log.records[next].frame <= frame)
+            apply(log.records[next++]);
+    };
+
+    applyUntil(0);
+    const uint64_t length = log.length;
+    destination->setStopCondition([&](ContextRenderLock &, uint64_t framesRendered)
+    {
+        applyUntil(framesRendered);
+        return framesRendered >= length;
+    });
+
+    context.startRendering();
+    destination->setStopCondition(nullptr);
+
+    if (transaction)
+        transaction->commit();
+    return skipped;
+}
+
+} // namespace lab
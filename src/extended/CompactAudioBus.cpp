@@ -0,0 +1,260 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/CompactAudioBus.h"
+#include "LabSound/core/AudioBus.h"
+
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace lab
+{
+
+namespace
+{
+    // An ADPCM block: the predictor and step index the decoder starts from, then four samples a word, the first in
+    // the low bits.
+    const size_t AdpcmHeaderWords = 2;
+    const size_t AdpcmBlockWords = AdpcmHeaderWords + CompactAudioBus::AdpcmBlockFrames / 4;
+
+    const int AdpcmIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+    const int AdpcmStepTable[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+        107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428,
+        4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+        22385, 24623, 27086, 29794, 32767
+    };
+
+    // The decoder's step, shared by the encoder so that it tracks what will be decoded.
+    inline void adpcmStep(int nibble, int & predictor, int & index)
+    {
+        const int step = AdpcmStepTable[index];
+        int delta = step >> 3;
+        if (nibble & 4) delta += step;
+        if (nibble & 2) delta += step >> 1;
+        if (nibble & 1) delta += step >> 2;
+        predictor += (nibble & 8) ? -delta : delta;
+        predictor = std::min(std::max(predictor, -32768), 32767);
+        index = std::min(std::max(index + AdpcmIndexTable[nibble & 7], 0), 88);
+    }
+
+    inline int adpcmEncode(int sample, int & predictor, int & index)
+    {
+        int step = AdpcmStepTable[index];
+        int diff = sample - predictor;
+        int nibble = 0;
+        if (diff < 0)
+        {
+            nibble = 8;
+            diff = -diff;
+        }
+        if (diff >= step) { nibble |= 4; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { nibble |= 2; diff -= step; }
+        step >>= 1;
+        if (diff >= step) nibble |= 1;
+        adpcmStep(nibble, predictor, index);
+        return nibble;
+    }
+
+    inline int16_t quantize16(float sample)
+    {
+        return static_cast<int16_t>(std::min(std::max(std::nearbyint(sample * 32768.f), -32768.f), 32767.f));
+    }
+
+    size_t adpcmBlocks(size_t length)
+    {
+        return (length + CompactAudioBus::AdpcmBlockFrames - 1) / CompactAudioBus::AdpcmBlockFrames;
+    }
+}
+
+const size_t CompactAudioBus::AdpcmBlockFrames;
+
+CompactAudioBus::CompactAudioBus(Format format, unsigned numberOfChannels, size_t length, float sampleRate)
+    : m_format(format)
+    , m_numberOfChannels(numberOfChannels)
+    , m_length(length)
+    , m_sampleRate(sampleRate)
+    , m_samples(numberOfChannels * (format == Format::ImaAdpcm ? adpcmBlocks(length) * AdpcmBlockWords : length))
+{
+}
+
+std::shared_ptr<CompactAudioBus> CompactAudioBus::create(const AudioBus & bus, Format format)
+{
+    unsigned numberOfChannels = static_cast<unsigned>(bus.numberOfChannels());
+    if (!numberOfChannels)
+        return nullptr;
+
+    size_t length = bus.length();
+    std::shared_ptr<CompactAudioBus> compact(new CompactAudioBus(format, numberOfChannels, length, bus.sampleRate()));
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+    {
+        const float * source = bus.channel(c)->data();
+        if (format == Format::ImaAdpcm)
+        {
+            // The state carries over from block to block, and is written at the start of each.
+            uint16_t * dest = compact->m_samples.data() + c * adpcmBlocks(length) * AdpcmBlockWords;
+            int predictor = 0;
+            int index = 0;
+            for (size_t first = 0; first < length; first += AdpcmBlockFrames, dest += AdpcmBlockWords)
+            {
+                dest[0] = static_cast<uint16_t>(static_cast<int16_t>(predictor));
+                dest[1] = static_cast<uint16_t>(index);
+                const size_t frames = std::min(AdpcmBlockFrames, length - first);
+                for (size_t i = 0; i < frames; ++i)
+                {
+                    const int nibble = adpcmEncode(quantize16(source[first + i]), predictor, index);
+                    dest[AdpcmHeaderWords + i / 4] |= static_cast<uint16_t>(nibble << (4 * (i & 3)));
+                }
+            }
+            continue;
+        }
+
+        uint16_t * dest = compact->m_samples.data() + c * length;
+        if (format == Format::Float16)
+        {
+            VectorMath::vfloatToHalf(source, dest, length);
+        }
+        else
+        {
+            // Scaled by 32768, the inverse of reading, so that 16 bit sources come back exactly.
+            for (size_t i = 0; i < length; ++i)
+                dest[i] = static_cast<uint16_t>(quantize16(source[i]));
+        }
+    }
+    return compact;
+}
+
+void CompactAudioBus::read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels) const
+{
+    bool isRangeGood = frame <= m_length && frameCount <= m_length - frame && numberOfChannels <= m_numberOfChannels;
+    ASSERT(isRangeGood);
+    if (!isRangeGood)
+        return;
+
+    if (m_format == Format::ImaAdpcm)
+    {
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+        {
+            float * dest = channels[c];
+            for (size_t i = 0; i < frameCount;)
+            {
+                const size_t block = (frame + i) / AdpcmBlockFrames;
+                const size_t skip = (frame + i) % AdpcmBlockFrames;
+                const size_t frames = std::min(AdpcmBlockFrames - skip, frameCount - i);
+                decode(c, block, skip, frames, dest + i);
+                i += frames;
+            }
+        }
+        return;
+    }
+
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+    {
+        const uint16_t * source = m_samples.data() + c * m_length + frame;
+        if (m_format == Format::Float16)
+            VectorMath::vhalfToFloat(source, channels[c], frameCount);
+        else
+            VectorMath::vdequantize16(reinterpret_cast<const int16_t *>(source), channels[c], frameCount);
+    }
+}
+
+float CompactAudioBus::sample(unsigned channel, size_t frame) const
+{
+    ASSERT(channel < m_numberOfChannels && frame < m_length);
+    if (m_format == Format::ImaAdpcm)
+    {
+        float value;
+        decode(channel, frame / AdpcmBlockFrames, frame % AdpcmBlockFrames, 1, &value);
+        return value;
+    }
+
+    const uint16_t * source = m_samples.data() + channel * m_length + frame;
+    float value;
+    if (m_format == Format::Float16)
+        VectorMath::vhalfToFloat(source, &value, 1);
+    else
+        value = *reinterpret_cast<const int16_t *>(source) * (1.0f / 32768.0f);
+    return value;
+}
+
+void CompactAudioBus::decode(unsigned channel, size_t block, size_t skip, size_t count, float * destination) const
+{
+    const uint16_t * source = m_samples.data() + (channel * adpcmBlocks(m_length) + block) * AdpcmBlockWords;
+    int predictor = static_cast<int16_t>(source[0]);
+    int index = source[1];
+    source += AdpcmHeaderWords;
+
+    const size_t end = skip + count;
+    for (size_t i = 0; i < end; ++i)
+    {
+        adpcmStep((source[i / 4] >> (4 * (i & 3))) & 15, predictor, index);
+        if (i >= skip)
+            destination[i - skip] = predictor * (1.0f / 32768.0f);
+    }
+}
+
+void CompactAudioBus::Reader::setBus(const CompactAudioBus * bus)
+{
+    m_bus = bus;
+    const size_t channels = bus && bus->m_format == Format::ImaAdpcm ? bus->m_numberOfChannels : 0;
+    m_decoded.assign(channels * AdpcmBlockFrames, 0.f);
+    m_blocks.assign(channels, SIZE_MAX);
+}
+
+const float * CompactAudioBus::Reader::block(unsigned channel, size_t frame)
+{
+    const size_t block = frame / AdpcmBlockFrames;
+    float * decoded = m_decoded.data() + channel * AdpcmBlockFrames;
+    if (m_blocks[channel] != block)
+    {
+        m_blocks[channel] = block;
+        m_bus->decode(channel, block, 0, std::min(AdpcmBlockFrames, m_bus->m_length - block * AdpcmBlockFrames), decoded);
+    }
+    return decoded;
+}
+
+void CompactAudioBus::Reader::read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels)
+{
+    if (!m_bus)
+        return;
+    if (m_bus->m_format != Format::ImaAdpcm)
+    {
+        m_bus->read(frame, frameCount, channels, numberOfChannels);
+        return;
+    }
+
+    bool isRangeGood = frame <= m_bus->m_length && frameCount <= m_bus->m_length - frame && numberOfChannels <= m_bus->m_numberOfChannels;
+    ASSERT(isRangeGood);
+    if (!isRangeGood)
+        return;
+
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+    {
+        for (size_t i = 0; i < frameCount;)
+        {
+            const size_t offset = (frame + i) % AdpcmBlockFrames;
+            const size_t frames = std::min(AdpcmBlockFrames - offset, frameCount - i);
+            const float * decoded = block(c, frame + i) + offset;
+            std::copy(decoded, decoded + frames, channels[c] + i);
+            i += frames;
+        }
+    }
+}
+
+float CompactAudioBus::Reader::sample(unsigned channel, size_t frame)
+{
+    if (m_bus->m_format != Format::ImaAdpcm)
+        return m_bus->sample(channel, frame);
+
+    ASSERT(channel < m_bus->m_numberOfChannels && frame < m_bus->m_length);
+    return block(channel, frame)[frame % AdpcmBlockFrames];
+}
+
+} // namespace lab
@@ -0,0 +1,276 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/DeviceOutputNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioIOCallback.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSourceProvider.h"
+#include "LabSound/core/Macros.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/AudioDestination.h"
+#include "internal/MultiChannelResampler.h"
+#include "internal/NullAudioDestination.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace lab
+{
+
+namespace
+{
+    // The ring's fill is averaged over about this long before the rate follows it, so that the burstiness of the
+    // two callbacks doesn't reach the resampler.
+    const double FillSeconds = 1;
+
+    // The rate moves by DriftGain per ring's worth of error in the fill, and no further than MaxDrift.
+    const double DriftGain = 0.002;
+    const double MaxDrift = 0.002;
+
+    // SincResampler's default kernel, which its blocks must be longer than.
+    const size_t ResamplerKernelSize = 32;
+}
+
+// The render thread writes quanta to the ring, and the device's callback reads them through the resampler.
+class DeviceOutputNode::Device : public AudioIOCallback, public AudioSourceProvider
+{
+public:
+
+    Device(int channels, float sampleRate, size_t renderQuantumSize, double bufferSeconds)
+        : m_channels(channels)
+        , m_sampleRate(sampleRate)
+        , m_target(std::max(static_cast<size_t>(bufferSeconds * sampleRate), renderQuantumSize))
+    {
+        m_capacity = 1;
+        while (m_capacity < m_target * 2 + renderQuantumSize)
+            m_capacity *= 2;
+        m_samples.resize(m_capacity * channels);
+
+        size_t blockSize = renderQuantumSize;
+        while (blockSize <= ResamplerKernelSize)
+            blockSize *= 2;
+        m_resampler.reset(new MultiChannelResampler(1.0, channels, blockSize));
+    }
+
+    // Called on the render thread.
+    void write(const AudioBus & bus, size_t frames)
+    {
+        const uint64_t written = m_written.load(std::memory_order_relaxed);
+        if (m_capacity - (written - m_read.load(std::memory_order_acquire)) < frames)
+        {
+            m_overruns.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const size_t start = written & (m_capacity - 1);
+        const size_t first = std::min(frames, m_capacity - start);
+        for (int c = 0; c < m_channels; ++c)
+        {
+            const AudioChannel * channel = bus.channel(c);
+            float * ring = &m_samples[c * m_capacity];
+            if (channel->isSilent())
+            {
+                memset(ring + start, 0, sizeof(float) * first);
+                memset(ring, 0, sizeof(float) * (frames - first));
+            }
+            else
+            {
+                memcpy(ring + start, channel->data(), sizeof(float) * first);
+                memcpy(ring, channel->data() + first, sizeof(float) * (frames - first));
+            }
+        }
+
+        m_written.store(written + frames, std::memory_order_release);
+    }
+
+    // AudioIOCallback, called on the device's thread.
+    virtual void render(AudioBus *, AudioBus * destinationBus, size_t framesToProcess) override
+    {
+        if (!destinationBus)
+            return;
+
+        const size_t available = this->available();
+        if (!m_primed)
+        {
+            if (available < m_target)
+            {
+                destinationBus->zero();
+                return;
+            }
+            m_primed = true;
+            m_fill = static_cast<double>(available);
+        }
+
+        // Reading faster as the ring fills past the target, and slower as it drains, settles the rate on the
+        // ratio between the two clocks.
+        const double weight = 1 - std::exp(-static_cast<double>(framesToProcess) / (m_sampleRate * FillSeconds));
+        m_fill += (available - m_fill) * weight;
+        const double error = (m_fill - m_target) / m_target;
+        const double ratio = clampTo(1 + error * DriftGain, 1 - MaxDrift, 1 + MaxDrift);
+        m_ratio.store(ratio, std::memory_order_relaxed);
+
+        m_resampler->setScaleFactor(ratio);
+        m_resampler->process(this, destinationBus, framesToProcess);
+    }
+
+    // AudioSourceProvider, called by the resampler on the device's thread.
+    virtual void provideInput(AudioBus * bus, size_t framesToProcess) override
+    {
+        const uint64_t read = m_read.load(std::memory_order_relaxed);
+        const size_t frames = std::min(framesToProcess, available());
+        const size_t start = read & (m_capacity - 1);
+        const size_t first = std::min(frames, m_capacity - start);
+
+        const int channels = std::min(m_channels, static_cast<int>(bus->numberOfChannels()));
+        for (int c = 0; c < channels; ++c)
+        {
+            float * destination = bus->channel(c)->mutableData();
+            const float * ring = &m_samples[c * m_capacity];
+            memcpy(destination, ring + start, sizeof(float) * first);
+            memcpy(destination + first, ring, sizeof(float) * (frames - first));
+            memset(destination + frames, 0, sizeof(float) * (framesToProcess - frames));
+        }
+
+        m_read.store(read + frames, std::memory_order_release);
+
+        // Once the ring runs dry the device waits for it to fill again, rather than stuttering on every quantum.
+        if (frames < framesToProcess)
+        {
+            m_underruns.fetch_add(1, std::memory_order_relaxed);
+            m_primed = false;
+        }
+    }
+
+    size_t available() const
+    {
+        return static_cast<size_t>(m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed));
+    }
+
+    double latency() const
+    {
+        return (m_target + m_resampler->latencyFrames()) / static_cast<double>(m_sampleRate);
+    }
+
+    const int m_channels;
+    const float m_sampleRate;
+    const size_t m_target;
+
+    std::atomic<double> m_ratio{ 1 };
+    std::atomic<uint64_t> m_underruns{ 0 };
+    std::atomic<uint64_t> m_overruns{ 0 };
+
+private:
+
+    // Planar, m_capacity frames, a power of two, per channel. Each side owns its own count.
+    std::vector<float> m_samples;
+    size_t m_capacity;
+    std::atomic<uint64_t> m_written{ 0 };
+    std::atomic<uint64_t> m_read{ 0 };
+
+    // Owned by the device's thread.
+    std::unique_ptr<MultiChannelResampler> m_resampler;
+    bool m_primed = false;
+    double m_fill = 0;
+};
+
+DeviceOutputNode::DeviceOutputNode(AudioContext & context, const AudioDeviceSettings & settings, int channels, double bufferSeconds)
+    : AudioBasicInspectorNode(2)
+{
+    channels = clampTo(channels, 1, static_cast<int>(context.channelLimit()));
+    const float sampleRate = context.sampleRate();
+    const size_t quantum = context.renderQuantumSize();
+
+    m_device.reset(new Device(channels, sampleRate, quantum, bufferSeconds));
+    m_mix.reset(new AudioBus(channels, quantum));
+
+    // As the context's destination does, the Null backend is made here rather than by the platform's factory.
+    if (settings.backend == AudioDeviceSettings::Backend::Null)
+        m_destination.reset(new NullAudioDestination(*m_device, channels, sampleRate, quantum, settings));
+    else
+        m_destination.reset(AudioDestination::MakePlatformAudioDestination(*m_device, channels, sampleRate, quantum, settings));
+
+    if (m_destination)
+        m_destination->start();
+}
+
+DeviceOutputNode::~DeviceOutputNode()
+{
+    if (m_destination)
+        m_destination->stop();
+    uninitialize();
+}
+
+void DeviceOutputNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+
+    if (!isInitialized() || !input(0)->isConnected())
+    {
+        if (outputBus)
+            outputBus->zero();
+
+        // The device is fed silence, rather than left to underrun.
+        m_mix->zero();
+        m_device->write(*m_mix, std::min(framesToProcess, m_mix->length()));
+        return;
+    }
+
+    AudioBus * bus = input(0)->bus(r);
+    bool isBusGood = bus && (bus->numberOfChannels() > 0) && (bus->channel(0)->length() >= framesToProcess);
+
+    if (!isBusGood)
+    {
+        outputBus->zero();
+        return;
+    }
+
+    // Mixed to the device's channels only when they differ; the mix is sized for the render quantum.
+    const AudioBus * deviceBus = bus;
+    if (bus->numberOfChannels() != static_cast<size_t>(m_device->m_channels))
+    {
+        if (m_mix->length() != bus->length())
+            m_mix.reset(new AudioBus(m_device->m_channels, bus->length()));
+        m_mix->copyFrom(*bus);
+        deviceBus = m_mix.get();
+    }
+    m_device->write(*deviceBus, framesToProcess);
+
+    // As with the RecorderNode, the input passes through unless it had to be mixed to the output's channels.
+    if (bus != outputBus)
+        outputBus->copyFrom(*bus);
+}
+
+void DeviceOutputNode::reset(ContextRenderLock &)
+{
+}
+
+double DeviceOutputNode::driftRatio() const
+{
+    return m_device->m_ratio.load(std::memory_order_relaxed);
+}
+
+uint64_t DeviceOutputNode::underrunCount() const
+{
+    return m_device->m_underruns.load(std::memory_order_relaxed);
+}
+
+uint64_t DeviceOutputNode::overrunCount() const
+{
+    return m_device->m_overruns.load(std::memory_order_relaxed);
+}
+
+double DeviceOutputNode::latency() const
+{
+    return m_device->latency();
+}
+
+} // namespace lab
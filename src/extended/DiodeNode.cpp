@@ -5,7 +5,12 @@
 
 #include "LabSound/core/AudioSetting.h"
 #include "LabSound/core/Macros.h"
+
+#include "internal/VectorMath.h"
+
+#include <limits>
 #include <mutex>
+#include <vector>
 
 namespace lab
 {
@@ -37,24 +42,31 @@ void DiodeNode::setCurve()
 
     float h = _distortion->valueFloat();
 
-    const int samples = 1024;
-
-    std::vector<float> wsCurve;
-    wsCurve.resize(samples);
-
-    float s = float(samples);
-    for (int i = 0; i < samples; ++i)
-    {
-        // convert the index to a voltage of range -1 to 1
-        float v = fabsf((float(i) - s / 2.0f) / (s / 2.0f));
-        if (v <= vb)
-            v = 0;
-        else if ((vb < v) && (v <= vl))
-            v = h * powf(v - vb, 2.0f) / (2 * vl - 2.0f * vb);
-        else
-            v = h * v - h * vl + (h * ((powf(vl - vb, 2.0f)) / (2.0f * vl - 2.0f * vb)));
-        wsCurve[i] = v;
-    }
+    const size_t samples = 1024;
+    const size_t half = samples / 2;
+
+    // The index as a voltage of range -1 to 1, folded to its magnitude: down from 1 to 0, then up again.
+    std::vector<float> voltage(samples);
+    const float top = 1.f;
+    const float down = -1.f / float(half);
+    const float up = 1.f / float(half);
+    VectorMath::vramp(&top, &down, voltage.data(), half + 1);
+    VectorMath::vramp(&up, &up, voltage.data() + half + 1, samples - half - 1);
+
+    // Zero up to vb, a parabola from vb to vl, and a line of gradient h beyond, in one expression: the parabola
+    // over the voltage clipped to [vb, vl], plus the line over the voltage's excess above vl.
+    std::vector<float> wsCurve(samples);
+    const float fMax = std::numeric_limits<float>::max();
+    const float minusVb = -vb;
+    const float minusVl = -vl;
+    const float scale = h / (2.f * vl - 2.f * vb);
+    VectorMath::vclip(voltage.data(), 1, &vb, &vl, wsCurve.data(), 1, samples);
+    VectorMath::vsadd(wsCurve.data(), &minusVb, wsCurve.data(), samples);
+    VectorMath::vmul(wsCurve.data(), 1, wsCurve.data(), 1, wsCurve.data(), 1, samples);
+    VectorMath::vsmul(wsCurve.data(), 1, &scale, wsCurve.data(), 1, samples);
+    VectorMath::vclip(voltage.data(), 1, &vl, &fMax, voltage.data(), 1, samples);
+    VectorMath::vsadd(voltage.data(), &minusVl, voltage.data(), samples);
+    VectorMath::vsma(voltage.data(), 1, &h, wsCurve.data(), 1, samples);
 
     waveShaper->setCurve(std::move(wsCurve));
 }
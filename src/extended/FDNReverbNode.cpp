@@ -0,0 +1,429 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/FDNReverbNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
+namespace lab
+{
+
+namespace
+{
+    const unsigned StereoChannels = 2;
+
+    // The network is run in blocks no longer than this, nor than its shortest line less half a frame, so that
+    // every frame a block reads was written by an earlier block.
+    enum { BlockFrames = 128 };
+
+    // The shortest and the longest line, in seconds, at a size of 1. Lengths in between are spread geometrically.
+    const double ShortestLine = 0.023;
+    const double LongestLine = 0.089;
+
+    const float MinSize = 0.1f;
+    const float MaxModulationDepth = 0.004f;
+
+    // The widest gap between primes below the longest line at 192kHz is under this.
+    const size_t PrimeSlack = 128;
+
+    const double piDouble = 3.14159265358979323846;
+
+    bool isPrime(size_t n)
+    {
+        if (n < 2)
+            return false;
+        for (size_t d = 2; d * d <= n; ++d)
+            if (n % d == 0)
+                return false;
+        return true;
+    }
+
+    // Lines of mutually prime lengths don't resonate together.
+    size_t primeAtOrAbove(size_t n)
+    {
+        while (!isPrime(n))
+            ++n;
+        return n;
+    }
+
+    // a, b = a + b, a - b.
+    void butterfly(float * a, float * b, size_t framesToProcess)
+    {
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(a + i);
+            __m128 y = _mm_loadu_ps(b + i);
+            _mm_storeu_ps(a + i, _mm_add_ps(x, y));
+            _mm_storeu_ps(b + i, _mm_sub_ps(x, y));
+        }
+#elif defined(ARM_NEON_INTRINSICS)
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            float32x4_t x = vld1q_f32(a + i);
+            float32x4_t y = vld1q_f32(b + i);
+            vst1q_f32(a + i, vaddq_f32(x, y));
+            vst1q_f32(b + i, vsubq_f32(x, y));
+        }
+#endif
+
+        for (; i < framesToProcess; ++i)
+        {
+            const float x = a[i];
+            const float y = b[i];
+            a[i] = x + y;
+            b[i] = x - y;
+        }
+    }
+}
+
+struct FDNReverbNode::Internals
+{
+    Internals(float sampleRate)
+        : capacity(static_cast<size_t>(std::ceil((LongestLine + MaxModulationDepth) * sampleRate)) + PrimeSlack + 2)
+        , rows(MaxLines * BlockFrames)
+    {
+        for (uint32_t i = 0; i < MaxLines; ++i)
+            lines[i].allocate(capacity + 1);
+    }
+
+    void reset()
+    {
+        for (uint32_t i = 0; i < MaxLines; ++i)
+        {
+            lines[i].zero();
+            state[i] = 0;
+            interpolatorState[i] = 0;
+            lastDelay[i] = lengths[i];
+        }
+        writeIndex = 0;
+        phase = 0;
+    }
+
+    // The lines are as long as size makes them, and the feedback matrix is a Hadamard matrix; it is orthogonal,
+    // so that the network is lossless but for the damping filters.
+    void designLines(uint32_t count, float size, float sampleRate)
+    {
+        const double ratio = LongestLine / ShortestLine;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const double seconds = size * ShortestLine * std::pow(ratio, static_cast<double>(i) / (count - 1));
+            lengths[i] = static_cast<float>(primeAtOrAbove(std::max(size_t(2), static_cast<size_t>(seconds * sampleRate))));
+        }
+        lineCount = count;
+        designedSize = size;
+    }
+
+    // Each line's damping filter is a one pole lowpass, g (1 - p) / (1 - p z^-1), whose gain at DC sets the decay
+    // of the line's length, and whose gain at Nyquist the faster decay given by damping. The matrix' 1 / sqrt(N)
+    // normalization is folded into the filter.
+    void designDamping(float decayTime, float damping, float sampleRate)
+    {
+        const double highFrequencyRatio = 1 - 0.95 * damping;
+        const double normalization = 1 / std::sqrt(static_cast<double>(lineCount));
+        for (uint32_t i = 0; i < lineCount; ++i)
+        {
+            const double g = std::pow(10.0, -3.0 * lengths[i] / (sampleRate * decayTime));
+            const double gNyquist = std::pow(10.0, -3.0 * lengths[i] / (sampleRate * decayTime * highFrequencyRatio));
+            const double p = (g - gNyquist) / (g + gNyquist);
+            pole[i] = static_cast<float>(p);
+            feed[i] = static_cast<float>(g * (1 - p) * normalization);
+        }
+        designedDecayTime = decayTime;
+        designedDamping = damping;
+    }
+
+    // The delay of each line at the LFO's phase; the lines' LFOs are spread evenly around the cycle.
+    float delayAt(uint32_t line, double atPhase, float depthFrames) const
+    {
+        const double offset = 2 * piDouble * line / lineCount;
+        return lengths[line] + 0.5f * depthFrames * static_cast<float>(1 + std::sin(atPhase + offset));
+    }
+
+    // Every line has the same capacity, so they share a write index. A line is followed by a copy of its first
+    // frame, so that the frame after the last is read without wrapping.
+    size_t capacity;
+    AudioFloatArray lines[MaxLines];
+    size_t writeIndex = 0;
+
+    // A block of each line's output, one row per line, which the matrix mixes in place.
+    AudioFloatArray rows;
+
+    float lengths[MaxLines] = {};
+    float lastDelay[MaxLines] = {};
+    float feed[MaxLines] = {};
+    float pole[MaxLines] = {};
+    float state[MaxLines] = {};
+    float interpolatorState[MaxLines] = {};
+    double phase = 0;
+
+    uint32_t lineCount = 0;
+    float designedSize = 0;
+    uint32_t linesVersion = 0; // of the settings the lines were designed for
+    uint32_t sizeVersion = 0;
+    float designedDecayTime = 0;
+    float designedDamping = -1;
+};
+
+FDNReverbNode::FDNReverbNode(float sampleRate)
+    : AudioNode()
+    , m_lines(std::make_shared<AudioSetting>("lines"))
+    , m_size(std::make_shared<AudioSetting>("size"))
+    , m_sampleRate(sampleRate)
+{
+    m_decayTime = std::make_shared<AudioParam>("decayTime", 2, 0.1, 30);
+    m_damping = std::make_shared<AudioParam>("damping", 0.5, 0, 1);
+    m_modulationRate = std::make_shared<AudioParam>("modulationRate", 0.5, 0, 5);
+    m_modulationDepth = std::make_shared<AudioParam>("modulationDepth", 0.0005, 0, MaxModulationDepth);
+    m_params.push_back(m_decayTime);
+    m_params.push_back(m_damping);
+    m_params.push_back(m_modulationRate);
+    m_params.push_back(m_modulationDepth);
+
+    m_lines->setUint32(MaxLines);
+    m_lines->setValueChanged(
+        [this]()
+        {
+            uint32_t lines = m_lines->valueUint32();
+            if (lines != 8 && lines != MaxLines)
+                throw std::out_of_range("An FDN reverb has 8 or 16 lines");
+        });
+    m_size->setFloat(1.f);
+    m_settings.push_back(m_lines);
+    m_settings.push_back(m_size);
+
+    addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, StereoChannels)));
+
+    initialize();
+}
+
+FDNReverbNode::~FDNReverbNode()
+{
+    uninitialize();
+}
+
+void FDNReverbNode::initialize()
+{
+    if (isInitialized())
+        return;
+
+    m_internal.reset(new Internals(m_sampleRate));
+
+    AudioNode::initialize();
+}
+
+void FDNReverbNode::uninitialize()
+{
+    if (!isInitialized())
+        return;
+
+    AudioNode::uninitialize();
+
+    m_internal.reset();
+}
+
+uint32_t FDNReverbNode::lines() const { return m_lines->valueUint32(); }
+void FDNReverbNode::setLines(uint32_t lines) { m_lines->setUint32(lines); }
+float FDNReverbNode::size() const { return m_size->valueFloat(); }
+void FDNReverbNode::setSize(float size) { m_size->setFloat(size); }
+
+void FDNReverbNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    ASSERT(outputBus);
+
+    if (!isInitialized() || !r.context())
+    {
+        outputBus->zero();
+        return;
+    }
+
+    Internals & internal = *m_internal;
+    const float sampleRate = m_sampleRate;
+
+    // The lines start over as their number changes, and keep their contents as their lengths do; the read
+    // positions then sweep to the new lengths over a block. The settings are only looked at as they change.
+    if (m_lines->changed(internal.linesVersion) | m_size->changed(internal.sizeVersion))
+    {
+        const uint32_t lineCount = m_lines->valueUint32() == 8 ? 8 : MaxLines;
+        const float size = std::max(MinSize, std::min(m_size->valueFloat(), 1.f));
+        if (lineCount != internal.lineCount)
+        {
+            internal.designLines(lineCount, size, sampleRate);
+            internal.designedDamping = -1;
+            internal.reset();
+        }
+        else if (size != internal.designedSize)
+        {
+            internal.designLines(lineCount, size, sampleRate);
+            internal.designedDamping = -1;
+        }
+    }
+    const uint32_t lineCount = internal.lineCount;
+
+    const float decayTime = m_decayTime->value(r);
+    const float damping = m_damping->value(r);
+    if (decayTime != internal.designedDecayTime || damping != internal.designedDamping)
+        internal.designDamping(decayTime, damping, sampleRate);
+
+    const double phaseIncrement = 2 * piDouble * m_modulationRate->value(r) / sampleRate;
+    const float depthFrames = m_modulationDepth->value(r) * sampleRate;
+
+    // A mono input feeds every line, and no input lets the tail ring out.
+    const float * sourceL = nullptr;
+    const float * sourceR = nullptr;
+    if (input(0)->isConnected())
+    {
+        AudioBus * inputBus = input(0)->bus(r);
+        sourceL = inputBus->channel(0)->data();
+        sourceR = inputBus->numberOfChannels() > 1 ? inputBus->channel(1)->data() : sourceL;
+    }
+
+    // Each channel feeds half of the lines, at the gain that keeps its energy.
+    const float inputGain = std::sqrt(2.f / lineCount);
+    const float negativeInputGain = -inputGain;
+
+    float * destinationL = outputBus->channel(0)->mutableData();
+    float * destinationR = outputBus->channel(1)->mutableData();
+
+    const size_t capacity = internal.capacity;
+    float * rows = internal.rows.data();
+
+    size_t frame = 0;
+    while (frame < framesToProcess)
+    {
+        float shortest = static_cast<float>(BlockFrames);
+        for (uint32_t i = 0; i < lineCount; ++i)
+            shortest = std::min(shortest, std::min(internal.lastDelay[i], internal.lengths[i]));
+        const size_t frames = std::min(framesToProcess - frame, static_cast<size_t>(shortest - 0.5f));
+        const double endPhase = internal.phase + phaseIncrement * frames;
+
+        // Each line is read along a delay ramping from where the last block left it to where the LFO is at the
+        // end of this block, and through its damping filter. Linear interpolation would lowpass the line by an
+        // amount that changes with the delay's fraction, on every round, so the fraction is delayed by a first
+        // order allpass instead, keeping it within half a frame of 1 so that the allpass stays well damped. The
+        // read position, half a frame on, moves by one frame less the delay's step each frame. Every frame read
+        // was written before the block began.
+        const size_t writeIndex = internal.writeIndex;
+        for (uint32_t i = 0; i < lineCount; ++i)
+        {
+            const float * line = internal.lines[i].data();
+            float * row = rows + i * BlockFrames;
+
+            const float startDelay = internal.lastDelay[i];
+            const float endDelay = internal.delayAt(i, endPhase, depthFrames);
+            const double delayStep = static_cast<double>(endDelay - startDelay) / frames;
+            const double increment = 1 - delayStep;
+            double readPosition = static_cast<double>(writeIndex + capacity) - startDelay - delayStep + 0.5;
+            if (readPosition >= capacity)
+                readPosition -= capacity;
+
+            const float feed = internal.feed[i];
+            const float pole = internal.pole[i];
+            float z = internal.state[i];
+            float interpolated = internal.interpolatorState[i];
+
+            for (size_t k = 0; k < frames; ++k)
+            {
+                // The delay past the newer frame is 1.5 less the position's fraction.
+                const int older = static_cast<int>(readPosition);
+                const float fraction = static_cast<float>(readPosition - older);
+                const float eta = (fraction - 0.5f) / (2.5f - fraction);
+                interpolated = line[older] + eta * (line[older + 1] - interpolated);
+
+                z = feed * interpolated + pole * z;
+                row[k] = z;
+
+                readPosition += increment;
+                if (readPosition >= capacity)
+                    readPosition -= capacity;
+            }
+
+            internal.state[i] = z;
+            internal.interpolatorState[i] = interpolated;
+            internal.lastDelay[i] = endDelay;
+        }
+
+        // The fast Hadamard transform, log2 N passes of butterflies between whole rows.
+        for (uint32_t span = 1; span < lineCount; span *= 2)
+            for (uint32_t i = 0; i < lineCount; i += 2 * span)
+                for (uint32_t j = i; j < i + span; ++j)
+                    butterfly(rows + j * BlockFrames, rows + (j + span) * BlockFrames, frames);
+
+        // Every row but the first is a balanced combination of all the lines, and any two are uncorrelated.
+        ::memcpy(destinationL + frame, rows + 1 * BlockFrames, sizeof(float) * frames);
+        ::memcpy(destinationR + frame, rows + 2 * BlockFrames, sizeof(float) * frames);
+
+        // The input enters after the matrix, into the even lines from the left and the odd from the right, with
+        // the signs alternating by pairs so that the lines don't start out in step.
+        if (sourceL)
+        {
+            for (uint32_t i = 0; i < lineCount; ++i)
+            {
+                const float * source = ((i & 1) ? sourceR : sourceL) + frame;
+                const float * gain = (i & 2) ? &negativeInputGain : &inputGain;
+                VectorMath::vsma(source, 1, gain, rows + i * BlockFrames, 1, frames);
+            }
+        }
+
+        // The rows are written to the lines in at most two spans, and the guard frame past the end of a line
+        // follows its first frame.
+        const size_t firstSpan = std::min(frames, capacity - writeIndex);
+        for (uint32_t i = 0; i < lineCount; ++i)
+        {
+            float * line = internal.lines[i].data();
+            const float * row = rows + i * BlockFrames;
+            ::memcpy(line + writeIndex, row, sizeof(float) * firstSpan);
+            if (firstSpan < frames)
+                ::memcpy(line, row + firstSpan, sizeof(float) * (frames - firstSpan));
+            if (writeIndex == 0 || firstSpan < frames)
+                line[capacity] = line[0];
+        }
+
+        internal.writeIndex = writeIndex + frames >= capacity ? writeIndex + frames - capacity : writeIndex + frames;
+        internal.phase = std::fmod(endPhase, 2 * piDouble);
+        frame += frames;
+    }
+
+    outputBus->clearSilentFlag();
+}
+
+void FDNReverbNode::reset(ContextRenderLock &)
+{
+    if (m_internal)
+        m_internal->reset();
+}
+
+// The tail lasts until the network is 80dB down, and a round through its longest line after.
+double FDNReverbNode::tailTime(ContextRenderLock & r) const
+{
+    const double longest = (LongestLine + MaxModulationDepth) * std::max(MinSize, std::min(m_size->valueFloat(), 1.f));
+    return m_decayTime->value(r) * 80.0 / 60.0 + longest;
+}
+
+} // namespace lab
@@ -0,0 +1,548 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/FeatureExtractorNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/WindowFunctions.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/FFTFrame.h"
+#include "internal/SharedSpectrum.h"
+#include "internal/TripleBuffer.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace lab
+{
+
+namespace
+{
+    const uint32_t MinWindowSize = 64;
+    const uint32_t MaxWindowSize = 16384;
+
+    // Magnitudes are compressed as log(1 + Compression * magnitude) before their flux is taken, so that quiet
+    // onsets count as well as loud ones.
+    const float Compression = 100.f;
+
+    // The flux is compared with its average over this many frames, and an onset is followed by at least
+    // RefractorySeconds without another.
+    const size_t FluxHistory = 16;
+    const double RefractorySeconds = 0.05;
+
+    // The least flux, averaged over the bins, that can be an onset. A steady tone's leakage wavers under it.
+    const float MinOnsetFlux = 0.002f;
+
+    // The McLeod pitch method takes the first of the normalized autocorrelation's key maxima within this
+    // fraction of the highest.
+    const float KeyMaximumThreshold = 0.9f;
+
+    // The floor of the mel band energies, before their log is taken.
+    const float MinEnergy = 1e-10f;
+
+    const double piDouble = 3.14159265358979323846;
+
+    uint32_t nextPowerOfTwo(uint32_t n)
+    {
+        uint32_t size = 1;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+
+    double hzToMel(double hz) { return 2595.0 * std::log10(1.0 + hz / 700.0); }
+    double melToHz(double mel) { return 700.0 * (std::pow(10.0, mel / 2595.0) - 1.0); }
+}
+
+// Everything that depends on the settings, rebuilt when they change.
+struct FeatureExtractorNode::Analysis
+{
+    Analysis(float sampleRate, uint32_t windowSize, uint32_t hopSize, uint32_t melBandCount, uint32_t mfccCount,
+             float minPitch, float maxPitch, float onsetThreshold, uint32_t features);
+
+    // Called from the shared spectrum with each frame's spectrum, and the input it was taken from.
+    void analyseFrame(FFTFrame & frame, const float * input, Features & result);
+
+    void computeMelBands(Features & result);
+    void computeOnset(Features & result);
+    void computePitch(Features & result);
+
+    float sampleRate;
+    uint32_t features;
+
+    // Shared with other analysers of the same source, see process().
+    std::shared_ptr<SharedSpectrum> spectrum;
+    const float * input = nullptr;
+    size_t bins;
+
+    // The magnitude spectrum, scaled so that a full scale sine at a bin's frequency has a magnitude of 1, and
+    // its square.
+    AudioFloatArray magnitude;
+    AudioFloatArray power;
+    AudioFloatArray scratch;
+    AudioFloatArray binFrequencies;
+
+    // Each band's triangle of weights over the power spectrum, packed one after another.
+    uint32_t melBandCount;
+    std::vector<uint32_t> bandStart;
+    std::vector<uint32_t> bandLength;
+    std::vector<uint32_t> bandOffset;
+    AudioFloatArray bandWeights;
+
+    // The orthonormal DCT-II, a row per coefficient.
+    uint32_t mfccCount;
+    AudioFloatArray dct;
+
+    AudioFloatArray compressed;
+    AudioFloatArray previousCompressed;
+    float onsetThreshold;
+    float fluxHistory[FluxHistory] = {};
+    float fluxSum = 0;
+    size_t fluxIndex = 0;
+    uint64_t refractoryFrames;
+    uint64_t framesSinceOnset;
+
+    // The frame zero padded to twice its length, so that the autocorrelation found through the FFT isn't circular.
+    FFTFrame autocorrelationFrame;
+    AudioFloatArray padded;
+    AudioFloatArray autocorrelationScratch;
+    AudioFloatArray nsdf;
+    size_t minLag;
+    size_t maxLag;
+
+    uint64_t hops = 0;
+};
+
+FeatureExtractorNode::Analysis::Analysis(float sampleRate, uint32_t windowSize, uint32_t hopSize, uint32_t melBandCount,
+                                         uint32_t mfccCount, float minPitch, float maxPitch, float onsetThreshold, uint32_t features)
+    : sampleRate(sampleRate)
+    , features(features)
+    , spectrum(SharedSpectrum::acquire({ nullptr, window_hanning, windowSize, hopSize, AudioNode::ProcessingSizeInFrames }))
+    , bins(spectrum->fftSize() / 2 + 1)
+    , magnitude(bins)
+    , power(bins)
+    , scratch(bins)
+    , binFrequencies(bins)
+    , melBandCount(melBandCount)
+    , mfccCount(std::min(mfccCount, melBandCount))
+    , dct(std::max<size_t>(size_t(mfccCount) * melBandCount, 1))
+    , compressed(bins)
+    , previousCompressed(bins)
+    , onsetThreshold(onsetThreshold)
+    , refractoryFrames(static_cast<uint64_t>(std::ceil(RefractorySeconds * sampleRate / spectrum->hopSize())))
+    , framesSinceOnset(refractoryFrames)
+    , autocorrelationFrame(2 * spectrum->fftSize())
+    , padded(2 * spectrum->fftSize())
+    , autocorrelationScratch(spectrum->fftSize())
+{
+    const size_t fftSize = spectrum->fftSize();
+    for (size_t k = 0; k < bins; ++k)
+        binFrequencies[k] = static_cast<float>(k * sampleRate / fftSize);
+
+    // The bands' edges are spaced evenly in mels up to the Nyquist frequency, each band's triangle rising from
+    // the centre of the band below to its own centre, and falling to the centre of the band above.
+    const double topMel = hzToMel(sampleRate * 0.5);
+    std::vector<double> edges(melBandCount + 2);
+    for (size_t i = 0; i < edges.size(); ++i)
+        edges[i] = melToHz(topMel * i / (melBandCount + 1)) * fftSize / sampleRate;
+
+    std::vector<float> weights;
+    for (uint32_t m = 0; m < melBandCount; ++m)
+    {
+        const double lower = edges[m], centre = edges[m + 1], upper = edges[m + 2];
+        const uint32_t first = static_cast<uint32_t>(std::ceil(lower));
+        const uint32_t last = std::min(static_cast<uint32_t>(std::floor(upper)), static_cast<uint32_t>(bins - 1));
+        bandStart.push_back(first);
+        bandOffset.push_back(static_cast<uint32_t>(weights.size()));
+        for (uint32_t k = first; k <= last; ++k)
+        {
+            const double w = k <= centre ? (k - lower) / std::max(centre - lower, 1e-9) : (upper - k) / std::max(upper - centre, 1e-9);
+            weights.push_back(static_cast<float>(std::max(w, 0.0)));
+        }
+        bandLength.push_back(static_cast<uint32_t>(weights.size()) - bandOffset.back());
+    }
+    bandWeights.allocate(std::max<size_t>(weights.size(), 1));
+    if (!weights.empty())
+        std::memcpy(bandWeights.data(), weights.data(), sizeof(float) * weights.size());
+
+    for (uint32_t i = 0; i < this->mfccCount; ++i)
+    {
+        const double scale = std::sqrt((i == 0 ? 1.0 : 2.0) / melBandCount);
+        for (uint32_t m = 0; m < melBandCount; ++m)
+            dct[i * melBandCount + m] = static_cast<float>(scale * std::cos(piDouble * i * (m + 0.5) / melBandCount));
+    }
+
+    // The lags are limited to half the window, so that every lag's autocorrelation sums over as many frames.
+    minLag = std::max<size_t>(static_cast<size_t>(sampleRate / std::max(maxPitch, 1.f)), 2);
+    maxLag = std::max(std::min<size_t>(static_cast<size_t>(std::ceil(sampleRate / std::max(minPitch, 1.f))), windowSize / 2), minLag + 1);
+    nsdf.allocate(maxLag + 2);
+}
+
+void FeatureExtractorNode::Analysis::analyseFrame(FFTFrame & frame, const float * input, Features & result)
+{
+    this->input = input;
+
+    // The Nyquist bin is packed into the first imaginary component.
+    const size_t half = bins - 1;
+    const float * real = frame.realData();
+    const float * imag = frame.imagData();
+    float * p = power.data();
+    VectorMath::vmul(real, 1, real, 1, p, 1, half);
+    VectorMath::vmul(imag, 1, imag, 1, scratch.data(), 1, half);
+    VectorMath::vadd(p, 1, scratch.data(), 1, p, 1, half);
+    p[0] = real[0] * real[0];
+    p[half] = imag[0] * imag[0];
+
+    // A Hann window sums to half its length, so a full scale sine's bin comes out at a quarter of it.
+    const float scale = 4.f / spectrum->windowSize();
+    const float powerScale = scale * scale;
+    VectorMath::vsmul(p, 1, &powerScale, p, 1, bins);
+    const float one_half = 0.5f;
+    VectorMath::vpow(p, &one_half, magnitude.data(), bins);
+
+    ++hops;
+
+    if (features & (MelBands | MFCC))
+        computeMelBands(result);
+
+    if (features & Centroid)
+    {
+        float weighted = 0, total = 0;
+        const float * m = magnitude.data();
+        const float * f = binFrequencies.data();
+        for (size_t k = 0; k < bins; ++k)
+        {
+            weighted += f[k] * m[k];
+            total += m[k];
+        }
+        result.centroid = total > 0 ? weighted / total : 0;
+    }
+
+    if (features & Onset)
+        computeOnset(result);
+
+    if (features & Pitch)
+        computePitch(result);
+}
+
+void FeatureExtractorNode::Analysis::computeMelBands(Features & result)
+{
+    const float * p = power.data();
+    const float * weights = bandWeights.data();
+    result.melBandCount = melBandCount;
+    for (uint32_t m = 0; m < melBandCount; ++m)
+    {
+        const float * w = weights + bandOffset[m];
+        const float * source = p + bandStart[m];
+        float energy = 0;
+        for (uint32_t k = 0; k < bandLength[m]; ++k)
+            energy += w[k] * source[k];
+        result.melBands[m] = std::max(energy, MinEnergy);
+    }
+    VectorMath::vlog(result.melBands, result.melBands, melBandCount);
+
+    if (!(features & MFCC))
+        return;
+
+    result.mfccCount = mfccCount;
+    for (uint32_t i = 0; i < mfccCount; ++i)
+    {
+        const float * row = dct.data() + i * melBandCount;
+        float sum = 0;
+        for (uint32_t m = 0; m < melBandCount; ++m)
+            sum += row[m] * result.melBands[m];
+        result.mfcc[i] = sum;
+    }
+}
+
+void FeatureExtractorNode::Analysis::computeOnset(Features & result)
+{
+    // The flux is the rise in compressed magnitude, summed over the bins that rose.
+    float * c = compressed.data();
+    const float compression = Compression;
+    const float one = 1.f;
+    VectorMath::vsmul(magnitude.data(), 1, &compression, c, 1, bins);
+    VectorMath::vsadd(c, &one, c, bins);
+    VectorMath::vlog(c, c, bins);
+
+    const float * previous = previousCompressed.data();
+    float flux = 0;
+    for (size_t k = 0; k < bins; ++k)
+        flux += std::max(c[k] - previous[k], 0.f);
+    flux /= bins;
+    std::memcpy(previousCompressed.data(), c, sizeof(float) * bins);
+
+    // The first frame rises from silence, so its flux is left out.
+    if (hops == 1)
+        flux = 0;
+
+    const float average = fluxSum / FluxHistory;
+    ++framesSinceOnset;
+    result.flux = flux;
+    result.onset = flux > onsetThreshold * average + MinOnsetFlux && framesSinceOnset > refractoryFrames;
+    if (result.onset)
+        framesSinceOnset = 0;
+
+    fluxSum += flux - fluxHistory[fluxIndex];
+    fluxHistory[fluxIndex] = flux;
+    fluxIndex = (fluxIndex + 1) % FluxHistory;
+}
+
+void FeatureExtractorNode::Analysis::computePitch(Features & result)
+{
+    const size_t windowSize = spectrum->windowSize();
+    const float * x = input;
+
+    float energy = 0;
+    VectorMath::vsvesq(x, 1, &energy, windowSize);
+    if (energy <= 0)
+        return;
+
+    // The autocorrelation is the inverse transform of the power spectrum. It is scaled by its value at lag 0,
+    // which is the frame's energy, as not every FFT scales its forward transform the same.
+    float * r = padded.data();
+    std::memcpy(r, x, sizeof(float) * windowSize);
+    std::memset(r + windowSize, 0, sizeof(float) * (padded.size() - windowSize));
+    autocorrelationFrame.doFFT(r);
+
+    const size_t half = autocorrelationFrame.fftSize() / 2;
+    float * real = autocorrelationFrame.realData();
+    float * imag = autocorrelationFrame.imagData();
+    const float dc = real[0] * real[0];
+    const float nyquist = imag[0] * imag[0];
+    VectorMath::vmul(real, 1, real, 1, real, 1, half);
+    VectorMath::vmul(imag, 1, imag, 1, autocorrelationScratch.data(), 1, half);
+    VectorMath::vadd(real, 1, autocorrelationScratch.data(), 1, real, 1, half);
+    std::memset(imag, 0, sizeof(float) * half);
+    real[0] = dc;
+    imag[0] = nyquist;
+    autocorrelationFrame.doInverseFFT(r);
+    if (r[0] <= 0)
+        return;
+    const float autocorrelationScale = energy / r[0];
+
+    // The normalized square difference function of McLeod and Wyvill: 2 r(t) / m(t), where m(t) sums the
+    // squares of the two overlapping spans, and is updated from lag to lag.
+    float * n = nsdf.data();
+    double m = 2.0 * energy;
+    for (size_t lag = 0; lag <= maxLag; ++lag)
+    {
+        n[lag] = m > 0 ? static_cast<float>(2.0 * r[lag] * autocorrelationScale / m) : 0.f;
+        m -= static_cast<double>(x[windowSize - 1 - lag]) * x[windowSize - 1 - lag] + static_cast<double>(x[lag]) * x[lag];
+    }
+
+    // The key maxima are the highest points of each positive span, after the function first goes negative.
+    size_t lag = 1;
+    while (lag < maxLag && n[lag] > 0)
+        ++lag;
+
+    float highest = 0;
+    size_t keyCount = 0;
+    size_t keyLags[64];
+    while (lag < maxLag && keyCount < 64)
+    {
+        while (lag < maxLag && n[lag] <= 0)
+            ++lag;
+        size_t best = lag;
+        while (lag < maxLag && n[lag] > 0)
+        {
+            if (n[lag] > n[best])
+                best = lag;
+            ++lag;
+        }
+        if (best < maxLag && best >= minLag && n[best] > 0)
+        {
+            keyLags[keyCount++] = best;
+            highest = std::max(highest, n[best]);
+        }
+    }
+
+    for (size_t i = 0; i < keyCount; ++i)
+    {
+        const size_t best = keyLags[i];
+        if (n[best] < KeyMaximumThreshold * highest)
+            continue;
+
+        // The peak is placed between lags by the parabola through it and its neighbours.
+        const float left = n[best - 1], centre = n[best], right = n[best + 1];
+        const float denominator = left - 2 * centre + right;
+        float offset = 0, peak = centre;
+        if (denominator < 0)
+        {
+            offset = 0.5f * (left - right) / denominator;
+            peak = centre - 0.25f * (left - right) * offset;
+        }
+        result.pitch = sampleRate / (best + offset);
+        result.pitchClarity = std::min(peak, 1.f);
+        return;
+    }
+}
+
+struct FeatureExtractorNode::Internals
+{
+    Internals()
+        : published([](Features & f) { std::memset(&f, 0, sizeof(f)); })
+    {
+    }
+
+    // configure() replaces the analysis under the lock, which the audio thread only tries for.
+    std::unique_ptr<Analysis> analysis;
+    std::mutex configLock;
+
+    uint64_t sequence = 0;
+
+    // From the audio thread to the readers, who take turns as its consumer.
+    TripleBuffer<Features> published;
+    std::mutex readerLock;
+    uint64_t lastRead = 0;
+};
+
+FeatureExtractorNode::FeatureExtractorNode(float sampleRate)
+    : AudioBasicInspectorNode(2)
+    , m_windowSize(std::make_shared<AudioSetting>("windowSize"))
+    , m_hopSize(std::make_shared<AudioSetting>("hopSize"))
+    , m_melBands(std::make_shared<AudioSetting>("melBands"))
+    , m_mfccCount(std::make_shared<AudioSetting>("mfccCount"))
+    , m_minPitch(std::make_shared<AudioSetting>("minPitch"))
+    , m_maxPitch(std::make_shared<AudioSetting>("maxPitch"))
+    , m_onsetThreshold(std::make_shared<AudioSetting>("onsetThreshold"))
+    , m_features(std::make_shared<AudioSetting>("features"))
+    , m_sampleRate(sampleRate)
+    , m_internal(new Internals())
+{
+    m_windowSize->setUint32(1024);
+    m_hopSize->setUint32(256);
+    m_melBands->setUint32(40);
+    m_mfccCount->setUint32(13);
+    m_minPitch->setFloat(50.f);
+    m_maxPitch->setFloat(2000.f);
+    m_onsetThreshold->setFloat(1.5f);
+    m_features->setUint32(AllFeatures);
+
+    for (auto & setting : { m_windowSize, m_hopSize, m_melBands, m_mfccCount, m_minPitch, m_maxPitch, m_onsetThreshold, m_features })
+    {
+        setting->setValueChanged([this]() { configure(); });
+        m_settings.push_back(setting);
+    }
+
+    addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
+
+    configure();
+    initialize();
+}
+
+FeatureExtractorNode::~FeatureExtractorNode()
+{
+    uninitialize();
+}
+
+void FeatureExtractorNode::configure()
+{
+    const uint32_t windowSize = std::min(std::max(nextPowerOfTwo(m_windowSize->valueUint32()), MinWindowSize), MaxWindowSize);
+    const uint32_t hopSize = std::max(std::min(m_hopSize->valueUint32(), windowSize), 1u);
+    const uint32_t melBands = std::max(std::min(m_melBands->valueUint32(), uint32_t(MaxMelBands)), 1u);
+    const uint32_t mfccCount = std::min(m_mfccCount->valueUint32(), uint32_t(MaxMFCCs));
+
+    // Built before the lock is taken, so the audio thread isn't kept waiting meanwhile.
+    std::unique_ptr<Analysis> analysis(new Analysis(m_sampleRate, windowSize, hopSize, melBands, mfccCount, m_minPitch->valueFloat(),
+                                                    m_maxPitch->valueFloat(), m_onsetThreshold->valueFloat(), m_features->valueUint32()));
+    {
+        std::lock_guard<std::mutex> lock(m_internal->configLock);
+        analysis.swap(m_internal->analysis);
+    }
+}
+
+void FeatureExtractorNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+
+    if (!isInitialized() || !input(0)->isConnected())
+    {
+        if (outputBus)
+            outputBus->zero();
+        return;
+    }
+
+    AudioBus * bus = input(0)->bus(r);
+    bool isBusGood = bus && bus->numberOfChannels() > 0 && bus->channel(0)->length() >= framesToProcess;
+    if (!isBusGood)
+    {
+        outputBus->zero();
+        return;
+    }
+
+    // While the analysis is being replaced the quantum goes unanalysed.
+    Internals & internal = *m_internal;
+    if (internal.configLock.try_lock())
+    {
+        Analysis & analysis = *internal.analysis;
+
+        // Other analysers of the same source with the same window and hop share the spectrum; taking it, when
+        // the source or the render quantum changes, is the only time the audio thread allocates.
+        SharedSpectrum::Key key = analysis.spectrum->key();
+        key.source = SharedSpectrum::sourceOf(r, input(0).get());
+        key.quantumSize = r.context()->renderQuantumSize();
+        if (key != analysis.spectrum->key())
+            analysis.spectrum = SharedSpectrum::acquire(key);
+
+        analysis.spectrum->analyse(r, *bus, framesToProcess, [&](FFTFrame & frame, const float * input, uint64_t sampleFrame)
+        {
+            Features & result = internal.published.back();
+            std::memset(&result, 0, sizeof(result));
+            analysis.analyseFrame(frame, input, result);
+            result.sequence = ++internal.sequence;
+            result.sampleFrame = sampleFrame;
+            internal.published.publish();
+        });
+        internal.configLock.unlock();
+    }
+
+    if (bus != outputBus)
+        outputBus->copyFrom(*bus);
+}
+
+void FeatureExtractorNode::reset(ContextRenderLock &)
+{
+    configure();
+}
+
+void FeatureExtractorNode::setWindowSize(uint32_t size) { m_windowSize->setUint32(size); }
+uint32_t FeatureExtractorNode::windowSize() const { return m_windowSize->valueUint32(); }
+void FeatureExtractorNode::setHopSize(uint32_t size) { m_hopSize->setUint32(size); }
+uint32_t FeatureExtractorNode::hopSize() const { return m_hopSize->valueUint32(); }
+void FeatureExtractorNode::setMelBands(uint32_t bands) { m_melBands->setUint32(bands); }
+uint32_t FeatureExtractorNode::melBands() const { return m_melBands->valueUint32(); }
+void FeatureExtractorNode::setMFCCCount(uint32_t count) { m_mfccCount->setUint32(count); }
+uint32_t FeatureExtractorNode::mfccCount() const { return m_mfccCount->valueUint32(); }
+void FeatureExtractorNode::setOnsetThreshold(float threshold) { m_onsetThreshold->setFloat(threshold); }
+void FeatureExtractorNode::setEnabledFeatures(uint32_t features) { m_features->setUint32(features); }
+uint32_t FeatureExtractorNode::enabledFeatures() const { return m_features->valueUint32(); }
+
+void FeatureExtractorNode::setPitchRange(float minPitch, float maxPitch)
+{
+    m_minPitch->setFloat(minPitch, false);
+    m_maxPitch->setFloat(maxPitch);
+}
+
+bool FeatureExtractorNode::features(Features & result)
+{
+    std::lock_guard<std::mutex> lock(m_internal->readerLock);
+    m_internal->published.update();
+    result = m_internal->published.front();
+    const bool fresh = result.sequence != m_internal->lastRead;
+    m_internal->lastRead = result.sequence;
+    return fresh;
+}
+
+} // namespace lab
@@ -8,6 +8,8 @@
 #include "LabSound/extended/FunctionNode.h"
 #include "LabSound/extended/AudioContextLock.h"
 
+#include <algorithm>
+
 using namespace std;
 using namespace lab;
 
@@ -24,12 +26,23 @@ namespace lab
     {
         uninitialize();
     }
+
+    std::shared_ptr<AudioParam> FunctionNode::addParam(const std::string & name, double defaultValue, double minValue, double maxValue)
+    {
+        auto param = std::make_shared<AudioParam>(name, defaultValue, minValue, maxValue);
+        m_params.push_back(param);
+        _addedParams.push_back(param);
+
+        _paramValues.emplace_back(new AudioFloatArray(AudioNode::ProcessingSizeInFrames));
+        _paramValuePointers.push_back(_paramValues.back()->data());
+        return param;
+    }
     
     void FunctionNode::process(ContextRenderLock & r, size_t framesToProcess)
     {
         AudioBus * outputBus = output(0)->bus(r);
 
-        if (!isInitialized() || !outputBus->numberOfChannels() || !_function)
+        if (!isInitialized() || !outputBus->numberOfChannels() || (!_function && !_blockFunction))
         {
             outputBus->zero();
             return;
@@ -38,21 +51,53 @@ namespace lab
         size_t quantumFrameOffset;
         size_t nonSilentFramesToProcess;
         
-        updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess);
+        if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
+            return;
 
-        if (!nonSilentFramesToProcess) 
+        // At control rate the sounding frames are rendered as one value each stride, at the start of the bus.
+        const size_t stride = controlStride();
+        size_t offset = quantumFrameOffset;
+        size_t frames = nonSilentFramesToProcess;
+        if (stride > 1)
         {
-            outputBus->zero();
-            return;
+            offset = (quantumFrameOffset + stride - 1) / stride;
+            const size_t end = (quantumFrameOffset + nonSilentFramesToProcess + stride - 1) / stride;
+            frames = end - offset;
+            for (size_t i = 0; i < outputBus->numberOfChannels(); ++i)
+            {
+                float * destP = outputBus->channel(i)->mutableData();
+                std::fill(destP, destP + offset, 0.f);
+                std::fill(destP + end, destP + framesToProcess / stride, 0.f);
+            }
         }
 
-        for (size_t i = 0; i < outputBus->numberOfChannels(); ++i)
+        if (_blockFunction)
+        {
+            for (size_t i = 0; i < _paramValues.size(); ++i)
+            {
+                if (framesToProcess > _paramValues[i]->size())
+                {
+                    _paramValues[i]->allocate(framesToProcess);
+                    _paramValuePointers[i] = _paramValues[i]->data();
+                }
+                float * values = _paramValues[i]->data();
+                _addedParams[i]->calculateSampleAccurateValues(r, values, framesToProcess);
+                for (size_t f = 1; stride > 1 && f < framesToProcess / stride; ++f)
+                    values[f] = values[f * stride];
+            }
+
+            _blockFunction(r, this, *outputBus, offset, frames, _paramValuePointers.data(), _userData);
+        }
+        else
         {
-            float * destP = outputBus->channel(i)->mutableData();
-            
-            // Start rendering at the correct offset.
-            destP += quantumFrameOffset;
-            _function(r, this, static_cast<int>(i), destP, nonSilentFramesToProcess);
+            for (size_t i = 0; i < outputBus->numberOfChannels(); ++i)
+            {
+                float * destP = outputBus->channel(i)->mutableData();
+
+                // Start rendering at the correct offset.
+                destP += offset;
+                _function(r, this, static_cast<int>(i), destP, frames);
+            }
         }
 
         _now += double(framesToProcess) / r.context()->sampleRate();
@@ -0,0 +1,340 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/GranularNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace lab
+{
+
+namespace
+{
+    const uint32_t DefaultMaxGrains = 256;
+
+    // The window is read from a table of this many intervals, with linear interpolation.
+    const size_t WindowTableSize = 1024;
+
+    const double Pi = 3.14159265358979323846;
+
+    uint64_t frameAt(ContextRenderLock & r, double when)
+    {
+        const uint64_t now = r.context()->currentSampleFrame();
+        const double frame = std::round(when * r.context()->sampleRate());
+        return frame > static_cast<double>(now) ? static_cast<uint64_t>(frame) : now;
+    }
+}
+
+GranularNode::GranularNode()
+    : AudioNode()
+    , m_indices(AudioNode::ProcessingSizeInFrames)
+    , m_windowValues(AudioNode::ProcessingSizeInFrames)
+    , m_samples(AudioNode::ProcessingSizeInFrames)
+    , m_window(std::make_shared<AudioSetting>("window"))
+    , m_maxGrains(std::make_shared<AudioSetting>("maxGrains"))
+{
+    m_density = make_shared<AudioParam>("density", 0.0, 0.0, 10000.0);
+    m_duration = make_shared<AudioParam>("duration", 0.05, 0.001, 10.0);
+    m_position = make_shared<AudioParam>("position", 0.0, 0.0, 100000.0);
+    m_positionJitter = make_shared<AudioParam>("positionJitter", 0.0, 0.0, 100000.0);
+    m_playbackRate = make_shared<AudioParam>("playbackRate", 1.0, -16.0, 16.0);
+    m_spread = make_shared<AudioParam>("spread", 0.0, 0.0, 1.0);
+    m_gain = make_shared<AudioParam>("gain", 1.0, 0.0, 1.0);
+    m_params.push_back(m_density);
+    m_params.push_back(m_duration);
+    m_params.push_back(m_position);
+    m_params.push_back(m_positionJitter);
+    m_params.push_back(m_playbackRate);
+    m_params.push_back(m_spread);
+    m_params.push_back(m_gain);
+
+    m_window->setUint32(HANN, false);
+    m_maxGrains->setUint32(DefaultMaxGrains, false);
+    m_settings.push_back(m_window);
+    m_settings.push_back(m_maxGrains);
+
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
+
+    resizePool(DefaultMaxGrains);
+    m_window->changed(m_windowVersion);
+    buildWindow();
+
+    initialize();
+}
+
+GranularNode::~GranularNode()
+{
+    uninitialize();
+}
+
+void GranularNode::resizePool(size_t count)
+{
+    m_grains.resize(count);
+    m_active.clear();
+    m_active.reserve(count);
+    m_free.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        m_free[i] = static_cast<uint32_t>(count - 1 - i);
+}
+
+void GranularNode::buildWindow()
+{
+    m_windowType = m_window->valueUint32();
+    m_windowTable.resize(WindowTableSize + 1);
+    for (size_t i = 0; i <= WindowTableSize; ++i)
+    {
+        const double x = static_cast<double>(i) / WindowTableSize;
+        double w;
+        switch (WindowType(m_windowType))
+        {
+            case TRIANGLE:
+                w = 1 - std::fabs(2 * x - 1);
+                break;
+            case TUKEY:
+            {
+                const double edge = std::min(x, 1 - x);
+                w = edge < 0.25 ? 0.5 * (1 - std::cos(Pi * edge / 0.25)) : 1;
+                break;
+            }
+            case HANN:
+            default:
+                w = 0.5 * (1 - std::cos(2 * Pi * x));
+                break;
+        }
+        m_windowTable[i] = static_cast<float>(w);
+    }
+}
+
+float GranularNode::random()
+{
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return static_cast<float>(static_cast<int32_t>(m_random)) * (1.0f / 2147483648.0f);
+}
+
+void GranularNode::setSource(ContextRenderLock & r, std::shared_ptr<AudioBus> source)
+{
+    m_source = source;
+    resizePool(m_grains.size());
+}
+
+bool GranularNode::triggerGrain(ContextRenderLock & r, double when, double position, double duration,
+                                float playbackRate, float gain, float pan)
+{
+    if (!r.context())
+        return false;
+    return startGrain(r, frameAt(r, when), position, duration, playbackRate, gain, pan);
+}
+
+bool GranularNode::startGrain(ContextRenderLock & r, uint64_t frame, double position, double duration,
+                              float playbackRate, float gain, float pan)
+{
+    if (!m_source || !m_source->length() || m_free.empty())
+        return false;
+
+    const double sampleRate = r.context()->sampleRate();
+    const double sourceRate = m_source->sampleRate() > 0 ? m_source->sampleRate() : sampleRate;
+    const double lastFrame = static_cast<double>(m_source->length() - 1);
+
+    Grain grain;
+    grain.rate = playbackRate * sourceRate / sampleRate;
+    grain.length = static_cast<uint32_t>(std::max(1.0, std::round(duration * sampleRate)));
+
+    // Shorten a grain longer than the source, and keep the rest of it within the source.
+    const double speed = std::fabs(grain.rate);
+    if (speed * (grain.length - 1) > lastFrame)
+        grain.length = static_cast<uint32_t>(lastFrame / speed) + 1;
+    const double span = grain.rate * (grain.length - 1);
+    const double start = position * sourceRate;
+    grain.position = span >= 0 ? std::min(std::max(start, 0.0), lastFrame - span)
+                               : std::min(std::max(start, -span), lastFrame);
+
+    grain.startFrame = frame;
+    grain.elapsed = 0;
+
+    pan = std::min(std::max(pan, -1.f), 1.f);
+    if (m_source->numberOfChannels() > 1)
+    {
+        // A stereo grain is balanced rather than panned, so that centred it plays at its own level.
+        grain.gainLeft = gain * std::min(1.f, 1.f - pan);
+        grain.gainRight = gain * std::min(1.f, 1.f + pan);
+    }
+    else
+    {
+        const float angle = static_cast<float>((pan + 1) * Pi / 4);
+        grain.gainLeft = gain * std::cos(angle);
+        grain.gainRight = gain * std::sin(angle);
+    }
+
+    const uint32_t index = m_free.back();
+    m_free.pop_back();
+    m_grains[index] = grain;
+    m_active.push_back(index);
+    return true;
+}
+
+bool GranularNode::renderGrain(Grain & grain, float * left, float * right, uint64_t quantumStart, size_t framesToProcess)
+{
+    const size_t offset = grain.startFrame > quantumStart ? static_cast<size_t>(std::min<uint64_t>(grain.startFrame - quantumStart, framesToProcess)) : 0;
+    if (offset >= framesToProcess)
+        return false;
+
+    const size_t frames = std::min<size_t>(framesToProcess - offset, grain.length - grain.elapsed);
+    float * indices = m_indices.data();
+    float * window = m_windowValues.data();
+    float * samples = m_samples.data();
+
+    // The window, across the grain's frames.
+    const float windowStep = static_cast<float>(WindowTableSize) / std::max<uint32_t>(1, grain.length - 1);
+    const float windowStart = grain.elapsed * windowStep;
+    VectorMath::vramp(&windowStart, &windowStep, indices, frames);
+    VectorMath::vlookup(m_windowTable.data(), m_windowTable.size(), indices, window, frames);
+
+    // Read positions relative to the lowest source frame read, so that they keep their fractions in a float.
+    const double last = grain.position + grain.rate * (frames - 1);
+    const size_t base = static_cast<size_t>(std::max(0.0, std::floor(std::min(grain.position, last))));
+    const size_t tableSize = m_source->length() - base;
+    const float readStart = static_cast<float>(grain.position - base);
+    const float readStep = static_cast<float>(grain.rate);
+    VectorMath::vramp(&readStart, &readStep, indices, frames);
+
+    VectorMath::vlookup(m_source->channel(0)->data() + base, tableSize, indices, samples, frames);
+    VectorMath::vmul(samples, 1, window, 1, samples, 1, frames);
+    VectorMath::vsma(samples, 1, &grain.gainLeft, left + offset, 1, frames);
+    if (m_source->numberOfChannels() > 1)
+    {
+        VectorMath::vlookup(m_source->channel(1)->data() + base, tableSize, indices, samples, frames);
+        VectorMath::vmul(samples, 1, window, 1, samples, 1, frames);
+    }
+    VectorMath::vsma(samples, 1, &grain.gainRight, right + offset, 1, frames);
+
+    grain.position += grain.rate * frames;
+    grain.elapsed += static_cast<uint32_t>(frames);
+    return grain.elapsed >= grain.length;
+}
+
+void GranularNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    outputBus->zero();
+
+    if (!isInitialized() || !r.context())
+        return;
+
+    const size_t maxGrains = std::max<uint32_t>(1, m_maxGrains->valueUint32());
+    if (maxGrains != m_grains.size())
+        resizePool(maxGrains);
+    if (m_window->changed(m_windowVersion))
+        buildWindow();
+
+    if (framesToProcess > m_indices.size())
+    {
+        m_indices.allocate(framesToProcess);
+        m_windowValues.allocate(framesToProcess);
+        m_samples.allocate(framesToProcess);
+    }
+
+    const uint64_t quantumStart = r.context()->currentSampleFrame();
+    const double quantumEnd = static_cast<double>(quantumStart + framesToProcess);
+
+    // Schedule the grains starting this quantum, each at its own frame.
+    const float density = m_density->value(r);
+    if (m_source && density > 0)
+    {
+        const double interval = r.context()->sampleRate() / density;
+        if (!m_isStreaming)
+        {
+            m_isStreaming = true;
+            m_nextOnset = static_cast<double>(quantumStart);
+        }
+        else
+            m_nextOnset = std::min(m_nextOnset, m_lastOnset + interval);
+
+        const double duration = m_duration->value(r);
+        const double position = m_position->value(r);
+        const double jitter = m_positionJitter->value(r);
+        const float playbackRate = m_playbackRate->value(r);
+        const float spread = m_spread->value(r);
+        while (m_nextOnset < quantumEnd)
+        {
+            const uint64_t frame = std::max(quantumStart, static_cast<uint64_t>(m_nextOnset));
+            const double at = position + (jitter > 0 ? jitter * random() : 0.0);
+            const float pan = spread > 0 ? spread * random() : 0.f;
+            startGrain(r, frame, at, duration, playbackRate, 1.f, pan);
+            m_lastOnset = m_nextOnset;
+            m_nextOnset += interval;
+        }
+    }
+    else
+        m_isStreaming = false;
+
+    if (m_active.empty())
+        return;
+
+    float * left = outputBus->channel(0)->mutableData();
+    float * right = outputBus->channel(1)->mutableData();
+
+    for (size_t i = 0; i < m_active.size();)
+    {
+        const uint32_t index = m_active[i];
+        if (renderGrain(m_grains[index], left, right, quantumStart, framesToProcess))
+        {
+            m_free.push_back(index);
+            m_active[i] = m_active.back();
+            m_active.pop_back();
+        }
+        else
+            ++i;
+    }
+
+    outputBus->copyWithGainFrom(*outputBus, &m_lastGain, m_gain->value(r));
+    outputBus->clearSilentFlag();
+}
+
+void GranularNode::reset(ContextRenderLock & r)
+{
+    resizePool(m_grains.size());
+    m_isStreaming = false;
+    m_lastGain = m_gain->value(r);
+}
+
+GranularNode::WindowType GranularNode::window() const
+{
+    return WindowType(m_window->valueUint32());
+}
+
+void GranularNode::setWindow(WindowType window)
+{
+    m_window->setUint32(static_cast<uint32_t>(window));
+}
+
+uint32_t GranularNode::maxGrains() const
+{
+    return m_maxGrains->valueUint32();
+}
+
+void GranularNode::setMaxGrains(uint32_t grains)
+{
+    m_maxGrains->setUint32(grains);
+}
+
+bool GranularNode::propagatesSilence(ContextRenderLock & r) const
+{
+    return m_active.empty() && (!m_source || m_density->value(r) <= 0);
+}
+
+} // namespace lab
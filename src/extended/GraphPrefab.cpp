@@ -0,0 +1,805 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/GraphPrefab.h"
+
+#include "LabSound/core/AnalyserNode.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/BiquadFilterNode.h"
+#include "LabSound/core/ChannelMergerNode.h"
+#include "LabSound/core/ChannelSplitterNode.h"
+#include "LabSound/core/ConvolverNode.h"
+#include "LabSound/core/DelayNode.h"
+#include "LabSound/core/DynamicsCompressorNode.h"
+#include "LabSound/core/GainNode.h"
+#include "LabSound/core/GraphTransaction.h"
+#include "LabSound/core/OscillatorNode.h"
+#include "LabSound/core/PannerNode.h"
+#include "LabSound/core/SampledAudioNode.h"
+#include "LabSound/core/StereoPannerNode.h"
+#include "LabSound/core/WaveShaperNode.h"
+
+#include "LabSound/extended/ADSRNode.h"
+#include "LabSound/extended/ClipNode.h"
+#include "LabSound/extended/FDNReverbNode.h"
+#include "LabSound/extended/GranularNode.h"
+#include "LabSound/extended/MixerNode.h"
+#include "LabSound/extended/NoiseNode.h"
+#include "LabSound/extended/OscillatorBankNode.h"
+#include "LabSound/extended/PWMNode.h"
+#include "LabSound/extended/ParametricEQNode.h"
+#include "LabSound/extended/PeakCompNode.h"
+#include "LabSound/extended/PitchShiftNode.h"
+#include "LabSound/extended/PowerMonitorNode.h"
+#include "LabSound/extended/SfxrNode.h"
+#include "LabSound/extended/SpatializationNode.h"
+#include "LabSound/extended/SupersawNode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace lab
+{
+
+namespace
+{
+    const size_t NoParam = SIZE_MAX;
+    const uint32_t BinaryMagic = 0x5047534c; // "LSGP"
+    const uint32_t BinaryVersion = 1;
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::map<std::string, GraphPrefab::NodeFactory> factories;
+
+        Registry()
+        {
+            auto add = [this](const char * type, GraphPrefab::NodeFactory factory) { factories[type] = std::move(factory); };
+            add("AnalyserNode", [](AudioContext &, PrefabArena & a) { return a.make<AnalyserNode>(); });
+            add("BiquadFilterNode", [](AudioContext &, PrefabArena & a) { return a.make<BiquadFilterNode>(); });
+            add("ChannelMergerNode", [](AudioContext &, PrefabArena & a) { return a.make<ChannelMergerNode>(); });
+            add("ChannelSplitterNode", [](AudioContext &, PrefabArena & a) { return a.make<ChannelSplitterNode>(); });
+            add("ConvolverNode", [](AudioContext &, PrefabArena & a) { return a.make<ConvolverNode>(); });
+            add("DelayNode", [](AudioContext & c, PrefabArena & a) { return a.make<DelayNode>(c.sampleRate()); });
+            add("DynamicsCompressorNode", [](AudioContext &, PrefabArena & a) { return a.make<DynamicsCompressorNode>(); });
+            add("GainNode", [](AudioContext &, PrefabArena & a) { return a.make<GainNode>(); });
+            add("OscillatorNode", [](AudioContext & c, PrefabArena & a) { return a.make<OscillatorNode>(c.sampleRate()); });
+            add("PannerNode", [](AudioContext & c, PrefabArena & a) { return a.make<PannerNode>(c.sampleRate()); });
+            add("SampledAudioNode", [](AudioContext &, PrefabArena & a) { return a.make<SampledAudioNode>(); });
+            add("StereoPannerNode", [](AudioContext & c, PrefabArena & a) { return a.make<StereoPannerNode>(c.sampleRate()); });
+            add("WaveShaperNode", [](AudioContext &, PrefabArena & a) { return a.make<WaveShaperNode>(); });
+
+            add("ADSRNode", [](AudioContext &, PrefabArena & a) { return a.make<ADSRNode>(); });
+            add("ClipNode", [](AudioContext &, PrefabArena & a) { return a.make<ClipNode>(); });
+            add("FDNReverbNode", [](AudioContext & c, PrefabArena & a) { return a.make<FDNReverbNode>(c.sampleRate()); });
+            add("GranularNode", [](AudioContext &, PrefabArena & a) { return a.make<GranularNode>(); });
+            add("MixerNode", [](AudioContext &, PrefabArena & a) { return a.make<MixerNode>(); });
+            add("NoiseNode", [](AudioContext &, PrefabArena & a) { return a.make<NoiseNode>(); });
+            add("OscillatorBankNode", [](AudioContext & c, PrefabArena & a) { return a.make<OscillatorBankNode>(c.sampleRate()); });
+            add("PWMNode", [](AudioContext &, PrefabArena & a) { return a.make<PWMNode>(); });
+            add("ParametricEQNode", [](AudioContext &, PrefabArena & a) { return a.make<ParametricEQNode>(); });
+            add("PeakCompNode", [](AudioContext &, PrefabArena & a) { return a.make<PeakCompNode>(); });
+            add("PitchShiftNode", [](AudioContext &, PrefabArena & a) { return a.make<PitchShiftNode>(); });
+            add("PowerMonitorNode", [](AudioContext &, PrefabArena & a) { return a.make<PowerMonitorNode>(); });
+            add("SfxrNode", [](AudioContext & c, PrefabArena & a) { return a.make<SfxrNode>(c.sampleRate()); });
+            add("SpatializationNode", [](AudioContext & c, PrefabArena & a) { return a.make<SpatializationNode>(c.sampleRate()); });
+            add("SupersawNode", [](AudioContext &, PrefabArena & a) { return a.make<SupersawNode>(); });
+        }
+    };
+
+    Registry & registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    // JSON, as much as descriptions need of it.
+    struct Json
+    {
+        enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+        double number = 0;
+        std::string string;
+        std::vector<Json> items;
+        std::vector<std::pair<std::string, Json>> members;
+
+        const Json * member(const char * name) const
+        {
+            for (auto & m : members)
+                if (m.first == name)
+                    return &m.second;
+            return nullptr;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+
+        explicit JsonParser(const std::string & text) : m_text(text) {}
+
+        Json parse()
+        {
+            Json value = parseValue();
+            skipSpace();
+            if (m_pos != m_text.size())
+                fail("trailing text");
+            return value;
+        }
+
+    private:
+
+        [[noreturn]] void fail(const char * what) const
+        {
+            throw std::invalid_argument(std::string("Malformed graph description, ") + what + " at " + std::to_string(m_pos));
+        }
+
+        void skipSpace()
+        {
+            while (m_pos < m_text.size() && m_text[m_pos] && strchr(" \t\r\n", m_text[m_pos]))
+                ++m_pos;
+        }
+
+        bool take(char c)
+        {
+            skipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == c)
+            {
+                ++m_pos;
+                return true;
+            }
+            return false;
+        }
+
+        bool takeWord(const char * word)
+        {
+            const size_t length = strlen(word);
+            if (m_text.compare(m_pos, length, word) != 0)
+                return false;
+            m_pos += length;
+            return true;
+        }
+
+        Json parseValue()
+        {
+            skipSpace();
+            if (m_pos >= m_text.size())
+                fail("unexpected end");
+
+            Json value;
+            const char c = m_text[m_pos];
+            if (c == '{')
+            {
+                ++m_pos;
+                value.type = Json::Type::Object;
+                if (take('}'))
+                    return value;
+                do
+                {
+                    skipSpace();
+                    std::string name = parseString();
+                    if (!take(':'))
+                        fail("expected ':'");
+                    value.members.emplace_back(std::move(name), parseValue());
+                } while (take(','));
+                if (!take('}'))
+                    fail("expected '}'");
+            }
+            else if (c == '[')
+            {
+                ++m_pos;
+                value.type = Json::Type::Array;
+                if (take(']'))
+                    return value;
+                do
+                    value.items.push_back(parseValue());
+                while (take(','));
+                if (!take(']'))
+                    fail("expected ']'");
+            }
+            else if (c == '"')
+            {
+                value.type = Json::Type::String;
+                value.string = parseString();
+            }
+            else if (takeWord("true") || takeWord("false"))
+            {
+                value.type = Json::Type::Bool;
+                value.number = c == 't' ? 1 : 0;
+            }
+            else if (takeWord("null"))
+            {
+            }
+            else
+            {
+                const char * start = m_text.c_str() + m_pos;
+                char * end = nullptr;
+                value.number = strtod(start, &end);
+                if (end == start)
+                    fail("unexpected character");
+                value.type = Json::Type::Number;
+                m_pos += end - start;
+            }
+            return value;
+        }
+
+        std::string parseString()
+        {
+            if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+                fail("expected a string");
+            ++m_pos;
+
+            std::string out;
+            while (m_pos < m_text.size() && m_text[m_pos] != '"')
+            {
+                char c = m_text[m_pos++];
+                if (c == '\\')
+                {
+                    if (m_pos >= m_text.size())
+                        break;
+                    c = m_text[m_pos++];
+                    switch (c)
+                    {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u':
+                    {
+                        // Names are ASCII; anything else is kept as '?'.
+                        if (m_pos + 4 > m_text.size())
+                            fail("short escape");
+                        const unsigned code = static_cast<unsigned>(strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16));
+                        m_pos += 4;
+                        c = code < 0x80 ? static_cast<char>(code) : '?';
+                        break;
+                    }
+                    default: break;
+                    }
+                }
+                out += c;
+            }
+            if (m_pos >= m_text.size())
+                fail("unterminated string");
+            ++m_pos;
+            return out;
+        }
+
+        const std::string & m_text;
+        size_t m_pos = 0;
+    };
+
+    std::string quoted(const std::string & text)
+    {
+        std::string out = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out + "\"";
+    }
+
+    std::string number(double value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+
+    size_t toIndex(const Json * value, const char * what)
+    {
+        if (!value || value->type != Json::Type::Number || value->number < 0 || value->number != std::floor(value->number))
+            throw std::invalid_argument(std::string("Malformed graph description, bad ") + what);
+        return static_cast<size_t>(value->number);
+    }
+
+    std::vector<GraphDescription::Value> toValues(const Json * object)
+    {
+        std::vector<GraphDescription::Value> values;
+        if (!object)
+            return values;
+        if (object->type != Json::Type::Object)
+            throw std::invalid_argument("Malformed graph description, values must be an object");
+        for (auto & m : object->members)
+        {
+            if (m.second.type != Json::Type::Number && m.second.type != Json::Type::Bool)
+                throw std::invalid_argument("Malformed graph description, " + m.first + " must be a number");
+            values.push_back({ m.first, static_cast<float>(m.second.number) });
+        }
+        return values;
+    }
+
+    class BinaryWriter
+    {
+    public:
+
+        void u32(uint32_t v)
+        {
+            for (int i = 0; i < 4; ++i)
+                bytes.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+
+        void f32(float v)
+        {
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            u32(bits);
+        }
+
+        void string(const std::string & s)
+        {
+            u32(static_cast<uint32_t>(s.size()));
+            bytes.insert(bytes.end(), s.begin(), s.end());
+        }
+
+        std::vector<uint8_t> bytes;
+    };
+
+    class BinaryReader
+    {
+    public:
+
+        BinaryReader(const uint8_t * data, size_t size) : m_data(data), m_size(size) {}
+
+        uint32_t u32()
+        {
+            need(4);
+            uint32_t v = 0;
+            for (int i = 0; i < 4; ++i)
+                v |= uint32_t(m_data[m_pos++]) << (8 * i);
+            return v;
+        }
+
+        float f32()
+        {
+            const uint32_t bits = u32();
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        std::string string()
+        {
+            const uint32_t length = u32();
+            need(length);
+            std::string s(reinterpret_cast<const char *>(m_data + m_pos), length);
+            m_pos += length;
+            return s;
+        }
+
+        // A count of items of at least minBytes each, checked against what's left so that a corrupt count
+        // can't ask for a vast allocation.
+        uint32_t count(size_t minBytes)
+        {
+            const uint32_t n = u32();
+            need(static_cast<size_t>(n) * minBytes);
+            return n;
+        }
+
+        bool done() const { return m_pos == m_size; }
+
+    private:
+
+        void need(size_t bytes) const
+        {
+            if (m_size - m_pos < bytes)
+                throw std::invalid_argument("Malformed graph description, truncated");
+        }
+
+        const uint8_t * m_data;
+        size_t m_size;
+        size_t m_pos = 0;
+    };
+}
+
+size_t GraphDescription::addNode(const std::string & type, const std::string & name)
+{
+    Node node;
+    node.type = type;
+    node.name = name;
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+void GraphDescription::setParam(size_t node, const std::string & param, float value)
+{
+    nodes.at(node).params.push_back({ param, value });
+}
+
+void GraphDescription::setSetting(size_t node, const std::string & setting, float value)
+{
+    nodes.at(node).settings.push_back({ setting, value });
+}
+
+void GraphDescription::connect(size_t destination, size_t source, uint32_t input, uint32_t output)
+{
+    Connection c;
+    c.source = source;
+    c.output = output;
+    c.destination = destination;
+    c.input = input;
+    connections.push_back(std::move(c));
+}
+
+void GraphDescription::connectParam(size_t destination, const std::string & param, size_t driver, uint32_t output)
+{
+    Connection c;
+    c.source = driver;
+    c.output = output;
+    c.destination = destination;
+    c.param = param;
+    connections.push_back(std::move(c));
+}
+
+std::string GraphDescription::toJson() const
+{
+    auto values = [](const std::vector<Value> & values) {
+        std::string out = "{";
+        for (size_t i = 0; i < values.size(); ++i)
+            out += (i ? "," : "") + quoted(values[i].name) + ":" + number(values[i].value);
+        return out + "}";
+    };
+
+    std::string out = "{\"nodes\":[";
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const Node & node = nodes[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"type\":" + quoted(node.type);
+        if (!node.name.empty())
+            out += ",\"name\":" + quoted(node.name);
+        if (!node.params.empty())
+            out += ",\"params\":" + values(node.params);
+        if (!node.settings.empty())
+            out += ",\"settings\":" + values(node.settings);
+        out += "}";
+    }
+
+    out += "\n],\"connections\":[";
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        const Connection & c = connections[i];
+        out += i ? ",\n" : "\n";
+        out += "{\"source\":" + std::to_string(c.source) + ",\"destination\":" + std::to_string(c.destination);
+        if (c.output)
+            out += ",\"output\":" + std::to_string(c.output);
+        if (!c.param.empty())
+            out += ",\"param\":" + quoted(c.param);
+        else if (c.input)
+            out += ",\"input\":" + std::to_string(c.input);
+        out += "}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+GraphDescription GraphDescription::fromJson(const std::string & json)
+{
+    const Json root = JsonParser(json).parse();
+    const Json * jsonNodes = root.member("nodes");
+    if (root.type != Json::Type::Object || !jsonNodes || jsonNodes->type != Json::Type::Array)
+        throw std::invalid_argument("Malformed graph description, expected an object with an array of nodes");
+
+    GraphDescription description;
+    for (const Json & n : jsonNodes->items)
+    {
+        const Json * type = n.member("type");
+        if (!type || type->type != Json::Type::String)
+            throw std::invalid_argument("Malformed graph description, a node without a type");
+        const Json * name = n.member("name");
+
+        Node node;
+        node.type = type->string;
+        node.name = name && name->type == Json::Type::String ? name->string : std::string();
+        node.params = toValues(n.member("params"));
+        node.settings = toValues(n.member("settings"));
+        description.nodes.push_back(std::move(node));
+    }
+
+    if (const Json * jsonConnections = root.member("connections"))
+    {
+        if (jsonConnections->type != Json::Type::Array)
+            throw std::invalid_argument("Malformed graph description, connections must be an array");
+        for (const Json & j : jsonConnections->items)
+        {
+            Connection c;
+            c.source = toIndex(j.member("source"), "source");
+            c.destination = toIndex(j.member("destination"), "destination");
+            if (const Json * output = j.member("output"))
+                c.output = static_cast<uint32_t>(toIndex(output, "output"));
+            if (const Json * input = j.member("input"))
+                c.input = static_cast<uint32_t>(toIndex(input, "input"));
+            if (const Json * param = j.member("param"))
+                c.param = param->string;
+            description.connections.push_back(std::move(c));
+        }
+    }
+    return description;
+}
+
+std::vector<uint8_t> GraphDescription::toBinary() const
+{
+    BinaryWriter w;
+    w.u32(BinaryMagic);
+    w.u32(BinaryVersion);
+
+    w.u32(static_cast<uint32_t>(nodes.size()));
+    for (const Node & node : nodes)
+    {
+        w.string(node.type);
+        w.string(node.name);
+        for (const std::vector<Value> * values : { &node.params, &node.settings })
+        {
+            w.u32(static_cast<uint32_t>(values->size()));
+            for (const Value & v : *values)
+            {
+                w.string(v.name);
+                w.f32(v.value);
+            }
+        }
+    }
+
+    w.u32(static_cast<uint32_t>(connections.size()));
+    for (const Connection & c : connections)
+    {
+        w.u32(static_cast<uint32_t>(c.source));
+        w.u32(c.output);
+        w.u32(static_cast<uint32_t>(c.destination));
+        w.u32(c.input);
+        w.string(c.param);
+    }
+    return std::move(w.bytes);
+}
+
+GraphDescription GraphDescription::fromBinary(const uint8_t * data, size_t size)
+{
+    BinaryReader r(data, size);
+    if (r.u32() != BinaryMagic || r.u32() != BinaryVersion)
+        throw std::invalid_argument("Malformed graph description, not a binary description of this version");
+
+    GraphDescription description;
+    const uint32_t nodeCount = r.count(16);
+    description.nodes.resize(nodeCount);
+    for (Node & node : description.nodes)
+    {
+        node.type = r.string();
+        node.name = r.string();
+        for (std::vector<Value> * values : { &node.params, &node.settings })
+        {
+            values->resize(r.count(8));
+            for (Value & v : *values)
+            {
+                v.name = r.string();
+                v.value = r.f32();
+            }
+        }
+    }
+
+    description.connections.resize(r.count(20));
+    for (Connection & c : description.connections)
+    {
+        c.source = r.u32();
+        c.output = r.u32();
+        c.destination = r.u32();
+        c.input = r.u32();
+        c.param = r.string();
+    }
+
+    if (!r.done())
+        throw std::invalid_argument("Malformed graph description, trailing bytes");
+    return description;
+}
+
+struct PrefabArena::Block
+{
+    std::unique_ptr<std::max_align_t[]> memory;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t requested = 0;
+};
+
+PrefabArena::PrefabArena(size_t capacity)
+    : m_block(std::make_shared<Block>())
+{
+    if (capacity)
+    {
+        const size_t units = (capacity + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+        m_block->memory.reset(new std::max_align_t[units]);
+        m_block->capacity = units * sizeof(std::max_align_t);
+    }
+}
+
+size_t PrefabArena::used() const
+{
+    return m_block->requested;
+}
+
+void * PrefabArena::allocate(const std::shared_ptr<Block> & block, size_t bytes, size_t alignment)
+{
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    const size_t rounded = (bytes + alignment - 1) / alignment * alignment;
+    block->requested += rounded;
+
+    const size_t start = (block->used + alignment - 1) / alignment * alignment;
+    if (alignment == alignof(std::max_align_t) && start + bytes <= block->capacity)
+    {
+        block->used = start + bytes;
+        return reinterpret_cast<uint8_t *>(block->memory.get()) + start;
+    }
+    return ::operator new(bytes);
+}
+
+void PrefabArena::deallocate(const std::shared_ptr<Block> & block, void * p, size_t)
+{
+    // The block's memory goes with the block, once nothing refers to it.
+    const uint8_t * begin = reinterpret_cast<const uint8_t *>(block->memory.get());
+    const uint8_t * q = static_cast<const uint8_t *>(p);
+    if (begin && q >= begin && q < begin + block->capacity)
+        return;
+    ::operator delete(p);
+}
+
+void GraphPrefab::registerType(const std::string & type, NodeFactory factory)
+{
+    Registry & r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.factories[type] = std::move(factory);
+}
+
+std::shared_ptr<AudioNode> GraphPrefab::makeNode(AudioContext & context, const std::string & type)
+{
+    NodeFactory factory;
+    {
+        Registry & r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        auto found = r.factories.find(type);
+        if (found == r.factories.end())
+            return nullptr;
+        factory = found->second;
+    }
+
+    PrefabArena heap;
+    return factory(context, heap);
+}
+
+GraphPrefab::GraphPrefab(AudioContext & context, const GraphDescription & description)
+{
+    // A prototype of each node resolves its names and ports, and measures the arena.
+    PrefabArena measure;
+    std::vector<std::shared_ptr<AudioNode>> prototypes;
+
+    for (const GraphDescription::Node & n : description.nodes)
+    {
+        Node node;
+        node.name = n.name;
+        {
+            Registry & r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            auto found = r.factories.find(n.type);
+            if (found == r.factories.end())
+                throw std::invalid_argument("Unknown node type " + n.type);
+            node.factory = found->second;
+        }
+
+        std::shared_ptr<AudioNode> prototype = node.factory(context, measure);
+        if (!prototype)
+            throw std::invalid_argument("The factory for " + n.type + " made no node");
+
+        const std::vector<std::string> params = prototype->params();
+        for (const GraphDescription::Value & v : n.params)
+        {
+            auto found = std::find(params.begin(), params.end(), v.name);
+            if (found == params.end())
+                throw std::invalid_argument(n.type + " has no parameter " + v.name);
+            node.params.push_back({ static_cast<size_t>(found - params.begin()), v.value, false });
+        }
+
+        const std::vector<std::string> settings = prototype->settings();
+        for (const GraphDescription::Value & v : n.settings)
+        {
+            auto found = std::find(settings.begin(), settings.end(), v.name);
+            if (found == settings.end())
+                throw std::invalid_argument(n.type + " has no setting " + v.name);
+            const size_t index = static_cast<size_t>(found - settings.begin());
+            const bool integer = !prototype->settingAt(index)->floatAssigned() && v.value >= 0 && v.value == std::floor(v.value);
+            node.settings.push_back({ index, v.value, integer });
+        }
+
+        m_nodes.push_back(std::move(node));
+        prototypes.push_back(std::move(prototype));
+    }
+
+    for (const GraphDescription::Connection & c : description.connections)
+    {
+        if (c.source >= prototypes.size() || c.destination >= prototypes.size())
+            throw std::invalid_argument("A connection to a node the description doesn't have");
+
+        const AudioNode & source = *prototypes[c.source];
+        AudioNode & destination = *prototypes[c.destination];
+        if (c.output >= source.numberOfOutputs())
+            throw std::invalid_argument("A connection from an output the node doesn't have");
+
+        Connection connection = { c.source, c.output, c.destination, c.input, NoParam };
+        if (!c.param.empty())
+        {
+            const std::vector<std::string> params = destination.params();
+            auto found = std::find(params.begin(), params.end(), c.param);
+            if (found == params.end())
+                throw std::invalid_argument("A connection to a parameter the node doesn't have, " + c.param);
+            connection.param = static_cast<size_t>(found - params.begin());
+        }
+        else if (c.input >= destination.numberOfInputs())
+            throw std::invalid_argument("A connection to an input the node doesn't have");
+
+        m_connections.push_back(connection);
+    }
+
+    m_arenaBytes = measure.used();
+}
+
+GraphPrefab::~GraphPrefab()
+{
+}
+
+std::vector<std::shared_ptr<AudioNode>> GraphPrefab::instantiate(AudioContext & context, GraphTransaction & transaction) const
+{
+    PrefabArena arena(m_arenaBytes);
+
+    std::vector<std::shared_ptr<AudioNode>> nodes;
+    nodes.reserve(m_nodes.size());
+    for (const Node & node : m_nodes)
+    {
+        std::shared_ptr<AudioNode> instance = node.factory(context, arena);
+        for (const Value & v : node.params)
+            instance->paramAt(v.index)->setValue(v.value);
+        for (const Value & v : node.settings)
+        {
+            if (v.integer)
+                instance->settingAt(v.index)->setUint32(static_cast<uint32_t>(v.value));
+            else
+                instance->settingAt(v.index)->setFloat(v.value);
+        }
+        nodes.push_back(std::move(instance));
+    }
+
+    transaction.reserve(transaction.size() + m_connections.size());
+    for (const Connection & c : m_connections)
+    {
+        if (c.param == NoParam)
+            transaction.connect(nodes[c.destination], nodes[c.source], c.input, c.output);
+        else
+            transaction.connectParam(nodes[c.destination]->paramAt(c.param), nodes[c.source], c.output);
+    }
+    return nodes;
+}
+
+std::vector<std::shared_ptr<AudioNode>> GraphPrefab::instantiate(AudioContext & context) const
+{
+    GraphTransaction transaction(&context);
+    std::vector<std::shared_ptr<AudioNode>> nodes = instantiate(context, transaction);
+    transaction.commit();
+    return nodes;
+}
+
+size_t GraphPrefab::index(const std::string & name) const
+{
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+        if (m_nodes[i].name == name)
+            return i;
+    return m_nodes.size();
+}
+
+} // namespace lab
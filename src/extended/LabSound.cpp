@@ -2,12 +2,16 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/LabSound.h"
+#include "LabSound/core/AttachedAudioDestinationNode.h"
 #include "LabSound/core/AudioContext.h"
+#include "LabSound/core/ConcurrentQueue.h"
 #include "LabSound/core/DefaultAudioDestinationNode.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 #include "LabSound/extended/Logging.h"
 
+#include "internal/AlignedAllocation.h"
+
 #include <atomic>
 #include <chrono>
 #include <iostream>
@@ -28,11 +32,26 @@ std::shared_ptr<AudioHardwareSourceNode> MakeHardwareSourceNode(ContextRenderLoc
     return inputNode;
 }
 
-std::unique_ptr<lab::AudioContext> MakeRealtimeAudioContext(uint32_t numChannels, float sample_rate)
+std::unique_ptr<lab::AudioContext> MakeRealtimeAudioContext(uint32_t numChannels, float sample_rate, size_t renderQuantumSize)
+{
+    return MakeRealtimeAudioContext(AudioDeviceSettings(), numChannels, sample_rate, renderQuantumSize);
+}
+
+std::unique_ptr<lab::AudioContext> MakeRealtimeAudioContext(const AudioDeviceSettings & deviceSettings, uint32_t numChannels, float sample_rate, size_t renderQuantumSize)
 {
     LOG("Initialize Realtime Context");
-    std::unique_ptr<AudioContext> ctx(new lab::AudioContext(false));
-    ctx->setDestinationNode(std::make_shared<lab::DefaultAudioDestinationNode>(ctx.get(), numChannels, sample_rate));
+    std::unique_ptr<AudioContext> ctx(new lab::AudioContext(false, true, renderQuantumSize));
+    ctx->setDestinationNode(std::make_shared<lab::DefaultAudioDestinationNode>(ctx.get(), numChannels, sample_rate, deviceSettings));
+    ctx->lazyInitialize();
+    return ctx;
+}
+
+std::unique_ptr<lab::AudioContext> MakeAttachedAudioContext(AudioContext & host, uint32_t numChannels)
+{
+    LOG("Initialize Attached Context");
+    std::unique_ptr<AudioContext> ctx(new lab::AudioContext(false, true, host.renderQuantumSize()));
+    ctx->setDestinationNode(std::make_shared<lab::AttachedAudioDestinationNode>(ctx.get(), numChannels, host.sampleRate()));
+    host.attachContext(*ctx);
     ctx->lazyInitialize();
     return ctx;
 }
@@ -49,11 +68,11 @@ std::unique_ptr<lab::AudioContext> MakeOfflineAudioContext(uint32_t numChannels,
     return ctx;
 }
 
-std::unique_ptr<lab::AudioContext> MakeOfflineAudioContext(uint32_t numChannels, float recordTimeMilliseconds, float sampleRate)
+std::unique_ptr<lab::AudioContext> MakeOfflineAudioContext(uint32_t numChannels, float recordTimeMilliseconds, float sampleRate, size_t renderQuantumSize)
 {
     LOG("Initialize Offline Context");
 
-    std::unique_ptr<AudioContext> ctx(new lab::AudioContext(true));
+    std::unique_ptr<AudioContext> ctx(new lab::AudioContext(true, true, renderQuantumSize));
     float secondsToRun = (float) recordTimeMilliseconds * 0.001f;
     ctx->setDestinationNode(std::make_shared<lab::OfflineAudioDestinationNode>(ctx.get(), sampleRate, secondsToRun, numChannels));
     ctx->lazyInitialize();
@@ -77,8 +96,10 @@ namespace
         "DynamicsCompressor",
         "Function",
         "Gain",
+        "Granular",
         "Noise",
         "Oscillator",
+        "OscillatorBank",
         "Panner",
 #ifdef PD
         "PureData",
@@ -89,10 +110,12 @@ namespace
         "PWM",
         "Recorder",
         "SampledAudio",
+        "SampledInstrument",
         "Sfxr",
         "Spatialization",
         "SpectralMonitor",
         "StereoPanner",
+        "StreamingAudio",
         "SuperSaw",
         "WaveShaper",
         nullptr
@@ -115,16 +138,219 @@ char const * const * const AudioNodeNames()
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+namespace
+{
+    struct LogRecord
+    {
+        int level = LABSOUND_LOG_INFO;
+        const char * file = nullptr;
+        int line = 0;
+        char message[LABSOUND_LOG_MESSAGE_SIZE] = {};
+    };
+
+    void PrintLogMessage(int, const char * file, int line, const char * message)
+    {
+        printf("[%s @ %i]\n\t%s\n", file, line, message);
+        fflush(stdout);
+    }
+
+    std::atomic<int> s_logLevel{ LABSOUND_LOG_VERBOSE };
+    std::atomic<LabSoundLogSink> s_logSink{ nullptr };
+
+    void HandleLogRecord(const LogRecord & record)
+    {
+        LabSoundLogSink sink = s_logSink.load();
+        (sink ? sink : PrintLogMessage)(record.level, record.file, record.line, record.message);
+    }
+
+    // Messages are queued in preallocated records and handed to the sink on a thread of their own, so that
+    // logging never waits on the console. The thread runs while any context does, see LabSoundStartLogging();
+    // otherwise messages are handed to the sink directly.
+    class Logger : public lab::AlignedAllocation<Logger>
+    {
+    public:
+
+        static constexpr size_t QueueSize = 1024;
+
+        Logger()
+        : m_queue(QueueSize)
+        {
+        }
+
+        void start()
+        {
+            m_shouldRun = true;
+            m_thread = std::thread(&Logger::drain, this);
+            m_running = true;
+        }
+
+        // A producer that saw the logger running has pushed by the time the thread's last pass starts, so that
+        // pass hands on every message queued.
+        void stop()
+        {
+            m_running = false;
+            while (m_pushing.load())
+                std::this_thread::yield();
+            m_shouldRun = false;
+            m_thread.join();
+        }
+
+        // Returns false if the logger isn't running, for the message to be handed to the sink directly.
+        bool push(const LogRecord & record)
+        {
+            m_pushing.fetch_add(1);
+            const bool running = m_running.load();
+            if (running)
+            {
+                if (m_queue.tryPush(record))
+                    m_pushed.fetch_add(1);
+                else
+                    m_dropped.fetch_add(1);
+            }
+            m_pushing.fetch_sub(1);
+            return running;
+        }
+
+        void flush()
+        {
+            if (!m_running.load() || std::this_thread::get_id() == m_thread.get_id())
+                return;
+
+            const uint64_t pushed = m_pushed.load();
+            while (m_handled.load() < pushed)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+    private:
+
+        void drain()
+        {
+            const auto DrainInterval = std::chrono::milliseconds(5);
+
+            LogRecord record;
+            for (;;)
+            {
+                // A last pass is made once stopping, for the messages queued meanwhile.
+                const bool stopping = !m_shouldRun;
+
+                bool drained = false;
+                while (m_queue.tryPop(record))
+                {
+                    HandleLogRecord(record);
+                    m_handled.fetch_add(1);
+                    drained = true;
+                }
+
+                if (uint64_t dropped = m_dropped.exchange(0))
+                {
+                    LogRecord warning;
+                    warning.level = LABSOUND_LOG_ERROR;
+                    warning.file = __FILE__;
+                    warning.line = __LINE__;
+                    snprintf(warning.message, sizeof(warning.message), "%llu log messages were dropped; the queue was full",
+                             static_cast<unsigned long long>(dropped));
+                    HandleLogRecord(warning);
+                }
+
+                if (stopping)
+                    break;
+                if (!drained)
+                    std::this_thread::sleep_for(DrainInterval);
+            }
+        }
+
+        lab::BoundedMPSCQueue<LogRecord> m_queue;
+        std::atomic<uint64_t> m_pushed{ 0 };
+        std::atomic<uint64_t> m_handled{ 0 };
+        std::atomic<uint64_t> m_dropped{ 0 };
+        std::atomic<int> m_pushing{ 0 };
+        std::atomic<bool> m_running{ false };
+        std::atomic<bool> m_shouldRun{ false };
+        std::thread m_thread;
+    };
+
+    // Made by the first start, and never destroyed, so that no thread is started as the library is loaded nor
+    // joined as it's unloaded, when a Windows DLL holds the loader lock.
+    std::mutex s_loggerLock;
+    size_t s_loggerUsers = 0;
+    std::atomic<Logger *> s_logger{ nullptr };
+
+    void LogMessage(int level, const char * file, int line, const char * fmt, va_list args)
+    {
+        if (level < s_logLevel.load(std::memory_order_relaxed))
+            return;
+
+        LogRecord record;
+        record.level = level;
+        record.file = file;
+        record.line = line;
+        vsnprintf(record.message, sizeof(record.message), fmt, args);
+
+        Logger * logger = s_logger.load();
+        if (!logger || !logger->push(record))
+            HandleLogRecord(record);
+    }
+}
+
+void LabSoundLogAt(int level, const char * file, int line, const char * fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    LogMessage(level, file, line, fmt, args);
+    va_end(args);
+}
+
 void LabSoundLog(const char * file, int line, const char * fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
+    LogMessage(LABSOUND_LOG_ERROR, file, line, fmt, args);
+    va_end(args);
+}
+
+void LabSoundSetLogLevel(int level)
+{
+    s_logLevel = level;
+}
 
-    char tmp[256] = {0};
-    sprintf(tmp, "[%s @ %i]\n\t%s\n", file, line, fmt);
-    vprintf(tmp, args);
+int LabSoundGetLogLevel()
+{
+    return s_logLevel;
+}
 
-    va_end(args);
+void LabSoundSetLogSink(LabSoundLogSink sink)
+{
+    s_logSink = sink;
+}
+
+void LabSoundLogFlush()
+{
+    if (Logger * logger = s_logger.load())
+        logger->flush();
+}
+
+void LabSoundStartLogging()
+{
+    std::lock_guard<std::mutex> lock(s_loggerLock);
+    if (s_loggerUsers++)
+        return;
+
+    Logger * logger = s_logger.load();
+    if (!logger)
+    {
+        logger = new Logger();
+        s_logger = logger;
+    }
+    logger->start();
+}
+
+void LabSoundStopLogging()
+{
+    std::lock_guard<std::mutex> lock(s_loggerLock);
+    if (!s_loggerUsers || --s_loggerUsers)
+        return;
+
+    s_logger.load()->stop();
 }
 
 void LabSoundAssertLog(const char * file_, int line, const char * function_, const char * assertion_)
@@ -0,0 +1,240 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/LoadGovernor.h"
+
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioRenderHealth.h"
+#include "LabSound/core/ConvolverNode.h"
+#include "LabSound/core/PannerNode.h"
+#include "LabSound/core/SampledAudioNode.h"
+
+#include "LabSound/extended/SampledVoicePool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lab
+{
+
+namespace
+{
+    // Drops the entries whose objects are gone.
+    template <typename T>
+    void prune(std::vector<T> & entries)
+    {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [](const T & e) { return e.object.expired(); }), entries.end());
+    }
+}
+
+LoadGovernor::LoadGovernor(AudioContext & context)
+    : LoadGovernor(context, Settings())
+{
+}
+
+LoadGovernor::LoadGovernor(AudioContext & context, const Settings & settings)
+    : m_context(context)
+    , m_settings(settings)
+    , m_lastChange(std::chrono::steady_clock::now())
+{
+}
+
+LoadGovernor::~LoadGovernor()
+{
+    release();
+}
+
+void LoadGovernor::addPanner(std::shared_ptr<PannerNode> panner)
+{
+    m_panners.push_back({ panner });
+    if (m_engaged > static_cast<int>(Step::SimplerPanning))
+        updatePanners();
+}
+
+void LoadGovernor::addConvolver(std::shared_ptr<ConvolverNode> convolver)
+{
+    Entry<ConvolverNode> entry{ convolver };
+    if (m_engaged > static_cast<int>(Step::ShorterReverbs))
+    {
+        convolver->setTailLimit(m_settings.reverbTail);
+        entry.degraded = true;
+    }
+    m_convolvers.push_back(entry);
+}
+
+void LoadGovernor::addSampledNode(std::shared_ptr<SampledAudioNode> node)
+{
+    Entry<SampledAudioNode> entry{ node };
+    if (m_engaged > static_cast<int>(Step::CheaperResampling))
+    {
+        entry.restore = node->interpolation();
+        node->setInterpolation(SampledAudioNode::LINEAR);
+        entry.degraded = true;
+    }
+    m_sampledNodes.push_back(entry);
+}
+
+void LoadGovernor::addVoicePool(std::shared_ptr<SampledVoicePool> pool)
+{
+    Entry<SampledVoicePool> entry{ pool };
+    if (m_engaged > static_cast<int>(Step::FewerVoices))
+    {
+        pool->setVoiceLimit(static_cast<size_t>(std::ceil(pool->size() * m_settings.voiceFraction)));
+        entry.degraded = true;
+    }
+    m_voicePools.push_back(entry);
+}
+
+void LoadGovernor::update()
+{
+    const double load = m_context.renderHealth().recentLoad;
+    const auto now = std::chrono::steady_clock::now();
+
+    if (std::chrono::duration<double>(now - m_lastChange).count() >= m_settings.holdSeconds)
+    {
+        bool changed = false;
+        Event event;
+        if (m_engaged < StepCount && load >= m_settings.thresholds[m_engaged])
+        {
+            event = { static_cast<Step>(m_engaged++), true, load };
+            engage(event.step);
+            changed = true;
+        }
+        else if (m_engaged > 0 && load < m_settings.thresholds[m_engaged - 1] - m_settings.hysteresis)
+        {
+            event = { static_cast<Step>(--m_engaged), false, load };
+            disengage(event.step);
+            changed = true;
+        }
+
+        if (changed)
+        {
+            m_lastChange = now;
+            if (onChange)
+                onChange(event);
+        }
+    }
+
+    // Panners move, so which are distant enough to degrade is looked at again each update.
+    if (m_engaged > static_cast<int>(Step::SimplerPanning))
+        updatePanners();
+}
+
+void LoadGovernor::release()
+{
+    while (m_engaged > 0)
+        disengage(static_cast<Step>(--m_engaged));
+}
+
+void LoadGovernor::engage(Step step)
+{
+    switch (step)
+    {
+        case Step::SimplerPanning:
+            updatePanners();
+            break;
+
+        case Step::ShorterReverbs:
+            prune(m_convolvers);
+            for (auto & entry : m_convolvers)
+                if (std::shared_ptr<ConvolverNode> convolver = entry.object.lock())
+                {
+                    convolver->setTailLimit(m_settings.reverbTail);
+                    entry.degraded = true;
+                }
+            break;
+
+        case Step::CheaperResampling:
+            prune(m_sampledNodes);
+            for (auto & entry : m_sampledNodes)
+                if (std::shared_ptr<SampledAudioNode> node = entry.object.lock())
+                {
+                    entry.restore = node->interpolation();
+                    node->setInterpolation(SampledAudioNode::LINEAR);
+                    entry.degraded = true;
+                }
+            break;
+
+        case Step::FewerVoices:
+            prune(m_voicePools);
+            for (auto & entry : m_voicePools)
+                if (std::shared_ptr<SampledVoicePool> pool = entry.object.lock())
+                {
+                    pool->setVoiceLimit(static_cast<size_t>(std::ceil(pool->size() * m_settings.voiceFraction)));
+                    entry.degraded = true;
+                }
+            break;
+    }
+}
+
+void LoadGovernor::disengage(Step step)
+{
+    switch (step)
+    {
+        case Step::SimplerPanning:
+            for (auto & entry : m_panners)
+                if (entry.degraded)
+                {
+                    if (std::shared_ptr<PannerNode> panner = entry.object.lock())
+                        panner->setPanningModel(HRTF);
+                    entry.degraded = false;
+                }
+            break;
+
+        case Step::ShorterReverbs:
+            for (auto & entry : m_convolvers)
+                if (entry.degraded)
+                {
+                    if (std::shared_ptr<ConvolverNode> convolver = entry.object.lock())
+                        convolver->setTailLimit(std::numeric_limits<double>::infinity());
+                    entry.degraded = false;
+                }
+            break;
+
+        case Step::CheaperResampling:
+            for (auto & entry : m_sampledNodes)
+                if (entry.degraded)
+                {
+                    if (std::shared_ptr<SampledAudioNode> node = entry.object.lock())
+                        node->setInterpolation(static_cast<SampledAudioNode::InterpolationMode>(entry.restore));
+                    entry.degraded = false;
+                }
+            break;
+
+        case Step::FewerVoices:
+            for (auto & entry : m_voicePools)
+                if (entry.degraded)
+                {
+                    if (std::shared_ptr<SampledVoicePool> pool = entry.object.lock())
+                        pool->setVoiceLimit(pool->size());
+                    entry.degraded = false;
+                }
+            break;
+    }
+}
+
+void LoadGovernor::updatePanners()
+{
+    prune(m_panners);
+    for (auto & entry : m_panners)
+    {
+        std::shared_ptr<PannerNode> panner = entry.object.lock();
+        if (!panner)
+            continue;
+
+        const bool distant = panner->listenerDistance() >= m_settings.pannerDistance;
+        if (!entry.degraded && distant && panner->panningModel() == HRTF)
+        {
+            panner->setPanningModel(EQUALPOWER);
+            entry.degraded = true;
+        }
+        else if (entry.degraded && !distant)
+        {
+            panner->setPanningModel(HRTF);
+            entry.degraded = false;
+        }
+    }
+}
+
+} // namespace lab
@@ -0,0 +1,94 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/MappedAudioFile.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/Assertions.h"
+#include "internal/MappedFile.h"
+#include "internal/WaveFile.h"
+
+#include <cstring>
+
+namespace lab
+{
+
+struct MappedAudioFile::Internals
+{
+    std::unique_ptr<MappedFile> file;
+    WaveFormat format;
+    const uint8_t * frames = nullptr;
+};
+
+std::shared_ptr<MappedAudioFile> MappedAudioFile::open(const std::string & path)
+{
+    std::unique_ptr<Internals> internals(new Internals());
+    internals->file = MappedFile::open(path);
+    if (!internals->file)
+        return nullptr;
+
+    const MappedFile & file = *internals->file;
+    auto read = [&file](uint64_t offset, void * data, size_t size) {
+        if (offset > file.size() || size > file.size() - offset)
+            return false;
+        memcpy(data, file.data() + offset, size);
+        return true;
+    };
+    if (!readWaveFormat(read, file.size(), internals->format))
+    {
+        LOG_ERROR("%s can't be mapped; only PCM and float WAV files can", path.c_str());
+        return nullptr;
+    }
+
+    internals->frames = file.data() + internals->format.dataOffset;
+    return std::shared_ptr<MappedAudioFile>(new MappedAudioFile(std::move(internals)));
+}
+
+MappedAudioFile::MappedAudioFile(std::unique_ptr<Internals> internals)
+    : m_internals(std::move(internals))
+{
+}
+
+MappedAudioFile::~MappedAudioFile()
+{
+}
+
+unsigned MappedAudioFile::numberOfChannels() const
+{
+    return m_internals->format.numberOfChannels;
+}
+
+float MappedAudioFile::sampleRate() const
+{
+    return m_internals->format.sampleRate;
+}
+
+size_t MappedAudioFile::length() const
+{
+    return static_cast<size_t>(m_internals->format.frameCount);
+}
+
+double MappedAudioFile::duration() const
+{
+    return m_internals->format.frameCount / static_cast<double>(m_internals->format.sampleRate);
+}
+
+void MappedAudioFile::read(size_t frame, size_t frameCount, float * const * channels, unsigned numberOfChannels) const
+{
+    const WaveFormat & format = m_internals->format;
+    bool isRangeGood = frame <= format.frameCount && frameCount <= format.frameCount - frame;
+    ASSERT(isRangeGood);
+    if (!isRangeGood)
+        return;
+
+    convertWaveFrames(format, m_internals->frames + frame * format.bytesPerFrame(), frameCount, channels, numberOfChannels);
+}
+
+float MappedAudioFile::sample(unsigned channel, size_t frame) const
+{
+    const WaveFormat & format = m_internals->format;
+    ASSERT(channel < format.numberOfChannels && frame < format.frameCount);
+    return convertWaveSample(format, m_internals->frames + frame * format.bytesPerFrame() + channel * (format.bitsPerSample / 8));
+}
+
+} // namespace lab
@@ -0,0 +1,215 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/MixerNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/Macros.h"
+#include "LabSound/core/Mixing.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace lab
+{
+
+namespace
+{
+    // The gains from each channel of a mono or stereo input to the left and right outputs, as [output][input].
+    void stripGains(float gain, float pan, size_t channels, float gains[2][2])
+    {
+        pan = clampTo(pan, -1.f, 1.f);
+
+        // A mono input is panned at equal power across the outputs. Of a stereo input, as in StereoPannerNode,
+        // the channel on the side panned towards is kept, and the other is panned at equal power across both.
+        const double position = channels == 1 ? pan * 0.5 + 0.5 : (pan <= 0 ? pan + 1 : pan);
+        const double toLeft = position >= 1 ? 0 : std::cos(position * piOverTwoDouble);
+        const double toRight = position >= 1 ? 1 : std::sin(position * piOverTwoDouble);
+
+        if (channels == 1)
+        {
+            gains[0][0] = static_cast<float>(gain * toLeft);
+            gains[1][0] = static_cast<float>(gain * toRight);
+            gains[0][1] = gains[1][1] = 0;
+        }
+        else if (pan <= 0)
+        {
+            gains[0][0] = gain;
+            gains[0][1] = static_cast<float>(gain * toLeft);
+            gains[1][0] = 0;
+            gains[1][1] = static_cast<float>(gain * toRight);
+        }
+        else
+        {
+            gains[0][0] = static_cast<float>(gain * toLeft);
+            gains[0][1] = 0;
+            gains[1][0] = static_cast<float>(gain * toRight);
+            gains[1][1] = gain;
+        }
+    }
+}
+
+MixerNode::MixerNode(size_t numberOfInputs)
+    : AudioNode()
+    , m_downmix(new AudioBus(Channels::Stereo, AudioNode::ProcessingSizeInFrames))
+{
+    addInputs(numberOfInputs);
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, Channels::Stereo)));
+    initialize();
+}
+
+MixerNode::~MixerNode()
+{
+    uninitialize();
+}
+
+void MixerNode::addInputs(size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+        m_strips.emplace_back();
+    }
+}
+
+void MixerNode::setGain(size_t input, float gain)
+{
+    if (input < m_strips.size())
+        m_strips[input].gain.store(gain, std::memory_order_relaxed);
+}
+
+void MixerNode::setPan(size_t input, float pan)
+{
+    if (input < m_strips.size())
+        m_strips[input].pan.store(pan, std::memory_order_relaxed);
+}
+
+float MixerNode::gain(size_t input) const
+{
+    return input < m_strips.size() ? m_strips[input].gain.load(std::memory_order_relaxed) : 0.f;
+}
+
+float MixerNode::pan(size_t input) const
+{
+    return input < m_strips.size() ? m_strips[input].pan.load(std::memory_order_relaxed) : 0.f;
+}
+
+void MixerNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    outputBus->zero();
+    if (!isInitialized())
+        return;
+
+    if (framesToProcess != m_downmix->length())
+        m_downmix.reset(new AudioBus(Channels::Stereo, framesToProcess));
+
+    // Claimed on the first sounding input, so that the output stays silent without one.
+    float * outputs[2] = { nullptr, nullptr };
+    auto claimOutputs = [&]() {
+        if (!outputs[0])
+        {
+            outputs[0] = outputBus->channel(0)->mutableData();
+            outputs[1] = outputBus->channel(1)->mutableData();
+        }
+    };
+
+    // The channels of inputs whose gains are settled are gathered, and summed into the output in one pass.
+    const float * sources[VectorMath::MaxMixChannels];
+    float toLeft[VectorMath::MaxMixChannels];
+    float toRight[VectorMath::MaxMixChannels];
+    size_t sourceCount = 0;
+    auto flush = [&]() {
+        if (!sourceCount)
+            return;
+        claimOutputs();
+        const float * gains[2] = { toLeft, toRight };
+        VectorMath::vmix(sources, sourceCount, gains, outputs, 2, true, framesToProcess);
+        sourceCount = 0;
+    };
+
+    const size_t inputCount = std::min(numberOfInputs(), m_strips.size());
+    for (size_t i = 0; i < inputCount; ++i)
+    {
+        auto input = this->input(i);
+        if (!input->isConnected())
+            continue;
+
+        Strip & strip = m_strips[i];
+        AudioBus * bus = input->bus(r);
+        if (!bus || bus->isSilent() || bus->length() < framesToProcess)
+        {
+            strip.appliedChannels = 0;
+            continue;
+        }
+
+        size_t channels = bus->numberOfChannels();
+        if (channels > 2)
+        {
+            // The mixdown is shared, so any inputs gathered from an earlier one are summed first.
+            flush();
+            m_downmix->copyFrom(*bus);
+            bus = m_downmix.get();
+            channels = 2;
+        }
+
+        float target[2][2];
+        stripGains(strip.gain.load(std::memory_order_relaxed), strip.pan.load(std::memory_order_relaxed), channels, target);
+
+        // An input that just started sounding starts at its gains.
+        const bool settled = strip.appliedChannels != channels || !memcmp(strip.applied, target, sizeof(target));
+        if (settled)
+        {
+            if (sourceCount + channels > VectorMath::MaxMixChannels)
+                flush();
+
+            for (size_t c = 0; c < channels; ++c)
+            {
+                sources[sourceCount] = bus->channel(c)->data();
+                toLeft[sourceCount] = target[0][c];
+                toRight[sourceCount] = target[1][c];
+                ++sourceCount;
+            }
+        }
+        else
+        {
+            // Ramp from the gains last applied to the new ones over the quantum.
+            claimOutputs();
+            for (size_t c = 0; c < channels; ++c)
+            {
+                const float * source = bus->channel(c)->data();
+                for (size_t o = 0; o < 2; ++o)
+                {
+                    const float from = strip.applied[o][c];
+                    const float step = (target[o][c] - from) / framesToProcess;
+                    if (from == 0 && step == 0)
+                        continue;
+
+                    float * destination = outputs[o];
+                    for (size_t f = 0; f < framesToProcess; ++f)
+                        destination[f] += (from + step * (f + 1)) * source[f];
+                }
+            }
+        }
+
+        memcpy(strip.applied, target, sizeof(target));
+        strip.appliedChannels = channels;
+    }
+
+    flush();
+}
+
+void MixerNode::reset(ContextRenderLock &)
+{
+    for (Strip & strip : m_strips)
+        strip.appliedChannels = 0;
+}
+
+} // namespace lab
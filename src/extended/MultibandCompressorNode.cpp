@@ -0,0 +1,366 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/MultibandCompressorNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/Biquad.h"
+#include "internal/DynamicsCompressorKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lab
+{
+
+namespace
+{
+    const unsigned StereoChannels = 2;
+
+    // A fourth order Linkwitz-Riley crossover, each side two Butterworth sections, for a pair of channels. Its
+    // lowpass and highpass outputs are in phase, and sum to an allpass of the input.
+    struct Crossover
+    {
+        Biquad lowpass[2][StereoChannels];
+        Biquad highpass[2][StereoChannels];
+
+        // The allpass the crossover sums to, which keeps the bands below a higher crossover in phase with those
+        // split by it.
+        Biquad allpass[StereoChannels];
+
+        void design(double normalizedFrequency)
+        {
+            for (unsigned c = 0; c < StereoChannels; ++c)
+            {
+                // A resonance of 0 dB is a Q of 1 / sqrt(2), a Butterworth section.
+                for (int stage = 0; stage < 2; ++stage)
+                {
+                    lowpass[stage][c].setLowpassParams(normalizedFrequency, 0);
+                    highpass[stage][c].setHighpassParams(normalizedFrequency, 0);
+                }
+                allpass[c].setAllpassParams(normalizedFrequency, 1 / std::sqrt(2.0));
+            }
+        }
+
+        void reset()
+        {
+            for (unsigned c = 0; c < StereoChannels; ++c)
+            {
+                for (int stage = 0; stage < 2; ++stage)
+                {
+                    lowpass[stage][c].reset();
+                    highpass[stage][c].reset();
+                }
+                allpass[c].reset();
+            }
+        }
+
+        // low may not be source, but high may.
+        void split(const AudioBus & source, AudioBus & low, AudioBus & high, size_t framesToProcess)
+        {
+            filter(lowpass[0], source, low, framesToProcess);
+            filter(lowpass[1], low, low, framesToProcess);
+            filter(highpass[0], source, high, framesToProcess);
+            filter(highpass[1], high, high, framesToProcess);
+        }
+
+        static void filter(Biquad * biquads, const AudioBus & source, AudioBus & destination, size_t framesToProcess)
+        {
+            Biquad * channelBiquads[StereoChannels];
+            const float * sources[StereoChannels];
+            float * destinations[StereoChannels];
+            for (unsigned c = 0; c < StereoChannels; ++c)
+            {
+                channelBiquads[c] = &biquads[c];
+                sources[c] = source.channel(c)->data();
+                destinations[c] = destination.channel(c)->mutableData();
+            }
+            Biquad::process(channelBiquads, sources, destinations, StereoChannels, framesToProcess);
+        }
+    };
+}
+
+struct MultibandCompressorNode::Internals
+{
+    Internals()
+    {
+        for (uint32_t band = 0; band < MaxBands; ++band)
+        {
+            kernels[band].reset(new DynamicsCompressorKernel(StereoChannels));
+            kernels[band]->setAutomaticMakeupGain(false);
+        }
+        allocateBands(AudioNode::ProcessingSizeInFrames);
+    }
+
+    void allocateBands(size_t frames)
+    {
+        for (uint32_t band = 0; band < MaxBands; ++band)
+        {
+            bands[band].reset(new AudioBus(StereoChannels, frames));
+            sidechainBands[band].reset(new AudioBus(StereoChannels, frames));
+        }
+    }
+
+    void reset()
+    {
+        for (uint32_t band = 0; band < MaxBands; ++band)
+        {
+            kernels[band]->reset();
+            bandReduction[band] = 0;
+        }
+        for (Crossover & crossover : crossovers)
+            crossover.reset();
+        for (Crossover & crossover : sidechainCrossovers)
+            crossover.reset();
+    }
+
+    // Splits source into the first bandCount buses of bands, mixing it to stereo first.
+    void split(Crossover * splitters, const AudioBus & source, std::unique_ptr<AudioBus> * bands, uint32_t bandCount, bool alignPhase, size_t framesToProcess)
+    {
+        AudioBus & last = *bands[bandCount - 1];
+        last.copyFrom(source);
+        if (bandCount == 1)
+            return;
+
+        // What is above the low crossover is split again at the high one, and the band below it passes through
+        // the allpass that split sums to.
+        splitters[0].split(last, *bands[0], last, framesToProcess);
+        if (bandCount == 3)
+        {
+            splitters[1].split(last, *bands[1], last, framesToProcess);
+            if (alignPhase)
+                Crossover::filter(splitters[1].allpass, *bands[0], *bands[0], framesToProcess);
+        }
+    }
+
+    std::unique_ptr<DynamicsCompressorKernel> kernels[MaxBands];
+    float bandReduction[MaxBands] = {};
+
+    // The main input's crossovers, at the low and the high frequency, and the sidechain's.
+    Crossover crossovers[MaxBands - 1];
+    Crossover sidechainCrossovers[MaxBands - 1];
+    float designedSampleRate = 0;
+    uint32_t bandCount = 0;
+    uint32_t bandsVersion = 0; // of the settings the bands and crossovers were set up for
+    uint32_t lowVersion = 0;
+    uint32_t highVersion = 0;
+
+    std::unique_ptr<AudioBus> bands[MaxBands];
+    std::unique_ptr<AudioBus> sidechainBands[MaxBands];
+};
+
+MultibandCompressorNode::MultibandCompressorNode()
+    : AudioNode()
+    , m_bands(std::make_shared<AudioSetting>("bands"))
+    , m_lowCrossover(std::make_shared<AudioSetting>("lowCrossover"))
+    , m_highCrossover(std::make_shared<AudioSetting>("highCrossover"))
+{
+    // The same defaults as a DynamicsCompressorNode's.
+    m_threshold = std::make_shared<AudioParam>("threshold", -24, -100, 0);
+    m_knee = std::make_shared<AudioParam>("knee", 30, 0, 40);
+    m_ratio = std::make_shared<AudioParam>("ratio", 12, 1, 20);
+    m_attack = std::make_shared<AudioParam>("attack", 0.003, 0, 1);
+    m_release = std::make_shared<AudioParam>("release", 0.250, 0, 1);
+    m_makeupGain = std::make_shared<AudioParam>("makeupGain", 0, -40, 40);
+    m_reduction = std::make_shared<AudioParam>("reduction", 0, -20, 0);
+
+    m_params.push_back(m_threshold);
+    m_params.push_back(m_knee);
+    m_params.push_back(m_ratio);
+    m_params.push_back(m_attack);
+    m_params.push_back(m_release);
+    m_params.push_back(m_makeupGain);
+    m_params.push_back(m_reduction);
+
+    m_bands->setUint32(1);
+    m_lowCrossover->setFloat(250.f);
+    m_highCrossover->setFloat(3000.f);
+    m_settings.push_back(m_bands);
+    m_settings.push_back(m_lowCrossover);
+    m_settings.push_back(m_highCrossover);
+
+    addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+    addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, StereoChannels)));
+
+    initialize();
+}
+
+MultibandCompressorNode::~MultibandCompressorNode()
+{
+    uninitialize();
+}
+
+void MultibandCompressorNode::initialize()
+{
+    if (isInitialized())
+        return;
+
+    m_internal.reset(new Internals());
+
+    AudioNode::initialize();
+}
+
+void MultibandCompressorNode::prepare(AudioContext & context, size_t inputChannels)
+{
+    AudioNode::prepare(context, inputChannels);
+
+    // The buses are made here, and the render lock only taken to swap them in.
+    const size_t frames = context.renderQuantumSize();
+    if (m_internal && frames > m_internal->bands[0]->length())
+    {
+        std::unique_ptr<AudioBus> bands[MaxBands];
+        std::unique_ptr<AudioBus> sidechainBands[MaxBands];
+        for (uint32_t band = 0; band < MaxBands; ++band)
+        {
+            bands[band].reset(new AudioBus(StereoChannels, frames));
+            sidechainBands[band].reset(new AudioBus(StereoChannels, frames));
+        }
+
+        ContextRenderLock r(&context, "MultibandCompressorNode::prepare");
+        for (uint32_t band = 0; band < MaxBands; ++band)
+        {
+            std::swap(m_internal->bands[band], bands[band]);
+            std::swap(m_internal->sidechainBands[band], sidechainBands[band]);
+        }
+    }
+}
+
+void MultibandCompressorNode::uninitialize()
+{
+    if (!isInitialized())
+        return;
+
+    AudioNode::uninitialize();
+
+    m_internal.reset();
+}
+
+uint32_t MultibandCompressorNode::bands() const { return m_bands->valueUint32(); }
+void MultibandCompressorNode::setBands(uint32_t bands) { m_bands->setUint32(std::max(uint32_t(1), std::min(bands, uint32_t(MaxBands)))); }
+float MultibandCompressorNode::lowCrossover() const { return m_lowCrossover->valueFloat(); }
+void MultibandCompressorNode::setLowCrossover(float hz) { m_lowCrossover->setFloat(hz); }
+float MultibandCompressorNode::highCrossover() const { return m_highCrossover->valueFloat(); }
+void MultibandCompressorNode::setHighCrossover(float hz) { m_highCrossover->setFloat(hz); }
+
+float MultibandCompressorNode::bandReduction(uint32_t band) const
+{
+    return m_internal && band < MaxBands ? m_internal->bandReduction[band] : 0;
+}
+
+void MultibandCompressorNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    ASSERT(outputBus);
+
+    bool isSafe = isInitialized() && r.context();
+    ASSERT(isSafe);
+    if (!isSafe || !input(0)->isConnected())
+    {
+        outputBus->zero();
+        return;
+    }
+
+    Internals & internal = *m_internal;
+
+    // The band buses grow once if the context renders larger quanta than the default and prepare() wasn't called.
+    if (framesToProcess > internal.bands[0]->length())
+        internal.allocateBands(framesToProcess);
+    const float sampleRate = r.context()->sampleRate();
+
+    // The crossovers are designed again only as the settings or the sample rate change, and the filters and
+    // envelopes start over as the number of bands does. The settings are only looked at as they change.
+    if (m_bands->changed(internal.bandsVersion))
+    {
+        const uint32_t bandCount = std::max(uint32_t(1), std::min(m_bands->valueUint32(), uint32_t(MaxBands)));
+        if (bandCount != internal.bandCount)
+        {
+            internal.reset();
+            internal.bandCount = bandCount;
+        }
+    }
+    const uint32_t bandCount = internal.bandCount;
+
+    if ((m_lowCrossover->changed(internal.lowVersion) | m_highCrossover->changed(internal.highVersion)) ||
+        sampleRate != internal.designedSampleRate)
+    {
+        const float nyquist = sampleRate * 0.5f;
+        const float low = std::max(1.f, std::min(m_lowCrossover->valueFloat(), nyquist));
+        const float high = std::max(low, std::min(m_highCrossover->valueFloat(), nyquist));
+        internal.designedSampleRate = sampleRate;
+        internal.crossovers[0].design(low / nyquist);
+        internal.crossovers[1].design(high / nyquist);
+        internal.sidechainCrossovers[0].design(low / nyquist);
+        internal.sidechainCrossovers[1].design(high / nyquist);
+    }
+
+    const bool hasSidechain = input(1)->isConnected();
+    internal.split(internal.crossovers, *input(0)->bus(r), internal.bands, bandCount, true, framesToProcess);
+    if (hasSidechain)
+        internal.split(internal.sidechainCrossovers, *input(1)->bus(r), internal.sidechainBands, bandCount, false, framesToProcess);
+
+    const float threshold = m_threshold->value(r);
+    const float knee = m_knee->value(r);
+    const float ratio = m_ratio->value(r);
+    const float attack = m_attack->value(r);
+    const float release = m_release->value(r);
+    const float makeupGain = m_makeupGain->value(r);
+
+    // The lookahead and adaptive release of a DynamicsCompressor.
+    const float preDelay = 0.006f;
+    const float releaseZones[4] = { 0.09f, 0.16f, 0.42f, 0.98f };
+
+    float reduction = 0;
+    for (uint32_t band = 0; band < bandCount; ++band)
+    {
+        AudioBus & bus = *internal.bands[band];
+        const float * sources[StereoChannels];
+        float * destinations[StereoChannels];
+        const float * detectors[StereoChannels];
+        for (unsigned c = 0; c < StereoChannels; ++c)
+        {
+            sources[c] = bus.channel(c)->data();
+            destinations[c] = bus.channel(c)->mutableData();
+            detectors[c] = internal.sidechainBands[band]->channel(c)->data();
+        }
+
+        DynamicsCompressorKernel & kernel = *internal.kernels[band];
+        kernel.process(r, sources, destinations, StereoChannels, framesToProcess,
+                       threshold, knee, ratio, attack, release, preDelay, makeupGain, 1,
+                       releaseZones[0], releaseZones[1], releaseZones[2], releaseZones[3],
+                       hasSidechain ? detectors : nullptr, StereoChannels);
+
+        internal.bandReduction[band] = kernel.meteringGain();
+        reduction = std::min(reduction, kernel.meteringGain());
+    }
+
+    outputBus->copyFrom(*internal.bands[0]);
+    for (uint32_t band = 1; band < bandCount; ++band)
+        outputBus->sumFrom(*internal.bands[band]);
+    outputBus->clearSilentFlag();
+
+    m_reduction->setValue(reduction);
+}
+
+void MultibandCompressorNode::reset(ContextRenderLock &)
+{
+    if (m_internal)
+        m_internal->reset();
+}
+
+double MultibandCompressorNode::latencyTime(ContextRenderLock & r) const
+{
+    if (!m_internal || !r.context())
+        return 0;
+    return m_internal->kernels[0]->latencyFrames() / static_cast<double>(r.context()->sampleRate());
+}
+
+} // namespace lab
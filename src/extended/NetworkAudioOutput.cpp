@@ -0,0 +1,595 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/NetworkAudioOutput.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/Macros.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/VectorMath.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Opus comes with libnyquist, where LabSound is built with it.
+#if defined(__has_include)
+#if __has_include(<opus.h>)
+#include <opus.h>
+#define LABSOUND_NETWORK_OPUS 1
+#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace lab
+{
+
+namespace
+{
+#if defined(_WIN32)
+    typedef SOCKET Socket;
+    const Socket InvalidSocket = INVALID_SOCKET;
+
+    void closeSocket(Socket s) { closesocket(s); }
+
+    bool setNonBlocking(Socket s)
+    {
+        u_long on = 1;
+        return ioctlsocket(s, FIONBIO, &on) == 0;
+    }
+
+    // Winsock counts its users, so each output starts and cleans it up for itself.
+    struct SocketLibrary
+    {
+        SocketLibrary() { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); }
+        ~SocketLibrary() { WSACleanup(); }
+    };
+#else
+    typedef int Socket;
+    const Socket InvalidSocket = -1;
+
+    void closeSocket(Socket s) { close(s); }
+
+    bool setNonBlocking(Socket s)
+    {
+        const int flags = fcntl(s, F_GETFL, 0);
+        return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    struct SocketLibrary
+    {
+    };
+#endif
+
+    const size_t RtpHeaderBytes = 12;
+
+    // Packets are kept below a typical Ethernet MTU, less the IP and UDP headers.
+    const size_t MaxPayloadBytes = 1440;
+
+    // Opus's frame durations; packets take the nearest.
+    const double OpusFrameSeconds[] = { 0.0025, 0.005, 0.01, 0.02, 0.04, 0.06 };
+    const int OpusClockRate = 48000;
+
+    // A sender this far behind its schedule starts it again, rather than sending the backlog at once.
+    const double MaxLateSeconds = 0.1;
+
+    const uint8_t RtcpSenderReport = 200;
+    const uint8_t RtcpReceiverReport = 201;
+
+    void put16(uint8_t * p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 8);
+        p[1] = static_cast<uint8_t>(v);
+    }
+
+    void put32(uint8_t * p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    uint32_t get32(const uint8_t * p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+}
+
+// The render thread writes quanta to the ring, interleaved, and the sending thread reads packets from it.
+class NetworkAudioOutput::Sender
+{
+public:
+
+    Sender(float sampleRate, int channels, const Settings & settings)
+        : m_channels(channels)
+        , m_sampleRate(sampleRate)
+        , m_settings(settings)
+        , m_sources(channels)
+    {
+        m_encoding = settings.encoding;
+        if (m_encoding == Encoding::Opus && !openOpus())
+            m_encoding = Encoding::L24;
+
+        if (m_encoding == Encoding::Opus)
+        {
+            m_clockRatio = OpusClockRate / static_cast<double>(sampleRate);
+        }
+        else
+        {
+            const size_t bytes = m_encoding == Encoding::L16 ? 2 : 3;
+            m_packetFrames = std::max<size_t>(1, static_cast<size_t>(std::lround(settings.packetSeconds * sampleRate)));
+            const size_t largest = std::max<size_t>(1, MaxPayloadBytes / (bytes * channels));
+            if (m_packetFrames > largest)
+            {
+                LOG("Packets of %zu frames would pass the MTU; sending %zu frames a packet", m_packetFrames, largest);
+                m_packetFrames = largest;
+            }
+        }
+
+        const size_t target = std::max(static_cast<size_t>(settings.bufferSeconds * sampleRate), m_packetFrames * 2);
+        m_capacity = 1;
+        while (m_capacity < target)
+            m_capacity *= 2;
+        m_ring.resize(m_capacity * channels);
+
+        m_frame.resize(m_packetFrames * channels);
+        m_quantized.resize(m_packetFrames * channels);
+        m_packet.resize(RtpHeaderBytes + std::max(MaxPayloadBytes, m_packetFrames * channels * 3));
+
+        std::random_device random;
+        m_ssrc = settings.ssrc ? settings.ssrc : random();
+        m_sequence = static_cast<uint16_t>(random());
+        m_timestamp = random();
+
+        if (!openSockets())
+            return;
+
+        m_running = true;
+        m_thread = std::thread(&Sender::sendEntry, this);
+    }
+
+    ~Sender()
+    {
+        if (m_thread.joinable())
+        {
+            m_running = false;
+            m_thread.join();
+        }
+        if (m_rtp != InvalidSocket)
+            closeSocket(m_rtp);
+        if (m_rtcp != InvalidSocket)
+            closeSocket(m_rtcp);
+#if defined(LABSOUND_NETWORK_OPUS)
+        if (m_opus)
+            opus_encoder_destroy(m_opus);
+#endif
+    }
+
+    bool isOpen() const { return m_running.load(std::memory_order_relaxed); }
+
+    // Called on the render thread.
+    void write(const AudioBus & bus)
+    {
+        const size_t frames = bus.length();
+        const uint64_t written = m_written.load(std::memory_order_relaxed);
+        if (frames > AudioChannel::SharedZeroLength || m_capacity - (written - m_read.load(std::memory_order_acquire)) < frames)
+        {
+            m_overruns.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Channels the bus lacks are sent silent.
+        const int busChannels = static_cast<int>(bus.numberOfChannels());
+        for (int c = 0; c < m_channels; ++c)
+            m_sources[c] = c < busChannels ? bus.channel(c)->data() : AudioChannel::SharedZeros;
+
+        const size_t start = written & (m_capacity - 1);
+        const size_t first = std::min(frames, m_capacity - start);
+        VectorMath::vinterleave(m_sources.data(), m_channels, &m_ring[start * m_channels], first);
+        if (first < frames)
+        {
+            for (int c = 0; c < m_channels; ++c)
+                m_sources[c] += first;
+            VectorMath::vinterleave(m_sources.data(), m_channels, &m_ring[0], frames - first);
+        }
+
+        m_written.store(written + frames, std::memory_order_release);
+    }
+
+    Statistics statistics() const
+    {
+        Statistics s;
+        {
+            std::lock_guard<std::mutex> lock(m_statisticsMutex);
+            s = m_statistics;
+        }
+        s.overruns = m_overruns.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    double latency() const
+    {
+        return m_fill.load(std::memory_order_relaxed) / m_sampleRate + m_packetFrames / static_cast<double>(m_sampleRate);
+    }
+
+private:
+
+    bool openOpus()
+    {
+#if defined(LABSOUND_NETWORK_OPUS)
+        const int rate = static_cast<int>(m_sampleRate);
+        if (rate != 8000 && rate != 12000 && rate != 16000 && rate != 24000 && rate != 48000)
+        {
+            LOG_ERROR("Opus can't encode at %f Hz; sending L24", m_sampleRate);
+            return false;
+        }
+        if (m_channels > 2)
+        {
+            LOG_ERROR("Opus is sent mono or stereo, not %d channels; sending L24", m_channels);
+            return false;
+        }
+
+        int error = 0;
+        m_opus = opus_encoder_create(rate, m_channels, OPUS_APPLICATION_RESTRICTED_LOWDELAY, &error);
+        if (error != OPUS_OK)
+        {
+            LOG_ERROR("Couldn't make an Opus encoder: %s; sending L24", opus_strerror(error));
+            m_opus = nullptr;
+            return false;
+        }
+        opus_encoder_ctl(m_opus, OPUS_SET_BITRATE(m_settings.opusBitrate));
+
+        double seconds = OpusFrameSeconds[0];
+        for (double s : OpusFrameSeconds)
+            if (std::fabs(s - m_settings.packetSeconds) < std::fabs(seconds - m_settings.packetSeconds))
+                seconds = s;
+        m_packetFrames = static_cast<size_t>(std::lround(seconds * rate));
+        return true;
+#else
+        LOG_ERROR("LabSound was built without Opus; sending L24");
+        return false;
+#endif
+    }
+
+    bool openSockets()
+    {
+        sockaddr_in destination = {};
+        destination.sin_family = AF_INET;
+        destination.sin_port = htons(m_settings.port);
+        if (inet_pton(AF_INET, m_settings.address.c_str(), &destination.sin_addr) != 1)
+        {
+            LOG_ERROR("%s isn't an IPv4 address", m_settings.address.c_str());
+            return false;
+        }
+        m_destination = destination;
+
+        m_rtp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        m_rtcp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (m_rtp == InvalidSocket || m_rtcp == InvalidSocket)
+        {
+            LOG_ERROR("Couldn't open a UDP socket");
+            return false;
+        }
+
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(m_settings.localPort);
+        if (bind(m_rtp, reinterpret_cast<const sockaddr *>(&local), sizeof(local)) != 0)
+        {
+            LOG_ERROR("Couldn't bind RTP to port %u", static_cast<unsigned>(m_settings.localPort));
+            return false;
+        }
+
+        // Without a port for RTCP, the output just goes without receiver reports.
+        local.sin_port = htons(m_settings.localPort ? m_settings.localPort + 1 : 0);
+        if (bind(m_rtcp, reinterpret_cast<const sockaddr *>(&local), sizeof(local)) != 0 || !setNonBlocking(m_rtcp))
+        {
+            LOG("Couldn't bind RTCP to port %u; there will be no receiver reports", static_cast<unsigned>(m_settings.localPort + 1));
+            closeSocket(m_rtcp);
+            m_rtcp = InvalidSocket;
+        }
+
+        const uint8_t firstOctet = static_cast<uint8_t>(ntohl(destination.sin_addr.s_addr) >> 24);
+        if (firstOctet >= 224 && firstOctet <= 239)
+        {
+            const int ttl = m_settings.multicastTTL;
+            setsockopt(m_rtp, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char *>(&ttl), sizeof(ttl));
+        }
+        return true;
+    }
+
+    size_t available() const
+    {
+        return static_cast<size_t>(m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed));
+    }
+
+    void sendEntry()
+    {
+        using Clock = std::chrono::steady_clock;
+        const double packetSeconds = m_packetFrames / static_cast<double>(m_sampleRate);
+        const double fillWeight = 1 - std::exp(-packetSeconds);
+
+        // Packets are sent on a schedule of their own, begun when the first has been rendered, so that the
+        // quanta's bursts are evened out.
+        bool scheduled = false;
+        Clock::time_point start;
+        Clock::time_point lastDue;
+        uint64_t packets = 0;
+        double lastTransit = 0;
+        double jitter = 0;
+
+        while (m_running.load(std::memory_order_relaxed))
+        {
+            receiveReports();
+
+            if (!scheduled)
+            {
+                if (available() < m_packetFrames)
+                {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(packetSeconds / 2));
+                    continue;
+                }
+
+                // After an underrun, the timestamps skip the audio that wasn't there, so that receivers keep
+                // their playout in time.
+                const Clock::time_point now = Clock::now();
+                if (packets)
+                {
+                    const double gap = std::chrono::duration<double>(now - lastDue).count() - packetSeconds;
+                    m_timestamp += static_cast<uint32_t>(std::max(gap, 0.0) * m_sampleRate * m_clockRatio);
+                }
+                start = now;
+                packets = 0;
+                lastTransit = 0;
+                m_marker = true;
+                scheduled = true;
+            }
+
+            const Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(packets * packetSeconds));
+            std::this_thread::sleep_until(due);
+
+            const Clock::time_point now = Clock::now();
+            const double late = std::chrono::duration<double>(now - due).count();
+            const size_t inRing = available();
+            if (inRing < m_packetFrames || late > MaxLateSeconds)
+            {
+                std::lock_guard<std::mutex> lock(m_statisticsMutex);
+                ++m_statistics.underruns;
+                scheduled = false;
+                continue;
+            }
+
+            m_fill.store(m_fill.load(std::memory_order_relaxed) + (inRing - m_fill.load(std::memory_order_relaxed)) * fillWeight, std::memory_order_relaxed);
+
+            const size_t bytes = encode();
+            const bool sent = send(bytes);
+
+            // RFC 3550's estimator, over how late each packet leaves.
+            if (packets)
+                jitter += (std::fabs(late - lastTransit) - jitter) / 16;
+            lastTransit = late;
+            lastDue = due;
+            ++packets;
+
+            std::lock_guard<std::mutex> lock(m_statisticsMutex);
+            if (sent)
+            {
+                ++m_statistics.packetsSent;
+                m_statistics.bytesSent += bytes;
+            }
+            else
+                ++m_statistics.sendErrors;
+            m_statistics.sendJitter = jitter;
+        }
+    }
+
+    // Takes a packet's frames from the ring and writes the packet. Returns its size in bytes.
+    size_t encode()
+    {
+        const uint64_t read = m_read.load(std::memory_order_relaxed);
+        const size_t start = read & (m_capacity - 1);
+        const size_t first = std::min(m_packetFrames, m_capacity - start);
+        memcpy(m_frame.data(), &m_ring[start * m_channels], sizeof(float) * first * m_channels);
+        memcpy(m_frame.data() + first * m_channels, m_ring.data(), sizeof(float) * (m_packetFrames - first) * m_channels);
+        m_read.store(read + m_packetFrames, std::memory_order_release);
+
+        uint8_t * header = m_packet.data();
+        header[0] = 0x80;
+        header[1] = static_cast<uint8_t>((m_marker ? 0x80 : 0) | (m_settings.payloadType & 0x7f));
+        put16(header + 2, m_sequence++);
+        put32(header + 4, m_timestamp);
+        put32(header + 8, m_ssrc);
+        m_marker = false;
+        m_timestamp += static_cast<uint32_t>(std::lround(m_packetFrames * m_clockRatio));
+
+        uint8_t * payload = header + RtpHeaderBytes;
+        const size_t samples = m_packetFrames * m_channels;
+        switch (m_encoding)
+        {
+        case Encoding::L16:
+        {
+            int16_t * quantized = reinterpret_cast<int16_t *>(m_quantized.data());
+            VectorMath::vquantize16(m_frame.data(), quantized, m_dither, samples);
+            for (size_t i = 0; i < samples; ++i, payload += 2)
+                put16(payload, static_cast<uint16_t>(quantized[i]));
+            return RtpHeaderBytes + samples * 2;
+        }
+        case Encoding::L24:
+        {
+            const float scale = 8388607.f;
+            VectorMath::vquantize32(m_frame.data(), &scale, m_quantized.data(), samples);
+            for (size_t i = 0; i < samples; ++i, payload += 3)
+            {
+                const uint32_t v = static_cast<uint32_t>(m_quantized[i]);
+                payload[0] = static_cast<uint8_t>(v >> 16);
+                payload[1] = static_cast<uint8_t>(v >> 8);
+                payload[2] = static_cast<uint8_t>(v);
+            }
+            return RtpHeaderBytes + samples * 3;
+        }
+        case Encoding::Opus:
+        default:
+        {
+#if defined(LABSOUND_NETWORK_OPUS)
+            const opus_int32 encoded = opus_encode_float(m_opus, m_frame.data(), static_cast<int>(m_packetFrames), payload,
+                                                         static_cast<opus_int32>(m_packet.size() - RtpHeaderBytes));
+            return encoded > 0 ? RtpHeaderBytes + static_cast<size_t>(encoded) : 0;
+#else
+            return 0;
+#endif
+        }
+        }
+    }
+
+    bool send(size_t bytes)
+    {
+        if (!bytes)
+            return false;
+        auto sent = sendto(m_rtp, reinterpret_cast<const char *>(m_packet.data()), static_cast<int>(bytes), 0,
+                           reinterpret_cast<const sockaddr *>(&m_destination), sizeof(m_destination));
+        return sent == static_cast<decltype(sent)>(bytes);
+    }
+
+    // Reads whatever RTCP has arrived, keeping the latest report block about this stream.
+    void receiveReports()
+    {
+        if (m_rtcp == InvalidSocket)
+            return;
+
+        uint8_t buffer[1500];
+        for (;;)
+        {
+            const auto received = recv(m_rtcp, reinterpret_cast<char *>(buffer), sizeof(buffer), 0);
+            if (received <= 0)
+                return;
+
+            // A compound packet, each part's length in words less one.
+            const size_t size = static_cast<size_t>(received);
+            for (size_t offset = 0; offset + 8 <= size;)
+            {
+                const uint8_t * part = buffer + offset;
+                const size_t length = (((size_t(part[2]) << 8) | part[3]) + 1) * 4;
+                if ((part[0] >> 6) != 2 || offset + length > size)
+                    break;
+
+                const int blocks = part[0] & 0x1f;
+                size_t block = part[1] == RtcpSenderReport ? 28 : part[1] == RtcpReceiverReport ? 8 : length;
+                for (int b = 0; b < blocks && block + 24 <= length; ++b, block += 24)
+                    report(part + block);
+                offset += length;
+            }
+        }
+    }
+
+    void report(const uint8_t * block)
+    {
+        if (get32(block) != m_ssrc)
+            return;
+
+        // The cumulative count is 24 bits, signed.
+        int32_t lost = static_cast<int32_t>((uint32_t(block[5]) << 16) | (uint32_t(block[6]) << 8) | block[7]);
+        if (lost & 0x800000)
+            lost -= 0x1000000;
+
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        m_statistics.hasReceiverReport = true;
+        m_statistics.fractionLost = block[4] / 256.0;
+        m_statistics.cumulativeLost = lost;
+        m_statistics.receiverJitter = get32(block + 12) / (m_sampleRate * m_clockRatio);
+    }
+
+    const int m_channels;
+    const float m_sampleRate;
+    const Settings m_settings;
+    Encoding m_encoding;
+    size_t m_packetFrames = 0;
+    double m_clockRatio = 1; // RTP clock ticks per frame
+
+    SocketLibrary m_library;
+    Socket m_rtp = InvalidSocket;
+    Socket m_rtcp = InvalidSocket;
+    sockaddr_in m_destination = {};
+
+    // Interleaved, m_capacity frames, a power of two. Each side owns its own count.
+    std::vector<float> m_ring;
+    size_t m_capacity;
+    std::atomic<uint64_t> m_written{ 0 };
+    std::atomic<uint64_t> m_read{ 0 };
+    std::atomic<uint64_t> m_overruns{ 0 };
+    std::vector<const float *> m_sources;
+
+    // Owned by the sending thread.
+    std::vector<float> m_frame;
+    std::vector<int32_t> m_quantized;
+    std::vector<uint8_t> m_packet;
+    uint32_t m_dither[4] = { 0x9e3779b9, 0x7f4a7c15, 0x85ebca6b, 0xc2b2ae35 };
+    uint32_t m_ssrc;
+    uint16_t m_sequence;
+    uint32_t m_timestamp;
+    bool m_marker = true;
+#if defined(LABSOUND_NETWORK_OPUS)
+    OpusEncoder * m_opus = nullptr;
+#endif
+
+    std::atomic<double> m_fill{ 0 };
+    mutable std::mutex m_statisticsMutex;
+    Statistics m_statistics;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running{ false };
+};
+
+NetworkAudioOutput::NetworkAudioOutput(float sampleRate, int channels, const Settings & settings)
+    : m_sender(new Sender(sampleRate, std::max(channels, 1), settings))
+{
+}
+
+NetworkAudioOutput::~NetworkAudioOutput()
+{
+}
+
+bool NetworkAudioOutput::isOpen() const
+{
+    return m_sender->isOpen();
+}
+
+void NetworkAudioOutput::write(const AudioBus & bus, uint64_t)
+{
+    m_sender->write(bus);
+}
+
+std::function<void(const AudioBus &, uint64_t)> NetworkAudioOutput::output()
+{
+    return [this](const AudioBus & bus, uint64_t sampleFrame) { write(bus, sampleFrame); };
+}
+
+NetworkAudioOutput::Statistics NetworkAudioOutput::statistics() const
+{
+    return m_sender->statistics();
+}
+
+double NetworkAudioOutput::latency() const
+{
+    return m_sender->latency();
+}
+
+} // namespace lab
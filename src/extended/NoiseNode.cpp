@@ -4,19 +4,103 @@
 #include "LabSound/extended/NoiseNode.h"
 
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
 
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/FirstOrderFilter.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
 using namespace std;
 using namespace lab;
 
 namespace lab {
 
+    namespace
+    {
+        // Nodes made without a seed take the next of these, so that each plays its own noise.
+        std::atomic<uint32_t> s_nextSeed(1489853723);
+
+        const float WhiteScale = 1.0f / 2147483648.0f;
+
+        inline uint32_t xorshift(uint32_t x)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return x;
+        }
+
+        // The generators make four frames at a time, so a quantum's white noise is rounded up to a multiple of four.
+        inline size_t whiteFrameCount(size_t framesToProcess)
+        {
+            return (framesToProcess + 3) & ~size_t(3);
+        }
+
+        // Fills destination with framesToProcess values in [-1, 1), a multiple of four, frame i from lane i % 4.
+        void whiteNoise(uint32_t * lanes, float * destination, size_t framesToProcess)
+        {
+            size_t i = 0;
+
+#if defined(__SSE2__)
+            __m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes));
+            const __m128 scale = _mm_set1_ps(WhiteScale);
+            for (; i < framesToProcess; i += 4)
+            {
+                _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(state), scale));
+                state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+                state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+                state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), state);
+#elif defined(ARM_NEON_INTRINSICS)
+            uint32x4_t state = vld1q_u32(lanes);
+            for (; i < framesToProcess; i += 4)
+            {
+                vst1q_f32(destination + i, vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(state)), WhiteScale));
+                state = veorq_u32(state, vshlq_n_u32(state, 13));
+                state = veorq_u32(state, vshrq_n_u32(state, 17));
+                state = veorq_u32(state, vshlq_n_u32(state, 5));
+            }
+            vst1q_u32(lanes, state);
+#else
+            for (; i < framesToProcess; i += 4)
+            {
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    destination[i + lane] = static_cast<float>(static_cast<int32_t>(lanes[lane])) * WhiteScale;
+                    lanes[lane] = xorshift(lanes[lane]);
+                }
+            }
+#endif
+        }
+    }
+
     NoiseNode::NoiseNode() : AudioScheduledSourceNode()
     , _type(std::make_shared<AudioSetting>("type"))
+    , _seed(std::make_shared<AudioSetting>("seed"))
+    , m_white(new AudioFloatArray(whiteFrameCount(AudioNode::ProcessingSizeInFrames)))
     {
+        _seed->setUint32(s_nextSeed++);
+
         addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
         m_settings.push_back(_type);
+        m_settings.push_back(_seed);
         initialize();
     }
 
@@ -38,7 +122,49 @@ namespace lab {
         return NoiseType(_type->valueUint32());
     }
 
+    uint32_t NoiseNode::seed() const
+    {
+        return _seed->valueUint32();
+    }
+
+    void NoiseNode::setSeed(uint32_t seed)
+    {
+        _seed->setUint32(seed);
+    }
+
+    void NoiseNode::prepare(AudioContext & context, size_t inputChannels)
+    {
+        AudioScheduledSourceNode::prepare(context, inputChannels);
 
+        // The buffer is made here, and the render lock only taken to swap it in.
+        const size_t whiteFrames = whiteFrameCount(context.renderQuantumSize());
+        if (whiteFrames > m_white->size())
+        {
+            std::unique_ptr<AudioFloatArray> white(new AudioFloatArray(whiteFrames));
+            ContextRenderLock r(&context, "NoiseNode::prepare");
+            std::swap(m_white, white);
+        }
+    }
+
+    void NoiseNode::restart()
+    {
+        m_laneSeed = _seed->valueUint32();
+        m_restart = false;
+
+        // Spread the seed over the lanes with splitmix32's mixer; xorshift must not start at zero.
+        for (uint32_t lane = 0; lane < Lanes; ++lane)
+        {
+            uint32_t z = m_laneSeed + (lane + 1) * 0x9e3779b9u;
+            z = (z ^ (z >> 16)) * 0x85ebca6bu;
+            z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+            z ^= z >> 16;
+            m_lanes[lane] = z ? z : 0x6d2b79f5u;
+        }
+
+        m_lastWhite = 0;
+        m_brown = 0;
+        std::fill(m_pink, m_pink + 6, 0.f);
+    }
 
     void NoiseNode::process(ContextRenderLock& r, size_t framesToProcess)
     {
@@ -52,56 +178,55 @@ namespace lab {
         size_t quantumFrameOffset;
         size_t nonSilentFramesToProcess;
 
-        updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess);
-
-        if (!nonSilentFramesToProcess) {
-            outputBus->zero();
+        if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
             return;
-        }
+
+        if (_seed->changed(m_seedVersion) | m_restart)
+            restart();
+
+        // The generators make up to three frames more than the quantum needs; the extra frames are generated into
+        // the buffer, which prepare() sized for them, and never read. It only grows here if prepare() was skipped.
+        const size_t whiteFrames = whiteFrameCount(nonSilentFramesToProcess);
+        if (whiteFrames > m_white->size())
+            m_white->allocate(whiteFrames);
+
+        float* white = m_white->data();
+        whiteNoise(m_lanes, white, whiteFrames);
 
         float* destP = outputBus->channel(0)->mutableData();
 
         // Start rendering at the correct offset.
         destP += quantumFrameOffset;
-        size_t n = nonSilentFramesToProcess;
+        const size_t n = nonSilentFramesToProcess;
 
         switch (NoiseType(_type->valueUint32())) 
         {
                 // reference: http://noisehack.com/generate-noise-web-audio-api/
             case WHITE:
-                while (n--) {
-                    float white = ((float)((whiteSeed & 0x7fffffff) - 0x40000000)) * (float)(1.0f / 0x40000000);
-                    white = (white * 0.5f) - 1.0f;
-                    *destP++ = white;
-                    whiteSeed = whiteSeed * 435898247 + 382842987;
-                }
+                memcpy(destP, white, n * sizeof(float));
                 break;
             case PINK:
-                while (n--) {
-                    float white = ((float)((whiteSeed & 0x7fffffff) - 0x40000000)) * (float)(1.0f / 0x40000000);
-                    white = (white * 0.5f) - 1.0f;
-                    whiteSeed = whiteSeed * 435898247 + 382842987;
-
-                    pink0 = 0.99886f * pink0 + white * 0.0555179f;
-                    pink1 = 0.99332f * pink1 + white * 0.0750759f;
-                    pink2 = 0.96900f * pink2 + white * 0.1538520f;
-                    pink3 = 0.86650f * pink3 + white * 0.3104856f;
-                    pink4 = 0.55000f * pink4 + white * 0.5329522f;
-                    pink5 = -0.7616f * pink5 - white * 0.0168980f;
-                    *destP++ = (pink0 + pink1 + pink2 + pink3 + pink4 + pink5 + pink6 + (white * 0.5362f)) * 0.11f; // .11 roughly compensates gain
-                    pink6 = white * 0.115926f;
-                }
+            {
+                // Paul Kellet's refined filter: six one pole filters, plus the white noise and its previous frame.
+                static const float poles[6] = { 0.99886f, 0.99332f, 0.96900f, 0.86650f, 0.55000f, -0.7616f };
+                static const float gains[6] = { 0.0555179f, 0.0750759f, 0.1538520f, 0.3104856f, 0.5329522f, -0.0168980f };
+
+                FirstOrder::oneZero(white, destP, n, 0.5362f, 0.115926f, m_lastWhite);
+                for (int pole = 0; pole < 6; ++pole)
+                    FirstOrder::onePoleAdd(white, destP, n, poles[pole], gains[pole], m_pink[pole]);
+
+                const float scale = 0.11f; // roughly compensates gain
+                VectorMath::vsmul(destP, 1, &scale, destP, 1, n);
                 break;
+            }
             case BROWN:
-                while (n--) {
-                    float white = ((float)((whiteSeed & 0x7fffffff) - 0x40000000)) * (float)(1.0f / 0x40000000);
-                    white = (white * 0.5f) - 1.0f;
-                    whiteSeed = whiteSeed * 435898247 + 382842987;
-                    float brown = (lastBrown + (0.02f * white)) / 1.02f;
-                    *destP++ = brown * 3.5f; // roughly compensate for gain
-                    lastBrown = brown;
-                }
+            {
+                FirstOrder::onePole(white, destP, n, 1.0f / 1.02f, 0.02f / 1.02f, m_brown);
+
+                const float scale = 3.5f; // roughly compensate for gain
+                VectorMath::vsmul(destP, 1, &scale, destP, 1, n);
                 break;
+            }
             default:
                 throw std::invalid_argument("Invalid type specified");
         }
@@ -110,6 +235,7 @@ namespace lab {
 
     void NoiseNode::reset(ContextRenderLock&)
     {
+        m_restart = true;
     }
     
     bool NoiseNode::propagatesSilence(ContextRenderLock & r) const
@@ -118,4 +244,3 @@ namespace lab {
     }
     
 } // namespace lab
-
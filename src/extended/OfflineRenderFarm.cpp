@@ -0,0 +1,89 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/OfflineRenderFarm.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/OfflineAudioDestinationNode.h"
+
+#include <algorithm>
+
+namespace lab
+{
+
+OfflineRenderFarm::OfflineRenderFarm(size_t threadCount)
+{
+    if (!threadCount)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (size_t i = 0; i < threadCount; ++i)
+        m_threads.emplace_back(&OfflineRenderFarm::workerEntry, this);
+}
+
+OfflineRenderFarm::~OfflineRenderFarm()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_shouldRun = false;
+    }
+    m_work.notify_all();
+
+    for (auto & thread : m_threads)
+        thread.join();
+}
+
+void OfflineRenderFarm::submit(OfflineRenderJob job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_jobs.emplace_back(std::move(job));
+    }
+    m_work.notify_one();
+}
+
+void OfflineRenderFarm::wait()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_idle.wait(lock, [this]() { return m_jobs.empty() && !m_running; });
+}
+
+void OfflineRenderFarm::workerEntry()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;)
+    {
+        // Queued jobs are completed before the threads stop.
+        m_work.wait(lock, [this]() { return !m_jobs.empty() || !m_shouldRun; });
+        if (m_jobs.empty())
+            return;
+
+        OfflineRenderJob job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        ++m_running;
+        lock.unlock();
+
+        {
+            std::unique_ptr<AudioContext> context(new AudioContext(true, true, job.renderQuantumSize));
+            std::shared_ptr<OfflineAudioDestinationNode> destination =
+                std::make_shared<OfflineAudioDestinationNode>(context.get(), job.sampleRate, job.lengthSeconds, job.numChannels);
+            context->setDestinationNode(destination);
+            context->lazyInitialize();
+            if (job.renderWorkerCount)
+                context->setRenderWorkerCount(job.renderWorkerCount);
+
+            if (job.setup)
+                job.setup(*context, *destination);
+
+            context->startRendering();
+
+            if (job.finished)
+                job.finished(*context, *destination);
+        }
+
+        lock.lock();
+        --m_running;
+        if (m_jobs.empty() && !m_running)
+            m_idle.notify_all();
+    }
+}
+
+} // namespace lab
@@ -0,0 +1,198 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/OscillatorBankNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/WaveTable.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+#include "internal/WaveTableOscillator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace lab
+{
+
+OscillatorBankNode::OscillatorBankNode(const float sampleRate)
+    : AudioScheduledSourceNode()
+    , m_sampleRate(sampleRate)
+    , m_type(std::make_shared<AudioSetting>("type"))
+    , m_frequencies(AudioNode::ProcessingSizeInFrames)
+    , m_readIndices(AudioNode::ProcessingSizeInFrames)
+{
+    m_frequency = std::make_shared<AudioParam>("frequency", 440, 0, 100000);
+    m_gain = std::make_shared<AudioParam>("gain", 1.0, 0.0, 1.0);
+    m_params.push_back(m_frequency);
+    m_params.push_back(m_gain);
+
+    m_type->setValueChanged([this]() {
+        _setType(OscillatorType(m_type->valueUint32()));
+    });
+    m_settings.push_back(m_type);
+
+    setType(OscillatorType::SINE);
+
+    m_detuneScales.reserve(ReservedVoices);
+    m_amplitudes.reserve(ReservedVoices);
+    m_phases.reserve(ReservedVoices);
+
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
+
+    initialize();
+}
+
+OscillatorBankNode::~OscillatorBankNode()
+{
+    uninitialize();
+}
+
+OscillatorType OscillatorBankNode::type() const
+{
+    return OscillatorType(m_type->valueUint32());
+}
+
+void OscillatorBankNode::setType(OscillatorType type)
+{
+    m_type->setUint32(static_cast<uint32_t>(type));
+}
+
+void OscillatorBankNode::_setType(OscillatorType type)
+{
+    if (type < OscillatorType::SINE || type > OscillatorType::TRIANGLE)
+        throw std::invalid_argument("An oscillator bank plays the basic waveforms only");
+
+    m_waveTable = WaveTable::shared(m_sampleRate, type);
+}
+
+void OscillatorBankNode::setVoices(ContextRenderLock & r, const std::vector<float> & detunes, const std::vector<float> & amplitudes)
+{
+    bool isAmplitudesGood = amplitudes.empty() || amplitudes.size() == detunes.size();
+    ASSERT(isAmplitudesGood);
+    if (!isAmplitudesGood)
+        return;
+
+    const size_t previousCount = m_phases.size();
+    const size_t count = detunes.size();
+    const float waveTableSize = m_waveTable ? static_cast<float>(m_waveTable->periodicWaveSize()) : 0.f;
+
+    m_detuneScales.resize(count);
+    m_amplitudes.resize(count);
+    m_phases.resize(count);
+    for (size_t voice = 0; voice < count; ++voice)
+    {
+        m_detuneScales[voice] = std::pow(2.f, detunes[voice] / 1200.f);
+        m_amplitudes[voice] = amplitudes.empty() ? 1.f : amplitudes[voice];
+        if (voice >= previousCount)
+            m_phases[voice] = waveTableSize * voice / count;
+    }
+}
+
+void OscillatorBankNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+
+    if (!isInitialized() || !r.context() || !m_waveTable || m_phases.empty())
+    {
+        outputBus->zero();
+        return;
+    }
+
+    if (framesToProcess > m_frequencies.size())
+    {
+        m_frequencies.allocate(framesToProcess);
+        m_readIndices.allocate(framesToProcess);
+    }
+
+    size_t quantumFrameOffset = 0;
+    size_t nonSilentFramesToProcess = 0;
+    if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
+        return;
+
+    if (m_firstRender)
+    {
+        m_firstRender = false;
+        m_frequency->resetSmoothedValue(r);
+    }
+
+    // The frequency for the whole quantum, or from the offset on, frame by frame, while it is automated or
+    // de-zippering to a new value.
+    float * frequencies = m_frequencies.data();
+    bool hasSampleAccurateValues = m_frequency->hasSampleAccurateValues() && !m_frequency->isConstantForQuantum(r, framesToProcess);
+    if (hasSampleAccurateValues)
+        m_frequency->calculateSampleAccurateValues(r, frequencies, framesToProcess);
+    else
+        hasSampleAccurateValues = !m_frequency->smooth(r, frequencies, framesToProcess);
+
+    float frequency = 0;
+    float highestFrequency = 0;
+    if (hasSampleAccurateValues)
+    {
+        frequencies += quantumFrameOffset;
+        for (size_t i = 0; i < nonSilentFramesToProcess; ++i)
+        {
+            frequencies[i] = std::max(frequencies[i], 0.f);
+            highestFrequency = std::max(highestFrequency, frequencies[i]);
+        }
+    }
+    else
+    {
+        frequency = std::max(m_frequency->smoothedValue(), 0.f);
+        highestFrequency = frequency;
+    }
+
+    WaveTable & waveTable = *m_waveTable;
+    const unsigned waveTableSize = waveTable.periodicWaveSize();
+    const float rateScale = waveTable.rateScale();
+
+    float * destination = outputBus->channel(0)->mutableData() + quantumFrameOffset;
+    std::fill(destination, destination + nonSilentFramesToProcess, 0.f);
+
+    float * readIndices = m_readIndices.data();
+    for (size_t voice = 0; voice < m_phases.size(); ++voice)
+    {
+        const float detuneScale = m_detuneScales[voice];
+
+        float * lower = nullptr;
+        float * higher = nullptr;
+        float tableFactor = 0;
+        waveTable.waveDataForFundamentalFrequency(highestFrequency * detuneScale, lower, higher, tableFactor);
+
+        if (hasSampleAccurateValues)
+        {
+            const float scale = detuneScale * rateScale;
+            VectorMath::vsmul(frequencies, 1, &scale, readIndices, 1, nonSilentFramesToProcess);
+            waveTableReadIndices(m_phases[voice], readIndices, waveTableSize, readIndices, nonSilentFramesToProcess);
+        }
+        else
+            waveTableReadIndices(m_phases[voice], static_cast<double>(frequency) * detuneScale * rateScale, waveTableSize, readIndices, nonSilentFramesToProcess);
+
+        waveTableAccumulate(lower, higher, tableFactor, waveTableSize, readIndices, m_amplitudes[voice], destination, nonSilentFramesToProcess);
+    }
+
+    outputBus->copyWithGainFrom(*outputBus, &m_lastGain, m_gain->value(r));
+    outputBus->clearSilentFlag();
+}
+
+void OscillatorBankNode::reset(ContextRenderLock & r)
+{
+    const float waveTableSize = m_waveTable ? static_cast<float>(m_waveTable->periodicWaveSize()) : 0.f;
+    for (size_t voice = 0; voice < m_phases.size(); ++voice)
+        m_phases[voice] = waveTableSize * voice / m_phases.size();
+    m_lastGain = m_gain->value(r);
+}
+
+bool OscillatorBankNode::propagatesSilence(ContextRenderLock & r) const
+{
+    return !isPlayingOrScheduled() || hasFinished() || !m_waveTable || m_phases.empty();
+}
+
+} // namespace lab
@@ -0,0 +1,285 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/ParametricEQNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioProcessor.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/Biquad.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace lab
+{
+
+// As for a BiquadFilterNode, the tail of a section is taken to die out within this many seconds.
+static const double MaxSectionTailTime = 0.2;
+
+class ParametricEQNode::ParametricEQProcessor : public AudioProcessor
+{
+public:
+
+    // The normalized coefficients of a section, y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] - a1*y[n-1] - a2*y[n-2].
+    struct Section
+    {
+        double b0 = 1;
+        double b1 = 0;
+        double b2 = 0;
+        double a1 = 0;
+        double a2 = 0;
+    };
+
+    ParametricEQProcessor() : AudioProcessor(1) { }
+    virtual ~ParametricEQProcessor() { }
+
+    virtual void initialize() override
+    {
+        if (isInitialized())
+            return;
+
+        resizeState();
+        m_initialized = true;
+    }
+
+    virtual void uninitialize() override
+    {
+        m_initialized = false;
+    }
+
+    virtual void reset() override
+    {
+        std::fill(m_state.begin(), m_state.end(), 0.0);
+    }
+
+    virtual double tailTime(ContextRenderLock & r) const override { return m_bands.empty() ? 0 : MaxSectionTailTime; }
+    virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+    void setBands(const std::vector<ParametricEQBand> & bands)
+    {
+        const bool resized = bands.size() != m_bands.size();
+        m_bands = bands;
+        if (resized)
+        {
+            m_sections.resize(m_bands.size());
+            m_dirty.resize(m_bands.size());
+            resizeState();
+        }
+        std::fill(m_dirty.begin(), m_dirty.end(), uint8_t(1));
+        m_hasDirtyBands = true;
+    }
+
+    void setBand(size_t index, const ParametricEQBand & band)
+    {
+        m_bands[index] = band;
+        m_dirty[index] = 1;
+        m_hasDirtyBands = true;
+    }
+
+    const std::vector<ParametricEQBand> & bands() const { return m_bands; }
+
+    // Computes the coefficients of the band in biquad, or returns false for a band that passes its input through.
+    static bool design(Biquad & biquad, const ParametricEQBand & band, double nyquist)
+    {
+        const double frequency = band.frequency / nyquist;
+        switch (band.type)
+        {
+            case LOWPASS: biquad.setLowpassParams(frequency, band.q); return true;
+            case HIGHPASS: biquad.setHighpassParams(frequency, band.q); return true;
+            case BANDPASS: biquad.setBandpassParams(frequency, band.q); return true;
+            case LOWSHELF: biquad.setLowShelfParams(frequency, band.gain); return true;
+            case HIGHSHELF: biquad.setHighShelfParams(frequency, band.gain); return true;
+            case PEAKING: biquad.setPeakingParams(frequency, band.q, band.gain); return true;
+            case NOTCH: biquad.setNotchParams(frequency, band.q); return true;
+            case ALLPASS: biquad.setAllpassParams(frequency, band.q); return true;
+            default: return false;
+        }
+    }
+
+    virtual void process(ContextRenderLock & r, const AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess) override
+    {
+        if (!isInitialized() || !r.context())
+        {
+            destinationBus->zero();
+            return;
+        }
+
+        const size_t channelCount = numberOfChannels();
+        bool channelCountMatches = sourceBus->numberOfChannels() == channelCount && destinationBus->numberOfChannels() == channelCount;
+        ASSERT(channelCountMatches);
+        if (!channelCountMatches)
+            return;
+
+        updateCoefficients(r.context()->sampleRate());
+
+        const size_t bandCount = m_sections.size();
+        const Section * sections = m_sections.data();
+
+        for (size_t channel = 0; channel < channelCount; ++channel)
+        {
+            const float * source = sourceBus->channel(channel)->data();
+            float * destination = destinationBus->channel(channel)->mutableData();
+
+            if (!bandCount)
+            {
+                if (source != destination)
+                    std::memcpy(destination, source, sizeof(float) * framesToProcess);
+                continue;
+            }
+
+            // Each sample runs through every section before the next is read, in transposed direct form II,
+            // so that a section's two words of memory are all it carries from one sample to the next.
+            double * state = &m_state[channel * bandCount * 2];
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                double x = source[i];
+                for (size_t band = 0; band < bandCount; ++band)
+                {
+                    const Section & s = sections[band];
+                    double * z = state + band * 2;
+                    const double y = s.b0 * x + z[0];
+                    z[0] = s.b1 * x - s.a1 * y + z[1];
+                    z[1] = s.b2 * x - s.a2 * y;
+                    x = y;
+                }
+                destination[i] = static_cast<float>(x);
+            }
+
+            // Flush denormals here so we don't slow down the loop above.
+            for (size_t j = 0; j < bandCount * 2; ++j)
+            {
+                if (std::fabs(state[j]) < FLT_MIN)
+                    state[j] = 0;
+            }
+        }
+    }
+
+private:
+
+    void resizeState()
+    {
+        m_state.assign(numberOfChannels() * m_bands.size() * 2, 0.0);
+    }
+
+    void updateCoefficients(float sampleRate)
+    {
+        if (sampleRate != m_sampleRate)
+        {
+            m_sampleRate = sampleRate;
+            std::fill(m_dirty.begin(), m_dirty.end(), uint8_t(1));
+            m_hasDirtyBands = true;
+        }
+
+        if (!m_hasDirtyBands)
+            return;
+
+        const double nyquist = m_sampleRate * 0.5;
+        for (size_t band = 0; band < m_bands.size(); ++band)
+        {
+            if (!m_dirty[band])
+                continue;
+
+            Section & section = m_sections[band];
+            if (design(m_designer, m_bands[band], nyquist))
+                m_designer.getCoefficients(section.b0, section.b1, section.b2, section.a1, section.a2);
+            else
+                section = Section();
+            m_dirty[band] = 0;
+        }
+        m_hasDirtyBands = false;
+    }
+
+    std::vector<ParametricEQBand> m_bands;
+    std::vector<Section> m_sections;
+    std::vector<uint8_t> m_dirty;
+    bool m_hasDirtyBands{ false };
+    float m_sampleRate{ 0 };
+
+    // Computes the coefficients of the bands that change.
+    Biquad m_designer;
+
+    // Two words of memory per section, the sections of a channel side by side.
+    std::vector<double> m_state;
+};
+
+ParametricEQNode::ParametricEQNode() : AudioBasicProcessorNode()
+{
+    m_processor.reset(new ParametricEQProcessor());
+    initialize();
+}
+
+ParametricEQNode::~ParametricEQNode()
+{
+    uninitialize();
+}
+
+ParametricEQNode::ParametricEQProcessor * ParametricEQNode::eqProcessor() const
+{
+    return static_cast<ParametricEQProcessor *>(processor());
+}
+
+void ParametricEQNode::setBands(ContextRenderLock & r, const std::vector<ParametricEQBand> & bands)
+{
+    eqProcessor()->setBands(bands);
+}
+
+void ParametricEQNode::setBand(ContextRenderLock & r, size_t index, const ParametricEQBand & band)
+{
+    bool isIndexGood = index < bandCount();
+    ASSERT(isIndexGood);
+    if (!isIndexGood)
+        return;
+
+    eqProcessor()->setBand(index, band);
+}
+
+const std::vector<ParametricEQBand> & ParametricEQNode::bands() const
+{
+    return eqProcessor()->bands();
+}
+
+void ParametricEQNode::getFrequencyResponse(ContextRenderLock & r, const std::vector<float> & frequencyHz,
+                                            std::vector<float> & magResponse, std::vector<float> & phaseResponse)
+{
+    const size_t n = std::min(frequencyHz.size(), std::min(magResponse.size(), phaseResponse.size()));
+    if (!n || !r.context())
+        return;
+
+    std::fill(magResponse.begin(), magResponse.begin() + n, 1.f);
+    std::fill(phaseResponse.begin(), phaseResponse.begin() + n, 0.f);
+
+    // Convert from frequency in Hz to normalized frequency (0 -> 1), with 1 equal to the Nyquist frequency.
+    const double nyquist = r.context()->sampleRate() * 0.5;
+    std::vector<float> frequency(n);
+    for (size_t k = 0; k < n; ++k)
+        frequency[k] = static_cast<float>(frequencyHz[k] / nyquist);
+
+    // The cascade's response is the product of its sections': magnitudes multiply and phases add.
+    std::vector<float> bandMagnitude(n);
+    std::vector<float> bandPhase(n);
+    Biquad biquad;
+    for (const ParametricEQBand & band : bands())
+    {
+        if (!ParametricEQProcessor::design(biquad, band, nyquist))
+            continue;
+
+        biquad.getFrequencyResponse(n, frequency.data(), bandMagnitude.data(), bandPhase.data());
+        for (size_t k = 0; k < n; ++k)
+        {
+            magResponse[k] *= bandMagnitude[k];
+            phaseResponse[k] = static_cast<float>(std::remainder(phaseResponse[k] + bandPhase[k], twoPiDouble));
+        }
+    }
+}
+
+} // namespace lab
@@ -1,152 +1,299 @@
-
 // Copyright (c) 2003-2013 Nick Porcino, All rights reserved.
 // License is MIT: http://opensource.org/licenses/MIT
 
 #ifdef PD
 
-#include "LabSound.h"
-#include "PdNode.h"
+#include "LabSound/extended/PdNode.h"
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioProcessor.h"
+
+#include "LabSound/extended/AudioContextLock.h"
 
-#include "AudioBus.h"
-#include "AudioNodeInput.h"
-#include "AudioNodeOutput.h"
-#include "AudioProcessor.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/VectorMath.h"
 
 #include "PdBase.hpp"
 #include "z_libpd.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace lab {
 
-class PdNode::PdNodeInternal : public lab::AudioProcessor {
+namespace {
+
+    // The channels the patch is opened with, in and out.
+    const size_t PdChannels = 2;
+
+    // Interleaved frames of PdChannels, with one writer and one reader, which may be on different threads. Frames
+    // are counted from the start, and are at their count modulo the capacity. Pd's side moves whole blocks, and the
+    // capacity is a multiple of the block, so that a block is never split by the end of the ring; the render
+    // thread's side moves quanta, which may be.
+    class InterleavedRing
+    {
+    public:
+
+        // Starts with silence frames already written, placed so that the writer starts on a block.
+        InterleavedRing(size_t capacity, size_t blockSize, size_t silence)
+            : m_data(capacity * PdChannels)
+            , m_capacity(capacity)
+            , m_writeIndex((silence + blockSize - 1) / blockSize * blockSize)
+            , m_readIndex(m_writeIndex - silence)
+        {
+        }
+
+        size_t available() const { return static_cast<size_t>(m_writeIndex.load(std::memory_order_acquire) - m_readIndex.load(std::memory_order_relaxed)); }
+        size_t space() const { return m_capacity - static_cast<size_t>(m_writeIndex.load(std::memory_order_relaxed) - m_readIndex.load(std::memory_order_acquire)); }
+
+        // The frames that can be written, or read, before the end of the ring, and where they start.
+        size_t contiguousSpace() const { return std::min(space(), m_capacity - writeOffset()); }
+        size_t contiguousAvailable() const { return std::min(available(), m_capacity - readOffset()); }
+        float * writePointer() { return m_data.data() + writeOffset() * PdChannels; }
+        const float * readPointer() const { return m_data.data() + readOffset() * PdChannels; }
+
+        void commit(size_t frames) { m_writeIndex.store(m_writeIndex.load(std::memory_order_relaxed) + frames, std::memory_order_release); }
+        void consume(size_t frames) { m_readIndex.store(m_readIndex.load(std::memory_order_relaxed) + frames, std::memory_order_release); }
+
+        // Interleaves planar channels into the ring. There must be space.
+        void write(const float * const * channels, size_t frames)
+        {
+            size_t first = std::min(frames, m_capacity - writeOffset());
+            VectorMath::vinterleave(channels, PdChannels, writePointer(), first);
+            if (first < frames)
+            {
+                const float * rest[PdChannels];
+                for (size_t c = 0; c < PdChannels; ++c)
+                    rest[c] = channels[c] + first;
+                VectorMath::vinterleave(rest, PdChannels, m_data.data(), frames - first);
+            }
+            commit(frames);
+        }
+
+        // Deinterleaves from the ring into planar channels. The frames must be available.
+        void read(float * const * channels, size_t frames)
+        {
+            size_t first = std::min(frames, m_capacity - readOffset());
+            VectorMath::vdeinterleave(readPointer(), PdChannels, channels, first);
+            if (first < frames)
+            {
+                float * rest[PdChannels];
+                for (size_t c = 0; c < PdChannels; ++c)
+                    rest[c] = channels[c] + first;
+                VectorMath::vdeinterleave(m_data.data(), PdChannels, rest, frames - first);
+            }
+            consume(frames);
+        }
+
+    private:
+
+        size_t writeOffset() const { return static_cast<size_t>(m_writeIndex.load(std::memory_order_relaxed) % m_capacity); }
+        size_t readOffset() const { return static_cast<size_t>(m_readIndex.load(std::memory_order_relaxed) % m_capacity); }
+
+        AudioFloatArray m_data;
+        size_t m_capacity;
+        std::atomic<uint64_t> m_writeIndex;
+        std::atomic<uint64_t> m_readIndex;
+    };
+
+} // anon
+
+class PureDataNode::PureDataNodeInternal : public lab::AudioProcessor
+{
 public:
 
-    PdNodeInternal(float sampleRate)
-    : AudioProcessor(sampleRate)
-    , numChannels(2)
-    , pdBuffSize(128)
+    PureDataNodeInternal(float sampleRate, size_t quantumSize, bool runOnWorker)
+        : AudioProcessor(PdChannels)
+        , m_sampleRate(sampleRate)
+        , m_blockSize(static_cast<size_t>(libpd_blocksize()))
+        // A quantum smaller than a block waits for the rest of it; on the worker, every quantum waits for the next.
+        , m_latencyFrames((quantumSize < m_blockSize ? m_blockSize - quantumSize : 0) + (runOnWorker ? quantumSize : 0))
+        , m_input(4 * std::max(quantumSize, m_blockSize), m_blockSize, 0)
+        , m_output(4 * std::max(quantumSize, m_blockSize) + (m_latencyFrames + m_blockSize - 1) / m_blockSize * m_blockSize, m_blockSize, m_latencyFrames)
+        , m_silence(quantumSize)
+        , m_discard(quantumSize)
     {
-    }
-    
-    virtual ~PdNodeInternal() {
+        if (pd.init(PdChannels, PdChannels, static_cast<int>(sampleRate)))
+        {
+            pd.addToSearchPath("pd");
+            pd.computeAudio(true);
+        }
+
+        if (runOnWorker)
+            m_worker = std::thread(&PureDataNodeInternal::workerEntry, this);
     }
 
-    // AudioProcessor interface
-    virtual void initialize() {
+    virtual ~PureDataNodeInternal()
+    {
+        if (m_worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_running = false;
+            }
+            m_wake.notify_one();
+            m_worker.join();
+        }
     }
-    
-    virtual void uninitialize() { }
-    
-    // Processes the source to destination bus.  The number of channels must match in source and destination.
-    virtual void process(const lab::AudioBus* source, lab::AudioBus* destination, size_t framesToProcess) {
-        if (!numChannels)
+
+    virtual void initialize() override { m_initialized = true; }
+    virtual void uninitialize() override { m_initialized = false; }
+
+    // Pd keeps its own state.
+    virtual void reset() override { }
+
+    virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+    virtual double latencyTime(ContextRenderLock & r) const override { return m_latencyFrames / static_cast<double>(m_sampleRate); }
+
+    virtual void process(ContextRenderLock & r, const AudioBus * source, AudioBus * destination, size_t framesToProcess) override
+    {
+        if (!isInitialized() || !pd.isInited() || m_silence.size() < framesToProcess)
+        {
+            destination->zero();
             return;
-        
-        int ticks = framesToProcess >> blockSizeAsLog; // this is a faster way of computing (inNumberFrames / blockSize)
-        const float* inData = source->channel(0)->data();
-        float* outData = destination->channel(0)->mutableData();
-        pd.processFloat(ticks, inData, outData);
-    }
-    
-    // Resets filter state
-    virtual void reset() { }
-    
-    virtual void setNumberOfChannels(unsigned i) {
-        numChannels = i;
+        }
+
+        // A mono source feeds both of the patch's inputs.
+        const size_t sourceChannels = source->numberOfChannels();
+        const float * inputs[PdChannels];
+        float * outputs[PdChannels];
+        for (size_t c = 0; c < PdChannels; ++c)
+        {
+            if (c < sourceChannels)
+                inputs[c] = source->channel(c)->data();
+            else
+                inputs[c] = sourceChannels == 1 ? source->channel(0)->data() : m_silence.data();
+            outputs[c] = c < destination->numberOfChannels() ? destination->channel(c)->mutableData() : nullptr;
+        }
+
+        // Should the worker have fallen so far behind that the input has no room, the quantum is dropped.
+        if (m_input.space() >= framesToProcess)
+            m_input.write(inputs, framesToProcess);
+
+        // Offline, there is no deadline to keep, and the patch runs here so that the render is the same each time,
+        // with the same latency; the worker is never woken.
+        if (m_worker.joinable() && !r.context()->isOfflineContext())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_pending = true;
+            }
+            m_wake.notify_one();
+        }
+        else
+        {
+            runBlocks();
+        }
+
+        // Output channels the destination lacks are read into scratch and dropped.
+        if (m_output.available() >= framesToProcess)
+        {
+            float * channels[PdChannels];
+            for (size_t c = 0; c < PdChannels; ++c)
+                channels[c] = outputs[c] ? outputs[c] : m_discard.data();
+            m_output.read(channels, framesToProcess);
+            for (size_t c = PdChannels; c < destination->numberOfChannels(); ++c)
+                destination->channel(c)->zero();
+            destination->clearSilentFlag();
+        }
+        else
+        {
+            destination->zero();
+            m_underrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
     }
-    
-    virtual double tailTime() const { return 0; }
-    virtual double latencyTime() const { return 0; }
-    
-    // return true on successful initialization
-    bool initPure(const int numInChannels, const int numOutChannels,
-                  const int sampleRate, const int ticksPerBuffer);
-    
-    /// print
-    virtual void print(const std::string& message);
-    
+
     pd::PdBase pd;
-    
-    int numChannels;
-    int pdBuffSize;
-    int blockSizeAsLog;
-};
+    std::atomic<uint64_t> m_underrunCount{ 0 };
 
-namespace {
-    //http://graphics.stanford.edu/~seander/bithacks.html#IntegerLogObvious
-    int log2int(int x) {
-        if (x < 1) {
-            return -1;
-        }
-        int y = 1;
-        while (x >>= 1) {
-            ++y;
+private:
+
+    // Runs the patch over the whole blocks of input there is room for the output of, as few calls to Pd as the
+    // ends of the rings allow.
+    void runBlocks()
+    {
+        for (;;)
+        {
+            size_t frames = std::min(m_input.contiguousAvailable(), m_output.contiguousSpace());
+            frames -= frames % m_blockSize;
+            if (!frames)
+                return;
+
+            pd.processFloat(static_cast<int>(frames / m_blockSize), m_input.readPointer(), m_output.writePointer());
+            m_input.consume(frames);
+            m_output.commit(frames);
         }
-        return y;
     }
-} // anon
 
+    void workerEntry()
+    {
+        DenormalDisabler denormalDisabler;
 
-// return true on successful initialization
-bool PdNode::PdNodeInternal::initPure(const int numInChannels, const int numOutChannels,
-                                      const int sampleRate, const int ticksPerBuffer) {
-    
-    if (!pd.init(numInChannels, numOutChannels, sampleRate)) {
-        return false;
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        while (m_running)
+        {
+            m_wake.wait(lock, [this]() { return m_pending || !m_running; });
+            m_pending = false;
+            lock.unlock();
+            runBlocks();
+            lock.lock();
+        }
     }
-    blockSizeAsLog = log2int(libpd_blocksize());
-    
-    // subscribe to receive source names
-    pd.subscribe("toOF");
-    pd.subscribe("env");
-    
-    // add the data/pd folder to the search path
-    pd.addToSearchPath("pd");
-    
-    // audio processing on
-    pd.computeAudio(true);
-    
-    return true;
-}
 
-//--------------------------------------------------------------
-void PdNode::PdNodeInternal::print(const std::string& message) {
-    std::cout << message << std::endl;
-}
+    float m_sampleRate;
+    size_t m_blockSize;
+    size_t m_latencyFrames;
+
+    // Planar to Pd, and Pd to planar.
+    InterleavedRing m_input;
+    InterleavedRing m_output;
+
+    // For a channel missing from the input, and one missing from the output.
+    AudioFloatArray m_silence;
+    AudioFloatArray m_discard;
+
+    std::thread m_worker;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    bool m_pending = false;
+    bool m_running = true;
+};
 
-pd::PdBase& PdNode::pd() const {
+pd::PdBase & PureDataNode::pd() const
+{
     return data->pd;
 }
 
-PdNode::PdNode(lab::AudioContext* context, float sampleRate)
-: lab::AudioBasicProcessorNode(context, sampleRate)
-, data(new PdNodeInternal(sampleRate))
+uint64_t PureDataNode::underrunCount() const
+{
+    return data->m_underrunCount.load(std::memory_order_relaxed);
+}
+
+PureDataNode::PureDataNode(AudioContext & context, bool runOnWorker)
+    : AudioBasicProcessorNode()
+    , data(new PureDataNodeInternal(context.sampleRate(), context.renderQuantumSize(), runOnWorker))
 {
-    // Initially setup as lowpass filter.
-    m_processor = std::move(std::unique_ptr<lab::AudioProcessor>(data));
-    
-    setNodeType((AudioNode::NodeType) lab::NodeTypePd);
-    
-    addInput(adoptPtr(new lab::AudioNodeInput(this)));
-    addOutput(adoptPtr(new lab::AudioNodeOutput(this, 2))); // 2 stereo
-
-    data->initPure(2, 2, sampleRate, 128);
-    
+    m_processor.reset(data);
+
+    // The patch always sees two channels.
+    m_channelCount = PdChannels;
+    m_channelCountMode = ChannelCountMode::Explicit;
+
     initialize();
 }
 
-PdNode::~PdNode() {
-    data->numChannels = 0;  // ensure there if there is a latent callback pending, pd is not invoked
-    data = 0;
+PureDataNode::~PureDataNode()
+{
     uninitialize();
 }
 
-bool PdNode::propagatesSilence() const {
-    return !data->pd.isInited();
-}
-    
-    
-} // LabSound
+} // namespace lab
 
 #endif
@@ -5,89 +5,292 @@
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioProcessor.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
 #include "LabSound/core/Macros.h"
 
 #include "LabSound/extended/PingPongDelayNode.h"
 #include "LabSound/extended/AudioContextLock.h"
 
+#include "internal/Assertions.h"
+
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
 
 using namespace lab;
 
-namespace lab 
+namespace lab
 {
-    PingPongDelayNode::PingPongDelayNode(float sampleRate, float tempo)
+    //////////////////////////////////////////////
+    // Private PingPongDelayNode Implementation //
+    //////////////////////////////////////////////
+
+    // The longest delay, as for a BPMDelay.
+    const double PingPongMaxDelayTime = 8;
+
+    // The send, the two delays and the feedback between them, in one loop over an interleaved stereo delay
+    // line. Each frame of the line holds what entered the left delay and what entered the right, which is what
+    // left the left delay. The left delay is fed by the send and by the right delay through the feedback gain.
+    class PingPongDelayNode::Delay : public AudioNode
     {
-        input = std::make_shared<lab::GainNode>();
-        output = std::make_shared<lab::GainNode>();
+    public:
+
+        Delay(float sampleRate)
+            : m_lineLength(static_cast<size_t>(PingPongMaxDelayTime * sampleRate) + 1)
+        {
+            m_delayTime = std::make_shared<AudioParam>("delayTime", 0, 0, PingPongMaxDelayTime);
+            m_level = std::make_shared<AudioParam>("level", 1, 0, 1);
+            m_feedback = std::make_shared<AudioParam>("feedback", 0.5, 0, 1);
+            m_params.push_back(m_delayTime);
+            m_params.push_back(m_level);
+            m_params.push_back(m_feedback);
+
+            addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+            addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
+
+            initialize();
+        }
+
+        virtual ~Delay()
+        {
+            uninitialize();
+        }
+
+        virtual void initialize() override
+        {
+            if (isInitialized())
+                return;
+
+            m_line.allocate(m_lineLength * 2);
+            m_writeIndex = 0;
+            AudioNode::initialize();
+        }
+
+        virtual void uninitialize() override
+        {
+            if (!isInitialized())
+                return;
+
+            AudioNode::uninitialize();
+            m_line.allocate(0);
+        }
+
+        virtual void process(ContextRenderLock & r, size_t framesToProcess) override
+        {
+            AudioBus * outputBus = output(0)->bus(r);
+            ASSERT(outputBus);
+
+            if (!isInitialized() || !r.context())
+            {
+                outputBus->zero();
+                return;
+            }
+
+            // The send is the input's first two channels, summed and halved. The echoes carry on without an input.
+            const float * sourceL = nullptr;
+            const float * sourceR = nullptr;
+            if (input(0)->isConnected())
+            {
+                AudioBus * inputBus = input(0)->bus(r);
+                sourceL = inputBus->channel(0)->data();
+                if (inputBus->numberOfChannels() > 1)
+                    sourceR = inputBus->channel(1)->data();
+            }
+
+            // Synced to the transport, the delay follows its tempo as SetTempo() would have it.
+            const int syncIndex = m_syncIndex.load(std::memory_order_relaxed);
+            if (syncIndex >= 0)
+            {
+                const double bpm = r.context()->transport(r).bpm;
+                if (bpm != m_syncedBpm || syncIndex != m_syncedIndex)
+                {
+                    m_syncedBpm = bpm;
+                    m_syncedIndex = syncIndex;
+                    m_delayTime->setValue(float(60.0f * syncIndex) / static_cast<float>(bpm));
+                }
+            }
+            else
+                m_syncedIndex = -1;
+
+            const float sampleRate = r.context()->sampleRate();
+            const double delayFrames = std::round(m_delayTime->value(r) * sampleRate);
+            const size_t delay = static_cast<size_t>(std::max(1.0, std::min(delayFrames, static_cast<double>(m_lineLength - 1))));
+
+            // The level and feedback ramp across the quantum, as the gains they replace would de-zipper.
+            const float level = m_level->value(r);
+            const float feedback = m_feedback->value(r);
+            if (m_firstRender)
+            {
+                m_firstRender = false;
+                m_lastLevel = level;
+                m_lastFeedback = feedback;
+            }
+            const float levelStep = (level - m_lastLevel) / static_cast<float>(framesToProcess);
+            const float feedbackStep = (feedback - m_lastFeedback) / static_cast<float>(framesToProcess);
+
+            float * line = m_line.data();
+            float * destinationL = outputBus->channel(0)->mutableData();
+            float * destinationR = outputBus->channel(1)->mutableData();
+
+            const size_t lineLength = m_lineLength;
+            size_t writeIndex = m_writeIndex;
+            size_t readIndex = writeIndex >= delay ? writeIndex - delay : writeIndex + lineLength - delay;
+            float sendGain = m_lastLevel * 0.5f;
+            float feedbackGain = m_lastFeedback;
+
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                sendGain += levelStep * 0.5f;
+                feedbackGain += feedbackStep;
+
+                const float left = line[readIndex * 2];
+                const float right = line[readIndex * 2 + 1];
+
+                float send = 0;
+                if (sourceL)
+                    send = sourceR ? sourceL[i] + sourceR[i] : sourceL[i];
+
+                line[writeIndex * 2] = sendGain * send + feedbackGain * right;
+                line[writeIndex * 2 + 1] = left;
+
+                destinationL[i] = left;
+                destinationR[i] = right;
+
+                if (++writeIndex == lineLength)
+                    writeIndex = 0;
+                if (++readIndex == lineLength)
+                    readIndex = 0;
+            }
+
+            m_writeIndex = writeIndex;
+            m_lastLevel = level;
+            m_lastFeedback = feedback;
+            outputBus->clearSilentFlag();
+        }
 
-        leftDelay = std::make_shared<lab::BPMDelay>(sampleRate, tempo);
-        rightDelay = std::make_shared<lab::BPMDelay>(sampleRate, tempo);
+        virtual void reset(ContextRenderLock &) override
+        {
+            m_line.zero();
+            m_writeIndex = 0;
+            m_firstRender = true;
+        }
 
-        splitterGain = std::make_shared<lab::GainNode>();
-        wetGain = std::make_shared<lab::GainNode>();
-        feedbackGain = std::make_shared<lab::GainNode>();
+        std::shared_ptr<AudioParam> delayTime() { return m_delayTime; }
+        std::shared_ptr<AudioParam> level() { return m_level; }
+        std::shared_ptr<AudioParam> feedback() { return m_feedback; }
 
-        merger = std::make_shared<lab::ChannelMergerNode>(2);
-        splitter = std::make_shared<lab::ChannelSplitterNode>(2);
+        // The delay index to follow the transport's tempo with, or -1.
+        void syncToTransport(int delayIndex) { m_syncIndex.store(delayIndex, std::memory_order_relaxed); }
+
+    private:
+
+        // An echo takes two delays to come round to the left again, and is then down by the feedback. The tail
+        // lasts until the echoes are 80dB down, and for ever when they don't fall.
+        virtual double tailTime(ContextRenderLock & r) const override
+        {
+            const double roundTrip = 2 * m_delayTime->value(r);
+            const double feedback = m_feedback->value(r);
+            if (feedback >= 1)
+                return std::numeric_limits<double>::infinity();
+            if (feedback <= 0)
+                return roundTrip;
+            return roundTrip * (1 + std::log(1e-4) / std::log(feedback));
+        }
+
+        virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+        std::shared_ptr<AudioParam> m_delayTime;
+        std::shared_ptr<AudioParam> m_level;
+        std::shared_ptr<AudioParam> m_feedback;
+
+        size_t m_lineLength;
+        AudioFloatArray m_line;
+        size_t m_writeIndex{ 0 };
+
+        std::atomic<int> m_syncIndex{ -1 };
+        int m_syncedIndex{ -1 };
+        double m_syncedBpm{ 0 };
+
+        bool m_firstRender{ true };
+        float m_lastLevel{ 1 };
+        float m_lastFeedback{ 0.5f };
+    };
+
+    //////////////////////////////
+    // Public PingPongDelayNode //
+    //////////////////////////////
+
+    PingPongDelayNode::PingPongDelayNode(float sampleRate, float tempo) : tempo(tempo)
+    {
+        input = std::make_shared<lab::GainNode>();
+        output = std::make_shared<lab::GainNode>();
+
+        delay = std::make_shared<Delay>(sampleRate);
 
         SetDelayIndex(TempoSync::TS_8);
         SetFeedback(0.5f);
         SetLevel(1.0f);
     }
-    
+
     PingPongDelayNode::~PingPongDelayNode()
     {
 
     }
 
+    void PingPongDelayNode::recomputeDelay()
+    {
+        // The delay a BPMDelay makes of the tempo and the delay index.
+        float dT = float(60.0f * static_cast<int>(delayIndex)) / tempo;
+        delay->delayTime()->setValue(dT);
+    }
+
+    void PingPongDelayNode::SyncToTransport(bool sync)
+    {
+        transportSync = sync;
+        delay->syncToTransport(sync ? static_cast<int>(delayIndex) : -1);
+        if (!sync)
+            recomputeDelay();
+    }
+
     void PingPongDelayNode::SetTempo(float t)
-    { 
-        tempo = t; 
-        leftDelay->SetTempo(tempo);
-        rightDelay->SetTempo(tempo);
+    {
+        tempo = t;
+        if (!transportSync)
+            recomputeDelay();
     }
 
-    void PingPongDelayNode::SetFeedback(float f) 
+    void PingPongDelayNode::SetFeedback(float f)
     {
         auto clamped = clampTo<float>(f,0.0f, 1.0f);
-        feedbackGain->gain()->setValue(clamped);
+        delay->feedback()->setValue(clamped);
     }
 
-    void PingPongDelayNode::SetLevel(float f) 
+    void PingPongDelayNode::SetLevel(float f)
     {
         auto clamped = clampTo<float>(f,0.0f, 1.0f);
-        wetGain->gain()->setValue(clamped);
+        delay->level()->setValue(clamped);
     }
 
     void PingPongDelayNode::SetDelayIndex(TempoSync value)
     {
-        leftDelay->SetDelayIndex(value);
-        rightDelay->SetDelayIndex(value);
+        if (value >= TempoSync::TS_32 && value <= TempoSync::TS_2D)
+        {
+            delayIndex = value;
+            if (transportSync)
+                delay->syncToTransport(static_cast<int>(delayIndex));
+            else
+                recomputeDelay();
+        }
+        else
+            throw std::invalid_argument("Delay index out of bounds");
     }
 
-    void PingPongDelayNode::BuildSubgraph(std::unique_ptr<AudioContext> & ac) 
+    void PingPongDelayNode::BuildSubgraph(std::unique_ptr<AudioContext> & ac)
     {
-
-        // Input into splitter
-        ac->connect(splitter, input, 0, 0);
-
-        ac->connect(splitterGain, splitter, 0, 0);
-        ac->connect(splitterGain, splitter, 1, 0);
-
-        ac->connect(wetGain, splitterGain, 0, 0);
-        splitterGain->gain()->setValue(0.5f);
-
-        ac->connect(leftDelay, wetGain, 0, 0);
-        ac->connect(leftDelay, feedbackGain, 0, 0);
-
-        ac->connect(rightDelay, leftDelay, 0, 0);
-        ac->connect(feedbackGain, rightDelay, 0, 0);
-
-        ac->connect(merger, leftDelay, 0, 0);
-        ac->connect(merger, rightDelay, 0, 1);
-
-        ac->connect(output, merger, 0, 0);
+        ac->connect(delay, input, 0, 0);
+        ac->connect(output, delay, 0, 0);
 
         // Activate with input->output
         ac->connect(output, input, 0, 0);
@@ -0,0 +1,337 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/PitchShiftNode.h"
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/AudioProcessor.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/STFT.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace lab
+{
+
+static size_t windowSizeFor(PitchShiftNode::Quality quality)
+{
+    return quality == PitchShiftNode::Quality::HighQuality ? 4096 : 1024;
+}
+
+static size_t hopSizeFor(PitchShiftNode::Quality quality)
+{
+    return quality == PitchShiftNode::Quality::HighQuality ? 512 : 256;
+}
+
+// Wraps a phase to [-pi, pi].
+static inline float wrapPhase(float phase)
+{
+    return phase - TwoPi * std::floor(phase * (1.f / TwoPi) + 0.5f);
+}
+
+// One channel's phase vocoder.
+class PhaseVocoder
+{
+public:
+
+    PhaseVocoder(size_t windowSize, size_t hopSize)
+        : m_stft(window_hanning, windowSize, hopSize)
+        , m_bins(m_stft.fftSize() / 2)
+        , m_lastPhase(m_bins)
+        , m_sumPhase(m_bins)
+        , m_magnitude(m_bins)
+        , m_phase(m_bins)
+        , m_shiftedMagnitude(m_bins)
+        , m_shiftedPhase(m_bins)
+        , m_peaks(m_bins)
+        , m_peakFrequency(m_bins)
+    {
+    }
+
+    size_t latencyFrames() const { return m_stft.latencyFrames(); }
+
+    void reset()
+    {
+        m_stft.reset();
+        m_lastPhase.zero();
+        m_sumPhase.zero();
+    }
+
+    // ratio is the factor the frequencies are multiplied by.
+    void process(const float * source, float * destination, size_t framesToProcess, float ratio)
+    {
+        m_ratio = ratio;
+        m_stft.process(source, destination, framesToProcess, [this](FFTFrame & frame) { shift(frame); });
+    }
+
+private:
+
+    void shift(FFTFrame & frame)
+    {
+        float * real = frame.realData();
+        float * imag = frame.imagData();
+        float * lastPhase = m_lastPhase.data();
+        float * sumPhase = m_sumPhase.data();
+        float * magnitude = m_magnitude.data();
+        float * phase = m_phase.data();
+
+        // imag[0] holds the Nyquist bin, which is set aside, and bin 0 is taken as real.
+        const float nyquist = imag[0];
+        imag[0] = 0;
+        VectorMath::vpolar(real, imag, magnitude, phase, m_bins);
+
+        if (m_ratio == 1)
+        {
+            // The spectrum passes through, with its phases followed so that a shift starting later continues them.
+            std::memcpy(lastPhase, phase, sizeof(float) * m_bins);
+            std::memcpy(sumPhase, phase, sizeof(float) * m_bins);
+            imag[0] = nyquist;
+            return;
+        }
+
+        // The spectrum's peaks, each taken as a sinusoid whose lobe spreads over the bins around it, with their true
+        // frequencies, in bins, from how far their phases advanced beyond their centre frequencies' advance over
+        // a hop.
+        const float expected = TwoPi * static_cast<float>(m_stft.hopSize()) / static_cast<float>(m_stft.fftSize());
+        uint32_t * peaks = m_peaks.data();
+        float * peakFrequency = m_peakFrequency.data();
+        size_t peakCount = 0;
+        for (size_t k = 1; k + 1 < m_bins; ++k)
+        {
+            if (magnitude[k] > magnitude[k - 1] && magnitude[k] >= magnitude[k + 1])
+            {
+                const float advance = wrapPhase(phase[k] - lastPhase[k] - static_cast<float>(k) * expected);
+                peaks[peakCount] = static_cast<uint32_t>(k);
+                peakFrequency[peakCount++] = static_cast<float>(k) + advance / expected;
+            }
+        }
+
+        // Each peak moves, with the bins down to the troughs either side of it, by the whole bins nearest its
+        // shift in frequency, so that its lobe keeps its shape, and its bins keep their phases relative to the
+        // peak's. Where moved lobes would overlap, they meet halfway between their peaks. The peak's phase
+        // advances at its shifted frequency from the phase its new bin had in the last frame.
+        float * shiftedMagnitude = m_shiftedMagnitude.data();
+        float * shiftedPhase = m_shiftedPhase.data();
+        m_shiftedMagnitude.zero();
+        m_shiftedPhase.zero();
+        auto target = [&](size_t peak) {
+            return static_cast<ptrdiff_t>(peaks[peak]) + static_cast<ptrdiff_t>(std::floor(peakFrequency[peak] * (m_ratio - 1) + 0.5f));
+        };
+        const ptrdiff_t bins = static_cast<ptrdiff_t>(m_bins);
+        ptrdiff_t trough = 1;
+        ptrdiff_t begin = 1;
+        for (size_t i = 0; i < peakCount; ++i)
+        {
+            const ptrdiff_t p = peaks[i];
+            const ptrdiff_t q = target(i);
+            if (q >= bins)
+                break;
+
+            ptrdiff_t nextTrough = bins;
+            ptrdiff_t end = bins;
+            if (i + 1 < peakCount)
+            {
+                nextTrough = p + 1;
+                for (ptrdiff_t k = p + 2; k <= static_cast<ptrdiff_t>(peaks[i + 1]); ++k)
+                {
+                    if (magnitude[k] < magnitude[nextTrough])
+                        nextTrough = k;
+                }
+                end = std::min(bins, (q + target(i + 1) + 1) / 2);
+            }
+
+            if (q < 1)
+            {
+                trough = nextTrough;
+                begin = std::max(begin, end);
+                continue;
+            }
+
+            const float rotation = wrapPhase(sumPhase[q] + peakFrequency[i] * m_ratio * expected) - phase[p];
+            const ptrdiff_t offset = q - p;
+            const ptrdiff_t last = std::min(end, nextTrough + offset);
+            for (ptrdiff_t j = std::max(begin, trough + offset); j < last; ++j)
+            {
+                shiftedMagnitude[j] = magnitude[j - offset];
+                shiftedPhase[j] = phase[j - offset] + rotation;
+            }
+
+            trough = nextTrough;
+            begin = std::max(begin, end);
+        }
+
+        std::memcpy(lastPhase, phase, sizeof(float) * m_bins);
+        std::memcpy(sumPhase, shiftedPhase, sizeof(float) * m_bins);
+
+        // DC is kept as it was, and the Nyquist bin is cleared.
+        const float dc = real[0];
+        VectorMath::vrect(shiftedMagnitude, shiftedPhase, real, imag, m_bins);
+        real[0] = dc;
+        imag[0] = 0;
+    }
+
+    STFT m_stft;
+    size_t m_bins;
+    float m_ratio = 1;
+
+    // Per bin: the analysed phase of the last frame, and the synthesized phase.
+    AudioFloatArray m_lastPhase;
+    AudioFloatArray m_sumPhase;
+
+    // Per frame scratch.
+    AudioFloatArray m_magnitude;
+    AudioFloatArray m_phase;
+    AudioFloatArray m_shiftedMagnitude;
+    AudioFloatArray m_shiftedPhase;
+    std::vector<uint32_t> m_peaks;
+    AudioFloatArray m_peakFrequency;
+};
+
+class PitchShiftNode::PitchShiftProcessor : public AudioProcessor
+{
+public:
+
+    explicit PitchShiftProcessor(Quality quality) : AudioProcessor(1), m_quality(quality)
+    {
+        m_pitch = std::make_shared<AudioParam>("pitch", 0, -24, 24);
+    }
+
+    virtual ~PitchShiftProcessor() { }
+
+    virtual void initialize() override
+    {
+        if (isInitialized())
+            return;
+
+        // The channels kept from before are reset, and any new ones made.
+        m_vocoders.resize(numberOfChannels());
+        for (auto & vocoder : m_vocoders)
+        {
+            if (vocoder)
+                vocoder->reset();
+            else
+                vocoder.reset(new PhaseVocoder(windowSizeFor(m_quality), hopSizeFor(m_quality)));
+        }
+        m_initialized = true;
+    }
+
+    virtual void uninitialize() override
+    {
+        m_initialized = false;
+    }
+
+    virtual void reset() override
+    {
+        for (auto & vocoder : m_vocoders)
+            vocoder->reset();
+    }
+
+    virtual double tailTime(ContextRenderLock & r) const override { return latencyTime(r); }
+
+    virtual double latencyTime(ContextRenderLock & r) const override
+    {
+        return r.context() ? static_cast<double>(windowSizeFor(m_quality)) / r.context()->sampleRate() : 0;
+    }
+
+    virtual void process(ContextRenderLock & r, const AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess) override
+    {
+        if (!isInitialized() || !r.context())
+        {
+            destinationBus->zero();
+            return;
+        }
+
+        const size_t channelCount = numberOfChannels();
+        bool channelCountMatches = sourceBus->numberOfChannels() == channelCount && destinationBus->numberOfChannels() == channelCount;
+        ASSERT(channelCountMatches);
+        if (!channelCountMatches)
+            return;
+
+        const float semitones = std::max(-24.f, std::min(24.f, m_pitch->value(r)));
+        const float ratio = std::pow(2.f, semitones / 12.f);
+
+        for (size_t channel = 0; channel < channelCount; ++channel)
+        {
+            m_vocoders[channel]->process(sourceBus->channel(channel)->data(), destinationBus->channel(channel)->mutableData(),
+                                         framesToProcess, ratio);
+        }
+        destinationBus->clearSilentFlag();
+    }
+
+    Quality m_quality;
+    std::shared_ptr<AudioParam> m_pitch;
+    std::vector<std::unique_ptr<PhaseVocoder>> m_vocoders;
+};
+
+PitchShiftNode::PitchShiftNode(Quality quality) : AudioBasicProcessorNode()
+{
+    m_processor.reset(new PitchShiftProcessor(quality));
+    m_params.push_back(pitchProcessor()->m_pitch);
+    initialize();
+}
+
+PitchShiftNode::~PitchShiftNode()
+{
+    uninitialize();
+}
+
+PitchShiftNode::PitchShiftProcessor * PitchShiftNode::pitchProcessor() const
+{
+    return static_cast<PitchShiftProcessor *>(processor());
+}
+
+std::shared_ptr<AudioParam> PitchShiftNode::pitch() const
+{
+    return pitchProcessor()->m_pitch;
+}
+
+PitchShiftNode::Quality PitchShiftNode::quality() const
+{
+    return pitchProcessor()->m_quality;
+}
+
+std::unique_ptr<AudioBus> PitchShiftNode::timeStretch(const AudioBus & source, double timeScale, float semitones, Quality quality)
+{
+    const float sampleRate = source.sampleRate();
+    if (!sampleRate || !(timeScale > 0))
+        return nullptr;
+
+    // Resampled to timeScale times the rate and played at the original one, the bus lasts timeScale times as long,
+    // and its frequencies are divided by timeScale, which the shift multiplies back.
+    std::unique_ptr<AudioBus> stretched = AudioBus::createBySampleRateConverting(&source, false, static_cast<float>(sampleRate * timeScale));
+    if (!stretched)
+        return nullptr;
+    stretched->setSampleRate(sampleRate);
+
+    const float ratio = static_cast<float>(std::pow(2.0, semitones / 12.0) * timeScale);
+    const size_t length = stretched->length();
+
+    // Each channel runs on past its end by the latency, which is then dropped from the front.
+    for (size_t channel = 0; channel < stretched->numberOfChannels(); ++channel)
+    {
+        PhaseVocoder vocoder(windowSizeFor(quality), hopSizeFor(quality));
+        const size_t latency = vocoder.latencyFrames();
+        std::vector<float> buffer(length + latency, 0.f);
+
+        float * data = stretched->channel(channel)->mutableData();
+        std::memcpy(buffer.data(), data, sizeof(float) * length);
+        vocoder.process(buffer.data(), buffer.data(), buffer.size(), ratio);
+        std::memcpy(data, buffer.data() + latency, sizeof(float) * length);
+    }
+    stretched->clearSilentFlag();
+    return stretched;
+}
+
+} // namespace lab
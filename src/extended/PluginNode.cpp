@@ -0,0 +1,329 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/PluginNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/DenormalDisabler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace lab
+{
+
+const size_t PluginNode::ParameterEventFrames;
+
+// Runs the plugin a quantum behind the render thread. The render thread only touches the buffers while the worker
+// is idle, and hands them over by setting busy; the worker hands them back by clearing it.
+class PluginNode::Worker
+{
+public:
+
+    Worker(PluginNode & node, size_t quantumSize, size_t eventCapacity)
+        : m_node(node)
+        , m_input(new AudioBus(node.m_plugin->inputChannels(), quantumSize))
+        , m_output(new AudioBus(node.m_plugin->outputChannels(), quantumSize))
+        , m_events(eventCapacity)
+        , m_inputs(node.m_plugin->inputChannels())
+        , m_outputs(node.m_plugin->outputChannels())
+    {
+        for (size_t c = 0; c < m_inputs.size(); ++c)
+            m_inputs[c] = m_input->channel(c)->data();
+        for (size_t c = 0; c < m_outputs.size(); ++c)
+            m_outputs[c] = m_output->channel(c)->mutableData();
+    }
+
+    ~Worker()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_running = false;
+            }
+            m_wake.notify_one();
+            m_thread.join();
+        }
+    }
+
+    void start() { m_thread = std::thread(&Worker::workerEntry, this); }
+
+    // Takes the last quantum's output into destination, and hands this quantum's input and events to the worker,
+    // or to the calling thread if there's no deadline to keep.
+    void process(ContextRenderLock & r, const AudioBus & source, AudioBus & destination, size_t framesToProcess,
+                 const AudioPlugin::ParameterEvent * events, size_t eventCount)
+    {
+        if (m_busy.load(std::memory_order_acquire) || framesToProcess > m_input->length())
+        {
+            destination.zero();
+            m_underrunCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        destination.copyFrom(*m_output);
+
+        // As PluginNode::process, a mono source feeds all of the plugin's inputs.
+        const size_t sourceChannels = source.numberOfChannels();
+        for (size_t c = 0; c < m_inputs.size(); ++c)
+        {
+            if (c < sourceChannels || sourceChannels == 1)
+                std::memcpy(m_input->channel(c)->mutableData(), source.channel(c < sourceChannels ? c : 0)->data(), sizeof(float) * framesToProcess);
+            else
+                m_input->channel(c)->zero();
+        }
+        std::copy(events, events + eventCount, m_events.begin());
+        m_eventCount = eventCount;
+        m_frames = framesToProcess;
+
+        if (m_thread.joinable() && !r.context()->isOfflineContext())
+        {
+            m_busy.store(true, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_pending = true;
+            }
+            m_wake.notify_one();
+        }
+        else
+        {
+            run();
+        }
+    }
+
+    // The plugin is reset by the worker before it next runs, and the output waiting to be played is cleared.
+    void reset()
+    {
+        m_resetRequested.store(true, std::memory_order_release);
+        if (!m_busy.load(std::memory_order_acquire))
+            m_output->zero();
+    }
+
+    std::atomic<uint64_t> m_underrunCount{ 0 };
+
+private:
+
+    void run()
+    {
+        if (m_resetRequested.exchange(false, std::memory_order_acq_rel))
+            m_node.m_plugin->reset();
+        m_node.m_plugin->process(m_inputs.data(), m_outputs.data(), m_frames, m_events.data(), m_eventCount);
+        for (size_t c = 0; c < m_outputs.size(); ++c)
+            std::fill(m_outputs[c] + m_frames, m_outputs[c] + m_output->length(), 0.f);
+    }
+
+    void workerEntry()
+    {
+        DenormalDisabler denormalDisabler;
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        while (m_running)
+        {
+            m_wake.wait(lock, [this]() { return m_pending || !m_running; });
+            if (!m_pending)
+                continue;
+            m_pending = false;
+            lock.unlock();
+            run();
+            m_busy.store(false, std::memory_order_release);
+            lock.lock();
+        }
+    }
+
+    PluginNode & m_node;
+
+    std::unique_ptr<AudioBus> m_input;
+    std::unique_ptr<AudioBus> m_output;
+    std::vector<AudioPlugin::ParameterEvent> m_events;
+    size_t m_eventCount = 0;
+    size_t m_frames = 0;
+    std::vector<const float *> m_inputs;
+    std::vector<float *> m_outputs;
+
+    std::atomic<bool> m_busy{ false };
+    std::atomic<bool> m_resetRequested{ false };
+    std::thread m_thread;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    bool m_pending = false;
+    bool m_running = true;
+};
+
+PluginNode::PluginNode(AudioContext & context, std::unique_ptr<AudioPlugin> plugin, bool runOnWorker)
+    : AudioNode()
+    , m_plugin(std::move(plugin))
+    , m_sampleRate(context.sampleRate())
+{
+    const size_t quantumSize = context.renderQuantumSize();
+    const size_t inputChannels = m_plugin ? m_plugin->inputChannels() : 0;
+    const size_t outputChannels = m_plugin ? m_plugin->outputChannels() : 0;
+
+    addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, static_cast<int>(std::max<size_t>(outputChannels, 1)))));
+
+    // The input is mixed to the plugin's channels.
+    m_channelCount = std::max<size_t>(inputChannels, 1);
+    m_channelCountMode = ChannelCountMode::Explicit;
+
+    m_samplesPerQuantum = (quantumSize + ParameterEventFrames - 1) / ParameterEventFrames;
+    if (m_plugin)
+    {
+        for (auto & parameter : m_plugin->parameters())
+        {
+            auto param = std::make_shared<AudioParam>(parameter.name, parameter.defaultValue, parameter.minValue, parameter.maxValue);
+            m_params.push_back(param);
+            m_pluginParams.push_back(param);
+            m_sentValues.push_back(std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+    m_paramValues.reset(new AudioFloatArray(quantumSize));
+    m_paramSamples.reset(new AudioFloatArray(std::max<size_t>(m_pluginParams.size() * m_samplesPerQuantum, 1)));
+    m_events.resize(m_pluginParams.size() * m_samplesPerQuantum);
+
+    m_silence.reset(new AudioFloatArray(quantumSize));
+    m_discard.reset(new AudioFloatArray(quantumSize));
+    m_inputs.resize(inputChannels);
+    m_outputs.resize(outputChannels);
+
+    m_active = m_plugin && m_plugin->activate(m_sampleRate, quantumSize);
+    if (m_active && runOnWorker)
+    {
+        m_worker.reset(new Worker(*this, quantumSize, m_events.size()));
+        m_worker->start();
+    }
+
+    initialize();
+}
+
+PluginNode::~PluginNode()
+{
+    // The worker must stop before the plugin it runs goes.
+    m_worker.reset();
+    uninitialize();
+}
+
+std::shared_ptr<AudioParam> PluginNode::parameter(size_t index) const
+{
+    return index < m_pluginParams.size() ? m_pluginParams[index] : nullptr;
+}
+
+uint64_t PluginNode::underrunCount() const
+{
+    return m_worker ? m_worker->m_underrunCount.load(std::memory_order_relaxed) : 0;
+}
+
+double PluginNode::tailTime(ContextRenderLock & r) const
+{
+    return m_active ? m_plugin->tailTime() : 0;
+}
+
+double PluginNode::latencyTime(ContextRenderLock & r) const
+{
+    if (!m_active)
+        return 0;
+    const size_t frames = m_plugin->latencyFrames() + (m_worker ? m_silence->size() : 0);
+    return frames / static_cast<double>(m_sampleRate);
+}
+
+void PluginNode::gatherEvents(ContextRenderLock & r, size_t framesToProcess)
+{
+    // Sampled param by param, then made into events sample by sample, so that they come out in frame order.
+    const size_t samples = (framesToProcess + ParameterEventFrames - 1) / ParameterEventFrames;
+    float * values = m_paramValues->data();
+    float * sampled = m_paramSamples->data();
+    for (size_t p = 0; p < m_pluginParams.size(); ++p)
+    {
+        float * row = sampled + p * m_samplesPerQuantum;
+        AudioParam & param = *m_pluginParams[p];
+        if (param.hasSampleAccurateValues())
+        {
+            param.calculateSampleAccurateValues(r, values, framesToProcess);
+            for (size_t s = 0; s < samples; ++s)
+                row[s] = values[s * ParameterEventFrames];
+        }
+        else
+        {
+            std::fill(row, row + samples, param.value(r));
+        }
+    }
+
+    m_eventCount = 0;
+    for (size_t s = 0; s < samples; ++s)
+    {
+        for (size_t p = 0; p < m_pluginParams.size(); ++p)
+        {
+            const double value = sampled[p * m_samplesPerQuantum + s];
+            if (value == m_sentValues[p])
+                continue;
+            m_sentValues[p] = value;
+            m_events[m_eventCount++] = { static_cast<uint32_t>(s * ParameterEventFrames), static_cast<uint32_t>(p), value };
+        }
+    }
+}
+
+void PluginNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    const AudioBus * inputBus = input(0)->bus(r);
+
+    if (!isInitialized() || !m_active || !inputBus || framesToProcess > m_silence->size())
+    {
+        outputBus->zero();
+        return;
+    }
+
+    gatherEvents(r, framesToProcess);
+
+    if (m_worker)
+    {
+        m_worker->process(r, *inputBus, *outputBus, framesToProcess, m_events.data(), m_eventCount);
+        return;
+    }
+
+    // A mono source feeds all of the plugin's inputs; otherwise an input the source lacks is silent.
+    const size_t sourceChannels = inputBus->numberOfChannels();
+    for (size_t c = 0; c < m_inputs.size(); ++c)
+    {
+        if (c < sourceChannels)
+            m_inputs[c] = inputBus->channel(c)->data();
+        else
+            m_inputs[c] = sourceChannels == 1 ? inputBus->channel(0)->data() : m_silence->data();
+    }
+
+    // Output channels the bus lacks are written to scratch and dropped.
+    const size_t destinationChannels = outputBus->numberOfChannels();
+    for (size_t c = 0; c < m_outputs.size(); ++c)
+        m_outputs[c] = c < destinationChannels ? outputBus->channel(c)->mutableData() : m_discard->data();
+
+    m_plugin->process(m_inputs.data(), m_outputs.data(), framesToProcess, m_events.data(), m_eventCount);
+
+    for (size_t c = m_outputs.size(); c < destinationChannels; ++c)
+        outputBus->channel(c)->zero();
+    outputBus->clearSilentFlag();
+}
+
+void PluginNode::reset(ContextRenderLock & r)
+{
+    if (!m_active)
+        return;
+
+    if (m_worker)
+        m_worker->reset();
+    else
+        m_plugin->reset();
+
+    std::fill(m_sentValues.begin(), m_sentValues.end(), std::numeric_limits<double>::quiet_NaN());
+}
+
+} // namespace lab
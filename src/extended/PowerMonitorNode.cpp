@@ -3,19 +3,358 @@
 
 #include "LabSound/extended/PowerMonitorNode.h"
 
+#include "LabSound/extended/AudioContextLock.h"
+
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioSetting.h"
 #include "LabSound/core/Macros.h"
 
+#include "internal/Biquad.h"
+#include "internal/HalfBandResampler.h"
+#include "internal/Loudness.h"
+#include "internal/TripleBuffer.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 namespace lab {
     
     using namespace lab;
+
+    namespace
+    {
+        const size_t MaxChannels = PowerMonitorNode::MaxMeteredChannels;
+        const size_t SpanFrames = AudioNode::ProcessingSizeInFrames;
+
+        // Loudness is measured in 100ms blocks; the momentary window is 4 of them and the short term window 30.
+        const size_t MomentaryBlocks = 4;
+        const size_t ShortTermBlocks = 30;
+
+        // The integrated loudness gates blocks through a histogram of their loudness, in 0.1 LU bins from the
+        // absolute gate up.
+        const double AbsoluteGate = Loudness::AbsoluteGate;
+        const double RelativeGate = Loudness::RelativeGate;
+        const double BinWidth = 0.1;
+        const size_t Bins = 800;
+
+        // The half-band stages oversampling for the true peak.
+        const size_t OversamplerSideTaps = 12;
+
+        const float Silence = Loudness::Silence;
+
+        using Loudness::loudness;
+        using Loudness::channelWeight;
+
+        float decibels(float level)
+        {
+            return level > 0 ? 20.f * std::log10(level) : Silence;
+        }
+
+        void clear(PowerMonitorNode::Levels & levels)
+        {
+            levels.momentaryLoudness = Silence;
+            levels.shortTermLoudness = Silence;
+            levels.integratedLoudness = Silence;
+            levels.truePeak = Silence;
+            levels.maxTruePeak = Silence;
+            levels.channelCount = 0;
+            std::fill(levels.peak, levels.peak + MaxChannels, Silence);
+            std::fill(levels.rms, levels.rms + MaxChannels, Silence);
+        }
+    }
+
+    struct PowerMonitorNode::Meter
+    {
+        Meter()
+            : published([](Levels & levels) { clear(levels); })
+        {
+            for (size_t c = 0; c < MaxChannels; ++c)
+            {
+                weighted[c].allocate(SpanFrames);
+                upSamplers[c].reset(new HalfBandUpSampler(OversamplerSideTaps, SpanFrames));
+                upSamplers4x[c].reset(new HalfBandUpSampler(OversamplerSideTaps, 2 * SpanFrames));
+            }
+            oversampled.allocate(2 * SpanFrames);
+            oversampled4x.allocate(4 * SpanFrames);
+            reset();
+        }
+
+        // The K-weighting filters of BS.1770, designed for the sample rate.
+        void configure(float rate)
+        {
+            sampleRate = rate;
+            blockFrames = Loudness::blockFrames(rate);
+            for (size_t c = 0; c < MaxChannels; ++c)
+                Loudness::designKWeighting(rate, shelves[c], highpasses[c]);
+
+            reset();
+        }
+
+        void reset()
+        {
+            for (size_t c = 0; c < MaxChannels; ++c)
+            {
+                shelves[c].reset();
+                highpasses[c].reset();
+                upSamplers[c]->reset();
+                upSamplers4x[c]->reset();
+                blockEnergy[c] = 0;
+                blockPeak[c] = 0;
+                rmsSum[c] = 0;
+                rmsWindows[c].zero();
+            }
+            blockPosition = 0;
+            blockTruePeak = 0;
+            blocksSeen = 0;
+            std::fill(energies, energies + ShortTermBlocks, 0.0);
+            momentarySum = 0;
+            shortTermSum = 0;
+            std::memset(peaks, 0, sizeof(peaks));
+            std::fill(truePeaks, truePeaks + MomentaryBlocks, 0.f);
+            std::fill(histogramEnergy, histogramEnergy + Bins, 0.0);
+            std::fill(histogramCount, histogramCount + Bins, uint64_t(0));
+            rmsWrite = 0;
+            clear(current);
+        }
+
+        void process(AudioBus * bus, size_t framesToProcess, size_t windowSize);
+        void meterSpan(const float * const * sources, size_t channelCount, size_t frames);
+        void completeBlock(size_t channelCount);
+        float integratedLoudness() const;
+
+        float sampleRate = 0;
+        size_t blockFrames = 1;
+        size_t blockPosition = 0;
+
+        Biquad shelves[MaxChannels];
+        Biquad highpasses[MaxChannels];
+        AudioFloatArray weighted[MaxChannels];
+
+        std::unique_ptr<HalfBandUpSampler> upSamplers[MaxChannels];
+        std::unique_ptr<HalfBandUpSampler> upSamplers4x[MaxChannels];
+        AudioFloatArray oversampled;
+        AudioFloatArray oversampled4x;
+
+        // The block being measured.
+        double blockEnergy[MaxChannels];
+        float blockPeak[MaxChannels];
+        float blockTruePeak = 0;
+
+        // The weighted mean squares of the last ShortTermBlocks blocks, and their running sums.
+        uint64_t blocksSeen = 0;
+        double energies[ShortTermBlocks];
+        double momentarySum = 0;
+        double shortTermSum = 0;
+
+        float peaks[MomentaryBlocks][MaxChannels];
+        float truePeaks[MomentaryBlocks];
+
+        double histogramEnergy[Bins];
+        uint64_t histogramCount[Bins];
+
+        // The last windowSize frames of each channel, and the running sums of their squares.
+        AudioFloatArray rmsWindows[MaxChannels];
+        double rmsSum[MaxChannels];
+        size_t rmsWrite = 0;
+
+        Levels current;
+
+        // From the audio thread to the readers, who take turns as its consumer.
+        TripleBuffer<Levels> published;
+        std::mutex readerLock;
+    };
+
+    void PowerMonitorNode::Meter::process(AudioBus * bus, size_t framesToProcess, size_t windowSize)
+    {
+        const size_t channelCount = std::min(bus->numberOfChannels(), MaxChannels);
+
+        // The RMS windows are reallocated, on the audio thread, only when the window size changes.
+        windowSize = std::max<size_t>(windowSize, 1);
+        if (rmsWindows[0].size() != windowSize)
+        {
+            for (size_t c = 0; c < MaxChannels; ++c)
+            {
+                rmsWindows[c].allocate(windowSize);
+                rmsSum[c] = 0;
+            }
+            rmsWrite = 0;
+        }
+
+        const float * sources[MaxChannels];
+        for (size_t offset = 0; offset < framesToProcess;)
+        {
+            const size_t frames = std::min(std::min(framesToProcess - offset, SpanFrames), blockFrames - blockPosition);
+            for (size_t c = 0; c < channelCount; ++c)
+                sources[c] = bus->channel(c)->data() + offset;
+
+            meterSpan(sources, channelCount, frames);
+
+            blockPosition += frames;
+            if (blockPosition == blockFrames)
+                completeBlock(channelCount);
+            offset += frames;
+        }
+
+        current.channelCount = static_cast<uint32_t>(channelCount);
+        for (size_t c = 0; c < channelCount; ++c)
+            current.rms[c] = decibels(std::sqrt(static_cast<float>(std::max(rmsSum[c], 0.0) / windowSize)));
+
+        published.back() = current;
+        published.publish();
+    }
+
+    void PowerMonitorNode::Meter::meterSpan(const float * const * sources, size_t channelCount, size_t frames)
+    {
+        // The channels' K-weighting filters run side by side.
+        Biquad * shelfLanes[MaxChannels];
+        Biquad * highpassLanes[MaxChannels];
+        float * destinations[MaxChannels];
+        for (size_t c = 0; c < channelCount; ++c)
+        {
+            shelfLanes[c] = &shelves[c];
+            highpassLanes[c] = &highpasses[c];
+            destinations[c] = weighted[c].data();
+        }
+        Biquad::process(shelfLanes, sources, destinations, channelCount, frames);
+        Biquad::process(highpassLanes, destinations, destinations, channelCount, frames);
+
+        const size_t windowSize = rmsWindows[0].size();
+        for (size_t c = 0; c < channelCount; ++c)
+        {
+            float energy;
+            VectorMath::vsvesq(destinations[c], 1, &energy, frames);
+            blockEnergy[c] += energy;
+
+            float peak;
+            VectorMath::vmaxmgv(sources[c], 1, &peak, frames);
+            blockPeak[c] = std::max(blockPeak[c], peak);
+
+            upSamplers[c]->process(sources[c], oversampled.data(), frames);
+            upSamplers4x[c]->process(oversampled.data(), oversampled4x.data(), 2 * frames);
+            VectorMath::vmaxmgv(oversampled4x.data(), 1, &peak, 4 * frames);
+            blockTruePeak = std::max(blockTruePeak, peak);
+
+            // The frames entering the RMS window replace those leaving it, in spans up to its end.
+            float * window = rmsWindows[c].data();
+            size_t position = rmsWrite;
+            for (size_t done = 0; done < frames;)
+            {
+                const size_t span = std::min(frames - done, windowSize - position);
+                float entering, leaving;
+                VectorMath::vsvesq(sources[c] + done, 1, &entering, span);
+                VectorMath::vsvesq(window + position, 1, &leaving, span);
+                rmsSum[c] += static_cast<double>(entering) - leaving;
+                std::memcpy(window + position, sources[c] + done, sizeof(float) * span);
+
+                position += span;
+                if (position == windowSize)
+                {
+                    // Summed afresh once per round, so that rounding doesn't accumulate.
+                    float sum;
+                    VectorMath::vsvesq(window, 1, &sum, windowSize);
+                    rmsSum[c] = sum;
+                    position = 0;
+                }
+                done += span;
+            }
+        }
+        rmsWrite = (rmsWrite + frames) % windowSize;
+    }
+
+    void PowerMonitorNode::Meter::completeBlock(size_t channelCount)
+    {
+        double energy = 0;
+        for (size_t c = 0; c < channelCount; ++c)
+            energy += channelWeight(c, channelCount) * blockEnergy[c];
+        energy /= blockFrames;
+
+        // The running sums take the new block and drop the ones leaving their windows; they are summed afresh
+        // once per round of the ring.
+        const size_t index = static_cast<size_t>(blocksSeen % ShortTermBlocks);
+        const size_t leavingMomentary = (index + ShortTermBlocks - MomentaryBlocks) % ShortTermBlocks;
+        momentarySum += energy - energies[leavingMomentary];
+        shortTermSum += energy - energies[index];
+        energies[index] = energy;
+        if (index == ShortTermBlocks - 1)
+        {
+            shortTermSum = 0;
+            for (size_t i = 0; i < ShortTermBlocks; ++i)
+                shortTermSum += energies[i];
+            momentarySum = 0;
+            for (size_t i = 0; i < MomentaryBlocks; ++i)
+                momentarySum += energies[ShortTermBlocks - 1 - i];
+        }
+        ++blocksSeen;
+
+        const double momentary = std::max(momentarySum, 0.0) / MomentaryBlocks;
+        current.momentaryLoudness = loudness(momentary);
+        current.shortTermLoudness = loudness(std::max(shortTermSum, 0.0) / ShortTermBlocks);
+
+        // Every 400ms window, overlapping by 300ms, is a gating block.
+        if (blocksSeen >= MomentaryBlocks && current.momentaryLoudness > AbsoluteGate)
+        {
+            size_t bin = static_cast<size_t>((current.momentaryLoudness - AbsoluteGate) / BinWidth);
+            bin = std::min(bin, Bins - 1);
+            histogramEnergy[bin] += momentary;
+            ++histogramCount[bin];
+            current.integratedLoudness = integratedLoudness();
+        }
+
+        const size_t peakIndex = static_cast<size_t>(blocksSeen % MomentaryBlocks);
+        std::memcpy(peaks[peakIndex], blockPeak, sizeof(blockPeak));
+        truePeaks[peakIndex] = blockTruePeak;
+        for (size_t c = 0; c < channelCount; ++c)
+        {
+            float peak = 0;
+            for (size_t i = 0; i < MomentaryBlocks; ++i)
+                peak = std::max(peak, peaks[i][c]);
+            current.peak[c] = decibels(peak);
+        }
+        current.truePeak = decibels(*std::max_element(truePeaks, truePeaks + MomentaryBlocks));
+        current.maxTruePeak = std::max(current.maxTruePeak, decibels(blockTruePeak));
+
+        blockPosition = 0;
+        blockTruePeak = 0;
+        std::fill(blockEnergy, blockEnergy + MaxChannels, 0.0);
+        std::fill(blockPeak, blockPeak + MaxChannels, 0.f);
+    }
+
+    // The mean of the blocks above the absolute gate sets the relative gate, 10 LU below it, and the result is
+    // the mean of the blocks above that.
+    float PowerMonitorNode::Meter::integratedLoudness() const
+    {
+        double energy = 0;
+        uint64_t count = 0;
+        for (size_t i = 0; i < Bins; ++i)
+        {
+            energy += histogramEnergy[i];
+            count += histogramCount[i];
+        }
+        if (!count)
+            return Silence;
+
+        const double gate = loudness(energy / count) + RelativeGate;
+        const size_t first = gate > AbsoluteGate ? std::min(static_cast<size_t>((gate - AbsoluteGate) / BinWidth), Bins - 1) : 0;
+        energy = 0;
+        count = 0;
+        for (size_t i = first; i < Bins; ++i)
+        {
+            energy += histogramEnergy[i];
+            count += histogramCount[i];
+        }
+        return count ? loudness(energy / count) : Silence;
+    }
     
     PowerMonitorNode::PowerMonitorNode() 
     : AudioBasicInspectorNode(2), _db(0)
     , _windowSize(std::make_shared<AudioSetting>("windowSize"))
+    , _meter(new Meter())
     {
         addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
         _windowSize->setUint32(128);
@@ -89,6 +428,10 @@ namespace lab {
             _db = 20.0f * logf(rms) / logf(10.0f);
         }
         // to here
+
+        if (r.context()->sampleRate() != _meter->sampleRate)
+            _meter->configure(r.context()->sampleRate());
+        _meter->process(bus, framesToProcess, _windowSize->valueUint32());
         
         // For in-place processing, our override of pullInputs() will just pass the audio data
         // through unchanged if the channel count matches from input to output
@@ -101,6 +444,14 @@ namespace lab {
     void PowerMonitorNode::reset(ContextRenderLock&)
     {
         _db = 0;
+        _meter->reset();
+    }
+
+    void PowerMonitorNode::levels(Levels & result)
+    {
+        std::lock_guard<std::mutex> lock(_meter->readerLock);
+        _meter->published.update();
+        result = _meter->published.front();
     }
     
 } // namespace lab
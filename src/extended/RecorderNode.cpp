@@ -4,15 +4,28 @@
 #include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioMemory.h"
 
 #include "LabSound/extended/RecorderNode.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/AudioFileWriter.h"
+#include "internal/VectorMath.h"
 
 #include "libnyquist/Encoders.h"
 
+#include <algorithm>
+
 namespace lab 
 {
     
     using namespace lab;
+
+    namespace
+    {
+        // As many as a bus can have.
+        const int MaxStreamChannels = 32;
+    }
     
     RecorderNode::RecorderNode() : AudioBasicInspectorNode(2)
     {
@@ -24,8 +37,42 @@ namespace lab
     
     RecorderNode::~RecorderNode()
     {
+        stopStreaming();
         uninitialize();
     }
+
+    bool RecorderNode::startStreaming(const std::string & path, int channels, size_t bufferFrames, float lossyBitsPerSample)
+    {
+        std::unique_ptr<AudioFileWriter> stream = AudioFileWriter::open(path, static_cast<unsigned>(std::max(std::min(channels, MaxStreamChannels), 1)),
+                                                                      bufferFrames, lossyBitsPerSample);
+        if (!stream)
+            return false;
+
+        // The mono mix is sized for any quantum up front, so the render thread doesn't allocate.
+        std::unique_ptr<AudioFileWriter> previous;
+        {
+            std::lock_guard<std::mutex> lock(m_streamMutex);
+            previous.swap(m_stream);
+            m_stream = std::move(stream);
+            m_monoMix.resize(AudioNode::ProcessingSizeInFrames);
+            m_droppedQuanta = 0;
+        }
+
+        // Completed outside the lock, so that the render thread isn't kept from the new stream meanwhile.
+        if (previous)
+            previous->close();
+        return true;
+    }
+
+    bool RecorderNode::stopStreaming()
+    {
+        std::unique_ptr<AudioFileWriter> stream;
+        {
+            std::lock_guard<std::mutex> lock(m_streamMutex);
+            stream.swap(m_stream);
+        }
+        return stream ? stream->close() : true;
+    }
     
     void RecorderNode::getData(std::vector<float> & result)
     {
@@ -109,6 +156,53 @@ namespace lab
             }
 
         }
+
+        if (m_streamMutex.try_lock())
+        {
+            if (m_stream)
+            {
+                const unsigned streamChannels = m_stream->numberOfChannels();
+                const size_t numberOfChannels = bus->numberOfChannels();
+                const float * channels[MaxStreamChannels] = {};
+                bool written = true;
+
+                // A stream takes the channels it has as they are, but for a mono one, which takes the mix, each quantum
+                // a span at a time. The room is checked for the whole quantum first, so that a quantum is written or
+                // dropped whole, never in part.
+                if (m_stream->writableFrames() < framesToProcess)
+                {
+                    written = false;
+                }
+                else if (streamChannels == 1 && numberOfChannels > 1)
+                {
+                    const float scale = 1.0f / float(numberOfChannels);
+                    for (size_t offset = 0; offset < framesToProcess; offset += m_monoMix.size())
+                    {
+                        const size_t frames = std::min(framesToProcess - offset, m_monoMix.size());
+                        float * mix = m_monoMix.data();
+                        VectorMath::vsmul(bus->channel(0)->data() + offset, 1, &scale, mix, 1, frames);
+                        for (size_t c = 1; c < numberOfChannels; ++c)
+                            VectorMath::vsma(bus->channel(c)->data() + offset, 1, &scale, mix, 1, frames);
+                        channels[0] = mix;
+                        written = m_stream->write(channels, frames, r.context()->sampleRate()) && written;
+                    }
+                }
+                else
+                {
+                    for (size_t c = 0; c < std::min<size_t>(streamChannels, numberOfChannels); ++c)
+                        channels[c] = bus->channel(c)->data();
+                    written = m_stream->write(channels, framesToProcess, r.context()->sampleRate());
+                }
+
+                if (!written)
+                    m_droppedQuanta.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_streamMutex.unlock();
+        }
+        else
+        {
+            m_droppedQuanta.fetch_add(1, std::memory_order_relaxed);
+        }
         // <====== to here
         
         // For in-place processing, our override of pullInputs() will just pass the audio data
@@ -144,6 +238,15 @@ namespace lab
         nqr::encode_wav_to_disk(params, fileData.get(), filenameWithWavExtension);
     }
     
+    void RecorderNode::reportMemory(ContextRenderLock & r, AudioMemoryUsage & usage) const
+    {
+        AudioBasicInspectorNode::reportMemory(r, usage);
+        usage.add(AudioMemoryCategory::Other, m_monoMix.capacity() * sizeof(float));
+
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        usage.add(AudioMemoryCategory::Samples, m_data.capacity() * sizeof(float));
+    }
+
     void RecorderNode::reset(ContextRenderLock& r)
     {
         std::vector<float> clear;
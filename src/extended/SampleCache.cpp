@@ -0,0 +1,301 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/SampleCache.h"
+#include "LabSound/extended/AudioFileReader.h"
+
+#include "internal/Assertions.h"
+#include "internal/MappedFile.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace lab
+{
+
+const size_t SampleCache::DefaultBudget;
+
+namespace
+{
+    bool isReady(const std::shared_future<std::shared_ptr<AudioBus>> & bus)
+    {
+        return bus.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // A registered bus is a file of this header, the key it was decoded for, and its channels one after another,
+    // each starting on a cache line.
+    struct SharedBusHeader
+    {
+        char magic[8];
+        uint32_t numberOfChannels;
+        float sampleRate;
+        uint64_t length;
+        uint64_t channelStride; // in floats
+        uint64_t sourceSize;
+        int64_t sourceModified;
+        uint64_t keyLength;
+    };
+
+    const char SharedBusMagic[8] = { 'L', 'S', 'B', 'U', 'S', '0', '0', '1' };
+    const size_t SharedBusAlignment = 64;
+    const uint32_t SharedBusMaxChannels = 32; // as many as an AudioBus has
+
+    size_t alignShared(size_t bytes)
+    {
+        return (bytes + SharedBusAlignment - 1) & ~(SharedBusAlignment - 1);
+    }
+
+    std::string sharedKey(const std::string & path, bool mixToMono, float sampleRate)
+    {
+        return path + (mixToMono ? "|mono|" : "|all|") + std::to_string(sampleRate);
+    }
+
+    // Named by an FNV-1a hash of the key, which the file holds to tell collisions apart.
+    std::string sharedFile(const std::string & directory, const std::string & key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.lsbus", static_cast<unsigned long long>(hash));
+        char last = directory.back();
+        return directory + (last == '/' || last == '\\' ? "" : "/") + name;
+    }
+
+    bool sourceStamp(const std::string & path, uint64_t & size, int64_t & modified)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status))
+            return false;
+        size = static_cast<uint64_t>(status.st_size);
+        modified = static_cast<int64_t>(status.st_mtime);
+        return true;
+    }
+
+    // Returns nullptr unless the file is a registered bus for the key, decoded from the source as it is now.
+    std::shared_ptr<AudioBus> mapSharedBus(const std::string & file, const std::string & key, uint64_t sourceSize, int64_t sourceModified)
+    {
+        std::shared_ptr<MappedFile> mapping = MappedFile::open(file);
+        size_t dataOffset = alignShared(sizeof(SharedBusHeader) + key.size());
+        if (!mapping || mapping->size() < dataOffset)
+            return nullptr;
+
+        SharedBusHeader header;
+        memcpy(&header, mapping->data(), sizeof(header));
+        if (memcmp(header.magic, SharedBusMagic, sizeof(header.magic)) || header.keyLength != key.size()
+            || memcmp(mapping->data() + sizeof(header), key.data(), key.size())
+            || header.sourceSize != sourceSize || header.sourceModified != sourceModified)
+            return nullptr;
+
+        size_t floats = (mapping->size() - dataOffset) / sizeof(float);
+        if (!header.numberOfChannels || header.numberOfChannels > SharedBusMaxChannels || !header.length
+            || header.channelStride < header.length || header.channelStride > floats / header.numberOfChannels)
+            return nullptr;
+
+        // The channels refer to the mapping, which the bus's deleter keeps until the bus is destroyed. Its pages
+        // are read only.
+        float * samples = reinterpret_cast<float *>(const_cast<uint8_t *>(mapping->data() + dataOffset));
+        AudioBus * bus = new AudioBus(header.numberOfChannels, static_cast<size_t>(header.length), false);
+        for (uint32_t c = 0; c < header.numberOfChannels; ++c)
+            bus->setChannelMemory(c, samples + c * header.channelStride, static_cast<size_t>(header.length));
+        bus->setSampleRate(header.sampleRate);
+        return std::shared_ptr<AudioBus>(bus, [mapping](AudioBus * b) { delete b; });
+    }
+
+    bool registerSharedBus(const std::string & file, const std::string & key, const AudioBus & bus, uint64_t sourceSize, int64_t sourceModified)
+    {
+        SharedBusHeader header = {};
+        memcpy(header.magic, SharedBusMagic, sizeof(header.magic));
+        header.numberOfChannels = static_cast<uint32_t>(bus.numberOfChannels());
+        header.sampleRate = bus.sampleRate();
+        header.length = bus.length();
+        header.channelStride = alignShared(bus.length() * sizeof(float)) / sizeof(float);
+        header.sourceSize = sourceSize;
+        header.sourceModified = sourceModified;
+        header.keyLength = key.size();
+
+        // Written under a name of its own and renamed into place, so that no process maps it half written. Should
+        // another process register the same bus meanwhile, either copy serves.
+        std::random_device random;
+        const std::string temporary = file + "." + std::to_string(random()) + ".tmp";
+        FILE * f = fopen(temporary.c_str(), "wb");
+        if (!f)
+            return false;
+
+        const char padding[SharedBusAlignment] = {};
+        size_t headerBytes = sizeof(header) + key.size();
+        size_t channelBytes = bus.length() * sizeof(float);
+        bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(key.data(), 1, key.size(), f) == key.size()
+            && fwrite(padding, 1, alignShared(headerBytes) - headerBytes, f) == alignShared(headerBytes) - headerBytes;
+        for (size_t c = 0; written && c < bus.numberOfChannels(); ++c)
+        {
+            written = fwrite(bus.channel(c)->data(), sizeof(float), bus.length(), f) == bus.length()
+                && fwrite(padding, 1, alignShared(channelBytes) - channelBytes, f) == alignShared(channelBytes) - channelBytes;
+        }
+        written = (fclose(f) == 0) && written;
+
+        if (!written || std::rename(temporary.c_str(), file.c_str()))
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+SampleCache & SampleCache::shared()
+{
+    static SampleCache cache;
+    return cache;
+}
+
+SampleCache::SampleCache(size_t budgetBytes)
+    : m_budget(budgetBytes)
+{
+}
+
+SampleCache::~SampleCache()
+{
+}
+
+std::shared_ptr<AudioBus> SampleCache::bus(const std::string & path, bool mixToMono, float sampleRate)
+{
+    const Key key(path, mixToMono, sampleRate);
+    std::unique_lock<std::mutex> lock(m_lock);
+    auto found = m_index.find(key);
+    if (found != m_index.end())
+    {
+        ++m_statistics.hits;
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        std::shared_future<std::shared_ptr<AudioBus>> bus = found->second->bus;
+        lock.unlock();
+        return bus.get();
+    }
+
+    ++m_statistics.misses;
+    std::promise<std::shared_ptr<AudioBus>> decoded;
+    m_entries.push_front(Entry());
+    auto entry = m_entries.begin();
+    entry->key = key;
+    entry->bus = decoded.get_future().share();
+    m_index[key] = entry;
+    const std::string sharedDirectory = m_sharedDirectory;
+    lock.unlock();
+
+    // Decoded unlocked, so that other files can be found or decoded meanwhile. The entry can't be evicted until
+    // its bus has been set.
+    auto decode = [&]() {
+        std::shared_ptr<AudioBus> decodedBus = MakeBusFromFile(path, mixToMono);
+        if (decodedBus && sampleRate > 0 && decodedBus->sampleRate() != sampleRate)
+            decodedBus = AudioBus::createBySampleRateConverting(decodedBus.get(), false, sampleRate);
+        return decodedBus;
+    };
+
+    std::shared_ptr<AudioBus> bus;
+    bool mapped = false;
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!sharedDirectory.empty() && sourceStamp(path, sourceSize, sourceModified))
+    {
+        const std::string shared = sharedKey(path, mixToMono, sampleRate);
+        const std::string file = sharedFile(sharedDirectory, shared);
+        bus = mapSharedBus(file, shared, sourceSize, sourceModified);
+        mapped = bus != nullptr;
+        if (!bus)
+        {
+            // Once registered, the bus is mapped here too, so that this process shares the pages as well.
+            bus = decode();
+            if (bus && registerSharedBus(file, shared, *bus, sourceSize, sourceModified))
+            {
+                if (std::shared_ptr<AudioBus> registered = mapSharedBus(file, shared, sourceSize, sourceModified))
+                    bus = registered;
+            }
+        }
+    }
+    else
+        bus = decode();
+
+    lock.lock();
+    decoded.set_value(bus);
+    if (mapped)
+        ++m_statistics.sharedMaps;
+
+    if (!bus)
+    {
+        m_index.erase(key);
+        m_entries.erase(entry);
+        return nullptr;
+    }
+
+    entry->bytes = bus->length() * bus->numberOfChannels() * sizeof(float);
+    m_statistics.residentBytes += entry->bytes;
+    evict(m_budget);
+    return bus;
+}
+
+void SampleCache::evict(size_t bytes)
+{
+    auto entry = m_entries.end();
+    while (m_statistics.residentBytes > bytes && entry != m_entries.begin())
+    {
+        --entry;
+
+        // The cache's own reference is the one its future holds.
+        if (!isReady(entry->bus) || entry->bus.get().use_count() > 1)
+            continue;
+
+        m_statistics.residentBytes -= entry->bytes;
+        ++m_statistics.evictions;
+        m_index.erase(entry->key);
+        entry = m_entries.erase(entry);
+    }
+}
+
+size_t SampleCache::budget() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_budget;
+}
+
+void SampleCache::setBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_budget = budgetBytes;
+    evict(m_budget);
+}
+
+void SampleCache::purge()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    evict(0);
+}
+
+void SampleCache::setSharedDirectory(const std::string & directory)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_sharedDirectory = directory;
+}
+
+std::string SampleCache::sharedDirectory() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_sharedDirectory;
+}
+
+SampleCache::Statistics SampleCache::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Statistics statistics = m_statistics;
+    statistics.entryCount = m_entries.size();
+    return statistics;
+}
+
+} // namespace lab
@@ -1,134 +1,350 @@
 // License: BSD 2 Clause
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
-
 #include "LabSound/extended/SampledInstrumentNode.h"
 
-/*
-#include "internal/ConfigMacros.h"
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+
+#include <cmath>
+#include <limits>
 
-#include <string>
-#include <fstream>
-#include <streambuf>
-#include <stdlib.h>
+using namespace std;
 
-namespace lab 
+namespace lab
 {
 
-    using namespace lab;
+namespace
+{
+    const uint32_t DefaultPolyphony = 64;
+    const float DefaultRelease = 0.1f;
+
+    // Stolen voices fade out over this long, in slots of their own beyond the polyphony, so that they don't click.
+    const double StealTime = 0.005;
+    const size_t StealReserve = 32;
+
+    const uint64_t NoRelease = std::numeric_limits<uint64_t>::max();
 
-    struct SamplerSound 
+    uint64_t frameAt(ContextRenderLock & r, double when)
     {
+        const uint64_t now = r.context()->currentSampleFrame();
+        const double frame = std::round(when * r.context()->sampleRate());
+        return frame > static_cast<double>(now) ? static_cast<uint64_t>(frame) : now;
+    }
+}
 
-        SamplerSound(SampledInstrumentDefinition & def, float sampleRate)
-        {
-            soundBuf = new SoundBuffer(def.audio, def.extension, sampleRate);
-            this->baseMidiNote = def.root;
-            this->midiNoteLow = def.min;
-            this->midiNoteHigh = def.max;
-        }
+SampledInstrumentNode::SampledInstrumentNode()
+    : AudioNode()
+    , m_polyphony(std::make_shared<AudioSetting>("polyphony"))
+    , m_release(std::make_shared<AudioSetting>("release"))
+{
+    m_gain = make_shared<AudioParam>("gain", 1.0, 0.0, 1.0);
+    m_params.push_back(m_gain);
 
-        bool AppliesToNote(uint8_t note) 
-        {
-            // Debugging: 
-            //std::cout << "Note: " << int(note) << std::endl;
-            //std::cout << "Base: " << int(baseMidiNote) << std::endl;
-            //std::cout << "Low: " << int(midiNoteLow) << std::endl;
-            //std::cout << "High: " << int(midiNoteHigh) << std::endl;
-            //std::cout << std::endl << std::endl;
-            if (baseMidiNote == note || (note >= midiNoteLow && note <= midiNoteHigh)) 
-                return true; 
-            else 
-                return false; 
-        }
+    m_polyphony->setUint32(DefaultPolyphony, false);
+    m_release->setFloat(DefaultRelease, false);
+    m_settings.push_back(m_polyphony);
+    m_settings.push_back(m_release);
 
-        SoundBuffer * soundBuf;
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
 
-        uint8_t baseMidiNote;
-        uint8_t midiNoteLow;
-        uint8_t midiNoteHigh; 
-    };
+    resizeVoices(DefaultPolyphony + StealReserve);
 
-    SampledInstrumentNode::SampledInstrumentNode(AudioContext * ctx, float sampleRate) : sampleRate(sampleRate)
-    { 
-        gainNode = std::make_shared<GainNode>(sampleRate);
-        gainNode->gain()->setValue(1.0);
+    initialize();
+}
 
-        voices.resize(maxVoiceCount);
+SampledInstrumentNode::~SampledInstrumentNode()
+{
+    uninitialize();
+}
 
-        for (size_t i = 0; i < voices.size(); i++)
-        {
-            voices[i] = std::make_shared<SampledAudioNode>(sampleRate);
-            ctx->connect(gainNode, voices[i], 0, 0);
-        }
+void SampledInstrumentNode::resizeVoices(size_t count)
+{
+    m_position.resize(count);
+    m_rate.resize(count);
+    m_envelope.resize(count);
+    m_envelopeStep.resize(count);
+    m_voiceGain.resize(count);
+    m_startFrame.resize(count);
+    m_releaseFrame.resize(count);
+    m_releaseFrames.resize(count);
+    m_zone.resize(count);
+    m_note.resize(count);
+    m_state.resize(count, VoiceFree);
+    m_active.reserve(count);
+}
+
+void SampledInstrumentNode::setZones(ContextRenderLock & r, const std::vector<SampledInstrumentZone> & zones)
+{
+    allNotesOff(r);
+    for (uint32_t voice : m_active)
+        m_state[voice] = VoiceFree;
+    m_active.clear();
+    m_sounding = 0;
 
+    m_zones.clear();
+    for (const SampledInstrumentZone & zone : zones)
+    {
+        bool isZoneGood = zone.bus && zone.bus->length() && zone.bus->numberOfChannels();
+        ASSERT(isZoneGood);
+        if (isZoneGood)
+            m_zones.push_back(zone);
     }
+}
 
-    SampledInstrumentNode::~SampledInstrumentNode()
+uint32_t SampledInstrumentNode::allocateVoice(ContextRenderLock & r)
+{
+    // Voices are only added here, under the render lock, so that the render thread never sees the arrays resized.
+    const size_t polyphony = std::max<uint32_t>(1, m_polyphony->valueUint32());
+    if (m_position.size() < polyphony + StealReserve)
+        resizeVoices(polyphony + StealReserve);
+
+    if (m_sounding >= polyphony)
     {
+        // The quietest released voice, or failing that the oldest.
+        uint32_t victim = 0;
+        bool hasVictim = false;
+        for (uint32_t voice : m_active)
+        {
+            if (m_state[voice] == VoiceStolen)
+                continue;
+            if (!hasVictim || (m_state[voice] == VoiceReleased && (m_state[victim] != VoiceReleased || m_envelope[voice] < m_envelope[victim])))
+                victim = voice;
+            hasVictim = true;
+        }
 
+        if (hasVictim)
+        {
+            releaseVoice(victim, r.context()->currentSampleFrame(), static_cast<float>(StealTime * r.context()->sampleRate()));
+            m_state[victim] = VoiceStolen;
+            --m_sounding;
+        }
     }
 
-    // @tofix - add adsr
-    void SampledInstrumentNode::NoteOn(ContextRenderLock & r, const int midiNoteNumber, const float amplitude)
+    for (uint32_t voice = 0; voice < m_state.size(); ++voice)
     {
-        if (!r.context()) return;
+        if (m_state[voice] == VoiceFree)
+            return voice;
+    }
 
-        for (const auto & sample : samples)
+    // Every slot is fading out, so the oldest is cut off.
+    for (auto voice = m_active.begin(); voice != m_active.end(); ++voice)
+    {
+        if (m_state[*voice] == VoiceStolen)
         {
-            // Find note in sample map
-            if (sample->AppliesToNote(midiNoteNumber))
-            {
-                for (auto & v : voices)
-                {    
+            uint32_t taken = *voice;
+            m_active.erase(voice);
+            m_state[taken] = VoiceFree;
+            return taken;
+        }
+    }
 
-                    if (v->hasFinished())
-                    {
-                        v->reset(r);
-                    }
+    ASSERT(!"no voice could be allocated");
+    return 0;
+}
 
-                    if (v->playbackState() == 0) 
-                    {
-                        double pitchRatio = pow(2.0, (midiNoteNumber - sample->baseMidiNote) / 12.0);
+void SampledInstrumentNode::noteOn(ContextRenderLock & r, uint8_t note, uint8_t velocity, double when)
+{
+    if (!r.context())
+        return;
 
-                        v->playbackRate()->setValue(pitchRatio); 
-                        v->gain()->setValue(amplitude); 
+    auto zone = std::find_if(m_zones.begin(), m_zones.end(), [&](const SampledInstrumentZone & z) {
+        return note >= z.minNote && note <= z.maxNote && velocity >= z.minVelocity && velocity <= z.maxVelocity;
+    });
+    if (zone == m_zones.end())
+        return;
 
-                        // Connect the source node to the parsed audio data for playback
-                        v->setBus(r, sample->soundBuf->audioBuffer);
+    const uint32_t voice = allocateVoice(r);
+    m_position[voice] = 0;
+    m_rate[voice] = std::pow(2.0, (note - zone->root) / 12.0) * zone->bus->sampleRate() / r.context()->sampleRate();
+    m_envelope[voice] = 1;
+    m_envelopeStep[voice] = 0;
+    m_voiceGain[voice] = zone->gain * std::min<uint8_t>(velocity, 127) / 127.f;
+    m_startFrame[voice] = frameAt(r, when);
+    m_releaseFrame[voice] = NoRelease;
+    m_releaseFrames[voice] = 1;
+    m_zone[voice] = static_cast<uint32_t>(zone - m_zones.begin());
+    m_note[voice] = note;
+    m_state[voice] = VoiceHeld;
+    m_active.push_back(voice);
+    ++m_sounding;
+}
 
-                        v->start(r.context()->currentTime());
-                        v->stop(r.context()->currentTime() + sample->soundBuf->audioBuffer->length());
+void SampledInstrumentNode::noteOff(ContextRenderLock & r, uint8_t note, double when)
+{
+    if (!r.context())
+        return;
 
-                        return;
-                    }
-                }
-            }
-        }
+    const uint64_t frame = frameAt(r, when);
+    const float releaseFrames = std::max(1.f, m_release->valueFloat() * r.context()->sampleRate());
+    for (uint32_t voice : m_active)
+    {
+        if (m_state[voice] == VoiceHeld && m_note[voice] == note)
+            releaseVoice(voice, frame, releaseFrames);
     }
+}
+
+void SampledInstrumentNode::allNotesOff(ContextRenderLock & r)
+{
+    if (!r.context())
+        return;
 
-    void SampledInstrumentNode::NoteOff(ContextRenderLock & r, const int midiNoteNumber, const float amplitude)
+    const uint64_t frame = frameAt(r, 0);
+    const float releaseFrames = std::max(1.f, m_release->valueFloat() * r.context()->sampleRate());
+    for (uint32_t voice : m_active)
     {
-        if (!r.context()) return;
-         
-        // This logic is wrong. Find in voices... 
-        for (const auto & sample : samples)
+        if (m_state[voice] == VoiceHeld)
+            releaseVoice(voice, frame, releaseFrames);
+    }
+}
+
+void SampledInstrumentNode::releaseVoice(uint32_t voice, uint64_t frame, float frames)
+{
+    m_state[voice] = VoiceReleased;
+    m_releaseFrame[voice] = frame;
+    m_releaseFrames[voice] = frames;
+
+    // So that the release, from however loud the voice is by then, starts at the frame given.
+    m_envelopeStep[voice] = 0;
+}
+
+void SampledInstrumentNode::renderVoice(uint32_t voice, float * left, float * right, uint64_t quantumStart, size_t framesToProcess)
+{
+    const SampledInstrumentZone & zone = m_zones[m_zone[voice]];
+    const AudioBus & bus = *zone.bus;
+    const float * sourceL = bus.channel(0)->data();
+    const float * sourceR = bus.numberOfChannels() > 1 ? bus.channel(1)->data() : sourceL;
+    const size_t length = bus.length();
+
+    const bool isLooping = zone.loopEnd > zone.loopStart && zone.loopEnd <= length;
+    const double loopStart = static_cast<double>(zone.loopStart);
+    const double loopEnd = static_cast<double>(zone.loopEnd);
+
+    double position = m_position[voice];
+    const double rate = m_rate[voice];
+    float envelope = m_envelope[voice];
+    float step = m_envelopeStep[voice];
+    const float gain = m_voiceGain[voice];
+
+    const uint64_t startFrame = m_startFrame[voice];
+    size_t i = startFrame > quantumStart ? static_cast<size_t>(std::min<uint64_t>(startFrame - quantumStart, framesToProcess)) : 0;
+
+    // The frame at which the release starts, if it does this quantum, splits the quantum in two.
+    const uint64_t releaseFrame = std::max(m_releaseFrame[voice], startFrame);
+    const size_t releaseAt = releaseFrame > quantumStart ? static_cast<size_t>(std::min<uint64_t>(releaseFrame - quantumStart, framesToProcess)) : 0;
+
+    bool isFinished = false;
+    while (i < framesToProcess && !isFinished)
+    {
+        if (i == releaseAt && releaseFrame != NoRelease && step >= 0)
+            step = -std::max(envelope, 1e-6f) / m_releaseFrames[voice];
+
+        const size_t end = i < releaseAt ? releaseAt : framesToProcess;
+        for (; i < end; ++i)
         {
-            if (sample->AppliesToNote(midiNoteNumber))
+            if (isLooping && position >= loopEnd)
+                position -= loopEnd - loopStart;
+
+            size_t index = static_cast<size_t>(position);
+            if (index >= length)
+            {
+                isFinished = true;
+                break;
+            }
+
+            size_t next = index + 1;
+            if (isLooping && next >= zone.loopEnd)
+                next = zone.loopStart;
+            else if (next >= length)
+                next = index;
+
+            const float fraction = static_cast<float>(position - index);
+            const float amplitude = gain * envelope;
+            left[i] += (sourceL[index] + fraction * (sourceL[next] - sourceL[index])) * amplitude;
+            right[i] += (sourceR[index] + fraction * (sourceR[next] - sourceR[index])) * amplitude;
+
+            position += rate;
+            envelope += step;
+            if (envelope <= 0)
             {
-                //sample->Stop(r, midiNoteNumber, amplitude);
+                isFinished = true;
+                break;
             }
         }
     }
-    
-    void SampledInstrumentNode::LoadInstrument(std::vector<SampledInstrumentDefinition> & sounds) 
-    {
-        for (auto & samp : sounds) 
-        {
-            samples.push_back(std::make_shared<SamplerSound>(samp, sampleRate));
-        }
 
+    m_position[voice] = position;
+    m_envelope[voice] = std::min(envelope, 1.f);
+    m_envelopeStep[voice] = step;
+    if (isFinished)
+    {
+        if (m_state[voice] != VoiceStolen)
+            --m_sounding;
+        m_state[voice] = VoiceFree;
     }
+}
+
+void SampledInstrumentNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+    outputBus->zero();
+
+    if (!isInitialized() || !r.context() || m_active.empty())
+        return;
+
+    const uint64_t quantumStart = r.context()->currentSampleFrame();
+    float * left = outputBus->channel(0)->mutableData();
+    float * right = outputBus->channel(1)->mutableData();
+
+    for (uint32_t voice : m_active)
+        renderVoice(voice, left, right, quantumStart, framesToProcess);
+
+    m_active.erase(std::remove_if(m_active.begin(), m_active.end(), [this](uint32_t voice) {
+        return m_state[voice] == VoiceFree;
+    }), m_active.end());
+
+    outputBus->copyWithGainFrom(*outputBus, &m_lastGain, gain()->value(r));
+    outputBus->clearSilentFlag();
+}
+
+void SampledInstrumentNode::reset(ContextRenderLock & r)
+{
+    for (uint32_t voice : m_active)
+        m_state[voice] = VoiceFree;
+    m_active.clear();
+    m_sounding = 0;
+    m_lastGain = gain()->value(r);
+}
+
+uint32_t SampledInstrumentNode::polyphony() const
+{
+    return m_polyphony->valueUint32();
+}
+
+void SampledInstrumentNode::setPolyphony(uint32_t voices)
+{
+    m_polyphony->setUint32(voices);
+}
+
+float SampledInstrumentNode::release() const
+{
+    return m_release->valueFloat();
+}
+
+void SampledInstrumentNode::setRelease(float seconds)
+{
+    m_release->setFloat(seconds);
+}
 
+bool SampledInstrumentNode::propagatesSilence(ContextRenderLock & r) const
+{
+    return m_active.empty();
 }
-*/
+
+} // namespace lab
@@ -0,0 +1,90 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/SampledVoicePool.h"
+
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/SampledAudioNode.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include <algorithm>
+
+namespace lab
+{
+
+SampledVoicePool::SampledVoicePool(AudioContext & context, std::shared_ptr<AudioBus> bus, std::shared_ptr<AudioNode> destination, size_t voices)
+    : m_context(context)
+    , m_destination(std::move(destination))
+    , m_startedShot(voices, 0)
+    , m_limit(voices)
+{
+    m_voices.reserve(voices);
+    for (size_t i = 0; i < voices; ++i)
+    {
+        std::shared_ptr<SampledAudioNode> voice = std::make_shared<SampledAudioNode>();
+        {
+            ContextRenderLock r(&m_context, "SampledVoicePool");
+            voice->setBus(r, bus);
+        }
+        m_context.connect(m_destination, voice);
+        m_voices.push_back(std::move(voice));
+    }
+}
+
+SampledVoicePool::~SampledVoicePool()
+{
+    for (auto & voice : m_voices)
+        m_context.disconnect(m_destination, voice);
+}
+
+std::shared_ptr<SampledAudioNode> SampledVoicePool::play(double when, float gain, float playbackRate)
+{
+    if (activeVoices() >= m_limit)
+        return nullptr;
+
+    // Round robin from the voice after the one last started, which is the likeliest to have finished.
+    for (size_t n = 0; n < m_voices.size(); ++n)
+    {
+        std::shared_ptr<SampledAudioNode> & voice = m_voices[(m_next + n) % m_voices.size()];
+        if (voice->isPlayingOrScheduled())
+            continue;
+
+        m_startedShot[(m_next + n) % m_voices.size()] = ++m_shots;
+        m_next = (m_next + n + 1) % m_voices.size();
+        voice->gain()->setValue(gain);
+        voice->playbackRate()->setValue(playbackRate);
+        voice->startGrain(when, 0);
+        return voice;
+    }
+    return nullptr;
+}
+
+void SampledVoicePool::setVoiceLimit(size_t limit)
+{
+    m_limit = std::min(limit, m_voices.size());
+
+    std::vector<size_t> playing;
+    for (size_t i = 0; i < m_voices.size(); ++i)
+        if (m_voices[i]->isPlayingOrScheduled())
+            playing.push_back(i);
+
+    if (playing.size() <= m_limit)
+        return;
+
+    std::sort(playing.begin(), playing.end(), [this](size_t a, size_t b) { return m_startedShot[a] < m_startedShot[b]; });
+    for (size_t i = 0; i < playing.size() - m_limit; ++i)
+        m_voices[playing[i]]->stop(0);
+}
+
+size_t SampledVoicePool::activeVoices() const
+{
+    size_t active = 0;
+    for (auto & voice : m_voices)
+        if (voice->isPlayingOrScheduled())
+            ++active;
+    return active;
+}
+
+} // namespace lab
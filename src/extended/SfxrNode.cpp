@@ -183,6 +183,13 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
 using namespace std;
 using namespace lab;
 using namespace lab;
@@ -583,6 +590,92 @@ void SfxrNode::Sfxr::SynthSample(size_t length, float* buffer, FILE* file)
 
 namespace lab {
 
+    namespace
+    {
+        // The longest an effect is baked for; when repeating, the synthesizer never stops by itself.
+        const size_t MaxBakedFrames = 44100 * 30;
+
+        // Room for the node's params, read on the audio thread without allocating.
+        const size_t MaxParams = 32;
+
+        struct BakedEffect
+        {
+            std::vector<float> params;
+            std::shared_future<std::shared_ptr<AudioBus>> bus;
+        };
+
+        std::mutex & bakedLock()
+        {
+            static std::mutex lock;
+            return lock;
+        }
+
+        // Baked effects by hash of their params, and how many there are, so nodes skip looking when there are none.
+        std::map<uint64_t, std::vector<BakedEffect>> & bakedEffects()
+        {
+            static std::map<uint64_t, std::vector<BakedEffect>> effects;
+            return effects;
+        }
+
+        std::atomic<size_t> & bakedCount()
+        {
+            static std::atomic<size_t> count(0);
+            return count;
+        }
+
+        std::vector<float> paramValues(ContextRenderLock & r, const std::vector<std::shared_ptr<AudioParam>> & params)
+        {
+            std::vector<float> values;
+            values.reserve(params.size());
+            for (const std::shared_ptr<AudioParam> & param : params)
+                values.push_back(param->value(r));
+            return values;
+        }
+
+        // FNV-1a over the bits of the values.
+        uint64_t hashParams(const float * values, size_t count)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t bits;
+                memcpy(&bits, &values[i], sizeof(bits));
+                hash = (hash ^ bits) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // A baked effect for the params, if it's ready. The audio thread doesn't wait for the lock or the bake.
+        std::shared_ptr<AudioBus> findBakedEffect(ContextRenderLock & r, const std::vector<std::shared_ptr<AudioParam>> & params)
+        {
+            if (!bakedCount())
+                return nullptr;
+
+            float values[MaxParams];
+            const size_t count = std::min<size_t>(params.size(), MaxParams);
+            for (size_t i = 0; i < count; ++i)
+                values[i] = params[i]->value(r);
+
+            const uint64_t hash = hashParams(values, count);
+
+            std::unique_lock<std::mutex> guard(bakedLock(), std::try_to_lock);
+            if (!guard.owns_lock())
+                return nullptr;
+
+            auto found = bakedEffects().find(hash);
+            if (found == bakedEffects().end())
+                return nullptr;
+
+            for (const BakedEffect & effect : found->second)
+            {
+                if (effect.params.size() == count && std::equal(values, values + count, effect.params.begin()) &&
+                    effect.bus.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                    return effect.bus.get();
+            }
+            return nullptr;
+        }
+    }
+
     SfxrNode::SfxrNode(float sampleRate) : AudioScheduledSourceNode(), sfxr(new SfxrNode::Sfxr())
     {
         // Output is always mono.
@@ -650,38 +743,16 @@ namespace lab {
 
     void SfxrNode::noteOn() {
         start(0);
+        _noteStarted = true;
         sfxr->ResetSample(true);
         sfxr->ResetSample(false);
         sfxr->PlaySample();
     }
 
-    void SfxrNode::process(ContextRenderLock& r, size_t framesToProcess)
+    bool SfxrNode::copyParams(ContextRenderLock& r, Sfxr & synth)
     {
-        AudioBus* outputBus = output(0)->bus(r);
-
-        if (!isInitialized() || !outputBus->numberOfChannels()) {
-            outputBus->zero();
-            return;
-        }
-
-        size_t quantumFrameOffset;
-        size_t nonSilentFramesToProcess;
-
-        updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess);
-
-        if (!nonSilentFramesToProcess) {
-            outputBus->zero();
-            return;
-        }
-
-        float* destP = outputBus->channel(0)->mutableData();
-
-        // Start rendering at the correct offset.
-        destP += quantumFrameOffset;
-        size_t n = nonSilentFramesToProcess;
-
 #define UPDATE(typ, cur, val) \
-{ typ v = static_cast<typ>(val->value(r)); if (sfxr->cur != v) { needUpdate = true; sfxr->cur = v;} }
+{ typ v = static_cast<typ>(val->value(r)); if (synth.cur != v) { needUpdate = true; synth.cur = v;} }
 
         bool needUpdate = false;
         UPDATE(int, wave_type, _waveType)
@@ -701,7 +772,7 @@ namespace lab {
         UPDATE(float, p_env_punch, _sustainPunch)
 
         UPDATE(float, p_lpf_resonance, _lpFiterResonance)
-        sfxr->filter_on = sfxr->p_lpf_resonance > 0;
+        synth.filter_on = synth.p_lpf_resonance > 0;
         UPDATE(float, p_lpf_freq, _lpFilterCutoff)
         UPDATE(float, p_lpf_ramp, _lpFilterCutoffSweep)
         UPDATE(float, p_hpf_freq, _hpFilterCutoff)
@@ -714,22 +785,114 @@ namespace lab {
         UPDATE(float, p_arp_speed, _changeSpeed)
         UPDATE(float, p_arp_mod, _changeAmount)
 
-        if (needUpdate)
+#undef UPDATE
+
+        return needUpdate;
+    }
+
+    std::shared_future<std::shared_ptr<AudioBus>> SfxrNode::bake(ContextRenderLock& r)
+    {
+        std::vector<float> params = paramValues(r, m_params);
+        const uint64_t hash = hashParams(params.data(), params.size());
+
+        std::lock_guard<std::mutex> guard(bakedLock());
+        for (const BakedEffect & effect : bakedEffects()[hash])
+        {
+            if (effect.params == params)
+                return effect.bus;
+        }
+
+        // The synthesizer is set up here, from the params, and then run to the end of the effect on its own thread.
+        std::shared_ptr<Sfxr> synth = std::make_shared<Sfxr>();
+        synth->ResetParams();
+        copyParams(r, *synth);
+        synth->PlaySample();
+
+        std::shared_future<std::shared_ptr<AudioBus>> bus = std::async(std::launch::async, [synth]() {
+            const size_t chunk = 4096;
+            std::vector<float> samples;
+            while (synth->playing_sample && samples.size() < MaxBakedFrames)
+            {
+                const size_t start = samples.size();
+                samples.resize(start + chunk, 0.f);
+                synth->SynthSample(chunk, samples.data() + start, NULL);
+            }
+
+            // Trim the silence after the synthesizer stopped.
+            while (!samples.empty() && samples.back() == 0.f)
+                samples.pop_back();
+
+            std::shared_ptr<AudioBus> baked = std::make_shared<AudioBus>(1, std::max<size_t>(1, samples.size()));
+            baked->setSampleRate(44100.f);
+            if (!samples.empty())
+                memcpy(baked->channel(0)->mutableData(), samples.data(), sizeof(float) * samples.size());
+            return baked;
+        }).share();
+
+        bakedEffects()[hash].push_back(BakedEffect{ std::move(params), bus });
+        bakedCount()++;
+        return bus;
+    }
+
+    void SfxrNode::clearBakedEffects()
+    {
+        std::lock_guard<std::mutex> guard(bakedLock());
+        bakedEffects().clear();
+        bakedCount() = 0;
+    }
+
+    void SfxrNode::process(ContextRenderLock& r, size_t framesToProcess)
+    {
+        AudioBus* outputBus = output(0)->bus(r);
+
+        if (!isInitialized() || !outputBus->numberOfChannels()) {
+            outputBus->zero();
+            return;
+        }
+
+        size_t quantumFrameOffset;
+        size_t nonSilentFramesToProcess;
+
+        if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
+            return;
+
+        float* destP = outputBus->channel(0)->mutableData();
+
+        // Start rendering at the correct offset.
+        destP += quantumFrameOffset;
+        size_t n = nonSilentFramesToProcess;
+
+        if (copyParams(r, *sfxr))
             sfxr->ResetSample(false);
 
-#undef UPDATE
+        // A note on with the params of a baked effect plays that instead.
+        if (_noteStarted)
+        {
+            _noteStarted = false;
+            _baked = findBakedEffect(r, m_params);
+            _bakedPosition = 0;
+        }
 
-        float* fbuf = (float*) alloca(sizeof(float) * n);
-        memset(fbuf, 0, sizeof(float) * n);
-        sfxr->SynthSample(n, fbuf, NULL);
-        while (n--)
+        if (_baked)
         {
-            float f = fbuf[n];
-            if (f < -1.0f) f = -1.0f;
-            else if (f > 1.0f) f = 1.0f;
-            *destP++ = f;
+            const size_t length = _baked->length();
+            const size_t count = std::min(n, length - _bakedPosition);
+            memcpy(destP, _baked->channel(0)->data() + _bakedPosition, sizeof(float) * count);
+            memset(destP + count, 0, sizeof(float) * (n - count));
+            _bakedPosition += count;
+            if (_bakedPosition >= length)
+            {
+                _baked.reset();
+                sfxr->playing_sample = false;
+            }
+            outputBus->clearSilentFlag();
+            return;
         }
 
+        // SynthSample clamps each sample to [-1, 1].
+        memset(destP, 0, sizeof(float) * n);
+        sfxr->SynthSample(n, destP, NULL);
+
         outputBus->clearSilentFlag();
     }
 
@@ -7,6 +7,15 @@
 #include "LabSound/extended/SpatializationNode.h"
 #include "LabSound/extended/AudioContextLock.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace lab
 {
     
@@ -25,49 +34,262 @@ namespace lab
             float d = magnitude(cross(x0x1, x0x2)) / magnitude(x2x1);
             return d;
         }
+
+        // The attenuation by an occluder of the sound from the source, as heard by the listener.
+        float attenuation(const Occluder & o, const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos)
+        {
+            FloatPoint3D occPos(o.x, o.y, o.z);
+
+            float t;
+            float d = distanceFromPointToLine(occPos, listenerPos, sourcePos, t);
+
+            if (t <= 0 || t >= 1)
+                return 1.0f;
+
+            float maxAtten = o.maxAttenuation;
+
+            if (d <= o.innerRadius)
+                return maxAtten;
+
+            if (d <= o.outerRadius)
+            {
+                float inner = o.innerRadius;
+                float t = (d - inner) / (o.outerRadius - inner);
+                return maxAtten + (1.0f - maxAtten) * t;
+            }
+
+            return 1.0f;
+        }
     }
     
+    struct Occluders::Internals
+    {
+        struct Entry
+        {
+            Occluder occluder;
+            int lower[3];
+            int upper[3];
+            bool isLarge;
+            mutable uint32_t visit = 0;
+        };
+
+        // An occluder spanning more cells than this along any axis is tested against every source instead.
+        static const int MaxCellsPerAxis = 8;
+
+        explicit Internals(float cellSize) : cellSize(cellSize > 0 ? cellSize : 1.f) { }
+
+        const float cellSize;
+        std::atomic<float> movementThreshold{ 0.01f };
+        std::atomic<uint64_t> revision{ 1 };
+
+        mutable std::mutex mutex;
+        std::map<int, Entry> entries;
+        std::unordered_map<uint64_t, std::vector<Entry *>> cells;
+        std::vector<Entry *> large;
+
+        // Stamps the occluders already tested by a query, which may meet them in several cells.
+        mutable uint32_t visit = 0;
+
+        int cellCoordinate(float v) const
+        {
+            const float limit = float(1 << 20);
+            return static_cast<int>(std::max(-limit, std::min(limit - 1, std::floor(v / cellSize))));
+        }
+
+        static uint64_t cellKey(int x, int y, int z)
+        {
+            const uint64_t mask = (1u << 21) - 1;
+            return ((uint64_t(x) & mask) << 42) | ((uint64_t(y) & mask) << 21) | (uint64_t(z) & mask);
+        }
+
+        void insert(Entry & e)
+        {
+            const Occluder & o = e.occluder;
+            const float center[3] = { o.x, o.y, o.z };
+            e.isLarge = false;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                e.lower[axis] = cellCoordinate(center[axis] - o.outerRadius);
+                e.upper[axis] = cellCoordinate(center[axis] + o.outerRadius);
+                e.isLarge |= e.upper[axis] - e.lower[axis] >= MaxCellsPerAxis;
+            }
+
+            if (e.isLarge)
+            {
+                large.push_back(&e);
+                return;
+            }
+
+            for (int x = e.lower[0]; x <= e.upper[0]; ++x)
+                for (int y = e.lower[1]; y <= e.upper[1]; ++y)
+                    for (int z = e.lower[2]; z <= e.upper[2]; ++z)
+                        cells[cellKey(x, y, z)].push_back(&e);
+        }
+
+        void erase(Entry & e)
+        {
+            if (e.isLarge)
+            {
+                large.erase(std::find(large.begin(), large.end(), &e));
+                return;
+            }
+
+            for (int x = e.lower[0]; x <= e.upper[0]; ++x)
+                for (int y = e.lower[1]; y <= e.upper[1]; ++y)
+                    for (int z = e.lower[2]; z <= e.upper[2]; ++z)
+                    {
+                        auto cell = cells.find(cellKey(x, y, z));
+                        if (cell == cells.end())
+                            continue;
+                        cell->second.erase(std::find(cell->second.begin(), cell->second.end(), &e));
+                        if (cell->second.empty())
+                            cells.erase(cell);
+                    }
+        }
+
+        float occlusion(const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos) const
+        {
+            if (++visit == 0)
+            {
+                for (auto & i : entries)
+                    i.second.visit = 0;
+                visit = 1;
+            }
+
+            float occlusionAttenuation = 1.0f;
+            auto test = [&](Entry * e)
+            {
+                if (e->visit == visit)
+                    return;
+                e->visit = visit;
+                occlusionAttenuation *= attenuation(e->occluder, sourcePos, listenerPos);
+            };
+
+            for (Entry * e : large)
+                test(e);
+
+            // Walk the cells crossed by the line from the listener to the source. The point of the line nearest an
+            // occluder near enough to attenuate it is within the occluder's outer radius, and so in one of its cells.
+            int cell[3] = { cellCoordinate(listenerPos.x), cellCoordinate(listenerPos.y), cellCoordinate(listenerPos.z) };
+            const int last[3] = { cellCoordinate(sourcePos.x), cellCoordinate(sourcePos.y), cellCoordinate(sourcePos.z) };
+            const FloatPoint3D direction = sourcePos - listenerPos;
+
+            int step[3];
+            float tMax[3];
+            float tDelta[3];
+            int remaining = 0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float d = direction[axis];
+                step[axis] = d > 0 ? 1 : (d < 0 ? -1 : 0);
+                if (step[axis])
+                {
+                    const float boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cellSize;
+                    tMax[axis] = (boundary - listenerPos[axis]) / d;
+                    tDelta[axis] = cellSize / std::fabs(d);
+                }
+                else
+                {
+                    tMax[axis] = std::numeric_limits<float>::infinity();
+                    tDelta[axis] = std::numeric_limits<float>::infinity();
+                }
+                remaining += std::abs(last[axis] - cell[axis]);
+            }
+
+            for (;;)
+            {
+                auto found = cells.find(cellKey(cell[0], cell[1], cell[2]));
+                if (found != cells.end())
+                    for (Entry * e : found->second)
+                        test(e);
+
+                if (remaining-- <= 0)
+                    break;
+
+                int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+                if (!(tMax[axis] <= 1.f))
+                    break;
+                cell[axis] += step[axis];
+                tMax[axis] += tDelta[axis];
+            }
+
+            return occlusionAttenuation;
+        }
+    };
+
+    Occluders::Occluders(float cellSize)
+    : m_internal(new Internals(cellSize))
+    {
+    }
+
+    Occluders::~Occluders()
+    {
+    }
+
     void Occluders::setOccluder(int id, float x, float y, float z, float radius)
     {
+        std::lock_guard<std::mutex> lock(m_internal->mutex);
+
         Occluder o(x, y, z, radius);
-        occluders[id] = o;
+        auto i = m_internal->entries.find(id);
+        if (i != m_internal->entries.end())
+        {
+            const Occluder & placed = i->second.occluder;
+            const float moved = magnitude(FloatPoint3D(x, y, z) - FloatPoint3D(placed.x, placed.y, placed.z));
+            if (placed.outerRadius == o.outerRadius && moved <= m_internal->movementThreshold)
+                return;
+
+            m_internal->erase(i->second);
+        }
+
+        Internals::Entry & e = m_internal->entries[id];
+        e.occluder = o;
+        m_internal->insert(e);
+        ++m_internal->revision;
     }
     
     void Occluders::removeOccluder(int id)
     {
-        auto i = occluders.find(id);
-        if (i != occluders.end())
-            occluders.erase(i);
+        std::lock_guard<std::mutex> lock(m_internal->mutex);
+
+        auto i = m_internal->entries.find(id);
+        if (i != m_internal->entries.end())
+        {
+            m_internal->erase(i->second);
+            m_internal->entries.erase(i);
+            ++m_internal->revision;
+        }
     }
     
     float Occluders::occlusion(const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos) const
     {
-        float occlusionAttenuation = 1.0f;
-        for (auto i : occluders)
-        {
-            FloatPoint3D occPos(i.second.x, i.second.y, i.second.z);
-            
-            float t;
-            float d = distanceFromPointToLine(occPos, listenerPos, sourcePos, t);
-            
-            if (t <= 0 || t >= 1)
-                continue;
+        std::lock_guard<std::mutex> lock(m_internal->mutex);
+        return m_internal->occlusion(sourcePos, listenerPos);
+    }
 
-            //printf("param(%f), dist: %f\n", t, d);
-            float maxAtten = i.second.maxAttenuation;
-            
-            if (d <= i.second.innerRadius)
-            {
-                occlusionAttenuation *= maxAtten;
-            }
-            else if (d <= i.second.outerRadius)
-            {
-                float inner = i.second.innerRadius;
-                float t = (d - inner) / (i.second.outerRadius - inner);
-                occlusionAttenuation *= maxAtten + (1.0f - maxAtten) * t;
-            }
-        }
-        return occlusionAttenuation;
+    bool Occluders::tryOcclusion(const FloatPoint3D & sourcePos, const FloatPoint3D & listenerPos, float * result) const
+    {
+        std::unique_lock<std::mutex> lock(m_internal->mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return false;
+
+        *result = m_internal->occlusion(sourcePos, listenerPos);
+        return true;
+    }
+
+    void Occluders::setMovementThreshold(float distance)
+    {
+        m_internal->movementThreshold = std::max(0.f, distance);
+    }
+
+    float Occluders::movementThreshold() const
+    {
+        return m_internal->movementThreshold;
+    }
+
+    uint64_t Occluders::revision() const
+    {
+        return m_internal->revision;
     }
     
     // @tofix - pass in HRTF loader path
@@ -88,17 +310,40 @@ namespace lab
         
         AudioListener & listener = r.context()->listener();
 
-        FloatPoint3D fwd = {
-            listener.forwardX()->value(r),
-            listener.forwardY()->value(r),
-            listener.forwardZ()->value(r) };
+        FloatPoint3D listenerPos = {
+            listener.positionX()->value(r),
+            listener.positionY()->value(r),
+            listener.positionZ()->value(r) };
 
         FloatPoint3D pos = {
             positionX()->value(r),
             positionY()->value(r),
             positionZ()->value(r) };
 
-        float occlusionAttenuation = occluders ? occluders->occlusion(pos, fwd) : 1.0f;
-        return occlusionAttenuation * PannerNode::distanceConeGain(r);
+        if (!occluders)
+        {
+            m_occlusion = 1.f;
+            m_occlusionOccluders = nullptr;
+        }
+        else
+        {
+            const uint64_t revision = occluders->revision();
+            const float threshold = occluders->movementThreshold();
+            bool isStale = occluders.get() != m_occlusionOccluders || revision != m_occlusionRevision
+                || magnitude(pos - m_occlusionSource) > threshold || magnitude(listenerPos - m_occlusionListener) > threshold;
+
+            // While the occluders are being edited, the last occlusion found is kept for another quantum.
+            float occlusion;
+            if (isStale && occluders->tryOcclusion(pos, listenerPos, &occlusion))
+            {
+                m_occlusion = occlusion;
+                m_occlusionSource = pos;
+                m_occlusionListener = listenerPos;
+                m_occlusionOccluders = occluders.get();
+                m_occlusionRevision = revision;
+            }
+        }
+
+        return m_occlusion * PannerNode::distanceConeGain(r);
     }
 }
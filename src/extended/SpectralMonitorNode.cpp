@@ -10,7 +10,10 @@
 
 #include "LabSound/extended/SpectralMonitorNode.h"
 
-#include <ooura/fftsg.h>
+#include "internal/FFTFrame.h"
+#include "internal/SharedSpectrum.h"
+
+#include <algorithm>
 #include <cmath>
 
 namespace lab 
@@ -18,80 +21,48 @@ namespace lab
 
     using namespace lab;
 
-    //////////////////////////////////////////////////////
-    // Prviate FFT + SpectralMonitorNode Implementation //
-    //////////////////////////////////////////////////////
-
-    // FFT class directly inspired by that in Cinder Audio 2.
-    struct FFT 
-    {
-    public:
-        FFT(size_t size) : size(size)
-        {
-            oouraIp = (int *)calloc( 2 + (int)sqrt( size/2 ), sizeof( int ) );
-            oouraW = (float *)calloc( size/2, sizeof( float ) );
-        }
-
-        ~FFT()
-        {
-            free(oouraIp);
-            free(oouraW);
-        }
-
-        // does an in place transform of waveform to real and imag.
-        // real values are on even, imag on odd
-        void forward( std::vector<float>& waveform)
-        {
-            ooura::rdft( static_cast<int>(size), 1, &waveform[0], oouraIp, oouraW );
-        }
-
-        size_t size;
-        int * oouraIp;
-        float * oouraW;
-    };
-
     class SpectralMonitorNode::SpectralMonitorNodeInternal 
     {
     public:
 
         SpectralMonitorNodeInternal() 
         : windowSize(std::make_shared<AudioSetting>("windowSize"))
-        , fft(nullptr)
         {
             setWindowSize(512);
         }
 
-        ~SpectralMonitorNodeInternal() 
+        void setWindowSize(size_t s) 
         {
-            delete fft;
-        }
-
-        void setWindowSize(int s) 
-        {
-            cursor = 0;
-            windowSize->setUint32(static_cast<size_t>(s));
+            std::lock_guard<std::recursive_mutex> lock(magMutex);
 
-            buffer.resize(s);
+            windowSize->setUint32(static_cast<uint32_t>(s));
 
-            for (size_t i = 0; i < s; ++i) 
-            {
-                buffer[i] = 0;
-            }
+            // The windows don't overlap, and the FFT is the window's size, rounded up to a power of two. The
+            // source is found when the node renders.
+            spectrum = SharedSpectrum::acquire({ nullptr, lab::window_blackman, s, s, AudioNode::ProcessingSizeInFrames });
+            magnitudes.assign(spectrum->fftSize() / 2, 0.f);
+        }
 
-            delete fft;
-            fft = new FFT(s);
+        // Called from the shared spectrum with each window's spectrum, of the input's channels averaged, where
+        // this node reports the spectrum of their sum.
+        void storeMagnitudes(FFTFrame & frame, float scale)
+        {
+            // similar to cinder audio2 Scope object, although Scope smooths spectral samples frame by frame
+            // remove nyquist component, packed into the first imaginary component
+            const float * realP = frame.realData();
+            const float * imagP = frame.imagData();
+            magnitudes[0] = std::fabs(realP[0]) * scale;
+            for (size_t i = 1; i < magnitudes.size(); ++i)
+                magnitudes[i] = std::sqrt(realP[i] * realP[i] + imagP[i] * imagP[i]) * scale;
         }
-        
-        float _db;
 
-        size_t cursor;
+        // Shared with other analysers of the same source with the same window and hop.
+        std::shared_ptr<SharedSpectrum> spectrum;
 
-        std::vector<float> buffer;
+        std::vector<float> magnitudes;
         std::recursive_mutex magMutex;
 
         std::shared_ptr<AudioSetting> windowSize;
-
-        FFT * fft;
     };
 
     ////////////////////////////////
@@ -134,49 +105,22 @@ namespace lab
 
         // specific to this node
         {
-            std::vector<const float*> channels;
-            size_t numberOfChannels = bus->numberOfChannels();
-            for (size_t c = 0; c < numberOfChannels; ++ c)
-                channels.push_back(bus->channel(c)->data());
-
-            size_t sz = internalNode->windowSize->valueUint32();
-
-            // if the fft is smaller than the quantum, just grab a chunk
-            if (sz < framesToProcess) 
-            {
-                internalNode->cursor = 0;
-                framesToProcess = internalNode->windowSize->valueUint32();
-            }
-
-            // if the quantum overlaps the end of the window, just fill up the buffer
-            if (internalNode->cursor + framesToProcess > sz)
-                framesToProcess = sz - internalNode->cursor;
+            std::lock_guard<std::recursive_mutex> lock(internalNode->magMutex);
 
+            // Taking the spectrum, when the source or the render quantum changes, is the only time the audio
+            // thread allocates.
+            std::shared_ptr<SharedSpectrum> & spectrum = internalNode->spectrum;
+            SharedSpectrum::Key key = spectrum->key();
+            key.source = SharedSpectrum::sourceOf(r, input(0).get());
+            key.quantumSize = r.context()->renderQuantumSize();
+            if (key != spectrum->key())
+                spectrum = SharedSpectrum::acquire(key);
+
+            const float scale = static_cast<float>(bus->numberOfChannels());
+            spectrum->analyse(r, *bus, framesToProcess, [this, scale](FFTFrame & frame, const float *, uint64_t)
             {
-                std::lock_guard<std::recursive_mutex> lock(internalNode->magMutex);
-
-                internalNode->buffer.resize(sz);
-
-                for (size_t i = 0; i < framesToProcess; ++i) 
-                {
-                    internalNode->buffer[i + internalNode->cursor] = 0;
-                }
-
-                for (unsigned c = 0; c < numberOfChannels; ++c)
-                {
-                    for (size_t i = 0; i < framesToProcess; ++i) 
-                    {
-                        float p = channels[c][i];
-                        internalNode->buffer[i + internalNode->cursor] += p;
-                    }
-                }
-
-            }
-
-            // advance the cursor
-            internalNode->cursor += framesToProcess;
-            if (internalNode->cursor >= internalNode->windowSize->valueUint32())
-                internalNode->cursor = 0;
+                internalNode->storeMagnitudes(frame, scale);
+            });
         }
         // to here
 
@@ -193,35 +137,11 @@ namespace lab
         internalNode->setWindowSize(internalNode->windowSize->valueUint32());
     }
 
+    // The magnitude spectrum of the last complete window.
     void SpectralMonitorNode::spectralMag(std::vector<float>& result) 
     {
-        std::vector<float> window;
-
-        {
-            std::lock_guard<std::recursive_mutex> lock(internalNode->magMutex);
-            window.swap(internalNode->buffer);
-            internalNode->setWindowSize(internalNode->windowSize->valueUint32());
-        }
-
-        // http://www.ni.com/white-paper/4844/en/
-        applyWindow(lab::window_blackman, window);
-        internalNode->fft->forward(window);
-
-        // similar to cinder audio2 Scope object, although Scope smooths spectral samples frame by frame
-        // remove nyquist component - the first imaginary component
-        window[1] = 0.0f;
-
-        // compute normalized magnitude spectrum
-        // @tofix - break this into vector cartisian -> polar and then vector lowpass. skip lowpass if smoothing factor is very small
-        const float kMagScale = 1.0f ;/// detail->windowSize;
-        for(size_t i = 0; i < window.size(); i += 2)
-        {
-            float re = window[i];
-            float im = window[i+1];
-            window[i/2] = sqrt(re * re + im * im) * kMagScale;
-        }
-
-        result.swap(window);
+        std::lock_guard<std::recursive_mutex> lock(internalNode->magMutex);
+        result.assign(internalNode->magnitudes.begin(), internalNode->magnitudes.end());
     }
 
     void SpectralMonitorNode::windowSize(size_t ws) 
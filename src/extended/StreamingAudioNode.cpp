@@ -0,0 +1,263 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/StreamingAudioNode.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/AudioSetting.h"
+#include "LabSound/core/AudioSourceProvider.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Assertions.h"
+#include "internal/AudioFileStream.h"
+#include "internal/MultiChannelResampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace lab {
+
+namespace
+{
+    const float DefaultReadAhead = 0.5f;
+}
+
+// Reads the stream for the resampler, filling with silence what the stream doesn't have.
+class StreamingAudioNode::StreamProvider : public AudioSourceProvider
+{
+public:
+
+    explicit StreamProvider(AudioFileStream & stream) : m_stream(stream), m_channels(stream.format().numberOfChannels) { }
+
+    virtual void provideInput(AudioBus * bus, size_t framesToProcess) override
+    {
+        const unsigned numberOfChannels = std::min(static_cast<unsigned>(bus->numberOfChannels()), static_cast<unsigned>(m_channels.size()));
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+            m_channels[c] = bus->channel(c)->mutableData();
+
+        const size_t frames = m_stream.read(m_channels.data(), numberOfChannels, framesToProcess);
+        for (unsigned c = 0; c < bus->numberOfChannels(); ++c)
+        {
+            float * channel = bus->channel(c)->mutableData();
+            const size_t start = c < numberOfChannels ? frames : 0;
+            std::fill(channel + start, channel + framesToProcess, 0.f);
+        }
+    }
+
+private:
+
+    AudioFileStream & m_stream;
+    std::vector<float *> m_channels;
+};
+
+StreamingAudioNode::StreamingAudioNode()
+    : AudioScheduledSourceNode()
+    , m_isLooping(std::make_shared<AudioSetting>("loop"))
+    , m_loopStart(std::make_shared<AudioSetting>("loopStart"))
+    , m_loopEnd(std::make_shared<AudioSetting>("loopEnd"))
+    , m_readAhead(std::make_shared<AudioSetting>("readAhead"))
+{
+    m_gain = make_shared<AudioParam>("gain", 1.0, 0.0, 1.0);
+    m_params.push_back(m_gain);
+
+    m_readAhead->setFloat(DefaultReadAhead, false);
+    m_isLooping->setValueChanged([this]() { updateLoop(); });
+    m_loopStart->setValueChanged([this]() { updateLoop(); });
+    m_loopEnd->setValueChanged([this]() { updateLoop(); });
+
+    m_settings.push_back(m_isLooping);
+    m_settings.push_back(m_loopStart);
+    m_settings.push_back(m_loopEnd);
+    m_settings.push_back(m_readAhead);
+
+    // Default to mono. A call to setFile() will set the number of output channels to that of the file.
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
+
+    initialize();
+}
+
+StreamingAudioNode::~StreamingAudioNode()
+{
+    uninitialize();
+}
+
+bool StreamingAudioNode::setFile(ContextRenderLock & r, const std::string & path)
+{
+    ASSERT(r.context());
+
+    m_resampler.reset();
+    m_provider.reset();
+    m_resampledBus.reset();
+    m_stream.reset();
+    m_latencyFrames = 0;
+    m_tailFrames = 0;
+
+    std::shared_ptr<AudioFileStream> stream = AudioFileStream::open(path, m_readAhead->valueFloat());
+    if (!stream)
+        return false;
+
+    const WaveFormat & format = stream->format();
+    if (format.numberOfChannels > r.context()->channelLimit())
+        return false;
+
+    output(0)->setNumberOfChannels(r, format.numberOfChannels);
+    m_channels.resize(format.numberOfChannels);
+
+    const float sampleRate = r.context()->sampleRate();
+    if (format.sampleRate != sampleRate)
+    {
+        // Pulled a quantum's worth at a time, so as to buffer little more than needed.
+        const size_t quantum = r.context()->renderQuantumSize();
+        m_provider.reset(new StreamProvider(*stream));
+        m_resampler.reset(new MultiChannelResampler(static_cast<double>(format.sampleRate) / sampleRate, format.numberOfChannels, quantum));
+        m_resampledBus.reset(new AudioBus(format.numberOfChannels, quantum, false));
+        m_latencyFrames = static_cast<size_t>(std::ceil(m_resampler->latencyFrames() * sampleRate / format.sampleRate));
+    }
+
+    m_stream = stream;
+    updateLoop();
+    m_stream->start();
+    return true;
+}
+
+void StreamingAudioNode::process(ContextRenderLock & r, size_t framesToProcess)
+{
+    AudioBus * outputBus = output(0)->bus(r);
+
+    if (!m_stream || !isInitialized() || !r.context())
+    {
+        outputBus->zero();
+        return;
+    }
+
+    size_t quantumFrameOffset;
+    size_t nonSilentFramesToProcess;
+
+    if (!updateSchedulingInfo(r, framesToProcess, outputBus, quantumFrameOffset, nonSilentFramesToProcess))
+        return;
+
+    const unsigned numberOfChannels = static_cast<unsigned>(outputBus->numberOfChannels());
+    if (m_channels.size() < numberOfChannels)
+    {
+        outputBus->zero();
+        return;
+    }
+
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+        m_channels[c] = outputBus->channel(c)->mutableData() + quantumFrameOffset;
+
+    if (m_resampler)
+    {
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+            m_resampledBus->setChannelMemory(c, m_channels[c], nonSilentFramesToProcess);
+        m_resampler->process(m_provider.get(), m_resampledBus.get(), nonSilentFramesToProcess);
+    }
+    else
+    {
+        const size_t frames = m_stream->read(m_channels.data(), numberOfChannels, nonSilentFramesToProcess);
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+            std::fill(m_channels[c] + frames, m_channels[c] + nonSilentFramesToProcess, 0.f);
+    }
+
+    outputBus->copyWithGainFrom(*outputBus, &m_lastGain, gain()->value(r));
+    outputBus->clearSilentFlag();
+
+    // The resampler holds back the last of the stream, which is played out before the node finishes.
+    const bool hasEnded = m_stream->hasEnded();
+    if (hasEnded)
+        m_tailFrames -= std::min(m_tailFrames, nonSilentFramesToProcess);
+    else
+        m_tailFrames = m_latencyFrames;
+
+    if (hasEnded && !m_tailFrames)
+        finish(r);
+}
+
+void StreamingAudioNode::reset(ContextRenderLock & r)
+{
+    m_lastGain = gain()->value(r);
+    m_tailFrames = m_latencyFrames;
+    AudioScheduledSourceNode::reset(r);
+}
+
+float StreamingAudioNode::duration() const
+{
+    if (!m_stream)
+        return 0;
+    const WaveFormat & format = m_stream->format();
+    return static_cast<float>(format.frameCount / format.sampleRate);
+}
+
+void StreamingAudioNode::seek(double seconds)
+{
+    if (!m_stream)
+        return;
+
+    m_stream->seek(static_cast<uint64_t>(std::max(0.0, seconds) * m_stream->format().sampleRate));
+}
+
+void StreamingAudioNode::updateLoop()
+{
+    if (!m_stream)
+        return;
+
+    const double sampleRate = m_stream->format().sampleRate;
+    m_stream->setLoop(loop(), static_cast<uint64_t>(std::max(0.0, loopStart()) * sampleRate), static_cast<uint64_t>(std::max(0.0, loopEnd()) * sampleRate));
+}
+
+bool StreamingAudioNode::loop() const
+{
+    return m_isLooping->valueUint32() != 0;
+}
+
+void StreamingAudioNode::setLoop(bool loop)
+{
+    m_isLooping->setUint32(loop ? 1 : 0);
+}
+
+double StreamingAudioNode::loopStart() const
+{
+    return m_loopStart->valueFloat();
+}
+
+double StreamingAudioNode::loopEnd() const
+{
+    return m_loopEnd->valueFloat();
+}
+
+void StreamingAudioNode::setLoopStart(double loopStart)
+{
+    m_loopStart->setFloat(static_cast<float>(loopStart));
+}
+
+void StreamingAudioNode::setLoopEnd(double loopEnd)
+{
+    m_loopEnd->setFloat(static_cast<float>(loopEnd));
+}
+
+double StreamingAudioNode::readAhead() const
+{
+    return m_readAhead->valueFloat();
+}
+
+void StreamingAudioNode::setReadAhead(double seconds)
+{
+    m_readAhead->setFloat(static_cast<float>(seconds));
+}
+
+uint64_t StreamingAudioNode::underrunCount() const
+{
+    return m_stream ? m_stream->underrunCount() : 0;
+}
+
+bool StreamingAudioNode::propagatesSilence(ContextRenderLock & r) const
+{
+    return !isPlayingOrScheduled() || hasFinished() || !m_stream;
+}
+
+} // namespace lab
@@ -1,16 +1,17 @@
 // License: BSD 2 Clause
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
-#include "LabSound/core/OscillatorNode.h"
-#include "LabSound/core/AudioNodeInput.h"
 #include "LabSound/core/AudioNodeOutput.h"
 #include "LabSound/core/AudioBus.h"
 
 #include "LabSound/extended/SupersawNode.h"
 #include "LabSound/extended/ADSRNode.h"
 #include "LabSound/extended/AudioContextLock.h"
+#include "LabSound/extended/OscillatorBankNode.h"
 
+#include <algorithm>
 #include <cfloat>
+#include <vector>
 
 using namespace lab;
 
@@ -25,12 +26,17 @@ namespace lab
     {
     public:
 
-        SupersawNodeInternal() : cachedDetune(FLT_MAX), cachedFrequency(FLT_MAX)
+        SupersawNodeInternal() : cachedDetune(FLT_MAX), cachedSawCount(0)
         {
             gainNode = std::make_shared<ADSRNode>();
-            sawCount = std::make_shared<AudioParam>("sawCount", 1.0, 100.0f, 3.0f);
+            sawCount = std::make_shared<AudioParam>("sawCount", 1.0, 1.0f, 100.0f);
             detune = std::make_shared<AudioParam>("detune", 1.0, 0, 120);
-            frequency= std::make_shared<AudioParam>("frequency", 440.0, 1.0f, sampleRate * 0.5f);
+
+            saws = std::make_shared<OscillatorBankNode>();
+            saws->setType(OscillatorType::SAWTOOTH);
+            saws->start(0);
+
+            detunes.reserve(OscillatorBankNode::ReservedVoices);
         }
 
         ~SupersawNodeInternal()
@@ -38,78 +44,37 @@ namespace lab
 
         }
 
+        // Spreads the saws evenly across the detune, in cents either side of the frequency.
         void update(ContextRenderLock & r)
         {
-            if (cachedFrequency != frequency->value(r))
-            {
-                cachedFrequency = frequency->value(r);
-                for (auto i : saws)
-                {
-                    i->frequency()->setValue(cachedFrequency);
-                    i->frequency()->resetSmoothedValue();
-                }
-            }
-
-            if (cachedDetune != detune->value(r))
-            {
-                cachedDetune = detune->value(r);
-                float n = cachedDetune / ((float) saws.size() - 1.0f);
-                for (size_t i = 0; i < saws.size(); ++i)
-                {
-                    saws[i]->detune()->setValue(-cachedDetune + float(i) * 2 * n);
-                }
-            }
-        }
-
-        void update(ContextRenderLock & r, bool okayToReallocate)
-        {
-            size_t currentN = saws.size();
-            int n = int(sawCount->value(r) + 0.5f);
-
-            auto context = r.context();
-
-            if (okayToReallocate && (n != currentN))
-            {
-                for (auto i : sawStorage)
-                {
-                    // r.context()->disconnect(i); // dimitri
-                    context->disconnect(i, nullptr);
-                }
-
-                sawStorage.clear();
-                saws.clear();
+            int n = std::max(1, int(sawCount->value(r) + 0.5f));
+            float spread = detune->value(r);
+            if (n == cachedSawCount && spread == cachedDetune)
+                return;
 
-                for (int i = 0; i < n; ++i) sawStorage.emplace_back(std::make_shared<OscillatorNode>(sampleRate));
+            cachedSawCount = n;
+            cachedDetune = spread;
 
-                for (int i = 0; i < n; ++i) saws.push_back(sawStorage[i].get());
+            detunes.resize(n);
+            for (int i = 0; i < n; ++i)
+                detunes[i] = n > 1 ? -spread + float(i) * 2 * spread / float(n - 1) : 0;
 
-                for (auto i : sawStorage)
-                {
-                    i->setType(OscillatorType::SAWTOOTH);
-                    context->connect(gainNode, i, 0, 0);
-                    i->start(0);
-                }
-
-                cachedFrequency = FLT_MAX;
-                cachedDetune = FLT_MAX;
-            }
-
-            update(r);
+            saws->setVoices(r, detunes);
         }
 
         std::shared_ptr<ADSRNode> gainNode;
+        std::shared_ptr<OscillatorBankNode> saws;
         std::shared_ptr<AudioParam> detune;
-        std::shared_ptr<AudioParam> frequency;
         std::shared_ptr<AudioParam> sawCount;
 
+        bool isConnected{ false };
+
     private:
 
-        float sampleRate;
         float cachedDetune;
-        float cachedFrequency;
+        int cachedSawCount;
 
-        std::vector<std::shared_ptr<OscillatorNode>> sawStorage;
-        std::vector<OscillatorNode * > saws;
+        std::vector<float> detunes;
     };
 
     //////////////////////////
@@ -121,10 +86,9 @@ namespace lab
         internalNode.reset(new SupersawNodeInternal());
 
         m_params.push_back(internalNode->detune);
-        m_params.push_back(internalNode->frequency);
+        m_params.push_back(internalNode->saws->frequency());
         m_params.push_back(internalNode->sawCount);
 
-        addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
         addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
 
         initialize();
@@ -141,21 +105,29 @@ namespace lab
 
         AudioBus * outputBus = output(0)->bus(r);
 
-        if (!isInitialized() || !outputBus->numberOfChannels())
+        if (!isInitialized() || !outputBus->numberOfChannels() || !internalNode->isConnected)
         {
             outputBus->zero();
             return;
         }
 
-        AudioBus * inputBus = input(0)->bus(r);
+        // The saws render into the envelope, which is rendered here rather than by the graph.
+        ADSRNode & envelope = *internalNode->gainNode;
+        envelope.processIfNecessary(r, framesToProcess);
 
-        outputBus->copyFrom(*inputBus);
+        outputBus->copyFrom(*envelope.output(0)->bus(r));
         outputBus->clearSilentFlag();
     }
 
     void SupersawNode::update(ContextRenderLock & r)
     {
-        internalNode->update(r, true);
+        if (!internalNode->isConnected && r.context())
+        {
+            r.context()->connect(internalNode->gainNode, internalNode->saws, 0, 0);
+            internalNode->isConnected = true;
+        }
+
+        internalNode->update(r);
     }
 
     std::shared_ptr<AudioParam> SupersawNode::attack() const { return internalNode->gainNode->attackTime(); }
@@ -163,7 +135,7 @@ namespace lab
     std::shared_ptr<AudioParam> SupersawNode::sustain() const { return internalNode->gainNode->sustainLevel(); }
     std::shared_ptr<AudioParam> SupersawNode::release() const { return internalNode->gainNode->releaseTime(); }
     std::shared_ptr<AudioParam> SupersawNode::detune() const { return internalNode->detune; }
-    std::shared_ptr<AudioParam> SupersawNode::frequency() const { return internalNode->frequency; }
+    std::shared_ptr<AudioParam> SupersawNode::frequency() const { return internalNode->saws->frequency(); }
     std::shared_ptr<AudioParam> SupersawNode::sawCount() const { return internalNode->sawCount; }
 
     void SupersawNode::noteOn(double when)
@@ -178,7 +150,8 @@ namespace lab
 
     bool SupersawNode::propagatesSilence(ContextRenderLock & r) const
     {
-        return true; // return internalNode->gainNode->propagatesSilence(now); // dimitri 
+        // The envelope only starts a note as it renders, so can't be left dormant.
+        return !internalNode->isConnected;
     }
 
 } // End namespace lab
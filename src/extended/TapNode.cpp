@@ -0,0 +1,280 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+
+#include "LabSound/extended/AudioContextLock.h"
+#include "LabSound/extended/TapNode.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lab
+{
+
+    namespace
+    {
+        // A slot's state: being written, or the number of leases on its block.
+        const int32_t Writing = -1;
+    }
+
+    class TapNode::Ring
+    {
+    public:
+
+        struct Slot
+        {
+            std::atomic<int32_t> state{ 0 };
+
+            // Whether the block has been leased since it was written, for DropNewest.
+            std::atomic<bool> taken{ false };
+
+            // Written only in the Writing state, so stable while a lease is held.
+            uint64_t sequence{ 0 };
+            uint64_t droppedBefore{ 0 };
+            uint64_t sampleFrame{ 0 };
+            float sampleRate{ 0 };
+            size_t length{ 0 };
+            float * data{ nullptr };
+        };
+
+        Ring(int channels, size_t blockCount, OverflowPolicy policy, size_t blockFrames)
+            : channels(channels)
+            , blockCount(blockCount)
+            , blockFrames(blockFrames)
+            , policy(policy)
+            , slots(new Slot[blockCount])
+            , storage(blockCount * blockFrames * channels)
+        {
+            for (size_t i = 0; i < blockCount; ++i)
+                slots[i].data = storage.data() + i * blockFrames * channels;
+        }
+
+        Slot & slotFor(uint64_t sequence) { return slots[static_cast<size_t>((sequence - 1) % blockCount)]; }
+
+        // Render thread only. Returns false if the block was dropped.
+        bool write(const AudioBus & bus, size_t offset, size_t frames, uint64_t sampleFrame, float sampleRate)
+        {
+            const uint64_t sequence = latest.load(std::memory_order_relaxed) + 1;
+            Slot & slot = slotFor(sequence);
+
+            int32_t unleased = 0;
+            if (!slot.state.compare_exchange_strong(unleased, Writing, std::memory_order_acquire))
+                return drop();
+            if (policy == DropNewest && slot.sequence != 0 && !slot.taken.load(std::memory_order_relaxed))
+            {
+                slot.state.store(0, std::memory_order_release);
+                return drop();
+            }
+
+            const size_t busChannels = bus.numberOfChannels();
+            for (int c = 0; c < channels; ++c)
+            {
+                float * destination = slot.data + c * blockFrames;
+                if (static_cast<size_t>(c) < busChannels)
+                    std::memcpy(destination, bus.channel(c)->data() + offset, sizeof(float) * frames);
+                else
+                    std::memset(destination, 0, sizeof(float) * frames);
+            }
+            slot.sequence = sequence;
+            slot.droppedBefore = pendingDrops;
+            slot.sampleFrame = sampleFrame;
+            slot.sampleRate = sampleRate;
+            slot.length = frames;
+            slot.taken.store(false, std::memory_order_relaxed);
+            pendingDrops = 0;
+
+            slot.state.store(0, std::memory_order_release);
+            latest.store(sequence, std::memory_order_release);
+            return true;
+        }
+
+        bool drop()
+        {
+            ++pendingDrops;
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Any thread. Returns whether the lease was taken.
+        bool lease(uint64_t sequence)
+        {
+            if (sequence == 0)
+                return false;
+
+            Slot & slot = slotFor(sequence);
+            int32_t state = slot.state.load(std::memory_order_relaxed);
+            do
+            {
+                if (state == Writing)
+                    return false;
+            } while (!slot.state.compare_exchange_weak(state, state + 1, std::memory_order_acquire));
+
+            // Held, the block can't change, but it may already be another than the one asked for.
+            if (slot.sequence != sequence)
+            {
+                release(sequence);
+                return false;
+            }
+            slot.taken.store(true, std::memory_order_relaxed);
+            return true;
+        }
+
+        void release(uint64_t sequence)
+        {
+            slotFor(sequence).state.fetch_sub(1, std::memory_order_release);
+        }
+
+        const int channels;
+        const size_t blockCount;
+        const size_t blockFrames;
+        const OverflowPolicy policy;
+
+        std::unique_ptr<Slot[]> slots;
+        AudioFloatArray storage;
+
+        std::atomic<uint64_t> latest{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+        uint64_t pendingDrops{ 0 };
+    };
+
+    TapNode::Lease::Lease(Lease && other)
+        : m_ring(std::move(other.m_ring))
+        , m_slot(other.m_slot)
+    {
+    }
+
+    TapNode::Lease & TapNode::Lease::operator=(Lease && other)
+    {
+        if (this != &other)
+        {
+            reset();
+            m_ring = std::move(other.m_ring);
+            m_slot = other.m_slot;
+        }
+        return *this;
+    }
+
+    TapNode::Lease::~Lease()
+    {
+        reset();
+    }
+
+    void TapNode::Lease::reset()
+    {
+        if (m_ring)
+        {
+            m_ring->slots[m_slot].state.fetch_sub(1, std::memory_order_release);
+            m_ring.reset();
+        }
+    }
+
+    uint64_t TapNode::Lease::sequence() const { return m_ring ? m_ring->slots[m_slot].sequence : 0; }
+    uint64_t TapNode::Lease::droppedBefore() const { return m_ring ? m_ring->slots[m_slot].droppedBefore : 0; }
+    uint64_t TapNode::Lease::sampleFrame() const { return m_ring ? m_ring->slots[m_slot].sampleFrame : 0; }
+    float TapNode::Lease::sampleRate() const { return m_ring ? m_ring->slots[m_slot].sampleRate : 0; }
+    int TapNode::Lease::numberOfChannels() const { return m_ring ? m_ring->channels : 0; }
+    size_t TapNode::Lease::length() const { return m_ring ? m_ring->slots[m_slot].length : 0; }
+
+    const float * TapNode::Lease::channel(int c) const
+    {
+        if (!m_ring || c < 0 || c >= m_ring->channels)
+            return nullptr;
+        return m_ring->slots[m_slot].data + c * m_ring->blockFrames;
+    }
+
+    TapNode::TapNode(int channels, size_t blockCount, OverflowPolicy policy, size_t blockFrames)
+        : AudioBasicInspectorNode(2)
+        , m_ring(std::make_shared<Ring>(std::max(std::min(channels, static_cast<int>(AudioContext::maxChannelLimit)), 1),
+                                        std::max<size_t>(blockCount, 2), policy, std::max<size_t>(blockFrames, 1)))
+    {
+        addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+        addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
+
+        initialize();
+    }
+
+    TapNode::~TapNode()
+    {
+        uninitialize();
+    }
+
+    void TapNode::process(ContextRenderLock & r, size_t framesToProcess)
+    {
+        AudioBus * outputBus = output(0)->bus(r);
+
+        if (!isInitialized() || !input(0)->isConnected())
+        {
+            if (outputBus)
+                outputBus->zero();
+            return;
+        }
+
+        AudioBus * bus = input(0)->bus(r);
+        bool isBusGood = bus && (bus->numberOfChannels() > 0) && (bus->channel(0)->length() >= framesToProcess);
+
+        if (!isBusGood)
+        {
+            outputBus->zero();
+            return;
+        }
+
+        // A quantum longer than a block is published as several.
+        const uint64_t sampleFrame = r.context()->currentSampleFrame();
+        const float sampleRate = r.context()->sampleRate();
+        for (size_t offset = 0; offset < framesToProcess; offset += m_ring->blockFrames)
+        {
+            const size_t frames = std::min(framesToProcess - offset, m_ring->blockFrames);
+            m_ring->write(*bus, offset, frames, sampleFrame + offset, sampleRate);
+        }
+
+        // As with the RecorderNode, the input passes through unless it had to be mixed to the output's channels.
+        if (bus != outputBus)
+            outputBus->copyFrom(*bus);
+    }
+
+    void TapNode::reset(ContextRenderLock &)
+    {
+        // The blocks keep their numbers across a reset, so consumers' cursors stay good.
+    }
+
+    uint64_t TapNode::latestSequence() const
+    {
+        return m_ring->latest.load(std::memory_order_acquire);
+    }
+
+    TapNode::Lease TapNode::acquire(uint64_t sequence)
+    {
+        if (!m_ring->lease(sequence))
+            return Lease();
+        return Lease(m_ring, static_cast<size_t>((sequence - 1) % m_ring->blockCount));
+    }
+
+    TapNode::Lease TapNode::acquireNext(uint64_t & sequence)
+    {
+        const uint64_t latest = latestSequence();
+        const uint64_t oldest = latest > m_ring->blockCount ? latest - m_ring->blockCount + 1 : 1;
+
+        // A block found overwritten, or being written, is skipped for the next.
+        for (uint64_t s = std::max(sequence, oldest); s <= latest; ++s)
+        {
+            Lease lease = acquire(s);
+            if (lease)
+            {
+                sequence = s + 1;
+                return lease;
+            }
+        }
+        return Lease();
+    }
+
+    uint64_t TapNode::droppedBlockCount() const
+    {
+        return m_ring->dropped.load(std::memory_order_relaxed);
+    }
+
+} // end namespace lab
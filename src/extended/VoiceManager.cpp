@@ -0,0 +1,126 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/VoiceManager.h"
+
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioListener.h"
+#include "LabSound/core/AudioParam.h"
+#include "LabSound/core/GainNode.h"
+#include "LabSound/core/PannerNode.h"
+#include "LabSound/core/SampledAudioNode.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lab
+{
+
+VoiceManager::VoiceManager(AudioContext & context, size_t maxVoices)
+    : m_context(context)
+    , m_maxVoices(maxVoices)
+{
+}
+
+VoiceManager::~VoiceManager()
+{
+    for (Voice & voice : m_voices)
+        if (std::shared_ptr<SampledAudioNode> source = voice.source.lock())
+            source->setVirtualized(false);
+}
+
+size_t VoiceManager::addGroup(size_t maxVoices, std::shared_ptr<GainNode> bus)
+{
+    Group group;
+    group.maxVoices = maxVoices;
+    group.bus = bus;
+    m_groups.push_back(group);
+    return m_groups.size() - 1;
+}
+
+void VoiceManager::addVoice(size_t group, std::shared_ptr<SampledAudioNode> source, std::shared_ptr<PannerNode> panner, int priority)
+{
+    if (!source || group >= m_groups.size())
+        return;
+
+    Voice voice;
+    voice.source = source;
+    voice.panner = panner;
+    voice.group = group;
+    voice.priority = priority;
+    m_voices.push_back(voice);
+}
+
+void VoiceManager::update()
+{
+    m_voices.erase(std::remove_if(m_voices.begin(), m_voices.end(), [](const Voice & voice) {
+        std::shared_ptr<SampledAudioNode> source = voice.source.lock();
+        return !source || source->hasFinished();
+    }), m_voices.end());
+
+    AudioListener & listener = m_context.listener();
+    const float listenerX = listener.positionX()->smoothedValue();
+    const float listenerY = listener.positionY()->smoothedValue();
+    const float listenerZ = listener.positionZ()->smoothedValue();
+
+    std::vector<float> busGains(m_groups.size(), 1.f);
+    for (size_t g = 0; g < m_groups.size(); ++g)
+    {
+        if (std::shared_ptr<GainNode> bus = m_groups[g].bus.lock())
+            busGains[g] = bus->gain()->smoothedValue();
+        m_groups[g].real = 0;
+    }
+
+    // Held until the update is done, since they are only referred to weakly.
+    std::vector<std::shared_ptr<SampledAudioNode>> sources(m_voices.size());
+
+    m_ranking.clear();
+    for (size_t i = 0; i < m_voices.size(); ++i)
+    {
+        Voice & voice = m_voices[i];
+        std::shared_ptr<SampledAudioNode> source = voice.source.lock();
+        if (!source)
+            continue;
+
+        sources[i] = source;
+        voice.loudness = std::fabs(source->gain()->smoothedValue() * busGains[voice.group]);
+
+        if (std::shared_ptr<PannerNode> panner = voice.panner.lock())
+        {
+            const float dx = panner->positionX()->smoothedValue() - listenerX;
+            const float dy = panner->positionY()->smoothedValue() - listenerY;
+            const float dz = panner->positionZ()->smoothedValue() - listenerZ;
+            voice.loudness *= panner->distanceGainAt(std::sqrt(dx * dx + dy * dy + dz * dz));
+        }
+
+        // Voices yet to be scheduled, or stopped, hold no place.
+        if (source->isPlayingOrScheduled())
+            m_ranking.push_back(i);
+    }
+
+    std::sort(m_ranking.begin(), m_ranking.end(), [this](size_t a, size_t b) {
+        const Voice & va = m_voices[a];
+        const Voice & vb = m_voices[b];
+        return va.priority != vb.priority ? va.priority > vb.priority : va.loudness > vb.loudness;
+    });
+
+    m_real = 0;
+    m_virtual = 0;
+    for (size_t i : m_ranking)
+    {
+        Voice & voice = m_voices[i];
+        Group & group = m_groups[voice.group];
+        const bool real = voice.loudness >= m_threshold && group.real < group.maxVoices && m_real < m_maxVoices;
+        if (real)
+        {
+            ++group.real;
+            ++m_real;
+        }
+        else
+            ++m_virtual;
+
+        sources[i]->setVirtualized(!real);
+    }
+}
+
+} // namespace lab
@@ -0,0 +1,38 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AlignedAllocation_h
+#define AlignedAllocation_h
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace lab {
+
+// Before C++17, new only aligns to alignof(std::max_align_t), short of the cache line alignment of the lock-free
+// queues' positions. A type holding them derives from AlignedAllocation<itself>, and new and delete of it pad
+// the block and align it by hand. The block's address is kept just before the object.
+template <typename T>
+struct AlignedAllocation
+{
+    static void * operator new(std::size_t size)
+    {
+        const std::size_t alignment = alignof(T) > alignof(void *) ? alignof(T) : alignof(void *);
+        void * block = ::operator new(size + alignment + sizeof(void *));
+        const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(block) + sizeof(void *);
+        void * object = reinterpret_cast<void *>((start + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1));
+        static_cast<void **>(object)[-1] = block;
+        return object;
+    }
+
+    static void operator delete(void * object)
+    {
+        if (object)
+            ::operator delete(static_cast<void **>(object)[-1]);
+    }
+};
+
+} // namespace lab
+
+#endif // AlignedAllocation_h
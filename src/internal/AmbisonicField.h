@@ -0,0 +1,82 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AmbisonicField_h
+#define AmbisonicField_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include "internal/Ambisonics.h"
+
+#include <atomic>
+#include <memory>
+
+namespace lab {
+
+class AudioBus;
+class ContextRenderLock;
+class HRTFDatabaseLoader;
+
+// The ambisonic field of the listener, into which PannerNodes using PanningMode::AMBISONIC encode their sources as the
+// graph is pulled. Once the graph has been rendered, the destination decodes the field to binaural and mixes it into its
+// output, so that however many sources there are, a render quantum costs one decode.
+// Both happen on the audio thread, though panners in a level of the schedule encode on the render workers at once; each
+// encode adds to an accumulator no other encode is using at the time, and the accumulators are summed as they're decoded.
+class AmbisonicField
+{
+public:
+
+    AmbisonicField();
+    ~AmbisonicField();
+
+    // Readies the field to decode with the loader's HRTF database, the first to be given being used for every source.
+    // Returns false until the database has been loaded and its decoding filters made; an offline context waits for them.
+    // Allocates once, when the decoder is made. While one caller prepares the field, the others are refused.
+    bool prepare(ContextRenderLock & r, const std::shared_ptr<HRTFDatabaseLoader> & loader);
+
+    // Adds a mono source to the field, with the AmbisonicChannels coefficients ramped linearly from fromCoefficients to
+    // toCoefficients over the frames. The field must have been prepared.
+    void encode(const float * source, const float * fromCoefficients, const float * toCoefficients, size_t framesToProcess);
+
+    // Decodes the field into the destination, adding to what is there, and clears it for the next render quantum.
+    void decode(ContextRenderLock & r, AudioBus * destination, size_t framesToProcess);
+
+    // The frames between a source being encoded and being heard.
+    size_t latencyFrames() const;
+
+private:
+
+    bool prepareDecoder(ContextRenderLock & r, const std::shared_ptr<HRTFDatabaseLoader> & loader);
+
+    // More encodes than this at once, which takes as many render workers, wait for an accumulator to come free.
+    static const int MaxAccumulators = 16;
+
+    struct Accumulator
+    {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        std::unique_ptr<AudioBus> field;
+        AudioFloatArray rampedSource; // i * source[i], for the coefficients' ramps
+        bool hasInput = false;        // whether anything has been encoded into it this render quantum
+    };
+
+    std::atomic<bool> m_prepared{ false };
+    std::atomic_flag m_preparing = ATOMIC_FLAG_INIT;
+
+    std::shared_ptr<HRTFDatabaseLoader> m_loader;
+    const AmbisonicDecoderFilters * m_filters = nullptr;
+    std::unique_ptr<PartitionedConvolver> m_convolver;
+
+    Accumulator m_accumulators[MaxAccumulators];
+    std::unique_ptr<AudioBus> m_field;
+    std::unique_ptr<AudioBus> m_decoded;
+
+    // i, for the coefficients' ramps.
+    AudioFloatArray m_frameIndices;
+
+    // The frames decoded since something was last encoded.
+    size_t m_silentFrames = 0;
+};
+
+} // namespace lab
+
+#endif // AmbisonicField_h
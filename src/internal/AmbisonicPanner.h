@@ -0,0 +1,50 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AmbisonicPanner_h
+#define AmbisonicPanner_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include "internal/Ambisonics.h"
+#include "internal/Panner.h"
+
+namespace lab
+{
+
+class HRTFDatabaseLoader;
+
+// Encodes its source into the listener's AmbisonicField rather than to its own output, which is left silent. The field
+// is decoded to binaural with the HRTF database of the first loader given to it.
+class AmbisonicPanner : public Panner
+{
+
+public:
+
+    AmbisonicPanner(const float sampleRate, std::shared_ptr<HRTFDatabaseLoader> loader);
+    virtual ~AmbisonicPanner();
+
+    // Panner; encodes with unity gain.
+    virtual void pan(ContextRenderLock & r, double azimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess) override;
+    virtual void reset() override { m_isFirstRender = true; }
+
+    // Encodes the input, attenuated by the gain. Returns false, having encoded nothing, until the listener's field can be decoded.
+    bool encode(ContextRenderLock & r, double azimuth, double elevation, float gain, const AudioBus * inputBus, size_t framesToProcess);
+
+    virtual double tailTime(ContextRenderLock & r) const override { return 0; }
+    virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+
+private:
+
+    std::shared_ptr<HRTFDatabaseLoader> m_databaseLoader;
+
+    // The gains of the last render quantum's end, from which the next one's are ramped.
+    float m_coefficients[AmbisonicChannels];
+    bool m_isFirstRender = true;
+
+    AudioFloatArray m_monoSource;
+};
+
+} // namespace lab
+
+#endif // AmbisonicPanner_h
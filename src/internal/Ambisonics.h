@@ -0,0 +1,64 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef Ambisonics_h
+#define Ambisonics_h
+
+#include "internal/PartitionedConvolver.h"
+
+#include <vector>
+
+namespace lab {
+
+class HRTFKernel;
+
+// The sound field of PanningMode::AMBISONIC sources is kept to third order, as ACN ordered channels with SN3D normalization.
+const unsigned AmbisonicOrder = 3;
+const unsigned AmbisonicChannels = (AmbisonicOrder + 1) * (AmbisonicOrder + 1);
+
+// Fills coefficients with the AmbisonicChannels gains which encode a source at the azimuth and elevation, in degrees,
+// as the PannerNode calculates them: positive azimuths are to the listener's right.
+void ambisonicCoefficients(double azimuth, double elevation, float * coefficients);
+
+// The responses which decode an ambisonic field to binaural, one per channel and ear. The field is decoded to virtual
+// speakers in the directions of a set of HRTF kernels, and each channel's response is the sum of the speakers' responses,
+// weighted by how much the channel feeds each of them, so that decoding costs one convolution per channel and ear
+// however many speakers there are.
+class AmbisonicDecoderFilters
+{
+public:
+
+    struct VirtualSpeaker
+    {
+        double azimuth;
+        double elevation;
+        HRTFKernel * kernelL;
+        HRTFKernel * kernelR;
+    };
+
+    // The speakers are expected to lie on rings of equal elevation, as the measurements of an HRTF database do; each ring
+    // stands for the band of the sphere halfway to its neighbours, and the lowest and highest for the rest of it.
+    // The responses are partitioned for convolution with the fftSize.
+    AmbisonicDecoderFilters(const std::vector<VirtualSpeaker> & speakers, size_t fftSize);
+
+    // The paths of a PartitionedConvolver with AmbisonicChannels inputs, and a left and a right output.
+    const std::vector<PartitionedConvolver::Path> & paths() const { return m_paths; }
+
+    size_t fftSize() const { return m_fftSize; }
+
+    // The number of frames the decoded output continues for after the field falls silent.
+    size_t tailFrames() const { return m_tailFrames; }
+
+private:
+
+    size_t m_fftSize;
+    size_t m_tailFrames;
+
+    // Indexed by channel * 2 + ear.
+    std::vector<PartitionedConvolver::Partitions> m_partitions;
+    std::vector<PartitionedConvolver::Path> m_paths;
+};
+
+} // namespace lab
+
+#endif // Ambisonics_h
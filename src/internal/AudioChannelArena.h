@@ -0,0 +1,40 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioChannelArena_h
+#define AudioChannelArena_h
+
+#include <cstddef>
+
+namespace lab {
+
+// AudioChannelArena supplies the sample memory of channels that manage their own storage. Buffers of up to
+// MaxFrames frames are rounded up to a power of two of at least MinFrames, and carved from contiguous,
+// cache line aligned slabs of their size class. A released buffer goes onto its class's free list and is
+// handed out again, so the channels of a graph's buses are created and destroyed without reaching the
+// system allocator once the slabs have been populated. Longer buffers, such as decoded files, are not pooled.
+//
+// The arena is shared by every context: nodes and their buses are created before they are added to a
+// context, and may outlive it. Slabs are never returned to the system.
+namespace AudioChannelArena
+{
+    const size_t MinFrames = 128;
+    const size_t MaxFrames = 4096;
+
+    // Returns zeroed storage for length frames, or nullptr if length isn't pooled.
+    // capacity receives the size of the buffer in frames, which has to be passed back to release().
+    // Safe to call from any thread.
+    float * acquire(size_t length, size_t & capacity);
+
+    // Returns a buffer obtained from acquire(). Safe to call from any thread.
+    void release(float * buffer, size_t capacity);
+
+    // The bytes of the slabs populated so far, and of the buffers currently acquired from them.
+    // Safe to call from any thread.
+    size_t bytesReserved();
+    size_t bytesInUse();
+}
+
+} // namespace lab
+
+#endif // AudioChannelArena_h
@@ -10,6 +10,7 @@
 namespace lab {
 
     class AudioDSPKernelProcessor;
+    class AudioMemoryUsage;
     
 // AudioDSPKernel does the processing for one channel of an AudioDSPKernelProcessor.
 
@@ -32,6 +33,9 @@ public:
     virtual double tailTime(ContextRenderLock & r) const = 0;
     virtual double latencyTime(ContextRenderLock & r) const = 0;
 
+    // Adds the memory the kernel allocated, see AudioNode::reportMemory().
+    virtual void reportMemory(AudioMemoryUsage &) const { }
+
 protected:
 
     AudioDSPKernelProcessor* m_kernelProcessor;
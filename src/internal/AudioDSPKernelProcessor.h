@@ -41,7 +41,22 @@ public:
     virtual double tailTime(ContextRenderLock & r) const override;
     virtual double latencyTime(ContextRenderLock & r) const override;
 
+    virtual void reportMemory(AudioMemoryUsage & usage) const override;
+
 protected:
+
+    // Called before the kernels run, on the thread processing the node. The kernels may then run on several
+    // threads at once, so whatever they share, such as the values of the processor's parameters for the quantum,
+    // is evaluated here for them to read.
+    virtual void prepareKernels(ContextRenderLock&, size_t framesToProcess) { }
+
+    // Whether the processor has enough channels to spread its kernels over the render workers, see
+    // AudioContext::setParallelKernelThreshold().
+    bool processesInParallel(ContextRenderLock&) const;
+
+    // Runs each kernel over its channel, in parallel if processesInParallel().
+    void processKernels(ContextRenderLock&, const AudioBus* source, AudioBus* destination, size_t framesToProcess);
+
     std::vector<std::unique_ptr<AudioDSPKernel> > m_kernels;
     bool m_hasJustReset;
 };
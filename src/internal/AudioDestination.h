@@ -5,6 +5,8 @@
 #ifndef AudioDestination_h
 #define AudioDestination_h
 
+#include "LabSound/core/AudioDeviceSettings.h"
+
 namespace lab {
 
 struct AudioIOCallback;
@@ -15,7 +17,10 @@ struct AudioIOCallback;
 struct AudioDestination
 {
     //@tofix - web audio puts the input initialization on the destination as well. I'm not sure that makes sense.
-    static AudioDestination * MakePlatformAudioDestination(AudioIOCallback &, size_t numberOfOutputChannels, float sampleRate);
+    // framesPerBuffer is the render quantum size of the context; the hardware is asked for buffers of that size.
+    // settings choose among the platform's backends, and configure the one chosen.
+    static AudioDestination * MakePlatformAudioDestination(AudioIOCallback &, size_t numberOfOutputChannels, float sampleRate, size_t framesPerBuffer,
+                                                           const AudioDeviceSettings & settings);
 
     virtual ~AudioDestination() { }
 
@@ -25,6 +30,20 @@ struct AudioDestination
     // Sample-rate conversion may happen in AudioDestination to the hardware sample-rate
     virtual float sampleRate() const = 0;
 
+    // The seconds by which the graph renders ahead of the frames handed to the hardware, for what the destination
+    // buffers and converts between them.
+    virtual double baseLatency() const { return 0; }
+
+    // The seconds the hardware holds a frame before it's played, such as the device's buffer, where known.
+    virtual double outputLatency() const { return 0; }
+
+    // The seconds between a frame arriving at the hardware's input and its being handed to the graph, where known.
+    virtual double inputLatency() const { return 0; }
+
+    // The seconds between a frame arriving at the input and the graph's response to it being played. A backend
+    // that only knows the total of its stream's buffering reports it here, rather than split between the two.
+    virtual double roundTripLatency() const { return inputLatency() + baseLatency() + outputLatency(); }
+
     // maxChannelCount() returns the total number of output channels of the audio hardware.
     // A value of 0 indicates that the number of channels cannot be configured and
     // that only stereo (2-channel) destinations can be created.
@@ -0,0 +1,111 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioFileStream_h
+#define AudioFileStream_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include "internal/WaveFile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+// A PCM WAV file read from disk as it is played, rather than decoded whole. A shared I/O thread converts the frames
+// ahead of the playback position into a ring of planar floats, which the render thread reads without waiting.
+// The ring holds the file's frames in the order they will be played, so loops are unrolled into it as they are read,
+// and a seek discards what was buffered.
+class AudioFileStream
+{
+public:
+
+    // Opens the file, to be read readAheadSeconds ahead of playback once started. Returns nullptr if the file can't
+    // be opened or isn't a WAV file of samples WaveFormat describes.
+    static std::shared_ptr<AudioFileStream> open(const std::string & path, double readAheadSeconds);
+    ~AudioFileStream();
+
+    // Starts reading on the I/O thread. The loop and the position to start from are best set before, so that the
+    // first frames read are the ones wanted.
+    void start();
+
+    const WaveFormat & format() const { return m_format; }
+
+    // The frames that can be buffered ahead of playback.
+    size_t capacity() const { return m_capacity; }
+
+    // Safe to call from any thread. Frames already buffered still play; the new position is read from once the I/O
+    // thread gets to it, usually within a few milliseconds.
+    void seek(uint64_t frame);
+
+    // Safe to call from any thread. Applies to the frames not yet buffered. A loopEnd of zero, or past the file's
+    // end, loops at the end of the file.
+    void setLoop(bool loop, uint64_t loopStart, uint64_t loopEnd);
+
+    // Render thread only. Copies up to frameCount buffered frames into the channels, which may be fewer than the
+    // stream has, and returns how many were copied. Fewer are copied at the end of the stream, while a seek is
+    // being made, or if the I/O thread has fallen behind, which is counted as an underrun.
+    size_t read(float * const * channels, unsigned numberOfChannels, size_t frameCount);
+
+    // Render thread only. Whether every frame to the end of a stream that doesn't loop has been read.
+    bool hasEnded();
+
+    // The number of reads the I/O thread couldn't supply in time.
+    uint64_t underrunCount() const { return m_underrunCount.load(std::memory_order_relaxed); }
+
+private:
+
+    class Thread;
+
+    AudioFileStream(std::FILE * file, const WaveFormat & format, size_t capacity);
+
+    // Called on the I/O thread. Reads the next part of the file into the ring, if there is room, and returns
+    // whether anything was done.
+    bool fill();
+
+    bool readFile(uint64_t offset, void * data, size_t size);
+
+    // The file, and the offset it is at, if known, so that reading on from the last read doesn't seek.
+    std::FILE * m_file;
+    uint64_t m_fileOffset;
+    WaveFormat m_format;
+
+    // The ring, one channel after another. Frames are counted from the start of the stream, and are at their count
+    // modulo the capacity in the ring. Only the I/O thread writes, and only the render thread reads.
+    AudioFloatArray m_ring;
+    size_t m_capacity;
+    std::atomic<uint64_t> m_writeIndex{ 0 };
+    std::atomic<uint64_t> m_readIndex{ 0 };
+
+    // The frame at which a stream that doesn't loop ends.
+    std::atomic<uint64_t> m_endIndex;
+
+    // Held by the I/O thread while a seek empties the ring, and tried by the render thread, which doesn't wait for
+    // it but reads nothing until the next quantum.
+    std::mutex m_seekLock;
+
+    // Requests for the I/O thread.
+    std::atomic<uint64_t> m_seekFrame;
+    std::atomic<bool> m_loop{ false };
+    std::atomic<uint64_t> m_loopStart{ 0 };
+    std::atomic<uint64_t> m_loopEnd{ 0 };
+
+    std::atomic<uint64_t> m_underrunCount{ 0 };
+
+    // The I/O thread's own state: the next frame of the file to read, whether it has been read to the end, and the
+    // file's bytes for a chunk of frames.
+    uint64_t m_filePosition = 0;
+    bool m_isAtEnd = false;
+    std::vector<uint8_t> m_chunk;
+
+    std::shared_ptr<Thread> m_thread;
+};
+
+} // namespace lab
+
+#endif // AudioFileStream_h
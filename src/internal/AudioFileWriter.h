@@ -0,0 +1,105 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef AudioFileWriter_h
+#define AudioFileWriter_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace lab {
+
+// An audio file written to disk as it is recorded, rather than kept in memory. The render thread copies frames
+// into a preallocated ring, which a writer thread of the file's own drains to disk, encoding them on the way.
+// When the ring has no room for a write, the writer having fallen behind, the whole write is dropped and counted.
+//
+// WAV and CAF files hold 32 bit float samples. Their header is written with the file, and its sizes and sample
+// rate are filled in when it is closed. CAF marks its data as running to the end of the file until then, so a CAF
+// file interrupted before closing still reads; WAV sizes are 32 bits, so recordings of 4GB or more should be CAF.
+//
+// WavPack files hold 24 bit samples, compressed losslessly to around half that, or, in its hybrid mode, lossily
+// to a given number of bits per sample. The encoder runs in its fast mode, so that a multichannel recording costs
+// the writer thread a small fraction of a core. Its blocks are complete as they're written, so an interrupted
+// file reads up to its last block; the total length in the first block is filled in when the file is closed.
+class AudioFileWriter
+{
+public:
+
+    // Creates the file, CAF if the path ends in .caf, WavPack if it ends in .wv and WAV otherwise, with a ring of
+    // capacityFrames frames, and starts the writer thread. A WavPack file is lossless if lossyBitsPerSample is 0,
+    // and otherwise encoded at that rate, from 2 to 23 bits per sample; other files ignore it. Returns nullptr if
+    // the file can't be created.
+    static std::unique_ptr<AudioFileWriter> open(const std::string & path, unsigned numberOfChannels, size_t capacityFrames,
+                                                 float lossyBitsPerSample = 0);
+
+    // Closes the file.
+    ~AudioFileWriter();
+
+    unsigned numberOfChannels() const { return m_numberOfChannels; }
+
+    // Render thread only. Interleaves frameCount frames of the channels into the ring, or drops them all if there
+    // isn't room, returning false. A channel may be null for silence.
+    bool write(const float * const * channels, size_t frameCount, float sampleRate);
+
+    // Render thread only. The frames the ring has room for; the writer thread only ever adds to them, so a write of
+    // this many won't be dropped.
+    size_t writableFrames() const
+    {
+        const uint64_t buffered = m_writePosition.load(std::memory_order_relaxed) - m_readPosition.load(std::memory_order_acquire);
+        return m_capacity - static_cast<size_t>(buffered);
+    }
+
+    // For offline rendering, which may wait on the writer: writes as write() does, but waits for room in the ring
+    // rather than dropping frames, in parts if there are more than it holds. Returns false only once closed.
+    bool writeWaiting(const float * const * channels, size_t frameCount, float sampleRate);
+
+    // Writes what is buffered, fills in the header and closes the file; the render thread mustn't write meanwhile
+    // or after. Returns false if anything couldn't be written.
+    bool close();
+
+    // The frames written to the ring.
+    uint64_t frameCount() const { return m_writePosition.load(std::memory_order_relaxed); }
+
+private:
+
+    // Encodes interleaved frames into the file, on the writer thread.
+    class Encoder;
+    class PCMEncoder;
+    class WavPackEncoder;
+
+    AudioFileWriter(std::unique_ptr<Encoder> encoder, unsigned numberOfChannels, size_t capacityFrames);
+
+    void writerEntry();
+
+    // Encodes the buffered frames to the file, and returns whether there were any.
+    bool drain();
+
+    std::unique_ptr<Encoder> m_encoder;
+    bool m_begun{ false };
+    bool m_failed{ false };
+    unsigned m_numberOfChannels;
+
+    // Interleaved frames, each at its count modulo the capacity. Only the render thread writes, and only the writer
+    // thread reads.
+    AudioFloatArray m_ring;
+    size_t m_capacity;
+    std::atomic<uint64_t> m_writePosition{ 0 };
+    std::atomic<uint64_t> m_readPosition{ 0 };
+    std::atomic<float> m_sampleRate{ 0 };
+
+    std::thread m_writer;
+    bool m_shouldRun{ true };
+    bool m_closed{ false };
+    std::mutex m_lock;
+    std::condition_variable m_work;
+};
+
+} // namespace lab
+
+#endif // AudioFileWriter_h
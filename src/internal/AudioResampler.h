@@ -10,7 +10,7 @@
 
 #include "internal/AudioResamplerKernel.h"
 
-#include <vector>
+#include <memory>
 
 namespace lab {
 
@@ -27,6 +27,9 @@ public:
     // Given an AudioSourceProvider, process() resamples the source stream into destinationBus.
     void process(ContextRenderLock&, AudioSourceProvider*, AudioBus* destinationBus, size_t framesToProcess);
 
+    // As process(), at a rate for each frame, such as an a-rate parameter's values, in place of rate().
+    void process(ContextRenderLock&, AudioSourceProvider*, AudioBus* destinationBus, size_t framesToProcess, const float* rates);
+
     // Resets the processing state.
     void reset();
 
@@ -36,11 +39,16 @@ public:
     void setRate(double rate);
     double rate() const { return m_rate; }
 
+    // Linear by default.
+    void setInterpolation(AudioResamplerKernel::Interpolation interpolation) { m_interpolation = interpolation; }
+    AudioResamplerKernel::Interpolation interpolation() const { return m_interpolation; }
+
     static const double MaxRate;
 
 private:
     double m_rate;
-    std::vector<std::unique_ptr<AudioResamplerKernel> > m_kernels;
+    AudioResamplerKernel::Interpolation m_interpolation;
+    std::unique_ptr<AudioResamplerKernel> m_kernel;
     std::unique_ptr<AudioBus> m_sourceBus;
 };
 
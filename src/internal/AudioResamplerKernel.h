@@ -7,28 +7,41 @@
 
 #include "LabSound/core/AudioArray.h"
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace lab {
 
-class AudioResampler;
-class ContextRenderLock;
-    
-// AudioResamplerKernel does resampling on a single mono channel.
-// It uses a simple linear interpolation for good performance.
+class AudioBus;
+
+// AudioResamplerKernel resamples the channels of a stream together: the read positions are worked out once a frame
+// for all of them, and then each channel is interpolated at them in a loop of its own. The rate may change from
+// frame to frame. When the positions land on whole frames of the source at a rate of one, the frames are copied.
 
 class AudioResamplerKernel {
 public:
-    AudioResamplerKernel(AudioResampler*);
 
-    // getSourcePointer() should be called each time before process() is called.
-    // Given a number of frames to process (for subsequent call to process()), it returns a pointer and numberOfSourceFramesNeeded
-    // where sample data should be copied. This sample data provides the input to the resampler when process() is called.
-    // framesToProcess must be less than or equal to MaxFramesToProcess.
-    float* getSourcePointer(size_t framesToProcess, size_t* numberOfSourceFramesNeeded);
+    enum Interpolation
+    {
+        Linear, // between the two frames around a position
+        Cubic   // through the four frames around it, as a Catmull-Rom spline; smoother, at about twice the cost
+    };
+
+    explicit AudioResamplerKernel(unsigned numberOfChannels);
+
+    unsigned numberOfChannels() const { return static_cast<unsigned>(m_sourceBuffers.size()); }
 
-    // process() resamples framesToProcess frames from the source into destination.
-    // Each call to process() must be preceded by a call to getSourcePointer() so that source input may be supplied.
-    // framesToProcess must be less than or equal to MaxFramesToProcess.
-    void process(ContextRenderLock&, float* destination, size_t framesToProcess);
+    // Works out the positions of the next framesToProcess frames, at rates[i] source frames for the i-th, or at
+    // rate for all of them if rates is null, and returns how many source frames they need. Each rate is clamped
+    // to 0 to AudioResampler::MaxRate. Those frames are then to be written at sourcePointer() before process() is
+    // called. framesToProcess must be less than or equal to MaxFramesToProcess.
+    size_t prepare(size_t framesToProcess, double rate, const float * rates);
+
+    float * sourcePointer(unsigned channel);
+
+    // Resamples the frames prepared into the first framesToProcess frames of each of the destination's channels.
+    void process(AudioBus * destination, size_t framesToProcess, Interpolation interpolation);
 
     // Resets the processing state.
     void reset();
@@ -36,20 +49,23 @@ public:
     static const size_t MaxFramesToProcess;
 
 private:
-    double rate() const;
 
-    AudioResampler* m_resampler;
-    AudioFloatArray m_sourceBuffer;
-    
-    // This is a (floating point) read index on the input stream.
+    // The source frames kept from one call to the next, so that every position has a frame before it and two
+    // after for the cubic interpolation.
+    enum { History = 4 };
+
+    std::vector<std::unique_ptr<AudioFloatArray>> m_sourceBuffers;
+
+    // The read position at the start of the next call, in the source buffers: from 1 to 2, past the first of the
+    // frames kept, or History after a reset, so that the first frame provided is the first played.
     double m_virtualReadIndex;
 
-    // We need to have continuity from one call of process() to the next.
-    // m_lastValues stores the last two sample values from the last call to process().
-    // m_fillIndex represents how many buffered samples we have which can be as many as 2.
-    // For the first call to process() (or after reset()) there will be no buffered samples.
-    float m_lastValues[2];
-    unsigned m_fillIndex;
+    // The positions of the prepared frames, as the source frame before each and the fraction past it.
+    std::vector<uint32_t> m_indices;
+    AudioFloatArray m_fractions;
+    double m_nextReadIndex;
+    size_t m_bufferLength;
+    bool m_unity;
 };
 
 } // namespace lab
@@ -0,0 +1,92 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef BackgroundConvolverPool_h
+#define BackgroundConvolverPool_h
+
+#include "LabSound/core/AudioThreadPolicy.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lab {
+
+class ReverbConvolver;
+
+// BackgroundConvolverPool processes the background stages of every ReverbConvolver using background threads,
+// on a small shared set of worker threads rather than a thread per convolver. Each convolver's outstanding
+// input is a job whose deadline is set by the scheduling slack of its background stages; an idle worker takes
+// the registered convolver that has used the largest fraction of its slack, so the one closest to missing its
+// deadline goes first. Jobs that have used more than half of their slack are counted as at risk.
+class BackgroundConvolverPool
+{
+public:
+
+    // The pool shared by all convolvers, created on first use and destroyed with its last holder.
+    static std::shared_ptr<BackgroundConvolverPool> shared();
+
+    // The policy of the shared pool's workers, which a pool created later also takes, and their failures to
+    // apply it.
+    static void setSharedThreadPolicy(const AudioThreadPolicy & policy, double quantumSeconds);
+    static unsigned sharedPolicyFailures();
+
+    explicit BackgroundConvolverPool(size_t workerCount);
+    ~BackgroundConvolverPool();
+
+    size_t workerCount() const { return m_workers.size(); }
+
+    void add(ReverbConvolver * convolver);
+
+    // Blocks until no worker is processing the convolver, after which the pool no longer refers to it.
+    void remove(ReverbConvolver * convolver);
+
+    // Called from the audio thread once more input has been buffered. Never blocks; if the pool is busy
+    // the workers still find the input when they next look, within a few milliseconds.
+    void wake();
+
+    // The number of times a job was started with more than half of its slack used.
+    size_t atRiskCount() const { return m_atRiskCount.load(); }
+
+    // Each worker applies the policy to itself when it next looks for work.
+    void setThreadPolicy(const AudioThreadPolicy & policy, double quantumSeconds);
+    unsigned policyFailures() const { return m_policyFailures.load(); }
+
+private:
+
+    struct Entry
+    {
+        ReverbConvolver * convolver;
+        bool busy;
+        bool atRisk;
+    };
+
+    void workerEntry();
+
+    // Returns the index of the entry to process next, or -1 if none has outstanding input. Called with the lock held.
+    int nextEntry();
+
+    std::vector<std::thread> m_workers;
+    std::vector<Entry> m_entries;
+    bool m_shouldRun{ true };
+
+    std::mutex m_lock;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+
+    std::atomic<size_t> m_atRiskCount{ 0 };
+
+    // Guarded by m_lock. Workers compare m_policyGeneration with the one they last applied.
+    AudioThreadPolicy m_policy;
+    double m_quantumSeconds{ 0 };
+    uint32_t m_policyGeneration{ 0 };
+    std::atomic<unsigned> m_policyFailures{ 0 };
+};
+
+} // namespace lab
+
+#endif // BackgroundConvolverPool_h
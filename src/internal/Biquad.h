@@ -11,6 +11,7 @@
 
 #include <sys/types.h>
 #include <complex>
+#include <stdint.h>
 
 namespace lab 
 {
@@ -27,6 +28,21 @@ public:
 
     void process(const float* sourceP, float* destP, size_t framesToProcess);
 
+    // Filters while moving the coefficients linearly, frame by frame, from this biquad's to target's, which this
+    // biquad then keeps from the last frame on.
+    void process(const float* sourceP, float* destP, size_t framesToProcess, const Biquad& target);
+
+    // Filters a channel through each of channelCount biquads, all set to the coefficients of the first, with the
+    // channels' filter memory side by side in vector lanes so that their recurrences run together.
+    static void process(Biquad* const* biquads, const float* const* sourceP, float* const* destP,
+                        size_t channelCount, size_t framesToProcess);
+
+    // Takes the coefficients of another biquad, keeping this one's filter memory.
+    void copyCoefficientsFrom(const Biquad& other);
+
+    // The normalized coefficients set by the last of the set functions, for filters running the recurrence themselves.
+    void getCoefficients(double& b0, double& b1, double& b2, double& a1, double& a2) const;
+
     // frequency is 0 - 1 normalized, resonance and dbGain are in decibels.
     // Q is a unitless quality factor.
     void setLowpassParams(double frequency, double resonance);
@@ -46,6 +62,9 @@ public:
     // (The zeroes will be the inverse of the poles)
     void setAllpassPole(const std::complex<double>& pole);
 
+    // Sets coefficients designed elsewhere, such as a standard's, dividing them all by a0.
+    void setNormalizedCoefficients(double b0, double b1, double b2, double a0, double a1, double a2);
+
     // Resets filter state
     void reset();
 
@@ -57,8 +76,6 @@ public:
                               float* magResponse,
                               float* phaseResponse);
 private:
-    void setNormalizedCoefficients(double b0, double b1, double b2, double a0, double a1, double a2);
-    
     // Filter coefficients. The filter is defined as
     //
     // y[n] + m_a1*y[n-1] + m_a2*y[n-2] = m_b0*x[n] + m_b1*x[n-1] + m_b2*x[n-2].
@@ -68,7 +85,24 @@ private:
     double m_a1;
     double m_a2;
 
-#if defined(LABSOUND_PLATFORM_OSX)
+#if defined(LABSOUND_FIXED_POINT)
+    // Filter memory, as FixedPoint signals
+    int32_t m_x1;
+    int32_t m_x2;
+    int32_t m_y1;
+    int32_t m_y2;
+
+    // The coefficients rounded to m_fixedBits fraction bits, kept up to date by setNormalizedCoefficients() and
+    // copyCoefficientsFrom().
+    int32_t m_fixedB0;
+    int32_t m_fixedB1;
+    int32_t m_fixedB2;
+    int32_t m_fixedA1;
+    int32_t m_fixedA2;
+    int m_fixedBits;
+
+    void quantizeCoefficients();
+#elif defined(LABSOUND_PLATFORM_OSX)
     void processFast(const float* sourceP, float* destP, size_t framesToProcess);
     void processSliceFast(double* sourceP, double* destP, double* coefficientsP, size_t framesToProcess);
     AudioDoubleArray m_inputBuffer;
@@ -79,6 +113,10 @@ private:
     double m_x2; // input delayed by 2 samples
     double m_y1; // output delayed by 1 sample
     double m_y2; // output delayed by 2 samples
+
+    // Filters Pairs * 2 channels at once.
+    template <size_t Pairs>
+    static void processLanes(Biquad* const* biquads, const float* const* sourceP, float* const* destP, size_t framesToProcess);
 #endif
 
 };
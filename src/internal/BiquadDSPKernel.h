@@ -38,10 +38,6 @@ public:
     virtual double tailTime(ContextRenderLock & r) const override;
     virtual double latencyTime(ContextRenderLock & r) const override;
 
-protected:
-    Biquad m_biquad;
-    BiquadProcessor* biquadProcessor() { return static_cast<BiquadProcessor*>(processor()); }
-
     // To prevent audio glitches when parameters are changed,
     // dezippering is used to slowly change the parameters.
     // |useSmoothing| implies that we want to update using the
@@ -50,6 +46,15 @@ protected:
     // if they are not dirty. (Used when computing the frequency
     // response.)
     void updateCoefficientsIfNecessary(ContextRenderLock& r, bool useSmoothing, bool forceUpdate);
+
+    Biquad& biquad() { return m_biquad; }
+
+    // Configures biquad as a filter of the given type, from parameter values as a BiquadProcessor has them.
+    static void setCoefficients(Biquad& biquad, FilterType type, double sampleRate, double frequency, double q, double gain, double detune);
+
+protected:
+    Biquad m_biquad;
+    BiquadProcessor* biquadProcessor() { return static_cast<BiquadProcessor*>(processor()); }
 };
 
 } // namespace lab
@@ -5,6 +5,7 @@
 #ifndef BiquadProcessor_h
 #define BiquadProcessor_h
 
+#include "LabSound/core/AudioArray.h"
 #include "LabSound/core/AudioParam.h"
 #include "LabSound/core/AudioBus.h"
 
@@ -35,7 +36,7 @@ public:
                               float* magResponse,
                               float* phaseResponse);
 
-    void checkForDirtyCoefficients(ContextRenderLock&);
+    void checkForDirtyCoefficients(ContextRenderLock&, size_t framesToProcess);
     
     bool filterCoefficientsDirty() const { return m_filterCoefficientsDirty; }
     bool hasSampleAccurateValues() const { return m_hasSampleAccurateValues; }
@@ -48,7 +49,16 @@ public:
     FilterType type() const { return m_type; }
     void setType(FilterType);
 
+    // While a parameter is automated or driven by a connection, the coefficients are designed every this many
+    // frames and interpolated linearly in between.
+    size_t coefficientInterval() const { return m_coefficientInterval; }
+    void setCoefficientInterval(size_t frames);
+
 private:
+    // Channels sharing coefficients are filtered together, this many at a time, from the kernel at start.
+    static const size_t GroupSize = 8;
+    void processGroup(const AudioBus* source, AudioBus* destination, size_t start, size_t framesToProcess);
+
     FilterType m_type;
 
     std::shared_ptr<AudioParam> m_parameter1;
@@ -61,6 +71,12 @@ private:
 
     // Set to true if any of the filter parameters are sample-accurate.
     bool m_hasSampleAccurateValues;
+
+    // The values of the parameters for the quantum, and the coefficients the kernels ramp to, when they are.
+    void processSampleAccurate(ContextRenderLock&, const AudioBus* source, AudioBus* destination, size_t framesToProcess);
+    AudioFloatArray m_parameterValues[4];
+    Biquad m_nextCoefficients;
+    size_t m_coefficientInterval;
 };
 
 } // namespace lab
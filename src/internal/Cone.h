@@ -18,11 +18,14 @@ public:
     // Returns scalar gain for the given source/listener positions/orientations
     double gain(FloatPoint3D sourcePosition, FloatPoint3D sourceOrientation, FloatPoint3D listenerPosition);
 
+    // Returns scalar gain for the cosine of the angle between the source's orientation and the source-listener vector
+    double gain(double angleCosine) const;
+
     // Angles in degrees
-    void setInnerAngle(double innerAngle) { m_innerAngle = innerAngle; }
+    void setInnerAngle(double innerAngle) { m_innerAngle = innerAngle; updateThresholds(); }
     double innerAngle() const { return m_innerAngle; }
 
-    void setOuterAngle(double outerAngle) { m_outerAngle = outerAngle; }
+    void setOuterAngle(double outerAngle) { m_outerAngle = outerAngle; updateThresholds(); }
     double outerAngle() const { return m_outerAngle; }
 
     void setOuterGain(double outerGain) { m_outerGain = outerGain; }
@@ -32,6 +35,12 @@ protected:
     double m_innerAngle;
     double m_outerAngle;
     double m_outerGain;
+
+    // The cosines of the half angles, within which the gain is unity, and beyond which it is the outer gain. Only
+    // between them is the angle itself needed.
+    void updateThresholds();
+    double m_innerCosine;
+    double m_outerCosine;
 };
 
 } // namespace lab
@@ -6,41 +6,68 @@
 #define DelayDSPKernel_h
 
 #include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioNode.h"
 
 #include "internal/AudioDSPKernel.h"
 #include "internal/DelayProcessor.h"
 
+#include <memory>
+
 namespace lab {
 
 class DelayProcessor;
     
 class DelayDSPKernel : public AudioDSPKernel {
 public:  
+    // A kernel of a DelayProcessor starts with room for InitialCapacityTime, or the maximum delay if that is
+    // shorter, and grows as the delay approaches its capacity. A standalone kernel has room for its maximum from
+    // the start.
     explicit DelayDSPKernel(DelayProcessor*, float sampleRate);
     DelayDSPKernel(double maxDelayTime, float sampleRate);
-    virtual ~DelayDSPKernel() {}
+    virtual ~DelayDSPKernel();
     
     virtual void process(ContextRenderLock&, const float* source, float* destination, size_t framesToProcess) override;
     virtual void reset() override;
     
     double maxDelayTime() const { return m_maxDelayTime; }
+
+    // The frames the delay line currently holds, which is at most enough for maxDelayTime().
+    size_t bufferLength() const { return m_buffer->size(); }
     
     void setDelayFrames(double numberOfFrames) { m_desiredDelayFrames = numberOfFrames; }
 
     virtual double tailTime(ContextRenderLock & r) const override;
     virtual double latencyTime(ContextRenderLock & r) const override;
 
+    virtual void reportMemory(AudioMemoryUsage & usage) const override;
+
 private:
-    AudioFloatArray m_buffer;
+    // Quanta are processed in blocks of at most this many frames.
+    enum { BlockFrames = AudioNode::ProcessingSizeInFrames };
+
+    static const double InitialCapacityTime;
+
+    struct Growth;
+
+    // Called at the start of each quantum. Adopts a grown buffer that has been made, and asks for one if
+    // delayTime, the longest in the quantum, comes within a quarter of the capacity.
+    void updateCapacity(ContextRenderLock&, double delayTime, float sampleRate);
+
+    // Reads a block while the delay holds still, a span of the buffer per interpolator tap.
+    void readConstantDelay(size_t writeIndex, double delayFrames, DelayInterpolation, float* destination, size_t framesToProcess);
+
+    // The weights of the frames before, at, after, and two after a position, fraction past the frame it falls on.
+    static void lagrangeCoefficients(double fraction, float* coefficients);
+
+    std::unique_ptr<AudioFloatArray> m_buffer;
+    std::shared_ptr<Growth> m_growth;
     double m_maxDelayTime;
-    int m_writeIndex;
+    size_t m_writeIndex;
     double m_currentDelayTime;
     double m_smoothingRate;
     bool m_firstTime;
     double m_desiredDelayFrames;
 
-    AudioFloatArray m_delayTimes;
-
     DelayProcessor * delayProcessor() { return static_cast<DelayProcessor*>(processor()); }
     size_t bufferLengthForDelay(double delayTime, double sampleRate) const;
 };
@@ -5,7 +5,9 @@
 #ifndef DelayProcessor_h
 #define DelayProcessor_h
 
+#include "LabSound/core/AudioArray.h"
 #include "LabSound/core/AudioParam.h"
+#include "LabSound/core/DelayNode.h"
 
 #include "internal/AudioDSPKernelProcessor.h"
 
@@ -18,6 +20,7 @@ class DelayProcessor : public AudioDSPKernelProcessor
     std::shared_ptr<AudioParam> m_delayTime;
     double m_maxDelayTime;
     float m_sampleRate;
+    DelayInterpolation m_interpolation{ DelayInterpolation::LINEAR };
 public:
 
     DelayProcessor(float sampleRate, unsigned numberOfChannels, double maxDelayTime);
@@ -29,6 +32,25 @@ public:
     std::shared_ptr<AudioParam> delayTime() const { return m_delayTime; }
 
     double maxDelayTime() { return m_maxDelayTime; }
+
+    DelayInterpolation interpolation() const { return m_interpolation; }
+    void setInterpolation(DelayInterpolation type) { m_interpolation = type; }
+
+    // The delay time over the quantum, evaluated once for all the kernels: a value per frame if
+    // quantumIsSampleAccurate(), and otherwise the one quantumDelayTime().
+    bool quantumIsSampleAccurate() const { return m_quantumIsSampleAccurate; }
+    const float* quantumDelayTimes() const { return m_quantumDelayTimes.data(); }
+    double quantumDelayTime() const { return m_quantumDelayTime; }
+
+protected:
+
+    virtual void prepareKernels(ContextRenderLock&, size_t framesToProcess) override;
+
+private:
+
+    AudioFloatArray m_quantumDelayTimes;
+    double m_quantumDelayTime = 0;
+    bool m_quantumIsSampleAccurate = false;
 };
 
 } // namespace lab
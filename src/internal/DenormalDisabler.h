@@ -9,17 +9,28 @@
 
 
 // Deal with denormals. They can very seriously impact performance on x86.
+//
+// The mode belongs to the thread, so every thread that runs DSP holds a DenormalDisabler for as long as it runs:
+// the render callback, the offline render, and the worker, loader and decoder threads. Where the mode is set in
+// hardware flushDenormalFloatToZero is a nop; elsewhere the filters' recursive state is flushed by hand.
 
 // Define HAVE_DENORMAL if we support flushing denormals to zero.
 #if defined(LABSOUND_PLATFORM_WINDOWS)
     #define HAVE_DENORMAL
 #endif
 #include <float.h>
+#include <math.h>
+#include <stdint.h>
 
 #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
 #define HAVE_DENORMAL
 #endif
 
+// On ARM the flush-to-zero bit of the floating point control register covers both inputs and results.
+#if defined(__GNUC__) && (defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FP)))
+#define HAVE_DENORMAL
+#endif
+
 namespace lab {
 
 #ifdef HAVE_DENORMAL
@@ -37,7 +48,7 @@ public:
         _controlfp_s(&unused, _DN_FLUSH, _MCW_DN);
 #else
         m_savedCSR = getCSR();
-        setCSR(m_savedCSR | 0x8040);
+        setCSR(m_savedCSR | FlushToZeroBits);
 #endif
     }
 
@@ -54,7 +65,7 @@ public:
     // This is a nop if we can flush denormals to zero in hardware.
     static inline float flushDenormalFloatToZero(float f)
     {
-#if defined(LABSOUND_PLATFORM_WINDOWS) && (!_M_IX86_FP)
+#if defined(LABSOUND_PLATFORM_WINDOWS) && defined(_M_IX86) && (!_M_IX86_FP)
         // For systems using x87 instead of sse, there's no hardware support
         // to flush denormals automatically. Hence, we need to flush
         // denormals to zero manually.
@@ -65,19 +76,55 @@ public:
     }
 private:
 #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
-    inline int getCSR()
+    // MXCSR's flush-to-zero and denormals-are-zero bits.
+    enum { FlushToZeroBits = 0x8040 };
+
+    inline unsigned int getCSR()
     {
-        int result;
+        unsigned int result;
         asm volatile("stmxcsr %0" : "=m" (result));
         return result;
     }
 
-    inline void setCSR(int a)
+    inline void setCSR(unsigned int a)
     {
-        int temp = a;
+        unsigned int temp = a;
         asm volatile("ldmxcsr %0" : : "m" (temp));
     }
 
+#elif defined(__GNUC__) && defined(__aarch64__)
+    // FPCR's FZ bit. The upper half of the register is reserved, so it is kept in 32 bits.
+    enum { FlushToZeroBits = 1 << 24 };
+
+    inline unsigned int getCSR()
+    {
+        uint64_t result;
+        asm volatile("mrs %0, fpcr" : "=r" (result));
+        return static_cast<unsigned int>(result);
+    }
+
+    inline void setCSR(unsigned int a)
+    {
+        uint64_t temp = a;
+        asm volatile("msr fpcr, %0" : : "r" (temp));
+    }
+
+#elif defined(__GNUC__) && defined(__arm__)
+    // FPSCR's FZ bit.
+    enum { FlushToZeroBits = 1 << 24 };
+
+    inline unsigned int getCSR()
+    {
+        unsigned int result;
+        asm volatile("vmrs %0, fpscr" : "=r" (result));
+        return result;
+    }
+
+    inline void setCSR(unsigned int a)
+    {
+        asm volatile("vmsr fpscr, %0" : : "r" (a));
+    }
+
 #endif
 
     unsigned int m_savedCSR;
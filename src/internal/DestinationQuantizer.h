@@ -0,0 +1,64 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef DestinationQuantizer_h
+#define DestinationQuantizer_h
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioIOCallback.h"
+
+namespace lab {
+
+// Sits between a platform audio destination and the graph, so that the graph renders in quanta whatever size of
+// buffer the device asks for.
+// A device buffer that is a multiple of the quantum is rendered a quantum at a time straight into the device's
+// memory, with its live input handed over in place, and adds no latency. Otherwise quanta are rendered ahead
+// into a buffer of one, which adds up to a quantum to the output's latency, and the live input is delayed by a
+// quantum so that it can be handed over whole. Either way every quantum is whole.
+class DestinationQuantizer : public AudioIOCallback
+{
+public:
+
+    // deviceFrames is the buffer size the device negotiated; callbacks of other sizes are still rendered.
+    DestinationQuantizer(AudioIOCallback & graph, unsigned numberOfChannels, unsigned numberOfInputChannels, size_t renderQuantumSize,
+                         size_t deviceFrames);
+    virtual ~DestinationQuantizer() = default;
+
+    // Called on the audio thread with buses over the device's buffers; doesn't allocate.
+    virtual void render(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess) override;
+
+    // True if the device's buffer is rendered in place, without adding latency.
+    bool inPlace() const { return m_inPlace; }
+
+    // The most frames by which the graph renders ahead of the frames handed to the device.
+    size_t latencyFrames() const { return m_inPlace ? 0 : m_renderQuantumSize; }
+
+    // The frames by which the live input is delayed before the graph is handed it.
+    size_t inputLatencyFrames() const { return m_inPlace ? 0 : m_renderQuantumSize; }
+
+private:
+
+    void renderInPlace(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess);
+    void renderAhead(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess);
+
+    AudioIOCallback & m_graph;
+    size_t m_renderQuantumSize;
+    bool m_inPlace;
+
+    // Views of a quantum of the device's buffers.
+    AudioBus m_outputView;
+    AudioBus m_inputView;
+
+    // When rendering ahead, the last quantum rendered, of which the frames from m_readIndex on are yet to be
+    // played, and the live input, a quantum behind, waiting to be handed to the graph.
+    AudioBus m_outputQuantum;
+    size_t m_readIndex;
+    AudioBus m_inputQuantum;
+    AudioBus m_inputRing;
+    size_t m_inputWrite = 0;
+    size_t m_inputAvailable;
+};
+
+} // namespace lab
+
+#endif // DestinationQuantizer_h
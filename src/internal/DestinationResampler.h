@@ -0,0 +1,46 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef DestinationResampler_h
+#define DestinationResampler_h
+
+#include "LabSound/core/AudioIOCallback.h"
+
+#include <memory>
+
+namespace lab {
+
+class AudioBus;
+class MultiChannelResampler;
+
+// Sits between a platform audio destination and the graph when the hardware runs at a different rate than the
+// context, so that the graph keeps rendering at its own rate whatever rate the device negotiated.
+// The hardware calls render() for frames at its rate; they are resampled from whole render quanta which the graph
+// renders, at the context's rate, as they are needed.
+// Live audio input isn't resampled, and the graph is given none.
+class DestinationResampler : public AudioIOCallback
+{
+public:
+
+    DestinationResampler(AudioIOCallback & graph, unsigned numberOfChannels, float graphSampleRate, float deviceSampleRate, size_t renderQuantumSize);
+    virtual ~DestinationResampler();
+
+    // Called on the audio thread; doesn't allocate once the resampler has been primed.
+    virtual void render(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess) override;
+
+    // The most seconds by which the graph renders ahead of the frames handed to the hardware.
+    double latency() const;
+
+private:
+
+    class GraphProvider;
+
+    std::unique_ptr<GraphProvider> m_provider;
+    std::unique_ptr<MultiChannelResampler> m_resampler;
+    float m_graphSampleRate;
+    size_t m_renderQuantumSize;
+};
+
+} // namespace lab
+
+#endif // DestinationResampler_h
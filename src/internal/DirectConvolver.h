@@ -17,10 +17,12 @@ public:
 
     DirectConvolver(size_t inputBlockSize);
 
-    void process(AudioFloatArray* convolutionKernel, const float* sourceP, float* destP, size_t framesToProcess);
+    void process(const AudioFloatArray* convolutionKernel, const float* sourceP, float* destP, size_t framesToProcess);
 
     void reset();
 
+    size_t memoryBytes() const { return m_buffer.size() * sizeof(float); }
+
 private:
 
     size_t m_inputBlockSize;
@@ -0,0 +1,66 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef DopplerDelay_h
+#define DopplerDelay_h
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioBus.h"
+
+#include <cstdint>
+
+namespace lab {
+
+// The propagation delay between a source and the listener, distance / speed of sound. As the distance changes the
+// delay is ramped across the quantum, so that the line is read faster or slower than it is written and the signal
+// is shifted in pitch by the Doppler ratio, whatever the source is. Reads are linearly interpolated; while the delay
+// holds still, each channel is read as two spans of the line scaled and summed, and while it moves, the read
+// positions are generated as a ramp and gathered. Up to two channels, as many as a PannerNode takes.
+class DopplerDelay
+{
+public:
+
+    // The longest delay, which at the speed of sound in air is about 343 meters; sources further away are heard
+    // with this delay, and their movement beyond it is not shifted.
+    static const double MaxDelayTime;
+
+    // The fastest the delay may change, in frames per frame, limiting the shift to 4 octaves up and 3 down as
+    // PannerNode::dopplerRate() does. Jumps in position glide at this rate rather than click.
+    static const double MaxApproachRate;
+    static const double MaxRecedeRate;
+
+    // Allocates the lines, for quanta of up to maxFrames, so is made off the render thread.
+    DopplerDelay(float sampleRate, size_t maxFrames);
+
+    // Writes the source into the line and returns it read back at a delay ramped from the previous quantum's to
+    // delayFrames, clamped to the longest delay. The first quantum after a reset starts at delayFrames.
+    // framesToProcess must be at most maxFrames().
+    AudioBus * process(const AudioBus * source, double delayFrames, size_t framesToProcess);
+
+    size_t maxFrames() const { return m_mono.length(); }
+
+    void reset();
+
+    double delayFrames() const { return m_delayFrames; }
+
+    size_t memoryBytes() const;
+
+private:
+
+    // Reads frames of a line from index on, wrapping, scaled by gain; added to the destination if accumulate.
+    void readSpan(const float * line, size_t index, float gain, bool accumulate, float * destination, size_t frames) const;
+
+    AudioFloatArray m_lines[2];
+    AudioBus m_mono;
+    AudioBus m_stereo;
+    AudioFloatArray m_positions;
+    size_t m_mask;
+    size_t m_writeIndex = 0;
+    double m_maxDelayFrames;
+    double m_delayFrames = 0;
+    bool m_first = true;
+};
+
+} // namespace lab
+
+#endif // DopplerDelay_h
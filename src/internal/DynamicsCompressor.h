@@ -75,9 +75,11 @@ protected:
         ZeroPole filters[4];
     } ZeroPoleFilterPack4;
 
-    // Per-channel emphasis filters.
+    // Per-channel emphasis filters, and each stage's filters of all the channels, as ZeroPole::process takes them.
     std::vector<std::unique_ptr<ZeroPoleFilterPack4> > m_preFilterPacks;
     std::vector<std::unique_ptr<ZeroPoleFilterPack4> > m_postFilterPacks;
+    std::vector<ZeroPole*> m_preFilterStages[4];
+    std::vector<ZeroPole*> m_postFilterStages[4];
 
     std::unique_ptr<const float*[]> m_sourceChannels;
     std::unique_ptr<float*[]> m_destinationChannels;
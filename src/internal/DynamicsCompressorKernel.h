@@ -43,9 +43,17 @@ public:
                  float releaseZone1,
                  float releaseZone2,
                  float releaseZone3,
-                 float releaseZone4
+                 float releaseZone4,
+
+                 // Detects from these channels instead of the sources, if given, for sidechain compression.
+                 const float * detectorChannels[] = nullptr,
+                 unsigned numberOfDetectorChannels = 0
                  );
 
+    // The post gain is raised, by default, to make up for the compression of a full scale signal. A compressor
+    // ducking under a sidechain turns this off, so that the signal passes at unity while the sidechain is quiet.
+    void setAutomaticMakeupGain(bool enabled) { m_automaticMakeupGain = enabled; }
+
     void reset();
 
     unsigned latencyFrames() const { return m_lastPreDelayFrames; }
@@ -73,8 +81,20 @@ protected:
     int m_preDelayReadIndex;
     int m_preDelayWriteIndex;
 
+    // Copy a division into a channel's pre-delay at the write index, and out of it at the read index scaled by
+    // gain, in at most two spans either side of the buffer's end.
+    void writePreDelay(unsigned channel, const float* source, size_t framesToProcess);
+    void readPreDelay(unsigned channel, const float* gain, float* destination, size_t framesToProcess);
+
+    // The static curve's attenuation of each frame of the detector's input, and the rate at which the detector
+    // releases towards it.
+    void computeAttenuation(const float* absInput, float k, float satReleaseFrames,
+                            float* attenuation, float* satReleaseRate, size_t framesToProcess);
+
     float m_maxAttackCompressionDiffDb;
 
+    bool m_automaticMakeupGain{ true };
+
     // Static compression curve.
     float kneeCurve(float x, float k);
     float saturate(float x, float k);
@@ -5,6 +5,8 @@
 #ifndef EqualPowerPanner_h
 #define EqualPowerPanner_h
 
+#include "LabSound/core/AudioArray.h"
+
 #include "internal/Panner.h"
 
 namespace lab
@@ -35,6 +37,10 @@ private:
     
     double m_gainL = 0.0;
     double m_gainR = 0.0;
+
+    // Scratch for the de-zippered gains of a quantum.
+    AudioFloatArray m_gainCurveL;
+    AudioFloatArray m_gainCurveR;
 };
 
 } // namespace lab
@@ -23,7 +23,7 @@ public:
     // The input to output latency is equal to fftSize / 2
     //
     // Processing in-place is allowed...
-    void process(FFTFrame* fftKernel, const float* sourceP, float* destP, size_t framesToProcess);
+    void process(const FFTFrame* fftKernel, const float* sourceP, float* destP, size_t framesToProcess);
 
     void reset();
 
@@ -36,11 +36,10 @@ private:
     size_t m_readWriteIndex;
     AudioFloatArray m_inputBuffer;
 
-    // Stores output which we read a little at a time
-    AudioFloatArray m_outputBuffer;
-
-    // Saves the 2nd half of the FFT buffer, so we can do an overlap-add with the 1st half of the next one
-    AudioFloatArray m_lastOverlapBuffer;
+    // Stores output which we read a little at a time, from the 1st half of the current buffer. The buffers
+    // alternate, so the 2nd half of the previous one is overlap-added in place rather than saved aside.
+    AudioFloatArray m_outputBuffers[2];
+    size_t m_currentOutput;
 };
 
 } // namespace lab
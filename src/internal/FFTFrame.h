@@ -12,26 +12,65 @@
 #include <vector>
 #include <memory>
 
-#if defined(LABSOUND_PLATFORM_OSX) && !defined(WEBAUDIO_KISSFFT)
+// One FFT library is compiled in, chosen at build time by defining one of WEBAUDIO_PFFFT, WEBAUDIO_FFTW,
+// WEBAUDIO_MKL or WEBAUDIO_OOURA. Otherwise macOS uses Accelerate, unless WEBAUDIO_KISSFFT is defined,
+// and every other platform falls back to KissFFT.
+#if defined(WEBAUDIO_PFFFT)
+#define USE_PFFFT_FFT 1
+#elif defined(WEBAUDIO_FFTW)
+#define USE_FFTW_FFT 1
+#elif defined(WEBAUDIO_MKL)
+#define USE_MKL_FFT 1
+#elif defined(WEBAUDIO_OOURA)
+#define USE_OOURA_FFT 1
+#elif defined(LABSOUND_PLATFORM_OSX) && !defined(WEBAUDIO_KISSFFT)
 #define USE_ACCELERATE_FFT 1
 #else
+#define USE_KISS_FFT 1
+#endif
+
+#ifndef USE_PFFFT_FFT
+#define USE_PFFFT_FFT 0
+#endif
+#ifndef USE_FFTW_FFT
+#define USE_FFTW_FFT 0
+#endif
+#ifndef USE_MKL_FFT
+#define USE_MKL_FFT 0
+#endif
+#ifndef USE_OOURA_FFT
+#define USE_OOURA_FFT 0
+#endif
+#ifndef USE_ACCELERATE_FFT
 #define USE_ACCELERATE_FFT 0
 #endif
+#ifndef USE_KISS_FFT
+#define USE_KISS_FFT 0
+#endif
 
 #if USE_ACCELERATE_FFT
 #include <Accelerate/Accelerate.h>
-#endif // !USE_ACCELERATE_FFT
-
-#if defined(WEBAUDIO_KISSFFT)
+#elif USE_PFFFT_FFT
+#include <pffft.h>
+#elif USE_FFTW_FFT
+#include <fftw3.h>
+#elif USE_MKL_FFT
+#include <mkl_dfti.h>
+#elif USE_KISS_FFT
 #include <kissfft/kiss_fft.hpp>
 #include <kissfft/kiss_fftr.hpp>
-#endif // USE(WEBAUDIO_KISSFFT)
+#endif
 
 namespace lab 
 {
 
 // Defines the interface for an "FFT frame", an object which is able to perform a forward
 // and reverse FFT, internally storing the resultant frequency-domain data.
+//
+// Every implementation stores the spectrum in the same packed layout: realData() and imagData() hold bins
+// 0 to fftSize / 2 - 1, except that imagData()[0] holds the real Nyquist component, as the imaginary parts
+// of the DC and Nyquist bins are always zero. The forward transform is unscaled, apart from Accelerate's
+// which is doubled and compensated for by multiply(), and the inverse scales so that x == IFFT(FFT(x)).
 class FFTFrame 
 {
 
@@ -59,11 +98,15 @@ public:
     static std::unique_ptr<FFTFrame> createInterpolatedFrame(const FFTFrame& frame1, const FFTFrame& frame2, double x);
 
     void doPaddedFFT(const float* data, size_t dataSize); // zero-padding with dataSize <= fftSize
+    void multiplyAccumulate(const FFTFrame& frame1, const FFTFrame& frame2); // adds frame1 * frame2, scaled as multiply() scales
     double extractAverageGroupDelay();
     void addConstantGroupDelay(double sampleFrameDelay);
 
     size_t fftSize() const { return m_FFTSize; }
     size_t log2FFTSize() const { return m_log2FFTSize; }
+
+    // The bytes of a frame's real and imaginary halves; the working buffers some backends keep besides aren't counted.
+    static size_t memoryBytes(size_t fftSize) { return fftSize * sizeof(float); }
     
 #if USE_ACCELERATE_FFT
     static void cleanup();
@@ -89,22 +132,51 @@ private:
     DSPSplitComplex m_frame;
     AudioFloatArray m_realData;
     AudioFloatArray m_imagData;
-#else // !USE_ACCELERATE_FFT
-    
-#if defined(WEBAUDIO_KISSFFT)
-    kiss_fftr_cfg mFFT;
-    kiss_fftr_cfg mIFFT;
+#elif USE_PFFFT_FFT
+    static PFFFT_Setup * setupForSize(size_t fftSize);
+
+    PFFFT_Setup * m_setup;
 
-    kiss_fft_cpx* m_cpxInputData;
-    kiss_fft_cpx* m_cpxOutputData;
+    AudioFloatArray m_realData;
+    AudioFloatArray m_imagData;
+    AudioFloatArray m_buffer; // the ordered spectrum, or the time domain signal
+    AudioFloatArray m_work;
+#elif USE_FFTW_FFT
+    static void plansForSize(size_t fftSize, fftwf_plan & forward, fftwf_plan & inverse);
 
-    std::vector<kiss_fft_cpx> mOutputBuffer; 
+    fftwf_plan m_forwardPlan;
+    fftwf_plan m_inversePlan;
 
     AudioFloatArray m_realData;
     AudioFloatArray m_imagData;
-#endif
+    AudioFloatArray m_complexData; // fftSize / 2 + 1 interleaved bins
+    AudioFloatArray m_timeData;
+#elif USE_MKL_FFT
+    static DFTI_DESCRIPTOR_HANDLE descriptorForSize(size_t fftSize);
+
+    DFTI_DESCRIPTOR_HANDLE m_descriptor;
+
+    AudioFloatArray m_realData;
+    AudioFloatArray m_imagData;
+    AudioFloatArray m_complexData; // fftSize / 2 + 1 interleaved bins
+#elif USE_OOURA_FFT
+    static void tablesForSize(size_t fftSize, int *& ip, float *& w);
+
+    int * m_ip;
+    float * m_w;
 
-#endif // !USE_ACCELERATE_FFT
+    AudioFloatArray m_realData;
+    AudioFloatArray m_imagData;
+    AudioFloatArray m_buffer; // transformed in place
+#elif USE_KISS_FFT
+    static kiss_fftr_cfg configForSize(size_t fftSize, bool inverse);
+
+    kiss_fftr_cfg mFFT;
+    kiss_fftr_cfg mIFFT;
+
+    AudioFloatArray m_realData;
+    AudioFloatArray m_imagData;
+#endif
 };
 
 } // namespace lab
@@ -0,0 +1,35 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef FirstOrderFilter_h
+#define FirstOrderFilter_h
+
+#include <cstddef>
+
+namespace lab {
+
+// First order filter primitives over a run of frames. The state is the filter's memory from the frame before the
+// run, and is left as it is after the last. Each works in place when destP is sourceP.
+//
+// A one-pole's recurrence is run four frames at a time as a prefix scan, in which each frame of a group takes in
+// the ones before it by powers of the pole, so that it vectorises like the one-zero does. Its rounding differs from
+// the frame by frame recurrence's in the last bits.
+namespace FirstOrder {
+
+// y[n] = gain * x[n] + pole * y[n - 1]
+void onePole(const float* sourceP, float* destP, size_t framesToProcess, float pole, float gain, float& lastY);
+
+// As onePole, adding y to destP, which must not be sourceP, in place of writing it.
+void onePoleAdd(const float* sourceP, float* destP, size_t framesToProcess, float pole, float gain, float& lastY);
+
+// y[n] = b0 * x[n] + b1 * x[n - 1]
+void oneZero(const float* sourceP, float* destP, size_t framesToProcess, float b0, float b1, float& lastX);
+
+// y[n] = x[n] - x[n - 1] + pole * y[n - 1]; removes DC, with a pole just below one, such as 0.995.
+void dcBlock(const float* sourceP, float* destP, size_t framesToProcess, float pole, float& lastX, float& lastY);
+
+} // namespace FirstOrder
+
+} // namespace lab
+
+#endif // FirstOrderFilter_h
@@ -0,0 +1,72 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef FixedPoint_h
+#define FixedPoint_h
+
+#include <stdint.h>
+
+// Integer arithmetic for the LABSOUND_FIXED_POINT build, for targets whose floating point is slow or emulated.
+//
+// Buses stay float; a kernel built for fixed point converts its input to a signal on the way in and back on the
+// way out, and runs its inner loop on integers. Signals are Q27 in 32 bits, full scale 1.0 with 16 times of
+// headroom above it, so that the overs a graph may produce between its nodes survive until the destination clips.
+// Coefficients carry as many fraction bits as their magnitude leaves room for, see coefficientBits(). Products are
+// accumulated in 64 bits, and an accumulator of five of them cannot overflow.
+
+namespace lab {
+namespace fixed {
+
+const int SignalBits = 27;
+
+inline int32_t saturate(int64_t value)
+{
+    if (value > INT32_MAX)
+        return INT32_MAX;
+    if (value < INT32_MIN)
+        return INT32_MIN;
+    return static_cast<int32_t>(value);
+}
+
+// Truncates toward zero, and saturates; NaN becomes silence.
+inline int32_t fromFloat(float sample)
+{
+    const float scaled = sample * static_cast<float>(1 << SignalBits);
+    if (scaled >= 2147483520.f)
+        return INT32_MAX;
+    if (scaled > -2147483648.f)
+        return static_cast<int32_t>(scaled);
+    return scaled == scaled ? INT32_MIN : 0;
+}
+
+inline float toFloat(int32_t sample)
+{
+    return static_cast<float>(sample) * (1.f / static_cast<float>(1 << SignalBits));
+}
+
+// The fraction bits for coefficients no larger than largest, keeping each product with a signal below 2^60.
+inline int coefficientBits(double largest)
+{
+    int bits = 29;
+    while (bits > 0 && largest >= static_cast<double>(int64_t(1) << (29 - bits)))
+        --bits;
+    return bits;
+}
+
+// Rounds a coefficient to bits fraction bits; the result may need up to 64 - 29 + bits bits.
+inline int64_t quantize(double coefficient, int bits)
+{
+    const double scaled = coefficient * static_cast<double>(int64_t(1) << bits);
+    return static_cast<int64_t>(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+// Rounds an accumulator of products with coefficients of bits fraction bits back to a signal.
+inline int32_t round(int64_t accumulator, int bits)
+{
+    return saturate((accumulator + (bits ? int64_t(1) << (bits - 1) : 0)) >> bits);
+}
+
+} // namespace fixed
+} // namespace lab
+
+#endif // FixedPoint_h
@@ -6,37 +6,156 @@
 #define HRTFDatabase_h
 
 #include "LabSound/extended/Util.h"
+#include "LabSound/core/ConcurrentQueue.h"
+#include "internal/AlignedAllocation.h"
 #include "internal/HRTFElevation.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace lab {
  
+class AmbisonicDecoderFilters;
 class HRTFKernel;
-class HRTFDatabase 
+struct SpectrumCacheKey;
+
+// HRTFDatabase loads the measured kernels of every elevation up front. The interpolated kernels of the other azimuths
+// and elevations are materialized on the database's own thread the first time they, or a neighbour, are asked for,
+// and only the MaxInterpolatedKernels most recently used are kept. Until a kernel is ready, the nearest measured
+// one stands in for it.
+class HRTFDatabase : public AlignedAllocation<HRTFDatabase>
 {
     
     NO_MOVE(HRTFDatabase);
     
 public:
 
-    HRTFDatabase(float sampleRate, const std::string & searchPath);
+    // Loads the subject's responses from searchPath, from its packed database if there is one for the sample rate.
+    HRTFDatabase(float sampleRate, const std::string & searchPath, const std::string & subjectName = DefaultSubject);
+    ~HRTFDatabase();
+
+    // Returns false if any of the measured responses couldn't be loaded.
+    bool isValid() const { return m_slots != nullptr; }
+
+    // Kernels returned by getKernelsFromAzimuthElevation() remain valid while the Reader that was alive when they
+    // were returned is. Interpolated kernels that are evicted are only freed once no Reader is alive.
+    class Reader
+    {
+    public:
+        explicit Reader(HRTFDatabase & database) : m_database(database) { m_database.m_readers.fetch_add(1); }
+        ~Reader() { m_database.m_readers.fetch_sub(1); }
+
+    private:
+        HRTFDatabase & m_database;
+    };
 
     // getKernelsFromAzimuthElevation() returns a left and right ear kernel, and an interpolated left and right frame delay for the given azimuth and elevation.
     // azimuthBlend must be in the range 0 -> 1.
     // Valid values for azimuthIndex are 0 -> HRTFElevation::NumberOfTotalAzimuths - 1 (corresponding to angles of 0 -> 360).
     // Valid values for elevationAngle are MinElevation -> MaxElevation.
+    // It doesn't block or allocate, and must be called while a Reader is alive.
     void getKernelsFromAzimuthElevation(double azimuthBlend, unsigned azimuthIndex, double elevationAngle, HRTFKernel* &kernelL, HRTFKernel* &kernelR, double& frameDelayL, double& frameDelayR);
 
+    // Asks for the kernels around the azimuth and elevation to be materialized ahead of being needed, for example where a
+    // moving source is headed. It doesn't block or allocate.
+    void prefetch(unsigned azimuthIndex, double elevationAngle);
+
+    // The elevation index getKernelsFromAzimuthElevation() uses for the angle, with the fraction of the way to the next.
+    double elevationIndexFromAngle(double elevationAngle) const;
+
     // Returns the number of different azimuth angles.
     static unsigned numberOfAzimuths() { return HRTFElevation::NumberOfTotalAzimuths; }
 
+    // The most pairs of interpolated kernels kept at once. The measured kernels are always kept.
+    static const size_t MaxInterpolatedKernels;
+
+    // The number of pairs of interpolated kernels currently materialized.
+    size_t interpolatedKernelCount() const { return m_interpolatedKernelCount.load(std::memory_order_relaxed); }
+
+    // The subject of the IRCAM responses shipped with LabSound.
+    static const char * const DefaultSubject;
+
+    const std::string & subjectName() const { return info->subjectName; }
+
+    // The bytes of the measured and interpolated kernels' spectra, counting measured kernels shared between azimuths
+    // and elevations once. May be called from any thread.
+    size_t memoryBytes() const;
+
+    // Returns the filters which decode the ambisonic field of PanningMode::AMBISONIC sources to binaural, with virtual
+    // speakers at every measured azimuth and elevation, or nullptr after asking for them to be made on the database's
+    // thread. It doesn't block or allocate.
+    const AmbisonicDecoderFilters * ambisonicDecoderFilters();
+
+    // The FFT size the ambisonic decoder's responses are partitioned for.
+    static const size_t AmbisonicDecoderFFTSize;
+
 private:
 
+    // Returns false if any of the measured responses is missing. A packed database is hashed in place of the responses' files.
+    bool cacheKey(SpectrumCacheKey & key, const HRTFDatabaseFile * database);
+    bool loadFromCache(const SpectrumCacheKey & key);
+    void saveToCache(const SpectrumCacheKey & key);
+
+    struct KernelPair
+    {
+        std::shared_ptr<HRTFKernel> kernelL;
+        std::shared_ptr<HRTFKernel> kernelR;
+    };
+
+    // One per azimuth of every elevation, interpolated ones included. Measured slots are filled at load and never emptied.
+    struct Slot
+    {
+        std::atomic<KernelPair *> kernels{ nullptr };
+        std::atomic<bool> requested{ false };
+        std::atomic<uint32_t> lastUsed{ 0 };
+    };
+
+    size_t slotIndex(size_t elevationIndex, unsigned azimuthIndex) const { return elevationIndex * numberOfAzimuths() + azimuthIndex % numberOfAzimuths(); }
+    bool isMeasured(size_t slotIndex) const;
+
+    // Returns the slot's kernels, or, after requesting them, those of the nearest measured azimuth and elevation.
+    KernelPair * kernelsForSlot(size_t slotIndex);
+    void request(size_t slotIndex);
+    void wakeMaterializer();
+
+    // Called on the materializer thread.
+    void materializerEntry();
+    void materialize(size_t slotIndex);
+    void evictLeastRecentlyUsed();
+    void freeRetiredKernels();
+    void makeAmbisonicDecoderFilters();
+
+    // The measured elevations.
     std::vector<std::unique_ptr<HRTFElevation> > m_elevations;
     
     std::unique_ptr<HRTFDatabaseInfo> info;
-    
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::vector<std::unique_ptr<KernelPair>> m_measuredKernels;
+    size_t m_measuredKernelBytes = 0;
+
+    // Slots to materialize; a slot is only queued again once it has been evicted.
+    BoundedMPSCQueue<uint32_t> m_requests{ 1024 };
+
+    // Ticks once per kernel lookup, to order slots by their last use.
+    std::atomic<uint32_t> m_clock{ 0 };
+    std::atomic<int> m_readers{ 0 };
+    std::atomic<size_t> m_interpolatedKernelCount{ 0 };
+
+    std::atomic<AmbisonicDecoderFilters *> m_ambisonicDecoderFilters{ nullptr };
+    std::atomic<bool> m_ambisonicDecoderFiltersRequested{ false };
+
+    // Only touched by the materializer thread.
+    std::vector<size_t> m_interpolatedSlots;
+    std::vector<KernelPair *> m_retiredKernels;
+
+    std::mutex m_lock;
+    std::condition_variable m_work;
+    bool m_shouldRun = false;
+    std::thread m_materializer;
 };
 
 } // namespace lab
@@ -0,0 +1,77 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef HRTFDatabaseFile_h
+#define HRTFDatabaseFile_h
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab
+{
+
+class MappedFile;
+
+// A packed HRTF database holds the measured responses of both ears for every azimuth and elevation of a subject,
+// prepared for one sample rate: resampled, with the leading (average group) delay extracted, and truncated to the
+// length HRTFKernel convolves. It replaces opening and decoding a file per response with a single mapping.
+// Files are written by the LabSoundHRTFPack tool, in the native byte order.
+class HRTFDatabaseFile
+{
+public:
+    // The responses of one azimuth and elevation, each responseLength long.
+    struct Response
+    {
+        int azimuth;
+        int elevation;
+        float frameDelayL;
+        float frameDelayR;
+        std::vector<float> left;
+        std::vector<float> right;
+    };
+
+    // The packed database of the subject at the sample rate, for example "IRC_Composite_44100.hrtf".
+    static std::string pathForSubject(const std::string & searchPath, const std::string & subjectName, float sampleRate);
+
+    // Maps a packed database; returns nullptr if the file is missing or malformed.
+    static std::unique_ptr<HRTFDatabaseFile> open(const std::string & path);
+
+    // Returns false if the file can't be written, or the responses aren't all responseLength long.
+    static bool write(const std::string & path, float sampleRate, size_t fftSize, size_t responseLength, const std::vector<Response> & responses);
+
+    ~HRTFDatabaseFile();
+
+    float sampleRate() const { return m_sampleRate; }
+
+    // The FFT size of the kernels the responses were prepared for.
+    size_t fftSize() const { return m_fftSize; }
+    size_t responseLength() const { return m_responseLength; }
+
+    bool hasResponse(int azimuth, int elevation) const { return m_responses.count(std::make_pair(azimuth, elevation)) != 0; }
+
+    // Points left and right into the mapping; returns false if the file has no responses for the azimuth and elevation.
+    bool response(int azimuth, int elevation, const float * & left, const float * & right, float & frameDelayL, float & frameDelayR) const;
+
+    // The whole file, for hashing.
+    const uint8_t * data() const;
+    size_t size() const;
+
+private:
+    HRTFDatabaseFile() = default;
+
+    struct ResponseHeader;
+
+    std::unique_ptr<MappedFile> m_file;
+    float m_sampleRate = 0;
+    size_t m_fftSize = 0;
+    size_t m_responseLength = 0;
+    std::map<std::pair<int, int>, const ResponseHeader *> m_responses;
+};
+
+} // namespace lab
+
+#endif // HRTFDatabaseFile_h
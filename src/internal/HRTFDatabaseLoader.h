@@ -7,71 +7,75 @@
 
 #include "internal/HRTFDatabase.h"
 
-#include <thread>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
+#include <string>
+#include <vector>
 
 namespace lab {
 
-// HRTFDatabaseLoader will asynchronously load the default HRTFDatabase in a new thread.
-
-class HRTFDatabaseLoader {
+// HRTFDatabaseLoader asynchronously loads the HRTFDatabase of a sample rate, search path and subject in a new thread.
+// Loaders are shared: everyone asking for the same sample rate, search path and subject gets the same loader, which
+// lives for as long as any of them holds it. The loading thread holds it too until it has finished, so that
+// releasing the last reference never waits for loading.
+class HRTFDatabaseLoader
+{
     
 public:
-    // Both constructor and destructor must be called from the main thread.
-    // It's expected that the singletons will be accessed instead.
-    // @CBB the guts of the loader should be a private singleton, so that the loader can be constructed without a factory
-    explicit HRTFDatabaseLoader(float sampleRate, const std::string & searchPath);
-    
-    // Lazily creates the singleton HRTFDatabaseLoader (if not already created) and starts loading asynchronously (when created the first time).
-    // Returns the singleton HRTFDatabaseLoader.
-    // Must be called from the main thread.
-    static std::shared_ptr<HRTFDatabaseLoader> MakeHRTFLoaderSingleton(float sampleRate, const std::string & searchPath);
 
-    // Returns the singleton HRTFDatabaseLoader.
-    static std::shared_ptr<HRTFDatabaseLoader> loader() { return s_loader; }
+    // Returns the loader of the sample rate, search path and subject, creating it and starting to load if there is
+    // none. The databases of several subjects may be resident at once, for example one per listener.
+    // May be called from any thread.
+    static std::shared_ptr<HRTFDatabaseLoader> loaderFor(float sampleRate, const std::string & searchPath,
+                                                         const std::string & subjectName = HRTFDatabase::DefaultSubject);
     
-    // Both constructor and destructor must be called from the main thread.
     ~HRTFDatabaseLoader();
     
-    // Returns true once the default database has been completely loaded.
-    bool isLoaded() const;
+    // Returns true once loading has finished, whether or not the database could be loaded.
+    bool isLoaded() const { return m_finished.load(std::memory_order_acquire); }
+
+    // Returns nullptr while loading, and if the database couldn't be loaded. Never blocks.
+    HRTFDatabase * database() const { return m_database.load(std::memory_order_acquire); }
+
+    // Becomes ready, with database(), once loading has finished.
+    std::shared_future<HRTFDatabase *> loaded() const { return m_loaded; }
+
+    // Calls the callback with database() once loading has finished; on the loading thread, or right away on the calling
+    // thread if it already has.
+    void whenLoaded(std::function<void(HRTFDatabase *)> callback);
 
     // waitForLoaderThreadCompletion() may be called more than once and is thread-safe.
     void waitForLoaderThreadCompletion();
-    
-    HRTFDatabase * database() { return m_hrtfDatabase.get(); }
 
     float databaseSampleRate() const { return m_databaseSampleRate; }
-    
-    // Called in asynchronous loading thread.
-    void load();
-
-    // defaultHRTFDatabase() gives access to the loaded database.
-    // This can be called from any thread, but it is the callers responsibilty to call this while the context (and thus HRTFDatabaseLoader)
-    // is still alive.  Otherwise this will return 0.
-    static HRTFDatabase* defaultHRTFDatabase();
+    const std::string & searchPath() const { return m_searchPath; }
+    const std::string & subjectName() const { return m_subjectName; }
 
 private:
-    static void databaseLoaderEntry(HRTFDatabaseLoader* threadData);
 
-    // If it hasn't already been loaded, creates a new thread and initiates asynchronous loading of the default database.
-    // This must be called from the main thread.
-    void loadAsynchronously();
+    HRTFDatabaseLoader(float sampleRate, const std::string & searchPath, const std::string & subjectName);
+
+    // Called in asynchronous loading thread.
+    static void databaseLoaderEntry(std::shared_ptr<HRTFDatabaseLoader> loader);
+    void load();
 
-    static std::shared_ptr<HRTFDatabaseLoader> s_loader; // singleton
     std::unique_ptr<HRTFDatabase> m_hrtfDatabase;
+    std::atomic<HRTFDatabase *> m_database{ nullptr };
+    std::atomic<bool> m_finished{ false };
+
+    std::promise<HRTFDatabase *> m_promise;
+    std::shared_future<HRTFDatabase *> m_loaded;
 
-    // Holding a m_threadLock is required when accessing m_databaseLoaderThread.
-    std::mutex m_threadLock;
-    std::thread m_databaseLoaderThread;
-    std::condition_variable m_loadingCondition;
-    bool m_loading;
+    // Holding m_callbacksLock is required when accessing m_callbacks.
+    std::mutex m_callbacksLock;
+    std::vector<std::function<void(HRTFDatabase *)>> m_callbacks;
 
     float m_databaseSampleRate;
-    
-    std::string searchPath;
-    
+    std::string m_searchPath;
+    std::string m_subjectName;
 };
 
 } // namespace lab
@@ -14,7 +14,11 @@
 namespace lab
 {
 
-// HRTFElevation contains all of the HRTFKernels (one left ear and one right ear per azimuth angle) for a particular elevation.
+class HRTFDatabaseFile;
+class SpectrumCacheReader;
+class SpectrumCacheWriter;
+
+// HRTFElevation contains the measured HRTFKernels (one left ear and one right ear per azimuth angle) for a particular elevation.
 class HRTFElevation 
 {
 
@@ -22,23 +26,28 @@ public:
     
     // Loads and returns an HRTFElevation with the given HRTF database subject name and elevation from resources.
     // Normally, there will only be a single HRTF database set, but this API supports the possibility of multiple ones with different names.
-    // Interpolated azimuths will be generated based on InterpolationFactor.
+    // Only the measured azimuths are loaded; kernelsForAzimuth() interpolates the others on demand. Identical kernels
+    // are shared, see ShareKernel().
     // Valid values for elevation are -45 -> +90 in 15 degree increments.
-    static std::unique_ptr<HRTFElevation> createForSubject(HRTFDatabaseInfo * info, int elevation);
+    // The responses are read from the packed database if one is given, rather than from a file each.
+    static std::unique_ptr<HRTFElevation> createForSubject(HRTFDatabaseInfo * info, int elevation, const HRTFDatabaseFile * database = nullptr);
+
+    // Reads the kernels of an elevation written by writeToCache; returns nullptr if the cache entry doesn't have them all.
+    static std::unique_ptr<HRTFElevation> createFromCache(HRTFDatabaseInfo * info, SpectrumCacheReader & cache, int elevation);
+
+    // Writes the left and right ear kernels of every measured azimuth, with their frame delays.
+    void writeToCache(SpectrumCacheWriter & cache) const;
 
-    // Given two HRTFElevations, and an interpolation factor x: 0 -> 1, returns an interpolated HRTFElevation.
-    static std::unique_ptr<HRTFElevation> createByInterpolatingSlices(HRTFDatabaseInfo * info, HRTFElevation * hrtfElevation1, HRTFElevation * hrtfElevation2, float x);
+    // Hashes the contents of the resources createForSubject loads for the elevation; returns false if any is missing.
+    static bool hashResourcesForSubject(HRTFDatabaseInfo * info, int elevation, uint64_t & hash);
 
-    // Returns the list of left or right ear HRTFKernels for all the azimuths going from 0 to 360 degrees.
-    HRTFKernelList * kernelListL() { return m_kernelListL.get(); }
-    HRTFKernelList * kernelListR() { return m_kernelListR.get(); }
+    // Returns the left and right kernels for the azimuth index, 0 -> NumberOfTotalAzimuths - 1. Those of a measured azimuth
+    // are shared, and those of the others are interpolated from the two measured azimuths around it.
+    void kernelsForAzimuth(unsigned azimuthIndex, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR) const;
+
+    static bool isMeasuredAzimuth(unsigned azimuthIndex) { return !(azimuthIndex % InterpolationFactor); }
 
     double elevationAngle() const { return m_elevationAngle; }
-    unsigned numberOfAzimuths() const { return NumberOfTotalAzimuths; }
-    
-    // Returns the left and right kernels for the given azimuth index.
-    // The interpolated delays based on azimuthBlend: 0 -> 1 are returned in frameDelayL and frameDelayR.
-    void getKernelsFromAzimuth(double azimuthBlend, unsigned azimuthIndex, HRTFKernel * & kernelL, HRTFKernel * & kernelR, double & frameDelayL, double & frameDelayR);
     
     // Spacing, in degrees, between every azimuth loaded from resource.
     static const unsigned AzimuthSpacing;
@@ -56,15 +65,20 @@ public:
     // Valid values for azimuth are 0 -> 345 in 15 degree increments.
     // Valid values for elevation are -45 -> +90 in 15 degree increments.
     // Returns true on success.
-    static bool calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR);
+    static bool calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR,
+                                                    const HRTFDatabaseFile * database = nullptr);
 
     // Given a specific azimuth and elevation angle, returns the left and right HRTFKernel in kernelL and kernelR.
     // This method averages the measured response using symmetry of azimuth (for example by averaging the -30.0 and +30.0 azimuth responses).
     // Returns true on success.
-    static bool calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR);
+    static bool calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR,
+                                                             const HRTFDatabaseFile * database = nullptr);
 
 private:
 
+    // The resource with the responses of both ears for the azimuth and elevation
+    static std::string resourceName(HRTFDatabaseInfo * info, int azimuth, int elevation);
+
     HRTFElevation(HRTFDatabaseInfo * info, std::unique_ptr<HRTFKernelList> kernelListL, std::unique_ptr<HRTFKernelList> kernelListR, int elevation)
     : m_kernelListL(std::move(kernelListL))
     , m_kernelListR(std::move(kernelListR))
@@ -72,6 +86,7 @@ private:
     {
     }
 
+    // The kernels of the measured azimuths, NumberOfRawAzimuths of each.
     std::unique_ptr<HRTFKernelList> m_kernelListL;
     std::unique_ptr<HRTFKernelList> m_kernelListR;
     
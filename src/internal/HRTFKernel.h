@@ -24,6 +24,10 @@ public:
     // Note: this is destructive on the passed in AudioChannel.
     // The length of channel must be a power of two.
     HRTFKernel(AudioChannel *, size_t fftSize, float sampleRate);
+
+    // Takes a response whose leading delay, frameDelay, has already been extracted, such as one of a packed HRTF database.
+    // Only the first fftSize / 2 frames of the response are used.
+    HRTFKernel(const float * response, size_t responseLength, float frameDelay, size_t fftSize, float sampleRate);
     
     HRTFKernel(std::unique_ptr<FFTFrame> fftFrame, float frameDelay, float sampleRate) : m_fftFrame(std::move(fftFrame)) , m_frameDelay(frameDelay), m_sampleRate(sampleRate)
     {
@@ -39,8 +43,15 @@ public:
 
     float sampleRate() const { return m_sampleRate; }
 
+    // Removes the leading delay from the first analysisFFTSize frames of the channel in place, and returns it.
+    // The length of the channel must be at least analysisFFTSize, which must be a power of two.
+    static float extractAverageGroupDelay(AudioChannel *, size_t analysisFFTSize);
+
 private:
 
+    // Fades out and transforms the delay-removed response, which is destructive on it.
+    void initializeFrame(float * impulseResponse, size_t responseLength, size_t fftSize);
+
     // Note: this is destructive on the passed in AudioChannel.
     std::unique_ptr<FFTFrame> m_fftFrame;
     float m_frameDelay;
@@ -52,6 +63,12 @@ typedef std::vector<std::shared_ptr<HRTFKernel> > HRTFKernelList;
 // Given two HRTFKernels, and an interpolation factor x: 0 -> 1, returns an interpolated HRTFKernel.
 std::unique_ptr<HRTFKernel> MakeInterpolatedKernel(HRTFKernel * kernel1, HRTFKernel * kernel2, float x);
 
+// Returns a kernel alive elsewhere in the process with the same spectrum, frame delay and sample rate as kernel, or
+// kernel itself, which is then shared in turn. Databases share their measured kernels this way: a subject's
+// responses clamped to the same elevation, subjects with responses in common, and the databases of several contexts.
+// Shared kernels must not be modified. May be called from any thread; it locks, so not from the render thread.
+std::shared_ptr<HRTFKernel> ShareKernel(std::shared_ptr<HRTFKernel> kernel);
+
 } // namespace lab
 
 #endif // HRTFKernel_h
@@ -12,18 +12,24 @@
 namespace lab 
 {
 
+class HRTFDatabaseLoader;
+
 class HRTFPanner : public Panner
 {
 
 public:
 
-    HRTFPanner(const float sampleRate);
+    // Pans with the loader's database once it has been loaded, and outputs silence until then.
+    HRTFPanner(const float sampleRate, std::shared_ptr<HRTFDatabaseLoader> loader);
     virtual ~HRTFPanner();
 
     // Panner
     virtual void pan(ContextRenderLock &, double azimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess) override;
     virtual void reset() override;
 
+    // Asks the database for the kernels of an azimuth and elevation the source is expected to reach soon.
+    void prefetch(double azimuth, double elevation);
+
     uint32_t fftSize() const { return fftSizeForSampleRate(m_sampleRate); }
     static uint32_t fftSizeForSampleRate(float sampleRate);
 
@@ -32,6 +38,9 @@ public:
 
 private:
 
+    // Pans quanta of at least RenderingQuantum frames, a segment of RenderingQuantum at a time.
+    void panSegments(ContextRenderLock &, double azimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess);
+
     // Given an azimuth angle in the range -180 -> +180, returns the corresponding azimuth index for the database,
     // and azimuthBlend which is an interpolation value from 0 -> 1.
     int calculateDesiredAzimuthIndexAndBlend(double azimuth, double& azimuthBlend);
@@ -81,6 +90,14 @@ private:
     AudioFloatArray m_tempR1;
     AudioFloatArray m_tempL2;
     AudioFloatArray m_tempR2;
+
+    // The segment being gathered from quanta smaller than RenderingQuantum, and the one panned before it, which
+    // is played meanwhile, both from m_segmentPosition on.
+    std::unique_ptr<AudioBus> m_segmentInput;
+    std::unique_ptr<AudioBus> m_segmentOutput;
+    size_t m_segmentPosition = 0;
+
+    std::shared_ptr<HRTFDatabaseLoader> m_databaseLoader;
 };
 
 } // namespace lab
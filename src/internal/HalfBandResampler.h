@@ -0,0 +1,70 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef HalfBandResampler_h
+#define HalfBandResampler_h
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioNode.h"
+
+#include <vector>
+
+namespace lab
+{
+
+// Stages doubling and halving the sample rate through a Kaiser windowed half-band lowpass. Every other tap of a
+// half-band filter is zero but the center's, so each stage is run as two polyphase branches: one is a delay, and
+// only the other is filtered, with sideTaps coefficients mirrored about the center. The filter is flat to 0.4 of
+// the lower rate for 12 side taps, and rejects 80dB from 0.6 of it. State is kept from block to block.
+
+class HalfBandUpSampler
+{
+public:
+
+    HalfBandUpSampler(size_t sideTaps, size_t blockSize = AudioNode::ProcessingSizeInFrames);
+
+    // Writes twice framesToProcess frames to destination, which mustn't be source.
+    void process(const float * source, float * destination, size_t framesToProcess);
+    void reset();
+
+    // In frames at the lower rate.
+    size_t latencyFrames() const { return m_sideTaps; }
+
+private:
+
+    std::vector<float> m_coefficients;
+    size_t m_sideTaps;
+    size_t m_blockSize;
+
+    // The input, following the frames from earlier blocks that the filter still reads.
+    AudioFloatArray m_input;
+    AudioFloatArray m_odd;
+};
+
+class HalfBandDownSampler
+{
+public:
+
+    HalfBandDownSampler(size_t sideTaps, size_t blockSize = AudioNode::ProcessingSizeInFrames);
+
+    // Reads twice framesToProcess frames from source and writes framesToProcess to destination, which may be source.
+    void process(const float * source, float * destination, size_t framesToProcess);
+    void reset();
+
+    // In frames at the lower rate.
+    size_t latencyFrames() const { return m_sideTaps - 1; }
+
+private:
+
+    std::vector<float> m_coefficients;
+    size_t m_sideTaps;
+    size_t m_blockSize;
+
+    // The even and odd input frames, each following the frames from earlier blocks that the filter still reads.
+    AudioFloatArray m_even;
+    AudioFloatArray m_odd;
+};
+
+} // namespace lab
+
+#endif // HalfBandResampler_h
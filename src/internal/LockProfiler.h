@@ -0,0 +1,118 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef LockProfiler_h
+#define LockProfiler_h
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace lab {
+
+// The acquisitions of a lock by one holder, see AudioContext::setLockProfiling(). Written only by the thread that
+// holds the lock, as it releases it, so writers never race, and read by AudioContext::lockProfile() without
+// synchronization; the statistics may be an acquisition apart from each other.
+struct LockHolderRecord
+{
+    // Times are counted in buckets an octave wide; bucket b holds the times from 2^(b - 1) ticks up to 2^b.
+    static const int BucketCount = 64;
+
+    static int bucket(uint64_t ticks)
+    {
+        if (!ticks)
+            return 0;
+#if defined(_MSC_VER)
+        unsigned long msb;
+        _BitScanReverse64(&msb, ticks);
+        return static_cast<int>(msb) + 1 < BucketCount ? static_cast<int>(msb) + 1 : BucketCount - 1;
+#else
+        const int msb = 63 - __builtin_clzll(ticks);
+        return msb + 1 < BucketCount ? msb + 1 : BucketCount - 1;
+#endif
+    }
+
+    static double bucketLowTicks(int bucket) { return bucket ? static_cast<double>(uint64_t(1) << (bucket - 1)) : 0.0; }
+
+    // Clears a record last written in an earlier period, as it is first written in this one.
+    void beginEpoch(uint32_t currentEpoch)
+    {
+        if (epoch.load(std::memory_order_relaxed) == currentEpoch)
+            return;
+
+        for (auto * counter : { &acquisitions, &contended, &waitTicks, &maxWaitTicks, &holdTicks, &maxHoldTicks,
+                                &blockedOthers, &blockedOthersTicks, &maxBlockedOthersTicks })
+            counter->store(0, std::memory_order_relaxed);
+        for (int b = 0; b < BucketCount; ++b)
+        {
+            waitHistogram[b].store(0, std::memory_order_relaxed);
+            holdHistogram[b].store(0, std::memory_order_relaxed);
+        }
+        epoch.store(currentEpoch, std::memory_order_release);
+    }
+
+    static void add(std::atomic<uint64_t> & counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void raise(std::atomic<uint64_t> & counter, uint64_t value)
+    {
+        if (value > counter.load(std::memory_order_relaxed))
+            counter.store(value, std::memory_order_relaxed);
+    }
+
+    // The suitor string naming the holder, claimed once and never changed.
+    std::atomic<const char *> holder{ nullptr };
+
+    std::atomic<uint32_t> epoch{ 0 };
+    std::atomic<uint64_t> acquisitions{ 0 };
+    std::atomic<uint64_t> contended{ 0 };
+    std::atomic<uint64_t> waitTicks{ 0 };
+    std::atomic<uint64_t> maxWaitTicks{ 0 };
+    std::atomic<uint64_t> holdTicks{ 0 };
+    std::atomic<uint64_t> maxHoldTicks{ 0 };
+    std::atomic<uint64_t> blockedOthers{ 0 };
+    std::atomic<uint64_t> blockedOthersTicks{ 0 };
+    std::atomic<uint64_t> maxBlockedOthersTicks{ 0 };
+    std::atomic<uint64_t> waitHistogram[BucketCount] = {};
+    std::atomic<uint64_t> holdHistogram[BucketCount] = {};
+};
+
+// The holders of one lock, found by the address of their suitor string. Holders beyond the table's size share
+// the last record.
+struct LockProfileRecords
+{
+    static const int MaxHolders = 64;
+
+    LockHolderRecord & recordFor(const char * holder)
+    {
+        const uint64_t hash = (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(holder)) >> 3) * 0x9E3779B97F4A7C15ull;
+        for (int i = 0; i < MaxHolders - 1; ++i)
+        {
+            LockHolderRecord & record = holders[(hash + i) % (MaxHolders - 1)];
+            const char * claimed = record.holder.load(std::memory_order_relaxed);
+            if (claimed == holder)
+                return record;
+            if (!claimed)
+            {
+                record.holder.store(holder, std::memory_order_release);
+                return record;
+            }
+        }
+
+        LockHolderRecord & overflow = holders[MaxHolders - 1];
+        overflow.holder.store("(other holders)", std::memory_order_release);
+        return overflow;
+    }
+
+    LockHolderRecord holders[MaxHolders];
+};
+
+} // namespace lab
+
+#endif // LockProfiler_h
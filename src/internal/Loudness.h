@@ -0,0 +1,85 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef Loudness_h
+#define Loudness_h
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/AudioBus.h"
+
+#include "internal/Biquad.h"
+
+#include <limits>
+#include <vector>
+
+namespace lab {
+
+// The pieces of ITU-R BS.1770 loudness measurement shared by PowerMonitorNode's meter and the file loader.
+namespace Loudness
+{
+    // Blocks are gated absolutely at -70 LUFS, then 10 LU below the mean of those that pass.
+    const double AbsoluteGate = -70;
+    const double RelativeGate = -10;
+
+    // Integrated loudness is gated over 400ms windows of four 100ms blocks, overlapping by 300ms.
+    const size_t WindowBlocks = 4;
+
+    const float Silence = -std::numeric_limits<float>::infinity();
+
+    // The loudness of a weighted mean square, in LUFS.
+    float loudness(double meanSquare);
+
+    // The channel weights: the surround channels count for 1.41, and the LFE not at all.
+    double channelWeight(size_t channel, size_t channelCount);
+
+    // The frames of a 100ms block at the sample rate.
+    size_t blockFrames(float sampleRate);
+
+    // The K-weighting filters, a high shelf modelling the head and a highpass, designed for the sample rate as in
+    // the annex of BS.1770.
+    void designKWeighting(float sampleRate, Biquad & shelf, Biquad & highpass);
+}
+
+// Measures a whole signal as it's produced, a span at a time: its sample peak, its RMS over every sample of every
+// channel, and its integrated loudness, exactly gated over the 100ms blocks the signal completes. Up to
+// MaxChannels channels are measured.
+class LoudnessAnalyzer
+{
+public:
+
+    static const size_t MaxChannels = 8;
+
+    // The longest span analyze() takes at once; longer ones are taken in pieces.
+    static const size_t SpanFrames = 4096;
+
+    // expectedFrames, if known, reserves the blocks up front.
+    LoudnessAnalyzer(float sampleRate, size_t channelCount, size_t expectedFrames = 0);
+
+    // The next frames of a channel. Every channel is given the same frames before advance() moves past them.
+    void analyze(size_t channel, const float * source, size_t frames);
+    void advance(size_t frames);
+
+    AudioBusLoudness result() const;
+
+private:
+
+    size_t m_channelCount;
+    size_t m_blockFrames;
+    size_t m_block = 0;
+    size_t m_blockPosition = 0;
+
+    Biquad m_shelves[MaxChannels];
+    Biquad m_highpasses[MaxChannels];
+    AudioFloatArray m_weighted;
+
+    // The weighted sums of the squares of each block's K-weighted samples.
+    std::vector<double> m_blockEnergies;
+
+    float m_peak = 0;
+    double m_sumOfSquares = 0;
+    uint64_t m_samples = 0;
+};
+
+} // namespace lab
+
+#endif // Loudness_h
@@ -0,0 +1,34 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace lab {
+
+// A read only mapping of a whole file, which is unmapped when destroyed.
+class MappedFile
+{
+public:
+    // Returns nullptr if the file can't be opened, is empty, or can't be mapped.
+    static std::unique_ptr<MappedFile> open(const std::string& path);
+    ~MappedFile();
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(m_data); }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(void* data, size_t size) : m_data(data), m_size(size) {}
+
+    void* m_data;
+    size_t m_size;
+};
+
+} // namespace lab
+
+#endif // MappedFile_h
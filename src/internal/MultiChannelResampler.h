@@ -13,14 +13,26 @@
 namespace lab {
     
 class AudioBus;
-class ContextRenderLock;
     
 class MultiChannelResampler {
 public:   
-    MultiChannelResampler(double scaleFactor, unsigned numberOfChannels);
+    // blockSize is the number of frames the provider is asked for at a time, see SincResampler.
+    MultiChannelResampler(double scaleFactor, unsigned numberOfChannels, size_t blockSize = 512);
+    ~MultiChannelResampler();
     
     // Process given AudioSourceProvider for streaming applications.
-    void process(ContextRenderLock&, AudioSourceProvider*, AudioBus* destination, size_t framesToProcess);
+    void process(AudioSourceProvider*, AudioBus* destination, size_t framesToProcess);
+
+    // The most source frames asked for before the output they contribute to is produced.
+    size_t latencyFrames() const { return m_kernels.front()->latencyFrames(); }
+
+    // See SincResampler::setScaleFactor().
+    void setScaleFactor(double scaleFactor);
+
+    // Converts all of source into destination, which has as many channels and source's length / scaleFactor frames,
+    // as SincResampler::process() would one channel at a time. The channels of a long source are cut into ranges
+    // that are converted on up to threadCount threads, the calling thread among them; zero means one for each core.
+    static void convert(const AudioBus & source, AudioBus & destination, double scaleFactor, size_t threadCount = 0);
 
 private:
     // FIXME: the mac port can have a more highly optimized implementation based on CoreAudio
@@ -29,6 +41,12 @@ private:
     
     // Each channel will be resampled using a high-quality SincResampler.
     std::vector<std::unique_ptr<SincResampler> > m_kernels;
+
+    // The provider's multi-channel audio, pulled by the first kernel and read again by the others, the bus the
+    // provider fills, wrapping part of it, and the number of frames of each pull.
+    std::unique_ptr<AudioBus> m_multiChannelBus;
+    std::unique_ptr<AudioBus> m_pullBus;
+    std::vector<size_t> m_pulls;
     
     unsigned m_numberOfChannels;
 };
@@ -0,0 +1,115 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef NodeProfiler_h
+#define NodeProfiler_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace lab {
+
+class AudioNode;
+
+// A cheap, monotonic tick count: the time stamp counter on x86, the virtual counter on ARM64, and the steady clock
+// elsewhere. Ticks are converted to seconds by comparing them with the steady clock over the profiling period.
+inline uint64_t ProfileTicks()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// The render times of a node. Written by whichever thread processes the node, one at a time, and read by
+// AudioContext::profile() without synchronization; the statistics may be a call apart from each other.
+struct NodeProfileRecord
+{
+    // Times are counted in buckets a quarter of an octave wide.
+    static const int SubBuckets = 4;
+    static const int BucketCount = 64 * SubBuckets;
+
+    static int bucket(uint64_t ticks)
+    {
+        if (ticks < SubBuckets)
+            return static_cast<int>(ticks);
+
+#if defined(_MSC_VER)
+        unsigned long msb;
+        _BitScanReverse64(&msb, ticks);
+#else
+        const int msb = 63 - __builtin_clzll(ticks);
+#endif
+        const int sub = static_cast<int>(ticks >> (msb - 2)) & (SubBuckets - 1);
+        return (static_cast<int>(msb) - 1) * SubBuckets + sub;
+    }
+
+    // The middle of the bucket's range of ticks.
+    static double bucketTicks(int bucket)
+    {
+        if (bucket < SubBuckets)
+            return bucket;
+
+        const int msb = bucket / SubBuckets + 1;
+        const double low = static_cast<double>((SubBuckets + bucket % SubBuckets) * (uint64_t(1) << (msb - 2)));
+        return low + 0.5 * static_cast<double>(uint64_t(1) << (msb - 2));
+    }
+
+    // Called by the thread that processed the node. A record last written in an earlier epoch is cleared first.
+    void record(uint64_t ticks, uint32_t currentEpoch)
+    {
+        if (epoch.load(std::memory_order_relaxed) != currentEpoch)
+        {
+            calls.store(0, std::memory_order_relaxed);
+            totalTicks.store(0, std::memory_order_relaxed);
+            minTicks.store(UINT64_MAX, std::memory_order_relaxed);
+            maxTicks.store(0, std::memory_order_relaxed);
+            for (auto & count : histogram)
+                count.store(0, std::memory_order_relaxed);
+            epoch.store(currentEpoch, std::memory_order_release);
+        }
+
+        calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalTicks.store(totalTicks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+        if (ticks < minTicks.load(std::memory_order_relaxed))
+            minTicks.store(ticks, std::memory_order_relaxed);
+        if (ticks > maxTicks.load(std::memory_order_relaxed))
+            maxTicks.store(ticks, std::memory_order_relaxed);
+        std::atomic<uint32_t> & count = histogram[bucket(ticks)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Set by the graph update when the node is first scheduled, and only touched there.
+    bool registered = false;
+    std::string type;
+    const AudioNode * node = nullptr;
+
+    std::atomic<uint32_t> epoch{ 0 };
+    std::atomic<uint64_t> calls{ 0 };
+    std::atomic<uint64_t> totalTicks{ 0 };
+    std::atomic<uint64_t> minTicks{ UINT64_MAX };
+    std::atomic<uint64_t> maxTicks{ 0 };
+    std::atomic<uint32_t> histogram[BucketCount] = {};
+};
+
+// The node's class name, without its namespace.
+std::string NodeTypeName(const AudioNode & node);
+
+} // namespace lab
+
+#endif // NodeProfiler_h
@@ -0,0 +1,57 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef NullAudioDestination_h
+#define NullAudioDestination_h
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioDeviceSettings.h"
+
+#include "internal/AudioDestination.h"
+
+#include <atomic>
+#include <thread>
+
+namespace lab {
+
+struct AudioIOCallback;
+
+// Renders without any hardware, from a thread of its own paced by the steady clock, as AudioDeviceSettings'
+// Null backend. Each quantum is rendered once it falls due, or up to nullLookahead seconds before, and handed
+// to nullOutput. Should the thread fall more than a second behind, such as when the process was suspended, it
+// skips ahead rather than rendering the backlog, and counts the skip.
+class NullAudioDestination : public AudioDestination
+{
+public:
+
+    NullAudioDestination(AudioIOCallback &, size_t numChannels, float sampleRate, size_t framesPerBuffer, const AudioDeviceSettings & settings);
+    virtual ~NullAudioDestination();
+
+    virtual void start() override;
+    virtual void stop() override;
+
+    float sampleRate() const override { return m_sampleRate; }
+    double baseLatency() const override { return m_lookahead; }
+
+    uint64_t skipCount() const { return m_skips.load(std::memory_order_relaxed); }
+
+private:
+
+    void renderEntry();
+
+    AudioIOCallback & m_callback;
+    float m_sampleRate;
+    size_t m_framesPerBuffer;
+    double m_lookahead;
+    std::function<void(const AudioBus &, uint64_t)> m_output;
+
+    AudioBus m_renderBus;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running{ false };
+    std::atomic<uint64_t> m_skips{ 0 };
+};
+
+} // namespace lab
+
+#endif // NullAudioDestination_h
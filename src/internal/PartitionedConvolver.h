@@ -0,0 +1,119 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef PartitionedConvolver_h
+#define PartitionedConvolver_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include "internal/FFTFrame.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lab {
+
+// Convolves with a response split into partitions of fftSize / 2 frames. The spectra of the most recent input
+// blocks are kept in a frequency domain delay line, and each output block is the sum of their products with the
+// partitions' spectra, so a block costs one forward and one inverse FFT however long the response is. Only the
+// newest partition depends on the block's own input; the products of the older ones are accumulated a few at a
+// time over the calls leading up to the block's FFT, which keeps the cost of each call nearly flat.
+//
+// A convolver may also have several inputs and outputs, connected by paths which each have their own response.
+// Each input's delay line is shared by all of its paths, and the paths into an output are summed in the frequency
+// domain, so a block costs one forward FFT per input and one inverse FFT per output.
+class PartitionedConvolver {
+public:
+    typedef std::vector<std::unique_ptr<FFTFrame>> Partitions;
+
+    // The response from an input to an output of the convolver.
+    struct Path
+    {
+        size_t input;
+        size_t output;
+        const Partitions* partitions;
+    };
+
+    // Transforms a response split into partitions of fftSize / 2 frames, the last one zero padded.
+    // fftSize must be a power of two
+    static Partitions partitionResponse(size_t fftSize, const float* response, size_t responseLength);
+
+    // The partitions are not copied, and must outlive the convolver; any number of convolvers may share them.
+    explicit PartitionedConvolver(const Partitions& partitions);
+
+    // The responses of all of the paths must have the same FFT size and number of partitions.
+    PartitionedConvolver(size_t numberOfInputs, size_t numberOfOutputs, const std::vector<Path>& paths);
+
+    // As with FFTConvolver, framesToProcess must divide fftSize / 2 or be a multiple of it, and the input to
+    // output latency is equal to fftSize / 2. Processing in-place is allowed.
+    void process(const float* sourceP, float* destP, size_t framesToProcess);
+
+    // Takes one source per input and one destination per output.
+    void process(const float* const* sources, float* const* destinations, size_t framesToProcess);
+
+    void reset();
+
+    // Forgets the input so far, as if it had been silent, without moving the convolver's place in its blocks.
+    void clearHistory();
+
+    // Skips the multiply-adds of the partitions at or past count, all but the first, cutting the response
+    // short. The input's spectra are kept regardless, so raised again, the partitions are heard at once.
+    void setPartitionLimit(size_t count) { m_partitionLimit = std::max<size_t>(count, 1); }
+
+    size_t fftSize() const { return m_fftSize; }
+    size_t partitionCount() const { return m_partitionCount; }
+
+    // The bytes of the inputs' spectra and the buffers; the partitions of the responses aren't the convolver's.
+    size_t memoryBytes() const;
+
+private:
+    struct Input
+    {
+        explicit Input(size_t fftSize);
+
+        // One spectrum per partition, as a ring in which the convolver's m_newestSpectrum is the last block's.
+        Partitions spectra;
+
+        // Buffer input until we get fftSize / 2 samples then do an FFT; the 2nd half is always zeroed
+        AudioFloatArray buffer;
+    };
+
+    struct Output
+    {
+        explicit Output(size_t fftSize);
+
+        // The spectrum of the next output block, complete up to the convolver's m_nextPartition.
+        FFTFrame accumulator;
+
+        // Stores output which we read a little at a time
+        AudioFloatArray buffer;
+
+        // Saves the 2nd half of the FFT buffer, so we can do an overlap-add with the 1st half of the next one
+        AudioFloatArray lastOverlap;
+    };
+
+    void initialize(size_t numberOfInputs, size_t numberOfOutputs);
+
+    // Accumulates the products of the older partitions, up to but not including endPartition.
+    void accumulatePartitions(size_t endPartition);
+
+    void clearAccumulators();
+
+    size_t m_fftSize;
+    size_t m_partitionCount;
+
+    std::vector<Path> m_paths;
+    std::vector<std::unique_ptr<Input>> m_inputs;
+    std::vector<std::unique_ptr<Output>> m_outputs;
+
+    size_t m_newestSpectrum;
+    size_t m_nextPartition;
+    size_t m_readWriteIndex;
+    size_t m_partitionLimit = SIZE_MAX;
+};
+
+} // namespace lab
+
+#endif // PartitionedConvolver_h
@@ -0,0 +1,151 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef PreparedImpulse_h
+#define PreparedImpulse_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include "internal/FFTFrame.h"
+#include "internal/PartitionedConvolver.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lab {
+
+class AudioBus;
+class SpectrumCacheReader;
+class SpectrumCacheWriter;
+struct SpectrumCacheKey;
+
+// The kernel of one ReverbConvolverStage: a section of an impulse response channel, transformed for the
+// convolver that will process it. Exactly one of the kernels is set.
+struct PreparedStage
+{
+    size_t offset;
+    size_t length;
+    size_t fftSize;
+    bool background; // processed by the background workers rather than in the real-time thread
+
+    std::unique_ptr<AudioFloatArray> directKernel;   // the leading frames, convolved in the time domain
+    PartitionedConvolver::Partitions partitions;     // one or more partitions of fftSize / 2 frames
+};
+
+// Connects an input of a matrix convolution to one of its outputs, through a channel of the impulse response.
+struct ConvolutionRoute
+{
+    size_t input;
+    size_t output;
+    size_t channel;
+};
+
+// PreparedImpulse splits each channel of an impulse response into the stages of a ReverbConvolver and
+// transforms them once. Any number of convolvers may share it, each keeping only its own input, overlap and
+// accumulation buffers.
+//
+// The constructor transforms the head of the response and returns, leaving the rest of the partitions to
+// threads of its own, which take them in order of their place in the response. The response is usable as far
+// as preparedLength(), which convolvers treat like a tail limit, so a long response is heard at once, and its
+// tail joins as it's transformed. Once the whole response is prepared, it's immutable.
+class PreparedImpulse
+{
+public:
+    enum
+    {
+        // The first FFT stage has this size; successive stages double in size until they reach the maximum
+        MinFFTSize = 128,
+
+        // Don't exceed this FFT size for the stages which run in the real-time thread
+        MaxRealtimeFFTSize = 2048,
+
+        // With background threads, only this leading portion of the response is processed in the real-time thread.
+        // The background stages then have about 278msec @ 44.1KHz of scheduling slack.
+        RealtimeFrameLimit = 8192 + 4096,
+    };
+
+    // maxFFTSize can be adjusted (from say 2048 to 32768) depending on how much precision is necessary.
+    // If normalize is set, the kernels are scaled to calibrate the perceived volume of the reverb.
+    // If offline is set, the stages in the real-time thread grow to maxFFTSize rather than MaxRealtimeFFTSize, so
+    // a long response's tail is convolved in far fewer, larger partitions. That's much less work per frame, but
+    // the quantum in which each large block completes takes all of its transforms, which only an offline render
+    // can afford.
+    PreparedImpulse(std::shared_ptr<AudioBus> impulseResponse, size_t maxFFTSize, bool useBackgroundThreads, bool normalize, bool offline = false);
+    ~PreparedImpulse();
+
+    // The frames from the start of the response whose stages and partitions are ready. May be called from any thread.
+    size_t preparedLength() const { return m_preparedLength.load(std::memory_order_acquire); }
+
+    // Blocks until the whole response is prepared.
+    void waitUntilPrepared();
+
+    const std::shared_ptr<AudioBus> & impulseResponse() const { return m_impulseResponse; }
+
+    // The bytes of the stages' kernels, as transformed or to be, not counting the response they're made from.
+    // May be called from any thread.
+    size_t memoryBytes() const;
+
+    size_t numberOfChannels() const { return m_channels.size(); }
+    size_t length() const { return m_length; }
+    bool useBackgroundThreads() const { return m_useBackgroundThreads; }
+    bool offline() const { return m_offline; }
+
+    // Every channel has the same stages, differing only in their kernels.
+    const std::vector<PreparedStage> & stages(size_t channel) const { return m_channels[channel]; }
+
+    // The routes of a matrix of numberOfInputs by numberOfOutputs responses, in which the response from input i to
+    // output o is channel i * numberOfOutputs + o. A true stereo response (LL, LR, RL, RR) is a 2 by 2 matrix, and
+    // the responses of an Ambisonic B-format room to a mono source a 1 by 4 one.
+    static std::vector<ConvolutionRoute> matrixRoutes(size_t numberOfInputs, size_t numberOfOutputs);
+
+private:
+
+    static SpectrumCacheKey cacheKey(AudioBus* impulseResponse, size_t maxFFTSize, bool useBackgroundThreads, bool offline, float scale);
+
+    // Prepares every channel, reading the partitions from cached if it is set, or else leaving them to be
+    // transformed. Returns false, preparing nothing, if the cached entry doesn't match the stages.
+    bool prepareChannels(size_t maxFFTSize, float scale, SpectrumCacheReader* cached);
+
+    static std::vector<PreparedStage> prepareChannel(const float* response, size_t responseLength, size_t maxFFTSize, bool useBackgroundThreads, bool offline,
+                                                     SpectrumCacheReader* cached);
+
+    // A partition of every channel, to be transformed.
+    struct Transform
+    {
+        size_t stage;
+        size_t partition;
+        size_t end; // where the partition ends in the response
+    };
+
+    void startTransforms();
+    void transform(size_t index);
+    void transformEntry();
+
+    std::shared_ptr<AudioBus> m_impulseResponse;
+    std::vector<std::vector<PreparedStage>> m_channels;
+    size_t m_length;
+    bool m_useBackgroundThreads;
+    bool m_offline;
+    float m_scale;
+
+    std::vector<Transform> m_transforms;
+    std::atomic<size_t> m_nextTransform{ 0 };
+    std::atomic<size_t> m_preparedLength{ 0 };
+    std::atomic<bool> m_cancelled{ false };
+    std::vector<std::thread> m_workers;
+
+    // Guard the transforms' completion, and the cache entry written once they're all done.
+    std::mutex m_progressLock;
+    std::condition_variable m_prepared;
+    std::vector<bool> m_transformed;
+    size_t m_preparedTransforms = 0; // complete in order
+    std::unique_ptr<SpectrumCacheWriter> m_cache;
+};
+
+} // namespace lab
+
+#endif // PreparedImpulse_h
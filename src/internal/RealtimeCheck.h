@@ -0,0 +1,36 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef RealtimeCheck_h
+#define RealtimeCheck_h
+
+// LABSOUND_REALTIME_SCOPE() marks the calling thread as rendering until the end of the scope, so that
+// allocations and locks made meanwhile are recorded; see lab::AudioRealtimeCheck. Scopes may nest. Without
+// LABSOUND_RT_CHECK it compiles away.
+#if defined(LABSOUND_RT_CHECK)
+#define LABSOUND_REALTIME_CONCAT2(a, b) a##b
+#define LABSOUND_REALTIME_CONCAT(a, b) LABSOUND_REALTIME_CONCAT2(a, b)
+#define LABSOUND_REALTIME_SCOPE() lab::RealtimeScope LABSOUND_REALTIME_CONCAT(realtimeScope, __LINE__)
+#else
+#define LABSOUND_REALTIME_SCOPE() ((void) 0)
+#endif
+
+namespace lab {
+
+void RealtimeScopeEnter();
+void RealtimeScopeLeave();
+
+class RealtimeScope
+{
+public:
+
+    RealtimeScope() { RealtimeScopeEnter(); }
+    ~RealtimeScope() { RealtimeScopeLeave(); }
+
+    RealtimeScope(const RealtimeScope &) = delete;
+    RealtimeScope & operator=(const RealtimeScope &) = delete;
+};
+
+} // namespace lab
+
+#endif // RealtimeCheck_h
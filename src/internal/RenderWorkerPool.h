@@ -0,0 +1,80 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef RenderWorkerPool_h
+#define RenderWorkerPool_h
+
+#include "LabSound/core/AudioThreadPolicy.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lab {
+
+// RenderWorkerPool processes the independent items of one level of the render schedule on a fixed set of
+// worker threads. The thread calling run() (the audio thread) takes part as participant zero, and run()
+// returns only once every item has completed, which is the barrier between dependency levels.
+//
+// Each participant is dealt a contiguous range of the level. It takes items from the front of its own
+// range, and once that is exhausted steals from the back of the other participants' ranges.
+class RenderWorkerPool
+{
+public:
+
+    typedef void (*Task)(void * userData, size_t index);
+
+    // Each worker applies policy to itself as it starts, pinned to the policy's cores in turn.
+    RenderWorkerPool(size_t workerCount, const AudioThreadPolicy & policy, double quantumSeconds);
+    ~RenderWorkerPool();
+
+    size_t workerCount() const { return m_workers.size(); }
+
+    // The AudioThreadPolicy::Failure mask of the workers started so far.
+    unsigned policyFailures() const { return m_policyFailures.load(); }
+
+    // Calls task(userData, i) for every i in [0, count) and blocks until all calls have returned.
+    // Must only be called from one thread at a time. Does not allocate.
+    void run(Task task, void * userData, size_t count);
+
+private:
+
+    // The begin of a range is stored in the low 32 bits and the end in the high 32 bits, so that the owner
+    // and a thief can each claim an item with a single compare and swap. Padded to a cache line.
+    struct Range
+    {
+        std::atomic<uint64_t> bounds{ 0 };
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    void workerEntry(size_t participant);
+    bool take(size_t participant, bool fromBack, uint32_t & item);
+    bool processOne(size_t participant);
+
+    std::vector<std::thread> m_workers;
+    AudioThreadPolicy m_policy;
+    double m_quantumSeconds;
+    std::atomic<unsigned> m_policyFailures{ 0 };
+    std::unique_ptr<Range[]> m_ranges;
+    size_t m_participantCount;
+
+    Task m_task{ nullptr };
+    void * m_userData{ nullptr };
+    std::atomic<size_t> m_remaining{ 0 };
+
+    std::atomic<uint32_t> m_generation{ 0 };
+    std::atomic<bool> m_shouldRun{ true };
+
+    // Workers spin between quanta, and only sleep after a long idle period.
+    std::atomic<int> m_sleeping{ 0 };
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+};
+
+} // namespace lab
+
+#endif // RenderWorkerPool_h
@@ -12,6 +12,7 @@
 namespace lab {
 
 class AudioBus;
+class AudioChannel;
     
 // Multi-channel convolution reverb with channel matrixing - one or more ReverbConvolver objects are used internally.
 
@@ -20,24 +21,41 @@ public:
     enum { MaxFrameSize = 256 };
 
     // renderSliceSize is a rendering hint, so the FFTs can be optimized to not all occur at the same time (very bad when rendering on a real-time thread).
-    Reverb(AudioBus* impulseResponseBuffer, size_t renderSliceSize, size_t maxFFTSize, size_t numberOfChannels, bool useBackgroundThreads, bool normalize);
+    // The prepared impulse's kernels are shared with any other reverbs using it; only the convolvers' buffers are per reverb.
+    Reverb(std::shared_ptr<const PreparedImpulse> impulse, size_t renderSliceSize, size_t numberOfChannels);
+
+    // Convolves numberOfInputs channels into numberOfOutputs through a matrix of responses, such as a true stereo or an
+    // Ambisonic B-format set. The impulse response has numberOfInputs * numberOfOutputs channels, in the order of
+    // PreparedImpulse::matrixRoutes.
+    Reverb(std::shared_ptr<const PreparedImpulse> impulse, size_t renderSliceSize, size_t numberOfInputs, size_t numberOfOutputs);
 
     void process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus* destinationBus, size_t framesToProcess);
     void reset();
 
+    // See ReverbConvolver::setTailLimit().
+    void setTailLimit(size_t frames);
+
     size_t impulseResponseLength() const { return m_impulseResponseLength; }
     size_t latencyFrames() const;
 
+    // The prepared impulse the convolvers share, and the bytes of their own buffers besides it.
+    std::shared_ptr<const PreparedImpulse> impulse() const;
+    size_t memoryBytes() const;
+
 private:
 
-    void initialize(AudioBus* impulseResponseBuffer, size_t renderSliceSize, size_t maxFFTSize, size_t numberOfChannels, bool useBackgroundThreads);
+    void processMatrix(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus* destinationBus, size_t framesToProcess);
 
     size_t m_impulseResponseLength;
+    size_t m_numberOfResponseChannels;
 
+    // One per channel of a mono or stereo impulse response
     std::vector<std::unique_ptr<ReverbConvolver> > m_convolvers;
 
-    // For "True" stereo processing
-    std::unique_ptr<AudioBus> m_tempBuffer;
+    // A matrix of responses, including "True" stereo, is processed by a single convolver
+    std::unique_ptr<ReverbConvolver> m_matrixConvolver;
+    std::vector<const AudioChannel*> m_matrixSources;
+    std::vector<AudioChannel*> m_matrixDestinations;
 };
 
 } // namespace lab
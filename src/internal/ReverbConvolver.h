@@ -7,17 +7,18 @@
 
 #include "LabSound/core/AudioArray.h"
 
+#include "internal/BackgroundConvolverPool.h"
 #include "internal/DirectConvolver.h"
-#include "internal/FFTConvolver.h"
+#include "internal/PartitionedConvolver.h"
+#include "internal/PreparedImpulse.h"
 #include "internal/ReverbAccumulationBuffer.h"
 #include "internal/ReverbConvolverStage.h"
 #include "internal/ReverbInputBuffer.h"
 
-#include <mutex>
-#include <vector>
-#include <condition_variable>
-#include <thread>
 #include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace lab {
 
@@ -28,50 +29,71 @@ class ReverbConvolver {
     
 public:
     
-    // maxFFTSize can be adjusted (from say 2048 to 32768) depending on how much precision is necessary.
-    // For certain tweaky de-convolving applications the phase errors add up quickly and lead to non-sensical results with
-    // larger FFT sizes and single-precision floats.  In these cases 2048 is a good size.
-    // If not doing multi-threaded convolution, then should not go > 8192.
-    ReverbConvolver(AudioChannel* impulseResponse, size_t renderSliceSize, size_t maxFFTSize, size_t convolverRenderPhase, bool useBackgroundThreads);
+    // Convolves with one channel of a prepared impulse response, which may be shared with other convolvers.
+    ReverbConvolver(std::shared_ptr<const PreparedImpulse> impulse, size_t channel, size_t renderSliceSize, size_t convolverRenderPhase);
+
+    // Convolves numberOfInputs channels into numberOfOutputs, through the impulse response channels of the routes.
+    // Each input is transformed once per FFT block however many routes it feeds, and the routes into an output are
+    // summed before its single inverse transform.
+    ReverbConvolver(std::shared_ptr<const PreparedImpulse> impulse, size_t numberOfInputs, size_t numberOfOutputs,
+                    const std::vector<ConvolutionRoute>& routes, size_t renderSliceSize, size_t convolverRenderPhase);
     ~ReverbConvolver();
 
     void process(ContextRenderLock& r, const AudioChannel* sourceChannel, AudioChannel* destinationChannel, size_t framesToProcess);
+
+    // Takes one source channel per input and one destination channel per output.
+    void process(ContextRenderLock& r, const AudioChannel* const* sourceChannels, AudioChannel* const* destinationChannels, size_t framesToProcess);
     void reset();
 
     size_t impulseResponseLength() const { return m_impulseResponseLength; }
 
-    ReverbInputBuffer* inputBuffer() { return &m_inputBuffer; }
+    size_t numberOfInputs() const { return m_inputBuffers.size(); }
+    size_t numberOfOutputs() const { return m_accumulationBuffers.size(); }
+
+    ReverbInputBuffer* inputBuffer(size_t input) { return m_inputBuffers[input].get(); }
 
     bool useBackgroundThreads() const { return m_useBackgroundThreads; }
-    void backgroundThreadEntry();
+
+    // Called by the background pool's workers, one at a time, to catch the background stages up with the input.
+    void processBackgroundStages();
+
+    // The input the background stages have yet to process, as a fraction of their scheduling slack.
+    double backgroundLoad() const;
 
     size_t latencyFrames() const;
 
+    const std::shared_ptr<const PreparedImpulse> & impulse() const { return m_impulse; }
+
+    // The bytes of the convolver's buffers and stages, not counting the prepared impulse.
+    size_t memoryBytes() const;
+
+    // The stages whose part of the response starts at or past limit frames are skipped, saving their work. They
+    // resume from silence once the limit is raised again. Within a stage of uniform partitions, the partitions
+    // past the limit are skipped instead, and are heard again at once.
+    void setTailLimit(size_t frames) { m_tailLimit.store(frames, std::memory_order_relaxed); }
+
 private:
 
+    std::shared_ptr<const PreparedImpulse> m_impulse;
+
     std::vector<std::unique_ptr<ReverbConvolverStage> > m_stages;
     std::vector<std::unique_ptr<ReverbConvolverStage> > m_backgroundStages;
     size_t m_impulseResponseLength;
 
-    ReverbAccumulationBuffer m_accumulationBuffer;
-
-    // One or more background threads read from this input buffer which is fed from the realtime thread.
-    ReverbInputBuffer m_inputBuffer;
+    // One per output
+    std::vector<std::unique_ptr<ReverbAccumulationBuffer> > m_accumulationBuffers;
 
-    // First stage will be of size m_minFFTSize.  Each next stage will be twice as big until we hit m_maxFFTSize.
-    size_t m_minFFTSize;
-    size_t m_maxFFTSize;
+    // One per input. One or more background threads read from these input buffers which are fed from the realtime thread.
+    std::vector<std::unique_ptr<ReverbInputBuffer> > m_inputBuffers;
 
-    // But don't exceed this size in the real-time thread (if we're doing background processing).
-    size_t m_maxRealtimeFFTSize;
+    // Per process() call, the data of the source channels
+    std::vector<const float*> m_sources;
 
-    // Background thread and synchronization
+    // The background stages are processed by workers shared with the other convolvers
     bool m_useBackgroundThreads;
-    std::thread m_backgroundThread;
-    std::atomic<bool> m_wantsToExit;
-    bool m_moreInputBuffered;
-    mutable std::mutex m_backgroundThreadLock;
-    mutable std::condition_variable m_backgroundThreadCondition;
+    std::shared_ptr<BackgroundConvolverPool> m_backgroundPool;
+
+    std::atomic<size_t> m_tailLimit{ SIZE_MAX };
 };
 
 } // namespace lab
@@ -8,39 +8,67 @@
 #include "LabSound/core/AudioArray.h"
 
 #include "internal/FFTFrame.h"
+#include "internal/PreparedImpulse.h"
+
+#include <memory>
+#include <vector>
 
 namespace lab {
 
 class ReverbAccumulationBuffer;
 class ReverbConvolver;
-class FFTConvolver;
 class DirectConvolver;
     
 // A ReverbConvolverStage represents the convolution associated with a sub-section of a large impulse response.
 // It incorporates a delay line to account for the offset of the sub-section within the larger impulse response.
+// A stage convolves each of its inputs with the sub-sections of the channels routed from it, and accumulates the
+// results into the accumulation buffers of their outputs.
 class ReverbConvolverStage {
 public:
     // renderPhase is useful to know so that we can manipulate the pre versus post delay so that stages will perform
     // their heavy work (FFT processing) on different slices to balance the load in a real-time thread.
-    ReverbConvolverStage(const float* impulseResponse, size_t responseLength, size_t reverbTotalLatency, size_t stageOffset, size_t stageLength, size_t fftSize, size_t renderPhase, size_t renderSliceSize, ReverbAccumulationBuffer*, bool directMode = false);
+    // The stage's kernels are shared rather than copied, and the impulse must outlive the stage.
+    ReverbConvolverStage(const PreparedImpulse& impulse, size_t stageIndex, const std::vector<ConvolutionRoute>& routes,
+                         size_t numberOfInputs, size_t reverbTotalLatency, size_t renderPhase, size_t renderSliceSize,
+                         const std::vector<ReverbAccumulationBuffer*>& accumulationBuffers);
+    ~ReverbConvolverStage();
 
+    // Takes one source per input.
     // WARNING: framesToProcess must be such that it evenly divides the delay buffer size (stage_offset).
-    void process(const float* source, size_t framesToProcess);
+    void process(const float* const* sources, size_t framesToProcess);
 
     void processInBackground(ReverbConvolver* convolver, size_t framesToProcess);
 
+    // Keeps the stage in step with the others without convolving, for a reverb whose tail is cut short. When it is
+    // processed again, it starts from silence.
+    void skip(const float* const* sources, size_t framesToProcess);
+    void skipInBackground(ReverbConvolver* convolver, size_t framesToProcess);
+
+    // Where the stage's part of the impulse response starts.
+    size_t offset() const { return m_offset; }
+
+    // Skips the partitions of a stage of uniform partitions that start at or past frames into the response.
+    void setTailLimit(size_t frames);
+
     void reset();
 
     // Useful for background processing
     int inputReadIndex() const { return m_inputReadIndex; }
 
+    // The bytes of the stage's own buffers and convolvers; its kernels are the prepared impulse's.
+    size_t memoryBytes() const;
+
 private:
-    std::unique_ptr<FFTFrame> m_fftKernel;
-    std::unique_ptr<FFTConvolver> m_fftConvolver;
+    std::unique_ptr<PartitionedConvolver> m_partitionedConvolver;
+
+    size_t m_numberOfInputs;
+    size_t m_numberOfOutputs;
 
+    // One delay line per input, each of m_preDelayBufferSize frames
     AudioFloatArray m_preDelayBuffer;
+    size_t m_preDelayBufferSize;
 
-    ReverbAccumulationBuffer* m_accumulationBuffer;
+    std::vector<ReverbAccumulationBuffer*> m_accumulationBuffers;
     int m_accumulationReadIndex;
     int m_inputReadIndex;
 
@@ -49,11 +77,22 @@ private:
     size_t m_preReadWriteIndex;
     size_t m_framesProcessed;
 
+    // One buffer per output, each of m_preDelayBufferSize frames
     AudioFloatArray m_temporaryBuffer;
 
+    // Per process() call, the sources read from the convolver's input buffers, the pre-delayed sources and the stage's outputs
+    std::vector<const float*> m_backgroundSources;
+    std::vector<const float*> m_sources;
+    std::vector<float*> m_destinations;
+
+    // The direct convolvers keep the history of their input, so each route has its own.
     bool m_directMode;
-    std::unique_ptr<AudioFloatArray> m_directKernel;
-    std::unique_ptr<DirectConvolver> m_directConvolver;
+    std::vector<const AudioFloatArray*> m_directKernels;
+    std::vector<std::unique_ptr<DirectConvolver>> m_directConvolvers;
+    std::vector<ConvolutionRoute> m_routes;
+
+    size_t m_offset;
+    bool m_skipped = false; // the convolvers' history is stale
 };
 
 } // namespace lab
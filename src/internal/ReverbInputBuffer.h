@@ -30,6 +30,8 @@ public:
 
     void reset();
 
+    size_t memoryBytes() const { return m_buffer.size() * sizeof(float); }
+
 private:
     AudioFloatArray m_buffer;
     size_t m_writeIndex;
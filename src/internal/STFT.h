@@ -0,0 +1,82 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef STFT_h
+#define STFT_h
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/WindowFunctions.h"
+
+#include "internal/FFTFrame.h"
+
+#include <functional>
+
+namespace lab
+{
+
+// A short time Fourier transform, for nodes that work on a signal's spectrum a frame at a time. Every hopSize
+// frames of input, the last windowSize frames are windowed, zero padded to fftSize and transformed, and the
+// spectrum is handed to a callback, which may change it. process() then transforms each frame back, and
+// overlap-adds it through a synthesis window that is normalized so that an unchanged spectrum is resynthesized
+// exactly, for any window and hop. The windows are tabulated up front, and nothing is allocated after
+// construction.
+class STFT
+{
+public:
+
+    // Called with each frame's spectrum, in FFTFrame's packed layout.
+    typedef std::function<void(FFTFrame & frame)> FrameCallback;
+
+    // hopSize is at most windowSize. fftSize is rounded up to a power of two no smaller than windowSize, so 0
+    // picks the smallest.
+    STFT(WindowType window, size_t windowSize, size_t hopSize, size_t fftSize = 0);
+
+    size_t windowSize() const { return m_windowSize; }
+    size_t hopSize() const { return m_hopSize; }
+    size_t fftSize() const { return m_frame.fftSize(); }
+
+    // The delay of process()'s output behind its input.
+    size_t latencyFrames() const { return m_windowSize; }
+
+    void reset();
+
+    // Buffers the source and calls onFrame for each frame that completes.
+    void analyse(const float * source, size_t framesToProcess, const FrameCallback & onFrame);
+
+    // As analyse(), and writes the resynthesized frames to destination, which may be source.
+    void process(const float * source, float * destination, size_t framesToProcess, const FrameCallback & onFrame);
+
+    // Windows and transforms windowSize frames buffered by the caller, and returns their spectrum.
+    FFTFrame & analyseFrame(const float * frame);
+
+    // During a callback, the windowSize frames of input being analysed, before windowing.
+    const float * inputFrame() const { return m_input.data(); }
+
+    size_t memoryBytes() const;
+
+private:
+
+    void runFrame(const FrameCallback & onFrame, bool resynthesize);
+
+    size_t m_windowSize;
+    size_t m_hopSize;
+
+    AudioFloatArray m_analysisWindow;
+    AudioFloatArray m_synthesisWindow;
+
+    // The last windowSize frames of input, of which the final hopSize - m_pending are yet to arrive.
+    AudioFloatArray m_input;
+    size_t m_pending;
+
+    // The frame being transformed, zero padded to the FFT size.
+    AudioFloatArray m_padded;
+    FFTFrame m_frame;
+
+    // The overlap-add of the resynthesized frames, and the hop of it that is complete and being played out.
+    AudioFloatArray m_accumulator;
+    AudioFloatArray m_ready;
+};
+
+} // namespace lab
+
+#endif // STFT_h
@@ -0,0 +1,104 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SharedSpectrum_h
+#define SharedSpectrum_h
+
+#include "LabSound/core/AudioArray.h"
+#include "LabSound/core/WindowFunctions.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/STFT.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace lab
+{
+
+class AudioBus;
+class AudioNodeInput;
+
+// The STFT of a source, mixed to mono by averaging its channels, shared by the nodes analysing that source with the
+// same window, window size and hop, so that each frame is windowed and transformed once however many of them read
+// it. The first of them to call analyse() in a render quantum feeds it that quantum, and keeps the frames it
+// completes; the others, which may render on other threads, wait for it and are handed the same frames. A source is
+// an output the consumers' inputs are connected to, and to nothing else; the first consumer's input mixes it for
+// all of them.
+class SharedSpectrum
+{
+public:
+
+    struct Key
+    {
+        const void * source; // null for an analysis shared with no one
+        WindowType window;
+        size_t windowSize;
+        size_t hopSize;
+        size_t quantumSize; // the context's render quantum, which sizes the frames kept for a quantum
+
+        bool operator==(const Key & other) const
+        {
+            return source == other.source && window == other.window && windowSize == other.windowSize && hopSize == other.hopSize
+                && quantumSize == other.quantumSize;
+        }
+        bool operator!=(const Key & other) const { return !(*this == other); }
+    };
+
+    // Called with each frame's spectrum, in FFTFrame's packed layout, the windowSize frames of input it was taken
+    // from, before windowing, and the context's frame at the end of them. The spectrum must not be changed.
+    typedef std::function<void(FFTFrame & frame, const float * input, uint64_t sampleFrame)> FrameCallback;
+
+    // The analysis shared under key, made if there is none. Not realtime safe, as it may allocate the analysis;
+    // consumers acquire one when their settings, source or render quantum change.
+    static std::shared_ptr<SharedSpectrum> acquire(const Key & key);
+
+    // The output input is connected to, if it's connected to one and no others, as a Key's source; else null.
+    static const void * sourceOf(ContextRenderLock & r, AudioNodeInput * input);
+
+    explicit SharedSpectrum(const Key & key);
+
+    const Key & key() const { return m_key; }
+    size_t windowSize() const { return m_stft.windowSize(); }
+    size_t hopSize() const { return m_stft.hopSize(); }
+    size_t fftSize() const { return m_stft.fftSize(); }
+
+    void analyse(ContextRenderLock & r, const AudioBus & bus, size_t framesToProcess, const FrameCallback & onFrame);
+
+    // The bytes of the STFT and the frames kept for the consumers.
+    size_t memoryBytes() const;
+
+private:
+
+    // Keeps a copy of the frame the STFT completed, and the input it was taken from.
+    void keep(FFTFrame & frame);
+
+    Key m_key;
+    STFT m_stft;
+
+    // The consumers may render on different threads. The first to claim a quantum analyses it, and marks it ready
+    // for the others.
+    std::atomic<uint64_t> m_claimedQuantum{ UINT64_MAX };
+    std::atomic<uint64_t> m_readyQuantum{ UINT64_MAX };
+
+    bool m_started = false;
+    uint64_t m_startFrame = 0;
+    uint64_t m_hops = 0;
+
+    // The input's channels averaged, a quantum at a time.
+    AudioFloatArray m_mixed;
+
+    // The frames completed in the current quantum, their inputs and their ends; as many as a quantum of the key's
+    // size completes, made up front.
+    size_t m_frameCount = 0;
+    std::vector<std::unique_ptr<FFTFrame>> m_frames;
+    std::vector<std::unique_ptr<AudioFloatArray>> m_inputs;
+    std::vector<uint64_t> m_frameEnds;
+};
+
+} // namespace lab
+
+#endif // SharedSpectrum_h
@@ -8,8 +8,12 @@
 #include "LabSound/core/AudioSourceProvider.h"
 #include "LabSound/core/AudioArray.h"
 
+#include <memory>
+
 namespace lab {
 
+class AudioBus;
+
 // SincResampler is a high-quality sample-rate converter.
 
 class SincResampler {
@@ -17,25 +21,43 @@ public:
     // scaleFactor == sourceSampleRate / destinationSampleRate
     // kernelSize can be adjusted for quality (higher is better)
     // numberOfKernelOffsets is used for interpolation and is the number of sub-sample kernel shifts.
-    SincResampler(double scaleFactor, size_t kernelSize = 32, size_t numberOfKernelOffsets = 32);
+    // blockSize is the number of source frames a streaming resampler asks its provider for at a time; it must be
+    // larger than kernelSize.
+    SincResampler(double scaleFactor, size_t kernelSize = 32, size_t numberOfKernelOffsets = 32, size_t blockSize = 512);
+    ~SincResampler();
     
     // Processes numberOfSourceFrames from source to produce numberOfSourceFrames / scaleFactor frames in destination.
     void process(const float* source, float* destination, size_t numberOfSourceFrames);
 
+    // Produces the framesToProcess frames from firstFrame on of what process() would make of the whole source, each
+    // worked out from the source frames around it rather than from a stream, so that ranges of one conversion can be
+    // processed separately, on different threads, and put together make the same frames. Doesn't change the
+    // resampler's streaming state.
+    void process(const float* source, size_t numberOfSourceFrames, float* destination, size_t firstFrame, size_t framesToProcess) const;
+
     // Process with input source callback function for streaming applications.
     void process(AudioSourceProvider*, float* destination, size_t framesToProcess);
 
+    // The most source frames a streaming resampler asks for before producing the output they contribute to.
+    size_t latencyFrames() const { return m_blockSize + m_kernelSize / 2; }
+
+    // Changes the rate a little, such as to follow a device's clock drift. The kernels stay those made for the
+    // scale factor the resampler was made with.
+    void setScaleFactor(double scaleFactor) { m_scaleFactor = scaleFactor; }
+
 protected:
-    void initializeKernel();
     void consumeSource(float* buffer, size_t numberOfSourceFrames);
     
     double m_scaleFactor;
     size_t m_kernelSize;
     size_t m_numberOfKernelOffsets;
 
-    // m_kernelStorage has m_numberOfKernelOffsets kernels back-to-back, each of size m_kernelSize.
+    // m_kernelStorage has m_numberOfKernelOffsets + 1 kernels back-to-back, each of size m_kernelSize and starting
+    // m_kernelStride floats after the previous one, so that every kernel is cache line aligned.
     // The kernel offsets are sub-sample shifts of a windowed sinc() shifted from 0.0 to 1.0 sample.
-    AudioFloatArray m_kernelStorage;
+    // The kernels only depend on the constructor's arguments, so resamplers made with the same ones share them.
+    size_t m_kernelStride;
+    std::shared_ptr<const AudioFloatArray> m_kernelStorage;
     
     // m_virtualSourceIndex is an index on the source input buffer with sub-sample precision.
     // It must be double precision to avoid drift.
@@ -53,6 +75,9 @@ protected:
     // m_sourceProvider is used to provide the audio input stream to the resampler.
     AudioSourceProvider* m_sourceProvider;    
 
+    // Wraps the input buffer for m_sourceProvider, so that streaming doesn't allocate.
+    std::unique_ptr<AudioBus> m_sourceBus;
+
     // The buffer is primed once at the very beginning of processing.
     bool m_isBufferPrimed;
 };
@@ -0,0 +1,62 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SpatialBatch_h
+#define SpatialBatch_h
+
+#include "LabSound/core/AudioArray.h"
+
+#include <memory>
+#include <vector>
+
+namespace lab {
+
+class AudioNodeOutput;
+class ContextRenderLock;
+class PannerNode;
+
+// The geometry of every PannerNode in a render schedule, evaluated together at the start of each render quantum.
+// The panners' positions and orientations are gathered into arrays, one per coordinate, so that the distances,
+// directions and cone angles of all of them are computed in one vectorized pass, and the listener's parameters are
+// read once rather than by every panner. The panners then read their results in process(). Only the panners that
+// have moved or turned, or all of them when the listener has, are evaluated; the rest keep their geometry.
+class SpatialBatch
+{
+public:
+
+    // The panners are referred to through one of their outputs, weakly, as the render schedule refers to its nodes.
+    explicit SpatialBatch(std::vector<std::weak_ptr<AudioNodeOutput>> emitters);
+    ~SpatialBatch();
+
+    // Called on the render thread at the start of a quantum; doesn't allocate.
+    void update(ContextRenderLock & r);
+
+    size_t size() const { return m_emitters.size(); }
+
+private:
+
+    std::vector<std::weak_ptr<AudioNodeOutput>> m_emitters;
+
+    // The emitters alive this quantum, held until their results have been written.
+    std::vector<std::shared_ptr<AudioNodeOutput>> m_held;
+    std::vector<PannerNode *> m_panners;
+
+    AudioFloatArray m_positionX;
+    AudioFloatArray m_positionY;
+    AudioFloatArray m_positionZ;
+    AudioFloatArray m_orientationX;
+    AudioFloatArray m_orientationY;
+    AudioFloatArray m_orientationZ;
+
+    // The distance to the listener, the source-listener vector projected on the listener's right, front and up
+    // axes, and the cosine of the angle between the orientation and the vector from the source to the listener.
+    AudioFloatArray m_distance;
+    AudioFloatArray m_right;
+    AudioFloatArray m_front;
+    AudioFloatArray m_up;
+    AudioFloatArray m_coneCosine;
+};
+
+} // namespace lab
+
+#endif // SpatialBatch_h
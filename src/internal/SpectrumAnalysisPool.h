@@ -0,0 +1,54 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SpectrumAnalysisPool_h
+#define SpectrumAnalysisPool_h
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lab {
+
+class RealtimeAnalyser;
+
+// SpectrumAnalysisPool runs the FFT analysis of every RealtimeAnalyser on one shared worker thread, so that
+// neither the audio thread, which only hands over the latest input, nor the threads reading the results, which
+// only copy out the latest spectrum, ever compute one. An analyser's FFT is at most 2048 points, so a single
+// worker keeps up with many analysers.
+class SpectrumAnalysisPool
+{
+public:
+
+    // The pool shared by all analysers, created on first use and destroyed with its last holder.
+    static std::shared_ptr<SpectrumAnalysisPool> shared();
+
+    SpectrumAnalysisPool();
+    ~SpectrumAnalysisPool();
+
+    void add(RealtimeAnalyser * analyser);
+
+    // Blocks until the worker is not analysing, after which the pool no longer refers to the analyser.
+    void remove(RealtimeAnalyser * analyser);
+
+    // Called from the audio thread once an analyser has published input. Never blocks; if the worker is busy
+    // it finds the input when it next looks.
+    void wake();
+
+private:
+
+    void workerEntry();
+
+    std::thread m_worker;
+    std::vector<RealtimeAnalyser *> m_analysers;
+    bool m_shouldRun{ true };
+
+    std::mutex m_lock;
+    std::condition_variable m_work;
+};
+
+} // namespace lab
+
+#endif // SpectrumAnalysisPool_h
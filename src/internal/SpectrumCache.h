@@ -0,0 +1,87 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef SpectrumCache_h
+#define SpectrumCache_h
+
+#include "internal/FFTFrame.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lab {
+
+class MappedFile;
+
+// Identifies an entry of the spectrum cache (see SetSpectrumCacheDirectory). kind names what the frames are, such
+// as "impulse", and sourceHash covers the source audio and all of the parameters the frames depend on, besides the
+// sample rate, the FFT size and the FFT implementation, which are part of the key themselves.
+struct SpectrumCacheKey
+{
+    std::string kind;
+    uint64_t sourceHash;
+    float sampleRate;
+    size_t fftSize;
+
+    // A 64 bit FNV-1a variant, continuing from hash
+    enum : uint64_t { InitialHash = 14695981039346656037ULL };
+    static uint64_t hash(const void* data, size_t size, uint64_t hash = InitialHash);
+
+    // Hashes a file's contents; returns false if it can't be read.
+    static bool hashFile(const std::string& path, uint64_t& hash);
+};
+
+// Returns true if a cache directory has been set.
+bool spectrumCacheEnabled();
+
+// Reads the frames of a cache entry, in the order they were written, from a read only mapping of its file.
+class SpectrumCacheReader
+{
+public:
+    // Returns nullptr if the cache is disabled, or it has no complete entry for the key.
+    static std::unique_ptr<SpectrumCacheReader> open(const SpectrumCacheKey& key);
+    ~SpectrumCacheReader();
+
+    size_t frameCount() const { return m_frameCount; }
+    bool atEnd() const { return m_cursor == m_end; }
+
+    // Copies the next frame into frame, which must have the size it was written with, and returns its tag in tag.
+    // Returns false once the frames are exhausted, or if the next one has another size.
+    bool read(FFTFrame& frame, float* tag = nullptr);
+
+private:
+    SpectrumCacheReader() = default;
+
+    std::unique_ptr<MappedFile> m_file;
+
+    const uint8_t* m_cursor = nullptr;
+    const uint8_t* m_end = nullptr;
+    size_t m_frameCount = 0;
+};
+
+// Collects the frames of a cache entry, and publishes them as a whole so a reader never sees a partial entry.
+class SpectrumCacheWriter
+{
+public:
+    // Returns nullptr if the cache is disabled.
+    static std::unique_ptr<SpectrumCacheWriter> create(const SpectrumCacheKey& key);
+
+    // tag is a value stored with the frame, such as an HRTF kernel's frame delay.
+    void write(const FFTFrame& frame, float tag = 0);
+
+    // Writes the entry to a temporary file, then renames it into place. Returns false on failure.
+    bool commit();
+
+private:
+    explicit SpectrumCacheWriter(const SpectrumCacheKey& key) : m_key(key) {}
+
+    SpectrumCacheKey m_key;
+    std::vector<uint8_t> m_frames;
+    size_t m_frameCount = 0;
+};
+
+} // namespace lab
+
+#endif // SpectrumCache_h
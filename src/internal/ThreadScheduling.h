@@ -0,0 +1,19 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef ThreadScheduling_h
+#define ThreadScheduling_h
+
+#include "LabSound/core/AudioThreadPolicy.h"
+
+namespace lab {
+
+// Applies policy to the calling thread, and returns a mask of the AudioThreadPolicy::Failure that occurred, each
+// logged with the thread's name. quantumSeconds is the render period, which macOS's time constraint policy is
+// given. With a coreIndex, the thread is pinned to that one of the policy's cores, modulo their count, rather
+// than to all of them.
+unsigned ApplyAudioThreadPolicy(const AudioThreadPolicy & policy, const char * threadName, double quantumSeconds, int coreIndex = -1);
+
+} // namespace lab
+
+#endif // ThreadScheduling_h
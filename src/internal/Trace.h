@@ -0,0 +1,64 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// LABSOUND_TRACE_SCOPE(name) records the time from where it appears to the end of its scope as an event of the
+// calling thread, and LABSOUND_TRACE_THREAD(name) names the calling thread in the trace; see lab::AudioTrace.
+// Names must be string literals, as only their pointers are recorded. Without LABSOUND_TRACE both compile away.
+#if defined(LABSOUND_TRACE)
+#define LABSOUND_TRACE_CONCAT2(a, b) a##b
+#define LABSOUND_TRACE_CONCAT(a, b) LABSOUND_TRACE_CONCAT2(a, b)
+#define LABSOUND_TRACE_SCOPE(name) lab::TraceScope LABSOUND_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define LABSOUND_TRACE_THREAD(name) lab::TraceThreadName(name)
+#else
+#define LABSOUND_TRACE_SCOPE(name) ((void) 0)
+#define LABSOUND_TRACE_THREAD(name) ((void) 0)
+#endif
+
+namespace lab {
+
+extern std::atomic<bool> g_tracing;
+
+inline uint64_t TraceNow()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Appends an event to the calling thread's buffer. The first event a thread records in a trace allocates its
+// buffer; every later one is lock free.
+void TraceRecord(const char * name, uint64_t start, uint64_t end);
+
+void TraceThreadName(const char * name);
+
+class TraceScope
+{
+    const char * m_name;
+    uint64_t m_start;
+
+public:
+
+    explicit TraceScope(const char * name)
+    : m_name(g_tracing.load(std::memory_order_relaxed) ? name : nullptr)
+    , m_start(m_name ? TraceNow() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_name)
+            TraceRecord(m_name, m_start, TraceNow());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope & operator=(const TraceScope &) = delete;
+};
+
+} // namespace lab
+
+#endif // Trace_h
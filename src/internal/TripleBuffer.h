@@ -0,0 +1,69 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <atomic>
+#include <cstdint>
+
+namespace lab {
+
+// Hands the latest of a series of values from a single producer to a single consumer, neither of which ever
+// waits for the other. The producer fills the back slot and publishes it by swapping it with the middle one;
+// the consumer takes the middle slot, if it was published since the consumer last looked, by swapping it with
+// the front one. A value published before the consumer looks is replaced rather than queued.
+//
+// The slots are prepared up front, so that neither side allocates.
+template <typename T>
+class TripleBuffer
+{
+public:
+
+    // Calls initialize(slot) on each of the three slots.
+    template <typename Initialize>
+    explicit TripleBuffer(Initialize initialize)
+    {
+        for (T & slot : m_slots)
+            initialize(slot);
+    }
+
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer & operator=(const TripleBuffer &) = delete;
+
+    // The producer's slot, which it may fill at leisure before publishing.
+    T & back() { return m_slots[m_back]; }
+
+    void publish()
+    {
+        uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | Fresh), std::memory_order_acq_rel);
+        m_back = previous & IndexMask;
+    }
+
+    // Makes the last published value the front one, and returns false if there was none since the last call.
+    bool update()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & Fresh))
+            return false;
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & IndexMask;
+        return true;
+    }
+
+    // The consumer's slot, which stays as it is until the consumer next updates.
+    const T & front() const { return m_slots[m_front]; }
+    T & front() { return m_slots[m_front]; }
+
+private:
+
+    enum : uint8_t { IndexMask = 3, Fresh = 4 };
+
+    T m_slots[3];
+    uint8_t m_back = 0;
+    uint8_t m_front = 1;
+    std::atomic<uint8_t> m_middle{ 2 };
+};
+
+} // namespace lab
+
+#endif // TripleBuffer_h
@@ -7,6 +7,7 @@
 
 
 #include <cstddef>
+#include <cstdint>
 
 // Defines the interface for several vector math functions whose implementation will ideally be optimized.
 
@@ -34,9 +35,107 @@ void vmul(const float* source1P, int sourceStride1, const float* source2P, int s
 // Multiplies two complex vectors.
 void zvmul(const float* real1P, const float* imag1P, const float* real2P, const float* imag2P, float* realDestP, float* imagDestP, size_t framesToProcess);
 
+// Multiplies two complex vectors and adds the products to a third, acc += source1 * source2.
+void zvma(const float* real1P, const float* imag1P, const float* real2P, const float* imag2P, float* realAccP, float* imagAccP, size_t framesToProcess);
+
 // Copies elements while clipping values to the threshold inputs.
 void vclip(const float* sourceP, int sourceStride, const float* lowThresholdP, const float* highThresholdP, float* destP, int destStride, size_t framesToProcess);
 
+// The functions below operate on contiguous vectors. Unless noted, the destination may be the source.
+
+// Sets every element to a value.
+void vfill(const float* valueP, float* destP, size_t framesToProcess);
+
+// Adds a value to every element.
+void vsadd(const float* sourceP, const float* addendP, float* destP, size_t framesToProcess);
+
+// Generates a linear ramp, destP[i] = *startP + i * *stepP.
+void vramp(const float* startP, const float* stepP, float* destP, size_t framesToProcess);
+
+// Generates an exponential ramp, destP[i] = *startP * *ratioP ^ i. The ratio must be positive.
+void vexpramp(const float* startP, const float* ratioP, float* destP, size_t framesToProcess);
+
+// Natural exponential. Results below the smallest normal float may be flushed to zero.
+void vexp(const float* sourceP, float* destP, size_t framesToProcess);
+
+// Natural logarithm. Zero gives -infinity and negative values NaN; denormals are treated as the smallest normal.
+void vlog(const float* sourceP, float* destP, size_t framesToProcess);
+
+// Raises positive elements to a power.
+void vpow(const float* sourceP, const float* exponentP, float* destP, size_t framesToProcess);
+
+// Converts between linear gain and decibels, like AudioUtilities::linearToDecibels() and decibelsToLinear().
+// A linear value of zero gives -1000 dB; linear values must not be negative.
+void vlinearToDecibels(const float* sourceP, float* destP, size_t framesToProcess);
+void vdecibelsToLinear(const float* sourceP, float* destP, size_t framesToProcess);
+
+// Hyperbolic tangent.
+void vtanh(const float* sourceP, float* destP, size_t framesToProcess);
+
+// Convolves with a kernel of kernelSize taps, destP[i] = sum of sourceP[i - j] * kernelP[j] for j < kernelSize,
+// so the kernelSize - 1 frames before sourceP are read as history. The destination must not overlap the source.
+void vconv(const float* sourceP, const float* kernelP, size_t kernelSize, float* destP, size_t framesToProcess);
+
+// The dot products of the source with two kernels, *dot1P = sum of sourceP[i] * kernel1P[i] and *dot2P likewise,
+// reading the source once. SincResampler interpolates between the results for neighbouring sub-sample offsets.
+void vdotpr2(const float* sourceP, const float* kernel1P, const float* kernel2P, float* dot1P, float* dot2P, size_t framesToProcess);
+
+// Adds several vectors to the destination, destP[i] += sourcesP[0][i] + sourcesP[1][i] + ..., in that order,
+// reading and writing the destination once. The sources must not overlap the destination.
+void vsum(const float* const* sourcesP, size_t sourceCount, float* destP, size_t framesToProcess);
+
+// The most channels vmix() takes on either side.
+const size_t MaxMixChannels = 8;
+
+// Mixes channels through gains in one pass that reads each source once per frame, destsP[d][i] = (accumulate ?
+// destsP[d][i] : 0) + gainsP[d][0] * sourcesP[0][i] + gainsP[d][1] * sourcesP[1][i] + ..., in that order, with
+// zero gains skipped. The sources must not overlap the destinations.
+void vmix(const float* const* sourcesP, size_t sourceCount, const float* const* gainsP, float* const* destsP, size_t destCount, bool accumulate, size_t framesToProcess);
+
+// A one-pole smoother approaching a target, destP[i] = *stateP += (*targetP - *stateP) * *coefficientP, leaving
+// *stateP at the last value. The coefficient is clamped to [0, 1].
+void vsmooth(float* stateP, const float* targetP, const float* coefficientP, float* destP, size_t framesToProcess);
+
+// Equal-power pan gains for positions from 0, hard left, to 1, hard right: leftP[i] = cos(positionP[i] * pi / 2) and
+// rightP[i] = sin(positionP[i] * pi / 2), to within 4e-6, and exactly 0 at the ends. Positions are clamped to [0, 1].
+void vpangains(const float* positionP, float* leftP, float* rightP, size_t framesToProcess);
+
+// Interleaves planar channels, destP[i * channelCount + c] = sourcesP[c][i], and the reverse. Two channels, and
+// each group of four, move a vector at a time; any channels left over move one sample at a time.
+void vinterleave(const float* const* sourcesP, size_t channelCount, float* destP, size_t framesToProcess);
+void vdeinterleave(const float* sourceP, size_t channelCount, float* const* destsP, size_t framesToProcess);
+
+// Mixes interleaved stereo down to mono, destP[i] = 0.5 * (sourceP[2 * i] + sourceP[2 * i + 1]).
+void vdownmix2(const float* sourceP, float* destP, size_t framesToProcess);
+
+// Converts to 16 bit integers, destP[i] = round(sourceP[i] * 32767 + dither), saturating, with sourceP[i] clamped
+// to [-1, 1]. The dither is triangular, of one step peak, drawn from the four lanes of *ditherStateP, which must
+// start non-zero and is advanced.
+void vquantize16(const float* sourceP, int16_t* destP, uint32_t* ditherStateP, size_t framesToProcess);
+
+// Converts to 32 bit integers, destP[i] = round(sourceP[i] * *scale), with sourceP[i] clamped to [-1, 1]. The
+// scale must be below 2^31; 8388607 gives 24 bits in the low bytes.
+void vquantize32(const float* sourceP, const float* scale, int32_t* destP, size_t framesToProcess);
+
+// The inverses, destP[i] = sourceP[i] / 32768, and destP[i] = sourceP[i] * *scale.
+void vdequantize16(const int16_t* sourceP, float* destP, size_t framesToProcess);
+void vdequantize32(const int32_t* sourceP, const float* scale, float* destP, size_t framesToProcess);
+
+// Converts between floats and IEEE half precision floats held as their bits, rounding to the nearest, ties to
+// even. Values beyond the half range become infinities, and NaNs stay NaNs.
+void vhalfToFloat(const uint16_t* sourceP, float* destP, size_t framesToProcess);
+void vfloatToHalf(const float* sourceP, uint16_t* destP, size_t framesToProcess);
+
+// Converts complex values to polar form, magP[i] = |z| and phaseP[i] = atan2(imagP[i], realP[i]) to within 2e-5
+// radians, and back, realP[i] = magP[i] * cos(phaseP[i]) and imagP[i] = magP[i] * sin(phaseP[i]), to within 1e-6
+// for phases within +-8192. The destinations must not overlap the sources.
+void vpolar(const float* realP, const float* imagP, float* magP, float* phaseP, size_t framesToProcess);
+void vrect(const float* magP, const float* phaseP, float* realP, float* imagP, size_t framesToProcess);
+
+// Reads a table at fractional indices with linear interpolation. Indices are clamped to [0, tableSize - 1],
+// and the table must not be empty.
+void vlookup(const float* tableP, size_t tableSize, const float* indexP, float* destP, size_t framesToProcess);
+
 } // namespace VectorMath
 
 } // namespace lab
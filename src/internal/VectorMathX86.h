@@ -0,0 +1,62 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef VectorMathX86_h
+#define VectorMathX86_h
+
+#include "LabSound/core/Macros.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(LABSOUND_PLATFORM_OSX) && (defined(__x86_64__) || defined(_M_X64)) \
+    && (defined(LABSOUND_COMPILER_GCC) || defined(LABSOUND_COMPILER_CLANG) || defined(LABSOUND_COMPILER_VISUAL_STUDIO))
+#define LABSOUND_VECTORMATH_DISPATCH 1
+#endif
+
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+
+namespace lab {
+
+namespace VectorMath {
+
+// The unit stride kernels of VectorMath for instruction sets beyond the SSE2 baseline the library is built for.
+// They are compiled for their target with function attributes, so one binary carries all of them, and the
+// table is filled in once, when the library is loaded, with the widest implementation the processor and
+// operating system support (AVX-512, else AVX2 with FMA). Entries left nullptr, which includes any call
+// made before the table is initialized, use the baseline implementation.
+struct Kernels
+{
+    void (*vsma)(const float * source, float scale, float * dest, size_t framesToProcess);
+    void (*vsmul)(const float * source, float scale, float * dest, size_t framesToProcess);
+    void (*vadd)(const float * source1, const float * source2, float * dest, size_t framesToProcess);
+    void (*vmul)(const float * source1, const float * source2, float * dest, size_t framesToProcess);
+    void (*zvmul)(const float * real1, const float * imag1, const float * real2, const float * imag2, float * realDest, float * imagDest, size_t framesToProcess);
+    void (*zvma)(const float * real1, const float * imag1, const float * real2, const float * imag2, float * realAcc, float * imagAcc, size_t framesToProcess);
+    float (*vsvesq)(const float * source, size_t framesToProcess);
+    float (*vmaxmgv)(const float * source, size_t framesToProcess);
+    void (*vclip)(const float * source, float low, float high, float * dest, size_t framesToProcess);
+    void (*vfill)(float value, float * dest, size_t framesToProcess);
+    void (*vsadd)(const float * source, float addend, float * dest, size_t framesToProcess);
+    void (*vramp)(float start, float step, float * dest, size_t framesToProcess);
+    void (*vexp)(const float * source, float * dest, size_t framesToProcess);
+    void (*vlog)(const float * source, float * dest, size_t framesToProcess);
+    void (*vtanh)(const float * source, float * dest, size_t framesToProcess);
+    void (*vlookup)(const float * table, size_t tableSize, const float * index, float * dest, size_t framesToProcess);
+    void (*vconv)(const float * source, const float * kernel, size_t kernelSize, float * dest, size_t framesToProcess);
+    void (*vdotpr2)(const float * source, const float * kernel1, const float * kernel2, float * dot1, float * dot2, size_t framesToProcess);
+
+    // F16C, which comes with nearly all processors having AVX2, but is checked for separately.
+    void (*vhalfToFloat)(const uint16_t * source, float * dest, size_t framesToProcess);
+    void (*vfloatToHalf)(const float * source, uint16_t * dest, size_t framesToProcess);
+};
+
+const Kernels & kernels();
+
+} // namespace VectorMath
+
+} // namespace lab
+
+#endif // LABSOUND_VECTORMATH_DISPATCH
+
+#endif // VectorMathX86_h
@@ -0,0 +1,47 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef WaveFile_h
+#define WaveFile_h
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace lab {
+
+// The layout of the samples of a PCM WAV file.
+struct WaveFormat
+{
+    unsigned numberOfChannels = 0;
+    float sampleRate = 0;
+
+    // The bits each sample is stored in, 8, 16, 24 or 32. Samples are integers, 8 bit ones unsigned, unless isFloat
+    // is set, when they are 32 bit floats.
+    unsigned bitsPerSample = 0;
+    bool isFloat = false;
+
+    // Where the interleaved frames start in the file, and how many there are.
+    uint64_t dataOffset = 0;
+    uint64_t frameCount = 0;
+
+    size_t bytesPerFrame() const { return numberOfChannels * (bitsPerSample / 8); }
+};
+
+// Reads size bytes at offset into data, returning false unless all of them could be read.
+typedef std::function<bool(uint64_t offset, void * data, size_t size)> WaveFileReader;
+
+// Finds the format and the samples of a RIFF WAVE file of fileSize bytes. Returns false if it isn't one, or its
+// samples are compressed or of a size other than those WaveFormat describes.
+bool readWaveFormat(const WaveFileReader & read, uint64_t fileSize, WaveFormat & format);
+
+// Converts a sample of the format to a float.
+float convertWaveSample(const WaveFormat & format, const uint8_t * sample);
+
+// Converts frames of the format's interleaved samples to floats in numberOfChannels planar channels. Channels the
+// format has beyond those are skipped; numberOfChannels must not be more than the format's.
+void convertWaveFrames(const WaveFormat & format, const uint8_t * frames, size_t frameCount, float * const * channels, unsigned numberOfChannels);
+
+} // namespace lab
+
+#endif // WaveFile_h
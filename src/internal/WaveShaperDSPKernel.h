@@ -5,11 +5,17 @@
 #ifndef WaveShaperDSPKernel_h
 #define WaveShaperDSPKernel_h
 
+#include "LabSound/core/AudioArray.h"
+
 #include "internal/AudioDSPKernel.h"
 #include "internal/WaveShaperProcessor.h"
 
+#include <memory>
+
 namespace lab {
 
+class HalfBandDownSampler;
+class HalfBandUpSampler;
 class WaveShaperProcessor;
 
 // WaveShaperDSPKernel is an AudioDSPKernel and is responsible for non-linear distortion on one channel.
@@ -18,19 +24,35 @@ class WaveShaperDSPKernel : public AudioDSPKernel
 {
 public:  
 
-    explicit WaveShaperDSPKernel(WaveShaperProcessor * processor) : AudioDSPKernel(processor) { }
+    explicit WaveShaperDSPKernel(WaveShaperProcessor * processor);
+    virtual ~WaveShaperDSPKernel();
     
     // AudioDSPKernel
     virtual void process(ContextRenderLock&,
                          const float* source, float* dest, size_t framesToProcess) override;
-    virtual void reset() override { }
+    virtual void reset() override;
 
     virtual double tailTime(ContextRenderLock & r) const override { return 0; }
-    virtual double latencyTime(ContextRenderLock & r) const override { return 0; }
+    virtual double latencyTime(ContextRenderLock & r) const override;
     
 protected:
 
     WaveShaperProcessor* waveShaperProcessor() { return static_cast<WaveShaperProcessor*>(processor()); }
+    const WaveShaperProcessor* waveShaperProcessor() const { return static_cast<const WaveShaperProcessor*>(processor()); }
+
+    // Applies the curve at whatever rate the frames are at. destination may be source.
+    void processCurve(const float* curveData, size_t curveLength, const float* source, float* destination, size_t framesToProcess);
+
+    // The first stage doubles the rate and the second doubles it again, at which the filter can be far shorter.
+    std::unique_ptr<HalfBandUpSampler> m_upSampler;
+    std::unique_ptr<HalfBandDownSampler> m_downSampler;
+    std::unique_ptr<HalfBandUpSampler> m_upSampler2x;
+    std::unique_ptr<HalfBandDownSampler> m_downSampler2x;
+    AudioFloatArray m_tempBuffer;
+    AudioFloatArray m_tempBuffer2x;
+
+    // The oversampling the stages last ran at, so that their state can be cleared when it changes.
+    OverSampleType m_lastOversample{ OverSampleType::OVERSAMPLE_NONE };
 
 };
 
@@ -5,6 +5,8 @@
 #ifndef WaveShaperProcessor_h
 #define WaveShaperProcessor_h
 
+#include "LabSound/core/WaveShaperNode.h"
+
 #include "internal/AudioDSPKernel.h"
 #include "internal/AudioDSPKernelProcessor.h"
 #include <memory>
@@ -45,7 +47,14 @@ public:
     // the alternative is to copy the curve, but that isn't great either.
     std::unique_ptr<Curve> curve();
 
+    // The curve the kernels apply, only valid within process(), which holds the curve for them.
+    const std::vector<float> & renderingCurve() const { return m_curve; }
+
+    OverSampleType oversample() const { return m_oversample; }
+    void setOversample(OverSampleType type) { m_oversample = type; }
+
 private:
+    OverSampleType m_oversample{ OverSampleType::OVERSAMPLE_NONE };
     std::mutex m_curveWrite;
     std::vector<float> m_curve;
     std::vector<float> m_newCurve;
@@ -0,0 +1,31 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#ifndef WaveTableOscillator_h
+#define WaveTableOscillator_h
+
+#include <cstddef>
+
+namespace lab {
+
+// The render loop shared by the wavetable oscillators. A table size is a power of two, and read indices are in
+// table frames; each is read from the lower and higher tables of a WaveTable range, between the frame it falls
+// on and the next, and then crossfaded from the higher table to the lower by the range's interpolation factor.
+
+// Fills readIndices with the phase of framesToProcess frames, advancing it by increment, or by each of
+// increments, per frame. The phase is kept within [0, tableSize) and left at the frame following the last.
+// readIndices may be increments.
+void waveTableReadIndices(double & phase, double increment, unsigned tableSize, float * readIndices, size_t framesToProcess);
+void waveTableReadIndices(double & phase, const float * increments, unsigned tableSize, float * readIndices, size_t framesToProcess);
+
+// Writes the waveform at the read indices to destination.
+void waveTableRead(const float * lower, const float * higher, float tableFactor, unsigned tableSize,
+                   const float * readIndices, float * destination, size_t framesToProcess);
+
+// Adds the waveform at the read indices, scaled by amplitude, to destination.
+void waveTableAccumulate(const float * lower, const float * higher, float tableFactor, unsigned tableSize,
+                         const float * readIndices, float amplitude, float * destination, size_t framesToProcess);
+
+} // namespace lab
+
+#endif // WaveTableOscillator_h
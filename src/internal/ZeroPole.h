@@ -23,6 +23,10 @@ public:
 
     void process(const float *source, float *destination, size_t framesToProcess);
 
+    // Processes channelCount channels, each through its own filter, four at a time in vector lanes where the
+    // target has them. Any of the destinations may be its source.
+    static void process(ZeroPole* const* filters, const float* const* sourceP, float* const* destP, size_t channelCount, size_t framesToProcess);
+
     // Reset filter state.
     void reset() { m_lastX = 0; m_lastY = 0; }
     
@@ -31,6 +35,10 @@ public:
     
     float zero() const { return m_zero; }
     float pole() const { return m_pole; }
+
+private:
+
+    static void processLanes(ZeroPole* const* filters, const float* const* sourceP, float* const* destP, size_t framesToProcess);
 };
 
 } // namespace lab
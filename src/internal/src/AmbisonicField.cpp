@@ -0,0 +1,180 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/AmbisonicField.h"
+#include "internal/HRTFDatabase.h"
+#include "internal/HRTFDatabaseLoader.h"
+#include "internal/VectorMath.h"
+#include "internal/Assertions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace lab {
+
+using namespace VectorMath;
+
+AmbisonicField::AmbisonicField()
+{
+}
+
+AmbisonicField::~AmbisonicField()
+{
+}
+
+bool AmbisonicField::prepare(ContextRenderLock & r, const std::shared_ptr<HRTFDatabaseLoader> & loader)
+{
+    if (m_prepared.load(std::memory_order_acquire))
+        return true;
+
+    // Panners encoding on the render workers may get here together; one prepares, and the rest skip a quantum.
+    if (m_preparing.test_and_set(std::memory_order_acquire))
+        return false;
+
+    const bool prepared = prepareDecoder(r, loader);
+    if (prepared)
+        m_prepared.store(true, std::memory_order_release);
+    m_preparing.clear(std::memory_order_release);
+    return prepared;
+}
+
+bool AmbisonicField::prepareDecoder(ContextRenderLock & r, const std::shared_ptr<HRTFDatabaseLoader> & loader)
+{
+    if (!m_loader)
+        m_loader = loader;
+    if (!m_loader)
+        return false;
+
+    // An offline context doesn't render in real time, so it waits rather than leave its sources out.
+    const bool isOffline = r.context()->isOfflineContext();
+    if (isOffline)
+        m_loader->waitForLoaderThreadCompletion();
+
+    HRTFDatabase * database = m_loader->database();
+    if (!database)
+        return false;
+
+    const AmbisonicDecoderFilters * filters = database->ambisonicDecoderFilters();
+    while (!filters && isOffline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        filters = database->ambisonicDecoderFilters();
+    }
+    if (!filters)
+        return false;
+
+    const size_t renderQuantumSize = r.context()->renderQuantumSize();
+    m_filters = filters;
+    m_convolver.reset(new PartitionedConvolver(AmbisonicChannels, 2, filters->paths()));
+    m_field.reset(new AudioBus(AmbisonicChannels, renderQuantumSize));
+    m_decoded.reset(new AudioBus(2, renderQuantumSize));
+    for (Accumulator & accumulator : m_accumulators)
+    {
+        accumulator.field.reset(new AudioBus(AmbisonicChannels, renderQuantumSize));
+        accumulator.rampedSource.allocate(renderQuantumSize);
+    }
+    m_frameIndices.allocate(renderQuantumSize);
+
+    const float zero = 0;
+    const float one = 1;
+    vramp(&zero, &one, m_frameIndices.data(), renderQuantumSize);
+    return true;
+}
+
+void AmbisonicField::encode(const float * source, const float * fromCoefficients, const float * toCoefficients, size_t framesToProcess)
+{
+    bool isSafe = m_prepared.load(std::memory_order_acquire) && source && framesToProcess <= m_field->length();
+    ASSERT(isSafe);
+    if (!isSafe)
+        return;
+
+    // Only as many accumulators are busy as there are encodes running at once, so one is nearly always free.
+    Accumulator * accumulator = nullptr;
+    for (int i = 0; !accumulator; i = (i + 1) % MaxAccumulators)
+    {
+        if (!m_accumulators[i].busy.test_and_set(std::memory_order_acquire))
+            accumulator = &m_accumulators[i];
+    }
+
+    // A linear ramp of a coefficient, from + i * step, is from * source[i] + step * i * source[i], so each channel
+    // costs two multiply-adds with constant gains while the source is moving, and one while it isn't.
+    const bool isRamped = !std::equal(fromCoefficients, fromCoefficients + AmbisonicChannels, toCoefficients);
+    float * rampedSource = accumulator->rampedSource.data();
+    if (isRamped)
+        vmul(source, 1, m_frameIndices.data(), 1, rampedSource, 1, framesToProcess);
+
+    for (unsigned i = 0; i < AmbisonicChannels; ++i)
+    {
+        float * destination = accumulator->field->channel(i)->mutableData();
+        const float from = fromCoefficients[i];
+        const float step = (toCoefficients[i] - from) / framesToProcess;
+
+        vsma(source, 1, &from, destination, 1, framesToProcess);
+        if (isRamped && step)
+            vsma(rampedSource, 1, &step, destination, 1, framesToProcess);
+    }
+
+    accumulator->hasInput = true;
+    accumulator->busy.clear(std::memory_order_release);
+}
+
+void AmbisonicField::decode(ContextRenderLock & r, AudioBus * destination, size_t framesToProcess)
+{
+    if (!m_prepared.load(std::memory_order_acquire) || !destination)
+        return;
+
+    bool isSafe = framesToProcess <= m_field->length();
+    ASSERT(isSafe);
+    if (!isSafe)
+        return;
+
+    // The graph has been rendered, so no encode is running; the accumulators used this quantum are summed.
+    bool hasInput = false;
+    for (Accumulator & accumulator : m_accumulators)
+    {
+        if (!accumulator.hasInput)
+            continue;
+
+        if (hasInput)
+            m_field->sumFrom(*accumulator.field);
+        else
+            m_field->copyFrom(*accumulator.field);
+        accumulator.field->zero();
+        accumulator.hasInput = false;
+        hasInput = true;
+    }
+
+    // Once the last sources' tail has been decoded, there is nothing to do until one is encoded again.
+    if (!hasInput && m_silentFrames >= m_filters->tailFrames())
+        return;
+
+    if (!hasInput)
+        m_field->zero();
+
+    // The destination may be longer than the render quantum; the frames past it are left silent.
+    if (m_decoded->length() < destination->length())
+        m_decoded.reset(new AudioBus(2, destination->length()));
+
+    const float * sources[AmbisonicChannels];
+    for (unsigned i = 0; i < AmbisonicChannels; ++i)
+        sources[i] = m_field->channel(i)->data();
+    float * destinations[2] = { m_decoded->channel(0)->mutableData(), m_decoded->channel(1)->mutableData() };
+
+    m_convolver->process(sources, destinations, framesToProcess);
+
+    destination->sumFrom(*m_decoded);
+
+    m_silentFrames = hasInput ? 0 : m_silentFrames + framesToProcess;
+}
+
+size_t AmbisonicField::latencyFrames() const
+{
+    return m_prepared.load(std::memory_order_acquire) ? m_filters->fftSize() / 2 : 0;
+}
+
+} // namespace lab
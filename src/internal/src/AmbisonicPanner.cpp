@@ -0,0 +1,81 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioListener.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/AmbisonicField.h"
+#include "internal/AmbisonicPanner.h"
+#include "internal/HRTFDatabaseLoader.h"
+#include "internal/VectorMath.h"
+#include "internal/Assertions.h"
+
+#include <algorithm>
+
+namespace lab
+{
+
+AmbisonicPanner::AmbisonicPanner(const float sampleRate, std::shared_ptr<HRTFDatabaseLoader> loader)
+    : Panner(sampleRate, PanningMode::AMBISONIC)
+    , m_databaseLoader(std::move(loader))
+    , m_monoSource(AudioNode::ProcessingSizeInFrames)
+{
+    std::fill(m_coefficients, m_coefficients + AmbisonicChannels, 0.f);
+}
+
+AmbisonicPanner::~AmbisonicPanner()
+{
+}
+
+void AmbisonicPanner::pan(ContextRenderLock & r, double azimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess)
+{
+    encode(r, azimuth, elevation, 1.f, inputBus, framesToProcess);
+    if (outputBus)
+        outputBus->zero();
+}
+
+bool AmbisonicPanner::encode(ContextRenderLock & r, double azimuth, double elevation, float gain, const AudioBus * inputBus, size_t framesToProcess)
+{
+    size_t numInputChannels = inputBus ? inputBus->numberOfChannels() : 0;
+
+    bool isInputGood = inputBus && numInputChannels >= Channels::Mono && numInputChannels <= Channels::Stereo && framesToProcess <= inputBus->length();
+    ASSERT(isInputGood);
+    if (!isInputGood)
+        return false;
+
+    AmbisonicField & field = r.context()->listener().ambisonicField();
+    if (!field.prepare(r, m_databaseLoader))
+        return false;
+
+    // The field is filled from a point, so a stereo source is mixed down.
+    const float * source = inputBus->channel(0)->data();
+    if (numInputChannels == Channels::Stereo)
+    {
+        if (m_monoSource.size() < framesToProcess)
+            m_monoSource.allocate(framesToProcess);
+
+        const float half = 0.5f;
+        VectorMath::vadd(source, 1, inputBus->channel(1)->data(), 1, m_monoSource.data(), 1, framesToProcess);
+        VectorMath::vsmul(m_monoSource.data(), 1, &half, m_monoSource.data(), 1, framesToProcess);
+        source = m_monoSource.data();
+    }
+
+    float coefficients[AmbisonicChannels];
+    ambisonicCoefficients(azimuth, elevation, coefficients);
+    VectorMath::vsmul(coefficients, 1, &gain, coefficients, 1, AmbisonicChannels);
+
+    // Snap to the first position and gain, and ramp to each new one over a render quantum.
+    if (m_isFirstRender)
+    {
+        std::copy(coefficients, coefficients + AmbisonicChannels, m_coefficients);
+        m_isFirstRender = false;
+    }
+
+    field.encode(source, m_coefficients, coefficients, framesToProcess);
+    std::copy(coefficients, coefficients + AmbisonicChannels, m_coefficients);
+    return true;
+}
+
+} // namespace lab
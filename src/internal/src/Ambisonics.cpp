@@ -0,0 +1,153 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioChannel.h"
+#include "LabSound/core/Macros.h"
+
+#include "internal/Ambisonics.h"
+#include "internal/HRTFKernel.h"
+#include "internal/VectorMath.h"
+#include "internal/Assertions.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lab {
+
+namespace
+{
+    unsigned orderOfChannel(unsigned channel)
+    {
+        return static_cast<unsigned>(std::sqrt(static_cast<double>(channel)));
+    }
+
+    double legendre(unsigned order, double x)
+    {
+        double previous = 1;
+        double current = x;
+        if (!order)
+            return previous;
+        for (unsigned l = 1; l < order; ++l)
+        {
+            double next = ((2 * l + 1) * x * current - l * previous) / (l + 1);
+            previous = current;
+            current = next;
+        }
+        return current;
+    }
+
+    // The max rE weights of the orders, which narrow the decoded image of a source at the cost of some spread.
+    double maxREWeight(unsigned order)
+    {
+        return legendre(order, std::cos(137.9 / (AmbisonicOrder + 1.51) * piDouble / 180.0));
+    }
+}
+
+void ambisonicCoefficients(double azimuth, double elevation, float * coefficients)
+{
+    // Ambisonic azimuths are counterclockwise, with x to the front, y to the left, and z up.
+    const double theta = -azimuth * piDouble / 180.0;
+    const double phi = elevation * piDouble / 180.0;
+    const double x = std::cos(phi) * std::cos(theta);
+    const double y = std::cos(phi) * std::sin(theta);
+    const double z = std::sin(phi);
+
+    const double sqrt3 = std::sqrt(3.0);
+    const double sqrt15 = std::sqrt(15.0);
+    const double sqrt3_8 = std::sqrt(3.0 / 8.0);
+    const double sqrt5_8 = std::sqrt(5.0 / 8.0);
+
+    const double values[AmbisonicChannels] = {
+        1,
+
+        y,
+        z,
+        x,
+
+        sqrt3 * x * y,
+        sqrt3 * y * z,
+        0.5 * (3 * z * z - 1),
+        sqrt3 * x * z,
+        0.5 * sqrt3 * (x * x - y * y),
+
+        sqrt5_8 * y * (3 * x * x - y * y),
+        sqrt15 * x * y * z,
+        sqrt3_8 * y * (5 * z * z - 1),
+        0.5 * z * (5 * z * z - 3),
+        sqrt3_8 * x * (5 * z * z - 1),
+        0.5 * sqrt15 * z * (x * x - y * y),
+        sqrt5_8 * x * (x * x - 3 * y * y),
+    };
+
+    for (unsigned i = 0; i < AmbisonicChannels; ++i)
+        coefficients[i] = static_cast<float>(values[i]);
+}
+
+AmbisonicDecoderFilters::AmbisonicDecoderFilters(const std::vector<VirtualSpeaker> & speakers, size_t fftSize)
+    : m_fftSize(fftSize)
+    , m_tailFrames(0)
+{
+    ASSERT(!speakers.empty());
+
+    // The rings, lowest first, and the number of speakers on each.
+    std::vector<double> rings;
+    for (const VirtualSpeaker & speaker : speakers)
+        rings.push_back(speaker.elevation);
+    std::sort(rings.begin(), rings.end());
+    rings.erase(std::unique(rings.begin(), rings.end()), rings.end());
+
+    std::vector<size_t> speakersOnRing(rings.size());
+    for (const VirtualSpeaker & speaker : speakers)
+        ++speakersOnRing[std::lower_bound(rings.begin(), rings.end(), speaker.elevation) - rings.begin()];
+
+    // Each speaker's share of its ring's band, as a fraction of the sphere.
+    auto speakerWeight = [&](double elevation) -> double
+    {
+        size_t i = std::lower_bound(rings.begin(), rings.end(), elevation) - rings.begin();
+        double lower = i ? 0.5 * (rings[i - 1] + rings[i]) : -90.0;
+        double upper = i + 1 < rings.size() ? 0.5 * (rings[i] + rings[i + 1]) : 90.0;
+        double band = 0.5 * (std::sin(upper * piDouble / 180.0) - std::sin(lower * piDouble / 180.0));
+        return band / speakersOnRing[i];
+    };
+
+    // Sampling the field at the speakers: with SN3D channels the gains of each order are scaled by 2 * order + 1.
+    float orderGains[AmbisonicOrder + 1];
+    for (unsigned order = 0; order <= AmbisonicOrder; ++order)
+        orderGains[order] = static_cast<float>((2 * order + 1) * maxREWeight(order));
+
+    size_t responseLength = speakers.front().kernelL->fftSize();
+    std::vector<std::vector<float>> responses(AmbisonicChannels * 2, std::vector<float>(responseLength));
+    for (const VirtualSpeaker & speaker : speakers)
+    {
+        ASSERT(speaker.kernelL->fftSize() == responseLength && speaker.kernelR->fftSize() == responseLength);
+
+        float coefficients[AmbisonicChannels];
+        ambisonicCoefficients(speaker.azimuth, speaker.elevation, coefficients);
+        const float weight = static_cast<float>(speakerWeight(speaker.elevation));
+
+        // The kernels' responses with their leading delays put back.
+        std::unique_ptr<AudioChannel> impulseResponses[2] = { speaker.kernelL->createImpulseResponse(), speaker.kernelR->createImpulseResponse() };
+        for (unsigned channel = 0; channel < AmbisonicChannels; ++channel)
+        {
+            const float gain = weight * orderGains[orderOfChannel(channel)] * coefficients[channel];
+            for (unsigned ear = 0; ear < 2; ++ear)
+            {
+                std::vector<float> & response = responses[channel * 2 + ear];
+                VectorMath::vsma(impulseResponses[ear]->data(), 1, &gain, response.data(), 1, responseLength);
+            }
+        }
+    }
+
+    for (const std::vector<float> & response : responses)
+        m_partitions.push_back(PartitionedConvolver::partitionResponse(fftSize, response.data(), responseLength));
+
+    for (unsigned channel = 0; channel < AmbisonicChannels; ++channel)
+    {
+        for (unsigned ear = 0; ear < 2; ++ear)
+            m_paths.push_back(PartitionedConvolver::Path { channel, ear, &m_partitions[channel * 2 + ear] });
+    }
+
+    m_tailFrames = m_partitions.front().size() * (fftSize / 2) + fftSize / 2;
+}
+
+} // namespace lab
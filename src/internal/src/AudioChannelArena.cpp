@@ -0,0 +1,153 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/AudioChannelArena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+namespace lab {
+
+namespace
+{
+    const size_t CacheLineSize = 64;
+    const size_t SlabBytes = 64 * 1024;
+    const size_t ClassCount = 6; // MinFrames to MaxFrames, doubling
+
+    // A free buffer stores the link to the next free buffer in its first bytes.
+    struct FreeBuffer
+    {
+        FreeBuffer * next;
+    };
+
+    // The critical sections only unlink or link a buffer, so a spin lock keeps the render thread
+    // clear of the operating system. Each class sits on its own cache line.
+    struct alignas(CacheLineSize) SizeClass
+    {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        FreeBuffer * freeList = nullptr;
+    };
+
+    struct Arena
+    {
+        SizeClass classes[ClassCount];
+        std::atomic<size_t> bytesReserved{ 0 };
+        std::atomic<size_t> bytesInUse{ 0 };
+    };
+
+    Arena & arena()
+    {
+        // Deliberately never destroyed, so that channels released during static destruction are still valid. Built
+        // in static storage, as new only aligns the classes' cache lines from C++17.
+        static std::aligned_storage<sizeof(Arena), alignof(Arena)>::type storage;
+        static Arena * instance = new (&storage) Arena();
+        return *instance;
+    }
+
+    class SpinLock
+    {
+        std::atomic_flag & m_flag;
+    public:
+        explicit SpinLock(std::atomic_flag & flag) : m_flag(flag)
+        {
+            while (m_flag.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        ~SpinLock() { m_flag.clear(std::memory_order_release); }
+    };
+
+    size_t classIndex(size_t length, size_t & capacity)
+    {
+        size_t index = 0;
+        capacity = AudioChannelArena::MinFrames;
+        while (capacity < length)
+        {
+            capacity <<= 1;
+            ++index;
+        }
+        return index;
+    }
+
+    // Carves a new slab into buffers of the class's size, returning one and adding the rest to the free list.
+    FreeBuffer * populate(SizeClass & sizeClass, size_t capacity)
+    {
+        const size_t bufferBytes = capacity * sizeof(float);
+        const size_t count = SlabBytes > bufferBytes ? SlabBytes / bufferBytes : 1;
+
+        uint8_t * slab = static_cast<uint8_t *>(malloc(count * bufferBytes + CacheLineSize));
+        if (!slab)
+            return nullptr;
+        arena().bytesReserved.fetch_add(count * bufferBytes, std::memory_order_relaxed);
+
+        uint8_t * aligned = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(slab) + CacheLineSize - 1) & ~(uintptr_t) (CacheLineSize - 1));
+
+        SpinLock lock(sizeClass.lock);
+        for (size_t i = 1; i < count; ++i)
+        {
+            FreeBuffer * buffer = reinterpret_cast<FreeBuffer *>(aligned + i * bufferBytes);
+            buffer->next = sizeClass.freeList;
+            sizeClass.freeList = buffer;
+        }
+        return reinterpret_cast<FreeBuffer *>(aligned);
+    }
+}
+
+float * AudioChannelArena::acquire(size_t length, size_t & capacity)
+{
+    if (!length || length > MaxFrames)
+        return nullptr;
+
+    SizeClass & sizeClass = arena().classes[classIndex(length, capacity)];
+
+    FreeBuffer * buffer;
+    {
+        SpinLock lock(sizeClass.lock);
+        buffer = sizeClass.freeList;
+        if (buffer)
+            sizeClass.freeList = buffer->next;
+    }
+
+    // The slab is allocated outside of the lock, so other threads keep recycling buffers meanwhile.
+    if (!buffer)
+        buffer = populate(sizeClass, capacity);
+    if (!buffer)
+        return nullptr;
+
+    arena().bytesInUse.fetch_add(capacity * sizeof(float), std::memory_order_relaxed);
+
+    float * data = reinterpret_cast<float *>(buffer);
+    memset(data, 0, capacity * sizeof(float));
+    return data;
+}
+
+void AudioChannelArena::release(float * data, size_t capacity)
+{
+    if (!data)
+        return;
+
+    size_t classCapacity;
+    SizeClass & sizeClass = arena().classes[classIndex(capacity, classCapacity)];
+    arena().bytesInUse.fetch_sub(classCapacity * sizeof(float), std::memory_order_relaxed);
+
+    FreeBuffer * buffer = reinterpret_cast<FreeBuffer *>(data);
+    SpinLock lock(sizeClass.lock);
+    buffer->next = sizeClass.freeList;
+    sizeClass.freeList = buffer;
+}
+
+size_t AudioChannelArena::bytesReserved()
+{
+    return arena().bytesReserved.load(std::memory_order_relaxed);
+}
+
+size_t AudioChannelArena::bytesInUse()
+{
+    return arena().bytesInUse.load(std::memory_order_relaxed);
+}
+
+} // namespace lab
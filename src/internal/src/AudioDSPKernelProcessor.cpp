@@ -2,6 +2,9 @@
 // Copyright (C) 2010, Google Inc. All rights reserved.
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/extended/AudioContextLock.h"
+
 #include "internal/AudioDSPKernelProcessor.h"
 #include "internal/AudioDSPKernel.h"
 #include "internal/Assertions.h"
@@ -54,9 +57,41 @@ void AudioDSPKernelProcessor::process(ContextRenderLock& r, const AudioBus* sour
     if (!channelCountMatches)
         return;
         
-    for (unsigned i = 0; i < m_kernels.size(); ++i)
-        m_kernels[i]->process(r, source->channel(i)->data(),
-                                 destination->channel(i)->mutableData(), framesToProcess);
+    prepareKernels(r, framesToProcess);
+    processKernels(r, source, destination, framesToProcess);
+}
+
+bool AudioDSPKernelProcessor::processesInParallel(ContextRenderLock& r) const
+{
+    const size_t threshold = r.context() ? r.context()->parallelKernelThreshold() : 0;
+    return threshold && m_kernels.size() >= threshold;
+}
+
+void AudioDSPKernelProcessor::processKernels(ContextRenderLock& r, const AudioBus* source, AudioBus* destination, size_t framesToProcess)
+{
+    if (!processesInParallel(r)) {
+        for (unsigned i = 0; i < m_kernels.size(); ++i)
+            m_kernels[i]->process(r, source->channel(i)->data(),
+                                     destination->channel(i)->mutableData(), framesToProcess);
+        return;
+    }
+
+    struct Work
+    {
+        AudioDSPKernelProcessor* processor;
+        ContextRenderLock* renderLock;
+        const AudioBus* source;
+        AudioBus* destination;
+        size_t framesToProcess;
+    };
+
+    Work work = { this, &r, source, destination, framesToProcess };
+    r.context()->runOnIdleRenderWorkers(r, [](void* userData, size_t index)
+    {
+        Work* work = static_cast<Work*>(userData);
+        work->processor->m_kernels[index]->process(*work->renderLock, work->source->channel(index)->data(),
+                                                   work->destination->channel(index)->mutableData(), work->framesToProcess);
+    }, &work, m_kernels.size());
 }
 
 // Resets filter state
@@ -73,6 +108,12 @@ void AudioDSPKernelProcessor::reset()
         m_kernels[i]->reset();
 }
 
+void AudioDSPKernelProcessor::reportMemory(AudioMemoryUsage & usage) const
+{
+    for (auto & kernel : m_kernels)
+        kernel->reportMemory(usage);
+}
+
 double AudioDSPKernelProcessor::tailTime(ContextRenderLock & r) const
 {
     // It is expected that all the kernels have the same tailTime.
@@ -0,0 +1,352 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/Assertions.h"
+#include "internal/AudioFileStream.h"
+#include "internal/DenormalDisabler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace lab {
+
+namespace
+{
+    const uint64_t NoSeek = std::numeric_limits<uint64_t>::max();
+    const uint64_t NoEnd = std::numeric_limits<uint64_t>::max();
+
+    // The most frames read from the file at a time.
+    const size_t ChunkFrames = 4096;
+
+    // Reads are only started when a chunk's worth of the ring is free, so the I/O thread also looks for room at
+    // this interval, which is short next to any useful read ahead.
+    const auto PollInterval = std::chrono::milliseconds(5);
+
+    bool seekFile(std::FILE * file, uint64_t offset)
+    {
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+        return !_fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+        return !fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    }
+
+    uint64_t fileSize(std::FILE * file)
+    {
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+        if (_fseeki64(file, 0, SEEK_END))
+            return 0;
+        __int64 size = _ftelli64(file);
+#else
+        if (fseeko(file, 0, SEEK_END))
+            return 0;
+        off_t size = ftello(file);
+#endif
+        return size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+}
+
+// The thread that fills every stream's ring, taking the streams in turn a chunk at a time.
+class AudioFileStream::Thread
+{
+public:
+
+    // The thread shared by all streams, created on first use and stopped with its last stream.
+    static std::shared_ptr<Thread> shared()
+    {
+        static std::mutex sharedLock;
+        static std::weak_ptr<Thread> sharedThread;
+
+        std::lock_guard<std::mutex> lock(sharedLock);
+        std::shared_ptr<Thread> thread = sharedThread.lock();
+        if (!thread)
+        {
+            thread = std::make_shared<Thread>();
+            sharedThread = thread;
+        }
+        return thread;
+    }
+
+    Thread()
+        : m_thread(&Thread::threadEntry, this)
+    {
+    }
+
+    ~Thread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_shouldRun = false;
+        }
+        m_work.notify_all();
+        m_thread.join();
+    }
+
+    void add(AudioFileStream * stream)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_streams.push_back(stream);
+        }
+        m_work.notify_one();
+    }
+
+    // Blocks while the stream is being filled, after which the thread no longer refers to it.
+    void remove(AudioFileStream * stream)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_idle.wait(lock, [&]() { return m_busy != stream; });
+        m_streams.erase(std::remove(m_streams.begin(), m_streams.end(), stream), m_streams.end());
+    }
+
+    void wake()
+    {
+        m_work.notify_one();
+    }
+
+private:
+
+    void threadEntry()
+    {
+        DenormalDisabler denormalDisabler;
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_shouldRun)
+        {
+            // Streams may be added or removed while one is filled unlocked, so they are found by index each time.
+            bool didWork = false;
+            for (size_t i = 0; i < m_streams.size() && m_shouldRun; ++i)
+            {
+                m_busy = m_streams[i];
+                lock.unlock();
+                didWork |= m_busy->fill();
+                lock.lock();
+                m_busy = nullptr;
+                m_idle.notify_all();
+            }
+
+            if (!didWork)
+                m_work.wait_for(lock, PollInterval);
+        }
+    }
+
+    std::vector<AudioFileStream *> m_streams;
+    AudioFileStream * m_busy = nullptr;
+    bool m_shouldRun = true;
+
+    std::mutex m_lock;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+
+    std::thread m_thread;
+};
+
+std::shared_ptr<AudioFileStream> AudioFileStream::open(const std::string & path, double readAheadSeconds)
+{
+    std::FILE * file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return nullptr;
+
+    const uint64_t size = fileSize(file);
+    WaveFormat format;
+    auto read = [file](uint64_t offset, void * data, size_t bytes) {
+        return seekFile(file, offset) && std::fread(data, 1, bytes, file) == bytes;
+    };
+    if (!readWaveFormat(read, size, format))
+    {
+        LOG_ERROR("%s can't be streamed; only PCM and float WAV files can", path.c_str());
+        std::fclose(file);
+        return nullptr;
+    }
+
+    // At least a chunk more than the read ahead, so that a chunk can be read once that much is free.
+    size_t capacity = ChunkFrames;
+    const double readAheadFrames = std::max(0.0, readAheadSeconds) * format.sampleRate;
+    while (capacity < readAheadFrames + ChunkFrames)
+        capacity *= 2;
+
+    return std::shared_ptr<AudioFileStream>(new AudioFileStream(file, format, capacity));
+}
+
+AudioFileStream::AudioFileStream(std::FILE * file, const WaveFormat & format, size_t capacity)
+    : m_file(file)
+    , m_fileOffset(NoSeek)
+    , m_format(format)
+    , m_ring(capacity * format.numberOfChannels)
+    , m_capacity(capacity)
+    , m_endIndex(NoEnd)
+    , m_seekFrame(NoSeek)
+    , m_chunk(ChunkFrames * format.bytesPerFrame())
+{
+}
+
+AudioFileStream::~AudioFileStream()
+{
+    if (m_thread)
+        m_thread->remove(this);
+    std::fclose(m_file);
+}
+
+void AudioFileStream::start()
+{
+    if (m_thread)
+        return;
+
+    m_thread = Thread::shared();
+    m_thread->add(this);
+}
+
+void AudioFileStream::seek(uint64_t frame)
+{
+    m_seekFrame.store(std::min(frame, m_format.frameCount), std::memory_order_relaxed);
+    if (m_thread)
+        m_thread->wake();
+}
+
+void AudioFileStream::setLoop(bool loop, uint64_t loopStart, uint64_t loopEnd)
+{
+    m_loopStart.store(loopStart, std::memory_order_relaxed);
+    m_loopEnd.store(loopEnd, std::memory_order_relaxed);
+    m_loop.store(loop, std::memory_order_relaxed);
+    if (m_thread)
+        m_thread->wake();
+}
+
+bool AudioFileStream::readFile(uint64_t offset, void * data, size_t size)
+{
+    if (offset != m_fileOffset && !seekFile(m_file, offset))
+    {
+        m_fileOffset = NoSeek;
+        return false;
+    }
+
+    bool isRead = std::fread(data, 1, size, m_file) == size;
+    m_fileOffset = isRead ? offset + size : NoSeek;
+    return isRead;
+}
+
+bool AudioFileStream::fill()
+{
+    const uint64_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+
+    // A seek discards what was buffered, so the stream starts over from the frames written next.
+    const uint64_t seekFrame = m_seekFrame.exchange(NoSeek, std::memory_order_relaxed);
+    if (seekFrame != NoSeek)
+    {
+        std::lock_guard<std::mutex> lock(m_seekLock);
+        m_readIndex.store(writeIndex, std::memory_order_relaxed);
+        m_endIndex.store(NoEnd, std::memory_order_relaxed);
+        m_filePosition = seekFrame;
+        m_isAtEnd = false;
+    }
+
+    if (m_isAtEnd)
+        return false;
+
+    const uint64_t readIndex = m_readIndex.load(std::memory_order_acquire);
+    size_t frames = std::min(m_capacity - static_cast<size_t>(writeIndex - readIndex), ChunkFrames);
+    if (frames < ChunkFrames && frames < m_format.frameCount - std::min(m_filePosition, m_format.frameCount))
+        return false;
+
+    // The loop, if there is one, as the I/O thread will read it this time.
+    const uint64_t frameCount = m_format.frameCount;
+    const bool loop = m_loop.load(std::memory_order_relaxed);
+    uint64_t loopEnd = m_loopEnd.load(std::memory_order_relaxed);
+    if (!loopEnd || loopEnd > frameCount)
+        loopEnd = frameCount;
+    const uint64_t loopStart = std::min(m_loopStart.load(std::memory_order_relaxed), loopEnd);
+    const bool isLooping = loop && loopStart < loopEnd;
+
+    if (isLooping && m_filePosition >= loopEnd)
+        m_filePosition = loopStart;
+
+    const uint64_t segmentEnd = isLooping ? loopEnd : frameCount;
+    frames = static_cast<size_t>(std::min<uint64_t>(frames, segmentEnd - std::min(m_filePosition, segmentEnd)));
+
+    const size_t bytesPerFrame = m_format.bytesPerFrame();
+    if (frames && !readFile(m_format.dataOffset + m_filePosition * bytesPerFrame, m_chunk.data(), frames * bytesPerFrame))
+    {
+        LOG_ERROR("Streaming stopped after a read failed");
+        frames = 0;
+        m_filePosition = frameCount;
+    }
+
+    // The chunk may wrap around the end of the ring.
+    const size_t start = static_cast<size_t>(writeIndex % m_capacity);
+    const size_t firstFrames = std::min(frames, m_capacity - start);
+    const unsigned channelCount = m_format.numberOfChannels;
+    std::vector<float *> channels(channelCount);
+    for (unsigned c = 0; c < channelCount; ++c)
+        channels[c] = m_ring.data() + c * m_capacity + start;
+    convertWaveFrames(m_format, m_chunk.data(), firstFrames, channels.data(), channelCount);
+
+    if (firstFrames < frames)
+    {
+        for (unsigned c = 0; c < channelCount; ++c)
+            channels[c] = m_ring.data() + c * m_capacity;
+        convertWaveFrames(m_format, m_chunk.data() + firstFrames * bytesPerFrame, frames - firstFrames, channels.data(), channelCount);
+    }
+
+    m_filePosition += frames;
+    m_writeIndex.store(writeIndex + frames, std::memory_order_release);
+
+    if (m_filePosition >= segmentEnd)
+    {
+        if (isLooping)
+        {
+            m_filePosition = loopStart;
+        }
+        else
+        {
+            m_isAtEnd = true;
+            m_endIndex.store(writeIndex + frames, std::memory_order_release);
+        }
+    }
+
+    return frames > 0;
+}
+
+size_t AudioFileStream::read(float * const * channels, unsigned numberOfChannels, size_t frameCount)
+{
+    std::unique_lock<std::mutex> lock(m_seekLock, std::try_to_lock);
+    if (!lock.owns_lock())
+        return 0;
+
+    const uint64_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+    const uint64_t writeIndex = m_writeIndex.load(std::memory_order_acquire);
+    const uint64_t endIndex = m_endIndex.load(std::memory_order_acquire);
+    const size_t frames = static_cast<size_t>(std::min<uint64_t>(frameCount, writeIndex - readIndex));
+
+    const size_t start = static_cast<size_t>(readIndex % m_capacity);
+    const size_t firstFrames = std::min(frames, m_capacity - start);
+    numberOfChannels = std::min(numberOfChannels, m_format.numberOfChannels);
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+    {
+        const float * ring = m_ring.data() + c * m_capacity;
+        memcpy(channels[c], ring + start, sizeof(float) * firstFrames);
+        memcpy(channels[c] + firstFrames, ring, sizeof(float) * (frames - firstFrames));
+    }
+
+    m_readIndex.store(readIndex + frames, std::memory_order_release);
+
+    if (frames < frameCount && readIndex + frames < endIndex)
+        m_underrunCount.fetch_add(1, std::memory_order_relaxed);
+
+    return frames;
+}
+
+bool AudioFileStream::hasEnded()
+{
+    std::unique_lock<std::mutex> lock(m_seekLock, std::try_to_lock);
+    return lock.owns_lock() && m_readIndex.load(std::memory_order_relaxed) >= m_endIndex.load(std::memory_order_acquire);
+}
+
+} // namespace lab
@@ -0,0 +1,478 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/Logging.h"
+
+#include "internal/AudioFileWriter.h"
+#include "internal/DenormalDisabler.h"
+
+#include <wavpack.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace lab {
+
+namespace
+{
+    // Wakes are best effort, so the writer also drains the ring at this interval.
+    const auto PollInterval = std::chrono::milliseconds(20);
+
+    // The writer encodes at most this many samples at a time.
+    const size_t ChunkSamples = 16384;
+
+    // WavPack's hybrid mode ranges over these rates.
+    const float MinLossyBitsPerSample = 2;
+    const float MaxLossyBitsPerSample = 23;
+
+    const size_t WaveHeaderSize = 44;
+
+    // The CAF header: the file header, the desc chunk and the data chunk's header with its edit count.
+    const size_t CAFHeaderSize = 8 + 12 + 32 + 12 + 4;
+
+    // RIFF is little endian and CAF's headers big endian, whatever the platform.
+    void putUint16(uint8_t * p, uint16_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); }
+    void putUint32(uint8_t * p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = uint8_t(v >> (8 * i)); }
+    void putBigUint16(uint8_t * p, uint16_t v) { p[0] = uint8_t(v >> 8); p[1] = uint8_t(v); }
+    void putBigUint32(uint8_t * p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = uint8_t(v >> (24 - 8 * i)); }
+    void putBigUint64(uint8_t * p, uint64_t v) { for (int i = 0; i < 8; ++i) p[i] = uint8_t(v >> (56 - 8 * i)); }
+
+    bool endsWith(const std::string & s, const char * suffix)
+    {
+        size_t n = strlen(suffix);
+        if (s.size() < n)
+            return false;
+        for (size_t i = 0; i < n; ++i)
+            if (tolower(s[s.size() - n + i]) != suffix[i])
+                return false;
+        return true;
+    }
+}
+
+class AudioFileWriter::Encoder
+{
+public:
+
+    virtual ~Encoder() {}
+
+    // Called before the first frames are encoded, once their sample rate is known.
+    virtual bool begin(float sampleRate) { return true; }
+
+    virtual bool encode(const float * interleaved, size_t frames) = 0;
+
+    // Completes the file, now that frames frames have been encoded, and closes it.
+    virtual bool finish(uint64_t frames, float sampleRate) = 0;
+};
+
+class AudioFileWriter::PCMEncoder : public AudioFileWriter::Encoder
+{
+public:
+
+    PCMEncoder(std::FILE * file, bool isCAF, unsigned numberOfChannels)
+        : m_file(file)
+        , m_isCAF(isCAF)
+        , m_numberOfChannels(numberOfChannels)
+        , m_bytes(ChunkSamples * 4)
+    {
+    }
+
+    ~PCMEncoder() override
+    {
+        if (m_file)
+            std::fclose(m_file);
+    }
+
+    // An incomplete header is written before the frames, and the complete one once they all are.
+    bool writeHeader(uint64_t frames, float sampleRate, bool complete);
+
+    bool encode(const float * interleaved, size_t frames) override
+    {
+        // The samples are stored little endian.
+        const size_t samples = frames * m_numberOfChannels;
+        uint8_t * bytes = m_bytes.data();
+        for (size_t i = 0; i < samples; ++i)
+        {
+            uint32_t bits;
+            memcpy(&bits, interleaved + i, sizeof(bits));
+            putUint32(bytes + 4 * i, bits);
+        }
+        return std::fwrite(bytes, 4, samples, m_file) == samples;
+    }
+
+    bool finish(uint64_t frames, float sampleRate) override
+    {
+        bool written = writeHeader(frames, sampleRate, true);
+        written = std::fclose(m_file) == 0 && written;
+        m_file = nullptr;
+        return written;
+    }
+
+private:
+
+    std::FILE * m_file;
+    bool m_isCAF;
+    unsigned m_numberOfChannels;
+    std::vector<uint8_t> m_bytes;
+};
+
+bool AudioFileWriter::PCMEncoder::writeHeader(uint64_t frames, float sampleRate, bool complete)
+{
+    const uint32_t bytesPerFrame = 4 * m_numberOfChannels;
+    const uint64_t dataSize = frames * bytesPerFrame;
+
+    uint8_t header[std::max(WaveHeaderSize, CAFHeaderSize)] = {};
+    size_t size;
+    if (m_isCAF)
+    {
+        uint8_t * p = header;
+        memcpy(p, "caff", 4);
+        putBigUint16(p + 4, 1);
+        putBigUint16(p + 6, 0);
+
+        p += 8;
+        memcpy(p, "desc", 4);
+        putBigUint64(p + 4, 32);
+        double rate = sampleRate;
+        uint64_t rateBits;
+        memcpy(&rateBits, &rate, sizeof(rateBits));
+        putBigUint64(p + 12, rateBits);
+        memcpy(p + 20, "lpcm", 4);
+        putBigUint32(p + 24, 1 | 2); // floating point, little endian
+        putBigUint32(p + 28, bytesPerFrame);
+        putBigUint32(p + 32, 1);
+        putBigUint32(p + 36, m_numberOfChannels);
+        putBigUint32(p + 40, 32);
+
+        // Until the file is closed the data runs to its end, which CAF marks with a size of -1.
+        p += 44;
+        memcpy(p, "data", 4);
+        putBigUint64(p + 4, complete ? dataSize + 4 : ~uint64_t(0));
+        putBigUint32(p + 12, 0);
+        size = CAFHeaderSize;
+    }
+    else
+    {
+        const uint32_t dataSize32 = static_cast<uint32_t>(std::min<uint64_t>(dataSize, 0xFFFFFFFFu - 36));
+        memcpy(header, "RIFF", 4);
+        putUint32(header + 4, 36 + dataSize32);
+        memcpy(header + 8, "WAVE", 4);
+        memcpy(header + 12, "fmt ", 4);
+        putUint32(header + 16, 16);
+        putUint16(header + 20, 3); // IEEE float
+        putUint16(header + 22, static_cast<uint16_t>(m_numberOfChannels));
+        putUint32(header + 24, static_cast<uint32_t>(sampleRate));
+        putUint32(header + 28, static_cast<uint32_t>(sampleRate) * bytesPerFrame);
+        putUint16(header + 32, static_cast<uint16_t>(bytesPerFrame));
+        putUint16(header + 34, 32);
+        memcpy(header + 36, "data", 4);
+        putUint32(header + 40, dataSize32);
+        size = WaveHeaderSize;
+    }
+
+    return std::fseek(m_file, 0, SEEK_SET) == 0 && std::fwrite(header, 1, size, m_file) == size;
+}
+
+class AudioFileWriter::WavPackEncoder : public AudioFileWriter::Encoder
+{
+public:
+
+    WavPackEncoder(std::FILE * file, unsigned numberOfChannels, float lossyBitsPerSample)
+        : m_file(file)
+        , m_numberOfChannels(numberOfChannels)
+        , m_lossyBitsPerSample(lossyBitsPerSample)
+        , m_samples(ChunkSamples)
+    {
+    }
+
+    ~WavPackEncoder() override
+    {
+        if (m_context)
+            WavpackCloseFile(m_context);
+        if (m_file)
+            std::fclose(m_file);
+    }
+
+    bool begin(float sampleRate) override
+    {
+        m_context = WavpackOpenFileOutput(&WavPackEncoder::writeBlock, this, nullptr);
+        if (!m_context)
+            return false;
+
+        WavpackConfig config;
+        memset(&config, 0, sizeof(config));
+        config.bytes_per_sample = 3;
+        config.bits_per_sample = 24;
+        config.num_channels = static_cast<int>(m_numberOfChannels);
+        config.channel_mask = m_numberOfChannels == 1 ? 0x4 : m_numberOfChannels == 2 ? 0x3 : 0;
+        config.sample_rate = static_cast<int32_t>(sampleRate);
+        config.flags = CONFIG_FAST_FLAG;
+        if (m_lossyBitsPerSample > 0)
+        {
+            // Without CONFIG_BITRATE_KBPS, the bitrate is in bits per sample.
+            config.flags |= CONFIG_HYBRID_FLAG;
+            config.bitrate = std::max(std::min(m_lossyBitsPerSample, MaxLossyBitsPerSample), MinLossyBitsPerSample);
+        }
+
+        // The length isn't known until the file is closed, when it is written into the first block.
+        if (!WavpackSetConfiguration(m_context, &config, static_cast<uint32_t>(-1)) || !WavpackPackInit(m_context))
+        {
+            LOG_ERROR("Can't start a WavPack stream: %s", WavpackGetErrorMessage(m_context));
+            return false;
+        }
+        return true;
+    }
+
+    bool encode(const float * interleaved, size_t frames) override
+    {
+        if (!m_context)
+            return false;
+
+        const size_t samples = frames * m_numberOfChannels;
+        int32_t * destination = m_samples.data();
+        for (size_t i = 0; i < samples; ++i)
+        {
+            const float sample = std::max(std::min(interleaved[i] * 8388608.f, 8388607.f), -8388608.f);
+            destination[i] = static_cast<int32_t>(std::lrint(sample));
+        }
+        return WavpackPackSamples(m_context, destination, static_cast<uint32_t>(frames)) != 0 && !m_blockFailed;
+    }
+
+    bool finish(uint64_t frames, float sampleRate) override
+    {
+        bool written = true;
+        if (m_context)
+        {
+            written = WavpackFlushSamples(m_context) != 0 && !m_blockFailed;
+            if (written && !m_firstBlock.empty())
+            {
+                WavpackUpdateNumSamples(m_context, m_firstBlock.data());
+                written = std::fseek(m_file, 0, SEEK_SET) == 0 &&
+                          std::fwrite(m_firstBlock.data(), 1, m_firstBlock.size(), m_file) == m_firstBlock.size();
+            }
+            WavpackCloseFile(m_context);
+            m_context = nullptr;
+        }
+        written = std::fclose(m_file) == 0 && written;
+        m_file = nullptr;
+        return written;
+    }
+
+private:
+
+    // WavPack hands each block over complete. The first is kept, to be rewritten with the length.
+    static int writeBlock(void * id, void * data, int32_t byteCount)
+    {
+        WavPackEncoder * encoder = static_cast<WavPackEncoder *>(id);
+        const size_t size = static_cast<size_t>(byteCount);
+        if (encoder->m_firstBlock.empty())
+            encoder->m_firstBlock.assign(static_cast<uint8_t *>(data), static_cast<uint8_t *>(data) + size);
+        if (std::fwrite(data, 1, size, encoder->m_file) != size)
+            encoder->m_blockFailed = true;
+        return !encoder->m_blockFailed;
+    }
+
+    std::FILE * m_file;
+    unsigned m_numberOfChannels;
+    float m_lossyBitsPerSample;
+    WavpackContext * m_context{ nullptr };
+    std::vector<int32_t> m_samples;
+    std::vector<uint8_t> m_firstBlock;
+    bool m_blockFailed{ false };
+};
+
+std::unique_ptr<AudioFileWriter> AudioFileWriter::open(const std::string & path, unsigned numberOfChannels, size_t capacityFrames,
+                                                       float lossyBitsPerSample)
+{
+    std::FILE * file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        LOG_ERROR("Can't create %s to record to", path.c_str());
+        return nullptr;
+    }
+
+    numberOfChannels = std::max(numberOfChannels, 1u);
+    std::unique_ptr<Encoder> encoder;
+    if (endsWith(path, ".wv"))
+    {
+        encoder.reset(new WavPackEncoder(file, numberOfChannels, lossyBitsPerSample));
+    }
+    else
+    {
+        std::unique_ptr<PCMEncoder> pcm(new PCMEncoder(file, endsWith(path, ".caf"), numberOfChannels));
+        if (!pcm->writeHeader(0, 0, false))
+        {
+            LOG_ERROR("Can't write to %s", path.c_str());
+            return nullptr;
+        }
+        encoder = std::move(pcm);
+    }
+
+    std::unique_ptr<AudioFileWriter> writer(new AudioFileWriter(std::move(encoder), numberOfChannels, std::max<size_t>(capacityFrames, 1)));
+    writer->m_writer = std::thread(&AudioFileWriter::writerEntry, writer.get());
+    return writer;
+}
+
+AudioFileWriter::AudioFileWriter(std::unique_ptr<Encoder> encoder, unsigned numberOfChannels, size_t capacityFrames)
+    : m_encoder(std::move(encoder))
+    , m_numberOfChannels(numberOfChannels)
+    , m_ring(capacityFrames * numberOfChannels)
+    , m_capacity(capacityFrames)
+{
+}
+AudioFileWriter::~AudioFileWriter()
+{
+    close();
+}
+
+bool AudioFileWriter::write(const float * const * channels, size_t frameCount, float sampleRate)
+{
+    const uint64_t writePosition = m_writePosition.load(std::memory_order_relaxed);
+    const uint64_t readPosition = m_readPosition.load(std::memory_order_acquire);
+    if (writePosition + frameCount - readPosition > m_capacity)
+        return false;
+
+    m_sampleRate.store(sampleRate, std::memory_order_relaxed);
+
+    // The frames are interleaved into the ring in up to two spans, around its end.
+    const unsigned numberOfChannels = m_numberOfChannels;
+    float * ring = m_ring.data();
+    size_t position = static_cast<size_t>(writePosition % m_capacity);
+    for (size_t done = 0; done < frameCount;)
+    {
+        const size_t frames = std::min(frameCount - done, m_capacity - position);
+        float * destination = ring + position * numberOfChannels;
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+        {
+            const float * source = channels[c];
+            if (source)
+                for (size_t i = 0; i < frames; ++i)
+                    destination[i * numberOfChannels + c] = source[done + i];
+            else
+                for (size_t i = 0; i < frames; ++i)
+                    destination[i * numberOfChannels + c] = 0;
+        }
+        done += frames;
+        position = 0;
+    }
+
+    m_writePosition.store(writePosition + frameCount, std::memory_order_release);
+
+    // The render thread must not wait for the lock; a missed wake is covered by the writer's polling.
+    if (m_lock.try_lock())
+    {
+        m_work.notify_one();
+        m_lock.unlock();
+    }
+    return true;
+}
+
+bool AudioFileWriter::writeWaiting(const float * const * channels, size_t frameCount, float sampleRate)
+{
+    // The writer always makes room in the end, as it keeps draining the ring after a failure.
+    std::vector<const float *> part(m_numberOfChannels);
+    for (size_t done = 0; done < frameCount;)
+    {
+        const size_t frames = std::min(frameCount - done, m_capacity);
+        for (unsigned c = 0; c < m_numberOfChannels; ++c)
+            part[c] = channels[c] ? channels[c] + done : nullptr;
+
+        while (!write(part.data(), frames, sampleRate))
+        {
+            if (m_closed)
+                return false;
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_work.notify_one();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        done += frames;
+    }
+    return true;
+}
+
+bool AudioFileWriter::drain()
+{
+    const uint64_t writePosition = m_writePosition.load(std::memory_order_acquire);
+    uint64_t readPosition = m_readPosition.load(std::memory_order_relaxed);
+    if (readPosition == writePosition)
+        return false;
+
+    // The sample rate has been stored by the time the first frames are.
+    if (!m_begun)
+    {
+        m_begun = true;
+        if (!m_encoder->begin(m_sampleRate.load(std::memory_order_relaxed)))
+        {
+            LOG_ERROR("Recording stopped as its encoder couldn't start");
+            m_failed = true;
+        }
+    }
+
+    const unsigned numberOfChannels = m_numberOfChannels;
+    const size_t chunkFrames = std::max<size_t>(ChunkSamples / numberOfChannels, 1);
+    while (readPosition < writePosition)
+    {
+        const size_t position = static_cast<size_t>(readPosition % m_capacity);
+        const size_t frames = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(writePosition - readPosition, m_capacity - position), chunkFrames));
+
+        if (!m_failed && !m_encoder->encode(m_ring.data() + position * numberOfChannels, frames))
+        {
+            LOG_ERROR("Recording stopped after a write failed");
+            m_failed = true;
+        }
+
+        readPosition += frames;
+        m_readPosition.store(readPosition, std::memory_order_release);
+    }
+    return true;
+}
+
+void AudioFileWriter::writerEntry()
+{
+    DenormalDisabler denormalDisabler;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_shouldRun)
+    {
+        lock.unlock();
+        bool drained = drain();
+        lock.lock();
+
+        if (!drained && m_shouldRun)
+            m_work.wait_for(lock, PollInterval);
+    }
+}
+
+bool AudioFileWriter::close()
+{
+    if (m_closed)
+        return !m_failed;
+    m_closed = true;
+
+    if (m_writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_shouldRun = false;
+        }
+        m_work.notify_all();
+        m_writer.join();
+    }
+
+    // The writer may have stopped with frames still to write.
+    drain();
+
+    if (!m_encoder->finish(m_writePosition.load(), m_sampleRate.load()))
+        m_failed = true;
+    m_encoder.reset();
+    return !m_failed;
+}
+
+} // namespace lab
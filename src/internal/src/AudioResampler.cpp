@@ -17,45 +17,41 @@ namespace lab {
 const double AudioResampler::MaxRate = 8.0;
 
 AudioResampler::AudioResampler()
-    : m_rate(1.0)
+    : AudioResampler(1)
 {
-    m_kernels.push_back(std::unique_ptr<AudioResamplerKernel>(new AudioResamplerKernel(this)));
-    m_sourceBus = std::unique_ptr<AudioBus>(new AudioBus(1, 0, false));
 }
 
 AudioResampler::AudioResampler(unsigned numberOfChannels)
     : m_rate(1.0)
+    , m_interpolation(AudioResamplerKernel::Linear)
+    , m_kernel(new AudioResamplerKernel(numberOfChannels))
+    , m_sourceBus(new AudioBus(numberOfChannels, 0, false))
 {
-    for (unsigned i = 0; i < numberOfChannels; ++i)
-        m_kernels.push_back(std::unique_ptr<AudioResamplerKernel>(new AudioResamplerKernel(this)));
-
-    m_sourceBus = std::unique_ptr<AudioBus>(new AudioBus(numberOfChannels, 0, false));
 }
 
 void AudioResampler::configureChannels(unsigned numberOfChannels)
 {
-    unsigned currentSize = m_kernels.size();
-    if (numberOfChannels == currentSize)
+    if (numberOfChannels == m_kernel->numberOfChannels())
         return; // already setup
 
-    // First deal with adding or removing kernels.
-    if (numberOfChannels > currentSize) {
-        for (unsigned i = currentSize; i < numberOfChannels; ++i)
-            m_kernels.push_back(std::unique_ptr<AudioResamplerKernel>(new AudioResamplerKernel(this)));
-    } else
-        m_kernels.resize(numberOfChannels);
+    m_kernel.reset(new AudioResamplerKernel(numberOfChannels));
 
     // Reconfigure our source bus to the new channel size.
     m_sourceBus = std::unique_ptr<AudioBus>(new AudioBus(numberOfChannels, 0, false));
 }
 
 void AudioResampler::process(ContextRenderLock& r, AudioSourceProvider* provider, AudioBus* destinationBus, size_t framesToProcess)
+{
+    process(r, provider, destinationBus, framesToProcess, nullptr);
+}
+
+void AudioResampler::process(ContextRenderLock&, AudioSourceProvider* provider, AudioBus* destinationBus, size_t framesToProcess, const float* rates)
 {
     ASSERT(provider);
     if (!provider)
         return;
         
-    unsigned numberOfChannels = m_kernels.size();
+    unsigned numberOfChannels = m_kernel->numberOfChannels();
 
     // Make sure our configuration matches the bus we're rendering to.
     bool channelsMatch = (destinationBus && destinationBus->numberOfChannels() == numberOfChannels);
@@ -63,27 +59,19 @@ void AudioResampler::process(ContextRenderLock& r, AudioSourceProvider* provider
     if (!channelsMatch)
         return;
 
-    // Setup the source bus.
-    for (unsigned i = 0; i < numberOfChannels; ++i) {
-        // Figure out how many frames we need to get from the provider, and a pointer to the buffer.
-        size_t framesNeeded;
-        float* fillPointer = m_kernels[i]->getSourcePointer(framesToProcess, &framesNeeded);
-        ASSERT(fillPointer);
-        if (!fillPointer)
-            return;
-            
-        m_sourceBus->setChannelMemory(i, fillPointer, framesNeeded);
-    }
-
-    // Ask the provider to supply the desired number of source frames.
-    provider->provideInput(m_sourceBus.get(), m_sourceBus->length());
+    // Figure out how many frames we need to get from the provider, and point the source bus at where they go.
+    size_t framesNeeded = m_kernel->prepare(framesToProcess, m_rate, rates);
+    if (framesNeeded)
+    {
+        for (unsigned i = 0; i < numberOfChannels; ++i)
+            m_sourceBus->setChannelMemory(i, m_kernel->sourcePointer(i), framesNeeded);
 
-    // Now that we have the source data, resample each channel into the destination bus.
-    // FIXME: optimize for the common stereo case where it's faster to process both left/right channels in the same inner loop.
-    for (unsigned i = 0; i < numberOfChannels; ++i) {
-        float* destination = destinationBus->channel(i)->mutableData();
-        m_kernels[i]->process(r, destination, framesToProcess);
+        // Ask the provider to supply the desired number of source frames.
+        provider->provideInput(m_sourceBus.get(), framesNeeded);
     }
+
+    // Now that we have the source data, resample all of the channels into the destination bus.
+    m_kernel->process(destinationBus, framesToProcess, m_interpolation);
 }
 
 void AudioResampler::setRate(double rate)
@@ -96,9 +84,7 @@ void AudioResampler::setRate(double rate)
 
 void AudioResampler::reset()
 {
-    unsigned numberOfChannels = m_kernels.size();
-    for (unsigned i = 0; i < numberOfChannels; ++i)
-        m_kernels[i]->reset();
+    m_kernel->reset();
 }
 
 } // namespace lab
@@ -4,116 +4,132 @@
 
 #include "internal/AudioResamplerKernel.h"
 #include "internal/AudioResampler.h"
-#include "internal/AudioResampler.h"
 #include "internal/Assertions.h"
 
+#include "LabSound/core/AudioBus.h"
+
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
 namespace lab {
-    
+
 const size_t AudioResamplerKernel::MaxFramesToProcess = 128;
 
-AudioResamplerKernel::AudioResamplerKernel(AudioResampler* resampler)
-    : m_resampler(resampler)
-    // The buffer size must be large enough to hold up to two extra sample frames for the linear interpolation.
-    , m_sourceBuffer(2 + static_cast<int>(MaxFramesToProcess * AudioResampler::MaxRate))
-    , m_virtualReadIndex(0.0)
-    , m_fillIndex(0)
+AudioResamplerKernel::AudioResamplerKernel(unsigned numberOfChannels)
+    : m_indices(MaxFramesToProcess)
+    , m_fractions(MaxFramesToProcess)
+    , m_nextReadIndex(0)
+    , m_bufferLength(0)
+    , m_unity(false)
 {
-    m_lastValues[0] = 0.0f;
-    m_lastValues[1] = 0.0f;
+    // The kept frames, the frames of a quantum at the highest rate, and the three a position may reach past them.
+    const size_t bufferSize = History + static_cast<size_t>(MaxFramesToProcess * AudioResampler::MaxRate) + 3;
+    for (unsigned i = 0; i < numberOfChannels; ++i)
+        m_sourceBuffers.emplace_back(new AudioFloatArray(bufferSize));
+
+    reset();
 }
 
-float* AudioResamplerKernel::getSourcePointer(size_t framesToProcess, size_t* numberOfSourceFramesNeededP)
+size_t AudioResamplerKernel::prepare(size_t framesToProcess, double rate, const float * rates)
 {
     ASSERT(framesToProcess <= MaxFramesToProcess);
-    
-    // Calculate the next "virtual" index.  After process() is called, m_virtualReadIndex will equal this value.
-    double nextFractionalIndex = m_virtualReadIndex + framesToProcess * rate();
+    framesToProcess = min(framesToProcess, MaxFramesToProcess);
+    if (m_sourceBuffers.empty())
+        return 0;
 
-    // Because we're linearly interpolating between the previous and next sample we need to round up so we include the next sample.
-    int endIndex = static_cast<int>(nextFractionalIndex + 1.0); // round up to next integer index
+    const double maxRate = AudioResampler::MaxRate;
+    rate = min(max(rate, 0.0), maxRate);
+
+    // The positions are summed in double precision, so that a long run of them doesn't drift.
+    double position = m_virtualReadIndex;
+    bool unity = position == std::floor(position);
+    uint32_t * indices = m_indices.data();
+    float * fractions = m_fractions.data();
+    for (size_t i = 0; i < framesToProcess; ++i)
+    {
+        const uint32_t index = static_cast<uint32_t>(position);
+        indices[i] = index;
+        fractions[i] = static_cast<float>(position - index);
+
+        const double step = rates ? min(max(static_cast<double>(rates[i]), 0.0), maxRate) : rate;
+        unity = unity && step == 1.0;
+        position += step;
+    }
 
-    // Determine how many input frames we'll need.
-    // We need to fill the buffer up to and including endIndex (so add 1) but we've already buffered m_fillIndex frames from last time.
-    size_t framesNeeded = 1 + endIndex - m_fillIndex;
-    if (numberOfSourceFramesNeededP)
-        *numberOfSourceFramesNeededP = framesNeeded;
+    // Up to the frame two past the next call's first position, which are kept with the one before it.
+    m_nextReadIndex = position;
+    m_bufferLength = static_cast<size_t>(position) + 3;
+    m_unity = unity;
 
-    // Do bounds checking for the source buffer.
-    bool isGood = m_fillIndex < m_sourceBuffer.size() && m_fillIndex + framesNeeded <= m_sourceBuffer.size();
+    bool isGood = m_bufferLength <= m_sourceBuffers.front()->size();
     ASSERT(isGood);
     if (!isGood)
-        return 0;
+        m_bufferLength = m_sourceBuffers.front()->size();
 
-    return m_sourceBuffer.data() + m_fillIndex;
+    return m_bufferLength - History;
 }
 
-void AudioResamplerKernel::process(ContextRenderLock&, float* destination, size_t framesToProcess)
+float * AudioResamplerKernel::sourcePointer(unsigned channel)
 {
-    ASSERT(framesToProcess <= MaxFramesToProcess);
+    return m_sourceBuffers[channel]->data() + History;
+}
 
-    float* source = m_sourceBuffer.data();
-    
-    double rate = this->rate();
-    rate = max(0.0, rate);
-    rate = min(AudioResampler::MaxRate, rate);
-    
-    // Start out with the previous saved values (if any).
-    if (m_fillIndex > 0) {
-        source[0] = m_lastValues[0];
-        source[1] = m_lastValues[1];
+void AudioResamplerKernel::process(AudioBus * destination, size_t framesToProcess, Interpolation interpolation)
+{
+    ASSERT(framesToProcess <= MaxFramesToProcess);
+    framesToProcess = min(framesToProcess, MaxFramesToProcess);
+
+    const uint32_t * indices = m_indices.data();
+    const float * fractions = m_fractions.data();
+    const unsigned numberOfChannels = min(this->numberOfChannels(), static_cast<unsigned>(destination->numberOfChannels()));
+
+    for (unsigned c = 0; c < numberOfChannels; ++c)
+    {
+        const float * source = m_sourceBuffers[c]->data();
+        float * out = destination->channel(c)->mutableData();
+
+        if (m_unity)
+        {
+            memcpy(out, source + indices[0], sizeof(float) * framesToProcess);
+        }
+        else if (interpolation == Cubic)
+        {
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                const float * x = source + indices[i];
+                const float f = fractions[i];
+                const float c1 = 0.5f * (x[1] - x[-1]);
+                const float c2 = x[-1] - 2.5f * x[0] + 2.f * x[1] - 0.5f * x[2];
+                const float c3 = 0.5f * (x[2] - x[-1]) + 1.5f * (x[0] - x[1]);
+                out[i] = ((c3 * f + c2) * f + c1) * f + x[0];
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                const float a = source[indices[i]];
+                const float b = source[indices[i] + 1];
+                out[i] = a + fractions[i] * (b - a);
+            }
+        }
     }
 
-    // Make a local copy.
-    double virtualReadIndex = m_virtualReadIndex;
-    
-    // Sanity check source buffer access.
-    ASSERT(framesToProcess > 0);
-    ASSERT(virtualReadIndex >= 0 && 1 + static_cast<unsigned>(virtualReadIndex + (framesToProcess - 1) * rate) < m_sourceBuffer.size());
-
-    // Do the linear interpolation.
-    int n = framesToProcess;
-    while (n--) {
-        unsigned readIndex = static_cast<unsigned>(virtualReadIndex);
-        double interpolationFactor = virtualReadIndex - readIndex;
-
-        double sample1 = source[readIndex];
-        double sample2 = source[readIndex + 1];
-
-        double sample = (1.0 - interpolationFactor) * sample1 + interpolationFactor * sample2;
-
-        *destination++ = static_cast<float>(sample);
-
-        virtualReadIndex += rate;
-    }                        
-
-    // Save the last two sample-frames which will later be used at the beginning of the source buffer the next time around.
-    int readIndex = static_cast<int>(virtualReadIndex);
-    m_lastValues[0] = source[readIndex];
-    m_lastValues[1] = source[readIndex + 1];
-    m_fillIndex = 2;
-
-    // Wrap the virtual read index back to the start of the buffer.
-    virtualReadIndex -= readIndex;
-
-    // Put local copy back into member variable.
-    m_virtualReadIndex = virtualReadIndex;
+    // The frame before the next position, and the three after it, start the buffers the next time around.
+    const size_t keep = static_cast<size_t>(m_nextReadIndex) - 1;
+    for (auto & buffer : m_sourceBuffers)
+        memmove(buffer->data(), buffer->data() + keep, sizeof(float) * History);
+    m_virtualReadIndex = m_nextReadIndex - keep;
 }
 
 void AudioResamplerKernel::reset()
 {
-    m_virtualReadIndex = 0.0;
-    m_fillIndex = 0;
-    m_lastValues[0] = 0.0f;
-    m_lastValues[1] = 0.0f;
-}
-
-double AudioResamplerKernel::rate() const
-{
-    return m_resampler->rate();
+    for (auto & buffer : m_sourceBuffers)
+        buffer->zero();
+    m_virtualReadIndex = History;
 }
 
 } // namespace lab
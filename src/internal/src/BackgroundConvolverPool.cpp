@@ -0,0 +1,200 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/Logging.h"
+
+#include "internal/BackgroundConvolverPool.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/ReverbConvolver.h"
+#include "internal/ThreadScheduling.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace lab {
+
+namespace
+{
+    // Wakes are best effort, so idle workers also look for input at this interval. It is a small part of the
+    // slack, which is about a quarter of a second.
+    const auto PollInterval = std::chrono::milliseconds(10);
+
+    const double AtRiskLoad = 0.5;
+
+    // Background convolution is bulk work that may fall well behind the audio thread, so a few workers serve
+    // any number of convolvers, leaving the remaining cores to rendering.
+    size_t defaultWorkerCount()
+    {
+        size_t cores = std::thread::hardware_concurrency();
+        return std::min<size_t>(std::max<size_t>(cores / 2, 1), 4);
+    }
+
+    std::mutex s_sharedLock;
+    std::weak_ptr<BackgroundConvolverPool> s_shared;
+
+    // Set with s_sharedLock held, for the shared pool and any created after it.
+    bool s_sharedPolicySet = false;
+    AudioThreadPolicy s_sharedPolicy;
+    double s_sharedQuantumSeconds = 0;
+}
+
+std::shared_ptr<BackgroundConvolverPool> BackgroundConvolverPool::shared()
+{
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    std::shared_ptr<BackgroundConvolverPool> pool = s_shared.lock();
+    if (!pool)
+    {
+        pool = std::make_shared<BackgroundConvolverPool>(defaultWorkerCount());
+        if (s_sharedPolicySet)
+            pool->setThreadPolicy(s_sharedPolicy, s_sharedQuantumSeconds);
+        s_shared = pool;
+    }
+    return pool;
+}
+
+void BackgroundConvolverPool::setSharedThreadPolicy(const AudioThreadPolicy & policy, double quantumSeconds)
+{
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    s_sharedPolicySet = true;
+    s_sharedPolicy = policy;
+    s_sharedQuantumSeconds = quantumSeconds;
+    if (std::shared_ptr<BackgroundConvolverPool> pool = s_shared.lock())
+        pool->setThreadPolicy(policy, quantumSeconds);
+}
+
+unsigned BackgroundConvolverPool::sharedPolicyFailures()
+{
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    std::shared_ptr<BackgroundConvolverPool> pool = s_shared.lock();
+    return pool ? pool->policyFailures() : 0;
+}
+
+void BackgroundConvolverPool::setThreadPolicy(const AudioThreadPolicy & policy, double quantumSeconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_policy = policy;
+        m_quantumSeconds = quantumSeconds;
+        ++m_policyGeneration;
+        m_policyFailures = 0;
+    }
+    m_work.notify_all();
+}
+
+BackgroundConvolverPool::BackgroundConvolverPool(size_t workerCount)
+{
+    for (size_t i = 0; i < std::max<size_t>(workerCount, 1); ++i)
+        m_workers.emplace_back(&BackgroundConvolverPool::workerEntry, this);
+}
+
+BackgroundConvolverPool::~BackgroundConvolverPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_shouldRun = false;
+    }
+    m_work.notify_all();
+
+    for (auto & worker : m_workers)
+        if (worker.joinable())
+            worker.join();
+}
+
+void BackgroundConvolverPool::add(ReverbConvolver * convolver)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_entries.push_back({ convolver, false, false });
+}
+
+void BackgroundConvolverPool::remove(ReverbConvolver * convolver)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    auto matches = [convolver](const Entry & entry) { return entry.convolver == convolver; };
+    m_idle.wait(lock, [&]() {
+        auto entry = std::find_if(m_entries.begin(), m_entries.end(), matches);
+        return entry == m_entries.end() || !entry->busy;
+    });
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), matches), m_entries.end());
+}
+
+void BackgroundConvolverPool::wake()
+{
+    // The audio thread must not wait for the lock; a missed wake is covered by the workers' polling.
+    if (m_lock.try_lock())
+    {
+        m_work.notify_one();
+        m_lock.unlock();
+    }
+}
+
+int BackgroundConvolverPool::nextEntry()
+{
+    int next = -1;
+    double nextLoad = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (m_entries[i].busy)
+            continue;
+
+        double load = m_entries[i].convolver->backgroundLoad();
+        if (load > nextLoad)
+        {
+            next = static_cast<int>(i);
+            nextLoad = load;
+        }
+    }
+
+    if (next >= 0)
+    {
+        // Count each time a convolver becomes at risk, rather than every job while it stays so.
+        Entry & entry = m_entries[next];
+        bool atRisk = nextLoad > AtRiskLoad;
+        if (atRisk && !entry.atRisk)
+        {
+            m_atRiskCount.fetch_add(1);
+            LOG("Background convolution has used %d%% of its scheduling slack", static_cast<int>(nextLoad * 100));
+        }
+        entry.atRisk = atRisk;
+    }
+    return next;
+}
+
+void BackgroundConvolverPool::workerEntry()
+{
+    DenormalDisabler denormalDisabler;
+
+    uint32_t appliedPolicy = 0;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_shouldRun)
+    {
+        if (appliedPolicy != m_policyGeneration)
+        {
+            appliedPolicy = m_policyGeneration;
+            m_policyFailures.fetch_or(ApplyAudioThreadPolicy(m_policy, "background convolution", m_quantumSeconds));
+        }
+
+        int next = nextEntry();
+        if (next < 0)
+        {
+            m_work.wait_for(lock, PollInterval);
+            continue;
+        }
+
+        // remove() waits while the entry is busy, so the convolver outlives the unlocked section; the entry
+        // itself may move if others are added or removed meanwhile, so it is found again afterwards.
+        ReverbConvolver * convolver = m_entries[next].convolver;
+        m_entries[next].busy = true;
+
+        lock.unlock();
+        convolver->processBackgroundStages();
+        lock.lock();
+
+        for (auto & entry : m_entries)
+            if (entry.convolver == convolver)
+                entry.busy = false;
+        m_idle.notify_all();
+    }
+}
+
+} // namespace lab
@@ -10,10 +10,18 @@
 #include <algorithm>
 #include <stdio.h>
 
-#if defined(LABSOUND_PLATFORM_OSX)
+#if defined(LABSOUND_FIXED_POINT)
+#include "internal/FixedPoint.h"
+#elif defined(LABSOUND_PLATFORM_OSX)
 #include <Accelerate/Accelerate.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(ARM_NEON_INTRINSICS) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace std;
 
 namespace lab {
@@ -22,7 +30,7 @@ const int kBufferSize = 1024;
 
 Biquad::Biquad()
 {
-#if defined(LABSOUND_PLATFORM_OSX)
+#if defined(LABSOUND_PLATFORM_OSX) && !defined(LABSOUND_FIXED_POINT)
     // Allocate two samples more for filter history
     m_inputBuffer.allocate(kBufferSize + 2);
     m_outputBuffer.allocate(kBufferSize + 2);
@@ -40,7 +48,36 @@ Biquad::~Biquad()
 
 void Biquad::process(const float* sourceP, float* destP, size_t framesToProcess)
 {
-#if defined(LABSOUND_PLATFORM_OSX)
+#if defined(LABSOUND_FIXED_POINT)
+    int32_t x1 = m_x1;
+    int32_t x2 = m_x2;
+    int32_t y1 = m_y1;
+    int32_t y2 = m_y2;
+
+    const int64_t b0 = m_fixedB0;
+    const int64_t b1 = m_fixedB1;
+    const int64_t b2 = m_fixedB2;
+    const int64_t a1 = m_fixedA1;
+    const int64_t a2 = m_fixedA2;
+    const int bits = m_fixedBits;
+
+    for (size_t i = 0; i < framesToProcess; ++i) {
+        int32_t x = fixed::fromFloat(sourceP[i]);
+        int32_t y = fixed::round(b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2, bits);
+
+        destP[i] = fixed::toFloat(y);
+
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+    }
+
+    m_x1 = x1;
+    m_x2 = x2;
+    m_y1 = y1;
+    m_y2 = y2;
+#elif defined(LABSOUND_PLATFORM_OSX)
     // Use vecLib if available
     processFast(sourceP, destP, framesToProcess);
 #else
@@ -88,7 +125,268 @@ void Biquad::process(const float* sourceP, float* destP, size_t framesToProcess)
 #endif
 }
 
+void Biquad::process(const float* sourceP, float* destP, size_t framesToProcess, const Biquad& target)
+{
+    if (!framesToProcess)
+        return;
+
+#if defined(LABSOUND_FIXED_POINT)
+    // The coefficients move in the finer of the two biquads' formats, with 16 more bits to step by.
+    const int bits = std::min(m_fixedBits, target.m_fixedBits);
+    const int stepBits = bits + 16;
+    const int64_t frames = static_cast<int64_t>(framesToProcess);
+
+    int64_t b0 = fixed::quantize(m_b0, stepBits);
+    int64_t b1 = fixed::quantize(m_b1, stepBits);
+    int64_t b2 = fixed::quantize(m_b2, stepBits);
+    int64_t a1 = fixed::quantize(m_a1, stepBits);
+    int64_t a2 = fixed::quantize(m_a2, stepBits);
+    const int64_t db0 = (fixed::quantize(target.m_b0, stepBits) - b0) / frames;
+    const int64_t db1 = (fixed::quantize(target.m_b1, stepBits) - b1) / frames;
+    const int64_t db2 = (fixed::quantize(target.m_b2, stepBits) - b2) / frames;
+    const int64_t da1 = (fixed::quantize(target.m_a1, stepBits) - a1) / frames;
+    const int64_t da2 = (fixed::quantize(target.m_a2, stepBits) - a2) / frames;
+
+    int32_t x1 = m_x1;
+    int32_t x2 = m_x2;
+    int32_t y1 = m_y1;
+    int32_t y2 = m_y2;
+
+    for (size_t i = 0; i < framesToProcess; ++i) {
+        b0 += db0;
+        b1 += db1;
+        b2 += db2;
+        a1 += da1;
+        a2 += da2;
+
+        int32_t x = fixed::fromFloat(sourceP[i]);
+        int64_t accumulator = (b0 >> 16)*x + (b1 >> 16)*x1 + (b2 >> 16)*x2 - (a1 >> 16)*y1 - (a2 >> 16)*y2;
+        int32_t y = fixed::round(accumulator, bits);
+
+        destP[i] = fixed::toFloat(y);
+
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+    }
+
+    copyCoefficientsFrom(target);
+
+    m_x1 = x1;
+    m_x2 = x2;
+    m_y1 = y1;
+    m_y2 = y2;
+#else
+#if defined(LABSOUND_PLATFORM_OSX)
+    // The filter memory is the history kept at the start of the vDSP buffers.
+    double* inputP = m_inputBuffer.data();
+    double* outputP = m_outputBuffer.data();
+    double x1 = inputP[1];
+    double x2 = inputP[0];
+    double y1 = outputP[1];
+    double y2 = outputP[0];
+#else
+    double x1 = m_x1;
+    double x2 = m_x2;
+    double y1 = m_y1;
+    double y2 = m_y2;
+#endif
+
+    // Steps landing on the target's coefficients at the last frame.
+    const double scale = 1.0 / framesToProcess;
+    const double db0 = (target.m_b0 - m_b0) * scale;
+    const double db1 = (target.m_b1 - m_b1) * scale;
+    const double db2 = (target.m_b2 - m_b2) * scale;
+    const double da1 = (target.m_a1 - m_a1) * scale;
+    const double da2 = (target.m_a2 - m_a2) * scale;
+
+    double b0 = m_b0;
+    double b1 = m_b1;
+    double b2 = m_b2;
+    double a1 = m_a1;
+    double a2 = m_a2;
+
+    for (size_t i = 0; i < framesToProcess; ++i) {
+        b0 += db0;
+        b1 += db1;
+        b2 += db2;
+        a1 += da1;
+        a2 += da2;
+
+        float x = sourceP[i];
+        float y = static_cast<float>(b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2);
+
+        destP[i] = y;
+
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+    }
+
+    // The steps may not sum to the target exactly, so take its coefficients as they are.
+    copyCoefficientsFrom(target);
+
 #if defined(LABSOUND_PLATFORM_OSX)
+    inputP[1] = DenormalDisabler::flushDenormalFloatToZero(x1);
+    inputP[0] = DenormalDisabler::flushDenormalFloatToZero(x2);
+    outputP[1] = DenormalDisabler::flushDenormalFloatToZero(y1);
+    outputP[0] = DenormalDisabler::flushDenormalFloatToZero(y2);
+#else
+    m_x1 = DenormalDisabler::flushDenormalFloatToZero(x1);
+    m_x2 = DenormalDisabler::flushDenormalFloatToZero(x2);
+    m_y1 = DenormalDisabler::flushDenormalFloatToZero(y1);
+    m_y2 = DenormalDisabler::flushDenormalFloatToZero(y2);
+#endif
+#endif // LABSOUND_FIXED_POINT
+}
+
+void Biquad::copyCoefficientsFrom(const Biquad& other)
+{
+    m_b0 = other.m_b0;
+    m_b1 = other.m_b1;
+    m_b2 = other.m_b2;
+    m_a1 = other.m_a1;
+    m_a2 = other.m_a2;
+
+#if defined(LABSOUND_FIXED_POINT)
+    m_fixedB0 = other.m_fixedB0;
+    m_fixedB1 = other.m_fixedB1;
+    m_fixedB2 = other.m_fixedB2;
+    m_fixedA1 = other.m_fixedA1;
+    m_fixedA2 = other.m_fixedA2;
+    m_fixedBits = other.m_fixedBits;
+#endif
+}
+
+void Biquad::getCoefficients(double& b0, double& b1, double& b2, double& a1, double& a2) const
+{
+    b0 = m_b0;
+    b1 = m_b1;
+    b2 = m_b2;
+    a1 = m_a1;
+    a2 = m_a2;
+}
+
+#if !defined(LABSOUND_PLATFORM_OSX) && !defined(LABSOUND_FIXED_POINT) && (defined(__SSE2__) || (defined(ARM_NEON_INTRINSICS) && defined(__aarch64__)))
+#define BIQUAD_LANES 1
+
+namespace {
+
+// Two channels of double precision filter memory. The arithmetic is the scalar loop's, term by term and in the
+// same order, so a channel filters to the same samples whichever way it is processed.
+#ifdef __SSE2__
+    typedef __m128d Lanes;
+    inline Lanes broadcast(double value) { return _mm_set1_pd(value); }
+    inline Lanes load(double a, double b) { return _mm_set_pd(b, a); }
+    inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_pd(a, b); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm_add_pd(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_pd(a, b); }
+    inline double lane0(Lanes a) { return _mm_cvtsd_f64(a); }
+    inline double lane1(Lanes a) { return _mm_cvtsd_f64(_mm_unpackhi_pd(a, a)); }
+
+    // Rounds to the float written out, and returns it widened again for the filter memory.
+    inline Lanes roundToFloat(Lanes y, float& a, float& b)
+    {
+        __m128 rounded = _mm_cvtpd_ps(y);
+        a = _mm_cvtss_f32(rounded);
+        b = _mm_cvtss_f32(_mm_shuffle_ps(rounded, rounded, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtps_pd(rounded);
+    }
+#else
+    typedef float64x2_t Lanes;
+    inline Lanes broadcast(double value) { return vdupq_n_f64(value); }
+    inline Lanes load(double a, double b) { return vsetq_lane_f64(b, vdupq_n_f64(a), 1); }
+    inline Lanes mul(Lanes a, Lanes b) { return vmulq_f64(a, b); }
+    inline Lanes add(Lanes a, Lanes b) { return vaddq_f64(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return vsubq_f64(a, b); }
+    inline double lane0(Lanes a) { return vgetq_lane_f64(a, 0); }
+    inline double lane1(Lanes a) { return vgetq_lane_f64(a, 1); }
+
+    inline Lanes roundToFloat(Lanes y, float& a, float& b)
+    {
+        float32x2_t rounded = vcvt_f32_f64(y);
+        a = vget_lane_f32(rounded, 0);
+        b = vget_lane_f32(rounded, 1);
+        return vcvt_f64_f32(rounded);
+    }
+#endif
+
+} // namespace
+
+template <size_t Pairs>
+void Biquad::processLanes(Biquad* const* biquads, const float* const* sourceP, float* const* destP, size_t framesToProcess)
+{
+    // The caller has given every biquad the first one's coefficients.
+    const Biquad& coefficients = *biquads[0];
+    const Lanes b0 = broadcast(coefficients.m_b0);
+    const Lanes b1 = broadcast(coefficients.m_b1);
+    const Lanes b2 = broadcast(coefficients.m_b2);
+    const Lanes a1 = broadcast(coefficients.m_a1);
+    const Lanes a2 = broadcast(coefficients.m_a2);
+
+    Lanes x1[Pairs], x2[Pairs], y1[Pairs], y2[Pairs];
+    for (size_t p = 0; p < Pairs; ++p) {
+        const Biquad& first = *biquads[p * 2];
+        const Biquad& second = *biquads[p * 2 + 1];
+        x1[p] = load(first.m_x1, second.m_x1);
+        x2[p] = load(first.m_x2, second.m_x2);
+        y1[p] = load(first.m_y1, second.m_y1);
+        y2[p] = load(first.m_y2, second.m_y2);
+    }
+
+    for (size_t i = 0; i < framesToProcess; ++i) {
+        for (size_t p = 0; p < Pairs; ++p) {
+            Lanes x = load(sourceP[p * 2][i], sourceP[p * 2 + 1][i]);
+            Lanes y = sub(sub(add(add(mul(b0, x), mul(b1, x1[p])), mul(b2, x2[p])), mul(a1, y1[p])), mul(a2, y2[p]));
+
+            x2[p] = x1[p];
+            x1[p] = x;
+            y2[p] = y1[p];
+            y1[p] = roundToFloat(y, destP[p * 2][i], destP[p * 2 + 1][i]);
+        }
+    }
+
+    for (size_t p = 0; p < Pairs; ++p) {
+        Biquad& first = *biquads[p * 2];
+        Biquad& second = *biquads[p * 2 + 1];
+        first.m_x1 = DenormalDisabler::flushDenormalFloatToZero(lane0(x1[p]));
+        first.m_x2 = DenormalDisabler::flushDenormalFloatToZero(lane0(x2[p]));
+        first.m_y1 = DenormalDisabler::flushDenormalFloatToZero(lane0(y1[p]));
+        first.m_y2 = DenormalDisabler::flushDenormalFloatToZero(lane0(y2[p]));
+        second.m_x1 = DenormalDisabler::flushDenormalFloatToZero(lane1(x1[p]));
+        second.m_x2 = DenormalDisabler::flushDenormalFloatToZero(lane1(x2[p]));
+        second.m_y1 = DenormalDisabler::flushDenormalFloatToZero(lane1(y1[p]));
+        second.m_y2 = DenormalDisabler::flushDenormalFloatToZero(lane1(y2[p]));
+    }
+}
+
+#endif
+
+void Biquad::process(Biquad* const* biquads, const float* const* sourceP, float* const* destP,
+                     size_t channelCount, size_t framesToProcess)
+{
+    for (size_t channel = 1; channel < channelCount; ++channel)
+        biquads[channel]->copyCoefficientsFrom(*biquads[0]);
+
+    size_t channel = 0;
+
+#ifdef BIQUAD_LANES
+    // Four channels at a time keep two independent recurrences in flight, then a last pair.
+    for (; channel + 4 <= channelCount; channel += 4)
+        processLanes<2>(biquads + channel, sourceP + channel, destP + channel, framesToProcess);
+    if (channel + 2 <= channelCount) {
+        processLanes<1>(biquads + channel, sourceP + channel, destP + channel, framesToProcess);
+        channel += 2;
+    }
+#endif
+
+    for (; channel < channelCount; ++channel)
+        biquads[channel]->process(sourceP[channel], destP[channel], framesToProcess);
+}
+
+#if defined(LABSOUND_PLATFORM_OSX) && !defined(LABSOUND_FIXED_POINT)
 
 // Here we have optimized version using Accelerate.framework
 
@@ -147,7 +445,7 @@ void Biquad::processSliceFast(double* sourceP, double* destP, double* coefficien
 
 void Biquad::reset()
 {
-#if defined(LABSOUND_PLATFORM_OSX)
+#if defined(LABSOUND_PLATFORM_OSX) && !defined(LABSOUND_FIXED_POINT)
     // Two extra samples for filter history
     double* inputP = m_inputBuffer.data();
     inputP[0] = 0;
@@ -246,8 +544,29 @@ void Biquad::setNormalizedCoefficients(double b0, double b1, double b2, double a
     m_a1 = a1 * a0Inverse;
     m_a2 = a2 * a0Inverse;
 
+#if defined(LABSOUND_FIXED_POINT)
+    quantizeCoefficients();
+#endif
+}
+
+#if defined(LABSOUND_FIXED_POINT)
+
+void Biquad::quantizeCoefficients()
+{
+    double largest = 0;
+    for (double c : { m_b0, m_b1, m_b2, m_a1, m_a2 })
+        largest = std::max(largest, std::abs(c));
+
+    m_fixedBits = fixed::coefficientBits(largest);
+    m_fixedB0 = fixed::saturate(fixed::quantize(m_b0, m_fixedBits));
+    m_fixedB1 = fixed::saturate(fixed::quantize(m_b1, m_fixedBits));
+    m_fixedB2 = fixed::saturate(fixed::quantize(m_b2, m_fixedBits));
+    m_fixedA1 = fixed::saturate(fixed::quantize(m_a1, m_fixedBits));
+    m_fixedA2 = fixed::saturate(fixed::quantize(m_a2, m_fixedBits));
 }
 
+#endif
+
 void Biquad::setLowShelfParams(double frequency, double dbGain)
 {
     // Clip frequencies to between 0 and 1, inclusive.
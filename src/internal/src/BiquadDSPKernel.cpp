@@ -42,51 +42,56 @@ void BiquadDSPKernel::updateCoefficientsIfNecessary(ContextRenderLock& r, bool u
             detune = biquadProcessor()->parameter4()->value(r);
         }
 
-        // Convert from Hertz to normalized frequency 0 -> 1.
-        double nyquist = r.context()->sampleRate() * 0.5f;
-        double normalizedFrequency = value1 / nyquist;
-
-        // Offset frequency by detune.
-        if (detune)
-            normalizedFrequency *= pow(2, detune / 1200);
-
-        // Configure the biquad with the new filter parameters for the appropriate type of filter.
-        switch (biquadProcessor()->type()) {
-        case FilterType::LOWPASS:
-            m_biquad.setLowpassParams(normalizedFrequency, value2);
-            break;
-
-        case FilterType::HIGHPASS:
-            m_biquad.setHighpassParams(normalizedFrequency, value2);
-            break;
-
-        case FilterType::BANDPASS:
-            m_biquad.setBandpassParams(normalizedFrequency, value2);
-            break;
-
-        case FilterType::LOWSHELF:
-            m_biquad.setLowShelfParams(normalizedFrequency, gain);
-            break;
-
-        case FilterType::HIGHSHELF:
-            m_biquad.setHighShelfParams(normalizedFrequency, gain);
-            break;
-
-        case FilterType::PEAKING:
-            m_biquad.setPeakingParams(normalizedFrequency, value2, gain);
-            break;
-
-        case FilterType::NOTCH:
-            m_biquad.setNotchParams(normalizedFrequency, value2);
-            break;
-
-        case FilterType::ALLPASS:
-            m_biquad.setAllpassParams(normalizedFrequency, value2);
-            break;
-                
-        default:
-            break;
-        }
+        setCoefficients(m_biquad, biquadProcessor()->type(), r.context()->sampleRate(), value1, value2, gain, detune);
+    }
+}
+
+void BiquadDSPKernel::setCoefficients(Biquad& biquad, FilterType type, double sampleRate, double frequency, double q, double gain, double detune)
+{
+    // Convert from Hertz to normalized frequency 0 -> 1.
+    double nyquist = sampleRate * 0.5;
+    double normalizedFrequency = frequency / nyquist;
+
+    // Offset frequency by detune.
+    if (detune)
+        normalizedFrequency *= pow(2, detune / 1200);
+
+    // Configure the biquad with the new filter parameters for the appropriate type of filter.
+    switch (type) {
+    case FilterType::LOWPASS:
+        biquad.setLowpassParams(normalizedFrequency, q);
+        break;
+
+    case FilterType::HIGHPASS:
+        biquad.setHighpassParams(normalizedFrequency, q);
+        break;
+
+    case FilterType::BANDPASS:
+        biquad.setBandpassParams(normalizedFrequency, q);
+        break;
+
+    case FilterType::LOWSHELF:
+        biquad.setLowShelfParams(normalizedFrequency, gain);
+        break;
+
+    case FilterType::HIGHSHELF:
+        biquad.setHighShelfParams(normalizedFrequency, gain);
+        break;
+
+    case FilterType::PEAKING:
+        biquad.setPeakingParams(normalizedFrequency, q, gain);
+        break;
+
+    case FilterType::NOTCH:
+        biquad.setNotchParams(normalizedFrequency, q);
+        break;
+
+    case FilterType::ALLPASS:
+        biquad.setAllpassParams(normalizedFrequency, q);
+        break;
+
+    default:
+        break;
     }
 }
 
@@ -94,9 +99,8 @@ void BiquadDSPKernel::process(ContextRenderLock& r, const float* source, float*
 {
     ASSERT(source && destination && biquadProcessor());
     
-    // Recompute filter coefficients if any of the parameters have changed.
-    // FIXME: as an optimization, implement a way that a Biquad object can simply copy its internal filter coefficients from another Biquad object.
-    // Then re-factor this code to only run for the first BiquadDSPKernel of each BiquadProcessor.
+    // Recompute filter coefficients if any of the parameters have changed. A processor with more than one channel
+    // computes them once, on its first kernel, and filters the channels together instead.
 
     updateCoefficientsIfNecessary(r, true, false);
 
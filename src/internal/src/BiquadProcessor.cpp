@@ -2,15 +2,23 @@
 // Copyright (C) 2010, Google Inc. All rights reserved.
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/extended/AudioContextLock.h"
+
 #include "internal/BiquadProcessor.h"
 #include "internal/BiquadDSPKernel.h"
 
+#include <algorithm>
+
 namespace lab {
+
+const size_t BiquadProcessor::GroupSize;
     
 BiquadProcessor::BiquadProcessor(size_t numberOfChannels, bool autoInitialize) : AudioDSPKernelProcessor(numberOfChannels),
     m_type(LOWPASS), 
     m_filterCoefficientsDirty(true), 
-    m_hasSampleAccurateValues(false)
+    m_hasSampleAccurateValues(false),
+    m_coefficientInterval(16)
 {
 
     // Create parameters for BiquadFilterNode.
@@ -34,24 +42,30 @@ AudioDSPKernel* BiquadProcessor::createKernel()
     return new BiquadDSPKernel(this);
 }
 
-void BiquadProcessor::checkForDirtyCoefficients(ContextRenderLock& r)
+void BiquadProcessor::checkForDirtyCoefficients(ContextRenderLock& r, size_t framesToProcess)
 {
     // Deal with smoothing / de-zippering. Start out assuming filter parameters are not changing.
 
     // The BiquadDSPKernel objects rely on this value to see if they need to re-compute their internal filter coefficients.
     m_filterCoefficientsDirty = false;
     m_hasSampleAccurateValues = false;
-    
-    if (m_parameter1->hasSampleAccurateValues() || m_parameter2->hasSampleAccurateValues() || m_parameter3->hasSampleAccurateValues() || m_parameter4->hasSampleAccurateValues()) {
+
+    // A parameter automated on a timeline that holds one value over the quantum is smoothed like any other,
+    // snapping to the value, so the coefficients are only computed again when the value changes.
+    auto isChanging = [&r, framesToProcess](AudioParam& param) {
+        return param.hasSampleAccurateValues() && !param.isConstantForQuantum(r, framesToProcess);
+    };
+
+    if (isChanging(*m_parameter1) || isChanging(*m_parameter2) || isChanging(*m_parameter3) || isChanging(*m_parameter4)) {
         m_filterCoefficientsDirty = true;
         m_hasSampleAccurateValues = true;
     } else {
         if (m_hasJustReset) {
             // Snap to exact values first time after reset, then smooth for subsequent changes.
-            m_parameter1->resetSmoothedValue();
-            m_parameter2->resetSmoothedValue();
-            m_parameter3->resetSmoothedValue();
-            m_parameter4->resetSmoothedValue();
+            m_parameter1->resetSmoothedValue(r);
+            m_parameter2->resetSmoothedValue(r);
+            m_parameter3->resetSmoothedValue(r);
+            m_parameter4->resetSmoothedValue(r);
             m_filterCoefficientsDirty = true;
             m_hasJustReset = false;
         } else {
@@ -73,12 +87,112 @@ void BiquadProcessor::process(ContextRenderLock& r, const AudioBus* source, Audi
         return;
     }
         
-    checkForDirtyCoefficients(r);
-            
-    // For each channel of our input, process using the corresponding BiquadDSPKernel into the output channel.
-    for (unsigned i = 0; i < m_kernels.size(); ++i) {
-        m_kernels[i]->process(r, source->channel(i)->data(), destination->channel(i)->mutableData(), framesToProcess);
+    checkForDirtyCoefficients(r, framesToProcess);
+
+    if (m_hasSampleAccurateValues) {
+        processSampleAccurate(r, source, destination, framesToProcess);
+        return;
     }
+
+    if (m_kernels.size() < 2) {
+        // For each channel of our input, process using the corresponding BiquadDSPKernel into the output channel.
+        for (unsigned i = 0; i < m_kernels.size(); ++i) {
+            m_kernels[i]->process(r, source->channel(i)->data(), destination->channel(i)->mutableData(), framesToProcess);
+        }
+        return;
+    }
+
+    // Every kernel computes the same coefficients from the same parameters, so the first computes them and the
+    // channels are filtered together, a group at a time, with its coefficients.
+    BiquadDSPKernel* first = static_cast<BiquadDSPKernel*>(m_kernels[0].get());
+    first->updateCoefficientsIfNecessary(r, true, false);
+
+    struct Work
+    {
+        BiquadProcessor* processor;
+        const AudioBus* source;
+        AudioBus* destination;
+        size_t framesToProcess;
+    };
+    Work work = { this, source, destination, framesToProcess };
+    auto task = [](void* userData, size_t group) {
+        Work* work = static_cast<Work*>(userData);
+        work->processor->processGroup(work->source, work->destination, group * GroupSize, work->framesToProcess);
+    };
+
+    // A wide bus's groups are independent, and may be filtered on the render workers.
+    const size_t groups = (m_kernels.size() + GroupSize - 1) / GroupSize;
+    if (groups > 1 && processesInParallel(r))
+        r.context()->runOnIdleRenderWorkers(r, task, &work, groups);
+    else {
+        for (size_t group = 0; group < groups; ++group)
+            task(&work, group);
+    }
+}
+
+void BiquadProcessor::processGroup(const AudioBus* source, AudioBus* destination, size_t start, size_t framesToProcess)
+{
+    Biquad* biquads[GroupSize];
+    const float* sources[GroupSize];
+    float* destinations[GroupSize];
+
+    const size_t count = std::min(GroupSize, m_kernels.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+        biquads[i] = &static_cast<BiquadDSPKernel*>(m_kernels[start + i].get())->biquad();
+        sources[i] = source->channel(start + i)->data();
+        destinations[i] = destination->channel(start + i)->mutableData();
+    }
+    if (start)
+        biquads[0]->copyCoefficientsFrom(static_cast<BiquadDSPKernel*>(m_kernels[0].get())->biquad());
+    Biquad::process(biquads, sources, destinations, count, framesToProcess);
+}
+
+void BiquadProcessor::processSampleAccurate(ContextRenderLock& r, const AudioBus* source, AudioBus* destination, size_t framesToProcess)
+{
+    AudioParam* parameters[4] = { m_parameter1.get(), m_parameter2.get(), m_parameter3.get(), m_parameter4.get() };
+    float* values[4];
+    for (int i = 0; i < 4; ++i) {
+        if (m_parameterValues[i].size() < framesToProcess)
+            m_parameterValues[i].allocate(framesToProcess);
+        values[i] = m_parameterValues[i].data();
+
+        if (parameters[i]->hasSampleAccurateValues())
+            parameters[i]->calculateSampleAccurateValues(r, values[i], framesToProcess);
+        else
+            std::fill(values[i], values[i] + framesToProcess, parameters[i]->finalValue(r));
+    }
+
+    const double sampleRate = r.context()->sampleRate();
+
+    if (m_hasJustReset) {
+        // Start from the first frame's coefficients rather than ramping to them from the last filter's.
+        BiquadDSPKernel::setCoefficients(m_nextCoefficients, m_type, sampleRate, values[0][0], values[1][0], values[2][0], values[3][0]);
+        for (unsigned i = 0; i < m_kernels.size(); ++i)
+            static_cast<BiquadDSPKernel*>(m_kernels[i].get())->biquad().copyCoefficientsFrom(m_nextCoefficients);
+
+        for (int i = 0; i < 4; ++i)
+            parameters[i]->resetSmoothedValue(r);
+        m_hasJustReset = false;
+    }
+
+    // Designing the coefficients costs several transcendental functions, so it is done every interval, for the
+    // interval's last frame, and each channel ramps to them over the interval.
+    const size_t interval = m_coefficientInterval;
+    for (size_t start = 0; start < framesToProcess; start += interval) {
+        const size_t frames = std::min(interval, framesToProcess - start);
+        const size_t last = start + frames - 1;
+        BiquadDSPKernel::setCoefficients(m_nextCoefficients, m_type, sampleRate, values[0][last], values[1][last], values[2][last], values[3][last]);
+
+        for (unsigned i = 0; i < m_kernels.size(); ++i) {
+            Biquad& biquad = static_cast<BiquadDSPKernel*>(m_kernels[i].get())->biquad();
+            biquad.process(source->channel(i)->data() + start, destination->channel(i)->mutableData() + start, frames, m_nextCoefficients);
+        }
+    }
+}
+
+void BiquadProcessor::setCoefficientInterval(size_t frames)
+{
+    m_coefficientInterval = std::max(frames, size_t(1));
 }
 
 void BiquadProcessor::setType(FilterType type)
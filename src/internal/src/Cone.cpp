@@ -5,13 +5,63 @@
 #include "internal/Cone.h"
 #include "LabSound/core/Macros.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace lab {
 
+namespace
+{
+    // The angle in degrees whose half has the sine u, 2 asin(u), for u from 0 to the sine of 45 degrees, where it is
+    // smooth, at ConeAnglePoints intervals. Read with linear interpolation it is within about 1e-4 degrees.
+    const int ConeAnglePoints = 256;
+    const double ConeAngleRange = 0.70710678118654752;
+
+    struct ConeAngleTable
+    {
+        float angles[ConeAnglePoints + 1];
+
+        ConeAngleTable()
+        {
+            for (int i = 0; i <= ConeAnglePoints; ++i)
+                angles[i] = static_cast<float>(360.0 * std::asin(ConeAngleRange * i / ConeAnglePoints) / piDouble);
+        }
+
+        double lookup(double u) const
+        {
+            const double position = std::min(u * (ConeAnglePoints / ConeAngleRange), double(ConeAnglePoints));
+            const int point = std::min(static_cast<int>(position), ConeAnglePoints - 1);
+            return angles[point] + (angles[point + 1] - angles[point]) * (position - point);
+        }
+    };
+
+    // The angle between two unit vectors, in degrees, from the cosine of it, without acos(). Up to 90 degrees, the
+    // sine of the half angle is sqrt((1 - c) / 2); beyond, the cosine of it is sqrt((1 + c) / 2), and the angle is
+    // 180 degrees less that whose half has that sine.
+    double coneAngle(double angleCosine)
+    {
+        static const ConeAngleTable table;
+        if (angleCosine >= 0)
+            return table.lookup(std::sqrt(std::max(0.0, (1 - angleCosine) * 0.5)));
+        return 180.0 - table.lookup(std::sqrt(std::max(0.0, (1 + angleCosine) * 0.5)));
+    }
+}
+
 ConeEffect::ConeEffect()
     : m_innerAngle(360.0)
     , m_outerAngle(360.0)
     , m_outerGain(0.0)
 {
+    updateThresholds();
+}
+
+void ConeEffect::updateThresholds()
+{
+    // Divide by 2.0 here since API is entire angle (not half-angle)
+    const double absInnerAngle = std::min(std::fabs(m_innerAngle) / 2.0, 180.0);
+    const double absOuterAngle = std::min(std::fabs(m_outerAngle) / 2.0, 180.0);
+    m_innerCosine = std::cos(absInnerAngle * piDouble / 180.0);
+    m_outerCosine = std::cos(absOuterAngle * piDouble / 180.0);
 }
 
 double ConeEffect::gain(FloatPoint3D sourcePosition, FloatPoint3D sourceOrientation, FloatPoint3D listenerPosition)
@@ -27,29 +77,26 @@ double ConeEffect::gain(FloatPoint3D sourcePosition, FloatPoint3D sourceOrientat
     normalizedSourceOrientation = normalize(normalizedSourceOrientation);
 
     // Angle between the source orientation vector and the source-listener vector
-    double dotProduct = dot(sourceToListener, normalizedSourceOrientation);
-    double angle = 180.0 * acos(dotProduct) / piDouble;
-    double absAngle = fabs(angle);
+    return gain(dot(sourceToListener, normalizedSourceOrientation));
+}
 
-    // Divide by 2.0 here since API is entire angle (not half-angle)
-    double absInnerAngle = fabs(m_innerAngle) / 2.0;
-    double absOuterAngle = fabs(m_outerAngle) / 2.0;
-    double gain = 1.0;
-
-    if (absAngle <= absInnerAngle)
-        // No attenuation
-        gain = 1.0;
-    else if (absAngle >= absOuterAngle)
-        // Max attenuation
-        gain = m_outerGain;
-    else {
-        // Between inner and outer cones
-        // inner -> outer, x goes from 0 -> 1
-        double x = (absAngle - absInnerAngle) / (absOuterAngle - absInnerAngle);
-        gain = (1.0 - x) + m_outerGain * x;
-    }
+double ConeEffect::gain(double angleCosine) const
+{
+    if ((m_innerAngle == 360.0) && (m_outerAngle == 360.0))
+        return 1.0; // no cone specified - unity gain
+
+    // The cosine falls as the angle grows, so within the inner cone it is at least the inner half angle's.
+    if (angleCosine >= m_innerCosine)
+        return 1.0; // No attenuation
+    if (angleCosine <= m_outerCosine)
+        return m_outerGain; // Max attenuation
 
-    return gain;
+    // Between inner and outer cones
+    // inner -> outer, x goes from 0 -> 1
+    double absInnerAngle = std::fabs(m_innerAngle) / 2.0;
+    double absOuterAngle = std::fabs(m_outerAngle) / 2.0;
+    double x = std::max(0.0, std::min(1.0, (coneAngle(angleCosine) - absInnerAngle) / (absOuterAngle - absInnerAngle)));
+    return (1.0 - x) + m_outerGain * x;
 }
 
 } // namespace lab
@@ -2,13 +2,19 @@
 // Copyright (C) 2010, Google Inc. All rights reserved.
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioMemory.h"
 #include "LabSound/core/AudioNode.h"
 
 #include "internal/DelayDSPKernel.h"
 #include "internal/AudioUtilities.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
@@ -16,10 +22,45 @@ namespace lab {
 
 const float SmoothingTimeConstant = 0.020f; // 20ms
 
+// How near, in frames, a smoothed delay comes to the desired delay before it is taken to have arrived.
+const double SnapThresholdFrames = 1e-4;
+
+const double DelayDSPKernel::InitialCapacityTime = 0.1;
+
+// A larger buffer, made on the graph update thread. The render thread asks for it, swaps it in once it is Ready,
+// and hands the old buffer back to be freed, leaving no allocation or deallocation on the render path. Only the
+// render thread moves the state out of Idle and Ready, and only the task moves it out of Requested and Retiring.
+struct DelayDSPKernel::Growth : public AudioContext::DeferredTask
+{
+    enum State { Idle, Requested, Ready, Retiring };
+
+    std::atomic<int> state{ Idle };
+    size_t requestedLength = 0;
+    std::unique_ptr<AudioFloatArray> buffer;
+
+    // Set on the render thread while the task is Requested or Retiring but couldn't be posted yet.
+    bool needsPosting = false;
+
+    virtual void run() override
+    {
+        const int current = state.load(std::memory_order_acquire);
+        if (current == Requested)
+        {
+            buffer.reset(new AudioFloatArray(requestedLength));
+            state.store(Ready, std::memory_order_release);
+        }
+        else if (current == Retiring)
+        {
+            buffer.reset();
+            state.store(Idle, std::memory_order_release);
+        }
+    }
+};
+
 DelayDSPKernel::DelayDSPKernel( DelayProcessor * processor, float sampleRate) : AudioDSPKernel(processor)
+    , m_buffer(new AudioFloatArray())
     , m_writeIndex(0)
     , m_firstTime(true)
-    , m_delayTimes(AudioNode::ProcessingSizeInFrames)
 {
     ASSERT(processor);
     if (!processor)
@@ -30,13 +71,13 @@ DelayDSPKernel::DelayDSPKernel( DelayProcessor * processor, float sampleRate) :
     if (m_maxDelayTime < 0)
         return;
 
-    m_buffer.allocate(bufferLengthForDelay(m_maxDelayTime, sampleRate));
-    m_buffer.zero();
+    m_buffer->allocate(bufferLengthForDelay(std::min(m_maxDelayTime, InitialCapacityTime), sampleRate));
+    m_growth = std::make_shared<Growth>();
 
     m_smoothingRate = AudioUtilities::discreteTimeConstantForSampleRate(SmoothingTimeConstant, sampleRate);
 }
 
-DelayDSPKernel::DelayDSPKernel(double maxDelayTime, float sampleRate) : AudioDSPKernel(), m_maxDelayTime(maxDelayTime), m_writeIndex(0), m_firstTime(true)
+DelayDSPKernel::DelayDSPKernel(double maxDelayTime, float sampleRate) : AudioDSPKernel(), m_buffer(new AudioFloatArray()), m_maxDelayTime(maxDelayTime), m_writeIndex(0), m_firstTime(true)
 {
     ASSERT(maxDelayTime > 0.0);
     if (maxDelayTime <= 0.0)
@@ -47,26 +88,71 @@ DelayDSPKernel::DelayDSPKernel(double maxDelayTime, float sampleRate) : AudioDSP
     if (!bufferLength)
         return;
 
-    m_buffer.allocate(bufferLength);
-    m_buffer.zero();
+    m_buffer->allocate(bufferLength);
 
     m_smoothingRate = AudioUtilities::discreteTimeConstantForSampleRate(SmoothingTimeConstant, sampleRate);
 }
 
+DelayDSPKernel::~DelayDSPKernel() = default;
+
 size_t DelayDSPKernel::bufferLengthForDelay(double maxDelayTime, double sampleRate) const
 {
     // Compute the length of the buffer needed to handle a max delay of |maxDelayTime|. One is
-    // added to handle the case where the actual delay equals the maximum delay.
-    return 1 + AudioUtilities::timeToSampleFrame(maxDelayTime, sampleRate);
+    // added to handle the case where the actual delay equals the maximum delay, and another for the frame before
+    // the oldest that the Lagrange interpolator reads. A block is written ahead of reading it, so there is room
+    // for a block more.
+    return 2 + AudioUtilities::timeToSampleFrame(maxDelayTime, sampleRate) + BlockFrames;
 }
 
-void DelayDSPKernel::process(ContextRenderLock& r, const float* source, float* destination, size_t framesToProcess)
+void DelayDSPKernel::updateCapacity(ContextRenderLock& r, double delayTime, float sampleRate)
 {
-    size_t bufferLength = m_buffer.size();
-    float* buffer = m_buffer.data();
+    Growth& growth = *m_growth;
+    const int state = growth.state.load(std::memory_order_acquire);
+
+    if (state == Growth::Ready) {
+        // Unroll the ring into the start of the larger buffer, oldest frame first, so that the delay reads on
+        // where it left off. The frames past it read as the silence from before the buffer held anything.
+        AudioFloatArray& grown = *growth.buffer;
+        const size_t oldLength = m_buffer->size();
+        const float* old = m_buffer->data();
+        memcpy(grown.data(), old + m_writeIndex, sizeof(float) * (oldLength - m_writeIndex));
+        memcpy(grown.data() + oldLength - m_writeIndex, old, sizeof(float) * m_writeIndex);
+        m_writeIndex = oldLength;
+
+        std::swap(m_buffer, growth.buffer);
+        growth.state.store(Growth::Retiring, std::memory_order_release);
+        growth.needsPosting = true;
+    }
+    else if (state == Growth::Idle) {
+        const size_t capacity = m_buffer->size();
+        const size_t maxLength = bufferLengthForDelay(m_maxDelayTime, sampleRate);
+        const double usableFrames = static_cast<double>(capacity - 2 - BlockFrames);
+        if (capacity < maxLength && delayTime * sampleRate > 0.75 * usableFrames) {
+            growth.requestedLength = std::min(maxLength, bufferLengthForDelay(std::min(m_maxDelayTime, 2 * delayTime), sampleRate));
+            growth.state.store(Growth::Requested, std::memory_order_release);
+            growth.needsPosting = true;
+        }
+    }
 
-    ASSERT(bufferLength);
-    if (!bufferLength)
+    if (!growth.needsPosting)
+        return;
+
+    // Offline rendering doesn't have to keep time, and waiting on the update thread would make what is heard
+    // depend on how fast it runs, so the buffer is made in place.
+    if (r.context()->isOfflineContext()) {
+        growth.run();
+        growth.needsPosting = false;
+        if (growth.state.load(std::memory_order_acquire) == Growth::Ready)
+            updateCapacity(r, delayTime, sampleRate);
+    }
+    else if (r.context()->deferTask(r, m_growth))
+        growth.needsPosting = false;
+}
+
+void DelayDSPKernel::process(ContextRenderLock& r, const float* source, float* destination, size_t framesToProcess)
+{
+    ASSERT(m_buffer->size());
+    if (!m_buffer->size())
         return;
 
     ASSERT(source && destination);
@@ -74,66 +160,179 @@ void DelayDSPKernel::process(ContextRenderLock& r, const float* source, float* d
         return;
 
     float sampleRate = r.context()->sampleRate();
+    const DelayInterpolation interpolation = delayProcessor() ? delayProcessor()->interpolation() : DelayInterpolation::LINEAR;
+
+    // The processor evaluates the delay time once for all its kernels, which may run on several threads.
+    const bool sampleAccurate = delayProcessor() && delayProcessor()->quantumIsSampleAccurate();
+    const float* delayTimes = sampleAccurate ? delayProcessor()->quantumDelayTimes() : nullptr;
     double delayTime = 0;
-    float* delayTimes = m_delayTimes.data();
-    double maxTime = maxDelayTime();
+    if (!sampleAccurate)
+        delayTime = delayProcessor() ? delayProcessor()->quantumDelayTime() : m_desiredDelayFrames / sampleRate;
+
+    if (m_growth) {
+        float longestDelayTime = static_cast<float>(delayTime);
+        if (sampleAccurate)
+            VectorMath::vmaxmgv(delayTimes, 1, &longestDelayTime, framesToProcess);
+        updateCapacity(r, std::min(maxDelayTime(), static_cast<double>(longestDelayTime)), sampleRate);
+    }
 
-    bool sampleAccurate = delayProcessor() && delayProcessor()->delayTime()->hasSampleAccurateValues();
+    const size_t bufferLength = m_buffer->size();
+    float* buffer = m_buffer->data();
 
-    if (sampleAccurate)
-        delayProcessor()->delayTime()->calculateSampleAccurateValues(r, delayTimes, framesToProcess);
-    else {
-        delayTime = delayProcessor() ? delayProcessor()->delayTime()->finalValue(r) : m_desiredDelayFrames / sampleRate;
+    double maxTime = maxDelayTime();
+
+    // Until the buffer has grown, the delay is read within what it has room for.
+    const double capacityFrames = static_cast<double>(bufferLength - 2 - BlockFrames);
 
+    if (!sampleAccurate) {
         // Make sure the delay time is in a valid range.
         delayTime = min(maxTime, delayTime);
         delayTime = max(0.0, delayTime);
 
-        if (m_firstTime) {
+        // Once the smoothed delay has all but arrived, it is held at the desired delay, which reads the buffer in spans.
+        if (m_firstTime || std::abs(delayTime - m_currentDelayTime) * sampleRate < SnapThresholdFrames) {
             m_currentDelayTime = delayTime;
             m_firstTime = false;
         }
     }
 
-    for (unsigned i = 0; i < framesToProcess; ++i) {
-        if (sampleAccurate) {
-            delayTime = delayTimes[i];
-            delayTime = std::min(maxTime, delayTime);
-            delayTime = std::max(0.0, delayTime);
-            m_currentDelayTime = delayTime;
-        } else {
-            // Approach desired delay time.
-            m_currentDelayTime += (delayTime - m_currentDelayTime) * m_smoothingRate;
+    const bool constantDelay = !sampleAccurate && m_currentDelayTime == delayTime;
+
+    while (framesToProcess) {
+        const size_t frames = std::min(framesToProcess, static_cast<size_t>(BlockFrames));
+
+        // The block is written first, in up to two spans either side of the end of the buffer. The frames that
+        // are read in it are never written over by it, as the buffer has a block's room to spare.
+        const size_t writeIndex = m_writeIndex;
+        const size_t firstSpan = std::min(frames, bufferLength - writeIndex);
+        memcpy(buffer + writeIndex, source, sizeof(float) * firstSpan);
+        memcpy(buffer, source + firstSpan, sizeof(float) * (frames - firstSpan));
+
+        m_writeIndex = writeIndex + frames;
+        if (m_writeIndex >= bufferLength)
+            m_writeIndex -= bufferLength;
+
+        if (constantDelay)
+            readConstantDelay(writeIndex, std::min(m_currentDelayTime * sampleRate, capacityFrames), interpolation, destination, frames);
+        else {
+            size_t frameWriteIndex = writeIndex;
+            for (size_t i = 0; i < frames; ++i) {
+                if (sampleAccurate) {
+                    delayTime = *delayTimes++;
+                    delayTime = std::min(maxTime, delayTime);
+                    delayTime = std::max(0.0, delayTime);
+                    m_currentDelayTime = delayTime;
+                } else {
+                    // Approach desired delay time.
+                    m_currentDelayTime += (delayTime - m_currentDelayTime) * m_smoothingRate;
+                }
+
+                const double desiredDelayFrames = std::min(m_currentDelayTime * sampleRate, capacityFrames);
+                double readPosition = frameWriteIndex + bufferLength - desiredDelayFrames;
+                if (readPosition >= bufferLength)
+                    readPosition -= bufferLength;
+
+                const size_t readIndex = static_cast<size_t>(readPosition);
+                const double interpolationFactor = readPosition - readIndex;
+
+                if (interpolation == DelayInterpolation::LAGRANGE && desiredDelayFrames >= 2) {
+                    float coefficients[4];
+                    lagrangeCoefficients(interpolationFactor, coefficients);
+                    const size_t before = readIndex ? readIndex - 1 : bufferLength - 1;
+                    size_t after = readIndex + 1;
+                    if (after == bufferLength)
+                        after = 0;
+                    size_t afterNext = after + 1;
+                    if (afterNext == bufferLength)
+                        afterNext = 0;
+                    destination[i] = coefficients[0] * buffer[before] + coefficients[1] * buffer[readIndex]
+                                   + coefficients[2] * buffer[after] + coefficients[3] * buffer[afterNext];
+                } else {
+                    // Linearly interpolate in-between delay times.
+                    const size_t readIndex2 = readIndex + 1 == bufferLength ? 0 : readIndex + 1;
+                    double sample1 = buffer[readIndex];
+                    double sample2 = buffer[readIndex2];
+                    destination[i] = static_cast<float>((1.0 - interpolationFactor) * sample1 + interpolationFactor * sample2);
+                }
+
+                if (++frameWriteIndex == bufferLength)
+                    frameWriteIndex = 0;
+            }
         }
 
-        double desiredDelayFrames = m_currentDelayTime * sampleRate;
-
-        double readPosition = m_writeIndex + bufferLength - desiredDelayFrames;
-        if (readPosition >= bufferLength)
-            readPosition -= bufferLength;
-
-        // Linearly interpolate in-between delay times.
-        int readIndex1 = static_cast<int>(readPosition);
-        int readIndex2 = (readIndex1 + 1) % bufferLength;
-        double interpolationFactor = readPosition - readIndex1;
-
-        double input = static_cast<float>(*source++);
-        buffer[m_writeIndex] = static_cast<float>(input);
-        m_writeIndex = (m_writeIndex + 1) % bufferLength;
-
-        double sample1 = buffer[readIndex1];
-        double sample2 = buffer[readIndex2];
-
-        double output = (1.0 - interpolationFactor) * sample1 + interpolationFactor * sample2;
+        source += frames;
+        destination += frames;
+        framesToProcess -= frames;
+    }
+}
 
-        *destination++ = static_cast<float>(output);
+void DelayDSPKernel::readConstantDelay(size_t writeIndex, double delayFrames, DelayInterpolation interpolation, float* destination, size_t framesToProcess)
+{
+    const size_t bufferLength = m_buffer->size();
+    const float* buffer = m_buffer->data();
+
+    double readPosition = writeIndex + bufferLength - delayFrames;
+    if (readPosition >= bufferLength)
+        readPosition -= bufferLength;
+
+    const size_t readIndex = static_cast<size_t>(readPosition);
+    const double interpolationFactor = readPosition - readIndex;
+
+    // Every frame falls between the same two frames of the buffer, so each tap of the interpolator is a span of
+    // the buffer, scaled and summed into the destination.
+    auto tap = [&](size_t index, float coefficient, bool first) {
+        if (index >= bufferLength)
+            index -= bufferLength;
+        float* dest = destination;
+        size_t frames = framesToProcess;
+        while (frames) {
+            const size_t span = std::min(frames, bufferLength - index);
+            if (first)
+                VectorMath::vsmul(buffer + index, 1, &coefficient, dest, 1, span);
+            else
+                VectorMath::vsma(buffer + index, 1, &coefficient, dest, 1, span);
+            index = 0;
+            dest += span;
+            frames -= span;
+        }
+    };
+
+    if (!interpolationFactor)
+        tap(readIndex, 1, true);
+    else if (interpolation == DelayInterpolation::LAGRANGE && delayFrames >= 2) {
+        float coefficients[4];
+        lagrangeCoefficients(interpolationFactor, coefficients);
+        tap(readIndex + bufferLength - 1, coefficients[0], true);
+        tap(readIndex, coefficients[1], false);
+        tap(readIndex + 1, coefficients[2], false);
+        tap(readIndex + 2, coefficients[3], false);
+    } else {
+        tap(readIndex, static_cast<float>(1.0 - interpolationFactor), true);
+        tap(readIndex + 1, static_cast<float>(interpolationFactor), false);
     }
 }
 
+void DelayDSPKernel::lagrangeCoefficients(double fraction, float * coefficients)
+{
+    // Third order Lagrange through the frames before and after the two a position falls between.
+    const double d = fraction;
+    coefficients[0] = static_cast<float>(-d * (d - 1) * (d - 2) / 6);
+    coefficients[1] = static_cast<float>((d + 1) * (d - 1) * (d - 2) / 2);
+    coefficients[2] = static_cast<float>(-(d + 1) * d * (d - 2) / 2);
+    coefficients[3] = static_cast<float>((d + 1) * d * (d - 1) / 6);
+}
+
 void DelayDSPKernel::reset()
 {
     m_firstTime = true;
-    m_buffer.zero();
+    m_buffer->zero();
+}
+
+void DelayDSPKernel::reportMemory(AudioMemoryUsage & usage) const
+{
+    // A grown line being made for the kernel is counted once it's adopted.
+    if (m_buffer)
+        usage.add(AudioMemoryCategory::DelayLines, m_buffer->size() * sizeof(float));
 }
 
 double DelayDSPKernel::tailTime(ContextRenderLock & r) const
@@ -14,6 +14,7 @@ DelayProcessor::DelayProcessor(float sampleRate, unsigned numberOfChannels, doub
 : AudioDSPKernelProcessor(numberOfChannels)
 , m_maxDelayTime(maxDelayTime)
 , m_sampleRate(sampleRate)
+, m_quantumDelayTimes(AudioNode::ProcessingSizeInFrames)
 {
     m_delayTime = std::make_shared<AudioParam>("delayTime", 0.0, 0.0, maxDelayTime);
 }
@@ -29,4 +30,17 @@ AudioDSPKernel * DelayProcessor::createKernel()
     return new DelayDSPKernel(this, m_sampleRate);
 }
 
+void DelayProcessor::prepareKernels(ContextRenderLock& r, size_t framesToProcess)
+{
+    m_quantumIsSampleAccurate = m_delayTime->hasSampleAccurateValues();
+    if (m_quantumIsSampleAccurate) {
+        // Grows once if the context renders larger quanta than the default.
+        if (framesToProcess > m_quantumDelayTimes.size())
+            m_quantumDelayTimes.allocate(framesToProcess);
+        m_delayTime->calculateSampleAccurateValues(r, m_quantumDelayTimes.data(), framesToProcess);
+    }
+    else
+        m_quantumDelayTime = m_delayTime->finalValue(r);
+}
+
 } // namespace lab
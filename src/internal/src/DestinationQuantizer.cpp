@@ -0,0 +1,116 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/Assertions.h"
+#include "internal/DestinationQuantizer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lab {
+
+DestinationQuantizer::DestinationQuantizer(AudioIOCallback & graph, unsigned numberOfChannels, unsigned numberOfInputChannels, size_t renderQuantumSize,
+                                           size_t deviceFrames)
+    : m_graph(graph)
+    , m_renderQuantumSize(renderQuantumSize)
+    , m_inPlace((deviceFrames % renderQuantumSize) == 0)
+    , m_outputView(numberOfChannels, renderQuantumSize, false)
+    , m_inputView(numberOfInputChannels, renderQuantumSize, false)
+    , m_outputQuantum(numberOfChannels, renderQuantumSize)
+    , m_readIndex(renderQuantumSize)
+    , m_inputQuantum(numberOfInputChannels, renderQuantumSize)
+    , m_inputRing(numberOfInputChannels, deviceFrames + 2 * renderQuantumSize)
+    , m_inputAvailable(renderQuantumSize)
+{
+    ASSERT(renderQuantumSize > 0);
+}
+
+void DestinationQuantizer::render(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess)
+{
+    if (!destinationBus)
+        return;
+
+    // A callback of another size than the device negotiated is rendered ahead too, as is the one after it if
+    // it leaves frames of a quantum to play, so that no node ever sees a quantum shorter than the render quantum.
+    if (m_inPlace && framesToProcess % m_renderQuantumSize == 0 && m_readIndex == m_renderQuantumSize)
+        renderInPlace(sourceBus, destinationBus, framesToProcess);
+    else
+        renderAhead(sourceBus, destinationBus, framesToProcess);
+}
+
+void DestinationQuantizer::renderInPlace(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess)
+{
+    const bool hasInput = sourceBus && sourceBus->numberOfChannels() >= m_inputView.numberOfChannels() && m_inputView.numberOfChannels() > 0;
+    const size_t channels = std::min(destinationBus->numberOfChannels(), m_outputView.numberOfChannels());
+
+    const size_t frames = m_renderQuantumSize;
+    for (size_t offset = 0; offset < framesToProcess; offset += frames)
+    {
+        for (size_t c = 0; c < channels; ++c)
+            m_outputView.setChannelMemory(c, destinationBus->channel(c)->mutableData() + offset, frames);
+
+        if (hasInput)
+        {
+            for (size_t c = 0; c < m_inputView.numberOfChannels(); ++c)
+                m_inputView.setChannelMemory(c, sourceBus->channel(c)->mutableData() + offset, frames);
+        }
+
+        m_graph.render(hasInput ? &m_inputView : nullptr, &m_outputView, frames);
+    }
+}
+
+void DestinationQuantizer::renderAhead(AudioBus * sourceBus, AudioBus * destinationBus, size_t framesToProcess)
+{
+    const size_t inputChannels = m_inputRing.numberOfChannels();
+    const size_t ringFrames = m_inputRing.length();
+    const bool hasInput = sourceBus && sourceBus->numberOfChannels() >= inputChannels && inputChannels > 0;
+
+    // The input is queued first, so that every quantum rendered below has a whole quantum of it. The ring starts
+    // a quantum of silence ahead, which is the delay the input sees; it only overflows if the device hands over
+    // more than it negotiated, and then the oldest frames are dropped.
+    if (hasInput)
+    {
+        for (size_t done = 0; done < framesToProcess;)
+        {
+            const size_t frames = std::min(framesToProcess - done, ringFrames - m_inputWrite);
+            for (size_t c = 0; c < inputChannels; ++c)
+                std::memcpy(m_inputRing.channel(c)->mutableData() + m_inputWrite, sourceBus->channel(c)->data() + done, sizeof(float) * frames);
+            m_inputWrite = (m_inputWrite + frames) % ringFrames;
+            done += frames;
+        }
+        m_inputAvailable = std::min(m_inputAvailable + framesToProcess, ringFrames);
+    }
+
+    const size_t channels = std::min(destinationBus->numberOfChannels(), m_outputQuantum.numberOfChannels());
+    for (size_t done = 0; done < framesToProcess;)
+    {
+        if (m_readIndex == m_renderQuantumSize)
+        {
+            if (hasInput && m_inputAvailable >= m_renderQuantumSize)
+            {
+                const size_t read = (m_inputWrite + ringFrames - m_inputAvailable) % ringFrames;
+                const size_t first = std::min(m_renderQuantumSize, ringFrames - read);
+                for (size_t c = 0; c < inputChannels; ++c)
+                {
+                    const float * ring = m_inputRing.channel(c)->data();
+                    float * quantum = m_inputQuantum.channel(c)->mutableData();
+                    std::memcpy(quantum, ring + read, sizeof(float) * first);
+                    std::memcpy(quantum + first, ring, sizeof(float) * (m_renderQuantumSize - first));
+                }
+                m_inputAvailable -= m_renderQuantumSize;
+            }
+
+            m_graph.render(hasInput ? &m_inputQuantum : nullptr, &m_outputQuantum, m_renderQuantumSize);
+            m_readIndex = 0;
+        }
+
+        const size_t frames = std::min(framesToProcess - done, m_renderQuantumSize - m_readIndex);
+        for (size_t c = 0; c < channels; ++c)
+            std::memcpy(destinationBus->channel(c)->mutableData() + done, m_outputQuantum.channel(c)->data() + m_readIndex, sizeof(float) * frames);
+
+        m_readIndex += frames;
+        done += frames;
+    }
+}
+
+} // namespace lab
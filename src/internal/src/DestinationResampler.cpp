@@ -0,0 +1,102 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioSourceProvider.h"
+
+#include "internal/Assertions.h"
+#include "internal/DestinationResampler.h"
+#include "internal/MultiChannelResampler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lab {
+
+namespace
+{
+    // SincResampler's default kernel, which its blocks must be longer than.
+    const size_t ResamplerKernelSize = 32;
+}
+
+// Renders the graph a quantum at a time, and hands the resampler its frames however many it asks for.
+class DestinationResampler::GraphProvider : public AudioSourceProvider
+{
+public:
+
+    GraphProvider(AudioIOCallback & graph, unsigned numberOfChannels, size_t renderQuantumSize)
+        : m_graph(graph)
+        , m_quantum(numberOfChannels, renderQuantumSize)
+        , m_readIndex(renderQuantumSize)
+    {
+    }
+
+    virtual void provideInput(AudioBus * bus, size_t framesToProcess) override
+    {
+        bool isBusGood = bus && bus->numberOfChannels() <= m_quantum.numberOfChannels() && bus->length() >= framesToProcess;
+        ASSERT(isBusGood);
+        if (!isBusGood)
+            return;
+
+        const size_t renderQuantumSize = m_quantum.length();
+        size_t written = 0;
+        while (written < framesToProcess)
+        {
+            if (m_readIndex == renderQuantumSize)
+            {
+                m_graph.render(nullptr, &m_quantum, renderQuantumSize);
+                m_readIndex = 0;
+            }
+
+            size_t frames = std::min(framesToProcess - written, renderQuantumSize - m_readIndex);
+            for (unsigned i = 0; i < bus->numberOfChannels(); ++i)
+                std::memcpy(bus->channel(i)->mutableData() + written, m_quantum.channel(i)->data() + m_readIndex, sizeof(float) * frames);
+
+            written += frames;
+            m_readIndex += frames;
+        }
+    }
+
+private:
+
+    AudioIOCallback & m_graph;
+    AudioBus m_quantum;
+
+    // The first frame of m_quantum not yet handed to the resampler.
+    size_t m_readIndex;
+};
+
+DestinationResampler::DestinationResampler(AudioIOCallback & graph, unsigned numberOfChannels, float graphSampleRate, float deviceSampleRate, size_t renderQuantumSize)
+    : m_provider(new GraphProvider(graph, numberOfChannels, renderQuantumSize))
+    , m_graphSampleRate(graphSampleRate)
+    , m_renderQuantumSize(renderQuantumSize)
+{
+    ASSERT(graphSampleRate > 0 && deviceSampleRate > 0);
+
+    // Whole quanta are asked for at a time, so that once primed the graph is only rendered as the resampler needs it.
+    size_t blockSize = renderQuantumSize;
+    while (blockSize <= ResamplerKernelSize)
+        blockSize *= 2;
+
+    m_resampler.reset(new MultiChannelResampler(static_cast<double>(graphSampleRate) / deviceSampleRate, numberOfChannels, blockSize));
+}
+
+DestinationResampler::~DestinationResampler()
+{
+}
+
+void DestinationResampler::render(AudioBus *, AudioBus * destinationBus, size_t framesToProcess)
+{
+    if (!destinationBus)
+        return;
+
+    m_resampler->process(m_provider.get(), destinationBus, framesToProcess);
+}
+
+double DestinationResampler::latency() const
+{
+    // The resampler's look ahead, and the part of a quantum that may be left over after its last request.
+    return (m_resampler->latencyFrames() + m_renderQuantumSize) / static_cast<double>(m_graphSampleRate);
+}
+
+} // namespace lab
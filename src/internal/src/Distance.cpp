@@ -6,17 +6,68 @@
 #include "internal/Distance.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <math.h>
 
 using namespace std;
 
 namespace lab {
 
+DistanceTable::DistanceTable(double rolloffFactor)
+{
+    for (int i = 0; i <= Octaves * PointsPerOctave; ++i)
+    {
+        const double x = ldexp(1.0 + double(i % PointsPerOctave) / PointsPerOctave, i / PointsPerOctave + FirstOctave);
+        m_gains[i] = static_cast<float>(pow(x, -rolloffFactor));
+    }
+}
+
+const DistanceTable * DistanceTable::shared(double rolloffFactor)
+{
+    static std::mutex lock;
+    static std::map<double, std::unique_ptr<DistanceTable>> tables;
+
+    if (!isfinite(rolloffFactor))
+        return nullptr;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = tables.find(rolloffFactor);
+    if (found != tables.end())
+        return found->second.get();
+    if (tables.size() >= MaxShared)
+        return nullptr;
+
+    DistanceTable * table = new DistanceTable(rolloffFactor);
+    tables[rolloffFactor].reset(table);
+    return table;
+}
+
+bool DistanceTable::gain(float x, float & gain) const
+{
+    // The exponent picks the octave, and the mantissa the point within it. A negative x, or not a number, lands
+    // past the last octave.
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const int octave = static_cast<int>(bits >> 23) - 127 - FirstOctave;
+    if (octave < 0 || octave >= Octaves)
+        return false;
+
+    const float position = static_cast<float>(bits & 0x7fffff) * (PointsPerOctave / 8388608.f);
+    const int point = static_cast<int>(position);
+    const float * g = m_gains + octave * PointsPerOctave + point;
+    gain = g[0] + (g[1] - g[0]) * (position - static_cast<float>(point));
+    return true;
+}
+
 DistanceEffect::DistanceEffect()
 {
 }
 
-double DistanceEffect::gain(double distance)
+double DistanceEffect::gain(double distance) const
 {
     // don't go beyond maximum distance
     distance = min(distance, m_maxDistance);
@@ -37,19 +88,40 @@ double DistanceEffect::gain(double distance)
     return 0.0;
 }
 
-double DistanceEffect::linearGain(double distance)
+float DistanceEffect::tableGain(float distance) const
+{
+    const DistanceTable * table = m_table.load(std::memory_order_acquire);
+    if (table && m_refDistance > 0)
+    {
+        double d = min(static_cast<double>(distance), m_maxDistance);
+        if (m_isClamped)
+            d = max(d, m_refDistance);
+
+        float g;
+        if (table->gain(static_cast<float>(d / m_refDistance), g))
+            return g;
+    }
+    return static_cast<float>(gain(distance));
+}
+
+void DistanceEffect::updateTable()
+{
+    m_table.store(m_model == ModelExponential ? DistanceTable::shared(m_rolloffFactor) : nullptr, std::memory_order_release);
+}
+
+double DistanceEffect::linearGain(double distance) const
 {
     // We want a gain that decreases linearly from m_refDistance to
     // m_maxDistance. The gain is 1 at m_refDistance.
     return (1.0 - m_rolloffFactor * (distance - m_refDistance) / (m_maxDistance - m_refDistance));
 }
 
-double DistanceEffect::inverseGain(double distance)
+double DistanceEffect::inverseGain(double distance) const
 {
     return m_refDistance / (m_refDistance + m_rolloffFactor * (distance - m_refDistance));
 }
 
-double DistanceEffect::exponentialGain(double distance)
+double DistanceEffect::exponentialGain(double distance) const
 {
     return pow(distance / m_refDistance, -m_rolloffFactor);
 }
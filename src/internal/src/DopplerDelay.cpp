@@ -0,0 +1,146 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/DopplerDelay.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace lab {
+
+const double DopplerDelay::MaxDelayTime = 1.0;
+const double DopplerDelay::MaxApproachRate = 15.0;
+const double DopplerDelay::MaxRecedeRate = 0.875;
+
+// Changes in delay smaller than this, in frames, are held rather than ramped.
+static const double SteadyFrames = 1.0e-3;
+
+DopplerDelay::DopplerDelay(float sampleRate, size_t maxFrames)
+: m_mono(1, maxFrames)
+, m_stereo(2, maxFrames)
+, m_positions(maxFrames)
+{
+    m_maxDelayFrames = std::floor(MaxDelayTime * sampleRate);
+
+    // A power of two, so that indices wrap with a mask, with room for a quantum ahead of the longest delay and the
+    // frame after it that interpolation reads.
+    size_t length = 1;
+    while (length < static_cast<size_t>(m_maxDelayFrames) + maxFrames + 2)
+        length <<= 1;
+    m_mask = length - 1;
+
+    for (AudioFloatArray & line : m_lines)
+        line.allocate(length);
+}
+
+void DopplerDelay::reset()
+{
+    for (AudioFloatArray & line : m_lines)
+        line.zero();
+    m_writeIndex = 0;
+    m_delayFrames = 0;
+    m_first = true;
+}
+
+void DopplerDelay::readSpan(const float * line, size_t index, float gain, bool accumulate, float * destination, size_t frames) const
+{
+    while (frames)
+    {
+        const size_t span = std::min(frames, m_mask + 1 - index);
+        if (accumulate)
+            VectorMath::vsma(line + index, 1, &gain, destination, 1, span);
+        else
+            VectorMath::vsmul(line + index, 1, &gain, destination, 1, span);
+        destination += span;
+        frames -= span;
+        index = 0;
+    }
+}
+
+size_t DopplerDelay::memoryBytes() const
+{
+    return (m_lines[0].size() + m_lines[1].size() + m_positions.size()) * sizeof(float) + m_mono.memoryBytes() + m_stereo.memoryBytes();
+}
+
+AudioBus * DopplerDelay::process(const AudioBus * source, double delayFrames, size_t framesToProcess)
+{
+    const size_t channels = std::min<size_t>(source->numberOfChannels(), 2);
+    AudioBus * destination = channels == 1 ? &m_mono : &m_stereo;
+    framesToProcess = std::min(framesToProcess, destination->length());
+
+    if (!std::isfinite(delayFrames))
+        delayFrames = m_delayFrames;
+    delayFrames = std::max(0.0, std::min(delayFrames, m_maxDelayFrames));
+
+    if (m_first)
+    {
+        m_delayFrames = delayFrames;
+        m_first = false;
+    }
+
+    const double start = m_delayFrames;
+    double step = 0;
+    if (std::fabs(delayFrames - start) >= SteadyFrames && framesToProcess)
+        step = std::max(-MaxApproachRate, std::min((delayFrames - start) / framesToProcess, MaxRecedeRate));
+    m_delayFrames = std::max(0.0, std::min(start + step * framesToProcess, m_maxDelayFrames));
+
+    const size_t writeIndex = m_writeIndex;
+    const size_t lineLength = m_mask + 1;
+    for (size_t c = 0; c < channels; ++c)
+    {
+        float * line = m_lines[c].data();
+        const float * input = source->channel(c)->data();
+        const size_t firstSpan = std::min(framesToProcess, lineLength - writeIndex);
+        memcpy(line + writeIndex, input, sizeof(float) * firstSpan);
+        memcpy(line, input + firstSpan, sizeof(float) * (framesToProcess - firstSpan));
+    }
+    m_writeIndex = (writeIndex + framesToProcess) & m_mask;
+
+    // Frame i is read at writeIndex + i - delay(i). The whole frames of the starting delay are taken out so that
+    // what remains, the fraction and the ramp, is small enough to hold in a float without losing the fraction.
+    const double wholeFrames = std::floor(start);
+    const size_t base = (writeIndex + lineLength - static_cast<size_t>(wholeFrames)) & m_mask;
+    const float fraction = static_cast<float>(start - wholeFrames);
+
+    if (step == 0)
+    {
+        // Between the frame before base and base, fraction of the way back.
+        const size_t before = (base + m_mask) & m_mask;
+        for (size_t c = 0; c < channels; ++c)
+        {
+            const float * line = m_lines[c].data();
+            float * output = destination->channel(c)->mutableData();
+            readSpan(line, base, 1.f - fraction, false, output, framesToProcess);
+            if (fraction > 0.f)
+                readSpan(line, before, fraction, true, output, framesToProcess);
+        }
+    }
+    else
+    {
+        // positions[i] = i - fraction - i * step, the read position relative to base.
+        float * positions = m_positions.data();
+        const float first = -fraction;
+        const float rate = static_cast<float>(1.0 - step);
+        VectorMath::vramp(&first, &rate, positions, framesToProcess);
+
+        for (size_t c = 0; c < channels; ++c)
+        {
+            const float * line = m_lines[c].data();
+            float * output = destination->channel(c)->mutableData();
+            for (size_t i = 0; i < framesToProcess; ++i)
+            {
+                const float position = positions[i];
+                const float whole = std::floor(position);
+                const float t = position - whole;
+                const size_t index = (base + lineLength + static_cast<ptrdiff_t>(whole)) & m_mask;
+                output[i] = line[index] + t * (line[(index + 1) & m_mask] - line[index]);
+            }
+        }
+    }
+
+    return destination;
+}
+
+} // namespace lab
@@ -155,17 +155,9 @@ void DynamicsCompressor::process(ContextRenderLock& r, const AudioBus* sourceBus
 
     // Apply pre-emphasis filter.
     // Note that the final three stages are computed in-place in the destination buffer.
-    for (unsigned i = 0; i < numberOfChannels; ++i)
-    {
-        const float* sourceData = m_sourceChannels[i];
-        float* destinationData = m_destinationChannels[i];
-        ZeroPole* preFilters = m_preFilterPacks[i]->filters;
-
-        preFilters[0].process(sourceData, destinationData, framesToProcess);
-        preFilters[1].process(destinationData, destinationData, framesToProcess);
-        preFilters[2].process(destinationData, destinationData, framesToProcess);
-        preFilters[3].process(destinationData, destinationData, framesToProcess);
-    }
+    ZeroPole::process(m_preFilterStages[0].data(), m_sourceChannels.get(), m_destinationChannels.get(), numberOfChannels, framesToProcess);
+    for (unsigned stageIndex = 1; stageIndex < 4; ++stageIndex)
+        ZeroPole::process(m_preFilterStages[stageIndex].data(), m_destinationChannels.get(), m_destinationChannels.get(), numberOfChannels, framesToProcess);
 
     float dbThreshold = parameterValue(ParamThreshold);
     float dbKnee = parameterValue(ParamKnee);
@@ -213,16 +205,8 @@ void DynamicsCompressor::process(ContextRenderLock& r, const AudioBus* sourceBus
     setParameterValue(ParamReduction, m_compressor.meteringGain());
 
     // Apply de-emphasis filter.
-    for (unsigned i = 0; i < numberOfChannels; ++i)
-    {
-        float* destinationData = m_destinationChannels[i];
-        ZeroPole* postFilters = m_postFilterPacks[i]->filters;
-
-        postFilters[0].process(destinationData, destinationData, framesToProcess);
-        postFilters[1].process(destinationData, destinationData, framesToProcess);
-        postFilters[2].process(destinationData, destinationData, framesToProcess);
-        postFilters[3].process(destinationData, destinationData, framesToProcess);
-    }
+    for (unsigned stageIndex = 0; stageIndex < 4; ++stageIndex)
+        ZeroPole::process(m_postFilterStages[stageIndex].data(), m_destinationChannels.get(), m_destinationChannels.get(), numberOfChannels, framesToProcess);
 }
 
 void DynamicsCompressor::reset()
@@ -248,10 +232,21 @@ void DynamicsCompressor::setNumberOfChannels(unsigned numberOfChannels)
 
     m_preFilterPacks.clear();
     m_postFilterPacks.clear();
+    for (unsigned stageIndex = 0; stageIndex < 4; ++stageIndex)
+    {
+        m_preFilterStages[stageIndex].clear();
+        m_postFilterStages[stageIndex].clear();
+    }
+
     for (unsigned i = 0; i < numberOfChannels; ++i)
     {
         m_preFilterPacks.push_back(std::unique_ptr<ZeroPoleFilterPack4>(new ZeroPoleFilterPack4()));
         m_postFilterPacks.push_back(std::unique_ptr<ZeroPoleFilterPack4>(new ZeroPoleFilterPack4()));
+        for (unsigned stageIndex = 0; stageIndex < 4; ++stageIndex)
+        {
+            m_preFilterStages[stageIndex].push_back(&m_preFilterPacks[i]->filters[stageIndex]);
+            m_postFilterStages[stageIndex].push_back(&m_postFilterPacks[i]->filters[stageIndex]);
+        }
     }
 
     m_sourceChannels = std::unique_ptr<const float*[]>(new const float*[numberOfChannels]);
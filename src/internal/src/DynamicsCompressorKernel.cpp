@@ -8,11 +8,14 @@
 #include "internal/AudioUtilities.h"
 #include "internal/DenormalDisabler.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 
-#include <memory>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
 
 using namespace std;
 
@@ -25,6 +28,14 @@ const float meteringReleaseTimeConstant = 0.325f;
 
 const float uninitializedValue = -1;
 
+// sin(pi / 2 * x) for x in [0, 1], the gain warp, by its Taylor series through x^11, which is within 6e-8.
+static inline float sinHalfPi(float x)
+{
+    float t = 0.5f * piFloat * x;
+    float t2 = t * t;
+    return t * (1 + t2 * (-1 / 6.f + t2 * (1 / 120.f + t2 * (-1 / 5040.f + t2 * (1 / 362880.f + t2 * (-1 / 39916800.f))))));
+}
+
 DynamicsCompressorKernel::DynamicsCompressorKernel(unsigned numberOfChannels) :
       m_lastPreDelayFrames(DefaultPreDelayFrames)
     , m_preDelayReadIndex(0)
@@ -193,7 +204,9 @@ void DynamicsCompressorKernel::process(ContextRenderLock & r,
                                        float releaseZone1,
                                        float releaseZone2,
                                        float releaseZone3,
-                                       float releaseZone4
+                                       float releaseZone4,
+                                       const float * detectorChannels[],
+                                       unsigned numberOfDetectorChannels
                                        )
 {
     ASSERT(m_preDelayBuffers.size() == numberOfChannels);
@@ -214,6 +227,9 @@ void DynamicsCompressorKernel::process(ContextRenderLock & r,
     // Empirical/perceptual tuning.
     fullRangeMakeupGain = powf(fullRangeMakeupGain, 0.6f);
 
+    if (!m_automaticMakeupGain)
+        fullRangeMakeupGain = 1;
+
     float masterLinearGain = decibelsToLinear(dbPostGain) * fullRangeMakeupGain;
 
     // Attack parameters.
@@ -340,51 +356,42 @@ void DynamicsCompressorKernel::process(ContextRenderLock & r,
         // Inner loop - calculate shaped power average - apply compression.
         // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+        // The division's frames are taken a stage at a time, each stage over all of them, so that only the
+        // detector and the gain envelope, which carry from one frame to the next, run frame by frame.
+
+        // Write the division into the pre-delay, and detect from the undelayed peak across the channels, or across
+        // the detector's.
+        alignas(16) float compressorInput[nDivisionFrames];
+        std::fill(compressorInput, compressorInput + nDivisionFrames, 0.f);
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+            writePreDelay(c, sourceChannels[c] + frameIndex, nDivisionFrames);
+
+        const float ** detectors = detectorChannels ? detectorChannels : sourceChannels;
+        const unsigned detectorCount = detectorChannels ? numberOfDetectorChannels : numberOfChannels;
+        for (unsigned c = 0; c < detectorCount; ++c) {
+            const float* detector = detectors[c] + frameIndex;
+            for (int j = 0; j < nDivisionFrames; ++j)
+                compressorInput[j] = max(compressorInput[j], fabsf(detector[j]));
+        }
+
+        // Put through shaping curve.
+        // This is linear up to the threshold, then enters a "knee" portion followed by the "ratio" portion.
+        // The transition from the threshold to the knee is smooth (1st derivative matched).
+        // The transition from the knee to the ratio portion is smooth (1st derivative matched).
+        alignas(16) float attenuation[nDivisionFrames];
+        alignas(16) float satReleaseRate[nDivisionFrames];
+        computeAttenuation(compressorInput, k, satReleaseFrames, attenuation, satReleaseRate, nDivisionFrames);
+
+        alignas(16) float gain[nDivisionFrames];
         {
-            int preDelayReadIndex = m_preDelayReadIndex;
-            int preDelayWriteIndex = m_preDelayWriteIndex;
             float detectorAverage = m_detectorAverage;
             float compressorGain = m_compressorGain;
 
-            int loopFrames = nDivisionFrames;
-            while (loopFrames--) {
-                float compressorInput = 0;
-
-                // Predelay signal, computing compression amount from un-delayed version.
-                for (unsigned i = 0; i < numberOfChannels; ++i) {
-                    float* delayBuffer = m_preDelayBuffers[i]->data();
-                    float undelayedSource = sourceChannels[i][frameIndex];
-                    delayBuffer[preDelayWriteIndex] = undelayedSource;
-
-                    float absUndelayedSource = undelayedSource > 0 ? undelayedSource : -undelayedSource;
-                    if (compressorInput < absUndelayedSource)
-                        compressorInput = absUndelayedSource;
-                }
+            for (int j = 0; j < nDivisionFrames; ++j) {
+                bool isRelease = (attenuation[j] > detectorAverage);
+                float rate = isRelease ? satReleaseRate[j] : 1;
 
-                // Calculate shaped power on undelayed input.
-
-                float scaledInput = compressorInput;
-                float absInput = scaledInput > 0 ? scaledInput : -scaledInput;
-
-                // Put through shaping curve.
-                // This is linear up to the threshold, then enters a "knee" portion followed by the "ratio" portion.
-                // The transition from the threshold to the knee is smooth (1st derivative matched).
-                // The transition from the knee to the ratio portion is smooth (1st derivative matched).
-                float shapedInput = saturate(absInput, k);
-
-                float attenuation = absInput <= 0.0001f ? 1 : shapedInput / absInput;
-
-                float attenuationDb = -linearToDecibels(attenuation);
-                attenuationDb = max(2.0f, attenuationDb);
-
-                float dbPerFrame = attenuationDb / satReleaseFrames;
-
-                float satReleaseRate = decibelsToLinear(dbPerFrame) - 1;
-
-                bool isRelease = (attenuation > detectorAverage);
-                float rate = isRelease ? satReleaseRate : 1;
-
-                detectorAverage += (attenuation - detectorAverage) * rate;
+                detectorAverage += (attenuation[j] - detectorAverage) * rate;
                 detectorAverage = min(1.0f, detectorAverage);
 
                 // Fix gremlins.
@@ -403,40 +410,117 @@ void DynamicsCompressorKernel::process(ContextRenderLock & r,
                     compressorGain = min(1.0f, compressorGain);
                 }
 
-                // Warp pre-compression gain to smooth out sharp exponential transition points.
-                float postWarpCompressorGain = sinf(0.5f * piFloat * compressorGain);
-
-                // Calculate total gain using master gain and effect blend.
-                float totalGain = dryMix + wetMix * masterLinearGain * postWarpCompressorGain;
-
-                // Calculate metering.
-                float dbRealGain = 20 * log10(postWarpCompressorGain);
-                if (dbRealGain < m_meteringGain)
-                    m_meteringGain = dbRealGain;
-                else
-                    m_meteringGain += (dbRealGain - m_meteringGain) * m_meteringReleaseK;
-
-                // Apply final gain.
-                for (unsigned i = 0; i < numberOfChannels; ++i) 
-                {
-                    float* delayBuffer = m_preDelayBuffers[i]->data();
-                    destinationChannels[i][frameIndex] = delayBuffer[preDelayReadIndex] * totalGain;
-                }
-
-                frameIndex++;
-                preDelayReadIndex = (preDelayReadIndex + 1) & MaxPreDelayFramesMask;
-                preDelayWriteIndex = (preDelayWriteIndex + 1) & MaxPreDelayFramesMask;
+                gain[j] = compressorGain;
             }
 
             // Locals back to member variables.
-            m_preDelayReadIndex = preDelayReadIndex;
-            m_preDelayWriteIndex = preDelayWriteIndex;
             m_detectorAverage = DenormalDisabler::flushDenormalFloatToZero(detectorAverage);
             m_compressorGain = DenormalDisabler::flushDenormalFloatToZero(compressorGain);
         }
+
+        // Warp pre-compression gain to smooth out sharp exponential transition points.
+        alignas(16) float postWarpCompressorGain[nDivisionFrames];
+        for (int j = 0; j < nDivisionFrames; ++j)
+            postWarpCompressorGain[j] = sinHalfPi(gain[j]);
+
+        // Calculate metering.
+        alignas(16) float dbRealGain[nDivisionFrames];
+        VectorMath::vlinearToDecibels(postWarpCompressorGain, dbRealGain, nDivisionFrames);
+        for (int j = 0; j < nDivisionFrames; ++j) {
+            if (dbRealGain[j] < m_meteringGain)
+                m_meteringGain = dbRealGain[j];
+            else
+                m_meteringGain += (dbRealGain[j] - m_meteringGain) * m_meteringReleaseK;
+        }
+
+        // Calculate total gain using master gain and effect blend.
+        alignas(16) float totalGain[nDivisionFrames];
+        const float wetGain = wetMix * masterLinearGain;
+        VectorMath::vsmul(postWarpCompressorGain, 1, &wetGain, totalGain, 1, nDivisionFrames);
+        VectorMath::vsadd(totalGain, &dryMix, totalGain, nDivisionFrames);
+
+        // Apply final gain.
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+            readPreDelay(c, totalGain, destinationChannels[c] + frameIndex, nDivisionFrames);
+
+        m_preDelayReadIndex = (m_preDelayReadIndex + nDivisionFrames) & MaxPreDelayFramesMask;
+        m_preDelayWriteIndex = (m_preDelayWriteIndex + nDivisionFrames) & MaxPreDelayFramesMask;
+        frameIndex += nDivisionFrames;
     }
 }
 
+void DynamicsCompressorKernel::writePreDelay(unsigned channel, const float* source, size_t framesToProcess)
+{
+    // Up to the end of the buffer, then on from its start.
+    float* delayBuffer = m_preDelayBuffers[channel]->data();
+    size_t first = min(framesToProcess, size_t(MaxPreDelayFrames - m_preDelayWriteIndex));
+    memcpy(delayBuffer + m_preDelayWriteIndex, source, sizeof(float) * first);
+    memcpy(delayBuffer, source + first, sizeof(float) * (framesToProcess - first));
+}
+
+void DynamicsCompressorKernel::readPreDelay(unsigned channel, const float* gain, float* destination, size_t framesToProcess)
+{
+    const float* delayBuffer = m_preDelayBuffers[channel]->data();
+    size_t first = min(framesToProcess, size_t(MaxPreDelayFrames - m_preDelayReadIndex));
+    VectorMath::vmul(delayBuffer + m_preDelayReadIndex, 1, gain, 1, destination, 1, first);
+    VectorMath::vmul(delayBuffer, 1, gain + first, 1, destination + first, 1, framesToProcess - first);
+}
+
+void DynamicsCompressorKernel::computeAttenuation(const float* absInput, float k, float satReleaseFrames,
+                                                  float* attenuation, float* satReleaseRate, size_t framesToProcess)
+{
+    // Below the threshold the curve is linear, so a quiet division needs none of the exponentials.
+    float maxInput = 0;
+    for (size_t j = 0; j < framesToProcess; ++j)
+        maxInput = max(maxInput, absInput[j]);
+
+    if (maxInput < m_linearThreshold || maxInput <= 0.0001f) {
+        const float rate = decibelsToLinear(2 / satReleaseFrames) - 1;
+        std::fill(attenuation, attenuation + framesToProcess, 1.f);
+        std::fill(satReleaseRate, satReleaseRate + framesToProcess, rate);
+        return;
+    }
+
+    // The knee, m_linearThreshold + (1 - e^(-k * (x - m_linearThreshold))) / k, and the ratio portion, a line in
+    // dB, both take one exponential, so their exponents are gathered and raised together. satReleaseRate serves
+    // for the logarithms of the inputs first.
+    float* inputDb = satReleaseRate;
+    VectorMath::vlinearToDecibels(absInput, inputDb, framesToProcess);
+
+    const float dbToNaturalExponent = logf(10) / 20;
+    for (size_t j = 0; j < framesToProcess; ++j) {
+        float x = absInput[j];
+        if (x < m_kneeThreshold)
+            attenuation[j] = -k * (x - m_linearThreshold);
+        else
+            attenuation[j] = (m_ykneeThresholdDb + m_slope * (inputDb[j] - m_kneeThresholdDb)) * dbToNaturalExponent;
+    }
+    VectorMath::vexp(attenuation, attenuation, framesToProcess);
+
+    for (size_t j = 0; j < framesToProcess; ++j) {
+        float x = absInput[j];
+        float shapedInput;
+        if (x < m_linearThreshold)
+            shapedInput = x;
+        else if (x < m_kneeThreshold)
+            shapedInput = m_linearThreshold + (1 - attenuation[j]) / k;
+        else
+            shapedInput = attenuation[j];
+
+        attenuation[j] = x <= 0.0001f ? 1 : shapedInput / x;
+    }
+
+    // The detector releases by at least 2 dB over satReleaseFrames, faster the more the input is attenuated.
+    float* attenuationDb = satReleaseRate;
+    VectorMath::vlinearToDecibels(attenuation, attenuationDb, framesToProcess);
+    for (size_t j = 0; j < framesToProcess; ++j)
+        attenuationDb[j] = max(2.0f, -attenuationDb[j]) / satReleaseFrames;
+    VectorMath::vdecibelsToLinear(attenuationDb, satReleaseRate, framesToProcess);
+
+    const float minusOne = -1;
+    VectorMath::vsadd(satReleaseRate, &minusOne, satReleaseRate, framesToProcess);
+}
+
 void DynamicsCompressorKernel::reset()
 {
     m_detectorAverage = 0;
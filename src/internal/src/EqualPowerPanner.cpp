@@ -9,6 +9,7 @@
 #include "internal/EqualPowerPanner.h"
 #include "internal/AudioUtilities.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include "LabSound/extended/AudioContextLock.h"
 
@@ -18,6 +19,9 @@
 // Use a 50ms smoothing / de-zippering time-constant.
 const float SmoothingTimeConstant = 0.050f;
 
+// Gains this close to their targets are snapped to them.
+const double SnapThreshold = 1e-5;
+
 using namespace std;
 
 namespace lab {
@@ -81,57 +85,78 @@ void EqualPowerPanner::pan(ContextRenderLock & r, double azimuth, double /*eleva
         }
     }
 
-    desiredGainL = cos(0.5 * piDouble * desiredPanPosition);
-    desiredGainR = sin(0.5 * piDouble * desiredPanPosition);
-   
-    // Don't de-zipper on first render call.
-    if (m_isFirstRender) {
+    float desiredGains[2];
+    const float position = static_cast<float>(desiredPanPosition);
+    VectorMath::vpangains(&position, &desiredGains[0], &desiredGains[1], 1);
+    desiredGainL = desiredGains[0];
+    desiredGainR = desiredGains[1];
+
+    // Don't de-zipper on first render call, nor once the gains are close enough to be heard as there.
+    if (m_isFirstRender || (fabs(desiredGainL - m_gainL) < SnapThreshold && fabs(desiredGainR - m_gainR) < SnapThreshold)) {
         m_isFirstRender = false;
         m_gainL = desiredGainL;
         m_gainR = desiredGainR;
     }
-    
-    // Cache in local variables.
-    double gainL = m_gainL;
-    double gainR = m_gainR;
-    
-    // Get local copy of smoothing constant.
-    const double SmoothingConstant = m_smoothingConstant;
-    
-    int n = framesToProcess;
 
+    const float* sources[2] = { sourceL, sourceR };
+    float* destinations[2] = { destinationL, destinationR };
+
+    if (m_gainL == desiredGainL && m_gainR == desiredGainR) {
+        // The gains are constant over the quantum, so the sources are read once for both outputs.
+        const float gainL = static_cast<float>(m_gainL);
+        const float gainR = static_cast<float>(m_gainR);
+        if (numberOfInputChannels == 1) {
+            const float gains[2][1] = { { gainL }, { gainR } };
+            const float* gainPointers[2] = { gains[0], gains[1] };
+            VectorMath::vmix(sources, 1, gainPointers, destinations, 2, false, framesToProcess);
+        } else {
+            const bool keepLeft = azimuth <= 0;
+            const float gains[2][2] = { { keepLeft ? 1.f : gainL, keepLeft ? gainL : 0.f },
+                                        { keepLeft ? 0.f : gainR, keepLeft ? gainR : 1.f } };
+            const float* gainPointers[2] = { gains[0], gains[1] };
+            VectorMath::vmix(sources, 2, gainPointers, destinations, 2, false, framesToProcess);
+        }
+        return;
+    }
+
+    // De-zipper each gain along its smoothing curve, then pan through the curves.
+    if (m_gainCurveL.size() < framesToProcess) {
+        m_gainCurveL.allocate(framesToProcess);
+        m_gainCurveR.allocate(framesToProcess);
+    }
+
+    float* gainL = m_gainCurveL.data();
+    float* gainR = m_gainCurveR.data();
+    const float smoothing = static_cast<float>(m_smoothingConstant);
+    float state = static_cast<float>(m_gainL);
+    VectorMath::vsmooth(&state, &desiredGains[0], &smoothing, gainL, framesToProcess);
+    m_gainL = state;
+    state = static_cast<float>(m_gainR);
+    VectorMath::vsmooth(&state, &desiredGains[1], &smoothing, gainR, framesToProcess);
+    m_gainR = state;
+
+    size_t n = framesToProcess;
     if (numberOfInputChannels == 1) { // For mono source case.
-        while (n--) {
-            float inputL = *sourceL++;
-            gainL += (desiredGainL - gainL) * SmoothingConstant;
-            gainR += (desiredGainR - gainR) * SmoothingConstant;
-            *destinationL++ = static_cast<float>(inputL * gainL);
-            *destinationR++ = static_cast<float>(inputL * gainR);
+        for (size_t i = 0; i < n; ++i) {
+            const float input = sourceL[i];
+            destinationL[i] = input * gainL[i];
+            destinationR[i] = input * gainR[i];
         }
-    } else { // For stereo source case.
-        if (azimuth <= 0) { // from -90 -> 0
-            while (n--) {
-                float inputL = *sourceL++;
-                float inputR = *sourceR++;
-                gainL += (desiredGainL - gainL) * SmoothingConstant;
-                gainR += (desiredGainR - gainR) * SmoothingConstant;
-                *destinationL++ = static_cast<float>(inputL + inputR * gainL);
-                *destinationR++ = static_cast<float>(inputR * gainR);
-            }
-        } else { // from 0 -> +90
-            while (n--) {
-                float inputL = *sourceL++;
-                float inputR = *sourceR++;
-                gainL += (desiredGainL - gainL) * SmoothingConstant;
-                gainR += (desiredGainR - gainR) * SmoothingConstant;
-                *destinationL++ = static_cast<float>(inputL * gainL);
-                *destinationR++ = static_cast<float>(inputR + inputL * gainR);
-            }
+    } else if (azimuth <= 0) { // from -90 -> 0
+        for (size_t i = 0; i < n; ++i) {
+            const float inputL = sourceL[i];
+            const float inputR = sourceR[i];
+            destinationL[i] = inputL + inputR * gainL[i];
+            destinationR[i] = inputR * gainR[i];
+        }
+    } else { // from 0 -> +90
+        for (size_t i = 0; i < n; ++i) {
+            const float inputL = sourceL[i];
+            const float inputR = sourceR[i];
+            destinationL[i] = inputL * gainL[i];
+            destinationR[i] = inputR + inputL * gainR[i];
         }
     }
-
-    m_gainL = gainL;
-    m_gainR = gainR;
 }
 
 } // namespace lab
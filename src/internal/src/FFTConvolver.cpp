@@ -14,12 +14,13 @@ FFTConvolver::FFTConvolver(size_t fftSize)
     : m_frame(fftSize)
     , m_readWriteIndex(0)
     , m_inputBuffer(fftSize) // 2nd half of buffer is always zeroed
-    , m_outputBuffer(fftSize)
-    , m_lastOverlapBuffer(fftSize / 2)
+    , m_currentOutput(0)
 {
+    m_outputBuffers[0].allocate(fftSize);
+    m_outputBuffers[1].allocate(fftSize);
 }
 
-void FFTConvolver::process(FFTFrame * fftKernel, const float * sourceP, float * destP, size_t framesToProcess)
+void FFTConvolver::process(const FFTFrame * fftKernel, const float * sourceP, float * destP, size_t framesToProcess)
 {
     uint32_t halfSize = fftSize() / 2;
 
@@ -48,10 +49,10 @@ void FFTConvolver::process(FFTFrame * fftKernel, const float * sourceP, float *
         memcpy(inputP + m_readWriteIndex, sourceP, sizeof(float) * divisionSize);
 
         // Copy samples from output buffer
-        float* outputP = m_outputBuffer.data();
+        float* outputP = m_outputBuffers[m_currentOutput].data();
 
         // Sanity check
-        bool isCopyGood2 = destP && outputP && m_readWriteIndex + divisionSize <= m_outputBuffer.size();
+        bool isCopyGood2 = destP && outputP && m_readWriteIndex + divisionSize <= halfSize;
         ASSERT(isCopyGood2);
         if (!isCopyGood2)
             return;
@@ -64,20 +65,16 @@ void FFTConvolver::process(FFTFrame * fftKernel, const float * sourceP, float *
         {
 
             // The input buffer is now filled (get frequency-domain version)
+            const float* lastOverlapP = m_outputBuffers[m_currentOutput].data() + halfSize;
+            m_currentOutput ^= 1;
+            float* nextOutputP = m_outputBuffers[m_currentOutput].data();
+
             m_frame.doFFT(m_inputBuffer.data());
             m_frame.multiply(*fftKernel);
-            m_frame.doInverseFFT(m_outputBuffer.data());
+            m_frame.doInverseFFT(nextOutputP);
 
             // Overlap-add 1st half from previous time
-            vadd(m_outputBuffer.data(), 1, m_lastOverlapBuffer.data(), 1, m_outputBuffer.data(), 1, halfSize);
-
-            // Finally, save 2nd half of result
-            bool isCopyGood3 = m_outputBuffer.size() == 2 * halfSize && m_lastOverlapBuffer.size() == halfSize;
-            ASSERT(isCopyGood3);
-            if (!isCopyGood3)
-                return;
-
-            memcpy(m_lastOverlapBuffer.data(), m_outputBuffer.data() + halfSize, sizeof(float) * halfSize);
+            vadd(nextOutputP, 1, lastOverlapP, 1, nextOutputP, 1, halfSize);
 
             // Reset index back to start for next time
             m_readWriteIndex = 0;
@@ -87,7 +84,8 @@ void FFTConvolver::process(FFTFrame * fftKernel, const float * sourceP, float *
 
 void FFTConvolver::reset()
 {
-    m_lastOverlapBuffer.zero();
+    m_outputBuffers[0].zero();
+    m_outputBuffers[1].zero();
     m_readWriteIndex = 0;
 }
 
@@ -5,6 +5,7 @@
 #include "LabSound/extended/Logging.h"
 
 #include "internal/FFTFrame.h"
+#include "internal/VectorMath.h"
 
 #ifndef NDEBUG
 #include <stdio.h>
@@ -27,6 +28,39 @@ void FFTFrame::doPaddedFFT(const float* data, size_t dataSize)
     doFFT(paddedResponse.data());
 }
 
+void FFTFrame::multiplyAccumulate(const FFTFrame& frame1, const FFTFrame& frame2)
+{
+    float* realP = realData();
+    float* imagP = imagData();
+    const float* realP1 = frame1.realData();
+    const float* imagP1 = frame1.imagData();
+    const float* realP2 = frame2.realData();
+    const float* imagP2 = frame2.imagData();
+
+    size_t halfSize = fftSize() / 2;
+
+#if USE_ACCELERATE_FFT
+    // multiply() halves the product of two doubled spectra; the sum is doubled so that the product can be
+    // accumulated at full scale, and the whole halved afterwards.
+    float scale = 2.0f;
+    VectorMath::vsmul(realP, 1, &scale, realP, 1, halfSize);
+    VectorMath::vsmul(imagP, 1, &scale, imagP, 1, halfSize);
+#endif
+
+    // The packed DC/nyquist component is accumulated with real arithmetic.
+    float real0 = realP[0] + realP1[0] * realP2[0];
+    float imag0 = imagP[0] + imagP1[0] * imagP2[0];
+    VectorMath::zvma(realP1, imagP1, realP2, imagP2, realP, imagP, halfSize);
+    realP[0] = real0;
+    imagP[0] = imag0;
+
+#if USE_ACCELERATE_FFT
+    scale = 0.5f;
+    VectorMath::vsmul(realP, 1, &scale, realP, 1, halfSize);
+    VectorMath::vsmul(imagP, 1, &scale, imagP, 1, halfSize);
+#endif
+}
+
 std::unique_ptr<FFTFrame> FFTFrame::createInterpolatedFrame(const FFTFrame& frame1, const FFTFrame& frame2, double x)
 {
     std::unique_ptr<FFTFrame> newFrame(new FFTFrame(frame1.fftSize()));
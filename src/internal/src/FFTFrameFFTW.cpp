@@ -0,0 +1,174 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "internal/Assertions.h"
+#include "internal/FFTFrame.h"
+
+#if USE_FFTW_FFT
+
+#include "internal/VectorMath.h"
+
+#include <cstring>
+#include <mutex>
+
+// To use this implementation, add WEBAUDIO_FFTW=1 to the list of preprocessor defines, and link
+// the single precision FFTW library, fftw3f.
+namespace lab
+{
+
+namespace
+{
+    const int kMaxFFTPow2Size = 24;
+
+    // The planner isn't thread safe, but executing a plan is, so each size is planned once, under a lock,
+    // and the plans are shared by all frames. Each frame executes them on its own buffers, which are
+    // allocated with the alignment of the planning buffers. Deliberately never destroyed, as frames may
+    // be destroyed during static destruction.
+    struct FFTWPlans
+    {
+        fftwf_plan forward;
+        fftwf_plan inverse;
+    };
+
+    std::mutex s_plansLock;
+    FFTWPlans s_plans[kMaxFFTPow2Size];
+
+    fftwf_complex * asComplex(AudioFloatArray & array)
+    {
+        return reinterpret_cast<fftwf_complex *>(array.data());
+    }
+}
+
+void FFTFrame::plansForSize(size_t fftSize, fftwf_plan & forward, fftwf_plan & inverse)
+{
+    int pow2size = static_cast<int>(log2(fftSize));
+    ASSERT(pow2size < kMaxFFTPow2Size);
+
+    std::lock_guard<std::mutex> lock(s_plansLock);
+    FFTWPlans & plans = s_plans[pow2size];
+    if (!plans.forward)
+    {
+        // Measuring overwrites the buffers, so plan on scratch buffers rather than on a frame's.
+        const int n = static_cast<int>(fftSize);
+        float * timeData = fftwf_alloc_real(fftSize);
+        fftwf_complex * complexData = fftwf_alloc_complex(fftSize / 2 + 1);
+        plans.forward = fftwf_plan_dft_r2c_1d(n, timeData, complexData, FFTW_MEASURE);
+        plans.inverse = fftwf_plan_dft_c2r_1d(n, complexData, timeData, FFTW_MEASURE);
+        fftwf_free(timeData);
+        fftwf_free(complexData);
+        ASSERT(plans.forward && plans.inverse);
+    }
+    forward = plans.forward;
+    inverse = plans.inverse;
+}
+
+// Normal constructor: allocates for a given fftSize.
+FFTFrame::FFTFrame(size_t fftSize)
+    : m_FFTSize(fftSize)
+    , m_log2FFTSize(static_cast<size_t>(log2(fftSize)))
+    , m_forwardPlan(nullptr)
+    , m_inversePlan(nullptr)
+    , m_realData(fftSize / 2 + 1)
+    , m_imagData(fftSize / 2 + 1)
+    , m_complexData(fftSize + 2)
+    , m_timeData(fftSize)
+{
+    // We only allow power of two.
+    ASSERT(1UL << m_log2FFTSize == m_FFTSize);
+
+    plansForSize(fftSize, m_forwardPlan, m_inversePlan);
+}
+
+// Creates a blank/empty frame (interpolate() must later be called).
+FFTFrame::FFTFrame()
+    : m_FFTSize(0)
+    , m_log2FFTSize(0)
+    , m_forwardPlan(nullptr)
+    , m_inversePlan(nullptr)
+{
+}
+
+// Copy constructor.
+FFTFrame::FFTFrame(const FFTFrame& frame)
+    : m_FFTSize(frame.m_FFTSize)
+    , m_log2FFTSize(frame.m_log2FFTSize)
+    , m_forwardPlan(frame.m_forwardPlan)
+    , m_inversePlan(frame.m_inversePlan)
+    , m_realData(frame.m_FFTSize / 2 + 1)
+    , m_imagData(frame.m_FFTSize / 2 + 1)
+    , m_complexData(frame.m_FFTSize + 2)
+    , m_timeData(frame.m_FFTSize)
+{
+    size_t nbytes = sizeof(float) * (m_FFTSize / 2 + 1);
+    memcpy(realData(), frame.realData(), nbytes);
+    memcpy(imagData(), frame.imagData(), nbytes);
+}
+
+FFTFrame::~FFTFrame()
+{
+}
+
+void FFTFrame::multiply(const FFTFrame& frame)
+{
+    float* realP1 = realData();
+    float* imagP1 = imagData();
+    const float* realP2 = frame.realData();
+    const float* imagP2 = frame.imagData();
+
+    size_t halfSize = m_FFTSize / 2;
+    float real0 = realP1[0];
+    float imag0 = imagP1[0];
+    VectorMath::zvmul(realP1, imagP1, realP2, imagP2, realP1, imagP1, halfSize);
+
+    // Multiply the packed DC/nyquist component
+    realP1[0] = real0 * realP2[0];
+    imagP1[0] = imag0 * imagP2[0];
+}
+
+void FFTFrame::doFFT(const float* data)
+{
+    // The plans were made for aligned buffers, and the real to complex transform preserves its input.
+    float * input = const_cast<float *>(data);
+    if (fftwf_alignment_of(input) != 0)
+    {
+        memcpy(m_timeData.data(), data, sizeof(float) * m_FFTSize);
+        input = m_timeData.data();
+    }
+    fftwf_execute_dft_r2c(m_forwardPlan, input, asComplex(m_complexData));
+
+    // De-interleave to separate real and complex arrays, and pack the Nyquist component in place of
+    // the imaginary part of DC, which is zero.
+    VectorMath::vdeintlve(m_complexData.data(), m_realData.data(), m_imagData.data(), m_FFTSize);
+    m_imagData[0] = m_complexData[m_FFTSize];
+}
+
+void FFTFrame::doInverseFFT(float* data)
+{
+    // The complex to real transform overwrites its input, which is why it is unpacked into a buffer.
+    float * complexData = m_complexData.data();
+    VectorMath::vintlve(m_realData.data(), m_imagData.data(), complexData, m_FFTSize);
+    complexData[1] = 0;
+    complexData[m_FFTSize] = m_imagData[0];
+    complexData[m_FFTSize + 1] = 0;
+
+    fftwf_execute_dft_c2r(m_inversePlan, asComplex(m_complexData), m_timeData.data());
+
+    // Scale so that a forward then inverse FFT yields exactly the original data.
+    const float scale = 1.0f / m_FFTSize;
+    VectorMath::vsmul(m_timeData.data(), 1, &scale, data, 1, m_FFTSize);
+}
+
+float* FFTFrame::realData() const
+{
+    return const_cast<float*>(m_realData.data());
+}
+
+float* FFTFrame::imagData() const
+{
+    return const_cast<float*>(m_imagData.data());
+}
+
+} // namespace lab
+
+#endif // USE_FFTW_FFT
@@ -3,135 +3,160 @@
 
 #include "LabSound/core/Macros.h"
 #include "internal/Assertions.h"
+#include "internal/FFTFrame.h"
 
-#if defined(WEBAUDIO_KISSFFT)
+#if USE_KISS_FFT
 
-#include "internal/FFTFrame.h"
 #include "internal/VectorMath.h"
 
 #include <kissfft/kiss_fftr.hpp>
 #include <iostream>
+#include <mutex>
 
 // To use this implementation, add WTF_USE_WEBAUDIO_KISSFFT=1 to the list of preprocessor defines
-namespace lab 
+namespace lab
 {
-    
-    const int kMaxFFTPow2Size = 24;
-    
+
+    namespace
+    {
+        const int kMaxFFTPow2Size = 24;
+
+        // The twiddle factors and factorization of each size and direction are computed once and shared by
+        // all frames, since the _work transforms only read the config. Deliberately never freed, as frames may
+        // be destroyed during static destruction.
+        std::mutex s_configsLock;
+        kiss_fftr_cfg s_configs[2][kMaxFFTPow2Size];
+
+        // The spectrum is only kept as the frame's split real and imaginary arrays. The interleaved bins and
+        // the transforms' work area are needed for the duration of a transform, so each thread has one set,
+        // rather than every frame, such as the thousands of HRTF kernels, carrying its own.
+        struct KissScratch
+        {
+            std::vector<kiss_fft_cpx> bins;
+            std::vector<kiss_fft_cpx> work;
+        };
+
+        KissScratch & scratchForSize(size_t fftSize)
+        {
+            thread_local KissScratch scratch;
+            if (scratch.bins.size() < fftSize / 2 + 1)
+            {
+                scratch.bins.resize(fftSize / 2 + 1);
+                scratch.work.resize(fftSize / 2);
+            }
+            return scratch;
+        }
+    }
+
+    kiss_fftr_cfg FFTFrame::configForSize(size_t fftSize, bool inverse)
+    {
+        int pow2size = static_cast<int>(log2(fftSize));
+        ASSERT(pow2size < kMaxFFTPow2Size);
+
+        std::lock_guard<std::mutex> lock(s_configsLock);
+        kiss_fftr_cfg & config = s_configs[inverse][pow2size];
+        if (!config)
+            config = kiss_fftr_alloc(static_cast<int>(fftSize), inverse, nullptr, nullptr);
+        return config;
+    }
+
     // Normal constructor: allocates for a given fftSize.
     FFTFrame::FFTFrame(size_t fftSize) : m_FFTSize(fftSize), m_log2FFTSize(static_cast<unsigned>(log2((double)fftSize))), mFFT(0), mIFFT(0), m_realData(fftSize / 2 + 1), m_imagData(fftSize / 2 + 1)
     {
         // We only allow power of two.
         ASSERT(1UL << m_log2FFTSize == m_FFTSize);
-        
-        const int mBinSize = m_FFTSize / 2 + 1; 
-
-        mFFT = kiss_fftr_alloc(m_FFTSize, 0, nullptr, nullptr);
-        mIFFT = kiss_fftr_alloc(m_FFTSize, 1, nullptr, nullptr);
-        
-        m_cpxInputData = new kiss_fft_cpx[mBinSize];
-        m_cpxOutputData = new kiss_fft_cpx[mBinSize];
-
-        size_t nbytes = sizeof(float) * mBinSize;
 
-        memset(realData(), 0, nbytes);
-        memset(imagData(), 0, nbytes);
+        mFFT = configForSize(m_FFTSize, false);
+        mIFFT = configForSize(m_FFTSize, true);
     }
-    
+
     // Creates a blank/empty frame (interpolate() must later be called).
     FFTFrame::FFTFrame() : m_FFTSize(0), m_log2FFTSize(0), mFFT(0), mIFFT(0)
     {
 
     }
-    
-    // Copy constructor.
-    FFTFrame::FFTFrame(const FFTFrame& frame) : m_FFTSize(frame.m_FFTSize), m_log2FFTSize(frame.m_log2FFTSize), mFFT(0), mIFFT(0), m_realData(frame.m_FFTSize / 2), m_imagData(frame.m_FFTSize / 2)
-    { 
-        mFFT = kiss_fftr_alloc(m_FFTSize, 0, nullptr, nullptr);
-        mIFFT = kiss_fftr_alloc(m_FFTSize, 1, nullptr, nullptr);
-
-        const int mBinSize = m_FFTSize / 2 + 1; 
 
+    // Copy constructor.
+    FFTFrame::FFTFrame(const FFTFrame& frame) : m_FFTSize(frame.m_FFTSize), m_log2FFTSize(frame.m_log2FFTSize), mFFT(frame.mFFT), mIFFT(frame.mIFFT), m_realData(frame.m_FFTSize / 2 + 1), m_imagData(frame.m_FFTSize / 2 + 1)
+    {
         // Copy/setup frame data.
-        unsigned nbytes = sizeof(float) * mBinSize;
-
+        size_t nbytes = sizeof(float) * (m_FFTSize / 2 + 1);
         memcpy(realData(), frame.realData(), nbytes);
         memcpy(imagData(), frame.imagData(), nbytes);
-
-        m_cpxInputData = new kiss_fft_cpx[mBinSize];
-        m_cpxOutputData = new kiss_fft_cpx[mBinSize];
     }
-    
+
     FFTFrame::~FFTFrame()
     {
-        KISS_FFT_FREE(mFFT);
-        KISS_FFT_FREE(mIFFT);
-        delete m_cpxInputData;
-        delete m_cpxOutputData;
     }
-    
+
     void FFTFrame::multiply(const FFTFrame& frame)
     {
         FFTFrame& frame1 = *this;
         FFTFrame& frame2 = const_cast<FFTFrame&>(frame);
-        
+
         float* realP1 = frame1.realData();
         float* imagP1 = frame1.imagData();
         const float* realP2 = frame2.realData();
         const float* imagP2 = frame2.imagData();
-        
+
         unsigned halfSize = fftSize() / 2;
         float real0 = realP1[0];
         float imag0 = imagP1[0];
         VectorMath::zvmul(realP1, imagP1, realP2, imagP2, realP1, imagP1, halfSize);
-        
+
         // Multiply the packed DC/nyquist component
         realP1[0] = real0 * realP2[0];
         imagP1[0] = imag0 * imagP2[0];
     }
-    
+
     void FFTFrame::doFFT(const float* data)
     {
-        kiss_fftr(mFFT, data, m_cpxOutputData);
-        
-        float * outputData = reinterpret_cast<float*>(m_cpxOutputData); // interleaved .r / .i
+        KissScratch & scratch = scratchForSize(m_FFTSize);
+        kiss_fftr_work(mFFT, data, scratch.bins.data(), scratch.work.data());
+
+        float * outputData = reinterpret_cast<float*>(scratch.bins.data()); // interleaved .r / .i
 
         // De-interleave to separate real and complex arrays.
         VectorMath::vdeintlve(outputData, m_realData.data(), m_imagData.data(), m_FFTSize);
+
+        // Pack the Nyquist component in place of the imaginary part of DC, which is zero.
+        m_imagData[0] = scratch.bins[m_FFTSize / 2].r;
     }
-    
+
     void FFTFrame::doInverseFFT(float* data)
     {
-        const uint32_t inputSize = m_FFTSize / 2 + 1;
+        KissScratch & scratch = scratchForSize(m_FFTSize);
+        kiss_fft_cpx * inputData = scratch.bins.data();
+        const size_t inputSize = m_FFTSize / 2 + 1;
 
-        for (uint32_t i = 0; i < inputSize; ++i) 
-        {
-            m_cpxInputData[i].r = m_realData.data()[i];
-            m_cpxInputData[i].i = m_imagData.data()[i];
-        }
+        VectorMath::vintlve(m_realData.data(), m_imagData.data(), reinterpret_cast<float*>(inputData), m_FFTSize);
+
+        // Unpack the Nyquist component.
+        inputData[0].i = 0;
+        inputData[inputSize - 1].r = m_imagData[0];
+        inputData[inputSize - 1].i = 0;
 
         // Inverse-transform the (inputSize) points of data in each
-        // of (m_cpxInputData.r) and (m_cpxInputData.i) 
-        float * outData = reinterpret_cast<float*>(m_cpxOutputData); // .r + .i
-        kiss_fftri(mIFFT, m_cpxInputData, outData);
+        // of (inputData.r) and (inputData.i)
+        kiss_fftri_work(mIFFT, inputData, data, scratch.work.data());
 
         // Scale so that a forward then inverse FFT yields exactly the original data and
         // store the resulting (m_FFTSize) points in (data).
         //  x == IFFT(FFT(x))
         const float scale = 1.0f / m_FFTSize;
-        VectorMath::vsmul(outData, 1, &scale, data, 1, m_FFTSize);
+        VectorMath::vsmul(data, 1, &scale, data, 1, m_FFTSize);
     }
-    
+
     float* FFTFrame::realData() const
     {
         return const_cast<float*>(m_realData.data());
     }
-    
+
     float* FFTFrame::imagData() const
     {
         return const_cast<float*>(m_imagData.data());
     }
- 
+
 } // namespace lab
 
-#endif // USE KISS FFT
+#endif // USE_KISS_FFT
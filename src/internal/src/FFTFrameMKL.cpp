@@ -0,0 +1,162 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "internal/Assertions.h"
+#include "internal/FFTFrame.h"
+
+#if USE_MKL_FFT
+
+#include "internal/VectorMath.h"
+
+#include <cstring>
+#include <mutex>
+
+// To use this implementation, add WEBAUDIO_MKL=1 to the list of preprocessor defines, and link
+// Intel MKL's single dynamic library, mkl_rt.
+namespace lab
+{
+
+namespace
+{
+    const int kMaxFFTPow2Size = 24;
+
+    // A committed descriptor may be used by several threads at once, so frames of the same size share one.
+    // Deliberately never freed, as frames may be destroyed during static destruction.
+    std::mutex s_descriptorsLock;
+    DFTI_DESCRIPTOR_HANDLE s_descriptors[kMaxFFTPow2Size];
+
+    bool succeeded(MKL_LONG status)
+    {
+        return !status || DftiErrorClass(status, DFTI_NO_ERROR);
+    }
+}
+
+DFTI_DESCRIPTOR_HANDLE FFTFrame::descriptorForSize(size_t fftSize)
+{
+    int pow2size = static_cast<int>(log2(fftSize));
+    ASSERT(pow2size < kMaxFFTPow2Size);
+
+    std::lock_guard<std::mutex> lock(s_descriptorsLock);
+    if (!s_descriptors[pow2size])
+    {
+        DFTI_DESCRIPTOR_HANDLE descriptor = nullptr;
+        bool created = succeeded(DftiCreateDescriptor(&descriptor, DFTI_SINGLE, DFTI_REAL, 1, static_cast<MKL_LONG>(fftSize)))
+            && succeeded(DftiSetValue(descriptor, DFTI_PLACEMENT, DFTI_NOT_INPLACE))
+            && succeeded(DftiSetValue(descriptor, DFTI_CONJUGATE_EVEN_STORAGE, DFTI_COMPLEX_COMPLEX))
+            && succeeded(DftiSetValue(descriptor, DFTI_BACKWARD_SCALE, 1.0f / fftSize))
+
+            // The transforms run on the audio thread, so keep MKL from using its thread pool.
+            && succeeded(DftiSetValue(descriptor, DFTI_THREAD_LIMIT, 1))
+            && succeeded(DftiCommitDescriptor(descriptor));
+
+        ASSERT(created);
+        if (!created)
+        {
+            if (descriptor)
+                DftiFreeDescriptor(&descriptor);
+            return nullptr;
+        }
+        s_descriptors[pow2size] = descriptor;
+    }
+    return s_descriptors[pow2size];
+}
+
+// Normal constructor: allocates for a given fftSize.
+FFTFrame::FFTFrame(size_t fftSize)
+    : m_FFTSize(fftSize)
+    , m_log2FFTSize(static_cast<size_t>(log2(fftSize)))
+    , m_descriptor(descriptorForSize(fftSize))
+    , m_realData(fftSize / 2 + 1)
+    , m_imagData(fftSize / 2 + 1)
+    , m_complexData(fftSize + 2)
+{
+    // We only allow power of two.
+    ASSERT(1UL << m_log2FFTSize == m_FFTSize);
+}
+
+// Creates a blank/empty frame (interpolate() must later be called).
+FFTFrame::FFTFrame()
+    : m_FFTSize(0)
+    , m_log2FFTSize(0)
+    , m_descriptor(nullptr)
+{
+}
+
+// Copy constructor.
+FFTFrame::FFTFrame(const FFTFrame& frame)
+    : m_FFTSize(frame.m_FFTSize)
+    , m_log2FFTSize(frame.m_log2FFTSize)
+    , m_descriptor(frame.m_descriptor)
+    , m_realData(frame.m_FFTSize / 2 + 1)
+    , m_imagData(frame.m_FFTSize / 2 + 1)
+    , m_complexData(frame.m_FFTSize + 2)
+{
+    size_t nbytes = sizeof(float) * (m_FFTSize / 2 + 1);
+    memcpy(realData(), frame.realData(), nbytes);
+    memcpy(imagData(), frame.imagData(), nbytes);
+}
+
+FFTFrame::~FFTFrame()
+{
+}
+
+void FFTFrame::multiply(const FFTFrame& frame)
+{
+    float* realP1 = realData();
+    float* imagP1 = imagData();
+    const float* realP2 = frame.realData();
+    const float* imagP2 = frame.imagData();
+
+    size_t halfSize = m_FFTSize / 2;
+    float real0 = realP1[0];
+    float imag0 = imagP1[0];
+    VectorMath::zvmul(realP1, imagP1, realP2, imagP2, realP1, imagP1, halfSize);
+
+    // Multiply the packed DC/nyquist component
+    realP1[0] = real0 * realP2[0];
+    imagP1[0] = imag0 * imagP2[0];
+}
+
+void FFTFrame::doFFT(const float* data)
+{
+    if (!m_descriptor)
+        return;
+
+    // Out of place, the input is only read.
+    DftiComputeForward(m_descriptor, const_cast<float *>(data), m_complexData.data());
+
+    // De-interleave to separate real and complex arrays, and pack the Nyquist component in place of
+    // the imaginary part of DC, which is zero.
+    VectorMath::vdeintlve(m_complexData.data(), m_realData.data(), m_imagData.data(), m_FFTSize);
+    m_imagData[0] = m_complexData[m_FFTSize];
+}
+
+void FFTFrame::doInverseFFT(float* data)
+{
+    if (!m_descriptor)
+        return;
+
+    float * complexData = m_complexData.data();
+    VectorMath::vintlve(m_realData.data(), m_imagData.data(), complexData, m_FFTSize);
+    complexData[1] = 0;
+    complexData[m_FFTSize] = m_imagData[0];
+    complexData[m_FFTSize + 1] = 0;
+
+    // The descriptor's backward scale makes a forward then inverse FFT yield exactly the original data.
+    DftiComputeBackward(m_descriptor, complexData, data);
+}
+
+float* FFTFrame::realData() const
+{
+    return const_cast<float*>(m_realData.data());
+}
+
+float* FFTFrame::imagData() const
+{
+    return const_cast<float*>(m_imagData.data());
+}
+
+} // namespace lab
+
+#endif // USE_MKL_FFT
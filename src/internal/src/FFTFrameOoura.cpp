@@ -0,0 +1,158 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "internal/Assertions.h"
+#include "internal/FFTFrame.h"
+
+#if USE_OOURA_FFT
+
+#include "internal/VectorMath.h"
+
+#include <ooura/fftsg.h>
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+// To use this implementation, add WEBAUDIO_OOURA=1 to the list of preprocessor defines
+namespace lab
+{
+
+namespace
+{
+    const int kMaxFFTPow2Size = 24;
+
+    // The bit reversal and twiddle tables of each size are built once and then only read, so they are
+    // shared by all frames. Deliberately never freed, as frames may be destroyed during static destruction.
+    struct OouraTables
+    {
+        int * ip;
+        float * w;
+    };
+
+    std::mutex s_tablesLock;
+    OouraTables s_tables[kMaxFFTPow2Size];
+}
+
+void FFTFrame::tablesForSize(size_t fftSize, int *& ip, float *& w)
+{
+    int pow2size = static_cast<int>(log2(fftSize));
+    ASSERT(pow2size < kMaxFFTPow2Size);
+
+    std::lock_guard<std::mutex> lock(s_tablesLock);
+    OouraTables & tables = s_tables[pow2size];
+    if (!tables.ip)
+    {
+        tables.ip = new int[2 + static_cast<size_t>(std::sqrt(fftSize / 2.0)) + 1]();
+        tables.w = new float[fftSize / 2]();
+
+        // rdft fills in the tables on its first call.
+        AudioFloatArray scratch(fftSize);
+        ooura::rdft(static_cast<int>(fftSize), 1, scratch.data(), tables.ip, tables.w);
+    }
+    ip = tables.ip;
+    w = tables.w;
+}
+
+// Normal constructor: allocates for a given fftSize.
+FFTFrame::FFTFrame(size_t fftSize)
+    : m_FFTSize(fftSize)
+    , m_log2FFTSize(static_cast<size_t>(log2(fftSize)))
+    , m_ip(nullptr)
+    , m_w(nullptr)
+    , m_realData(fftSize / 2 + 1)
+    , m_imagData(fftSize / 2 + 1)
+    , m_buffer(fftSize)
+{
+    // We only allow power of two.
+    ASSERT(1UL << m_log2FFTSize == m_FFTSize);
+
+    tablesForSize(fftSize, m_ip, m_w);
+}
+
+// Creates a blank/empty frame (interpolate() must later be called).
+FFTFrame::FFTFrame()
+    : m_FFTSize(0)
+    , m_log2FFTSize(0)
+    , m_ip(nullptr)
+    , m_w(nullptr)
+{
+}
+
+// Copy constructor.
+FFTFrame::FFTFrame(const FFTFrame& frame)
+    : m_FFTSize(frame.m_FFTSize)
+    , m_log2FFTSize(frame.m_log2FFTSize)
+    , m_ip(frame.m_ip)
+    , m_w(frame.m_w)
+    , m_realData(frame.m_FFTSize / 2 + 1)
+    , m_imagData(frame.m_FFTSize / 2 + 1)
+    , m_buffer(frame.m_FFTSize)
+{
+    size_t nbytes = sizeof(float) * (m_FFTSize / 2 + 1);
+    memcpy(realData(), frame.realData(), nbytes);
+    memcpy(imagData(), frame.imagData(), nbytes);
+}
+
+FFTFrame::~FFTFrame()
+{
+}
+
+void FFTFrame::multiply(const FFTFrame& frame)
+{
+    float* realP1 = realData();
+    float* imagP1 = imagData();
+    const float* realP2 = frame.realData();
+    const float* imagP2 = frame.imagData();
+
+    size_t halfSize = m_FFTSize / 2;
+    float real0 = realP1[0];
+    float imag0 = imagP1[0];
+    VectorMath::zvmul(realP1, imagP1, realP2, imagP2, realP1, imagP1, halfSize);
+
+    // Multiply the packed DC/nyquist component
+    realP1[0] = real0 * realP2[0];
+    imagP1[0] = imag0 * imagP2[0];
+}
+
+void FFTFrame::doFFT(const float* data)
+{
+    float * buffer = m_buffer.data();
+    memcpy(buffer, data, sizeof(float) * m_FFTSize);
+    ooura::rdft(static_cast<int>(m_FFTSize), 1, buffer, m_ip, m_w);
+
+    // rdft already packs the Nyquist component into the second element. Its sines have the opposite
+    // sign of the forward transform's, so the imaginary parts are negated.
+    VectorMath::vdeintlve(buffer, m_realData.data(), m_imagData.data(), m_FFTSize);
+    const float minusOne = -1;
+    VectorMath::vsmul(m_imagData.data() + 1, 1, &minusOne, m_imagData.data() + 1, 1, m_FFTSize / 2 - 1);
+}
+
+void FFTFrame::doInverseFFT(float* data)
+{
+    float * buffer = m_buffer.data();
+    VectorMath::vintlve(m_realData.data(), m_imagData.data(), buffer, m_FFTSize);
+    for (size_t i = 3; i < m_FFTSize; i += 2)
+        buffer[i] = -buffer[i];
+
+    ooura::rdft(static_cast<int>(m_FFTSize), -1, buffer, m_ip, m_w);
+
+    // The inverse rdft is scaled by n / 2.
+    const float scale = 2.0f / m_FFTSize;
+    VectorMath::vsmul(buffer, 1, &scale, data, 1, m_FFTSize);
+}
+
+float* FFTFrame::realData() const
+{
+    return const_cast<float*>(m_realData.data());
+}
+
+float* FFTFrame::imagData() const
+{
+    return const_cast<float*>(m_imagData.data());
+}
+
+} // namespace lab
+
+#endif // USE_OOURA_FFT
@@ -0,0 +1,145 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "internal/Assertions.h"
+#include "internal/FFTFrame.h"
+
+#if USE_PFFFT_FFT
+
+#include "internal/VectorMath.h"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+// To use this implementation, add WEBAUDIO_PFFFT=1 to the list of preprocessor defines,
+// and build pffft.c into the library. PFFFT transforms real signals of multiples of 32 samples.
+namespace lab
+{
+
+namespace
+{
+    const int kMaxFFTPow2Size = 24;
+
+    // Setups only hold twiddle factors once created, so frames of the same size share one.
+    // Deliberately never destroyed, as frames may be destroyed during static destruction.
+    std::mutex s_setupsLock;
+    PFFFT_Setup * s_setups[kMaxFFTPow2Size];
+
+    bool isSimdAligned(const float * data)
+    {
+        return !(reinterpret_cast<uintptr_t>(data) & 15);
+    }
+}
+
+PFFFT_Setup * FFTFrame::setupForSize(size_t fftSize)
+{
+    int pow2size = static_cast<int>(log2(fftSize));
+    ASSERT(pow2size < kMaxFFTPow2Size);
+    ASSERT(fftSize >= 32);
+
+    std::lock_guard<std::mutex> lock(s_setupsLock);
+    if (!s_setups[pow2size])
+        s_setups[pow2size] = pffft_new_setup(static_cast<int>(fftSize), PFFFT_REAL);
+    return s_setups[pow2size];
+}
+
+// Normal constructor: allocates for a given fftSize.
+FFTFrame::FFTFrame(size_t fftSize)
+    : m_FFTSize(fftSize)
+    , m_log2FFTSize(static_cast<size_t>(log2(fftSize)))
+    , m_setup(setupForSize(fftSize))
+    , m_realData(fftSize / 2 + 1)
+    , m_imagData(fftSize / 2 + 1)
+    , m_buffer(fftSize)
+    , m_work(fftSize)
+{
+    // We only allow power of two.
+    ASSERT(1UL << m_log2FFTSize == m_FFTSize);
+}
+
+// Creates a blank/empty frame (interpolate() must later be called).
+FFTFrame::FFTFrame()
+    : m_FFTSize(0)
+    , m_log2FFTSize(0)
+    , m_setup(nullptr)
+{
+}
+
+// Copy constructor.
+FFTFrame::FFTFrame(const FFTFrame& frame)
+    : m_FFTSize(frame.m_FFTSize)
+    , m_log2FFTSize(frame.m_log2FFTSize)
+    , m_setup(frame.m_setup)
+    , m_realData(frame.m_FFTSize / 2 + 1)
+    , m_imagData(frame.m_FFTSize / 2 + 1)
+    , m_buffer(frame.m_FFTSize)
+    , m_work(frame.m_FFTSize)
+{
+    size_t nbytes = sizeof(float) * (m_FFTSize / 2 + 1);
+    memcpy(realData(), frame.realData(), nbytes);
+    memcpy(imagData(), frame.imagData(), nbytes);
+}
+
+FFTFrame::~FFTFrame()
+{
+}
+
+void FFTFrame::multiply(const FFTFrame& frame)
+{
+    float* realP1 = realData();
+    float* imagP1 = imagData();
+    const float* realP2 = frame.realData();
+    const float* imagP2 = frame.imagData();
+
+    size_t halfSize = m_FFTSize / 2;
+    float real0 = realP1[0];
+    float imag0 = imagP1[0];
+    VectorMath::zvmul(realP1, imagP1, realP2, imagP2, realP1, imagP1, halfSize);
+
+    // Multiply the packed DC/nyquist component
+    realP1[0] = real0 * realP2[0];
+    imagP1[0] = imag0 * imagP2[0];
+}
+
+void FFTFrame::doFFT(const float* data)
+{
+    // PFFFT requires 16 byte aligned buffers, and may transform in place.
+    float * buffer = m_buffer.data();
+    const float * input = data;
+    if (!isSimdAligned(data))
+    {
+        memcpy(buffer, data, sizeof(float) * m_FFTSize);
+        input = buffer;
+    }
+    pffft_transform_ordered(m_setup, input, buffer, m_work.data(), PFFFT_FORWARD);
+
+    // The ordered spectrum starts with the DC and Nyquist components, which is the packed layout.
+    VectorMath::vdeintlve(buffer, m_realData.data(), m_imagData.data(), m_FFTSize);
+}
+
+void FFTFrame::doInverseFFT(float* data)
+{
+    float * buffer = m_buffer.data();
+    VectorMath::vintlve(m_realData.data(), m_imagData.data(), buffer, m_FFTSize);
+    pffft_transform_ordered(m_setup, buffer, buffer, m_work.data(), PFFFT_BACKWARD);
+
+    // Scale so that a forward then inverse FFT yields exactly the original data.
+    const float scale = 1.0f / m_FFTSize;
+    VectorMath::vsmul(buffer, 1, &scale, data, 1, m_FFTSize);
+}
+
+float* FFTFrame::realData() const
+{
+    return const_cast<float*>(m_realData.data());
+}
+
+float* FFTFrame::imagData() const
+{
+    return const_cast<float*>(m_imagData.data());
+}
+
+} // namespace lab
+
+#endif // USE_PFFFT_FFT
@@ -0,0 +1,113 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/FirstOrderFilter.h"
+#include "internal/DenormalDisabler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
+namespace lab {
+
+namespace FirstOrder {
+
+namespace {
+
+    template <bool Accumulate>
+    void onePoleScan(const float* source, float* destination, size_t framesToProcess, float a, float b, float& state)
+    {
+        size_t i = 0;
+        float y = state;
+
+#if defined(__SSE2__)
+        const __m128 mb = _mm_set1_ps(b);
+        const __m128 a1 = _mm_set1_ps(a);
+        const __m128 a2 = _mm_set1_ps(a * a);
+        const __m128 powers = _mm_setr_ps(a, a * a, a * a * a, a * a * a * a);
+        __m128 carry = _mm_set1_ps(y);
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            __m128 u = _mm_mul_ps(mb, _mm_loadu_ps(source + i));
+            u = _mm_add_ps(u, _mm_mul_ps(a1, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 4))));
+            u = _mm_add_ps(u, _mm_mul_ps(a2, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 8))));
+            __m128 out = _mm_add_ps(u, _mm_mul_ps(powers, carry));
+            carry = _mm_shuffle_ps(out, out, _MM_SHUFFLE(3, 3, 3, 3));
+            if (Accumulate)
+                _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), out));
+            else
+                _mm_storeu_ps(destination + i, out);
+        }
+        y = _mm_cvtss_f32(carry);
+#elif defined(ARM_NEON_INTRINSICS)
+        const float32x4_t zero = vdupq_n_f32(0);
+        const float powersData[4] = { a, a * a, a * a * a, a * a * a * a };
+        const float32x4_t powers = vld1q_f32(powersData);
+        const float a2 = a * a;
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            float32x4_t u = vmulq_n_f32(vld1q_f32(source + i), b);
+            u = vmlaq_n_f32(u, vextq_f32(zero, u, 3), a);
+            u = vmlaq_n_f32(u, vextq_f32(zero, u, 2), a2);
+            float32x4_t out = vmlaq_n_f32(u, powers, y);
+            y = vgetq_lane_f32(out, 3);
+            if (Accumulate)
+                vst1q_f32(destination + i, vaddq_f32(vld1q_f32(destination + i), out));
+            else
+                vst1q_f32(destination + i, out);
+        }
+#endif
+
+        for (; i < framesToProcess; ++i)
+        {
+            y = a * y + b * source[i];
+            if (Accumulate)
+                destination[i] += y;
+            else
+                destination[i] = y;
+        }
+
+        // Flushed here rather than in the loop, so as not to slow it down.
+        state = DenormalDisabler::flushDenormalFloatToZero(y);
+    }
+
+} // namespace
+
+void onePole(const float* sourceP, float* destP, size_t framesToProcess, float pole, float gain, float& lastY)
+{
+    onePoleScan<false>(sourceP, destP, framesToProcess, pole, gain, lastY);
+}
+
+void onePoleAdd(const float* sourceP, float* destP, size_t framesToProcess, float pole, float gain, float& lastY)
+{
+    onePoleScan<true>(sourceP, destP, framesToProcess, pole, gain, lastY);
+}
+
+void oneZero(const float* sourceP, float* destP, size_t framesToProcess, float b0, float b1, float& lastX)
+{
+    if (!framesToProcess)
+        return;
+
+    // Runs from the end, so that in place, each frame's predecessor is read before it is written over.
+    const float first = sourceP[0];
+    const float last = sourceP[framesToProcess - 1];
+    for (size_t i = framesToProcess - 1; i > 0; --i)
+        destP[i] = b0 * sourceP[i] + b1 * sourceP[i - 1];
+    destP[0] = b0 * first + b1 * lastX;
+
+    lastX = last;
+}
+
+void dcBlock(const float* sourceP, float* destP, size_t framesToProcess, float pole, float& lastX, float& lastY)
+{
+    oneZero(sourceP, destP, framesToProcess, 1, -1, lastX);
+    onePole(destP, destP, framesToProcess, pole, 1, lastY);
+}
+
+} // namespace FirstOrder
+
+} // namespace lab
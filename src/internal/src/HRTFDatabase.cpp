@@ -2,53 +2,354 @@
 // Copyright (C) 2010, Google Inc. All rights reserved.
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
+#include "internal/Ambisonics.h"
 #include "internal/HRTFDatabase.h"
+#include "internal/HRTFDatabaseFile.h"
 #include "internal/HRTFElevation.h"
+#include "internal/HRTFPanner.h"
+#include "internal/SpectrumCache.h"
 #include "internal/Assertions.h"
+#include "internal/DenormalDisabler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
 
 using namespace std;
 
 namespace lab {
 
-HRTFDatabase::HRTFDatabase(float sampleRate, const std::string & searchPath)
+namespace
 {
-    info.reset(new HRTFDatabaseInfo("Composite", searchPath, sampleRate));
-    
-    m_elevations.resize(info->numTotalElevations);
+    // A request that misses the materializer's wake is served within this time.
+    const auto PollInterval = std::chrono::milliseconds(10);
+
+    // Queued in place of a slot to have the ambisonic decoder's filters made.
+    const uint32_t AmbisonicDecoderFiltersRequest = ~0u;
+}
+
+// About 1 MB of kernels at 44.1 kHz, enough for every azimuth of one elevation and part of its neighbours.
+const size_t HRTFDatabase::MaxInterpolatedKernels = 256;
+
+// Partitions of a render quantum, so that decoding adds no more latency than that.
+const size_t HRTFDatabase::AmbisonicDecoderFFTSize = 256;
+
+const char * const HRTFDatabase::DefaultSubject = "Composite";
+
+HRTFDatabase::HRTFDatabase(float sampleRate, const std::string & searchPath, const std::string & subjectName)
+{
+    info.reset(new HRTFDatabaseInfo(subjectName, searchPath, sampleRate));
     
-    int elevationIndex = 0;
-    for (int elevation = info->minElevation; elevation <= info->maxElevation; elevation += info->rawElevationAngleSpacing)
+    m_elevations.resize(info->numberOfRawElevations);
+
+    // A packed database prepared for the sample rate is mapped in one piece, rather than opening every response's file.
+    std::unique_ptr<HRTFDatabaseFile> database = HRTFDatabaseFile::open(HRTFDatabaseFile::pathForSubject(searchPath, info->subjectName, sampleRate));
+    if (database && (database->sampleRate() != sampleRate || database->fftSize() != HRTFPanner::fftSizeForSampleRate(sampleRate)))
     {
-        std::unique_ptr<HRTFElevation> hrtfElevation = HRTFElevation::createForSubject(info.get(), elevation);
-        
-        // @tofix - removed ASSERT(hrtfElevation.get());
-        if (!hrtfElevation.get()) return;
-        
-        m_elevations[elevationIndex] = std::move(hrtfElevation);
-        elevationIndex += info->interpolationFactor;
+        LOG_ERROR("The packed HRTF database in %s was prepared for another sample rate", searchPath.c_str());
+        database.reset();
     }
 
-    // Go back and interpolate elevations
-    if (info->interpolationFactor > 1)
+    // The measured kernels may be cached on disk, keyed by the measured responses.
+    SpectrumCacheKey key;
+    bool useCache = spectrumCacheEnabled() && cacheKey(key, database.get());
+    if (!useCache || !loadFromCache(key))
     {
-        for (int i = 0; i < info->numTotalElevations; i += info->interpolationFactor)
+        int elevationIndex = 0;
+        for (int elevation = info->minElevation; elevation <= info->maxElevation; elevation += info->rawElevationAngleSpacing)
         {
-            int j = (i + info->interpolationFactor);
+            std::unique_ptr<HRTFElevation> hrtfElevation = HRTFElevation::createForSubject(info.get(), elevation, database.get());
             
-            if (j >= info->numTotalElevations)
+            // @tofix - removed ASSERT(hrtfElevation.get());
+            if (!hrtfElevation.get()) return;
+            
+            m_elevations[elevationIndex++] = std::move(hrtfElevation);
+        }
+
+        if (useCache)
+            saveToCache(key);
+    }
+
+    // The slots of the measured azimuths of the measured elevations share the elevations' kernels.
+    m_slots.reset(new Slot[info->numTotalElevations * numberOfAzimuths()]);
+    for (int e = 0; e < info->numTotalElevations; e += info->interpolationFactor)
+    {
+        for (unsigned a = 0; a < numberOfAzimuths(); a += HRTFElevation::InterpolationFactor)
+        {
+            std::unique_ptr<KernelPair> kernels(new KernelPair());
+            m_elevations[e / info->interpolationFactor]->kernelsForAzimuth(a, kernels->kernelL, kernels->kernelR);
+            m_slots[slotIndex(e, a)].kernels.store(kernels.get());
+            m_measuredKernels.push_back(std::move(kernels));
+        }
+    }
+
+    std::set<const HRTFKernel *> distinctKernels;
+    for (auto & kernels : m_measuredKernels)
+    {
+        distinctKernels.insert(kernels->kernelL.get());
+        distinctKernels.insert(kernels->kernelR.get());
+    }
+    m_measuredKernelBytes = distinctKernels.size() * FFTFrame::memoryBytes(HRTFPanner::fftSizeForSampleRate(sampleRate));
+
+    m_shouldRun = true;
+    m_materializer = std::thread(&HRTFDatabase::materializerEntry, this);
+}
+
+HRTFDatabase::~HRTFDatabase()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_shouldRun = false;
+        m_work.notify_one();
+    }
+
+    if (m_materializer.joinable())
+        m_materializer.join();
+
+    for (size_t slot : m_interpolatedSlots)
+        delete m_slots[slot].kernels.load();
+    for (KernelPair * kernels : m_retiredKernels)
+        delete kernels;
+    delete m_ambisonicDecoderFilters.load();
+}
+
+bool HRTFDatabase::cacheKey(SpectrumCacheKey & key, const HRTFDatabaseFile * database)
+{
+    int parameters[] = { info->minElevation, info->maxElevation, info->rawElevationAngleSpacing, info->interpolationFactor,
+                         static_cast<int>(HRTFElevation::InterpolationFactor) };
+    uint64_t hash = SpectrumCacheKey::hash(parameters, sizeof(parameters));
+    hash = SpectrumCacheKey::hash(info->subjectName.data(), info->subjectName.size(), hash);
+
+    if (database)
+    {
+        hash = SpectrumCacheKey::hash(database->data(), database->size(), hash);
+    }
+    else
+    {
+        for (int elevation = info->minElevation; elevation <= info->maxElevation; elevation += info->rawElevationAngleSpacing)
+        {
+            if (!HRTFElevation::hashResourcesForSubject(info.get(), elevation, hash))
+                return false;
+        }
+    }
+
+    key = SpectrumCacheKey { "hrtf", hash, info->sampleRate, HRTFPanner::fftSizeForSampleRate(info->sampleRate) };
+    return true;
+}
+
+bool HRTFDatabase::loadFromCache(const SpectrumCacheKey & key)
+{
+    std::unique_ptr<SpectrumCacheReader> cache = SpectrumCacheReader::open(key);
+    if (!cache)
+        return false;
+
+    for (size_t i = 0; i < m_elevations.size(); ++i)
+    {
+        int elevation = info->minElevation + static_cast<int>(i) * info->rawElevationAngleSpacing;
+        m_elevations[i] = HRTFElevation::createFromCache(info.get(), *cache, elevation);
+        if (!m_elevations[i])
+            break;
+    }
+
+    if (m_elevations.back() && cache->atEnd())
+        return true;
+
+    for (auto & elevation : m_elevations)
+        elevation.reset();
+    return false;
+}
+
+void HRTFDatabase::saveToCache(const SpectrumCacheKey & key)
+{
+    std::unique_ptr<SpectrumCacheWriter> cache = SpectrumCacheWriter::create(key);
+    if (!cache)
+        return;
+
+    for (const auto & elevation : m_elevations)
+    {
+        if (!elevation)
+            return;
+        elevation->writeToCache(*cache);
+    }
+    cache->commit();
+}
+
+size_t HRTFDatabase::memoryBytes() const
+{
+    if (!m_measuredKernelBytes)
+        return 0;
+
+    const size_t pairBytes = 2 * FFTFrame::memoryBytes(m_measuredKernels.front()->kernelL->fftSize());
+    return m_measuredKernelBytes + interpolatedKernelCount() * pairBytes;
+}
+
+bool HRTFDatabase::isMeasured(size_t slotIndex) const
+{
+    size_t elevationIndex = slotIndex / numberOfAzimuths();
+    unsigned azimuthIndex = slotIndex % numberOfAzimuths();
+    return !(elevationIndex % info->interpolationFactor) && HRTFElevation::isMeasuredAzimuth(azimuthIndex);
+}
+
+HRTFDatabase::KernelPair * HRTFDatabase::kernelsForSlot(size_t slotIndex)
+{
+    Slot & slot = m_slots[slotIndex];
+    slot.lastUsed.store(m_clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    // Loaded after the Reader has been counted, so an evicted pair seen here isn't freed until the Reader goes.
+    KernelPair * kernels = slot.kernels.load();
+    if (kernels)
+        return kernels;
+
+    request(slotIndex);
+
+    // Round to the nearest measured azimuth and elevation, whose slots are always filled.
+    const size_t elevationFactor = info->interpolationFactor;
+    const unsigned azimuthFactor = HRTFElevation::InterpolationFactor;
+    size_t elevationIndex = slotIndex / numberOfAzimuths();
+    unsigned azimuthIndex = slotIndex % numberOfAzimuths();
+    elevationIndex = std::min((elevationIndex + elevationFactor / 2) / elevationFactor, m_elevations.size() - 1) * elevationFactor;
+    azimuthIndex = (azimuthIndex + azimuthFactor / 2) / azimuthFactor * azimuthFactor;
+    return m_slots[this->slotIndex(elevationIndex, azimuthIndex)].kernels.load();
+}
+
+void HRTFDatabase::request(size_t slotIndex)
+{
+    Slot & slot = m_slots[slotIndex];
+    if (slot.requested.exchange(true))
+        return;
+
+    if (!m_requests.tryPush(static_cast<uint32_t>(slotIndex)))
+    {
+        slot.requested.store(false);
+        return;
+    }
+
+    wakeMaterializer();
+}
+
+void HRTFDatabase::wakeMaterializer()
+{
+    // The audio thread must not wait for the lock; a missed wake is covered by the materializer's polling.
+    if (m_lock.try_lock())
+    {
+        m_work.notify_one();
+        m_lock.unlock();
+    }
+}
+
+void HRTFDatabase::prefetch(unsigned azimuthIndex, double elevationAngle)
+{
+    if (!m_slots)
+        return;
+
+    size_t elevationIndex = std::min(static_cast<size_t>(info->indexFromElevationAngle(elevationAngle)), static_cast<size_t>(info->numTotalElevations - 1));
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        size_t slot = slotIndex(elevationIndex, azimuthIndex + i);
+        if (!m_slots[slot].kernels.load(std::memory_order_relaxed))
+            request(slot);
+    }
+}
+
+void HRTFDatabase::materializerEntry()
+{
+    DenormalDisabler denormalDisabler;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_shouldRun)
+    {
+        lock.unlock();
+
+        // Evicting as each slot is materialized keeps within the bound while requests keep coming.
+        uint32_t slot;
+        while (m_requests.tryPop(slot))
+        {
+            if (slot == AmbisonicDecoderFiltersRequest)
+                makeAmbisonicDecoderFilters();
+            else if (!m_slots[slot].kernels.load())
             {
-                j = i; // for last elevation interpolate with itself
+                materialize(slot);
+                evictLeastRecentlyUsed();
             }
+            freeRetiredKernels();
+        }
+        freeRetiredKernels();
+
+        lock.lock();
+        if (m_shouldRun && m_requests.empty())
+            m_work.wait_for(lock, PollInterval);
+    }
+}
 
-            // Create the interpolated convolution kernels and delays.
-            for (int jj = 1; jj < info->interpolationFactor; ++jj)
+void HRTFDatabase::materialize(size_t slotIndex)
+{
+    ASSERT(!isMeasured(slotIndex));
+
+    // Interpolate between the azimuths of the measured elevation below, and then towards the one above, as the
+    // last measured elevation is interpolated with itself.
+    const size_t elevationFactor = info->interpolationFactor;
+    size_t elevationIndex = slotIndex / numberOfAzimuths();
+    unsigned azimuthIndex = slotIndex % numberOfAzimuths();
+    size_t i = elevationIndex / elevationFactor;
+    size_t j = std::min(i + 1, m_elevations.size() - 1);
+    float x = static_cast<float>(elevationIndex % elevationFactor) / static_cast<float>(elevationFactor);
+
+    std::unique_ptr<KernelPair> kernels(new KernelPair());
+    m_elevations[i]->kernelsForAzimuth(azimuthIndex, kernels->kernelL, kernels->kernelR);
+    if (x > 0)
+    {
+        std::shared_ptr<HRTFKernel> kernelL2;
+        std::shared_ptr<HRTFKernel> kernelR2;
+        m_elevations[j]->kernelsForAzimuth(azimuthIndex, kernelL2, kernelR2);
+        kernels->kernelL = MakeInterpolatedKernel(kernels->kernelL.get(), kernelL2.get(), x);
+        kernels->kernelR = MakeInterpolatedKernel(kernels->kernelR.get(), kernelR2.get(), x);
+    }
+
+    Slot & slot = m_slots[slotIndex];
+    slot.lastUsed.store(m_clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    slot.kernels.store(kernels.release());
+    m_interpolatedSlots.push_back(slotIndex);
+    m_interpolatedKernelCount.store(m_interpolatedSlots.size(), std::memory_order_relaxed);
+}
+
+void HRTFDatabase::evictLeastRecentlyUsed()
+{
+    const uint32_t now = m_clock.load(std::memory_order_relaxed);
+    while (m_interpolatedSlots.size() > MaxInterpolatedKernels)
+    {
+        // The clock may wrap, so compare ages rather than times.
+        size_t oldest = 0;
+        uint32_t oldestAge = 0;
+        for (size_t i = 0; i < m_interpolatedSlots.size(); ++i)
+        {
+            uint32_t age = now - m_slots[m_interpolatedSlots[i]].lastUsed.load(std::memory_order_relaxed);
+            if (age >= oldestAge)
             {
-                float x = static_cast<float>(jj) / static_cast<float>(info->interpolationFactor);
-                m_elevations[i + jj] = HRTFElevation::createByInterpolatingSlices(info.get(), m_elevations[i].get(), m_elevations[j].get(), x);
-                ASSERT(m_elevations[i + jj].get());
+                oldest = i;
+                oldestAge = age;
             }
         }
+
+        // Once emptied, the slot can be requested again.
+        Slot & slot = m_slots[m_interpolatedSlots[oldest]];
+        m_retiredKernels.push_back(slot.kernels.exchange(nullptr));
+        slot.requested.store(false);
+
+        m_interpolatedSlots[oldest] = m_interpolatedSlots.back();
+        m_interpolatedSlots.pop_back();
     }
+    m_interpolatedKernelCount.store(m_interpolatedSlots.size(), std::memory_order_relaxed);
+}
+
+void HRTFDatabase::freeRetiredKernels()
+{
+    // The retired pairs were unpublished before this load; any Reader that could have seen one is still counted.
+    if (m_retiredKernels.empty() || m_readers.load())
+        return;
+
+    for (KernelPair * kernels : m_retiredKernels)
+        delete kernels;
+    m_retiredKernels.clear();
 }
 
 void HRTFDatabase::getKernelsFromAzimuthElevation(double azimuthBlend,
@@ -59,33 +360,85 @@ void HRTFDatabase::getKernelsFromAzimuthElevation(double azimuthBlend,
                                                   double & frameDelayL,
                                                   double & frameDelayR)
 {
-    
-    size_t elevationIndex = info->indexFromElevationAngle(elevationAngle);
-    
-    ASSERT(elevationIndex < m_elevations.size() && m_elevations.size() > 0);
-    
-    if (!m_elevations.size())
+    bool isIndexGood = azimuthIndex < numberOfAzimuths();
+    ASSERT(isIndexGood && m_slots);
+
+    if (!m_slots || !isIndexGood)
     {
         kernelL = 0;
         kernelR = 0;
         return;
     }
-    
-    if (elevationIndex > m_elevations.size() - 1)
+
+    bool checkAzimuthBlend = azimuthBlend >= 0.0 && azimuthBlend < 1.0;
+    ASSERT(checkAzimuthBlend);
+    if (!checkAzimuthBlend)
     {
-        elevationIndex = m_elevations.size() - 1;
+        azimuthBlend = 0.0;
     }
     
-    HRTFElevation * hrtfElevation = m_elevations[elevationIndex].get();
-    
-    ASSERT(hrtfElevation);
+    size_t elevationIndex = info->indexFromElevationAngle(elevationAngle);
     
-    if (!hrtfElevation)
+    if (elevationIndex > static_cast<size_t>(info->numTotalElevations - 1))
     {
-        throw std::runtime_error("Error getting hrtfElevation");
+        elevationIndex = info->numTotalElevations - 1;
     }
-    
-    hrtfElevation->getKernelsFromAzimuth(azimuthBlend, azimuthIndex, kernelL, kernelR, frameDelayL, frameDelayR);
-}                                                     
+
+    m_clock.fetch_add(1, std::memory_order_relaxed);
+    KernelPair * kernels = kernelsForSlot(slotIndex(elevationIndex, azimuthIndex));
+    KernelPair * kernels2 = kernelsForSlot(slotIndex(elevationIndex, azimuthIndex + 1));
+
+    // Return the left and right kernels.
+    kernelL = kernels->kernelL.get();
+    kernelR = kernels->kernelR.get();
+
+    // Linearly interpolate delays.
+    frameDelayL = (1.0 - azimuthBlend) * kernelL->frameDelay() + azimuthBlend * kernels2->kernelL->frameDelay();
+    frameDelayR = (1.0 - azimuthBlend) * kernelR->frameDelay() + azimuthBlend * kernels2->kernelR->frameDelay();
+}
+
+double HRTFDatabase::elevationIndexFromAngle(double elevationAngle) const
+{
+    elevationAngle = std::max(static_cast<double>(info->minElevation), std::min(static_cast<double>(info->maxElevation), elevationAngle));
+    return info->interpolationFactor * (elevationAngle - info->minElevation) / info->rawElevationAngleSpacing;
+}
+
+const AmbisonicDecoderFilters * HRTFDatabase::ambisonicDecoderFilters()
+{
+    const AmbisonicDecoderFilters * filters = m_ambisonicDecoderFilters.load();
+    if (filters || !m_slots || m_ambisonicDecoderFiltersRequested.exchange(true))
+        return filters;
+
+    if (!m_requests.tryPush(uint32_t(AmbisonicDecoderFiltersRequest)))
+    {
+        m_ambisonicDecoderFiltersRequested.store(false);
+        return nullptr;
+    }
+
+    wakeMaterializer();
+    return nullptr;
+}
+
+void HRTFDatabase::makeAmbisonicDecoderFilters()
+{
+    if (m_ambisonicDecoderFilters.load())
+        return;
+
+    // The measured slots are never emptied, so their kernels may be read without a Reader. The database's azimuths
+    // are reversed from the panner's.
+    std::vector<AmbisonicDecoderFilters::VirtualSpeaker> speakers;
+    for (int e = 0; e < info->numTotalElevations; e += info->interpolationFactor)
+    {
+        const double elevation = info->minElevation + e / info->interpolationFactor * info->rawElevationAngleSpacing;
+        for (unsigned a = 0; a < numberOfAzimuths(); a += HRTFElevation::InterpolationFactor)
+        {
+            const KernelPair * kernels = m_slots[slotIndex(e, a)].kernels.load();
+            const double azimuth = -360.0 * a / numberOfAzimuths();
+            speakers.push_back({ azimuth, elevation, kernels->kernelL.get(), kernels->kernelR.get() });
+        }
+    }
+
+    m_ambisonicDecoderFilters.store(new AmbisonicDecoderFilters(speakers, AmbisonicDecoderFFTSize));
+}
 
 } // namespace lab
@@ -0,0 +1,149 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/HRTFDatabaseFile.h"
+#include "internal/MappedFile.h"
+#include "internal/Assertions.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace lab
+{
+
+namespace
+{
+    // Raise this whenever the layout changes.
+    const uint32_t HRTFDatabaseFileVersion = 1;
+
+    // A file is this header followed by responseCount records, each a ResponseHeader followed by the
+    // responseLength samples of the left ear and the responseLength samples of the right ear.
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        float sampleRate;
+        uint32_t fftSize;
+        uint32_t responseLength;
+        uint32_t responseCount;
+    };
+}
+
+struct HRTFDatabaseFile::ResponseHeader
+{
+    int32_t azimuth;
+    int32_t elevation;
+    float frameDelayL;
+    float frameDelayR;
+};
+
+std::string HRTFDatabaseFile::pathForSubject(const std::string & searchPath, const std::string & subjectName, float sampleRate)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%d.hrtf", static_cast<int>(sampleRate));
+    return searchPath + "/IRC_" + subjectName + suffix;
+}
+
+std::unique_ptr<HRTFDatabaseFile> HRTFDatabaseFile::open(const std::string & path)
+{
+    std::unique_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file)
+        return nullptr;
+
+    const uint8_t * begin = file->data();
+    if (file->size() < sizeof(FileHeader))
+        return nullptr;
+
+    FileHeader header;
+    memcpy(&header, begin, sizeof(header));
+    if (memcmp(header.magic, "LSHR", 4) || header.version != HRTFDatabaseFileVersion || !header.responseLength)
+        return nullptr;
+
+    // Every record must be present; records are a multiple of four bytes, so the samples in the mapping are aligned.
+    const size_t recordSize = sizeof(ResponseHeader) + 2 * sizeof(float) * header.responseLength;
+    if (file->size() != sizeof(FileHeader) + recordSize * header.responseCount)
+    {
+        LOG_ERROR("HRTF database %s is truncated", path.c_str());
+        return nullptr;
+    }
+
+    std::unique_ptr<HRTFDatabaseFile> database(new HRTFDatabaseFile());
+    database->m_sampleRate = header.sampleRate;
+    database->m_fftSize = header.fftSize;
+    database->m_responseLength = header.responseLength;
+
+    const uint8_t * record = begin + sizeof(FileHeader);
+    for (uint32_t i = 0; i < header.responseCount; ++i, record += recordSize)
+    {
+        const ResponseHeader * response = reinterpret_cast<const ResponseHeader *>(record);
+        database->m_responses[std::make_pair(response->azimuth, response->elevation)] = response;
+    }
+
+    database->m_file = std::move(file);
+    return database;
+}
+
+bool HRTFDatabaseFile::write(const std::string & path, float sampleRate, size_t fftSize, size_t responseLength, const std::vector<Response> & responses)
+{
+    for (const Response & response : responses)
+    {
+        if (response.left.size() != responseLength || response.right.size() != responseLength)
+            return false;
+    }
+
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    FileHeader header;
+    memcpy(header.magic, "LSHR", 4);
+    header.version = HRTFDatabaseFileVersion;
+    header.sampleRate = sampleRate;
+    header.fftSize = static_cast<uint32_t>(fftSize);
+    header.responseLength = static_cast<uint32_t>(responseLength);
+    header.responseCount = static_cast<uint32_t>(responses.size());
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (const Response & response : responses)
+    {
+        ResponseHeader responseHeader = { response.azimuth, response.elevation, response.frameDelayL, response.frameDelayR };
+        written = written && fwrite(&responseHeader, sizeof(responseHeader), 1, file) == 1
+            && fwrite(response.left.data(), sizeof(float), responseLength, file) == responseLength
+            && fwrite(response.right.data(), sizeof(float), responseLength, file) == responseLength;
+    }
+
+    written = !fclose(file) && written;
+    if (!written)
+        remove(path.c_str());
+    return written;
+}
+
+HRTFDatabaseFile::~HRTFDatabaseFile()
+{
+}
+
+bool HRTFDatabaseFile::response(int azimuth, int elevation, const float * & left, const float * & right, float & frameDelayL, float & frameDelayR) const
+{
+    auto it = m_responses.find(std::make_pair(azimuth, elevation));
+    if (it == m_responses.end())
+        return false;
+
+    const ResponseHeader * response = it->second;
+    left = reinterpret_cast<const float *>(response + 1);
+    right = left + m_responseLength;
+    frameDelayL = response->frameDelayL;
+    frameDelayR = response->frameDelayR;
+    return true;
+}
+
+const uint8_t * HRTFDatabaseFile::data() const
+{
+    return m_file->data();
+}
+
+size_t HRTFDatabaseFile::size() const
+{
+    return m_file->size();
+}
+
+} // namespace lab
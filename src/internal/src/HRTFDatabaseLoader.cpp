@@ -5,96 +5,118 @@
 #include "internal/HRTFDatabaseLoader.h"
 #include "internal/HRTFDatabase.h"
 #include "internal/Assertions.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/Trace.h"
 
-#include <iostream>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <utility>
 
 namespace lab
 {
 
-// Singleton
-std::shared_ptr<HRTFDatabaseLoader> HRTFDatabaseLoader::s_loader;
+namespace
+{
+    // The loaders in use, by sample rate, search path and subject. Entries of released loaders are pruned as others are added.
+    typedef std::map<std::tuple<float, std::string, std::string>, std::weak_ptr<HRTFDatabaseLoader>> LoaderRegistry;
+
+    std::mutex s_registryLock;
+    LoaderRegistry s_registry;
+}
 
-std::shared_ptr<HRTFDatabaseLoader> HRTFDatabaseLoader::MakeHRTFLoaderSingleton(float sampleRate, const std::string & searchPath)
+std::shared_ptr<HRTFDatabaseLoader> HRTFDatabaseLoader::loaderFor(float sampleRate, const std::string & searchPath, const std::string & subjectName)
 {
-    if (!s_loader)
+    std::lock_guard<std::mutex> lock(s_registryLock);
+
+    std::weak_ptr<HRTFDatabaseLoader> & entry = s_registry[std::make_tuple(sampleRate, searchPath, subjectName)];
+    std::shared_ptr<HRTFDatabaseLoader> loader = entry.lock();
+    if (loader)
+        return loader;
+
+    for (auto it = s_registry.begin(); it != s_registry.end();)
     {
-        s_loader = std::make_shared<HRTFDatabaseLoader>(sampleRate, searchPath);
-        s_loader->loadAsynchronously();
+        if (it->second.expired() && &it->second != &entry)
+            it = s_registry.erase(it);
+        else
+            ++it;
     }
-    return s_loader;
+
+    loader.reset(new HRTFDatabaseLoader(sampleRate, searchPath, subjectName));
+    entry = loader;
+
+    std::thread(databaseLoaderEntry, loader).detach();
+    return loader;
 }
 
-HRTFDatabaseLoader::HRTFDatabaseLoader(float sampleRate, const std::string & searchPath)
-: m_loading(false)
+HRTFDatabaseLoader::HRTFDatabaseLoader(float sampleRate, const std::string & searchPath, const std::string & subjectName)
+: m_loaded(m_promise.get_future().share())
 , m_databaseSampleRate(sampleRate)
-, searchPath(searchPath)
+, m_searchPath(searchPath)
+, m_subjectName(subjectName)
 {
-    ASSERT(!s_loader.get());
 }
 
 HRTFDatabaseLoader::~HRTFDatabaseLoader()
 {
-    waitForLoaderThreadCompletion();
-    
-    if (m_databaseLoaderThread.joinable()) m_databaseLoaderThread.join();
-
-    m_hrtfDatabase.reset();
-    
-    ASSERT(this == s_loader.get());
-    
-    s_loader.reset();
+    // The loading thread holds the loader until it has finished, so there is nothing to wait for.
+    ASSERT(isLoaded());
 }
 
 // Asynchronously load the database in this thread.
-void HRTFDatabaseLoader::databaseLoaderEntry(HRTFDatabaseLoader * threadData)
+void HRTFDatabaseLoader::databaseLoaderEntry(std::shared_ptr<HRTFDatabaseLoader> loader)
 {
-    std::lock_guard<std::mutex> locker(threadData->m_threadLock);
-    HRTFDatabaseLoader * loader = reinterpret_cast<HRTFDatabaseLoader*>(threadData);
     ASSERT(loader);
+    LABSOUND_TRACE_THREAD("HRTF loader");
 
-    threadData->m_loading = true;
+    // The kernels are made by FFT here, see DenormalDisabler.
+    DenormalDisabler denormalDisabler;
     loader->load();
-    threadData->m_loadingCondition.notify_one();
 }
 
 void HRTFDatabaseLoader::load()
 {
-    m_hrtfDatabase.reset(new HRTFDatabase(m_databaseSampleRate, searchPath));
-    
-    if (!m_hrtfDatabase.get())
+    LABSOUND_TRACE_SCOPE("HRTF database load");
+
+    std::unique_ptr<HRTFDatabase> database(new HRTFDatabase(m_databaseSampleRate, m_searchPath, m_subjectName));
+    if (!database->isValid())
     {
-        LOG_ERROR("HRTF database not loaded");
+        LOG_ERROR("HRTF database of subject %s not loaded from %s", m_subjectName.c_str(), m_searchPath.c_str());
+        database.reset();
     }
-}
 
-void HRTFDatabaseLoader::loadAsynchronously()
-{
-    std::lock_guard<std::mutex> lock(m_threadLock);
-    
-    if (!m_hrtfDatabase.get() && !m_loading)
+    m_hrtfDatabase = std::move(database);
+    m_database.store(m_hrtfDatabase.get(), std::memory_order_release);
+
+    std::vector<std::function<void(HRTFDatabase *)>> callbacks;
     {
-        m_databaseLoaderThread = std::thread(databaseLoaderEntry, this);
+        std::lock_guard<std::mutex> lock(m_callbacksLock);
+        m_finished.store(true, std::memory_order_release);
+        callbacks.swap(m_callbacks);
     }
-}
 
-bool HRTFDatabaseLoader::isLoaded() const
-{
-    return (m_hrtfDatabase.get() != nullptr);
+    // The callbacks run first, so that once the future is ready, they have.
+    for (auto & callback : callbacks)
+        callback(m_hrtfDatabase.get());
+    m_promise.set_value(m_hrtfDatabase.get());
 }
 
-void HRTFDatabaseLoader::waitForLoaderThreadCompletion()
+void HRTFDatabaseLoader::whenLoaded(std::function<void(HRTFDatabase *)> callback)
 {
-    std::unique_lock<std::mutex> locker(m_threadLock);
-    while (!m_hrtfDatabase.get())
     {
-        m_loadingCondition.wait(locker);
+        std::lock_guard<std::mutex> lock(m_callbacksLock);
+        if (!isLoaded())
+        {
+            m_callbacks.push_back(std::move(callback));
+            return;
+        }
     }
+    callback(database());
 }
 
-HRTFDatabase * HRTFDatabaseLoader::defaultHRTFDatabase()
+void HRTFDatabaseLoader::waitForLoaderThreadCompletion()
 {
-    if (!s_loader) return nullptr;
-    return s_loader->database();
+    m_loaded.wait();
 }
 
 } // namespace lab
@@ -6,9 +6,11 @@
 #include "LabSound/extended/AudioFileReader.h"
 
 #include "internal/HRTFElevation.h"
+#include "internal/HRTFDatabaseFile.h"
 #include "internal/Biquad.h"
 #include "internal/FFTFrame.h"
 #include "internal/HRTFPanner.h"
+#include "internal/SpectrumCache.h"
 #include "internal/Assertions.h"
 
 #include <algorithm>
@@ -59,12 +61,13 @@ const uint32_t HRTFElevation::NumberOfTotalAzimuths = NumberOfRawAzimuths * Inte
 
 // Takes advantage of the symmetry and creates a composite version of the two measured versions.  For example, we have both azimuth 30 and -30 degrees
 // where the roles of left and right ears are reversed with respect to each other.
-bool HRTFElevation::calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR)
+bool HRTFElevation::calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR,
+                                                                 const HRTFDatabaseFile * database)
 {
     std::shared_ptr<HRTFKernel> kernelL1;
     std::shared_ptr<HRTFKernel> kernelR1;
 
-    bool success = calculateKernelsForAzimuthElevation(info, azimuth, elevation, kernelL1, kernelR1);
+    bool success = calculateKernelsForAzimuthElevation(info, azimuth, elevation, kernelL1, kernelR1, database);
 
     if (!success)
         return false;
@@ -75,7 +78,7 @@ bool HRTFElevation::calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInf
     std::shared_ptr<HRTFKernel> kernelL2;
     std::shared_ptr<HRTFKernel> kernelR2;
 
-    success = calculateKernelsForAzimuthElevation(info, symmetricAzimuth, elevation, kernelL2, kernelR2);
+    success = calculateKernelsForAzimuthElevation(info, symmetricAzimuth, elevation, kernelL2, kernelR2, database);
 
     if (!success) return false;
 
@@ -86,7 +89,23 @@ bool HRTFElevation::calculateSymmetricKernelsForAzimuthElevation(HRTFDatabaseInf
     return true;
 }
 
-bool HRTFElevation::calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel>& kernelL, std::shared_ptr<HRTFKernel>& kernelR)
+std::string HRTFElevation::resourceName(HRTFDatabaseInfo * info, int azimuth, int elevation)
+{
+    // Construct the resource name from the subject name, azimuth, and elevation, for example:
+    // "IRC_Composite_C_R0195_T015_P000"
+    int positiveElevation = elevation < 0 ? elevation + 360 : elevation;
+
+    char tempStr[16];
+
+    // Located in $searchPath / [format] .wav
+    // @tofix - this assumes we want to open this path and read via libnyquist fopen.
+    // ... will need to change for Android. Maybe MakeBusFromInternalResource / along with a LoadInternalResources requried by LabSound
+    sprintf(tempStr, "%03d_P%03d", azimuth, positiveElevation);
+    return info->searchPath + "/" + "IRC_" + info->subjectName + "_C_R0195_T" + tempStr + ".wav";
+}
+
+bool HRTFElevation::calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info, int azimuth, int elevation, std::shared_ptr<HRTFKernel>& kernelL, std::shared_ptr<HRTFKernel>& kernelR,
+                                                        const HRTFDatabaseFile * database)
 {
     // Valid values for azimuth are 0 -> 345 in 15 degree increments.
     // Valid values for elevation are -45 -> +90 in 15 degree increments.
@@ -99,17 +118,27 @@ bool HRTFElevation::calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info,
     ASSERT(isElevationGood);
     if (!isElevationGood) return false;
 
-    // Construct the resource name from the subject name, azimuth, and elevation, for example:
-    // "IRC_Composite_C_R0195_T015_P000"
-    int positiveElevation = elevation < 0 ? elevation + 360 : elevation;
+    const size_t fftSize = HRTFPanner::fftSizeForSampleRate(info->sampleRate);
 
-    char tempStr[16];
+    // The packed responses are already at the sample rate, with their leading delays extracted.
+    if (database)
+    {
+        const float * responseL;
+        const float * responseR;
+        float frameDelayL;
+        float frameDelayR;
+        if (!database->response(azimuth, elevation, responseL, responseR, frameDelayL, frameDelayR))
+        {
+            LOG_ERROR("The HRTF database has no responses for azimuth %d elevation %d", azimuth, elevation);
+            return false;
+        }
 
-    // Located in $searchPath / [format] .wav
-    // @tofix - this assumes we want to open this path and read via libnyquist fopen.
-    // ... will need to change for Android. Maybe MakeBusFromInternalResource / along with a LoadInternalResources requried by LabSound
-    sprintf(tempStr, "%03d_P%03d", azimuth, positiveElevation);
-    std::string resourceName = info->searchPath + "/" + "IRC_" + info->subjectName + "_C_R0195_T" + tempStr + ".wav";
+        kernelL = ShareKernel(std::make_shared<HRTFKernel>(responseL, database->responseLength(), frameDelayL, fftSize, info->sampleRate));
+        kernelR = ShareKernel(std::make_shared<HRTFKernel>(responseR, database->responseLength(), frameDelayR, fftSize, info->sampleRate));
+        return true;
+    }
+
+    std::string resourceName = HRTFElevation::resourceName(info, azimuth, elevation);
 
     auto impulseResponse = lab::MakeBusFromFile(resourceName.c_str(), false);
 
@@ -135,14 +164,13 @@ bool HRTFElevation::calculateKernelsForAzimuthElevation(HRTFDatabaseInfo * info,
     AudioChannel * rightEarImpulseResponse = impulseResponse->channelByType(Channel::Right);
 
     // Note that depending on the fftSize returned by the panner, we may be truncating the impulse response we just loaded in.
-    const size_t fftSize = HRTFPanner::fftSizeForSampleRate(info->sampleRate);
-    kernelL = std::make_shared<HRTFKernel>(leftEarImpulseResponse, fftSize, info->sampleRate);
-    kernelR = std::make_shared<HRTFKernel>(rightEarImpulseResponse, fftSize, info->sampleRate);
+    kernelL = ShareKernel(std::make_shared<HRTFKernel>(leftEarImpulseResponse, fftSize, info->sampleRate));
+    kernelR = ShareKernel(std::make_shared<HRTFKernel>(rightEarImpulseResponse, fftSize, info->sampleRate));
 
     return true;
 }
 
-std::unique_ptr<HRTFElevation> HRTFElevation::createForSubject(HRTFDatabaseInfo * info, int elevation)
+std::unique_ptr<HRTFElevation> HRTFElevation::createForSubject(HRTFDatabaseInfo * info, int elevation, const HRTFDatabaseFile * database)
 {
     bool isElevationGood = elevation >= -45 && elevation <= 90 && (elevation / 15) * 15 == elevation;
     ASSERT(isElevationGood);
@@ -150,105 +178,86 @@ std::unique_ptr<HRTFElevation> HRTFElevation::createForSubject(HRTFDatabaseInfo
     if (!isElevationGood)
         return nullptr;
 
-    std::unique_ptr<HRTFKernelList> kernelListL = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfTotalAzimuths));
-    std::unique_ptr<HRTFKernelList> kernelListR = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfTotalAzimuths));
+    std::unique_ptr<HRTFKernelList> kernelListL = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfRawAzimuths));
+    std::unique_ptr<HRTFKernelList> kernelListR = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfRawAzimuths));
 
     // Load convolution kernels from HRTF files.
-    int interpolatedIndex = 0;
     for (uint32_t rawIndex = 0; rawIndex < NumberOfRawAzimuths; ++rawIndex)
     {
-        // Don't let elevation exceed maximum for this azimuth.
+        // Don't let elevation exceed maximum for this azimuth, unless a packed database, such as one made from a
+        // SOFA file, has a response for it.
         int maxElevation = maxElevations[rawIndex];
-        int actualElevation = min(elevation, maxElevation);
+        int actualElevation = database && database->hasResponse(rawIndex * AzimuthSpacing, elevation) ? elevation : min(elevation, maxElevation);
 
-        bool success = calculateKernelsForAzimuthElevation(info, rawIndex * AzimuthSpacing, actualElevation, kernelListL->at(interpolatedIndex), kernelListR->at(interpolatedIndex));
+        bool success = calculateKernelsForAzimuthElevation(info, rawIndex * AzimuthSpacing, actualElevation, kernelListL->at(rawIndex), kernelListR->at(rawIndex), database);
         if (!success)
             return nullptr;
-
-        interpolatedIndex += InterpolationFactor;
-    }
-
-    // Now go back and interpolate intermediate azimuth values.
-    for (uint32_t i = 0; i < NumberOfTotalAzimuths; i += InterpolationFactor)
-    {
-        int j = (i + InterpolationFactor) % NumberOfTotalAzimuths;
-
-        // Create the interpolated convolution kernels and delays.
-        for (uint32_t jj = 1; jj < InterpolationFactor; ++jj)
-        {
-            float x = float(jj) / float(InterpolationFactor); // interpolate from 0 -> 1
-
-            (*kernelListL)[i + jj] = MakeInterpolatedKernel(kernelListL->at(i).get(), kernelListL->at(j).get(), x);
-            (*kernelListR)[i + jj] = MakeInterpolatedKernel(kernelListR->at(i).get(), kernelListR->at(j).get(), x);
-        }
     }
 
     return std::unique_ptr<HRTFElevation>(new HRTFElevation(info, std::move(kernelListL), std::move(kernelListR), elevation));
 }
 
-std::unique_ptr<HRTFElevation> HRTFElevation::createByInterpolatingSlices(HRTFDatabaseInfo * info, HRTFElevation * hrtfElevation1, HRTFElevation* hrtfElevation2, float x)
+void HRTFElevation::kernelsForAzimuth(unsigned azimuthIndex, std::shared_ptr<HRTFKernel> & kernelL, std::shared_ptr<HRTFKernel> & kernelR) const
 {
-    ASSERT(hrtfElevation1 && hrtfElevation2);
-    if (!hrtfElevation1 || !hrtfElevation2)
-        return nullptr;
-
-    ASSERT(x >= 0.0 && x < 1.0);
-
-    std::unique_ptr<HRTFKernelList> kernelListL = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfTotalAzimuths));
-    std::unique_ptr<HRTFKernelList> kernelListR = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfTotalAzimuths));
+    ASSERT(azimuthIndex < NumberOfTotalAzimuths);
+    azimuthIndex %= NumberOfTotalAzimuths;
 
-    HRTFKernelList * kernelListL1 = hrtfElevation1->kernelListL();
-    HRTFKernelList * kernelListR1 = hrtfElevation1->kernelListR();
-    HRTFKernelList * kernelListL2 = hrtfElevation2->kernelListL();
-    HRTFKernelList * kernelListR2 = hrtfElevation2->kernelListR();
-
-    // Interpolate kernels of corresponding azimuths of the two elevations.
-    for (uint32_t i = 0; i < NumberOfTotalAzimuths; ++i)
+    uint32_t i = azimuthIndex / InterpolationFactor;
+    if (isMeasuredAzimuth(azimuthIndex))
     {
-        (*kernelListL)[i] = MakeInterpolatedKernel(kernelListL1->at(i).get(), kernelListL2->at(i).get(), x);
-        (*kernelListR)[i] = MakeInterpolatedKernel(kernelListR1->at(i).get(), kernelListR2->at(i).get(), x);
+        kernelL = m_kernelListL->at(i);
+        kernelR = m_kernelListR->at(i);
+        return;
     }
 
-    // Interpolate elevation angle.
-    double angle = (1.0 - x) * hrtfElevation1->elevationAngle() + x * hrtfElevation2->elevationAngle();
+    // Interpolate from the measured azimuth below to the one above, wrapping around at 360 degrees.
+    uint32_t j = (i + 1) % NumberOfRawAzimuths;
+    float x = float(azimuthIndex % InterpolationFactor) / float(InterpolationFactor); // interpolate from 0 -> 1
 
-    return std::unique_ptr<HRTFElevation>(new HRTFElevation(info, std::move(kernelListL), std::move(kernelListR), (int) angle));
+    kernelL = MakeInterpolatedKernel(m_kernelListL->at(i).get(), m_kernelListL->at(j).get(), x);
+    kernelR = MakeInterpolatedKernel(m_kernelListR->at(i).get(), m_kernelListR->at(j).get(), x);
 }
 
-void HRTFElevation::getKernelsFromAzimuth(double azimuthBlend, unsigned azimuthIndex, HRTFKernel* &kernelL, HRTFKernel* &kernelR, double& frameDelayL, double& frameDelayR)
+bool HRTFElevation::hashResourcesForSubject(HRTFDatabaseInfo * info, int elevation, uint64_t & hash)
 {
-    bool checkAzimuthBlend = azimuthBlend >= 0.0 && azimuthBlend < 1.0;
-    ASSERT(checkAzimuthBlend);
-    if (!checkAzimuthBlend)
+    for (uint32_t rawIndex = 0; rawIndex < NumberOfRawAzimuths; ++rawIndex)
     {
-        azimuthBlend = 0.0;
+        int actualElevation = min(elevation, maxElevations[rawIndex]);
+        if (!SpectrumCacheKey::hashFile(resourceName(info, rawIndex * AzimuthSpacing, actualElevation), hash))
+            return false;
     }
+    return true;
+}
 
-    size_t numKernels = m_kernelListL->size();
+std::unique_ptr<HRTFElevation> HRTFElevation::createFromCache(HRTFDatabaseInfo * info, SpectrumCacheReader & cache, int elevation)
+{
+    std::unique_ptr<HRTFKernelList> kernelListL = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfRawAzimuths));
+    std::unique_ptr<HRTFKernelList> kernelListR = std::unique_ptr<HRTFKernelList>(new HRTFKernelList(NumberOfRawAzimuths));
 
-    bool isIndexGood = azimuthIndex < numKernels;
-    ASSERT(isIndexGood);
-    if (!isIndexGood)
+    const size_t fftSize = HRTFPanner::fftSizeForSampleRate(info->sampleRate);
+    for (uint32_t i = 0; i < NumberOfRawAzimuths; ++i)
     {
-        kernelL = 0;
-        kernelR = 0;
-        return;
-    }
-
-    // Return the left and right kernels.
-    kernelL = m_kernelListL->at(azimuthIndex).get();
-    kernelR = m_kernelListR->at(azimuthIndex).get();
+        std::unique_ptr<FFTFrame> frameL(new FFTFrame(fftSize));
+        std::unique_ptr<FFTFrame> frameR(new FFTFrame(fftSize));
+        float frameDelayL;
+        float frameDelayR;
+        if (!cache.read(*frameL, &frameDelayL) || !cache.read(*frameR, &frameDelayR))
+            return nullptr;
 
-    frameDelayL = m_kernelListL->at(azimuthIndex)->frameDelay();
-    frameDelayR = m_kernelListR->at(azimuthIndex)->frameDelay();
+        (*kernelListL)[i] = ShareKernel(std::make_shared<HRTFKernel>(std::move(frameL), frameDelayL, info->sampleRate));
+        (*kernelListR)[i] = ShareKernel(std::make_shared<HRTFKernel>(std::move(frameR), frameDelayR, info->sampleRate));
+    }
 
-    int azimuthIndex2 = (azimuthIndex + 1) % numKernels;
-    double frameDelay2L = m_kernelListL->at(azimuthIndex2)->frameDelay();
-    double frameDelay2R = m_kernelListR->at(azimuthIndex2)->frameDelay();
+    return std::unique_ptr<HRTFElevation>(new HRTFElevation(info, std::move(kernelListL), std::move(kernelListR), elevation));
+}
 
-    // Linearly interpolate delays.
-    frameDelayL = (1.0 - azimuthBlend) * frameDelayL + azimuthBlend * frameDelay2L;
-    frameDelayR = (1.0 - azimuthBlend) * frameDelayR + azimuthBlend * frameDelay2R;
+void HRTFElevation::writeToCache(SpectrumCacheWriter & cache) const
+{
+    for (uint32_t i = 0; i < NumberOfRawAzimuths; ++i)
+    {
+        cache.write(*m_kernelListL->at(i)->fftFrame(), m_kernelListL->at(i)->frameDelay());
+        cache.write(*m_kernelListR->at(i)->fftFrame(), m_kernelListR->at(i)->frameDelay());
+    }
 }
 
 } // namespace lab
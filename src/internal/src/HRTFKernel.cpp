@@ -6,12 +6,17 @@
 #include "internal/Biquad.h"
 #include "internal/FFTFrame.h"
 #include "internal/Assertions.h"
+#include "internal/SpectrumCache.h"
 
 #include "LabSound/core/AudioChannel.h"
 
 #include "LabSound/core/Macros.h"
 
 #include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 using namespace std;
 
@@ -22,7 +27,7 @@ namespace lab
 // This represents the initial delay before the most energetic part of the impulse response.
 // The sample-frame delay is removed from the impulseP impulse response, and this value  is returned.
 // the length of the passed in AudioChannel must be a power of 2.
-inline float ExtractAverageGroupDelay(AudioChannel * channel, size_t analysisFFTSize)
+float HRTFKernel::extractAverageGroupDelay(AudioChannel * channel, size_t analysisFFTSize)
 {
     ASSERT(channel);
         
@@ -51,16 +56,31 @@ HRTFKernel::HRTFKernel(AudioChannel * channel, size_t fftSize, float sampleRate)
     ASSERT(channel);
 
     // Determine the leading delay (average group delay) for the response.
-    m_frameDelay = ExtractAverageGroupDelay(channel, fftSize / 2);
+    m_frameDelay = extractAverageGroupDelay(channel, fftSize / 2);
 
-    float* impulseResponse = channel->mutableData();
-    size_t responseLength = channel->length();
+    initializeFrame(channel->mutableData(), channel->length(), fftSize);
+}
+
+HRTFKernel::HRTFKernel(const float * response, size_t responseLength, float frameDelay, size_t fftSize, float sampleRate)
+: m_frameDelay(frameDelay) , m_sampleRate(sampleRate)
+{
+    ASSERT(response);
+
+    // The fade out is applied to a copy, as the response may be read only.
+    size_t truncatedResponseLength = std::min(responseLength, fftSize / 2);
+    AudioFloatArray impulseResponse(truncatedResponseLength);
+    memcpy(impulseResponse.data(), response, sizeof(float) * truncatedResponseLength);
 
+    initializeFrame(impulseResponse.data(), truncatedResponseLength, fftSize);
+}
+
+void HRTFKernel::initializeFrame(float * impulseResponse, size_t responseLength, size_t fftSize)
+{
     // We need to truncate to fit into 1/2 the FFT size (with zero padding) in order to do proper convolution.
     size_t truncatedResponseLength = std::min(responseLength, fftSize / 2); // truncate if necessary to max impulse response length allowed by FFT
 
     // Quick fade-out (apply window) at truncation point
-    unsigned numberOfFadeOutFrames = static_cast<unsigned>(sampleRate / 4410); // 10 sample-frames @44.1KHz sample-rate
+    unsigned numberOfFadeOutFrames = static_cast<unsigned>(m_sampleRate / 4410); // 10 sample-frames @44.1KHz sample-rate
     ASSERT(numberOfFadeOutFrames < truncatedResponseLength);
 
     if (numberOfFadeOutFrames < truncatedResponseLength) 
@@ -111,4 +131,56 @@ std::unique_ptr<HRTFKernel> MakeInterpolatedKernel(HRTFKernel* kernel1, HRTFKern
     return std::unique_ptr<HRTFKernel>(new HRTFKernel(std::move(interpolatedFrame), frameDelay, sampleRate1));
 }
 
+namespace
+{
+    // The kernels alive in the process, by their spectrum's hash, FFT size and sample rate. Kernels with the same
+    // key are compared in full, so a hash collision only costs sharing. Released entries are pruned as others are added.
+    typedef std::tuple<uint64_t, size_t, float> SharedKernelKey;
+
+    std::mutex s_sharedKernelsLock;
+    std::multimap<SharedKernelKey, std::weak_ptr<HRTFKernel>> s_sharedKernels;
+
+    bool sameKernel(HRTFKernel & a, HRTFKernel & b)
+    {
+        const size_t bins = a.fftSize() / 2;
+        return a.frameDelay() == b.frameDelay()
+            && !memcmp(a.fftFrame()->realData(), b.fftFrame()->realData(), sizeof(float) * bins)
+            && !memcmp(a.fftFrame()->imagData(), b.fftFrame()->imagData(), sizeof(float) * bins);
+    }
+}
+
+std::shared_ptr<HRTFKernel> ShareKernel(std::shared_ptr<HRTFKernel> kernel)
+{
+    if (!kernel)
+        return kernel;
+
+    const size_t bins = kernel->fftSize() / 2;
+    uint64_t hash = SpectrumCacheKey::hash(kernel->fftFrame()->realData(), sizeof(float) * bins);
+    hash = SpectrumCacheKey::hash(kernel->fftFrame()->imagData(), sizeof(float) * bins, hash);
+    const float frameDelay = kernel->frameDelay();
+    hash = SpectrumCacheKey::hash(&frameDelay, sizeof(frameDelay), hash);
+    const SharedKernelKey key(hash, kernel->fftSize(), kernel->sampleRate());
+
+    std::lock_guard<std::mutex> lock(s_sharedKernelsLock);
+
+    auto range = s_sharedKernels.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        std::shared_ptr<HRTFKernel> shared = it->second.lock();
+        if (shared && sameKernel(*shared, *kernel))
+            return shared;
+    }
+
+    for (auto it = s_sharedKernels.begin(); it != s_sharedKernels.end();)
+    {
+        if (it->second.expired())
+            it = s_sharedKernels.erase(it);
+        else
+            ++it;
+    }
+
+    s_sharedKernels.emplace(key, kernel);
+    return kernel;
+}
+
 } // namespace lab
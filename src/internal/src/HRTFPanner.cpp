@@ -24,7 +24,12 @@ const double MaxDelayTimeSeconds = 0.002;
 const int UninitializedAzimuth = -1;
 const uint32_t RenderingQuantum = 128;
 
-HRTFPanner::HRTFPanner(const float sampleRate) : Panner(sampleRate, PanningMode::HRTF)
+// How far, in azimuths and elevations of the database, a source may stray from the kernels in use before others are
+// chosen, so that a source jittering at the boundary of two kernels doesn't keep switching between them.
+const double AzimuthHysteresis = 0.25;
+const double ElevationHysteresis = 0.25;
+
+HRTFPanner::HRTFPanner(const float sampleRate, std::shared_ptr<HRTFDatabaseLoader> loader) : Panner(sampleRate, PanningMode::HRTF)
     , m_crossfadeSelection(CrossfadeSelection1)
     , m_azimuthIndex1(UninitializedAzimuth)
     , m_elevation1(0)
@@ -42,6 +47,9 @@ HRTFPanner::HRTFPanner(const float sampleRate) : Panner(sampleRate, PanningMode:
     , m_tempR1(RenderingQuantum)
     , m_tempL2(RenderingQuantum)
     , m_tempR2(RenderingQuantum)
+    , m_segmentInput(new AudioBus(Channels::Stereo, RenderingQuantum))
+    , m_segmentOutput(new AudioBus(Channels::Stereo, RenderingQuantum))
+    , m_databaseLoader(std::move(loader))
 {
 }
 
@@ -66,6 +74,9 @@ void HRTFPanner::reset()
     m_convolverR2.reset();
     m_delayLineL.reset();
     m_delayLineR.reset();
+    m_segmentInput->zero();
+    m_segmentOutput->zero();
+    m_segmentPosition = 0;
 }
 
 int HRTFPanner::calculateDesiredAzimuthIndexAndBlend(double azimuth, double& azimuthBlend)
@@ -75,10 +86,7 @@ int HRTFPanner::calculateDesiredAzimuthIndexAndBlend(double azimuth, double& azi
     if (azimuth < 0)
         azimuth += 360.0;
 
-    HRTFDatabase * database = HRTFDatabaseLoader::defaultHRTFDatabase();
-    ASSERT(database);
-
-    int numberOfAzimuths = database->numberOfAzimuths();
+    int numberOfAzimuths = HRTFDatabase::numberOfAzimuths();
     const double angleBetweenAzimuths = 360.0 / numberOfAzimuths;
 
     // Calculate the azimuth index and the blend (0 -> 1) for interpolation.
@@ -93,7 +101,65 @@ int HRTFPanner::calculateDesiredAzimuthIndexAndBlend(double azimuth, double& azi
     return desiredAzimuthIndex;
 }
 
+void HRTFPanner::prefetch(double desiredAzimuth, double elevation)
+{
+    HRTFDatabase * database = m_databaseLoader ? m_databaseLoader->database() : nullptr;
+    if (!database)
+        return;
+
+    // As in pan(), the database's azimuths are reversed.
+    double azimuth = -desiredAzimuth;
+    if (azimuth < -180.0 || azimuth > 180.0)
+        return;
+
+    double azimuthBlend;
+    database->prefetch(calculateDesiredAzimuthIndexAndBlend(azimuth, azimuthBlend), elevation);
+}
+
 void HRTFPanner::pan(ContextRenderLock & r, double desiredAzimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess)
+{
+    if (framesToProcess >= RenderingQuantum)
+    {
+        panSegments(r, desiredAzimuth, elevation, inputBus, outputBus, framesToProcess);
+        return;
+    }
+
+    size_t numInputChannels = inputBus ? inputBus->numberOfChannels() : 0;
+
+    bool isInputGood = inputBus && numInputChannels >= Channels::Mono && numInputChannels <= Channels::Stereo && framesToProcess <= inputBus->length();
+    ASSERT(isInputGood);
+
+    bool isOutputGood = outputBus && outputBus->numberOfChannels() == Channels::Stereo && framesToProcess <= outputBus->length();
+    ASSERT(isOutputGood);
+
+    // A smaller quantum divides RenderingQuantum, as both are powers of two.
+    if (!isInputGood || !isOutputGood || RenderingQuantum % framesToProcess)
+    {
+        if (outputBus)
+            outputBus->zero();
+        return;
+    }
+
+    // Smaller quanta are gathered into a segment, which is panned once it is full. Each quantum is answered from
+    // the segment panned last, so the output is a segment later. A mono source goes to both of the segment's
+    // channels, which pans it as panSegments() pans a mono input.
+    for (unsigned c = 0; c < Channels::Stereo; ++c)
+    {
+        const AudioChannel * source = inputBus->channel(std::min<size_t>(c, numInputChannels - 1));
+        std::copy(source->data(), source->data() + framesToProcess, m_segmentInput->channel(c)->mutableData() + m_segmentPosition);
+        const float * panned = m_segmentOutput->channel(c)->data() + m_segmentPosition;
+        std::copy(panned, panned + framesToProcess, outputBus->channel(c)->mutableData());
+    }
+
+    m_segmentPosition += framesToProcess;
+    if (m_segmentPosition == RenderingQuantum)
+    {
+        m_segmentPosition = 0;
+        panSegments(r, desiredAzimuth, elevation, m_segmentInput.get(), m_segmentOutput.get(), RenderingQuantum);
+    }
+}
+
+void HRTFPanner::panSegments(ContextRenderLock & r, double desiredAzimuth, double elevation, const AudioBus * inputBus, AudioBus * outputBus, size_t framesToProcess)
 {
     size_t numInputChannels = inputBus ? inputBus->numberOfChannels() : 0;
 
@@ -103,16 +169,17 @@ void HRTFPanner::pan(ContextRenderLock & r, double desiredAzimuth, double elevat
     bool isOutputGood = outputBus && outputBus->numberOfChannels() == Channels::Stereo && framesToProcess <= outputBus->length();
     ASSERT(isOutputGood);
 
-    if (!isInputGood || !isOutputGood)
+    // Render quanta smaller than RenderingQuantum are gathered by pan(); see below.
+    bool isQuantumGood = framesToProcess >= RenderingQuantum;
+
+    if (!isInputGood || !isOutputGood || !isQuantumGood)
     {
         if (outputBus)
             outputBus->zero();
         return;
     }
 
-    // This code only runs as long as the context is alive and after database has been loaded.
-    HRTFDatabase* database = HRTFDatabaseLoader::defaultHRTFDatabase();
-    ASSERT(database);
+    HRTFDatabase * database = m_databaseLoader ? m_databaseLoader->database() : nullptr;
 
     if (!database) 
     {
@@ -120,6 +187,9 @@ void HRTFPanner::pan(ContextRenderLock & r, double desiredAzimuth, double elevat
         return;
     }
 
+    // Keeps the kernels in use until the end of the quantum.
+    HRTFDatabase::Reader reader(*database);
+
     // IRCAM HRTF azimuths values from the loaded database is reversed from the panner's notion of azimuth.
     double azimuth = -desiredAzimuth;
 
@@ -159,6 +229,38 @@ void HRTFPanner::pan(ContextRenderLock & r, double desiredAzimuth, double elevat
         m_elevation2 = elevation;
     }
 
+    // While no transition is running, stay with the kernels in use if the source is within the hysteresis of them.
+    if (!m_crossfadeIncr)
+    {
+        int & azimuthIndex = m_crossfadeSelection == CrossfadeSelection1 ? m_azimuthIndex1 : m_azimuthIndex2;
+        double & azimuthElevation = m_crossfadeSelection == CrossfadeSelection1 ? m_elevation1 : m_elevation2;
+
+        const int numberOfAzimuths = HRTFDatabase::numberOfAzimuths();
+        double azimuthOffset = desiredAzimuthIndex + azimuthBlend - azimuthIndex;
+        if (azimuthOffset < -numberOfAzimuths / 2)
+            azimuthOffset += numberOfAzimuths;
+        else if (azimuthOffset >= numberOfAzimuths / 2)
+            azimuthOffset -= numberOfAzimuths;
+
+        if (azimuthOffset >= -AzimuthHysteresis && azimuthOffset < 1 + AzimuthHysteresis)
+        {
+            desiredAzimuthIndex = azimuthIndex;
+            azimuthBlend = min(max(azimuthOffset, 0.0), 1.0 - 1e-9);
+        }
+
+        // Within one elevation index the kernels are the same.
+        double elevationOffset = database->elevationIndexFromAngle(elevation) - floor(database->elevationIndexFromAngle(azimuthElevation));
+        if (elevationOffset >= -ElevationHysteresis && elevationOffset < 1 + ElevationHysteresis)
+            elevation = azimuthElevation;
+
+        // The kernels of neighbouring azimuths differ little, so moving to one replaces the kernels in place rather
+        // than cross-fading, which would convolve twice. The convolvers overlap-add, so each block's tail is still
+        // that of the kernel it was convolved with.
+        int azimuthStep = (desiredAzimuthIndex - azimuthIndex + numberOfAzimuths) % numberOfAzimuths;
+        if (elevation == azimuthElevation && (azimuthStep == 1 || azimuthStep == numberOfAzimuths - 1))
+            azimuthIndex = desiredAzimuthIndex;
+    }
+
     // Cross-fade / transition over a period of around 45 milliseconds.
     // This is an empirical value tuned to be a reasonable trade-off between
     // smoothness and speed.
@@ -307,7 +409,9 @@ double HRTFPanner::tailTime(ContextRenderLock & r) const
 double HRTFPanner::latencyTime(ContextRenderLock & r) const
 {
     // The latency of a FFTConvolver is also fftSize() / 2, and is in addition to its tailTime of the same value.
-    return (fftSize() / 2) / static_cast<double>(r.context()->sampleRate());
+    // Quanta smaller than a segment are gathered into one, which adds a segment.
+    const size_t gathering = r.context()->renderQuantumSize() < RenderingQuantum ? RenderingQuantum : 0;
+    return (fftSize() / 2 + gathering) / static_cast<double>(r.context()->sampleRate());
 }
 
 } // namespace lab
@@ -0,0 +1,187 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/HalfBandResampler.h"
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
+namespace lab
+{
+
+namespace
+{
+    const double KaiserBeta = 7;
+
+    double besselI0(double x)
+    {
+        double sum = 1;
+        double term = 1;
+        for (int k = 1; k < 32; ++k)
+        {
+            const double t = x / (2 * k);
+            term *= t * t;
+            sum += term;
+        }
+        return sum;
+    }
+
+    // The odd taps of the half-band filter out from the center, scaled to sum to a quarter of gain so that the
+    // filter passes gain at DC. The center tap is half.
+    std::vector<float> halfBandCoefficients(size_t sideTaps, double gain)
+    {
+        const double piDouble = 3.14159265358979323846;
+        const double halfWidth = static_cast<double>(2 * sideTaps - 1);
+
+        std::vector<double> taps(sideTaps);
+        double sum = 0;
+        for (size_t j = 0; j < sideTaps; ++j)
+        {
+            const double k = static_cast<double>(2 * j + 1);
+            const double ratio = k / halfWidth;
+            const double window = besselI0(KaiserBeta * std::sqrt(std::max(0.0, 1 - ratio * ratio))) / besselI0(KaiserBeta);
+            taps[j] = std::sin(0.5 * piDouble * k) / (piDouble * k) * window;
+            sum += taps[j];
+        }
+
+        std::vector<float> coefficients(sideTaps);
+        for (size_t j = 0; j < sideTaps; ++j)
+            coefficients[j] = static_cast<float>(taps[j] * 0.25 * gain / sum);
+        return coefficients;
+    }
+
+    // The filtered branch: destination[n] = sum over j of coefficients[j] * (p[n + j] + p[n - j - 1]). p is preceded
+    // by sideTaps frames of history and followed by sideTaps - 1 frames beyond the last frame.
+    void halfBandSum(const float * p, const float * coefficients, size_t sideTaps, float * destination, size_t framesToProcess)
+    {
+        size_t n = 0;
+
+#if defined(__SSE2__)
+        for (; n + 4 <= framesToProcess; n += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (size_t j = 0; j < sideTaps; ++j)
+            {
+                __m128 pair = _mm_add_ps(_mm_loadu_ps(p + n + j), _mm_loadu_ps(p + n - j - 1));
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(coefficients[j]), pair));
+            }
+            _mm_storeu_ps(destination + n, sum);
+        }
+#elif defined(ARM_NEON_INTRINSICS)
+        for (; n + 4 <= framesToProcess; n += 4)
+        {
+            float32x4_t sum = vdupq_n_f32(0);
+            for (size_t j = 0; j < sideTaps; ++j)
+            {
+                float32x4_t pair = vaddq_f32(vld1q_f32(p + n + j), vld1q_f32(p + n - j - 1));
+                sum = vmlaq_n_f32(sum, pair, coefficients[j]);
+            }
+            vst1q_f32(destination + n, sum);
+        }
+#endif
+
+        for (; n < framesToProcess; ++n)
+        {
+            float sum = 0;
+            for (size_t j = 0; j < sideTaps; ++j)
+                sum += coefficients[j] * (p[n + j] + p[n - j - 1]);
+            destination[n] = sum;
+        }
+    }
+}
+
+HalfBandUpSampler::HalfBandUpSampler(size_t sideTaps, size_t blockSize)
+    : m_coefficients(halfBandCoefficients(sideTaps, 2))
+    , m_sideTaps(sideTaps)
+    , m_blockSize(blockSize)
+    , m_input(2 * sideTaps - 1 + blockSize)
+    , m_odd(blockSize)
+{
+    ASSERT(sideTaps && blockSize);
+}
+
+void HalfBandUpSampler::process(const float * source, float * destination, size_t framesToProcess)
+{
+    ASSERT(source && destination && source != destination);
+
+    const size_t history = 2 * m_sideTaps - 1;
+    float * input = m_input.data();
+    float * p = input + m_sideTaps;
+
+    while (framesToProcess)
+    {
+        const size_t frames = std::min(framesToProcess, m_blockSize);
+        memcpy(input + history, source, sizeof(float) * frames);
+
+        // The zero stuffed frames are filtered, and the others are the input, delayed to the filter's center.
+        halfBandSum(p, m_coefficients.data(), m_sideTaps, m_odd.data(), frames);
+        VectorMath::vintlve(p - 1, m_odd.data(), destination, 2 * frames);
+
+        memmove(input, input + frames, sizeof(float) * history);
+        source += frames;
+        destination += 2 * frames;
+        framesToProcess -= frames;
+    }
+}
+
+void HalfBandUpSampler::reset()
+{
+    m_input.zero();
+}
+
+HalfBandDownSampler::HalfBandDownSampler(size_t sideTaps, size_t blockSize)
+    : m_coefficients(halfBandCoefficients(sideTaps, 1))
+    , m_sideTaps(sideTaps)
+    , m_blockSize(blockSize)
+    , m_even(2 * sideTaps - 1 + blockSize)
+    , m_odd(2 * sideTaps - 1 + blockSize)
+{
+    ASSERT(sideTaps && blockSize);
+}
+
+void HalfBandDownSampler::process(const float * source, float * destination, size_t framesToProcess)
+{
+    ASSERT(source && destination);
+
+    const size_t history = 2 * m_sideTaps - 1;
+    float * even = m_even.data();
+    float * odd = m_odd.data();
+    const float half = 0.5f;
+
+    while (framesToProcess)
+    {
+        // A block is read in full before its output is written, and the output never passes the input still to
+        // be read, so that destination may be source.
+        const size_t frames = std::min(framesToProcess, m_blockSize);
+        VectorMath::vdeintlve(source, even + history, odd + history, 2 * frames);
+
+        // Only the odd frames meet the filter's side taps; the even frames meet its center.
+        halfBandSum(odd + m_sideTaps, m_coefficients.data(), m_sideTaps, destination, frames);
+        VectorMath::vsma(even + m_sideTaps, 1, &half, destination, 1, frames);
+
+        memmove(even, even + frames, sizeof(float) * history);
+        memmove(odd, odd + frames, sizeof(float) * history);
+        source += 2 * frames;
+        destination += frames;
+        framesToProcess -= frames;
+    }
+}
+
+void HalfBandDownSampler::reset()
+{
+    m_even.zero();
+    m_odd.zero();
+}
+
+} // namespace lab
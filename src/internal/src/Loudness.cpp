@@ -0,0 +1,172 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/Loudness.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lab {
+
+namespace Loudness
+{
+    float loudness(double meanSquare)
+    {
+        return meanSquare > 0 ? static_cast<float>(-0.691 + 10 * std::log10(meanSquare)) : Silence;
+    }
+
+    double channelWeight(size_t channel, size_t channelCount)
+    {
+        if (channelCount == 6)
+            return channel == 3 ? 0 : channel >= 4 ? 1.41 : 1;
+        if (channelCount == 4)
+            return channel >= 2 ? 1.41 : 1;
+        return 1;
+    }
+
+    size_t blockFrames(float sampleRate)
+    {
+        return std::max<size_t>(static_cast<size_t>(sampleRate / 10 + 0.5f), 1);
+    }
+
+    void designKWeighting(float sampleRate, Biquad & shelf, Biquad & highpass)
+    {
+        const double piDouble = 3.14159265358979323846;
+
+        double K = std::tan(piDouble * 1681.974450955533 / sampleRate);
+        double Q = 0.7071752369554196;
+        double Vh = std::pow(10.0, 3.999843853973347 / 20);
+        double Vb = std::pow(Vh, 0.4996667741545416);
+        double a0 = 1 + K / Q + K * K;
+        shelf.setNormalizedCoefficients(Vh + Vb * K / Q + K * K, 2 * (K * K - Vh), Vh - Vb * K / Q + K * K,
+                                        a0, 2 * (K * K - 1), 1 - K / Q + K * K);
+
+        K = std::tan(piDouble * 38.13547087602444 / sampleRate);
+        Q = 0.5003270373238773;
+        a0 = 1 + K / Q + K * K;
+        highpass.setNormalizedCoefficients(a0, -2 * a0, a0, a0, 2 * (K * K - 1), 1 - K / Q + K * K);
+    }
+}
+
+LoudnessAnalyzer::LoudnessAnalyzer(float sampleRate, size_t channelCount, size_t expectedFrames)
+    : m_channelCount(std::min(channelCount, MaxChannels))
+    , m_blockFrames(Loudness::blockFrames(sampleRate))
+    , m_weighted(SpanFrames)
+{
+    for (size_t c = 0; c < m_channelCount; ++c)
+    {
+        Loudness::designKWeighting(sampleRate, m_shelves[c], m_highpasses[c]);
+        m_shelves[c].reset();
+        m_highpasses[c].reset();
+    }
+    m_blockEnergies.reserve(expectedFrames / m_blockFrames + 2);
+}
+
+void LoudnessAnalyzer::analyze(size_t channel, const float * source, size_t frames)
+{
+    if (channel >= m_channelCount)
+        return;
+
+    float peak;
+    float sumOfSquares;
+    VectorMath::vmaxmgv(source, 1, &peak, frames);
+    VectorMath::vsvesq(source, 1, &sumOfSquares, frames);
+    m_peak = std::max(m_peak, peak);
+    m_sumOfSquares += sumOfSquares;
+    m_samples += frames;
+
+    const double weight = Loudness::channelWeight(channel, m_channelCount);
+    if (!weight)
+        return;
+
+    // The K-weighted energy goes to the blocks the frames fall in.
+    size_t block = m_block;
+    size_t position = m_blockPosition;
+    float * weighted = m_weighted.data();
+    while (frames)
+    {
+        const size_t span = std::min(std::min(frames, SpanFrames), m_blockFrames - position);
+        m_shelves[channel].process(source, weighted, span);
+        m_highpasses[channel].process(weighted, weighted, span);
+
+        float energy;
+        VectorMath::vsvesq(weighted, 1, &energy, span);
+        if (m_blockEnergies.size() <= block)
+            m_blockEnergies.resize(block + 1, 0.0);
+        m_blockEnergies[block] += weight * energy;
+
+        source += span;
+        frames -= span;
+        position += span;
+        if (position == m_blockFrames)
+        {
+            position = 0;
+            ++block;
+        }
+    }
+}
+
+void LoudnessAnalyzer::advance(size_t frames)
+{
+    m_blockPosition += frames;
+    m_block += m_blockPosition / m_blockFrames;
+    m_blockPosition %= m_blockFrames;
+}
+
+AudioBusLoudness LoudnessAnalyzer::result() const
+{
+    AudioBusLoudness loudness;
+    loudness.measured = true;
+    loudness.peak = m_peak;
+    loudness.rms = m_samples ? static_cast<float>(std::sqrt(m_sumOfSquares / m_samples)) : 0.f;
+    loudness.integratedLoudness = Loudness::Silence;
+
+    // Only the blocks the signal completed are gated.
+    const size_t blocks = std::min(m_block, m_blockEnergies.size());
+    if (blocks < Loudness::WindowBlocks)
+        return loudness;
+
+    const size_t windows = blocks - Loudness::WindowBlocks + 1;
+    const double windowFrames = static_cast<double>(Loudness::WindowBlocks * m_blockFrames);
+    auto windowMeanSquare = [&](size_t first)
+    {
+        double energy = 0;
+        for (size_t i = 0; i < Loudness::WindowBlocks; ++i)
+            energy += m_blockEnergies[first + i];
+        return energy / windowFrames;
+    };
+
+    double energy = 0;
+    size_t count = 0;
+    for (size_t w = 0; w < windows; ++w)
+    {
+        const double meanSquare = windowMeanSquare(w);
+        if (Loudness::loudness(meanSquare) > Loudness::AbsoluteGate)
+        {
+            energy += meanSquare;
+            ++count;
+        }
+    }
+    if (!count)
+        return loudness;
+
+    const double gate = Loudness::loudness(energy / count) + Loudness::RelativeGate;
+    energy = 0;
+    count = 0;
+    for (size_t w = 0; w < windows; ++w)
+    {
+        const double meanSquare = windowMeanSquare(w);
+        const float windowLoudness = Loudness::loudness(meanSquare);
+        if (windowLoudness > Loudness::AbsoluteGate && windowLoudness > gate)
+        {
+            energy += meanSquare;
+            ++count;
+        }
+    }
+    if (count)
+        loudness.integratedLoudness = Loudness::loudness(energy / count);
+    return loudness;
+}
+
+} // namespace lab
@@ -0,0 +1,76 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+
+#include "internal/MappedFile.h"
+
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lab
+{
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    void* data = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        // The view keeps the file mapping and the file open once their handles are closed.
+        HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (fileMapping)
+        {
+            data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(fileMapping);
+        }
+    }
+    CloseHandle(file);
+
+    if (!data)
+        return nullptr;
+    return std::unique_ptr<MappedFile>(new MappedFile(data, static_cast<size_t>(fileSize.QuadPart)));
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return nullptr;
+
+    struct stat status;
+    void* data = nullptr;
+    if (!fstat(file, &status) && status.st_size > 0)
+    {
+        // The mapping keeps the file open once its descriptor is closed.
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED)
+            data = nullptr;
+    }
+    ::close(file);
+
+    if (!data)
+        return nullptr;
+    return std::unique_ptr<MappedFile>(new MappedFile(data, static_cast<size_t>(status.st_size)));
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+    UnmapViewOfFile(m_data);
+#else
+    munmap(m_data, m_size);
+#endif
+}
+
+} // namespace lab
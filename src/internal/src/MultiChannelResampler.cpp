@@ -7,25 +7,45 @@
 #include "internal/MultiChannelResampler.h"
 #include "internal/Assertions.h"
 
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+
 namespace lab {
 
 namespace {
 
 // ChannelProvider provides a single channel of audio data (one channel at a time) for each channel
 // of data provided to us in a multi-channel provider.
+// The kernels are processed one after another, and since they all buffer in the same way, every kernel asks for
+// input as many times, and for as many frames, as the first one. So the first kernel's requests are pulled from the
+// multi-channel provider and kept, and handed out again, in the same order, to each of the others.
 
 class ChannelProvider : public AudioSourceProvider {
 public:
-    ChannelProvider(AudioSourceProvider* multiChannelProvider, unsigned numberOfChannels)
+    ChannelProvider(AudioSourceProvider* multiChannelProvider, unsigned numberOfChannels,
+                    std::unique_ptr<AudioBus>& multiChannelBus, AudioBus& pullBus, std::vector<size_t>& pulls)
         : m_multiChannelProvider(multiChannelProvider)
         , m_numberOfChannels(numberOfChannels)
+        , m_multiChannelBus(multiChannelBus)
+        , m_pullBus(pullBus)
+        , m_pulls(pulls)
         , m_currentChannel(0)
-        , m_framesToProcess(0)
+        , m_pullIndex(0)
+        , m_frameOffset(0)
+    {
+        m_pulls.clear();
+    }
+
+    // Called before each kernel is processed, starting with the first channel.
+    void setChannel(unsigned channel)
     {
+        m_currentChannel = channel;
+        m_pullIndex = 0;
+        m_frameOffset = 0;
     }
 
-    // provideInput() will be called once for each channel, starting with the first channel.
-    // Each time it's called, it will provide the next channel of data.
     virtual void provideInput(AudioBus* bus, size_t framesToProcess)
     {
         bool isBusGood = bus && bus->numberOfChannels() == 1;
@@ -33,65 +53,147 @@ public:
         if (!isBusGood)
             return;
 
-        // Get the data from the multi-channel provider when the first channel asks for it.
-        // For subsequent channels, we can just dish out the channel data from that (stored in m_multiChannelBus).
-        if (m_currentChannel != 0) {
-            m_framesToProcess = framesToProcess;
-            m_multiChannelBus = std::unique_ptr<AudioBus>(new AudioBus(m_numberOfChannels, framesToProcess));
-            m_multiChannelProvider->provideInput(m_multiChannelBus.get(), framesToProcess);
+        // The first channel pulls the data from the multi-channel provider, after the data it pulled before,
+        // growing the bus kept between calls if need be.
+        if (m_currentChannel == 0) {
+            size_t framesNeeded = m_frameOffset + framesToProcess;
+            if (!m_multiChannelBus || m_multiChannelBus->length() < framesNeeded) {
+                std::unique_ptr<AudioBus> grown(new AudioBus(m_numberOfChannels, framesNeeded));
+                for (unsigned i = 0; m_multiChannelBus && i < m_numberOfChannels; ++i)
+                    memcpy(grown->channel(i)->mutableData(), m_multiChannelBus->channel(i)->data(), sizeof(float) * m_frameOffset);
+                m_multiChannelBus = std::move(grown);
+            }
+
+            for (unsigned i = 0; i < m_numberOfChannels; ++i)
+                m_pullBus.setChannelMemory(i, m_multiChannelBus->channel(i)->mutableData() + m_frameOffset, framesToProcess);
+            m_multiChannelProvider->provideInput(&m_pullBus, framesToProcess);
+            m_pulls.push_back(framesToProcess);
         }
 
-        // All channels must ask for the same amount. This should always be the case, but let's just make sure.
-        bool isGood = m_multiChannelBus.get() && framesToProcess == m_framesToProcess;
+        // All channels must ask for the same amounts. This should always be the case, but let's just make sure.
+        bool isGood = m_pullIndex < m_pulls.size() && m_pulls[m_pullIndex] == framesToProcess && m_currentChannel < m_numberOfChannels;
         ASSERT(isGood);
         if (!isGood)
             return;
 
         // Copy the channel data from what we received from m_multiChannelProvider.
-        ASSERT(static_cast<unsigned>(m_currentChannel) <= m_numberOfChannels);
-        if (static_cast<unsigned>(m_currentChannel) < m_numberOfChannels) {
-            memcpy(bus->channel(0)->mutableData(),
-                   m_multiChannelBus->channel(m_currentChannel)->data(), sizeof(float) * framesToProcess);
-            
-            // increment channel
-            ++m_currentChannel;
-        }
+        memcpy(bus->channel(0)->mutableData(),
+               m_multiChannelBus->channel(m_currentChannel)->data() + m_frameOffset, sizeof(float) * framesToProcess);
+
+        ++m_pullIndex;
+        m_frameOffset += framesToProcess;
     }
 
 private:
     AudioSourceProvider* m_multiChannelProvider;
-    std::unique_ptr<AudioBus> m_multiChannelBus;
     unsigned m_numberOfChannels;
+
+    // The data pulled this time, back to back, the bus wrapping the part being pulled, and the size of each pull.
+    std::unique_ptr<AudioBus>& m_multiChannelBus;
+    AudioBus& m_pullBus;
+    std::vector<size_t>& m_pulls;
+
     unsigned m_currentChannel;
-    size_t m_framesToProcess; // Used to verify that all channels ask for the same amount.
+    size_t m_pullIndex;
+    size_t m_frameOffset;
 };
 
+// The destination frames converted as one piece of work; long enough that the threads spend their time converting.
+const size_t ConvertRangeFrames = 65536;
+
 } // namespace
 
-MultiChannelResampler::MultiChannelResampler(double scaleFactor, unsigned numberOfChannels)
-    : m_numberOfChannels(numberOfChannels)
+MultiChannelResampler::MultiChannelResampler(double scaleFactor, unsigned numberOfChannels, size_t blockSize)
+    : m_pullBus(new AudioBus(numberOfChannels, blockSize, false))
+    , m_numberOfChannels(numberOfChannels)
 {
+    m_pulls.reserve(8);
+
     // Create each channel's resampler.
     for (unsigned channelIndex = 0; channelIndex < numberOfChannels; ++channelIndex)
-        m_kernels.push_back(std::unique_ptr<SincResampler>(new SincResampler(scaleFactor)));
+        m_kernels.push_back(std::unique_ptr<SincResampler>(new SincResampler(scaleFactor, 32, 32, blockSize)));
+}
+
+MultiChannelResampler::~MultiChannelResampler()
+{
+}
+
+void MultiChannelResampler::setScaleFactor(double scaleFactor)
+{
+    for (auto & kernel : m_kernels)
+        kernel->setScaleFactor(scaleFactor);
 }
 
-void MultiChannelResampler::process(ContextRenderLock&, AudioSourceProvider* provider, AudioBus* destination, size_t framesToProcess)
+void MultiChannelResampler::process(AudioSourceProvider* provider, AudioBus* destination, size_t framesToProcess)
 {
     // The provider can provide us with multi-channel audio data. But each of our single-channel resamplers (kernels)
     // below requires a provider which provides a single unique channel of data.
     // channelProvider wraps the original multi-channel provider and dishes out one channel at a time.
-    ChannelProvider channelProvider(provider, m_numberOfChannels);
+    ChannelProvider channelProvider(provider, m_numberOfChannels, m_multiChannelBus, *m_pullBus, m_pulls);
 
     for (unsigned channelIndex = 0; channelIndex < m_numberOfChannels; ++channelIndex) {
         // Depending on the sample-rate scale factor, and the internal buffering used in a SincResampler
         // kernel, this call to process() will only sometimes call provideInput() on the channelProvider.
         // However, if it calls provideInput() for the first channel, then it will call it for the remaining
         // channels, since they all buffer in the same way and are processing the same number of frames.
+        channelProvider.setChannel(channelIndex);
         m_kernels[channelIndex]->process(&channelProvider,
                                          destination->channel(channelIndex)->mutableData(),
                                          framesToProcess);
     }
 }
 
+void MultiChannelResampler::convert(const AudioBus & source, AudioBus & destination, double scaleFactor, size_t threadCount)
+{
+    const size_t numberOfChannels = source.numberOfChannels();
+    bool isGood = destination.numberOfChannels() == numberOfChannels && scaleFactor > 0;
+    ASSERT(isGood);
+    if (!isGood)
+        return;
+
+    const size_t sourceLength = source.length();
+    const size_t destinationLength = std::min(destination.length(), static_cast<size_t>(sourceLength / scaleFactor));
+    const size_t rangesPerChannel = (destinationLength + ConvertRangeFrames - 1) / ConvertRangeFrames;
+    const size_t rangeCount = rangesPerChannel * numberOfChannels;
+    if (!rangeCount)
+        return;
+
+    // Every range is worked out from the source alone, so one resampler serves all the threads.
+    const SincResampler resampler(scaleFactor);
+    std::atomic<size_t> next{ 0 };
+    auto work = [&]()
+    {
+        for (size_t range = next++; range < rangeCount; range = next++)
+        {
+            const size_t channel = range / rangesPerChannel;
+            const size_t first = (range % rangesPerChannel) * ConvertRangeFrames;
+            const size_t frames = std::min(ConvertRangeFrames, destinationLength - first);
+            resampler.process(source.channel(channel)->data(), sourceLength,
+                              destination.channel(channel)->mutableData() + first, first, frames);
+        }
+    };
+
+    if (!threadCount)
+        threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    threadCount = std::min(threadCount, rangeCount);
+
+    // If a thread can't be started, the ones that did, and this one, convert its share.
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i)
+    {
+        try
+        {
+            threads.emplace_back(work);
+        }
+        catch (const std::system_error &)
+        {
+            break;
+        }
+    }
+
+    work();
+    for (auto & thread : threads)
+        thread.join();
+}
+
 } // namespace lab
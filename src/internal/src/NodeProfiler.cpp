@@ -0,0 +1,44 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/NodeProfiler.h"
+
+#include "LabSound/core/AudioNode.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+namespace lab {
+
+std::string NodeTypeName(const AudioNode & node)
+{
+    std::string name = typeid(node).name();
+
+#if defined(__GNUC__)
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (demangled)
+    {
+        if (status == 0)
+            name = demangled;
+        std::free(demangled);
+    }
+#endif
+
+    // MSVC names are already readable, but for their "class " prefix.
+    for (const char * prefix : { "class ", "struct " })
+        if (name.compare(0, strlen(prefix), prefix) == 0)
+            name.erase(0, strlen(prefix));
+
+    const size_t scope = name.rfind("::");
+    if (scope != std::string::npos)
+        name.erase(0, scope + 2);
+    return name;
+}
+
+} // namespace lab
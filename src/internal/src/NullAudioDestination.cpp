@@ -0,0 +1,98 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioIOCallback.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/NullAudioDestination.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace lab {
+
+namespace
+{
+    // The furthest the clock may get ahead of the rendering before the thread gives up on catching up.
+    const double MaxBacklogSeconds = 1.0;
+}
+
+NullAudioDestination::NullAudioDestination(AudioIOCallback & callback, size_t numChannels, float sampleRate, size_t framesPerBuffer,
+                                           const AudioDeviceSettings & settings)
+    : m_callback(callback)
+    , m_sampleRate(sampleRate)
+    , m_framesPerBuffer(framesPerBuffer)
+    , m_lookahead(std::max(settings.nullLookahead, 0.0))
+    , m_output(settings.nullOutput)
+    , m_renderBus(numChannels, framesPerBuffer)
+{
+    m_renderBus.setSampleRate(sampleRate);
+}
+
+NullAudioDestination::~NullAudioDestination()
+{
+    stop();
+}
+
+void NullAudioDestination::start()
+{
+    if (m_thread.joinable())
+        return;
+
+    m_running = true;
+    m_thread = std::thread(&NullAudioDestination::renderEntry, this);
+}
+
+void NullAudioDestination::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    m_thread.join();
+}
+
+void NullAudioDestination::renderEntry()
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Frames are counted from the clock's start, so that rounding doesn't accumulate from quantum to quantum.
+    const double framesAhead = m_lookahead * m_sampleRate;
+    const double maxBacklog = MaxBacklogSeconds * m_sampleRate;
+    Clock::time_point started = Clock::now();
+    uint64_t rendered = 0;
+    uint64_t sampleFrame = 0;
+
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        const double elapsed = std::chrono::duration<double>(Clock::now() - started).count() * m_sampleRate;
+
+        if (elapsed - rendered > maxBacklog)
+        {
+            LOG("The Null destination fell %f seconds behind its clock and skipped ahead", (elapsed - rendered) / m_sampleRate);
+            m_skips.fetch_add(1, std::memory_order_relaxed);
+            m_callback.reportXrun();
+            started = Clock::now();
+            rendered = 0;
+            continue;
+        }
+
+        // A quantum falls due when the clock reaches its first frame, as a device would ask for it. Every quantum
+        // that has, or will within the lookahead, is rendered now.
+        while (rendered <= elapsed + framesAhead && m_running.load(std::memory_order_relaxed))
+        {
+            m_callback.render(nullptr, &m_renderBus, m_framesPerBuffer);
+            if (m_output)
+                m_output(m_renderBus, sampleFrame);
+
+            rendered += m_framesPerBuffer;
+            sampleFrame += m_framesPerBuffer;
+        }
+
+        // Then sleep until the next one falls due.
+        const double nextDue = (rendered - framesAhead) / m_sampleRate;
+        std::this_thread::sleep_until(started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(nextDue)));
+    }
+}
+
+} // namespace lab
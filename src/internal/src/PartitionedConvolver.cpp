@@ -0,0 +1,218 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/PartitionedConvolver.h"
+#include "internal/VectorMath.h"
+#include "internal/Assertions.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lab {
+
+using namespace VectorMath;
+
+PartitionedConvolver::Partitions PartitionedConvolver::partitionResponse(size_t fftSize, const float* response, size_t responseLength)
+{
+    size_t halfSize = fftSize / 2;
+    size_t partitionCount = std::max<size_t>(1, (responseLength + halfSize - 1) / halfSize);
+
+    Partitions partitions;
+    for (size_t i = 0; i < partitionCount; ++i)
+    {
+        std::unique_ptr<FFTFrame> partition(new FFTFrame(fftSize));
+        size_t offset = i * halfSize;
+        if (offset < responseLength)
+            partition->doPaddedFFT(response + offset, std::min(halfSize, responseLength - offset));
+        partitions.push_back(std::move(partition));
+    }
+    return partitions;
+}
+
+PartitionedConvolver::Input::Input(size_t fftSize)
+    : buffer(fftSize)
+{
+}
+
+PartitionedConvolver::Output::Output(size_t fftSize)
+    : accumulator(fftSize)
+    , buffer(fftSize)
+    , lastOverlap(fftSize / 2)
+{
+}
+
+PartitionedConvolver::PartitionedConvolver(const Partitions& partitions)
+    : m_fftSize(partitions.front()->fftSize())
+    , m_partitionCount(partitions.size())
+    , m_paths(1, Path { 0, 0, &partitions })
+{
+    initialize(1, 1);
+}
+
+PartitionedConvolver::PartitionedConvolver(size_t numberOfInputs, size_t numberOfOutputs, const std::vector<Path>& paths)
+    : m_fftSize(paths.front().partitions->front()->fftSize())
+    , m_partitionCount(paths.front().partitions->size())
+    , m_paths(paths)
+{
+    for (const Path& path : paths)
+    {
+        ASSERT(path.input < numberOfInputs && path.output < numberOfOutputs);
+        ASSERT(path.partitions->size() == m_partitionCount && path.partitions->front()->fftSize() == m_fftSize);
+    }
+    initialize(numberOfInputs, numberOfOutputs);
+}
+
+void PartitionedConvolver::initialize(size_t numberOfInputs, size_t numberOfOutputs)
+{
+    for (size_t i = 0; i < numberOfInputs; ++i)
+    {
+        std::unique_ptr<Input> input(new Input(m_fftSize));
+        for (size_t p = 0; p < m_partitionCount; ++p)
+            input->spectra.push_back(std::unique_ptr<FFTFrame>(new FFTFrame(m_fftSize)));
+        m_inputs.push_back(std::move(input));
+    }
+    for (size_t i = 0; i < numberOfOutputs; ++i)
+        m_outputs.push_back(std::unique_ptr<Output>(new Output(m_fftSize)));
+
+    m_newestSpectrum = 0;
+    m_nextPartition = 1;
+    m_readWriteIndex = 0;
+}
+
+void PartitionedConvolver::accumulatePartitions(size_t endPartition)
+{
+    // The next block's partition p meets the input from p blocks before it, which is p - 1 blocks before the newest.
+    size_t count = partitionCount();
+    for (; m_nextPartition < std::min(endPartition, m_partitionLimit); ++m_nextPartition)
+    {
+        size_t spectrum = (m_newestSpectrum + count + 1 - m_nextPartition) % count;
+        for (const Path& path : m_paths)
+        {
+            m_outputs[path.output]->accumulator.multiplyAccumulate(*m_inputs[path.input]->spectra[spectrum],
+                                                                   *(*path.partitions)[m_nextPartition]);
+        }
+    }
+    m_nextPartition = std::max(m_nextPartition, endPartition);
+}
+
+void PartitionedConvolver::clearAccumulators()
+{
+    size_t halfSize = fftSize() / 2;
+    for (auto& output : m_outputs)
+    {
+        memset(output->accumulator.realData(), 0, sizeof(float) * halfSize);
+        memset(output->accumulator.imagData(), 0, sizeof(float) * halfSize);
+    }
+    m_nextPartition = 1;
+}
+
+void PartitionedConvolver::process(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    process(&sourceP, &destP, framesToProcess);
+}
+
+void PartitionedConvolver::process(const float* const* sources, float* const* destinations, size_t framesToProcess)
+{
+    size_t halfSize = fftSize() / 2;
+
+    // framesToProcess must be an exact multiple of halfSize,
+    // or halfSize is a multiple of framesToProcess when halfSize > framesToProcess.
+    bool isGood = framesToProcess && !(halfSize % framesToProcess && framesToProcess % halfSize);
+    ASSERT(isGood);
+    if (!isGood)
+        return;
+
+    size_t numberOfDivisions = halfSize <= framesToProcess ? (framesToProcess / halfSize) : 1;
+    size_t divisionSize = numberOfDivisions == 1 ? framesToProcess : halfSize;
+
+    // Spread the older partitions over the divisions of a block, finishing by the last one.
+    size_t divisionsPerBlock = halfSize / divisionSize;
+    size_t partitionsPerDivision = (partitionCount() - 1 + divisionsPerBlock - 1) / divisionsPerBlock;
+
+    for (size_t i = 0; i < numberOfDivisions; ++i)
+    {
+        accumulatePartitions(std::min(m_nextPartition + partitionsPerDivision, partitionCount()));
+
+        // Copy the inputs before the outputs, as processing in-place is allowed.
+        size_t offset = i * divisionSize;
+        for (size_t j = 0; j < m_inputs.size(); ++j)
+            memcpy(m_inputs[j]->buffer.data() + m_readWriteIndex, sources[j] + offset, sizeof(float) * divisionSize);
+        for (size_t j = 0; j < m_outputs.size(); ++j)
+            memcpy(destinations[j] + offset, m_outputs[j]->buffer.data() + m_readWriteIndex, sizeof(float) * divisionSize);
+        m_readWriteIndex += divisionSize;
+
+        // Check if it's time to perform the next FFT
+        if (m_readWriteIndex == halfSize)
+        {
+            accumulatePartitions(partitionCount());
+
+            // The input buffers are now filled; their spectra replace the oldest ones, which no partition needs any more.
+            m_newestSpectrum = (m_newestSpectrum + 1) % partitionCount();
+            for (auto& input : m_inputs)
+                input->spectra[m_newestSpectrum]->doFFT(input->buffer.data());
+
+            for (const Path& path : m_paths)
+            {
+                m_outputs[path.output]->accumulator.multiplyAccumulate(*m_inputs[path.input]->spectra[m_newestSpectrum],
+                                                                       *path.partitions->front());
+            }
+
+            for (auto& output : m_outputs)
+            {
+                float* outputP = output->buffer.data();
+                output->accumulator.doInverseFFT(outputP);
+
+                // Overlap-add 1st half from previous time, and save the 2nd half for next time
+                vadd(outputP, 1, output->lastOverlap.data(), 1, outputP, 1, halfSize);
+                memcpy(output->lastOverlap.data(), outputP + halfSize, sizeof(float) * halfSize);
+            }
+
+            // Start the next block's spectra
+            clearAccumulators();
+            m_readWriteIndex = 0;
+        }
+    }
+}
+
+void PartitionedConvolver::reset()
+{
+    size_t halfSize = fftSize() / 2;
+    for (auto& input : m_inputs)
+    {
+        for (auto& spectrum : input->spectra)
+        {
+            memset(spectrum->realData(), 0, sizeof(float) * halfSize);
+            memset(spectrum->imagData(), 0, sizeof(float) * halfSize);
+        }
+    }
+    clearAccumulators();
+
+    for (auto& output : m_outputs)
+        output->lastOverlap.zero();
+    m_readWriteIndex = 0;
+}
+
+void PartitionedConvolver::clearHistory()
+{
+    const size_t readWriteIndex = m_readWriteIndex;
+    reset();
+    m_readWriteIndex = readWriteIndex;
+
+    for (auto& input : m_inputs)
+        input->buffer.zero();
+    for (auto& output : m_outputs)
+        output->buffer.zero();
+}
+
+size_t PartitionedConvolver::memoryBytes() const
+{
+    const size_t spectrumBytes = FFTFrame::memoryBytes(m_fftSize);
+    size_t bytes = 0;
+    for (auto& input : m_inputs)
+        bytes += input->spectra.size() * spectrumBytes + input->buffer.size() * sizeof(float);
+    for (auto& output : m_outputs)
+        bytes += spectrumBytes + (output->buffer.size() + output->lastOverlap.size()) * sizeof(float);
+    return bytes;
+}
+
+} // namespace lab
@@ -0,0 +1,377 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/PreparedImpulse.h"
+#include "internal/SpectrumCache.h"
+#include "internal/VectorMath.h"
+#include "internal/Assertions.h"
+
+#include "LabSound/core/AudioBus.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lab {
+
+using namespace VectorMath;
+
+namespace
+{
+    // Empirical gain calibration tested across many impulse responses to ensure perceived volume is same as dry (unprocessed) signal
+    const float GainCalibration = -58;
+    const float GainCalibrationSampleRate = 44100;
+
+    // A minimum power value to when normalizing a silent (or very quiet) impulse response
+    const float MinPower = 0.000125f;
+
+    float calculateNormalizationScale(AudioBus* response)
+    {
+        // Normalize by RMS power
+        size_t numberOfChannels = response->numberOfChannels();
+        size_t length = response->length();
+
+        float power = 0;
+
+        for (size_t i = 0; i < numberOfChannels; ++i)
+        {
+            float channelPower = 0;
+            vsvesq(response->channel(i)->data(), 1, &channelPower, length);
+            power += channelPower;
+        }
+
+        power = std::sqrt(power / (numberOfChannels * length));
+
+        // Protect against accidental overload
+        if (std::isinf(power) || std::isnan(power) || power < MinPower)
+            power = MinPower;
+
+        float scale = 1 / power;
+
+        scale *= powf(10, GainCalibration * 0.05f); // calibrate to make perceived volume same as unprocessed
+
+        // Scale depends on sample-rate.
+        if (response->sampleRate())
+            scale *= GainCalibrationSampleRate / response->sampleRate();
+
+        // True-stereo compensation
+        if (response->numberOfChannels() == Channels::Quad)
+            scale *= 0.5f;
+
+        return scale;
+    }
+
+    // Reads the partitions of a stage of stageSize frames; returns none if the cached entry doesn't have them all.
+    PartitionedConvolver::Partitions readPartitions(SpectrumCacheReader* cached, size_t fftSize, size_t stageSize)
+    {
+        size_t halfSize = fftSize / 2;
+        size_t partitionCount = std::max<size_t>(1, (stageSize + halfSize - 1) / halfSize);
+
+        PartitionedConvolver::Partitions partitions;
+        for (size_t i = 0; i < partitionCount; ++i)
+        {
+            std::unique_ptr<FFTFrame> partition(new FFTFrame(fftSize));
+            if (!cached->read(*partition))
+                return PartitionedConvolver::Partitions();
+            partitions.push_back(std::move(partition));
+        }
+        return partitions;
+    }
+
+    // The partitions of a stage, to be transformed.
+    PartitionedConvolver::Partitions allocatePartitions(size_t fftSize, size_t stageSize)
+    {
+        size_t halfSize = fftSize / 2;
+        size_t partitionCount = std::max<size_t>(1, (stageSize + halfSize - 1) / halfSize);
+
+        PartitionedConvolver::Partitions partitions;
+        for (size_t i = 0; i < partitionCount; ++i)
+            partitions.push_back(std::unique_ptr<FFTFrame>(new FFTFrame(fftSize)));
+        return partitions;
+    }
+
+    // Transformed on the constructing thread, so that the response is heard at once; a few milliseconds' work.
+    const size_t SynchronousFrames = PreparedImpulse::RealtimeFrameLimit;
+
+    // The transforms are linear, so the response is scaled through its spectra rather than in place.
+    void scaleSpectrum(FFTFrame& frame, float scale)
+    {
+        size_t halfSize = frame.fftSize() / 2;
+        vsmul(frame.realData(), 1, &scale, frame.realData(), 1, halfSize);
+        vsmul(frame.imagData(), 1, &scale, frame.imagData(), 1, halfSize);
+    }
+}
+
+PreparedImpulse::PreparedImpulse(std::shared_ptr<AudioBus> impulseResponse, size_t maxFFTSize, bool useBackgroundThreads, bool normalize, bool offline)
+    : m_impulseResponse(impulseResponse)
+    , m_length(impulseResponse->length())
+    , m_useBackgroundThreads(useBackgroundThreads)
+    , m_offline(offline)
+    , m_scale(normalize ? calculateNormalizationScale(impulseResponse.get()) : 1)
+{
+    const float scale = m_scale;
+
+    // The transforms are most of the work, so their results may be cached on disk. The entry's frames are
+    // the stages' partitions, already scaled.
+    std::unique_ptr<SpectrumCacheReader> cached;
+    std::unique_ptr<SpectrumCacheWriter> cache;
+    if (spectrumCacheEnabled())
+    {
+        SpectrumCacheKey key = cacheKey(impulseResponse.get(), maxFFTSize, useBackgroundThreads, offline, scale);
+        cached = SpectrumCacheReader::open(key);
+        if (cached && !prepareChannels(maxFFTSize, scale, cached.get()))
+            cached.reset();
+        if (!cached)
+            cache = SpectrumCacheWriter::create(key);
+    }
+
+    if (!m_channels.empty())
+    {
+        m_preparedLength.store(m_length, std::memory_order_release);
+        return;
+    }
+
+    prepareChannels(maxFFTSize, scale, nullptr);
+    m_cache = std::move(cache);
+    startTransforms();
+}
+
+PreparedImpulse::~PreparedImpulse()
+{
+    // Transforms under way are finished, and the rest abandoned.
+    m_cancelled = true;
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+void PreparedImpulse::startTransforms()
+{
+    // Every channel has the same stages, so the first's describe the transforms. A direct stage's kernel is
+    // ready as it's copied.
+    const std::vector<PreparedStage>& stages = m_channels.front();
+    size_t preparedLength = 0;
+    for (size_t s = 0; s < stages.size(); ++s)
+    {
+        const PreparedStage& stage = stages[s];
+        if (stage.directKernel)
+        {
+            if (m_transforms.empty())
+                preparedLength = stage.offset + stage.length;
+            continue;
+        }
+
+        size_t halfSize = stage.fftSize / 2;
+        for (size_t p = 0; p < stage.partitions.size(); ++p)
+            m_transforms.push_back(Transform { s, p, std::min(stage.offset + (p + 1) * halfSize, stage.offset + stage.length) });
+    }
+    m_preparedLength.store(m_transforms.empty() ? m_length : preparedLength, std::memory_order_release);
+    m_transformed.assign(m_transforms.size(), false);
+
+    size_t next;
+    while ((next = m_nextTransform.load()) < m_transforms.size() && m_transforms[next].end <= SynchronousFrames)
+        transform(m_nextTransform++);
+
+    size_t remaining = m_transforms.size() - m_nextTransform.load();
+    if (!remaining)
+        return;
+
+    size_t workerCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 2u) - 1, 8);
+    workerCount = std::min(workerCount, remaining);
+    for (size_t i = 0; i < workerCount; ++i)
+        m_workers.emplace_back(&PreparedImpulse::transformEntry, this);
+}
+
+void PreparedImpulse::transformEntry()
+{
+    size_t index;
+    while (!m_cancelled && (index = m_nextTransform++) < m_transforms.size())
+        transform(index);
+}
+
+void PreparedImpulse::transform(size_t index)
+{
+    const Transform& t = m_transforms[index];
+    for (size_t c = 0; c < m_channels.size(); ++c)
+    {
+        PreparedStage& stage = m_channels[c][t.stage];
+        size_t halfSize = stage.fftSize / 2;
+        size_t offset = t.partition * halfSize;
+        FFTFrame& partition = *stage.partitions[t.partition];
+        partition.doPaddedFFT(m_impulseResponse->channel(c)->data() + stage.offset + offset, std::min(halfSize, stage.length - offset));
+        if (m_scale != 1)
+            scaleSpectrum(partition, m_scale);
+    }
+
+    // The response is prepared as far as the transforms done in order reach.
+    std::lock_guard<std::mutex> lock(m_progressLock);
+    m_transformed[index] = true;
+    size_t prepared = m_preparedTransforms;
+    while (prepared < m_transforms.size() && m_transformed[prepared])
+        ++prepared;
+    if (prepared == m_preparedTransforms)
+        return;
+
+    m_preparedTransforms = prepared;
+    m_preparedLength.store(prepared == m_transforms.size() ? m_length : m_transforms[prepared - 1].end, std::memory_order_release);
+    if (prepared < m_transforms.size())
+        return;
+
+    if (m_cache)
+    {
+        for (const auto& stages : m_channels)
+            for (const PreparedStage& stage : stages)
+                for (const auto& partition : stage.partitions)
+                    m_cache->write(*partition);
+        m_cache->commit();
+        m_cache.reset();
+    }
+    m_prepared.notify_all();
+}
+
+size_t PreparedImpulse::memoryBytes() const
+{
+    // The partitions are allocated with the stages, and only their contents are filled in later.
+    size_t bytes = 0;
+    for (const auto& channel : m_channels)
+    {
+        for (const PreparedStage& stage : channel)
+        {
+            if (stage.directKernel)
+                bytes += stage.directKernel->size() * sizeof(float);
+            bytes += stage.partitions.size() * FFTFrame::memoryBytes(stage.fftSize);
+        }
+    }
+    return bytes;
+}
+
+void PreparedImpulse::waitUntilPrepared()
+{
+    std::unique_lock<std::mutex> lock(m_progressLock);
+    m_prepared.wait(lock, [this]() { return m_preparedTransforms == m_transforms.size(); });
+}
+
+SpectrumCacheKey PreparedImpulse::cacheKey(AudioBus* impulseResponse, size_t maxFFTSize, bool useBackgroundThreads, bool offline, float scale)
+{
+    // The stages depend on the response's length, maxFFTSize, useBackgroundThreads and offline. Only an offline
+    // impulse hashes the last, so the entries of the others are still found.
+    uint64_t parameters[] = { impulseResponse->numberOfChannels(), impulseResponse->length(), maxFFTSize, useBackgroundThreads };
+    uint64_t hash = SpectrumCacheKey::hash(parameters, sizeof(parameters));
+    if (offline)
+        hash = SpectrumCacheKey::hash(&offline, sizeof(offline), hash);
+    hash = SpectrumCacheKey::hash(&scale, sizeof(scale), hash);
+    for (size_t i = 0; i < impulseResponse->numberOfChannels(); ++i)
+        hash = SpectrumCacheKey::hash(impulseResponse->channel(i)->data(), sizeof(float) * impulseResponse->length(), hash);
+
+    return SpectrumCacheKey { "impulse", hash, impulseResponse->sampleRate(), maxFFTSize };
+}
+
+bool PreparedImpulse::prepareChannels(size_t maxFFTSize, float scale, SpectrumCacheReader* cached)
+{
+    for (size_t i = 0; i < m_impulseResponse->numberOfChannels(); ++i)
+    {
+        m_channels.push_back(prepareChannel(m_impulseResponse->channel(i)->data(), m_length, maxFFTSize, m_useBackgroundThreads, m_offline, cached));
+
+        for (PreparedStage& stage : m_channels.back())
+        {
+            // A stage that is neither direct nor partitioned could not be read from the cache.
+            if (!stage.directKernel && stage.partitions.empty())
+            {
+                m_channels.clear();
+                return false;
+            }
+
+            if (scale == 1)
+                continue;
+
+            if (stage.directKernel)
+                vsmul(stage.directKernel->data(), 1, &scale, stage.directKernel->data(), 1, stage.directKernel->size());
+        }
+    }
+
+    // Every frame of the entry must have been used.
+    if (cached && !cached->atEnd())
+    {
+        m_channels.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<ConvolutionRoute> PreparedImpulse::matrixRoutes(size_t numberOfInputs, size_t numberOfOutputs)
+{
+    std::vector<ConvolutionRoute> routes;
+    for (size_t i = 0; i < numberOfInputs; ++i)
+        for (size_t o = 0; o < numberOfOutputs; ++o)
+            routes.push_back(ConvolutionRoute { i, o, i * numberOfOutputs + o });
+    return routes;
+}
+
+std::vector<PreparedStage> PreparedImpulse::prepareChannel(const float* response, size_t totalResponseLength, size_t maxFFTSize, bool useBackgroundThreads,
+                                                           bool offline, SpectrumCacheReader* cached)
+{
+    std::vector<PreparedStage> stages;
+
+    // Once the real-time stages reach their largest FFT size, the rest of their portion of the response is
+    // a single stage of uniform partitions, which does one pair of FFTs per block however long it is, and
+    // spreads the multiply-adds of its older partitions over the slices in between. Likewise the background
+    // stages once they reach maxFFTSize, so that a long response's input is transformed once per block, and
+    // its products are summed in one pass over the spectra and added to the accumulation buffers once, rather
+    // than by a stage per partition. Offline, the real-time stages grow as large as the background stages would.
+    const size_t maxRealtimeFFTSize = offline ? maxFFTSize : std::min<size_t>(MaxRealtimeFFTSize, maxFFTSize);
+
+    size_t stageOffset = 0;
+    size_t fftSize = MinFFTSize;
+    while (stageOffset < totalResponseLength) {
+        size_t stageSize = fftSize / 2;
+
+        bool isRealtimeStage = !(useBackgroundThreads && stageOffset > RealtimeFrameLimit);
+        if (isRealtimeStage && stageOffset && fftSize == maxRealtimeFFTSize) {
+            // With background threads, the real-time portion ends at the first partition boundary past the limit.
+            size_t realtimeLength = totalResponseLength - stageOffset;
+            if (useBackgroundThreads)
+                realtimeLength = std::min<size_t>(realtimeLength, ((RealtimeFrameLimit - stageOffset) / stageSize + 1) * stageSize);
+            stageSize = realtimeLength;
+        } else if (!isRealtimeStage && fftSize == maxFFTSize) {
+            stageSize = totalResponseLength - stageOffset;
+        }
+
+        // For the last stage, it's possible that stageOffset is such that we're straddling the end
+        // of the impulse response buffer (if we use stageSize), so reduce the last stage's length...
+        if (stageSize + stageOffset > totalResponseLength)
+            stageSize = totalResponseLength - stageOffset;
+
+        PreparedStage stage;
+        stage.offset = stageOffset;
+        stage.length = stageSize;
+        stage.fftSize = fftSize;
+        stage.background = !isRealtimeStage;
+
+        // The total latency is zero because the direct-convolution is used in the leading portion.
+        bool useDirectConvolver = !stageOffset;
+
+        if (useDirectConvolver) {
+            stage.directKernel.reset(new AudioFloatArray(fftSize / 2));
+            stage.directKernel->copyToRange(response, 0, stageSize);
+        } else if (!cached) {
+            stage.partitions = allocatePartitions(fftSize, stageSize);
+        } else {
+            stage.partitions = readPartitions(cached, fftSize, stageSize);
+        }
+
+        stages.push_back(std::move(stage));
+        stageOffset += stageSize;
+
+        if (!useDirectConvolver) {
+            // Figure out next FFT size
+            fftSize *= 2;
+        }
+
+        if (isRealtimeStage && fftSize > maxRealtimeFFTSize)
+            fftSize = maxRealtimeFFTSize;
+        if (fftSize > maxFFTSize)
+            fftSize = maxFFTSize;
+    }
+
+    return stages;
+}
+
+} // namespace lab
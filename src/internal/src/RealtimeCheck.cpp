@@ -0,0 +1,382 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/RealtimeCheck.h"
+
+#include "LabSound/core/AudioRealtimeCheck.h"
+#include "LabSound/extended/Logging.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#if defined(LABSOUND_RT_CHECK)
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#else
+#include <new>
+#endif
+#endif
+
+// The hooks run inside malloc, so the thread's state must be reachable without allocating; initial-exec TLS is.
+#if defined(__GNUC__)
+#define LABSOUND_RT_THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+#define LABSOUND_RT_THREAD_LOCAL thread_local
+#endif
+
+// The frames skipped at the top of a recorded stack are counted, so the functions making them mustn't be inlined.
+#if defined(_MSC_VER)
+#define LABSOUND_RT_NOINLINE __declspec(noinline)
+#else
+#define LABSOUND_RT_NOINLINE __attribute__((noinline))
+#endif
+
+namespace lab {
+
+namespace {
+
+    const int MaxFrames = 24;
+    const int MaxViolations = 128;
+
+    // A distinct call stack. Every member is constant initialized, so the table is usable by allocations made
+    // before static constructors run. Records are claimed by the thread that first sees the stack, and found
+    // again by the hash of its frames.
+    struct ViolationRecord
+    {
+        std::atomic<uint64_t> hash{ 0 };
+        std::atomic<bool> ready{ false };
+        std::atomic<uint64_t> count{ 0 };
+        AudioRealtimeViolation::Kind kind = AudioRealtimeViolation::Kind::Allocation;
+        int depth = 0;
+        void * frames[MaxFrames] = {};
+        uint64_t logged = 0; // guarded by s_logLock
+    };
+
+    ViolationRecord s_records[MaxViolations];
+    std::atomic<uint64_t> s_overflow{ 0 };
+    uint64_t s_overflowLogged = 0;
+    std::mutex s_logLock;
+
+    LABSOUND_RT_THREAD_LOCAL int t_realtimeDepth = 0;
+    LABSOUND_RT_THREAD_LOCAL bool t_recording = false;
+
+    const char * kindName(AudioRealtimeViolation::Kind kind)
+    {
+        switch (kind)
+        {
+            case AudioRealtimeViolation::Kind::Allocation: return "allocation";
+            case AudioRealtimeViolation::Kind::Deallocation: return "deallocation";
+            case AudioRealtimeViolation::Kind::Lock: return "mutex lock";
+        }
+        return "";
+    }
+
+    std::vector<std::string> symbolize(void * const * frames, int depth)
+    {
+        std::vector<std::string> stack;
+#if defined(LABSOUND_RT_CHECK) && (defined(__GLIBC__) || defined(__APPLE__))
+        if (char ** symbols = backtrace_symbols(frames, depth))
+        {
+            for (int i = 0; i < depth; ++i)
+                stack.emplace_back(symbols[i]);
+            free(symbols);
+            return stack;
+        }
+#endif
+        for (int i = 0; i < depth; ++i)
+        {
+            char address[32];
+            snprintf(address, sizeof(address), "%p", frames[i]);
+            stack.emplace_back(address);
+        }
+        return stack;
+    }
+
+#if defined(LABSOUND_RT_CHECK)
+
+    LABSOUND_RT_NOINLINE int captureStack(void ** frames, int maxFrames)
+    {
+#if defined(__GLIBC__) || defined(__APPLE__)
+        return backtrace(frames, maxFrames);
+#elif defined(_WIN32)
+        return CaptureStackBackTrace(0, static_cast<DWORD>(maxFrames), frames, nullptr);
+#else
+        (void) frames;
+        (void) maxFrames;
+        return 0;
+#endif
+    }
+
+    // Called from the hooks on a thread inside a realtime scope. Anything the recording itself allocates or
+    // locks, such as the unwinder loading on first use, is let through.
+    LABSOUND_RT_NOINLINE void recordViolation(AudioRealtimeViolation::Kind kind)
+    {
+        if (t_recording)
+            return;
+        t_recording = true;
+
+        // The first frames are captureStack(), this function and the hook.
+        const int Skip = 3;
+        void * frames[MaxFrames + Skip];
+        int depth = captureStack(frames, MaxFrames + Skip) - Skip;
+        if (depth < 0)
+            depth = 0;
+
+        uint64_t hash = 14695981039346656037ull ^ static_cast<uint64_t>(kind);
+        for (int i = 0; i < depth; ++i)
+            hash = (hash ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(frames[Skip + i]))) * 1099511628211ull;
+        if (!hash)
+            hash = 1;
+
+        for (int probe = 0; probe < MaxViolations; ++probe)
+        {
+            ViolationRecord & record = s_records[(hash + probe) % MaxViolations];
+            uint64_t existing = record.hash.load(std::memory_order_acquire);
+            if (!existing && record.hash.compare_exchange_strong(existing, hash))
+            {
+                record.kind = kind;
+                record.depth = depth;
+                for (int i = 0; i < depth; ++i)
+                    record.frames[i] = frames[Skip + i];
+                record.ready.store(true, std::memory_order_release);
+                existing = hash;
+            }
+            if (existing == hash)
+            {
+                record.count.fetch_add(1, std::memory_order_relaxed);
+                t_recording = false;
+                return;
+            }
+        }
+
+        s_overflow.fetch_add(1, std::memory_order_relaxed);
+        t_recording = false;
+    }
+
+#endif
+
+} // anonymous namespace
+
+void RealtimeScopeEnter()
+{
+    ++t_realtimeDepth;
+}
+
+void RealtimeScopeLeave()
+{
+    --t_realtimeDepth;
+}
+
+bool AudioRealtimeCheck::available()
+{
+#if defined(LABSOUND_RT_CHECK)
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::vector<AudioRealtimeViolation> AudioRealtimeCheck::violations()
+{
+    std::vector<AudioRealtimeViolation> result;
+    for (ViolationRecord & record : s_records)
+    {
+        if (!record.ready.load(std::memory_order_acquire))
+            continue;
+
+        AudioRealtimeViolation violation;
+        violation.kind = record.kind;
+        violation.count = record.count.load(std::memory_order_relaxed);
+        violation.stack = symbolize(record.frames, record.depth);
+        result.push_back(std::move(violation));
+    }
+    return result;
+}
+
+// Meant for between test scenes; a violation being recorded meanwhile may be lost.
+void AudioRealtimeCheck::reset()
+{
+    std::lock_guard<std::mutex> lock(s_logLock);
+    for (ViolationRecord & record : s_records)
+    {
+        record.ready.store(false);
+        record.count.store(0);
+        record.logged = 0;
+        record.hash.store(0);
+    }
+    s_overflow.store(0);
+    s_overflowLogged = 0;
+}
+
+size_t AudioRealtimeCheck::log()
+{
+    std::lock_guard<std::mutex> lock(s_logLock);
+
+    // Logged whatever the build's logging level, as the check is only built in on purpose.
+    size_t logged = 0;
+    for (ViolationRecord & record : s_records)
+    {
+        if (!record.ready.load(std::memory_order_acquire))
+            continue;
+
+        const uint64_t count = record.count.load(std::memory_order_relaxed);
+        if (count == record.logged)
+            continue;
+
+        LabSoundLog(__FILE__, __LINE__, "Realtime violation: %s while rendering, %llu times, at",
+                    kindName(record.kind), static_cast<unsigned long long>(count));
+        for (const std::string & frame : symbolize(record.frames, record.depth))
+            LabSoundLog(__FILE__, __LINE__, "    %s", frame.c_str());
+
+        record.logged = count;
+        ++logged;
+    }
+
+    const uint64_t overflow = s_overflow.load(std::memory_order_relaxed);
+    if (overflow != s_overflowLogged)
+    {
+        LabSoundLog(__FILE__, __LINE__, "Realtime violations: %llu more from call stacks that weren't recorded",
+                    static_cast<unsigned long long>(overflow - s_overflowLogged));
+        s_overflowLogged = overflow;
+    }
+
+    return logged;
+}
+
+} // namespace lab
+
+#if defined(LABSOUND_RT_CHECK)
+
+#if defined(__GLIBC__)
+
+// glibc's allocator is reached through its __libc_ entry points, so malloc itself can be interposed, catching C
+// allocations and operator new alike.
+extern "C"
+{
+    void * __libc_malloc(size_t size);
+    void * __libc_calloc(size_t count, size_t size);
+    void * __libc_realloc(void * pointer, size_t size);
+    void __libc_free(void * pointer);
+
+    void * malloc(size_t size) noexcept
+    {
+        if (lab::t_realtimeDepth)
+            lab::recordViolation(lab::AudioRealtimeViolation::Kind::Allocation);
+        return __libc_malloc(size);
+    }
+
+    void * calloc(size_t count, size_t size) noexcept
+    {
+        if (lab::t_realtimeDepth)
+            lab::recordViolation(lab::AudioRealtimeViolation::Kind::Allocation);
+        return __libc_calloc(count, size);
+    }
+
+    void * realloc(void * pointer, size_t size) noexcept
+    {
+        if (lab::t_realtimeDepth)
+            lab::recordViolation(lab::AudioRealtimeViolation::Kind::Allocation);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void * pointer) noexcept
+    {
+        if (pointer && lab::t_realtimeDepth)
+            lab::recordViolation(lab::AudioRealtimeViolation::Kind::Deallocation);
+        __libc_free(pointer);
+    }
+
+    // try_lock is what the render thread is meant to use, so only blocking locks are caught. The real function
+    // is looked up without a function local static, whose guard could itself lock.
+    int pthread_mutex_lock(pthread_mutex_t * mutex) noexcept
+    {
+        using LockFunction = int (*)(pthread_mutex_t *);
+        static std::atomic<LockFunction> s_lock{ nullptr };
+
+        LockFunction lock = s_lock.load(std::memory_order_acquire);
+        if (!lock)
+        {
+            lock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+            s_lock.store(lock, std::memory_order_release);
+        }
+
+        if (lab::t_realtimeDepth)
+            lab::recordViolation(lab::AudioRealtimeViolation::Kind::Lock);
+        return lock(mutex);
+    }
+}
+
+#else
+
+// Elsewhere malloc can't be portably interposed, so C++ allocations are caught by replacing operator new and
+// delete; the sized and nothrow forms are replaced as well, as they don't all forward to these everywhere.
+void * operator new(std::size_t size)
+{
+    if (lab::t_realtimeDepth)
+        lab::recordViolation(lab::AudioRealtimeViolation::Kind::Allocation);
+    if (void * pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    if (lab::t_realtimeDepth)
+        lab::recordViolation(lab::AudioRealtimeViolation::Kind::Allocation);
+    return std::malloc(size ? size : 1);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t & tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void * pointer) noexcept
+{
+    if (pointer && lab::t_realtimeDepth)
+        lab::recordViolation(lab::AudioRealtimeViolation::Kind::Deallocation);
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void * pointer, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void * pointer, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer);
+}
+
+#endif
+
+#endif // LABSOUND_RT_CHECK
@@ -0,0 +1,168 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+
+#include "internal/RenderWorkerPool.h"
+#include "internal/DenormalDisabler.h"
+#include "internal/RealtimeCheck.h"
+#include "internal/ThreadScheduling.h"
+
+#include <chrono>
+
+namespace lab {
+
+namespace
+{
+    // A worker keeps spinning for a little longer than one render quantum at 44.1kHz before it goes to sleep, so
+    // that a steadily rendering context never has to wake its workers through the operating system.
+    const auto SpinDuration = std::chrono::milliseconds(4);
+
+    inline uint64_t packRange(uint32_t begin, uint32_t end)
+    {
+        return static_cast<uint64_t>(begin) | (static_cast<uint64_t>(end) << 32);
+    }
+
+    inline uint32_t rangeBegin(uint64_t bounds) { return static_cast<uint32_t>(bounds); }
+    inline uint32_t rangeEnd(uint64_t bounds) { return static_cast<uint32_t>(bounds >> 32); }
+}
+
+RenderWorkerPool::RenderWorkerPool(size_t workerCount, const AudioThreadPolicy & policy, double quantumSeconds)
+: m_policy(policy)
+, m_quantumSeconds(quantumSeconds)
+, m_participantCount(workerCount + 1)
+{
+    m_ranges.reset(new Range[m_participantCount]);
+
+    for (size_t i = 0; i < workerCount; ++i)
+        m_workers.emplace_back(&RenderWorkerPool::workerEntry, this, i + 1);
+}
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_shouldRun = false;
+    }
+    m_wake.notify_all();
+
+    for (auto & worker : m_workers)
+        if (worker.joinable())
+            worker.join();
+}
+
+bool RenderWorkerPool::take(size_t participant, bool fromBack, uint32_t & item)
+{
+    std::atomic<uint64_t> & bounds = m_ranges[participant].bounds;
+    uint64_t current = bounds.load();
+
+    while (rangeBegin(current) < rangeEnd(current))
+    {
+        uint32_t begin = rangeBegin(current);
+        uint32_t end = rangeEnd(current);
+        uint64_t desired = fromBack ? packRange(begin, end - 1) : packRange(begin + 1, end);
+
+        if (bounds.compare_exchange_weak(current, desired))
+        {
+            item = fromBack ? end - 1 : begin;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RenderWorkerPool::processOne(size_t participant)
+{
+    uint32_t item;
+    bool found = take(participant, false, item);
+
+    for (size_t i = 1; !found && i < m_participantCount; ++i)
+        found = take((participant + i) % m_participantCount, true, item);
+
+    if (!found)
+        return false;
+
+    // The task can only change once every item of the current level has completed, so having claimed an
+    // item guarantees that m_task and m_userData are the values published with it.
+    m_task(m_userData, item);
+    m_remaining.fetch_sub(1);
+    return true;
+}
+
+void RenderWorkerPool::run(Task task, void * userData, size_t count)
+{
+    if (!count)
+        return;
+
+    if (m_workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            task(userData, i);
+        return;
+    }
+
+    m_task = task;
+    m_userData = userData;
+    m_remaining = count;
+
+    // Deal out contiguous ranges, the first ones taking one extra item each if the level doesn't divide evenly.
+    size_t share = count / m_participantCount;
+    size_t extra = count % m_participantCount;
+    size_t begin = 0;
+    for (size_t p = 0; p < m_participantCount; ++p)
+    {
+        size_t end = begin + share + (p < extra ? 1 : 0);
+        m_ranges[p].bounds.store(packRange(static_cast<uint32_t>(begin), static_cast<uint32_t>(end)));
+        begin = end;
+    }
+
+    m_generation.fetch_add(1);
+
+    if (m_sleeping.load())
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wake.notify_all();
+    }
+
+    while (processOne(0)) { }
+
+    // Barrier: the level is complete once the items claimed by other participants have finished too.
+    while (m_remaining.load())
+        std::this_thread::yield();
+}
+
+void RenderWorkerPool::workerEntry(size_t participant)
+{
+    DenormalDisabler denormalDisabler;
+
+    m_policyFailures.fetch_or(ApplyAudioThreadPolicy(m_policy, "render worker", m_quantumSeconds, static_cast<int>(participant - 1)));
+
+    uint32_t seen = m_generation.load();
+
+    while (m_shouldRun)
+    {
+        auto idleSince = std::chrono::steady_clock::now();
+        uint32_t spins = 0;
+
+        while (m_generation.load() == seen && m_shouldRun)
+        {
+            if ((++spins & 63) || std::chrono::steady_clock::now() - idleSince < SpinDuration)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_sleeping.fetch_add(1);
+            m_wake.wait(lock, [this, seen]() { return m_generation.load() != seen || !m_shouldRun; });
+            m_sleeping.fetch_sub(1);
+        }
+
+        seen = m_generation.load();
+
+        LABSOUND_REALTIME_SCOPE();
+        while (processOne(participant)) { }
+    }
+}
+
+} // namespace lab
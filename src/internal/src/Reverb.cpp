@@ -9,105 +9,76 @@
 
 #include "LabSound/core/AudioBus.h"
 #include "LabSound/core/Macros.h"
-#include "LabSound/extended/AudioFileReader.h"
 
-#include <math.h>
-
-#if defined(LABSOUND_PLATFORM_OSX)
-using namespace std;
-#endif
+#include <algorithm>
 
 namespace lab {
 
 using namespace VectorMath;
 
-// Empirical gain calibration tested across many impulse responses to ensure perceived volume is same as dry (unprocessed) signal
-const float GainCalibration = -58;
-const float GainCalibrationSampleRate = 44100;
-
-// A minimum power value to when normalizing a silent (or very quiet) impulse response
-const float MinPower = 0.000125f;
-    
-static float calculateNormalizationScale(AudioBus* response)
+Reverb::Reverb(std::shared_ptr<const PreparedImpulse> impulse, size_t renderSliceSize, size_t numberOfChannels)
+    : m_impulseResponseLength(impulse->length())
+    , m_numberOfResponseChannels(impulse->numberOfChannels())
 {
-    // Normalize by RMS power
-    size_t numberOfChannels = response->numberOfChannels();
-    size_t length = response->length();
-
-    float power = 0;
-
-    for (size_t i = 0; i < numberOfChannels; ++i) 
-    {
-        float channelPower = 0;
-        vsvesq(response->channel(i)->data(), 1, &channelPower, length);
-        power += channelPower;
+    // A four channel impulse response is "True" stereo, a 2 by 2 matrix of LL, LR, RL and RR responses
+    if (m_numberOfResponseChannels == Channels::Quad) {
+        m_matrixConvolver = std::unique_ptr<ReverbConvolver>(
+            new ReverbConvolver(impulse, 2, 2, PreparedImpulse::matrixRoutes(2, 2), renderSliceSize, 0));
+        m_matrixSources.resize(2);
+        m_matrixDestinations.resize(2);
+        return;
     }
 
-    power = sqrt(power / (numberOfChannels * length));
-
-    // Protect against accidental overload
-    if (std::isinf(power) || std::isnan(power) || power < MinPower)
-        power = MinPower;
+    // The reverb can handle a mono impulse response and still do stereo processing, with a convolver per input channel
+    size_t numberOfConvolvers = std::max(m_numberOfResponseChannels, std::min<size_t>(numberOfChannels, Channels::Stereo));
+    m_convolvers.reserve(numberOfConvolvers);
 
-    float scale = 1 / power;
-
-    scale *= powf(10, GainCalibration * 0.05f); // calibrate to make perceived volume same as unprocessed
-
-    // Scale depends on sample-rate.
-    if (response->sampleRate())
-        scale *= GainCalibrationSampleRate / response->sampleRate();
-
-    // True-stereo compensation
-    if (response->numberOfChannels() == Channels::Quad)
-        scale *= 0.5f;
+    size_t convolverRenderPhase = 0;
+    for (size_t i = 0; i < numberOfConvolvers; ++i) {
+        m_convolvers.push_back(
+           std::unique_ptr<ReverbConvolver>(
+               new ReverbConvolver(impulse, i % m_numberOfResponseChannels, renderSliceSize, convolverRenderPhase)));
 
-    return scale;
+        convolverRenderPhase += renderSliceSize;
+    }
 }
 
-Reverb::Reverb(AudioBus* impulseResponse, size_t renderSliceSize, size_t maxFFTSize, size_t numberOfChannels, bool useBackgroundThreads, bool normalize)
+Reverb::Reverb(std::shared_ptr<const PreparedImpulse> impulse, size_t renderSliceSize, size_t numberOfInputs, size_t numberOfOutputs)
+    : m_impulseResponseLength(impulse->length())
+    , m_numberOfResponseChannels(impulse->numberOfChannels())
+    , m_matrixSources(numberOfInputs)
+    , m_matrixDestinations(numberOfOutputs)
 {
-    float scale = 1;
-
-    if (normalize) {
-        scale = calculateNormalizationScale(impulseResponse);
-
-        if (scale)
-            impulseResponse->scale(scale);
-    }
-
-    initialize(impulseResponse, renderSliceSize, maxFFTSize, numberOfChannels, useBackgroundThreads);
+    bool isMatrixGood = numberOfInputs && numberOfOutputs && m_numberOfResponseChannels == numberOfInputs * numberOfOutputs;
+    ASSERT(isMatrixGood);
+    if (!isMatrixGood)
+        return;
 
-    // Undo scaling since this shouldn't be a destructive operation on impulseResponse.
-    // FIXME: What about roundoff? Perhaps consider making a temporary scaled copy
-    // instead of scaling and unscaling in place.
-    if (normalize && scale)
-        impulseResponse->scale(1 / scale);
+    m_matrixConvolver = std::unique_ptr<ReverbConvolver>(
+        new ReverbConvolver(impulse, numberOfInputs, numberOfOutputs, PreparedImpulse::matrixRoutes(numberOfInputs, numberOfOutputs), renderSliceSize, 0));
 }
 
-void Reverb::initialize(AudioBus* impulseResponseBuffer, size_t renderSliceSize, size_t maxFFTSize, size_t numberOfChannels, bool useBackgroundThreads)
+void Reverb::processMatrix(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus* destinationBus, size_t framesToProcess)
 {
-    m_impulseResponseLength = impulseResponseBuffer->length();
-
-    // The reverb can handle a mono impulse response and still do stereo processing
-    size_t numResponseChannels = impulseResponseBuffer->numberOfChannels();
-    m_convolvers.reserve(numberOfChannels);
-
-    int convolverRenderPhase = 0;
-    for (size_t i = 0; i < numResponseChannels; ++i) {
-        AudioChannel* channel = impulseResponseBuffer->channel(i);
-
-        m_convolvers.push_back(
-           std::unique_ptr<ReverbConvolver>(
-               new ReverbConvolver(channel, renderSliceSize, maxFFTSize,
-                                  convolverRenderPhase, useBackgroundThreads)));
-
-        convolverRenderPhase += renderSliceSize;
+    size_t numInputChannels = sourceBus->numberOfChannels();
+    size_t numMatrixInputs = m_matrixConvolver->numberOfInputs();
+    size_t numMatrixOutputs = m_matrixConvolver->numberOfOutputs();
+
+    // A mono input feeds every input of the matrix, as in processing mono with a "True" stereo impulse response (1 -> 4 -> 2).
+    // This is an inefficient use of the matrix, but we should handle the case.
+    bool isMatrixingSupported = (numInputChannels == numMatrixInputs || numInputChannels == Channels::Mono)
+        && destinationBus->numberOfChannels() == numMatrixOutputs;
+    if (!isMatrixingSupported) {
+        destinationBus->zero();
+        return;
     }
 
-    // For "True" stereo processing we allocate a temporary buffer to avoid repeatedly allocating it in the process() method.
-    // It can be bad to allocate memory in a real-time thread.
-    if (numResponseChannels == Channels::Quad)
-        m_tempBuffer = std::unique_ptr<AudioBus>(new AudioBus(2, MaxFrameSize));
+    for (size_t i = 0; i < numMatrixInputs; ++i)
+        m_matrixSources[i] = sourceBus->channel(numInputChannels == numMatrixInputs ? i : 0);
+    for (size_t i = 0; i < numMatrixOutputs; ++i)
+        m_matrixDestinations[i] = destinationBus->channel(i);
+
+    m_matrixConvolver->process(r, m_matrixSources.data(), m_matrixDestinations.data(), framesToProcess);
 }
 
 void Reverb::process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus* destinationBus, size_t framesToProcess)
@@ -121,6 +92,14 @@ void Reverb::process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus*
     if (!isSafeToProcess)
         return;
 
+    if (!m_matrixSources.empty()) {
+        if (m_matrixConvolver)
+            processMatrix(r, sourceBus, destinationBus, framesToProcess);
+        else
+            destinationBus->zero();
+        return;
+    }
+
     // For now only handle mono or stereo output
     if (destinationBus->numberOfChannels() > Channels::Stereo) 
     {
@@ -134,7 +113,7 @@ void Reverb::process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus*
     // Handle input -> output matrixing...
     size_t numInputChannels = sourceBus->numberOfChannels();
     size_t numOutputChannels = destinationBus->numberOfChannels();
-    size_t numReverbChannels = m_convolvers.size();
+    size_t numReverbChannels = m_numberOfResponseChannels;
 
     if (numInputChannels == Channels::Stereo && numReverbChannels == Channels::Stereo && numOutputChannels == Channels::Stereo) {
         // 2 -> 2 -> 2
@@ -142,14 +121,14 @@ void Reverb::process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus*
         AudioChannel* destinationChannelR = destinationBus->channelByType(Channel::Right);
         m_convolvers[0]->process(r, sourceChannelL, destinationChannelL, framesToProcess);
         m_convolvers[1]->process(r, sourceChannelR, destinationChannelR, framesToProcess);
-    } else if (numInputChannels == Channels::Stereo && numReverbChannels == Channels::Mono && numOutputChannels == Channels::Stereo) {
+    } else if (numInputChannels == Channels::Stereo && numReverbChannels == Channels::Mono && numOutputChannels == Channels::Stereo && m_convolvers.size() == Channels::Stereo) {
         // LabSound added this case, should submit it back to WebKit after it's known to work correctly
         // because the initialize method says that a mono-IR is expected to work with a stero in/out setup
-        // 2 -> 1 -> 2
+        // 2 -> 1 -> 2, with a convolver per input channel sharing the response
         const AudioChannel* sourceChannelR = sourceBus->channelByType(Channel::Right);
         AudioChannel* destinationChannelR = destinationBus->channelByType(Channel::Right);
         m_convolvers[0]->process(r, sourceChannelL, destinationChannelL, framesToProcess);
-        m_convolvers[0]->process(r, sourceChannelR, destinationChannelR, framesToProcess);
+        m_convolvers[1]->process(r, sourceChannelR, destinationChannelR, framesToProcess);
     } else  if (numInputChannels == Channels::Mono && numOutputChannels == Channels::Stereo && numReverbChannels == Channels::Stereo) {
         // 1 -> 2 -> 2
         for (int i = 0; i < 2; ++i) {
@@ -170,40 +149,6 @@ void Reverb::process(ContextRenderLock& r, const AudioBus* sourceBus, AudioBus*
     } else if (numInputChannels == Channels::Mono && numReverbChannels == Channels::Mono && numOutputChannels == Channels::Mono) {
         // 1 -> 1 -> 1
         m_convolvers[0]->process(r, sourceChannelL, destinationChannelL, framesToProcess);
-    } else if (numInputChannels == Channels::Stereo && numReverbChannels == Channels::Quad && numOutputChannels == Channels::Stereo) {
-        // 2 -> 4 -> 2 ("True" stereo)
-        const AudioChannel* sourceChannelR = sourceBus->channelByType(Channel::Right);
-        AudioChannel* destinationChannelR = destinationBus->channelByType(Channel::Right);
-
-        AudioChannel* tempChannelL = m_tempBuffer->channelByType(Channel::Left);
-        AudioChannel* tempChannelR = m_tempBuffer->channelByType(Channel::Right);
-
-        // Process left virtual source
-        m_convolvers[0]->process(r, sourceChannelL, destinationChannelL, framesToProcess);
-        m_convolvers[1]->process(r, sourceChannelL, destinationChannelR, framesToProcess);
-
-        // Process right virtual source
-        m_convolvers[2]->process(r, sourceChannelR, tempChannelL, framesToProcess);
-        m_convolvers[3]->process(r, sourceChannelR, tempChannelR, framesToProcess);
-
-        destinationBus->sumFrom(*m_tempBuffer);
-    } else if (numInputChannels == Channels::Mono && numReverbChannels == Channels::Quad && numOutputChannels == Channels::Stereo) {
-        // 1 -> 4 -> 2 (Processing mono with "True" stereo impulse response)
-        // This is an inefficient use of a four-channel impulse response, but we should handle the case.
-        AudioChannel* destinationChannelR = destinationBus->channelByType(Channel::Right);
-
-        AudioChannel* tempChannelL = m_tempBuffer->channelByType(Channel::Left);
-        AudioChannel* tempChannelR = m_tempBuffer->channelByType(Channel::Right);
-
-        // Process left virtual source
-        m_convolvers[0]->process(r, sourceChannelL, destinationChannelL, framesToProcess);
-        m_convolvers[1]->process(r, sourceChannelL, destinationChannelR, framesToProcess);
-
-        // Process right virtual source
-        m_convolvers[2]->process(r, sourceChannelL, tempChannelL, framesToProcess);
-        m_convolvers[3]->process(r, sourceChannelL, tempChannelR, framesToProcess);
-
-        destinationBus->sumFrom(*m_tempBuffer);
     } else {
         // Handle gracefully any unexpected / unsupported matrixing
         // FIXME: add code for 5.1 support...
@@ -216,11 +161,40 @@ void Reverb::reset()
 {
     for (size_t i = 0; i < m_convolvers.size(); ++i)
         m_convolvers[i]->reset();
+
+    if (m_matrixConvolver)
+        m_matrixConvolver->reset();
+}
+
+void Reverb::setTailLimit(size_t frames)
+{
+    for (auto& convolver : m_convolvers)
+        convolver->setTailLimit(frames);
+
+    if (m_matrixConvolver)
+        m_matrixConvolver->setTailLimit(frames);
 }
 
 size_t Reverb::latencyFrames() const
 {
+    if (m_matrixConvolver)
+        return m_matrixConvolver->latencyFrames();
     return !m_convolvers.empty() ? (*m_convolvers.begin())->latencyFrames() : 0;
 }
 
+std::shared_ptr<const PreparedImpulse> Reverb::impulse() const
+{
+    if (m_matrixConvolver)
+        return m_matrixConvolver->impulse();
+    return !m_convolvers.empty() ? m_convolvers.front()->impulse() : nullptr;
+}
+
+size_t Reverb::memoryBytes() const
+{
+    size_t bytes = m_matrixConvolver ? m_matrixConvolver->memoryBytes() : 0;
+    for (auto& convolver : m_convolvers)
+        bytes += convolver->memoryBytes();
+    return bytes;
+}
+
 } // namespace lab
@@ -5,6 +5,7 @@
 #include "LabSound/extended/AudioContextLock.h"
 
 #include "internal/ReverbConvolverStage.h"
+#include "internal/PreparedImpulse.h"
 #include "internal/VectorMath.h"
 #include "internal/ReverbAccumulationBuffer.h"
 #include "internal/ReverbConvolver.h"
@@ -15,26 +16,39 @@ namespace lab {
 
 using namespace VectorMath;
 
-ReverbConvolverStage::ReverbConvolverStage(const float* impulseResponse, size_t, size_t reverbTotalLatency, size_t stageOffset, size_t stageLength,
-                                           size_t fftSize, size_t renderPhase, size_t renderSliceSize, ReverbAccumulationBuffer* accumulationBuffer, bool directMode)
-    : m_accumulationBuffer(accumulationBuffer)
+ReverbConvolverStage::ReverbConvolverStage(const PreparedImpulse& impulse, size_t stageIndex, const std::vector<ConvolutionRoute>& routes,
+                                           size_t numberOfInputs, size_t reverbTotalLatency, size_t renderPhase, size_t renderSliceSize,
+                                           const std::vector<ReverbAccumulationBuffer*>& accumulationBuffers)
+    : m_numberOfInputs(numberOfInputs)
+    , m_numberOfOutputs(accumulationBuffers.size())
+    , m_accumulationBuffers(accumulationBuffers)
     , m_accumulationReadIndex(0)
     , m_inputReadIndex(0)
-    , m_directMode(directMode)
+    , m_backgroundSources(numberOfInputs)
+    , m_sources(numberOfInputs)
+    , m_destinations(accumulationBuffers.size())
+    , m_routes(routes)
+    , m_offset(impulse.stages(routes.front().channel)[stageIndex].offset)
 {
-    ASSERT(impulseResponse);
-    ASSERT(accumulationBuffer);
-
-    if (!m_directMode) {
-        m_fftKernel = std::unique_ptr<FFTFrame>(new FFTFrame(fftSize));
-        m_fftKernel->doPaddedFFT(impulseResponse + stageOffset, stageLength);
-        m_fftConvolver = std::unique_ptr<FFTConvolver>(new FFTConvolver(fftSize));
+    ASSERT(!routes.empty() && !accumulationBuffers.empty());
+
+    // Every channel has the same stages, so the first route's describes them all.
+    const PreparedStage& stage = impulse.stages(routes.front().channel)[stageIndex];
+    size_t stageOffset = stage.offset;
+    size_t fftSize = stage.fftSize;
+    m_directMode = stage.directKernel != nullptr;
+
+    if (m_directMode) {
+        for (const ConvolutionRoute& route : routes) {
+            m_directKernels.push_back(impulse.stages(route.channel)[stageIndex].directKernel.get());
+            m_directConvolvers.push_back(std::unique_ptr<DirectConvolver>(new DirectConvolver(renderSliceSize)));
+        }
     } else {
-        m_directKernel = std::unique_ptr<AudioFloatArray>(new AudioFloatArray(fftSize / 2));
-        m_directKernel->copyToRange(impulseResponse + stageOffset, 0, fftSize / 2);
-        m_directConvolver = std::unique_ptr<DirectConvolver>(new DirectConvolver(renderSliceSize));
+        std::vector<PartitionedConvolver::Path> paths;
+        for (const ConvolutionRoute& route : routes)
+            paths.push_back(PartitionedConvolver::Path { route.input, route.output, &impulse.stages(route.channel)[stageIndex].partitions });
+        m_partitionedConvolver = std::unique_ptr<PartitionedConvolver>(new PartitionedConvolver(numberOfInputs, m_numberOfOutputs, paths));
     }
-    m_temporaryBuffer.allocate(renderSliceSize);
 
     // The convolution stage at offset stageOffset needs to have a corresponding delay to cancel out the offset.
     size_t totalDelay = stageOffset + reverbTotalLatency;
@@ -60,73 +74,146 @@ ReverbConvolverStage::ReverbConvolverStage(const float* impulseResponse, size_t,
 
     size_t delayBufferSize = m_preDelayLength < fftSize ? fftSize : m_preDelayLength;
     delayBufferSize = delayBufferSize < renderSliceSize ? renderSliceSize : delayBufferSize;
-    m_preDelayBuffer.allocate(delayBufferSize);
+    m_preDelayBufferSize = delayBufferSize;
+    if (m_preDelayLength > 0)
+        m_preDelayBuffer.allocate(delayBufferSize * numberOfInputs);
+
+    // In direct mode, the extra buffer receives each route's convolution before it is summed into its output.
+    m_temporaryBuffer.allocate(delayBufferSize * (m_numberOfOutputs + (m_directMode ? 1 : 0)));
+}
+
+ReverbConvolverStage::~ReverbConvolverStage()
+{
 }
 
 void ReverbConvolverStage::processInBackground(ReverbConvolver* convolver, size_t framesToProcess)
 {
-    ReverbInputBuffer* inputBuffer = convolver->inputBuffer();
-    float* source = inputBuffer->directReadFrom(&m_inputReadIndex, framesToProcess);
-    process(source, framesToProcess);
+    // The inputs are written together, so they are read together.
+    int readIndex = m_inputReadIndex;
+    for (size_t i = 0; i < m_numberOfInputs; ++i) {
+        readIndex = m_inputReadIndex;
+        m_backgroundSources[i] = convolver->inputBuffer(i)->directReadFrom(&readIndex, framesToProcess);
+    }
+    m_inputReadIndex = readIndex;
+
+    process(m_backgroundSources.data(), framesToProcess);
+}
+
+void ReverbConvolverStage::skipInBackground(ReverbConvolver* convolver, size_t framesToProcess)
+{
+    int readIndex = m_inputReadIndex;
+    for (size_t i = 0; i < m_numberOfInputs; ++i) {
+        readIndex = m_inputReadIndex;
+        m_backgroundSources[i] = convolver->inputBuffer(i)->directReadFrom(&readIndex, framesToProcess);
+    }
+    m_inputReadIndex = readIndex;
+
+    skip(m_backgroundSources.data(), framesToProcess);
+}
+
+void ReverbConvolverStage::setTailLimit(size_t frames)
+{
+    if (m_directMode)
+        return;
+
+    size_t halfSize = m_partitionedConvolver->fftSize() / 2;
+    size_t limit = frames > m_offset ? frames - m_offset : 0;
+    m_partitionedConvolver->setPartitionLimit(limit >= SIZE_MAX - halfSize ? SIZE_MAX : (limit + halfSize - 1) / halfSize);
+}
+
+void ReverbConvolverStage::skip(const float* const* sources, size_t framesToProcess)
+{
+    if (!sources || (m_preDelayLength > 0 && m_preReadWriteIndex + framesToProcess > m_preDelayBufferSize))
+        return;
+
+    // The accumulation buffers advance together, so the stage's place in them moves on though it adds nothing.
+    m_accumulationBuffers.front()->updateReadIndex(&m_accumulationReadIndex, framesToProcess);
+    m_skipped = true;
+
+    // The pre-delay is kept up to date, so that the stage resumes with recent input.
+    if (m_preDelayLength > 0) {
+        for (size_t i = 0; i < m_numberOfInputs; ++i)
+            memcpy(m_preDelayBuffer.data() + i * m_preDelayBufferSize + m_preReadWriteIndex, sources[i], sizeof(float) * framesToProcess);
+        m_preReadWriteIndex += framesToProcess;
+        if (m_preReadWriteIndex >= m_preDelayLength)
+            m_preReadWriteIndex = 0;
+    }
+
+    m_framesProcessed += framesToProcess;
 }
 
-void ReverbConvolverStage::process(const float* source, size_t framesToProcess)
+void ReverbConvolverStage::process(const float* const* sources, size_t framesToProcess)
 {
-    ASSERT(source);
-    if (!source)
+    ASSERT(sources);
+    if (!sources)
         return;
     
     // Deal with pre-delay stream : note special handling of zero delay.
-
-    const float* preDelayedSource;
-    float* preDelayedDestination;
-    float* temporaryBuffer;
-    bool isTemporaryBufferSafe = false;
     if (m_preDelayLength > 0) {
         // Handles both the read case (call to process() ) and the write case (memcpy() )
-        bool isPreDelaySafe = m_preReadWriteIndex + framesToProcess <= m_preDelayBuffer.size();
+        bool isPreDelaySafe = m_preReadWriteIndex + framesToProcess <= m_preDelayBufferSize;
         ASSERT(isPreDelaySafe);
         if (!isPreDelaySafe)
             return;
-
-        isTemporaryBufferSafe = framesToProcess <= m_temporaryBuffer.size();
-
-        preDelayedDestination = m_preDelayBuffer.data() + m_preReadWriteIndex;
-        preDelayedSource = preDelayedDestination;
-        temporaryBuffer = m_temporaryBuffer.data();        
-    } else {
-        // Zero delay
-        preDelayedDestination = 0;
-        preDelayedSource = source;
-        temporaryBuffer = m_preDelayBuffer.data();
-        
-        isTemporaryBufferSafe = framesToProcess <= m_preDelayBuffer.size();
     }
-    
+
+    bool isTemporaryBufferSafe = framesToProcess <= m_preDelayBufferSize;
     ASSERT(isTemporaryBufferSafe);
     if (!isTemporaryBufferSafe)
         return;
 
+    for (size_t i = 0; i < m_numberOfInputs; ++i) {
+        if (m_preDelayLength > 0)
+            m_sources[i] = m_preDelayBuffer.data() + i * m_preDelayBufferSize + m_preReadWriteIndex;
+        else
+            m_sources[i] = sources[i]; // Zero delay
+    }
+    for (size_t i = 0; i < m_numberOfOutputs; ++i)
+        m_destinations[i] = m_temporaryBuffer.data() + i * m_preDelayBufferSize;
+
     if (m_framesProcessed < m_preDelayLength) {
         // For the first m_preDelayLength frames don't process the convolver, instead simply buffer in the pre-delay.
         // But while buffering the pre-delay, we still need to update our index.
-        m_accumulationBuffer->updateReadIndex(&m_accumulationReadIndex, framesToProcess);
+        m_accumulationBuffers.front()->updateReadIndex(&m_accumulationReadIndex, framesToProcess);
     } else {
-        // Now, run the convolution (into the delay buffer).
+        if (m_skipped) {
+            if (!m_directMode)
+                m_partitionedConvolver->clearHistory();
+            else
+                for (auto& convolver : m_directConvolvers)
+                    convolver->reset();
+            m_skipped = false;
+        }
+
+        // Now, run the convolution (into the temporary buffers).
         // An expensive FFT will happen every fftSize / 2 frames.
-        // We process in-place here...
-        if (!m_directMode)
-            m_fftConvolver->process(m_fftKernel.get(), preDelayedSource, temporaryBuffer, framesToProcess);
-        else
-            m_directConvolver->process(m_directKernel.get(), preDelayedSource, temporaryBuffer, framesToProcess);
-
-        // Now accumulate into reverb's accumulation buffer.
-        m_accumulationBuffer->accumulate(temporaryBuffer, framesToProcess, &m_accumulationReadIndex, m_postDelayLength);
+        if (!m_directMode) {
+            m_partitionedConvolver->process(m_sources.data(), m_destinations.data(), framesToProcess);
+        } else {
+            float* routeDestination = m_temporaryBuffer.data() + m_numberOfOutputs * m_preDelayBufferSize;
+            for (size_t i = 0; i < m_numberOfOutputs; ++i)
+                memset(m_destinations[i], 0, sizeof(float) * framesToProcess);
+
+            for (size_t i = 0; i < m_routes.size(); ++i) {
+                float* destination = m_destinations[m_routes[i].output];
+                m_directConvolvers[i]->process(m_directKernels[i], m_sources[m_routes[i].input], routeDestination, framesToProcess);
+                vadd(routeDestination, 1, destination, 1, destination, 1, framesToProcess);
+            }
+        }
+
+        // Now accumulate into reverb's accumulation buffers, which all advance together.
+        int readIndex = m_accumulationReadIndex;
+        for (size_t i = 0; i < m_numberOfOutputs; ++i) {
+            readIndex = m_accumulationReadIndex;
+            m_accumulationBuffers[i]->accumulate(m_destinations[i], framesToProcess, &readIndex, m_postDelayLength);
+        }
+        m_accumulationReadIndex = readIndex;
     }
 
     // Finally copy input to pre-delay.
     if (m_preDelayLength > 0) {
-        memcpy(preDelayedDestination, source, sizeof(float) * framesToProcess);
+        for (size_t i = 0; i < m_numberOfInputs; ++i)
+            memcpy(m_preDelayBuffer.data() + i * m_preDelayBufferSize + m_preReadWriteIndex, sources[i], sizeof(float) * framesToProcess);
         m_preReadWriteIndex += framesToProcess;
 
         ASSERT(m_preReadWriteIndex <= m_preDelayLength);
@@ -139,15 +226,28 @@ void ReverbConvolverStage::process(const float* source, size_t framesToProcess)
 
 void ReverbConvolverStage::reset()
 {
-    if (!m_directMode)
-        m_fftConvolver->reset();
-    else
-        m_directConvolver->reset();
+    if (!m_directMode) {
+        m_partitionedConvolver->reset();
+    } else {
+        for (auto& convolver : m_directConvolvers)
+            convolver->reset();
+    }
     
     m_preDelayBuffer.zero();
+    m_skipped = false;
     m_accumulationReadIndex = 0;
     m_inputReadIndex = 0;
     m_framesProcessed = 0;
 }
 
+size_t ReverbConvolverStage::memoryBytes() const
+{
+    size_t bytes = (m_preDelayBuffer.size() + m_temporaryBuffer.size()) * sizeof(float);
+    if (m_partitionedConvolver)
+        bytes += m_partitionedConvolver->memoryBytes();
+    for (auto& convolver : m_directConvolvers)
+        bytes += convolver->memoryBytes();
+    return bytes;
+}
+
 } // namespace lab
@@ -0,0 +1,136 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/STFT.h"
+#include "internal/Assertions.h"
+#include "internal/VectorMath.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lab
+{
+
+namespace
+{
+    size_t nextPowerOfTwo(size_t n)
+    {
+        size_t size = 1;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+}
+
+STFT::STFT(WindowType window, size_t windowSize, size_t hopSize, size_t fftSize)
+    : m_windowSize(std::max<size_t>(windowSize, 1))
+    , m_hopSize(std::max<size_t>(std::min(hopSize, m_windowSize), 1))
+    , m_analysisWindow(m_windowSize)
+    , m_synthesisWindow(m_windowSize)
+    , m_input(m_windowSize)
+    , m_padded(nextPowerOfTwo(std::max(fftSize, m_windowSize)))
+    , m_frame(nextPowerOfTwo(std::max(fftSize, m_windowSize)))
+    , m_accumulator(m_windowSize)
+    , m_ready(m_hopSize)
+{
+    float * analysis = m_analysisWindow.data();
+    std::memcpy(analysis, windowCoefficients(window, m_windowSize), sizeof(float) * m_windowSize);
+
+    // Each output frame is the sum of the frames overlapping it, each weighted by the analysis and synthesis
+    // windows at its offset into them. Those offsets are the same modulo the hop, so dividing the synthesis
+    // window by the sum of the squared analysis window over them makes the weights add up to one.
+    float * synthesis = m_synthesisWindow.data();
+    for (size_t i = 0; i < m_hopSize; ++i)
+    {
+        double sum = 0;
+        for (size_t j = i; j < m_windowSize; j += m_hopSize)
+            sum += static_cast<double>(analysis[j]) * analysis[j];
+        for (size_t j = i; j < m_windowSize; j += m_hopSize)
+            synthesis[j] = sum > 1e-9 ? static_cast<float>(analysis[j] / sum) : 0.f;
+    }
+
+    reset();
+}
+
+size_t STFT::memoryBytes() const
+{
+    const size_t frames = m_analysisWindow.size() + m_synthesisWindow.size() + m_input.size() + m_padded.size()
+        + m_accumulator.size() + m_ready.size();
+    return frames * sizeof(float) + FFTFrame::memoryBytes(fftSize());
+}
+
+void STFT::reset()
+{
+    m_input.zero();
+    m_accumulator.zero();
+    m_ready.zero();
+    m_pending = 0;
+}
+
+FFTFrame & STFT::analyseFrame(const float * frame)
+{
+    float * padded = m_padded.data();
+    VectorMath::vmul(frame, 1, m_analysisWindow.data(), 1, padded, 1, m_windowSize);
+    std::memset(padded + m_windowSize, 0, sizeof(float) * (m_padded.size() - m_windowSize));
+    m_frame.doFFT(padded);
+    return m_frame;
+}
+
+void STFT::runFrame(const FrameCallback & onFrame, bool resynthesize)
+{
+    onFrame(analyseFrame(m_input.data()));
+
+    // The input moves on by a hop, leaving room for the next.
+    float * input = m_input.data();
+    std::memmove(input, input + m_hopSize, sizeof(float) * (m_windowSize - m_hopSize));
+
+    if (!resynthesize)
+        return;
+
+    // Only the window's span of the inverse transform is kept; what a changed spectrum spreads into the
+    // padding is dropped.
+    float * padded = m_padded.data();
+    float * accumulator = m_accumulator.data();
+    m_frame.doInverseFFT(padded);
+    VectorMath::vmul(padded, 1, m_synthesisWindow.data(), 1, padded, 1, m_windowSize);
+    VectorMath::vadd(accumulator, 1, padded, 1, accumulator, 1, m_windowSize);
+
+    // No later frame overlaps the first hop of the accumulator, so it is complete.
+    std::memcpy(m_ready.data(), accumulator, sizeof(float) * m_hopSize);
+    std::memmove(accumulator, accumulator + m_hopSize, sizeof(float) * (m_windowSize - m_hopSize));
+    std::memset(accumulator + m_windowSize - m_hopSize, 0, sizeof(float) * m_hopSize);
+}
+
+void STFT::analyse(const float * source, size_t framesToProcess, const FrameCallback & onFrame)
+{
+    process(source, nullptr, framesToProcess, onFrame);
+}
+
+void STFT::process(const float * source, float * destination, size_t framesToProcess, const FrameCallback & onFrame)
+{
+    ASSERT(source);
+
+    // Each span of input is taken before the same span of output is written, so the two may be the same.
+    const size_t inputOffset = m_windowSize - m_hopSize;
+    while (framesToProcess > 0)
+    {
+        const size_t frames = std::min(framesToProcess, m_hopSize - m_pending);
+        std::memcpy(m_input.data() + inputOffset + m_pending, source, sizeof(float) * frames);
+        if (destination)
+            std::memcpy(destination, m_ready.data() + m_pending, sizeof(float) * frames);
+
+        m_pending += frames;
+        if (m_pending == m_hopSize)
+        {
+            runFrame(onFrame, destination != nullptr);
+            m_pending = 0;
+        }
+
+        source += frames;
+        if (destination)
+            destination += frames;
+        framesToProcess -= frames;
+    }
+}
+
+} // namespace lab
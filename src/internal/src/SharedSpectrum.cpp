@@ -0,0 +1,135 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/SharedSpectrum.h"
+#include "internal/FFTFrame.h"
+#include "internal/VectorMath.h"
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioNode.h"
+#include "LabSound/core/AudioNodeInput.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace lab
+{
+
+namespace
+{
+    // The analyses in use. Entries of released ones are pruned as others are added.
+    std::mutex s_registryLock;
+    std::vector<std::weak_ptr<SharedSpectrum>> s_registry;
+}
+
+std::shared_ptr<SharedSpectrum> SharedSpectrum::acquire(const Key & key)
+{
+    if (!key.source)
+        return std::make_shared<SharedSpectrum>(key);
+
+    std::lock_guard<std::mutex> lock(s_registryLock);
+
+    for (auto it = s_registry.begin(); it != s_registry.end();)
+    {
+        std::shared_ptr<SharedSpectrum> spectrum = it->lock();
+        if (!spectrum)
+        {
+            it = s_registry.erase(it);
+            continue;
+        }
+        if (spectrum->key() == key)
+            return spectrum;
+        ++it;
+    }
+
+    std::shared_ptr<SharedSpectrum> spectrum = std::make_shared<SharedSpectrum>(key);
+    s_registry.push_back(spectrum);
+    return spectrum;
+}
+
+const void * SharedSpectrum::sourceOf(ContextRenderLock & r, AudioNodeInput * input)
+{
+    return input->numberOfRenderingConnections(r) == 1 ? input->renderingOutput(r, 0) : nullptr;
+}
+
+SharedSpectrum::SharedSpectrum(const Key & key)
+    : m_key(key)
+    , m_stft(key.window, key.windowSize, key.hopSize)
+    , m_mixed(AudioNode::ProcessingSizeInFrames)
+{
+    // Room for the frames a quantum completes, so that none is made while rendering.
+    const size_t frames = std::max<size_t>(key.quantumSize, 1) / m_stft.hopSize() + 1;
+    for (size_t i = 0; i < frames; ++i)
+    {
+        m_frames.emplace_back(new FFTFrame(m_stft.fftSize()));
+        m_inputs.emplace_back(new AudioFloatArray(m_stft.windowSize()));
+    }
+    m_frameEnds.resize(frames);
+}
+
+size_t SharedSpectrum::memoryBytes() const
+{
+    return m_stft.memoryBytes() + m_mixed.size() * sizeof(float)
+        + m_frames.size() * (FFTFrame::memoryBytes(m_stft.fftSize()) + m_stft.windowSize() * sizeof(float));
+}
+
+void SharedSpectrum::keep(FFTFrame & frame)
+{
+    // Only a quantum larger than the key's completes more frames than were made; the rest of them are dropped.
+    ++m_hops;
+    if (m_frameCount == m_frames.size())
+        return;
+
+    FFTFrame & kept = *m_frames[m_frameCount];
+    const size_t half = m_stft.fftSize() / 2;
+    std::memcpy(kept.realData(), frame.realData(), sizeof(float) * half);
+    std::memcpy(kept.imagData(), frame.imagData(), sizeof(float) * half);
+    std::memcpy(m_inputs[m_frameCount]->data(), m_stft.inputFrame(), sizeof(float) * m_stft.windowSize());
+    m_frameEnds[m_frameCount] = m_startFrame + m_hops * m_stft.hopSize();
+    ++m_frameCount;
+}
+
+void SharedSpectrum::analyse(ContextRenderLock & r, const AudioBus & bus, size_t framesToProcess, const FrameCallback & onFrame)
+{
+    const uint64_t quantum = r.context()->currentSampleFrame();
+    uint64_t claimed = m_claimedQuantum.load(std::memory_order_acquire);
+    if (claimed != quantum && m_claimedQuantum.compare_exchange_strong(claimed, quantum, std::memory_order_acq_rel))
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            m_startFrame = quantum;
+        }
+        m_frameCount = 0;
+
+        const size_t numberOfChannels = bus.numberOfChannels();
+        const float scale = 1.f / numberOfChannels;
+        float * mixed = m_mixed.data();
+        for (size_t offset = 0; offset < framesToProcess; offset += m_mixed.size())
+        {
+            const size_t frames = std::min(framesToProcess - offset, m_mixed.size());
+            VectorMath::vsmul(bus.channel(0)->data() + offset, 1, &scale, mixed, 1, frames);
+            for (size_t c = 1; c < numberOfChannels; ++c)
+                VectorMath::vsma(bus.channel(c)->data() + offset, 1, &scale, mixed, 1, frames);
+
+            m_stft.analyse(mixed, frames, [this](FFTFrame & frame) { keep(frame); });
+        }
+
+        m_readyQuantum.store(quantum, std::memory_order_release);
+    }
+    else
+    {
+        // Another consumer is analysing the quantum on another render worker; it takes no longer than its own
+        // analysis would have.
+        while (m_readyQuantum.load(std::memory_order_acquire) != quantum)
+            std::this_thread::yield();
+    }
+
+    for (size_t i = 0; i < m_frameCount; ++i)
+        onFrame(*m_frames[i], m_inputs[i]->data(), m_frameEnds[i]);
+}
+
+} // namespace lab
@@ -5,11 +5,13 @@
 #include "LabSound/core/Macros.h"
 #include "internal/SincResampler.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 #include "LabSound/core/AudioBus.h"
 
-#ifdef __SSE2__
-#include <emmintrin.h>
-#endif
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 using namespace std;
 
@@ -42,23 +44,13 @@ using namespace std;
 
 namespace lab {
 
-SincResampler::SincResampler(double scaleFactor, size_t kernelSize, size_t numberOfKernelOffsets)
-    : m_scaleFactor(scaleFactor)
-    , m_kernelSize(kernelSize)
-    , m_numberOfKernelOffsets(numberOfKernelOffsets)
-    , m_kernelStorage(m_kernelSize * (m_numberOfKernelOffsets + 1))
-    , m_virtualSourceIndex(0)
-    , m_blockSize(512)
-    , m_inputBuffer(m_blockSize + m_kernelSize) // See input buffer layout above.
-    , m_source(0)
-    , m_sourceFramesAvailable(0)
-    , m_sourceProvider(0)
-    , m_isBufferPrimed(false)
-{
-    initializeKernel();
-}
+// AudioArray is cache line aligned; a kernel stride of a cache line's floats keeps every kernel aligned with it.
+const size_t KernelAlignmentFrames = 16;
 
-void SincResampler::initializeKernel()
+namespace {
+
+// Fills kernels with the windowed sinc() kernels of the sub-sample offsets, kernelStride floats apart.
+void initializeKernels(AudioFloatArray & kernels, double scaleFactor, size_t kernelSize, size_t numberOfKernelOffsets, size_t kernelStride)
 {
     // Blackman window parameters.
     double alpha = 0.16;
@@ -67,22 +59,22 @@ void SincResampler::initializeKernel()
     double a2 = 0.5 * alpha;
 
     // sincScaleFactor is basically the normalized cutoff frequency of the low-pass filter.
-    double sincScaleFactor = m_scaleFactor > 1.0 ? 1.0 / m_scaleFactor : 1.0;
+    double sincScaleFactor = scaleFactor > 1.0 ? 1.0 / scaleFactor : 1.0;
 
     // The sinc function is an idealized brick-wall filter, but since we're windowing it the
     // transition from pass to stop does not happen right away. So we should adjust the
     // lowpass filter cutoff slightly downward to avoid some aliasing at the very high-end.
-    // FIXME: this value is empirical and to be more exact should vary depending on m_kernelSize.
+    // FIXME: this value is empirical and to be more exact should vary depending on kernelSize.
     sincScaleFactor *= 0.9;
 
-    int n = static_cast<int>(m_kernelSize);
+    int n = static_cast<int>(kernelSize);
     int halfSize = n / 2;
 
     // Generates a set of windowed sinc() kernels.
     // We generate a range of sub-sample offsets from 0.0 to 1.0.
-    for (size_t offsetIndex = 0; offsetIndex <= m_numberOfKernelOffsets; ++offsetIndex) 
+    for (size_t offsetIndex = 0; offsetIndex <= numberOfKernelOffsets; ++offsetIndex) 
     {
-        double subsampleOffset = static_cast<double>(offsetIndex) / m_numberOfKernelOffsets;
+        double subsampleOffset = static_cast<double>(offsetIndex) / numberOfKernelOffsets;
 
         for (int i = 0; i < n; ++i) {
             // Compute the sinc() with offset.
@@ -95,11 +87,64 @@ void SincResampler::initializeKernel()
             double window = a0 - a1 * cos(2.0 * piDouble * x) + a2 * cos(4.0 * piDouble * x);
 
             // Window the sinc() function and store at the correct offset.
-            m_kernelStorage[static_cast<size_t>(i) + offsetIndex * m_kernelSize] = static_cast<float>(sinc * window);
+            kernels[static_cast<size_t>(i) + offsetIndex * kernelStride] = static_cast<float>(sinc * window);
         }
     }
 }
 
+// The kernels in use, by scale factor, kernel size and number of kernel offsets. Entries of released kernels are
+// pruned as others are added.
+typedef std::map<std::tuple<double, size_t, size_t>, std::weak_ptr<const AudioFloatArray>> KernelRegistry;
+
+std::mutex s_kernelRegistryLock;
+KernelRegistry s_kernelRegistry;
+
+std::shared_ptr<const AudioFloatArray> kernelsFor(double scaleFactor, size_t kernelSize, size_t numberOfKernelOffsets, size_t kernelStride)
+{
+    std::lock_guard<std::mutex> lock(s_kernelRegistryLock);
+
+    std::weak_ptr<const AudioFloatArray> & entry = s_kernelRegistry[std::make_tuple(scaleFactor, kernelSize, numberOfKernelOffsets)];
+    std::shared_ptr<const AudioFloatArray> kernels = entry.lock();
+    if (kernels)
+        return kernels;
+
+    for (auto it = s_kernelRegistry.begin(); it != s_kernelRegistry.end();)
+    {
+        if (it->second.expired() && &it->second != &entry)
+            it = s_kernelRegistry.erase(it);
+        else
+            ++it;
+    }
+
+    std::shared_ptr<AudioFloatArray> made = std::make_shared<AudioFloatArray>(kernelStride * (numberOfKernelOffsets + 1));
+    initializeKernels(*made, scaleFactor, kernelSize, numberOfKernelOffsets, kernelStride);
+    entry = made;
+    return made;
+}
+
+} // namespace
+
+SincResampler::SincResampler(double scaleFactor, size_t kernelSize, size_t numberOfKernelOffsets, size_t blockSize)
+    : m_scaleFactor(scaleFactor)
+    , m_kernelSize(kernelSize)
+    , m_numberOfKernelOffsets(numberOfKernelOffsets)
+    , m_kernelStride((kernelSize + KernelAlignmentFrames - 1) / KernelAlignmentFrames * KernelAlignmentFrames)
+    , m_kernelStorage(kernelsFor(scaleFactor, kernelSize, numberOfKernelOffsets, m_kernelStride))
+    , m_virtualSourceIndex(0)
+    , m_blockSize(blockSize)
+    , m_inputBuffer(m_blockSize + m_kernelSize) // See input buffer layout above.
+    , m_source(0)
+    , m_sourceFramesAvailable(0)
+    , m_sourceProvider(0)
+    , m_sourceBus(new AudioBus(1, m_blockSize + m_kernelSize / 2, false))
+    , m_isBufferPrimed(false)
+{
+}
+
+SincResampler::~SincResampler()
+{
+}
+
 void SincResampler::consumeSource(float* buffer, size_t numberOfSourceFrames)
 {
     ASSERT(m_sourceProvider);
@@ -107,69 +152,62 @@ void SincResampler::consumeSource(float* buffer, size_t numberOfSourceFrames)
         return;
     
     // Wrap the provided buffer by an AudioBus for use by the source provider.
-    AudioBus bus(1, numberOfSourceFrames, false);
-
     // FIXME: Find a way to make the following const-correct:
-    bus.setChannelMemory(0, buffer, numberOfSourceFrames);
+    m_sourceBus->setChannelMemory(0, buffer, numberOfSourceFrames);
     
-    m_sourceProvider->provideInput(&bus, numberOfSourceFrames);
+    m_sourceProvider->provideInput(m_sourceBus.get(), numberOfSourceFrames);
 }
 
-namespace {
-
-// BufferSourceProvider is an AudioSourceProvider wrapping an in-memory buffer.
-
-class BufferSourceProvider : public AudioSourceProvider {
-public:
-    BufferSourceProvider(const float* source, size_t numberOfSourceFrames)
-        : m_source(source)
-        , m_sourceFramesAvailable(numberOfSourceFrames)
-    {
-    }
-    
-    // Consumes samples from the in-memory buffer.
-    virtual void provideInput(AudioBus* bus, size_t framesToProcess)
-    {
-        ASSERT(m_source && bus);
-        if (!m_source || !bus)
-            return;
-            
-        float* buffer = bus->channel(0)->mutableData();
-
-        // Clamp to number of frames available and zero-pad.
-        size_t framesToCopy = min(m_sourceFramesAvailable, framesToProcess);
-        memcpy(buffer, m_source, sizeof(float) * framesToCopy);
+void SincResampler::process(const float* source, float* destination, size_t numberOfSourceFrames)
+{
+    size_t numberOfDestinationFrames = static_cast<size_t>(numberOfSourceFrames / m_scaleFactor);
+    process(source, numberOfSourceFrames, destination, 0, numberOfDestinationFrames);
+}
 
-        // Zero-pad if necessary.
-        if (framesToCopy < framesToProcess)
-            memset(buffer + framesToCopy, 0, sizeof(float) * (framesToProcess - framesToCopy));
+void SincResampler::process(const float* source, size_t numberOfSourceFrames, float* destination, size_t firstFrame, size_t framesToProcess) const
+{
+    bool isGood = source && destination && !(m_kernelSize % 2);
+    ASSERT(isGood);
+    if (!isGood)
+        return;
 
-        m_sourceFramesAvailable -= framesToCopy;
-        m_source += framesToCopy;
-    }
-    
-private:
-    const float* m_source;
-    size_t m_sourceFramesAvailable;
-};
+    // A streamed conversion has kernelSize / 2 frames of silence ahead of the source (r1 above), so the kernel for
+    // the frame at a position starts that many frames before it. Near the ends of the source, the frames the kernel
+    // covers are copied with the silence around them.
+    const ptrdiff_t halfKernel = static_cast<ptrdiff_t>(m_kernelSize / 2);
+    const ptrdiff_t sourceLength = static_cast<ptrdiff_t>(numberOfSourceFrames);
+    AudioFloatArray padded(m_kernelSize);
 
-} // namespace
+    for (size_t i = 0; i < framesToProcess; ++i)
+    {
+        // The position is worked out from the frame's index, rather than summed, so that it doesn't depend on
+        // where the range started.
+        double virtualSourceIndex = static_cast<double>(firstFrame + i) * m_scaleFactor;
+        ptrdiff_t sourceIndexI = static_cast<ptrdiff_t>(virtualSourceIndex);
+        double subsampleRemainder = virtualSourceIndex - sourceIndexI;
+
+        double virtualOffsetIndex = subsampleRemainder * m_numberOfKernelOffsets;
+        int offsetIndex = static_cast<int>(virtualOffsetIndex);
+
+        const float* k1 = m_kernelStorage->data() + offsetIndex * m_kernelStride;
+        const float* k2 = k1 + m_kernelStride;
+
+        const ptrdiff_t start = sourceIndexI - halfKernel;
+        const float* inputP = source + start;
+        if (start < 0 || start + static_cast<ptrdiff_t>(m_kernelSize) > sourceLength)
+        {
+            float* p = padded.data();
+            for (ptrdiff_t k = 0; k < static_cast<ptrdiff_t>(m_kernelSize); ++k)
+                p[k] = (start + k >= 0 && start + k < sourceLength) ? source[start + k] : 0.f;
+            inputP = p;
+        }
 
-void SincResampler::process(const float* source, float* destination, size_t numberOfSourceFrames)
-{
-    // Resample an in-memory buffer using an AudioSourceProvider.
-    BufferSourceProvider sourceProvider(source, numberOfSourceFrames);
+        float sum1;
+        float sum2;
+        VectorMath::vdotpr2(inputP, k1, k2, &sum1, &sum2, m_kernelSize);
 
-    size_t numberOfDestinationFrames = static_cast<size_t>(numberOfSourceFrames / m_scaleFactor);
-    size_t remaining = numberOfDestinationFrames;
-    
-    while (remaining) 
-    {
-        size_t framesThisTime = min(remaining, m_blockSize);
-        process(&sourceProvider, destination, framesThisTime);
-        
-        destination += framesThisTime;
-        remaining -= framesThisTime;
+        double kernelInterpolationFactor = virtualOffsetIndex - offsetIndex;
+        destination[i] = static_cast<float>((1.0 - kernelInterpolationFactor) * sum1 + kernelInterpolationFactor * sum2);
     }
 }
 
@@ -210,212 +248,20 @@ void SincResampler::process(AudioSourceProvider* sourceProvider, float* destinat
             double virtualOffsetIndex = subsampleRemainder * m_numberOfKernelOffsets;
             int offsetIndex = static_cast<int>(virtualOffsetIndex);
             
-            float* k1 = m_kernelStorage.data() + offsetIndex * m_kernelSize;
-            float* k2 = k1 + m_kernelSize;
+            const float* k1 = m_kernelStorage->data() + offsetIndex * m_kernelStride;
+            const float* k2 = k1 + m_kernelStride;
 
             // Initialize input pointer based on quantized m_virtualSourceIndex.
-            float* inputP = r1 + sourceIndexI;
+            const float* inputP = r1 + sourceIndexI;
 
             // We'll compute "convolutions" for the two kernels which straddle m_virtualSourceIndex
-            float sum1 = 0;
-            float sum2 = 0;
+            float sum1;
+            float sum2;
+            VectorMath::vdotpr2(inputP, k1, k2, &sum1, &sum2, m_kernelSize);
 
             // Figure out how much to weight each kernel's "convolution".
             double kernelInterpolationFactor = virtualOffsetIndex - offsetIndex;
 
-            // Generate a single output sample. 
-            int n = static_cast<int>(m_kernelSize);
-
-#define CONVOLVE_ONE_SAMPLE      \
-            input = *inputP++;   \
-            sum1 += input * *k1; \
-            sum2 += input * *k2; \
-            ++k1;                \
-            ++k2;
-
-            {
-                float input;
-
-#ifdef __SSE2__
-                // If the sourceP address is not 16-byte aligned, the first several frames (at most three) should be processed seperately.
-                while ((reinterpret_cast<uintptr_t>(inputP) & 0x0F) && n) {
-                    CONVOLVE_ONE_SAMPLE
-                    n--;
-                }
-
-                // Now the inputP is aligned and start to apply SSE.
-                float* endP = inputP + n - n % 4;
-                __m128 mInput;
-                __m128 mK1;
-                __m128 mK2;
-                __m128 mul1;
-                __m128 mul2;
-
-                __m128 sums1 = _mm_setzero_ps();
-                __m128 sums2 = _mm_setzero_ps();
-                bool k1Aligned = !(reinterpret_cast<uintptr_t>(k1) & 0x0F);
-                bool k2Aligned = !(reinterpret_cast<uintptr_t>(k2) & 0x0F);
-
-#define LOAD_DATA(l1, l2)                        \
-                mInput = _mm_load_ps(inputP);    \
-                mK1 = _mm_##l1##_ps(k1);         \
-                mK2 = _mm_##l2##_ps(k2);
-
-#define CONVOLVE_4_SAMPLES                       \
-                mul1 = _mm_mul_ps(mInput, mK1);  \
-                mul2 = _mm_mul_ps(mInput, mK2);  \
-                sums1 = _mm_add_ps(sums1, mul1); \
-                sums2 = _mm_add_ps(sums2, mul2); \
-                inputP += 4;                     \
-                k1 += 4;                         \
-                k2 += 4;
-
-                if (k1Aligned && k2Aligned) { // both aligned
-                    while (inputP < endP) {
-                        LOAD_DATA(load, load)
-                        CONVOLVE_4_SAMPLES
-                    }
-                } else if (!k1Aligned && k2Aligned) { // only k2 aligned
-                    while (inputP < endP) {
-                        LOAD_DATA(loadu, load)
-                        CONVOLVE_4_SAMPLES
-                    }
-                } else if (k1Aligned && !k2Aligned) { // only k1 aligned
-                    while (inputP < endP) {
-                        LOAD_DATA(load, loadu)
-                        CONVOLVE_4_SAMPLES
-                    }
-                } else { // both non-aligned
-                    while (inputP < endP) {
-                        LOAD_DATA(loadu, loadu)
-                        CONVOLVE_4_SAMPLES
-                    }
-                }
-
-                // Summarize the SSE results to sum1 and sum2.
-                float* groupSumP = reinterpret_cast<float*>(&sums1);
-                sum1 += groupSumP[0] + groupSumP[1] + groupSumP[2] + groupSumP[3];
-                groupSumP = reinterpret_cast<float*>(&sums2);
-                sum2 += groupSumP[0] + groupSumP[1] + groupSumP[2] + groupSumP[3];
-
-                n %= 4;
-                while (n) {
-                    CONVOLVE_ONE_SAMPLE
-                    n--;
-                }
-#else
-                // FIXME: add ARM NEON optimizations for the following. The scalar code-path can probably also be optimized better.
-                
-                // Optimize size 32 and size 64 kernels by unrolling the while loop.
-                // A 20 - 30% speed improvement was measured in some cases by using this approach.
-                
-                if (n == 32) {
-                    CONVOLVE_ONE_SAMPLE // 1
-                    CONVOLVE_ONE_SAMPLE // 2
-                    CONVOLVE_ONE_SAMPLE // 3
-                    CONVOLVE_ONE_SAMPLE // 4
-                    CONVOLVE_ONE_SAMPLE // 5
-                    CONVOLVE_ONE_SAMPLE // 6
-                    CONVOLVE_ONE_SAMPLE // 7
-                    CONVOLVE_ONE_SAMPLE // 8
-                    CONVOLVE_ONE_SAMPLE // 9
-                    CONVOLVE_ONE_SAMPLE // 10
-                    CONVOLVE_ONE_SAMPLE // 11
-                    CONVOLVE_ONE_SAMPLE // 12
-                    CONVOLVE_ONE_SAMPLE // 13
-                    CONVOLVE_ONE_SAMPLE // 14
-                    CONVOLVE_ONE_SAMPLE // 15
-                    CONVOLVE_ONE_SAMPLE // 16
-                    CONVOLVE_ONE_SAMPLE // 17
-                    CONVOLVE_ONE_SAMPLE // 18
-                    CONVOLVE_ONE_SAMPLE // 19
-                    CONVOLVE_ONE_SAMPLE // 20
-                    CONVOLVE_ONE_SAMPLE // 21
-                    CONVOLVE_ONE_SAMPLE // 22
-                    CONVOLVE_ONE_SAMPLE // 23
-                    CONVOLVE_ONE_SAMPLE // 24
-                    CONVOLVE_ONE_SAMPLE // 25
-                    CONVOLVE_ONE_SAMPLE // 26
-                    CONVOLVE_ONE_SAMPLE // 27
-                    CONVOLVE_ONE_SAMPLE // 28
-                    CONVOLVE_ONE_SAMPLE // 29
-                    CONVOLVE_ONE_SAMPLE // 30
-                    CONVOLVE_ONE_SAMPLE // 31
-                    CONVOLVE_ONE_SAMPLE // 32
-                } else if (n == 64) {
-                    CONVOLVE_ONE_SAMPLE // 1
-                    CONVOLVE_ONE_SAMPLE // 2
-                    CONVOLVE_ONE_SAMPLE // 3
-                    CONVOLVE_ONE_SAMPLE // 4
-                    CONVOLVE_ONE_SAMPLE // 5
-                    CONVOLVE_ONE_SAMPLE // 6
-                    CONVOLVE_ONE_SAMPLE // 7
-                    CONVOLVE_ONE_SAMPLE // 8
-                    CONVOLVE_ONE_SAMPLE // 9
-                    CONVOLVE_ONE_SAMPLE // 10
-                    CONVOLVE_ONE_SAMPLE // 11
-                    CONVOLVE_ONE_SAMPLE // 12
-                    CONVOLVE_ONE_SAMPLE // 13
-                    CONVOLVE_ONE_SAMPLE // 14
-                    CONVOLVE_ONE_SAMPLE // 15
-                    CONVOLVE_ONE_SAMPLE // 16
-                    CONVOLVE_ONE_SAMPLE // 17
-                    CONVOLVE_ONE_SAMPLE // 18
-                    CONVOLVE_ONE_SAMPLE // 19
-                    CONVOLVE_ONE_SAMPLE // 20
-                    CONVOLVE_ONE_SAMPLE // 21
-                    CONVOLVE_ONE_SAMPLE // 22
-                    CONVOLVE_ONE_SAMPLE // 23
-                    CONVOLVE_ONE_SAMPLE // 24
-                    CONVOLVE_ONE_SAMPLE // 25
-                    CONVOLVE_ONE_SAMPLE // 26
-                    CONVOLVE_ONE_SAMPLE // 27
-                    CONVOLVE_ONE_SAMPLE // 28
-                    CONVOLVE_ONE_SAMPLE // 29
-                    CONVOLVE_ONE_SAMPLE // 30
-                    CONVOLVE_ONE_SAMPLE // 31
-                    CONVOLVE_ONE_SAMPLE // 32
-                    CONVOLVE_ONE_SAMPLE // 33
-                    CONVOLVE_ONE_SAMPLE // 34
-                    CONVOLVE_ONE_SAMPLE // 35
-                    CONVOLVE_ONE_SAMPLE // 36
-                    CONVOLVE_ONE_SAMPLE // 37
-                    CONVOLVE_ONE_SAMPLE // 38
-                    CONVOLVE_ONE_SAMPLE // 39
-                    CONVOLVE_ONE_SAMPLE // 40
-                    CONVOLVE_ONE_SAMPLE // 41
-                    CONVOLVE_ONE_SAMPLE // 42
-                    CONVOLVE_ONE_SAMPLE // 43
-                    CONVOLVE_ONE_SAMPLE // 44
-                    CONVOLVE_ONE_SAMPLE // 45
-                    CONVOLVE_ONE_SAMPLE // 46
-                    CONVOLVE_ONE_SAMPLE // 47
-                    CONVOLVE_ONE_SAMPLE // 48
-                    CONVOLVE_ONE_SAMPLE // 49
-                    CONVOLVE_ONE_SAMPLE // 50
-                    CONVOLVE_ONE_SAMPLE // 51
-                    CONVOLVE_ONE_SAMPLE // 52
-                    CONVOLVE_ONE_SAMPLE // 53
-                    CONVOLVE_ONE_SAMPLE // 54
-                    CONVOLVE_ONE_SAMPLE // 55
-                    CONVOLVE_ONE_SAMPLE // 56
-                    CONVOLVE_ONE_SAMPLE // 57
-                    CONVOLVE_ONE_SAMPLE // 58
-                    CONVOLVE_ONE_SAMPLE // 59
-                    CONVOLVE_ONE_SAMPLE // 60
-                    CONVOLVE_ONE_SAMPLE // 61
-                    CONVOLVE_ONE_SAMPLE // 62
-                    CONVOLVE_ONE_SAMPLE // 63
-                    CONVOLVE_ONE_SAMPLE // 64
-                } else {
-                    while (n--) {
-                        // Non-optimized using actual while loop.
-                        CONVOLVE_ONE_SAMPLE
-                    }
-                }
-#endif
-            }
-
             // Linearly interpolate the two "convolutions".
             *destination++ = static_cast<float>((1.0 - kernelInterpolationFactor) * sum1 + kernelInterpolationFactor * sum2);
 
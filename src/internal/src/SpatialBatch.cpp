@@ -0,0 +1,225 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/AudioContext.h"
+#include "LabSound/core/AudioListener.h"
+#include "LabSound/core/AudioNodeOutput.h"
+#include "LabSound/core/Macros.h"
+#include "LabSound/core/PannerNode.h"
+#include "LabSound/extended/AudioContextLock.h"
+
+#include "internal/Cone.h"
+#include "internal/Distance.h"
+#include "internal/SpatialBatch.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lab {
+
+namespace
+{
+    // The listener's position, and its right, front and up axes, which are orthonormal.
+    struct ListenerFrame
+    {
+        float positionX, positionY, positionZ;
+        float rightX, rightY, rightZ;
+        float frontX, frontY, frontZ;
+        float upX, upY, upZ;
+    };
+
+    struct EmitterArrays
+    {
+        const float * positionX;
+        const float * positionY;
+        const float * positionZ;
+        const float * orientationX;
+        const float * orientationY;
+        const float * orientationZ;
+        float * distance;
+        float * right;
+        float * front;
+        float * up;
+        float * coneCosine;
+    };
+
+    void evaluateEmitter(const ListenerFrame & l, const EmitterArrays & e, size_t i)
+    {
+        float dx = e.positionX[i] - l.positionX;
+        float dy = e.positionY[i] - l.positionY;
+        float dz = e.positionZ[i] - l.positionZ;
+        float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float scale = distance > 0 ? 1 / distance : 0;
+        dx *= scale;
+        dy *= scale;
+        dz *= scale;
+
+        float ox = e.orientationX[i];
+        float oy = e.orientationY[i];
+        float oz = e.orientationZ[i];
+        float orientationLength = std::sqrt(ox * ox + oy * oy + oz * oz);
+
+        e.distance[i] = distance;
+        e.right[i] = dx * l.rightX + dy * l.rightY + dz * l.rightZ;
+        e.front[i] = dx * l.frontX + dy * l.frontY + dz * l.frontZ;
+        e.up[i] = dx * l.upX + dy * l.upY + dz * l.upZ;
+
+        // A source without an orientation radiates equally in every direction, as if the listener were straight ahead.
+        e.coneCosine[i] = orientationLength > 0 ? -(dx * ox + dy * oy + dz * oz) / orientationLength : 1;
+    }
+
+    void evaluateEmitters(const ListenerFrame & l, const EmitterArrays & e, size_t count)
+    {
+        size_t i = 0;
+
+#ifdef __SSE2__
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(e.positionX + i), _mm_set1_ps(l.positionX));
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(e.positionY + i), _mm_set1_ps(l.positionY));
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(e.positionZ + i), _mm_set1_ps(l.positionZ));
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+            // Zero where the source is at the listener, rather than dividing by zero.
+            __m128 isApart = _mm_cmpgt_ps(distance, zero);
+            __m128 scale = _mm_and_ps(isApart, _mm_div_ps(one, _mm_or_ps(distance, _mm_andnot_ps(isApart, one))));
+            dx = _mm_mul_ps(dx, scale);
+            dy = _mm_mul_ps(dy, scale);
+            dz = _mm_mul_ps(dz, scale);
+
+            __m128 ox = _mm_loadu_ps(e.orientationX + i);
+            __m128 oy = _mm_loadu_ps(e.orientationY + i);
+            __m128 oz = _mm_loadu_ps(e.orientationZ + i);
+            __m128 orientationLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+
+            auto project = [&](float x, float y, float z)
+            {
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(x)), _mm_mul_ps(dy, _mm_set1_ps(y))), _mm_mul_ps(dz, _mm_set1_ps(z)));
+            };
+
+            _mm_storeu_ps(e.distance + i, distance);
+            _mm_storeu_ps(e.right + i, project(l.rightX, l.rightY, l.rightZ));
+            _mm_storeu_ps(e.front + i, project(l.frontX, l.frontY, l.frontZ));
+            _mm_storeu_ps(e.up + i, project(l.upX, l.upY, l.upZ));
+
+            __m128 isOriented = _mm_cmpgt_ps(orientationLength, zero);
+            __m128 toward = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ox), _mm_mul_ps(dy, oy)), _mm_mul_ps(dz, oz));
+            __m128 cosine = _mm_div_ps(_mm_sub_ps(zero, toward), _mm_or_ps(orientationLength, _mm_andnot_ps(isOriented, one)));
+            _mm_storeu_ps(e.coneCosine + i, _mm_or_ps(_mm_and_ps(isOriented, cosine), _mm_andnot_ps(isOriented, one)));
+        }
+#endif
+
+        for (; i < count; ++i)
+            evaluateEmitter(l, e, i);
+    }
+}
+
+SpatialBatch::SpatialBatch(std::vector<std::weak_ptr<AudioNodeOutput>> emitters)
+    : m_emitters(std::move(emitters))
+    , m_held(m_emitters.size())
+    , m_panners(m_emitters.size())
+    , m_positionX(m_emitters.size())
+    , m_positionY(m_emitters.size())
+    , m_positionZ(m_emitters.size())
+    , m_orientationX(m_emitters.size())
+    , m_orientationY(m_emitters.size())
+    , m_orientationZ(m_emitters.size())
+    , m_distance(m_emitters.size())
+    , m_right(m_emitters.size())
+    , m_front(m_emitters.size())
+    , m_up(m_emitters.size())
+    , m_coneCosine(m_emitters.size())
+{
+}
+
+SpatialBatch::~SpatialBatch()
+{
+}
+
+void SpatialBatch::update(ContextRenderLock & r)
+{
+    AudioContext * context = r.context();
+    if (!context)
+        return;
+
+    const AudioListener::Frame & listener = context->listener().frame(r);
+    const uint64_t sampleFrame = context->currentSampleFrame();
+
+    // Gather the emitters still alive that have moved, or turned, or whose listener has, since their geometry was
+    // last worked out. The rest only have their gains brought up to date, in case their models have changed.
+    size_t count = 0;
+    for (auto & emitter : m_emitters)
+    {
+        std::shared_ptr<AudioNodeOutput> handle = emitter.lock();
+        if (!handle || !handle->node())
+            continue;
+
+        PannerNode * panner = static_cast<PannerNode *>(handle->node());
+        const FloatPoint3D position = { panner->positionX()->value(r), panner->positionY()->value(r), panner->positionZ()->value(r) };
+        const FloatPoint3D orientation = { panner->orientationX()->value(r), panner->orientationY()->value(r), panner->orientationZ()->value(r) };
+
+        if (panner->geometryCurrent(position, orientation, listener.version))
+        {
+            panner->updateGains();
+            panner->m_geometry.sampleFrame = sampleFrame;
+            context->deferRelease(r, std::move(handle));
+            continue;
+        }
+
+        PannerNode::Geometry & geometry = panner->m_geometry;
+        geometry.position = position;
+        geometry.orientation = orientation;
+        geometry.listenerVersion = listener.version;
+
+        m_positionX[count] = position.x;
+        m_positionY[count] = position.y;
+        m_positionZ[count] = position.z;
+        m_orientationX[count] = orientation.x;
+        m_orientationY[count] = orientation.y;
+        m_orientationZ[count] = orientation.z;
+        m_panners[count] = panner;
+        m_held[count++] = std::move(handle);
+    }
+
+    const ListenerFrame frame = {
+        listener.position.x, listener.position.y, listener.position.z,
+        listener.right.x, listener.right.y, listener.right.z,
+        listener.front.x, listener.front.y, listener.front.z,
+        listener.up.x, listener.up.y, listener.up.z };
+
+    const EmitterArrays arrays = {
+        m_positionX.data(), m_positionY.data(), m_positionZ.data(),
+        m_orientationX.data(), m_orientationY.data(), m_orientationZ.data(),
+        m_distance.data(), m_right.data(), m_front.data(), m_up.data(), m_coneCosine.data() };
+
+    evaluateEmitters(frame, arrays, count);
+
+    // The angles and the panners' own distance and cone models, which read shared tables rather than calling pow()
+    // and acos() for each panner.
+    for (size_t i = 0; i < count; ++i)
+    {
+        PannerNode::Geometry & geometry = m_panners[i]->m_geometry;
+
+        // Positive azimuths are to the right, and a source straight behind is at -180 degrees.
+        double azimuth = 180.0 * std::atan2(m_right[i], m_front[i]) / piDouble;
+        if (azimuth >= 180.0)
+            azimuth -= 360.0;
+        double elevation = 180.0 * std::asin(std::max(-1.f, std::min(1.f, m_up[i]))) / piDouble;
+
+        geometry.azimuth = std::isnan(azimuth) ? 0.0 : azimuth;
+        geometry.elevation = std::isnan(elevation) ? 0.0 : elevation;
+        geometry.distance = m_distance[i];
+        geometry.coneCosine = std::max(-1.f, std::min(1.f, m_coneCosine[i]));
+        geometry.sampleFrame = sampleFrame;
+        m_panners[i]->updateGains();
+
+        context->deferRelease(r, std::move(m_held[i]));
+    }
+}
+
+} // namespace lab
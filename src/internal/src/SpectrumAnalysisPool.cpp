@@ -0,0 +1,93 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/extended/RealtimeAnalyser.h"
+
+#include "internal/DenormalDisabler.h"
+#include "internal/SpectrumAnalysisPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace lab {
+
+namespace
+{
+    // Wakes are best effort, so the idle worker also looks for input at this interval, well under a frame of a
+    // display refreshing at 120Hz.
+    const auto PollInterval = std::chrono::milliseconds(4);
+
+    std::mutex s_sharedLock;
+    std::weak_ptr<SpectrumAnalysisPool> s_shared;
+}
+
+std::shared_ptr<SpectrumAnalysisPool> SpectrumAnalysisPool::shared()
+{
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    std::shared_ptr<SpectrumAnalysisPool> pool = s_shared.lock();
+    if (!pool)
+    {
+        pool = std::make_shared<SpectrumAnalysisPool>();
+        s_shared = pool;
+    }
+    return pool;
+}
+
+SpectrumAnalysisPool::SpectrumAnalysisPool()
+    : m_worker(&SpectrumAnalysisPool::workerEntry, this)
+{
+}
+
+SpectrumAnalysisPool::~SpectrumAnalysisPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_shouldRun = false;
+    }
+    m_work.notify_all();
+
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+void SpectrumAnalysisPool::add(RealtimeAnalyser * analyser)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_analysers.push_back(analyser);
+}
+
+void SpectrumAnalysisPool::remove(RealtimeAnalyser * analyser)
+{
+    // The worker analyses with the lock held, so once it is taken the analyser isn't in use.
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_analysers.erase(std::remove(m_analysers.begin(), m_analysers.end(), analyser), m_analysers.end());
+}
+
+void SpectrumAnalysisPool::wake()
+{
+    // The audio thread must not wait for the lock; a missed wake is covered by the worker's polling.
+    if (m_lock.try_lock())
+    {
+        m_work.notify_one();
+        m_lock.unlock();
+    }
+}
+
+void SpectrumAnalysisPool::workerEntry()
+{
+    DenormalDisabler denormalDisabler;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_shouldRun)
+    {
+        // Input published during a pass is found by the next, so the worker only waits after an idle pass.
+        bool analysed = false;
+        for (RealtimeAnalyser * analyser : m_analysers)
+            analysed = analyser->analysePendingInput() || analysed;
+
+        if (!analysed)
+            m_work.wait_for(lock, PollInterval);
+    }
+}
+
+} // namespace lab
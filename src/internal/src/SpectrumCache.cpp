@@ -0,0 +1,273 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "LabSound/extended/SpectrumCache.h"
+
+#include "internal/MappedFile.h"
+#include "internal/SpectrumCache.h"
+#include "internal/Assertions.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace lab
+{
+
+namespace
+{
+    std::mutex s_directoryLock;
+    std::string s_directory;
+
+    // Frames are stored as the FFT implementation leaves them, which differs between implementations in scale.
+#if USE_ACCELERATE_FFT
+    const char* const FFTImplementation = "accelerate";
+#elif USE_PFFFT_FFT
+    const char* const FFTImplementation = "pffft";
+#elif USE_FFTW_FFT
+    const char* const FFTImplementation = "fftw";
+#elif USE_MKL_FFT
+    const char* const FFTImplementation = "mkl";
+#elif USE_OOURA_FFT
+    const char* const FFTImplementation = "ooura";
+#else
+    const char* const FFTImplementation = "kissfft";
+#endif
+
+    // Raise this whenever the layout of an entry, or of the frames of any kind, changes.
+    const uint32_t SpectrumCacheVersion = 2;
+
+    // An entry is this header followed by frameCount records, each a FrameHeader followed by the fftSize / 2
+    // real and fftSize / 2 imaginary values of the packed spectrum. Values are in the native byte order.
+    struct EntryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        float sampleRate;
+        uint32_t fftSize;
+        uint32_t frameCount;
+        uint32_t reserved;
+        char implementation[16];
+    };
+
+    struct FrameHeader
+    {
+        uint32_t fftSize;
+        float tag;
+    };
+
+    size_t recordSize(size_t fftSize)
+    {
+        return sizeof(FrameHeader) + sizeof(float) * fftSize;
+    }
+
+    EntryHeader makeHeader(const SpectrumCacheKey& key, size_t frameCount)
+    {
+        EntryHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "LSSC", 4);
+        header.version = SpectrumCacheVersion;
+        header.sourceHash = key.sourceHash;
+        header.sampleRate = key.sampleRate;
+        header.fftSize = static_cast<uint32_t>(key.fftSize);
+        header.frameCount = static_cast<uint32_t>(frameCount);
+        strncpy(header.implementation, FFTImplementation, sizeof(header.implementation) - 1);
+        return header;
+    }
+
+    // Returns an empty path if the cache is disabled.
+    std::string entryPath(const SpectrumCacheKey& key)
+    {
+        std::string directory = SpectrumCacheDirectory();
+        if (directory.empty())
+            return directory;
+
+        char name[128];
+        snprintf(name, sizeof(name), "%s-%016llx-%d-%zu-%s.spectra", key.kind.c_str(), static_cast<unsigned long long>(key.sourceHash),
+                 static_cast<int>(key.sampleRate), key.fftSize, FFTImplementation);
+        return directory + "/" + name;
+    }
+}
+
+void SetSpectrumCacheDirectory(const std::string & directory)
+{
+    std::lock_guard<std::mutex> lock(s_directoryLock);
+    s_directory = directory;
+}
+
+std::string SpectrumCacheDirectory()
+{
+    std::lock_guard<std::mutex> lock(s_directoryLock);
+    return s_directory;
+}
+
+bool spectrumCacheEnabled()
+{
+    std::lock_guard<std::mutex> lock(s_directoryLock);
+    return !s_directory.empty();
+}
+
+uint64_t SpectrumCacheKey::hash(const void* data, size_t size, uint64_t hash)
+{
+    // FNV-1a, but on eight bytes at a time, as responses can be megabytes long; the shift folds the high bits of
+    // each product back down, since multiplying only carries the low bits of a word upwards.
+    const uint64_t prime = 1099511628211ULL;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; size; --size, ++bytes)
+        hash = (hash ^ *bytes) * prime;
+    return hash;
+}
+
+bool SpectrumCacheKey::hashFile(const std::string& path, uint64_t& hash)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    uint8_t buffer[16384];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = SpectrumCacheKey::hash(buffer, count, hash);
+
+    bool succeeded = !ferror(file);
+    fclose(file);
+    return succeeded;
+}
+
+std::unique_ptr<SpectrumCacheReader> SpectrumCacheReader::open(const SpectrumCacheKey& key)
+{
+    std::string path = entryPath(key);
+    if (path.empty())
+        return nullptr;
+
+    std::unique_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file)
+        return nullptr;
+
+    // The entry must be for this key and implementation, and hold every frame its header counts.
+    const uint8_t* begin = file->data();
+    const uint8_t* end = begin + file->size();
+    if (file->size() < sizeof(EntryHeader))
+        return nullptr;
+
+    EntryHeader header;
+    memcpy(&header, begin, sizeof(header));
+    EntryHeader expected = makeHeader(key, header.frameCount);
+    if (memcmp(&header, &expected, sizeof(header)))
+        return nullptr;
+
+    const uint8_t* cursor = begin + sizeof(EntryHeader);
+    for (uint32_t i = 0; i < header.frameCount; ++i)
+    {
+        FrameHeader frame;
+        if (static_cast<size_t>(end - cursor) < sizeof(frame))
+            return nullptr;
+        memcpy(&frame, cursor, sizeof(frame));
+        if (!frame.fftSize || static_cast<size_t>(end - cursor) < recordSize(frame.fftSize))
+            return nullptr;
+        cursor += recordSize(frame.fftSize);
+    }
+    if (cursor != end)
+        return nullptr;
+
+    std::unique_ptr<SpectrumCacheReader> reader(new SpectrumCacheReader());
+    reader->m_file = std::move(file);
+    reader->m_cursor = begin + sizeof(EntryHeader);
+    reader->m_end = end;
+    reader->m_frameCount = header.frameCount;
+    return reader;
+}
+
+SpectrumCacheReader::~SpectrumCacheReader()
+{
+}
+
+bool SpectrumCacheReader::read(FFTFrame& frame, float* tag)
+{
+    if (m_cursor == m_end)
+        return false;
+
+    FrameHeader header;
+    memcpy(&header, m_cursor, sizeof(header));
+    if (header.fftSize != frame.fftSize())
+        return false;
+
+    size_t halfSize = frame.fftSize() / 2;
+    const uint8_t* values = m_cursor + sizeof(header);
+    memcpy(frame.realData(), values, sizeof(float) * halfSize);
+    memcpy(frame.imagData(), values + sizeof(float) * halfSize, sizeof(float) * halfSize);
+    if (tag)
+        *tag = header.tag;
+
+    m_cursor += recordSize(header.fftSize);
+    return true;
+}
+
+std::unique_ptr<SpectrumCacheWriter> SpectrumCacheWriter::create(const SpectrumCacheKey& key)
+{
+    if (!spectrumCacheEnabled())
+        return nullptr;
+    return std::unique_ptr<SpectrumCacheWriter>(new SpectrumCacheWriter(key));
+}
+
+void SpectrumCacheWriter::write(const FFTFrame& frame, float tag)
+{
+    FrameHeader header = { static_cast<uint32_t>(frame.fftSize()), tag };
+    size_t halfSize = frame.fftSize() / 2;
+
+    size_t offset = m_frames.size();
+    m_frames.resize(offset + recordSize(frame.fftSize()));
+    uint8_t* record = m_frames.data() + offset;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), frame.realData(), sizeof(float) * halfSize);
+    memcpy(record + sizeof(header) + sizeof(float) * halfSize, frame.imagData(), sizeof(float) * halfSize);
+    ++m_frameCount;
+}
+
+bool SpectrumCacheWriter::commit()
+{
+    std::string path = entryPath(m_key);
+    if (path.empty())
+        return false;
+
+    // Several processes may be filling in the same entry; each writes its own file, and the last rename wins.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string temporaryPath = path + suffix;
+
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        LOG_ERROR("Can't write the spectrum cache entry %s", temporaryPath.c_str());
+        return false;
+    }
+
+    EntryHeader header = makeHeader(m_key, m_frameCount);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && (m_frames.empty() || fwrite(m_frames.data(), m_frames.size(), 1, file) == 1);
+    written = !fclose(file) && written;
+
+    if (written)
+    {
+        // rename doesn't replace an existing file on Windows, so retry once another entry is removed.
+        written = !std::rename(temporaryPath.c_str(), path.c_str());
+        if (!written && !std::remove(path.c_str()))
+            written = !std::rename(temporaryPath.c_str(), path.c_str());
+    }
+    if (!written)
+        std::remove(temporaryPath.c_str());
+    return written;
+}
+
+} // namespace lab
@@ -0,0 +1,149 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "LabSound/core/Macros.h"
+#include "LabSound/extended/Logging.h"
+
+#include "internal/ThreadScheduling.h"
+#include "internal/Trace.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <avrt.h>
+#elif defined(LABSOUND_PLATFORM_OSX)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace lab {
+
+namespace
+{
+    // Policies are applied on the render thread too, so the cores are passed as a range rather than copied.
+    struct CoreRange
+    {
+        const unsigned * begin;
+        const unsigned * end;
+    };
+
+#if defined(LABSOUND_PLATFORM_WINDOWS)
+
+    bool applyScheduling(const AudioThreadPolicy & policy, double)
+    {
+        // The MMCSS task stays joined for the life of the thread, so a thread only joins it once.
+        static thread_local HANDLE task = nullptr;
+        if (!task)
+        {
+            DWORD taskIndex = 0;
+            task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+            if (!task)
+                return false;
+        }
+        return AvSetMmThreadPriority(task, policy.priority > 90 ? AVRT_PRIORITY_CRITICAL : AVRT_PRIORITY_HIGH) != 0;
+    }
+
+    bool applyAffinity(CoreRange cores)
+    {
+        DWORD_PTR mask = 0;
+        for (const unsigned * core = cores.begin; core != cores.end; ++core)
+        {
+            if (*core >= sizeof(DWORD_PTR) * 8)
+                return false;
+            mask |= static_cast<DWORD_PTR>(1) << *core;
+        }
+        return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+    }
+
+#elif defined(LABSOUND_PLATFORM_OSX)
+
+    bool applyScheduling(const AudioThreadPolicy &, double quantumSeconds)
+    {
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        const double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+        const uint32_t period = static_cast<uint32_t>(std::max(quantumSeconds, 0.0005) * ticksPerSecond);
+
+        // Rendering is expected to take at most half the period, and must be done within it.
+        thread_time_constraint_policy_data_t constraint;
+        constraint.period = period;
+        constraint.computation = period / 2;
+        constraint.constraint = period;
+        constraint.preemptible = 1;
+        return thread_policy_set(mach_thread_self(), THREAD_TIME_CONSTRAINT_POLICY, reinterpret_cast<thread_policy_t>(&constraint),
+                                 THREAD_TIME_CONSTRAINT_POLICY_COUNT) == KERN_SUCCESS;
+    }
+
+    bool applyAffinity(CoreRange cores)
+    {
+        // Threads with the same tag are scheduled to share a cache where the hardware allows; zero means none.
+        thread_affinity_policy_data_t affinity;
+        affinity.affinity_tag = static_cast<integer_t>(*cores.begin + 1);
+        return thread_policy_set(mach_thread_self(), THREAD_AFFINITY_POLICY, reinterpret_cast<thread_policy_t>(&affinity),
+                                 THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+    }
+
+#else
+
+    bool applyScheduling(const AudioThreadPolicy & policy, double)
+    {
+        const int schedulingPolicy = policy.scheduling == AudioThreadPolicy::Scheduling::RoundRobin ? SCHED_RR : SCHED_FIFO;
+        sched_param param = {};
+        param.sched_priority = std::max(std::min(policy.priority, sched_get_priority_max(schedulingPolicy)), sched_get_priority_min(schedulingPolicy));
+        return pthread_setschedparam(pthread_self(), schedulingPolicy, &param) == 0;
+    }
+
+    bool applyAffinity(CoreRange cores)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const unsigned * core = cores.begin; core != cores.end; ++core)
+        {
+            if (*core >= CPU_SETSIZE)
+                return false;
+            CPU_SET(*core, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+#endif
+}
+
+unsigned ApplyAudioThreadPolicy(const AudioThreadPolicy & policy, const char * threadName, double quantumSeconds, int coreIndex)
+{
+    // Every LabSound thread applies a policy when it starts, so this is where they are named in traces.
+    LABSOUND_TRACE_THREAD(threadName);
+
+    unsigned failures = 0;
+
+    if (policy.scheduling != AudioThreadPolicy::Scheduling::Default && !applyScheduling(policy, quantumSeconds))
+    {
+        LOG_ERROR("The %s thread can't be given realtime scheduling; on Linux it needs CAP_SYS_NICE or an rtprio limit", threadName);
+        failures |= AudioThreadPolicy::SchedulingFailed;
+    }
+
+    // Either all of the policy's cores, or only the one at coreIndex.
+    CoreRange cores = { policy.cores.data(), policy.cores.data() + policy.cores.size() };
+    if (coreIndex >= 0 && !policy.cores.empty())
+    {
+        cores.begin += static_cast<size_t>(coreIndex) % policy.cores.size();
+        cores.end = cores.begin + 1;
+    }
+
+    if (cores.begin != cores.end && !applyAffinity(cores))
+    {
+        LOG_ERROR("The %s thread can't be pinned to the cores asked for", threadName);
+        failures |= AudioThreadPolicy::AffinityFailed;
+    }
+
+    return failures;
+}
+
+} // namespace lab
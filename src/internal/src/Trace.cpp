@@ -0,0 +1,214 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/Trace.h"
+
+#include "LabSound/core/AudioTrace.h"
+#include "LabSound/extended/Logging.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lab {
+
+std::atomic<bool> g_tracing{ false };
+
+namespace {
+
+    struct TraceEvent
+    {
+        const char * name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // A thread's events, written only by the thread; written counts every event ever recorded, and the latest
+    // capacity of them are kept.
+    struct TraceBuffer
+    {
+        TraceBuffer(size_t capacity, uint32_t threadId, const char * threadName)
+        : events(new TraceEvent[capacity])
+        , capacity(capacity)
+        , threadId(threadId)
+        , threadName(threadName)
+        {
+        }
+
+        std::unique_ptr<TraceEvent[]> events;
+        const size_t capacity;
+        const uint32_t threadId;
+        std::atomic<const char *> threadName;
+        std::atomic<uint64_t> written{ 0 };
+    };
+
+    // The buffers of the current trace. A thread keeps the buffer it holds alive, so a trace restarted while the
+    // thread records into it only orphans it.
+    struct TraceSession
+    {
+        std::mutex lock;
+        std::vector<std::shared_ptr<TraceBuffer>> buffers;
+        size_t capacity = 0;
+        uint64_t origin = 0;
+        std::atomic<uint32_t> generation{ 0 };
+    };
+
+    TraceSession & session()
+    {
+        static TraceSession s;
+        return s;
+    }
+
+    std::atomic<uint32_t> s_nextThreadId{ 1 };
+
+    thread_local std::shared_ptr<TraceBuffer> t_buffer;
+    thread_local uint32_t t_generation = 0;
+    thread_local uint32_t t_threadId = 0;
+    thread_local const char * t_threadName = nullptr;
+
+    void appendEscaped(std::string & out, const char * text)
+    {
+        for (const char * c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(*c) >= 0x20)
+                out += *c;
+        }
+    }
+
+    void appendMicroseconds(std::string & out, double nanoseconds)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.3f", nanoseconds * 1e-3);
+        out += text;
+    }
+
+} // anonymous namespace
+
+void TraceRecord(const char * name, uint64_t start, uint64_t end)
+{
+    TraceSession & s = session();
+    if (!t_buffer || t_generation != s.generation.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(s.lock);
+        if (!g_tracing.load())
+            return;
+
+        if (!t_threadId)
+            t_threadId = s_nextThreadId.fetch_add(1);
+        t_buffer = std::make_shared<TraceBuffer>(s.capacity, t_threadId, t_threadName);
+        t_generation = s.generation.load();
+        s.buffers.push_back(t_buffer);
+    }
+
+    TraceBuffer & buffer = *t_buffer;
+    const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[index % buffer.capacity] = { name, start, end };
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void TraceThreadName(const char * name)
+{
+    t_threadName = name;
+    if (t_buffer)
+        t_buffer->threadName.store(name);
+}
+
+bool AudioTrace::available()
+{
+#if defined(LABSOUND_TRACE)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AudioTrace::start(size_t eventsPerThread)
+{
+    if (!available())
+    {
+        LOG_ERROR("Tracing needs LabSound to be built with LABSOUND_TRACE");
+        return;
+    }
+
+    TraceSession & s = session();
+    std::lock_guard<std::mutex> lock(s.lock);
+    s.buffers.clear();
+    s.capacity = std::max<size_t>(eventsPerThread, 1);
+    s.origin = TraceNow();
+    s.generation.fetch_add(1, std::memory_order_release);
+    g_tracing.store(true);
+}
+
+void AudioTrace::stop()
+{
+    g_tracing.store(false);
+}
+
+bool AudioTrace::isTracing()
+{
+    return g_tracing.load();
+}
+
+std::string AudioTrace::json()
+{
+    TraceSession & s = session();
+    std::lock_guard<std::mutex> lock(s.lock);
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"LabSound\"}}";
+
+    for (const std::shared_ptr<TraceBuffer> & buffer : s.buffers)
+    {
+        const std::string tid = std::to_string(buffer->threadId);
+
+        if (const char * threadName = buffer->threadName.load())
+        {
+            out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+            appendEscaped(out, threadName);
+            out += "\"}}";
+        }
+
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > buffer->capacity ? written - buffer->capacity : 0;
+        for (uint64_t i = first; i < written; ++i)
+        {
+            const TraceEvent & event = buffer->events[i % buffer->capacity];
+
+            // A scope begun before the trace started is left out.
+            if (event.start < s.origin || event.end < event.start)
+                continue;
+
+            out += ",\n{\"name\":\"";
+            appendEscaped(out, event.name);
+            out += "\",\"cat\":\"LabSound\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            appendMicroseconds(out, static_cast<double>(event.start - s.origin));
+            out += ",\"dur\":";
+            appendMicroseconds(out, static_cast<double>(event.end - event.start));
+            out += "}";
+        }
+    }
+
+    out += "\n]}\n";
+    return out;
+}
+
+bool AudioTrace::write(const std::string & path)
+{
+    const std::string trace = json();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        LOG_ERROR("Can't write the trace to %s", path.c_str());
+        return false;
+    }
+    file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+    return static_cast<bool>(file);
+}
+
+} // namespace lab
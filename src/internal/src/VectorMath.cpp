@@ -6,6 +6,7 @@
 #include "internal/Assertions.h"
 
 #include "internal/VectorMath.h"
+#include "internal/VectorMathX86.h"
 
 #if defined(LABSOUND_PLATFORM_OSX)
 #include <Accelerate/Accelerate.h>
@@ -20,6 +21,8 @@
 #endif
 
 #include <algorithm>
+#include <cstring>
+#include <limits>
 #include <math.h>
 
 namespace lab {
@@ -76,6 +79,20 @@ void zvmul(const float* real1P, const float* imag1P, const float* real2P, const
 #endif
 }
 
+void zvma(const float* real1P, const float* imag1P, const float* real2P, const float* imag2P, float* realAccP, float* imagAccP, size_t framesToProcess)
+{
+    DSPSplitComplex sc1;
+    DSPSplitComplex sc2;
+    DSPSplitComplex acc;
+    sc1.realp = const_cast<float*>(real1P);
+    sc1.imagp = const_cast<float*>(imag1P);
+    sc2.realp = const_cast<float*>(real2P);
+    sc2.imagp = const_cast<float*>(imag2P);
+    acc.realp = realAccP;
+    acc.imagp = imagAccP;
+    vDSP_zvma(&sc1, 1, &sc2, 1, &acc, 1, &acc, 1, framesToProcess);
+}
+
 void vsma(const float* sourceP, int sourceStride, const float* scale, float* destP, int destStride, size_t framesToProcess)
 {
     vDSP_vsma(sourceP, sourceStride, scale, destP, destStride, destP, destStride, framesToProcess);
@@ -95,13 +112,281 @@ void vclip(const float* sourceP, int sourceStride, const float* lowThresholdP, c
 {
     vDSP_vclip(const_cast<float*>(sourceP), sourceStride, const_cast<float*>(lowThresholdP), const_cast<float*>(highThresholdP), destP, destStride, framesToProcess);
 }
+
+void vfill(const float* valueP, float* destP, size_t framesToProcess)
+{
+    vDSP_vfill(valueP, destP, 1, framesToProcess);
+}
+
+void vsadd(const float* sourceP, const float* addendP, float* destP, size_t framesToProcess)
+{
+    vDSP_vsadd(sourceP, 1, addendP, destP, 1, framesToProcess);
+}
+
+void vramp(const float* startP, const float* stepP, float* destP, size_t framesToProcess)
+{
+    vDSP_vramp(startP, stepP, destP, 1, framesToProcess);
+}
+
+void vexp(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    int n = static_cast<int>(framesToProcess);
+    vvexpf(destP, sourceP, &n);
+}
+
+void vlog(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    int n = static_cast<int>(framesToProcess);
+    vvlogf(destP, sourceP, &n);
+}
+
+void vtanh(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    int n = static_cast<int>(framesToProcess);
+    vvtanhf(destP, sourceP, &n);
+}
+
+void vlookup(const float* tableP, size_t tableSize, const float* indexP, float* destP, size_t framesToProcess)
+{
+    const float scale = 1;
+    const float offset = 0;
+    vDSP_vtabi(indexP, 1, &scale, &offset, tableP, tableSize, destP, 1, framesToProcess);
+}
+
+void vconv(const float* sourceP, const float* kernelP, size_t kernelSize, float* destP, size_t framesToProcess)
+{
+    // vDSP_conv correlates, so the kernel is read backwards from its last tap.
+    vDSP_conv(sourceP - kernelSize + 1, 1, kernelP + kernelSize - 1, -1, destP, 1, framesToProcess, kernelSize);
+}
+
+void vdotpr2(const float* sourceP, const float* kernel1P, const float* kernel2P, float* dot1P, float* dot2P, size_t framesToProcess)
+{
+    vDSP_dotpr(sourceP, 1, kernel1P, 1, dot1P, framesToProcess);
+    vDSP_dotpr(sourceP, 1, kernel2P, 1, dot2P, framesToProcess);
+}
+
+void vsum(const float* const* sourcesP, size_t sourceCount, float* destP, size_t framesToProcess)
+{
+    for (size_t source = 0; source < sourceCount; ++source)
+        vDSP_vadd(destP, 1, sourcesP[source], 1, destP, 1, framesToProcess);
+}
+
+void vmix(const float* const* sourcesP, size_t sourceCount, const float* const* gainsP, float* const* destsP, size_t destCount, bool accumulate, size_t framesToProcess)
+{
+    for (size_t dest = 0; dest < destCount; ++dest) {
+        if (!accumulate)
+            vDSP_vclr(destsP[dest], 1, framesToProcess);
+        for (size_t source = 0; source < sourceCount; ++source) {
+            if (gainsP[dest][source] != 0)
+                vDSP_vsma(sourcesP[source], 1, &gainsP[dest][source], destsP[dest], 1, destsP[dest], 1, framesToProcess);
+        }
+    }
+}
+#else
+
+#ifdef __SSE2__
+namespace {
+
+// AudioArray and channel buffers are cache line aligned and render quanta are multiples of the vector width, so
+// the buffers of a render quantum take the fast paths below, which have neither a scalar prologue nor a tail.
+inline bool isVectorAligned(const float* p) { return !(reinterpret_cast<uintptr_t>(p) & 0x0F); }
+inline bool isVectorLength(size_t framesToProcess) { return !(framesToProcess & 3); }
+
+// The exponential and logarithm follow Cephes' expf and logf: a range reduction by powers of two, and a
+// polynomial over the remainder. Their relative error is within a few units in the last place.
+inline __m128 expSSE2(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 underflow = _mm_cmplt_ps(x, _mm_set1_ps(-87.0f));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.0f)), _mm_set1_ps(88.0f));
+
+    // x = n * ln(2) + r, with n = floor(x / ln(2) + 0.5)
+    __m128 n = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(n));
+    n = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, n), one));
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+
+    __m128 y = _mm_set1_ps(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), one);
+
+    // Scale by 2^n, built directly in the exponent bits.
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(0x7f)), 23);
+    y = _mm_mul_ps(y, _mm_castsi128_ps(exponent));
+    return _mm_andnot_ps(underflow, y);
+}
+
+inline __m128 logSSE2(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 invalid = _mm_cmplt_ps(x, zero);
+    __m128 isZero = _mm_cmpeq_ps(x, zero);
+
+    // x = m * 2^e, with m in [sqrt(1/2), sqrt(2)). Denormals are treated as the smallest normal.
+    x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000)));
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23), _mm_set1_epi32(0x7e)));
+    x = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(~0x7f800000))), _mm_set1_ps(0.5f));
+    __m128 small = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+    e = _mm_sub_ps(e, _mm_and_ps(small, one));
+    x = _mm_add_ps(_mm_sub_ps(x, one), _mm_and_ps(small, x));
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(7.0376836292e-2f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+    y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    x = _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+
+    x = _mm_or_ps(x, invalid); // all bits set is a NaN
+    return _mm_or_ps(_mm_andnot_ps(isZero, x), _mm_and_ps(isZero, _mm_set1_ps(-std::numeric_limits<float>::infinity())));
+}
+
+} // namespace
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+namespace {
+
+// a + b * c, fused where the architecture has it (ARMv8, and ARMv7 with VFPv4).
+inline float32x4_t multiplyAdd(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+#if defined(__ARM_FEATURE_FMA) || defined(_M_ARM64)
+    return vfmaq_f32(a, b, c);
+#else
+    return vmlaq_f32(a, b, c);
+#endif
+}
+
+// a - b * c
+inline float32x4_t multiplySubtract(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+#if defined(__ARM_FEATURE_FMA) || defined(_M_ARM64)
+    return vfmsq_f32(a, b, c);
 #else
+    return vmlsq_f32(a, b, c);
+#endif
+}
+
+inline float horizontalSum(float32x4_t v)
+{
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vaddvq_f32(v);
+#else
+    float32x2_t twoSum = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(twoSum, twoSum), 0);
+#endif
+}
+
+inline float horizontalMax(float32x4_t v)
+{
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vmaxvq_f32(v);
+#else
+    float32x2_t twoMax = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpmax_f32(twoMax, twoMax), 0);
+#endif
+}
+
+inline float32x4_t selectNEON(uint32x4_t mask, float32x4_t ifSet, float32x4_t ifClear)
+{
+    return vbslq_f32(mask, ifSet, ifClear);
+}
+
+// The same approximations as expSSE2 and logSSE2.
+inline float32x4_t expNEON(float32x4_t x)
+{
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    uint32x4_t underflow = vcltq_f32(x, vdupq_n_f32(-87.0f));
+    x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-87.0f)), vdupq_n_f32(88.0f));
+
+    float32x4_t n = multiplyAdd(vdupq_n_f32(0.5f), x, vdupq_n_f32(1.44269504088896341f));
+    float32x4_t truncated = vcvtq_f32_s32(vcvtq_s32_f32(n));
+    n = vsubq_f32(truncated, selectNEON(vcgtq_f32(truncated, n), one, vdupq_n_f32(0)));
+    x = multiplySubtract(x, n, vdupq_n_f32(0.693359375f));
+    x = multiplySubtract(x, n, vdupq_n_f32(-2.12194440e-4f));
+
+    float32x4_t y = vdupq_n_f32(1.9875691500e-4f);
+    y = multiplyAdd(vdupq_n_f32(1.3981999507e-3f), y, x);
+    y = multiplyAdd(vdupq_n_f32(8.3334519073e-3f), y, x);
+    y = multiplyAdd(vdupq_n_f32(4.1665795894e-2f), y, x);
+    y = multiplyAdd(vdupq_n_f32(1.6666665459e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(5.0000001201e-1f), y, x);
+    y = vaddq_f32(multiplyAdd(x, y, vmulq_f32(x, x)), one);
+
+    int32x4_t exponent = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(0x7f)), 23);
+    y = vmulq_f32(y, vreinterpretq_f32_s32(exponent));
+    return selectNEON(underflow, vdupq_n_f32(0), y);
+}
+
+inline float32x4_t logNEON(float32x4_t x)
+{
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    uint32x4_t invalid = vcltq_f32(x, vdupq_n_f32(0));
+    uint32x4_t isZero = vceqq_f32(x, vdupq_n_f32(0));
+
+    x = vmaxq_f32(x, vreinterpretq_f32_u32(vdupq_n_u32(0x00800000)));
+    uint32x4_t bits = vreinterpretq_u32_f32(x);
+    float32x4_t e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(0x7e)));
+    x = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(~0x7f800000u)), vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+    uint32x4_t small = vcltq_f32(x, vdupq_n_f32(0.707106781186547524f));
+    e = vsubq_f32(e, selectNEON(small, one, vdupq_n_f32(0)));
+    x = vaddq_f32(vsubq_f32(x, one), selectNEON(small, x, vdupq_n_f32(0)));
+
+    float32x4_t z = vmulq_f32(x, x);
+    float32x4_t y = vdupq_n_f32(7.0376836292e-2f);
+    y = multiplyAdd(vdupq_n_f32(-1.1514610310e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(1.1676998740e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(-1.2420140846e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(1.4249322787e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(-1.6668057665e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(2.0000714765e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(-2.4999993993e-1f), y, x);
+    y = multiplyAdd(vdupq_n_f32(3.3333331174e-1f), y, x);
+    y = vmulq_f32(vmulq_f32(y, x), z);
+    y = multiplyAdd(y, e, vdupq_n_f32(-2.12194440e-4f));
+    y = multiplySubtract(y, z, vdupq_n_f32(0.5f));
+    x = multiplyAdd(vaddq_f32(x, y), e, vdupq_n_f32(0.693359375f));
+
+    x = selectNEON(invalid, vdupq_n_f32(std::numeric_limits<float>::quiet_NaN()), x);
+    return selectNEON(isZero, vdupq_n_f32(-std::numeric_limits<float>::infinity()), x);
+}
+
+} // namespace
+#endif
 
 void vsma(const float* sourceP, int sourceStride, const float* scale, float* destP, int destStride, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride == 1) && (destStride == 1) && kernels().vsma) {
+        kernels().vsma(sourceP, *scale, destP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
 
 #ifdef __SSE2__
+    if ((sourceStride == 1) && (destStride == 1) && isVectorLength(n) && isVectorAligned(sourceP) && isVectorAligned(destP)) {
+        __m128 mScale = _mm_set_ps1(*scale);
+        for (const float* endP = destP + n; destP < endP; sourceP += 4, destP += 4)
+            _mm_store_ps(destP, _mm_add_ps(_mm_load_ps(destP), _mm_mul_ps(_mm_load_ps(sourceP), mScale)));
+        return;
+    }
+
     if ((sourceStride == 1) && (destStride == 1)) {
         float k = *scale;
 
@@ -153,7 +438,7 @@ void vsma(const float* sourceP, int sourceStride, const float* scale, float* des
             float32x4_t source = vld1q_f32(sourceP);
             float32x4_t dest = vld1q_f32(destP);
 
-            dest = vmlaq_f32(dest, source, k);
+            dest = multiplyAdd(dest, source, k);
             vst1q_f32(destP, dest);
 
             sourceP += 4;
@@ -172,9 +457,23 @@ void vsma(const float* sourceP, int sourceStride, const float* scale, float* des
 
 void vsmul(const float* sourceP, int sourceStride, const float* scale, float* destP, int destStride, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride == 1) && (destStride == 1) && kernels().vsmul) {
+        kernels().vsmul(sourceP, *scale, destP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
 
 #ifdef __SSE2__
+    if ((sourceStride == 1) && (destStride == 1) && isVectorLength(n) && isVectorAligned(sourceP) && isVectorAligned(destP)) {
+        __m128 mScale = _mm_set_ps1(*scale);
+        for (const float* endP = destP + n; destP < endP; sourceP += 4, destP += 4)
+            _mm_store_ps(destP, _mm_mul_ps(_mm_load_ps(sourceP), mScale));
+        return;
+    }
+
     if ((sourceStride == 1) && (destStride == 1)) {
         float k = *scale;
 
@@ -252,9 +551,23 @@ void vsmul(const float* sourceP, int sourceStride, const float* scale, float* de
 
 void vadd(const float* source1P, int sourceStride1, const float* source2P, int sourceStride2, float* destP, int destStride, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride1 == 1) && (sourceStride2 == 1) && (destStride == 1) && kernels().vadd) {
+        kernels().vadd(source1P, source2P, destP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
 
 #ifdef __SSE2__
+    if ((sourceStride1 == 1) && (sourceStride2 == 1) && (destStride == 1) && isVectorLength(n)
+        && isVectorAligned(source1P) && isVectorAligned(source2P) && isVectorAligned(destP)) {
+        for (const float* endP = destP + n; destP < endP; source1P += 4, source2P += 4, destP += 4)
+            _mm_store_ps(destP, _mm_add_ps(_mm_load_ps(source1P), _mm_load_ps(source2P)));
+        return;
+    }
+
     if ((sourceStride1 ==1) && (sourceStride2 == 1) && (destStride == 1)) {
         // If the sourceP address is not 16-byte aligned, the first several frames (at most three) should be processed separately.
         while ((reinterpret_cast<size_t>(source1P) & 0x0F) && n) {
@@ -364,10 +677,24 @@ void vadd(const float* source1P, int sourceStride1, const float* source2P, int s
 
 void vmul(const float* source1P, int sourceStride1, const float* source2P, int sourceStride2, float* destP, int destStride, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride1 == 1) && (sourceStride2 == 1) && (destStride == 1) && kernels().vmul) {
+        kernels().vmul(source1P, source2P, destP, framesToProcess);
+        return;
+    }
+#endif
+
 
     int n = framesToProcess;
 
 #ifdef __SSE2__
+    if ((sourceStride1 == 1) && (sourceStride2 == 1) && (destStride == 1) && isVectorLength(n)
+        && isVectorAligned(source1P) && isVectorAligned(source2P) && isVectorAligned(destP)) {
+        for (const float* endP = destP + n; destP < endP; source1P += 4, source2P += 4, destP += 4)
+            _mm_store_ps(destP, _mm_mul_ps(_mm_load_ps(source1P), _mm_load_ps(source2P)));
+        return;
+    }
+
     if ((sourceStride1 == 1) && (sourceStride2 == 1) && (destStride == 1)) {
         // If the source1P address is not 16-byte aligned, the first several frames (at most three) should be processed separately.
         while ((reinterpret_cast<uintptr_t>(source1P) & 0x0F) && n) {
@@ -439,6 +766,13 @@ void vmul(const float* source1P, int sourceStride1, const float* source2P, int s
 
 void zvmul(const float* real1P, const float* imag1P, const float* real2P, const float* imag2P, float* realDestP, float* imagDestP, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().zvmul) {
+        kernels().zvmul(real1P, imag1P, real2P, imag2P, realDestP, imagDestP, framesToProcess);
+        return;
+    }
+#endif
+
     unsigned i = 0;
 #ifdef __SSE2__
     // Only use the SSE optimization in the very common case that all addresses are 16-byte aligned. 
@@ -466,21 +800,22 @@ void zvmul(const float* real1P, const float* imag1P, const float* real2P, const
         }
     }
 #elif defined(ARM_NEON_INTRINSICS)
-        unsigned endSize = framesToProcess - framesToProcess % 4;
-        while (i < endSize) {
-            float32x4_t real1 = vld1q_f32(real1P + i);
-            float32x4_t real2 = vld1q_f32(real2P + i);
-            float32x4_t imag1 = vld1q_f32(imag1P + i);
-            float32x4_t imag2 = vld1q_f32(imag2P + i);
+    // NEON loads don't require alignment. Both results are computed before storing, the destination may be a source.
+    unsigned endSize = framesToProcess - framesToProcess % 4;
+    while (i < endSize) {
+        float32x4_t real1 = vld1q_f32(real1P + i);
+        float32x4_t real2 = vld1q_f32(real2P + i);
+        float32x4_t imag1 = vld1q_f32(imag1P + i);
+        float32x4_t imag2 = vld1q_f32(imag2P + i);
 
-            float32x4_t realResult = vmlsq_f32(vmulq_f32(real1, real2), imag1, imag2);
-            float32x4_t imagResult = vmlaq_f32(vmulq_f32(real1, imag2), imag1, real2);
+        float32x4_t realResult = multiplySubtract(vmulq_f32(real1, real2), imag1, imag2);
+        float32x4_t imagResult = multiplyAdd(vmulq_f32(real1, imag2), imag1, real2);
 
-            vst1q_f32(realDestP + i, realResult);
-            vst1q_f32(imagDestP + i, imagResult);
+        vst1q_f32(realDestP + i, realResult);
+        vst1q_f32(imagDestP + i, imagResult);
 
-            i += 4;
-        }
+        i += 4;
+    }
 #endif
     for (; i < framesToProcess; ++i) {
         // Read and compute result before storing them, in case the
@@ -493,8 +828,67 @@ void zvmul(const float* real1P, const float* imag1P, const float* real2P, const
     }
 }
 
+void zvma(const float* real1P, const float* imag1P, const float* real2P, const float* imag2P, float* realAccP, float* imagAccP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().zvma) {
+        kernels().zvma(real1P, imag1P, real2P, imag2P, realAccP, imagAccP, framesToProcess);
+        return;
+    }
+#endif
+
+    size_t i = 0;
+#ifdef __SSE2__
+    // Spectra are held in AudioFloatArrays, which are aligned, so only the aligned case is vectorized.
+    if (!(reinterpret_cast<uintptr_t>(real1P) & 0x0F)
+        && !(reinterpret_cast<uintptr_t>(imag1P) & 0x0F)
+        && !(reinterpret_cast<uintptr_t>(real2P) & 0x0F)
+        && !(reinterpret_cast<uintptr_t>(imag2P) & 0x0F)
+        && !(reinterpret_cast<uintptr_t>(realAccP) & 0x0F)
+        && !(reinterpret_cast<uintptr_t>(imagAccP) & 0x0F)) {
+
+        size_t endSize = framesToProcess - framesToProcess % 4;
+        for (; i < endSize; i += 4) {
+            __m128 real1 = _mm_load_ps(real1P + i);
+            __m128 real2 = _mm_load_ps(real2P + i);
+            __m128 imag1 = _mm_load_ps(imag1P + i);
+            __m128 imag2 = _mm_load_ps(imag2P + i);
+            __m128 real = _mm_sub_ps(_mm_mul_ps(real1, real2), _mm_mul_ps(imag1, imag2));
+            __m128 imag = _mm_add_ps(_mm_mul_ps(real1, imag2), _mm_mul_ps(imag1, real2));
+            _mm_store_ps(realAccP + i, _mm_add_ps(_mm_load_ps(realAccP + i), real));
+            _mm_store_ps(imagAccP + i, _mm_add_ps(_mm_load_ps(imagAccP + i), imag));
+        }
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    size_t endSize = framesToProcess - framesToProcess % 4;
+    for (; i < endSize; i += 4) {
+        float32x4_t real1 = vld1q_f32(real1P + i);
+        float32x4_t real2 = vld1q_f32(real2P + i);
+        float32x4_t imag1 = vld1q_f32(imag1P + i);
+        float32x4_t imag2 = vld1q_f32(imag2P + i);
+
+        float32x4_t realResult = multiplySubtract(multiplyAdd(vld1q_f32(realAccP + i), real1, real2), imag1, imag2);
+        float32x4_t imagResult = multiplyAdd(multiplyAdd(vld1q_f32(imagAccP + i), real1, imag2), imag1, real2);
+
+        vst1q_f32(realAccP + i, realResult);
+        vst1q_f32(imagAccP + i, imagResult);
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        realAccP[i] += real1P[i] * real2P[i] - imag1P[i] * imag2P[i];
+        imagAccP[i] += real1P[i] * imag2P[i] + imag1P[i] * real2P[i];
+    }
+}
+
 void vsvesq(const float* sourceP, int sourceStride, float* sumP, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride == 1) && kernels().vsvesq) {
+        *sumP = kernels().vsvesq(sourceP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
     float sum = 0;
 
@@ -535,14 +929,10 @@ void vsvesq(const float* sourceP, int sourceStride, float* sumP, size_t framesTo
         float32x4_t fourSum = vdupq_n_f32(0);
         while (sourceP < endP) {
             float32x4_t source = vld1q_f32(sourceP);
-            fourSum = vmlaq_f32(fourSum, source, source);
+            fourSum = multiplyAdd(fourSum, source, source);
             sourceP += 4;
         }
-        float32x2_t twoSum = vadd_f32(vget_low_f32(fourSum), vget_high_f32(fourSum));
-
-        float groupSum[2];
-        vst1_f32(groupSum, twoSum);
-        sum += groupSum[0] + groupSum[1];
+        sum += horizontalSum(fourSum);
 
         n = tailFrames;
     }
@@ -560,6 +950,13 @@ void vsvesq(const float* sourceP, int sourceStride, float* sumP, size_t framesTo
 
 void vmaxmgv(const float* sourceP, int sourceStride, float* maxP, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride == 1) && kernels().vmaxmgv) {
+        *maxP = kernels().vmaxmgv(sourceP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
     float max = 0;
 
@@ -608,11 +1005,7 @@ void vmaxmgv(const float* sourceP, int sourceStride, float* maxP, size_t framesT
             fourMax = vmaxq_f32(fourMax, vabsq_f32(source));
             sourceP += 4;
         }
-        float32x2_t twoMax = vmax_f32(vget_low_f32(fourMax), vget_high_f32(fourMax));
-
-        float groupMax[2];
-        vst1_f32(groupMax, twoMax);
-        max = std::max(groupMax[0], groupMax[1]);
+        max = horizontalMax(fourMax);
 
         n = tailFrames;
     }
@@ -629,6 +1022,13 @@ void vmaxmgv(const float* sourceP, int sourceStride, float* maxP, size_t framesT
 
 void vclip(const float* sourceP, int sourceStride, const float* lowThresholdP, const float* highThresholdP, float* destP, int destStride, size_t framesToProcess)
 {
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if ((sourceStride == 1) && (destStride == 1) && kernels().vclip) {
+        kernels().vclip(sourceP, *lowThresholdP, *highThresholdP, destP, framesToProcess);
+        return;
+    }
+#endif
+
     int n = framesToProcess;
     float lowThreshold = *lowThresholdP;
     float highThreshold = *highThresholdP;
@@ -657,63 +1057,1238 @@ void vclip(const float* sourceP, int sourceStride, const float* lowThresholdP, c
     }
 }
 
+void vfill(const float* valueP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vfill) {
+        kernels().vfill(*valueP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    float value = *valueP;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 mValue = _mm_set1_ps(value);
+    for (; i + 4 <= framesToProcess; i += 4)
+        _mm_storeu_ps(destP + i, mValue);
+#elif defined(ARM_NEON_INTRINSICS)
+    float32x4_t fourValue = vdupq_n_f32(value);
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, fourValue);
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = value;
+}
+
+void vsadd(const float* sourceP, const float* addendP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vsadd) {
+        kernels().vsadd(sourceP, *addendP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    float addend = *addendP;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 mAddend = _mm_set1_ps(addend);
+    for (; i + 4 <= framesToProcess; i += 4)
+        _mm_storeu_ps(destP + i, _mm_add_ps(_mm_loadu_ps(sourceP + i), mAddend));
+#elif defined(ARM_NEON_INTRINSICS)
+    float32x4_t fourAddend = vdupq_n_f32(addend);
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, vaddq_f32(vld1q_f32(sourceP + i), fourAddend));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = sourceP[i] + addend;
+}
+
+void vramp(const float* startP, const float* stepP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vramp) {
+        kernels().vramp(*startP, *stepP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    // Each value is computed from its index rather than accumulated, so that long ramps don't drift.
+    float start = *startP;
+    float step = *stepP;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 mStart = _mm_set1_ps(start);
+    __m128 mStep = _mm_set1_ps(step);
+    __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+        _mm_storeu_ps(destP + i, _mm_add_ps(mStart, _mm_mul_ps(index, mStep)));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float laneValues[4] = { 0, 1, 2, 3 };
+    float32x4_t lanes = vld1q_f32(laneValues);
+    float32x4_t fourStart = vdupq_n_f32(start);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t index = vaddq_f32(vdupq_n_f32(static_cast<float>(i)), lanes);
+        vst1q_f32(destP + i, vaddq_f32(fourStart, vmulq_n_f32(index, step)));
+    }
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = start + static_cast<float>(i) * step;
+}
+
+void vexp(const float* sourceP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vexp) {
+        kernels().vexp(sourceP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= framesToProcess; i += 4)
+        _mm_storeu_ps(destP + i, expSSE2(_mm_loadu_ps(sourceP + i)));
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, expNEON(vld1q_f32(sourceP + i)));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = expf(sourceP[i]);
+}
+
+void vlog(const float* sourceP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vlog) {
+        kernels().vlog(sourceP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= framesToProcess; i += 4)
+        _mm_storeu_ps(destP + i, logSSE2(_mm_loadu_ps(sourceP + i)));
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, logNEON(vld1q_f32(sourceP + i)));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = logf(sourceP[i]);
+}
+
+void vtanh(const float* sourceP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vtanh) {
+        kernels().vtanh(sourceP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    // tanh(x) = (e^2x - 1) / (e^2x + 1), which is 1 to float precision beyond |x| = 9.
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 limit = _mm_set1_ps(9.0f);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(sourceP + i), _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+        __m128 e = expSSE2(_mm_add_ps(x, x));
+        _mm_storeu_ps(destP + i, _mm_div_ps(_mm_sub_ps(e, one), _mm_add_ps(e, one)));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t x = vminq_f32(vmaxq_f32(vld1q_f32(sourceP + i), vdupq_n_f32(-9.0f)), vdupq_n_f32(9.0f));
+        float32x4_t e = expNEON(vaddq_f32(x, x));
+        float32x4_t denominator = vaddq_f32(e, one);
+#if defined(__aarch64__) || defined(_M_ARM64)
+        float32x4_t quotient = vdivq_f32(vsubq_f32(e, one), denominator);
+#else
+        // ARMv7 has no vector division; refine the reciprocal estimate twice.
+        float32x4_t reciprocal = vrecpeq_f32(denominator);
+        reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+        reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+        float32x4_t quotient = vmulq_f32(vsubq_f32(e, one), reciprocal);
+#endif
+        vst1q_f32(destP + i, quotient);
+    }
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = tanhf(sourceP[i]);
+}
+
+void vlookup(const float* tableP, size_t tableSize, const float* indexP, float* destP, size_t framesToProcess)
+{
+    ASSERT(tableSize);
+    if (tableSize < 2) {
+        vfill(tableP, destP, framesToProcess);
+        return;
+    }
+
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vlookup) {
+        kernels().vlookup(tableP, tableSize, indexP, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    // The lower sample of each pair is at most tableSize - 2, so that the upper one is in the table; the last
+    // index then interpolates fully to the last entry.
+    const float maxIndex = static_cast<float>(tableSize - 1);
+    const float maxLower = static_cast<float>(tableSize - 2);
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 mMaxIndex = _mm_set1_ps(maxIndex);
+    const __m128 mMaxLower = _mm_set1_ps(maxLower);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        // The maximum is taken first, and returns zero for a NaN index.
+        __m128 index = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(indexP + i), _mm_setzero_ps()), mMaxIndex);
+        __m128 lower = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(index)), mMaxLower);
+        __m128 fraction = _mm_sub_ps(index, lower);
+
+        int k[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(k), _mm_cvttps_epi32(lower));
+        __m128 a = _mm_set_ps(tableP[k[3]], tableP[k[2]], tableP[k[1]], tableP[k[0]]);
+        __m128 b = _mm_set_ps(tableP[k[3] + 1], tableP[k[2] + 1], tableP[k[1] + 1], tableP[k[0] + 1]);
+        _mm_storeu_ps(destP + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fraction)));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t fourMaxIndex = vdupq_n_f32(maxIndex);
+    const float32x4_t fourMaxLower = vdupq_n_f32(maxLower);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t index = vminq_f32(vmaxq_f32(vld1q_f32(indexP + i), vdupq_n_f32(0)), fourMaxIndex);
+        float32x4_t lower = vminq_f32(vcvtq_f32_s32(vcvtq_s32_f32(index)), fourMaxLower);
+        float32x4_t fraction = vsubq_f32(index, lower);
+
+        int32_t k[4];
+        vst1q_s32(k, vcvtq_s32_f32(lower));
+        float aValues[4] = { tableP[k[0]], tableP[k[1]], tableP[k[2]], tableP[k[3]] };
+        float bValues[4] = { tableP[k[0] + 1], tableP[k[1] + 1], tableP[k[2] + 1], tableP[k[3] + 1] };
+        float32x4_t a = vld1q_f32(aValues);
+        float32x4_t b = vld1q_f32(bValues);
+        vst1q_f32(destP + i, multiplyAdd(a, vsubq_f32(b, a), fraction));
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        float index = indexP[i];
+        index = index > 0 ? (index < maxIndex ? index : maxIndex) : 0;
+        float lower = std::min(static_cast<float>(static_cast<int>(index)), maxLower);
+        int k = static_cast<int>(lower);
+        destP[i] = tableP[k] + (tableP[k + 1] - tableP[k]) * (index - lower);
+    }
+}
+
+void vconv(const float* sourceP, const float* kernelP, size_t kernelSize, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vconv) {
+        kernels().vconv(sourceP, kernelP, kernelSize, destP, framesToProcess);
+        return;
+    }
+#endif
+
+    // Vectorized across outputs: each tap is broadcast and multiplied with the consecutive sources it meets,
+    // and independent sums keep the additions from waiting on each other.
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= framesToProcess; i += 16) {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        __m128 sum2 = _mm_setzero_ps();
+        __m128 sum3 = _mm_setzero_ps();
+        const float* inputP = sourceP + i;
+        for (size_t j = 0; j < kernelSize; ++j, --inputP) {
+            __m128 tap = _mm_set1_ps(kernelP[j]);
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(tap, _mm_loadu_ps(inputP)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(tap, _mm_loadu_ps(inputP + 4)));
+            sum2 = _mm_add_ps(sum2, _mm_mul_ps(tap, _mm_loadu_ps(inputP + 8)));
+            sum3 = _mm_add_ps(sum3, _mm_mul_ps(tap, _mm_loadu_ps(inputP + 12)));
+        }
+        _mm_storeu_ps(destP + i, sum0);
+        _mm_storeu_ps(destP + i + 4, sum1);
+        _mm_storeu_ps(destP + i + 8, sum2);
+        _mm_storeu_ps(destP + i + 12, sum3);
+    }
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        const float* inputP = sourceP + i;
+        for (size_t j = 0; j < kernelSize; ++j, --inputP)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernelP[j]), _mm_loadu_ps(inputP)));
+        _mm_storeu_ps(destP + i, sum);
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 16 <= framesToProcess; i += 16) {
+        float32x4_t sum0 = vdupq_n_f32(0);
+        float32x4_t sum1 = vdupq_n_f32(0);
+        float32x4_t sum2 = vdupq_n_f32(0);
+        float32x4_t sum3 = vdupq_n_f32(0);
+        const float* inputP = sourceP + i;
+        for (size_t j = 0; j < kernelSize; ++j, --inputP) {
+            float32x4_t tap = vdupq_n_f32(kernelP[j]);
+            sum0 = multiplyAdd(sum0, tap, vld1q_f32(inputP));
+            sum1 = multiplyAdd(sum1, tap, vld1q_f32(inputP + 4));
+            sum2 = multiplyAdd(sum2, tap, vld1q_f32(inputP + 8));
+            sum3 = multiplyAdd(sum3, tap, vld1q_f32(inputP + 12));
+        }
+        vst1q_f32(destP + i, sum0);
+        vst1q_f32(destP + i + 4, sum1);
+        vst1q_f32(destP + i + 8, sum2);
+        vst1q_f32(destP + i + 12, sum3);
+    }
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t sum = vdupq_n_f32(0);
+        const float* inputP = sourceP + i;
+        for (size_t j = 0; j < kernelSize; ++j, --inputP)
+            sum = multiplyAdd(sum, vdupq_n_f32(kernelP[j]), vld1q_f32(inputP));
+        vst1q_f32(destP + i, sum);
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        float sum = 0;
+        for (size_t j = 0; j < kernelSize; ++j)
+            sum += sourceP[i - j] * kernelP[j];
+        destP[i] = sum;
+    }
+}
+
+void vdotpr2(const float* sourceP, const float* kernel1P, const float* kernel2P, float* dot1P, float* dot2P, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vdotpr2) {
+        kernels().vdotpr2(sourceP, kernel1P, kernel2P, dot1P, dot2P, framesToProcess);
+        return;
+    }
+#endif
+
+    // Two sums per kernel, so that the additions don't wait on each other.
+    size_t i = 0;
+    float dot1 = 0;
+    float dot2 = 0;
+#ifdef __SSE2__
+    __m128 sum1a = _mm_setzero_ps();
+    __m128 sum1b = _mm_setzero_ps();
+    __m128 sum2a = _mm_setzero_ps();
+    __m128 sum2b = _mm_setzero_ps();
+    for (; i + 8 <= framesToProcess; i += 8) {
+        __m128 sourceA = _mm_loadu_ps(sourceP + i);
+        __m128 sourceB = _mm_loadu_ps(sourceP + i + 4);
+        sum1a = _mm_add_ps(sum1a, _mm_mul_ps(sourceA, _mm_loadu_ps(kernel1P + i)));
+        sum1b = _mm_add_ps(sum1b, _mm_mul_ps(sourceB, _mm_loadu_ps(kernel1P + i + 4)));
+        sum2a = _mm_add_ps(sum2a, _mm_mul_ps(sourceA, _mm_loadu_ps(kernel2P + i)));
+        sum2b = _mm_add_ps(sum2b, _mm_mul_ps(sourceB, _mm_loadu_ps(kernel2P + i + 4)));
+    }
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 source = _mm_loadu_ps(sourceP + i);
+        sum1a = _mm_add_ps(sum1a, _mm_mul_ps(source, _mm_loadu_ps(kernel1P + i)));
+        sum2a = _mm_add_ps(sum2a, _mm_mul_ps(source, _mm_loadu_ps(kernel2P + i)));
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, _mm_add_ps(sum1a, sum1b));
+    dot1 = sums[0] + sums[1] + sums[2] + sums[3];
+    _mm_storeu_ps(sums, _mm_add_ps(sum2a, sum2b));
+    dot2 = sums[0] + sums[1] + sums[2] + sums[3];
+#elif defined(ARM_NEON_INTRINSICS)
+    float32x4_t sum1a = vdupq_n_f32(0);
+    float32x4_t sum1b = vdupq_n_f32(0);
+    float32x4_t sum2a = vdupq_n_f32(0);
+    float32x4_t sum2b = vdupq_n_f32(0);
+    for (; i + 8 <= framesToProcess; i += 8) {
+        float32x4_t sourceA = vld1q_f32(sourceP + i);
+        float32x4_t sourceB = vld1q_f32(sourceP + i + 4);
+        sum1a = multiplyAdd(sum1a, sourceA, vld1q_f32(kernel1P + i));
+        sum1b = multiplyAdd(sum1b, sourceB, vld1q_f32(kernel1P + i + 4));
+        sum2a = multiplyAdd(sum2a, sourceA, vld1q_f32(kernel2P + i));
+        sum2b = multiplyAdd(sum2b, sourceB, vld1q_f32(kernel2P + i + 4));
+    }
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t source = vld1q_f32(sourceP + i);
+        sum1a = multiplyAdd(sum1a, source, vld1q_f32(kernel1P + i));
+        sum2a = multiplyAdd(sum2a, source, vld1q_f32(kernel2P + i));
+    }
+    dot1 = horizontalSum(vaddq_f32(sum1a, sum1b));
+    dot2 = horizontalSum(vaddq_f32(sum2a, sum2b));
+#endif
+    for (; i < framesToProcess; ++i) {
+        dot1 += sourceP[i] * kernel1P[i];
+        dot2 += sourceP[i] * kernel2P[i];
+    }
+    *dot1P = dot1;
+    *dot2P = dot2;
+}
+
+void vsum(const float* const* sourcesP, size_t sourceCount, float* destP, size_t framesToProcess)
+{
+    // Sixteen frames of the destination at a time stay in registers while every source is added to them.
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= framesToProcess; i += 16) {
+        __m128 sum0 = _mm_loadu_ps(destP + i);
+        __m128 sum1 = _mm_loadu_ps(destP + i + 4);
+        __m128 sum2 = _mm_loadu_ps(destP + i + 8);
+        __m128 sum3 = _mm_loadu_ps(destP + i + 12);
+        for (size_t source = 0; source < sourceCount; ++source) {
+            const float* sourceP = sourcesP[source] + i;
+            sum0 = _mm_add_ps(sum0, _mm_loadu_ps(sourceP));
+            sum1 = _mm_add_ps(sum1, _mm_loadu_ps(sourceP + 4));
+            sum2 = _mm_add_ps(sum2, _mm_loadu_ps(sourceP + 8));
+            sum3 = _mm_add_ps(sum3, _mm_loadu_ps(sourceP + 12));
+        }
+        _mm_storeu_ps(destP + i, sum0);
+        _mm_storeu_ps(destP + i + 4, sum1);
+        _mm_storeu_ps(destP + i + 8, sum2);
+        _mm_storeu_ps(destP + i + 12, sum3);
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 16 <= framesToProcess; i += 16) {
+        float32x4_t sum0 = vld1q_f32(destP + i);
+        float32x4_t sum1 = vld1q_f32(destP + i + 4);
+        float32x4_t sum2 = vld1q_f32(destP + i + 8);
+        float32x4_t sum3 = vld1q_f32(destP + i + 12);
+        for (size_t source = 0; source < sourceCount; ++source) {
+            const float* sourceP = sourcesP[source] + i;
+            sum0 = vaddq_f32(sum0, vld1q_f32(sourceP));
+            sum1 = vaddq_f32(sum1, vld1q_f32(sourceP + 4));
+            sum2 = vaddq_f32(sum2, vld1q_f32(sourceP + 8));
+            sum3 = vaddq_f32(sum3, vld1q_f32(sourceP + 12));
+        }
+        vst1q_f32(destP + i, sum0);
+        vst1q_f32(destP + i + 4, sum1);
+        vst1q_f32(destP + i + 8, sum2);
+        vst1q_f32(destP + i + 12, sum3);
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        float sum = destP[i];
+        for (size_t source = 0; source < sourceCount; ++source)
+            sum += sourcesP[source][i];
+        destP[i] = sum;
+    }
+}
+
+void vmix(const float* const* sourcesP, size_t sourceCount, const float* const* gainsP, float* const* destsP, size_t destCount, bool accumulate, size_t framesToProcess)
+{
+    ASSERT(sourceCount <= MaxMixChannels && destCount <= MaxMixChannels);
+
+    // Four frames of every source are loaded once and then mixed into each destination in turn.
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 gains[MaxMixChannels][MaxMixChannels];
+    for (size_t dest = 0; dest < destCount; ++dest) {
+        for (size_t source = 0; source < sourceCount; ++source)
+            gains[dest][source] = _mm_set1_ps(gainsP[dest][source]);
+    }
+
+    __m128 sources[MaxMixChannels];
+    for (; i + 4 <= framesToProcess; i += 4) {
+        for (size_t source = 0; source < sourceCount; ++source)
+            sources[source] = _mm_loadu_ps(sourcesP[source] + i);
+        for (size_t dest = 0; dest < destCount; ++dest) {
+            __m128 sum = accumulate ? _mm_loadu_ps(destsP[dest] + i) : _mm_setzero_ps();
+            for (size_t source = 0; source < sourceCount; ++source) {
+                if (gainsP[dest][source] != 0)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(gains[dest][source], sources[source]));
+            }
+            _mm_storeu_ps(destsP[dest] + i, sum);
+        }
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    float32x4_t sources[MaxMixChannels];
+    for (; i + 4 <= framesToProcess; i += 4) {
+        for (size_t source = 0; source < sourceCount; ++source)
+            sources[source] = vld1q_f32(sourcesP[source] + i);
+        for (size_t dest = 0; dest < destCount; ++dest) {
+            float32x4_t sum = accumulate ? vld1q_f32(destsP[dest] + i) : vdupq_n_f32(0);
+            for (size_t source = 0; source < sourceCount; ++source) {
+                if (gainsP[dest][source] != 0)
+                    sum = vaddq_f32(sum, vmulq_n_f32(sources[source], gainsP[dest][source]));
+            }
+            vst1q_f32(destsP[dest] + i, sum);
+        }
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        for (size_t dest = 0; dest < destCount; ++dest) {
+            float sum = accumulate ? destsP[dest][i] : 0;
+            for (size_t source = 0; source < sourceCount; ++source) {
+                if (gainsP[dest][source] != 0)
+                    sum += gainsP[dest][source] * sourcesP[source][i];
+            }
+            destsP[dest][i] = sum;
+        }
+    }
+}
+
 #endif // OS(DARWIN)
 
-void vintlve(const float* realSrcP, const float* imagSrcP, float* destP, size_t framesToProcess) {
-    int i = 0;
-#if defined(ARM_NEON_INTRINSICS)
-    int j = 0;
-    int endSize = framesToProcess - framesToProcess % 4;
-    int len = endSize / 2;
+// These are composed from the kernels above.
 
-    while (i < len) {
-        float32x4_t source1 = vld1q_f32(realSrcP);
-        float32x4_t source2 = vld1q_f32(imagSrcP);
-        float32x4x2_t source = vzipq_f32(source1, source2);
+void vexpramp(const float* startP, const float* ratioP, float* destP, size_t framesToProcess)
+{
+    // start * ratio^i = start * e^(i * ln(ratio)), without the drift of a running product.
+    const float zero = 0;
+    const float logRatio = logf(*ratioP);
+    vramp(&zero, &logRatio, destP, framesToProcess);
+    vexp(destP, destP, framesToProcess);
+    vsmul(destP, 1, startP, destP, 1, framesToProcess);
+}
 
-        vst1q_f32(destP + j, source.val[0]);
-        vst1q_f32(destP + j + 4, source.val[1]);
-        realSrcP += 4;
-        imagSrcP += 4;
+void vsmooth(float* stateP, const float* targetP, const float* coefficientP, float* destP, size_t framesToProcess)
+{
+    if (!framesToProcess)
+        return;
+
+    // The distance to the target shrinks by 1 - coefficient a frame, target + (state - target) * (1 - k)^(i + 1).
+    const float target = *targetP;
+    const float coefficient = std::min(std::max(*coefficientP, 0.f), 1.f);
+    if (coefficient == 1) {
+        vfill(&target, destP, framesToProcess);
+    }
+    else {
+        const float ratio = 1 - coefficient;
+        const float start = (*stateP - target) * ratio;
+        vexpramp(&start, &ratio, destP, framesToProcess);
+        vsadd(destP, &target, destP, framesToProcess);
+    }
+    *stateP = destP[framesToProcess - 1];
+}
 
-        i += 4;
-        j += 8;
+void vpow(const float* sourceP, const float* exponentP, float* destP, size_t framesToProcess)
+{
+    vlog(sourceP, destP, framesToProcess);
+    vsmul(destP, 1, exponentP, destP, 1, framesToProcess);
+    vexp(destP, destP, framesToProcess);
+}
+
+void vlinearToDecibels(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    // 20 * log10(x), where -infinity for zero is raised to -1000.
+    const float scale = 20 / logf(10);
+    const float low = -1000;
+    const float high = std::numeric_limits<float>::max();
+    vlog(sourceP, destP, framesToProcess);
+    vsmul(destP, 1, &scale, destP, 1, framesToProcess);
+    vclip(destP, 1, &low, &high, destP, 1, framesToProcess);
+}
+
+void vdecibelsToLinear(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    // 10^(x / 20)
+    const float scale = logf(10) / 20;
+    vsmul(sourceP, 1, &scale, destP, 1, framesToProcess);
+    vexp(destP, destP, framesToProcess);
+}
+
+void vpangains(const float* positionP, float* leftP, float* rightP, size_t framesToProcess)
+{
+    // cos(x * pi / 2) = sin((1 - x) * pi / 2), and sin(x * pi / 2) over [0, 1] is its Taylor series to the ninth
+    // power, odd so that it is exactly zero at zero.
+    const float c1 = 1.57079633f;
+    const float c3 = -0.645964098f;
+    const float c5 = 0.0796926262f;
+    const float c7 = -0.00468175414f;
+    const float c9 = 0.000160441185f;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    auto sinSSE2 = [&](__m128 x) {
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c9), x2), _mm_set1_ps(c7));
+        y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(c5));
+        y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(c3));
+        y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(c1));
+        return _mm_mul_ps(y, x);
+    };
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(positionP + i), zero), one);
+        _mm_storeu_ps(leftP + i, sinSSE2(_mm_sub_ps(one, x)));
+        _mm_storeu_ps(rightP + i, sinSSE2(x));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t zero = vdupq_n_f32(0);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    auto sinNEON = [&](float32x4_t x) {
+        float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t y = vaddq_f32(vmulq_n_f32(x2, c9), vdupq_n_f32(c7));
+        y = vaddq_f32(vmulq_f32(y, x2), vdupq_n_f32(c5));
+        y = vaddq_f32(vmulq_f32(y, x2), vdupq_n_f32(c3));
+        y = vaddq_f32(vmulq_f32(y, x2), vdupq_n_f32(c1));
+        return vmulq_f32(y, x);
+    };
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t x = vminq_f32(vmaxq_f32(vld1q_f32(positionP + i), zero), one);
+        vst1q_f32(leftP + i, sinNEON(vsubq_f32(one, x)));
+        vst1q_f32(rightP + i, sinNEON(x));
     }
 #endif
-    int lenTail = framesToProcess / 2;
-    for (; i < lenTail; ++i) {
-        int baseIndex = 2 * i;
-        destP[baseIndex] = realSrcP[i];
-        destP[baseIndex + 1] = imagSrcP[i];
+    auto sinScalar = [&](float x) {
+        float x2 = x * x;
+        return x * (c1 + x2 * (c3 + x2 * (c5 + x2 * (c7 + x2 * c9))));
+    };
+    for (; i < framesToProcess; ++i) {
+        float x = std::min(std::max(positionP[i], 0.f), 1.f);
+        leftP[i] = sinScalar(1 - x);
+        rightP[i] = sinScalar(x);
     }
 }
 
-void vdeintlve(const float* sourceP, float* realDestP, float* imagDestP, size_t framesToProcess) {
-    int i = 0;
-#if defined(ARM_NEON_INTRINSICS)
-    int j = 0;
-    int endSize = framesToProcess - framesToProcess % 4;
+namespace {
 
-    while (i < endSize) {
-        float32x4_t source1 = vld1q_f32(sourceP);
-        float32x4_t source2 = vld1q_f32(sourceP + 4);
+#ifdef __SSE2__
+    inline void transpose4SSE2(__m128& r0, __m128& r1, __m128& r2, __m128& r3)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    inline void transpose4NEON(float32x4_t& r0, float32x4_t& r1, float32x4_t& r2, float32x4_t& r3)
+    {
+        float32x4x2_t t01 = vtrnq_f32(r0, r1);
+        float32x4x2_t t23 = vtrnq_f32(r2, r3);
+        r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+        r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+        r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+        r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+#endif
+
+    // xorshift32, and a uniform value in [0, 1) from its top 23 bits.
+    inline uint32_t nextDither(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    inline float ditherUnit(uint32_t bits)
+    {
+        uint32_t mantissa = (bits >> 9) | 0x3f800000;
+        float value;
+        memcpy(&value, &mantissa, sizeof(value));
+        return value - 1;
+    }
+
+} // namespace
+
+void vinterleave(const float* const* sourcesP, size_t channelCount, float* destP, size_t framesToProcess)
+{
+    if (channelCount == 1) {
+        memcpy(destP, sourcesP[0], sizeof(float) * framesToProcess);
+        return;
+    }
+
+    size_t c = 0;
+    if (channelCount == 2) {
+        const float* left = sourcesP[0];
+        const float* right = sourcesP[1];
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 4 <= framesToProcess; i += 4) {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(destP + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(destP + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#elif defined(ARM_NEON_INTRINSICS)
+        for (; i + 4 <= framesToProcess; i += 4) {
+            float32x4x2_t lr;
+            lr.val[0] = vld1q_f32(left + i);
+            lr.val[1] = vld1q_f32(right + i);
+            vst2q_f32(destP + 2 * i, lr);
+        }
+#endif
+        for (; i < framesToProcess; ++i) {
+            destP[2 * i] = left[i];
+            destP[2 * i + 1] = right[i];
+        }
+        return;
+    }
+
+#if defined(__SSE2__) || defined(ARM_NEON_INTRINSICS)
+    // Each group of four channels is read a vector from each, and written as four frames after a transpose.
+    const size_t endFrames = framesToProcess - framesToProcess % 4;
+    for (; c + 4 <= channelCount; c += 4) {
+        const float* s0 = sourcesP[c];
+        const float* s1 = sourcesP[c + 1];
+        const float* s2 = sourcesP[c + 2];
+        const float* s3 = sourcesP[c + 3];
+        float* d = destP + c;
+        for (size_t i = 0; i < endFrames; i += 4, d += 4 * channelCount) {
+#ifdef __SSE2__
+            __m128 r0 = _mm_loadu_ps(s0 + i);
+            __m128 r1 = _mm_loadu_ps(s1 + i);
+            __m128 r2 = _mm_loadu_ps(s2 + i);
+            __m128 r3 = _mm_loadu_ps(s3 + i);
+            transpose4SSE2(r0, r1, r2, r3);
+            _mm_storeu_ps(d, r0);
+            _mm_storeu_ps(d + channelCount, r1);
+            _mm_storeu_ps(d + 2 * channelCount, r2);
+            _mm_storeu_ps(d + 3 * channelCount, r3);
+#else
+            float32x4_t r0 = vld1q_f32(s0 + i);
+            float32x4_t r1 = vld1q_f32(s1 + i);
+            float32x4_t r2 = vld1q_f32(s2 + i);
+            float32x4_t r3 = vld1q_f32(s3 + i);
+            transpose4NEON(r0, r1, r2, r3);
+            vst1q_f32(d, r0);
+            vst1q_f32(d + channelCount, r1);
+            vst1q_f32(d + 2 * channelCount, r2);
+            vst1q_f32(d + 3 * channelCount, r3);
+#endif
+        }
+        for (size_t i = endFrames; i < framesToProcess; ++i) {
+            float* frame = destP + i * channelCount + c;
+            frame[0] = s0[i];
+            frame[1] = s1[i];
+            frame[2] = s2[i];
+            frame[3] = s3[i];
+        }
+    }
+#endif
+
+    for (; c < channelCount; ++c) {
+        const float* source = sourcesP[c];
+        float* d = destP + c;
+        for (size_t i = 0; i < framesToProcess; ++i, d += channelCount)
+            *d = source[i];
+    }
+}
+
+void vdeinterleave(const float* sourceP, size_t channelCount, float* const* destsP, size_t framesToProcess)
+{
+    if (channelCount == 1) {
+        memcpy(destsP[0], sourceP, sizeof(float) * framesToProcess);
+        return;
+    }
+
+    size_t c = 0;
+    if (channelCount == 2) {
+        float* left = destsP[0];
+        float* right = destsP[1];
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 4 <= framesToProcess; i += 4) {
+            __m128 a = _mm_loadu_ps(sourceP + 2 * i);
+            __m128 b = _mm_loadu_ps(sourceP + 2 * i + 4);
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(ARM_NEON_INTRINSICS)
+        for (; i + 4 <= framesToProcess; i += 4) {
+            float32x4x2_t lr = vld2q_f32(sourceP + 2 * i);
+            vst1q_f32(left + i, lr.val[0]);
+            vst1q_f32(right + i, lr.val[1]);
+        }
+#endif
+        for (; i < framesToProcess; ++i) {
+            left[i] = sourceP[2 * i];
+            right[i] = sourceP[2 * i + 1];
+        }
+        return;
+    }
+
+#if defined(__SSE2__) || defined(ARM_NEON_INTRINSICS)
+    const size_t endFrames = framesToProcess - framesToProcess % 4;
+    for (; c + 4 <= channelCount; c += 4) {
+        float* d0 = destsP[c];
+        float* d1 = destsP[c + 1];
+        float* d2 = destsP[c + 2];
+        float* d3 = destsP[c + 3];
+        const float* s = sourceP + c;
+        for (size_t i = 0; i < endFrames; i += 4, s += 4 * channelCount) {
+#ifdef __SSE2__
+            __m128 r0 = _mm_loadu_ps(s);
+            __m128 r1 = _mm_loadu_ps(s + channelCount);
+            __m128 r2 = _mm_loadu_ps(s + 2 * channelCount);
+            __m128 r3 = _mm_loadu_ps(s + 3 * channelCount);
+            transpose4SSE2(r0, r1, r2, r3);
+            _mm_storeu_ps(d0 + i, r0);
+            _mm_storeu_ps(d1 + i, r1);
+            _mm_storeu_ps(d2 + i, r2);
+            _mm_storeu_ps(d3 + i, r3);
+#else
+            float32x4_t r0 = vld1q_f32(s);
+            float32x4_t r1 = vld1q_f32(s + channelCount);
+            float32x4_t r2 = vld1q_f32(s + 2 * channelCount);
+            float32x4_t r3 = vld1q_f32(s + 3 * channelCount);
+            transpose4NEON(r0, r1, r2, r3);
+            vst1q_f32(d0 + i, r0);
+            vst1q_f32(d1 + i, r1);
+            vst1q_f32(d2 + i, r2);
+            vst1q_f32(d3 + i, r3);
+#endif
+        }
+        for (size_t i = endFrames; i < framesToProcess; ++i) {
+            const float* frame = sourceP + i * channelCount + c;
+            d0[i] = frame[0];
+            d1[i] = frame[1];
+            d2[i] = frame[2];
+            d3[i] = frame[3];
+        }
+    }
+#endif
+
+    for (; c < channelCount; ++c) {
+        float* dest = destsP[c];
+        const float* s = sourceP + c;
+        for (size_t i = 0; i < framesToProcess; ++i, s += channelCount)
+            dest[i] = *s;
+    }
+}
+
+void vdownmix2(const float* sourceP, float* destP, size_t framesToProcess)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 a = _mm_loadu_ps(sourceP + 2 * i);
+        __m128 b = _mm_loadu_ps(sourceP + 2 * i + 4);
+        __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_ps(destP + i, _mm_mul_ps(sum, half));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4x2_t lr = vld2q_f32(sourceP + 2 * i);
+        vst1q_f32(destP + i, vmulq_n_f32(vaddq_f32(lr.val[0], lr.val[1]), 0.5f));
+    }
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = 0.5f * (sourceP[2 * i] + sourceP[2 * i + 1]);
+}
 
-        float32x4x2_t source = vuzpq_f32(source1, source2);
+void vquantize16(const float* sourceP, int16_t* destP, uint32_t* ditherStateP, size_t framesToProcess)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 low = _mm_set1_ps(-1.0f);
+    const __m128 high = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128i exponent = _mm_set1_epi32(0x3f800000);
+    __m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ditherStateP));
+    auto next = [&]() {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        return _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9), exponent)), high);
+    };
+    for (; i + 8 <= framesToProcess; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(sourceP + i), low), high);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(sourceP + i + 4), low), high);
+        a = _mm_add_ps(_mm_mul_ps(a, scale), _mm_sub_ps(next(), next()));
+        b = _mm_add_ps(_mm_mul_ps(b, scale), _mm_sub_ps(next(), next()));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destP + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ditherStateP), state);
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t low = vdupq_n_f32(-1.0f);
+    const float32x4_t high = vdupq_n_f32(1.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const uint32x4_t exponent = vdupq_n_u32(0x3f800000);
+    const uint32x4_t signMask = vdupq_n_u32(0x80000000);
+    uint32x4_t state = vld1q_u32(ditherStateP);
+    auto next = [&]() {
+        state = veorq_u32(state, vshlq_n_u32(state, 13));
+        state = veorq_u32(state, vshrq_n_u32(state, 17));
+        state = veorq_u32(state, vshlq_n_u32(state, 5));
+        return vsubq_f32(vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(state, 9), exponent)), high);
+    };
+    // Rounded to nearest by adding a half of the value's sign before the truncating conversion.
+    auto roundNEON = [&](float32x4_t x) {
+        float32x4_t signedHalf = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(x), signMask), vreinterpretq_u32_f32(half)));
+        return vcvtq_s32_f32(vaddq_f32(x, signedHalf));
+    };
+    for (; i + 8 <= framesToProcess; i += 8) {
+        float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(sourceP + i), low), high);
+        float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(sourceP + i + 4), low), high);
+        a = vaddq_f32(vmulq_n_f32(a, 32767.0f), vsubq_f32(next(), next()));
+        b = vaddq_f32(vmulq_n_f32(b, 32767.0f), vsubq_f32(next(), next()));
+        vst1q_s16(destP + i, vcombine_s16(vqmovn_s32(roundNEON(a)), vqmovn_s32(roundNEON(b))));
+    }
+    vst1q_u32(ditherStateP, state);
+#endif
+    for (; i < framesToProcess; ++i) {
+        uint32_t& state = ditherStateP[i & 3];
+        float dither = ditherUnit(nextDither(state));
+        dither -= ditherUnit(nextDither(state));
+        float sample = std::min(std::max(sourceP[i], -1.0f), 1.0f) * 32767.0f + dither;
+        destP[i] = static_cast<int16_t>(std::min(std::max(lrintf(sample), -32768L), 32767L));
+    }
+}
 
-        vst1q_f32(realDestP + j, source.val[0]);
-        vst1q_f32(imagDestP + j, source.val[1]);
+void vquantize32(const float* sourceP, const float* scale, int32_t* destP, size_t framesToProcess)
+{
+    const float k = *scale;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 low = _mm_set1_ps(-1.0f);
+    const __m128 high = _mm_set1_ps(1.0f);
+    const __m128 mScale = _mm_set1_ps(k);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(sourceP + i), low), high);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destP + i), _mm_cvtps_epi32(_mm_mul_ps(x, mScale)));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t low = vdupq_n_f32(-1.0f);
+    const float32x4_t high = vdupq_n_f32(1.0f);
+    const uint32x4_t signMask = vdupq_n_u32(0x80000000);
+    const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t x = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(sourceP + i), low), high), k);
+        float32x4_t signedHalf = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(x), signMask), half));
+        vst1q_s32(destP + i, vcvtq_s32_f32(vaddq_f32(x, signedHalf)));
+    }
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = static_cast<int32_t>(lrintf(std::min(std::max(sourceP[i], -1.0f), 1.0f) * k));
+}
 
-        sourceP += 8;
+void vdequantize16(const int16_t* sourceP, float* destP, size_t framesToProcess)
+{
+    const float k = 1.0f / 32768.0f;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 mScale = _mm_set1_ps(k);
+    for (; i + 8 <= framesToProcess; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceP + i));
+        // Each sample is widened by moving it to the top of a 32 bit lane and shifting it back with its sign.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(destP + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), mScale));
+        _mm_storeu_ps(destP + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), mScale));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 8 <= framesToProcess; i += 8) {
+        int16x8_t x = vld1q_s16(sourceP + i);
+        vst1q_f32(destP + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), k));
+        vst1q_f32(destP + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), k));
+    }
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = sourceP[i] * k;
+}
 
-        i += 8;
-        j += 4;
+void vdequantize32(const int32_t* sourceP, const float* scale, float* destP, size_t framesToProcess)
+{
+    const float k = *scale;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 mScale = _mm_set1_ps(k);
+    for (; i + 4 <= framesToProcess; i += 4)
+        _mm_storeu_ps(destP + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceP + i))), mScale));
+#elif defined(ARM_NEON_INTRINSICS)
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(sourceP + i)), k));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = sourceP[i] * k;
+}
+
+namespace {
+
+float halfToFloat(uint16_t h)
+{
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1fu;
+    uint32_t mantissa = h & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0x1fu)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else if (exponent)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else {
+        // Zero, or subnormal: mantissa * 2^-24.
+        float f = mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+uint16_t floatToHalf(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    bits &= 0x7fffffffu;
+
+    // 2^16 and above is beyond rounding to the largest half; so are infinities, and NaNs are kept quiet.
+    if (bits >= 0x47800000u)
+        return sign | (bits > 0x7f800000u ? 0x7e00u : 0x7c00u);
+
+    // Below 2^-14 the half is subnormal. Adding 0.5 lines the half's mantissa up with the low bits of the
+    // float's, letting the addition round it.
+    if (bits < 0x38800000u) {
+        const uint32_t magicBits = 0x3f000000u;
+        float magic, sum;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        memcpy(&sum, &bits, sizeof(sum));
+        sum += magic;
+        memcpy(&bits, &sum, sizeof(bits));
+        return sign | static_cast<uint16_t>(bits - magicBits);
+    }
+
+    // Rebias the exponent and round the mantissa to ten bits, ties to even; a carry out of the mantissa
+    // correctly bumps the exponent, up to infinity.
+    uint32_t odd = (bits >> 13) & 1u;
+    bits += 0xc8000fffu + odd;
+    return sign | static_cast<uint16_t>(bits >> 13);
+}
+
+} // namespace
+
+void vhalfToFloat(const uint16_t* sourceP, float* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vhalfToFloat) {
+        kernels().vhalfToFloat(sourceP, destP, framesToProcess);
+        return;
+    }
+#endif
+    size_t i = 0;
+#if defined(ARM_NEON_INTRINSICS) && (defined(__aarch64__) || defined(_M_ARM64))
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1q_f32(destP + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(sourceP + i))));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = halfToFloat(sourceP[i]);
+}
+
+void vfloatToHalf(const float* sourceP, uint16_t* destP, size_t framesToProcess)
+{
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+    if (kernels().vfloatToHalf) {
+        kernels().vfloatToHalf(sourceP, destP, framesToProcess);
+        return;
+    }
+#endif
+    size_t i = 0;
+#if defined(ARM_NEON_INTRINSICS) && (defined(__aarch64__) || defined(_M_ARM64))
+    for (; i + 4 <= framesToProcess; i += 4)
+        vst1_u16(destP + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(sourceP + i))));
+#endif
+    for (; i < framesToProcess; ++i)
+        destP[i] = floatToHalf(sourceP[i]);
+}
+
+void vpolar(const float* realP, const float* imagP, float* magP, float* phaseP, size_t framesToProcess)
+{
+    // The arctangent of the smaller of |x| and |y| over the larger, over [0, 1] the odd polynomial of Abramowitz
+    // and Stegun 4.4.47, is reflected into the octant of (x, y).
+    const float a1 = 0.9998660f;
+    const float a3 = -0.3302995f;
+    const float a5 = 0.1801410f;
+    const float a7 = -0.0851330f;
+    const float a9 = 0.0208351f;
+    const float halfPi = 1.57079633f;
+    const float pi = 3.14159265f;
+    const float tiny = std::numeric_limits<float>::min();
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 x = _mm_loadu_ps(realP + i);
+        __m128 y = _mm_loadu_ps(imagP + i);
+        _mm_storeu_ps(magP + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+        __m128 ax = _mm_andnot_ps(signMask, x);
+        __m128 ay = _mm_andnot_ps(signMask, y);
+        __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(tiny)));
+        __m128 s = _mm_mul_ps(a, a);
+        __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a9), s), _mm_set1_ps(a7));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(a5));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(a3));
+        r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(a1)), a);
+        __m128 steep = _mm_cmpgt_ps(ay, ax);
+        r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(halfPi), r)), _mm_andnot_ps(steep, r));
+        __m128 left = _mm_cmplt_ps(x, _mm_setzero_ps());
+        r = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(_mm_set1_ps(pi), r)), _mm_andnot_ps(left, r));
+        _mm_storeu_ps(phaseP + i, _mm_or_ps(r, _mm_and_ps(signMask, y)));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const float32x4_t zero = vdupq_n_f32(0);
+    const uint32x4_t signMask = vdupq_n_u32(0x80000000);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t x = vld1q_f32(realP + i);
+        float32x4_t y = vld1q_f32(imagP + i);
+        float32x4_t squared = vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y));
+        float32x4_t ax = vabsq_f32(x);
+        float32x4_t ay = vabsq_f32(y);
+        float32x4_t numerator = vminq_f32(ax, ay);
+        float32x4_t denominator = vmaxq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(tiny));
+#if defined(__aarch64__) || defined(_M_ARM64)
+        vst1q_f32(magP + i, vsqrtq_f32(squared));
+        float32x4_t a = vdivq_f32(numerator, denominator);
+#else
+        // ARMv7 has no vector square root or division; refine the estimates twice.
+        float32x4_t root = vrsqrteq_f32(squared);
+        root = vmulq_f32(vrsqrtsq_f32(vmulq_f32(squared, root), root), root);
+        root = vmulq_f32(vrsqrtsq_f32(vmulq_f32(squared, root), root), root);
+        vst1q_f32(magP + i, selectNEON(vceqq_f32(squared, zero), zero, vmulq_f32(squared, root)));
+        float32x4_t reciprocal = vrecpeq_f32(denominator);
+        reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+        reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+        float32x4_t a = vmulq_f32(numerator, reciprocal);
+#endif
+        float32x4_t s = vmulq_f32(a, a);
+        float32x4_t r = vaddq_f32(vmulq_n_f32(s, a9), vdupq_n_f32(a7));
+        r = vaddq_f32(vmulq_f32(r, s), vdupq_n_f32(a5));
+        r = vaddq_f32(vmulq_f32(r, s), vdupq_n_f32(a3));
+        r = vmulq_f32(vaddq_f32(vmulq_f32(r, s), vdupq_n_f32(a1)), a);
+        r = selectNEON(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(halfPi), r), r);
+        r = selectNEON(vcltq_f32(x, zero), vsubq_f32(vdupq_n_f32(pi), r), r);
+        uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(y), signMask);
+        vst1q_f32(phaseP + i, vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(r), sign)));
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        float x = realP[i];
+        float y = imagP[i];
+        magP[i] = sqrtf(x * x + y * y);
+        float ax = fabsf(x);
+        float ay = fabsf(y);
+        float a = std::min(ax, ay) / std::max(std::max(ax, ay), tiny);
+        float s = a * a;
+        float r = ((((a9 * s + a7) * s + a5) * s + a3) * s + a1) * a;
+        if (ay > ax)
+            r = halfPi - r;
+        if (x < 0)
+            r = pi - r;
+        phaseP[i] = copysignf(r, y);
+    }
+}
+
+void vrect(const float* magP, const float* phaseP, float* realP, float* imagP, size_t framesToProcess)
+{
+    // The phase is reduced about the nearest multiple j of pi / 2, in three parts so that the reduction is exact
+    // for phases within +-8192, to r in [-pi / 4, pi / 4]. sin(r) and cos(r) are Cephes' polynomials, and are
+    // exchanged and negated according to the quadrant, j mod 4.
+    const float twoOverPi = 0.636619772f;
+    const float pi1 = 1.5703125f;
+    const float pi2 = 4.837512969970703125e-4f;
+    const float pi3 = 7.54978995489188216e-8f;
+    const float s1 = -1.6666654611e-1f;
+    const float s2 = 8.3321608736e-3f;
+    const float s3 = -1.9515295891e-4f;
+    const float c1 = 4.166664568298827e-2f;
+    const float c2 = -1.388731625493765e-3f;
+    const float c3 = 2.443315711809948e-5f;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        __m128 phase = _mm_loadu_ps(phaseP + i);
+        __m128i j = _mm_cvtps_epi32(_mm_mul_ps(phase, _mm_set1_ps(twoOverPi)));
+        __m128 q = _mm_cvtepi32_ps(j);
+        __m128 r = _mm_sub_ps(phase, _mm_mul_ps(q, _mm_set1_ps(pi1)));
+        r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(pi2)));
+        r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(pi3)));
+        __m128 z = _mm_mul_ps(r, r);
+        __m128 sine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s3), z), _mm_set1_ps(s2));
+        sine = _mm_add_ps(_mm_mul_ps(sine, z), _mm_set1_ps(s1));
+        sine = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sine, z), r), r);
+        __m128 cosine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c3), z), _mm_set1_ps(c2));
+        cosine = _mm_add_ps(_mm_mul_ps(cosine, z), _mm_set1_ps(c1));
+        cosine = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cosine, z), z), _mm_mul_ps(half, z)), _mm_set1_ps(1.0f));
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, one), one));
+        __m128 sinX = _mm_or_ps(_mm_and_ps(swap, cosine), _mm_andnot_ps(swap, sine));
+        __m128 cosX = _mm_or_ps(_mm_and_ps(swap, sine), _mm_andnot_ps(swap, cosine));
+        sinX = _mm_xor_ps(sinX, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, two), 30)));
+        cosX = _mm_xor_ps(cosX, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, one), two), 30)));
+        __m128 m = _mm_loadu_ps(magP + i);
+        _mm_storeu_ps(realP + i, _mm_mul_ps(m, cosX));
+        _mm_storeu_ps(imagP + i, _mm_mul_ps(m, sinX));
+    }
+#elif defined(ARM_NEON_INTRINSICS)
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t two = vdupq_n_u32(2);
+    const float32x4_t zero = vdupq_n_f32(0);
+    for (; i + 4 <= framesToProcess; i += 4) {
+        float32x4_t phase = vld1q_f32(phaseP + i);
+        float32x4_t t = vmulq_n_f32(phase, twoOverPi);
+        int32x4_t j = vcvtq_s32_f32(vaddq_f32(t, selectNEON(vcltq_f32(t, zero), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))));
+        float32x4_t q = vcvtq_f32_s32(j);
+        float32x4_t r = vsubq_f32(phase, vmulq_n_f32(q, pi1));
+        r = vsubq_f32(r, vmulq_n_f32(q, pi2));
+        r = vsubq_f32(r, vmulq_n_f32(q, pi3));
+        float32x4_t z = vmulq_f32(r, r);
+        float32x4_t sine = vaddq_f32(vmulq_n_f32(z, s3), vdupq_n_f32(s2));
+        sine = vaddq_f32(vmulq_f32(sine, z), vdupq_n_f32(s1));
+        sine = vaddq_f32(vmulq_f32(vmulq_f32(sine, z), r), r);
+        float32x4_t cosine = vaddq_f32(vmulq_n_f32(z, c3), vdupq_n_f32(c2));
+        cosine = vaddq_f32(vmulq_f32(cosine, z), vdupq_n_f32(c1));
+        cosine = vaddq_f32(vsubq_f32(vmulq_f32(vmulq_f32(cosine, z), z), vmulq_n_f32(z, 0.5f)), vdupq_n_f32(1.0f));
+        uint32x4_t quadrant = vreinterpretq_u32_s32(j);
+        uint32x4_t swap = vceqq_u32(vandq_u32(quadrant, one), one);
+        float32x4_t sinX = selectNEON(swap, cosine, sine);
+        float32x4_t cosX = selectNEON(swap, sine, cosine);
+        sinX = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(sinX), vshlq_n_u32(vandq_u32(quadrant, two), 30)));
+        cosX = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(cosX), vshlq_n_u32(vandq_u32(vaddq_u32(quadrant, one), two), 30)));
+        float32x4_t m = vld1q_f32(magP + i);
+        vst1q_f32(realP + i, vmulq_f32(m, cosX));
+        vst1q_f32(imagP + i, vmulq_f32(m, sinX));
+    }
+#endif
+    for (; i < framesToProcess; ++i) {
+        float phase = phaseP[i];
+        int j = static_cast<int>(nearbyintf(phase * twoOverPi));
+        float q = static_cast<float>(j);
+        float r = phase - q * pi1 - q * pi2 - q * pi3;
+        float z = r * r;
+        float sine = ((s3 * z + s2) * z + s1) * z * r + r;
+        float cosine = ((c3 * z + c2) * z + c1) * z * z - 0.5f * z + 1.0f;
+        if (j & 1)
+            std::swap(sine, cosine);
+        if (j & 2)
+            sine = -sine;
+        if ((j + 1) & 2)
+            cosine = -cosine;
+        realP[i] = magP[i] * cosine;
+        imagP[i] = magP[i] * sine;
+    }
+}
+
+// framesToProcess counts the floats of the interleaved buffer, which holds framesToProcess / 2 complex values.
+void vintlve(const float* realSrcP, const float* imagSrcP, float* destP, size_t framesToProcess) {
+    size_t length = framesToProcess / 2;
+    size_t i = 0;
+#if defined(ARM_NEON_INTRINSICS)
+    for (size_t endSize = length - length % 4; i < endSize; i += 4) {
+        float32x4x2_t complex;
+        complex.val[0] = vld1q_f32(realSrcP + i);
+        complex.val[1] = vld1q_f32(imagSrcP + i);
+        vst2q_f32(destP + 2 * i, complex);
+    }
+#endif
+    for (; i < length; ++i) {
+        destP[2 * i] = realSrcP[i];
+        destP[2 * i + 1] = imagSrcP[i];
+    }
+}
+
+void vdeintlve(const float* sourceP, float* realDestP, float* imagDestP, size_t framesToProcess) {
+    size_t length = framesToProcess / 2;
+    size_t i = 0;
+#if defined(ARM_NEON_INTRINSICS)
+    for (size_t endSize = length - length % 4; i < endSize; i += 4) {
+        float32x4x2_t complex = vld2q_f32(sourceP + 2 * i);
+        vst1q_f32(realDestP + i, complex.val[0]);
+        vst1q_f32(imagDestP + i, complex.val[1]);
     }
 #endif
-    int lenTail = framesToProcess / 2;
-    for (; i < lenTail; ++i) {
-        int baseIndex = 2 * i;
-        realDestP[i] = sourceP[baseIndex];
-        imagDestP[i] = sourceP[baseIndex + 1];
+    for (; i < length; ++i) {
+        realDestP[i] = sourceP[2 * i];
+        imagDestP[i] = sourceP[2 * i + 1];
     }
 }
 
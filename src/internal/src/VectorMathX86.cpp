@@ -0,0 +1,627 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/VectorMathX86.h"
+
+#if defined(LABSOUND_VECTORMATH_DISPATCH)
+
+#include <immintrin.h>
+
+#if defined(LABSOUND_COMPILER_VISUAL_STUDIO)
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Visual Studio compiles intrinsics for any instruction set without flags; GCC and Clang need to be told the
+// target of each function using them.
+#if defined(LABSOUND_COMPILER_VISUAL_STUDIO)
+#define LABSOUND_TARGET_AVX2
+#define LABSOUND_TARGET_AVX512
+#define LABSOUND_TARGET_F16C
+#else
+#define LABSOUND_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define LABSOUND_TARGET_AVX512 __attribute__((target("avx2,fma,avx512f")))
+#define LABSOUND_TARGET_F16C __attribute__((target("avx2,f16c")))
+#endif
+
+namespace lab {
+
+namespace VectorMath {
+
+namespace
+{
+    struct Features
+    {
+        bool avx2;   // with FMA
+        bool avx512; // the foundation instructions
+        bool f16c;   // with AVX2
+    };
+
+    Features detectFeatures()
+    {
+        Features features = { false, false, false };
+
+#if defined(LABSOUND_COMPILER_VISUAL_STUDIO)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool f16c = (info[2] & (1 << 29)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || maxLeaf < 7)
+            return features;
+
+        // The operating system has to preserve the wider registers across context switches.
+        unsigned long long xcr0 = _xgetbv(0);
+        bool ymmState = (xcr0 & 0x06) == 0x06;
+        bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        bool avx512f = (info[1] & (1 << 16)) != 0;
+
+        features.avx2 = ymmState && avx2 && fma;
+        features.avx512 = features.avx2 && zmmState && avx512f;
+        features.f16c = features.avx2 && f16c;
+#else
+        // These also check that the operating system has enabled the register state.
+        __builtin_cpu_init();
+        features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        features.avx512 = features.avx2 && __builtin_cpu_supports("avx512f");
+        features.f16c = features.avx2 && __builtin_cpu_supports("f16c");
+#endif
+        return features;
+    }
+
+    // AVX2 with FMA, eight frames at a time and a scalar tail.
+
+    LABSOUND_TARGET_AVX2 float horizontalSum(__m256 v)
+    {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+    }
+
+    LABSOUND_TARGET_AVX2 float horizontalMax(__m256 v)
+    {
+        __m128 max = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        max = _mm_max_ps(max, _mm_movehl_ps(max, max));
+        max = _mm_max_ss(max, _mm_shuffle_ps(max, max, 1));
+        return _mm_cvtss_f32(max);
+    }
+
+    LABSOUND_TARGET_AVX2 void vsmaAVX2(const float * source, float scale, float * dest, size_t n)
+    {
+        const __m256 k = _mm256_set1_ps(scale);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_fmadd_ps(_mm256_loadu_ps(source + i), k, _mm256_loadu_ps(dest + i)));
+        for (; i < n; ++i)
+            dest[i] += source[i] * scale;
+    }
+
+    LABSOUND_TARGET_AVX2 void vsmulAVX2(const float * source, float scale, float * dest, size_t n)
+    {
+        const __m256 k = _mm256_set1_ps(scale);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_loadu_ps(source + i), k));
+        for (; i < n; ++i)
+            dest[i] = source[i] * scale;
+    }
+
+    LABSOUND_TARGET_AVX2 void vaddAVX2(const float * source1, const float * source2, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(source1 + i), _mm256_loadu_ps(source2 + i)));
+        for (; i < n; ++i)
+            dest[i] = source1[i] + source2[i];
+    }
+
+    LABSOUND_TARGET_AVX2 void vmulAVX2(const float * source1, const float * source2, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_loadu_ps(source1 + i), _mm256_loadu_ps(source2 + i)));
+        for (; i < n; ++i)
+            dest[i] = source1[i] * source2[i];
+    }
+
+    // The destination may be one of the sources, so every frame is loaded before it is stored.
+    LABSOUND_TARGET_AVX2 void zvmulAVX2(const float * real1, const float * imag1, const float * real2, const float * imag2, float * realDest, float * imagDest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 r1 = _mm256_loadu_ps(real1 + i);
+            __m256 i1 = _mm256_loadu_ps(imag1 + i);
+            __m256 r2 = _mm256_loadu_ps(real2 + i);
+            __m256 i2 = _mm256_loadu_ps(imag2 + i);
+            _mm256_storeu_ps(realDest + i, _mm256_fmsub_ps(r1, r2, _mm256_mul_ps(i1, i2)));
+            _mm256_storeu_ps(imagDest + i, _mm256_fmadd_ps(r1, i2, _mm256_mul_ps(i1, r2)));
+        }
+        for (; i < n; ++i)
+        {
+            float realResult = real1[i] * real2[i] - imag1[i] * imag2[i];
+            float imagResult = real1[i] * imag2[i] + imag1[i] * real2[i];
+            realDest[i] = realResult;
+            imagDest[i] = imagResult;
+        }
+    }
+
+    LABSOUND_TARGET_AVX2 float vsvesqAVX2(const float * source, size_t n)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 s = _mm256_loadu_ps(source + i);
+            sum = _mm256_fmadd_ps(s, s, sum);
+        }
+        float total = horizontalSum(sum);
+        for (; i < n; ++i)
+            total += source[i] * source[i];
+        return total;
+    }
+
+    LABSOUND_TARGET_AVX2 float vmaxmgvAVX2(const float * source, size_t n)
+    {
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        __m256 max = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            max = _mm256_max_ps(max, _mm256_andnot_ps(signBit, _mm256_loadu_ps(source + i)));
+        float result = horizontalMax(max);
+        for (; i < n; ++i)
+            result = std::max(result, fabsf(source[i]));
+        return result;
+    }
+
+    LABSOUND_TARGET_AVX2 void vclipAVX2(const float * source, float low, float high, float * dest, size_t n)
+    {
+        const __m256 lowV = _mm256_set1_ps(low);
+        const __m256 highV = _mm256_set1_ps(high);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(source + i), highV), lowV));
+        for (; i < n; ++i)
+            dest[i] = std::max(std::min(source[i], high), low);
+    }
+
+    LABSOUND_TARGET_AVX2 void vfillAVX2(float value, float * dest, size_t n)
+    {
+        const __m256 v = _mm256_set1_ps(value);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, v);
+        for (; i < n; ++i)
+            dest[i] = value;
+    }
+
+    LABSOUND_TARGET_AVX2 void vsaddAVX2(const float * source, float addend, float * dest, size_t n)
+    {
+        const __m256 v = _mm256_set1_ps(addend);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(source + i), v));
+        for (; i < n; ++i)
+            dest[i] = source[i] + addend;
+    }
+
+    // Multiply and add are kept separate so the results match the scalar tail.
+    LABSOUND_TARGET_AVX2 void vrampAVX2(float start, float step, float * dest, size_t n)
+    {
+        const __m256 startV = _mm256_set1_ps(start);
+        const __m256 stepV = _mm256_set1_ps(step);
+        const __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 index = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+            _mm256_storeu_ps(dest + i, _mm256_add_ps(startV, _mm256_mul_ps(index, stepV)));
+        }
+        for (; i < n; ++i)
+            dest[i] = start + static_cast<float>(i) * step;
+    }
+
+    // The approximations of VectorMath.cpp's expSSE2 and logSSE2, eight frames wide and with fused multiply-adds.
+    LABSOUND_TARGET_AVX2 __m256 expAVX2(__m256 x)
+    {
+        __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(-87.0f), _CMP_LT_OQ);
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(88.0f));
+
+        __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+
+        __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+        y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+
+        __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(0x7f)), 23);
+        y = _mm256_mul_ps(y, _mm256_castsi256_ps(exponent));
+        return _mm256_andnot_ps(underflow, y);
+    }
+
+    LABSOUND_TARGET_AVX2 __m256 logAVX2(__m256 x)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 invalid = _mm256_cmp_ps(x, zero, _CMP_LT_OQ);
+        __m256 isZero = _mm256_cmp_ps(x, zero, _CMP_EQ_OQ);
+
+        x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000)));
+        __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(x), 23), _mm256_set1_epi32(0x7e)));
+        x = _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000))), _mm256_set1_ps(0.5f));
+        __m256 small = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+        e = _mm256_sub_ps(e, _mm256_and_ps(small, one));
+        x = _mm256_add_ps(_mm256_sub_ps(x, one), _mm256_and_ps(small, x));
+
+        __m256 z = _mm256_mul_ps(x, x);
+        __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.1514610310e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.1676998740e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.2420140846e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.4249322787e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.6668057665e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(2.0000714765e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-2.4999993993e-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(3.3333331174e-1f));
+        y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+        y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+        y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+        x = _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), _mm256_add_ps(x, y));
+
+        x = _mm256_or_ps(x, invalid);
+        return _mm256_blendv_ps(x, _mm256_set1_ps(-std::numeric_limits<float>::infinity()), isZero);
+    }
+
+    LABSOUND_TARGET_AVX2 void vexpAVX2(const float * source, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, expAVX2(_mm256_loadu_ps(source + i)));
+        for (; i < n; ++i)
+            dest[i] = expf(source[i]);
+    }
+
+    LABSOUND_TARGET_AVX2 void vlogAVX2(const float * source, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, logAVX2(_mm256_loadu_ps(source + i)));
+        for (; i < n; ++i)
+            dest[i] = logf(source[i]);
+    }
+
+    LABSOUND_TARGET_AVX2 void vtanhAVX2(const float * source, float * dest, size_t n)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i), _mm256_set1_ps(-9.0f)), _mm256_set1_ps(9.0f));
+            __m256 e = expAVX2(_mm256_add_ps(x, x));
+            _mm256_storeu_ps(dest + i, _mm256_div_ps(_mm256_sub_ps(e, one), _mm256_add_ps(e, one)));
+        }
+        for (; i < n; ++i)
+            dest[i] = tanhf(source[i]);
+    }
+
+    // Called with at least two table entries.
+    LABSOUND_TARGET_AVX2 void vlookupAVX2(const float * table, size_t tableSize, const float * index, float * dest, size_t n)
+    {
+        const float maxIndex = static_cast<float>(tableSize - 1);
+        const float maxLower = static_cast<float>(tableSize - 2);
+        const __m256 maxIndexV = _mm256_set1_ps(maxIndex);
+        const __m256 maxLowerV = _mm256_set1_ps(maxLower);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(index + i), _mm256_setzero_ps()), maxIndexV);
+            __m256 lower = _mm256_min_ps(_mm256_floor_ps(x), maxLowerV);
+            __m256i k = _mm256_cvttps_epi32(lower);
+            __m256 a = _mm256_i32gather_ps(table, k, 4);
+            __m256 b = _mm256_i32gather_ps(table + 1, k, 4);
+            _mm256_storeu_ps(dest + i, _mm256_fmadd_ps(_mm256_sub_ps(b, a), _mm256_sub_ps(x, lower), a));
+        }
+        for (; i < n; ++i)
+        {
+            float x = index[i];
+            x = x > 0 ? (x < maxIndex ? x : maxIndex) : 0;
+            float lower = std::min(static_cast<float>(static_cast<int>(x)), maxLower);
+            int k = static_cast<int>(lower);
+            dest[i] = table[k] + (table[k + 1] - table[k]) * (x - lower);
+        }
+    }
+
+    LABSOUND_TARGET_AVX2 void zvmaAVX2(const float * real1, const float * imag1, const float * real2, const float * imag2, float * realAcc, float * imagAcc, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 r1 = _mm256_loadu_ps(real1 + i);
+            __m256 i1 = _mm256_loadu_ps(imag1 + i);
+            __m256 r2 = _mm256_loadu_ps(real2 + i);
+            __m256 i2 = _mm256_loadu_ps(imag2 + i);
+            _mm256_storeu_ps(realAcc + i, _mm256_fnmadd_ps(i1, i2, _mm256_fmadd_ps(r1, r2, _mm256_loadu_ps(realAcc + i))));
+            _mm256_storeu_ps(imagAcc + i, _mm256_fmadd_ps(i1, r2, _mm256_fmadd_ps(r1, i2, _mm256_loadu_ps(imagAcc + i))));
+        }
+        for (; i < n; ++i)
+        {
+            realAcc[i] += real1[i] * real2[i] - imag1[i] * imag2[i];
+            imagAcc[i] += real1[i] * imag2[i] + imag1[i] * real2[i];
+        }
+    }
+
+    // Reads the kernelSize - 1 frames before the source; four independent sums of eight outputs share each tap.
+    LABSOUND_TARGET_AVX2 void vconvAVX2(const float * source, const float * kernel, size_t kernelSize, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            __m256 sum2 = _mm256_setzero_ps();
+            __m256 sum3 = _mm256_setzero_ps();
+            const float * input = source + i;
+            for (size_t j = 0; j < kernelSize; ++j, --input)
+            {
+                __m256 tap = _mm256_set1_ps(kernel[j]);
+                sum0 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(input), sum0);
+                sum1 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(input + 8), sum1);
+                sum2 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(input + 16), sum2);
+                sum3 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(input + 24), sum3);
+            }
+            _mm256_storeu_ps(dest + i, sum0);
+            _mm256_storeu_ps(dest + i + 8, sum1);
+            _mm256_storeu_ps(dest + i + 16, sum2);
+            _mm256_storeu_ps(dest + i + 24, sum3);
+        }
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            const float * input = source + i;
+            for (size_t j = 0; j < kernelSize; ++j, --input)
+                sum = _mm256_fmadd_ps(_mm256_set1_ps(kernel[j]), _mm256_loadu_ps(input), sum);
+            _mm256_storeu_ps(dest + i, sum);
+        }
+        for (; i < n; ++i)
+        {
+            float sum = 0;
+            for (size_t j = 0; j < kernelSize; ++j)
+                sum += source[i - j] * kernel[j];
+            dest[i] = sum;
+        }
+    }
+
+    // Two sums of eight per kernel, so that the fused multiply-adds don't wait on each other.
+    LABSOUND_TARGET_AVX2 void vdotpr2AVX2(const float * source, const float * kernel1, const float * kernel2, float * dot1, float * dot2, size_t n)
+    {
+        __m256 sum1a = _mm256_setzero_ps();
+        __m256 sum1b = _mm256_setzero_ps();
+        __m256 sum2a = _mm256_setzero_ps();
+        __m256 sum2b = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256 sourceA = _mm256_loadu_ps(source + i);
+            __m256 sourceB = _mm256_loadu_ps(source + i + 8);
+            sum1a = _mm256_fmadd_ps(sourceA, _mm256_loadu_ps(kernel1 + i), sum1a);
+            sum1b = _mm256_fmadd_ps(sourceB, _mm256_loadu_ps(kernel1 + i + 8), sum1b);
+            sum2a = _mm256_fmadd_ps(sourceA, _mm256_loadu_ps(kernel2 + i), sum2a);
+            sum2b = _mm256_fmadd_ps(sourceB, _mm256_loadu_ps(kernel2 + i + 8), sum2b);
+        }
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 s = _mm256_loadu_ps(source + i);
+            sum1a = _mm256_fmadd_ps(s, _mm256_loadu_ps(kernel1 + i), sum1a);
+            sum2a = _mm256_fmadd_ps(s, _mm256_loadu_ps(kernel2 + i), sum2a);
+        }
+        float total1 = horizontalSum(_mm256_add_ps(sum1a, sum1b));
+        float total2 = horizontalSum(_mm256_add_ps(sum2a, sum2b));
+        for (; i < n; ++i)
+        {
+            total1 += source[i] * kernel1[i];
+            total2 += source[i] * kernel2[i];
+        }
+        *dot1 = total1;
+        *dot2 = total2;
+    }
+
+    // AVX-512, sixteen frames at a time; the tail is handled with a mask rather than a scalar loop.
+
+    LABSOUND_TARGET_AVX512 __mmask16 tailMask(size_t remaining)
+    {
+        return static_cast<__mmask16>((1u << remaining) - 1);
+    }
+
+    LABSOUND_TARGET_AVX512 void vsmaAVX512(const float * source, float scale, float * dest, size_t n)
+    {
+        const __m512 k = _mm512_set1_ps(scale);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(dest + i, _mm512_fmadd_ps(_mm512_loadu_ps(source + i), k, _mm512_loadu_ps(dest + i)));
+        if (i < n)
+        {
+            __mmask16 m = tailMask(n - i);
+            _mm512_mask_storeu_ps(dest + i, m, _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, source + i), k, _mm512_maskz_loadu_ps(m, dest + i)));
+        }
+    }
+
+    LABSOUND_TARGET_AVX512 void vsmulAVX512(const float * source, float scale, float * dest, size_t n)
+    {
+        const __m512 k = _mm512_set1_ps(scale);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(dest + i, _mm512_mul_ps(_mm512_loadu_ps(source + i), k));
+        if (i < n)
+        {
+            __mmask16 m = tailMask(n - i);
+            _mm512_mask_storeu_ps(dest + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, source + i), k));
+        }
+    }
+
+    LABSOUND_TARGET_AVX512 void vaddAVX512(const float * source1, const float * source2, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(dest + i, _mm512_add_ps(_mm512_loadu_ps(source1 + i), _mm512_loadu_ps(source2 + i)));
+        if (i < n)
+        {
+            __mmask16 m = tailMask(n - i);
+            _mm512_mask_storeu_ps(dest + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, source1 + i), _mm512_maskz_loadu_ps(m, source2 + i)));
+        }
+    }
+
+    LABSOUND_TARGET_AVX512 void vmulAVX512(const float * source1, const float * source2, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(dest + i, _mm512_mul_ps(_mm512_loadu_ps(source1 + i), _mm512_loadu_ps(source2 + i)));
+        if (i < n)
+        {
+            __mmask16 m = tailMask(n - i);
+            _mm512_mask_storeu_ps(dest + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, source1 + i), _mm512_maskz_loadu_ps(m, source2 + i)));
+        }
+    }
+
+    LABSOUND_TARGET_AVX512 void zvmulAVX512(const float * real1, const float * imag1, const float * real2, const float * imag2, float * realDest, float * imagDest, size_t n)
+    {
+        for (size_t i = 0; i < n; i += 16)
+        {
+            __mmask16 m = n - i >= 16 ? static_cast<__mmask16>(0xffff) : tailMask(n - i);
+            __m512 r1 = _mm512_maskz_loadu_ps(m, real1 + i);
+            __m512 i1 = _mm512_maskz_loadu_ps(m, imag1 + i);
+            __m512 r2 = _mm512_maskz_loadu_ps(m, real2 + i);
+            __m512 i2 = _mm512_maskz_loadu_ps(m, imag2 + i);
+            _mm512_mask_storeu_ps(realDest + i, m, _mm512_fmsub_ps(r1, r2, _mm512_mul_ps(i1, i2)));
+            _mm512_mask_storeu_ps(imagDest + i, m, _mm512_fmadd_ps(r1, i2, _mm512_mul_ps(i1, r2)));
+        }
+    }
+
+    LABSOUND_TARGET_AVX512 float vsvesqAVX512(const float * source, size_t n)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m512 s = _mm512_loadu_ps(source + i);
+            sum = _mm512_fmadd_ps(s, s, sum);
+        }
+        if (i < n)
+        {
+            __m512 s = _mm512_maskz_loadu_ps(tailMask(n - i), source + i);
+            sum = _mm512_fmadd_ps(s, s, sum);
+        }
+        return _mm512_reduce_add_ps(sum);
+    }
+
+    LABSOUND_TARGET_AVX512 float vmaxmgvAVX512(const float * source, size_t n)
+    {
+        __m512 max = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            max = _mm512_max_ps(max, _mm512_abs_ps(_mm512_loadu_ps(source + i)));
+        if (i < n)
+            max = _mm512_max_ps(max, _mm512_abs_ps(_mm512_maskz_loadu_ps(tailMask(n - i), source + i)));
+        return _mm512_reduce_max_ps(max);
+    }
+
+    LABSOUND_TARGET_AVX512 void vclipAVX512(const float * source, float low, float high, float * dest, size_t n)
+    {
+        const __m512 lowV = _mm512_set1_ps(low);
+        const __m512 highV = _mm512_set1_ps(high);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(dest + i, _mm512_max_ps(_mm512_min_ps(_mm512_loadu_ps(source + i), highV), lowV));
+        if (i < n)
+        {
+            __mmask16 m = tailMask(n - i);
+            _mm512_mask_storeu_ps(dest + i, m, _mm512_max_ps(_mm512_min_ps(_mm512_maskz_loadu_ps(m, source + i), highV), lowV));
+        }
+    }
+
+    // F16C, eight frames at a time, and the tail through a vector's worth on the stack.
+
+    LABSOUND_TARGET_F16C void vhalfToFloatF16C(const uint16_t * source, float * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i))));
+        if (i < n)
+        {
+            alignas(16) uint16_t halves[8] = {};
+            alignas(32) float floats[8];
+            std::copy(source + i, source + n, halves);
+            _mm256_store_ps(floats, _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i *>(halves))));
+            std::copy(floats, floats + (n - i), dest + i);
+        }
+    }
+
+    LABSOUND_TARGET_F16C void vfloatToHalfF16C(const float * source, uint16_t * dest, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+        if (i < n)
+        {
+            alignas(32) float floats[8] = {};
+            alignas(16) uint16_t halves[8];
+            std::copy(source + i, source + n, floats);
+            _mm_store_si128(reinterpret_cast<__m128i *>(halves), _mm256_cvtps_ph(_mm256_load_ps(floats), _MM_FROUND_TO_NEAREST_INT));
+            std::copy(halves, halves + (n - i), dest + i);
+        }
+    }
+
+    Kernels selectKernels()
+    {
+        Kernels kernels = {};
+        Features features = detectFeatures();
+
+        if (features.avx512)
+        {
+            // The generators, transcendentals, convolution and dot product kernels use the AVX2 kernels.
+            kernels = { vsmaAVX512, vsmulAVX512, vaddAVX512, vmulAVX512, zvmulAVX512, zvmaAVX2, vsvesqAVX512, vmaxmgvAVX512, vclipAVX512,
+                        vfillAVX2, vsaddAVX2, vrampAVX2, vexpAVX2, vlogAVX2, vtanhAVX2, vlookupAVX2, vconvAVX2, vdotpr2AVX2 };
+        }
+        else if (features.avx2)
+        {
+            kernels = { vsmaAVX2, vsmulAVX2, vaddAVX2, vmulAVX2, zvmulAVX2, zvmaAVX2, vsvesqAVX2, vmaxmgvAVX2, vclipAVX2,
+                        vfillAVX2, vsaddAVX2, vrampAVX2, vexpAVX2, vlogAVX2, vtanhAVX2, vlookupAVX2, vconvAVX2, vdotpr2AVX2 };
+        }
+        if (features.f16c)
+        {
+            kernels.vhalfToFloat = vhalfToFloatF16C;
+            kernels.vfloatToHalf = vfloatToHalfF16C;
+        }
+        return kernels;
+    }
+
+    // Zero initialized, so that calls made during static initialization use the baseline.
+    const Kernels s_kernels = selectKernels();
+}
+
+const Kernels & kernels()
+{
+    return s_kernels;
+}
+
+} // namespace VectorMath
+
+} // namespace lab
+
+#endif // LABSOUND_VECTORMATH_DISPATCH
@@ -0,0 +1,293 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/Assertions.h"
+#include "internal/WaveFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
+namespace lab {
+
+namespace
+{
+    const uint16_t WaveFormatPCM = 1;
+    const uint16_t WaveFormatIEEEFloat = 3;
+    const uint16_t WaveFormatExtensible = 0xFFFE;
+
+    // RIFF is little endian whatever the platform.
+    uint16_t readUint16(const uint8_t * p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    uint32_t readUint32(const uint8_t * p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+    float convertFloat(const uint8_t * p)
+    {
+        float value;
+        uint32_t bits = readUint32(p);
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    float convertInt8(const uint8_t * p) { return (static_cast<int>(p[0]) - 128) * (1.f / 128); }
+    float convertInt16(const uint8_t * p) { return static_cast<int16_t>(readUint16(p)) * (1.f / 32768); }
+    float convertInt32(const uint8_t * p) { return static_cast<int32_t>(readUint32(p)) * (1.f / 2147483648.f); }
+
+    float convertInt24(const uint8_t * p)
+    {
+        // The sample is moved to the top of 32 bits, so that its sign is.
+        int32_t value = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24));
+        return value * (1.f / 2147483648.f);
+    }
+
+    // Converts the frames from firstFrame on.
+    template <typename Convert>
+    void deinterleave(const uint8_t * frames, size_t firstFrame, size_t frameCount, size_t bytesPerFrame, size_t bytesPerSample,
+                      float * const * channels, unsigned numberOfChannels, Convert convert)
+    {
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+        {
+            const uint8_t * sample = frames + firstFrame * bytesPerFrame + c * bytesPerSample;
+            float * destination = channels[c];
+            for (size_t i = firstFrame; i < frameCount; ++i, sample += bytesPerFrame)
+                destination[i] = convert(sample);
+        }
+    }
+
+#if (defined(__SSE2__) || defined(ARM_NEON_INTRINSICS)) && !defined(__ARM_BIG_ENDIAN)
+
+    // Vector loads read the samples as they are in memory, so are only used on little endian platforms.
+#define WAVE_FILE_VECTOR_CONVERSION
+
+    int32_t load32(const uint8_t * p)
+    {
+        int32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    // Converts 16 bit mono or stereo frames, which are dense enough to be loaded a vector at a time, and returns how
+    // many were converted, leaving the rest to the scalar loop.
+    size_t convertInt16Frames(const uint8_t * frames, size_t frameCount, unsigned fileChannels, float * const * channels, unsigned numberOfChannels)
+    {
+        const size_t vectorFrames = frameCount & ~size_t(7);
+        float * left = channels[0];
+        float * right = numberOfChannels > 1 ? channels[1] : nullptr;
+
+#if defined(__SSE2__)
+        const __m128 scale = _mm_set1_ps(1.f / 32768);
+        if (fileChannels == 1)
+        {
+            for (size_t i = 0; i < vectorFrames; i += 8)
+            {
+                // Each sample is unpacked into both halves of 32 bits, and shifted back down with its sign.
+                __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames + 2 * i));
+                __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+                __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+                _mm_storeu_ps(left + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+                _mm_storeu_ps(left + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < vectorFrames; i += 4)
+            {
+                // A frame is 32 bits, the left sample in the low half, and the right in the high.
+                __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames + 4 * i));
+                _mm_storeu_ps(left + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(samples, 16), 16)), scale));
+                if (right)
+                    _mm_storeu_ps(right + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(samples, 16)), scale));
+            }
+        }
+#else
+        const float32x4_t scale = vdupq_n_f32(1.f / 32768);
+        if (fileChannels == 1)
+        {
+            for (size_t i = 0; i < vectorFrames; i += 8)
+            {
+                int16x8_t samples = vld1q_s16(reinterpret_cast<const int16_t *>(frames + 2 * i));
+                vst1q_f32(left + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), scale));
+                vst1q_f32(left + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), scale));
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < vectorFrames; i += 8)
+            {
+                int16x8x2_t samples = vld2q_s16(reinterpret_cast<const int16_t *>(frames + 4 * i));
+                vst1q_f32(left + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples.val[0]))), scale));
+                vst1q_f32(left + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples.val[0]))), scale));
+                if (right)
+                {
+                    vst1q_f32(right + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples.val[1]))), scale));
+                    vst1q_f32(right + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples.val[1]))), scale));
+                }
+            }
+        }
+#endif
+        return vectorFrames;
+    }
+
+    // Converts 16, 24 or 32 bit frames of any number of channels, four samples of a channel at a time. Each sample is
+    // loaded as the 32 bits starting at it, and shifted up so that its top bit is theirs. Those bits run past the last
+    // sample of the last frame, so it is left to the scalar loop, with whatever else doesn't fill a vector.
+    size_t convertIntegerFrames(const uint8_t * frames, size_t frameCount, size_t bytesPerFrame, size_t bytesPerSample,
+                                float * const * channels, unsigned numberOfChannels)
+    {
+        const size_t vectorFrames = frameCount ? (frameCount - 1) & ~size_t(3) : 0;
+        const int shift = static_cast<int>(32 - 8 * bytesPerSample);
+
+#if defined(__SSE2__)
+        const __m128 scale = _mm_set1_ps(1.f / 2147483648.f);
+        const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+#else
+        const float32x4_t scale = vdupq_n_f32(1.f / 2147483648.f);
+        const int32x4_t shiftCount = vdupq_n_s32(shift);
+#endif
+
+        for (unsigned c = 0; c < numberOfChannels; ++c)
+        {
+            const uint8_t * sample = frames + c * bytesPerSample;
+            float * destination = channels[c];
+            for (size_t i = 0; i < vectorFrames; i += 4, sample += 4 * bytesPerFrame)
+            {
+#if defined(__SSE2__)
+                __m128i samples = _mm_set_epi32(load32(sample + 3 * bytesPerFrame), load32(sample + 2 * bytesPerFrame),
+                                                load32(sample + bytesPerFrame), load32(sample));
+                _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_sll_epi32(samples, shiftCount)), scale));
+#else
+                const int32_t lanes[4] = { load32(sample), load32(sample + bytesPerFrame),
+                                           load32(sample + 2 * bytesPerFrame), load32(sample + 3 * bytesPerFrame) };
+                int32x4_t samples = vshlq_s32(vld1q_s32(lanes), shiftCount);
+                vst1q_f32(destination + i, vmulq_f32(vcvtq_f32_s32(samples), scale));
+#endif
+            }
+        }
+        return vectorFrames;
+    }
+
+#endif
+}
+
+bool readWaveFormat(const WaveFileReader & read, uint64_t fileSize, WaveFormat & format)
+{
+    uint8_t riff[12];
+    if (fileSize < sizeof(riff) || !read(0, riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+        return false;
+
+    bool hasFormat = false;
+    uint16_t formatTag = 0;
+    uint16_t blockAlign = 0;
+
+    // Chunks are word aligned, and may come in any order; the samples are in the data chunk after the fmt one.
+    uint64_t offset = sizeof(riff);
+    uint8_t header[8];
+    while (offset + sizeof(header) <= fileSize && read(offset, header, sizeof(header)))
+    {
+        const uint64_t chunkSize = readUint32(header + 4);
+        const uint64_t chunkData = offset + sizeof(header);
+
+        if (!memcmp(header, "fmt ", 4))
+        {
+            uint8_t fmt[40] = {};
+            const size_t fmtSize = static_cast<size_t>(std::min<uint64_t>(chunkSize, sizeof(fmt)));
+            if (fmtSize < 16 || !read(chunkData, fmt, fmtSize))
+                return false;
+
+            formatTag = readUint16(fmt);
+            format.numberOfChannels = readUint16(fmt + 2);
+            format.sampleRate = static_cast<float>(readUint32(fmt + 4));
+            blockAlign = readUint16(fmt + 12);
+
+            // An extensible format's actual one is the first two bytes of its sub format's GUID.
+            if (formatTag == WaveFormatExtensible)
+            {
+                if (fmtSize < 26)
+                    return false;
+                formatTag = readUint16(fmt + 24);
+            }
+            hasFormat = true;
+        }
+        else if (!memcmp(header, "data", 4))
+        {
+            if (!hasFormat || !format.numberOfChannels || blockAlign % format.numberOfChannels)
+                return false;
+
+            // The samples' containers, rather than the bits of them which are valid.
+            format.bitsPerSample = 8 * (blockAlign / format.numberOfChannels);
+            format.isFloat = formatTag == WaveFormatIEEEFloat;
+
+            const bool isSupported = (formatTag == WaveFormatPCM && format.bitsPerSample >= 8 && format.bitsPerSample <= 32)
+                || (format.isFloat && format.bitsPerSample == 32);
+            if (!isSupported || format.sampleRate <= 0)
+                return false;
+
+            // A file that was truncated, or written without its sizes being filled in, plays what it has.
+            format.dataOffset = chunkData;
+            format.frameCount = std::min(chunkSize, fileSize - chunkData) / blockAlign;
+            return true;
+        }
+
+        offset = chunkData + chunkSize + (chunkSize & 1);
+    }
+
+    return false;
+}
+
+float convertWaveSample(const WaveFormat & format, const uint8_t * sample)
+{
+    if (format.isFloat)
+        return convertFloat(sample);
+
+    switch (format.bitsPerSample)
+    {
+        case 8: return convertInt8(sample);
+        case 16: return convertInt16(sample);
+        case 24: return convertInt24(sample);
+        case 32: return convertInt32(sample);
+        default:
+            ASSERT(!"unsupported sample size");
+            return 0;
+    }
+}
+
+void convertWaveFrames(const WaveFormat & format, const uint8_t * frames, size_t frameCount, float * const * channels, unsigned numberOfChannels)
+{
+    ASSERT(numberOfChannels <= format.numberOfChannels);
+    const size_t bytesPerFrame = format.bytesPerFrame();
+    const size_t bytesPerSample = format.bitsPerSample / 8;
+
+    if (format.isFloat)
+    {
+        deinterleave(frames, 0, frameCount, bytesPerFrame, 4, channels, numberOfChannels, convertFloat);
+        return;
+    }
+
+    // The frames the vector loops convert; the scalar ones finish off.
+    size_t firstFrame = 0;
+#if defined(WAVE_FILE_VECTOR_CONVERSION)
+    if (numberOfChannels && bytesPerSample == 2 && format.numberOfChannels <= 2)
+        firstFrame = convertInt16Frames(frames, frameCount, format.numberOfChannels, channels, numberOfChannels);
+    else if (bytesPerSample >= 2)
+        firstFrame = convertIntegerFrames(frames, frameCount, bytesPerFrame, bytesPerSample, channels, numberOfChannels);
+#endif
+
+    switch (bytesPerSample)
+    {
+        case 1: deinterleave(frames, firstFrame, frameCount, bytesPerFrame, 1, channels, numberOfChannels, convertInt8); break;
+        case 2: deinterleave(frames, firstFrame, frameCount, bytesPerFrame, 2, channels, numberOfChannels, convertInt16); break;
+        case 3: deinterleave(frames, firstFrame, frameCount, bytesPerFrame, 3, channels, numberOfChannels, convertInt24); break;
+        case 4: deinterleave(frames, firstFrame, frameCount, bytesPerFrame, 4, channels, numberOfChannels, convertInt32); break;
+        default:
+            ASSERT(!"unsupported sample size");
+            break;
+    }
+}
+
+} // namespace lab
@@ -3,9 +3,12 @@
 // Copyright (C) 2015+, The LabSound Authors. All rights reserved.
 
 #include "LabSound/core/Macros.h"
+#include "LabSound/core/AudioContext.h"
 #include "internal/WaveShaperDSPKernel.h"
 #include "internal/WaveShaperProcessor.h"
+#include "internal/HalfBandResampler.h"
 #include "internal/Assertions.h"
+#include "internal/VectorMath.h"
 
 #include <algorithm>
 
@@ -13,22 +16,44 @@ using namespace std;
 
 namespace lab {
 
+namespace
+{
+    // Passes to 0.4 of the sample rate, rejecting what the curve adds from 0.6 of it by 80dB.
+    const size_t FirstStageSideTaps = 12;
+
+    // Only has to pass up to a quarter of its input rate, and reject from three quarters of it.
+    const size_t SecondStageSideTaps = 5;
+}
+
+WaveShaperDSPKernel::WaveShaperDSPKernel(WaveShaperProcessor * processor)
+    : AudioDSPKernel(processor)
+    , m_upSampler(new HalfBandUpSampler(FirstStageSideTaps))
+    , m_downSampler(new HalfBandDownSampler(FirstStageSideTaps))
+    , m_upSampler2x(new HalfBandUpSampler(SecondStageSideTaps, AudioNode::ProcessingSizeInFrames * 2))
+    , m_downSampler2x(new HalfBandDownSampler(SecondStageSideTaps, AudioNode::ProcessingSizeInFrames * 2))
+    , m_tempBuffer(AudioNode::ProcessingSizeInFrames * 2)
+    , m_tempBuffer2x(AudioNode::ProcessingSizeInFrames * 4)
+{
+}
+
+WaveShaperDSPKernel::~WaveShaperDSPKernel() = default;
+
 void WaveShaperDSPKernel::process(ContextRenderLock &, const float* source, float* destination, size_t framesToProcess)
 {
     ASSERT(source && destination && waveShaperProcessor());
 
-    // Curve object locks the curve during processing
-    std::unique_ptr<WaveShaperProcessor::Curve> c = waveShaperProcessor()->curve();
+    // The processor holds the curve while its kernels run.
+    const std::vector<float> & curve = waveShaperProcessor()->renderingCurve();
 
-    if (c->curve.size() == 0) 
+    if (curve.size() == 0) 
     {
         // Act as "straight wire" pass-through if no curve is set.
         memcpy(destination, source, sizeof(float) * framesToProcess);
         return;
     }
 
-    float const * curveData = c->curve.data();
-    size_t curveLength = c->curve.size();
+    float const * curveData = curve.data();
+    size_t curveLength = curve.size();
 
     ASSERT(curveData);
 
@@ -38,20 +63,72 @@ void WaveShaperDSPKernel::process(ContextRenderLock &, const float* source, floa
         return;
     }
 
-    // Apply waveshaping curve.
-    for (unsigned i = 0; i < framesToProcess; ++i) 
+    const OverSampleType oversample = waveShaperProcessor()->oversample();
+    if (oversample != m_lastOversample)
+    {
+        // History left from another rate would be heard as a click.
+        reset();
+        m_lastOversample = oversample;
+    }
+
+    if (oversample == OverSampleType::OVERSAMPLE_NONE)
+    {
+        processCurve(curveData, curveLength, source, destination, framesToProcess);
+        return;
+    }
+
+    if (m_tempBuffer.size() < framesToProcess * 2)
     {
-        const float input = source[i];
+        m_tempBuffer.allocate(framesToProcess * 2);
+        m_tempBuffer2x.allocate(framesToProcess * 4);
+    }
 
-        // Calculate an index based on input -1 -> +1 with 0 being at the center of the curve data.
-        size_t index = static_cast<size_t>((curveLength * (input + 1)) / 2);
+    float * tempP = m_tempBuffer.data();
+    m_upSampler->process(source, tempP, framesToProcess);
 
-        // Clip index to the input range of the curve.
-        // This takes care of input outside of nominal range -1 -> +1
-        index = max(index, size_t(0));
-        index = min(index, curveLength - 1);
-        destination[i] = curveData[index];
+    if (oversample == OverSampleType::OVERSAMPLE_2X)
+        processCurve(curveData, curveLength, tempP, tempP, framesToProcess * 2);
+    else
+    {
+        float * tempP2x = m_tempBuffer2x.data();
+        m_upSampler2x->process(tempP, tempP2x, framesToProcess * 2);
+        processCurve(curveData, curveLength, tempP2x, tempP2x, framesToProcess * 4);
+        m_downSampler2x->process(tempP2x, tempP, framesToProcess * 2);
     }
+
+    m_downSampler->process(tempP, destination, framesToProcess);
+}
+
+void WaveShaperDSPKernel::processCurve(const float* curveData, size_t curveLength, const float* source, float* destination, size_t framesToProcess)
+{
+    // Apply waveshaping curve. Inputs -1 -> +1 map onto the curve's indices 0 -> curveLength - 1 with 0 at the
+    // center, and are interpolated linearly between curve points. Inputs outside of the nominal range take the
+    // end values of the curve.
+    const float halfRange = 0.5f * static_cast<float>(curveLength - 1);
+    VectorMath::vsmul(source, 1, &halfRange, destination, 1, framesToProcess);
+    VectorMath::vsadd(destination, &halfRange, destination, framesToProcess);
+    VectorMath::vlookup(curveData, curveLength, destination, destination, framesToProcess);
+}
+
+void WaveShaperDSPKernel::reset()
+{
+    m_upSampler->reset();
+    m_downSampler->reset();
+    m_upSampler2x->reset();
+    m_downSampler2x->reset();
+}
+
+double WaveShaperDSPKernel::latencyTime(ContextRenderLock & r) const
+{
+    const OverSampleType oversample = waveShaperProcessor()->oversample();
+    if (oversample == OverSampleType::OVERSAMPLE_NONE || !r.context())
+        return 0;
+
+    // The second stage's latency is in frames at twice the rate.
+    double latencyFrames = static_cast<double>(m_upSampler->latencyFrames() + m_downSampler->latencyFrames());
+    if (oversample == OverSampleType::OVERSAMPLE_4X)
+        latencyFrames += 0.5 * static_cast<double>(m_upSampler2x->latencyFrames() + m_downSampler2x->latencyFrames());
+    return latencyFrames / static_cast<double>(r.context()->sampleRate());
 }
 
 } // namespace lab
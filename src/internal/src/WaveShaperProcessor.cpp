@@ -39,24 +39,22 @@ void WaveShaperProcessor::process(ContextRenderLock& r, const AudioBus* source,
         return;
     }
 
-    /// @todo - make this lock free. Setting a curve might cause an audio glitch.
+    // The curve is held for the quantum, so that the kernels, which may run on several threads, share it
+    // without locking it each. Setting a curve might cause an audio glitch.
+    std::lock_guard<std::mutex> lock(m_curveWrite);
     if (m_newCurve.size())
     {
-        std::lock_guard<std::mutex> lock(m_curveWrite);
         std::swap(m_curve, m_newCurve);
         m_newCurve.clear();
     }
-    
+
     const bool channelCountMatches = source->numberOfChannels() == destination->numberOfChannels() && source->numberOfChannels() == m_kernels.size();
     
     if (!channelCountMatches)
         return;
 
     // For each channel of our input, process using the corresponding WaveShaperDSPKernel into the output channel.
-    for (unsigned i = 0; i < m_kernels.size(); ++i)
-    {
-        m_kernels[i]->process(r, source->channel(i)->data(), destination->channel(i)->mutableData(), framesToProcess);
-    }
+    processKernels(r, source, destination, framesToProcess);
 }
 
 std::unique_ptr<WaveShaperProcessor::Curve> WaveShaperProcessor::curve() 
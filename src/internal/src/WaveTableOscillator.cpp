@@ -0,0 +1,160 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+#include "internal/WaveTableOscillator.h"
+
+#include <cmath>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#endif
+
+namespace lab {
+
+namespace
+{
+    inline double wrapPhase(double phase, double tableSize)
+    {
+        // Increments up to the Nyquist frequency are under half the table, so one subtraction usually does.
+        if (phase >= tableSize)
+        {
+            phase -= tableSize;
+            if (phase >= tableSize)
+                phase -= std::floor(phase / tableSize) * tableSize;
+        }
+        else if (phase < 0)
+            phase -= std::floor(phase / tableSize) * tableSize;
+        return phase;
+    }
+
+    // Four frames at a time, gathering each from the tables, and the remainder one by one.
+    template <bool Accumulate>
+    void render(const float * lower, const float * higher, float tableFactor, unsigned tableSize,
+                const float * readIndices, float amplitude, float * destination, size_t framesToProcess)
+    {
+        const unsigned mask = tableSize - 1;
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128i indexMask = _mm_set1_epi32(static_cast<int>(mask));
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128 mTableFactor = _mm_set1_ps(tableFactor);
+        const __m128 mAmplitude = _mm_set1_ps(amplitude);
+        alignas(16) int32_t index1[4];
+        alignas(16) int32_t index2[4];
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            __m128 readIndex = _mm_loadu_ps(readIndices + i);
+            __m128i whole = _mm_cvttps_epi32(readIndex);
+            __m128 fraction = _mm_sub_ps(readIndex, _mm_cvtepi32_ps(whole));
+            _mm_store_si128(reinterpret_cast<__m128i *>(index1), _mm_and_si128(whole, indexMask));
+            _mm_store_si128(reinterpret_cast<__m128i *>(index2), _mm_and_si128(_mm_add_epi32(whole, one), indexMask));
+
+            __m128 lower1 = _mm_setr_ps(lower[index1[0]], lower[index1[1]], lower[index1[2]], lower[index1[3]]);
+            __m128 lower2 = _mm_setr_ps(lower[index2[0]], lower[index2[1]], lower[index2[2]], lower[index2[3]]);
+            __m128 higher1 = _mm_setr_ps(higher[index1[0]], higher[index1[1]], higher[index1[2]], higher[index1[3]]);
+            __m128 higher2 = _mm_setr_ps(higher[index2[0]], higher[index2[1]], higher[index2[2]], higher[index2[3]]);
+
+            __m128 sampleLower = _mm_add_ps(lower1, _mm_mul_ps(fraction, _mm_sub_ps(lower2, lower1)));
+            __m128 sampleHigher = _mm_add_ps(higher1, _mm_mul_ps(fraction, _mm_sub_ps(higher2, higher1)));
+            __m128 sample = _mm_add_ps(sampleHigher, _mm_mul_ps(mTableFactor, _mm_sub_ps(sampleLower, sampleHigher)));
+            if (Accumulate)
+                _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(mAmplitude, sample)));
+            else
+                _mm_storeu_ps(destination + i, sample);
+        }
+#elif defined(ARM_NEON_INTRINSICS)
+        const uint32x4_t indexMask = vdupq_n_u32(mask);
+        const uint32x4_t one = vdupq_n_u32(1);
+        uint32_t index1[4];
+        uint32_t index2[4];
+        float gathered[4][4];
+        for (; i + 4 <= framesToProcess; i += 4)
+        {
+            float32x4_t readIndex = vld1q_f32(readIndices + i);
+            uint32x4_t whole = vcvtq_u32_f32(readIndex);
+            float32x4_t fraction = vsubq_f32(readIndex, vcvtq_f32_u32(whole));
+            vst1q_u32(index1, vandq_u32(whole, indexMask));
+            vst1q_u32(index2, vandq_u32(vaddq_u32(whole, one), indexMask));
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                gathered[0][lane] = lower[index1[lane]];
+                gathered[1][lane] = lower[index2[lane]];
+                gathered[2][lane] = higher[index1[lane]];
+                gathered[3][lane] = higher[index2[lane]];
+            }
+            float32x4_t lower1 = vld1q_f32(gathered[0]);
+            float32x4_t higher1 = vld1q_f32(gathered[2]);
+
+            float32x4_t sampleLower = vmlaq_f32(lower1, fraction, vsubq_f32(vld1q_f32(gathered[1]), lower1));
+            float32x4_t sampleHigher = vmlaq_f32(higher1, fraction, vsubq_f32(vld1q_f32(gathered[3]), higher1));
+            float32x4_t sample = vmlaq_n_f32(sampleHigher, vsubq_f32(sampleLower, sampleHigher), tableFactor);
+            if (Accumulate)
+                vst1q_f32(destination + i, vmlaq_n_f32(vld1q_f32(destination + i), sample, amplitude));
+            else
+                vst1q_f32(destination + i, sample);
+        }
+#endif
+
+        for (; i < framesToProcess; ++i)
+        {
+            unsigned whole = static_cast<unsigned>(readIndices[i]);
+            float fraction = readIndices[i] - whole;
+            unsigned index1 = whole & mask;
+            unsigned index2 = (whole + 1) & mask;
+
+            float sampleLower = lower[index1] + fraction * (lower[index2] - lower[index1]);
+            float sampleHigher = higher[index1] + fraction * (higher[index2] - higher[index1]);
+            float sample = sampleHigher + tableFactor * (sampleLower - sampleHigher);
+            if (Accumulate)
+                destination[i] += amplitude * sample;
+            else
+                destination[i] = sample;
+        }
+    }
+}
+
+void waveTableReadIndices(double & phase, double increment, unsigned tableSize, float * readIndices, size_t framesToProcess)
+{
+    const double size = tableSize;
+    double p = wrapPhase(phase, size);
+    for (size_t i = 0; i < framesToProcess; ++i)
+    {
+        readIndices[i] = static_cast<float>(p);
+        p = wrapPhase(p + increment, size);
+    }
+    phase = p;
+}
+
+void waveTableReadIndices(double & phase, const float * increments, unsigned tableSize, float * readIndices, size_t framesToProcess)
+{
+    const double size = tableSize;
+    double p = wrapPhase(phase, size);
+    for (size_t i = 0; i < framesToProcess; ++i)
+    {
+        const float increment = increments[i];
+        readIndices[i] = static_cast<float>(p);
+        p = wrapPhase(p + increment, size);
+    }
+    phase = p;
+}
+
+void waveTableRead(const float * lower, const float * higher, float tableFactor, unsigned tableSize,
+                   const float * readIndices, float * destination, size_t framesToProcess)
+{
+    render<false>(lower, higher, tableFactor, tableSize, readIndices, 1.f, destination, framesToProcess);
+}
+
+void waveTableAccumulate(const float * lower, const float * higher, float tableFactor, unsigned tableSize,
+                         const float * readIndices, float amplitude, float * destination, size_t framesToProcess)
+{
+    render<true>(lower, higher, tableFactor, tableSize, readIndices, amplitude, destination, framesToProcess);
+}
+
+} // namespace lab
@@ -4,6 +4,15 @@
 
 #include "internal/ZeroPole.h"
 #include "internal/DenormalDisabler.h"
+#include "internal/FirstOrderFilter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define ZEROPOLE_LANES 1
+#elif defined(ARM_NEON_INTRINSICS)
+#include <arm_neon.h>
+#define ZEROPOLE_LANES 1
+#endif
 
 namespace lab 
 {
@@ -16,30 +25,87 @@ void ZeroPole::process(const float *source, float *destination, size_t framesToP
     // Gain compensation to make 0dB @ 0Hz
     const float k1 = 1 / (1 - zero);
     const float k2 = 1 - pole;
-    
-    // Member variables to locals.
-    float lastX = m_lastX;
-    float lastY = m_lastY;
 
-    while (framesToProcess--) 
-    {
-        float input = *source++;
+    FirstOrder::oneZero(source, destination, framesToProcess, k1, -k1 * zero, m_lastX);
+    FirstOrder::onePole(destination, destination, framesToProcess, pole, k2, m_lastY);
+}
+
+#ifdef ZEROPOLE_LANES
+
+namespace {
+
+// Four channels' filters, one to a lane, each with its own coefficients.
+#ifdef __SSE2__
+    typedef __m128 Lanes;
+    inline Lanes load(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+    inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+    inline void store(Lanes a, float* values) { _mm_storeu_ps(values, a); }
+#else
+    typedef float32x4_t Lanes;
+    inline Lanes load(float a, float b, float c, float d) { const float values[4] = { a, b, c, d }; return vld1q_f32(values); }
+    inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+    inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+    inline void store(Lanes a, float* values) { vst1q_f32(values, a); }
+#endif
+
+} // namespace
+
+void ZeroPole::processLanes(ZeroPole* const* filters, const float* const* sourceP, float* const* destP, size_t framesToProcess)
+{
+    const ZeroPole& f0 = *filters[0];
+    const ZeroPole& f1 = *filters[1];
+    const ZeroPole& f2 = *filters[2];
+    const ZeroPole& f3 = *filters[3];
+
+    const Lanes zero = load(f0.m_zero, f1.m_zero, f2.m_zero, f3.m_zero);
+    const Lanes pole = load(f0.m_pole, f1.m_pole, f2.m_pole, f3.m_pole);
+    const Lanes k1 = load(1 / (1 - f0.m_zero), 1 / (1 - f1.m_zero), 1 / (1 - f2.m_zero), 1 / (1 - f3.m_zero));
+    const Lanes k2 = load(1 - f0.m_pole, 1 - f1.m_pole, 1 - f2.m_pole, 1 - f3.m_pole);
 
-        // Zero
-        float output1 = k1 * (input - zero * lastX);
-        lastX = input;
+    Lanes lastX = load(f0.m_lastX, f1.m_lastX, f2.m_lastX, f3.m_lastX);
+    Lanes lastY = load(f0.m_lastY, f1.m_lastY, f2.m_lastY, f3.m_lastY);
 
-        // Pole
-        float output2 = k2 * output1 + pole * lastY;
-        lastY = output2;
+    float y[4];
+    for (size_t i = 0; i < framesToProcess; ++i) {
+        Lanes x = load(sourceP[0][i], sourceP[1][i], sourceP[2][i], sourceP[3][i]);
+        Lanes output1 = mul(k1, sub(x, mul(zero, lastX)));
+        lastX = x;
+        lastY = add(mul(k2, output1), mul(pole, lastY));
 
-        *destination++ = output2;
+        store(lastY, y);
+        destP[0][i] = y[0];
+        destP[1][i] = y[1];
+        destP[2][i] = y[2];
+        destP[3][i] = y[3];
     }
-    
-    // Locals to member variables. Flush denormals here so we don't
-    // slow down the inner loop above.
-    m_lastX = DenormalDisabler::flushDenormalFloatToZero(lastX);
-    m_lastY = DenormalDisabler::flushDenormalFloatToZero(lastY);
+
+    float x[4];
+    store(lastX, x);
+    store(lastY, y);
+    for (int lane = 0; lane < 4; ++lane) {
+        filters[lane]->m_lastX = DenormalDisabler::flushDenormalFloatToZero(x[lane]);
+        filters[lane]->m_lastY = DenormalDisabler::flushDenormalFloatToZero(y[lane]);
+    }
+}
+
+#endif
+
+void ZeroPole::process(ZeroPole* const* filters, const float* const* sourceP, float* const* destP, size_t channelCount, size_t framesToProcess)
+{
+    size_t channel = 0;
+
+#ifdef ZEROPOLE_LANES
+    // With four or more channels, four at a time run their recurrences together; a single channel's is vectorised
+    // over its frames instead.
+    for (; channel + 4 <= channelCount; channel += 4)
+        processLanes(filters + channel, sourceP + channel, destP + channel, framesToProcess);
+#endif
+
+    for (; channel < channelCount; ++channel)
+        filters[channel]->process(sourceP[channel], destP[channel], framesToProcess);
 }
 
 } // lab
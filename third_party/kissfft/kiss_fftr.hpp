@@ -38,6 +38,13 @@ void kiss_fftri(kiss_fftr_cfg cfg,const kiss_fft_cpx *freqdata,kiss_fft_scalar *
  output timedata has nfft scalar points
 */
 
+void kiss_fftr_work(kiss_fftr_cfg cfg,const kiss_fft_scalar *timedata,kiss_fft_cpx *freqdata,kiss_fft_cpx *work);
+void kiss_fftri_work(kiss_fftr_cfg cfg,const kiss_fft_cpx *freqdata,kiss_fft_scalar *timedata,kiss_fft_cpx *work);
+/*
+ As kiss_fftr and kiss_fftri, but using the caller's work buffer of nfft/2 complex points rather than
+ the one in cfg. The transforms then only read cfg, so a cfg can be shared by several threads.
+*/
+
 #define kiss_fftr_free free
 
 #ifdef __cplusplus
@@ -0,0 +1,242 @@
+// License: BSD 2 Clause
+// Copyright (C) 2015+, The LabSound Authors. All rights reserved.
+
+// LabSoundHRTFPack converts the IRCAM HRTF responses, one wav file per azimuth and elevation, into the packed
+// database HRTFDatabase maps at startup. A database is written for each sample rate, with every response
+// resampled to it and its leading delay already extracted, as IRC_<subject>_<rate>.hrtf next to the wav files.
+//
+// Usage: LabSoundHRTFPack [--subject name] [--sofa file.sofa] directory [sampleRate ...]
+//
+// The subject defaults to Composite, and the sample rates to 44100 and 48000.
+//
+// With --sofa, and when built with libmysofa (LABSOUND_MYSOFA_DIR), the responses are taken from a SOFA file, such
+// as a personalised measurement, rather than from the wav files, and the databases are written to the directory.
+// libmysofa resamples the file once for each sample rate, and each response of the 15 degree grid HRTFDatabase
+// reads is interpolated from the measured directions around it.
+
+#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
+    #define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "LabSound/core/AudioBus.h"
+#include "LabSound/extended/AudioFileReader.h"
+
+#include "internal/HRTFDatabaseFile.h"
+#include "internal/HRTFKernel.h"
+#include "internal/HRTFPanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(LABSOUND_MYSOFA)
+#include <mysofa.h>
+#endif
+
+using namespace lab;
+
+namespace
+{
+    bool fileExists(const std::string & path)
+    {
+        FILE * file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        fclose(file);
+        return true;
+    }
+
+    // The resource HRTFElevation loads for the azimuth and elevation, for example "IRC_Composite_C_R0195_T015_P000.wav".
+    std::string resourcePath(const std::string & directory, const std::string & subject, int azimuth, int elevation)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%03d_P%03d", azimuth, elevation < 0 ? elevation + 360 : elevation);
+        return directory + "/IRC_" + subject + "_C_R0195_T" + name + ".wav";
+    }
+
+    // Extracts the leading delay of one ear's response, and keeps the part the kernel convolves.
+    void prepareResponse(const AudioChannel * source, size_t fftSize, float & frameDelay, std::vector<float> & response)
+    {
+        AudioChannel channel(source->length());
+        channel.copyFrom(source);
+        frameDelay = HRTFKernel::extractAverageGroupDelay(&channel, fftSize / 2);
+        response.assign(channel.data(), channel.data() + fftSize / 2);
+    }
+
+    bool writeDatabase(const std::string & directory, const std::string & subject, float sampleRate, size_t fftSize,
+                       const std::vector<HRTFDatabaseFile::Response> & responses)
+    {
+        std::string path = HRTFDatabaseFile::pathForSubject(directory, subject, sampleRate);
+        if (!HRTFDatabaseFile::write(path, sampleRate, fftSize, fftSize / 2, responses))
+        {
+            fprintf(stderr, "Couldn't write %s\n", path.c_str());
+            return false;
+        }
+
+        printf("%s: %zu responses\n", path.c_str(), responses.size());
+        return true;
+    }
+
+#if defined(LABSOUND_MYSOFA)
+    bool packSofa(const std::string & sofaPath, const std::string & directory, const std::string & subject, float sampleRate)
+    {
+        const size_t fftSize = HRTFPanner::fftSizeForSampleRate(sampleRate);
+
+        int filterLength = 0;
+        int err = MYSOFA_OK;
+        MYSOFA_EASY * sofa = mysofa_open(sofaPath.c_str(), sampleRate, &filterLength, &err);
+        if (!sofa)
+        {
+            fprintf(stderr, "%s could not be read as a SOFA file (error %d)\n", sofaPath.c_str(), err);
+            return false;
+        }
+
+        // Padded to the part the kernel convolves, should the responses be shorter.
+        const size_t length = std::max(static_cast<size_t>(filterLength), fftSize / 2);
+        AudioChannel left(length);
+        AudioChannel right(length);
+
+        std::vector<HRTFDatabaseFile::Response> responses;
+        for (int azimuth = 0; azimuth < 360; azimuth += 15)
+        {
+            for (int elevation = -45; elevation <= 90; elevation += 15)
+            {
+                // SOFA's azimuths, like IRCAM's, run anticlockwise from straight ahead.
+                float position[3] = { static_cast<float>(azimuth), static_cast<float>(elevation), 1.f };
+                mysofa_s2c(position);
+
+                float delayL = 0;
+                float delayR = 0;
+                left.zero();
+                right.zero();
+                mysofa_getfilter_float(sofa, position[0], position[1], position[2], left.mutableData(), right.mutableData(), &delayL, &delayR);
+
+                // A file's delays, in seconds, are on top of any the responses hold.
+                HRTFDatabaseFile::Response response;
+                response.azimuth = azimuth;
+                response.elevation = elevation;
+                prepareResponse(&left, fftSize, response.frameDelayL, response.left);
+                prepareResponse(&right, fftSize, response.frameDelayR, response.right);
+                response.frameDelayL += delayL * sampleRate;
+                response.frameDelayR += delayR * sampleRate;
+                responses.push_back(std::move(response));
+            }
+        }
+
+        mysofa_close(sofa);
+        return writeDatabase(directory, subject, sampleRate, fftSize, responses);
+    }
+#endif
+
+    bool pack(const std::string & directory, const std::string & subject, float sampleRate)
+    {
+        const size_t fftSize = HRTFPanner::fftSizeForSampleRate(sampleRate);
+        std::vector<HRTFDatabaseFile::Response> responses;
+
+        for (int azimuth = 0; azimuth < 360; azimuth += 15)
+        {
+            for (int elevation = -45; elevation <= 90; elevation += 15)
+            {
+                // The measured elevations vary with the azimuth.
+                std::string path = resourcePath(directory, subject, azimuth, elevation);
+                if (!fileExists(path))
+                    continue;
+
+                std::shared_ptr<AudioBus> bus = MakeBusFromFile(path, false);
+                if (!bus || bus->numberOfChannels() != 2)
+                {
+                    fprintf(stderr, "%s is not a stereo response\n", path.c_str());
+                    return false;
+                }
+
+                if (bus->sampleRate() != sampleRate)
+                    bus = AudioBus::createBySampleRateConverting(bus.get(), false, sampleRate);
+
+                if (!bus || bus->length() < fftSize / 2)
+                {
+                    fprintf(stderr, "%s is too short for %d Hz\n", path.c_str(), static_cast<int>(sampleRate));
+                    return false;
+                }
+
+                HRTFDatabaseFile::Response response;
+                response.azimuth = azimuth;
+                response.elevation = elevation;
+                prepareResponse(bus->channelByType(Channel::Left), fftSize, response.frameDelayL, response.left);
+                prepareResponse(bus->channelByType(Channel::Right), fftSize, response.frameDelayR, response.right);
+                responses.push_back(std::move(response));
+            }
+        }
+
+        if (responses.empty())
+        {
+            fprintf(stderr, "No responses of subject %s were found in %s\n", subject.c_str(), directory.c_str());
+            return false;
+        }
+
+        return writeDatabase(directory, subject, sampleRate, fftSize, responses);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    std::string subject = "Composite";
+    std::string directory;
+    std::string sofaPath;
+    std::vector<float> sampleRates;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--subject") && i + 1 < argc)
+            subject = argv[++i];
+        else if (!strcmp(argv[i], "--sofa") && i + 1 < argc)
+            sofaPath = argv[++i];
+        else if (directory.empty())
+            directory = argv[i];
+        else
+            sampleRates.push_back(static_cast<float>(atof(argv[i])));
+    }
+
+    if (directory.empty())
+    {
+        fprintf(stderr, "Usage: LabSoundHRTFPack [--subject name] [--sofa file.sofa] directory [sampleRate ...]\n");
+        return EXIT_FAILURE;
+    }
+
+#if !defined(LABSOUND_MYSOFA)
+    if (!sofaPath.empty())
+    {
+        fprintf(stderr, "SOFA files need LabSoundHRTFPack built with libmysofa, see LABSOUND_MYSOFA_DIR\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    if (sampleRates.empty())
+        sampleRates = { 44100, 48000 };
+
+    for (float sampleRate : sampleRates)
+    {
+        // The range of sample rates the HRTF panner supports.
+        if (sampleRate < 44100 || sampleRate > 96000)
+        {
+            fprintf(stderr, "%g Hz is not between 44100 and 96000 Hz\n", sampleRate);
+            return EXIT_FAILURE;
+        }
+
+#if defined(LABSOUND_MYSOFA)
+        if (!sofaPath.empty())
+        {
+            if (!packSofa(sofaPath, directory, subject, sampleRate))
+                return EXIT_FAILURE;
+            continue;
+        }
+#endif
+
+        if (!pack(directory, subject, sampleRate))
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}